@@ -62,6 +62,8 @@ public:
 
   virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
   virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+  virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const;
+  virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm, double max_distance) const;
   virtual double distanceWorld(const CollisionWorld &world) const;
   virtual double distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const;
 };
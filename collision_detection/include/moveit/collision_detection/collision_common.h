@@ -39,6 +39,7 @@
 
 #include <boost/array.hpp>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <vector>
 #include <string>
 #include <map>
@@ -73,6 +74,10 @@ namespace collision_detection
   {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+    Contact() : body_handle_1(0), body_handle_2(0)
+    {
+    }
+
     /** \brief contact position */
     Eigen::Vector3d pos;
 
@@ -93,6 +98,85 @@ namespace collision_detection
 
     /** \brief The type of the second body involved in the contact */
     BodyType        body_type_2;
+
+    /** \brief The handle of the first body in its world (see World::ObjectHandle), if it is a world object; 0 otherwise */
+    std::size_t     body_handle_1;
+
+    /** \brief The handle of the second body in its world (see World::ObjectHandle), if it is a world object; 0 otherwise */
+    std::size_t     body_handle_2;
+  };
+
+  /** \brief A contact point stored without copying the names of the bodies involved (see CollisionRequest::compact_contacts).
+      The names are shared with the other contacts of the same result (see CollisionResult::internBodyName()), so they stay
+      valid as long as the contact does, independently of the bodies. */
+  struct CompactContact
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    CompactContact() : depth(0.0), body_handle_1(0), body_handle_2(0)
+    {
+    }
+
+    /** \brief Get the id of the first body involved in the contact */
+    const std::string& getBodyName1() const
+    {
+      return *body_name_ptr_1;
+    }
+
+    /** \brief Get the id of the second body involved in the contact */
+    const std::string& getBodyName2() const
+    {
+      return *body_name_ptr_2;
+    }
+
+    /** \brief Check if this contact is between the bodies whose interned names are \e name1 and \e name2 (in either order);
+        the names are compared by address, so they need to come from the result that holds this contact */
+    bool isBetween(const std::string *name1, const std::string *name2) const
+    {
+      return (body_name_ptr_1.get() == name1 && body_name_ptr_2.get() == name2) ||
+        (body_name_ptr_1.get() == name2 && body_name_ptr_2.get() == name1);
+    }
+
+    /** \brief Copy this contact into a full Contact (the body names are copied) */
+    void toContact(Contact &c) const
+    {
+      c.pos = pos;
+      c.normal = normal;
+      c.depth = depth;
+      c.body_name_1 = *body_name_ptr_1;
+      c.body_type_1 = body_type_1;
+      c.body_handle_1 = body_handle_1;
+      c.body_name_2 = *body_name_ptr_2;
+      c.body_type_2 = body_type_2;
+      c.body_handle_2 = body_handle_2;
+    }
+
+    /** \brief contact position */
+    Eigen::Vector3d    pos;
+
+    /** \brief normal unit vector at contact */
+    Eigen::Vector3d    normal;
+
+    /** \brief depth (penetration between bodies) */
+    double             depth;
+
+    /** \brief The id of the first body, interned by the result that holds the contact; the pointer identifies the body */
+    boost::shared_ptr<const std::string> body_name_ptr_1;
+
+    /** \brief The id of the second body, interned by the result that holds the contact; the pointer identifies the body */
+    boost::shared_ptr<const std::string> body_name_ptr_2;
+
+    /** \brief The type of the first body involved in the contact */
+    BodyType           body_type_1;
+
+    /** \brief The type of the second body involved in the contact */
+    BodyType           body_type_2;
+
+    /** \brief The handle of the first body in its world (see World::ObjectHandle), if it is a world object; 0 otherwise */
+    std::size_t        body_handle_1;
+
+    /** \brief The handle of the second body in its world (see World::ObjectHandle), if it is a world object; 0 otherwise */
+    std::size_t        body_handle_2;
   };
 
   /** \brief When collision costs are computed, this structure contains information about the partial cost incurred in a particular volume */
@@ -135,6 +219,7 @@ namespace collision_detection
   {
     CollisionResult() : collision(false),
                         distance(std::numeric_limits<double>::max()),
+                        time_of_contact(1.0),
                         contact_count(0)
     {
     }
@@ -147,23 +232,67 @@ namespace collision_detection
     {
       collision = false;
       distance = std::numeric_limits<double>::max();
+      time_of_contact = 1.0;
       contact_count = 0;
       contacts.clear();
+      compact_contacts.clear();
+      body_names.clear();
       cost_sources.clear();
     }
 
+    /** \brief Get the copy of \e name shared by the compact contacts of this result, creating it if needed. Each name is
+        copied once per result, however many contacts refer to it, and copies of the result share the same strings. */
+    const boost::shared_ptr<const std::string>& internBodyName(const std::string &name)
+    {
+      boost::shared_ptr<const std::string> &interned = body_names[name];
+      if (!interned)
+        interned.reset(new std::string(name));
+      return interned;
+    }
+
+    /** \brief Get the interned copy of \e name (see internBodyName()), or NULL if no compact contact refers to \e name */
+    const std::string* findBodyName(const std::string &name) const
+    {
+      std::map<std::string, boost::shared_ptr<const std::string> >::const_iterator it = body_names.find(name);
+      return it != body_names.end() ? it->second.get() : NULL;
+    }
+
+    /** \brief Get the contacts stored in \e compact_contacts in the form of \e contacts (this copies the body names) */
+    void getContactMap(ContactMap &contact_map) const
+    {
+      contact_map = contacts;
+      for (std::size_t i = 0 ; i < compact_contacts.size() ; ++i)
+      {
+        Contact c;
+        compact_contacts[i].toContact(c);
+        if (c.body_name_1 < c.body_name_2)
+          contact_map[std::make_pair(c.body_name_1, c.body_name_2)].push_back(c);
+        else
+          contact_map[std::make_pair(c.body_name_2, c.body_name_1)].push_back(c);
+      }
+    }
+
     /** \brief True if collision was found, false otherwise */
     bool                 collision;
 
     /** \brief Closest distance between two bodies */
     double               distance;
 
+    /** \brief For continuous checks, the earliest time of contact along the motion (between 0 and 1), if a collision was found */
+    double               time_of_contact;
+
     /** \brief Number of contacts returned */
     std::size_t          contact_count;
 
     /** \brief A map returning the pairs of ids of the bodies in contact, plus information about the contacts themselves */
     ContactMap           contacts;
 
+    /** \brief The contacts, if they were requested in compact form (see CollisionRequest::compact_contacts) */
+    std::vector<CompactContact> compact_contacts;
+
+    /** \brief The names referred to by \e compact_contacts (see internBodyName()) */
+    std::map<std::string, boost::shared_ptr<const std::string> > body_names;
+
     /** \brief When costs are computed, the individual cost sources are  */
     std::set<CostSource> cost_sources;
   };
@@ -176,6 +305,8 @@ namespace collision_detection
                          contacts(false),
                          max_contacts(1),
                          max_contacts_per_pair(1),
+                         compact_contacts(false),
+                         deepest_contact_only(false),
                          max_cost_sources(1),
                          min_cost_density(0.2),
                          verbose(false)
@@ -201,6 +332,14 @@ namespace collision_detection
     /** \brief Maximum number of contacts to compute per pair of bodies (multiple bodies may be in contact at different configurations) */
     std::size_t max_contacts_per_pair;
 
+    /** \brief If true, contacts are stored in CollisionResult::compact_contacts, which copies the name of each body once per result instead of once per contact,
+        rather than in CollisionResult::contacts. Detectors that do not support this fill CollisionResult::contacts instead;
+        CollisionResult::getContactMap() returns the contacts in either case. */
+    bool        compact_contacts;
+
+    /** \brief If true, only the deepest contact of each pair of bodies is reported (\e max_contacts_per_pair is then taken to be 1) */
+    bool        deepest_contact_only;
+
     /** \brief When costs are computed, this value defines how many of the top cost sources should be returned */
     std::size_t max_cost_sources;
 
@@ -215,6 +354,84 @@ namespace collision_detection
     bool        verbose;
   };
 
+  /** \brief Representation of a request for the distances between pairs of bodies */
+  struct DistanceRequest
+  {
+    DistanceRequest() : max_pairs(1),
+                        max_distance(std::numeric_limits<double>::max()),
+                        enable_nearest_points(true),
+                        verbose(false)
+    {
+    }
+
+    /** \brief The group name to compute distances for (optional; if empty, assume the complete robot) */
+    std::string group_name;
+
+    /** \brief The number of pairs of bodies to report; the pairs with the smallest distances are kept (0 reports all pairs within \e max_distance) */
+    std::size_t max_pairs;
+
+    /** \brief Pairs of bodies farther apart than this distance are not reported (and are pruned early by the broad phase) */
+    double      max_distance;
+
+    /** \brief If true, the nearest points and the normal are computed for every pair that is reported */
+    bool        enable_nearest_points;
+
+    /** \brief Flag indicating whether information about the computed distances should be reported */
+    bool        verbose;
+  };
+
+  /** \brief The distance between a pair of bodies, as reported by a distance query */
+  struct DistancePair
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /** \brief The distance between the bodies. For bodies in collision, this is minus the depth of their deepest
+        contact (0 if the depth can not be computed, e.g., for touching bodies) */
+    double          distance;
+
+    /** \brief The nearest point on the first body (the deepest contact point if the bodies are in collision) */
+    Eigen::Vector3d nearest_point_1;
+
+    /** \brief The nearest point on the second body (the deepest contact point if the bodies are in collision) */
+    Eigen::Vector3d nearest_point_2;
+
+    /** \brief Unit vector pointing from the first body towards the second, so in both cases moving the second body along
+        it increases the distance. For separated bodies this is the direction from \e nearest_point_1 to \e nearest_point_2;
+        for bodies in collision it is the normal of the deepest contact. Zero if undefined. */
+    Eigen::Vector3d normal;
+
+    /** \brief The id of the first body */
+    std::string     body_name_1;
+
+    /** \brief The type of the first body */
+    BodyType        body_type_1;
+
+    /** \brief The id of the second body */
+    std::string     body_name_2;
+
+    /** \brief The type of the second body */
+    BodyType        body_type_2;
+  };
+
+  /** \brief Representation of the result of a distance query */
+  struct DistanceResult
+  {
+    /** \brief Clear a previously stored result */
+    void clear()
+    {
+      pairs.clear();
+    }
+
+    /** \brief Get the smallest distance found (or the largest double if no pair was reported) */
+    double getMinimumDistance() const
+    {
+      return pairs.empty() ? std::numeric_limits<double>::max() : pairs.front().distance;
+    }
+
+    /** \brief The pairs of bodies that were reported, one entry per pair, in increasing order of distance */
+    std::vector<DistancePair> pairs;
+  };
+
 }
 
 #endif
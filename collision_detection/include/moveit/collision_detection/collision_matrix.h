@@ -92,6 +92,9 @@ namespace collision_detection
     /** @brief Copy constructor */
     AllowedCollisionMatrix(const AllowedCollisionMatrix& acm);
 
+    /** @brief Copy the entries of \e acm */
+    AllowedCollisionMatrix& operator=(const AllowedCollisionMatrix& acm);
+
     /** @brief Get the type of the allowed collision between two elements. Return true if the entry is included in the collision matrix.
      * Return false if the entry is not found.
      *  @param name1 name of first element
@@ -233,6 +236,18 @@ namespace collision_detection
     /** @brief Print the allowed collision matrix */
     void print(std::ostream& out) const;
 
+    /** @brief Get a number that identifies this instance (each instance, including copies, gets a distinct one) */
+    std::size_t getInstanceID() const
+    {
+      return instance_id_;
+    }
+
+    /** @brief Get a number that changes every time the content of the matrix is modified */
+    std::size_t getVersion() const
+    {
+      return version_;
+    }
+
   private:
 
     std::map<std::string, std::map<std::string, AllowedCollision::Type> > entries_;
@@ -241,6 +256,60 @@ namespace collision_detection
     std::map<std::string, AllowedCollision::Type>                         default_entries_;
     std::map<std::string, DecideContactFn>                                default_allowed_contacts_;
 
+    std::size_t                                                           instance_id_;
+    std::size_t                                                           version_;
+  };
+
+  /** @class CompiledAllowedCollisionMatrix
+   *  @brief A dense representation of the entries of an AllowedCollisionMatrix for a fixed list of names, so that elements
+   *   can be referred to by their index in that list. For every pair, the result of AllowedCollisionMatrix::getAllowedCollision()
+   *   is stored in two bits; the predicates of AllowedCollision::CONDITIONAL pairs are kept separately. */
+  class CompiledAllowedCollisionMatrix
+  {
+  public:
+
+    CompiledAllowedCollisionMatrix();
+
+    /** @brief Build the lookup table for all pairs of \e names, reading the entries of \e acm */
+    void compile(const AllowedCollisionMatrix &acm, const std::vector<std::string> &names);
+
+    /** @brief Check if the lookup table was built from \e acm, and \e acm was not modified since */
+    bool isCompiledFrom(const AllowedCollisionMatrix &acm) const
+    {
+      return compiled_ && acm_instance_id_ == acm.getInstanceID() && acm_version_ == acm.getVersion();
+    }
+
+    /** @brief Get the number of names the lookup table was built for */
+    std::size_t getSize() const
+    {
+      return size_;
+    }
+
+    /** @brief Equivalent of AllowedCollisionMatrix::getAllowedCollision() for the elements at index \e i and \e j in the list of names
+     *  passed to compile(). Return false if the pair is not included in the collision matrix. */
+    bool getAllowedCollision(std::size_t i, std::size_t j, AllowedCollision::Type& allowed_collision) const
+    {
+      const std::size_t k = i * size_ + j;
+      const unsigned char code = (bits_[k >> 2] >> ((k & 3) << 1)) & 3;
+      if (code == 0)
+        return false;
+      allowed_collision = (AllowedCollision::Type)(code - 1);
+      return true;
+    }
+
+    /** @brief Equivalent of AllowedCollisionMatrix::getAllowedCollision() for the predicate of the elements at index \e i and \e j in the
+     *  list of names passed to compile(). Return false if no predicate is known for the pair. */
+    bool getAllowedCollision(std::size_t i, std::size_t j, DecideContactFn &fn) const;
+
+  private:
+
+    std::size_t                                                           size_;
+    std::vector<unsigned char>                                            bits_;
+    std::map<std::pair<std::size_t, std::size_t>, DecideContactFn>        allowed_contacts_;
+
+    bool                                                                  compiled_;
+    std::size_t                                                           acm_instance_id_;
+    std::size_t                                                           acm_version_;
   };
 
   typedef boost::shared_ptr<AllowedCollisionMatrix> AllowedCollisionMatrixPtr;
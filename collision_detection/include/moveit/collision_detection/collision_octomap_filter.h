@@ -58,6 +58,7 @@ namespace collision_detection
  *  @param Whether to request a depth estimate from the algorithm (experimental...)
  *  @param The iso-surface threshold value (0.5 is a reasonable default).
  *  @param The metaball radius, as a multiple of the octomap cell size (1.5 is a reasonable default)
+ *  @param The number of threads the contacts are split between
  */
 int refineContactNormals(const World::ObjectConstPtr& object,
                          CollisionResult &res,
@@ -65,7 +66,8 @@ int refineContactNormals(const World::ObjectConstPtr& object,
                          double allowed_angle_divergence = 0.0,
                          bool estimate_depth = false,
                          double iso_value = 0.5,
-                         double metaball_radius_multiple = 1.5);
+                         double metaball_radius_multiple = 1.5,
+                         unsigned int threads = 1);
 
 }
 
@@ -98,6 +98,24 @@ namespace collision_detection
      *  @param acm The allowed collision matrix. */
     virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const = 0;
 
+    /** \brief Check a batch of states for self collision. Any collision between any pair of links is checked for,
+     *  NO collisions are ignored. \e res is resized to the number of states and the result for state \e i is added to \e res[i];
+     *  states for which \e res[i] already reports a collision (and no more contacts are needed) are skipped.
+     *  The default implementation checks one state at a time.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The CollisionResult objects for the states
+     *  @param states The kinematic states for which checks are being made */
+    virtual void checkSelfCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const std::vector<const robot_state::RobotState*> &states) const;
+
+    /** \brief Check a batch of states for self collision, as checkSelfCollisionBatch() above. Allowed collisions specified by the
+     *  allowed collision matrix are taken into account.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The CollisionResult objects for the states
+     *  @param states The kinematic states for which checks are being made
+     *  @param acm The allowed collision matrix. */
+    virtual void checkSelfCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const std::vector<const robot_state::RobotState*> &states,
+                                         const AllowedCollisionMatrix &acm) const;
+
     /** \brief Check for collision with a different robot (possibly a different kinematic model as well).
      *  Any collision between any pair of links is checked for, NO collisions are ignored.
      *  @param req A CollisionRequest object that encapsulates the collision request
@@ -235,6 +253,10 @@ namespace collision_detection
     /** @brief Get the link scaling as a vector of messages*/
     void getScale(std::vector<moveit_msgs::LinkScale> &scale) const;
 
+    /** @brief Get an estimate of the memory held by this collision model (e.g., the collision geometry of the links), in bytes.
+        The default implementation counts the padding and scaling maps only. */
+    virtual std::size_t getMemoryUsage() const;
+
   protected:
 
     /** @brief When the scale or padding is changed for a set of links by any of the functions in this class, updatedPaddingOrScaling() function is called.
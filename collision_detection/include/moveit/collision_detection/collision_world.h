@@ -92,6 +92,23 @@ namespace collision_detection
                                 const robot_state::RobotState &state,
                                 const AllowedCollisionMatrix &acm) const;
 
+    /** \brief Check whether the robot model is in collision with the world or with itself at a particular state, using
+     *  \e robot for the check with the world and \e self_robot (typically the same robot, without padding) for self collisions.
+     *  The check with the world is done first; self collisions are checked only if that check is not done yet.
+     *  Allowed collisions specified by the allowed collision matrix are taken into account.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res A CollisionResult object that encapsulates the collision result
+     *  @param robot The collision model for the robot, used for the check with the world
+     *  @param self_robot The collision model for the robot, used for the self collision check
+     *  @param state The kinematic state for which checks are being made
+     *  @param acm The allowed collision matrix. */
+    virtual void checkCollision(const CollisionRequest &req,
+                                CollisionResult &res,
+                                const CollisionRobot &robot,
+                                const CollisionRobot &self_robot,
+                                const robot_state::RobotState &state,
+                                const AllowedCollisionMatrix &acm) const;
+
     /** \brief Check whether the robot model is in collision with itself or the world in a continuous manner
      *  (between two robot states)
      *  Any collision between any pair of links is checked for, NO collisions are ignored.
@@ -120,6 +137,29 @@ namespace collision_detection
                                 const robot_state::RobotState &state2,
                                 const AllowedCollisionMatrix &acm) const;
 
+    /** \brief Check a batch of states for collision of the robot model with itself or the world. \e res is cleared and resized
+     *  to the number of states; the result for state \e i is stored in \e res[i].
+     *  Any collision between any pair of links is checked for, NO collisions are ignored.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The CollisionResult objects for the states
+     *  @param states The kinematic states for which checks are being made */
+    virtual void checkCollisionBatch(const CollisionRequest &req,
+                                     std::vector<CollisionResult> &res,
+                                     const CollisionRobot &robot,
+                                     const std::vector<const robot_state::RobotState*> &states) const;
+
+    /** \brief Check a batch of states for collision of the robot model with itself or the world, as checkCollisionBatch() above.
+     *  Allowed collisions specified by the allowed collision matrix are taken into account.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The CollisionResult objects for the states
+     *  @param states The kinematic states for which checks are being made
+     *  @param acm The allowed collision matrix. */
+    virtual void checkCollisionBatch(const CollisionRequest &req,
+                                     std::vector<CollisionResult> &res,
+                                     const CollisionRobot &robot,
+                                     const std::vector<const robot_state::RobotState*> &states,
+                                     const AllowedCollisionMatrix &acm) const;
+
     /** \brief Check whether the robot model is in collision with the world. Any collisions between a robot link
      *  and the world are considered. Self collisions are not checked.
      *  @param req A CollisionRequest object that encapsulates the collision request
@@ -173,6 +213,31 @@ namespace collision_detection
                                      const robot_state::RobotState &state2,
                                      const AllowedCollisionMatrix &acm) const = 0;
 
+    /** \brief Check a batch of states for collision of the robot model with the world. Self collisions are not checked.
+     *  \e res is resized to the number of states and the result for state \e i is added to \e res[i]; states for which \e res[i]
+     *  already reports a collision (and no more contacts are needed) are skipped. The default implementation checks one state at a time.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The CollisionResult objects for the states
+     *  @param robot The collision model for the robot
+     *  @param states The kinematic states for which checks are being made */
+    virtual void checkRobotCollisionBatch(const CollisionRequest &req,
+                                          std::vector<CollisionResult> &res,
+                                          const CollisionRobot &robot,
+                                          const std::vector<const robot_state::RobotState*> &states) const;
+
+    /** \brief Check a batch of states for collision of the robot model with the world, as checkRobotCollisionBatch() above.
+     *  Allowed collisions specified by the allowed collision matrix are taken into account.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The CollisionResult objects for the states
+     *  @param robot The collision model for the robot
+     *  @param states The kinematic states for which checks are being made
+     *  @param acm The allowed collision matrix. */
+    virtual void checkRobotCollisionBatch(const CollisionRequest &req,
+                                          std::vector<CollisionResult> &res,
+                                          const CollisionRobot &robot,
+                                          const std::vector<const robot_state::RobotState*> &states,
+                                          const AllowedCollisionMatrix &acm) const;
+
     /** \brief Check whether a given set of objects is in collision with objects from another world.
      *  Any contacts are considered.
      *  @param req A CollisionRequest object that encapsulates the collision request
@@ -208,6 +273,26 @@ namespace collision_detection
                                  const robot_state::RobotState &state,
                                  const AllowedCollisionMatrix &acm) const = 0;
 
+    /** \brief Compute the distance between a robot and the world, but only as precisely as needed to compare it to \e max_distance:
+     *  if no pair of bodies is closer than \e max_distance, \e max_distance is returned; otherwise, the distance of some pair closer
+     *  than \e max_distance is returned (not necessarily the shortest one). The default implementation computes the shortest distance.
+     *  @param robot The robot to check distance for
+     *  @param state The state for the robot to check distances from
+     *  @param max_distance The distance to compare against */
+    virtual double distanceRobot(const CollisionRobot &robot,
+                                 const robot_state::RobotState &state,
+                                 double max_distance) const;
+
+    /** \brief Compute the distance between a robot and the world, compared to \e max_distance as above
+     *  @param robot The robot to check distance for
+     *  @param state The state for the robot to check distances from
+     *  @param acm Using an allowed collision matrix has the effect of ignoring distances from links that are always allowed to be in collision.
+     *  @param max_distance The distance to compare against */
+    virtual double distanceRobot(const CollisionRobot &robot,
+                                 const robot_state::RobotState &state,
+                                 const AllowedCollisionMatrix &acm,
+                                 double max_distance) const;
+
     /** \brief The shortest distance to another world instance (\e world) */
     virtual double distanceWorld(const CollisionWorld &world) const = 0;
 
@@ -219,6 +304,31 @@ namespace collision_detection
      * Passing NULL will result in a new empty world being created. */
     virtual void setWorld(const WorldPtr& world);
 
+    /** \brief Build the data structures this collision world needs for \e shape ahead of time, so adding an object with
+        this shape to the world later is cheaper. This may be called from any thread. The default implementation does nothing. */
+    virtual void prepareShape(const shapes::ShapeConstPtr &shape) const;
+
+    /** \brief Get an estimate of the memory held by the data structures this collision world maintains for the world
+        objects (collision geometry, broad-phase structures), in bytes. The objects of the world are not counted. The default
+        implementation returns the size of the instance only. */
+    virtual std::size_t getMemoryUsage() const;
+
+    /** \brief Get the ids (sorted) of the world objects that have a shape intersecting the axis-aligned box between
+        \e min_corner and \e max_corner. The default implementation visits every object and compares the bounding sphere
+        of each shape to the box, so it may also report objects that are only close to the box; collision detectors with
+        a broad-phase structure override it with an exact and faster query. */
+    virtual void getObjectsInBox(const Eigen::Vector3d &min_corner, const Eigen::Vector3d &max_corner, std::vector<std::string> &ids) const;
+
+    /** \brief Get the ids (sorted) of the world objects that have a shape within \e radius of \e center. The default
+        implementation is conservative in the same way as getObjectsInBox(). */
+    virtual void getObjectsInSphere(const Eigen::Vector3d &center, double radius, std::vector<std::string> &ids) const;
+
+    /** \brief Find the first world object hit by the ray from \e origin along \e direction, up to \e max_distance.
+        On success, \e id is the id of the object and \e distance the distance from \e origin to the hit. Shapes that do not
+        have a volume (planes, octrees) are not hit. Return false if no object is hit. */
+    virtual bool castRay(const Eigen::Vector3d &origin, const Eigen::Vector3d &direction, double max_distance,
+                         std::string &id, double &distance) const;
+
     /** access the world geometry */
     const WorldPtr& getWorld()
     {
@@ -234,6 +344,12 @@ namespace collision_detection
     typedef World::ObjectPtr ObjectPtr;
     typedef World::ObjectConstPtr ObjectConstPtr;
 
+  protected:
+
+    /** \brief Intersect the ray from \e origin along the unit vector \e dir with the shapes of \e obj. Return true and
+        lower \e distance to the distance of the hit if the ray hits the object closer than \e distance. */
+    static bool castRayOnObject(const World::Object &obj, const Eigen::Vector3d &origin, const Eigen::Vector3d &dir, double &distance);
+
   private:
     WorldPtr      world_;       // The world.  Always valid.  Never NULL.
     WorldConstPtr world_const_; // always same as world_
@@ -42,6 +42,8 @@
 #include <map>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
 #include <Eigen/Geometry>
 #include <eigen_stl_containers/eigen_stl_vector_container.h>
 #include <geometric_shapes/shapes.h>
@@ -68,21 +70,32 @@ namespace collision_detection
     /* Collision Bodies                                                   */
     /**********************************************************************/
 
+    /** \brief A number that identifies an object; it does not change while the object exists, and it is
+     * never reused for other objects. 0 is not a valid handle. */
+    typedef std::size_t ObjectHandle;
+
     /** \brief A representation of an object */
     struct Object
     {
-      Object(const std::string &id) : id_(id) {}
+      Object(const std::string &id) : id_(id), handle_(0), version_(0) {}
 
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
       /** \brief The id for this object */
       std::string                         id_;
 
+      /** \brief The handle of this object, assigned when the object is created in a world. Copies of the world share it. */
+      ObjectHandle                        handle_;
+
       /** \brief An array of shapes */
       std::vector<shapes::ShapeConstPtr> shapes_;
 
       /** \brief An array of shape poses */
       EigenSTL::vector_Affine3d          shape_poses_;
+
+      /** \brief A number that changes every time the object is changed. Numbers are never reused across objects,
+       * so two objects with the same id and version (e.g. in copies of a world) have the same shapes and poses */
+      std::size_t                        version_;
     };
 
     typedef boost::shared_ptr<Object> ObjectPtr;
@@ -94,6 +107,12 @@ namespace collision_detection
     /** \brief Get a particular object */
     ObjectConstPtr getObject(const std::string &id) const;
 
+    /** \brief Get the object with handle \e handle (NULL if there is no such object in this world) */
+    ObjectConstPtr getObject(ObjectHandle handle) const;
+
+    /** \brief Get the handle of the object named \e id (0 if there is no such object) */
+    ObjectHandle getObjectHandle(const std::string &id) const;
+
     /** iterator over the objects in the world. */
     typedef std::map<std::string, ObjectConstPtr>::const_iterator const_iterator;
     /** iterator pointing to first change */
@@ -114,7 +133,8 @@ namespace collision_detection
     /** find changes for a named object */
     const_iterator find(const std::string& id) const
     {
-      return objects_.find(id);
+      IdIndex::const_iterator it = id_index_.find(id);
+      return it == id_index_.end() ? objects_.end() : const_iterator(it->second);
     }
 
 
@@ -144,6 +164,19 @@ namespace collision_detection
                            const shapes::ShapeConstPtr &shape,
                            const Eigen::Affine3d &pose);
 
+    /** \brief Notify observers that the data of a shape in an object was changed in place
+     * (e.g., cells of an octree were updated), while the shape kept its pointer and pose.
+     * Observers can then update what they derived from the shape instead of rebuilding it.
+     * Shape equality is verified by comparing pointers. Returns true on success. */
+    bool updateShapeInObject(const std::string &id,
+                             const shapes::ShapeConstPtr &shape);
+
+    /** \brief Update the pose of a shape in the object with handle \e handle.
+     * This avoids looking the object up by name. Returns true on success. */
+    bool moveShapeInObject(ObjectHandle handle,
+                           const shapes::ShapeConstPtr &shape,
+                           const Eigen::Affine3d &pose);
+
     /** \brief Remove shape from object.
      * Shape equality is verified by comparing pointers. Ownership of the
      * object is renounced (i.e. object is deleted if no external references
@@ -172,11 +205,14 @@ namespace collision_detection
       MOVE_SHAPE = 4,     /** one or more shapes in object were moved */
       ADD_SHAPE = 8,      /** shape(s) were added to object */
       REMOVE_SHAPE = 16,  /** shape(s) were removed from object */
+      UPDATE_SHAPE = 32,  /** the data of shape(s) in object was changed in place */
     };
 
     /** \brief Represents an action that occurred on an object in the world.
      * Several bits may be set indicating several things happened to the object.
-     * If the DESTROY bit is set, other bits will not be set. */
+     * If the DESTROY bit is set, other bits will not be set, unless the
+     * notification combines the changes of an update batch (see beginUpdate())
+     * in which the object was destroyed and created again. */
     class Action
     {
     public:
@@ -215,11 +251,27 @@ namespace collision_detection
      * Used which switching from one world to another. */
     void notifyObserverAllObjects(const ObserverHandle observer_handle, Action action) const;
 
+    /** \brief Start a batch of changes. Until the matching call to endUpdate(),
+     * observers are not notified; the changes to each object are combined
+     * instead, and the observers receive one notification per changed object
+     * at the end of the batch. Batches can be nested; only the outermost one
+     * notifies the observers. */
+    void beginUpdate();
+
+    /** \brief End a batch of changes started by beginUpdate() */
+    void endUpdate();
+
   private:
 
+    /* not implemented: the indices refer to the entries of objects_, so a world cannot be assigned this way */
+    World& operator=(const World &other);
+
     /** notify all observers of a change */
     void notify(const ObjectConstPtr&, Action);
 
+    /** notify observers of a change, right away */
+    void notifyObservers(const ObjectConstPtr&, Action);
+
     /** send notification of change to all objects. */
     void notifyAll(Action action);
 
@@ -234,10 +286,28 @@ namespace collision_detection
                                      const shapes::ShapeConstPtr &shape,
                                      const Eigen::Affine3d &pose);
 
+    typedef std::map<std::string, ObjectPtr>::iterator ObjectIterator;
+
+    /* Get the object named \e id, creating it (and setting \e created) if it does not exist */
+    ObjectPtr& getOrCreateObject(const std::string &id, bool &created);
+
+    /* Remove an object from the map and the indices */
+    void eraseObject(ObjectIterator it);
+
+    /* Move a shape of the object at \e it */
+    bool moveShapeInObject(ObjectIterator it,
+                           const shapes::ShapeConstPtr &shape,
+                           const Eigen::Affine3d &pose);
 
     /** The objects maintained in the world */
     std::map<std::string, ObjectPtr> objects_;
 
+    /* the entries of objects_, indexed by id and by handle */
+    typedef boost::unordered_map<std::string, ObjectIterator> IdIndex;
+    typedef boost::unordered_map<ObjectHandle, ObjectIterator> HandleIndex;
+    IdIndex                          id_index_;
+    HandleIndex                      handle_index_;
+
     /* observers to call when something changes */
     class Observer
     {
@@ -249,11 +319,42 @@ namespace collision_detection
     };
     std::vector<Observer*> observers_;
 
+    /* the combined changes to an object during an update batch */
+    struct PendingChange
+    {
+      PendingChange() : action_(UNINITIALIZED) {}
+      ObjectConstPtr obj_;
+      int            action_;
+    };
+
+    /* the number of nested update batches, and the changes made during them */
+    unsigned int                         update_depth_;
+    std::map<std::string, PendingChange> pending_changes_;
+
   };
 
   typedef boost::shared_ptr<World> WorldPtr;
   typedef boost::shared_ptr<const World> WorldConstPtr;
 
+  /** \brief Combines the changes made to a world during the lifetime of this
+   * object into one update batch (see World::beginUpdate()) */
+  class WorldUpdateBatch : private boost::noncopyable
+  {
+  public:
+    WorldUpdateBatch(World &world) : world_(world)
+    {
+      world_.beginUpdate();
+    }
+
+    ~WorldUpdateBatch()
+    {
+      world_.endUpdate();
+    }
+
+  private:
+    World &world_;
+  };
+
 }
 
 
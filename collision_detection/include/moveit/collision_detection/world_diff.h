@@ -39,6 +39,7 @@
 
 #include <moveit/collision_detection/world.h>
 #include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 namespace collision_detection
 {
@@ -71,13 +72,18 @@ namespace collision_detection
     /** \brief Turn off recording and erase all previously recorded changes. */
     void reset();
 
-    /** \brief Return all the changes that have been recorded */
-    const std::map<std::string, World::Action>& getChanges() const
+    /** \brief The net change to one object: its id and the actions that happened to it since recording started */
+    typedef std::pair<std::string, World::Action> Change;
+
+    /** \brief Return all the changes that have been recorded, one per object. Changes to an object are coalesced as
+     * they are recorded: an object created since recording started is reported as CREATE | ADD_SHAPE no matter how it
+     * changed afterwards, and an object created and destroyed again is not reported at all. */
+    const std::vector<Change>& getChanges() const
     {
       return changes_;
     }
 
-    typedef std::map<std::string, World::Action>::const_iterator const_iterator;
+    typedef std::vector<Change>::const_iterator const_iterator;
     /** iterator pointing to first change */
     const_iterator begin() const
     {
@@ -96,16 +102,11 @@ namespace collision_detection
     /** find changes for a named object */
     const_iterator find(const std::string& id) const
     {
-      return changes_.find(id);
+      boost::unordered_map<std::string, std::size_t>::const_iterator it = id_index_.find(id);
+      return it == id_index_.end() ? changes_.end() : changes_.begin() + it->second;
     }
     /** set the entry for an id */
-    void set(const std::string& id, World::Action val)
-    {
-      if (val)
-        changes_[id] = val;
-      else
-        changes_.erase(id);
-    }
+    void set(const std::string& id, World::Action val);
 
     /** \brief Clear the internally maintained vector of changes */
     void clearChanges();
@@ -114,8 +115,19 @@ namespace collision_detection
     /** \brief Notification function */
     void notify(const World::ObjectConstPtr&, World::Action);
 
-    /** keep changes in a map so they can be coalesced */
-    std::map<std::string, World::Action> changes_;
+    /** \brief Add a change for an object that has none yet; returns its index */
+    std::size_t addChange(const std::string &id, World::ObjectHandle handle, World::Action action);
+
+    /** \brief Remove the change at \e index; the last change takes its place */
+    void eraseChange(std::size_t index);
+
+    /** the changes, one per object, and the handle of the object each change was last recorded for (0 if unknown) */
+    std::vector<Change>              changes_;
+    std::vector<World::ObjectHandle> handles_;
+
+    /** the index of the change for each object, by id and by handle */
+    boost::unordered_map<std::string, std::size_t>         id_index_;
+    boost::unordered_map<World::ObjectHandle, std::size_t> handle_index_;
 
     /* observer handle for world callback */
     World::ObserverHandle observer_handle_;
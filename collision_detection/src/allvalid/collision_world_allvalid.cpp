@@ -100,6 +100,16 @@ double collision_detection::CollisionWorldAllValid::distanceRobot(const Collisio
   return 0.0;
 }
 
+double collision_detection::CollisionWorldAllValid::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const
+{
+  return 0.0;
+}
+
+double collision_detection::CollisionWorldAllValid::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm, double max_distance) const
+{
+  return 0.0;
+}
+
 double collision_detection::CollisionWorldAllValid::distanceWorld(const CollisionWorld &world) const
 {
   return 0.0;
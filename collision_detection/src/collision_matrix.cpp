@@ -36,20 +36,34 @@
 
 #include <moveit/collision_detection/collision_matrix.h>
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 #include <iomanip>
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix()
+namespace collision_detection
+{
+  static std::size_t newInstanceID()
+  {
+    static boost::mutex lock;
+    static std::size_t next_id = 0;
+    boost::mutex::scoped_lock slock(lock);
+    return next_id++;
+  }
+}
+
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix() : instance_id_(newInstanceID()), version_(0)
 {
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed) :
+  instance_id_(newInstanceID()), version_(0)
 {
   for (std::size_t i = 0 ; i < names.size() ; ++i)
     for (std::size_t j = i; j < names.size() ; ++j)
       setEntry(names[i], names[j], allowed);
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix &msg)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix &msg) :
+  instance_id_(newInstanceID()), version_(0)
 {
   if (msg.entry_names.size() != msg.entry_values.size() || msg.default_entry_names.size() != msg.default_entry_values.size())
     logError("The number of links does not match the number of entries in AllowedCollisionMatrix message");
@@ -67,7 +81,8 @@ collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit
   }
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const AllowedCollisionMatrix& acm)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const AllowedCollisionMatrix& acm) :
+  instance_id_(newInstanceID()), version_(0)
 {
   entries_ = acm.entries_;
   allowed_contacts_ = acm.allowed_contacts_;
@@ -75,6 +90,19 @@ collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const Allowe
   default_allowed_contacts_ = acm.default_allowed_contacts_;
 }
 
+collision_detection::AllowedCollisionMatrix& collision_detection::AllowedCollisionMatrix::operator=(const AllowedCollisionMatrix& acm)
+{
+  if (this != &acm)
+  {
+    entries_ = acm.entries_;
+    allowed_contacts_ = acm.allowed_contacts_;
+    default_entries_ = acm.default_entries_;
+    default_allowed_contacts_ = acm.default_allowed_contacts_;
+    ++version_;
+  }
+  return *this;
+}
+
 bool collision_detection::AllowedCollisionMatrix::getEntry(const std::string& name1, const std::string& name2, DecideContactFn &fn) const
 {
   std::map<std::string, std::map<std::string, DecideContactFn> >::const_iterator it1 = allowed_contacts_.find(name1);
@@ -119,6 +147,7 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::string &na
 {
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   entries_[name1][name2] = entries_[name2][name1] = v;
+  ++version_;
 
   // remove boost::function pointers, if any
   std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = allowed_contacts_.find(name1);
@@ -141,12 +170,14 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::string& na
 {
   entries_[name1][name2] = entries_[name2][name1] = AllowedCollision::CONDITIONAL;
   allowed_contacts_[name1][name2] = allowed_contacts_[name2][name1] = fn;
+  ++version_;
 }
 
 void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string& name)
 {
   entries_.erase(name);
   allowed_contacts_.erase(name);
+  ++version_;
   for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
     it->second.erase(name);
   for (std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = allowed_contacts_.begin() ; it != allowed_contacts_.end() ; ++it)
@@ -155,6 +186,7 @@ void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string&
 
 void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string& name1, const std::string &name2)
 {
+  ++version_;
   std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator jt = entries_.find(name1);
   if (jt != entries_.end())
   {
@@ -216,6 +248,7 @@ void collision_detection::AllowedCollisionMatrix::setEntry(bool allowed)
   for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it1 = entries_.begin() ; it1 != entries_.end() ; ++it1)
     for (std::map<std::string, AllowedCollision::Type>::iterator it2 = it1->second.begin() ; it2 != it1->second.end() ; ++it2)
       it2->second = v;
+  ++version_;
 }
 
 void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::string &name, bool allowed)
@@ -223,12 +256,14 @@ void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::str
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   default_entries_[name] = v;
   default_allowed_contacts_.erase(name);
+  ++version_;
 }
 
 void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::string &name, const DecideContactFn &fn)
 {
   default_entries_[name] = AllowedCollision::CONDITIONAL;
   default_allowed_contacts_[name] = fn;
+  ++version_;
 }
 
 bool collision_detection::AllowedCollisionMatrix::getDefaultEntry(const std::string &name, AllowedCollision::Type &allowed_collision) const
@@ -319,6 +354,7 @@ void collision_detection::AllowedCollisionMatrix::clear()
   allowed_contacts_.clear();
   default_entries_.clear();
   default_allowed_contacts_.clear();
+  ++version_;
 }
 
 void collision_detection::AllowedCollisionMatrix::getAllEntryNames(std::vector<std::string>& names) const
@@ -415,3 +451,46 @@ void collision_detection::AllowedCollisionMatrix::print(std::ostream& out) const
     out << std::endl;
   }
 }
+
+collision_detection::CompiledAllowedCollisionMatrix::CompiledAllowedCollisionMatrix() :
+  size_(0), compiled_(false), acm_instance_id_(0), acm_version_(0)
+{
+}
+
+void collision_detection::CompiledAllowedCollisionMatrix::compile(const AllowedCollisionMatrix &acm, const std::vector<std::string> &names)
+{
+  size_ = names.size();
+  bits_.clear();
+  bits_.resize((size_ * size_ + 3) / 4, 0);
+  allowed_contacts_.clear();
+
+  for (std::size_t i = 0 ; i < size_ ; ++i)
+    for (std::size_t j = 0 ; j < size_ ; ++j)
+    {
+      AllowedCollision::Type type;
+      if (!acm.getAllowedCollision(names[i], names[j], type))
+        continue;
+      // code 0 is reserved for pairs that are not in the matrix
+      const std::size_t k = i * size_ + j;
+      bits_[k >> 2] |= (unsigned char)((type + 1) << ((k & 3) << 1));
+      if (type == AllowedCollision::CONDITIONAL)
+      {
+        DecideContactFn fn;
+        if (acm.getAllowedCollision(names[i], names[j], fn))
+          allowed_contacts_[std::make_pair(i, j)] = fn;
+      }
+    }
+
+  compiled_ = true;
+  acm_instance_id_ = acm.getInstanceID();
+  acm_version_ = acm.getVersion();
+}
+
+bool collision_detection::CompiledAllowedCollisionMatrix::getAllowedCollision(std::size_t i, std::size_t j, DecideContactFn &fn) const
+{
+  std::map<std::pair<std::size_t, std::size_t>, DecideContactFn>::const_iterator it = allowed_contacts_.find(std::make_pair(i, j));
+  if (it == allowed_contacts_.end())
+    return false;
+  fn = it->second;
+  return true;
+}
@@ -34,147 +34,222 @@
 
 /* Author: Adam Leeper */
 
+
 #include <moveit/collision_detection/collision_common.h>
 #include <moveit/collision_detection/collision_octomap_filter.h>
 #include <moveit/collision_detection/collision_world.h>
 #include <octomap/math/Vector3.h>
 #include <octomap/math/Utils.h>
 #include <octomap/octomap.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <cmath>
 
 //static const double ISO_VALUE  = 0.5; // TODO magic number! (though, probably a good one).
 //static const double R_MULTIPLE = 1.5; // TODO magic number! (though, probably a good one).
 
-// forward declarations
-bool getMetaballSurfaceProperties(const octomap::point3d_list& cloud,
-                                  const double& spacing,
-                                  const double& iso_value,
-                                  const double& r_multiple,
-                                  const octomath::Vector3& contact_point,
-                                  octomath::Vector3& normal,
-                                  double& depth,
-                                  bool estimate_depth);
-
-bool findSurface(const octomap::point3d_list& cloud,
-                 const double& spacing,
-                 const double& iso_value,
-                 const double& r_multiple,
-                 const octomath::Vector3& seed,
-                 octomath::Vector3& surface_point,
-                 octomath::Vector3& normal);
-
-bool sampleCloud(const octomap::point3d_list& cloud,
-                 const double& spacing,
-                 const double& r_multiple,
-                 const octomath::Vector3& position,
-                 double& intensity,
-                 octomath::Vector3& gradient);
-
+namespace collision_detection
+{
+namespace
+{
 
-int collision_detection::refineContactNormals(const World::ObjectConstPtr& object,
-                                              CollisionResult &res,
-                                              double cell_bbx_search_distance,
-                                              double allowed_angle_divergence,
-                                              bool estimate_depth,
-                                              double iso_value,
-                                              double metaball_radius_multiple)
+// the centers of the occupied cells around a contact, stored coordinate by coordinate so the metaball field is evaluated
+// by straight loops over contiguous memory
+struct MetaballCloud
 {
-  if(!object)
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> z_;
+
+  void push_back(const octomap::point3d &p)
   {
-    logError("No valid Object passed in, cannot refine Normals!");
-    return 0;
+    x_.push_back(p.x());
+    y_.push_back(p.y());
+    z_.push_back(p.z());
   }
-  if(res.contact_count < 1)
+
+  std::size_t size() const
   {
-    logWarn("There do not appear to be any contacts, so there is nothing to refine!");
-    return 0;
+    return x_.size();
   }
+};
 
-  int modified = 0;
+// a contact to refine: the members of a Contact or a CompactContact that are read or updated
+struct ContactToRefine
+{
+  const Eigen::Vector3d *pos_;
+  Eigen::Vector3d       *normal_;
+  double                *depth_;
+};
 
-  // iterate through contacts
-  for( collision_detection::CollisionResult::ContactMap::iterator it = res.contacts.begin(); it != res.contacts.end(); ++it)
+// the number of cells a neighborhood spans along each axis, beyond which the neighborhood is gathered with a bbx iterator
+// instead of looking up every cell by its key
+static const int MAX_KEY_LOOKUP_SPAN = 16;
+
+// the number of neighborhoods a thread keeps before starting over
+static const std::size_t MAX_CACHED_NEIGHBORHOODS = 256;
+
+// the occupied cells around contact points, by the key of the cell each contact point is in
+class NeighborhoodCache
+{
+public:
+
+  NeighborhoodCache(const octomap::OcTree &octree, double cell_bbx_search_distance) :
+    octree_(octree), span_(std::max(0, (int)ceil(cell_bbx_search_distance)))
   {
-    std::string contact1 = it->first.first;
-    std::string contact2 = it->first.second;
-    std::string octomap_name = "";
-    std::vector<collision_detection::Contact>& contact_vector = it->second;
+  }
+
+  const MetaballCloud* getNeighborhood(const octomap::point3d &point)
+  {
+    octomap::OcTreeKey key;
+    if (!octree_.coordToKeyChecked(point, key))
+      return NULL;
+
+    std::map<octomap::OcTreeKey, MetaballCloud, KeyLess>::const_iterator it = cache_.find(key);
+    if (it != cache_.end())
+      return &it->second;
 
-    if(      contact1.find("octomap") != std::string::npos ) octomap_name = contact1;
-    else if( contact2.find("octomap") != std::string::npos ) octomap_name = contact2;
+    if (cache_.size() >= MAX_CACHED_NEIGHBORHOODS)
+      cache_.clear();
+    MetaballCloud &cloud = cache_[key];
+    if (2 * span_ + 1 <= MAX_KEY_LOOKUP_SPAN)
+    {
+      // look up the cells of the neighborhood directly by their keys
+      octomap::OcTreeKey k;
+      for (int dx = -span_ ; dx <= span_ ; ++dx)
+        for (int dy = -span_ ; dy <= span_ ; ++dy)
+          for (int dz = -span_ ; dz <= span_ ; ++dz)
+          {
+            k[0] = key[0] + dx;
+            k[1] = key[1] + dy;
+            k[2] = key[2] + dz;
+            const octomap::OcTreeNode *node = octree_.search(k);
+            if (node && octree_.isNodeOccupied(node))
+              cloud.push_back(octree_.keyToCoord(k));
+          }
+    }
     else
     {
-      continue;
+      double d = span_ * octree_.getResolution();
+      octomap::point3d center = octree_.keyToCoord(key);
+      octomap::point3d bbx_min = center - octomap::point3d(d, d, d);
+      octomap::point3d bbx_max = center + octomap::point3d(d, d, d);
+      for (octomap::OcTree::leaf_bbx_iterator lt = octree_.begin_leafs_bbx(bbx_min, bbx_max), end = octree_.end_leafs_bbx() ; lt != end ; ++lt)
+        if (octree_.isNodeOccupied(*lt))
+          cloud.push_back(lt.getCoordinate());
     }
+    return &cloud;
+  }
 
-    double cell_size = 0;
-    if(!object->shapes_.empty())
+private:
+
+  struct KeyLess
+  {
+    bool operator()(const octomap::OcTreeKey &a, const octomap::OcTreeKey &b) const
     {
-      const shapes::ShapeConstPtr& shape = object->shapes_[0];
-      boost::shared_ptr<const shapes::OcTree> shape_octree = boost::dynamic_pointer_cast<const shapes::OcTree>(shape);
-      if(shape_octree)
-      {
-        boost::shared_ptr<const octomap::OcTree> octree = shape_octree->octree;
-        cell_size = octree->getResolution();
-        for(size_t contact_index = 0; contact_index < contact_vector.size(); contact_index++)
-        {
-          const Eigen::Vector3d& point =   contact_vector[contact_index].pos;
-          const Eigen::Vector3d& normal =  contact_vector[contact_index].normal;
-
-          octomath::Vector3 contact_point(point[0], point[1], point[2]);
-          octomath::Vector3 contact_normal(normal[0], normal[1], normal[2]);
-          octomath::Vector3 diagonal = octomath::Vector3(1,1,1);
-          octomath::Vector3 bbx_min = contact_point - diagonal*cell_size*cell_bbx_search_distance;
-          octomath::Vector3 bbx_max = contact_point + diagonal*cell_size*cell_bbx_search_distance;
-          octomap::point3d_list node_centers;
-          octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator it = octree->begin_leafs_bbx(bbx_min, bbx_max);
-          octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator leafs_end = octree->end_leafs_bbx();
-          int count = 0;
-          for(  ; it != leafs_end; ++it)
-          {
-            octomap::point3d pt = it.getCoordinate();
-            //double prob = it->getOccupancy();
-            if(octree->isNodeOccupied(*it)) // magic number!
-            {
-              count++;
-              node_centers.push_back(pt);
-              //logInform("Adding point %d with prob %.3f at [%.3f, %.3f, %.3f]", count, prob, pt.x(), pt.y(), pt.z());
-            }
-          }
-          //logInform("Contact point at [%.3f, %.3f, %.3f], cell size %.3f, occupied cells %d",
-          //          contact_point.x(), contact_point.y(), contact_point.z(), cell_size, count);
+      if (a[0] != b[0])
+        return a[0] < b[0];
+      if (a[1] != b[1])
+        return a[1] < b[1];
+      return a[2] < b[2];
+    }
+  };
 
-          //octree->getOccupiedLeafsBBX(node_centers, bbx_min, bbx_max);
-          //logError("bad stuff in collision_octomap_filter.cpp; need to port octomap call for groovy");
+  const octomap::OcTree                                   &octree_;
+  int                                                      span_;
+  std::map<octomap::OcTreeKey, MetaballCloud, KeyLess>     cache_;
+};
 
-          octomath::Vector3 n;
-          double depth;
-          if(getMetaballSurfaceProperties(node_centers, cell_size, iso_value, metaball_radius_multiple,
-                                          contact_point, n, depth, estimate_depth))
-          {
-            // only modify normal if the refinement predicts a "very different" result.
-            double divergence = contact_normal.angleTo(n);
-            if(divergence > allowed_angle_divergence)
-            {
-              modified++;
-//              logInform("Normals differ by %.3f, changing: [%.3f, %.3f, %.3f] -> [%.3f, %.3f, %.3f]",
-//                        divergence,
-//                        contact_normal.x(), contact_normal.y(), contact_normal.z(),
-//                        n.x(), n.y(), n.z());
-              contact_vector[contact_index].normal = Eigen::Vector3d(n.x(), n.y(), n.z());
-            }
-
-            if(estimate_depth)
-              contact_vector[contact_index].depth = depth;
+bool sampleCloud(const MetaballCloud& cloud,
+                 const double& spacing,
+                 const double& r_multiple,
+                 const octomath::Vector3& position,
+                 double& intensity,
+                 octomath::Vector3& gradient)
+{
+  intensity = 0.f;
+  gradient = octomath::Vector3(0,0,0);
 
-          }
-        }
+  double R = r_multiple*spacing; // TODO magic number!
+  //double T = 0.5; // TODO magic number!
+
+  std::size_t NN = cloud.size();
+  if(NN == 0)
+  {
+    return false;
+  }
+
+  // constants for Wyvill
+  const double R2 = R*R;
+  const double R4 = R2*R2;
+  const double R6 = R4*R2;
+  const double a = -4.0/9.0, b = 17.0/9.0, c = -22.0/9.0;
+  const double a1 = a/R6, b1 = b/R4, c1 = c/R2;
+  const double a2 = 6*a1, b2 = 4*b1, c2 = 2*c1;
+
+  const double px = position.x(), py = position.y(), pz = position.z();
+  const double *x = &cloud.x_[0], *y = &cloud.y_[0], *z = &cloud.z_[0];
+  double f_sum = 0, gx = 0, gy = 0, gz = 0;
+  for (std::size_t i = 0 ; i < NN ; ++i)
+  {
+    double dx = px - x[i], dy = py - y[i], dz = pz - z[i];
+    double r2 = dx*dx + dy*dy + dz*dz;
+    if(r2 > R2)  // must skip points outside valid bounds.
+      continue;
+    double r4 = r2*r2;
+    double r6 = r4*r2;
+
+    // the gradient is pos/r * (a2*r^5 + b2*r^3 + c2*r), i.e., pos * (a2*r^4 + b2*r^2 + c2)
+    f_sum += a1*r6 + b1*r4 + c1*r2 + 1;
+    double g = a2*r4 + b2*r2 + c2;
+    gx += dx*g;
+    gy += dy*g;
+    gz += dz*g;
+  }
+
+  // TODO:  The whole library should be overhauled to follow the "gradient points out"
+  //        convention of implicit functions.
+  intensity = f_sum;
+  // implicit surface gradient convention points out, so we flip it.
+  gradient = octomath::Vector3(-gx, -gy, -gz);
+  return true; // it worked
+}
+
+// --------------------------------------------------------------------------
+// This algorithm is from Salisbury & Tarr's 1997 paper.  It will find the
+// closest point on the surface starting from a seed point that is close by
+// following the direction of the field gradient.
+bool findSurface(const MetaballCloud& cloud,
+                 const double& spacing,
+                 const double& iso_value,
+                 const double& r_multiple,
+                 const octomath::Vector3& seed,
+                 octomath::Vector3& surface_point,
+                 octomath::Vector3& normal)
+{
+    const double epsilon = 1e-10;
+    const int iterations = 10;
+    double intensity = 0;
+
+    octomath::Vector3 p = seed, dp, gs;
+    for (int i = 0; i < iterations; ++i)
+    {
+      if(!sampleCloud(cloud, spacing, r_multiple, p, intensity, gs)) return false;
+      double s = iso_value - intensity;
+      dp = (gs * -s) * (1.0 / std::max(gs.dot(gs), epsilon));
+      p = p + dp;
+      if (dp.dot(dp) < epsilon)
+      {
+        surface_point = p;
+        normal = gs.normalized();
+        return true;
       }
     }
-  }
-  return modified;
+    return false;
+//    return p;
 }
 
-bool getMetaballSurfaceProperties(const octomap::point3d_list& cloud,
+bool getMetaballSurfaceProperties(const MetaballCloud& cloud,
                                   const double& spacing,
                                   const double& iso_value,
                                   const double& r_multiple,
@@ -212,119 +287,127 @@ bool getMetaballSurfaceProperties(const octomap::point3d_list& cloud,
   }
 }
 
-// --------------------------------------------------------------------------
-// This algorithm is from Salisbury & Tarr's 1997 paper.  It will find the
-// closest point on the surface starting from a seed point that is close by
-// following the direction of the field gradient.
-bool findSurface(const octomap::point3d_list& cloud,
-                 const double& spacing,
-                 const double& iso_value,
-                 const double& r_multiple,
-                 const octomath::Vector3& seed,
-                 octomath::Vector3& surface_point,
-                 octomath::Vector3& normal)
+struct RefinementParameters
 {
-    const double epsilon = 1e-10;
-    const int iterations = 10;
-    double intensity = 0;
+  const octomap::OcTree *octree_;
+  double                 cell_bbx_search_distance_;
+  double                 allowed_angle_divergence_;
+  bool                   estimate_depth_;
+  double                 iso_value_;
+  double                 metaball_radius_multiple_;
+};
 
-    octomath::Vector3 p = seed, dp, gs;
-    for (int i = 0; i < iterations; ++i)
+// refine the contacts in [begin, end) of \e contacts; the number of modified normals is stored in \e modified
+void refineContacts(const RefinementParameters *params, const std::vector<ContactToRefine> *contacts, std::size_t begin, std::size_t end,
+                    int *modified)
+{
+  double cell_size = params->octree_->getResolution();
+  NeighborhoodCache neighborhoods(*params->octree_, params->cell_bbx_search_distance_);
+  *modified = 0;
+  for (std::size_t i = begin ; i < end ; ++i)
+  {
+    const ContactToRefine &contact = (*contacts)[i];
+    const Eigen::Vector3d& point = *contact.pos_;
+    const Eigen::Vector3d& normal = *contact.normal_;
+
+    octomath::Vector3 contact_point(point[0], point[1], point[2]);
+    octomath::Vector3 contact_normal(normal[0], normal[1], normal[2]);
+    const MetaballCloud *node_centers = neighborhoods.getNeighborhood(contact_point);
+    if (!node_centers)
+      continue;
+
+    octomath::Vector3 n;
+    double depth;
+    if(getMetaballSurfaceProperties(*node_centers, cell_size, params->iso_value_, params->metaball_radius_multiple_,
+                                    contact_point, n, depth, params->estimate_depth_))
     {
-      if(!sampleCloud(cloud, spacing, r_multiple, p, intensity, gs)) return false;
-      double s = iso_value - intensity;
-      dp = (gs * -s) * (1.0 / std::max(gs.dot(gs), epsilon));
-      p = p + dp;
-      if (dp.dot(dp) < epsilon)
+      // only modify normal if the refinement predicts a "very different" result.
+      double divergence = contact_normal.angleTo(n);
+      if(divergence > params->allowed_angle_divergence_)
       {
-        surface_point = p;
-        normal = gs.normalized();
-        return true;
+        (*modified)++;
+        *contact.normal_ = Eigen::Vector3d(n.x(), n.y(), n.z());
       }
+
+      if(params->estimate_depth_)
+        *contact.depth_ = depth;
     }
-    return false;
-//    return p;
+  }
 }
 
+}
+}
 
-bool sampleCloud(const octomap::point3d_list& cloud,
-                 const double& spacing,
-                 const double& r_multiple,
-                 const octomath::Vector3& position,
-                 double& intensity,
-                 octomath::Vector3& gradient)
+int collision_detection::refineContactNormals(const World::ObjectConstPtr& object,
+                                              CollisionResult &res,
+                                              double cell_bbx_search_distance,
+                                              double allowed_angle_divergence,
+                                              bool estimate_depth,
+                                              double iso_value,
+                                              double metaball_radius_multiple,
+                                              unsigned int threads)
 {
-  intensity = 0.f;
-  gradient = octomath::Vector3(0,0,0);
-
-  double R = r_multiple*spacing; // TODO magic number!
-  //double T = 0.5; // TODO magic number!
-
-  int NN = cloud.size();
-  if(NN == 0)
+  if(!object)
   {
-    return false;
+    logError("No valid Object passed in, cannot refine Normals!");
+    return 0;
+  }
+  if(res.contact_count < 1)
+  {
+    logWarn("There do not appear to be any contacts, so there is nothing to refine!");
+    return 0;
   }
 
-  // variables for Wyvill
-  double a=0, b=0, c=0, R2=0, R4=0, R6=0, a1=0, b1=0, c1=0, a2=0, b2=0, c2=0;
-  bool WYVILL = true;
-
-  octomap::point3d_list::const_iterator it;
-  for ( it = cloud.begin(); it != cloud.end(); it++ )
+  boost::shared_ptr<const octomap::OcTree> octree;
+  if(!object->shapes_.empty())
   {
-    octomath::Vector3 v = (*it);
+    boost::shared_ptr<const shapes::OcTree> shape_octree = boost::dynamic_pointer_cast<const shapes::OcTree>(object->shapes_[0]);
+    if(shape_octree)
+      octree = shape_octree->octree;
+  }
+  if(!octree)
+    return 0;
 
-    if(WYVILL)
-    {
-      R2 = R*R;
-      R4 = R2*R2;
-      R6 = R4*R2;
-      a = -4.0/9.0; b  = 17.0/9.0; c = -22.0/9.0;
-      a1 = a/R6; b1 = b/R4; c1 = c/R2;
-      a2 = 6*a1; b2 = 4*b1; c2 = 2*c1;
-    }
-    else
+  // gather the contacts with the octomap, from either form of contact storage
+  std::vector<ContactToRefine> contacts;
+  for( collision_detection::CollisionResult::ContactMap::iterator it = res.contacts.begin(); it != res.contacts.end(); ++it)
+  {
+    if(it->first.first.find("octomap") == std::string::npos && it->first.second.find("octomap") == std::string::npos)
+      continue;
+    std::vector<collision_detection::Contact>& contact_vector = it->second;
+    for(size_t contact_index = 0; contact_index < contact_vector.size(); contact_index++)
     {
-      logError("This should not be called!");
+      ContactToRefine c = { &contact_vector[contact_index].pos, &contact_vector[contact_index].normal, &contact_vector[contact_index].depth };
+      contacts.push_back(c);
     }
-
-    double f_val = 0;
-    octomath::Vector3 f_grad(0,0,0);
-
-    octomath::Vector3 pos = position-v;
-    double r = pos.norm();
-    pos = pos*(1.0/r);
-    if(r > R)  // must skip points outside valid bounds.
-    {
+  }
+  for(std::size_t i = 0 ; i < res.compact_contacts.size() ; ++i)
+  {
+    CompactContact &cc = res.compact_contacts[i];
+    if(cc.getBodyName1().find("octomap") == std::string::npos && cc.getBodyName2().find("octomap") == std::string::npos)
       continue;
-    }
-    double r2 = r*r;
-    double r3 = r*r2;
-    double r4 = r2*r2;
-    double r5 = r3*r2;
-    double r6 = r3*r3;
+    ContactToRefine c = { &cc.pos, &cc.normal, &cc.depth };
+    contacts.push_back(c);
+  }
+  if(contacts.empty())
+    return 0;
 
-    if(WYVILL)
-    {
-      f_val = (a1*r6 + b1*r4 + c1*r2 + 1);
-      f_grad = pos*(a2*r5 + b2*r3 + c2*r);
-    }
-    else
-    {
-      logError("This should not be called!");
-      double r_scaled = r/R;
-      // TODO still need to address the scaling...
-      f_val = pow((1-r_scaled),4)*(4*r_scaled + 1);
-      f_grad = pos*(-4.0/R*pow(1.0-r_scaled,3)*(4.0*r_scaled+1.0)+4.0/R*pow(1-r_scaled,4));
-    }
+  // contacts that are next to each other in the result are usually close in space too, so each thread takes
+  // a contiguous range of contacts and can reuse the neighborhoods it gathers
+  std::size_t nthreads = std::max<std::size_t>(1, std::min<std::size_t>(threads, contacts.size()));
+  std::vector<int> modified(nthreads, 0);
+  std::size_t chunk = (contacts.size() + nthreads - 1) / nthreads;
+  RefinementParameters params = { octree.get(), cell_bbx_search_distance, allowed_angle_divergence,
+                                   estimate_depth, iso_value, metaball_radius_multiple };
+  boost::thread_group workers;
+  for(std::size_t t = 1 ; t < nthreads ; ++t)
+    workers.create_thread(boost::bind(&refineContacts, &params, &contacts, std::min(contacts.size(), t * chunk),
+                                      std::min(contacts.size(), (t + 1) * chunk), &modified[t]));
+  refineContacts(&params, &contacts, 0, std::min(contacts.size(), chunk), &modified[0]);
+  workers.join_all();
 
-    // TODO:  The whole library should be overhauled to follow the "gradient points out"
-    //        convention of implicit functions.
-    intensity += f_val;
-    gradient += f_grad;
-  }
-  // implicit surface gradient convention points out, so we flip it.
-  gradient *= -1.0;
-  return true; // it worked
+  int total = 0;
+  for(std::size_t t = 0 ; t < nthreads ; ++t)
+    total += modified[t];
+  return total;
 }
@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection/collision_robot.h>
+#include <moveit/profiler/memory_usage.h>
 #include <limits>
 
 static inline bool validateScale(double scale)
@@ -253,6 +254,35 @@ void collision_detection::CollisionRobot::getScale(std::vector<moveit_msgs::Link
   }
 }
 
+void collision_detection::CollisionRobot::checkSelfCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res,
+                                                                  const std::vector<const robot_state::RobotState*> &states) const
+{
+  res.resize(states.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    if (!res[i].collision || (req.contacts && res[i].contacts.size() < req.max_contacts))
+      checkSelfCollision(req, res[i], *states[i]);
+}
+
+void collision_detection::CollisionRobot::checkSelfCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res,
+                                                                  const std::vector<const robot_state::RobotState*> &states,
+                                                                  const AllowedCollisionMatrix &acm) const
+{
+  res.resize(states.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    if (!res[i].collision || (req.contacts && res[i].contacts.size() < req.max_contacts))
+      checkSelfCollision(req, res[i], *states[i], acm);
+}
+
+std::size_t collision_detection::CollisionRobot::getMemoryUsage() const
+{
+  std::size_t bytes = sizeof(*this) + (link_padding_.size() + link_scale_.size()) * moveit::tools::estimateMapNodeBytes<std::string, double>();
+  for (std::map<std::string, double>::const_iterator it = link_padding_.begin() ; it != link_padding_.end() ; ++it)
+    bytes += it->first.capacity();
+  for (std::map<std::string, double>::const_iterator it = link_scale_.begin() ; it != link_scale_.end() ; ++it)
+    bytes += it->first.capacity();
+  return bytes;
+}
+
 void collision_detection::CollisionRobot::updatedPaddingOrScaling(const std::vector<std::string> &links)
 {
 }
@@ -152,78 +152,148 @@ double collision_detection::getTotalCost(const std::set<CostSource> &cost_source
 }
 
 
+namespace collision_detection
+{
+namespace
+{
+
+/** \brief An index of cost sources by the lower bound of their extent along x. Since the cost sources coming from octrees
+    are all about the same size, the sources whose x extent overlaps an interval are found without looking at the others. */
+class CostSourceIndex
+{
+public:
+
+  typedef std::set<CostSource>::const_iterator Iterator;
+
+  CostSourceIndex() : max_width_(0.0)
+  {
+  }
+
+  void insert(Iterator it)
+  {
+    index_.insert(std::make_pair(it->aabb_min[0], it));
+    max_width_ = std::max(max_width_, it->aabb_max[0] - it->aabb_min[0]);
+  }
+
+  void erase(Iterator it)
+  {
+    std::pair<Index::iterator, Index::iterator> range = index_.equal_range(it->aabb_min[0]);
+    for (Index::iterator jt = range.first ; jt != range.second ; ++jt)
+      if (jt->second == it)
+      {
+        index_.erase(jt);
+        break;
+      }
+  }
+
+  /** \brief Get the cost sources whose extent along x has an interior overlap with [\e min_x, \e max_x] */
+  void query(double min_x, double max_x, std::vector<Iterator> &result) const
+  {
+    result.clear();
+    for (Index::const_iterator it = index_.lower_bound(min_x - max_width_) ; it != index_.end() && it->first < max_x ; ++it)
+      if (it->second->aabb_max[0] > min_x)
+        result.push_back(it->second);
+  }
+
+private:
+
+  typedef std::multimap<double, Iterator> Index;
+
+  Index  index_;
+
+  /// The largest extent along x of the indexed cost sources
+  double max_width_;
+};
+
+// compute the intersection of the boxes of \e a and \e b in \e p, \e q; return false if the intersection is empty
+static inline bool intersectBoxes(const CostSource &a, const CostSource &b, double *p, double *q)
+{
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    p[i] = std::max(a.aabb_min[i], b.aabb_min[i]);
+    q[i] = std::min(a.aabb_max[i], b.aabb_max[i]);
+    if (p[i] >= q[i])
+      return false;
+  }
+  return true;
+}
+
+}
+}
+
 void collision_detection::intersectCostSources(std::set<CostSource> &cost_sources, const std::set<CostSource> &a, const std::set<CostSource> &b)
 {
   cost_sources.clear();
+  CostSourceIndex index;
+  for (std::set<CostSource>::const_iterator jt = b.begin() ; jt != b.end() ; ++jt)
+    index.insert(jt);
+
   CostSource tmp;
+  std::vector<CostSourceIndex::Iterator> candidates;
   for (std::set<CostSource>::const_iterator it = a.begin() ; it != a.end() ; ++it)
-    for (std::set<CostSource>::const_iterator jt = b.begin() ; jt != b.end() ; ++jt)
+  {
+    index.query(it->aabb_min[0], it->aabb_max[0], candidates);
+    for (std::size_t k = 0 ; k < candidates.size() ; ++k)
     {
-      tmp.aabb_min[0] = std::max(it->aabb_min[0], jt->aabb_min[0]);
-      tmp.aabb_min[1] = std::max(it->aabb_min[1], jt->aabb_min[1]);
-      tmp.aabb_min[2] = std::max(it->aabb_min[2], jt->aabb_min[2]);
-
-      tmp.aabb_max[0] = std::min(it->aabb_max[0], jt->aabb_max[0]);
-      tmp.aabb_max[1] = std::min(it->aabb_max[1], jt->aabb_max[1]);
-      tmp.aabb_max[2] = std::min(it->aabb_max[2], jt->aabb_max[2]);
-
-      if (tmp.aabb_min[0] >= tmp.aabb_max[0] || tmp.aabb_min[1] >= tmp.aabb_max[1] || tmp.aabb_min[2] >= tmp.aabb_max[2])
+      const CostSource &other = *candidates[k];
+      if (!intersectBoxes(*it, other, &tmp.aabb_min[0], &tmp.aabb_max[0]))
         continue;
-      tmp.cost = std::max(it->cost, jt->cost);
+      tmp.cost = std::max(it->cost, other.cost);
       cost_sources.insert(tmp);
     }
+  }
 }
 
 void collision_detection::removeOverlapping(std::set<CostSource> &cost_sources, double overlap_fraction)
 {
+  CostSourceIndex index;
+  for (std::set<CostSource>::const_iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
+    index.insert(it);
+
   double p[3], q[3];
+  std::vector<CostSourceIndex::Iterator> candidates;
   for (std::set<CostSource>::iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
   {
     double vol = it->getVolume() * overlap_fraction;
-    std::vector<std::set<CostSource>::iterator> remove;
-    std::set<CostSource>::iterator it1 = it;
-    for (std::set<CostSource>::iterator jt = ++it1 ; jt != cost_sources.end() ; ++jt)
+    index.query(it->aabb_min[0], it->aabb_max[0], candidates);
+    for (std::size_t k = 0 ; k < candidates.size() ; ++k)
     {
-      p[0] = std::max(it->aabb_min[0], jt->aabb_min[0]);
-      p[1] = std::max(it->aabb_min[1], jt->aabb_min[1]);
-      p[2] = std::max(it->aabb_min[2], jt->aabb_min[2]);
-
-      q[0] = std::min(it->aabb_max[0], jt->aabb_max[0]);
-      q[1] = std::min(it->aabb_max[1], jt->aabb_max[1]);
-      q[2] = std::min(it->aabb_max[2], jt->aabb_max[2]);
-
-      if (p[0] >= q[0] || p[1] >= q[1] || p[2] >= q[2])
+      // only the sources that come after this one (the less costly ones) are removed
+      std::set<CostSource>::iterator jt = candidates[k];
+      if (!cost_sources.key_comp()(*it, *jt))
+        continue;
+      if (!intersectBoxes(*it, *jt, p, q))
         continue;
 
       double intersect_volume = (q[0] - p[0]) * (q[1] - p[1]) * (q[2] - p[2]);
       if (intersect_volume >= vol)
-        remove.push_back(jt);
+      {
+        index.erase(jt);
+        cost_sources.erase(jt);
+      }
     }
-    for (std::size_t i = 0 ; i < remove.size() ; ++i)
-      cost_sources.erase(remove[i]);
   }
 }
 
 
 void collision_detection::removeCostSources(std::set<CostSource> &cost_sources, const std::set<CostSource> &cost_sources_to_remove, double overlap_fraction)
 {
+  CostSourceIndex index;
+  for (std::set<CostSource>::const_iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
+    index.insert(it);
+
   // remove all the boxes that overlap with the intersection previously computed in \e rem
   double p[3], q[3];
+  std::vector<CostSourceIndex::Iterator> candidates;
   for (std::set<CostSource>::const_iterator jt = cost_sources_to_remove.begin() ; jt != cost_sources_to_remove.end() ; ++jt)
   {
     std::vector<std::set<CostSource>::iterator> remove;
     std::set<CostSource> add;
-    for (std::set<CostSource>::iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
+    index.query(jt->aabb_min[0], jt->aabb_max[0], candidates);
+    for (std::size_t k = 0 ; k < candidates.size() ; ++k)
     {
-      p[0] = std::max(it->aabb_min[0], jt->aabb_min[0]);
-      p[1] = std::max(it->aabb_min[1], jt->aabb_min[1]);
-      p[2] = std::max(it->aabb_min[2], jt->aabb_min[2]);
-
-      q[0] = std::min(it->aabb_max[0], jt->aabb_max[0]);
-      q[1] = std::min(it->aabb_max[1], jt->aabb_max[1]);
-      q[2] = std::min(it->aabb_max[2], jt->aabb_max[2]);
-
-      if (p[0] >= q[0] || p[1] >= q[1] || p[2] >= q[2])
+      std::set<CostSource>::iterator it = candidates[k];
+      if (!intersectBoxes(*it, *jt, p, q))
         continue;
 
       double intersect_volume = (q[0] - p[0]) * (q[1] - p[1]) * (q[2] - p[2]);
@@ -252,8 +322,16 @@ void collision_detection::removeCostSources(std::set<CostSource> &cost_sources,
       }
     }
     for (std::size_t i = 0 ; i < remove.size() ; ++i)
+    {
+      index.erase(remove[i]);
       cost_sources.erase(remove[i]);
-    cost_sources.insert(add.begin(), add.end());
+    }
+    for (std::set<CostSource>::const_iterator it = add.begin() ; it != add.end() ; ++it)
+    {
+      std::pair<std::set<CostSource>::iterator, bool> r = cost_sources.insert(*it);
+      if (r.second)
+        index.insert(r.first);
+    }
   }
 }
 
@@ -36,6 +36,10 @@
 
 #include <moveit/collision_detection/collision_world.h>
 #include <geometric_shapes/shape_operations.h>
+#include <geometric_shapes/bodies.h>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <limits>
 
 collision_detection::CollisionWorld::CollisionWorld() :
   world_(new World()),
@@ -69,6 +73,15 @@ void collision_detection::CollisionWorld::checkCollision(const CollisionRequest
     checkRobotCollision(req, res, robot, state, acm);
 }
 
+void collision_detection::CollisionWorld::checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                         const CollisionRobot &self_robot, const robot_state::RobotState &state,
+                                                         const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollision(req, res, robot, state, acm);
+  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
+    self_robot.checkSelfCollision(req, res, state, acm);
+}
+
 void collision_detection::CollisionWorld::checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
                                                          const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
@@ -85,6 +98,51 @@ void collision_detection::CollisionWorld::checkCollision(const CollisionRequest
     checkRobotCollision(req, res, robot, state1, state2, acm);
 }
 
+void collision_detection::CollisionWorld::checkCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                              const std::vector<const robot_state::RobotState*> &states) const
+{
+  res.clear();
+  robot.checkSelfCollisionBatch(req, res, states);
+  checkRobotCollisionBatch(req, res, robot, states);
+}
+
+void collision_detection::CollisionWorld::checkCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                              const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const
+{
+  res.clear();
+  robot.checkSelfCollisionBatch(req, res, states, acm);
+  checkRobotCollisionBatch(req, res, robot, states, acm);
+}
+
+void collision_detection::CollisionWorld::checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                   const std::vector<const robot_state::RobotState*> &states) const
+{
+  res.resize(states.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    if (!res[i].collision || (req.contacts && res[i].contacts.size() < req.max_contacts))
+      checkRobotCollision(req, res[i], robot, *states[i]);
+}
+
+void collision_detection::CollisionWorld::checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                   const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const
+{
+  res.resize(states.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    if (!res[i].collision || (req.contacts && res[i].contacts.size() < req.max_contacts))
+      checkRobotCollision(req, res[i], robot, *states[i], acm);
+}
+
+double collision_detection::CollisionWorld::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const
+{
+  return std::min(distanceRobot(robot, state), max_distance);
+}
+
+double collision_detection::CollisionWorld::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state,
+                                                          const AllowedCollisionMatrix &acm, double max_distance) const
+{
+  return std::min(distanceRobot(robot, state, acm), max_distance);
+}
+
 void collision_detection::CollisionWorld::setWorld(const WorldPtr& world)
 {
   world_ = world;
@@ -93,3 +151,108 @@ void collision_detection::CollisionWorld::setWorld(const WorldPtr& world)
 
   world_const_ = world;
 }
+
+void collision_detection::CollisionWorld::prepareShape(const shapes::ShapeConstPtr &shape) const
+{
+}
+
+std::size_t collision_detection::CollisionWorld::getMemoryUsage() const
+{
+  return sizeof(*this);
+}
+
+namespace
+{
+// Bounding sphere of a shape placed at \e pose; false if the shape has no bounded volume (planes, octrees)
+bool getShapeBoundingSphere(const shapes::ShapeConstPtr &shape, const Eigen::Affine3d &pose, bodies::BoundingSphere &sphere)
+{
+  boost::scoped_ptr<bodies::Body> body(bodies::constructBodyFromShape(shape.get()));
+  if (!body)
+    return false;
+  body->setPose(pose);
+  body->computeBoundingSphere(sphere);
+  return true;
+}
+}
+
+void collision_detection::CollisionWorld::getObjectsInBox(const Eigen::Vector3d &min_corner, const Eigen::Vector3d &max_corner,
+                                                          std::vector<std::string> &ids) const
+{
+  ids.clear();
+  for (World::const_iterator it = world_const_->begin() ; it != world_const_->end() ; ++it)
+    for (std::size_t i = 0 ; i < it->second->shapes_.size() ; ++i)
+    {
+      bodies::BoundingSphere sphere;
+      // objects without a bounded volume may be anywhere
+      if (getShapeBoundingSphere(it->second->shapes_[i], it->second->shape_poses_[i], sphere))
+      {
+        Eigen::Vector3d closest = sphere.center.cwiseMax(min_corner).cwiseMin(max_corner);
+        if ((closest - sphere.center).squaredNorm() > sphere.radius * sphere.radius)
+          continue;
+      }
+      ids.push_back(it->first);
+      break;
+    }
+  std::sort(ids.begin(), ids.end());
+}
+
+void collision_detection::CollisionWorld::getObjectsInSphere(const Eigen::Vector3d &center, double radius, std::vector<std::string> &ids) const
+{
+  ids.clear();
+  for (World::const_iterator it = world_const_->begin() ; it != world_const_->end() ; ++it)
+    for (std::size_t i = 0 ; i < it->second->shapes_.size() ; ++i)
+    {
+      bodies::BoundingSphere sphere;
+      if (getShapeBoundingSphere(it->second->shapes_[i], it->second->shape_poses_[i], sphere) &&
+          (sphere.center - center).norm() > sphere.radius + radius)
+        continue;
+      ids.push_back(it->first);
+      break;
+    }
+  std::sort(ids.begin(), ids.end());
+}
+
+bool collision_detection::CollisionWorld::castRayOnObject(const World::Object &obj, const Eigen::Vector3d &origin, const Eigen::Vector3d &dir,
+                                                          double &distance)
+{
+  bool hit = false;
+  for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+  {
+    boost::scoped_ptr<bodies::Body> body(bodies::constructBodyFromShape(obj.shapes_[i].get()));
+    if (!body)
+      continue;
+    body->setPose(obj.shape_poses_[i]);
+    EigenSTL::vector_Vector3d intersections;
+    if (!body->intersectsRay(origin, dir, &intersections))
+      continue;
+    for (std::size_t j = 0 ; j < intersections.size() ; ++j)
+    {
+      double d = (intersections[j] - origin).norm();
+      if (d <= distance)
+      {
+        distance = d;
+        hit = true;
+      }
+    }
+  }
+  return hit;
+}
+
+bool collision_detection::CollisionWorld::castRay(const Eigen::Vector3d &origin, const Eigen::Vector3d &direction, double max_distance,
+                                                  std::string &id, double &distance) const
+{
+  double norm = direction.norm();
+  if (norm < std::numeric_limits<double>::epsilon())
+    return false;
+  Eigen::Vector3d dir = direction / norm;
+
+  bool hit = false;
+  distance = max_distance;
+  for (World::const_iterator it = world_const_->begin() ; it != world_const_->end() ; ++it)
+    if (castRayOnObject(*it->second, origin, dir, distance))
+    {
+      id = it->first;
+      hit = true;
+    }
+  return hit;
+}
@@ -36,13 +36,41 @@
 
 #include <moveit/collision_detection/world.h>
 #include <console_bridge/console.h>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
 
-collision_detection::World::World()
+namespace
+{
+std::size_t newObjectVersion()
+{
+  static boost::mutex lock;
+  static std::size_t next_version = 1;
+  boost::mutex::scoped_lock slock(lock);
+  return next_version++;
+}
+
+collision_detection::World::ObjectHandle newObjectHandle()
+{
+  static boost::mutex lock;
+  static collision_detection::World::ObjectHandle next_handle = 1;
+  boost::mutex::scoped_lock slock(lock);
+  return next_handle++;
+}
+}
+
+collision_detection::World::World() :
+  update_depth_(0)
 { }
 
-collision_detection::World::World(const World &other)
+collision_detection::World::World(const World &other) :
+  update_depth_(0)
 {
   objects_ = other.objects_;
+  for (ObjectIterator it = objects_.begin() ; it != objects_.end() ; ++it)
+  {
+    id_index_[it->first] = it;
+    handle_index_[it->second->handle_] = it;
+  }
 }
 
 collision_detection::World::~World()
@@ -51,6 +79,29 @@ collision_detection::World::~World()
     removeObserver(observers_.front());
 }
 
+collision_detection::World::ObjectPtr& collision_detection::World::getOrCreateObject(const std::string &id, bool &created)
+{
+  IdIndex::iterator idx = id_index_.find(id);
+  if (idx != id_index_.end())
+  {
+    created = false;
+    return idx->second->second;
+  }
+  ObjectIterator it = objects_.insert(std::make_pair(id, ObjectPtr(new Object(id)))).first;
+  it->second->handle_ = newObjectHandle();
+  id_index_[id] = it;
+  handle_index_[it->second->handle_] = it;
+  created = true;
+  return it->second;
+}
+
+void collision_detection::World::eraseObject(ObjectIterator it)
+{
+  id_index_.erase(it->first);
+  handle_index_.erase(it->second->handle_);
+  objects_.erase(it);
+}
+
 inline void collision_detection::World::addToObjectInternal(const ObjectPtr &obj,
                                                             const shapes::ShapeConstPtr &shape,
                                                             const Eigen::Affine3d &pose)
@@ -74,11 +125,10 @@ void collision_detection::World::addToObject(const std::string &id,
 
   int action = ADD_SHAPE;
 
-  ObjectPtr& obj = objects_[id];
-  if (!obj) {
-    obj.reset(new Object(id));
+  bool created;
+  ObjectPtr& obj = getOrCreateObject(id, created);
+  if (created)
     action |= CREATE;
-  }
 
   ensureUnique(obj);
 
@@ -94,11 +144,10 @@ void collision_detection::World::addToObject(const std::string &id,
 {
   int action = ADD_SHAPE;
 
-  ObjectPtr& obj = objects_[id];
-  if (!obj) {
-    obj.reset(new Object(id));
+  bool created;
+  ObjectPtr& obj = getOrCreateObject(id, created);
+  if (created)
     action |= CREATE;
-  }
 
   ensureUnique(obj);
   addToObjectInternal(obj, shape, pose);
@@ -116,11 +165,26 @@ std::vector<std::string> collision_detection::World::getObjectIds() const
 
 collision_detection::World::ObjectConstPtr collision_detection::World::getObject(const std::string &id) const
 {
-  std::map<std::string, ObjectPtr>::const_iterator it = objects_.find(id);
-  if (it == objects_.end())
+  IdIndex::const_iterator it = id_index_.find(id);
+  if (it == id_index_.end())
     return ObjectConstPtr();
   else
-    return it->second;
+    return it->second->second;
+}
+
+collision_detection::World::ObjectConstPtr collision_detection::World::getObject(ObjectHandle handle) const
+{
+  HandleIndex::const_iterator it = handle_index_.find(handle);
+  if (it == handle_index_.end())
+    return ObjectConstPtr();
+  else
+    return it->second->second;
+}
+
+collision_detection::World::ObjectHandle collision_detection::World::getObjectHandle(const std::string &id) const
+{
+  IdIndex::const_iterator it = id_index_.find(id);
+  return it == id_index_.end() ? 0 : it->second->second->handle_;
 }
 
 void collision_detection::World::ensureUnique(ObjectPtr &obj)
@@ -131,36 +195,63 @@ void collision_detection::World::ensureUnique(ObjectPtr &obj)
 
 bool collision_detection::World::hasObject(const std::string &id) const
 {
-  return objects_.find(id) != objects_.end();
+  return id_index_.find(id) != id_index_.end();
 }
 
 bool collision_detection::World::moveShapeInObject(const std::string &id,
                                                    const shapes::ShapeConstPtr &shape,
                                                    const Eigen::Affine3d &pose)
 {
-  std::map<std::string, ObjectPtr>::iterator it = objects_.find(id);
-  if (it != objects_.end())
-  {
-    unsigned int n = it->second->shapes_.size();
-    for (unsigned int i = 0 ; i < n ; ++i)
-      if (it->second->shapes_[i] == shape)
-      {
-        ensureUnique(it->second);
-        it->second->shape_poses_[i] = pose;
+  IdIndex::iterator it = id_index_.find(id);
+  return it != id_index_.end() && moveShapeInObject(it->second, shape, pose);
+}
 
-        notify(it->second, MOVE_SHAPE);
-        return true;
-      }
-  }
+bool collision_detection::World::moveShapeInObject(ObjectHandle handle,
+                                                   const shapes::ShapeConstPtr &shape,
+                                                   const Eigen::Affine3d &pose)
+{
+  HandleIndex::iterator it = handle_index_.find(handle);
+  return it != handle_index_.end() && moveShapeInObject(it->second, shape, pose);
+}
+
+bool collision_detection::World::moveShapeInObject(ObjectIterator it,
+                                                   const shapes::ShapeConstPtr &shape,
+                                                   const Eigen::Affine3d &pose)
+{
+  unsigned int n = it->second->shapes_.size();
+  for (unsigned int i = 0 ; i < n ; ++i)
+    if (it->second->shapes_[i] == shape)
+    {
+      ensureUnique(it->second);
+      it->second->shape_poses_[i] = pose;
+
+      notify(it->second, MOVE_SHAPE);
+      return true;
+    }
   return false;
 }
 
+bool collision_detection::World::updateShapeInObject(const std::string &id,
+                                                     const shapes::ShapeConstPtr &shape)
+{
+  IdIndex::iterator it = id_index_.find(id);
+  if (it == id_index_.end())
+    return false;
+  // the object itself does not change, so it is not copied
+  const std::vector<shapes::ShapeConstPtr> &shapes = it->second->second->shapes_;
+  if (std::find(shapes.begin(), shapes.end(), shape) == shapes.end())
+    return false;
+  notify(it->second->second, UPDATE_SHAPE);
+  return true;
+}
+
 bool collision_detection::World::removeShapeFromObject(const std::string &id,
                                                        const shapes::ShapeConstPtr &shape)
 {
-  std::map<std::string, ObjectPtr>::iterator it = objects_.find(id);
-  if (it != objects_.end())
+  IdIndex::iterator idx = id_index_.find(id);
+  if (idx != id_index_.end())
   {
+    ObjectIterator it = idx->second;
     unsigned int n = it->second->shapes_.size();
     for (unsigned int i = 0 ; i < n ; ++i)
       if (it->second->shapes_[i] == shape)
@@ -172,7 +263,7 @@ bool collision_detection::World::removeShapeFromObject(const std::string &id,
         if (it->second->shapes_.empty())
         {
           notify(it->second, DESTROY);
-          objects_.erase(it);
+          eraseObject(it);
         }
         else
         {
@@ -186,11 +277,12 @@ bool collision_detection::World::removeShapeFromObject(const std::string &id,
 
 bool collision_detection::World::removeObject(const std::string &id)
 {
-  std::map<std::string, ObjectPtr>::iterator it = objects_.find(id);
-  if (it != objects_.end())
+  IdIndex::iterator idx = id_index_.find(id);
+  if (idx != id_index_.end())
   {
+    ObjectIterator it = idx->second;
     notify(it->second, DESTROY);
-    objects_.erase(it);
+    eraseObject(it);
     return true;
   }
   return false;
@@ -200,6 +292,8 @@ void collision_detection::World::clearObjects()
 {
   notifyAll(DESTROY);
   objects_.clear();
+  id_index_.clear();
+  handle_index_.clear();
 }
 
 collision_detection::World::ObserverHandle collision_detection::World::addObserver(const ObserverCallbackFn &callback)
@@ -229,11 +323,69 @@ void collision_detection::World::notifyAll(Action action)
 }
 
 void collision_detection::World::notify(const ObjectConstPtr& obj, Action action)
+{
+  // all changes to objects are notified, so this is where they get their new version
+  if (action != DESTROY)
+    obj->version_ = newObjectVersion();
+
+  if (update_depth_ == 0)
+  {
+    notifyObservers(obj, action);
+    return;
+  }
+
+  std::map<std::string, PendingChange>::iterator it = pending_changes_.find(obj->id_);
+  if (it == pending_changes_.end())
+  {
+    PendingChange &change = pending_changes_[obj->id_];
+    change.obj_ = obj;
+    change.action_ = action;
+  }
+  else if (action == DESTROY)
+  {
+    // an object created in this batch was never seen by the observers
+    if (it->second.action_ & CREATE && !(it->second.action_ & DESTROY))
+      pending_changes_.erase(it);
+    else
+    {
+      it->second.obj_ = obj;
+      it->second.action_ = DESTROY;
+    }
+  }
+  else
+  {
+    it->second.obj_ = obj;
+    it->second.action_ |= action;
+  }
+}
+
+void collision_detection::World::notifyObservers(const ObjectConstPtr& obj, Action action)
 {
   for (std::vector<Observer*>::const_iterator obs = observers_.begin() ; obs != observers_.end() ; ++obs)
     (*obs)->callback_(obj, action);
 }
 
+void collision_detection::World::beginUpdate()
+{
+  update_depth_++;
+}
+
+void collision_detection::World::endUpdate()
+{
+  if (update_depth_ == 0)
+  {
+    logError("World::endUpdate() called without a matching call to beginUpdate()");
+    return;
+  }
+  if (--update_depth_ > 0)
+    return;
+
+  std::map<std::string, PendingChange> changes;
+  changes.swap(pending_changes_);
+  for (std::map<std::string, PendingChange>::const_iterator it = changes.begin() ; it != changes.end() ; ++it)
+    notifyObservers(it->second.obj_, Action(it->second.action_));
+}
+
 void collision_detection::World::notifyObserverAllObjects(const ObserverHandle observer_handle, Action action) const
 {
   for (std::vector<Observer*>::const_iterator obs = observers_.begin() ; obs != observers_.end() ; ++obs)
@@ -60,6 +60,9 @@ collision_detection::WorldDiff::WorldDiff(WorldDiff &other)
   if (world)
   {
     changes_ = other.changes_;
+    handles_ = other.handles_;
+    id_index_ = other.id_index_;
+    handle_index_ = other.handle_index_;
 
     boost::weak_ptr<World>(world).swap(world_);
     observer_handle_ = world->addObserver(boost::bind(&WorldDiff::notify, this, _1, _2));
@@ -94,7 +97,9 @@ void collision_detection::WorldDiff::setWorld(const WorldPtr& world)
   WorldPtr old_world = world_.lock();
   if (old_world)
   {
-    old_world->notifyObserverAllObjects(observer_handle_, World::DESTROY);
+    // objects of the old world are reported as destroyed even if they were created while recording
+    for (World::const_iterator it = old_world->begin() ; it != old_world->end() ; ++it)
+      set(it->first, World::DESTROY);
     old_world->removeObserver(observer_handle_);
   }
 
@@ -107,13 +112,104 @@ void collision_detection::WorldDiff::setWorld(const WorldPtr& world)
 void collision_detection::WorldDiff::clearChanges()
 {
   changes_.clear();
+  handles_.clear();
+  id_index_.clear();
+  handle_index_.clear();
+}
+
+void collision_detection::WorldDiff::set(const std::string& id, World::Action val)
+{
+  boost::unordered_map<std::string, std::size_t>::const_iterator it = id_index_.find(id);
+  if (it == id_index_.end())
+  {
+    if (val)
+      addChange(id, 0, val);
+  }
+  else if (val)
+    changes_[it->second].second = val;
+  else
+    eraseChange(it->second);
+}
+
+std::size_t collision_detection::WorldDiff::addChange(const std::string &id, World::ObjectHandle handle, World::Action action)
+{
+  std::size_t index = changes_.size();
+  changes_.push_back(Change(id, action));
+  handles_.push_back(handle);
+  id_index_[id] = index;
+  if (handle)
+    handle_index_[handle] = index;
+  return index;
+}
+
+void collision_detection::WorldDiff::eraseChange(std::size_t index)
+{
+  id_index_.erase(changes_[index].first);
+  if (handles_[index])
+    handle_index_.erase(handles_[index]);
+
+  std::size_t last = changes_.size() - 1;
+  if (index != last)
+  {
+    changes_[index].first.swap(changes_[last].first);
+    changes_[index].second = changes_[last].second;
+    handles_[index] = handles_[last];
+    id_index_[changes_[index].first] = index;
+    if (handles_[index])
+      handle_index_[handles_[index]] = index;
+  }
+  changes_.pop_back();
+  handles_.pop_back();
+}
+
+namespace
+{
+// an object created while recording is sent in full, so moving or changing its shapes adds nothing to the change
+int coalesceCreate(int action)
+{
+  if (action & collision_detection::World::CREATE)
+    return action & (collision_detection::World::DESTROY | collision_detection::World::CREATE | collision_detection::World::ADD_SHAPE);
+  return action;
+}
 }
 
 void collision_detection::WorldDiff::notify(const World::ObjectConstPtr& obj, World::Action action)
 {
-  World::Action& a = changes_[obj->id_];
+  // repeated updates of an object are found by handle, without hashing its id
+  boost::unordered_map<World::ObjectHandle, std::size_t>::const_iterator ht = handle_index_.find(obj->handle_);
+  std::size_t index;
+  if (ht != handle_index_.end())
+    index = ht->second;
+  else
+  {
+    boost::unordered_map<std::string, std::size_t>::const_iterator it = id_index_.find(obj->id_);
+    if (it == id_index_.end())
+    {
+      addChange(obj->id_, obj->handle_, coalesceCreate(action));
+      return;
+    }
+    index = it->second;
+
+    // the object was recreated (or its change was set by id); follow its new handle
+    if (handles_[index])
+      handle_index_.erase(handles_[index]);
+    handles_[index] = obj->handle_;
+    if (obj->handle_)
+      handle_index_[obj->handle_] = index;
+  }
+
+  int previous = changes_[index].second;
+  bool created = (previous & World::CREATE) && !(previous & World::DESTROY);
   if (action == World::DESTROY)
-    a = World::DESTROY;
+  {
+    // an object created since recording started was never seen by whoever reads the changes
+    if (created)
+      eraseChange(index);
+    else
+      changes_[index].second = World::DESTROY;
+  }
+  else if (action & World::DESTROY)
+    changes_[index].second = coalesceCreate(created ? action & ~World::DESTROY : (int)action);
   else
-    a = a | action;
+    changes_[index].second = coalesceCreate(previous | action);
 }
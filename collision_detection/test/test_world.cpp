@@ -419,6 +419,135 @@ TEST(World, TrackChanges)
   EXPECT_EQ(4, ta3.cnt_);
 }
 
+TEST(World, ObjectVersions)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+
+  world.addToObject("obj", ball, Eigen::Affine3d::Identity());
+  std::size_t v1 = world.getObject("obj")->version_;
+  EXPECT_NE(0u, v1);
+
+  // a copy of the world shares the object, and its version, until one of them changes it
+  collision_detection::World copy(world);
+  EXPECT_EQ(v1, copy.getObject("obj")->version_);
+
+  world.moveShapeInObject("obj", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,1)));
+  std::size_t v2 = world.getObject("obj")->version_;
+  EXPECT_NE(v1, v2);
+  EXPECT_EQ(v1, copy.getObject("obj")->version_);
+
+  copy.addToObject("obj", box, Eigen::Affine3d::Identity());
+  std::size_t v3 = copy.getObject("obj")->version_;
+  EXPECT_NE(v1, v3);
+  EXPECT_NE(v2, v3);
+}
+
+TEST(World, UpdateShapeInPlace)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+  world.addToObject("obj", ball, Eigen::Affine3d::Identity());
+  collision_detection::World::ObjectConstPtr obj = world.getObject("obj");
+  std::size_t v1 = obj->version_;
+
+  TestAction ta;
+  world.addObserver(boost::bind(TrackChangesNotify, &ta, _1, _2));
+
+  // only shapes of the object can be updated
+  EXPECT_FALSE(world.updateShapeInObject("obj", box));
+  EXPECT_FALSE(world.updateShapeInObject("xyz", ball));
+  EXPECT_EQ(0, ta.cnt_);
+
+  // the object is kept, but observers are told about the update
+  EXPECT_TRUE(world.updateShapeInObject("obj", ball));
+  EXPECT_EQ(1, ta.cnt_);
+  EXPECT_EQ(collision_detection::World::UPDATE_SHAPE, ta.action_);
+  EXPECT_EQ(obj, world.getObject("obj"));
+  EXPECT_NE(v1, obj->version_);
+}
+
+TEST(World, UpdateBatch)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+  world.addToObject("old", ball, Eigen::Affine3d::Identity());
+
+  TestAction ta;
+  collision_detection::World::ObserverHandle observer_ta;
+  observer_ta = world.addObserver(boost::bind(TrackChangesNotify, &ta, _1, _2));
+
+  {
+    collision_detection::WorldUpdateBatch batch(world);
+    world.addToObject("obj1", ball, Eigen::Affine3d::Identity());
+    world.addToObject("obj1", box, Eigen::Affine3d::Identity());
+    world.moveShapeInObject("obj1", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,1)));
+
+    // nested batches notify at the end of the outermost one
+    world.beginUpdate();
+    world.addToObject("temp", ball, Eigen::Affine3d::Identity());
+    world.removeObject("temp");
+    world.endUpdate();
+    EXPECT_EQ(0, ta.cnt_);
+  }
+
+  // one notification for the object, none for the one that came and went
+  EXPECT_EQ(1, ta.cnt_);
+  EXPECT_EQ("obj1", ta.obj_.id_);
+  EXPECT_EQ(2u, ta.obj_.shapes_.size());
+  EXPECT_EQ(collision_detection::World::CREATE |
+            collision_detection::World::ADD_SHAPE |
+            collision_detection::World::MOVE_SHAPE,
+            ta.action_);
+  ta.reset();
+
+  world.beginUpdate();
+  world.removeObject("old");
+  EXPECT_EQ(1, ta.cnt_);
+  world.endUpdate();
+  EXPECT_EQ(2, ta.cnt_);
+  EXPECT_EQ("old", ta.obj_.id_);
+  EXPECT_EQ(collision_detection::World::DESTROY, ta.action_);
+
+  world.removeObserver(observer_ta);
+}
+
+TEST(World, ObjectHandles)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+
+  EXPECT_EQ(0u, world.getObjectHandle("obj1"));
+  world.addToObject("obj1", ball, Eigen::Affine3d::Identity());
+  world.addToObject("obj2", box, Eigen::Affine3d::Identity());
+  collision_detection::World::ObjectHandle h1 = world.getObjectHandle("obj1");
+  collision_detection::World::ObjectHandle h2 = world.getObjectHandle("obj2");
+  EXPECT_NE(0u, h1);
+  EXPECT_NE(h1, h2);
+  EXPECT_EQ("obj1", world.getObject(h1)->id_);
+
+  // the handle stays the same as the object changes, and copies of the world share it
+  EXPECT_TRUE(world.moveShapeInObject(h1, ball, Eigen::Affine3d(Eigen::Translation3d(0,0,1))));
+  EXPECT_EQ(1.0, world.getObject("obj1")->shape_poses_[0].translation().z());
+  EXPECT_EQ(h1, world.getObjectHandle("obj1"));
+  collision_detection::World copy(world);
+  EXPECT_EQ(h1, copy.getObjectHandle("obj1"));
+  EXPECT_TRUE(copy.find("obj2") != copy.end());
+  EXPECT_FALSE(copy.moveShapeInObject(h1, box, Eigen::Affine3d::Identity()));
+
+  // handles are not reused
+  world.removeObject("obj1");
+  EXPECT_FALSE(world.getObject(h1));
+  EXPECT_FALSE(world.moveShapeInObject(h1, ball, Eigen::Affine3d::Identity()));
+  world.addToObject("obj1", ball, Eigen::Affine3d::Identity());
+  EXPECT_NE(h1, world.getObjectHandle("obj1"));
+  EXPECT_TRUE(copy.getObject(h1));
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -59,13 +59,13 @@ TEST(WorldDiff, TrackChanges)
   EXPECT_EQ(1, diff1.getChanges().size());
   EXPECT_EQ(0, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("obj1");
+  it = diff1.find("obj1");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
             it->second);
 
-  it = diff1.getChanges().find("xyz");
+  it = diff1.find("xyz");
   EXPECT_EQ(diff1.end(), it);
 
   world->addToObject("obj2",
@@ -75,7 +75,7 @@ TEST(WorldDiff, TrackChanges)
   EXPECT_EQ(2, diff1.getChanges().size());
   EXPECT_EQ(0, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("obj2");
+  it = diff1.find("obj2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
@@ -88,7 +88,7 @@ TEST(WorldDiff, TrackChanges)
   EXPECT_EQ(2, diff1.getChanges().size());
   EXPECT_EQ(0, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("obj2");
+  it = diff1.find("obj2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
@@ -105,14 +105,13 @@ TEST(WorldDiff, TrackChanges)
   EXPECT_EQ(2, diff1.getChanges().size());
   EXPECT_EQ(1, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("obj2");
+  it = diff1.find("obj2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
-            collision_detection::World::ADD_SHAPE |
-            collision_detection::World::MOVE_SHAPE,
+            collision_detection::World::ADD_SHAPE,
             it->second);
 
-  it = diff2.getChanges().find("obj2");
+  it = diff2.find("obj2");
   EXPECT_NE(diff2.end(), it);
   EXPECT_EQ(collision_detection::World::MOVE_SHAPE,
             it->second);
@@ -123,7 +122,7 @@ TEST(WorldDiff, TrackChanges)
   EXPECT_EQ(0, diff1.getChanges().size());
   EXPECT_EQ(1, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("obj2");
+  it = diff1.find("obj2");
   EXPECT_EQ(diff1.end(), it);
 
   world->addToObject("obj3",
@@ -162,42 +161,38 @@ TEST(WorldDiff, TrackChanges)
   EXPECT_EQ(1, diff1.getChanges().size());
   EXPECT_EQ(2, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("obj2");
+  it = diff1.find("obj2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
-  it = diff2.getChanges().find("obj2");
+  it = diff2.find("obj2");
   EXPECT_NE(diff2.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
   world->removeShapeFromObject("obj3", cyl);
 
-  it = diff1.getChanges().find("obj3");
+  it = diff1.find("obj3");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::REMOVE_SHAPE,
             it->second);
-  it = diff2.getChanges().find("obj3");
+  it = diff2.find("obj3");
   EXPECT_NE(diff2.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
-            collision_detection::World::ADD_SHAPE |
-            collision_detection::World::MOVE_SHAPE |
-            collision_detection::World::REMOVE_SHAPE,
+            collision_detection::World::ADD_SHAPE,
             it->second);
 
 
   world->removeShapeFromObject("obj3", box);
 
-  it = diff1.getChanges().find("obj3");
+  it = diff1.find("obj3");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::REMOVE_SHAPE,
             it->second);
-  it = diff2.getChanges().find("obj3");
+  it = diff2.find("obj3");
   EXPECT_NE(diff2.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
-            collision_detection::World::ADD_SHAPE |
-            collision_detection::World::MOVE_SHAPE |
-            collision_detection::World::REMOVE_SHAPE,
+            collision_detection::World::ADD_SHAPE,
             it->second);
 
   move_ok = world->moveShapeInObject(
@@ -206,29 +201,28 @@ TEST(WorldDiff, TrackChanges)
                           Eigen::Affine3d(Eigen::Translation3d(0,0,3)));
   EXPECT_TRUE(move_ok);
 
-  it = diff1.getChanges().find("obj3");
+  it = diff1.find("obj3");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::REMOVE_SHAPE |
             collision_detection::World::MOVE_SHAPE,
             it->second);
-  it = diff2.getChanges().find("obj3");
+  it = diff2.find("obj3");
   EXPECT_NE(diff2.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
-            collision_detection::World::ADD_SHAPE |
-            collision_detection::World::MOVE_SHAPE |
-            collision_detection::World::REMOVE_SHAPE,
+            collision_detection::World::ADD_SHAPE,
             it->second);
 
   world->removeShapeFromObject("obj3", ball);
 
-  it = diff1.getChanges().find("obj3");
+  it = diff1.find("obj3");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
-  it = diff2.getChanges().find("obj3");
-  EXPECT_NE(diff2.end(), it);
-  EXPECT_EQ(collision_detection::World::DESTROY,
-            it->second);
+
+  // obj3 was created after diff2 started recording, so there is nothing left to report
+  it = diff2.find("obj3");
+  EXPECT_EQ(diff2.end(), it);
+  EXPECT_EQ(1, diff2.getChanges().size());
 }
 
 TEST(WorldDiff, SetWorld)
@@ -285,34 +279,34 @@ TEST(WorldDiff, SetWorld)
   EXPECT_EQ(0, diff1b.getChanges().size());
   EXPECT_EQ(3, diff2.getChanges().size());
 
-  it = diff1.getChanges().find("objA1");
+  it = diff1.find("objA1");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
-  it = diff1.getChanges().find("objA2");
+  it = diff1.find("objA2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
-  it = diff1.getChanges().find("objA2");
+  it = diff1.find("objA2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
-  it = diff1.getChanges().find("objB1");
+  it = diff1.find("objB1");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
             it->second);
 
-  it = diff1.getChanges().find("objB2");
+  it = diff1.find("objB2");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
             it->second);
 
-  it = diff1.getChanges().find("objB3");
+  it = diff1.find("objB3");
   EXPECT_NE(diff1.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
@@ -327,34 +321,34 @@ TEST(WorldDiff, SetWorld)
   EXPECT_EQ(6, diff1b.getChanges().size());
   EXPECT_EQ(3, diff2.getChanges().size());
 
-  it = diff1b.getChanges().find("objA1");
+  it = diff1b.find("objA1");
   EXPECT_NE(diff1b.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
-  it = diff1b.getChanges().find("objA2");
+  it = diff1b.find("objA2");
   EXPECT_NE(diff1b.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
-  it = diff1b.getChanges().find("objA2");
+  it = diff1b.find("objA2");
   EXPECT_NE(diff1b.end(), it);
   EXPECT_EQ(collision_detection::World::DESTROY,
             it->second);
 
-  it = diff1b.getChanges().find("objB1");
+  it = diff1b.find("objB1");
   EXPECT_NE(diff1b.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
             it->second);
 
-  it = diff1b.getChanges().find("objB2");
+  it = diff1b.find("objB2");
   EXPECT_NE(diff1b.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
             it->second);
 
-  it = diff1b.getChanges().find("objB3");
+  it = diff1b.find("objB3");
   EXPECT_NE(diff1b.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE,
@@ -390,7 +384,7 @@ TEST(WorldDiff, SetWorld)
   EXPECT_EQ(7, diff1b.getChanges().size());
   EXPECT_EQ(7, diff2.getChanges().size());
 
-  it = diff2.getChanges().find("objC");
+  it = diff2.find("objC");
   EXPECT_NE(diff2.end(), it);
   EXPECT_EQ(collision_detection::World::CREATE |
             collision_detection::World::ADD_SHAPE |
@@ -418,6 +412,67 @@ TEST(WorldDiff, SetWorld)
 
 }
 
+TEST(WorldDiff, Coalesce)
+{
+  collision_detection::WorldPtr world(new collision_detection::World);
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+
+  world->addToObject("old", box, Eigen::Affine3d::Identity());
+  world->addToObject("recreated", box, Eigen::Affine3d::Identity());
+
+  collision_detection::WorldDiff diff(world);
+  collision_detection::WorldDiff::const_iterator it;
+
+  // create -> move -> move collapses to a single create
+  world->addToObject("new", ball, Eigen::Affine3d::Identity());
+  EXPECT_TRUE(world->moveShapeInObject("new", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,1))));
+  EXPECT_TRUE(world->moveShapeInObject("new", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,2))));
+
+  EXPECT_EQ(1, diff.size());
+  it = diff.find("new");
+  ASSERT_NE(diff.end(), it);
+  EXPECT_EQ(collision_detection::World::CREATE |
+            collision_detection::World::ADD_SHAPE,
+            it->second);
+
+  // moves of an object that existed before are recorded once
+  EXPECT_TRUE(world->moveShapeInObject("old", box, Eigen::Affine3d(Eigen::Translation3d(1,0,0))));
+  EXPECT_TRUE(world->moveShapeInObject("old", box, Eigen::Affine3d(Eigen::Translation3d(2,0,0))));
+  EXPECT_EQ(2, diff.size());
+  it = diff.find("old");
+  ASSERT_NE(diff.end(), it);
+  EXPECT_EQ(collision_detection::World::MOVE_SHAPE,
+            it->second);
+
+  // an object that existed before, then was removed and added again, is replaced
+  world->removeObject("recreated");
+  world->addToObject("recreated", ball, Eigen::Affine3d::Identity());
+  EXPECT_TRUE(world->moveShapeInObject("recreated", ball, Eigen::Affine3d(Eigen::Translation3d(0,1,0))));
+  EXPECT_EQ(3, diff.size());
+  it = diff.find("recreated");
+  ASSERT_NE(diff.end(), it);
+  EXPECT_EQ(collision_detection::World::DESTROY |
+            collision_detection::World::CREATE |
+            collision_detection::World::ADD_SHAPE,
+            it->second);
+
+  // an object created and destroyed while recording leaves no change behind
+  world->removeObject("new");
+  EXPECT_EQ(2, diff.size());
+  EXPECT_EQ(diff.end(), diff.find("new"));
+  EXPECT_NE(diff.end(), diff.find("old"));
+  EXPECT_NE(diff.end(), diff.find("recreated"));
+
+  // the remaining changes are still found after the removal reordered them
+  world->removeObject("recreated");
+  it = diff.find("recreated");
+  ASSERT_NE(diff.end(), it);
+  EXPECT_EQ(collision_detection::World::DESTROY,
+            it->second);
+  EXPECT_EQ(2, diff.size());
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,83 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_DISTANCE_FIELD_COLLISION_ROBOT_DISTANCE_FIELD_
+#define MOVEIT_COLLISION_DETECTION_DISTANCE_FIELD_COLLISION_ROBOT_DISTANCE_FIELD_
+
+#include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <eigen_stl_containers/eigen_stl_containers.h>
+
+namespace collision_detection
+{
+
+  /** \brief A collision robot whose links are also approximated by spheres, for checks against a distance field
+      (see CollisionWorldDistanceField). Self collisions and collisions with other robots are checked as in CollisionRobotFCL. */
+  class CollisionRobotDistanceField : public CollisionRobotFCL
+  {
+  public:
+
+    /** \brief A set of spheres that covers a body, expressed in the frame of the body */
+    struct BodySpheres
+    {
+      EigenSTL::vector_Vector3d centers_;
+      std::vector<double>       radii_;
+    };
+
+    CollisionRobotDistanceField(const robot_model::RobotModelConstPtr &kmodel, double padding = 0.0, double scale = 1.0);
+
+    CollisionRobotDistanceField(const CollisionRobotDistanceField &other);
+
+    /** \brief Get the spheres of the links, indexed by LinkModel::getTreeIndex(), in the frame of the collision body of each link.
+        Links without geometry have no spheres. The spheres include the padding and scaling of the links. */
+    const std::vector<BodySpheres>& getLinkSpheres() const
+    {
+      return link_spheres_;
+    }
+
+    /** \brief Compute spheres that cover \e shape, scaled by \e scale and padded by \e padding, in the frame of the shape.
+        A sphere is represented exactly; other shapes are covered by a row of spheres along the axis of their bounding cylinder.
+        Return false if no spheres can be computed for the type of \e shape. */
+    static bool computeBodySpheres(const shapes::Shape *shape, double scale, double padding, BodySpheres &spheres);
+
+  protected:
+
+    virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
+    void updateLinkSpheres(const robot_model::LinkModel *lmodel);
+
+    std::vector<BodySpheres> link_spheres_;
+  };
+
+}
+
+#endif
@@ -0,0 +1,136 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_DISTANCE_FIELD_COLLISION_WORLD_DISTANCE_FIELD_
+#define MOVEIT_COLLISION_DETECTION_DISTANCE_FIELD_COLLISION_WORLD_DISTANCE_FIELD_
+
+#include <moveit/collision_detection_distance_field/collision_robot_distance_field.h>
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/distance_field/world_distance_field.h>
+#include <boost/scoped_ptr.hpp>
+
+namespace collision_detection
+{
+
+  /** \brief A collision world that represents its objects in a signed PropagationDistanceField, kept up to date as the world
+      changes. Robots are checked as sets of spheres (see CollisionRobotDistanceField), with one distance lookup per sphere,
+      independently of the number and complexity of the world objects. Distances are measured to the centers of the obstacle
+      cells, less half the resolution of the field. Spheres the field cannot bound (those that reach outside its volume or
+      beyond the distance it propagates) are checked exactly against the shapes of the world objects instead.
+      Queries this world cannot answer (continuous checks, checks between worlds, robots that are not
+      CollisionRobotDistanceField) log an error and report a collision (or a distance of 0), never a collision-free result. */
+  class CollisionWorldDistanceField : public CollisionWorld
+  {
+  public:
+
+    CollisionWorldDistanceField();
+    explicit CollisionWorldDistanceField(const WorldPtr& world);
+
+    /** \brief Construct a world whose distance field covers the box of dimensions \e size with its minimum corner at \e origin,
+        at the given \e resolution, with distances propagated up to \e max_distance */
+    CollisionWorldDistanceField(const WorldPtr& world, const Eigen::Vector3d &size, const Eigen::Vector3d &origin,
+                                double resolution, double max_distance);
+
+    CollisionWorldDistanceField(const CollisionWorldDistanceField &other, const WorldPtr& world);
+    virtual ~CollisionWorldDistanceField();
+
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
+    virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const;
+    virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const;
+
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm, double max_distance) const;
+    virtual double distanceWorld(const CollisionWorld &world) const;
+    virtual double distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const;
+
+    virtual void setWorld(const WorldPtr& world);
+
+    /** \brief Get the distance field that represents the world */
+    const boost::shared_ptr<const distance_field::PropagationDistanceField>& getDistanceField() const
+    {
+      return const_field_;
+    }
+
+  protected:
+
+    /** \brief The spheres of the bodies of a robot state that are checked, in the world frame */
+    struct StateSpheres
+    {
+      EigenSTL::vector_Vector3d                      centers_;
+      std::vector<double>                            radii_;
+      /// for each sphere, the index of its body in \e bodies_
+      std::vector<std::size_t>                       body_index_;
+      std::vector<std::pair<std::string, BodyType> > bodies_;
+    };
+
+    void getStateSpheres(const CollisionRobotDistanceField &robot, const robot_state::RobotState &state, const std::string &group_name,
+                         const AllowedCollisionMatrix *acm, StateSpheres &spheres) const;
+    bool isCollisionAlwaysAllowed(const std::string &body_name, const AllowedCollisionMatrix *acm) const;
+
+    /** \brief Check whether the field bounds the clearance of the sphere at \e center with \e radius, given the \e distance
+        of its center in the field: the sphere, enlarged by a cell, must be inside the field, and either its distance is below
+        the propagated distance or the propagated distance alone keeps the sphere clear */
+    bool isSphereKnown(const Eigen::Vector3d &center, double radius, double distance) const;
+
+    /** \brief Get the clearance of the sphere at \e center with \e radius from the world objects \e body_name may not touch,
+        by checking the shapes of the objects. If the clearance is negative, \e contact describes the deepest contact found. */
+    double getExactSphereClearance(const Eigen::Vector3d &center, double radius, const std::string &body_name,
+                                   const AllowedCollisionMatrix *acm, Contact &contact) const;
+
+    /** \brief Find the occupied cell nearest to \e center, within \e radius, of an object \e body_name may not touch.
+        Returns false if there is none; \e found_any is set if occupied cells of other objects are within \e radius. */
+    bool findBlockingCell(const Eigen::Vector3d &center, double radius, const std::string &body_name, const AllowedCollisionMatrix *acm,
+                          Eigen::Vector3i &cell, std::string &object_id, bool &found_any) const;
+    const CollisionRobotDistanceField* getDistanceFieldRobot(const CollisionRobot &robot) const;
+
+    void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    double distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm, double max_distance) const;
+
+  private:
+
+    void initialize(const Eigen::Vector3d &size, const Eigen::Vector3d &origin, double resolution, double max_distance);
+
+    boost::shared_ptr<distance_field::PropagationDistanceField>       field_;
+    boost::shared_ptr<const distance_field::PropagationDistanceField> const_field_;
+    boost::scoped_ptr<distance_field::WorldDistanceField>           world_field_;
+  };
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection_distance_field/collision_robot_distance_field.h>
+#include <geometric_shapes/bodies.h>
+#include <boost/scoped_ptr.hpp>
+#include <cmath>
+
+collision_detection::CollisionRobotDistanceField::CollisionRobotDistanceField(const robot_model::RobotModelConstPtr &kmodel, double padding, double scale) :
+  CollisionRobotFCL(kmodel, padding, scale)
+{
+  link_spheres_.resize(links_.size());
+  for (std::size_t i = 0 ; i < links_.size() ; ++i)
+    if (links_[i] && links_[i]->getShape())
+      updateLinkSpheres(links_[i]);
+}
+
+collision_detection::CollisionRobotDistanceField::CollisionRobotDistanceField(const CollisionRobotDistanceField &other) :
+  CollisionRobotFCL(other), link_spheres_(other.link_spheres_)
+{
+}
+
+bool collision_detection::CollisionRobotDistanceField::computeBodySpheres(const shapes::Shape *shape, double scale, double padding, BodySpheres &spheres)
+{
+  spheres.centers_.clear();
+  spheres.radii_.clear();
+
+  if (shape->type == shapes::SPHERE)
+  {
+    spheres.centers_.push_back(Eigen::Vector3d::Zero());
+    spheres.radii_.push_back(static_cast<const shapes::Sphere*>(shape)->radius * scale + padding);
+    return true;
+  }
+
+  boost::scoped_ptr<bodies::Body> body(bodies::createBodyFromShape(shape));
+  if (!body)
+    return false;
+  body->setScale(scale);
+  body->setPadding(padding);
+
+  // split the bounding cylinder into segments about as long as they are wide;
+  // the sphere around each segment covers it entirely
+  bodies::BoundingCylinder cylinder;
+  body->computeBoundingCylinder(cylinder);
+  unsigned int count = cylinder.radius > 0.0 ? (unsigned int)ceil(cylinder.length / (2.0 * cylinder.radius)) : 1;
+  if (count < 1)
+    count = 1;
+  double half_length = cylinder.length / (2.0 * count);
+  double radius = sqrt(cylinder.radius * cylinder.radius + half_length * half_length);
+  for (unsigned int i = 0 ; i < count ; ++i)
+  {
+    spheres.centers_.push_back(cylinder.pose * Eigen::Vector3d(0.0, 0.0, -cylinder.length / 2.0 + (2 * i + 1) * half_length));
+    spheres.radii_.push_back(radius);
+  }
+  return true;
+}
+
+void collision_detection::CollisionRobotDistanceField::updateLinkSpheres(const robot_model::LinkModel *lmodel)
+{
+  BodySpheres &spheres = link_spheres_[lmodel->getTreeIndex()];
+  if (!computeBodySpheres(lmodel->getShape().get(), getLinkScale(lmodel->getName()), getLinkPadding(lmodel->getName()), spheres))
+    logWarn("Unable to compute collision spheres for link '%s'; it will not be checked against the distance field", lmodel->getName().c_str());
+}
+
+void collision_detection::CollisionRobotDistanceField::updatedPaddingOrScaling(const std::vector<std::string> &links)
+{
+  CollisionRobotFCL::updatedPaddingOrScaling(links);
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const robot_model::LinkModel *lmodel = kmodel_->getLinkModel(links[i]);
+    // unknown links are reported by CollisionRobotFCL
+    if (lmodel && links_[lmodel->getTreeIndex()] && lmodel->getShape())
+      updateLinkSpheres(lmodel);
+  }
+}
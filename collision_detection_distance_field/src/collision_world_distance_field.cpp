@@ -0,0 +1,510 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection_distance_field/collision_detector_allocator_distance_field.h>
+#include <moveit/collision_detection_fcl/collision_common.h>
+#include <fcl/shape/geometric_shapes.h>
+#include <limits>
+
+namespace collision_detection
+{
+namespace
+{
+
+// the default field is a 3m cube centered at the origin of the world
+const double DEFAULT_SIZE = 3.0;
+const double DEFAULT_RESOLUTION = 0.04;
+const double DEFAULT_MAX_DISTANCE = 0.5;
+
+// queries the field cannot answer are reported as collisions, so they are never mistaken for collision-free ones
+void reportUnsupported(const char *what, CollisionResult &res)
+{
+  logError("%s is not implemented for distance fields; reporting a collision", what);
+  res.collision = true;
+  res.distance = 0.0;
+  res.time_of_contact = 0.0;
+}
+
+}
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField() :
+  CollisionWorld()
+{
+  initialize(Eigen::Vector3d::Constant(DEFAULT_SIZE), Eigen::Vector3d::Constant(-DEFAULT_SIZE / 2.0), DEFAULT_RESOLUTION, DEFAULT_MAX_DISTANCE);
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField(const WorldPtr& world) :
+  CollisionWorld(world)
+{
+  initialize(Eigen::Vector3d::Constant(DEFAULT_SIZE), Eigen::Vector3d::Constant(-DEFAULT_SIZE / 2.0), DEFAULT_RESOLUTION, DEFAULT_MAX_DISTANCE);
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField(const WorldPtr& world, const Eigen::Vector3d &size, const Eigen::Vector3d &origin,
+                                                                              double resolution, double max_distance) :
+  CollisionWorld(world)
+{
+  initialize(size, origin, resolution, max_distance);
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField(const CollisionWorldDistanceField &other, const WorldPtr& world) :
+  CollisionWorld(other, world)
+{
+  // the field is rebuilt from the world, which has the same objects as the world of other
+  initialize(Eigen::Vector3d(other.field_->getSizeX(), other.field_->getSizeY(), other.field_->getSizeZ()),
+             Eigen::Vector3d(other.field_->getOriginX(), other.field_->getOriginY(), other.field_->getOriginZ()),
+             other.field_->getResolution(), other.field_->getUninitializedDistance());
+}
+
+collision_detection::CollisionWorldDistanceField::~CollisionWorldDistanceField()
+{
+}
+
+void collision_detection::CollisionWorldDistanceField::initialize(const Eigen::Vector3d &size, const Eigen::Vector3d &origin, double resolution, double max_distance)
+{
+  field_.reset(new distance_field::PropagationDistanceField(size.x(), size.y(), size.z(), resolution,
+                                                            origin.x(), origin.y(), origin.z(), max_distance, true));
+  const_field_ = field_;
+  world_field_.reset(new distance_field::WorldDistanceField(getWorld(), field_));
+}
+
+void collision_detection::CollisionWorldDistanceField::setWorld(const WorldPtr& world)
+{
+  if (world == getWorld())
+    return;
+  CollisionWorld::setWorld(world);
+  world_field_->setWorld(getWorld());
+}
+
+const collision_detection::CollisionRobotDistanceField* collision_detection::CollisionWorldDistanceField::getDistanceFieldRobot(const CollisionRobot &robot) const
+{
+  const CollisionRobotDistanceField *df_robot = dynamic_cast<const CollisionRobotDistanceField*>(&robot);
+  if (!df_robot)
+    logError("A distance field collision world can only check robots of type CollisionRobotDistanceField");
+  return df_robot;
+}
+
+bool collision_detection::CollisionWorldDistanceField::isCollisionAlwaysAllowed(const std::string &body_name, const AllowedCollisionMatrix *acm) const
+{
+  if (!acm)
+    return false;
+  std::vector<std::string> ids = getWorld()->getObjectIds();
+  if (ids.empty())
+    return false;
+  for (std::size_t i = 0 ; i < ids.size() ; ++i)
+  {
+    AllowedCollision::Type type;
+    if (!acm->getAllowedCollision(body_name, ids[i], type) || type != AllowedCollision::ALWAYS)
+      return false;
+  }
+  return true;
+}
+
+bool collision_detection::CollisionWorldDistanceField::isSphereKnown(const Eigen::Vector3d &center, double radius, double distance) const
+{
+  // obstacles outside the field are not represented, so the sphere and its neighboring cells must be inside it
+  const double margin = radius + field_->getResolution();
+  int x, y, z;
+  if (!field_->worldToGrid(center.x() - margin, center.y() - margin, center.z() - margin, x, y, z) ||
+      !field_->worldToGrid(center.x() + margin, center.y() + margin, center.z() + margin, x, y, z))
+    return false;
+
+  // distances are saturated at the propagated distance, which may be less than the radius
+  const double max_distance = field_->getUninitializedDistance();
+  return distance < max_distance || max_distance - 0.5 * field_->getResolution() - radius >= 0.0;
+}
+
+double collision_detection::CollisionWorldDistanceField::getExactSphereClearance(const Eigen::Vector3d &center, double radius, const std::string &body_name,
+                                                                                 const AllowedCollisionMatrix *acm, Contact &contact) const
+{
+  fcl::CollisionObject sphere(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Sphere(radius)),
+                              fcl::Transform3f(fcl::Vec3f(center.x(), center.y(), center.z())));
+  double clearance = std::numeric_limits<double>::max();
+  const WorldConstPtr &world = getWorld();
+  for (World::const_iterator it = world->begin() ; it != world->end() ; ++it)
+  {
+    AllowedCollision::Type type;
+    if (acm && acm->getAllowedCollision(body_name, it->first, type) && type == AllowedCollision::ALWAYS)
+      continue;
+    const World::Object &obj = *it->second;
+    for (std::size_t j = 0 ; j < obj.shapes_.size() ; ++j)
+    {
+      FCLGeometryConstPtr g = createCollisionGeometry(obj.shapes_[j], &obj);
+      if (!g || !g->collision_geometry_)
+        continue;
+      fcl::CollisionObject shape(g->collision_geometry_, transform2fcl(obj.shape_poses_[j]));
+      fcl::DistanceResult dres;
+      double d = fcl::distance(&sphere, &shape, fcl::DistanceRequest(), dres);
+      if (d > 0.0)
+      {
+        clearance = std::min(clearance, d);
+        continue;
+      }
+
+      // FCL gives no depth for overlapping shapes; the deepest contact provides it
+      fcl::CollisionResult cres;
+      fcl::collide(&sphere, &shape, fcl::CollisionRequest(std::numeric_limits<size_t>::max(), true), cres);
+      double depth = 0.0;
+      int deepest = -1;
+      for (std::size_t k = 0 ; k < cres.numContacts() ; ++k)
+        if (deepest < 0 || cres.getContact(k).penetration_depth > depth)
+        {
+          deepest = k;
+          depth = cres.getContact(k).penetration_depth;
+        }
+      if (-depth < clearance)
+      {
+        clearance = -depth;
+        contact.body_name_2 = it->first;
+        if (deepest >= 0)
+        {
+          const fcl::Contact &fc = cres.getContact(deepest);
+          contact.pos = Eigen::Vector3d(fc.pos[0], fc.pos[1], fc.pos[2]);
+          // FCL normals point from the sphere towards the object; contacts here point towards the body
+          contact.normal = -Eigen::Vector3d(fc.normal[0], fc.normal[1], fc.normal[2]);
+        }
+        else
+        {
+          contact.pos = center;
+          contact.normal.setZero();
+        }
+      }
+    }
+  }
+  contact.depth = clearance < 0.0 ? -clearance : 0.0;
+  return clearance;
+}
+
+bool collision_detection::CollisionWorldDistanceField::findBlockingCell(const Eigen::Vector3d &center, double radius, const std::string &body_name,
+                                                                        const AllowedCollisionMatrix *acm, Eigen::Vector3i &cell, std::string &object_id,
+                                                                        bool &found_any) const
+{
+  // every occupied cell within the radius is considered, so an allowed object nearer to the center can not hide another
+  int min_x, min_y, min_z, max_x, max_y, max_z;
+  field_->worldToGrid(center.x() - radius, center.y() - radius, center.z() - radius, min_x, min_y, min_z);
+  field_->worldToGrid(center.x() + radius, center.y() + radius, center.z() + radius, max_x, max_y, max_z);
+  found_any = false;
+  double best = radius;
+  bool found = false;
+  std::vector<std::string> ids;
+  for (int x = min_x ; x <= max_x ; ++x)
+    for (int y = min_y ; y <= max_y ; ++y)
+      for (int z = min_z ; z <= max_z ; ++z)
+      {
+        if (!field_->isCellValid(x, y, z) || field_->getCell(x, y, z).distance_square_ != 0)
+          continue;
+        Eigen::Vector3d p;
+        field_->gridToWorld(x, y, z, p.x(), p.y(), p.z());
+        double d = (p - center).norm();
+        if (d >= best)
+          continue;
+        ids.clear();
+        world_field_->getObjectsAtCell(x, y, z, ids);
+        for (std::size_t j = 0 ; j < ids.size() ; ++j)
+        {
+          found_any = true;
+          AllowedCollision::Type type;
+          if (!acm || !acm->getAllowedCollision(body_name, ids[j], type) || type != AllowedCollision::ALWAYS)
+          {
+            best = d;
+            found = true;
+            cell = Eigen::Vector3i(x, y, z);
+            object_id = ids[j];
+            break;
+          }
+        }
+      }
+  return found;
+}
+
+void collision_detection::CollisionWorldDistanceField::getStateSpheres(const CollisionRobotDistanceField &robot, const robot_state::RobotState &state,
+                                                                       const std::string &group_name, const AllowedCollisionMatrix *acm,
+                                                                       StateSpheres &spheres) const
+{
+  const robot_model::RobotModelConstPtr &kmodel = state.getRobotModel();
+  const std::set<const robot_model::LinkModel*> *active = NULL;
+  if (kmodel->hasJointModelGroup(group_name))
+    active = &kmodel->getJointModelGroup(group_name)->getUpdatedLinkModelsWithGeometrySet();
+
+  const std::vector<CollisionRobotDistanceField::BodySpheres> &link_spheres = robot.getLinkSpheres();
+  const std::vector<robot_state::LinkState*> &link_states = state.getLinkStateVector();
+  for (std::size_t i = 0 ; i < link_states.size() ; ++i)
+  {
+    const robot_model::LinkModel *lmodel = link_states[i]->getLinkModel();
+    const CollisionRobotDistanceField::BodySpheres &body = link_spheres[lmodel->getTreeIndex()];
+    if (body.centers_.empty() || (active && active->find(lmodel) == active->end()) ||
+        isCollisionAlwaysAllowed(lmodel->getName(), acm))
+      continue;
+    const Eigen::Affine3d &pose = link_states[i]->getGlobalCollisionBodyTransform();
+    for (std::size_t j = 0 ; j < body.centers_.size() ; ++j)
+    {
+      spheres.centers_.push_back(pose * body.centers_[j]);
+      spheres.radii_.push_back(body.radii_[j]);
+      spheres.body_index_.push_back(spheres.bodies_.size());
+    }
+    spheres.bodies_.push_back(std::make_pair(lmodel->getName(), BodyTypes::ROBOT_LINK));
+  }
+
+  // attached bodies change with the state, so their spheres are computed here
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  state.getAttachedBodies(attached_bodies);
+  for (std::size_t i = 0 ; i < attached_bodies.size() ; ++i)
+  {
+    const robot_state::AttachedBody *ab = attached_bodies[i];
+    if ((active && active->find(ab->getAttachedLink()) == active->end()) || isCollisionAlwaysAllowed(ab->getName(), acm))
+      continue;
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab->getShapes();
+    const EigenSTL::vector_Affine3d &poses = ab->getGlobalCollisionBodyTransforms();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    {
+      CollisionRobotDistanceField::BodySpheres body;
+      if (!CollisionRobotDistanceField::computeBodySpheres(shapes[j].get(), 1.0, 0.0, body))
+        continue;
+      for (std::size_t k = 0 ; k < body.centers_.size() ; ++k)
+      {
+        spheres.centers_.push_back(poses[j] * body.centers_[k]);
+        spheres.radii_.push_back(body.radii_[k]);
+        spheres.body_index_.push_back(spheres.bodies_.size());
+      }
+    }
+    spheres.bodies_.push_back(std::make_pair(ab->getName(), BodyTypes::ROBOT_ATTACHED));
+  }
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                                 const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotDistanceField *df_robot = getDistanceFieldRobot(robot);
+  if (!df_robot)
+  {
+    // reported as a collision, never as collision-free
+    res.collision = true;
+    return;
+  }
+
+  StateSpheres spheres;
+  getStateSpheres(*df_robot, state, req.group_name, acm, spheres);
+
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  std::vector<bool> in_bounds;
+  field_->getDistanceGradients(spheres.centers_, distances, gradients, in_bounds);
+
+  const double cell_offset = 0.5 * field_->getResolution();
+  const double max_distance = field_->getUninitializedDistance();
+  for (std::size_t i = 0 ; i < spheres.centers_.size() ; ++i)
+  {
+    const std::pair<std::string, BodyType> &body = spheres.bodies_[spheres.body_index_[i]];
+    const Eigen::Vector3d &center = spheres.centers_[i];
+    const double radius = spheres.radii_[i];
+    Contact c;
+    double clearance;
+    if (!in_bounds[i] || !isSphereKnown(center, radius, distances[i]))
+    {
+      // the field can not tell whether the sphere is clear, so its shape is checked against the objects
+      clearance = getExactSphereClearance(center, radius, body.first, acm, c);
+      if (req.distance && clearance < res.distance)
+        res.distance = clearance;
+      if (clearance >= 0.0)
+        continue;
+    }
+    else
+    {
+      // further than the propagated distance from any obstacle; the propagated distance bounds the clearance
+      if (distances[i] >= max_distance)
+        continue;
+      clearance = distances[i] - cell_offset - radius;
+      if (clearance >= 0.0)
+      {
+        if (req.distance && clearance < res.distance)
+          res.distance = clearance;
+        continue;
+      }
+
+      // the sphere reaches occupied cells; only those of objects the body may not touch are collisions
+      Eigen::Vector3i obstacle;
+      bool found_any;
+      if (findBlockingCell(center, radius + cell_offset, body.first, acm, obstacle, c.body_name_2, found_any))
+      {
+        field_->gridToWorld(obstacle.x(), obstacle.y(), obstacle.z(), c.pos.x(), c.pos.y(), c.pos.z());
+        // the normal points from the obstacle towards the body
+        Eigen::Vector3d n = center - c.pos;
+        c.normal = n.norm() > 0.0 ? Eigen::Vector3d(n.normalized()) :
+          (gradients[i].norm() > 0.0 ? Eigen::Vector3d(gradients[i].normalized()) : Eigen::Vector3d(Eigen::Vector3d::Zero()));
+        clearance = n.norm() - cell_offset - radius;
+        c.depth = -clearance;
+      }
+      else if (found_any)
+      {
+        // only allowed objects are that close
+        if (req.distance && res.distance > 0.0)
+          res.distance = 0.0;
+        continue;
+      }
+      else
+      {
+        // occupied cells without a known object are collisions as well
+        int x, y, z;
+        field_->worldToGrid(center.x(), center.y(), center.z(), x, y, z);
+        field_->gridToWorld(x, y, z, c.pos.x(), c.pos.y(), c.pos.z());
+        c.normal = gradients[i].norm() > 0.0 ? Eigen::Vector3d(gradients[i].normalized()) : Eigen::Vector3d(Eigen::Vector3d::Zero());
+        c.depth = -clearance;
+      }
+      if (req.distance && clearance < res.distance)
+        res.distance = clearance;
+    }
+    const std::string &object_id = c.body_name_2;
+
+    res.collision = true;
+    if (req.verbose)
+      logInform("Found a contact between '%s' (type '%s') and '%s' (type 'Object'), which constitutes a collision. Penetration depth is %lf",
+                body.first.c_str(), body.second == BodyTypes::ROBOT_LINK ? "Robot link" : "Robot attached", object_id.c_str(), -clearance);
+
+    if (req.contacts && res.contact_count < req.max_contacts)
+    {
+      std::vector<Contact> &contacts = res.contacts[std::make_pair(body.first, object_id)];
+      if (contacts.size() < req.max_contacts_per_pair)
+      {
+        c.body_name_1 = body.first;
+        c.body_type_1 = body.second;
+        c.body_type_2 = BodyTypes::WORLD_OBJECT;
+        if (!object_id.empty())
+          c.body_handle_2 = getWorld()->getObjectHandle(object_id);
+        contacts.push_back(c);
+        res.contact_count++;
+      }
+    }
+
+    if (req.is_done && req.is_done(res))
+      break;
+    if (!req.distance && (!req.contacts || res.contact_count >= req.max_contacts))
+      break;
+  }
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  checkRobotCollisionHelper(req, res, robot, state, NULL);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollisionHelper(req, res, robot, state, &acm);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
+{
+  reportUnsupported("Continuous collision checking", res);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
+{
+  reportUnsupported("Continuous collision checking", res);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
+{
+  reportUnsupported("Collision checking between worlds", res);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const
+{
+  reportUnsupported("Collision checking between worlds", res);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state,
+                                                                             const AllowedCollisionMatrix *acm, double max_distance) const
+{
+  // a robot that cannot be checked is reported as in contact
+  const CollisionRobotDistanceField *df_robot = getDistanceFieldRobot(robot);
+  if (!df_robot)
+    return 0.0;
+
+  StateSpheres spheres;
+  getStateSpheres(*df_robot, state, "", acm, spheres);
+  std::vector<double> distances;
+  field_->getDistances(spheres.centers_, distances);
+
+  // distances are only known up to the distance propagated in the field; spheres the field can not bound are checked exactly
+  const double cell_offset = 0.5 * field_->getResolution();
+  const double field_max_distance = field_->getUninitializedDistance();
+  double d = max_distance;
+  for (std::size_t i = 0 ; i < distances.size() ; ++i)
+  {
+    const Eigen::Vector3d &center = spheres.centers_[i];
+    const double radius = spheres.radii_[i];
+    if (!isSphereKnown(center, radius, distances[i]))
+    {
+      Contact c;
+      d = std::min(d, getExactSphereClearance(center, radius, spheres.bodies_[spheres.body_index_[i]].first, acm, c));
+    }
+    else
+      d = std::min(d, std::min(distances[i], field_max_distance) - cell_offset - radius);
+  }
+  return d;
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  return distanceRobotHelper(robot, state, NULL, std::numeric_limits<double>::max());
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  return distanceRobotHelper(robot, state, &acm, std::numeric_limits<double>::max());
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const
+{
+  return distanceRobotHelper(robot, state, NULL, max_distance);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm, double max_distance) const
+{
+  return distanceRobotHelper(robot, state, &acm, max_distance);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceWorld(const CollisionWorld &world) const
+{
+  logError("Distance computation between worlds is not implemented for distance fields; reporting contact");
+  return 0.0;
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const
+{
+  logError("Distance computation between worlds is not implemented for distance fields; reporting contact");
+  return 0.0;
+}
+
+const std::string collision_detection::CollisionDetectorAllocatorDistanceField::NAME_("DistanceField");
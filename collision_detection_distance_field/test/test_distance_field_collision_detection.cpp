@@ -0,0 +1,319 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/test_resources/config.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/collision_detection_distance_field/collision_detector_allocator_distance_field.h>
+
+#include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/shape_operations.h>
+
+#include <gtest/gtest.h>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+static std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+static std::string srdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string();
+
+class DistanceFieldCollisionDetectionTester : public testing::Test
+{
+
+protected:
+
+  virtual void SetUp()
+  {
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+
+    if (xml_file.is_open())
+    {
+      while ( xml_file.good() )
+      {
+        std::string line;
+        std::getline( xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+      urdf_ok_ = urdf_model_;
+    }
+    else
+    {
+      EXPECT_EQ("FAILED TO OPEN FILE", urdf_file);
+      urdf_ok_ = false;
+    }
+    srdf_ok_ = srdf_model_->initFile(*urdf_model_, srdf_file);
+
+    kmodel_.reset(new robot_model::RobotModel(urdf_model_, srdf_model_));
+
+    acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+
+    allocator_ = collision_detection::CollisionDetectorAllocatorDistanceField::create();
+    crobot_ = allocator_->allocateRobot(kmodel_);
+    cworld_ = allocator_->allocateWorld(collision_detection::WorldPtr(new collision_detection::World()));
+  }
+
+  virtual void TearDown()
+  {
+
+  }
+
+protected:
+
+  bool urdf_ok_;
+  bool srdf_ok_;
+
+  boost::shared_ptr<urdf::ModelInterface>  urdf_model_;
+  boost::shared_ptr<srdf::Model>           srdf_model_;
+
+  robot_model::RobotModelPtr               kmodel_;
+
+  collision_detection::CollisionDetectorAllocatorPtr            allocator_;
+  boost::shared_ptr<collision_detection::CollisionRobot>        crobot_;
+  boost::shared_ptr<collision_detection::CollisionWorld>        cworld_;
+
+  collision_detection::AllowedCollisionMatrixPtr acm_;
+
+  // attach a ball of the given radius to the gripper and return its center
+  Eigen::Vector3d attachBall(robot_state::RobotState &kstate, double radius)
+  {
+    std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Sphere(radius)));
+    EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+    kstate.attachBody("ball", shapes, poses, std::vector<std::string>(), "r_gripper_palm_link");
+    kstate.updateLinkTransforms();
+    return kstate.getAttachedBody("ball")->getGlobalCollisionBodyTransforms()[0].translation();
+  }
+
+  // add a box to the world that only the ball may collide with
+  void addBox(const collision_detection::WorldPtr &world, const std::string &id, double side, const Eigen::Vector3d &center)
+  {
+    Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+    pose.translation() = center;
+    world->addToObject(id, shapes::ShapeConstPtr(new shapes::Box(side, side, side)), pose);
+    acm_->setEntry(id, kmodel_->getLinkModelNames(), true);
+  }
+};
+
+TEST_F(DistanceFieldCollisionDetectionTester, InitOK)
+{
+  ASSERT_TRUE(urdf_ok_);
+  ASSERT_TRUE(srdf_ok_);
+  EXPECT_EQ("DistanceField", allocator_->getName());
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, SpheresCoverShapes)
+{
+  shapes::Box box(.2, .1, .6);
+  collision_detection::CollisionRobotDistanceField::BodySpheres spheres;
+  ASSERT_TRUE(collision_detection::CollisionRobotDistanceField::computeBodySpheres(&box, 1.0, 0.0, spheres));
+  ASSERT_FALSE(spheres.centers_.empty());
+  EXPECT_GT(spheres.centers_.size(), 1u);
+
+  // every corner of the box is within one of the spheres
+  for (int i = 0 ; i < 8 ; ++i)
+  {
+    Eigen::Vector3d corner(i & 1 ? .1 : -.1, i & 2 ? .05 : -.05, i & 4 ? .3 : -.3);
+    bool covered = false;
+    for (std::size_t j = 0 ; j < spheres.centers_.size() ; ++j)
+      if ((corner - spheres.centers_[j]).norm() <= spheres.radii_[j] + 1e-9)
+        covered = true;
+    EXPECT_TRUE(covered);
+  }
+
+  shapes::Sphere sphere(.1);
+  ASSERT_TRUE(collision_detection::CollisionRobotDistanceField::computeBodySpheres(&sphere, 2.0, .01, spheres));
+  ASSERT_EQ(1u, spheres.centers_.size());
+  EXPECT_NEAR(.21, spheres.radii_[0], 1e-9);
+
+  // every link with geometry has spheres
+  const collision_detection::CollisionRobotDistanceField &robot = dynamic_cast<const collision_detection::CollisionRobotDistanceField&>(*crobot_);
+  const std::vector<robot_model::LinkModel*> &links = kmodel_->getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    if (links[i]->getShape() && links[i]->getShape()->type != shapes::OCTREE)
+      EXPECT_FALSE(robot.getLinkSpheres()[links[i]->getTreeIndex()].centers_.empty()) << links[i]->getName();
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, WorldCollision)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 10;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  Eigen::Affine3d pose = kstate.getLinkState("r_gripper_palm_link")->getGlobalCollisionBodyTransform();
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pose);
+
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  ASSERT_GE(res.contact_count, 1u);
+  ASSERT_TRUE(res.contacts.find(std::make_pair(std::string("r_gripper_palm_link"), std::string("box"))) != res.contacts.end());
+  const collision_detection::Contact &contact = res.contacts[std::make_pair(std::string("r_gripper_palm_link"), std::string("box"))][0];
+  EXPECT_GT(contact.depth, 0.0);
+  EXPECT_EQ(collision_detection::BodyTypes::WORLD_OBJECT, contact.body_type_2);
+  EXPECT_LT(cworld_->distanceRobot(*crobot_, kstate, *acm_), 0.0);
+
+  // collisions with the box can be allowed
+  acm_->setEntry("box", kmodel_->getLinkModelNames(), true);
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // moving the box away updates the field
+  acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+  Eigen::Affine3d far = Eigen::Affine3d::Identity();
+  far.translation() = Eigen::Vector3d(-1.2, -1.2, -1.2);
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], far);
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // a copy of the world has the same field
+  collision_detection::WorldPtr world_copy(new collision_detection::World(*cworld_->getWorld()));
+  collision_detection::CollisionWorldPtr cworld_copy = allocator_->allocateWorld(cworld_, world_copy);
+  world_copy->moveShapeInObject("box", world_copy->getObject("box")->shapes_[0], pose);
+  res = collision_detection::CollisionResult();
+  cworld_copy->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, UnsupportedQueriesReportCollision)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  // the world is empty, but queries the field cannot answer must not look collision-free
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  res = collision_detection::CollisionResult();
+  cworld_->checkWorldCollision(req, res, *cworld_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, SphereLargerThanPropagatedDistance)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  Eigen::Vector3d center = attachBall(kstate, .3);
+
+  // distances are only propagated up to .2, less than the radius of the ball
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::CollisionWorldDistanceField cworld(world, Eigen::Vector3d(2.0, 2.0, 2.0), center - Eigen::Vector3d(1.0, 1.0, 1.0), .04, .2);
+  addBox(world, "box", .1, center + Eigen::Vector3d(.3, 0.0, 0.0));
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 10;
+  collision_detection::CollisionResult res;
+  cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_TRUE(res.contacts.find(std::make_pair(std::string("ball"), std::string("box"))) != res.contacts.end());
+  EXPECT_LT(cworld.distanceRobot(*crobot_, kstate, *acm_), 0.0);
+
+  // further away than the radius, the ball is free
+  world->moveShapeInObject("box", world->getObject("box")->shapes_[0],
+                           Eigen::Affine3d(Eigen::Translation3d(center + Eigen::Vector3d(.45, 0.0, 0.0))));
+  res = collision_detection::CollisionResult();
+  cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_GT(cworld.distanceRobot(*crobot_, kstate, *acm_), 0.0);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, SphereAtFieldBoundary)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  Eigen::Vector3d center = attachBall(kstate, .15);
+
+  // the field ends .1 beyond the center of the ball; the box is entirely outside it, but within the ball
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::CollisionWorldDistanceField cworld(world, Eigen::Vector3d(.6, .6, .6), center - Eigen::Vector3d(.5, .3, .3), .02, .3);
+  addBox(world, "box", .1, center + Eigen::Vector3d(.17, 0.0, 0.0));
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  collision_detection::CollisionResult res;
+  cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_TRUE(res.contacts.find(std::make_pair(std::string("ball"), std::string("box"))) != res.contacts.end());
+  EXPECT_LT(cworld.distanceRobot(*crobot_, kstate, *acm_), 0.0);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, AllowedObjectDoesNotHideOthers)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  Eigen::Vector3d center = attachBall(kstate, .1);
+
+  // the ball may touch the box at its center, but not the one overlapping its edge
+  collision_detection::WorldPtr world = cworld_->getWorld();
+  addBox(world, "allowed", .05, center);
+  addBox(world, "blocked", .05, center + Eigen::Vector3d(.1, 0.0, 0.0));
+  acm_->setEntry("allowed", "ball", true);
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 10;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_TRUE(res.contacts.find(std::make_pair(std::string("ball"), std::string("blocked"))) != res.contacts.end());
+  EXPECT_TRUE(res.contacts.find(std::make_pair(std::string("ball"), std::string("allowed"))) == res.contacts.end());
+
+  // once the other box is allowed as well, there is no collision
+  acm_->setEntry("blocked", "ball", true);
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
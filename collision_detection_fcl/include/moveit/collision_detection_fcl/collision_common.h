@@ -42,6 +42,7 @@
 #include <fcl/broadphase/broadphase.h>
 #include <fcl/collision.h>
 #include <fcl/distance.h>
+#include <boost/unordered_map.hpp>
 #include <set>
 
 namespace collision_detection
@@ -49,19 +50,31 @@ namespace collision_detection
 
 struct CollisionGeometryData
 {
-  CollisionGeometryData(const robot_model::LinkModel *link) : type(BodyTypes::ROBOT_LINK)
+  CollisionGeometryData(const robot_model::LinkModel *link) : type(BodyTypes::ROBOT_LINK), index(link->getTreeIndex()), handle(0)
   {
     ptr.link = link;
   }
 
-  CollisionGeometryData(const robot_state::AttachedBody *ab) : type(BodyTypes::ROBOT_ATTACHED)
+  CollisionGeometryData(const robot_state::AttachedBody *ab) : type(BodyTypes::ROBOT_ATTACHED), index(-1), handle(0)
   {
     ptr.ab = ab;
   }
 
-  CollisionGeometryData(const World::Object *obj) : type(BodyTypes::WORLD_OBJECT)
+  CollisionGeometryData(const World::Object *obj) : type(BodyTypes::WORLD_OBJECT), index(-1), handle(obj ? obj->handle_ : 0)
   {
     ptr.obj = obj;
+    if (obj)
+      object_id = obj->id_;
+  }
+
+  /// Check if this body is an attached body that is allowed to touch the robot link \e link; the touch links are looked up
+  /// by link index (see AttachedBody::getTouchLinkMask()), without comparing names
+  bool isTouchLink(const CollisionGeometryData *link) const
+  {
+    if (type != BodyTypes::ROBOT_ATTACHED || link->index < 0)
+      return false;
+    const std::vector<bool> &touch_links = ptr.ab->getTouchLinkMask();
+    return (std::size_t)link->index < touch_links.size() && touch_links[link->index];
   }
 
   const std::string& getID() const
@@ -75,7 +88,7 @@ struct CollisionGeometryData
     default:
       break;
     }
-    return ptr.obj->id_;
+    return object_id;
   }
 
   std::string getTypeString() const
@@ -93,6 +106,19 @@ struct CollisionGeometryData
   }
 
   BodyType type;
+
+  /// The index of the body in a CompiledAllowedCollisionMatrix built for the link names of the robot model,
+  /// i.e., the tree index of the link. Bodies that are not links have index -1.
+  int      index;
+
+  /// The handle of the body in its world, if the body is a world object; 0 otherwise.
+  /// Contacts with world objects can be traced back to the object through World::getObject() without comparing names.
+  World::ObjectHandle handle;
+
+  /// The id of the world object, if the body is a world object. It is copied because published broad-phase snapshots may
+  /// still be queried after the object was removed from (or replaced in) the world; ptr.obj is only compared, never followed.
+  std::string object_id;
+
   union
   {
     const robot_model::LinkModel    *link;
@@ -102,24 +128,65 @@ struct CollisionGeometryData
   } ptr;
 };
 
+/** \brief Get the mask of the links (by tree index) that are considered by a request for the group \e group_name, or NULL
+    if there is no such group and all links are considered */
+const std::vector<bool>* getActiveLinkMask(const robot_model::RobotModelConstPtr &kmodel, const std::string &group_name);
+
+/** \brief Check if the link with tree index \e index is marked in \e link_mask (a NULL mask marks all links) */
+inline bool isLinkInMask(const std::vector<bool> *link_mask, std::size_t index)
+{
+  return !link_mask || (index < link_mask->size() && (*link_mask)[index]);
+}
+
 struct CollisionData
 {
-  CollisionData() : req_(NULL), active_components_only_(NULL), res_(NULL), acm_(NULL), done_(false)
+  CollisionData() : req_(NULL), active_components_only_(NULL), active_link_mask_(NULL), res_(NULL), acm_(NULL), compiled_acm_(NULL),
+                    distance_threshold_(0.0), done_(false), indexed_compact_contacts_(0)
   {
   }
 
   CollisionData(const CollisionRequest *req, CollisionResult *res,
-                const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), res_(res), acm_(acm), done_(false)
+                const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), active_link_mask_(NULL), res_(res), acm_(acm),
+                                                     compiled_acm_(NULL), distance_threshold_(0.0), done_(false), indexed_compact_contacts_(0)
   {
   }
 
+  /// The number of compact contacts stored in \e res_ for a pair of bodies, and the position of the first one
+  struct CompactPairContacts
+  {
+    CompactPairContacts() : count_(0), first_(0)
+    {
+    }
+
+    std::size_t count_;
+    std::size_t first_;
+  };
+
+  /// Get the allowed collision type from \e compiled_acm_ if both bodies are links, or from \e acm_ otherwise
+  bool getAllowedCollision(const CollisionGeometryData *cd1, const CollisionGeometryData *cd2, AllowedCollision::Type &type) const;
+
+  /// Get the allowed collision predicate from \e compiled_acm_ if both bodies are links, or from \e acm_ otherwise
+  bool getAllowedCollision(const CollisionGeometryData *cd1, const CollisionGeometryData *cd2, DecideContactFn &fn) const;
+
   ~CollisionData()
   {
   }
 
-  /// Compute \e active_components_only_ based on \e req_
+  /// Compute \e active_components_only_ and \e active_link_mask_ based on \e req_
   void enableGroup(const robot_model::RobotModelConstPtr &kmodel);
 
+  /// Check if the robot link \e link (which may be NULL) is one of the active components
+  bool isActiveLink(const robot_model::LinkModel *link) const;
+
+  /// Get the copy of the name of \e cd interned by \e res_ (see CollisionResult::internBodyName()), looked up once per body
+  const boost::shared_ptr<const std::string>& internBodyName(const CollisionGeometryData *cd);
+
+  /// Get the copy of the name of \e cd interned by \e res_, or NULL if no compact contact refers to it
+  const std::string* findBodyName(const CollisionGeometryData *cd);
+
+  /// Get the compact contacts stored in \e res_ for the bodies with the interned names \e name1 and \e name2 (in any order)
+  CompactPairContacts& getCompactPairContacts(const std::string *name1, const std::string *name2);
+
   /// The collision request passed by the user
   const CollisionRequest       *req_;
 
@@ -128,14 +195,65 @@ struct CollisionData
   const std::set<const robot_model::LinkModel*>
                                *active_components_only_;
 
+  /// The same links as \e active_components_only_, as a mask indexed by link tree index (may be NULL even if the set is not)
+  const std::vector<bool>      *active_link_mask_;
+
   /// The user specified response location
   CollisionResult              *res_;
 
   /// The user specified collision matrix (may be NULL)
   const AllowedCollisionMatrix *acm_;
 
+  /// The compiled form of \e acm_ for the links of the robot model (may be NULL)
+  const CompiledAllowedCollisionMatrix
+                               *compiled_acm_;
+
+  /// Distance computation (see distanceCallback()) is complete as soon as a distance below this value is found
+  double                        distance_threshold_;
+
   /// Flag indicating whether collision checking is complete
   bool                          done_;
+
+  /// The names interned by \e res_, per body
+  boost::unordered_map<const CollisionGeometryData*, boost::shared_ptr<const std::string> >
+                                interned_names_;
+
+  /// The compact contacts of \e res_ per pair of interned names (the lower address first), for the first
+  /// \e indexed_compact_contacts_ contacts
+  boost::unordered_map<std::pair<const std::string*, const std::string*>, CompactPairContacts>
+                                compact_pairs_;
+  std::size_t                   indexed_compact_contacts_;
+};
+
+struct DistanceData
+{
+  DistanceData(const DistanceRequest *req, DistanceResult *res,
+               const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), active_link_mask_(NULL), res_(res), acm_(acm)
+  {
+  }
+
+  /// Compute \e active_components_only_ and \e active_link_mask_ based on \e req_
+  void enableGroup(const robot_model::RobotModelConstPtr &kmodel);
+
+  /// Check if the robot link \e link (which may be NULL) is one of the active components
+  bool isActiveLink(const robot_model::LinkModel *link) const;
+
+  /// The distance request passed by the user
+  const DistanceRequest        *req_;
+
+  /// If the distance request includes a group name, this set contains the pointers to the link models that are considered;
+  /// If the pointer is NULL, all pairs are considered.
+  const std::set<const robot_model::LinkModel*>
+                               *active_components_only_;
+
+  /// The same links as \e active_components_only_, as a mask indexed by link tree index (may be NULL even if the set is not)
+  const std::vector<bool>      *active_link_mask_;
+
+  /// The user specified result location
+  DistanceResult               *res_;
+
+  /// The user specified collision matrix (may be NULL); pairs whose collisions are always allowed are not reported
+  const AllowedCollisionMatrix *acm_;
 };
 
 
@@ -200,6 +318,16 @@ bool collisionCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void
 
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist);
 
+/// Distance callback for DistanceData: keeps the \e max_pairs nearest pairs of bodies in the result, and lowers \e min_dist
+/// to the distance beyond which pairs can no longer be reported, so the broad phase skips them
+bool distanceDetailedCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist);
+
+/// Check the objects of \e fcl_obj1 against those of \e fcl_obj2 (or against each other, if \e fcl_obj2 is NULL) for contact
+/// while they move: each object moves from its own transform to the transform of the object at the same index in \e fcl_obj1_end
+/// (or \e fcl_obj2_end). If contact is found, the earliest time of contact is stored in the result of \e cdata.
+void checkContinuousCollision(const FCLObject &fcl_obj1, const FCLObject &fcl_obj1_end,
+                              const FCLObject *fcl_obj2, const FCLObject *fcl_obj2_end, CollisionData &cdata);
+
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
                                             const robot_model::LinkModel *link);
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
@@ -207,6 +335,8 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
                                             const World::Object *obj);
 
+/// Geometry for a padded or scaled link is shared by all callers (e.g. all CollisionRobotFCL instances for a model) that ask
+/// for the same link, shape, scale and padding, for as long as one of them holds it
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, double scale, double padding,
                                             const robot_model::LinkModel *link);
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, double scale, double padding,
@@ -215,6 +345,50 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
                                             const World::Object *obj);
 void cleanCollisionGeometryCache();
 
+/// Counters of the caches of FCL geometry constructed for shapes, summed over the caches for links, attached bodies and world objects
+struct CollisionGeometryCacheStatistics
+{
+  CollisionGeometryCacheStatistics() : hits(0), misses(0), evictions(0), entries(0), bytes(0)
+  {
+  }
+
+  /// The number of times geometry was found in a cache instead of being constructed
+  std::size_t hits;
+
+  /// The number of times geometry had to be constructed
+  std::size_t misses;
+
+  /// The number of entries removed to keep a cache within its memory limit
+  std::size_t evictions;
+
+  /// The number of entries currently held
+  std::size_t entries;
+
+  /// The estimated memory held by the geometry of the current entries (BVH nodes, triangles and vertices, for meshes)
+  std::size_t bytes;
+};
+
+/// Limit the memory held by each of the geometry caches to \e max_bytes, evicting the least recently used entries once
+/// the limit is exceeded (0, the default, means no limit). Only geometry no longer used by any collision object is
+/// evicted, so the caches may hold more while the geometry in use does.
+void setCollisionGeometryCacheLimit(std::size_t max_bytes);
+
+/// Get the memory limit of each of the geometry caches (0 means no limit)
+std::size_t getCollisionGeometryCacheLimit();
+
+/// Get the counters of the geometry caches. Hits, misses and evictions are also counted as moveit::Profiler events while the profiler runs.
+CollisionGeometryCacheStatistics getCollisionGeometryCacheStatistics();
+
+/// Reset the hit, miss and eviction counters of the geometry caches
+void resetCollisionGeometryCacheStatistics();
+
+/// Get an estimate of the memory held by \e geometry, as accounted for by the geometry caches: the BVH nodes, triangles and
+/// vertices for meshes, the size of the FCL object otherwise (the octree of an octree geometry is held by its shape)
+std::size_t getCollisionGeometryMemoryUsage(const FCLGeometry &geometry);
+
+/// Get an estimate of the memory held by the FCL objects of \e fcl_obj, counting their collision geometry as well
+std::size_t getFCLObjectMemoryUsage(const FCLObject &fcl_obj);
+
 inline void transform2fcl(const Eigen::Affine3d &b, fcl::Transform3f &f)
 {
   Eigen::Quaterniond q(b.rotation());
@@ -237,9 +411,27 @@ inline void fcl2contact(const fcl::Contact &fc, Contact &c)
   const CollisionGeometryData *cgd1 = static_cast<const CollisionGeometryData*>(fc.o1->getUserData());
   c.body_name_1 = cgd1->getID();
   c.body_type_1 = cgd1->type;
+  c.body_handle_1 = cgd1->handle;
   const CollisionGeometryData *cgd2 = static_cast<const CollisionGeometryData*>(fc.o2->getUserData());
   c.body_name_2 = cgd2->getID();
   c.body_type_2 = cgd2->type;
+  c.body_handle_2 = cgd2->handle;
+}
+
+/** \brief Fill \e c from \e fc; the names of the bodies are interned by \e res, which is meant to hold the contact */
+inline void fcl2contact(const fcl::Contact &fc, CompactContact &c, CollisionResult &res)
+{
+  c.pos = Eigen::Vector3d(fc.pos[0], fc.pos[1], fc.pos[2]);
+  c.normal = Eigen::Vector3d(fc.normal[0], fc.normal[1], fc.normal[2]);
+  c.depth = fc.penetration_depth;
+  const CollisionGeometryData *cgd1 = static_cast<const CollisionGeometryData*>(fc.o1->getUserData());
+  c.body_name_ptr_1 = res.internBodyName(cgd1->getID());
+  c.body_type_1 = cgd1->type;
+  c.body_handle_1 = cgd1->handle;
+  const CollisionGeometryData *cgd2 = static_cast<const CollisionGeometryData*>(fc.o2->getUserData());
+  c.body_name_ptr_2 = res.internBodyName(cgd2->getID());
+  c.body_type_2 = cgd2->type;
+  c.body_handle_2 = cgd2->handle;
 }
 
 inline void fcl2costsource(const fcl::CostSource &fcs, CostSource& cs)
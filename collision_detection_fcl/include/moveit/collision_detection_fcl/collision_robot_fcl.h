@@ -41,6 +41,8 @@
 
 namespace collision_detection
 {
+  /** \brief The broad-phase data that the threads using a CollisionRobotFCL keep (defined in the implementation) */
+  struct SelfCollisionCacheRegistry;
 
   class CollisionRobotFCL : public CollisionRobot
   {
@@ -48,6 +50,9 @@ namespace collision_detection
 
   public:
 
+    /** \brief Pairs of indices of links (as in RobotModel::getLinkModels()) to be checked for self collision */
+    typedef std::vector<std::pair<std::size_t, std::size_t> > LinkPairs;
+
     CollisionRobotFCL(const robot_model::RobotModelConstPtr &kmodel, double padding = 0.0, double scale = 1.0);
 
     CollisionRobotFCL(const CollisionRobotFCL &other);
@@ -57,6 +62,16 @@ namespace collision_detection
     virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
     virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
 
+    /** \brief Compute the pairs of links with geometry that need to be checked for self collision under \e acm: all pairs,
+        except those whose collisions are always allowed (this includes the adjacent links disabled in the SRDF). The result
+        is meant to be computed once and passed to the corresponding checkSelfCollision() call, as long as \e acm does not change. */
+    void computeSelfCollisionPairs(const AllowedCollisionMatrix &acm, LinkPairs &pairs) const;
+
+    /** \brief Check for self collision by testing only the link pairs in \e pairs (computed by computeSelfCollisionPairs()
+        for \e acm), without a broad-phase pass over all pairs of links. Attached bodies are checked against all links. */
+    void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                            const AllowedCollisionMatrix &acm, const LinkPairs &pairs) const;
+
     virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                      const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const;
     virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
@@ -68,6 +83,22 @@ namespace collision_detection
                                      const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
                                      const AllowedCollisionMatrix &acm) const;
 
+    /** \brief A robot to be checked by checkRobotsCollision(): its collision representation and the state it is at */
+    typedef std::pair<const CollisionRobot*, const robot_state::RobotState*> RobotAndState;
+
+    /** \brief Check the robots in \e robots for collisions with each other (collisions within one robot are not checked). The links
+        of all robots go into one broad-phase manager that is traversed once, instead of checking each pair of robots with
+        checkOtherCollision(). If \e acm is specified, it is used for all pairs of robots. If \e req.group_name names a group of
+        a robot's model, only the links of that group are considered for that robot. If some robot is not a CollisionRobotFCL,
+        the robots are checked two at a time. */
+    static void checkRobotsCollision(const CollisionRequest &req, CollisionResult &res, const std::vector<RobotAndState> &robots,
+                                     const AllowedCollisionMatrix *acm = NULL);
+
+    /** \brief Check the robots in \e robots for collisions with each other, as above, with an allowed collision matrix for
+        each pair of robots: robots \e i and \e j (\e i < \e j) use \e pair_acms[i * robots.size() + j], which may be NULL. */
+    static void checkRobotsCollision(const CollisionRequest &req, CollisionResult &res, const std::vector<RobotAndState> &robots,
+                                     const std::vector<const AllowedCollisionMatrix*> &pair_acms);
+
     virtual double distanceSelf(const robot_state::RobotState &state) const;
     virtual double distanceSelf(const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
     virtual double distanceOther(const robot_state::RobotState &state,
@@ -75,25 +106,84 @@ namespace collision_detection
     virtual double distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
                                  const robot_state::RobotState &other_state, const AllowedCollisionMatrix &acm) const;
 
+    /** \brief The collision geometry of the links (including the variants kept for other paddings and scales) is counted. Geometry
+        is shared with copies of this instance and with other instances for the same model, so the same bytes may be counted for
+        each of them */
+    virtual std::size_t getMemoryUsage() const;
+
+    /** \brief Compute the distances between pairs of bodies of the robot at \e state, in a single broad-phase pass. The nearest
+        \e req.max_pairs pairs (within \e req.max_distance) are reported in \e res, with their nearest points if requested. */
+    void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const;
+
+    /** \brief Compute the distances between pairs of bodies of the robot at \e state, as above. Pairs whose collisions are always
+        allowed by \e acm are not reported. */
+    void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+
   protected:
 
     virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
-    void constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj) const;
+    /** \brief Construct the collision objects of the links of \e state and the bodies attached to them. If \e link_mask is
+        specified (see getActiveLinkMask()), only the links it marks (and the bodies attached to them) get objects. */
+    void constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj, const std::vector<bool> *link_mask = NULL) const;
+    void constructAttachedBodyObjects(const robot_state::LinkState *link_state, FCLObject &fcl_obj) const;
     void allocSelfCollisionBroadPhase(const robot_state::RobotState &state, FCLManager &manager) const;
+
+    /** \brief Get the broad-phase manager of the calling thread, updated to represent \e state. The collision objects
+        of the links are kept between calls, so only their transforms are updated and the tree is refit. The objects
+        for attached bodies are kept as well, as long as the state carries the same attached bodies with the same shapes.
+        The manager remains valid until the next call from the same thread. */
+    FCLManager& getSelfCollisionBroadPhase(const robot_state::RobotState &state) const;
     void getAttachedBodyObjects(const robot_state::AttachedBody *ab, std::vector<FCLGeometryConstPtr> &geoms) const;
 
     void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                   const AllowedCollisionMatrix *acm) const;
+
+    /** \brief Check \e state for collisions of the geometry of \e world_robot with the objects in \e world_manager and then,
+        unless the check is already done, for self collisions of this robot. Both checks use the broad-phase data of the self
+        check, so the link transforms are converted once: links with the same geometry in both robots share their collision
+        objects, and the other links of \e world_robot are moved to the transforms of the self collision objects. */
+    void checkWorldAndSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                          const CollisionRobotFCL &world_robot, fcl::BroadPhaseCollisionManager *world_manager,
+                                          const AllowedCollisionMatrix *acm) const;
+    void checkSelfCollisionContinuousHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                            const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
     void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                    const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                    const AllowedCollisionMatrix *acm) const;
+    void checkOtherCollisionContinuousHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                             const robot_state::RobotState &state2, const CollisionRobot &other_robot,
+                                             const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                             const AllowedCollisionMatrix *acm) const;
+    static void checkRobotsCollisionHelper(const CollisionRequest &req, CollisionResult &res, const std::vector<RobotAndState> &robots,
+                                           const AllowedCollisionMatrix *acm, const std::vector<const AllowedCollisionMatrix*> &pair_acms);
     double distanceSelfHelper(const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void distanceSelfHelper(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
     double distanceOtherHelper(const robot_state::RobotState &state, const CollisionRobot &other_robot,
                                const robot_state::RobotState &other_state, const AllowedCollisionMatrix *acm) const;
 
+    /** \brief Geometry constructed for a link, with the scale and padding it was constructed for */
+    struct GeometryVariant
+    {
+      double              scale_;
+      double              padding_;
+      FCLGeometryConstPtr geometry_;
+    };
+
+    /** \brief Use the geometry for the link at \e index with its current scale and padding, constructing it only if it is not in geom_variants_ */
+    void updateLinkGeometry(std::size_t index);
+
     std::vector<const robot_model::LinkModel*> links_;
     std::vector<FCLGeometryConstPtr>               geoms_;
-    std::map<std::string, std::size_t>             index_map_;
+
+    /** \brief For each link (indexed as geoms_), the geometry recently used for it, most recent first. Switching back to a
+        previous padding or scale is then only a matter of picking the geometry from here. */
+    std::vector<std::vector<GeometryVariant> >     geom_variants_;
+
+    /** \brief Identifies this instance and its current geoms_ (see checkWorldAndSelfCollisionHelper()) */
+    std::size_t                                    cache_id_;
+
+    /** \brief The broad-phase data cached by each thread for this instance (and its current geoms_); renewed with cache_id_ */
+    boost::shared_ptr<SelfCollisionCacheRegistry>  caches_;
   };
 
 }
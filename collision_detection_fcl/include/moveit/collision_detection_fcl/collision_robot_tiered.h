@@ -0,0 +1,85 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_FCL_COLLISION_ROBOT_TIERED_
+#define MOVEIT_COLLISION_DETECTION_FCL_COLLISION_ROBOT_TIERED_
+
+#include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+
+namespace collision_detection
+{
+
+  /** \brief A sphere that bounds a body, used by the coarse tier of the tiered collision detector */
+  struct BoundingSphere
+  {
+    Eigen::Vector3d center_;
+    double          radius_;
+  };
+
+  /** \brief Get the radius of a sphere centered at the origin of \e shape that contains the shape. Planes are unbounded
+      (the result is infinite). */
+  double computeShapeBoundingRadius(const shapes::Shape &shape);
+
+  /** \brief The robot of the tiered collision detector (see CollisionDetectorAllocatorTiered). Collision checks are those of
+      CollisionRobotFCL; in addition, the robot provides the bounding spheres of its bodies to the coarse tier of
+      CollisionWorldTiered. */
+  class CollisionRobotTiered : public CollisionRobotFCL
+  {
+  public:
+
+    CollisionRobotTiered(const robot_model::RobotModelConstPtr &kmodel, double padding = 0.0, double scale = 1.0);
+
+    CollisionRobotTiered(const CollisionRobotTiered &other);
+
+    /** \brief Get spheres that bound the (padded and scaled) collision geometry of the links and the geometry of the attached
+        bodies of \e state. Return false if some body is unbounded; \e spheres is then incomplete. */
+    bool getBoundingSpheres(const robot_state::RobotState &state, std::vector<BoundingSphere> &spheres) const;
+
+  protected:
+
+    virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
+
+  private:
+
+    /** \brief Compute the bounding radius of the link at \e index, with its current padding and scale */
+    void updateLinkRadius(std::size_t index);
+
+    /** \brief For each link (indexed as in RobotModel::getLinkModels()), the radius of the sphere around the origin of its
+        collision geometry that contains the padded and scaled geometry; negative for links without geometry */
+    std::vector<double> link_radius_;
+  };
+
+}
+
+#endif
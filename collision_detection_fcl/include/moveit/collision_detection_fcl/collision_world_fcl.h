@@ -39,6 +39,7 @@
 
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
 #include <fcl/broadphase/broadphase.h>
+#include <boost/thread/mutex.hpp>
 
 namespace collision_detection
 {
@@ -53,35 +54,120 @@ namespace collision_detection
     virtual ~CollisionWorldFCL();
 
 
+    using CollisionWorld::checkCollision;
+
+    /** \brief Check \e state for collisions with the world (using \e robot) and for self collisions (using \e self_robot).
+        Both checks share the collision objects and link transforms of the robot, and stop together. */
+    virtual void checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const CollisionRobot &self_robot,
+                                const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+
     virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
     virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
     virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
     virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
+    virtual void checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                          const std::vector<const robot_state::RobotState*> &states) const;
+    virtual void checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                          const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const;
     virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const;
     virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const;
 
     virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
     virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm, double max_distance) const;
+
+    /** \brief Compute the distances between the bodies of the robot at \e state and the world objects, in a single broad-phase pass.
+        The nearest \e req.max_pairs pairs (within \e req.max_distance) are reported in \e res, with their nearest points if requested. */
+    void distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+
+    /** \brief Compute the distances between the bodies of the robot at \e state and the world objects, as above. Pairs whose
+        collisions are always allowed by \e acm are not reported. */
+    void distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state,
+                       const AllowedCollisionMatrix &acm) const;
+
     virtual double distanceWorld(const CollisionWorld &world) const;
     virtual double distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const;
 
     virtual void setWorld(const WorldPtr& world);
 
+    /** \brief Build the FCL geometry for \e shape and keep it in the geometry cache, from which it is taken when an object with this shape enters the world */
+    virtual void prepareShape(const shapes::ShapeConstPtr &shape) const;
+
+    /** \brief The FCL objects of the world objects, their collision geometry and the broad-phase structure are counted. Collision
+        geometry is shared through the geometry cache (see getCollisionGeometryCacheStatistics()), so the same bytes may also be
+        counted for other collision worlds holding objects with the same shapes */
+    virtual std::size_t getMemoryUsage() const;
+
+    /** \brief The broad-phase structure of the world objects selects the candidate shapes, and only these are checked exactly */
+    virtual void getObjectsInBox(const Eigen::Vector3d &min_corner, const Eigen::Vector3d &max_corner, std::vector<std::string> &ids) const;
+    virtual void getObjectsInSphere(const Eigen::Vector3d &center, double radius, std::vector<std::string> &ids) const;
+
+    /** \brief Only the objects the broad-phase structure finds along the ray are intersected with it; rays of infinite
+        length visit every object, as in CollisionWorld::castRay() */
+    virtual bool castRay(const Eigen::Vector3d &origin, const Eigen::Vector3d &direction, double max_distance,
+                         std::string &id, double &distance) const;
+
   protected:
 
     void checkWorldCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix *acm) const;
     void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
-    double distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void checkRobotCollisionBatchHelper(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                        const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const;
+    void checkRobotCollisionContinuousHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                             const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
+    double distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                               double max_distance = std::numeric_limits<double>::max()) const;
+    void distanceRobotHelper(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state,
+                             const AllowedCollisionMatrix *acm) const;
     double distanceWorldHelper(const CollisionWorld &world, const AllowedCollisionMatrix *acm) const;
 
+    /** \brief Collect the ids of the world objects whose broad-phase bounds overlap \e query (the bounds of \e query must be
+        computed); if \e exact is true, only objects with a shape in contact with \e query are collected */
+    void getObjectsOverlapping(fcl::CollisionObject &query, bool exact, std::set<std::string> &ids) const;
+
+    /** \brief The broad-phase structure for the world objects, together with the objects it refers to. A snapshot is
+        not modified once it is published, so any number of queries can traverse it concurrently while the world changes. */
+    struct Snapshot
+    {
+      boost::shared_ptr<fcl::BroadPhaseCollisionManager> manager_;
+      std::map<std::string, FCLObject>                   fcl_objs_;
+    };
+    typedef boost::shared_ptr<const Snapshot> SnapshotConstPtr;
+
+    /** \brief Get the snapshot of the world objects queries should use. The thread that changes the world publishes the
+        updated snapshot before the change returns, so a query only waits if it starts while a change is being published.
+        Queries that already hold a snapshot keep using it. */
+    SnapshotConstPtr getSnapshot() const;
+
     void constructFCLObject(const World::Object *obj, FCLObject &fcl_obj) const;
     void updateFCLObject(const std::string &id);
 
+    /** \brief Update the FCL objects of \e obj after only the poses of its shapes changed: the collision geometry is kept, and
+        the published snapshot is refitted in place when no query uses it. Return false if the FCL objects need to be rebuilt instead. */
+    bool moveFCLObject(const World::Object *obj);
+
+    /** \brief Check whether the FCL objects of \e obj are still valid after the data of its shapes changed in place. This is the case
+        for octrees: the FCL geometry reads the octree at query time and is bounded by the root cell of the octree, so neither the
+        geometry nor the broad-phase data depend on the cells. Return false if the FCL objects need to be rebuilt. */
+    bool refreshFCLObject(const World::Object *obj);
 
-    boost::scoped_ptr<fcl::BroadPhaseCollisionManager> manager_;
+    /// The FCL objects of the world objects, as maintained from the world notifications (protected by \e objects_lock_)
     std::map<std::string, FCLObject >                  fcl_objs_;
+    mutable boost::mutex                               objects_lock_;
 
   private:
+
+    /// The snapshot built from the current content of \e fcl_objs_ (NULL while a change is published); only accessed atomically
+    mutable SnapshotConstPtr                           snapshot_;
+
+    /** \brief Build a snapshot from the current content of \e fcl_objs_ (\e objects_lock_ must be held) */
+    SnapshotConstPtr buildSnapshot() const;
+
+    /** \brief Publish a snapshot in which the FCL objects of \e id are those in \e fcl_objs_ (\e objects_lock_ must be held).
+        The published snapshot is updated in place if no query holds it, and rebuilt otherwise. */
+    void publishSnapshot(const std::string &id);
+
     void initialize();
     void notifyObjectChange(const ObjectConstPtr& obj, World::Action action);
     World::ObserverHandle observer_handle_;
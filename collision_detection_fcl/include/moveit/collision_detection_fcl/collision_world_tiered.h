@@ -0,0 +1,108 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_FCL_COLLISION_WORLD_TIERED_
+#define MOVEIT_COLLISION_DETECTION_FCL_COLLISION_WORLD_TIERED_
+
+#include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/collision_detection_fcl/collision_robot_tiered.h>
+
+namespace collision_detection
+{
+
+  /** \brief The world of the tiered collision detector (see CollisionDetectorAllocatorTiered).
+
+      Checks of a robot against the world first run a coarse, conservative test: every world object shape and every body
+      of the robot (a CollisionRobotTiered) is bounded by a sphere, and if no sphere of the robot overlaps a sphere of the
+      world, the state is certified free of collisions with the world without involving FCL. Only the states the coarse
+      test cannot certify are checked by CollisionWorldFCL. The coarse test ignores the allowed collision matrix and the
+      group of the request, so it can only let more states through to the exact check, never report a different result.
+
+      Requests for distances or costs, continuous checks and checks with robots of other types always go to the exact
+      check. Self collisions are checked by the robot, as for FCL. */
+  class CollisionWorldTiered : public CollisionWorldFCL
+  {
+  public:
+
+    CollisionWorldTiered();
+    explicit CollisionWorldTiered(const WorldPtr& world);
+    CollisionWorldTiered(const CollisionWorldTiered &other, const WorldPtr& world);
+    virtual ~CollisionWorldTiered();
+
+    using CollisionWorldFCL::checkCollision;
+
+    virtual void checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const CollisionRobot &self_robot,
+                                const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+
+    using CollisionWorldFCL::checkRobotCollision;
+
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual void checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                          const std::vector<const robot_state::RobotState*> &states) const;
+    virtual void checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                          const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const;
+
+    virtual void setWorld(const WorldPtr& world);
+
+    /** \brief Check whether the coarse test certifies that the bodies of \e robot at \e state do not touch the world objects.
+        This is false whenever the test does not apply (see the class description). */
+    bool isCertifiedFree(const CollisionRequest &req, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+
+  private:
+
+    typedef std::vector<BoundingSphere> Spheres;
+    typedef boost::shared_ptr<const Spheres> SpheresConstPtr;
+
+    /** \brief Get the bounding spheres of all the world objects, building them from \e object_spheres_ if they changed */
+    SpheresConstPtr getWorldSpheres() const;
+
+    void checkRobotCollisionBatchHelper(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                        const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const;
+
+    void notifyObjectBoundsChange(const ObjectConstPtr& obj, World::Action action);
+
+    /// The bounding spheres of the shapes of each world object (protected by \e bounds_lock_)
+    std::map<std::string, Spheres>         object_spheres_;
+    mutable boost::mutex                   bounds_lock_;
+
+    /// The spheres of all the objects in \e object_spheres_ (NULL if they need to be collected); only accessed atomically
+    mutable SpheresConstPtr                world_spheres_;
+
+    World::ObserverHandle                  bounds_observer_handle_;
+  };
+
+}
+
+#endif
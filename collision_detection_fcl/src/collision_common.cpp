@@ -38,16 +38,168 @@
 #include <fcl/BVH/BVH_model.h>
 #include <fcl/shape/geometric_shapes.h>
 #include <fcl/octree.h>
+#include <fcl/continuous_collision.h>
+#include <moveit/profiler/profiler.h>
+#include <moveit/profiler/query_counters.h>
 #include <boost/thread/mutex.hpp>
+#include <list>
+#include <cmath>
 
 namespace collision_detection
 {
 
+bool CollisionData::getAllowedCollision(const CollisionGeometryData *cd1, const CollisionGeometryData *cd2, AllowedCollision::Type &type) const
+{
+  if (compiled_acm_ && cd1->index >= 0 && cd2->index >= 0)
+    return compiled_acm_->getAllowedCollision(cd1->index, cd2->index, type);
+  return acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+}
+
+bool CollisionData::getAllowedCollision(const CollisionGeometryData *cd1, const CollisionGeometryData *cd2, DecideContactFn &fn) const
+{
+  if (compiled_acm_ && cd1->index >= 0 && cd2->index >= 0)
+    return compiled_acm_->getAllowedCollision(cd1->index, cd2->index, fn);
+  return acm_->getAllowedCollision(cd1->getID(), cd2->getID(), fn);
+}
+
+// true if the local bounding sphere of \e g (aabb_center, aabb_radius) is meaningful; unbounded geometry and octrees are excluded
+static inline bool hasBoundingSphere(const fcl::CollisionGeometry *g)
+{
+  switch (g->getObjectType())
+  {
+  case fcl::OT_BVH:
+    return true;
+  case fcl::OT_GEOM:
+    return g->getNodeType() != fcl::GEOM_PLANE && g->getNodeType() != fcl::GEOM_HALFSPACE;
+  default:
+    return false;
+  }
+}
+
+// a lower bound for the distance between two objects, from their bounding spheres. This is a conservative test that
+// resolves most pairs of meshes that are apart without traversing their BVHs. If there is no bound, -infinity is returned.
+static inline double boundingSphereDistance(const fcl::CollisionObject *o1, const fcl::CollisionObject *o2)
+{
+  const fcl::CollisionGeometry *g1 = o1->getCollisionGeometry();
+  const fcl::CollisionGeometry *g2 = o2->getCollisionGeometry();
+  if ((g1->getObjectType() != fcl::OT_BVH && g2->getObjectType() != fcl::OT_BVH) || !hasBoundingSphere(g1) || !hasBoundingSphere(g2))
+    return -std::numeric_limits<double>::infinity();
+  fcl::Vec3f c1 = o1->getTransform().transform(g1->aabb_center);
+  fcl::Vec3f c2 = o2->getTransform().transform(g2->aabb_center);
+  return (c1 - c2).length() - g1->aabb_radius - g2->aabb_radius;
+}
+
+const boost::shared_ptr<const std::string>& CollisionData::internBodyName(const CollisionGeometryData *cd)
+{
+  boost::shared_ptr<const std::string> &name = interned_names_[cd];
+  if (!name)
+    name = res_->internBodyName(cd->getID());
+  return name;
+}
+
+const std::string* CollisionData::findBodyName(const CollisionGeometryData *cd)
+{
+  boost::unordered_map<const CollisionGeometryData*, boost::shared_ptr<const std::string> >::const_iterator it = interned_names_.find(cd);
+  if (it != interned_names_.end())
+    return it->second.get();
+  const std::string *name = res_->findBodyName(cd->getID());
+  if (name)
+    internBodyName(cd);
+  return name;
+}
+
+CollisionData::CompactPairContacts& CollisionData::getCompactPairContacts(const std::string *name1, const std::string *name2)
+{
+  // the result may already hold contacts from other queries; they are indexed once, as are the ones added since
+  const std::vector<CompactContact> &contacts = res_->compact_contacts;
+  if (contacts.size() < indexed_compact_contacts_)
+  {
+    compact_pairs_.clear();
+    indexed_compact_contacts_ = 0;
+  }
+  for ( ; indexed_compact_contacts_ < contacts.size() ; ++indexed_compact_contacts_)
+  {
+    const std::string *n1 = contacts[indexed_compact_contacts_].body_name_ptr_1.get();
+    const std::string *n2 = contacts[indexed_compact_contacts_].body_name_ptr_2.get();
+    CompactPairContacts &pc = compact_pairs_[n1 < n2 ? std::make_pair(n1, n2) : std::make_pair(n2, n1)];
+    if (pc.count_++ == 0)
+      pc.first_ = indexed_compact_contacts_;
+  }
+  return compact_pairs_[name1 < name2 ? std::make_pair(name1, name2) : std::make_pair(name2, name1)];
+}
+
+// the number of contacts stored in the result of \e cdata for the pair of bodies \e cd1, \e cd2
+static std::size_t getStoredContactCount(CollisionData *cdata, const CollisionGeometryData *cd1, const CollisionGeometryData *cd2)
+{
+  if (cdata->req_->compact_contacts)
+  {
+    const std::string *name1 = cdata->findBodyName(cd1);
+    const std::string *name2 = cdata->findBodyName(cd2);
+    if (!name1 || !name2)
+      return 0;
+    return cdata->getCompactPairContacts(name1, name2).count_;
+  }
+
+  std::pair<std::string, std::string> cp = cd1->getID() < cd2->getID() ?
+    std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
+  CollisionResult::ContactMap::const_iterator it = cdata->res_->contacts.find(cp);
+  return it != cdata->res_->contacts.end() ? it->second.size() : 0;
+}
+
+// store a contact between \e cd1 and \e cd2 in the form requested; if only the deepest contact of a pair is wanted,
+// a contact already stored for the pair is replaced if \e fc is deeper
+static void storeContact(CollisionData *cdata, const fcl::Contact &fc, const CollisionGeometryData *cd1, const CollisionGeometryData *cd2)
+{
+  CollisionResult *res = cdata->res_;
+  if (cdata->req_->compact_contacts)
+  {
+    CompactContact c;
+    c.pos = Eigen::Vector3d(fc.pos[0], fc.pos[1], fc.pos[2]);
+    c.normal = Eigen::Vector3d(fc.normal[0], fc.normal[1], fc.normal[2]);
+    c.depth = fc.penetration_depth;
+    const CollisionGeometryData *cgd1 = static_cast<const CollisionGeometryData*>(fc.o1->getUserData());
+    c.body_name_ptr_1 = cdata->internBodyName(cgd1);
+    c.body_type_1 = cgd1->type;
+    c.body_handle_1 = cgd1->handle;
+    const CollisionGeometryData *cgd2 = static_cast<const CollisionGeometryData*>(fc.o2->getUserData());
+    c.body_name_ptr_2 = cdata->internBodyName(cgd2);
+    c.body_type_2 = cgd2->type;
+    c.body_handle_2 = cgd2->handle;
+    if (cdata->req_->deepest_contact_only)
+    {
+      const CollisionData::CompactPairContacts &pc = cdata->getCompactPairContacts(c.body_name_ptr_1.get(), c.body_name_ptr_2.get());
+      if (pc.count_ > 0)
+      {
+        if (c.depth > res->compact_contacts[pc.first_].depth)
+          res->compact_contacts[pc.first_] = c;
+        return;
+      }
+    }
+    res->compact_contacts.push_back(c);
+  }
+  else
+  {
+    Contact c;
+    fcl2contact(fc, c);
+    std::vector<Contact> &pair_contacts = cd1->getID() < cd2->getID() ?
+      res->contacts[std::make_pair(cd1->getID(), cd2->getID())] : res->contacts[std::make_pair(cd2->getID(), cd1->getID())];
+    if (cdata->req_->deepest_contact_only && !pair_contacts.empty())
+    {
+      if (c.depth > pair_contacts.front().depth)
+        pair_contacts.front() = c;
+      return;
+    }
+    pair_contacts.push_back(c);
+  }
+  res->contact_count++;
+}
+
 bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data)
 {
   CollisionData *cdata = reinterpret_cast<CollisionData*>(data);
   if (cdata->done_)
     return true;
+  moveit::tools::QueryCounters::count(moveit::tools::BROAD_PHASE_PAIRS);
   const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(o1->getCollisionGeometry()->getUserData());
   const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(o2->getCollisionGeometry()->getUserData());
 
@@ -58,8 +210,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
     const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
 
     // If neither of the involved components is active
-    if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
-        (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
+    if (!cdata->isActiveLink(l1) && !cdata->isActiveLink(l2))
       return false;
   }
 
@@ -69,7 +220,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   if (cdata->acm_)
   {
     AllowedCollision::Type type;
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found = cdata->getAllowedCollision(cd1, cd2, type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
@@ -86,7 +237,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       else
         if (type == AllowedCollision::CONDITIONAL)
         {
-          cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), dcf);
+          cdata->getAllowedCollision(cd1, cd2, dcf);
           if (cdata->req_->verbose)
             logDebug("Collision between '%s' and '%s' is conditionally allowed", cd1->getID().c_str(), cd2->getID().c_str());
         }
@@ -96,8 +247,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   // check if a link is touching an attached object
   if (cd1->type == BodyTypes::ROBOT_LINK && cd2->type == BodyTypes::ROBOT_ATTACHED)
   {
-    const std::set<std::string> &tl = cd2->ptr.ab->getTouchLinks();
-    if (tl.find(cd1->getID()) != tl.end())
+    if (cd2->isTouchLink(cd1))
     {
       always_allow_collision = true;
       if (cdata->req_->verbose)
@@ -108,8 +258,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   else
     if (cd2->type == BodyTypes::ROBOT_LINK && cd1->type == BodyTypes::ROBOT_ATTACHED)
     {
-      const std::set<std::string> &tl = cd1->ptr.ab->getTouchLinks();
-      if (tl.find(cd2->getID()) != tl.end())
+      if (cd1->isTouchLink(cd2))
       {
         always_allow_collision = true;
         if (cdata->req_->verbose)
@@ -128,6 +277,10 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   if (always_allow_collision)
     return false;
 
+  // the narrow phase is only needed if the bounding spheres overlap
+  if (boundingSphereDistance(o1, o2) > 0.0)
+    return false;
+
   if (cdata->req_->verbose)
     logDebug("Actually checking collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
 
@@ -136,19 +289,15 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   if (cdata->req_->contacts)
     if (cdata->res_->contact_count < cdata->req_->max_contacts)
     {
-      std::size_t have;
-      if (cd1->getID() < cd2->getID())
-      {
-        std::pair<std::string, std::string> cp(cd1->getID(), cd2->getID());
-        have = cdata->res_->contacts.find(cp) != cdata->res_->contacts.end() ? cdata->res_->contacts[cp].size() : 0;
-      }
+      // when only the deepest contact is kept, a stored contact may still be replaced by a deeper one
+      if (cdata->req_->deepest_contact_only)
+        want_contact_count = 1;
       else
       {
-        std::pair<std::string, std::string> cp(cd2->getID(), cd1->getID());
-        have = cdata->res_->contacts.find(cp) != cdata->res_->contacts.end() ? cdata->res_->contacts[cp].size() : 0;
+        std::size_t have = getStoredContactCount(cdata, cd1, cd2);
+        if (have < cdata->req_->max_contacts_per_pair)
+          want_contact_count = std::min(cdata->req_->max_contacts_per_pair - have, cdata->req_->max_contacts - cdata->res_->contact_count);
       }
-      if (have < cdata->req_->max_contacts_per_pair)
-        want_contact_count = std::min(cdata->req_->max_contacts_per_pair - have, cdata->req_->max_contacts - cdata->res_->contact_count);
     }
 
   if (dcf)
@@ -158,6 +307,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
     std::size_t num_max_cost_sources = cdata->req_->max_cost_sources;
     bool enable_contact = true;
     fcl::CollisionResult col_result;
+    moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
     int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(std::numeric_limits<size_t>::max(), enable_contact, num_max_cost_sources, enable_cost), col_result);
     if (num_contacts > 0)
     {
@@ -165,20 +315,27 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
         logInform("Found %d contacts between '%s' and '%s'. These contacts will be evaluated to check if they are accepted or not",
                   num_contacts, cd1->getID().c_str(), cd2->getID().c_str());
       Contact c;
-      const std::pair<std::string, std::string> &pc = cd1->getID() < cd2->getID() ?
-        std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
+      int deepest = -1;
       for (int i = 0 ; i < num_contacts ; ++i)
       {
         fcl2contact(col_result.getContact(i), c);
         // if the contact is  not allowed, we have a collision
         if (dcf(c) == false)
         {
+          // only the deepest unacceptable contact is stored, once they have all been seen
+          if (cdata->req_->deepest_contact_only && want_contact_count > 0)
+          {
+            if (deepest < 0 || col_result.getContact(i).penetration_depth > col_result.getContact(deepest).penetration_depth)
+              deepest = i;
+            cdata->res_->collision = true;
+            continue;
+          }
+
           // store the contact, if it is needed
           if (want_contact_count > 0)
           {
             --want_contact_count;
-            cdata->res_->contacts[pc].push_back(c);
-            cdata->res_->contact_count++;
+            storeContact(cdata, col_result.getContact(i), cd1, cd2);
             if (cdata->req_->verbose)
               logInform("Found unacceptable contact between '%s' and '%s'. Contact was stored.",
                         cd1->getID().c_str(), cd2->getID().c_str());
@@ -193,6 +350,8 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
             break;
         }
       }
+      if (deepest >= 0)
+        storeContact(cdata, col_result.getContact(deepest), cd1, cd2);
     }
 
     if (enable_cost)
@@ -219,39 +378,48 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       std::size_t num_max_cost_sources = cdata->req_->max_cost_sources;
       bool enable_contact = true;
 
+      // to find the deepest contact, all contacts are needed
+      std::size_t fcl_contact_count = cdata->req_->deepest_contact_only ? std::numeric_limits<size_t>::max() : want_contact_count;
       fcl::CollisionResult col_result;
-      int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(want_contact_count, enable_contact, num_max_cost_sources, enable_cost), col_result);
-      if (num_contacts > 0)
+      moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
+      int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(fcl_contact_count, enable_contact, num_max_cost_sources, enable_cost), col_result);
+      if (num_contacts > 0 && cdata->req_->deepest_contact_only)
       {
-        int num_contacts_initial = num_contacts;
-
-        // make sure we don't get more contacts than we want
-        if (want_contact_count >= (std::size_t)num_contacts)
-          want_contact_count -= num_contacts;
-        else
-        {
-          num_contacts = want_contact_count;
-          want_contact_count = 0;
-        }
-
+        int deepest = 0;
+        for (int i = 1 ; i < num_contacts ; ++i)
+          if (col_result.getContact(i).penetration_depth > col_result.getContact(deepest).penetration_depth)
+            deepest = i;
         if (cdata->req_->verbose)
-          logInform("Found %d contacts between '%s' (type '%s') and '%s' (type '%s'), which constitute a collision. %d contacts will be stored",
-                    num_contacts_initial,
-                    cd1->getID().c_str(), cd1->getTypeString().c_str(),
-                    cd2->getID().c_str(), cd2->getTypeString().c_str(),
-                    num_contacts);
-
-        const std::pair<std::string, std::string> &pc = cd1->getID() < cd2->getID() ?
-          std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
+          logInform("Found %d contacts between '%s' (type '%s') and '%s' (type '%s'), which constitute a collision. The deepest contact will be stored",
+                    num_contacts, cd1->getID().c_str(), cd1->getTypeString().c_str(), cd2->getID().c_str(), cd2->getTypeString().c_str());
         cdata->res_->collision = true;
-        for (int i = 0 ; i < num_contacts ; ++i)
+        storeContact(cdata, col_result.getContact(deepest), cd1, cd2);
+      }
+      else
+        if (num_contacts > 0)
         {
-          Contact c;
-          fcl2contact(col_result.getContact(i), c);
-          cdata->res_->contacts[pc].push_back(c);
-          cdata->res_->contact_count++;
+          int num_contacts_initial = num_contacts;
+
+          // make sure we don't get more contacts than we want
+          if (want_contact_count >= (std::size_t)num_contacts)
+            want_contact_count -= num_contacts;
+          else
+          {
+            num_contacts = want_contact_count;
+            want_contact_count = 0;
+          }
+
+          if (cdata->req_->verbose)
+            logInform("Found %d contacts between '%s' (type '%s') and '%s' (type '%s'), which constitute a collision. %d contacts will be stored",
+                      num_contacts_initial,
+                      cd1->getID().c_str(), cd1->getTypeString().c_str(),
+                      cd2->getID().c_str(), cd2->getTypeString().c_str(),
+                      num_contacts);
+
+          cdata->res_->collision = true;
+          for (int i = 0 ; i < num_contacts ; ++i)
+            storeContact(cdata, col_result.getContact(i), cd1, cd2);
         }
-      }
 
       if (enable_cost)
       {
@@ -274,6 +442,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       std::size_t num_max_cost_sources = cdata->req_->max_cost_sources;
       bool enable_contact = false;
       fcl::CollisionResult col_result;
+      moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
       int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(1, enable_contact, num_max_cost_sources, enable_cost), col_result);
       if (num_contacts > 0)
       {
@@ -322,9 +491,26 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   return cdata->done_;
 }
 
+// profiler events are counted under a per-thread lock with a lookup by name, so the shape caches only count them while
+// the profiler runs, and after releasing their own lock
+static inline void countCacheEvent(const char *name)
+{
+  if (moveit::Profiler::Running())
+    moveit::Profiler::Event(name);
+}
+
 struct FCLShapeCache
 {
-  FCLShapeCache() : clean_count_(0) {}
+  struct Entry
+  {
+    FCLGeometryConstPtr                                        geometry_;
+    std::size_t                                                bytes_;
+    std::list<boost::weak_ptr<const shapes::Shape> >::iterator lru_;
+  };
+
+  typedef std::map<boost::weak_ptr<const shapes::Shape>, Entry> EntryMap;
+
+  FCLShapeCache() : clean_count_(0), max_bytes_(0), bytes_(0), hits_(0), misses_(0), evictions_(0) {}
 
   void bumpUseCount(bool force = false)
   {
@@ -335,27 +521,86 @@ struct FCLShapeCache
     {
       clean_count_ = 0;
       unsigned int from = map_.size();
-      for (std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator it = map_.begin() ; it != map_.end() ; )
+      for (EntryMap::iterator it = map_.begin() ; it != map_.end() ; )
       {
-        std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator nit = it; ++nit;
+        EntryMap::iterator nit = it; ++nit;
         if (it->first.expired())
-          map_.erase(it);
+          erase(it);
         it = nit;
       }
       //      logDebug("Cleaning up cache for FCL objects that correspond to static shapes. Cache size reduced from %u to %u", from, (unsigned int)map_.size());
     }
   }
 
+  /// Mark an entry as the most recently used one
+  void touch(EntryMap::iterator it)
+  {
+    lru_.splice(lru_.begin(), lru_, it->second.lru_);
+  }
+
+  void insert(const boost::weak_ptr<const shapes::Shape> &wptr, const FCLGeometryConstPtr &geometry, std::size_t bytes)
+  {
+    EntryMap::iterator it = map_.find(wptr);
+    if (it != map_.end())
+      erase(it);
+    Entry &e = map_[wptr];
+    e.geometry_ = geometry;
+    e.bytes_ = bytes;
+    lru_.push_front(wptr);
+    e.lru_ = lru_.begin();
+    bytes_ += bytes;
+    enforceLimit();
+  }
+
+  void erase(EntryMap::iterator it)
+  {
+    bytes_ -= it->second.bytes_;
+    lru_.erase(it->second.lru_);
+    map_.erase(it);
+  }
+
+  /// Evict the least recently used entries until the cache holds no more than max_bytes_ (if that is not 0). Only entries
+  /// whose shape is gone or whose geometry is not used outside the cache are evicted: evicting geometry still in use frees
+  /// no memory, and the next lookup for its shape would build it again. The most recently used entry is always kept.
+  void enforceLimit()
+  {
+    if (max_bytes_ == 0 || bytes_ <= max_bytes_ || lru_.size() < 2)
+      return;
+    std::list<boost::weak_ptr<const shapes::Shape> >::iterator it = lru_.end();
+    --it;
+    while (bytes_ > max_bytes_ && it != lru_.begin())
+    {
+      std::list<boost::weak_ptr<const shapes::Shape> >::iterator prev = it;
+      --prev;
+      EntryMap::iterator entry = map_.find(*it);
+      if (it->expired() || entry->second.geometry_.unique())
+      {
+        erase(entry);
+        evictions_++;
+        if (moveit::Profiler::Running())
+          moveit::Profiler::Event("FCLShapeCache::eviction");
+      }
+      it = prev;
+    }
+  }
+
   static const unsigned int MAX_CLEAN_COUNT = 100; // every this many uses of the cache, a cleaning operation is executed (this is only removal of expired entries)
-  std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr> map_;
-  unsigned int clean_count_;
-  boost::mutex lock_;
+  EntryMap                                         map_;
+  std::list<boost::weak_ptr<const shapes::Shape> > lru_; // most recently used first
+  unsigned int                                     clean_count_;
+  std::size_t                                      max_bytes_;
+  std::size_t                                      bytes_;
+  std::size_t                                      hits_;
+  std::size_t                                      misses_;
+  std::size_t                                      evictions_;
+  boost::mutex                                     lock_;
 };
 
 
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data, double& min_dist)
 {
   CollisionData* cdata = reinterpret_cast<CollisionData*>(data);
+  moveit::tools::QueryCounters::count(moveit::tools::BROAD_PHASE_PAIRS);
 
   const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->getCollisionGeometry()->getUserData());
   const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->getCollisionGeometry()->getUserData());
@@ -367,8 +612,7 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
 
     // If neither of the involved components is active
-    if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
-        (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
+    if (!cdata->isActiveLink(l1) && !cdata->isActiveLink(l2))
     {
       min_dist = cdata->res_->distance;
       return cdata->done_;
@@ -381,7 +625,7 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   {
     AllowedCollision::Type type;
 
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found = cdata->getAllowedCollision(cd1, cd2, type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
@@ -398,8 +642,7 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   // check if a link is touching an attached object
   if (cd1->type == BodyTypes::ROBOT_LINK && cd2->type == BodyTypes::ROBOT_ATTACHED)
   {
-    const std::set<std::string> &tl = cd2->ptr.ab->getTouchLinks();
-    if (tl.find(cd1->getID()) != tl.end())
+    if (cd2->isTouchLink(cd1))
     {
       always_allow_collision = true;
       if (cdata->req_->verbose)
@@ -411,8 +654,7 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   {
     if (cd2->type == BodyTypes::ROBOT_LINK && cd1->type == BodyTypes::ROBOT_ATTACHED)
     {
-      const std::set<std::string> &tl = cd1->ptr.ab->getTouchLinks();
-      if (tl.find(cd2->getID()) != tl.end())
+      if (cd1->isTouchLink(cd2))
       {
         always_allow_collision = true;
         if (cdata->req_->verbose)
@@ -428,11 +670,19 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     return cdata->done_;
   }
 
+  // the narrow phase cannot find a smaller distance if the bounding spheres are farther apart than that
+  if (boundingSphereDistance(o1, o2) >= cdata->res_->distance)
+  {
+    min_dist = cdata->res_->distance;
+    return cdata->done_;
+  }
+
   if (cdata->req_->verbose)
     logDebug("Actually checking collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
 
   fcl::DistanceResult dist_result;
   dist_result.update(cdata->res_->distance, NULL, NULL, fcl::DistanceResult::NONE, fcl::DistanceResult::NONE); // can be faster
+  moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
   double d = fcl::distance(o1, o2, fcl::DistanceRequest(), dist_result);
 
   if(d < 0)
@@ -444,6 +694,8 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   {
     if(cdata->res_->distance > d)
       cdata->res_->distance = d;
+    if(d < cdata->distance_threshold_)
+      cdata->done_ = true;
   }
 
   min_dist = cdata->res_->distance;
@@ -451,6 +703,314 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   return cdata->done_;
 }
 
+// the naive continuous collision solver checks the motion at evenly spaced times; no point of a body may move by more
+// than half the thinnest side of either body between two checks, down to this step, and with at most this many checks
+static const double CONTINUOUS_MIN_STEP = 0.001;
+static const int CONTINUOUS_MAX_CHECKS = 1000;
+static const int CONTINUOUS_MIN_CHECKS = 10;
+
+// the angle of the rotation between the orientations at the two transforms, in [0, pi]
+static double getRotationAngle(const fcl::Transform3f &tf_start, const fcl::Transform3f &tf_end)
+{
+  fcl::Matrix3f r = tf_end.getRotation() * tf_start.getRotation().transpose();
+  double c = (r(0, 0) + r(1, 1) + r(2, 2) - 1.0) / 2.0;
+  return acos(std::max(-1.0, std::min(1.0, c)));
+}
+
+// a bound on the distance any point of the object travels under the screw motion to tf_end: its local AABB center moves
+// along a helix at most pi/2 times as long as the chord, and the other points turn around it by the rotation angle
+static double computeMotionExtent(const fcl::CollisionObject *obj, const fcl::Transform3f &tf_end)
+{
+  const fcl::CollisionGeometry *geom = obj->getCollisionGeometry();
+  double chord = (tf_end.transform(geom->aabb_center) - obj->getTransform().transform(geom->aabb_center)).length();
+  return M_PI / 2.0 * chord + getRotationAngle(obj->getTransform(), tf_end) * geom->aabb_radius;
+}
+
+static double getThickness(const fcl::CollisionGeometry *geom)
+{
+  return std::min(geom->aabb_local.width(), std::min(geom->aabb_local.height(), geom->aabb_local.depth()));
+}
+
+static int computeContinuousChecks(const fcl::CollisionObject *o1, const fcl::Transform3f &tf1_end,
+                                   const fcl::CollisionObject *o2, const fcl::Transform3f &tf2_end)
+{
+  double extent = computeMotionExtent(o1, tf1_end) + computeMotionExtent(o2, tf2_end);
+  double step = std::max(CONTINUOUS_MIN_STEP, 0.5 * std::min(getThickness(o1->getCollisionGeometry()), getThickness(o2->getCollisionGeometry())));
+  double checks = ceil(extent / step) + 1.0;
+  if (!(checks < CONTINUOUS_MAX_CHECKS))
+    return CONTINUOUS_MAX_CHECKS;
+  return std::max(CONTINUOUS_MIN_CHECKS, (int)checks);
+}
+
+static bool continuousCollisionCallback(fcl::CollisionObject *o1, const fcl::Transform3f &tf1_end,
+                                        fcl::CollisionObject *o2, const fcl::Transform3f &tf2_end, CollisionData *cdata)
+{
+  if (cdata->done_)
+    return true;
+  moveit::tools::QueryCounters::count(moveit::tools::BROAD_PHASE_PAIRS);
+  const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(o1->getCollisionGeometry()->getUserData());
+  const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(o2->getCollisionGeometry()->getUserData());
+
+  // If active components are specified
+  if (cdata->active_components_only_)
+  {
+    const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
+    const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
+
+    // If neither of the involved components is active
+    if (!cdata->isActiveLink(l1) && !cdata->isActiveLink(l2))
+      return false;
+  }
+
+  // conditionally allowed collisions need a contact to be decided, so they are treated as not allowed
+  if (cdata->acm_)
+  {
+    AllowedCollision::Type type;
+    if (cdata->getAllowedCollision(cd1, cd2, type) && type == AllowedCollision::ALWAYS)
+      return false;
+  }
+
+  // check if a link is touching an attached object
+  if (cd1->type == BodyTypes::ROBOT_LINK && cd2->type == BodyTypes::ROBOT_ATTACHED)
+  {
+    if (cd2->isTouchLink(cd1))
+      return false;
+  }
+  else
+    if (cd2->type == BodyTypes::ROBOT_LINK && cd1->type == BodyTypes::ROBOT_ATTACHED)
+    {
+      if (cd1->isTouchLink(cd2))
+        return false;
+    }
+  // bodies attached to the same link should not collide
+  if (cd1->type == BodyTypes::ROBOT_ATTACHED && cd2->type == BodyTypes::ROBOT_ATTACHED)
+  {
+    if (cd1->ptr.ab->getAttachedLink() == cd2->ptr.ab->getAttachedLink())
+      return false;
+  }
+
+  if (cdata->req_->verbose)
+    logDebug("Actually checking continuous collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
+
+  // the default motion model only translates the bodies; the screw motion between the two poses also follows rotations
+  fcl::ContinuousCollisionRequest ccd_request;
+  ccd_request.ccd_motion_type = fcl::CCDM_SCREW;
+  ccd_request.num_max_iterations = computeContinuousChecks(o1, tf1_end, o2, tf2_end);
+  fcl::ContinuousCollisionResult ccd_result;
+  moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
+  fcl::continuousCollide(o1->getCollisionGeometry(), o1->getTransform(), tf1_end,
+                         o2->getCollisionGeometry(), o2->getTransform(), tf2_end, ccd_request, ccd_result);
+  if (ccd_result.is_collide)
+  {
+    if (!cdata->res_->collision || ccd_result.time_of_contact < cdata->res_->time_of_contact)
+      cdata->res_->time_of_contact = ccd_result.time_of_contact;
+    cdata->res_->collision = true;
+    if (cdata->req_->verbose)
+      logInform("Found continuous collision between '%s' (type '%s') and '%s' (type '%s') at time %lf",
+                cd1->getID().c_str(), cd1->getTypeString().c_str(),
+                cd2->getID().c_str(), cd2->getTypeString().c_str(), ccd_result.time_of_contact);
+    // a contact at the start of the motion cannot be improved upon
+    if (ccd_result.time_of_contact <= 0.0)
+      cdata->done_ = true;
+  }
+
+  return cdata->done_;
+}
+
+bool distanceDetailedCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist)
+{
+  moveit::tools::QueryCounters::count(moveit::tools::BROAD_PHASE_PAIRS);
+  DistanceData *ddata = reinterpret_cast<DistanceData*>(data);
+  std::vector<DistancePair> &pairs = ddata->res_->pairs;
+
+  // pairs farther than this bound cannot be reported
+  double bound = ddata->req_->max_distance;
+  if (ddata->req_->max_pairs > 0 && pairs.size() >= ddata->req_->max_pairs && pairs.back().distance < bound)
+    bound = pairs.back().distance;
+  min_dist = bound;
+
+  const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->getCollisionGeometry()->getUserData());
+  const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->getCollisionGeometry()->getUserData());
+
+  // If active components are specified
+  if (ddata->active_components_only_)
+  {
+    const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
+    const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
+
+    // If neither of the involved components is active
+    if (!ddata->isActiveLink(l1) && !ddata->isActiveLink(l2))
+      return false;
+  }
+
+  // use the collision matrix (if any) to avoid certain distance checks
+  if (ddata->acm_)
+  {
+    AllowedCollision::Type type;
+    if (ddata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type) && type == AllowedCollision::ALWAYS)
+      return false;
+  }
+
+  // check if a link is touching an attached object
+  if (cd1->type == BodyTypes::ROBOT_LINK && cd2->type == BodyTypes::ROBOT_ATTACHED)
+  {
+    if (cd2->isTouchLink(cd1))
+      return false;
+  }
+  else
+    if (cd2->type == BodyTypes::ROBOT_LINK && cd1->type == BodyTypes::ROBOT_ATTACHED)
+    {
+      if (cd1->isTouchLink(cd2))
+        return false;
+    }
+  // bodies attached to the same link are not reported
+  if (cd1->type == BodyTypes::ROBOT_ATTACHED && cd2->type == BodyTypes::ROBOT_ATTACHED)
+  {
+    if (cd1->ptr.ab->getAttachedLink() == cd2->ptr.ab->getAttachedLink())
+      return false;
+  }
+
+  // a pair whose bounding spheres are farther apart than the bound cannot be reported
+  if (boundingSphereDistance(o1, o2) > bound)
+    return false;
+
+  if (ddata->req_->verbose)
+    logDebug("Computing distance between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
+
+  fcl::DistanceResult dist_result;
+  moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
+  double d = fcl::distance(o1, o2, fcl::DistanceRequest(ddata->req_->enable_nearest_points), dist_result);
+  if (d > ddata->req_->max_distance)
+    return false;
+
+  // FCL reports no depth or nearest points for bodies in collision; the deepest contact provides them instead
+  fcl::Contact deepest;
+  bool penetrating = false;
+  if (d <= 0.0)
+  {
+    fcl::CollisionResult col_result;
+    moveit::tools::QueryCounters::count(moveit::tools::NARROW_PHASE_CALLS);
+    std::size_t num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(std::numeric_limits<size_t>::max(), true), col_result);
+    for (std::size_t i = 0 ; i < num_contacts ; ++i)
+      if (!penetrating || col_result.getContact(i).penetration_depth > deepest.penetration_depth)
+      {
+        deepest = col_result.getContact(i);
+        penetrating = true;
+      }
+    d = penetrating ? -deepest.penetration_depth : 0.0;
+  }
+
+  // bodies made of multiple shapes get one entry only
+  std::vector<DistancePair>::iterator it = pairs.begin();
+  for ( ; it != pairs.end() ; ++it)
+    if ((it->body_name_1 == cd1->getID() && it->body_name_2 == cd2->getID()) ||
+        (it->body_name_1 == cd2->getID() && it->body_name_2 == cd1->getID()))
+      break;
+  if (it != pairs.end())
+  {
+    if (it->distance <= d)
+      return false;
+    pairs.erase(it);
+  }
+  else
+    if (d >= bound)
+      return false;
+
+  DistancePair dp;
+  dp.distance = d;
+  dp.body_name_1 = cd1->getID();
+  dp.body_type_1 = cd1->type;
+  dp.body_name_2 = cd2->getID();
+  dp.body_type_2 = cd2->type;
+  if (ddata->req_->enable_nearest_points)
+  {
+    if (penetrating)
+    {
+      // FCL contact normals point from the first object towards the second, as for separated bodies
+      dp.nearest_point_1 = Eigen::Vector3d(deepest.pos[0], deepest.pos[1], deepest.pos[2]);
+      dp.nearest_point_2 = dp.nearest_point_1;
+      dp.normal = Eigen::Vector3d(deepest.normal[0], deepest.normal[1], deepest.normal[2]);
+    }
+    else
+    {
+      dp.nearest_point_1 = Eigen::Vector3d(dist_result.nearest_points[0][0], dist_result.nearest_points[0][1], dist_result.nearest_points[0][2]);
+      dp.nearest_point_2 = Eigen::Vector3d(dist_result.nearest_points[1][0], dist_result.nearest_points[1][1], dist_result.nearest_points[1][2]);
+      dp.normal = dp.nearest_point_2 - dp.nearest_point_1;
+    }
+    double n = dp.normal.norm();
+    if (n > std::numeric_limits<double>::epsilon())
+      dp.normal /= n;
+    else
+      dp.normal.setZero();
+  }
+  else
+  {
+    dp.nearest_point_1.setZero();
+    dp.nearest_point_2.setZero();
+    dp.normal.setZero();
+  }
+
+  // keep the pairs sorted by distance
+  std::vector<DistancePair>::iterator pos = pairs.begin();
+  while (pos != pairs.end() && pos->distance <= d)
+    ++pos;
+  pairs.insert(pos, dp);
+  if (ddata->req_->max_pairs > 0 && pairs.size() > ddata->req_->max_pairs)
+    pairs.pop_back();
+
+  if (ddata->req_->max_pairs > 0 && pairs.size() >= ddata->req_->max_pairs && pairs.back().distance < min_dist)
+    min_dist = pairs.back().distance;
+
+  return false;
+}
+
+// the points of an object are within aabb_radius of the center of its local AABB; under the screw motion (rotating by at
+// most pi), that center stays within the sphere whose diameter joins its two positions, so the swept sphere is bounded by
+// the box around both positions inflated by aabb_radius and half their distance
+static fcl::AABB computeSweptAABB(const fcl::CollisionObject *obj, const fcl::Transform3f &tf_end)
+{
+  const fcl::CollisionGeometry *geom = obj->getCollisionGeometry();
+  fcl::Vec3f start = obj->getTransform().transform(geom->aabb_center);
+  fcl::Vec3f end = tf_end.transform(geom->aabb_center);
+  fcl::AABB aabb(start, end);
+  double margin = geom->aabb_radius + 0.5 * (end - start).length();
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    aabb.min_[i] -= margin;
+    aabb.max_[i] += margin;
+  }
+  return aabb;
+}
+
+void checkContinuousCollision(const FCLObject &fcl_obj1, const FCLObject &fcl_obj1_end,
+                              const FCLObject *fcl_obj2, const FCLObject *fcl_obj2_end, CollisionData &cdata)
+{
+  const std::vector<boost::shared_ptr<fcl::CollisionObject> > &objs1 = fcl_obj1.collision_objects_;
+  const std::vector<boost::shared_ptr<fcl::CollisionObject> > &objs1_end = fcl_obj1_end.collision_objects_;
+  std::vector<fcl::AABB> swept1(objs1.size());
+  for (std::size_t i = 0 ; i < objs1.size() ; ++i)
+    swept1[i] = computeSweptAABB(objs1[i].get(), objs1_end[i]->getTransform());
+
+  if (!fcl_obj2)
+  {
+    for (std::size_t i = 0 ; !cdata.done_ && i < objs1.size() ; ++i)
+      for (std::size_t j = i + 1 ; !cdata.done_ && j < objs1.size() ; ++j)
+        if (swept1[i].overlap(swept1[j]))
+          continuousCollisionCallback(objs1[i].get(), objs1_end[i]->getTransform(), objs1[j].get(), objs1_end[j]->getTransform(), &cdata);
+    return;
+  }
+
+  const std::vector<boost::shared_ptr<fcl::CollisionObject> > &objs2 = fcl_obj2->collision_objects_;
+  const std::vector<boost::shared_ptr<fcl::CollisionObject> > &objs2_end = fcl_obj2_end->collision_objects_;
+  for (std::size_t j = 0 ; !cdata.done_ && j < objs2.size() ; ++j)
+  {
+    fcl::AABB swept2 = computeSweptAABB(objs2[j].get(), objs2_end[j]->getTransform());
+    for (std::size_t i = 0 ; !cdata.done_ && i < objs1.size() ; ++i)
+      if (swept1[i].overlap(swept2))
+        continuousCollisionCallback(objs1[i].get(), objs1_end[i]->getTransform(), objs2[j].get(), objs2_end[j]->getTransform(), &cdata);
+  }
+}
+
 /* We template the function so we get a different cache for each of the template arguments combinations */
 template<typename BV, typename T>
 FCLShapeCache& GetShapeCache()
@@ -477,25 +1037,36 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
   FCLShapeCache &cache = GetShapeCache<BV, T>();
 
   boost::weak_ptr<const shapes::Shape> wptr(shape);
+  FCLGeometryConstPtr hit;
   {
     boost::mutex::scoped_lock slock(cache.lock_);
-    std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::const_iterator cache_it = cache.map_.find(wptr);
+    FCLShapeCache::EntryMap::iterator cache_it = cache.map_.find(wptr);
     if (cache_it != cache.map_.end())
     {
-      if (cache_it->second->collision_geometry_data_->ptr.raw == (void*)data)
+      const FCLGeometryConstPtr &geometry = cache_it->second.geometry_;
+      if (geometry->collision_geometry_data_->ptr.raw == (void*)data)
       {
-        //        logDebug("Collision data structures for object %s retrieved from cache.", cache_it->second->collision_geometry_data_->getID().c_str());
-        return cache_it->second;
+        //        logDebug("Collision data structures for object %s retrieved from cache.", geometry->collision_geometry_data_->getID().c_str());
+        cache.touch(cache_it);
+        cache.hits_++;
+        hit = geometry;
       }
       else
-        if (cache_it->second.unique())
+        if (geometry.unique())
         {
-          const_cast<FCLGeometry*>(cache_it->second.get())->updateCollisionGeometryData(data, false);
-          //          logDebug("Collision data structures for object %s retrieved from cache after updating the source object.", cache_it->second->collision_geometry_data_->getID().c_str());
-          return cache_it->second;
+          const_cast<FCLGeometry*>(geometry.get())->updateCollisionGeometryData(data, false);
+          //          logDebug("Collision data structures for object %s retrieved from cache after updating the source object.", geometry->collision_geometry_data_->getID().c_str());
+          cache.touch(cache_it);
+          cache.hits_++;
+          hit = geometry;
         }
     }
   }
+  if (hit)
+  {
+    countCacheEvent("FCLShapeCache::hit");
+    return hit;
+  }
 
   // attached objects could have previously been World::Object; we try to move them
   // from their old cache to the new one, if possible. the code is not pretty, but should help
@@ -507,14 +1078,15 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
 
     // attached bodies could be just moved from the environment.
     othercache.lock_.lock(); // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
-    std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator cache_it = othercache.map_.find(wptr);
+    FCLShapeCache::EntryMap::iterator cache_it = othercache.map_.find(wptr);
     if (cache_it != othercache.map_.end())
     {
-      if (cache_it->second.unique())
+      if (cache_it->second.geometry_.unique())
       {
         // remove from old cache
-        FCLGeometryConstPtr obj_cache = cache_it->second;
-        othercache.map_.erase(cache_it);
+        FCLGeometryConstPtr obj_cache = cache_it->second.geometry_;
+        std::size_t bytes = cache_it->second.bytes_;
+        othercache.erase(cache_it);
         othercache.lock_.unlock();
 
         // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
@@ -523,9 +1095,13 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
         //        logDebug("Collision data structures for attached body %s retrieved from the cache for world objects.", obj_cache->collision_geometry_data_->getID().c_str());
 
         // add to the new cache
-        boost::mutex::scoped_lock slock(cache.lock_);
-        cache.map_[wptr] = obj_cache;
-        cache.bumpUseCount();
+        {
+          boost::mutex::scoped_lock slock(cache.lock_);
+          cache.insert(wptr, obj_cache, bytes);
+          cache.hits_++;
+          cache.bumpUseCount();
+        }
+        countCacheEvent("FCLShapeCache::hit");
         return obj_cache;
       }
     }
@@ -542,14 +1118,15 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
 
       // attached bodies could be just moved from the environment.
       othercache.lock_.lock(); // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
-      std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator cache_it = othercache.map_.find(wptr);
+      FCLShapeCache::EntryMap::iterator cache_it = othercache.map_.find(wptr);
       if (cache_it != othercache.map_.end())
       {
-        if (cache_it->second.unique())
+        if (cache_it->second.geometry_.unique())
         {
           // remove from old cache
-          FCLGeometryConstPtr obj_cache = cache_it->second;
-          othercache.map_.erase(cache_it);
+          FCLGeometryConstPtr obj_cache = cache_it->second.geometry_;
+          std::size_t bytes = cache_it->second.bytes_;
+          othercache.erase(cache_it);
           othercache.lock_.unlock();
 
           // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
@@ -559,9 +1136,13 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
           //                   obj_cache->collision_geometry_data_->getID().c_str());
 
           // add to the new cache
-          boost::mutex::scoped_lock slock(cache.lock_);
-          cache.map_[wptr] = obj_cache;
-          cache.bumpUseCount();
+          {
+            boost::mutex::scoped_lock slock(cache.lock_);
+            cache.insert(wptr, obj_cache, bytes);
+            cache.hits_++;
+            cache.bumpUseCount();
+          }
+          countCacheEvent("FCLShapeCache::hit");
           return obj_cache;
         }
       }
@@ -569,6 +1150,7 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
     }
 
   fcl::CollisionGeometry* cg_g = NULL;
+  std::size_t bytes = 0; // the memory held by cg_g, as accounted for by the cache
   if (shape->type == shapes::PLANE) // shapes that directly produce CollisionGeometry
   {
     // handle cases individually
@@ -578,6 +1160,7 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
       {
         const shapes::Plane* p = static_cast<const shapes::Plane*>(shape.get());
         cg_g = new fcl::Plane(p->a, p->b, p->c, p->d);
+        bytes = sizeof(fcl::Plane);
       }
       break;
     default:
@@ -592,6 +1175,7 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
       {
         const shapes::Sphere* s = static_cast<const shapes::Sphere*>(shape.get());
         cg_g = new fcl::Sphere(s->radius);
+        bytes = sizeof(fcl::Sphere);
       }
       break;
     case shapes::BOX:
@@ -599,18 +1183,21 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
         const shapes::Box* s = static_cast<const shapes::Box*>(shape.get());
         const double* size = s->size;
         cg_g = new fcl::Box(size[0], size[1], size[2]);
+        bytes = sizeof(fcl::Box);
       }
       break;
     case shapes::CYLINDER:
       {
         const shapes::Cylinder* s = static_cast<const shapes::Cylinder*>(shape.get());
         cg_g = new fcl::Cylinder(s->radius, s->length);
+        bytes = sizeof(fcl::Cylinder);
       }
       break;
     case shapes::CONE:
       {
         const shapes::Cone* s = static_cast<const shapes::Cone*>(shape.get());
         cg_g = new fcl::Cone(s->radius, s->length);
+        bytes = sizeof(fcl::Cone);
       }
       break;
     case shapes::MESH:
@@ -632,12 +1219,14 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
           g->endModel();
         }
         cg_g = g;
+        bytes = g->memUsage(0); // includes the BVH nodes, triangles and vertices
       }
       break;
     case shapes::OCTREE:
       {
         const shapes::OcTree* g = static_cast<const shapes::OcTree*>(shape.get());
         cg_g = new fcl::OcTree(g->octree);
+        bytes = sizeof(fcl::OcTree); // the octree itself is held by the shape
       }
       break;
     default:
@@ -649,9 +1238,13 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
   {
     cg_g->computeLocalAABB();
     FCLGeometryConstPtr res(new FCLGeometry(cg_g, data));
-    boost::mutex::scoped_lock slock(cache.lock_);
-    cache.map_[wptr] = res;
-    cache.bumpUseCount();
+    {
+      boost::mutex::scoped_lock slock(cache.lock_);
+      cache.insert(wptr, res, bytes);
+      cache.misses_++;
+      cache.bumpUseCount();
+    }
+    countCacheEvent("FCLShapeCache::miss");
     return res;
   }
   return FCLGeometryConstPtr();
@@ -690,10 +1283,94 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
   }
 }
 
+/// The geometry constructed for padded or scaled links. Each padded shape is a new shape, so the shape caches cannot
+/// find it again; this registry lets every robot that uses the same padding and scale for a link share one BVH.
+struct PaddedLinkGeometryRegistry
+{
+  struct Key
+  {
+    boost::weak_ptr<const shapes::Shape> shape_;
+    const robot_model::LinkModel        *link_;
+    double                               scale_;
+    double                               padding_;
+
+    bool operator<(const Key &other) const
+    {
+      if (link_ != other.link_)
+        return link_ < other.link_;
+      if (scale_ != other.scale_)
+        return scale_ < other.scale_;
+      if (padding_ != other.padding_)
+        return padding_ < other.padding_;
+      return shape_ < other.shape_;
+    }
+  };
+
+  typedef std::map<Key, boost::weak_ptr<const FCLGeometry> > GeometryMap;
+
+  /// Remove the entries whose geometry is no longer held by anyone
+  void removeExpired()
+  {
+    for (GeometryMap::iterator it = map_.begin() ; it != map_.end() ; )
+    {
+      GeometryMap::iterator nit = it; ++nit;
+      if (it->second.expired() || it->first.shape_.expired())
+        map_.erase(it);
+      it = nit;
+    }
+  }
+
+  boost::mutex lock_;
+  GeometryMap  map_;
+};
+
+static PaddedLinkGeometryRegistry& getPaddedLinkGeometryRegistry()
+{
+  static PaddedLinkGeometryRegistry registry;
+  return registry;
+}
+
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, double scale, double padding,
                                             const robot_model::LinkModel *link)
 {
-  return createCollisionGeometry<fcl::OBBRSS, robot_model::LinkModel>(shape, scale, padding, link);
+  // unpadded geometry is already shared, through the cache for the link shapes
+  if (fabs(scale - 1.0) <= std::numeric_limits<double>::epsilon() && fabs(padding) <= std::numeric_limits<double>::epsilon())
+    return createCollisionGeometry<fcl::OBBRSS, robot_model::LinkModel>(shape, link);
+
+  PaddedLinkGeometryRegistry &registry = getPaddedLinkGeometryRegistry();
+  PaddedLinkGeometryRegistry::Key key;
+  key.shape_ = shape;
+  key.link_ = link;
+  key.scale_ = scale;
+  key.padding_ = padding;
+  {
+    boost::mutex::scoped_lock slock(registry.lock_);
+    PaddedLinkGeometryRegistry::GeometryMap::const_iterator it = registry.map_.find(key);
+    if (it != registry.map_.end())
+    {
+      FCLGeometryConstPtr geometry = it->second.lock();
+      if (geometry)
+      {
+        FCLShapeCache &cache = GetShapeCache<fcl::OBBRSS, robot_model::LinkModel>();
+        {
+          boost::mutex::scoped_lock cslock(cache.lock_);
+          cache.hits_++;
+        }
+        slock.unlock();
+        countCacheEvent("FCLShapeCache::hit");
+        return geometry;
+      }
+    }
+  }
+
+  FCLGeometryConstPtr geometry = createCollisionGeometry<fcl::OBBRSS, robot_model::LinkModel>(shape, scale, padding, link);
+  if (geometry)
+  {
+    boost::mutex::scoped_lock slock(registry.lock_);
+    registry.removeExpired();
+    registry.map_[key] = geometry;
+  }
+  return geometry;
 }
 
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, double scale, double padding,
@@ -722,14 +1399,153 @@ void cleanCollisionGeometryCache()
   }
 }
 
+// the caches geometry is constructed in, one for each kind of owner of the shapes
+static void getShapeCaches(std::vector<FCLShapeCache*> &caches)
+{
+  caches.push_back(&GetShapeCache<fcl::OBBRSS, robot_model::LinkModel>());
+  caches.push_back(&GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>());
+  caches.push_back(&GetShapeCache<fcl::OBBRSS, World::Object>());
+}
+
+void setCollisionGeometryCacheLimit(std::size_t max_bytes)
+{
+  std::vector<FCLShapeCache*> caches;
+  getShapeCaches(caches);
+  for (std::size_t i = 0 ; i < caches.size() ; ++i)
+  {
+    boost::mutex::scoped_lock slock(caches[i]->lock_);
+    caches[i]->max_bytes_ = max_bytes;
+    caches[i]->enforceLimit();
+  }
+}
+
+std::size_t getCollisionGeometryCacheLimit()
+{
+  FCLShapeCache &cache = GetShapeCache<fcl::OBBRSS, World::Object>();
+  boost::mutex::scoped_lock slock(cache.lock_);
+  return cache.max_bytes_;
+}
+
+CollisionGeometryCacheStatistics getCollisionGeometryCacheStatistics()
+{
+  CollisionGeometryCacheStatistics stats;
+  std::vector<FCLShapeCache*> caches;
+  getShapeCaches(caches);
+  for (std::size_t i = 0 ; i < caches.size() ; ++i)
+  {
+    boost::mutex::scoped_lock slock(caches[i]->lock_);
+    stats.hits += caches[i]->hits_;
+    stats.misses += caches[i]->misses_;
+    stats.evictions += caches[i]->evictions_;
+    stats.entries += caches[i]->map_.size();
+    stats.bytes += caches[i]->bytes_;
+  }
+  return stats;
+}
+
+void resetCollisionGeometryCacheStatistics()
+{
+  std::vector<FCLShapeCache*> caches;
+  getShapeCaches(caches);
+  for (std::size_t i = 0 ; i < caches.size() ; ++i)
+  {
+    boost::mutex::scoped_lock slock(caches[i]->lock_);
+    caches[i]->hits_ = caches[i]->misses_ = caches[i]->evictions_ = 0;
+  }
+}
+
+std::size_t getCollisionGeometryMemoryUsage(const FCLGeometry &geometry)
+{
+  std::size_t bytes = sizeof(FCLGeometry) + sizeof(CollisionGeometryData);
+  const fcl::CollisionGeometry *cg = geometry.collision_geometry_.get();
+  if (!cg)
+    return bytes;
+  switch (cg->getNodeType())
+  {
+  case fcl::BV_OBBRSS:
+    return bytes + static_cast<const fcl::BVHModel<fcl::OBBRSS>*>(cg)->memUsage(0);
+  case fcl::GEOM_BOX:
+    return bytes + sizeof(fcl::Box);
+  case fcl::GEOM_SPHERE:
+    return bytes + sizeof(fcl::Sphere);
+  case fcl::GEOM_CYLINDER:
+    return bytes + sizeof(fcl::Cylinder);
+  case fcl::GEOM_CONE:
+    return bytes + sizeof(fcl::Cone);
+  case fcl::GEOM_PLANE:
+    return bytes + sizeof(fcl::Plane);
+  case fcl::GEOM_OCTREE:
+    return bytes + sizeof(fcl::OcTree);
+  default:
+    return bytes + sizeof(fcl::CollisionGeometry);
+  }
+}
+
+std::size_t getFCLObjectMemoryUsage(const FCLObject &fcl_obj)
+{
+  std::size_t bytes = sizeof(FCLObject) + fcl_obj.collision_objects_.capacity() * sizeof(boost::shared_ptr<fcl::CollisionObject>) +
+    fcl_obj.collision_geometry_.capacity() * sizeof(FCLGeometryConstPtr) + fcl_obj.collision_objects_.size() * sizeof(fcl::CollisionObject);
+  for (std::size_t i = 0 ; i < fcl_obj.collision_geometry_.size() ; ++i)
+    if (fcl_obj.collision_geometry_[i])
+      bytes += getCollisionGeometryMemoryUsage(*fcl_obj.collision_geometry_[i]);
+  return bytes;
+}
+
+}
+
+const std::vector<bool>* collision_detection::getActiveLinkMask(const robot_model::RobotModelConstPtr &kmodel, const std::string &group_name)
+{
+  if (kmodel->hasJointModelGroup(group_name))
+    return &kmodel->getJointModelGroup(group_name)->getUpdatedLinkModelsWithGeometryMask();
+  return NULL;
 }
 
 void collision_detection::CollisionData::enableGroup(const robot_model::RobotModelConstPtr &kmodel)
 {
   if (kmodel->hasJointModelGroup(req_->group_name))
-    active_components_only_ = &kmodel->getJointModelGroup(req_->group_name)->getUpdatedLinkModelsWithGeometrySet();
+  {
+    const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup(req_->group_name);
+    active_components_only_ = &jmg->getUpdatedLinkModelsWithGeometrySet();
+    active_link_mask_ = &jmg->getUpdatedLinkModelsWithGeometryMask();
+  }
+  else
+  {
+    active_components_only_ = NULL;
+    active_link_mask_ = NULL;
+  }
+}
+
+bool collision_detection::CollisionData::isActiveLink(const robot_model::LinkModel *link) const
+{
+  if (!link)
+    return false;
+  if (active_link_mask_)
+    return isLinkInMask(active_link_mask_, link->getTreeIndex());
+  return !active_components_only_ || active_components_only_->find(link) != active_components_only_->end();
+}
+
+void collision_detection::DistanceData::enableGroup(const robot_model::RobotModelConstPtr &kmodel)
+{
+  if (kmodel->hasJointModelGroup(req_->group_name))
+  {
+    const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup(req_->group_name);
+    active_components_only_ = &jmg->getUpdatedLinkModelsWithGeometrySet();
+    active_link_mask_ = &jmg->getUpdatedLinkModelsWithGeometryMask();
+  }
   else
+  {
     active_components_only_ = NULL;
+    active_link_mask_ = NULL;
+  }
+}
+
+bool collision_detection::DistanceData::isActiveLink(const robot_model::LinkModel *link) const
+{
+  if (!link)
+    return false;
+  if (active_link_mask_)
+    return isLinkInMask(active_link_mask_, link->getTreeIndex());
+  return !active_components_only_ || active_components_only_->find(link) != active_components_only_->end();
 }
 
 void collision_detection::FCLObject::registerTo(fcl::BroadPhaseCollisionManager *manager)
@@ -35,21 +35,306 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/profiler/query_counters.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace collision_detection
+{
+namespace
+{
+
+/** \brief The broad-phase data kept by a thread for one CollisionRobotFCL */
+struct SelfCollisionCache
+{
+  SelfCollisionCache() : registered_(false), world_robot_cache_id_(std::numeric_limits<std::size_t>::max())
+  {
+  }
+
+  /// The manager and the collision objects for the links
+  FCLManager                         manager_;
+
+  /// For each link (indexed as CollisionRobotFCL::geoms_), the collision object in manager_ (NULL if the link has no geometry)
+  std::vector<fcl::CollisionObject*> link_objects_;
+
+  /// The objects of the attached bodies of the state last passed to getSelfCollisionBroadPhase()
+  FCLObject                          attached_;
+
+  /// The attached bodies the objects in attached_ were constructed for
+  std::vector<const robot_state::AttachedBody*> attached_bodies_;
+
+  /// The instance ids of attached_bodies_, as they were when the objects were constructed
+  std::vector<std::size_t>           attached_ids_;
+
+  /// The shapes of attached_bodies_, in order; holding them ensures a body is only considered unchanged if it uses the same shapes
+  std::vector<shapes::ShapeConstPtr> attached_shapes_;
+
+  /// For each object in attached_, the index of its body in attached_bodies_ and the index of its shape in that body
+  std::vector<std::pair<std::size_t, std::size_t> > attached_index_;
+
+  /// Flag indicating whether the link objects have been registered to the manager
+  bool                               registered_;
+
+  /// The compiled form of the last collision matrix used for self checks, for the link names of the robot model
+  CompiledAllowedCollisionMatrix     acm_;
+
+  /// The cache id of the robot whose geometry world_link_objects_ was set up for (see checkWorldAndSelfCollisionHelper())
+  std::size_t                        world_robot_cache_id_;
 
-collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::RobotModelConstPtr &kmodel, double padding, double scale) : CollisionRobot(kmodel, padding, scale)
+  /// For each link, the collision object checked against the world (NULL if the link has no geometry); this is the
+  /// object in link_objects_ if the link has the same geometry in both robots
+  std::vector<fcl::CollisionObject*> world_link_objects_;
+
+  /// The objects in world_link_objects_ that are not in link_objects_
+  FCLObject                          world_links_;
+
+  /// The geometry of the attached bodies passed to constructAttachedBodyObjects(), by instance id; for each body, one
+  /// entry per shape (NULL if no geometry could be constructed for the shape)
+  std::map<std::size_t, std::vector<FCLGeometryConstPtr> > attached_geometry_;
+};
+
+/// The number of attached bodies whose geometry a thread keeps for checks against the world
+static const std::size_t MAX_CACHED_ATTACHED_GEOMETRY = 64;
+
+typedef boost::shared_ptr<SelfCollisionCache> SelfCollisionCachePtr;
+
+}
+
+/** \brief The broad-phase data of all the threads that used a CollisionRobotFCL (for its current geometry). The registry owns
+    the caches, so they are released together with the robot; threads only refer to them, and release the ones they created
+    when they exit. */
+struct SelfCollisionCacheRegistry
+{
+  boost::mutex                    lock_;
+  std::set<SelfCollisionCachePtr> caches_;
+};
+
+namespace
+{
+
+/** \brief The caches a thread refers to, by registry */
+struct ThreadSelfCollisionCaches
+{
+  struct Entry
+  {
+    boost::weak_ptr<SelfCollisionCacheRegistry> registry_;
+    boost::weak_ptr<SelfCollisionCache>         cache_;
+  };
+  typedef std::map<const SelfCollisionCacheRegistry*, Entry> EntryMap;
+
+  ~ThreadSelfCollisionCaches()
+  {
+    for (EntryMap::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+      if (boost::shared_ptr<SelfCollisionCacheRegistry> registry = it->second.registry_.lock())
+      {
+        boost::mutex::scoped_lock slock(registry->lock_);
+        registry->caches_.erase(it->second.cache_.lock());
+      }
+  }
+
+  EntryMap entries_;
+};
+
+// the caches of a thread are released when the thread exits
+static boost::thread_specific_ptr<ThreadSelfCollisionCaches> thread_caches;
+
+// the cache of the calling thread in registry, created if needed; it lives as long as the registry
+static SelfCollisionCache* getThreadSelfCollisionCache(const boost::shared_ptr<SelfCollisionCacheRegistry> &registry)
+{
+  if (!thread_caches.get())
+    thread_caches.reset(new ThreadSelfCollisionCaches());
+  ThreadSelfCollisionCaches::EntryMap &entries = thread_caches->entries_;
+  ThreadSelfCollisionCaches::EntryMap::iterator it = entries.find(registry.get());
+  if (it != entries.end())
+  {
+    // the entry may be for a released registry that had the same address
+    if (it->second.registry_.lock() == registry)
+      if (SelfCollisionCachePtr cache = it->second.cache_.lock())
+        return cache.get();
+  }
+  else
+    // entries of released registries are dropped whenever an entry is added, so they do not accumulate
+    for (it = entries.begin() ; it != entries.end() ; )
+      if (it->second.registry_.expired())
+        entries.erase(it++);
+      else
+        ++it;
+
+  SelfCollisionCachePtr cache(new SelfCollisionCache());
+  {
+    boost::mutex::scoped_lock slock(registry->lock_);
+    registry->caches_.insert(cache);
+  }
+  ThreadSelfCollisionCaches::Entry &entry = entries[registry.get()];
+  entry.registry_ = registry;
+  entry.cache_ = cache;
+  return cache.get();
+}
+
+// the matrix is compiled again only if a different matrix is passed in, or the matrix was modified
+static const CompiledAllowedCollisionMatrix* getCompiledACM(SelfCollisionCache *cache, const AllowedCollisionMatrix *acm,
+                                                           const robot_model::RobotModelConstPtr &kmodel)
+{
+  if (!acm)
+    return NULL;
+  if (!cache->acm_.isCompiledFrom(*acm))
+    cache->acm_.compile(*acm, kmodel->getLinkModelNames());
+  return &cache->acm_;
+}
+
+// the attached objects can be reused if the state carries the same attached bodies, unmodified, with the same shapes;
+// the instance ids tell a body apart from one constructed later at the same address
+static bool sameAttachedBodies(const SelfCollisionCache *cache, const std::vector<const robot_state::AttachedBody*> &bodies)
+{
+  if (bodies != cache->attached_bodies_)
+    return false;
+  std::size_t k = 0;
+  for (std::size_t i = 0 ; i < bodies.size() ; ++i)
+  {
+    if (bodies[i]->getInstanceID() != cache->attached_ids_[i])
+      return false;
+    const std::vector<shapes::ShapeConstPtr> &shapes = bodies[i]->getShapes();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j, ++k)
+      if (k >= cache->attached_shapes_.size() || shapes[j] != cache->attached_shapes_[k])
+        return false;
+  }
+  return k == cache->attached_shapes_.size();
+}
+
+// collect the objects of the links marked in link_mask and of the bodies attached to them; link_objects is indexed as CollisionRobotFCL::geoms_
+static void getActiveObjects(const SelfCollisionCache *cache, const std::vector<fcl::CollisionObject*> &link_objects,
+                             const std::vector<bool> *link_mask, std::vector<fcl::CollisionObject*> &objects)
+{
+  objects.clear();
+  for (std::size_t i = 0 ; i < link_objects.size() ; ++i)
+    if (link_objects[i] && isLinkInMask(link_mask, i))
+      objects.push_back(link_objects[i]);
+  for (std::size_t i = 0 ; i < cache->attached_.collision_objects_.size() ; ++i)
+    if (isLinkInMask(link_mask, cache->attached_bodies_[cache->attached_index_[i].first]->getAttachedLink()->getTreeIndex()))
+      objects.push_back(cache->attached_.collision_objects_[i].get());
+}
+
+/** \brief The data passed to activeSelfCollisionCallback() */
+struct ActiveSelfCollisionData
+{
+  CollisionData                            *cd_;
+
+  /// The object the broad-phase manager is queried with
+  fcl::CollisionObject                     *query_;
+
+  /// The objects the manager was queried with before query_
+  const std::vector<fcl::CollisionObject*> *queried_;
+};
+
+// forward pairs to collisionCallback(), except the query object with itself and pairs already seen from the other object
+static bool activeSelfCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data)
+{
+  ActiveSelfCollisionData *d = reinterpret_cast<ActiveSelfCollisionData*>(data);
+  fcl::CollisionObject *other = o1 == d->query_ ? o2 : o1;
+  if (other == d->query_ || std::find(d->queried_->begin(), d->queried_->end(), other) != d->queried_->end())
+    return d->cd_->done_;
+  return collisionCallback(o1, o2, d->cd_);
+}
+
+// check for self collisions in manager; if only some of the objects are active, only the pairs that involve them are looked up
+static void collideSelf(fcl::BroadPhaseCollisionManager *manager, const SelfCollisionCache *cache, CollisionData &cd)
+{
+  std::vector<fcl::CollisionObject*> active;
+  if (cd.active_link_mask_)
+    getActiveObjects(cache, cache->link_objects_, cd.active_link_mask_, active);
+
+  // querying the tree once per object only pays off if few objects are active
+  if (!cd.active_link_mask_ || active.size() * 2 > cache->manager_.object_.collision_objects_.size() + cache->attached_.collision_objects_.size())
+  {
+    manager->collide(&cd, &collisionCallback);
+    return;
+  }
+
+  std::vector<fcl::CollisionObject*> queried;
+  queried.reserve(active.size());
+  for (std::size_t i = 0 ; !cd.done_ && i < active.size() ; ++i)
+  {
+    ActiveSelfCollisionData d;
+    d.cd_ = &cd;
+    d.query_ = active[i];
+    d.queried_ = &queried;
+    manager->collide(active[i], &d, &activeSelfCollisionCallback);
+    queried.push_back(active[i]);
+  }
+}
+
+/** \brief The data passed to robotsCollisionCallback() */
+struct RobotsCollisionData
+{
+  CollisionData                                                 *cd_;
+
+  /// The collision objects of all robots with the index of the robot they belong to, sorted by object
+  std::vector<std::pair<const fcl::CollisionObject*, std::size_t> > robot_of_;
+
+  /// The number of robots
+  std::size_t                                                    count_;
+
+  /// The allowed collision matrix for each pair of robots (count_ x count_, row-major); if empty, cd_->acm_ is used for all pairs
+  const std::vector<const AllowedCollisionMatrix*>              *pair_acms_;
+
+  std::size_t robotOf(const fcl::CollisionObject *o) const
+  {
+    return std::lower_bound(robot_of_.begin(), robot_of_.end(), std::make_pair(o, std::size_t(0)))->second;
+  }
+};
+
+// forward pairs of objects that belong to different robots to collisionCallback(), with the allowed collision matrix of those robots
+static bool robotsCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data)
+{
+  RobotsCollisionData *d = reinterpret_cast<RobotsCollisionData*>(data);
+  std::size_t r1 = d->robotOf(o1);
+  std::size_t r2 = d->robotOf(o2);
+  if (r1 == r2)
+    return d->cd_->done_;
+  if (!d->pair_acms_->empty())
+    d->cd_->acm_ = (*d->pair_acms_)[std::min(r1, r2) * d->count_ + std::max(r1, r2)];
+  return collisionCallback(o1, o2, d->cd_);
+}
+
+// the number of paddings and scalings geometry is kept for, for each link
+static const std::size_t MAX_GEOMETRY_VARIANTS = 4;
+
+static std::size_t newCacheId()
+{
+  static boost::mutex lock;
+  static std::size_t next_id = 0;
+  boost::mutex::scoped_lock slock(lock);
+  return next_id++;
+}
+
+}
+}
+
+collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::RobotModelConstPtr &kmodel, double padding, double scale) :
+  CollisionRobot(kmodel, padding, scale), cache_id_(newCacheId()), caches_(new SelfCollisionCacheRegistry())
 {
   links_ = kmodel_->getLinkModels();
+  geom_variants_.resize(links_.size());
 
-  // we keep the same order of objects as what RobotState *::getLinkState() returns
+  // we keep the same order of objects as what RobotState *::getLinkStateVector() returns,
+  // so geoms_ can be indexed by LinkModel::getTreeIndex()
   for (std::size_t i = 0 ; i < links_.size() ; ++i)
     if (links_[i] && links_[i]->getShape())
     {
-      FCLGeometryConstPtr g = createCollisionGeometry(links_[i]->getShape(), getLinkScale(links_[i]->getName()), getLinkPadding(links_[i]->getName()), links_[i]);
-      if (g)
-        index_map_[links_[i]->getName()] = geoms_.size();
+      GeometryVariant v;
+      v.scale_ = getLinkScale(links_[i]->getName());
+      v.padding_ = getLinkPadding(links_[i]->getName());
+      v.geometry_ = createCollisionGeometry(links_[i]->getShape(), v.scale_, v.padding_, links_[i]);
+      if (v.geometry_)
+        geom_variants_[i].push_back(v);
       else
         links_[i] = NULL;
-      geoms_.push_back(g);
+      geoms_.push_back(v.geometry_);
     }
     else
     {
@@ -58,11 +343,39 @@ collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::Rob
     }
 }
 
-collision_detection::CollisionRobotFCL::CollisionRobotFCL(const CollisionRobotFCL &other) : CollisionRobot(other)
+collision_detection::CollisionRobotFCL::CollisionRobotFCL(const CollisionRobotFCL &other) : CollisionRobot(other), cache_id_(newCacheId()), caches_(new SelfCollisionCacheRegistry())
 {
   links_ = other.links_;
   geoms_ = other.geoms_;
-  index_map_ = other.index_map_;
+  geom_variants_ = other.geom_variants_;
+}
+
+void collision_detection::CollisionRobotFCL::updateLinkGeometry(std::size_t index)
+{
+  const robot_model::LinkModel *lmodel = links_[index];
+  double scale = getLinkScale(lmodel->getName());
+  double padding = getLinkPadding(lmodel->getName());
+
+  std::vector<GeometryVariant> &variants = geom_variants_[index];
+  for (std::size_t i = 0 ; i < variants.size() ; ++i)
+    if (variants[i].scale_ == scale && variants[i].padding_ == padding)
+    {
+      std::rotate(variants.begin(), variants.begin() + i, variants.begin() + i + 1);
+      geoms_[index] = variants.front().geometry_;
+      return;
+    }
+
+  GeometryVariant v;
+  v.scale_ = scale;
+  v.padding_ = padding;
+  v.geometry_ = createCollisionGeometry(lmodel->getShape(), scale, padding, lmodel);
+  geoms_[index] = v.geometry_;
+  if (v.geometry_)
+  {
+    variants.insert(variants.begin(), v);
+    if (variants.size() > MAX_GEOMETRY_VARIANTS)
+      variants.resize(MAX_GEOMETRY_VARIANTS);
+  }
 }
 
 void collision_detection::CollisionRobotFCL::getAttachedBodyObjects(const robot_state::AttachedBody *ab,
@@ -77,36 +390,59 @@ void collision_detection::CollisionRobotFCL::getAttachedBodyObjects(const robot_
   }
 }
 
-void collision_detection::CollisionRobotFCL::constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj) const
+void collision_detection::CollisionRobotFCL::constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj,
+                                                                const std::vector<bool> *link_mask) const
 {
   const std::vector<robot_state::LinkState*> &link_states = state.getLinkStateVector();
   fcl_obj.collision_objects_.reserve(geoms_.size());
 
   for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
   {
+    if (!isLinkInMask(link_mask, i))
+      continue;
     if (geoms_[i] && geoms_[i]->collision_geometry_)
     {
       fcl::CollisionObject *collObj = new fcl::CollisionObject(geoms_[i]->collision_geometry_, transform2fcl(link_states[i]->getGlobalCollisionBodyTransform()));
       fcl_obj.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
       // the CollisionGeometryData is already stored in the class member geoms_, so we need not copy it
     }
-    std::vector<const robot_state::AttachedBody*> ab;
-    link_states[i]->getAttachedBodies(ab);
-    for (std::size_t j = 0 ; j < ab.size() ; ++j)
+    constructAttachedBodyObjects(link_states[i], fcl_obj);
+  }
+}
+
+void collision_detection::CollisionRobotFCL::constructAttachedBodyObjects(const robot_state::LinkState *link_state, FCLObject &fcl_obj) const
+{
+  std::vector<const robot_state::AttachedBody*> ab;
+  link_state->getAttachedBodies(ab);
+  if (ab.empty())
+    return;
+
+  // the geometry of a body is looked up in the shape cache only the first time the thread sees its instance id;
+  // the id changes whenever the definition of the body does, so the geometry kept for it cannot be stale
+  SelfCollisionCache *cache = getThreadSelfCollisionCache(caches_);
+  for (std::size_t j = 0 ; j < ab.size() ; ++j)
+  {
+    std::map<std::size_t, std::vector<FCLGeometryConstPtr> >::iterator it = cache->attached_geometry_.find(ab[j]->getInstanceID());
+    if (it == cache->attached_geometry_.end())
     {
-      std::vector<FCLGeometryConstPtr> objs;
-      getAttachedBodyObjects(ab[j], objs);
-      const EigenSTL::vector_Affine3d &ab_t = ab[j]->getGlobalCollisionBodyTransforms();
-      for (std::size_t k = 0 ; k < objs.size() ; ++k)
-        if (objs[k]->collision_geometry_)
-        {
-          fcl::CollisionObject *collObj = new fcl::CollisionObject(objs[k]->collision_geometry_, transform2fcl(ab_t[k]));
-          fcl_obj.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
-          // we copy the shared ptr to the CollisionGeometryData, as this is not stored by the class itself,
-          // and would be destroyed when objs goes out of scope.
-          fcl_obj.collision_geometry_.push_back(objs[k]);
-        }
+      if (cache->attached_geometry_.size() >= MAX_CACHED_ATTACHED_GEOMETRY)
+        cache->attached_geometry_.clear();
+      it = cache->attached_geometry_.insert(std::make_pair(ab[j]->getInstanceID(), std::vector<FCLGeometryConstPtr>())).first;
+      const std::vector<shapes::ShapeConstPtr> &shapes = ab[j]->getShapes();
+      it->second.resize(shapes.size());
+      for (std::size_t k = 0 ; k < shapes.size() ; ++k)
+        it->second[k] = createCollisionGeometry(shapes[k], ab[j]);
     }
+    const std::vector<FCLGeometryConstPtr> &objs = it->second;
+    const EigenSTL::vector_Affine3d &ab_t = ab[j]->getGlobalCollisionBodyTransforms();
+    for (std::size_t k = 0 ; k < objs.size() ; ++k)
+      if (objs[k] && objs[k]->collision_geometry_)
+      {
+        fcl::CollisionObject *collObj = new fcl::CollisionObject(objs[k]->collision_geometry_, transform2fcl(ab_t[k]));
+        fcl_obj.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
+        // we copy the shared ptr to the CollisionGeometryData, as the cache may drop it while fcl_obj is in use
+        fcl_obj.collision_geometry_.push_back(objs[k]);
+      }
   }
 }
 
@@ -120,6 +456,99 @@ void collision_detection::CollisionRobotFCL::allocSelfCollisionBroadPhase(const
   // manager.manager_->update();
 }
 
+collision_detection::FCLManager& collision_detection::CollisionRobotFCL::getSelfCollisionBroadPhase(const robot_state::RobotState &state) const
+{
+  SelfCollisionCache *cache = getThreadSelfCollisionCache(caches_);
+
+  // the link objects are created once per thread; the geometry is shared with geoms_
+  if (!cache->manager_.manager_)
+  {
+    cache->manager_.manager_.reset(new fcl::DynamicAABBTreeCollisionManager());
+    cache->link_objects_.resize(geoms_.size(), NULL);
+    for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+      if (geoms_[i] && geoms_[i]->collision_geometry_)
+      {
+        fcl::CollisionObject *collObj = new fcl::CollisionObject(geoms_[i]->collision_geometry_);
+        cache->manager_.object_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
+        // keep the CollisionGeometryData alive as long as the cache, even if geoms_ changes
+        cache->manager_.object_.collision_geometry_.push_back(geoms_[i]);
+        cache->link_objects_[i] = collObj;
+      }
+  }
+  fcl::BroadPhaseCollisionManager *manager = cache->manager_.manager_.get();
+
+  const std::vector<robot_state::LinkState*> &link_states = state.getLinkStateVector();
+  std::vector<const robot_state::AttachedBody*> bodies;
+  for (std::size_t i = 0 ; i < link_states.size() ; ++i)
+  {
+    std::vector<const robot_state::AttachedBody*> ab;
+    link_states[i]->getAttachedBodies(ab);
+    bodies.insert(bodies.end(), ab.begin(), ab.end());
+  }
+
+  // if the state carries the same attached bodies as the previously checked one, their objects are only moved;
+  // otherwise, the objects of the previous bodies are removed and new ones are constructed below
+  bool reuse_attached = sameAttachedBodies(cache, bodies);
+  if (reuse_attached)
+    for (std::size_t i = 0 ; i < cache->attached_.collision_objects_.size() ; ++i)
+    {
+      const std::pair<std::size_t, std::size_t> &idx = cache->attached_index_[i];
+      fcl::CollisionObject *collObj = cache->attached_.collision_objects_[i].get();
+      collObj->setTransform(transform2fcl(bodies[idx.first]->getGlobalCollisionBodyTransforms()[idx.second]));
+      collObj->computeAABB();
+    }
+  else
+  {
+    cache->attached_.unregisterFrom(manager);
+    cache->attached_.clear();
+    cache->attached_bodies_.clear();
+    cache->attached_ids_.clear();
+    cache->attached_shapes_.clear();
+    cache->attached_index_.clear();
+  }
+
+  for (std::size_t i = 0 ; i < cache->link_objects_.size() ; ++i)
+    if (cache->link_objects_[i])
+    {
+      cache->link_objects_[i]->setTransform(transform2fcl(link_states[i]->getGlobalCollisionBodyTransform()));
+      cache->link_objects_[i]->computeAABB();
+    }
+  if (cache->registered_)
+    manager->update();
+  else
+  {
+    cache->manager_.object_.registerTo(manager);
+    cache->registered_ = true;
+  }
+
+  if (!reuse_attached)
+  {
+    // the objects keep their geometry alive, so the shape cache does not hand it to other bodies while we hold it
+    for (std::size_t i = 0 ; i < bodies.size() ; ++i)
+    {
+      const std::vector<shapes::ShapeConstPtr> &shapes = bodies[i]->getShapes();
+      const EigenSTL::vector_Affine3d &ab_t = bodies[i]->getGlobalCollisionBodyTransforms();
+      for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+      {
+        FCLGeometryConstPtr g = createCollisionGeometry(shapes[j], bodies[i]);
+        if (g && g->collision_geometry_)
+        {
+          fcl::CollisionObject *collObj = new fcl::CollisionObject(g->collision_geometry_, transform2fcl(ab_t[j]));
+          cache->attached_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
+          cache->attached_.collision_geometry_.push_back(g);
+          cache->attached_index_.push_back(std::make_pair(i, j));
+        }
+      }
+      cache->attached_shapes_.insert(cache->attached_shapes_.end(), shapes.begin(), shapes.end());
+      cache->attached_ids_.push_back(bodies[i]->getInstanceID());
+    }
+    cache->attached_bodies_ = bodies;
+    cache->attached_.registerTo(manager);
+  }
+
+  return cache->manager_;
+}
+
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const
 {
   checkSelfCollisionHelper(req, res, state, NULL);
@@ -133,26 +562,175 @@ void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionR
 
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionContinuousHelper(req, res, state1, state2, NULL);
 }
 
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionContinuousHelper(req, res, state1, state2, &acm);
 }
 
 void collision_detection::CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                       const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
+  SelfCollisionCache *cache = getThreadSelfCollisionCache(caches_);
   CollisionData cd(&req, &res, acm);
+  cd.compiled_acm_ = getCompiledACM(cache, acm, getRobotModel());
   cd.enableGroup(getRobotModel());
-  manager.manager_->collide(&cd, &collisionCallback);
+  collideSelf(manager.manager_.get(), cache, cd);
   if (req.distance)
     res.distance = distanceSelfHelper(state, acm);
 }
 
+void collision_detection::CollisionRobotFCL::checkWorldAndSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                              const CollisionRobotFCL &world_robot, fcl::BroadPhaseCollisionManager *world_manager,
+                                                                              const AllowedCollisionMatrix *acm) const
+{
+  // a self collision check and a check against the world, done together
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS, 2);
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
+  SelfCollisionCache *cache = getThreadSelfCollisionCache(caches_);
+
+  if (cache->world_robot_cache_id_ != world_robot.cache_id_)
+  {
+    cache->world_links_.clear();
+    cache->world_link_objects_.assign(geoms_.size(), NULL);
+    for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+      if (world_robot.geoms_[i] && world_robot.geoms_[i]->collision_geometry_)
+      {
+        if (world_robot.geoms_[i] == geoms_[i])
+          cache->world_link_objects_[i] = cache->link_objects_[i];
+        else
+        {
+          fcl::CollisionObject *collObj = new fcl::CollisionObject(world_robot.geoms_[i]->collision_geometry_);
+          cache->world_links_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
+          cache->world_links_.collision_geometry_.push_back(world_robot.geoms_[i]);
+          cache->world_link_objects_[i] = collObj;
+        }
+      }
+    cache->world_robot_cache_id_ = world_robot.cache_id_;
+  }
+
+  CollisionData cd(&req, &res, acm);
+  cd.compiled_acm_ = getCompiledACM(cache, acm, getRobotModel());
+  cd.enableGroup(getRobotModel());
+
+  // the transforms of the links were converted when the self collision objects were moved to the state;
+  // links outside the group (if one is specified) are not checked against the world
+  const std::vector<robot_state::LinkState*> &link_states = state.getLinkStateVector();
+  for (std::size_t i = 0 ; !cd.done_ && i < cache->world_link_objects_.size() ; ++i)
+  {
+    fcl::CollisionObject *collObj = cache->world_link_objects_[i];
+    if (!collObj || !isLinkInMask(cd.active_link_mask_, i))
+      continue;
+    if (collObj != cache->link_objects_[i])
+    {
+      if (cache->link_objects_[i])
+        collObj->setTransform(cache->link_objects_[i]->getTransform());
+      else
+        collObj->setTransform(transform2fcl(link_states[i]->getGlobalCollisionBodyTransform()));
+      collObj->computeAABB();
+    }
+    world_manager->collide(collObj, &cd, &collisionCallback);
+  }
+
+  // attached bodies are not padded, so their objects are the same in both robots
+  for (std::size_t i = 0 ; !cd.done_ && i < cache->attached_.collision_objects_.size() ; ++i)
+    if (isLinkInMask(cd.active_link_mask_, cache->attached_bodies_[cache->attached_index_[i].first]->getAttachedLink()->getTreeIndex()))
+      world_manager->collide(cache->attached_.collision_objects_[i].get(), &cd, &collisionCallback);
+
+  if (!cd.done_)
+    collideSelf(manager.manager_.get(), cache, cd);
+}
+
+void collision_detection::CollisionRobotFCL::checkSelfCollisionContinuousHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                                const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
+  FCLObject fcl_obj1, fcl_obj2;
+  constructFCLObject(state1, fcl_obj1);
+  constructFCLObject(state2, fcl_obj2);
+  if (fcl_obj1.collision_objects_.size() != fcl_obj2.collision_objects_.size())
+  {
+    logError("Continuous collision checking requires the same bodies to be attached to the robot in both states");
+    return;
+  }
+
+  CollisionData cd(&req, &res, acm);
+  cd.compiled_acm_ = getCompiledACM(getThreadSelfCollisionCache(caches_), acm, getRobotModel());
+  cd.enableGroup(getRobotModel());
+  checkContinuousCollision(fcl_obj1, fcl_obj2, NULL, NULL, cd);
+
+  // contacts are computed for the state at the time of contact
+  if (res.collision && req.contacts)
+  {
+    robot_state::RobotState state(state1);
+    state1.interpolate(state2, res.time_of_contact, state);
+    CollisionRequest contact_req(req);
+    contact_req.distance = false;
+    checkSelfCollisionHelper(contact_req, res, state, acm);
+  }
+}
+
+void collision_detection::CollisionRobotFCL::computeSelfCollisionPairs(const AllowedCollisionMatrix &acm, LinkPairs &pairs) const
+{
+  pairs.clear();
+  for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+  {
+    if (!geoms_[i] || !geoms_[i]->collision_geometry_)
+      continue;
+    for (std::size_t j = i + 1 ; j < geoms_.size() ; ++j)
+    {
+      if (!geoms_[j] || !geoms_[j]->collision_geometry_)
+        continue;
+      AllowedCollision::Type type;
+      if (acm.getAllowedCollision(links_[i]->getName(), links_[j]->getName(), type) && type == AllowedCollision::ALWAYS)
+        continue;
+      pairs.push_back(std::make_pair(i, j));
+    }
+  }
+}
+
+void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                const AllowedCollisionMatrix &acm, const LinkPairs &pairs) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
+  getSelfCollisionBroadPhase(state);
+  SelfCollisionCache *cache = getThreadSelfCollisionCache(caches_);
+
+  CollisionData cd(&req, &res, &acm);
+  cd.compiled_acm_ = getCompiledACM(cache, &acm, getRobotModel());
+  cd.enableGroup(getRobotModel());
+
+  // the narrow phase is called directly for the pairs of links that may collide (and involve the group, if one is specified)
+  for (std::size_t i = 0 ; !cd.done_ && i < pairs.size() ; ++i)
+  {
+    if (!isLinkInMask(cd.active_link_mask_, pairs[i].first) && !isLinkInMask(cd.active_link_mask_, pairs[i].second))
+      continue;
+    fcl::CollisionObject *o1 = cache->link_objects_[pairs[i].first];
+    fcl::CollisionObject *o2 = cache->link_objects_[pairs[i].second];
+    if (o1 && o2 && o1->getAABB().overlap(o2->getAABB()))
+      collisionCallback(o1, o2, &cd);
+  }
+
+  // attached bodies are checked against everything else
+  const std::vector<boost::shared_ptr<fcl::CollisionObject> > &attached = cache->attached_.collision_objects_;
+  for (std::size_t i = 0 ; !cd.done_ && i < attached.size() ; ++i)
+  {
+    for (std::size_t j = 0 ; !cd.done_ && j < cache->link_objects_.size() ; ++j)
+      if (cache->link_objects_[j] && attached[i]->getAABB().overlap(cache->link_objects_[j]->getAABB()))
+        collisionCallback(attached[i].get(), cache->link_objects_[j], &cd);
+    for (std::size_t j = i + 1 ; !cd.done_ && j < attached.size() ; ++j)
+      if (attached[i]->getAABB().overlap(attached[j]->getAABB()))
+        collisionCallback(attached[i].get(), attached[j].get(), &cd);
+  }
+
+  if (req.distance)
+    res.distance = distanceSelfHelper(state, &acm);
+}
+
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const
 {
@@ -169,20 +747,21 @@ void collision_detection::CollisionRobotFCL::checkOtherCollision(const Collision
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionContinuousHelper(req, res, state1, state2, other_robot, other_state1, other_state2, NULL);
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
                                                                  const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionContinuousHelper(req, res, state1, state2, other_robot, other_state1, other_state2, &acm);
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                        const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                                                        const AllowedCollisionMatrix *acm) const
 {
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
   FCLManager manager;
   allocSelfCollisionBroadPhase(state, manager);
 
@@ -198,20 +777,154 @@ void collision_detection::CollisionRobotFCL::checkOtherCollisionHelper(const Col
     res.distance = distanceOtherHelper(state, other_robot, other_state, acm);
 }
 
+void collision_detection::CollisionRobotFCL::checkOtherCollisionContinuousHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                                 const robot_state::RobotState &state2, const CollisionRobot &other_robot,
+                                                                                 const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                                                                 const AllowedCollisionMatrix *acm) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
+  FCLObject fcl_obj1, fcl_obj2;
+  constructFCLObject(state1, fcl_obj1);
+  constructFCLObject(state2, fcl_obj2);
+
+  const CollisionRobotFCL &fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
+  FCLObject other_fcl_obj1, other_fcl_obj2;
+  fcl_rob.constructFCLObject(other_state1, other_fcl_obj1);
+  fcl_rob.constructFCLObject(other_state2, other_fcl_obj2);
+
+  if (fcl_obj1.collision_objects_.size() != fcl_obj2.collision_objects_.size() ||
+      other_fcl_obj1.collision_objects_.size() != other_fcl_obj2.collision_objects_.size())
+  {
+    logError("Continuous collision checking requires the same bodies to be attached to the robot in both states");
+    return;
+  }
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(getRobotModel());
+  checkContinuousCollision(fcl_obj1, fcl_obj2, &other_fcl_obj1, &other_fcl_obj2, cd);
+
+  // contacts are computed for the states at the time of contact
+  if (res.collision && req.contacts)
+  {
+    robot_state::RobotState state(state1);
+    state1.interpolate(state2, res.time_of_contact, state);
+    robot_state::RobotState other_state(other_state1);
+    other_state1.interpolate(other_state2, res.time_of_contact, other_state);
+    CollisionRequest contact_req(req);
+    contact_req.distance = false;
+    checkOtherCollisionHelper(contact_req, res, state, other_robot, other_state, acm);
+  }
+}
+
+void collision_detection::CollisionRobotFCL::checkRobotsCollision(const CollisionRequest &req, CollisionResult &res, const std::vector<RobotAndState> &robots,
+                                                                  const AllowedCollisionMatrix *acm)
+{
+  checkRobotsCollisionHelper(req, res, robots, acm, std::vector<const AllowedCollisionMatrix*>());
+}
+
+void collision_detection::CollisionRobotFCL::checkRobotsCollision(const CollisionRequest &req, CollisionResult &res, const std::vector<RobotAndState> &robots,
+                                                                  const std::vector<const AllowedCollisionMatrix*> &pair_acms)
+{
+  if (pair_acms.size() != robots.size() * robots.size())
+  {
+    logError("Expected %u allowed collision matrices for %u robots but got %u",
+             (unsigned int)(robots.size() * robots.size()), (unsigned int)robots.size(), (unsigned int)pair_acms.size());
+    return;
+  }
+  checkRobotsCollisionHelper(req, res, robots, NULL, pair_acms);
+}
+
+void collision_detection::CollisionRobotFCL::checkRobotsCollisionHelper(const CollisionRequest &req, CollisionResult &res, const std::vector<RobotAndState> &robots,
+                                                                        const AllowedCollisionMatrix *acm, const std::vector<const AllowedCollisionMatrix*> &pair_acms)
+{
+  std::vector<const CollisionRobotFCL*> fcl_robots(robots.size());
+  bool all_fcl = true;
+  for (std::size_t i = 0 ; i < robots.size() ; ++i)
+    if (!(fcl_robots[i] = dynamic_cast<const CollisionRobotFCL*>(robots[i].first)))
+      all_fcl = false;
+
+  // without a common representation, fall back to checking the robots two at a time
+  if (!all_fcl)
+  {
+    for (std::size_t i = 0 ; i < robots.size() ; ++i)
+      for (std::size_t j = i + 1 ; j < robots.size() ; ++j)
+      {
+        if (res.collision && !req.distance && (!req.contacts || res.contacts.size() >= req.max_contacts))
+          return;
+        const AllowedCollisionMatrix *pair_acm = pair_acms.empty() ? acm : pair_acms[i * robots.size() + j];
+        double distance = res.distance;
+        if (pair_acm)
+          robots[i].first->checkOtherCollision(req, res, *robots[i].second, *robots[j].first, *robots[j].second, *pair_acm);
+        else
+          robots[i].first->checkOtherCollision(req, res, *robots[i].second, *robots[j].first, *robots[j].second);
+        res.distance = std::min(distance, res.distance);
+      }
+    return;
+  }
+
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
+
+  // all links of all robots go into one manager, so pairs of robots are only looked at where their links are close
+  std::vector<FCLObject> fcl_objs(robots.size());
+  std::vector<fcl::CollisionObject*> objects;
+  RobotsCollisionData d;
+  for (std::size_t i = 0 ; i < robots.size() ; ++i)
+  {
+    fcl_robots[i]->constructFCLObject(*robots[i].second, fcl_objs[i], getActiveLinkMask(fcl_robots[i]->getRobotModel(), req.group_name));
+    for (std::size_t j = 0 ; j < fcl_objs[i].collision_objects_.size() ; ++j)
+    {
+      objects.push_back(fcl_objs[i].collision_objects_[j].get());
+      d.robot_of_.push_back(std::make_pair(objects.back(), i));
+    }
+  }
+  std::sort(d.robot_of_.begin(), d.robot_of_.end());
+
+  fcl::DynamicAABBTreeCollisionManager manager;
+  if (!objects.empty())
+    manager.registerObjects(objects);
+
+  CollisionData cd(&req, &res, acm);
+  d.cd_ = &cd;
+  d.count_ = robots.size();
+  d.pair_acms_ = &pair_acms;
+  manager.collide(&d, &robotsCollisionCallback);
+
+  if (req.distance)
+    for (std::size_t i = 0 ; i < robots.size() ; ++i)
+      for (std::size_t j = i + 1 ; j < robots.size() ; ++j)
+        res.distance = std::min(res.distance, fcl_robots[i]->distanceOtherHelper(*robots[i].second, *fcl_robots[j], *robots[j].second,
+                                                                                 pair_acms.empty() ? acm : pair_acms[i * robots.size() + j]));
+}
+
+std::size_t collision_detection::CollisionRobotFCL::getMemoryUsage() const
+{
+  std::size_t bytes = CollisionRobot::getMemoryUsage() + sizeof(*this) - sizeof(CollisionRobot) +
+    links_.capacity() * sizeof(const robot_model::LinkModel*) + geoms_.capacity() * sizeof(FCLGeometryConstPtr) +
+    geom_variants_.capacity() * sizeof(std::vector<GeometryVariant>);
+  for (std::size_t i = 0 ; i < geom_variants_.size() ; ++i)
+  {
+    bytes += geom_variants_[i].capacity() * sizeof(GeometryVariant);
+    for (std::size_t j = 0 ; j < geom_variants_[i].size() ; ++j)
+      if (geom_variants_[i][j].geometry_)
+        bytes += getCollisionGeometryMemoryUsage(*geom_variants_[i][j].geometry_);
+  }
+  return bytes;
+}
+
 void collision_detection::CollisionRobotFCL::updatedPaddingOrScaling(const std::vector<std::string> &links)
 {
   for (std::size_t i = 0 ; i < links.size() ; ++i)
   {
-    std::map<std::string, std::size_t>::const_iterator it = index_map_.find(links[i]);
     const robot_model::LinkModel *lmodel = kmodel_->getLinkModel(links[i]);
-    if (it != index_map_.end() && lmodel)
-    {
-      FCLGeometryConstPtr g = createCollisionGeometry(lmodel->getShape(), getLinkScale(links[i]), getLinkPadding(links[i]), lmodel);
-      geoms_[it->second] = g;
-    }
+    if (lmodel && links_[lmodel->getTreeIndex()])
+      updateLinkGeometry(lmodel->getTreeIndex());
     else
       logError("Updating padding or scaling for unknown link: '%s'", links[i].c_str());
   }
+
+  // the broad-phase data cached by threads refers to the old geometry
+  cache_id_ = newCacheId();
+  caches_.reset(new SelfCollisionCacheRegistry());
 }
 
 double collision_detection::CollisionRobotFCL::distanceSelf(const robot_state::RobotState &state) const
@@ -228,12 +941,13 @@ double collision_detection::CollisionRobotFCL::distanceSelf(const robot_state::R
 double collision_detection::CollisionRobotFCL::distanceSelfHelper(const robot_state::RobotState &state,
                                                                   const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  moveit::tools::QueryCounters::count(moveit::tools::DISTANCE_QUERIES);
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
 
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
+  cd.compiled_acm_ = getCompiledACM(getThreadSelfCollisionCache(caches_), acm, getRobotModel());
   cd.enableGroup(getRobotModel());
 
   manager.manager_->distance(&cd, &distanceCallback);
@@ -241,6 +955,27 @@ double collision_detection::CollisionRobotFCL::distanceSelfHelper(const robot_st
   return res.distance;
 }
 
+void collision_detection::CollisionRobotFCL::distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const
+{
+  distanceSelfHelper(req, res, state, NULL);
+}
+
+void collision_detection::CollisionRobotFCL::distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                                                          const AllowedCollisionMatrix &acm) const
+{
+  distanceSelfHelper(req, res, state, &acm);
+}
+
+void collision_detection::CollisionRobotFCL::distanceSelfHelper(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                                                                const AllowedCollisionMatrix *acm) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::DISTANCE_QUERIES);
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
+  DistanceData dd(&req, &res, acm);
+  dd.enableGroup(getRobotModel());
+  manager.manager_->distance(&dd, &distanceDetailedCallback);
+}
+
 double collision_detection::CollisionRobotFCL::distanceOther(const robot_state::RobotState &state,
                                                              const CollisionRobot &other_robot,
                                                              const robot_state::RobotState &other_state) const
@@ -261,6 +996,7 @@ double collision_detection::CollisionRobotFCL::distanceOtherHelper(const robot_s
                                                                    const robot_state::RobotState &other_state,
                                                                    const AllowedCollisionMatrix *acm) const
 {
+  moveit::tools::QueryCounters::count(moveit::tools::DISTANCE_QUERIES);
   FCLManager manager;
   allocSelfCollisionBroadPhase(state, manager);
 
@@ -0,0 +1,154 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection_fcl/collision_robot_tiered.h>
+#include <limits>
+
+double collision_detection::computeShapeBoundingRadius(const shapes::Shape &shape)
+{
+  switch (shape.type)
+  {
+  case shapes::SPHERE:
+    return static_cast<const shapes::Sphere&>(shape).radius;
+  case shapes::BOX:
+    {
+      const double *size = static_cast<const shapes::Box&>(shape).size;
+      return Eigen::Vector3d(size[0], size[1], size[2]).norm() / 2.0;
+    }
+  case shapes::CYLINDER:
+    {
+      const shapes::Cylinder &c = static_cast<const shapes::Cylinder&>(shape);
+      return sqrt(c.radius * c.radius + c.length * c.length / 4.0);
+    }
+  case shapes::CONE:
+    {
+      const shapes::Cone &c = static_cast<const shapes::Cone&>(shape);
+      return sqrt(c.radius * c.radius + c.length * c.length / 4.0);
+    }
+  case shapes::MESH:
+    {
+      // meshes need not be centered at their origin
+      const shapes::Mesh &mesh = static_cast<const shapes::Mesh&>(shape);
+      double r2 = 0.0;
+      for (unsigned int i = 0 ; i < mesh.vertex_count ; ++i)
+      {
+        const double *v = mesh.vertices + 3 * i;
+        double d2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+        if (d2 > r2)
+          r2 = d2;
+      }
+      return sqrt(r2);
+    }
+  case shapes::OCTREE:
+    {
+      const shapes::OcTree &tree = static_cast<const shapes::OcTree&>(shape);
+      if (!tree.octree || tree.octree->size() == 0)
+        return 0.0;
+      double min[3], max[3];
+      tree.octree->getMetricMin(min[0], min[1], min[2]);
+      tree.octree->getMetricMax(max[0], max[1], max[2]);
+      double r2 = 0.0;
+      for (int i = 0 ; i < 3 ; ++i)
+        r2 += std::max(min[i] * min[i], max[i] * max[i]);
+      return sqrt(r2);
+    }
+  default:
+    return std::numeric_limits<double>::infinity();
+  }
+}
+
+collision_detection::CollisionRobotTiered::CollisionRobotTiered(const robot_model::RobotModelConstPtr &kmodel, double padding, double scale) :
+  CollisionRobotFCL(kmodel, padding, scale)
+{
+  link_radius_.resize(links_.size(), -1.0);
+  for (std::size_t i = 0 ; i < links_.size() ; ++i)
+    updateLinkRadius(i);
+}
+
+collision_detection::CollisionRobotTiered::CollisionRobotTiered(const CollisionRobotTiered &other) :
+  CollisionRobotFCL(other), link_radius_(other.link_radius_)
+{
+}
+
+void collision_detection::CollisionRobotTiered::updateLinkRadius(std::size_t index)
+{
+  const robot_model::LinkModel *lmodel = links_[index];
+  if (lmodel && geoms_[index])
+    link_radius_[index] = computeShapeBoundingRadius(*lmodel->getShape()) * getLinkScale(lmodel->getName()) +
+      std::max(0.0, getLinkPadding(lmodel->getName()));
+  else
+    link_radius_[index] = -1.0;
+}
+
+void collision_detection::CollisionRobotTiered::updatedPaddingOrScaling(const std::vector<std::string> &links)
+{
+  CollisionRobotFCL::updatedPaddingOrScaling(links);
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    if (kmodel_->hasLinkModel(links[i]))
+      updateLinkRadius(kmodel_->getLinkModel(links[i])->getTreeIndex());
+}
+
+bool collision_detection::CollisionRobotTiered::getBoundingSpheres(const robot_state::RobotState &state, std::vector<BoundingSphere> &spheres) const
+{
+  spheres.clear();
+  const std::vector<robot_state::LinkState*> &link_states = state.getLinkStateVector();
+  BoundingSphere s;
+  for (std::size_t i = 0 ; i < link_radius_.size() ; ++i)
+    if (link_radius_[i] >= 0.0)
+    {
+      if (link_radius_[i] == std::numeric_limits<double>::infinity())
+        return false;
+      s.center_ = link_states[i]->getGlobalCollisionBodyTransform().translation();
+      s.radius_ = link_radius_[i];
+      spheres.push_back(s);
+    }
+
+  // attached bodies are neither padded nor scaled
+  std::vector<const robot_state::AttachedBody*> attached;
+  state.getAttachedBodies(attached);
+  for (std::size_t i = 0 ; i < attached.size() ; ++i)
+  {
+    const std::vector<shapes::ShapeConstPtr> &shapes = attached[i]->getShapes();
+    const EigenSTL::vector_Affine3d &ts = attached[i]->getGlobalCollisionBodyTransforms();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    {
+      s.radius_ = computeShapeBoundingRadius(*shapes[j]);
+      if (s.radius_ == std::numeric_limits<double>::infinity())
+        return false;
+      s.center_ = ts[j].translation();
+      spheres.push_back(s);
+    }
+  }
+  return true;
+}
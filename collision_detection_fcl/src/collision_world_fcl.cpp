@@ -35,6 +35,8 @@
 /* Author Ioan Sucan */
 
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/profiler/query_counters.h>
+#include <moveit/profiler/memory_usage.h>
 #include <fcl/shape/geometric_shape_to_BVH_model.h>
 #include <fcl/traversal/traversal_node_bvhs.h>
 #include <fcl/traversal/traversal_node_setup.h>
@@ -43,9 +45,7 @@
 collision_detection::CollisionWorldFCL::CollisionWorldFCL() :
   CollisionWorld()
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
+  boost::atomic_store(&snapshot_, buildSnapshot());
 
   // request notifications about changes to new world
   observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
@@ -54,9 +54,7 @@ collision_detection::CollisionWorldFCL::CollisionWorldFCL() :
 collision_detection::CollisionWorldFCL::CollisionWorldFCL(const WorldPtr& world) :
   CollisionWorld(world)
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
+  boost::atomic_store(&snapshot_, buildSnapshot());
 
   // request notifications about changes to new world
   observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
@@ -66,14 +64,13 @@ collision_detection::CollisionWorldFCL::CollisionWorldFCL(const WorldPtr& world)
 collision_detection::CollisionWorldFCL::CollisionWorldFCL(const CollisionWorldFCL &other, const WorldPtr& world) :
   CollisionWorld(other, world)
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
-
-  fcl_objs_ = other.fcl_objs_;
-  for (std::map<std::string, FCLObject>::iterator it = fcl_objs_.begin() ; it != fcl_objs_.end() ; ++it)
-    it->second.registerTo(manager_.get());
-  // manager_->update();
+  {
+    boost::mutex::scoped_lock slock(other.objects_lock_);
+    fcl_objs_ = other.fcl_objs_;
+    // the FCL objects are not modified once created, so the snapshot of other can be shared
+    SnapshotConstPtr snapshot = boost::atomic_load(&other.snapshot_);
+    boost::atomic_store(&snapshot_, snapshot ? snapshot : other.buildSnapshot());
+  }
 
   // request notifications about changes to new world
   observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
@@ -96,29 +93,141 @@ void collision_detection::CollisionWorldFCL::checkRobotCollision(const Collision
 
 void collision_detection::CollisionWorldFCL::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionContinuousHelper(req, res, robot, state1, state2, NULL);
 }
 
 void collision_detection::CollisionWorldFCL::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionContinuousHelper(req, res, robot, state1, state2, &acm);
+}
+
+void collision_detection::CollisionWorldFCL::checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const CollisionRobot &self_robot,
+                                                            const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  const CollisionRobotFCL *robot_fcl = dynamic_cast<const CollisionRobotFCL*>(&robot);
+  const CollisionRobotFCL *self_robot_fcl = dynamic_cast<const CollisionRobotFCL*>(&self_robot);
+
+  // distances are computed by separate passes anyway, so the checks are only combined when no distance is requested
+  if (req.distance || !robot_fcl || !self_robot_fcl || robot.getRobotModel() != self_robot.getRobotModel())
+  {
+    CollisionWorld::checkCollision(req, res, robot, self_robot, state, acm);
+    return;
+  }
+
+  SnapshotConstPtr snapshot = getSnapshot();
+  self_robot_fcl->checkWorldAndSelfCollisionHelper(req, res, state, *robot_fcl, snapshot->manager_.get(), &acm);
 }
 
 void collision_detection::CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
 {
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
   const CollisionRobotFCL &robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
-  FCLObject fcl_obj;
-  robot_fcl.constructFCLObject(state, fcl_obj);
-
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(robot.getRobotModel());
+
+  // links outside the group could only collide with world objects, which are never active; they get no objects
+  FCLObject fcl_obj;
+  robot_fcl.constructFCLObject(state, fcl_obj, cd.active_link_mask_);
+
+  SnapshotConstPtr snapshot = getSnapshot();
   for (std::size_t i = 0 ; !cd.done_ && i < fcl_obj.collision_objects_.size() ; ++i)
-    manager_->collide(fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+    snapshot->manager_->collide(fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
 
   if (req.distance)
     res.distance = distanceRobotHelper(robot, state, acm);
 }
 
+void collision_detection::CollisionWorldFCL::checkRobotCollisionContinuousHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                                                                 const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
+  const CollisionRobotFCL &robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(robot.getRobotModel());
+  FCLObject fcl_obj1, fcl_obj2;
+  robot_fcl.constructFCLObject(state1, fcl_obj1, cd.active_link_mask_);
+  robot_fcl.constructFCLObject(state2, fcl_obj2, cd.active_link_mask_);
+  if (fcl_obj1.collision_objects_.size() != fcl_obj2.collision_objects_.size())
+  {
+    logError("Continuous collision checking requires the same bodies to be attached to the robot in both states");
+    return;
+  }
+
+  // world objects do not move
+  SnapshotConstPtr snapshot = getSnapshot();
+  for (std::map<std::string, FCLObject>::const_iterator it = snapshot->fcl_objs_.begin() ; !cd.done_ && it != snapshot->fcl_objs_.end() ; ++it)
+    checkContinuousCollision(fcl_obj1, fcl_obj2, &it->second, &it->second, cd);
+
+  // contacts are computed for the state at the time of contact
+  if (res.collision && req.contacts)
+  {
+    robot_state::RobotState state(state1);
+    state1.interpolate(state2, res.time_of_contact, state);
+    CollisionRequest contact_req(req);
+    contact_req.distance = false;
+    checkRobotCollisionHelper(contact_req, res, robot, state, acm);
+  }
+}
+
+void collision_detection::CollisionWorldFCL::checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                      const std::vector<const robot_state::RobotState*> &states) const
+{
+  checkRobotCollisionBatchHelper(req, res, robot, states, NULL);
+}
+
+void collision_detection::CollisionWorldFCL::checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                      const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollisionBatchHelper(req, res, robot, states, &acm);
+}
+
+void collision_detection::CollisionWorldFCL::checkRobotCollisionBatchHelper(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                            const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS, states.size());
+  const CollisionRobotFCL &robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  SnapshotConstPtr snapshot = getSnapshot();
+  res.resize(states.size());
+
+  // the collision objects for the links (of the group, if one is specified) are created once and only moved from one state to the next
+  const std::vector<bool> *link_mask = getActiveLinkMask(robot.getRobotModel(), req.group_name);
+  FCLObject link_objs;
+  std::vector<std::size_t> link_indices;
+  for (std::size_t i = 0 ; i < robot_fcl.geoms_.size() ; ++i)
+    if (isLinkInMask(link_mask, i) && robot_fcl.geoms_[i] && robot_fcl.geoms_[i]->collision_geometry_)
+    {
+      link_objs.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(new fcl::CollisionObject(robot_fcl.geoms_[i]->collision_geometry_)));
+      link_indices.push_back(i);
+    }
+
+  for (std::size_t s = 0 ; s < states.size() ; ++s)
+  {
+    if (res[s].collision && (!req.contacts || res[s].contacts.size() >= req.max_contacts))
+      continue;
+
+    const std::vector<robot_state::LinkState*> &link_states = states[s]->getLinkStateVector();
+    for (std::size_t i = 0 ; i < link_indices.size() ; ++i)
+    {
+      link_objs.collision_objects_[i]->setTransform(transform2fcl(link_states[link_indices[i]]->getGlobalCollisionBodyTransform()));
+      link_objs.collision_objects_[i]->computeAABB();
+    }
+    FCLObject attached_objs;
+    for (std::size_t i = 0 ; i < link_states.size() ; ++i)
+      if (isLinkInMask(link_mask, i))
+        robot_fcl.constructAttachedBodyObjects(link_states[i], attached_objs);
+
+    CollisionData cd(&req, &res[s], acm);
+    cd.enableGroup(robot.getRobotModel());
+    for (std::size_t i = 0 ; !cd.done_ && i < link_objs.collision_objects_.size() ; ++i)
+      snapshot->manager_->collide(link_objs.collision_objects_[i].get(), &cd, &collisionCallback);
+    for (std::size_t i = 0 ; !cd.done_ && i < attached_objs.collision_objects_.size() ; ++i)
+      snapshot->manager_->collide(attached_objs.collision_objects_[i].get(), &cd, &collisionCallback);
+
+    if (req.distance)
+      res[s].distance = distanceRobotHelper(robot, *states[s], acm);
+  }
+}
+
 void collision_detection::CollisionWorldFCL::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
 {
   checkWorldCollisionHelper(req, res, other_world, NULL);
@@ -131,9 +240,12 @@ void collision_detection::CollisionWorldFCL::checkWorldCollision(const Collision
 
 void collision_detection::CollisionWorldFCL::checkWorldCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix *acm) const
 {
+  moveit::tools::QueryCounters::count(moveit::tools::COLLISION_CHECKS);
   const CollisionWorldFCL &other_fcl_world = dynamic_cast<const CollisionWorldFCL&>(other_world);
+  SnapshotConstPtr snapshot = getSnapshot();
+  SnapshotConstPtr other_snapshot = other_fcl_world.getSnapshot();
   CollisionData cd(&req, &res, acm);
-  manager_->collide(other_fcl_world.manager_.get(), &cd, &collisionCallback);
+  snapshot->manager_->collide(other_snapshot->manager_.get(), &cd, &collisionCallback);
 
   if (req.distance)
     res.distance = distanceWorldHelper(other_world, acm);
@@ -153,39 +265,115 @@ void collision_detection::CollisionWorldFCL::constructFCLObject(const World::Obj
   }
 }
 
-void collision_detection::CollisionWorldFCL::updateFCLObject(const std::string &id)
+collision_detection::CollisionWorldFCL::SnapshotConstPtr collision_detection::CollisionWorldFCL::getSnapshot() const
 {
-  // remove FCL objects that correspond to this object
-  std::map<std::string, FCLObject>::iterator jt = fcl_objs_.find(id);
-  if (jt != fcl_objs_.end())
+  SnapshotConstPtr snapshot = boost::atomic_load(&snapshot_);
+  if (snapshot)
+    return snapshot;
+
+  // a change of the world is being published; wait for it
+  boost::mutex::scoped_lock slock(objects_lock_);
+  snapshot = boost::atomic_load(&snapshot_);
+  if (!snapshot)
   {
-    jt->second.unregisterFrom(manager_.get());
-    jt->second.clear();
+    snapshot = buildSnapshot();
+    boost::atomic_store(&snapshot_, snapshot);
   }
+  return snapshot;
+}
 
-  // check to see if we have this object
-  collision_detection::World::const_iterator it = getWorld()->find(id);
-  if (it != getWorld()->end())
+collision_detection::CollisionWorldFCL::SnapshotConstPtr collision_detection::CollisionWorldFCL::buildSnapshot() const
+{
+  boost::shared_ptr<Snapshot> snapshot(new Snapshot());
+  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
+  // m->tree_init_level = 2;
+  snapshot->manager_.reset(m);
+  // the FCL objects are shared with fcl_objs_; they are replaced, not modified, when an object changes
+  snapshot->fcl_objs_ = fcl_objs_;
+  for (std::map<std::string, FCLObject>::iterator it = snapshot->fcl_objs_.begin() ; it != snapshot->fcl_objs_.end() ; ++it)
+    it->second.registerTo(m);
+  return snapshot;
+}
+
+void collision_detection::CollisionWorldFCL::publishSnapshot(const std::string &id)
+{
+  // once unpublished, a snapshot no query holds cannot be reached by queries either (they wait for objects_lock_),
+  // so it can be updated in place instead of rebuilt from scratch
+  SnapshotConstPtr snapshot = boost::atomic_exchange(&snapshot_, SnapshotConstPtr());
+  if (snapshot && snapshot.unique())
   {
-    // construct FCL objects that correspond to this object
-    if (jt != fcl_objs_.end())
+    Snapshot *s = const_cast<Snapshot*>(snapshot.get());
+    std::map<std::string, FCLObject>::iterator old = s->fcl_objs_.find(id);
+    if (old != s->fcl_objs_.end())
     {
-      constructFCLObject(it->second.get(), jt->second);
-      jt->second.registerTo(manager_.get());
+      old->second.unregisterFrom(s->manager_.get());
+      s->fcl_objs_.erase(old);
     }
-    else
+    std::map<std::string, FCLObject>::const_iterator it = fcl_objs_.find(id);
+    if (it != fcl_objs_.end())
     {
-      constructFCLObject(it->second.get(), fcl_objs_[id]);
-      fcl_objs_[id].registerTo(manager_.get());
+      FCLObject &added = s->fcl_objs_[id];
+      added = it->second;
+      added.registerTo(s->manager_.get());
     }
+    s->manager_->update();
   }
   else
-  {
-    if (jt != fcl_objs_.end())
-      fcl_objs_.erase(jt);
-  }
+    snapshot = buildSnapshot();
+  boost::atomic_store(&snapshot_, snapshot);
+}
+
+void collision_detection::CollisionWorldFCL::updateFCLObject(const std::string &id)
+{
+  boost::mutex::scoped_lock slock(objects_lock_);
 
-  // manager_->update();
+  // remove FCL objects that correspond to this object; snapshots still using them keep them alive
+  fcl_objs_.erase(id);
+
+  // check to see if we have this object
+  collision_detection::World::const_iterator it = getWorld()->find(id);
+  if (it != getWorld()->end())
+    // construct FCL objects that correspond to this object
+    constructFCLObject(it->second.get(), fcl_objs_[id]);
+
+  publishSnapshot(id);
+}
+
+bool collision_detection::CollisionWorldFCL::moveFCLObject(const World::Object *obj)
+{
+  boost::mutex::scoped_lock slock(objects_lock_);
+
+  // the geometry can only be kept if there is one FCL object per shape, all built for this instance of the object
+  std::map<std::string, FCLObject>::iterator it = fcl_objs_.find(obj->id_);
+  if (it == fcl_objs_.end() || it->second.collision_objects_.size() != obj->shapes_.size())
+    return false;
+  for (std::size_t i = 0 ; i < it->second.collision_geometry_.size() ; ++i)
+    if (it->second.collision_geometry_[i]->collision_geometry_data_->ptr.obj != obj)
+      return false;
+
+  // the FCL objects may be used by snapshots, so new ones are made; they share the geometry of the old ones
+  FCLObject moved;
+  moved.collision_geometry_ = it->second.collision_geometry_;
+  for (std::size_t i = 0 ; i < moved.collision_geometry_.size() ; ++i)
+    moved.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(
+                                         new fcl::CollisionObject(moved.collision_geometry_[i]->collision_geometry_,
+                                                                  transform2fcl(obj->shape_poses_[i]))));
+  it->second = moved;
+  publishSnapshot(obj->id_);
+  return true;
+}
+
+bool collision_detection::CollisionWorldFCL::refreshFCLObject(const World::Object *obj)
+{
+  boost::mutex::scoped_lock slock(objects_lock_);
+
+  std::map<std::string, FCLObject>::const_iterator it = fcl_objs_.find(obj->id_);
+  if (it == fcl_objs_.end() || it->second.collision_objects_.size() != obj->shapes_.size())
+    return false;
+  for (std::size_t i = 0 ; i < obj->shapes_.size() ; ++i)
+    if (obj->shapes_[i]->type != shapes::OCTREE || it->second.collision_geometry_[i]->collision_geometry_data_->ptr.obj != obj)
+      return false;
+  return true;
 }
 
 void collision_detection::CollisionWorldFCL::setWorld(const WorldPtr& world)
@@ -197,8 +385,11 @@ void collision_detection::CollisionWorldFCL::setWorld(const WorldPtr& world)
   getWorld()->removeObserver(observer_handle_);
 
   // clear out objects from old world
-  manager_->clear();
-  fcl_objs_.clear();
+  {
+    boost::mutex::scoped_lock slock(objects_lock_);
+    fcl_objs_.clear();
+    boost::atomic_store(&snapshot_, buildSnapshot());
+  }
   cleanCollisionGeometryCache();
 
   CollisionWorld::setWorld(world);
@@ -210,40 +401,169 @@ void collision_detection::CollisionWorldFCL::setWorld(const WorldPtr& world)
   getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
 }
 
+void collision_detection::CollisionWorldFCL::prepareShape(const shapes::ShapeConstPtr &shape) const
+{
+  // the cache keeps the geometry while no object uses it; the object that later uses this shape takes it over
+  createCollisionGeometry(shape, static_cast<const World::Object*>(NULL));
+}
+
+std::size_t collision_detection::CollisionWorldFCL::getMemoryUsage() const
+{
+  const std::size_t node = moveit::tools::estimateMapNodeBytes<std::string, FCLObject>();
+  std::size_t bytes = CollisionWorld::getMemoryUsage() + sizeof(*this) - sizeof(CollisionWorld);
+  {
+    boost::mutex::scoped_lock slock(objects_lock_);
+    for (std::map<std::string, FCLObject>::const_iterator it = fcl_objs_.begin() ; it != fcl_objs_.end() ; ++it)
+      bytes += node + it->first.capacity() + getFCLObjectMemoryUsage(it->second) - sizeof(FCLObject);
+  }
+  // the snapshot shares the FCL objects; it adds its own map and the nodes of the dynamic AABB tree (about two per object)
+  SnapshotConstPtr snapshot = boost::atomic_load(&snapshot_);
+  if (snapshot)
+    bytes += sizeof(Snapshot) + sizeof(fcl::DynamicAABBTreeCollisionManager) + snapshot->fcl_objs_.size() * node +
+      snapshot->manager_->size() * 2 * (sizeof(fcl::AABB) + 4 * sizeof(void*));
+  return bytes;
+}
+
+namespace
+{
+struct RegionQueryData
+{
+  fcl::CollisionObject  *query_;
+  bool                   exact_;
+  std::set<std::string> *ids_;
+};
+
+bool regionQueryCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data)
+{
+  RegionQueryData *rqd = reinterpret_cast<RegionQueryData*>(data);
+  fcl::CollisionObject *obj = o1 == rqd->query_ ? o2 : o1;
+  const collision_detection::CollisionGeometryData *cd =
+    static_cast<const collision_detection::CollisionGeometryData*>(obj->getCollisionGeometry()->getUserData());
+  const std::string &id = cd->getID();
+  if (rqd->ids_->find(id) != rqd->ids_->end())
+    return false;
+  if (rqd->exact_)
+  {
+    fcl::CollisionRequest req;
+    fcl::CollisionResult res;
+    if (fcl::collide(obj, rqd->query_, req, res) == 0)
+      return false;
+  }
+  rqd->ids_->insert(id);
+  return false;
+}
+}
+
+void collision_detection::CollisionWorldFCL::getObjectsOverlapping(fcl::CollisionObject &query, bool exact, std::set<std::string> &ids) const
+{
+  SnapshotConstPtr snapshot = getSnapshot();
+  RegionQueryData rqd;
+  rqd.query_ = &query;
+  rqd.exact_ = exact;
+  rqd.ids_ = &ids;
+  snapshot->manager_->collide(&query, &rqd, &regionQueryCallback);
+}
+
+void collision_detection::CollisionWorldFCL::getObjectsInBox(const Eigen::Vector3d &min_corner, const Eigen::Vector3d &max_corner,
+                                                             std::vector<std::string> &ids) const
+{
+  Eigen::Vector3d extents = (max_corner - min_corner).cwiseMax(Eigen::Vector3d::Zero());
+  Eigen::Vector3d center = (min_corner + max_corner) / 2.0;
+  fcl::CollisionObject query(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Box(extents.x(), extents.y(), extents.z())),
+                             fcl::Transform3f(fcl::Vec3f(center.x(), center.y(), center.z())));
+  std::set<std::string> found;
+  getObjectsOverlapping(query, true, found);
+  ids.assign(found.begin(), found.end());
+}
+
+void collision_detection::CollisionWorldFCL::getObjectsInSphere(const Eigen::Vector3d &center, double radius, std::vector<std::string> &ids) const
+{
+  fcl::CollisionObject query(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Sphere(std::max(radius, 0.0))),
+                             fcl::Transform3f(fcl::Vec3f(center.x(), center.y(), center.z())));
+  std::set<std::string> found;
+  getObjectsOverlapping(query, true, found);
+  ids.assign(found.begin(), found.end());
+}
+
+bool collision_detection::CollisionWorldFCL::castRay(const Eigen::Vector3d &origin, const Eigen::Vector3d &direction, double max_distance,
+                                                     std::string &id, double &distance) const
+{
+  double norm = direction.norm();
+  if (norm < std::numeric_limits<double>::epsilon())
+    return false;
+  if (!(max_distance < std::numeric_limits<double>::infinity()))
+    return CollisionWorld::castRay(origin, direction, max_distance, id, distance);
+
+  // a thin box along the ray selects the candidate objects
+  Eigen::Vector3d dir = direction / norm;
+  Eigen::Affine3d pose(Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitX(), dir));
+  pose.translation() = origin + dir * (max_distance / 2.0);
+  fcl::CollisionObject query(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Box(max_distance, 1e-6, 1e-6)), transform2fcl(pose));
+  std::set<std::string> candidates;
+  getObjectsOverlapping(query, false, candidates);
+
+  bool hit = false;
+  distance = max_distance;
+  for (std::set<std::string>::const_iterator it = candidates.begin() ; it != candidates.end() ; ++it)
+  {
+    ObjectConstPtr obj = getWorld()->getObject(*it);
+    if (obj && castRayOnObject(*obj, origin, dir, distance))
+    {
+      id = *it;
+      hit = true;
+    }
+  }
+  return hit;
+}
+
 void collision_detection::CollisionWorldFCL::notifyObjectChange(const ObjectConstPtr& obj, World::Action action)
 {
   if (action == World::DESTROY)
   {
-    std::map<std::string, FCLObject>::iterator it = fcl_objs_.find(obj->id_);
-    if (it != fcl_objs_.end())
     {
-      it->second.unregisterFrom(manager_.get());
-      it->second.clear();
-      fcl_objs_.erase(it);
+      boost::mutex::scoped_lock slock(objects_lock_);
+      if (fcl_objs_.erase(obj->id_))
+        publishSnapshot(obj->id_);
     }
     cleanCollisionGeometryCache();
   }
   else
   {
-    updateFCLObject(obj->id_);
-    if (action & (World::DESTROY|World::REMOVE_SHAPE))
-      cleanCollisionGeometryCache();
+    bool kept = (action == World::MOVE_SHAPE && moveFCLObject(obj.get())) ||
+                (action == World::UPDATE_SHAPE && refreshFCLObject(obj.get()));
+    if (!kept)
+    {
+      updateFCLObject(obj->id_);
+      if (action & (World::DESTROY|World::REMOVE_SHAPE))
+        cleanCollisionGeometryCache();
+    }
   }
 }
 
-double collision_detection::CollisionWorldFCL::distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+double collision_detection::CollisionWorldFCL::distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                                                                   double max_distance) const
 {
+  moveit::tools::QueryCounters::count(moveit::tools::DISTANCE_QUERIES);
   const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
   FCLObject fcl_obj;
   robot_fcl.constructFCLObject(state, fcl_obj);
 
+  SnapshotConstPtr snapshot = getSnapshot();
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(robot.getRobotModel());
 
+  // starting from max_distance, the broad phase skips pairs that are farther apart, and the traversal
+  // stops at the first pair that is closer
+  if (max_distance < res.distance)
+  {
+    res.distance = max_distance;
+    cd.distance_threshold_ = max_distance;
+  }
+
   for(std::size_t i = 0; !cd.done_ && i < fcl_obj.collision_objects_.size(); ++i)
-    manager_->distance(fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
+    snapshot->manager_->distance(fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
 
 
   return res.distance;
@@ -259,6 +579,43 @@ double collision_detection::CollisionWorldFCL::distanceRobot(const CollisionRobo
   return distanceRobotHelper(robot, state, &acm);
 }
 
+double collision_detection::CollisionWorldFCL::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, double max_distance) const
+{
+  return distanceRobotHelper(robot, state, NULL, max_distance);
+}
+
+double collision_detection::CollisionWorldFCL::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm, double max_distance) const
+{
+  return distanceRobotHelper(robot, state, &acm, max_distance);
+}
+
+void collision_detection::CollisionWorldFCL::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                           const robot_state::RobotState &state) const
+{
+  distanceRobotHelper(req, res, robot, state, NULL);
+}
+
+void collision_detection::CollisionWorldFCL::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                           const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  distanceRobotHelper(req, res, robot, state, &acm);
+}
+
+void collision_detection::CollisionWorldFCL::distanceRobotHelper(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                                 const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  moveit::tools::QueryCounters::count(moveit::tools::DISTANCE_QUERIES);
+  const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  DistanceData dd(&req, &res, acm);
+  dd.enableGroup(robot.getRobotModel());
+  FCLObject fcl_obj;
+  robot_fcl.constructFCLObject(state, fcl_obj, dd.active_link_mask_);
+
+  SnapshotConstPtr snapshot = getSnapshot();
+  for (std::size_t i = 0 ; i < fcl_obj.collision_objects_.size() ; ++i)
+    snapshot->manager_->distance(fcl_obj.collision_objects_[i].get(), &dd, &distanceDetailedCallback);
+}
+
 double collision_detection::CollisionWorldFCL::distanceWorld(const CollisionWorld &world) const
 {
   return distanceWorldHelper(world, NULL);
@@ -271,11 +628,14 @@ double collision_detection::CollisionWorldFCL::distanceWorld(const CollisionWorl
 
 double collision_detection::CollisionWorldFCL::distanceWorldHelper(const CollisionWorld &other_world, const AllowedCollisionMatrix *acm) const
 {
+  moveit::tools::QueryCounters::count(moveit::tools::DISTANCE_QUERIES);
   const CollisionWorldFCL& other_fcl_world = dynamic_cast<const CollisionWorldFCL&>(other_world);
+  SnapshotConstPtr snapshot = getSnapshot();
+  SnapshotConstPtr other_snapshot = other_fcl_world.getSnapshot();
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
-  manager_->distance(other_fcl_world.manager_.get(), &cd, &distanceCallback);
+  snapshot->manager_->distance(other_snapshot->manager_.get(), &cd, &distanceCallback);
 
   return res.distance;
 }
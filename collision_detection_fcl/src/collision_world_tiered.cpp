@@ -0,0 +1,230 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection_fcl/collision_world_tiered.h>
+#include <moveit/collision_detection_fcl/collision_detector_allocator_tiered.h>
+#include <limits>
+
+const std::string collision_detection::CollisionDetectorAllocatorTiered::NAME_("TIERED");
+
+collision_detection::CollisionWorldTiered::CollisionWorldTiered() :
+  CollisionWorldFCL()
+{
+  bounds_observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldTiered::notifyObjectBoundsChange, this, _1, _2));
+}
+
+collision_detection::CollisionWorldTiered::CollisionWorldTiered(const WorldPtr& world) :
+  CollisionWorldFCL(world)
+{
+  bounds_observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldTiered::notifyObjectBoundsChange, this, _1, _2));
+  getWorld()->notifyObserverAllObjects(bounds_observer_handle_, World::CREATE);
+}
+
+collision_detection::CollisionWorldTiered::CollisionWorldTiered(const CollisionWorldTiered &other, const WorldPtr& world) :
+  CollisionWorldFCL(other, world)
+{
+  {
+    boost::mutex::scoped_lock slock(other.bounds_lock_);
+    object_spheres_ = other.object_spheres_;
+  }
+  boost::atomic_store(&world_spheres_, boost::atomic_load(&other.world_spheres_));
+  bounds_observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldTiered::notifyObjectBoundsChange, this, _1, _2));
+}
+
+collision_detection::CollisionWorldTiered::~CollisionWorldTiered()
+{
+  getWorld()->removeObserver(bounds_observer_handle_);
+}
+
+void collision_detection::CollisionWorldTiered::setWorld(const WorldPtr& world)
+{
+  if (world == getWorld())
+    return;
+
+  getWorld()->removeObserver(bounds_observer_handle_);
+  {
+    boost::mutex::scoped_lock slock(bounds_lock_);
+    object_spheres_.clear();
+    boost::atomic_store(&world_spheres_, SpheresConstPtr());
+  }
+
+  CollisionWorldFCL::setWorld(world);
+
+  bounds_observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldTiered::notifyObjectBoundsChange, this, _1, _2));
+  getWorld()->notifyObserverAllObjects(bounds_observer_handle_, World::CREATE);
+}
+
+void collision_detection::CollisionWorldTiered::notifyObjectBoundsChange(const ObjectConstPtr& obj, World::Action action)
+{
+  boost::mutex::scoped_lock slock(bounds_lock_);
+  if (action == World::DESTROY)
+    object_spheres_.erase(obj->id_);
+  else
+  {
+    Spheres &spheres = object_spheres_[obj->id_];
+    spheres.resize(obj->shapes_.size());
+    for (std::size_t i = 0 ; i < obj->shapes_.size() ; ++i)
+    {
+      spheres[i].center_ = obj->shape_poses_[i].translation();
+      spheres[i].radius_ = computeShapeBoundingRadius(*obj->shapes_[i]);
+    }
+  }
+  boost::atomic_store(&world_spheres_, SpheresConstPtr());
+}
+
+collision_detection::CollisionWorldTiered::SpheresConstPtr collision_detection::CollisionWorldTiered::getWorldSpheres() const
+{
+  SpheresConstPtr spheres = boost::atomic_load(&world_spheres_);
+  if (spheres)
+    return spheres;
+
+  boost::mutex::scoped_lock slock(bounds_lock_);
+  spheres = boost::atomic_load(&world_spheres_);
+  if (!spheres)
+  {
+    boost::shared_ptr<Spheres> all(new Spheres());
+    for (std::map<std::string, Spheres>::const_iterator it = object_spheres_.begin() ; it != object_spheres_.end() ; ++it)
+      all->insert(all->end(), it->second.begin(), it->second.end());
+    spheres = all;
+    boost::atomic_store(&world_spheres_, spheres);
+  }
+  return spheres;
+}
+
+bool collision_detection::CollisionWorldTiered::isCertifiedFree(const CollisionRequest &req, const CollisionRobot &robot,
+                                                                const robot_state::RobotState &state) const
+{
+  if (req.distance || req.cost)
+    return false;
+  const CollisionRobotTiered *tiered_robot = dynamic_cast<const CollisionRobotTiered*>(&robot);
+  if (!tiered_robot)
+    return false;
+
+  SpheresConstPtr world_spheres = getWorldSpheres();
+  if (world_spheres->empty())
+    return true;
+
+  std::vector<BoundingSphere> robot_spheres;
+  if (!tiered_robot->getBoundingSpheres(state, robot_spheres))
+    return false;
+  if (robot_spheres.empty())
+    return true;
+
+  // a sphere around all the bodies of the robot discards most of the world at once
+  Eigen::Vector3d lo = robot_spheres[0].center_, hi = lo;
+  for (std::size_t i = 1 ; i < robot_spheres.size() ; ++i)
+  {
+    lo = lo.cwiseMin(robot_spheres[i].center_);
+    hi = hi.cwiseMax(robot_spheres[i].center_);
+  }
+  BoundingSphere robot_sphere;
+  robot_sphere.center_ = (lo + hi) / 2.0;
+  robot_sphere.radius_ = 0.0;
+  for (std::size_t i = 0 ; i < robot_spheres.size() ; ++i)
+    robot_sphere.radius_ = std::max(robot_sphere.radius_, (robot_spheres[i].center_ - robot_sphere.center_).norm() + robot_spheres[i].radius_);
+
+  for (Spheres::const_iterator it = world_spheres->begin() ; it != world_spheres->end() ; ++it)
+  {
+    if ((it->center_ - robot_sphere.center_).norm() > it->radius_ + robot_sphere.radius_)
+      continue;
+    for (std::size_t i = 0 ; i < robot_spheres.size() ; ++i)
+      if (!((it->center_ - robot_spheres[i].center_).norm() > it->radius_ + robot_spheres[i].radius_))
+        return false;
+  }
+  return true;
+}
+
+void collision_detection::CollisionWorldTiered::checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                               const CollisionRobot &self_robot, const robot_state::RobotState &state,
+                                                               const AllowedCollisionMatrix &acm) const
+{
+  if (isCertifiedFree(req, robot, state))
+    self_robot.checkSelfCollision(req, res, state, acm);
+  else
+    CollisionWorldFCL::checkCollision(req, res, robot, self_robot, state, acm);
+}
+
+void collision_detection::CollisionWorldTiered::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                    const robot_state::RobotState &state) const
+{
+  if (!isCertifiedFree(req, robot, state))
+    CollisionWorldFCL::checkRobotCollision(req, res, robot, state);
+}
+
+void collision_detection::CollisionWorldTiered::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                    const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  if (!isCertifiedFree(req, robot, state))
+    CollisionWorldFCL::checkRobotCollision(req, res, robot, state, acm);
+}
+
+void collision_detection::CollisionWorldTiered::checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                         const std::vector<const robot_state::RobotState*> &states) const
+{
+  checkRobotCollisionBatchHelper(req, res, robot, states, NULL);
+}
+
+void collision_detection::CollisionWorldTiered::checkRobotCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                         const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollisionBatchHelper(req, res, robot, states, &acm);
+}
+
+void collision_detection::CollisionWorldTiered::checkRobotCollisionBatchHelper(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                                               const std::vector<const robot_state::RobotState*> &states,
+                                                                               const AllowedCollisionMatrix *acm) const
+{
+  res.clear();
+  res.resize(states.size());
+
+  // only the states the coarse test cannot certify are checked, in one batch
+  std::vector<const robot_state::RobotState*> exact_states;
+  std::vector<std::size_t> exact_index;
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    if (!isCertifiedFree(req, robot, *states[i]))
+    {
+      exact_states.push_back(states[i]);
+      exact_index.push_back(i);
+    }
+  if (exact_states.empty())
+    return;
+
+  std::vector<CollisionResult> exact_res;
+  if (acm)
+    CollisionWorldFCL::checkRobotCollisionBatch(req, exact_res, robot, exact_states, *acm);
+  else
+    CollisionWorldFCL::checkRobotCollisionBatch(req, exact_res, robot, exact_states);
+  for (std::size_t i = 0 ; i < exact_index.size() ; ++i)
+    res[exact_index[i]] = exact_res[i];
+}
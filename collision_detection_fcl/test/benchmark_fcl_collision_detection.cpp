@@ -0,0 +1,379 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Benchmarks of FCL collision checking for the PR2 in worlds of primitives, meshes or an octree, at several sizes.
+   The time of a world check is also broken down into constructing the collision objects, the broad phase (finding pairs
+   of objects whose bounding boxes overlap) and the narrow phase (checking those pairs). See moveit::Benchmark for the
+   command line arguments. */
+
+#include <moveit/test_resources/config.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/profiler/benchmark.h>
+
+#include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/shape_operations.h>
+#include <console_bridge/console.h>
+#include <octomap/octomap.h>
+#include <fcl/broadphase/broadphase_dynamic_AABB_tree.h>
+#include <fcl/collision.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <fstream>
+#include <cmath>
+
+namespace
+{
+
+std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+std::string srdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string();
+std::string kinect_dae_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/meshes/sensors/kinect_v0/kinect.dae").string();
+
+typedef boost::variate_generator<boost::mt19937&, boost::uniform_real<> > UniformReal;
+
+robot_model::RobotModelPtr loadPR2()
+{
+  std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+  if (!xml_file.is_open())
+  {
+    logError("Unable to open '%s'", urdf_file.c_str());
+    return robot_model::RobotModelPtr();
+  }
+  std::string xml_string;
+  while (xml_file.good())
+  {
+    std::string line;
+    std::getline(xml_file, line);
+    xml_string += (line + "\n");
+  }
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+  if (!urdf_model)
+    return robot_model::RobotModelPtr();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, srdf_file);
+  return robot_model::RobotModelPtr(new robot_model::RobotModel(urdf_model, srdf_model));
+}
+
+/** \brief The collision matrix a planning scene would use: collisions between the pairs disabled in the SRDF are allowed */
+collision_detection::AllowedCollisionMatrix makeACM(const robot_model::RobotModelConstPtr &model)
+{
+  collision_detection::AllowedCollisionMatrix acm;
+  const std::vector<std::string> &collision_links = model->getLinkModelNamesWithCollisionGeometry();
+  acm.setEntry(collision_links, collision_links, false);
+  const std::vector<srdf::Model::DisabledCollision> &dc = model->getSRDF()->getDisabledCollisionPairs();
+  for (std::vector<srdf::Model::DisabledCollision>::const_iterator it = dc.begin(); it != dc.end(); ++it)
+    acm.setEntry(it->link1_, it->link2_, true);
+  return acm;
+}
+
+Eigen::Affine3d randomPose(UniformReal &x, UniformReal &y, UniformReal &z, UniformReal &angle)
+{
+  Eigen::Affine3d pose = Eigen::Translation3d(x(), y(), z()) * Eigen::AngleAxisd(angle(), Eigen::Vector3d::UnitZ()) *
+    Eigen::AngleAxisd(angle(), Eigen::Vector3d::UnitX());
+  return pose;
+}
+
+/** \brief A world of \e count boxes, spheres and cylinders of 2 to 10 cm, spread over 3 x 3 x 2 m around the robot */
+collision_detection::WorldPtr makePrimitiveWorld(std::size_t count)
+{
+  boost::mt19937 rng(count);
+  UniformReal x(rng, boost::uniform_real<>(-1.5, 1.5)), y(rng, boost::uniform_real<>(-1.5, 1.5)), z(rng, boost::uniform_real<>(0.0, 2.0));
+  UniformReal angle(rng, boost::uniform_real<>(-M_PI, M_PI)), size(rng, boost::uniform_real<>(0.02, 0.1));
+
+  collision_detection::WorldPtr world(new collision_detection::World());
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    shapes::Shape *shape;
+    switch (i % 3)
+    {
+    case 0:
+      shape = new shapes::Box(size(), size(), size());
+      break;
+    case 1:
+      shape = new shapes::Sphere(size() / 2.0);
+      break;
+    default:
+      shape = new shapes::Cylinder(size() / 2.0, size());
+    }
+    world->addToObject("object" + boost::lexical_cast<std::string>(i), shapes::ShapeConstPtr(shape), randomPose(x, y, z, angle));
+  }
+  return world;
+}
+
+/** \brief A world of \e count copies of a mesh, spread like the primitives above; each copy is a separate shape, as
+    objects from separate detections would be */
+collision_detection::WorldPtr makeMeshWorld(const shapes::ShapeConstPtr &mesh, std::size_t count)
+{
+  boost::mt19937 rng(count);
+  UniformReal x(rng, boost::uniform_real<>(-1.5, 1.5)), y(rng, boost::uniform_real<>(-1.5, 1.5)), z(rng, boost::uniform_real<>(0.0, 2.0));
+  UniformReal angle(rng, boost::uniform_real<>(-M_PI, M_PI));
+
+  collision_detection::WorldPtr world(new collision_detection::World());
+  for (std::size_t i = 0 ; i < count ; ++i)
+    world->addToObject("mesh" + boost::lexical_cast<std::string>(i), shapes::ShapeConstPtr(mesh->clone()), randomPose(x, y, z, angle));
+  return world;
+}
+
+/** \brief A world with one octree of about \e count occupied 2 cm cells, in front of the robot and within reach of its arms */
+collision_detection::WorldPtr makeOctreeWorld(std::size_t count)
+{
+  boost::mt19937 rng(count);
+  UniformReal x(rng, boost::uniform_real<>(0.3, 1.3)), y(rng, boost::uniform_real<>(-0.8, 0.8)), z(rng, boost::uniform_real<>(0.0, 1.5));
+
+  boost::shared_ptr<octomap::OcTree> tree(new octomap::OcTree(0.02));
+  for (std::size_t i = 0 ; i < count ; ++i)
+    tree->updateNode(octomap::point3d(x(), y(), z()), true);
+
+  collision_detection::WorldPtr world(new collision_detection::World());
+  world->addToObject("octomap", shapes::ShapeConstPtr(new shapes::OcTree(tree)), Eigen::Affine3d::Identity());
+  return world;
+}
+
+/** \brief The collision objects of the links of a state and of the objects of a world, each in a broad-phase manager,
+    as CollisionRobotFCL and CollisionWorldFCL construct them */
+struct BroadPhaseScene
+{
+  void construct(const robot_state::RobotState &state, const collision_detection::World &world)
+  {
+    robot_.clear();
+    world_.clear();
+    const std::vector<robot_state::LinkState*> &links = state.getLinkStateVector();
+    for (std::size_t i = 0 ; i < links.size() ; ++i)
+    {
+      const robot_model::LinkModel *link = links[i]->getLinkModel();
+      if (!link->getShape())
+        continue;
+      collision_detection::FCLGeometryConstPtr g = collision_detection::createCollisionGeometry(link->getShape(), link);
+      if (!g)
+        continue;
+      robot_.collision_geometry_.push_back(g);
+      robot_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>
+                                          (new fcl::CollisionObject(g->collision_geometry_,
+                                                                    collision_detection::transform2fcl(links[i]->getGlobalCollisionBodyTransform()))));
+    }
+    for (collision_detection::World::const_iterator it = world.begin() ; it != world.end() ; ++it)
+      for (std::size_t i = 0 ; i < it->second->shapes_.size() ; ++i)
+      {
+        collision_detection::FCLGeometryConstPtr g = collision_detection::createCollisionGeometry(it->second->shapes_[i], it->second.get());
+        if (!g)
+          continue;
+        world_.collision_geometry_.push_back(g);
+        world_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>
+                                            (new fcl::CollisionObject(g->collision_geometry_,
+                                                                      collision_detection::transform2fcl(it->second->shape_poses_[i]))));
+      }
+
+    robot_manager_.reset(new fcl::DynamicAABBTreeCollisionManager());
+    robot_.registerTo(robot_manager_.get());
+    robot_manager_->setup();
+    world_manager_.reset(new fcl::DynamicAABBTreeCollisionManager());
+    world_.registerTo(world_manager_.get());
+    world_manager_->setup();
+  }
+
+  collision_detection::FCLObject                     robot_;
+  collision_detection::FCLObject                     world_;
+  boost::shared_ptr<fcl::BroadPhaseCollisionManager> robot_manager_;
+  boost::shared_ptr<fcl::BroadPhaseCollisionManager> world_manager_;
+};
+
+typedef std::vector<std::pair<fcl::CollisionObject*, fcl::CollisionObject*> > CandidatePairs;
+
+bool collectPair(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data)
+{
+  reinterpret_cast<CandidatePairs*>(data)->push_back(std::make_pair(o1, o2));
+  return false;
+}
+
+void constructObjects(BroadPhaseScene &scene, const robot_state::RobotState &state, const collision_detection::WorldPtr &world)
+{
+  scene.construct(state, *world);
+}
+
+void broadPhase(const BroadPhaseScene &scene, CandidatePairs &pairs)
+{
+  pairs.clear();
+  scene.world_manager_->collide(scene.robot_manager_.get(), &pairs, &collectPair);
+}
+
+void narrowPhase(const CandidatePairs &pairs)
+{
+  fcl::CollisionRequest request;
+  std::size_t count = 0;
+  for (std::size_t i = 0 ; i < pairs.size() ; ++i)
+  {
+    fcl::CollisionResult result;
+    count += fcl::collide(pairs[i].first, pairs[i].second, request, result);
+  }
+  moveit::Benchmark::keep(count);
+}
+
+void constructWorld(const collision_detection::WorldPtr &world, bool cold)
+{
+  if (cold)
+    collision_detection::cleanCollisionGeometryCache();
+  collision_detection::CollisionWorldFCL cworld(world);
+  moveit::Benchmark::keep(cworld);
+}
+
+void checkSelf(const collision_detection::CollisionRobotFCL &crobot, const collision_detection::CollisionRequest &req,
+               const robot_state::RobotState &state, const collision_detection::AllowedCollisionMatrix &acm)
+{
+  collision_detection::CollisionResult res;
+  crobot.checkSelfCollision(req, res, state, acm);
+  moveit::Benchmark::keep(res.collision);
+}
+
+void checkRobot(const collision_detection::CollisionWorldFCL &cworld, const collision_detection::CollisionRobotFCL &crobot,
+                const collision_detection::CollisionRequest &req, const robot_state::RobotState &state,
+                const collision_detection::AllowedCollisionMatrix &acm)
+{
+  collision_detection::CollisionResult res;
+  cworld.checkRobotCollision(req, res, crobot, state, acm);
+  moveit::Benchmark::keep(res.collision);
+}
+
+void distanceSelf(const collision_detection::CollisionRobotFCL &crobot, const robot_state::RobotState &state,
+                  const collision_detection::AllowedCollisionMatrix &acm)
+{
+  double d = crobot.distanceSelf(state, acm);
+  moveit::Benchmark::keep(d);
+}
+
+void distanceRobot(const collision_detection::CollisionWorldFCL &cworld, const collision_detection::CollisionRobotFCL &crobot,
+                   const robot_state::RobotState &state, const collision_detection::AllowedCollisionMatrix &acm)
+{
+  double d = cworld.distanceRobot(crobot, state, acm);
+  moveit::Benchmark::keep(d);
+}
+
+/** \brief The requests the checks are timed with: a yes/no answer, up to 10 contacts per pair, and cost sources */
+std::vector<std::pair<std::string, collision_detection::CollisionRequest> > makeRequests()
+{
+  std::vector<std::pair<std::string, collision_detection::CollisionRequest> > requests(3);
+  requests[0].first = "binary";
+  requests[1].first = "contacts";
+  requests[1].second.contacts = true;
+  requests[1].second.max_contacts = 1000;
+  requests[1].second.max_contacts_per_pair = 10;
+  requests[2].first = "cost";
+  requests[2].second.cost = true;
+  requests[2].second.max_cost_sources = 20;
+  return requests;
+}
+
+void benchmarkWorld(moveit::Benchmark &bench, const std::string &name, const collision_detection::WorldPtr &world,
+                    const collision_detection::CollisionRobotFCL &crobot, const robot_state::RobotState &state,
+                    const collision_detection::AllowedCollisionMatrix &acm)
+{
+  const std::string p = "world/" + name + "/";
+
+  bench.run(p + "construct/cold", boost::bind(&constructWorld, world, true), world->size());
+  bench.run(p + "construct/cached", boost::bind(&constructWorld, world, false), world->size());
+
+  collision_detection::CollisionWorldFCL cworld(world);
+  std::vector<std::pair<std::string, collision_detection::CollisionRequest> > requests = makeRequests();
+  for (std::size_t i = 0 ; i < requests.size() ; ++i)
+    bench.run(p + "checkRobotCollision/" + requests[i].first,
+              boost::bind(&checkRobot, boost::cref(cworld), boost::cref(crobot), boost::cref(requests[i].second),
+                          boost::cref(state), boost::cref(acm)));
+  bench.run(p + "distanceRobot", boost::bind(&distanceRobot, boost::cref(cworld), boost::cref(crobot), boost::cref(state), boost::cref(acm)));
+
+  // the parts of a world check, without the filtering by the collision matrix and the bookkeeping of the result
+  BroadPhaseScene scene;
+  bench.run(p + "breakdown/objects", boost::bind(&constructObjects, boost::ref(scene), boost::cref(state), world));
+  scene.construct(state, *world);
+  CandidatePairs pairs;
+  bench.run(p + "breakdown/broad_phase", boost::bind(&broadPhase, boost::cref(scene), boost::ref(pairs)));
+  broadPhase(scene, pairs);
+  bench.run(p + "breakdown/narrow_phase(" + boost::lexical_cast<std::string>(pairs.size()) + " pairs)",
+            boost::bind(&narrowPhase, boost::cref(pairs)), std::max<std::size_t>(pairs.size(), 1));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  robot_model::RobotModelPtr model = loadPR2();
+  if (!model)
+    return 1;
+  collision_detection::AllowedCollisionMatrix acm = makeACM(model);
+  collision_detection::CollisionRobotFCL crobot(model);
+  robot_state::RobotState state(model);
+  state.setToDefaultValues();
+
+  std::vector<std::pair<std::string, collision_detection::CollisionRequest> > requests = makeRequests();
+  for (std::size_t i = 0 ; i < requests.size() ; ++i)
+    bench.run("self/checkSelfCollision/" + requests[i].first,
+              boost::bind(&checkSelf, boost::cref(crobot), boost::cref(requests[i].second), boost::cref(state), boost::cref(acm)));
+  bench.run("self/distanceSelf", boost::bind(&distanceSelf, boost::cref(crobot), boost::cref(state), boost::cref(acm)));
+
+  const std::size_t primitive_counts[] = { 10, 100, 1000 };
+  for (std::size_t i = 0 ; i < 3 ; ++i)
+  {
+    std::string name = "primitives" + boost::lexical_cast<std::string>(primitive_counts[i]);
+    benchmarkWorld(bench, name, makePrimitiveWorld(primitive_counts[i]), crobot, state, acm);
+  }
+
+  shapes::ShapeConstPtr mesh(shapes::createMeshFromResource("file://" + kinect_dae_file));
+  if (mesh)
+  {
+    const std::size_t mesh_counts[] = { 5, 20, 50 };
+    for (std::size_t i = 0 ; i < 3 ; ++i)
+    {
+      std::string name = "meshes" + boost::lexical_cast<std::string>(mesh_counts[i]);
+      benchmarkWorld(bench, name, makeMeshWorld(mesh, mesh_counts[i]), crobot, state, acm);
+    }
+  }
+  else
+    logError("Unable to load '%s'; the mesh worlds are skipped", kinect_dae_file.c_str());
+
+  const std::size_t cell_counts[] = { 1000, 10000, 50000 };
+  for (std::size_t i = 0 ; i < 3 ; ++i)
+  {
+    std::string name = "octree" + boost::lexical_cast<std::string>(cell_counts[i]);
+    benchmarkWorld(bench, name, makeOctreeWorld(cell_counts[i]), crobot, state, acm);
+  }
+
+  return bench.report();
+}
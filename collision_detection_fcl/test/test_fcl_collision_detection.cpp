@@ -39,6 +39,7 @@
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/collision_detection_fcl/collision_world_tiered.h>
 
 #include <urdf_parser/urdf_parser.h>
 #include <geometric_shapes/shape_operations.h>
@@ -48,8 +49,10 @@
 #include <algorithm>
 #include <ctype.h>
 #include <fstream>
+#include <limits>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 typedef collision_detection::CollisionWorldFCL DefaultCWorldType;
 typedef collision_detection::CollisionRobotFCL DefaultCRobotType;
@@ -177,6 +180,107 @@ TEST_F(FclCollisionDetectionTester, LinksInCollision)
 }
 
 
+TEST_F(FclCollisionDetectionTester, RepeatedChecksFollowState)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  robot_state::RobotState colliding_state(kstate);
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  colliding_state.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  colliding_state.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  // the broad-phase data is reused between calls, so alternate between the two states
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    collision_detection::CollisionRequest req;
+    collision_detection::CollisionResult res1;
+    crobot_->checkSelfCollision(req, res1, colliding_state, *acm_);
+    ASSERT_TRUE(res1.collision);
+
+    collision_detection::CollisionResult res2;
+    crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+    ASSERT_FALSE(res2.collision);
+  }
+}
+
+TEST_F(FclCollisionDetectionTester, PrecomputedLinkPairs)
+{
+  const DefaultCRobotType &fcl_robot = static_cast<const DefaultCRobotType&>(*crobot_);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  robot_state::RobotState colliding_state(kstate);
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  colliding_state.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  colliding_state.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  DefaultCRobotType::LinkPairs pairs;
+  fcl_robot.computeSelfCollisionPairs(*acm_, pairs);
+  EXPECT_FALSE(pairs.empty());
+  std::size_t links_with_geometry = kmodel_->getLinkModelsWithCollisionGeometry().size();
+  EXPECT_LT(pairs.size(), links_with_geometry * (links_with_geometry - 1) / 2);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  fcl_robot.checkSelfCollision(req, res1, colliding_state, *acm_, pairs);
+  EXPECT_TRUE(res1.collision);
+
+  collision_detection::CollisionResult res2;
+  fcl_robot.checkSelfCollision(req, res2, kstate, *acm_, pairs);
+  EXPECT_FALSE(res2.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, ModifiedCollisionMatrix)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+
+  collision_detection::CompiledAllowedCollisionMatrix compiled;
+  compiled.compile(*acm_, kmodel_->getLinkModelNames());
+  EXPECT_TRUE(compiled.isCompiledFrom(*acm_));
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  EXPECT_FALSE(compiled.isCompiledFrom(*acm_));
+
+  compiled.compile(*acm_, kmodel_->getLinkModelNames());
+  collision_detection::AllowedCollision::Type type;
+  ASSERT_TRUE(compiled.getAllowedCollision(kmodel_->getLinkModel("r_gripper_palm_link")->getTreeIndex(),
+                                           kmodel_->getLinkModel("l_gripper_palm_link")->getTreeIndex(), type));
+  EXPECT_EQ(collision_detection::AllowedCollision::NEVER, type);
+
+  // the lookup tables used by the checks must follow the changes to the matrix
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  crobot_->checkSelfCollision(req, res1, kstate, *acm_);
+  EXPECT_TRUE(res1.collision);
+
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", true);
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+  EXPECT_FALSE(res2.collision);
+
+  acm_->setDefaultEntry("r_gripper_palm_link", false);
+  collision_detection::CollisionResult res3;
+  crobot_->checkSelfCollision(req, res3, kstate, *acm_);
+  EXPECT_TRUE(res3.collision);
+
+  collision_detection::AllowedCollisionMatrix acm(*acm_);
+  acm.setDefaultEntry("r_gripper_palm_link", true);
+  collision_detection::CollisionResult res4;
+  crobot_->checkSelfCollision(req, res4, kstate, acm);
+  EXPECT_FALSE(res4.collision);
+}
+
 TEST_F(FclCollisionDetectionTester, ContactReporting)
 {
   collision_detection::CollisionRequest req;
@@ -230,6 +334,64 @@ TEST_F(FclCollisionDetectionTester, ContactReporting)
 
 }
 
+TEST_F(FclCollisionDetectionTester, CompactContacts)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("base_bellow_link", offset);
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("base_link", "base_bellow_link", false);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 10;
+  req.max_contacts_per_pair = 5;
+  req.deepest_contact_only = true;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_EQ(2u, res.contacts.size());
+  for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin() ; it != res.contacts.end() ; ++it)
+    EXPECT_EQ(1u, it->second.size());
+
+  // the same contacts, without copies of the body names
+  req.compact_contacts = true;
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+  ASSERT_TRUE(res2.collision);
+  EXPECT_TRUE(res2.contacts.empty());
+  ASSERT_EQ(2u, res2.compact_contacts.size());
+  EXPECT_EQ(res.contact_count, res2.contact_count);
+
+  collision_detection::CollisionResult::ContactMap contacts;
+  res2.getContactMap(contacts);
+  ASSERT_EQ(res.contacts.size(), contacts.size());
+  for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin() ; it != res.contacts.end() ; ++it)
+  {
+    ASSERT_TRUE(contacts.find(it->first) != contacts.end());
+    EXPECT_NEAR(it->second[0].depth, contacts[it->first][0].depth, 1e-9);
+  }
+
+  // the names are owned by the result, so a copy stays usable after the original is gone
+  collision_detection::CollisionResult *res3 = new collision_detection::CollisionResult(res2);
+  res2.clear();
+  collision_detection::CollisionResult res4(*res3);
+  delete res3;
+  ASSERT_EQ(2u, res4.compact_contacts.size());
+  for (std::size_t i = 0 ; i < res4.compact_contacts.size() ; ++i)
+  {
+    const std::string &name1 = res4.compact_contacts[i].getBodyName1();
+    const std::string &name2 = res4.compact_contacts[i].getBodyName2();
+    EXPECT_TRUE(res.contacts.find(name1 < name2 ? std::make_pair(name1, name2) : std::make_pair(name2, name1)) != res.contacts.end());
+  }
+}
+
 TEST_F(FclCollisionDetectionTester, ContactPositions)
 {
   collision_detection::CollisionRequest req;
@@ -358,6 +520,653 @@ TEST_F(FclCollisionDetectionTester, AttachedBodyTester) {
   ASSERT_TRUE(res.collision);
 }
 
+TEST_F(FclCollisionDetectionTester, AttachedBodyGeometryAgainstWorld)
+{
+  acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+  acm_->setEntry("obstacle", "box", false);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  std::vector<shapes::ShapeConstPtr> shapes;
+  EigenSTL::vector_Affine3d poses;
+  shapes.push_back(shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  poses.push_back(Eigen::Affine3d::Identity());
+  poses[0].translation().x() = 2.0;
+  std::vector<std::string> touch_links;
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+  cworld_->getWorld()->addToObject("obstacle", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)),
+                                   kstate.getAttachedBody("box")->getGlobalCollisionBodyTransforms()[0]);
+
+  // the geometry of the body is kept between checks, so repeated checks must keep finding the contact
+  collision_detection::CollisionRequest req;
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    collision_detection::CollisionResult res;
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+    ASSERT_TRUE(res.collision);
+  }
+
+  // a body attached again under the same name, with a new shape, does not reuse the previous geometry
+  kstate.clearAttachedBody("box");
+  shapes[0].reset(new shapes::Box(.001, .001, .001));
+  poses[0].translation().x() = 2.2;
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, AttachedBodyFollowsState)
+{
+  acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+  acm_->setEntry("box", "l_gripper_palm_link", false);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  std::vector<double> default_values;
+  kstate.getStateValues(default_values);
+
+  std::vector<shapes::ShapeConstPtr> shapes;
+  EigenSTL::vector_Affine3d poses;
+  shapes.push_back(shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  poses.push_back(Eigen::Affine3d::Identity());
+  std::vector<std::string> touch_links(1, "r_gripper_palm_link");
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+
+  // the objects of the attached body are reused between calls, so they must follow the state
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    collision_detection::CollisionRequest req;
+    collision_detection::CollisionResult res1;
+    kstate.setStateValues(default_values);
+    crobot_->checkSelfCollision(req, res1, kstate, *acm_);
+    ASSERT_FALSE(res1.collision);
+
+    collision_detection::CollisionResult res2;
+    kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+    kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+    crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+    ASSERT_TRUE(res2.collision);
+  }
+
+  // a body attached again with a new shape is not mistaken for the previous one
+  kstate.clearAttachedBody("box");
+  shapes[0].reset(new shapes::Box(.001, .001, .001));
+  poses[0].translation().x() = -1.0;
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  ASSERT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousCollision)
+{
+  robot_state::RobotState state1(kmodel_);
+  state1.setToDefaultValues();
+  robot_state::RobotState state2(state1);
+  std::map<std::string, double> values;
+  values["world_joint/x"] = 4.0;
+  state2.setStateValues(values);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, state1, state2, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 2.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, 5.0)), pos);
+
+  // the box is only hit in the middle of the motion
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, *acm_);
+  EXPECT_FALSE(res.collision);
+  cworld_->checkRobotCollision(req, res, *crobot_, state2, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, state2, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_GT(res.time_of_contact, 0.0);
+  EXPECT_LT(res.time_of_contact, 0.5);
+
+  acm_->setDefaultEntry("box", true);
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, state2, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousCollisionPureRotation)
+{
+  // a box held 2m in front of the base sweeps a quarter circle when the base turns in place; a straight line between
+  // the two poses of the box would pass 0.6m inside the obstacle
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.2, .2, .2)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  poses[0].translation() = Eigen::Vector3d(2.0, 0.0, 0.5);
+  std::vector<std::string> touch_links;
+
+  robot_state::RobotState state1(kmodel_);
+  state1.setToDefaultValues();
+  state1.attachBody("held_box", shapes, poses, touch_links, "base_link");
+  robot_state::RobotState state2(kmodel_);
+  state2.setToDefaultValues();
+  std::map<std::string, double> values;
+  values["world_joint/theta"] = M_PI / 2.0;
+  state2.setStateValues(values);
+  state2.attachBody("held_box", shapes, poses, touch_links, "base_link");
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation() = Eigen::Vector3d(sqrt(2.0), sqrt(2.0), 0.0);
+  cworld_->getWorld()->addToObject("post", shapes::ShapeConstPtr(new shapes::Box(.1, .1, 5.0)), pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, *acm_);
+  EXPECT_FALSE(res.collision);
+  cworld_->checkRobotCollision(req, res, *crobot_, state2, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, state2, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_GT(res.time_of_contact, 0.0);
+  EXPECT_LT(res.time_of_contact, 1.0);
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousCollisionHalfTurn)
+{
+  // a box held 2m in front of the base turns by half a circle, from one side of the robot to the other; the boxes
+  // around its two poses stay close to the y axis, but the box passes one of the posts on the x axis
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.2, .2, .2)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  poses[0].translation() = Eigen::Vector3d(2.0, 0.0, 0.5);
+  std::vector<std::string> touch_links;
+
+  robot_state::RobotState state1(kmodel_);
+  state1.setToDefaultValues();
+  std::map<std::string, double> values;
+  values["world_joint/theta"] = -M_PI / 2.0;
+  state1.setStateValues(values);
+  state1.attachBody("held_box", shapes, poses, touch_links, "base_link");
+  robot_state::RobotState state2(kmodel_);
+  state2.setToDefaultValues();
+  values["world_joint/theta"] = M_PI / 2.0;
+  state2.setStateValues(values);
+  state2.attachBody("held_box", shapes, poses, touch_links, "base_link");
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation() = Eigen::Vector3d(2.0, 0.0, 0.0);
+  cworld_->getWorld()->addToObject("front_post", shapes::ShapeConstPtr(new shapes::Box(.1, .1, 5.0)), pos);
+  pos.translation() = Eigen::Vector3d(-2.0, 0.0, 0.0);
+  cworld_->getWorld()->addToObject("back_post", shapes::ShapeConstPtr(new shapes::Box(.1, .1, 5.0)), pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, *acm_);
+  EXPECT_FALSE(res.collision);
+  cworld_->checkRobotCollision(req, res, *crobot_, state2, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  cworld_->checkRobotCollision(req, res, *crobot_, state1, state2, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_GT(res.time_of_contact, 0.0);
+  EXPECT_LT(res.time_of_contact, 1.0);
+}
+
+TEST_F(FclCollisionDetectionTester, BatchCollision)
+{
+  robot_state::RobotState free_state(kmodel_);
+  free_state.setToDefaultValues();
+  robot_state::RobotState colliding_state(free_state);
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  colliding_state.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  std::vector<const robot_state::RobotState*> states;
+  states.push_back(&free_state);
+  states.push_back(&colliding_state);
+  states.push_back(&free_state);
+
+  collision_detection::CollisionRequest req;
+  std::vector<collision_detection::CollisionResult> res;
+  cworld_->checkCollisionBatch(req, res, *crobot_, states, *acm_);
+  ASSERT_EQ(states.size(), res.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    collision_detection::CollisionResult single_res;
+    cworld_->checkCollision(req, single_res, *crobot_, *states[i], *acm_);
+    EXPECT_EQ(single_res.collision, res[i].collision);
+  }
+  EXPECT_FALSE(res[0].collision);
+  EXPECT_TRUE(res[1].collision);
+  EXPECT_FALSE(res[2].collision);
+}
+
+TEST_F(FclCollisionDetectionTester, TieredCollision)
+{
+  collision_detection::CollisionRobotTiered trobot(kmodel_);
+  collision_detection::CollisionWorldTiered tworld;
+
+  robot_state::RobotState free_state(kmodel_);
+  free_state.setToDefaultValues();
+  robot_state::RobotState colliding_state(free_state);
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  colliding_state.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  tworld.getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  collision_detection::CollisionRequest req;
+  EXPECT_TRUE(tworld.isCertifiedFree(req, trobot, free_state));
+  EXPECT_FALSE(tworld.isCertifiedFree(req, trobot, colliding_state));
+  EXPECT_FALSE(tworld.isCertifiedFree(req, *crobot_, free_state));
+
+  // both tiers agree with FCL
+  std::vector<const robot_state::RobotState*> states;
+  states.push_back(&free_state);
+  states.push_back(&colliding_state);
+  std::vector<collision_detection::CollisionResult> res;
+  tworld.checkCollisionBatch(req, res, trobot, states, *acm_);
+  ASSERT_EQ(states.size(), res.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    collision_detection::CollisionResult tiered_res, fcl_res;
+    tworld.checkCollision(req, tiered_res, trobot, *states[i], *acm_);
+    cworld_->checkCollision(req, fcl_res, *crobot_, *states[i], *acm_);
+    EXPECT_EQ(fcl_res.collision, tiered_res.collision);
+    EXPECT_EQ(fcl_res.collision, res[i].collision);
+  }
+
+  // moving the object invalidates the bounds
+  tworld.getWorld()->moveShapeInObject("box", tworld.getWorld()->getObject("box")->shapes_[0], Eigen::Affine3d::Identity());
+  EXPECT_FALSE(tworld.isCertifiedFree(req, trobot, free_state));
+}
+
+TEST_F(FclCollisionDetectionTester, SpatialQueries)
+{
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(1.0, 1.0, 1.0)), pos);
+  pos.translation().x() = 10.0;
+  cworld_->getWorld()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.5)), pos);
+
+  std::vector<std::string> ids;
+  cworld_->getObjectsInBox(Eigen::Vector3d(4.0, -1.0, -1.0), Eigen::Vector3d(4.6, 1.0, 1.0), ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("box", ids[0]);
+  cworld_->getObjectsInBox(Eigen::Vector3d(6.0, -1.0, -1.0), Eigen::Vector3d(9.0, 1.0, 1.0), ids);
+  EXPECT_TRUE(ids.empty());
+
+  cworld_->getObjectsInSphere(Eigen::Vector3d(7.5, 0.0, 0.0), 2.1, ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("box", ids[0]);
+  EXPECT_EQ("sphere", ids[1]);
+  cworld_->getObjectsInSphere(Eigen::Vector3d(7.5, 0.0, 0.0), 1.9, ids);
+  EXPECT_TRUE(ids.empty());
+
+  // the exact queries agree with the default ones where these are exact
+  std::string id;
+  double distance;
+  ASSERT_TRUE(cworld_->castRay(Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitX(), 20.0, id, distance));
+  EXPECT_EQ("box", id);
+  EXPECT_NEAR(4.5, distance, 1e-6);
+  ASSERT_TRUE(cworld_->castRay(Eigen::Vector3d(20.0, 0.0, 0.0), -Eigen::Vector3d::UnitX(), 20.0, id, distance));
+  EXPECT_EQ("sphere", id);
+  EXPECT_NEAR(9.5, distance, 1e-6);
+  ASSERT_TRUE(cworld_->castRay(Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitX(), std::numeric_limits<double>::infinity(), id, distance));
+  EXPECT_EQ("box", id);
+  EXPECT_FALSE(cworld_->castRay(Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitX(), 4.0, id, distance));
+  EXPECT_FALSE(cworld_->castRay(Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitY(), 20.0, id, distance));
+}
+
+TEST_F(FclCollisionDetectionTester, MultiRobotCollision)
+{
+  robot_state::RobotState state1(kmodel_);
+  state1.setToDefaultValues();
+  robot_state::RobotState state2(state1);
+  robot_state::RobotState far_state(state1);
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 10.0;
+  far_state.updateStateWithLinkAt("base_footprint", pos);
+
+  typedef collision_detection::CollisionRobotFCL::RobotAndState RobotAndState;
+  std::vector<RobotAndState> robots;
+  robots.push_back(RobotAndState(crobot_.get(), &state1));
+  robots.push_back(RobotAndState(crobot_.get(), &far_state));
+
+  // links of the same robot touch each other, but only collisions between robots are reported
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  collision_detection::CollisionRobotFCL::checkRobotsCollision(req, res1, robots);
+  EXPECT_FALSE(res1.collision);
+
+  robots.push_back(RobotAndState(crobot_.get(), &state2));
+  collision_detection::CollisionResult res2;
+  collision_detection::CollisionRobotFCL::checkRobotsCollision(req, res2, robots);
+  EXPECT_TRUE(res2.collision);
+
+  // allowing all collisions between the two robots at the same place leaves no collisions
+  std::vector<const collision_detection::AllowedCollisionMatrix*> pair_acms(robots.size() * robots.size(), NULL);
+  pair_acms[0 * robots.size() + 2] = acm_.get();
+  collision_detection::CollisionResult res3;
+  collision_detection::CollisionRobotFCL::checkRobotsCollision(req, res3, robots, pair_acms);
+  EXPECT_FALSE(res3.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, CombinedWorldAndSelfCollision)
+{
+  collision_detection::CollisionRobotFCL padded_robot(kmodel_, 0.05);
+  robot_state::RobotState free_state(kmodel_);
+  free_state.setToDefaultValues();
+  robot_state::RobotState self_colliding_state(free_state);
+  robot_state::RobotState world_colliding_state(free_state);
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  self_colliding_state.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  self_colliding_state.updateStateWithLinkAt("base_bellow_link", offset);
+  acm_->setEntry("base_link", "base_bellow_link", false);
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  world_colliding_state.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  std::vector<const robot_state::RobotState*> states;
+  states.push_back(&free_state);
+  states.push_back(&self_colliding_state);
+  states.push_back(&world_colliding_state);
+  states.push_back(&free_state);
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 100;
+  req.max_contacts_per_pair = 1;
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    // the same robot for both checks, and a padded robot for the world
+    for (int padded = 0 ; padded < 2 ; ++padded)
+    {
+      const collision_detection::CollisionRobot &robot = padded ? static_cast<const collision_detection::CollisionRobot&>(padded_robot) : *crobot_;
+      collision_detection::CollisionResult separate_res, combined_res;
+      cworld_->checkRobotCollision(req, separate_res, robot, *states[i], *acm_);
+      crobot_->checkSelfCollision(req, separate_res, *states[i], *acm_);
+      cworld_->checkCollision(req, combined_res, robot, *crobot_, *states[i], *acm_);
+      EXPECT_EQ(separate_res.collision, combined_res.collision);
+      EXPECT_EQ(separate_res.contact_count, combined_res.contact_count);
+      EXPECT_EQ(separate_res.contacts.size(), combined_res.contacts.size());
+    }
+  }
+
+  collision_detection::CollisionResult res;
+  cworld_->checkCollision(req, res, padded_robot, *crobot_, world_colliding_state, *acm_);
+  EXPECT_TRUE(res.collision);
+  res.clear();
+  cworld_->checkCollision(req, res, padded_robot, *crobot_, free_state, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, GroupRestrictedChecks)
+{
+  const robot_model::JointModelGroup *right_arm = kmodel_->getJointModelGroup("right_arm");
+  ASSERT_TRUE(right_arm);
+  const std::vector<bool> &mask = right_arm->getUpdatedLinkModelsWithGeometryMask();
+  const std::vector<const robot_model::LinkModel*> &links = kmodel_->getLinkModels();
+  ASSERT_EQ(links.size(), mask.size());
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    EXPECT_EQ(right_arm->getUpdatedLinkModelsWithGeometrySet().count(links[i]) > 0, (bool)mask[i]);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  req.group_name = "right_arm";
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // the right gripper is not updated by the left arm
+  res.clear();
+  req.group_name = "left_arm";
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkCollision(req, res, *crobot_, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // self collisions are reported for a group as long as one of the links is in it
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  req.group_name = "right_arm";
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  req.group_name = "left_arm";
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // with contacts, the pair is reported once
+  req.contacts = true;
+  req.max_contacts = 100;
+  req.max_contacts_per_pair = 100;
+  collision_detection::CollisionResult group_res, full_res;
+  crobot_->checkSelfCollision(req, group_res, kstate, *acm_);
+  req.group_name.clear();
+  crobot_->checkSelfCollision(req, full_res, kstate, *acm_);
+  EXPECT_EQ(full_res.contact_count, group_res.contact_count);
+}
+
+static void checkWorldRepeatedly(const collision_detection::CollisionWorld *cworld, const collision_detection::CollisionRobot *crobot,
+                                 const robot_state::RobotState *state, const collision_detection::AllowedCollisionMatrix *acm,
+                                 unsigned int *collision_count)
+{
+  collision_detection::CollisionRequest req;
+  for (int i = 0 ; i < 100 ; ++i)
+  {
+    collision_detection::CollisionResult res;
+    cworld->checkRobotCollision(req, res, *crobot, *state, *acm);
+    if (res.collision)
+      ++(*collision_count);
+  }
+}
+
+TEST_F(FclCollisionDetectionTester, ConcurrentWorldQueries)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  // queries run while objects that do not touch the robot are added and removed
+  std::vector<unsigned int> collision_counts(4, 0);
+  std::vector<boost::thread*> threads;
+  for (std::size_t i = 0 ; i < collision_counts.size() ; ++i)
+    threads.push_back(new boost::thread(boost::bind(&checkWorldRepeatedly, cworld_.get(), crobot_.get(), &kstate, acm_.get(), &collision_counts[i])));
+
+  Eigen::Affine3d far_pos = Eigen::Affine3d::Identity();
+  far_pos.translation().z() = 20.0;
+  for (int i = 0 ; i < 50 ; ++i)
+  {
+    cworld_->getWorld()->addToObject("far", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), far_pos);
+    cworld_->getWorld()->removeObject("far");
+  }
+
+  for (std::size_t i = 0 ; i < threads.size() ; ++i)
+  {
+    threads[i]->join();
+    delete threads[i];
+    EXPECT_EQ(100u, collision_counts[i]);
+  }
+}
+
+TEST_F(FclCollisionDetectionTester, ConcurrentWorldMoves)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  shapes::ShapeConstPtr box(new shapes::Box(.1, .1, .1));
+  cworld_->getWorld()->addToObject("box", box, pos);
+  shapes::ShapeConstPtr far_box(new shapes::Box(.1, .1, .1));
+  Eigen::Affine3d far_pos = Eigen::Affine3d::Identity();
+  far_pos.translation().z() = 20.0;
+  cworld_->getWorld()->addToObject("far", far_box, far_pos);
+
+  // the writer publishes each change while the queries run; the box keeps touching the robot as it moves
+  std::vector<unsigned int> collision_counts(4, 0);
+  std::vector<boost::thread*> threads;
+  for (std::size_t i = 0 ; i < collision_counts.size() ; ++i)
+    threads.push_back(new boost::thread(boost::bind(&checkWorldRepeatedly, cworld_.get(), crobot_.get(), &kstate, acm_.get(), &collision_counts[i])));
+
+  for (int i = 0 ; i < 50 ; ++i)
+  {
+    Eigen::Affine3d box_pos = pos;
+    box_pos.translation().y() = 0.001 * (i % 10);
+    far_pos.translation().x() = 0.1 * i;
+    cworld_->getWorld()->moveShapeInObject("box", box, box_pos);
+    cworld_->getWorld()->moveShapeInObject("far", far_box, far_pos);
+  }
+
+  for (std::size_t i = 0 ; i < threads.size() ; ++i)
+  {
+    threads[i]->join();
+    delete threads[i];
+    EXPECT_EQ(100u, collision_counts[i]);
+  }
+
+  // the last moves are visible to the queries that follow them
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  Eigen::Affine3d away = pos;
+  away.translation().z() = 10.0;
+  cworld_->getWorld()->moveShapeInObject("box", box, away);
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, MovingObstacle)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos);
+
+  Eigen::Affine3d far_pos = Eigen::Affine3d::Identity();
+  far_pos.translation().z() = 20.0;
+  shapes::ShapeConstPtr box(new shapes::Box(.1, .1, .1));
+  cworld_->getWorld()->addToObject("box", box, far_pos);
+
+  // the obstacle moves in and out of the gripper; only its pose is updated, and each check sees the latest one
+  for (int i = 0 ; i < 10 ; ++i)
+  {
+    cworld_->getWorld()->moveShapeInObject("box", box, i % 2 ? pos : far_pos);
+    collision_detection::CollisionRequest req;
+    collision_detection::CollisionResult res;
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+    EXPECT_EQ(i % 2 == 1, res.collision);
+  }
+
+  // a copy of the world shares the published objects; moving the obstacle in one does not move it in the other
+  DefaultCWorldType copy(static_cast<const DefaultCWorldType&>(*cworld_), collision_detection::WorldPtr(new collision_detection::World(*cworld_->getWorld())));
+  cworld_->getWorld()->moveShapeInObject("box", box, pos);
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1, res2;
+  cworld_->checkRobotCollision(req, res1, *crobot_, kstate, *acm_);
+  copy.checkRobotCollision(req, res2, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res1.collision);
+  EXPECT_FALSE(res2.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, DistancePairs)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos);
+  const collision_detection::CollisionWorldFCL &fcl_world = static_cast<const collision_detection::CollisionWorldFCL&>(*cworld_);
+
+  pos.translation().x() = 5.5;
+  cworld_->getWorld()->addToObject("near", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+  pos.translation().x() = 6.0;
+  cworld_->getWorld()->addToObject("far", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  collision_detection::DistanceRequest req;
+  req.max_pairs = 0;
+  req.max_distance = 2.0;
+  collision_detection::DistanceResult res;
+  fcl_world.distanceRobot(req, res, *crobot_, kstate, *acm_);
+  ASSERT_FALSE(res.pairs.empty());
+  bool found_near = false, found_far = false;
+  for (std::size_t i = 0 ; i < res.pairs.size() ; ++i)
+  {
+    EXPECT_LE(res.pairs[i].distance, req.max_distance);
+    if (i > 0)
+      EXPECT_LE(res.pairs[i - 1].distance, res.pairs[i].distance);
+    if (res.pairs[i].body_name_2 == "near" || res.pairs[i].body_name_1 == "near")
+      found_near = true;
+    if (res.pairs[i].body_name_2 == "far" || res.pairs[i].body_name_1 == "far")
+      found_far = true;
+  }
+  EXPECT_TRUE(found_near);
+  EXPECT_TRUE(found_far);
+  EXPECT_NEAR(cworld_->distanceRobot(*crobot_, kstate, *acm_), res.getMinimumDistance(), 1e-6);
+
+  // bounded queries only compare against the threshold
+  double d = res.getMinimumDistance();
+  EXPECT_DOUBLE_EQ(d / 2.0, cworld_->distanceRobot(*crobot_, kstate, *acm_, d / 2.0));
+  EXPECT_LT(cworld_->distanceRobot(*crobot_, kstate, *acm_, 2.0), 2.0);
+
+  // only the nearest pair is kept
+  req.max_pairs = 1;
+  collision_detection::DistanceResult res1;
+  fcl_world.distanceRobot(req, res1, *crobot_, kstate, *acm_);
+  ASSERT_EQ(1u, res1.pairs.size());
+  EXPECT_NEAR(res.getMinimumDistance(), res1.getMinimumDistance(), 1e-6);
+
+  // pairs beyond the cutoff are not reported
+  req.max_distance = 0.01;
+  collision_detection::DistanceResult res2;
+  fcl_world.distanceRobot(req, res2, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res2.pairs.empty());
+
+  // a colliding pair reports the depth of its deepest contact, at a single point
+  pos.translation().x() = 5.0;
+  cworld_->getWorld()->addToObject("inside", shapes::ShapeConstPtr(new shapes::Box(.3, .3, .3)), pos);
+  req.max_pairs = 1;
+  collision_detection::DistanceResult res3;
+  fcl_world.distanceRobot(req, res3, *crobot_, kstate, *acm_);
+  ASSERT_EQ(1u, res3.pairs.size());
+  EXPECT_LE(res3.pairs[0].distance, 0.0);
+  EXPECT_TRUE(res3.pairs[0].body_name_1 == "inside" || res3.pairs[0].body_name_2 == "inside");
+  EXPECT_TRUE(res3.pairs[0].nearest_point_1.isApprox(res3.pairs[0].nearest_point_2));
+  double n = res3.pairs[0].normal.norm();
+  EXPECT_TRUE(n == 0.0 || fabs(n - 1.0) < 1e-6);
+}
+
 TEST_F(FclCollisionDetectionTester, DiffSceneTester)
 {
   robot_state::RobotState kstate(kmodel_);
@@ -569,6 +1378,105 @@ TEST_F(FclCollisionDetectionTester, TestChangingShapeSize)
   }
 }
 
+TEST_F(FclCollisionDetectionTester, GeometryCacheLimit)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  collision_detection::resetCollisionGeometryCacheStatistics();
+  collision_detection::CollisionGeometryCacheStatistics stats1 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_EQ(0u, stats1.hits);
+  EXPECT_EQ(0u, stats1.misses);
+  EXPECT_EQ(0u, stats1.evictions);
+
+  // a new shape needs new geometry; updating the object reuses the geometry of the shape it already had
+  shapes::ShapeConstPtr box1(new shapes::Box(1, 1, 1));
+  cworld_->getWorld()->addToObject("box", box1, Eigen::Affine3d::Identity());
+  collision_detection::CollisionGeometryCacheStatistics stats2 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_EQ(1u, stats2.misses);
+  EXPECT_GT(stats2.bytes, stats1.bytes);
+
+  shapes::ShapeConstPtr box2(new shapes::Box(1, 1, 1));
+  cworld_->getWorld()->addToObject("box", box2, Eigen::Affine3d::Identity());
+  collision_detection::CollisionGeometryCacheStatistics stats3 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_EQ(2u, stats3.misses);
+  EXPECT_LE(1u, stats3.hits);
+
+  // geometry in use is not evicted: that would free no memory, and it would be constructed again for the next robot
+  collision_detection::setCollisionGeometryCacheLimit(1);
+  EXPECT_EQ(1u, collision_detection::getCollisionGeometryCacheLimit());
+  collision_detection::CollisionGeometryCacheStatistics stats4 = collision_detection::getCollisionGeometryCacheStatistics();
+  collision_detection::CollisionRobotFCL crobot2(kmodel_);
+  collision_detection::CollisionGeometryCacheStatistics stats5 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_EQ(stats4.misses, stats5.misses);
+  EXPECT_LT(stats4.hits, stats5.hits);
+
+  // once no object uses the geometry of the boxes, it is evicted
+  cworld_->getWorld()->removeObject("box");
+  cworld_->getWorld()->addToObject("other_box", shapes::ShapeConstPtr(new shapes::Box(1, 1, 1)), Eigen::Affine3d::Identity());
+  collision_detection::CollisionGeometryCacheStatistics stats6 = collision_detection::getCollisionGeometryCacheStatistics();
+  collision_detection::setCollisionGeometryCacheLimit(1);
+  collision_detection::CollisionGeometryCacheStatistics stats7 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_LE(stats6.evictions + 2, stats7.evictions);
+  EXPECT_LT(stats7.bytes, stats6.bytes);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  collision_detection::setCollisionGeometryCacheLimit(0);
+}
+
+TEST_F(FclCollisionDetectionTester, SharedPaddedLinkGeometry)
+{
+  // robots with the same padding share the padded link geometry
+  collision_detection::CollisionRobotFCL crobot1(kmodel_, 0.05);
+  collision_detection::CollisionGeometryCacheStatistics stats1 = collision_detection::getCollisionGeometryCacheStatistics();
+  collision_detection::CollisionRobotFCL crobot2(kmodel_, 0.05);
+  collision_detection::CollisionGeometryCacheStatistics stats2 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_EQ(stats1.misses, stats2.misses);
+  EXPECT_LT(stats1.hits, stats2.hits);
+
+  // a different padding needs geometry of its own
+  collision_detection::CollisionRobotFCL crobot3(kmodel_, 0.1);
+  collision_detection::CollisionGeometryCacheStatistics stats3 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_LT(stats2.misses, stats3.misses);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1, res2;
+  crobot1.checkSelfCollision(req, res1, kstate, *acm_);
+  crobot2.checkSelfCollision(req, res2, kstate, *acm_);
+  EXPECT_EQ(res1.collision, res2.collision);
+}
+TEST_F(FclCollisionDetectionTester, TogglePadding)
+{
+  collision_detection::CollisionRobotFCL crobot(kmodel_, 0.0);
+  crobot.setPadding(0.02);
+  crobot.setPadding(0.0);
+
+  // switching between paddings the robot already used constructs no geometry
+  collision_detection::CollisionGeometryCacheStatistics stats1 = collision_detection::getCollisionGeometryCacheStatistics();
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    crobot.setPadding(0.02);
+    crobot.setPadding(0.0);
+  }
+  collision_detection::CollisionGeometryCacheStatistics stats2 = collision_detection::getCollisionGeometryCacheStatistics();
+  EXPECT_EQ(stats1.misses, stats2.misses);
+  EXPECT_EQ(stats1.hits, stats2.hits);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1, res2;
+  crobot.checkSelfCollision(req, res1, kstate, *acm_);
+  crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+  EXPECT_EQ(res1.collision, res2.collision);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -39,6 +39,9 @@
 
 #include <moveit/constraint_samplers/constraint_sampler_allocator.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
+#include <list>
 
 namespace constraint_samplers
 {
@@ -60,7 +63,7 @@ public:
    * \brief Empty constructor
    *
    */
-  ConstraintSamplerManager()
+  ConstraintSamplerManager() : sampler_cache_size_(0)
   {
   }
   /**
@@ -71,6 +74,7 @@ public:
   void registerSamplerAllocator(const ConstraintSamplerAllocatorPtr &sa)
   {
     sampler_alloc_.push_back(sa);
+    clearSamplerCache();
   }
   /**
    * \brief Selects among the potential sampler allocators.
@@ -90,6 +94,33 @@ public:
    */
   ConstraintSamplerPtr selectSampler(const planning_scene::PlanningSceneConstPtr &scene, const std::string &group_name, const moveit_msgs::Constraints &constr) const;
 
+  /**
+   * \brief Keep the results of up to \e max_entries calls to
+   * selectSampler(), so a repeated request hands back the sampler
+   * that is already configured instead of allocating a new one.
+   *
+   * A result is reused for a request for the same scene, group and
+   * constraints, as long as neither the scene nor its parents changed
+   * since (see planning_scene::PlanningScene::getChangeStamp()).  The
+   * least recently used result is discarded when the cache is full.
+   * The sampler is shared with the earlier callers, along with anything
+   * they set on it (e.g., the state validity callback), so the cache
+   * should not be used when samplers are used from several threads at
+   * once.
+   *
+   * @param max_entries The number of results to keep; 0 disables the cache
+   */
+  void setSamplerCacheSize(std::size_t max_entries);
+
+  /** \brief Get the number of results of selectSampler() that are kept; 0 if the cache is disabled */
+  std::size_t getSamplerCacheSize() const
+  {
+    return sampler_cache_size_;
+  }
+
+  /** \brief Discard the results of selectSampler() that are kept */
+  void clearSamplerCache();
+
   /**
    * \brief Default logic to select a ConstraintSampler given a
    * constraints message.
@@ -121,6 +152,7 @@ public:
    *   - It will attempt to determine which constraints act on the IK link for the sub-group IK solvers, and attempts to create ConstraintSampler functions by recursively calling \ref selectDefaultSampler for the sub-group.
    *   - If any samplers are valid, it adds them to a vector of type \ref ConstraintSamplerPtr.
    *   - Once it has iterated through each sub-group, if any samplers are valid, they are returned in a UnionConstraintSampler, along with a JointConstraintSampler if one exists.
+   * - If there is no direct IK solver for the group and position or orientation constraints are present, the function will attempt to create a ProjectionConstraintSampler, which is returned alone or in a UnionConstraintSampler along with a JointConstraintSampler if one exists.
    * @param scene The planning scene that will be used to create the ConstraintSampler
    * @param group_name The group name for which to create a sampler
    * @param constr The set of constraints for which to create a sampler
@@ -131,7 +163,23 @@ public:
 
 private:
 
+  /** \brief A result of selectSampler() and the request it was computed for */
+  struct CachedSampler
+  {
+    const planning_scene::PlanningScene *scene_;
+    std::size_t                          change_stamp_;
+    std::string                          group_name_;
+    std::vector<boost::uint8_t>          constraints_; // the serialized constraints message
+    ConstraintSamplerPtr                 sampler_;
+  };
+
+  ConstraintSamplerPtr allocateSampler(const planning_scene::PlanningSceneConstPtr &scene, const std::string &group_name, const moveit_msgs::Constraints &constr) const;
+
   std::vector<ConstraintSamplerAllocatorPtr> sampler_alloc_; /**< \brief Holds the constraint sampler allocators, which will be tested in order  */
+
+  std::size_t                                sampler_cache_size_; /**< \brief The number of results of selectSampler() to keep */
+  mutable std::list<CachedSampler>           sampler_cache_; /**< \brief The results of selectSampler(), most recently used first */
+  mutable boost::mutex                       sampler_cache_lock_;
 };
 
 typedef boost::shared_ptr<ConstraintSamplerManager> ConstraintSamplerManagerPtr; /**< \brief boost::shared_ptr to a ConstraintSamplerManager */
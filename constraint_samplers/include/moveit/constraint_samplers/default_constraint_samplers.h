@@ -38,6 +38,7 @@
 #define MOVEIT_CONSTRAINT_SAMPLERS_DEFAULT_CONSTRAINT_SAMPLERS_
 
 #include <moveit/constraint_samplers/constraint_sampler.h>
+#include <moveit/constraint_samplers/ik_seed_database.h>
 #include <random_numbers/random_numbers.h>
 
 namespace constraint_samplers
@@ -125,6 +126,39 @@ public:
                        const robot_state::RobotState &reference_state,
                        unsigned int max_attempts);
 
+  /**
+   * \brief Produces \e count samples at once, without setting them in a JointStateGroup.
+   *
+   * The samples have the same distribution as the ones produced by
+   * sample().  The variables of single DOF joints are drawn from
+   * ranges precomputed by configure(), one variable at a time for all
+   * samples; only multi-DOF joints without bounds go through their
+   * joint model.
+   *
+   * @param [in] count The number of samples to produce
+   * @param [out] values The samples, one after the other, each in the order of the variables of the group
+   *
+   * @return True if the sampler is configured, otherwise false
+   */
+  bool sampleBatch(std::size_t count, std::vector<double> &values);
+
+  /**
+   * \brief Draws the samples of sample() and sampleBatch() from the points of \e sampler instead of independent random values.
+   *
+   * With a low-discrepancy sampler (e.g., robot_model::SobolSampler), the samples spread over the allowed region more evenly.
+   * The sampler is used until the next configuration; passing NULL returns to random values.
+   *
+   * @param [in] sampler The sampler, producing at least getSampleDimension() coordinates
+   *
+   * @return True if the sampler is configured and the sampler produces enough coordinates, otherwise false
+   */
+  bool setVariableSampler(const robot_model::VariableSamplerPtr &sampler);
+
+  /**
+   * \brief Gets the number of coordinates a sampler passed to setVariableSampler() needs to produce.
+   */
+  unsigned int getSampleDimension() const;
+
   /**
    * \brief Gets the number of constrained joints - joints that have an
    * additional bound beyond the joint limits.
@@ -186,12 +220,24 @@ protected:
 
   virtual void clear();
 
+  /**
+   * \brief Writes the values of one sample, computed from the next point of \e variable_sampler_, to \e values.
+   */
+  void sampleFromVariableSampler(double *values);
+
   random_numbers::RandomNumberGenerator           random_number_generator_; /**< \brief Random number generator used to sample */
+  robot_model::VariableSamplerPtr                 variable_sampler_; /**< \brief If set, the sampler the samples are computed from instead of \e random_number_generator_ */
+  std::vector<double>                             point_; /**< \brief The point of \e variable_sampler_ the current sample is computed from */
   std::vector<JointInfo>                          bounds_; /**< \brief The bounds for any joint with bounds that are more restrictive than the joint limits */
 
   std::vector<const robot_model::JointModel*> unbounded_; /**< \brief The joints that are not bounded except by joint limits */
   std::vector<unsigned int>                       uindex_; /**< \brief The index of the unbounded joints in the joint state vector */
   std::vector<double>                             values_; /**< \brief Values associated with this group to avoid continuously reallocating */
+
+  std::vector<unsigned int>                       uniform_index_; /**< \brief The index of the variables sampleBatch() draws uniformly */
+  std::vector<double>                             uniform_min_; /**< \brief The lower bound of the variables in \e uniform_index_ */
+  std::vector<double>                             uniform_range_; /**< \brief The width of the range of the variables in \e uniform_index_ */
+  std::vector<std::size_t>                        joint_sampled_; /**< \brief The entries of \e unbounded_ that sampleBatch() samples through their joint model */
 };
 
 /**
@@ -296,7 +342,7 @@ public:
    */
   IKConstraintSampler(const planning_scene::PlanningSceneConstPtr &scene,
                       const std::string &group_name) :
-    ConstraintSampler(scene, group_name)
+    ConstraintSampler(scene, group_name), ik_threads_(1)
   {
   }
 
@@ -373,6 +419,57 @@ public:
     ik_timeout_ = timeout;
   }
 
+  /**
+   * \brief Gets the number of threads sample() and project() distribute IK attempts over
+   */
+  unsigned int getIKThreads() const
+  {
+    return ik_threads_;
+  }
+
+  /**
+   * \brief Sets the number of threads sample() and project() distribute IK attempts over.
+   *
+   * With more than one thread, the attempts are raced: each thread
+   * samples poses and calls IK with its own solver instance and its
+   * own copy of the state, and the first valid solution is used.  The
+   * other threads stop at their next attempt; an IK call that is in
+   * progress is not interrupted, but the solutions it finds are
+   * rejected.  Each call leases its solver instances from the group
+   * (see JointModelGroup::acquireSolverInstance()) and returns them when
+   * it is done; if the group cannot provide distinct instances,
+   * sampling stays single threaded.  The
+   * state validity callback must be safe to call from several threads
+   * at once.
+   *
+   * @param num_threads The number of threads; 0 is treated as 1
+   */
+  void setIKThreads(unsigned int num_threads);
+
+  /**
+   * \brief Gets the database of IK solutions used for seeding IK, or an empty pointer if there is none
+   */
+  const IKSeedDatabasePtr& getSeedDatabase() const
+  {
+    return seed_database_;
+  }
+
+  /**
+   * \brief Sets a database of IK solutions used for seeding IK.
+   *
+   * When IK is not seeded with the values of the group (as the first
+   * attempt of project() is), the seed is chosen at random among the
+   * solutions the database holds for the nearest poses and a random
+   * value.  Every solution IK finds is added to the database.  The
+   * database should only be shared by samplers for the same group.
+   *
+   * @param database The database, or an empty pointer to seed IK with random values only
+   */
+  void setSeedDatabase(const IKSeedDatabasePtr &database)
+  {
+    seed_database_ = database;
+  }
+
   /**
    * \brief Gets the position constraint associated with this sampler.
    *
@@ -469,6 +566,9 @@ public:
 
 protected:
 
+  /** \brief The state shared by the threads of a parallel IK search */
+  struct ParallelSearch;
+
   virtual void clear();
 
   /**
@@ -479,7 +579,7 @@ protected:
   bool loadIKSolver();
 
   /**
-   * \brief Actually calls IK on the given pose, generating a random seed state.
+   * \brief Actually calls IK on the given pose, generating a random seed state, with a solver instance leased from the group.
    *
    * @param ik_query The pose for solving IK, assumed to be for the tip frame in the base frame
    * @param timeout The timeout for the IK search
@@ -491,14 +591,188 @@ protected:
   bool callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback, double timeout,
               robot_state::JointStateGroup *jsg, bool use_as_seed);
 
+  /** \brief Same as callIK() above, using the IK solver \e solver and random seeds from \e rng */
+  bool callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback, double timeout,
+              robot_state::JointStateGroup *jsg, bool use_as_seed, const kinematics::KinematicsBase &solver, random_numbers::RandomNumberGenerator &rng);
+
+  /** \brief Same as samplePose() above, using the random numbers from \e rng */
+  bool samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat, const robot_state::RobotState &ks, unsigned int max_attempts,
+                  random_numbers::RandomNumberGenerator &rng);
+
   bool sampleHelper(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project);
 
+  /** \brief Race the IK attempts of sampleHelper() over threads, one for each of \e solvers */
+  bool sampleParallel(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project,
+                      const std::vector<kinematics::KinematicsBaseConstPtr> &solvers);
+
+  /** \brief The attempts of one thread of sampleParallel() */
+  void sampleThread(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project,
+                    const kinematics::KinematicsBaseConstPtr &solver, ParallelSearch *search);
+
+  /** \brief Lease up to \e count distinct solver instances from the group; they go back to the group when \e solvers
+      releases them */
+  void acquireSolvers(std::size_t count, std::vector<kinematics::KinematicsBaseConstPtr> &solvers) const;
+
   random_numbers::RandomNumberGenerator random_number_generator_; /**< \brief Random generator used by the sampler */
   IKSamplingPose                        sampling_pose_; /**< \brief Holder for the pose used for sampling */
-  kinematics::KinematicsBaseConstPtr    kb_; /**< \brief Holds the kinematics solver */
+  kinematics::KinematicsBaseConstPtr    kb_; /**< \brief The shared solver of the group, which gives the frames of IK; IK calls lease their own instances */
   double                                ik_timeout_; /**< \brief Holds the timeout associated with IK */
   std::string                           ik_frame_; /**< \brief Holds the base from of the IK solver */
   bool                                  transform_ik_; /**< \brief True if the frame associated with the kinematic model is different than the base frame of the IK solver */
+  unsigned int                          ik_threads_; /**< \brief The number of threads IK attempts are distributed over */
+  IKSeedDatabasePtr                     seed_database_; /**< \brief The solutions used as seeds for IK, if any */
+};
+
+/**
+ * \brief A class that samples position and/or orientation constraints
+ * without an IK solver.
+ *
+ * A pose is sampled in the constraint regions the same way the \ref
+ * IKConstraintSampler does, and the joint values of the group are then
+ * moved towards that pose with damped least-squares steps computed
+ * from the Jacobian of the constrained link, until the constraints are
+ * satisfied.  This requires the group to be a chain that updates the
+ * constrained link.  It is meant as a fallback for groups that have
+ * no IK solver: it is slower than IK and only finds the solutions
+ * that are reachable from the starting values by following the
+ * gradient.
+ */
+class ProjectionConstraintSampler : public ConstraintSampler
+{
+public:
+
+  /**
+   * \brief Constructor
+   *
+   * @param [in] scene The planning scene used to check the constraint
+   *
+   * @param [in] group_name The group name associated with the
+   * constraint.  Will be invalid if no group name is passed in or the
+   * joint model group cannot be found in the kinematic model
+   *
+   */
+  ProjectionConstraintSampler(const planning_scene::PlanningSceneConstPtr &scene,
+                              const std::string &group_name) :
+    ConstraintSampler(scene, group_name), max_iterations_(20)
+  {
+  }
+
+  /**
+   * \brief Configures the sampler given a constraints message.
+   *
+   * The constraints are chosen the same way as in \ref
+   * IKConstraintSampler::configure(const moveit_msgs::Constraints &constr)
+   * and passed to \ref configure(const IKSamplingPose &sp).
+   *
+   * @param constr The Constraint message
+   *
+   * @return True if some valid position and orientation constraints
+   * exist and the overloaded configuration function returns true.
+   * Otherwise, returns false.
+   */
+  virtual bool configure(const moveit_msgs::Constraints &constr);
+
+  /**
+   * \brief Configures the sampler given a IKSamplingPose.
+   *
+   * It returns true if the following are true:
+   * \li The \ref IKSamplingPose has either a valid orientation or position constraint
+   * \li The position and orientation constraints are specified for the same link
+   * \li The group is a chain and the constrained link is updated by the group
+   *
+   * @param [in] sp The variable that contains the position and orientation constraints
+   *
+   * @return True if all conditions are met and the group specified in
+   * the constructor is valid.  Otherwise, false.
+   */
+  bool configure(const IKSamplingPose &sp);
+
+  /**
+   * \brief Gets the maximum number of steps taken towards each sampled pose
+   */
+  unsigned int getMaxIterations() const
+  {
+    return max_iterations_;
+  }
+
+  /**
+   * \brief Sets the maximum number of steps taken towards each sampled pose
+   */
+  void setMaxIterations(unsigned int max_iterations)
+  {
+    max_iterations_ = max_iterations;
+  }
+
+  /**
+   * \brief Gets the position constraint associated with this sampler.
+   *
+   * @return The position constraint, or an empty boost::shared_ptr if none has been specified
+   */
+  const boost::shared_ptr<kinematic_constraints::PositionConstraint>& getPositionConstraint() const
+  {
+    return sampling_pose_.position_constraint_;
+  }
+
+  /**
+   * \brief Gets the orientation constraint associated with this sampler.
+   *
+   * @return The orientation constraint, or an empty boost::shared_ptr if none has been specified
+   */
+  const boost::shared_ptr<kinematic_constraints::OrientationConstraint>& getOrientationConstraint() const
+  {
+    return sampling_pose_.orientation_constraint_;
+  }
+
+  /**
+   * \brief Gets the link name associated with this sampler
+   */
+  const std::string& getLinkName() const;
+
+  /**
+   * \brief Produces a sample, putting the result in the JointStateGroup.
+   *
+   * Each attempt starts from random joint values, samples a pose in
+   * the constraint regions and takes at most \ref getMaxIterations()
+   * steps towards it.  The attempt succeeds as soon as the constraints
+   * are satisfied and the state validity callback, if any, accepts the
+   * joint values.
+   *
+   * @param jsg The joint state group in question.  Must match the group passed in the constructor or will return false.
+   * @param ks A reference state that will be used for transforming the sampled poses
+   * @param max_attempts The number of attempts to both sample a pose and move towards it
+   *
+   * @return True if joint values that satisfy the constraints were found.  Otherwise false.
+   */
+  virtual bool sample(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts);
+
+  /**
+   * \brief Same as sample(), except that the first attempt starts from the current values of the group
+   */
+  virtual bool project(robot_state::JointStateGroup *jsg,
+                       const robot_state::RobotState &reference_state,
+                       unsigned int max_attempts);
+
+protected:
+
+  virtual void clear();
+
+  bool sampleHelper(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project);
+
+  /**
+   * \brief Move the values of \e jsg towards the pose (\e pos, \e quat) of the constrained link
+   *
+   * @return True if the constraints and the state validity callback are satisfied after some step
+   */
+  bool moveTowards(robot_state::JointStateGroup *jsg, const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat);
+
+  /** \brief Check the constraints and the state validity callback for the current values of \e jsg */
+  bool isSatisfied(robot_state::JointStateGroup *jsg) const;
+
+  random_numbers::RandomNumberGenerator random_number_generator_; /**< \brief Random generator used by the sampler */
+  IKSamplingPose                        sampling_pose_; /**< \brief Holder for the pose used for sampling */
+  const robot_model::LinkModel         *link_; /**< \brief The constrained link */
+  Eigen::Vector3d                       link_offset_; /**< \brief The constrained point, in the frame of \e link_ */
+  unsigned int                          max_iterations_; /**< \brief The maximum number of steps taken towards each sampled pose */
 };
 
 
@@ -0,0 +1,159 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_CONSTRAINT_SAMPLERS_IK_SEED_DATABASE_
+#define MOVEIT_CONSTRAINT_SAMPLERS_IK_SEED_DATABASE_
+
+#include <geometry_msgs/Pose.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <Eigen/Geometry>
+#include <string>
+#include <vector>
+
+namespace constraint_samplers
+{
+
+/**
+ * \brief A database of IK solutions, indexed by the pose of the IK tip
+ * they were found for, used to seed new IK queries for nearby poses.
+ *
+ * The poses are assumed to be in the base frame of the IK solver and
+ * the solutions in the variable order of a single group, so a database
+ * should only be shared by samplers for the same group and solver.
+ * Entries are kept in a grid of cubic cells of size \e cell_size, and
+ * seeds are looked up in the cell of the query and its neighbors.  The
+ * nearest seeds are those with the lowest sum of the distance between
+ * positions and \e orientation_weight times the angle between
+ * orientations.  This class is thread safe.
+ */
+class IKSeedDatabase
+{
+public:
+
+  /**
+   * \brief Constructor
+   *
+   * @param [in] cell_size The size of the grid cells, in meters
+   * @param [in] orientation_weight The weight of the angle between orientations (in radians) relative to the distance between positions
+   * @param [in] max_entries The maximum number of solutions stored; later ones are not added
+   */
+  IKSeedDatabase(double cell_size = 0.05, double orientation_weight = 0.1, std::size_t max_entries = 100000);
+
+  /**
+   * \brief Add the \e solution found for \e pose.  A solution is not
+   * added if there is already one for a pose closer than a tenth of
+   * the cell size and a hundredth of a radian.
+   *
+   * @return True if the solution was added
+   */
+  bool add(const geometry_msgs::Pose &pose, const std::vector<double> &solution);
+
+  /**
+   * \brief Get up to \e count solutions stored for poses near \e pose, nearest first
+   *
+   * @return True if at least one solution was found
+   */
+  bool getNearestSeeds(const geometry_msgs::Pose &pose, std::size_t count, std::vector<std::vector<double> > &seeds) const;
+
+  /** \brief Get the number of solutions stored */
+  std::size_t size() const;
+
+  /** \brief Remove all solutions */
+  void clear();
+
+  /** \brief Write the stored solutions to \e filename.  Returns false if the file could not be written. */
+  bool save(const std::string &filename) const;
+
+  /** \brief Add the solutions stored in \e filename to this database.  Returns false if the file could not be read or is malformed. */
+  bool load(const std::string &filename);
+
+  double getCellSize() const
+  {
+    return cell_size_;
+  }
+
+  double getOrientationWeight() const
+  {
+    return orientation_weight_;
+  }
+
+  std::size_t getMaxEntries() const
+  {
+    return max_entries_;
+  }
+
+private:
+
+  struct Entry
+  {
+    Eigen::Vector3d     position_;
+    double              orientation_[4]; // x, y, z, w; not a quaternion, which would need aligned storage
+    std::vector<double> solution_;
+  };
+
+  typedef boost::tuple<int, int, int> CellKey;
+
+  struct CellKeyHash
+  {
+    std::size_t operator()(const CellKey &key) const;
+  };
+
+  typedef boost::unordered_map<CellKey, std::vector<std::size_t>, CellKeyHash> CellMap;
+
+  CellKey getCellKey(const Eigen::Vector3d &position) const;
+
+  double getAngle(const Entry &entry, const Eigen::Quaterniond &orientation) const;
+
+  double getDistance(const Entry &entry, const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation) const;
+
+  bool addEntry(const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation, const std::vector<double> &solution);
+
+  double               cell_size_;
+  double               orientation_weight_;
+  std::size_t          max_entries_;
+  std::vector<Entry>   entries_;
+  CellMap              cells_;
+  mutable boost::mutex lock_;
+};
+
+typedef boost::shared_ptr<IKSeedDatabase> IKSeedDatabasePtr;
+typedef boost::shared_ptr<const IKSeedDatabase> IKSeedDatabaseConstPtr;
+
+}
+
+#endif
@@ -57,6 +57,19 @@ namespace constraint_samplers
 class UnionConstraintSampler : public ConstraintSampler
 {
 public:
+
+  /** \brief How a member sampler performed in the calls to sample() and project() so far */
+  struct SamplerStatistics
+  {
+    SamplerStatistics() : attempts(0), successes(0), time(0.0)
+    {
+    }
+
+    std::size_t attempts;  /**< \brief The number of times the sampler was called */
+    std::size_t successes; /**< \brief The number of times the sampler produced a sample */
+    double      time;      /**< \brief The total time spent in the sampler, in seconds */
+  };
+
   /**
    * \brief Constructor, which will re-order its internal list of
    * samplers on construction.
@@ -110,6 +123,60 @@ public:
     return samplers_;
   }
 
+  /**
+   * \brief Gets the statistics of the samplers, in the order of getSamplers()
+   */
+  const std::vector<SamplerStatistics>& getSamplerStatistics() const
+  {
+    return statistics_;
+  }
+
+  /** \brief Forget the statistics gathered so far */
+  void resetSamplerStatistics();
+
+  /**
+   * \brief Enable or disable adaptive scheduling of the samplers.
+   *
+   * The order of getSamplers() is only required between samplers that
+   * depend on each other: those whose groups update common links, and
+   * those where one has a frame dependency on a link the other
+   * updates.  With adaptive scheduling, the samplers are called in the
+   * order that respects these dependencies and, among the samplers
+   * that are free to go next, prefers the one with the lowest expected
+   * time spent per failure (the time per attempt divided by the failure
+   * rate seen so far).  Since a sample fails as soon as one sampler
+   * fails, this spends the least time on samples that fail.
+   */
+  void setAdaptiveScheduling(bool flag)
+  {
+    adaptive_ = flag;
+  }
+
+  bool getAdaptiveScheduling() const
+  {
+    return adaptive_;
+  }
+
+  /**
+   * \brief Enable or disable calling independent samplers concurrently.
+   *
+   * When enabled, all the samplers whose dependencies (see
+   * setAdaptiveScheduling()) have been sampled are called at once, each
+   * in its own thread and on its own copy of the state.  The samplers
+   * and their state validity callbacks must then be safe to call from
+   * several threads at once.  This only pays off for samplers that take
+   * long, such as IK based ones.
+   */
+  void setConcurrentSampling(bool flag)
+  {
+    concurrent_ = flag;
+  }
+
+  bool getConcurrentSampling() const
+  {
+    return concurrent_;
+  }
+
   /**
    * \brief No-op, as the union constraint sampler is for already
    * configured samplers
@@ -156,7 +223,20 @@ public:
 
 protected:
 
+  /** \brief Get the groups of samplers to call one after the other; the samplers in a group are called concurrently if
+      concurrent sampling is enabled, and one after the other otherwise */
+  void getSchedule(std::vector<std::vector<std::size_t> > &schedule) const;
+
+  /** \brief The expected time spent in sampler \e index per failure, used by adaptive scheduling */
+  double getSchedulingCost(std::size_t index) const;
+
+  bool sampleHelper(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project);
+
   std::vector<ConstraintSamplerPtr> samplers_; /**< \brief Holder for sorted internal list of samplers*/
+  std::vector<std::vector<std::size_t> > predecessors_; /**< \brief For each sampler, the earlier samplers it depends on */
+  std::vector<SamplerStatistics>    statistics_; /**< \brief The statistics of each sampler */
+  bool                              adaptive_; /**< \brief Whether adaptive scheduling is enabled */
+  bool                              concurrent_; /**< \brief Whether independent samplers are called concurrently */
 };
 
 }
@@ -37,11 +37,64 @@
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
 #include <moveit/constraint_samplers/union_constraint_sampler.h>
+#include <ros/serialization.h>
 #include <sstream>
 
+void constraint_samplers::ConstraintSamplerManager::setSamplerCacheSize(std::size_t max_entries)
+{
+  boost::mutex::scoped_lock slock(sampler_cache_lock_);
+  sampler_cache_size_ = max_entries;
+  while (sampler_cache_.size() > sampler_cache_size_)
+    sampler_cache_.pop_back();
+}
+
+void constraint_samplers::ConstraintSamplerManager::clearSamplerCache()
+{
+  boost::mutex::scoped_lock slock(sampler_cache_lock_);
+  sampler_cache_.clear();
+}
+
 constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSamplerManager::selectSampler(const planning_scene::PlanningSceneConstPtr &scene,
                                                                                                        const std::string &group_name,
                                                                                                        const moveit_msgs::Constraints &constr) const
+{
+  if (sampler_cache_size_ == 0)
+    return allocateSampler(scene, group_name, constr);
+
+  CachedSampler request;
+  request.scene_ = scene.get();
+  request.change_stamp_ = scene->getChangeStamp();
+  request.group_name_ = group_name;
+  request.constraints_.resize(ros::serialization::serializationLength(constr));
+  ros::serialization::OStream stream(&request.constraints_[0], request.constraints_.size());
+  ros::serialization::serialize(stream, constr);
+
+  {
+    boost::mutex::scoped_lock slock(sampler_cache_lock_);
+    for (std::list<CachedSampler>::iterator it = sampler_cache_.begin() ; it != sampler_cache_.end() ; ++it)
+      if (it->scene_ == request.scene_ && it->change_stamp_ == request.change_stamp_ &&
+          it->group_name_ == request.group_name_ && it->constraints_ == request.constraints_)
+      {
+        sampler_cache_.splice(sampler_cache_.begin(), sampler_cache_, it);
+        return sampler_cache_.front().sampler_;
+      }
+  }
+
+  // the lock is not held while allocating, so concurrent identical requests may each allocate a sampler
+  request.sampler_ = allocateSampler(scene, group_name, constr);
+  boost::mutex::scoped_lock slock(sampler_cache_lock_);
+  if (sampler_cache_size_ > 0)
+  {
+    sampler_cache_.push_front(request);
+    while (sampler_cache_.size() > sampler_cache_size_)
+      sampler_cache_.pop_back();
+  }
+  return request.sampler_;
+}
+
+constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSamplerManager::allocateSampler(const planning_scene::PlanningSceneConstPtr &scene,
+                                                                                                         const std::string &group_name,
+                                                                                                         const moveit_msgs::Constraints &constr) const
 {
   for (std::size_t i = 0 ; i < sampler_alloc_.size() ; ++i)
     if (sampler_alloc_[i]->canService(scene, group_name, constr))
@@ -304,6 +357,22 @@ constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSampler
     }
   }
 
+  // without an IK solver for the group, position and orientation constraints can still be sampled by
+  // moving the joints towards poses in the constraint regions
+  if (!ik_alloc && (!constr.position_constraints.empty() || !constr.orientation_constraints.empty()))
+  {
+    boost::shared_ptr<ProjectionConstraintSampler> pcs(new ProjectionConstraintSampler(scene, jmg->getName()));
+    if (pcs->configure(constr))
+    {
+      logDebug("Allocated a projection-based sampler for group '%s' satisfying position and/or orientation constraints on link '%s'",
+               jmg->getName().c_str(), pcs->getLinkName().c_str());
+      if (samplers.empty())
+        return pcs;
+      samplers.push_back(pcs);
+      return ConstraintSamplerPtr(new UnionConstraintSampler(scene, jmg->getName(), samplers));
+    }
+  }
+
   //if we've gotten here, just return joint sampler
   if (joint_sampler)
   {
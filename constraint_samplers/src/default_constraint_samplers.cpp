@@ -36,9 +36,12 @@
 
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
 #include <set>
+#include <algorithm>
 #include <cassert>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 bool constraint_samplers::JointConstraintSampler::configure(const moveit_msgs::Constraints &constr)
 {
@@ -136,6 +139,25 @@ bool constraint_samplers::JointConstraintSampler::configure(const std::vector<ki
       unbounded_.push_back(joints[i]);
       uindex_.push_back(vim.find(joints[i]->getName())->second);
     }
+
+  // precompute the ranges the variables of single DOF joints are drawn from, for sampleBatch()
+  for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
+    if (unbounded_[i]->getType() == robot_model::JointModel::REVOLUTE || unbounded_[i]->getType() == robot_model::JointModel::PRISMATIC)
+    {
+      const std::pair<double, double> &b = unbounded_[i]->getVariableBounds()[0];
+      uniform_index_.push_back(uindex_[i]);
+      uniform_min_.push_back(b.first);
+      uniform_range_.push_back(b.second - b.first);
+    }
+    else
+      joint_sampled_.push_back(i);
+  for (std::size_t i = 0 ; i < bounds_.size() ; ++i)
+  {
+    uniform_index_.push_back(bounds_[i].index_);
+    uniform_min_.push_back(bounds_[i].min_bound_);
+    uniform_range_.push_back(bounds_[i].max_bound_ - bounds_[i].min_bound_);
+  }
+
   values_.resize(jmg_->getVariableCount());
   is_valid_ = true;
   return true;
@@ -158,6 +180,13 @@ bool constraint_samplers::JointConstraintSampler::sample(robot_state::JointState
     return false;
   }
 
+  if (variable_sampler_)
+  {
+    sampleFromVariableSampler(&values_[0]);
+    jsg->setVariableValues(values_);
+    return true;
+  }
+
   // sample the unbounded joints first (in case some joint variables are bounded)
   for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
   {
@@ -177,6 +206,101 @@ bool constraint_samplers::JointConstraintSampler::sample(robot_state::JointState
   return true;
 }
 
+bool constraint_samplers::JointConstraintSampler::sampleBatch(std::size_t count, std::vector<double> &values)
+{
+  if (!is_valid_)
+  {
+    logWarn("JointConstraintSampler not configured, won't sample");
+    return false;
+  }
+
+  const std::size_t n = values_.size();
+  values.resize(count * n);
+  if (count == 0)
+    return true;
+
+  if (variable_sampler_)
+  {
+    for (std::size_t s = 0 ; s < count ; ++s)
+      sampleFromVariableSampler(&values[s * n]);
+    return true;
+  }
+
+  // as in sample(), the unbounded joints come first, so bounds on some of their variables override their values
+  std::vector<double> v;
+  for (std::size_t k = 0 ; k < joint_sampled_.size() ; ++k)
+  {
+    const robot_model::JointModel *jm = unbounded_[joint_sampled_[k]];
+    double *out = &values[uindex_[joint_sampled_[k]]];
+    for (std::size_t s = 0 ; s < count ; ++s, out += n)
+    {
+      v.clear();
+      jm->getVariableRandomValues(random_number_generator_, v);
+      std::copy(v.begin(), v.end(), out);
+    }
+  }
+
+  for (std::size_t k = 0 ; k < uniform_index_.size() ; ++k)
+  {
+    const double lo = uniform_min_[k];
+    const double range = uniform_range_[k];
+    double *out = &values[uniform_index_[k]];
+    for (std::size_t s = 0 ; s < count ; ++s, out += n)
+      *out = lo + range * random_number_generator_.uniform01();
+  }
+  return true;
+}
+
+unsigned int constraint_samplers::JointConstraintSampler::getSampleDimension() const
+{
+  unsigned int dimension = bounds_.size();
+  for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
+    dimension += unbounded_[i]->getStateSpaceDimension();
+  return dimension;
+}
+
+bool constraint_samplers::JointConstraintSampler::setVariableSampler(const robot_model::VariableSamplerPtr &sampler)
+{
+  if (!sampler)
+  {
+    variable_sampler_.reset();
+    return true;
+  }
+  if (!is_valid_)
+  {
+    logWarn("JointConstraintSampler not configured, cannot use a variable sampler");
+    return false;
+  }
+  unsigned int dimension = getSampleDimension();
+  if (sampler->getDimension() < dimension)
+  {
+    logError("JointConstraintSampler for group '%s' needs points with %u coordinates but the sampler produces %u",
+             getGroupName().c_str(), dimension, sampler->getDimension());
+    return false;
+  }
+  variable_sampler_ = sampler;
+  point_.resize(std::max(sampler->getDimension(), 1u));
+  return true;
+}
+
+void constraint_samplers::JointConstraintSampler::sampleFromVariableSampler(double *values)
+{
+  variable_sampler_->sample(&point_[0]);
+  const double *unit = &point_[0];
+
+  // as in sample(), the unbounded joints come first, so bounds on some of their variables override their values
+  std::vector<double> v;
+  for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
+  {
+    v.clear();
+    unbounded_[i]->getVariableValuesFromUnit(unit, v);
+    std::copy(v.begin(), v.end(), values + uindex_[i]);
+    unit += unbounded_[i]->getStateSpaceDimension();
+  }
+  for (std::size_t i = 0 ; i < bounds_.size() ; ++i, ++unit)
+    values[bounds_[i].index_] = bounds_[i].min_bound_ + *unit * (bounds_[i].max_bound_ - bounds_[i].min_bound_);
+}
+
 bool constraint_samplers::JointConstraintSampler::project(robot_state::JointStateGroup *jsg,
                                                           const robot_state::RobotState &reference_state,
                                                           unsigned int max_attempts)
@@ -191,6 +315,12 @@ void constraint_samplers::JointConstraintSampler::clear()
   unbounded_.clear();
   uindex_.clear();
   values_.clear();
+  uniform_index_.clear();
+  uniform_min_.clear();
+  uniform_range_.clear();
+  joint_sampled_.clear();
+  variable_sampler_.reset();
+  point_.clear();
 }
 
 constraint_samplers::IKSamplingPose::IKSamplingPose()
@@ -222,17 +352,51 @@ constraint_samplers::IKSamplingPose::IKSamplingPose(const boost::shared_ptr<kine
 {
 }
 
-void constraint_samplers::IKConstraintSampler::clear()
+namespace constraint_samplers
 {
-  ConstraintSampler::clear();
-  kb_.reset();
-  ik_frame_ = "";
-  transform_ik_ = false;
+namespace
+{
+// choose the constraints to sample for: a position and orientation constraint pair for the same link, or else a
+// position constraint, or else an orientation constraint
+bool getSamplingPose(const moveit_msgs::Constraints &constr, const planning_scene::PlanningSceneConstPtr &scene, IKSamplingPose &sp)
+{
+  for (std::size_t p = 0 ; p < constr.position_constraints.size() ; ++p)
+    for (std::size_t o = 0 ; o < constr.orientation_constraints.size() ; ++o)
+      if (constr.position_constraints[p].link_name == constr.orientation_constraints[o].link_name)
+      {
+        boost::shared_ptr<kinematic_constraints::PositionConstraint> pc(new kinematic_constraints::PositionConstraint(scene->getRobotModel()));
+        boost::shared_ptr<kinematic_constraints::OrientationConstraint> oc(new kinematic_constraints::OrientationConstraint(scene->getRobotModel()));
+        if (pc->configure(constr.position_constraints[p], scene->getTransforms()) && oc->configure(constr.orientation_constraints[o], scene->getTransforms()))
+        {
+          sp = IKSamplingPose(pc, oc);
+          return true;
+        }
+      }
+
+  for (std::size_t p = 0 ; p < constr.position_constraints.size() ; ++p)
+  {
+    boost::shared_ptr<kinematic_constraints::PositionConstraint> pc(new kinematic_constraints::PositionConstraint(scene->getRobotModel()));
+    if (pc->configure(constr.position_constraints[p], scene->getTransforms()))
+    {
+      sp = IKSamplingPose(pc);
+      return true;
+    }
+  }
+
+  for (std::size_t o = 0 ; o < constr.orientation_constraints.size() ; ++o)
+  {
+    boost::shared_ptr<kinematic_constraints::OrientationConstraint> oc(new kinematic_constraints::OrientationConstraint(scene->getRobotModel()));
+    if (oc->configure(constr.orientation_constraints[o], scene->getTransforms()))
+    {
+      sp = IKSamplingPose(oc);
+      return true;
+    }
+  }
+  return false;
 }
 
-bool constraint_samplers::IKConstraintSampler::configure(const IKSamplingPose &sp)
+bool checkSamplingPose(const IKSamplingPose &sp)
 {
-  clear();
   if(!sp.position_constraint_ && !sp.orientation_constraint_) return false;
   if((!sp.orientation_constraint_ && !sp.position_constraint_->enabled()) ||
      (!sp.position_constraint_ && !sp.orientation_constraint_->enabled()) ||
@@ -241,20 +405,116 @@ bool constraint_samplers::IKConstraintSampler::configure(const IKSamplingPose &s
     logWarn("No enabled constraints in sampling pose");
     return false;
   }
-
-  sampling_pose_ = sp;
-  ik_timeout_ = jmg_->getDefaultIKTimeout();
-  if (sampling_pose_.position_constraint_ && sampling_pose_.orientation_constraint_)
-    if (sampling_pose_.position_constraint_->getLinkModel()->getName() != sampling_pose_.orientation_constraint_->getLinkModel()->getName())
+  if (sp.position_constraint_ && sp.orientation_constraint_)
+    if (sp.position_constraint_->getLinkModel()->getName() != sp.orientation_constraint_->getLinkModel()->getName())
     {
       logError("Position and orientation constraints need to be specified for the same link in order to use IK-based sampling");
       return false;
     }
+  return true;
+}
+
+// sample a point in one of the regions of the constraint, in the model frame
+bool samplePosition(const kinematic_constraints::PositionConstraint &pc, const robot_state::RobotState &ks, unsigned int max_attempts,
+                    random_numbers::RandomNumberGenerator &rng, Eigen::Vector3d &pos)
+{
+  const std::vector<bodies::BodyPtr> &b = pc.getConstraintRegions();
+  if (!b.empty())
+  {
+    bool found = false;
+    std::size_t k = rng.uniformInteger(0, b.size() - 1);
+    for (std::size_t i = 0 ; i < b.size() ; ++i)
+      if (b[(i+k) % b.size()]->samplePointInside(rng, max_attempts, pos))
+      {
+        found = true;
+        break;
+      }
+    if (!found)
+    {
+      logError("Unable to sample a point inside the constraint region");
+      return false;
+    }
+  }
+  else
+  {
+    logError("Unable to sample a point inside the constraint region. Constraint region is empty when it should not be.");
+    return false;
+  }
+
+  // if this constraint is with respect a mobile frame, we need to convert this rotation to the root frame of the model
+  if (pc.mobileReferenceFrame())
+    pos = ks.getFrameTransform(pc.getReferenceFrame()) * pos;
+  return true;
+}
+
+// sample an orientation within the tolerances of the constraint, in the model frame
+void sampleOrientation(const kinematic_constraints::OrientationConstraint &oc, const robot_state::RobotState &ks,
+                       random_numbers::RandomNumberGenerator &rng, Eigen::Quaterniond &quat)
+{
+  // sample a rotation matrix within the allowed bounds
+  double angle_x = 2.0 * (rng.uniform01() - 0.5) * (oc.getXAxisTolerance()-std::numeric_limits<double>::epsilon());
+  double angle_y = 2.0 * (rng.uniform01() - 0.5) * (oc.getYAxisTolerance()-std::numeric_limits<double>::epsilon());
+  double angle_z = 2.0 * (rng.uniform01() - 0.5) * (oc.getZAxisTolerance()-std::numeric_limits<double>::epsilon());
+  Eigen::Affine3d diff(Eigen::AngleAxisd(angle_x, Eigen::Vector3d::UnitX())
+                       * Eigen::AngleAxisd(angle_y, Eigen::Vector3d::UnitY())
+                       * Eigen::AngleAxisd(angle_z, Eigen::Vector3d::UnitZ()));
+  Eigen::Affine3d reqr(oc.getDesiredRotationMatrix() * diff.rotation());
+  quat = Eigen::Quaterniond(reqr.rotation());
+
+  // if this constraint is with respect a mobile frame, we need to convert this rotation to the root frame of the model
+  if (oc.mobileReferenceFrame())
+  {
+    const Eigen::Affine3d &t = ks.getFrameTransform(oc.getReferenceFrame());
+    Eigen::Affine3d rt(t.rotation() * quat.toRotationMatrix());
+    quat = Eigen::Quaterniond(rt.rotation());
+  }
+}
+}
+}
+
+void constraint_samplers::IKConstraintSampler::clear()
+{
+  ConstraintSampler::clear();
+  kb_.reset();
+  ik_frame_ = "";
+  transform_ik_ = false;
+}
+
+void constraint_samplers::IKConstraintSampler::setIKThreads(unsigned int num_threads)
+{
+  ik_threads_ = std::max(num_threads, 1u);
+}
+
+void constraint_samplers::IKConstraintSampler::acquireSolvers(std::size_t count, std::vector<kinematics::KinematicsBaseConstPtr> &solvers) const
+{
+  solvers.clear();
+  while (solvers.size() < count)
+  {
+    // the pool of the group hands out the shared instance if it cannot create distinct ones
+    kinematics::KinematicsBaseConstPtr solver = jmg_->acquireSolverInstance();
+    if (!solver || std::find(solvers.begin(), solvers.end(), solver) != solvers.end())
+    {
+      logDebug("IK sampling for group '%s' will use %u thread(s).", jmg_->getName().c_str(), (unsigned int)solvers.size());
+      break;
+    }
+    solvers.push_back(solver);
+  }
+}
+
+bool constraint_samplers::IKConstraintSampler::configure(const IKSamplingPose &sp)
+{
+  clear();
+  if (!checkSamplingPose(sp))
+    return false;
+
+  sampling_pose_ = sp;
+  ik_timeout_ = jmg_->getDefaultIKTimeout();
 
   if (sampling_pose_.position_constraint_ && sampling_pose_.position_constraint_->mobileReferenceFrame())
     frame_depends_.push_back(sampling_pose_.position_constraint_->getReferenceFrame());
   if (sampling_pose_.orientation_constraint_ && sampling_pose_.orientation_constraint_->mobileReferenceFrame())
     frame_depends_.push_back(sampling_pose_.orientation_constraint_->getReferenceFrame());
+  // the shared instance only tells the frames of the solver; IK calls lease instances of their own
   kb_ = jmg_->getSolverInstance();
   if (!kb_)
   {
@@ -268,30 +528,8 @@ bool constraint_samplers::IKConstraintSampler::configure(const IKSamplingPose &s
 
 bool constraint_samplers::IKConstraintSampler::configure(const moveit_msgs::Constraints &constr)
 {
-  for (std::size_t p = 0 ; p < constr.position_constraints.size() ; ++p)
-    for (std::size_t o = 0 ; o < constr.orientation_constraints.size() ; ++o)
-      if (constr.position_constraints[p].link_name == constr.orientation_constraints[o].link_name)
-      {
-        boost::shared_ptr<kinematic_constraints::PositionConstraint> pc(new kinematic_constraints::PositionConstraint(scene_->getRobotModel()));
-        boost::shared_ptr<kinematic_constraints::OrientationConstraint> oc(new kinematic_constraints::OrientationConstraint(scene_->getRobotModel()));
-        if (pc->configure(constr.position_constraints[p], scene_->getTransforms()) && oc->configure(constr.orientation_constraints[o], scene_->getTransforms()))
-          return configure(IKSamplingPose(pc, oc));
-      }
-
-  for (std::size_t p = 0 ; p < constr.position_constraints.size() ; ++p)
-  {
-    boost::shared_ptr<kinematic_constraints::PositionConstraint> pc(new kinematic_constraints::PositionConstraint(scene_->getRobotModel()));
-    if (pc->configure(constr.position_constraints[p], scene_->getTransforms()))
-      return configure(IKSamplingPose(pc));
-  }
-
-  for (std::size_t o = 0 ; o < constr.orientation_constraints.size() ; ++o)
-  {
-    boost::shared_ptr<kinematic_constraints::OrientationConstraint> oc(new kinematic_constraints::OrientationConstraint(scene_->getRobotModel()));
-    if (oc->configure(constr.orientation_constraints[o], scene_->getTransforms()))
-        return configure(IKSamplingPose(oc));
-  }
-  return false;
+  IKSamplingPose sp;
+  return getSamplingPose(constr, scene_, sp) && configure(sp);
 }
 
 double constraint_samplers::IKConstraintSampler::getSamplingVolume() const
@@ -361,35 +599,19 @@ bool constraint_samplers::IKConstraintSampler::loadIKSolver()
 bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat,
                                                           const robot_state::RobotState &ks,
                                                           unsigned int max_attempts)
+{
+  return samplePose(pos, quat, ks, max_attempts, random_number_generator_);
+}
+
+bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat,
+                                                          const robot_state::RobotState &ks,
+                                                          unsigned int max_attempts,
+                                                          random_numbers::RandomNumberGenerator &rng)
 {
   if (sampling_pose_.position_constraint_)
   {
-    const std::vector<bodies::BodyPtr> &b = sampling_pose_.position_constraint_->getConstraintRegions();
-    if (!b.empty())
-    {
-      bool found = false;
-      std::size_t k = random_number_generator_.uniformInteger(0, b.size() - 1);
-      for (std::size_t i = 0 ; i < b.size() ; ++i)
-        if (b[(i+k) % b.size()]->samplePointInside(random_number_generator_, max_attempts, pos))
-        {
-          found = true;
-          break;
-        }
-      if (!found)
-      {
-        logError("Unable to sample a point inside the constraint region");
-        return false;
-      }
-    }
-    else
-    {
-      logError("Unable to sample a point inside the constraint region. Constraint region is empty when it should not be.");
+    if (!samplePosition(*sampling_pose_.position_constraint_, ks, max_attempts, rng, pos))
       return false;
-    }
-
-    // if this constraint is with respect a mobile frame, we need to convert this rotation to the root frame of the model
-    if (sampling_pose_.position_constraint_->mobileReferenceFrame())
-      pos = ks.getFrameTransform(sampling_pose_.position_constraint_->getReferenceFrame()) * pos;
   }
   else
   {
@@ -398,7 +620,9 @@ bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos,
     robot_state::JointStateGroup *tmp = tempState.getJointStateGroup(jmg_->getName());
     if (tmp)
     {
-      tmp->setToRandomValues();
+      std::vector<double> values;
+      jmg_->getVariableRandomValues(rng, values);
+      tmp->setVariableValues(values);
       pos = tempState.getLinkState(sampling_pose_.orientation_constraint_->getLinkModel()->getName())->getGlobalLinkTransform().translation();
     }
     else
@@ -409,30 +633,12 @@ bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos,
   }
 
   if (sampling_pose_.orientation_constraint_)
-  {
-    // sample a rotation matrix within the allowed bounds
-    double angle_x = 2.0 * (random_number_generator_.uniform01() - 0.5) * (sampling_pose_.orientation_constraint_->getXAxisTolerance()-std::numeric_limits<double>::epsilon());
-    double angle_y = 2.0 * (random_number_generator_.uniform01() - 0.5) * (sampling_pose_.orientation_constraint_->getYAxisTolerance()-std::numeric_limits<double>::epsilon());
-    double angle_z = 2.0 * (random_number_generator_.uniform01() - 0.5) * (sampling_pose_.orientation_constraint_->getZAxisTolerance()-std::numeric_limits<double>::epsilon());
-    Eigen::Affine3d diff(Eigen::AngleAxisd(angle_x, Eigen::Vector3d::UnitX())
-                         * Eigen::AngleAxisd(angle_y, Eigen::Vector3d::UnitY())
-                         * Eigen::AngleAxisd(angle_z, Eigen::Vector3d::UnitZ()));
-    Eigen::Affine3d reqr(sampling_pose_.orientation_constraint_->getDesiredRotationMatrix() * diff.rotation());
-    quat = Eigen::Quaterniond(reqr.rotation());
-
-    // if this constraint is with respect a mobile frame, we need to convert this rotation to the root frame of the model
-    if (sampling_pose_.orientation_constraint_->mobileReferenceFrame())
-    {
-      const Eigen::Affine3d &t = ks.getFrameTransform(sampling_pose_.orientation_constraint_->getReferenceFrame());
-      Eigen::Affine3d rt(t.rotation() * quat.toRotationMatrix());
-      quat = Eigen::Quaterniond(rt.rotation());
-    }
-  }
+    sampleOrientation(*sampling_pose_.orientation_constraint_, ks, rng, quat);
   else
   {
     // sample a random orientation
     double q[4];
-    random_number_generator_.quaternion(q);
+    rng.quaternion(q);
     quat = Eigen::Quaterniond(q[3], q[0], q[1], q[2]);
   }
 
@@ -473,6 +679,38 @@ void samplingIkCallbackFnAdapter(robot_state::JointStateGroup *jsg, const robot_
     error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
 }
 }
+
+struct IKConstraintSampler::ParallelSearch
+{
+  ParallelSearch() : next_attempt_(0), found_(false), failed_(false)
+  {
+  }
+
+  bool stopped()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    return found_ || failed_;
+  }
+
+  boost::mutex        lock_;
+  unsigned int        next_attempt_; // the index of the next attempt a thread may start
+  bool                found_; // a thread found a solution, which is in solution_
+  bool                failed_; // a thread was unable to sample a pose, so the search fails
+  std::vector<double> solution_;
+};
+
+namespace
+{
+// reject the solutions found after the search is over, so the solver does not spend time validating them
+void parallelIkCallbackFnAdapter(const boost::function<bool()> &stopped, const kinematics::KinematicsBase::IKCallbackFn &callback,
+                                 const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_sol, moveit_msgs::MoveItErrorCodes &error_code)
+{
+  if (stopped())
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+  else
+    callback(ik_pose, ik_sol, error_code);
+}
+}
 }
 
 bool constraint_samplers::IKConstraintSampler::sample(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts)
@@ -492,6 +730,17 @@ bool constraint_samplers::IKConstraintSampler::sampleHelper(robot_state::JointSt
     return false;
   }
 
+  // solver instances are leased from the group for the duration of the call only
+  std::vector<kinematics::KinematicsBaseConstPtr> solvers;
+  acquireSolvers(std::min<std::size_t>(ik_threads_, std::max(max_attempts, 1u)), solvers);
+  if (solvers.empty())
+  {
+    logError("No IK solver");
+    return false;
+  }
+  if (solvers.size() > 1)
+    return sampleParallel(jsg, ks, max_attempts, project, solvers);
+
   kinematics::KinematicsBase::IKCallbackFn adapted_ik_validity_callback;
   if (state_validity_callback_)
     adapted_ik_validity_callback = boost::bind(&samplingIkCallbackFnAdapter, jsg, state_validity_callback_, _1, _2, _3);
@@ -517,12 +766,88 @@ bool constraint_samplers::IKConstraintSampler::sampleHelper(robot_state::JointSt
     ik_query.orientation.z = quat.z();
     ik_query.orientation.w = quat.w();
 
-    if (callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, jsg, project && a == 0))
+    if (callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, jsg, project && a == 0, *solvers[0], random_number_generator_))
       return true;
   }
   return false;
 }
 
+bool constraint_samplers::IKConstraintSampler::sampleParallel(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project,
+                                                              const std::vector<kinematics::KinematicsBaseConstPtr> &solvers)
+{
+  ParallelSearch search;
+  std::size_t num_threads = std::min<std::size_t>(solvers.size(), max_attempts);
+  std::vector<robot_state::RobotStatePtr> states(num_threads);
+  boost::thread_group threads;
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+  {
+    states[t].reset(new robot_state::RobotState(*jsg->getRobotState()));
+    threads.create_thread(boost::bind(&IKConstraintSampler::sampleThread, this, states[t]->getJointStateGroup(jsg->getName()), boost::cref(ks),
+                                      max_attempts, project, solvers[t], &search));
+  }
+  threads.join_all();
+
+  if (!search.found_)
+    return false;
+  jsg->setVariableValues(search.solution_);
+  return true;
+}
+
+void constraint_samplers::IKConstraintSampler::sampleThread(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project,
+                                                            const kinematics::KinematicsBaseConstPtr &solver, ParallelSearch *search)
+{
+  random_numbers::RandomNumberGenerator rng;
+
+  // without a validity callback, the search only stops between IK calls
+  kinematics::KinematicsBase::IKCallbackFn parallel_ik_callback;
+  if (state_validity_callback_)
+    parallel_ik_callback = boost::bind(&parallelIkCallbackFnAdapter, boost::function<bool()>(boost::bind(&ParallelSearch::stopped, search)),
+                                       kinematics::KinematicsBase::IKCallbackFn(boost::bind(&samplingIkCallbackFnAdapter, jsg, state_validity_callback_, _1, _2, _3)),
+                                       _1, _2, _3);
+
+  while (true)
+  {
+    unsigned int a;
+    {
+      boost::mutex::scoped_lock slock(search->lock_);
+      if (search->found_ || search->failed_ || search->next_attempt_ >= max_attempts)
+        return;
+      a = search->next_attempt_++;
+    }
+
+    Eigen::Vector3d point;
+    Eigen::Quaterniond quat;
+    if (!samplePose(point, quat, ks, max_attempts, rng))
+    {
+      if (verbose_)
+        logInform("IK constraint sampler was unable to produce a pose to run IK for");
+      boost::mutex::scoped_lock slock(search->lock_);
+      search->failed_ = true;
+      return;
+    }
+
+    geometry_msgs::Pose ik_query;
+    ik_query.position.x = point.x();
+    ik_query.position.y = point.y();
+    ik_query.position.z = point.z();
+    ik_query.orientation.x = quat.x();
+    ik_query.orientation.y = quat.y();
+    ik_query.orientation.z = quat.z();
+    ik_query.orientation.w = quat.w();
+
+    if (callIK(ik_query, parallel_ik_callback, ik_timeout_, jsg, project && a == 0, *solver, rng))
+    {
+      boost::mutex::scoped_lock slock(search->lock_);
+      if (!search->found_)
+      {
+        search->found_ = true;
+        jsg->getVariableValues(search->solution_);
+      }
+      return;
+    }
+  }
+}
+
 bool constraint_samplers::IKConstraintSampler::project(robot_state::JointStateGroup *jsg,
                                                        const robot_state::RobotState &reference_state,
                                                        unsigned int max_attempts)
@@ -532,6 +857,14 @@ bool constraint_samplers::IKConstraintSampler::project(robot_state::JointStateGr
 
 bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
                                                       double timeout, robot_state::JointStateGroup *jsg, bool use_as_seed)
+{
+  kinematics::KinematicsBaseConstPtr solver = jmg_->acquireSolverInstance();
+  return solver && callIK(ik_query, adapted_ik_validity_callback, timeout, jsg, use_as_seed, *solver, random_number_generator_);
+}
+
+bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
+                                                      double timeout, robot_state::JointStateGroup *jsg, bool use_as_seed,
+                                                      const kinematics::KinematicsBase &solver, random_numbers::RandomNumberGenerator &rng)
 {
   const std::vector<unsigned int>& ik_joint_bijection = jmg_->getKinematicsSolverJointBijection();
   std::vector<double> seed(ik_joint_bijection.size(), 0.0);
@@ -540,8 +873,20 @@ bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose
   if (use_as_seed)
     jsg->getVariableValues(vals);
   else
-    // sample a seed value
-    jmg_->getVariableRandomValues(random_number_generator_, vals);
+  {
+    // choose among the solutions for the nearest poses and a random value, so a seed that does not lead to a valid
+    // solution does not get used for every attempt
+    std::vector<std::vector<double> > seeds;
+    if (seed_database_ && seed_database_->getNearestSeeds(ik_query, 3, seeds))
+    {
+      std::size_t k = rng.uniformInteger(0, seeds.size());
+      if (k < seeds.size() && seeds[k].size() == ik_joint_bijection.size())
+        vals = seeds[k];
+    }
+    if (vals.empty())
+      // sample a seed value
+      jmg_->getVariableRandomValues(rng, vals);
+  }
 
   assert(vals.size() == ik_joint_bijection.size());
   for (std::size_t i = 0 ; i < ik_joint_bijection.size() ; ++i)
@@ -551,14 +896,16 @@ bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose
   moveit_msgs::MoveItErrorCodes error;
 
   if (adapted_ik_validity_callback ?
-      kb_->searchPositionIK(ik_query, seed, timeout, ik_sol, adapted_ik_validity_callback, error) :
-      kb_->searchPositionIK(ik_query, seed, timeout, ik_sol, error))
+      solver.searchPositionIK(ik_query, seed, timeout, ik_sol, adapted_ik_validity_callback, error) :
+      solver.searchPositionIK(ik_query, seed, timeout, ik_sol, error))
   {
     assert(ik_sol.size() == ik_joint_bijection.size());
     std::vector<double> solution(ik_joint_bijection.size());
     for (std::size_t i = 0 ; i < ik_joint_bijection.size() ; ++i)
       solution[i] = ik_sol[ik_joint_bijection[i]];
     jsg->setVariableValues(solution);
+    if (seed_database_)
+      seed_database_->add(ik_query, solution);
 
     assert(!sampling_pose_.orientation_constraint_ || sampling_pose_.orientation_constraint_->decide(*jsg->getRobotState(), verbose_).satisfied);
     assert(!sampling_pose_.position_constraint_ || sampling_pose_.position_constraint_->decide(*jsg->getRobotState(), verbose_).satisfied);
@@ -577,3 +924,172 @@ bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose
   }
   return false;
 }
+
+void constraint_samplers::ProjectionConstraintSampler::clear()
+{
+  ConstraintSampler::clear();
+  sampling_pose_ = IKSamplingPose();
+  link_ = NULL;
+  link_offset_ = Eigen::Vector3d::Zero();
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::configure(const moveit_msgs::Constraints &constr)
+{
+  IKSamplingPose sp;
+  return getSamplingPose(constr, scene_, sp) && configure(sp);
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::configure(const IKSamplingPose &sp)
+{
+  clear();
+  if (!checkSamplingPose(sp))
+    return false;
+
+  sampling_pose_ = sp;
+  link_ = sp.position_constraint_ ? sp.position_constraint_->getLinkModel() : sp.orientation_constraint_->getLinkModel();
+  if (sp.position_constraint_ && sp.position_constraint_->hasLinkOffset())
+    link_offset_ = sp.position_constraint_->getLinkOffset();
+
+  if (!jmg_->isChain())
+  {
+    logWarn("Projection-based sampling needs the Jacobian of group '%s', but the group is not a chain", jmg_->getName().c_str());
+    return false;
+  }
+  if (!jmg_->isLinkUpdated(link_->getName()))
+  {
+    logWarn("Link '%s' is not updated by group '%s'. Cannot use projection-based sampling", link_->getName().c_str(), jmg_->getName().c_str());
+    return false;
+  }
+
+  if (sampling_pose_.position_constraint_ && sampling_pose_.position_constraint_->mobileReferenceFrame())
+    frame_depends_.push_back(sampling_pose_.position_constraint_->getReferenceFrame());
+  if (sampling_pose_.orientation_constraint_ && sampling_pose_.orientation_constraint_->mobileReferenceFrame())
+    frame_depends_.push_back(sampling_pose_.orientation_constraint_->getReferenceFrame());
+  is_valid_ = true;
+  return true;
+}
+
+const std::string& constraint_samplers::ProjectionConstraintSampler::getLinkName() const
+{
+  return link_->getName();
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::sample(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts)
+{
+  return sampleHelper(jsg, ks, max_attempts, false);
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::project(robot_state::JointStateGroup *jsg,
+                                                               const robot_state::RobotState &reference_state,
+                                                               unsigned int max_attempts)
+{
+  return sampleHelper(jsg, reference_state, max_attempts, true);
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::sampleHelper(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks,
+                                                                    unsigned int max_attempts, bool project)
+{
+  if (!is_valid_)
+    return false;
+
+  if (jsg->getName() != getGroupName())
+  {
+    logWarn("ProjectionConstraintSampler sample function called with name %s which is not the group %s for which it was configured",
+            jsg->getName().c_str(), getGroupName().c_str());
+    return false;
+  }
+
+  for (unsigned int a = 0 ; a < max_attempts ; ++a)
+  {
+    if (!project || a > 0)
+      jsg->setToRandomValues();
+
+    // the target of the constraint that is not specified is ignored by moveTowards()
+    Eigen::Vector3d pos = Eigen::Vector3d::Zero();
+    Eigen::Quaterniond quat = Eigen::Quaterniond::Identity();
+    if (sampling_pose_.position_constraint_ && !samplePosition(*sampling_pose_.position_constraint_, ks, max_attempts, random_number_generator_, pos))
+    {
+      if (verbose_)
+        logInform("Projection constraint sampler was unable to produce a pose to move towards");
+      return false;
+    }
+    if (sampling_pose_.orientation_constraint_)
+      sampleOrientation(*sampling_pose_.orientation_constraint_, ks, random_number_generator_, quat);
+
+    if (moveTowards(jsg, pos, quat))
+      return true;
+  }
+  return false;
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::isSatisfied(robot_state::JointStateGroup *jsg) const
+{
+  const robot_state::RobotState &state = *jsg->getRobotState();
+  if (sampling_pose_.position_constraint_ && !sampling_pose_.position_constraint_->decide(state, verbose_).satisfied)
+    return false;
+  if (sampling_pose_.orientation_constraint_ && !sampling_pose_.orientation_constraint_->decide(state, verbose_).satisfied)
+    return false;
+  if (state_validity_callback_)
+  {
+    std::vector<double> values;
+    jsg->getVariableValues(values);
+    return state_validity_callback_(jsg, values);
+  }
+  return true;
+}
+
+bool constraint_samplers::ProjectionConstraintSampler::moveTowards(robot_state::JointStateGroup *jsg, const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat)
+{
+  // damping of the least-squares steps, so the steps stay bounded near singularities
+  static const double damping = 1e-2;
+  // the largest change of the joint values (in norm) of a single step
+  static const double max_step = 0.5;
+
+  const bool use_position = sampling_pose_.position_constraint_;
+  const bool use_orientation = sampling_pose_.orientation_constraint_;
+  const unsigned int rows = (use_position ? 3 : 0) + (use_orientation ? 3 : 0);
+
+  // getJacobian() expresses the Jacobian in the frame of the parent link of the chain
+  const robot_model::LinkModel *reference_link = jmg_->getJacobianReferenceLink();
+  const robot_state::LinkState *link_state = jsg->getRobotState()->getLinkState(link_);
+
+  Eigen::MatrixXd jacobian;
+  Eigen::MatrixXd task(rows, jsg->getVariableCount());
+  Eigen::VectorXd error(rows);
+  for (unsigned int i = 0 ; i < max_iterations_ ; ++i)
+  {
+    if (isSatisfied(jsg))
+      return true;
+
+    const robot_state::LinkState *reference_state = reference_link ? jsg->getRobotState()->getLinkState(reference_link) : NULL;
+    const Eigen::Matrix3d reference_rotation = reference_state ? reference_state->getGlobalLinkTransform().rotation() :
+      jsg->getRobotState()->getRootTransform().rotation();
+    if (!jsg->getJacobian(link_, link_offset_, jacobian))
+      return false;
+
+    // the errors are expressed in the frame of the Jacobian
+    const Eigen::Affine3d &link_transform = link_state->getGlobalLinkTransform();
+    unsigned int row = 0;
+    if (use_position)
+    {
+      error.segment<3>(row) = reference_rotation.transpose() * (pos - link_transform * link_offset_);
+      task.block(row, 0, 3, task.cols()) = jacobian.topRows(3);
+      row += 3;
+    }
+    if (use_orientation)
+    {
+      Eigen::AngleAxisd diff(quat.toRotationMatrix() * link_transform.rotation().transpose());
+      error.segment<3>(row) = reference_rotation.transpose() * (diff.angle() * diff.axis());
+      task.block(row, 0, 3, task.cols()) = jacobian.bottomRows(3);
+    }
+
+    Eigen::MatrixXd jjt = task * task.transpose();
+    jjt.diagonal().array() += damping * damping;
+    Eigen::VectorXd qdot = task.transpose() * jjt.ldlt().solve(error);
+    double norm = qdot.norm();
+    if (norm > max_step)
+      qdot *= max_step / norm;
+    jsg->integrateJointVelocity(qdot, 1.0);
+  }
+  return isSatisfied(jsg);
+}
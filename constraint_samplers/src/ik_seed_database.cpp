@@ -0,0 +1,253 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/constraint_samplers/ik_seed_database.h>
+#include <boost/functional/hash.hpp>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <cmath>
+
+namespace constraint_samplers
+{
+namespace
+{
+const std::string IK_SEED_DATABASE_HEADER = "moveit_ik_seed_database 1";
+
+Eigen::Quaterniond poseOrientation(const geometry_msgs::Pose &pose)
+{
+  Eigen::Quaterniond q(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z);
+  double n = q.norm();
+  if (n < std::numeric_limits<double>::epsilon())
+    return Eigen::Quaterniond::Identity();
+  q.coeffs() /= n;
+  return q;
+}
+
+bool closerSeed(const std::pair<double, std::size_t> &a, const std::pair<double, std::size_t> &b)
+{
+  return a.first < b.first;
+}
+
+// the number of characters left to read from \e in
+std::size_t remainingChars(std::istream &in)
+{
+  std::istream::pos_type pos = in.tellg();
+  in.seekg(0, std::ios::end);
+  std::istream::pos_type end = in.tellg();
+  in.seekg(pos);
+  return pos >= 0 && end > pos ? (std::size_t)(end - pos) : 0;
+}
+}
+}
+
+std::size_t constraint_samplers::IKSeedDatabase::CellKeyHash::operator()(const CellKey &key) const
+{
+  std::size_t seed = 0;
+  boost::hash_combine(seed, key.get<0>());
+  boost::hash_combine(seed, key.get<1>());
+  boost::hash_combine(seed, key.get<2>());
+  return seed;
+}
+
+constraint_samplers::IKSeedDatabase::IKSeedDatabase(double cell_size, double orientation_weight, std::size_t max_entries) :
+  cell_size_(cell_size > 0.0 ? cell_size : 0.05), orientation_weight_(orientation_weight), max_entries_(max_entries)
+{
+}
+
+constraint_samplers::IKSeedDatabase::CellKey constraint_samplers::IKSeedDatabase::getCellKey(const Eigen::Vector3d &position) const
+{
+  return CellKey((int)floor(position.x() / cell_size_), (int)floor(position.y() / cell_size_), (int)floor(position.z() / cell_size_));
+}
+
+double constraint_samplers::IKSeedDatabase::getAngle(const Entry &entry, const Eigen::Quaterniond &orientation) const
+{
+  // q and -q are the same orientation
+  double dot = fabs(entry.orientation_[0] * orientation.x() + entry.orientation_[1] * orientation.y() +
+                    entry.orientation_[2] * orientation.z() + entry.orientation_[3] * orientation.w());
+  return 2.0 * acos(std::min(dot, 1.0));
+}
+
+double constraint_samplers::IKSeedDatabase::getDistance(const Entry &entry, const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation) const
+{
+  return (entry.position_ - position).norm() + orientation_weight_ * getAngle(entry, orientation);
+}
+
+bool constraint_samplers::IKSeedDatabase::addEntry(const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation, const std::vector<double> &solution)
+{
+  if (entries_.size() >= max_entries_)
+    return false;
+
+  std::vector<std::size_t> &cell = cells_[getCellKey(position)];
+  for (std::size_t i = 0 ; i < cell.size() ; ++i)
+    if ((entries_[cell[i]].position_ - position).norm() < cell_size_ / 10.0 && getAngle(entries_[cell[i]], orientation) < 0.01)
+      return false;
+
+  Entry e;
+  e.position_ = position;
+  e.orientation_[0] = orientation.x();
+  e.orientation_[1] = orientation.y();
+  e.orientation_[2] = orientation.z();
+  e.orientation_[3] = orientation.w();
+  e.solution_ = solution;
+  cell.push_back(entries_.size());
+  entries_.push_back(e);
+  return true;
+}
+
+bool constraint_samplers::IKSeedDatabase::add(const geometry_msgs::Pose &pose, const std::vector<double> &solution)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return addEntry(Eigen::Vector3d(pose.position.x, pose.position.y, pose.position.z), poseOrientation(pose), solution);
+}
+
+bool constraint_samplers::IKSeedDatabase::getNearestSeeds(const geometry_msgs::Pose &pose, std::size_t count, std::vector<std::vector<double> > &seeds) const
+{
+  seeds.clear();
+  Eigen::Vector3d position(pose.position.x, pose.position.y, pose.position.z);
+  Eigen::Quaterniond orientation = poseOrientation(pose);
+
+  boost::mutex::scoped_lock slock(lock_);
+  CellKey key = getCellKey(position);
+  std::vector<std::pair<double, std::size_t> > candidates;
+  for (int dx = -1 ; dx <= 1 ; ++dx)
+    for (int dy = -1 ; dy <= 1 ; ++dy)
+      for (int dz = -1 ; dz <= 1 ; ++dz)
+      {
+        CellMap::const_iterator it = cells_.find(CellKey(key.get<0>() + dx, key.get<1>() + dy, key.get<2>() + dz));
+        if (it == cells_.end())
+          continue;
+        for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+          candidates.push_back(std::make_pair(getDistance(entries_[it->second[i]], position, orientation), it->second[i]));
+      }
+
+  count = std::min(count, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), &closerSeed);
+  for (std::size_t i = 0 ; i < count ; ++i)
+    seeds.push_back(entries_[candidates[i].second].solution_);
+  return !seeds.empty();
+}
+
+std::size_t constraint_samplers::IKSeedDatabase::size() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return entries_.size();
+}
+
+void constraint_samplers::IKSeedDatabase::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  entries_.clear();
+  cells_.clear();
+}
+
+bool constraint_samplers::IKSeedDatabase::save(const std::string &filename) const
+{
+  std::ofstream out(filename.c_str());
+  if (!out.good())
+  {
+    logError("Unable to open '%s' for writing the IK seed database", filename.c_str());
+    return false;
+  }
+  out.precision(std::numeric_limits<double>::digits10 + 2);
+
+  boost::mutex::scoped_lock slock(lock_);
+  out << IK_SEED_DATABASE_HEADER << std::endl << entries_.size() << std::endl;
+  for (std::size_t i = 0 ; i < entries_.size() ; ++i)
+  {
+    const Entry &e = entries_[i];
+    out << e.position_.x() << " " << e.position_.y() << " " << e.position_.z() << " "
+        << e.orientation_[0] << " " << e.orientation_[1] << " " << e.orientation_[2] << " " << e.orientation_[3] << " "
+        << e.solution_.size();
+    for (std::size_t j = 0 ; j < e.solution_.size() ; ++j)
+      out << " " << e.solution_[j];
+    out << std::endl;
+  }
+  return out.good();
+}
+
+bool constraint_samplers::IKSeedDatabase::load(const std::string &filename)
+{
+  std::ifstream in(filename.c_str());
+  if (!in.good())
+  {
+    logError("Unable to open '%s' for reading the IK seed database", filename.c_str());
+    return false;
+  }
+
+  std::string header;
+  std::getline(in, header);
+  if (header != IK_SEED_DATABASE_HEADER)
+  {
+    logError("'%s' is not an IK seed database", filename.c_str());
+    return false;
+  }
+
+  // every number takes at least one digit and a separator, so an entry takes at least 16 characters and each value of
+  // its solution 2 more; corrupt counts are rejected before anything is allocated for them
+  std::size_t count = 0;
+  in >> count;
+  if (in.fail() || count > remainingChars(in) / 16)
+  {
+    logError("The IK seed database in '%s' has an invalid entry count", filename.c_str());
+    return false;
+  }
+  boost::mutex::scoped_lock slock(lock_);
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    double v[7];
+    std::size_t n = 0;
+    for (int k = 0 ; k < 7 ; ++k)
+      in >> v[k];
+    in >> n;
+    if (in.fail() || n > remainingChars(in) / 2)
+    {
+      logError("The IK seed database in '%s' is malformed after %u entries", filename.c_str(), (unsigned int)i);
+      return false;
+    }
+    std::vector<double> solution(n);
+    for (std::size_t j = 0 ; j < n ; ++j)
+      in >> solution[j];
+    if (in.fail())
+    {
+      logError("The IK seed database in '%s' is malformed after %u entries", filename.c_str(), (unsigned int)i);
+      return false;
+    }
+    Eigen::Quaterniond q(v[6], v[3], v[4], v[5]);
+    q.normalize();
+    addEntry(Eigen::Vector3d(v[0], v[1], v[2]), q, solution);
+  }
+  return true;
+}
@@ -36,6 +36,11 @@
 
 #include <moveit/constraint_samplers/union_constraint_sampler.h>
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
+#include <ros/time.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <algorithm>
 
 namespace constraint_samplers
@@ -103,15 +108,51 @@ struct OrderSamplers
     return (a->getJointModelGroup()->getName() < b->getJointModelGroup()->getName());
   }
 };
+
+// whether the order of samplers a and b matters
+static bool samplersDependOnEachOther(const ConstraintSamplerPtr &a, const ConstraintSamplerPtr &b)
+{
+  const std::vector<std::string> &alinks = a->getJointModelGroup()->getUpdatedLinkModelNames();
+  const std::vector<std::string> &blinks = b->getJointModelGroup()->getUpdatedLinkModelNames();
+  std::set<std::string> a_updates(alinks.begin(), alinks.end());
+  for (std::size_t i = 0 ; i < blinks.size() ; ++i)
+    if (a_updates.find(blinks[i]) != a_updates.end())
+      return true;
+  const std::vector<std::string> &fdb = b->getFrameDependency();
+  for (std::size_t i = 0 ; i < fdb.size() ; ++i)
+    if (a_updates.find(fdb[i]) != a_updates.end())
+      return true;
+  std::set<std::string> b_updates(blinks.begin(), blinks.end());
+  const std::vector<std::string> &fda = a->getFrameDependency();
+  for (std::size_t i = 0 ; i < fda.size() ; ++i)
+    if (b_updates.find(fda[i]) != b_updates.end())
+      return true;
+  return false;
+}
+
+static void callSampler(const ConstraintSamplerPtr &sampler, robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks,
+                        unsigned int max_attempts, bool project, bool *result, double *duration)
+{
+  ros::WallTime start = ros::WallTime::now();
+  *result = project ? sampler->project(jsg, ks, max_attempts) : sampler->sample(jsg, ks, max_attempts);
+  *duration = (ros::WallTime::now() - start).toSec();
+}
 }
 
 constraint_samplers::UnionConstraintSampler::UnionConstraintSampler(const planning_scene::PlanningSceneConstPtr &scene, const std::string &group_name,
                                                                     const std::vector<ConstraintSamplerPtr> &samplers) :
-  ConstraintSampler(scene, group_name), samplers_(samplers)
+  ConstraintSampler(scene, group_name), samplers_(samplers), adaptive_(false), concurrent_(false)
 {
   // using stable sort to preserve order of equivalents
   std::stable_sort(samplers_.begin(), samplers_.end(), OrderSamplers());
 
+  statistics_.resize(samplers_.size());
+  predecessors_.resize(samplers_.size());
+  for (std::size_t i = 0 ; i < samplers_.size() ; ++i)
+    for (std::size_t j = 0 ; j < i ; ++j)
+      if (samplersDependOnEachOther(samplers_[j], samplers_[i]))
+        predecessors_[i].push_back(j);
+
   for (std::size_t i = 0 ; i < samplers_.size() ; ++i)
   {
     const std::vector<std::string> &fd = samplers_[i]->getFrameDependency();
@@ -122,62 +163,159 @@ constraint_samplers::UnionConstraintSampler::UnionConstraintSampler(const planni
   }
 }
 
-bool constraint_samplers::UnionConstraintSampler::sample(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts)
+void constraint_samplers::UnionConstraintSampler::resetSamplerStatistics()
 {
-  jsg->setToRandomValues();
+  statistics_.assign(samplers_.size(), SamplerStatistics());
+}
+
+double constraint_samplers::UnionConstraintSampler::getSchedulingCost(std::size_t index) const
+{
+  const SamplerStatistics &st = statistics_[index];
+  // the success rate is estimated as if there was one success and one failure more, so it is never 0 or 1
+  double failure = (st.attempts - st.successes + 1.0) / (st.attempts + 2.0);
+  double time = st.attempts > 0 ? st.time / st.attempts : 0.0;
+  return time / failure;
+}
 
-  if (samplers_.size() >= 1)
+void constraint_samplers::UnionConstraintSampler::getSchedule(std::vector<std::vector<std::size_t> > &schedule) const
+{
+  schedule.clear();
+  if (!adaptive_ && !concurrent_)
   {
-    if (!samplers_[0]->sample(jsg->getRobotState()->getJointStateGroup(samplers_[0]->getJointModelGroup()->getName()), ks, max_attempts))
-      return false;
+    for (std::size_t i = 0 ; i < samplers_.size() ; ++i)
+      schedule.push_back(std::vector<std::size_t>(1, i));
+    return;
   }
 
-  if (samplers_.size() > 1)
+  std::vector<bool> scheduled(samplers_.size(), false);
+  std::size_t remaining = samplers_.size();
+  while (remaining > 0)
   {
-    robot_state::RobotState temp = ks;
-    *(temp.getJointStateGroup(jsg->getName())) = *jsg;
+    // the samplers whose dependencies have all been scheduled earlier
+    std::vector<std::size_t> ready;
+    for (std::size_t i = 0 ; i < samplers_.size() ; ++i)
+      if (!scheduled[i])
+      {
+        bool free = true;
+        for (std::size_t j = 0 ; j < predecessors_[i].size() && free ; ++j)
+          free = scheduled[predecessors_[i][j]];
+        if (free)
+          ready.push_back(i);
+      }
 
-    for (std::size_t i = 1 ; i < samplers_.size() ; ++i)
+    if (concurrent_)
+    {
+      for (std::size_t k = 0 ; k < ready.size() ; ++k)
+        scheduled[ready[k]] = true;
+      remaining -= ready.size();
+      schedule.push_back(ready);
+    }
+    else
     {
-      robot_state::JointStateGroup *x = jsg->getRobotState()->getJointStateGroup(samplers_[i]->getJointModelGroup()->getName());
-      if (samplers_[i]->sample(x, temp, max_attempts))
+      std::size_t best = ready[0];
+      double best_cost = getSchedulingCost(best);
+      for (std::size_t k = 1 ; k < ready.size() ; ++k)
       {
-        if (i + 1 < samplers_.size())
-          *(temp.getJointStateGroup(samplers_[i]->getJointModelGroup()->getName())) = *x;
+        double cost = getSchedulingCost(ready[k]);
+        if (cost < best_cost)
+        {
+          best = ready[k];
+          best_cost = cost;
+        }
       }
-      else
-        return false;
+      scheduled[best] = true;
+      --remaining;
+      schedule.push_back(std::vector<std::size_t>(1, best));
     }
   }
-
-  return true;
 }
 
-bool constraint_samplers::UnionConstraintSampler::project(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts)
+bool constraint_samplers::UnionConstraintSampler::sampleHelper(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts, bool project)
 {
-  if (samplers_.size() >= 1)
-  {
-    if (!samplers_[0]->project(jsg->getRobotState()->getJointStateGroup(samplers_[0]->getJointModelGroup()->getName()), ks, max_attempts))
-      return false;
-  }
+  std::vector<std::vector<std::size_t> > schedule;
+  getSchedule(schedule);
 
-  if (samplers_.size() > 1)
+  // the samplers after the first step get the samples of the earlier ones through this reference state
+  boost::scoped_ptr<robot_state::RobotState> temp;
+  for (std::size_t s = 0 ; s < schedule.size() ; ++s)
   {
-    robot_state::RobotState temp = ks;
-    *(temp.getJointStateGroup(jsg->getName())) = *jsg;
+    const std::vector<std::size_t> &step = schedule[s];
+    const robot_state::RobotState &reference = temp ? *temp : ks;
+    std::vector<char> results(step.size(), 0);
+    std::vector<double> durations(step.size(), 0.0);
 
-    for (std::size_t i = 1 ; i < samplers_.size() ; ++i)
+    if (step.size() == 1)
+    {
+      const ConstraintSamplerPtr &sampler = samplers_[step[0]];
+      bool result;
+      callSampler(sampler, jsg->getRobotState()->getJointStateGroup(sampler->getJointModelGroup()->getName()), reference, max_attempts, project, &result, &durations[0]);
+      results[0] = result;
+    }
+    else
     {
-      robot_state::JointStateGroup *x = jsg->getRobotState()->getJointStateGroup(samplers_[i]->getJointModelGroup()->getName());
-      if (samplers_[i]->project(x, temp, max_attempts))
+      // each sampler works on its own copy of the state; the samples are copied back once all are done
+      std::vector<robot_state::RobotStatePtr> states(step.size());
+      boost::scoped_array<bool> flags(new bool[step.size()]);
+      boost::thread_group threads;
+      for (std::size_t k = 0 ; k < step.size() ; ++k)
       {
-        if (i + 1 < samplers_.size())
-          *(temp.getJointStateGroup(samplers_[i]->getJointModelGroup()->getName())) = *x;
+        const ConstraintSamplerPtr &sampler = samplers_[step[k]];
+        states[k].reset(new robot_state::RobotState(*jsg->getRobotState()));
+        threads.create_thread(boost::bind(&callSampler, sampler, states[k]->getJointStateGroup(sampler->getJointModelGroup()->getName()),
+                                          boost::cref(reference), max_attempts, project, &flags[k], &durations[k]));
+      }
+      threads.join_all();
+      for (std::size_t k = 0 ; k < step.size() ; ++k)
+      {
+        results[k] = flags[k];
+        if (flags[k])
+        {
+          const std::string &name = samplers_[step[k]]->getJointModelGroup()->getName();
+          *(jsg->getRobotState()->getJointStateGroup(name)) = *(states[k]->getJointStateGroup(name));
+        }
       }
+    }
+
+    bool ok = true;
+    for (std::size_t k = 0 ; k < step.size() ; ++k)
+    {
+      SamplerStatistics &st = statistics_[step[k]];
+      st.attempts++;
+      st.time += durations[k];
+      if (results[k])
+        st.successes++;
       else
-        return false;
+        ok = false;
+    }
+    if (!ok)
+      return false;
+
+    if (s + 1 < schedule.size())
+    {
+      if (!temp)
+      {
+        temp.reset(new robot_state::RobotState(ks));
+        *(temp->getJointStateGroup(jsg->getName())) = *jsg;
+      }
+      else
+        for (std::size_t k = 0 ; k < step.size() ; ++k)
+        {
+          const std::string &name = samplers_[step[k]]->getJointModelGroup()->getName();
+          *(temp->getJointStateGroup(name)) = *(jsg->getRobotState()->getJointStateGroup(name));
+        }
     }
   }
 
   return true;
 }
+
+bool constraint_samplers::UnionConstraintSampler::sample(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts)
+{
+  jsg->setToRandomValues();
+  return sampleHelper(jsg, ks, max_attempts, false);
+}
+
+bool constraint_samplers::UnionConstraintSampler::project(robot_state::JointStateGroup *jsg, const robot_state::RobotState &ks, unsigned int max_attempts)
+{
+  return sampleHelper(jsg, ks, max_attempts, true);
+}
@@ -0,0 +1,289 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/* Benchmarks of kinematic constraint evaluation (decide()) and of constraint samplers for the PR2. The constraints are
+   evaluated on random states; the samplers make one attempt per call, and their success rate is reported along with
+   the time. See moveit::Benchmark for the command line arguments. */
+
+#include <moveit/test_resources/config.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <moveit/constraint_samplers/default_constraint_samplers.h>
+#include <moveit/constraint_samplers/union_constraint_sampler.h>
+#include <moveit/profiler/benchmark.h>
+#include <urdf_parser/urdf_parser.h>
+#include <console_bridge/console.h>
+#include <boost/bind.hpp>
+#include <boost/filesystem/path.hpp>
+#include <sstream>
+#include <fstream>
+
+#include "pr2_arm_kinematics_plugin.h"
+
+namespace
+{
+
+/** \brief Random states the constraints are evaluated on, used in turn */
+struct StatePool
+{
+  StatePool(const robot_model::RobotModelConstPtr &model, std::size_t count) : next_(0)
+  {
+    for (std::size_t i = 0 ; i < count ; ++i)
+    {
+      robot_state::RobotStatePtr state(new robot_state::RobotState(model));
+      state->setToDefaultValues();
+      state->getJointStateGroup("arms")->setToRandomValues();
+      states_.push_back(state);
+    }
+  }
+
+  const robot_state::RobotState& next()
+  {
+    const robot_state::RobotState &state = *states_[next_];
+    next_ = (next_ + 1) % states_.size();
+    return state;
+  }
+
+  std::vector<robot_state::RobotStatePtr> states_;
+  std::size_t                             next_;
+};
+
+/** \brief The number of calls made to a sampler and how many of them produced a sample */
+struct SampleCount
+{
+  SampleCount() : calls_(0), successes_(0)
+  {
+  }
+
+  std::string str() const
+  {
+    std::stringstream ss;
+    ss << "success " << (calls_ > 0 ? 100.0 * successes_ / calls_ : 0.0) << "%";
+    return ss.str();
+  }
+
+  std::size_t calls_;
+  std::size_t successes_;
+};
+
+kinematics::KinematicsBasePtr allocatePr2Solver(const kinematics::KinematicsBasePtr &solver, const robot_model::JointModelGroup *jmg)
+{
+  return solver;
+}
+
+kinematics::KinematicsBasePtr makePr2ArmSolver(const boost::shared_ptr<urdf::ModelInterface> &urdf_model, const std::string &group,
+                                               const std::string &tip)
+{
+  boost::shared_ptr<pr2_arm_kinematics::PR2ArmKinematicsPlugin> solver(new pr2_arm_kinematics::PR2ArmKinematicsPlugin);
+  solver->setRobotModel(urdf_model);
+  solver->initialize("", group, "torso_lift_link", tip, .01);
+  return solver;
+}
+
+void decide(const kinematic_constraints::KinematicConstraint &constraint, StatePool &pool)
+{
+  bool satisfied = constraint.decide(pool.next()).satisfied;
+  moveit::Benchmark::keep(satisfied);
+}
+
+void sample(constraint_samplers::ConstraintSampler &sampler, robot_state::RobotState &state, const std::string &group, SampleCount &count)
+{
+  ++count.calls_;
+  if (sampler.sample(state.getJointStateGroup(group), state, 1))
+    ++count.successes_;
+}
+
+void runSampler(moveit::Benchmark &bench, const std::string &name, constraint_samplers::ConstraintSampler &sampler,
+                robot_state::RobotState &state, const std::string &group)
+{
+  SampleCount count;
+  bench.run(name, boost::bind(&sample, boost::ref(sampler), boost::ref(state), boost::cref(group), boost::ref(count)));
+  bench.setNote(name, count.str());
+}
+
+moveit_msgs::PositionConstraint makePositionConstraintMsg(const std::string &frame, const std::string &link, double x, double y, double z,
+                                                         unsigned int regions)
+{
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = link;
+  pcm.header.frame_id = frame;
+  pcm.constraint_region.primitives.resize(regions);
+  pcm.constraint_region.primitive_poses.resize(regions);
+  for (unsigned int i = 0 ; i < regions ; ++i)
+  {
+    pcm.constraint_region.primitives[i].type = i % 2 ? shape_msgs::SolidPrimitive::SPHERE : shape_msgs::SolidPrimitive::BOX;
+    if (i % 2)
+      pcm.constraint_region.primitives[i].dimensions.resize(1, 0.1);
+    else
+      pcm.constraint_region.primitives[i].dimensions.resize(3, 0.15);
+    pcm.constraint_region.primitive_poses[i].position.x = x;
+    pcm.constraint_region.primitive_poses[i].position.y = y + 0.2 * i;
+    pcm.constraint_region.primitive_poses[i].position.z = z;
+    pcm.constraint_region.primitive_poses[i].orientation.w = 1.0;
+  }
+  pcm.weight = 1.0;
+  return pcm;
+}
+
+moveit_msgs::OrientationConstraint makeOrientationConstraintMsg(const std::string &frame, const std::string &link)
+{
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.link_name = link;
+  ocm.header.frame_id = frame;
+  ocm.orientation.w = 1.0;
+  ocm.absolute_x_axis_tolerance = 0.2;
+  ocm.absolute_y_axis_tolerance = 0.1;
+  ocm.absolute_z_axis_tolerance = 0.4;
+  ocm.weight = 1.0;
+  return ocm;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  std::fstream xml_file((boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string().c_str(), std::fstream::in);
+  if (!xml_file.is_open())
+  {
+    logError("Unable to open the PR2 URDF in '%s'", MOVEIT_TEST_RESOURCES_DIR);
+    return 1;
+  }
+  std::string xml_string;
+  while (xml_file.good())
+  {
+    std::string line;
+    std::getline(xml_file, line);
+    xml_string += (line + "\n");
+  }
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model, srdf_model));
+
+  kinematics::KinematicsBasePtr right_solver = makePr2ArmSolver(urdf_model, "right_arm", "r_wrist_roll_link");
+  kinematics::KinematicsBasePtr left_solver = makePr2ArmSolver(urdf_model, "left_arm", "l_wrist_roll_link");
+  std::map<std::string, robot_model::SolverAllocatorFn> allocators;
+  allocators["right_arm"] = boost::bind(&allocatePr2Solver, right_solver, _1);
+  allocators["left_arm"] = boost::bind(&allocatePr2Solver, left_solver, _1);
+  kmodel->setKinematicsAllocators(allocators);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(kmodel));
+  const robot_state::Transforms &tf = ps->getTransforms();
+  const std::string &frame = kmodel->getModelFrame();
+  StatePool pool(kmodel, 64);
+
+  // constraint evaluation
+  kinematic_constraints::JointConstraint jc(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "r_elbow_flex_joint";
+  jcm.position = -1.0;
+  jcm.tolerance_above = 0.5;
+  jcm.tolerance_below = 0.5;
+  jcm.weight = 1.0;
+  jc.configure(jcm);
+  bench.run("decide/JointConstraint", boost::bind(&decide, boost::cref(jc), boost::ref(pool)));
+
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  pc.configure(makePositionConstraintMsg(frame, "r_wrist_roll_link", 0.55, -0.2, 1.0, 1), tf);
+  bench.run("decide/PositionConstraint/1region", boost::bind(&decide, boost::cref(pc), boost::ref(pool)));
+
+  kinematic_constraints::PositionConstraint pc8(kmodel);
+  pc8.configure(makePositionConstraintMsg(frame, "r_wrist_roll_link", 0.55, -0.8, 1.0, 8), tf);
+  bench.run("decide/PositionConstraint/8regions", boost::bind(&decide, boost::cref(pc8), boost::ref(pool)));
+
+  kinematic_constraints::OrientationConstraint oc(kmodel);
+  oc.configure(makeOrientationConstraintMsg(frame, "r_wrist_roll_link"), tf);
+  bench.run("decide/OrientationConstraint", boost::bind(&decide, boost::cref(oc), boost::ref(pool)));
+
+  kinematic_constraints::VisibilityConstraint vc(kmodel);
+  moveit_msgs::VisibilityConstraint vcm;
+  vcm.sensor_pose.header.frame_id = "narrow_stereo_optical_frame";
+  vcm.sensor_pose.pose.position.z = 0.05;
+  vcm.sensor_pose.pose.orientation.w = 1.0;
+  vcm.target_pose.header.frame_id = "l_gripper_r_finger_tip_link";
+  vcm.target_pose.pose.position.z = 0.03;
+  vcm.target_pose.pose.orientation.w = 1.0;
+  vcm.target_radius = 0.05;
+  vcm.cone_sides = 10;
+  vcm.sensor_view_direction = moveit_msgs::VisibilityConstraint::SENSOR_Z;
+  vcm.weight = 1.0;
+  vc.configure(vcm, tf);
+  bench.run("decide/VisibilityConstraint", boost::bind(&decide, boost::cref(vc), boost::ref(pool)));
+
+  // sampling, one attempt per call
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  std::vector<kinematic_constraints::JointConstraint> joint_constraints(1, jc);
+  constraint_samplers::JointConstraintSampler jcs(ps, "right_arm");
+  jcs.configure(joint_constraints);
+  runSampler(bench, "sample/JointConstraintSampler", jcs, ks, "right_arm");
+
+  constraint_samplers::IKConstraintSampler iks_position(ps, "right_arm");
+  iks_position.configure(constraint_samplers::IKSamplingPose(pc));
+  runSampler(bench, "sample/IKConstraintSampler/position", iks_position, ks, "right_arm");
+
+  constraint_samplers::IKConstraintSampler iks_pose(ps, "right_arm");
+  iks_pose.configure(constraint_samplers::IKSamplingPose(pc, oc));
+  runSampler(bench, "sample/IKConstraintSampler/pose", iks_pose, ks, "right_arm");
+
+  // a torso height for the whole body, and a pose for the left hand
+  kinematic_constraints::JointConstraint torso(kmodel);
+  moveit_msgs::JointConstraint torso_msg;
+  torso_msg.joint_name = "torso_lift_joint";
+  torso_msg.position = 0.1;
+  torso_msg.tolerance_above = 0.05;
+  torso_msg.tolerance_below = 0.05;
+  torso_msg.weight = 1.0;
+  torso.configure(torso_msg);
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> torso_sampler(new constraint_samplers::JointConstraintSampler(ps, "arms_and_torso"));
+  torso_sampler->configure(std::vector<kinematic_constraints::JointConstraint>(1, torso));
+
+  kinematic_constraints::PositionConstraint left_pc(kmodel);
+  left_pc.configure(makePositionConstraintMsg(frame, "l_wrist_roll_link", 0.55, 0.2, 1.0, 1), tf);
+  kinematic_constraints::OrientationConstraint left_oc(kmodel);
+  left_oc.configure(makeOrientationConstraintMsg(frame, "l_wrist_roll_link"), tf);
+  boost::shared_ptr<constraint_samplers::IKConstraintSampler> left_sampler(new constraint_samplers::IKConstraintSampler(ps, "left_arm"));
+  left_sampler->configure(constraint_samplers::IKSamplingPose(left_pc, left_oc));
+
+  std::vector<constraint_samplers::ConstraintSamplerPtr> samplers;
+  samplers.push_back(torso_sampler);
+  samplers.push_back(left_sampler);
+  constraint_samplers::UnionConstraintSampler ucs(ps, "arms_and_torso", samplers);
+  runSampler(bench, "sample/UnionConstraintSampler", ucs, ks, "arms_and_torso");
+
+  return bench.report();
+}
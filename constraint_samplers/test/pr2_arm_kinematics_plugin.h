@@ -137,6 +137,10 @@ public:
    */
   PR2ArmKinematicsPlugin();
 
+  // keep the Eigen overloads of the base class visible next to the ones overridden here
+  using kinematics::KinematicsBase::searchPositionIK;
+  using kinematics::KinematicsBase::getPositionFK;
+
   void setRobotModel(boost::shared_ptr<urdf::ModelInterface>& robot_model);
 
   /**
@@ -52,6 +52,7 @@
 #include <fstream>
 #include <boost/bind.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
 
 #include "pr2_arm_kinematics_plugin.h"
 
@@ -281,6 +282,73 @@ TEST_F(LoadPlanningModelsPr2, JointConstraintsSamplerSimple)
   }
 }
 
+TEST_F(LoadPlanningModelsPr2, JointConstraintsSamplerBatch)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  kinematic_constraints::JointConstraint jc(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "r_shoulder_pan_joint";
+  jcm.position = 0.42;
+  jcm.tolerance_above = 0.01;
+  jcm.tolerance_below = 0.05;
+  jcm.weight = 1.0;
+  EXPECT_TRUE(jc.configure(jcm));
+  std::vector<kinematic_constraints::JointConstraint> js(1, jc);
+
+  constraint_samplers::JointConstraintSampler jcs(ps, "right_arm");
+  std::vector<double> values;
+  EXPECT_FALSE(jcs.sampleBatch(10, values));
+  EXPECT_TRUE(jcs.configure(js));
+
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  const std::size_t n = jsg->getVariableCount();
+  EXPECT_TRUE(jcs.sampleBatch(1000, values));
+  ASSERT_EQ(1000 * n, values.size());
+  for (std::size_t s = 0 ; s < 1000 ; ++s)
+  {
+    jsg->setVariableValues(std::vector<double>(values.begin() + s * n, values.begin() + (s + 1) * n));
+    EXPECT_TRUE(jsg->satisfiesBounds());
+    EXPECT_TRUE(jc.decide(ks).satisfied);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, JointConstraintsSamplerQuasiRandom)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  kinematic_constraints::JointConstraint jc(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "r_shoulder_pan_joint";
+  jcm.position = 0.42;
+  jcm.tolerance_above = 0.01;
+  jcm.tolerance_below = 0.05;
+  jcm.weight = 1.0;
+  EXPECT_TRUE(jc.configure(jcm));
+  std::vector<kinematic_constraints::JointConstraint> js(1, jc);
+
+  constraint_samplers::JointConstraintSampler jcs(ps, "right_arm");
+  EXPECT_TRUE(jcs.configure(js));
+  EXPECT_FALSE(jcs.setVariableSampler(robot_model::VariableSamplerPtr(new robot_model::SobolSampler(jcs.getSampleDimension() - 1))));
+  EXPECT_TRUE(jcs.setVariableSampler(robot_model::VariableSamplerPtr(new robot_model::SobolSampler(jcs.getSampleDimension()))));
+
+  // the samples respect the bounds, and the constrained joint covers both halves of its range
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  unsigned int low = 0;
+  for (std::size_t s = 0 ; s < 64 ; ++s)
+  {
+    EXPECT_TRUE(jcs.sample(jsg, ks, 1));
+    EXPECT_TRUE(jsg->satisfiesBounds());
+    EXPECT_TRUE(jc.decide(ks).satisfied);
+    if (ks.getJointState("r_shoulder_pan_joint")->getVariableValues()[0] < 0.40)
+      ++low;
+  }
+  EXPECT_LE(24u, low);
+  EXPECT_GE(40u, low);
+}
+
 TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerSimple)
 {
   robot_state::RobotState ks(kmodel);
@@ -459,6 +527,226 @@ TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerValid)
   }
 }
 
+static kinematics::KinematicsBasePtr allocatePr2RightArmSolver(const boost::shared_ptr<urdf::ModelInterface> &urdf_model, const robot_model::JointModelGroup *jmg)
+{
+  boost::shared_ptr<pr2_arm_kinematics::PR2ArmKinematicsPlugin> solver(new pr2_arm_kinematics::PR2ArmKinematicsPlugin);
+  solver->setRobotModel(urdf_model);
+  solver->initialize("", "right_arm", "torso_lift_link", "r_wrist_roll_link", .01);
+  return solver;
+}
+
+static bool rejectAllStates(robot_state::JointStateGroup *, const std::vector<double> &)
+{
+  return false;
+}
+
+TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerParallel)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms &tf = ps->getTransformsNonConst();
+
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "r_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.001;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = -0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+
+  // the allocator of the fixture returns the same instance every time, so sampling stays single threaded
+  constraint_samplers::IKConstraintSampler iks1(ps, "right_arm");
+  iks1.setIKThreads(4);
+  EXPECT_TRUE(iks1.configure(constraint_samplers::IKSamplingPose(pc)));
+  EXPECT_EQ(4u, iks1.getIKThreads());
+  EXPECT_TRUE(iks1.sample(ks.getJointStateGroup("right_arm"), ks, 100));
+  EXPECT_TRUE(pc.decide(ks).satisfied);
+
+  std::map<std::string, robot_model::SolverAllocatorFn> allocators;
+  allocators["right_arm"] = boost::bind(&allocatePr2RightArmSolver, urdf_model, _1);
+  kmodel->setKinematicsAllocators(allocators);
+
+  constraint_samplers::IKConstraintSampler iks2(ps, "right_arm");
+  EXPECT_TRUE(iks2.configure(constraint_samplers::IKSamplingPose(pc)));
+  iks2.setIKThreads(4);
+  for (int t = 0 ; t < 100 ; ++t)
+  {
+    EXPECT_TRUE(iks2.sample(ks.getJointStateGroup("right_arm"), ks, 100));
+    EXPECT_TRUE(pc.decide(ks).satisfied);
+  }
+
+  // with a validity callback that rejects everything, all attempts fail
+  iks2.setIKTimeout(0.01);
+  iks2.setStateValidityCallback(boost::bind(&rejectAllStates, _1, _2));
+  EXPECT_FALSE(iks2.sample(ks.getJointStateGroup("right_arm"), ks, 8));
+}
+
+TEST_F(LoadPlanningModelsPr2, SolverInstancePool)
+{
+  // the allocator of the fixture returns the same instance every time, so only the shared instance is handed out
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("right_arm");
+  EXPECT_TRUE(jmg->acquireSolverInstance() == jmg->getSolverInstance());
+
+  std::map<std::string, robot_model::SolverAllocatorFn> allocators;
+  allocators["right_arm"] = boost::bind(&allocatePr2RightArmSolver, urdf_model, _1);
+  kmodel->setKinematicsAllocators(allocators);
+  jmg = kmodel->getJointModelGroup("right_arm");
+
+  kinematics::KinematicsBaseConstPtr s1 = jmg->acquireSolverInstance();
+  kinematics::KinematicsBaseConstPtr s2 = jmg->acquireSolverInstance();
+  ASSERT_TRUE(s1 && s2);
+  EXPECT_TRUE(s1 != s2);
+  EXPECT_TRUE(s1 != jmg->getSolverInstance());
+  EXPECT_EQ(jmg->getSolverInstance()->getTipFrame(), s1->getTipFrame());
+
+  // released instances are reused
+  const kinematics::KinematicsBase *released = s2.get();
+  s2.reset();
+  kinematics::KinematicsBaseConstPtr s3 = jmg->acquireSolverInstance();
+  EXPECT_EQ(released, s3.get());
+
+  // a configured IK sampler leases instances only while it samples
+  released = s3.get();
+  s3.reset();
+  constraint_samplers::IKConstraintSampler iks(ps, "right_arm");
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "r_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.001;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = -0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  ASSERT_TRUE(pc.configure(pcm, ps->getTransforms()));
+  ASSERT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+  kinematics::KinematicsBaseConstPtr s4 = jmg->acquireSolverInstance();
+  EXPECT_EQ(released, s4.get());
+  s4.reset();
+
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  EXPECT_TRUE(iks.sample(ks.getJointStateGroup("right_arm"), ks, 100));
+  kinematics::KinematicsBaseConstPtr s5 = jmg->acquireSolverInstance();
+  EXPECT_EQ(released, s5.get());
+}
+
+TEST(IKSeedDatabase, NearestSeeds)
+{
+  constraint_samplers::IKSeedDatabase db(0.1, 0.1);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = 0.5;
+  EXPECT_TRUE(db.add(p, std::vector<double>(2, 1.0)));
+  // a pose that is almost the same does not add another solution
+  p.position.x = 0.501;
+  EXPECT_FALSE(db.add(p, std::vector<double>(2, 5.0)));
+  p.position.x = 0.55;
+  EXPECT_TRUE(db.add(p, std::vector<double>(2, 2.0)));
+  p.position.x = 2.0;
+  EXPECT_TRUE(db.add(p, std::vector<double>(2, 3.0)));
+  EXPECT_EQ(3u, db.size());
+
+  std::vector<std::vector<double> > seeds;
+  p.position.x = 0.56;
+  EXPECT_TRUE(db.getNearestSeeds(p, 5, seeds));
+  ASSERT_EQ(2u, seeds.size());
+  EXPECT_EQ(2.0, seeds[0][0]);
+  EXPECT_EQ(1.0, seeds[1][0]);
+
+  // nothing is stored near the origin
+  p.position.x = 0.0;
+  EXPECT_FALSE(db.getNearestSeeds(p, 5, seeds));
+
+  std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  EXPECT_TRUE(db.save(filename));
+  constraint_samplers::IKSeedDatabase loaded(0.1, 0.1);
+  EXPECT_TRUE(loaded.load(filename));
+  boost::filesystem::remove(filename);
+  EXPECT_EQ(3u, loaded.size());
+  p.position.x = 2.0;
+  EXPECT_TRUE(loaded.getNearestSeeds(p, 1, seeds));
+  ASSERT_EQ(1u, seeds.size());
+  EXPECT_EQ(3.0, seeds[0][1]);
+}
+
+TEST(IKSeedDatabase, CorruptCounts)
+{
+  std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  constraint_samplers::IKSeedDatabase db(0.1, 0.1);
+
+  // an entry count the file cannot hold
+  {
+    std::ofstream out(filename.c_str());
+    out << "moveit_ik_seed_database 1" << std::endl << "1000000000000" << std::endl << "0 0 0 0 0 0 1 1 0.5" << std::endl;
+  }
+  EXPECT_FALSE(db.load(filename));
+
+  // a solution dimension the file cannot hold
+  {
+    std::ofstream out(filename.c_str());
+    out << "moveit_ik_seed_database 1" << std::endl << "1" << std::endl << "0 0 0 0 0 0 1 1000000000000 0.5" << std::endl;
+  }
+  EXPECT_FALSE(db.load(filename));
+  EXPECT_EQ(0u, db.size());
+
+  {
+    std::ofstream out(filename.c_str());
+    out << "moveit_ik_seed_database 1" << std::endl << "1" << std::endl << "0 0 0 0 0 0 1 2 0.5 0.25" << std::endl;
+  }
+  EXPECT_TRUE(db.load(filename));
+  EXPECT_EQ(1u, db.size());
+  boost::filesystem::remove(filename);
+}
+
+TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerSeedDatabase)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms &tf = ps->getTransformsNonConst();
+
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.001;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+
+  constraint_samplers::IKConstraintSampler iks(ps, "left_arm");
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+  constraint_samplers::IKSeedDatabasePtr db(new constraint_samplers::IKSeedDatabase());
+  iks.setSeedDatabase(db);
+  for (int t = 0 ; t < 20 ; ++t)
+  {
+    EXPECT_TRUE(iks.sample(ks.getJointStateGroup("left_arm"), ks, 100));
+    EXPECT_TRUE(pc.decide(ks).satisfied);
+  }
+  // the sampled orientations are random, so most solutions are kept
+  EXPECT_LT(0u, db->size());
+}
+
 TEST_F(LoadPlanningModelsPr2, UnionConstraintSampler)
 {
   robot_state::RobotState ks(kmodel);
@@ -615,6 +903,58 @@ TEST_F(LoadPlanningModelsPr2, UnionConstraintSampler)
   EXPECT_EQ(ikcs_test->getJointModelGroup()->getName(), "right_arm");
 }
 
+TEST_F(LoadPlanningModelsPr2, UnionConstraintSamplerScheduling)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  kinematic_constraints::JointConstraint jc1(kmodel);
+  moveit_msgs::JointConstraint jcm1;
+  jcm1.joint_name = "r_elbow_flex_joint";
+  jcm1.position = -1.0;
+  jcm1.tolerance_above = 0.01;
+  jcm1.tolerance_below = 0.01;
+  jcm1.weight = 1.0;
+  EXPECT_TRUE(jc1.configure(jcm1));
+
+  kinematic_constraints::JointConstraint jc2(kmodel);
+  moveit_msgs::JointConstraint jcm2 = jcm1;
+  jcm2.joint_name = "l_elbow_flex_joint";
+  EXPECT_TRUE(jc2.configure(jcm2));
+
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> right(new constraint_samplers::JointConstraintSampler(ps, "right_arm"));
+  EXPECT_TRUE(right->configure(std::vector<kinematic_constraints::JointConstraint>(1, jc1)));
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> left(new constraint_samplers::JointConstraintSampler(ps, "left_arm"));
+  EXPECT_TRUE(left->configure(std::vector<kinematic_constraints::JointConstraint>(1, jc2)));
+
+  std::vector<constraint_samplers::ConstraintSamplerPtr> cs;
+  cs.push_back(right);
+  cs.push_back(left);
+  constraint_samplers::UnionConstraintSampler ucs(ps, "arms", cs);
+  EXPECT_FALSE(ucs.getAdaptiveScheduling());
+  EXPECT_FALSE(ucs.getConcurrentSampling());
+
+  // the arms are independent, so their samplers may run in any order, or at once
+  for (int mode = 0 ; mode < 3 ; ++mode)
+  {
+    ucs.setAdaptiveScheduling(mode > 0);
+    ucs.setConcurrentSampling(mode > 1);
+    ucs.resetSamplerStatistics();
+    for (int t = 0 ; t < 10 ; ++t)
+    {
+      EXPECT_TRUE(ucs.sample(ks.getJointStateGroup("arms"), ks, 1));
+      EXPECT_TRUE(jc1.decide(ks).satisfied);
+      EXPECT_TRUE(jc2.decide(ks).satisfied);
+    }
+    ASSERT_EQ(2u, ucs.getSamplerStatistics().size());
+    for (std::size_t i = 0 ; i < 2 ; ++i)
+    {
+      EXPECT_EQ(10u, ucs.getSamplerStatistics()[i].attempts);
+      EXPECT_EQ(10u, ucs.getSamplerStatistics()[i].successes);
+    }
+  }
+}
+
 TEST_F(LoadPlanningModelsPr2, PoseConstraintSamplerManager)
 {
   robot_state::RobotState ks(kmodel);
@@ -696,6 +1036,123 @@ TEST_F(LoadPlanningModelsPr2, PoseConstraintSamplerManager)
   EXPECT_NEAR(iks->getOrientationConstraint()->getXAxisTolerance(),.1, .0001);
 }
 
+TEST_F(LoadPlanningModelsPr2, ProjectionConstraintSamplerManager)
+{
+  // a model without IK solvers
+  robot_model::RobotModelPtr model(new robot_model::RobotModel(urdf_model, srdf_model));
+  planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(model));
+  robot_state::RobotState ks(model);
+  ks.setToDefaultValues();
+
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.01;
+  pcm.header.frame_id = model->getModelFrame();
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.link_name = "l_wrist_roll_link";
+  ocm.header.frame_id = model->getModelFrame();
+  ocm.orientation.w = 1.0;
+  ocm.absolute_x_axis_tolerance = 0.2;
+  ocm.absolute_y_axis_tolerance = 0.1;
+  ocm.absolute_z_axis_tolerance = 0.4;
+  ocm.weight = 1.0;
+
+  moveit_msgs::Constraints c;
+  c.position_constraints.push_back(pcm);
+  c.orientation_constraints.push_back(ocm);
+
+  constraint_samplers::ConstraintSamplerPtr s = constraint_samplers::ConstraintSamplerManager::selectDefaultSampler(scene, "left_arm", c);
+  ASSERT_TRUE(s);
+  constraint_samplers::ProjectionConstraintSampler *pcs = dynamic_cast<constraint_samplers::ProjectionConstraintSampler*>(s.get());
+  ASSERT_TRUE(pcs);
+  ASSERT_TRUE(pcs->getPositionConstraint());
+  ASSERT_TRUE(pcs->getOrientationConstraint());
+  EXPECT_EQ("l_wrist_roll_link", pcs->getLinkName());
+
+  // the link is not updated by the right arm
+  EXPECT_FALSE(constraint_samplers::ConstraintSamplerManager::selectDefaultSampler(scene, "right_arm", c));
+
+  static const int NT = 20;
+  for (int t = 0 ; t < NT ; ++t)
+  {
+    EXPECT_TRUE(s->sample(ks.getJointStateGroup("left_arm"), ks, 100));
+    EXPECT_TRUE(pcs->getPositionConstraint()->decide(ks).satisfied);
+    EXPECT_TRUE(pcs->getOrientationConstraint()->decide(ks).satisfied);
+  }
+
+  // projecting a state that satisfies the constraints leaves it unchanged
+  std::vector<double> values, projected;
+  ks.getJointStateGroup("left_arm")->getVariableValues(values);
+  EXPECT_TRUE(s->project(ks.getJointStateGroup("left_arm"), ks, 1));
+  ks.getJointStateGroup("left_arm")->getVariableValues(projected);
+  ASSERT_EQ(values.size(), projected.size());
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    EXPECT_DOUBLE_EQ(values[i], projected[i]);
+
+  // position only
+  c.orientation_constraints.clear();
+  s = constraint_samplers::ConstraintSamplerManager::selectDefaultSampler(scene, "left_arm", c);
+  pcs = dynamic_cast<constraint_samplers::ProjectionConstraintSampler*>(s.get());
+  ASSERT_TRUE(pcs);
+  EXPECT_FALSE(pcs->getOrientationConstraint());
+  EXPECT_TRUE(s->sample(ks.getJointStateGroup("left_arm"), ks, 100));
+  EXPECT_TRUE(pcs->getPositionConstraint()->decide(ks).satisfied);
+}
+
+TEST_F(LoadPlanningModelsPr2, ConstraintSamplerManagerCache)
+{
+  moveit_msgs::Constraints con;
+  con.joint_constraints.resize(1);
+  con.joint_constraints[0].joint_name = "l_shoulder_pan_joint";
+  con.joint_constraints[0].position = 0.54;
+  con.joint_constraints[0].tolerance_above = 0.01;
+  con.joint_constraints[0].tolerance_below = 0.01;
+  con.joint_constraints[0].weight = 1.0;
+
+  constraint_samplers::ConstraintSamplerManager csm;
+  constraint_samplers::ConstraintSamplerPtr s1 = csm.selectSampler(ps, "left_arm", con);
+  EXPECT_TRUE(s1);
+  // without a cache, each request gets its own sampler
+  EXPECT_NE(s1, csm.selectSampler(ps, "left_arm", con));
+
+  csm.setSamplerCacheSize(2);
+  EXPECT_EQ(2u, csm.getSamplerCacheSize());
+  s1 = csm.selectSampler(ps, "left_arm", con);
+  EXPECT_EQ(s1, csm.selectSampler(ps, "left_arm", con));
+
+  // different constraints or another group get different samplers
+  moveit_msgs::Constraints con2 = con;
+  con2.joint_constraints[0].position = 0.5;
+  constraint_samplers::ConstraintSamplerPtr s2 = csm.selectSampler(ps, "left_arm", con2);
+  EXPECT_TRUE(s2);
+  EXPECT_NE(s1, s2);
+  EXPECT_FALSE(csm.selectSampler(ps, "right_arm", con));
+
+  // the least recently used sampler was discarded
+  EXPECT_NE(s1, csm.selectSampler(ps, "left_arm", con));
+
+  // a change to the scene discards the samplers configured for it
+  s1 = csm.selectSampler(ps, "left_arm", con);
+  ps->getCurrentStateNonConst().setToDefaultValues();
+  EXPECT_NE(s1, csm.selectSampler(ps, "left_arm", con));
+
+  csm.clearSamplerCache();
+  s1 = csm.selectSampler(ps, "left_arm", con);
+  EXPECT_EQ(s1, csm.selectSampler(ps, "left_arm", con));
+  csm.setSamplerCacheSize(0);
+  EXPECT_NE(s1, csm.selectSampler(ps, "left_arm", con));
+}
+
 TEST_F(LoadPlanningModelsPr2, JointVersusPoseConstraintSamplerManager)
 {
   robot_state::RobotState ks(kmodel);
@@ -40,6 +40,8 @@
 #include <vector>
 #include <string>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <moveit_msgs/RobotTrajectory.h>
 
 /// Namespace for the base class of a MoveIt controller manager
@@ -98,8 +100,11 @@ class MoveItControllerHandle
 {
 public:
 
+  /** \brief Called with the final status of an execution */
+  typedef boost::function<void(const ExecutionStatus &status)> ExecutionCallback;
+
   /** \brief Each controller has a name. The handle is initialized with that name */
-  MoveItControllerHandle(const std::string &name) : name_(name)
+  MoveItControllerHandle(const std::string &name) : name_(name), execution_complete_(true)
   {
   }
 
@@ -125,10 +130,100 @@ public:
   /** \brief Return the execution status of the last trajectory sent to the controller. */
   virtual ExecutionStatus getLastExecutionStatus() = 0;
 
+  /** \brief Return true if the handle reports the end of executions to callbacks (see addExecutionCallback()), so no
+      thread needs to wait in waitForExecution(). The default implementation returns false. */
+  virtual bool supportsExecutionCallbacks() const
+  {
+    return false;
+  }
+
+  /** \brief Call \e callback once, with the final status, when the execution in progress completes. If no execution is in
+      progress, the callback is called right away with the status of the last one. Callbacks run in a thread of the handle
+      and should return quickly. Return false if the handle does not support callbacks. */
+  bool addExecutionCallback(const ExecutionCallback &callback)
+  {
+    if (!supportsExecutionCallbacks())
+      return false;
+    ExecutionStatus status;
+    {
+      boost::mutex::scoped_lock slock(execution_callbacks_lock_);
+      if (!execution_complete_)
+      {
+        execution_callbacks_.push_back(callback);
+        return true;
+      }
+      status = execution_status_;
+    }
+    callback(status);
+    return true;
+  }
+
+  /** \brief Return true if the controller can execute a trajectory that is sent in segments, while the later segments are
+      still being computed (see beginTrajectoryStream()). The default implementation returns false. */
+  virtual bool supportsTrajectoryStreaming() const
+  {
+    return false;
+  }
+
+  /** \brief Start executing a trajectory of which only the first segment, \e segment, is known. More segments are sent
+      with appendTrajectorySegment() and the end of the trajectory is marked by endTrajectoryStream(). This function should
+      not block, just like sendTrajectory(). Until the stream is ended, the execution status is RUNNING; if the controller
+      reaches the end of the segments received so far, it holds the last point until more arrive. Return false if the
+      controller cannot accept the segment or does not support streaming (default). */
+  virtual bool beginTrajectoryStream(const moveit_msgs::RobotTrajectory &segment)
+  {
+    return false;
+  }
+
+  /** \brief Append a segment to the trajectory started by beginTrajectoryStream(). The points of \e segment follow the points
+      sent before, and their time_from_start is relative to the end of the previous segment. The segment must control the
+      same joints as the first one. Return false if the segment cannot be accepted; the trajectory sent so far is then still
+      executed, up to its end. */
+  virtual bool appendTrajectorySegment(const moveit_msgs::RobotTrajectory &segment)
+  {
+    return false;
+  }
+
+  /** \brief Mark the end of the trajectory started by beginTrajectoryStream(). After this call, waitForExecution() and
+      getLastExecutionStatus() behave as for a trajectory sent with sendTrajectory(). Return false if no stream was started. */
+  virtual bool endTrajectoryStream()
+  {
+    return false;
+  }
+
 protected:
 
+  /** \brief Handles that support callbacks call this when they start executing a trajectory, before the execution can
+      complete */
+  void executionStarted()
+  {
+    boost::mutex::scoped_lock slock(execution_callbacks_lock_);
+    execution_complete_ = false;
+  }
+
+  /** \brief Handles that support callbacks call this when an execution completes; the pending callbacks are called with
+      \e status */
+  void executionComplete(const ExecutionStatus &status)
+  {
+    std::vector<ExecutionCallback> callbacks;
+    {
+      boost::mutex::scoped_lock slock(execution_callbacks_lock_);
+      execution_complete_ = true;
+      execution_status_ = status;
+      callbacks.swap(execution_callbacks_);
+    }
+    for (std::size_t i = 0 ; i < callbacks.size() ; ++i)
+      callbacks[i](status);
+  }
+
   std::string name_;
 
+private:
+
+  boost::mutex execution_callbacks_lock_;
+  std::vector<ExecutionCallback> execution_callbacks_;
+  bool execution_complete_;
+  ExecutionStatus execution_status_;
 };
 
 typedef boost::shared_ptr<MoveItControllerHandle> MoveItControllerHandlePtr;
@@ -189,6 +284,22 @@ public:
 
   /** \brief Activate and deactivate controllers */
   virtual bool switchControllers(const std::vector<std::string> &activate, const std::vector<std::string> &deactivate) = 0;
+
+  /** \brief Report whether the controller \e name accepts trajectories in segments (see MoveItControllerHandle::beginTrajectoryStream()),
+      so execution can start before the whole trajectory is computed. The default implementation asks the controller handle. */
+  virtual bool supportsTrajectoryStreaming(const std::string &name)
+  {
+    MoveItControllerHandlePtr handle = getControllerHandle(name);
+    return handle && handle->supportsTrajectoryStreaming();
+  }
+
+  /** \brief Report whether the handle of controller \e name reports completed executions to callbacks (see
+      MoveItControllerHandle::addExecutionCallback()). The default implementation asks the controller handle. */
+  virtual bool supportsExecutionCallbacks(const std::string &name)
+  {
+    MoveItControllerHandlePtr handle = getControllerHandle(name);
+    return handle && handle->supportsExecutionCallbacks();
+  }
 };
 
 typedef boost::shared_ptr<MoveItControllerManager> MoveItControllerManagerPtr;
@@ -0,0 +1,255 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_DISTANCE_FIELD_COMPACT_DISTANCE_FIELD_
+#define MOVEIT_DISTANCE_FIELD_COMPACT_DISTANCE_FIELD_
+
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <boost/shared_ptr.hpp>
+
+namespace distance_field
+{
+
+/**
+ * \brief Compact structure that holds voxel information for the
+ * CompactDistanceField.  Will be used in VoxelGrid.
+ *
+ * Squared distances are stored in 16 bits and the closest points as
+ * 8 bit offsets relative to the cell, which takes a quarter of the
+ * memory of a \ref PropDistanceFieldVoxel.
+ */
+struct CompactPropDistanceFieldVoxel
+{
+  /**
+   * \brief Constructor.  All fields left uninitialized.
+   */
+  CompactPropDistanceFieldVoxel();
+
+  /**
+   * \brief Constructor.  Sets values for the squared distances and
+   * marks both closest points as undefined.
+   *
+   * @param [in] distance_sq_positive Squared distance in cells to the closest obstacle
+   *
+   * @param [in] distance_sq_negative Squared distance in cells to the nearest unoccupied cell
+   */
+  CompactPropDistanceFieldVoxel(unsigned short distance_sq_positive, unsigned short distance_sq_negative);
+
+  unsigned short distance_square_;          /**< \brief Distance in cells to the closest obstacle, squared */
+  unsigned short negative_distance_square_; /**< \brief Distance in cells to the nearest unoccupied cell, squared */
+  signed char closest_point_offset_[3];     /**< \brief Offset from this cell to the closest occupied cell */
+  signed char closest_negative_point_offset_[3]; /**< \brief Offset from this cell to the closest unoccupied cell */
+
+  static const signed char UNDEFINED_OFFSET = -128; /**< \brief Offset value that represents an undefined closest point */
+  static const int MAX_OFFSET = 127;                /**< \brief Largest offset that can be represented, in cells */
+  static const int MAX_DISTANCE_SQ = MAX_OFFSET * MAX_OFFSET; /**< \brief Largest squared distance for which all closest points can be represented */
+};
+
+/**
+ * \brief A read-only DistanceField that holds the result of a \ref
+ * PropagationDistanceField in a compact form.
+ *
+ * The distances are computed by a PropagationDistanceField, which
+ * can be discarded once the compact field is built.  Lookups give
+ * the same distances while using a quarter of the memory, which also
+ * makes them more cache friendly for large fields.  The field cannot
+ * be modified, except for being reset.  The maximum distance must
+ * not exceed \ref CompactPropDistanceFieldVoxel::MAX_OFFSET cells.
+ */
+class CompactDistanceField : public DistanceField
+{
+public:
+
+  /**
+   * \brief Constructor that packs the content of a
+   * PropagationDistanceField.
+   *
+   * Distances beyond \ref CompactPropDistanceFieldVoxel::MAX_OFFSET
+   * cells are clamped, and an error is logged.
+   *
+   * @param [in] df The distance field to pack
+   */
+  CompactDistanceField(const PropagationDistanceField& df);
+
+  virtual ~CompactDistanceField();
+
+  /**
+   * \brief Not supported; the field is read-only.  Logs an error.
+   */
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d &points);
+
+  /**
+   * \brief Not supported; the field is read-only.  Logs an error.
+   */
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d &points);
+
+  /**
+   * \brief Not supported; the field is read-only.  Logs an error.
+   */
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /**
+   * \brief Resets all cells to the maximum distance, as if there were
+   * no obstacles.
+   */
+  virtual void reset();
+
+  //passthrough docs to DistanceField
+  virtual double getDistance(double x, double y, double z) const;
+
+  //passthrough docs to DistanceField
+  virtual double getDistance(int x, int y, int z) const;
+
+  //passthrough docs to DistanceField
+  virtual bool isCellValid(int x, int y, int z) const;
+
+  //passthrough docs to DistanceField
+  virtual int getXNumCells() const;
+
+  //passthrough docs to DistanceField
+  virtual int getYNumCells() const;
+
+  //passthrough docs to DistanceField
+  virtual int getZNumCells() const;
+
+  //passthrough docs to DistanceField
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+
+  //passthrough docs to DistanceField
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Not supported.  Logs an error.
+   *
+   * @return False
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Not supported; the field is read-only.  Logs an error.
+   *
+   * @return False
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  //passthrough docs to DistanceField
+  virtual std::size_t getMemoryUsage() const;
+
+  //passthrough docs to DistanceField
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+  /**
+   * \brief Gets compact cell data given an indexes.  No validity
+   * check.
+   *
+   * @param [in] x The integer X location
+   * @param [in] y The integer Y location
+   * @param [in] z The integer Z location
+   *
+   * @return The data in the indicated cell
+   */
+  const CompactPropDistanceFieldVoxel& getCell(int x, int y, int z) const
+  {
+    return voxel_grid_->getCell(x, y, z);
+  }
+
+  /**
+   * \brief Gets the closest occupied cell, or the closest unoccupied
+   * cell for negative distances, of the indicated cell.
+   *
+   * @param [in] x The integer X location
+   * @param [in] y The integer Y location
+   * @param [in] z The integer Z location
+   * @param [out] closest The closest cell
+   * @param [in] negative Whether to get the closest unoccupied cell
+   *
+   * @return True if the cell is valid and has a closest cell within
+   * the maximum distance; otherwise False.
+   */
+  bool getClosestCell(int x, int y, int z, Eigen::Vector3i& closest, bool negative = false) const;
+
+  /**
+   * \brief Gets the maximum distance squared value, in cells.
+   *
+   * @return The maximum distance squared.
+   */
+  int getMaximumDistanceSquared() const
+  {
+    return max_distance_sq_;
+  }
+
+private:
+
+  /**
+   * \brief Gets the signed distance of a voxel, in meters.
+   */
+  double getDistance(const CompactPropDistanceFieldVoxel& object) const;
+
+  boost::shared_ptr<VoxelGrid<CompactPropDistanceFieldVoxel> > voxel_grid_; /**< \brief Actual container for distance data */
+  double max_distance_;         /**< \brief Holds maximum distance  */
+  int max_distance_sq_;         /**< \brief Holds maximum distance squared in cells */
+  std::vector<double> sqrt_table_; /**< \brief Precomputed square root table for faster distance lookups */
+};
+
+////////////////////////// inline functions follow ////////////////////////////////////////
+
+inline CompactPropDistanceFieldVoxel::CompactPropDistanceFieldVoxel(unsigned short distance_sq_positive,
+                                                                    unsigned short distance_sq_negative):
+  distance_square_(distance_sq_positive),
+  negative_distance_square_(distance_sq_negative)
+{
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    closest_point_offset_[i] = UNDEFINED_OFFSET;
+    closest_negative_point_offset_[i] = UNDEFINED_OFFSET;
+  }
+}
+
+inline CompactPropDistanceFieldVoxel::CompactPropDistanceFieldVoxel()
+{
+}
+
+inline double CompactDistanceField::getDistance(const CompactPropDistanceFieldVoxel& object) const
+{
+  return sqrt_table_[object.distance_square_]-sqrt_table_[object.negative_distance_square_];
+}
+
+}
+
+#endif
@@ -85,6 +85,9 @@ class DistanceField
 {
 public:
 
+  /** \brief An inclusive range of cells: the minimum and maximum cell indices */
+  typedef std::pair<Eigen::Vector3i, Eigen::Vector3i> CellBox;
+
   /**
    * \brief Constructor, where units are arbitrary but are assumed to
    * be meters.
@@ -160,7 +163,8 @@ public:
    *
    * This function uses the Body class in the geometric_shapes package
    * to determine the set of obstacle points, with the exception of
-   * OcTrees as mentioned.  A bounding sphere is computed given the
+   * OcTrees as mentioned, and of meshes, which are voxelized directly
+   * at the resolution of the distance field (see \ref setFillMeshes).  A bounding sphere is computed given the
    * shape; the bounding sphere is iterated through in 3D at the
    * resolution of the distance_field, with each point tested for
    * point inclusion.  For more information about the behavior of
@@ -177,17 +181,30 @@ public:
    * \brief Adds an octree to the distance field.  Cells that are
    * occupied in the octree that lie within the voxel grid are added
    * to the distance field.  The octree can represent either a larger
-   * or smaller volume than the distance field.  If the resolution of
-   * the octree is less than or equal to the resolution of the
-   * distance field then the center of each leaf cell of the octree
-   * will be added to the distance field.  If the resolution of the
-   * octree is greater than a 3D volume of the correct resolution will
-   * be added for each occupied leaf node.
+   * or smaller volume than the distance field.  Each occupied leaf,
+   * at any depth, is rasterized as the box of cells whose centers it
+   * contains; a leaf smaller than a cell occupies the cell that
+   * contains its center.  The boxes are passed to \ref
+   * addCellBoxesToField without building a list of points.
    *
    * @param [in] octree The octree to add to the distance field
    */
   void addOcTreeToField(const octomap::OcTree* octree);
 
+  /**
+   * \brief Gets the obstacle points of a shape at a given pose:
+   * the points that \ref addShapeToField adds for the shape.  For
+   * octrees, these are the points \ref addOcTreeToField adds for the
+   * octree, which is located at the given pose.
+   *
+   * @param [in] shape The shape to discretize
+   * @param [in] pose The pose of the shape
+   * @param [out] points The obstacle points of the shape
+   */
+  void getShapePoints(const shapes::Shape* shape,
+                      const Eigen::Affine3d& pose,
+                      EigenSTL::vector_Vector3d& points) const;
+
   /**
    * \brief Moves the shape in the distance field from the old pose to
    * the new pose, removing points that are no longer obstacle points,
@@ -299,6 +316,34 @@ public:
   double getDistanceGradient(double x, double y, double z,
                              double& gradient_x, double& gradient_y, double& gradient_z,
                              bool& in_bounds) const;
+
+  /**
+   * \brief Gets the distances to the closest obstacles for a set of
+   * locations.  Equivalent to calling \ref getDistance(double x,
+   * double y, double z) const for each location, but derived classes
+   * may implement it without a virtual call per location.
+   *
+   * @param [in] points The locations to query
+   * @param [out] distances The distance for each location
+   */
+  virtual void getDistances(const EigenSTL::vector_Vector3d& points,
+                            std::vector<double>& distances) const;
+
+  /**
+   * \brief Gets the distances and gradients for a set of locations.
+   * Equivalent to calling \ref getDistanceGradient for each
+   * location, but derived classes may implement it without virtual
+   * calls per location.
+   *
+   * @param [in] points The locations to query
+   * @param [out] distances The distance for each location
+   * @param [out] gradients The gradient for each location
+   * @param [out] in_bounds Whether each location is valid for gradient purposes
+   */
+  virtual void getDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                    std::vector<double>& distances,
+                                    EigenSTL::vector_Vector3d& gradients,
+                                    std::vector<bool>& in_bounds) const;
   /**
    * \brief Gets the distance to the closest obstacle at the given
    * integer cell location. The particulars of this function are
@@ -402,6 +447,14 @@ public:
    */
   virtual bool readFromStream(std::istream& stream) = 0;
 
+  /**
+   * \brief Gets an estimate of the memory held by the distance
+   * field: its cells and the data structures used to update them.
+   *
+   * @return The number of bytes
+   */
+  virtual std::size_t getMemoryUsage() const = 0;
+
   /**
    * \brief Get an iso-surface for visualization in rviz.  The
    * iso-surface shows every cell that has a distance in a given
@@ -572,6 +625,28 @@ public:
     return resolution_;
   }
 
+  /**
+   * \brief Sets whether the interior of meshes is added to the
+   * distance field along with their surface.  Filling requires
+   * closed meshes; for meshes with holes larger than a cell, only the
+   * surface is added.  Meshes are filled by default.
+   *
+   * @param [in] fill Whether to fill meshes
+   */
+  void setFillMeshes(bool fill)
+  {
+    fill_meshes_ = fill;
+  }
+
+  /**
+   * \brief Gets whether the interior of meshes is added to the
+   * distance field.
+   */
+  bool getFillMeshes() const
+  {
+    return fill_meshes_;
+  }
+
   /**
    * \brief Gets a distance value for an invalid cell.
    *
@@ -581,6 +656,48 @@ public:
   virtual double getUninitializedDistance() const = 0;
 
 protected:
+  /**
+   * \brief Adds the cells of the given boxes to the field as
+   * obstacles.  The default implementation adds the centers of the
+   * cells using \ref addPointsToField; implementations with direct
+   * access to their cells should override it.
+   *
+   * @param [in] boxes The boxes of cells, which must lie within the field
+   */
+  virtual void addCellBoxesToField(const std::vector<CellBox>& boxes);
+
+  /**
+   * \brief Gets the boxes of cells covered by the occupied leaves of
+   * an octree, clipped to the field.  See \ref addOcTreeToField.
+   */
+  void getOcTreeCellBoxes(const octomap::OcTree* octree,
+                          std::vector<CellBox>& boxes) const;
+
+  /**
+   * \brief Gets the centers of the cells of the given boxes.
+   */
+  void getCellBoxPoints(const std::vector<CellBox>& boxes,
+                        EigenSTL::vector_Vector3d& points) const;
+
+  /**
+   * \brief Gets the points that represent the occupied leaves of an
+   * octree located at the given pose, restricted to the leaves that
+   * may be within the volume of the distance field.
+   */
+  void getOcTreePoints(const octomap::OcTree* octree,
+                       const Eigen::Affine3d& pose,
+                       EigenSTL::vector_Vector3d& points) const;
+
+  /**
+   * \brief Gets the centers of the cells a mesh at the given pose
+   * occupies.  The cells overlapping the triangles are found by
+   * scan-converting each triangle; if \ref getFillMeshes is true,
+   * the cells enclosed by them are added as well.
+   */
+  void getMeshPoints(const shapes::Mesh* mesh,
+                     const Eigen::Affine3d& pose,
+                     EigenSTL::vector_Vector3d& points) const;
+
   /**
    * \brief Helper function that sets the point value and color given
    * the distance.
@@ -609,6 +726,7 @@ protected:
   double origin_z_;             /**< \brief Z origin of the distance field */
   double resolution_;           /**< \brief Resolution of the distance field */
   int inv_twice_resolution_;    /**< \brief Computed value 1.0/(2.0*resolution_) */
+  bool fill_meshes_;            /**< \brief Whether the interior of meshes is added to the field */
 };
 
 }
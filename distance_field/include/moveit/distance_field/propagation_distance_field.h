@@ -160,6 +160,14 @@ public:
    * \ref PropagationDistanceField description for more information on
    * the implications of this.
    *
+   * @param [in] propagation_threads The number of threads used to
+   * propagate distances.  See \ref setPropagationThreads.
+   *
+   * @param [in] sparse_storage Whether to store the cells in blocks
+   * that are only allocated when distances near obstacles are
+   * written.  Memory then scales with the volume near obstacles
+   * rather than with the volume of the field.
+   *
    */
   PropagationDistanceField(double size_x,
                            double size_y,
@@ -167,7 +175,9 @@ public:
                            double resolution,
                            double origin_x, double origin_y, double origin_z,
                            double max_distance,
-                           bool propagate_negative_distances=false);
+                           bool propagate_negative_distances=false,
+                           unsigned int propagation_threads=1,
+                           bool sparse_storage=false);
 
   /**
    * \brief Constructor based on an OcTree and bounding box
@@ -190,12 +200,22 @@ public:
    * and all obstacle cells will be assigned zero distance.  See the
    * \ref PropagationDistanceField description for more information on
    * the implications of this.
+   *
+   * @param [in] propagation_threads The number of threads used to
+   * propagate distances.  See \ref setPropagationThreads.
+   *
+   * @param [in] sparse_storage Whether to store the cells in blocks
+   * that are only allocated when distances near obstacles are
+   * written.  Memory then scales with the volume near obstacles
+   * rather than with the volume of the field.
    */
   PropagationDistanceField(const octomap::OcTree& octree,
                            const octomap::point3d& bbx_min,
                            const octomap::point3d& bbx_max,
                            double max_distance,
-                           bool propagate_negative_distances=false);
+                           bool propagate_negative_distances=false,
+                           unsigned int propagation_threads=1,
+                           bool sparse_storage=false);
 
   /**
    * \brief Constructor that takes an istream and reads the contents
@@ -216,11 +236,21 @@ public:
    * \ref PropagationDistanceField description for more information on
    * the implications of this.
    *
+   * @param [in] propagation_threads The number of threads used to
+   * propagate distances.  See \ref setPropagationThreads.
+   *
+   * @param [in] sparse_storage Whether to store the cells in blocks
+   * that are only allocated when distances near obstacles are
+   * written.  Memory then scales with the volume near obstacles
+   * rather than with the volume of the field.
+   *
    * @return
    */
   PropagationDistanceField(std::istream& stream,
                            double max_distance,
-                           bool propagate_negative_distances=false);
+                           bool propagate_negative_distances=false,
+                           unsigned int propagation_threads=1,
+                           bool sparse_storage=false);
   /**
    * \brief Empty destructor
    *
@@ -282,6 +312,13 @@ public:
    * the old_points and then \ref addPointsToField on the new points -
    * this does not require computing set differences.
    *
+   * When the cells that change exceed the fraction of the field set
+   * with \ref setRebuildFraction, the distances are not updated
+   * incrementally: the bounding box of the changed cells, grown by
+   * the maximum distance, is reset and propagated again from its
+   * obstacles and the cells bordering it.  If that box covers more
+   * than half of the field, the whole field is rebuilt instead.
+   *
    * @param [in] old_points The set of points that all should be obstacle cells in the distance field
    * @param [in] new_points The set of points, all of which are intended to be obstacle points in the distance field
    *
@@ -330,6 +367,33 @@ public:
    */
   virtual double getDistance(int x, int y, int z) const;
 
+  /**
+   * \brief Gets the distances for a set of locations, accessing the
+   * voxel grid directly rather than through a virtual call per
+   * location.
+   *
+   * @param [in] points The locations to query
+   * @param [out] distances The distance for each location
+   */
+  virtual void getDistances(const EigenSTL::vector_Vector3d& points,
+                            std::vector<double>& distances) const;
+
+  /**
+   * \brief Gets the distances and gradients for a set of locations,
+   * accessing the voxel grid directly rather than through virtual
+   * calls per location.  The results are the same as those of \ref
+   * getDistanceGradient.
+   *
+   * @param [in] points The locations to query
+   * @param [out] distances The distance for each location
+   * @param [out] gradients The gradient for each location
+   * @param [out] in_bounds Whether each location is valid for gradient purposes
+   */
+  virtual void getDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                    std::vector<double>& distances,
+                                    EigenSTL::vector_Vector3d& gradients,
+                                    std::vector<bool>& in_bounds) const;
+
   virtual bool isCellValid(int x, int y, int z) const;
   virtual int getXNumCells() const;
   virtual int getYNumCells() const;
@@ -373,6 +437,68 @@ public:
    */
   virtual bool readFromStream(std::istream& stream);
 
+  /**
+   * \brief Gets an estimate of the memory held by the distance
+   * field: the voxel grid, the propagation queues, the update stamps
+   * and the lookup tables.
+   *
+   * @return The number of bytes
+   */
+  virtual std::size_t getMemoryUsage() const;
+
+  /**
+   * \brief Writes the propagated contents of the distance field to
+   * the supplied stream in a binary format.
+   *
+   * Unlike \ref writeToStream, this stores the grid parameters, the
+   * maximum distance, whether negative distances are propagated, and
+   * for every cell the squared distances, closest points and update
+   * directions, so that loading needs no propagation.  Squared
+   * distances are stored in 16 bits and cell coordinates in 16 bits,
+   * so fields with a maximum distance over 255 cells or more than
+   * 32767 cells along an axis cannot be written.  Without
+   * compression, each cell array starts at an 8 byte aligned offset,
+   * and the file can be loaded by mapping it into memory with \ref
+   * readBinaryFromFile.
+   *
+   * @param [out] stream The stream to which to write the distance field contents
+   * @param [in] compress Whether to compress the cell data with Zlib
+   *
+   * @return True if the field could be written; otherwise False.
+   */
+  bool writeBinaryToStream(std::ostream& stream, bool compress=false) const;
+
+  /**
+   * \brief Reads a distance field written by \ref
+   * writeBinaryToStream.  The grid parameters, maximum distance and
+   * whether negative distances are propagated are replaced by the
+   * values in the data.  No propagation is run.
+   *
+   * @param [in] stream The stream from which to read
+   *
+   * @return True if the data is valid; otherwise False.  If the
+   * grid parameters were read but the cell data is invalid, the field
+   * is left empty.
+   */
+  bool readBinaryFromStream(std::istream& stream);
+
+  /**
+   * \brief The same as \ref readBinaryFromStream, reading from a
+   * block of memory.
+   *
+   * @param [in] data The data written by \ref writeBinaryToStream
+   * @param [in] size The size of the data in bytes
+   */
+  bool readBinaryFromData(const char* data, std::size_t size);
+
+  /**
+   * \brief The same as \ref readBinaryFromStream, reading from a
+   * file that is mapped into memory.
+   *
+   * @param [in] path The path of the file
+   */
+  bool readBinaryFromFile(const std::string& path);
+
   //passthrough docs to DistanceField
   virtual double getUninitializedDistance() const
   {
@@ -387,11 +513,30 @@ public:
    * @param [in] y The integer Y location
    * @param [in] z The integer Z location
    *
-   * @return The data in the indicated cell or an unitialized
-   * voxel if the indexes are not valid.
+   * @return A copy of the data in the indicated cell or an
+   * unitialized voxel if the indexes are not valid.  With sparse
+   * storage, cells that were never written are reported as they are
+   * after reset(), with each cell its own closest unoccupied cell.
+   */
+  PropDistanceFieldVoxel getCell(int x, int y, int z) const {
+    return getGrid().getCellValue(x, y, z);
+  }
+
+  /**
+   * \brief Whether the cells are stored in blocks allocated on
+   * demand.
+   */
+  bool hasSparseStorage() const
+  {
+    return sparse_storage_;
+  }
+
+  /**
+   * \brief Gets the voxel grid holding the distance data.
    */
-  const PropDistanceFieldVoxel& getCell(int x, int y, int z) const {
-    return voxel_grid_->getCell(x, y, z);
+  const VoxelGrid<PropDistanceFieldVoxel>& getGrid() const
+  {
+    return *voxel_grid_;
   }
 
   /**
@@ -407,6 +552,69 @@ public:
     return max_distance_sq_;
   }
 
+  /**
+   * \brief Sets the number of threads used to propagate distances.
+   *
+   * With more than one thread, the cells of each large distance
+   * bucket are split among the threads, which compute the updates
+   * of the neighboring cells in parallel; the updates are then
+   * applied in the order of the bucket.  The resulting field is
+   * identical to the one computed with a single thread.
+   *
+   * @param [in] threads The number of threads (0 is treated as 1)
+   */
+  void setPropagationThreads(unsigned int threads)
+  {
+    propagation_threads_ = threads > 0 ? threads : 1;
+  }
+
+  /**
+   * \brief Gets the number of threads used to propagate distances.
+   *
+   * @return The number of threads
+   */
+  unsigned int getPropagationThreads() const
+  {
+    return propagation_threads_;
+  }
+
+  /**
+   * \brief Sets the fraction of the cells of the field that must
+   * change in a call to \ref updatePointsInField for the changed
+   * region to be propagated again from scratch instead of being
+   * updated incrementally.  The incremental update visits every cell
+   * whose closest obstacle was removed, which under heavy churn can
+   * cost more than a bounded rebuild.
+   *
+   * @param [in] fraction The fraction of cells, in (0, 1]; 0 always updates incrementally
+   */
+  void setRebuildFraction(double fraction)
+  {
+    rebuild_fraction_ = fraction;
+  }
+
+  /**
+   * \brief Gets the fraction of changed cells above which updates
+   * are propagated again from scratch.
+   *
+   * @return The fraction of cells, 0 if updates are always incremental
+   */
+  double getRebuildFraction() const
+  {
+    return rebuild_fraction_;
+  }
+
+protected:
+
+  /**
+   * \brief Adds the cells of the given boxes as obstacles, writing
+   * them into the voxel grid directly rather than through world
+   * points.
+   *
+   * @param [in] boxes The boxes of cells, which must lie within the field
+   */
+  virtual void addCellBoxesToField(const std::vector<CellBox>& boxes);
+
 private:
 
   typedef std::set<Eigen::Vector3i, compareEigen_Vector3i> VoxelSet; /**< \brief Typedef for set of integer indices */
@@ -433,6 +641,18 @@ private:
    */
   void removeObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points);
 
+  /**
+   * \brief Applies the given changes of obstacle cells by resetting
+   * the bounding box of the changes, grown by the maximum distance,
+   * and propagating it again; the whole field is rebuilt if the box
+   * covers more than half of it.
+   *
+   * @param removed Valid obstacle cells to remove, sorted by compareEigen_Vector3i
+   * @param added Valid cells to add, which are not obstacles
+   */
+  void rebuildChangedRegion(const std::vector<Eigen::Vector3i>& removed,
+                            const std::vector<Eigen::Vector3i>& added);
+
   /**
    * \brief Propagates outward to the maximum distance given the
    * contents of the \ref bucket_queue_, and clears the \ref
@@ -449,6 +669,44 @@ private:
    */
   void propagateNegative();
 
+  /**
+   * \brief An update of a neighboring cell computed when a bucket is
+   * propagated in parallel.
+   */
+  struct BucketUpdate
+  {
+    Eigen::Vector3i loc_;       /**< \brief The cell to update */
+    int distance_sq_;           /**< \brief Its new distance squared */
+    int update_direction_;      /**< \brief The direction it is updated from */
+  };
+
+  /**
+   * \brief Computes the updates the cell at \e loc in bucket \e
+   * bucket makes to its neighbors, given the current content of the
+   * grid, and appends them to \e updates.  Used for both positive
+   * and negative propagation, as selected by \e negative.
+   */
+  void computeBucketUpdates(const Eigen::Vector3i& loc, unsigned int bucket, bool negative,
+                            std::vector<BucketUpdate>& updates) const;
+
+  /**
+   * \brief Computes the updates for the cells \e begin to \e end
+   * of \e cells; \e ends receives, for each cell, the number of
+   * updates computed up to and including that cell.  Runs in a
+   * separate thread.
+   */
+  void computeBucketUpdatesRange(const std::vector<Eigen::Vector3i>* cells, std::size_t begin, std::size_t end,
+                                 unsigned int bucket, bool negative,
+                                 std::vector<BucketUpdate>* updates, std::vector<std::size_t>* ends) const;
+
+  /**
+   * \brief Processes bucket \e bucket of \e queue using \ref
+   * propagation_threads_ threads, with the same result as the
+   * serial loops of \ref propagatePositive and \ref
+   * propagateNegative.
+   */
+  void propagateBucketParallel(std::vector<std::vector<Eigen::Vector3i> >& queue, unsigned int bucket, bool negative);
+
   /**
    * \brief Determines distance based on actual voxel data
    *
@@ -513,6 +771,15 @@ private:
 
   bool propagate_negative_;     /**< \brief Whether or not to propagate negative distances */
 
+  unsigned int propagation_threads_; /**< \brief The number of threads used to propagate distances */
+
+  std::vector<unsigned int> update_stamps_; /**< \brief For each cell, the last bucket processed in parallel in which it was updated (only allocated for parallel propagation on a dense grid) */
+  unsigned int update_stamp_;   /**< \brief Identifies the bucket being processed in parallel */
+
+  bool sparse_storage_;         /**< \brief Whether the voxel grid allocates its cells on demand */
+
+  double rebuild_fraction_;     /**< \brief The fraction of changed cells above which updates rebuild the changed region */
+
   boost::shared_ptr<VoxelGrid<PropDistanceFieldVoxel> > voxel_grid_; /**< \brief Actual container for distance data */
 
   /// \brief Structure used to hold propagation frontier
@@ -0,0 +1,126 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_DISTANCE_FIELD_SENSOR_FRUSTUM_
+#define MOVEIT_DISTANCE_FIELD_SENSOR_FRUSTUM_
+
+#include <moveit/distance_field/distance_field.h>
+#include <moveit/sensor_manager/sensor_manager.h>
+#include <geometric_shapes/shapes.h>
+#include <Eigen/Geometry>
+#include <eigen_stl_containers/eigen_stl_containers.h>
+
+namespace distance_field
+{
+
+/**
+ * \brief The volume observed by a sensor, computed once from its
+ * moveit_sensor_manager::SensorInfo and reused for any sensor pose.
+ *
+ * The frustum is expressed in the sensor frame: the sensor looks
+ * along Z, observations start at SensorInfo::min_dist and end at
+ * SensorInfo::max_dist, and SensorInfo::x_angle and
+ * SensorInfo::y_angle are the full opening angles about the Y and X
+ * axes. Besides containment tests, the frustum provides a mesh that
+ * can be added to a collision world, and visibility queries that
+ * march along rays through a distance field to find occlusions.
+ */
+class SensorFrustum
+{
+public:
+
+  SensorFrustum(const moveit_sensor_manager::SensorInfo &info);
+
+  const moveit_sensor_manager::SensorInfo& getSensorInfo() const
+  {
+    return info_;
+  }
+
+  /**
+   * \brief Get a mesh of the frustum in the sensor frame. The mesh is
+   * shared by all callers and never changes.
+   */
+  const shapes::ShapeConstPtr& getShape() const
+  {
+    return shape_;
+  }
+
+  /** \brief Check whether \e point (in the sensor frame) is inside the frustum */
+  bool contains(const Eigen::Vector3d &point) const;
+
+  /** \brief Check whether \e point (in the world frame) is inside the frustum of a sensor at \e sensor_pose */
+  bool contains(const Eigen::Affine3d &sensor_pose, const Eigen::Vector3d &point) const
+  {
+    return contains(sensor_pose.inverse() * point);
+  }
+
+  /**
+   * \brief Check whether \e point (in the frame of \e df) can be
+   * observed by a sensor at \e sensor_pose: the point must be in
+   * the frustum and the segment from the sensor to the point must
+   * not pass through an obstacle of \e df.
+   *
+   * The segment is sphere traced: each step advances by the distance
+   * to the closest obstacle, so free space is crossed in a few steps.
+   * The part of the segment closer than \e tolerance to the point is
+   * not checked, so points on the surface of obstacles are visible.
+   * The part closer to the sensor than SensorInfo::min_dist is not
+   * checked either, so the sensor's own mount does not occlude it.
+   */
+  bool isVisible(const Eigen::Affine3d &sensor_pose, const Eigen::Vector3d &point, const DistanceField &df, double tolerance) const;
+
+  /** \brief Calls isVisible() with the resolution of \e df as the tolerance */
+  bool isVisible(const Eigen::Affine3d &sensor_pose, const Eigen::Vector3d &point, const DistanceField &df) const
+  {
+    return isVisible(sensor_pose, point, df, df.getResolution());
+  }
+
+  /**
+   * \brief Get the fraction of the points of a region (in the frame
+   * of \e df) that are visible from \e sensor_pose, as defined by
+   * isVisible(). Returns 0 for an empty region.
+   */
+  double getVisibleFraction(const Eigen::Affine3d &sensor_pose, const EigenSTL::vector_Vector3d &region, const DistanceField &df) const;
+
+private:
+
+  moveit_sensor_manager::SensorInfo info_;
+  double tan_x_;
+  double tan_y_;
+  shapes::ShapeConstPtr shape_;
+};
+
+}
+
+#endif
@@ -39,6 +39,8 @@
 
 #include <algorithm>
 #include <cmath>
+#include <vector>
+#include <cstddef>
 
 namespace distance_field
 {
@@ -55,11 +57,30 @@ enum Dimension {
  * given resolution, where the data is supplied as a template
  * parameter.
  *
+ * The grid can optionally be stored sparsely, as blocks of
+ * BLOCK_SIZE^3 cells that are only allocated when a cell in them is
+ * accessed for writing.  Cells in blocks that were never written
+ * hold the value the grid was last reset to.  This is useful for
+ * large volumes where only a small part of the cells is ever
+ * modified.
+ *
  */
 template <typename T>
 class VoxelGrid
 {
 public:
+
+  /**
+   * \brief Function called for every cell of a newly allocated block
+   * of a sparse grid, after it is set to the reset value.  Allows
+   * cells to be initialized with values that depend on their
+   * location.
+   */
+  typedef void (*CellInitializer)(T& cell, int x, int y, int z);
+
+  static const int BLOCK_SIZE_BITS = 3; /**< \brief Log2 of the number of cells along each dimension of a block */
+  static const int BLOCK_SIZE = 1 << BLOCK_SIZE_BITS; /**< \brief Number of cells along each dimension of a block */
+
   /**
    * \brief Constructor for the VoxelGrid.
    *
@@ -84,9 +105,13 @@ public:
    *
    * @param [in] default_object An object that will be returned for any
    * future queries that are not valid
+   *
+   * @param [in] sparse Whether to allocate storage in blocks, only
+   * when cells are written
    */
   VoxelGrid(double size_x, double size_y, double size_z, double resolution,
-            double origin_x, double origin_y, double origin_z, T default_object);
+            double origin_x, double origin_y, double origin_z, T default_object,
+            bool sparse = false);
   virtual ~VoxelGrid();
 
   /**
@@ -113,9 +138,13 @@ public:
    * @param [in] origin_x Minimum point along the X axis of the volume
    * @param [in] origin_y Minimum point along the Y axis of the volume
    * @param [in] origin_z Minimum point along the Z axis of the volume
+   *
+   * @param [in] sparse Whether to allocate storage in blocks, only
+   * when cells are written
    */
   void resize(double size_x, double size_y, double size_z, double resolution,
-    double origin_x, double origin_y, double origin_z, T default_object);
+    double origin_x, double origin_y, double origin_z, T default_object,
+    bool sparse = false);
 
   /**
    * \brief Operator that gets the value of the given location (x, y,
@@ -146,8 +175,10 @@ public:
    * @param [in] y The Y index of the desired cell
    * @param [in] z The Z index of the desired cell
    *
-   * @return The data in the indicated cell, or a default value
-   * supplied in the constructor if the location is not valid.
+   * For a sparse grid, this allocates the block containing the cell
+   * if needed.  Use the const version to only read the cell.
+   *
+   * @return The data in the indicated cell.  No validity check.
    */
   T& getCell(int x, int y, int z);
 
@@ -173,16 +204,65 @@ public:
 
   /**
    * The const version of the the function in \ref VoxelGrid::getCell(int x, int y, int z).
+   * For a sparse grid, cells in blocks that are not allocated hold
+   * the value the grid was last reset to.
    */
   const T& getCell(int x, int y, int z) const;
 
+  /**
+   * \brief Gets a copy of the given cell.  Unlike the const
+   * getCell(), for a cell in a block of a sparse grid that is not
+   * allocated, this is the value the cell would have once its block
+   * is allocated, including the effect of the cell initializer.
+   *
+   * @param [in] x The X index of the desired cell
+   * @param [in] y The Y index of the desired cell
+   * @param [in] z The Z index of the desired cell
+   *
+   * @return A copy of the data in the indicated cell.  No validity check.
+   */
+  T getCellValue(int x, int y, int z) const;
+
   /**
    * \brief Sets every cell in the voxel grid to the supplied data
    *
+   * For a sparse grid, this frees all the blocks.
+   *
    * @param [in] initial The template variable to which to set the data
    */
   void reset(const T& initial);
 
+  /**
+   * \brief Whether the grid is stored in blocks that are allocated
+   * on demand
+   */
+  bool isSparse() const;
+
+  /**
+   * \brief Sets the function used for the cells of newly allocated
+   * blocks of a sparse grid.  Has no effect on dense grids.
+   *
+   * @param [in] initializer The function, or NULL for none
+   */
+  void setCellInitializer(CellInitializer initializer);
+
+  /**
+   * \brief Gets the number of blocks currently allocated for a
+   * sparse grid
+   *
+   * @return The number of allocated blocks; 0 for a dense grid
+   */
+  std::size_t getNumAllocatedBlocks() const;
+
+  /**
+   * \brief Gets an estimate of the memory held by the grid: the
+   * cells (only the allocated blocks, for a sparse grid) and the
+   * table of blocks
+   *
+   * @return The number of bytes
+   */
+  std::size_t getMemoryUsage() const;
+
   /**
    * \brief Gets the size in arbitrary units of the indicated dimension
    *
@@ -292,6 +372,33 @@ protected:
   int num_cells_total_;         /**< \brief The total number of voxels in the grid */
   int stride1_;                 /**< \brief The step to take when stepping between consecutive X members in the 1D array */
   int stride2_;                 /**< \brief The step to take when stepping between consecutive Y members given an X in the 1D array */
+  bool sparse_;                 /**< \brief Whether the data is stored in blocks allocated on demand */
+  T fill_object_;               /**< \brief The value of cells in blocks that are not allocated */
+  std::vector<T*> blocks_;      /**< \brief Storage for the blocks of a sparse grid; NULL if not allocated */
+  int num_blocks_[3];           /**< \brief The number of blocks in each dimension (in Dimension order) */
+  std::size_t num_allocated_blocks_; /**< \brief The number of blocks that are allocated */
+  CellInitializer cell_initializer_; /**< \brief Called for each cell of a newly allocated block */
+
+  /**
+   * \brief Gets the index of the block containing a cell, with no
+   * validity check.
+   */
+  int blockRef(int x, int y, int z) const;
+
+  /**
+   * \brief Gets the index of a cell within its block.
+   */
+  int inBlockRef(int x, int y, int z) const;
+
+  /**
+   * \brief Allocates and initializes the block containing a cell.
+   */
+  T* allocateBlock(int x, int y, int z);
+
+  /**
+   * \brief Frees all the blocks of a sparse grid.
+   */
+  void clearBlocks();
 
   /**
    * \brief Gets the 1D index into the array, with no validity check.
@@ -335,15 +442,21 @@ protected:
 
 template<typename T>
 VoxelGrid<T>::VoxelGrid(double size_x, double size_y, double size_z, double resolution,
-    double origin_x, double origin_y, double origin_z, T default_object)
+    double origin_x, double origin_y, double origin_z, T default_object, bool sparse)
   : data_(NULL)
+  , sparse_(false)
+  , num_allocated_blocks_(0)
+  , cell_initializer_(NULL)
 {
-  resize(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, default_object);
+  resize(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, default_object, sparse);
 }
 
 template<typename T>
 VoxelGrid<T>::VoxelGrid()
   : data_(NULL)
+  , sparse_(false)
+  , num_allocated_blocks_(0)
+  , cell_initializer_(NULL)
 {
   for (int i=DIM_X; i<=DIM_Z; ++i)
   {
@@ -351,6 +464,7 @@ VoxelGrid<T>::VoxelGrid()
     origin_[i] = 0;
     origin_minus_[i] = 0;
     num_cells_[i] = 0;
+    num_blocks_[i] = 0;
   }
   resolution_ = 1.0;
   oo_resolution_ = 1.0 / resolution_;
@@ -361,10 +475,12 @@ VoxelGrid<T>::VoxelGrid()
 
 template<typename T>
 void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double resolution,
-    double origin_x, double origin_y, double origin_z, T default_object)
+    double origin_x, double origin_y, double origin_z, T default_object, bool sparse)
 {
   delete[] data_;
   data_ = NULL;
+  clearBlocks();
+  blocks_.clear();
 
   size_[DIM_X] = size_x;
   size_[DIM_Y] = size_y;
@@ -389,15 +505,57 @@ void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double re
   stride1_ = num_cells_[DIM_Y]*num_cells_[DIM_Z];
   stride2_ = num_cells_[DIM_Z];
 
+  sparse_ = sparse;
+  fill_object_ = default_object;
+  for (int i=DIM_X; i<=DIM_Z; ++i)
+    num_blocks_[i] = (num_cells_[i] + BLOCK_SIZE - 1) >> BLOCK_SIZE_BITS;
+
   // initialize the data:
   if (num_cells_total_ > 0)
-    data_ = new T[num_cells_total_];
+  {
+    if (sparse_)
+      blocks_.resize(num_blocks_[DIM_X] * num_blocks_[DIM_Y] * num_blocks_[DIM_Z], NULL);
+    else
+      data_ = new T[num_cells_total_];
+  }
 }
 
 template<typename T>
 VoxelGrid<T>::~VoxelGrid()
 {
   delete[] data_;
+  clearBlocks();
+}
+
+template<typename T>
+void VoxelGrid<T>::clearBlocks()
+{
+  for (std::size_t i = 0 ; i < blocks_.size() ; ++i)
+  {
+    delete[] blocks_[i];
+    blocks_[i] = NULL;
+  }
+  num_allocated_blocks_ = 0;
+}
+
+template<typename T>
+T* VoxelGrid<T>::allocateBlock(int x, int y, int z)
+{
+  T* block = new T[BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE];
+  std::fill(block, block + BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE, fill_object_);
+  if (cell_initializer_)
+  {
+    int bx = x & ~(BLOCK_SIZE - 1);
+    int by = y & ~(BLOCK_SIZE - 1);
+    int bz = z & ~(BLOCK_SIZE - 1);
+    for (int i = 0 ; i < BLOCK_SIZE ; ++i)
+      for (int j = 0 ; j < BLOCK_SIZE ; ++j)
+        for (int k = 0 ; k < BLOCK_SIZE ; ++k)
+          cell_initializer_(block[inBlockRef(i, j, k)], bx + i, by + j, bz + k);
+  }
+  blocks_[blockRef(x, y, z)] = block;
+  ++num_allocated_blocks_;
+  return block;
 }
 
 template<typename T>
@@ -421,6 +579,47 @@ inline int VoxelGrid<T>::ref(int x, int y, int z) const
   return x*stride1_ + y*stride2_ + z;
 }
 
+template<typename T>
+inline int VoxelGrid<T>::blockRef(int x, int y, int z) const
+{
+  return ((x >> BLOCK_SIZE_BITS) * num_blocks_[DIM_Y] + (y >> BLOCK_SIZE_BITS)) * num_blocks_[DIM_Z] + (z >> BLOCK_SIZE_BITS);
+}
+
+template<typename T>
+inline int VoxelGrid<T>::inBlockRef(int x, int y, int z) const
+{
+  return (((x & (BLOCK_SIZE - 1)) << BLOCK_SIZE_BITS) + (y & (BLOCK_SIZE - 1))) << BLOCK_SIZE_BITS | (z & (BLOCK_SIZE - 1));
+}
+
+template<typename T>
+inline bool VoxelGrid<T>::isSparse() const
+{
+  return sparse_;
+}
+
+template<typename T>
+inline void VoxelGrid<T>::setCellInitializer(CellInitializer initializer)
+{
+  cell_initializer_ = initializer;
+}
+
+template<typename T>
+inline std::size_t VoxelGrid<T>::getNumAllocatedBlocks() const
+{
+  return num_allocated_blocks_;
+}
+
+template<typename T>
+std::size_t VoxelGrid<T>::getMemoryUsage() const
+{
+  std::size_t bytes = sizeof(*this) + blocks_.capacity() * sizeof(T*);
+  if (sparse_)
+    bytes += num_allocated_blocks_ * BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE * sizeof(T);
+  else if (data_)
+    bytes += (std::size_t)num_cells_total_ * sizeof(T);
+  return bytes;
+}
+
 template<typename T>
 inline double VoxelGrid<T>::getSize(Dimension dim) const
 {
@@ -465,19 +664,41 @@ inline const T& VoxelGrid<T>::operator()(double x, double y, double z) const
 template<typename T>
 inline T& VoxelGrid<T>::getCell(int x, int y, int z)
 {
-  return data_[ref(x,y,z)];
+  if (!sparse_)
+    return data_[ref(x,y,z)];
+  T* block = blocks_[blockRef(x,y,z)];
+  if (!block)
+    block = allocateBlock(x,y,z);
+  return block[inBlockRef(x,y,z)];
 }
 
 template<typename T>
 inline const T& VoxelGrid<T>::getCell(int x, int y, int z) const
 {
-  return data_[ref(x,y,z)];
+  if (!sparse_)
+    return data_[ref(x,y,z)];
+  const T* block = blocks_[blockRef(x,y,z)];
+  return block ? block[inBlockRef(x,y,z)] : fill_object_;
+}
+
+template<typename T>
+inline T VoxelGrid<T>::getCellValue(int x, int y, int z) const
+{
+  if (!sparse_)
+    return data_[ref(x,y,z)];
+  const T* block = blocks_[blockRef(x,y,z)];
+  if (block)
+    return block[inBlockRef(x,y,z)];
+  T cell = fill_object_;
+  if (cell_initializer_)
+    cell_initializer_(cell, x, y, z);
+  return cell;
 }
 
 template<typename T>
 inline void VoxelGrid<T>::setCell(int x, int y, int z, const T& obj)
 {
-  data_[ref(x,y,z)] = obj;
+  getCell(x,y,z) = obj;
 }
 
 template<typename T>
@@ -510,7 +731,13 @@ inline double VoxelGrid<T>::getLocationFromCell(Dimension dim, int cell) const
 template<typename T>
 inline void VoxelGrid<T>::reset(const T& initial)
 {
-  std::fill(data_, data_ + num_cells_total_, initial);
+  if (sparse_)
+  {
+    clearBlocks();
+    fill_object_ = initial;
+  }
+  else
+    std::fill(data_, data_ + num_cells_total_, initial);
 }
 
 template<typename T>
@@ -0,0 +1,147 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_DISTANCE_FIELD_WORLD_DISTANCE_FIELD_
+#define MOVEIT_DISTANCE_FIELD_WORLD_DISTANCE_FIELD_
+
+#include <moveit/distance_field/distance_field.h>
+#include <moveit/collision_detection/world.h>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <map>
+
+namespace distance_field
+{
+
+/**
+ * \brief Keeps a DistanceField up to date with the objects of a
+ * collision_detection::World.
+ *
+ * The object observes the world.  When objects are added, moved or
+ * removed, only the cells whose occupancy changes are passed to \ref
+ * DistanceField::updatePointsInField, so only the affected regions
+ * are propagated again.  The number of objects occupying each cell is
+ * counted, so removing an object does not remove cells that other
+ * objects still occupy.
+ */
+class WorldDistanceField : private boost::noncopyable
+{
+public:
+
+  /**
+   * \brief Constructor.  Adds the objects already in \e world to \e
+   * field, which must not contain other obstacles when obstacles are
+   * later removed.
+   *
+   * @param [in] world The world to observe
+   * @param [in] field The distance field to maintain
+   */
+  WorldDistanceField(const collision_detection::WorldPtr& world,
+                     const boost::shared_ptr<DistanceField>& field);
+
+  ~WorldDistanceField();
+
+  /**
+   * \brief Observes a different world.  The objects of the previous
+   * world that are not in the new one are removed from the field.
+   *
+   * @param [in] world The world to observe
+   */
+  void setWorld(const collision_detection::WorldPtr& world);
+
+  /**
+   * \brief Gets the world that is observed.
+   */
+  const collision_detection::WorldPtr& getWorld() const
+  {
+    return world_;
+  }
+
+  /**
+   * \brief Gets the distance field that is maintained.
+   */
+  const boost::shared_ptr<DistanceField>& getDistanceField() const
+  {
+    return field_;
+  }
+
+  /**
+   * \brief Gets the ids of the objects that occupy a cell of the
+   * field.
+   *
+   * @param [in] x The X index of the cell
+   * @param [in] y The Y index of the cell
+   * @param [in] z The Z index of the cell
+   * @param [out] ids The ids of the objects occupying the cell
+   */
+  void getObjectsAtCell(int x, int y, int z, std::vector<std::string>& ids) const;
+
+  /**
+   * \brief Gets an estimate of the memory held by the maintained
+   * distance field and by the bookkeeping of the cells occupied by
+   * each object.
+   *
+   * @return The number of bytes
+   */
+  std::size_t getMemoryUsage() const;
+
+private:
+
+  /** \brief Callback for changes of the world */
+  void notify(const collision_detection::World::ObjectConstPtr& obj, collision_detection::World::Action action);
+
+  /** \brief Sets the cells occupied by an object and updates the field accordingly */
+  void updateObject(const std::string& id, std::vector<int>& cells);
+
+  /** \brief Computes the sorted indices of the cells occupied by an object */
+  void computeCells(const collision_detection::World::Object& obj, std::vector<int>& cells) const;
+
+  /** \brief Gets the center of the cell with the given index */
+  Eigen::Vector3d getCellCenter(int index) const;
+
+  collision_detection::WorldPtr                  world_;           /**< \brief The world that is observed */
+  collision_detection::World::ObserverHandle     observer_handle_; /**< \brief The handle of the observer on world_ */
+  boost::shared_ptr<DistanceField>               field_;           /**< \brief The distance field that is maintained */
+  std::map<std::string, std::vector<int> >       object_cells_;    /**< \brief The cells occupied by each object, sorted */
+  boost::unordered_map<int, unsigned int>        cell_counts_;     /**< \brief The number of objects occupying each cell */
+};
+
+typedef boost::shared_ptr<WorldDistanceField> WorldDistanceFieldPtr;
+typedef boost::shared_ptr<const WorldDistanceField> WorldDistanceFieldConstPtr;
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/distance_field/compact_distance_field.h>
+#include <console_bridge/console.h>
+
+namespace distance_field
+{
+
+namespace
+{
+// offset from a cell to its closest point, or UNDEFINED_OFFSET if it cannot be represented
+void packClosestPoint(const Eigen::Vector3i& closest, int x, int y, int z, signed char* offset)
+{
+  int d[3] = { closest.x() - x, closest.y() - y, closest.z() - z };
+  bool valid = closest.x() != PropDistanceFieldVoxel::UNINITIALIZED;
+  for (int i = 0 ; valid && i < 3 ; ++i)
+    valid = d[i] >= -CompactPropDistanceFieldVoxel::MAX_OFFSET && d[i] <= CompactPropDistanceFieldVoxel::MAX_OFFSET;
+  for (int i = 0 ; i < 3 ; ++i)
+    if (valid)
+      offset[i] = d[i];
+    else
+      offset[i] = CompactPropDistanceFieldVoxel::UNDEFINED_OFFSET;
+}
+}
+
+CompactDistanceField::CompactDistanceField(const PropagationDistanceField& df) :
+  DistanceField(df.getSizeX(), df.getSizeY(), df.getSizeZ(), df.getResolution(),
+                df.getOriginX(), df.getOriginY(), df.getOriginZ()),
+  max_distance_(df.getUninitializedDistance()),
+  max_distance_sq_(df.getMaximumDistanceSquared())
+{
+  if (max_distance_sq_ > CompactPropDistanceFieldVoxel::MAX_DISTANCE_SQ)
+  {
+    logError("Maximum distance of %d cells cannot be represented in a compact distance field; distances are clamped to %d cells",
+             (int)ceil(max_distance_ / resolution_), CompactPropDistanceFieldVoxel::MAX_OFFSET);
+    max_distance_sq_ = CompactPropDistanceFieldVoxel::MAX_DISTANCE_SQ;
+  }
+
+  voxel_grid_.reset(new VoxelGrid<CompactPropDistanceFieldVoxel>(size_x_, size_y_, size_z_,
+                                                                 resolution_,
+                                                                 origin_x_, origin_y_, origin_z_,
+                                                                 CompactPropDistanceFieldVoxel(max_distance_sq_, 0)));
+
+  sqrt_table_.resize(max_distance_sq_+1);
+  for (int i=0; i<=max_distance_sq_; ++i)
+    sqrt_table_[i] = sqrt(double(i))*resolution_;
+
+  for (int x = 0; x < getXNumCells(); ++x)
+    for (int y = 0; y < getYNumCells(); ++y)
+      for (int z = 0; z < getZNumCells(); ++z)
+      {
+        const PropDistanceFieldVoxel& voxel = df.getCell(x, y, z);
+        CompactPropDistanceFieldVoxel& compact = voxel_grid_->getCell(x, y, z);
+        compact.distance_square_ = std::min(voxel.distance_square_, max_distance_sq_);
+        compact.negative_distance_square_ = std::min(voxel.negative_distance_square_, max_distance_sq_);
+        packClosestPoint(voxel.closest_point_, x, y, z, compact.closest_point_offset_);
+        packClosestPoint(voxel.closest_negative_point_, x, y, z, compact.closest_negative_point_offset_);
+      }
+}
+
+CompactDistanceField::~CompactDistanceField()
+{
+}
+
+void CompactDistanceField::addPointsToField(const EigenSTL::vector_Vector3d &points)
+{
+  logError("Cannot add points to a compact distance field");
+}
+
+void CompactDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d &points)
+{
+  logError("Cannot remove points from a compact distance field");
+}
+
+void CompactDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                               const EigenSTL::vector_Vector3d& new_points)
+{
+  logError("Cannot update points in a compact distance field");
+}
+
+void CompactDistanceField::reset()
+{
+  voxel_grid_->reset(CompactPropDistanceFieldVoxel(max_distance_sq_, 0));
+}
+
+double CompactDistanceField::getDistance(double x, double y, double z) const
+{
+  return getDistance((*voxel_grid_.get())(x,y,z));
+}
+
+double CompactDistanceField::getDistance(int x, int y, int z) const
+{
+  return getDistance(voxel_grid_->getCell(x,y,z));
+}
+
+bool CompactDistanceField::isCellValid(int x, int y, int z) const
+{
+  return voxel_grid_->isCellValid(x,y,z);
+}
+
+int CompactDistanceField::getXNumCells() const
+{
+  return voxel_grid_->getNumCells(DIM_X);
+}
+
+int CompactDistanceField::getYNumCells() const
+{
+  return voxel_grid_->getNumCells(DIM_Y);
+}
+
+int CompactDistanceField::getZNumCells() const
+{
+  return voxel_grid_->getNumCells(DIM_Z);
+}
+
+bool CompactDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  return voxel_grid_->gridToWorld(x, y, z, world_x, world_y, world_z);
+}
+
+bool CompactDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  return voxel_grid_->worldToGrid(world_x, world_y, world_z, x, y, z);
+}
+
+bool CompactDistanceField::writeToStream(std::ostream& stream) const
+{
+  logError("Writing a compact distance field is not supported; write the PropagationDistanceField it was built from");
+  return false;
+}
+
+bool CompactDistanceField::readFromStream(std::istream& stream)
+{
+  logError("Cannot read into a compact distance field; read a PropagationDistanceField and pack it");
+  return false;
+}
+
+std::size_t CompactDistanceField::getMemoryUsage() const
+{
+  return sizeof(*this) + voxel_grid_->getMemoryUsage() + sqrt_table_.capacity() * sizeof(double);
+}
+
+bool CompactDistanceField::getClosestCell(int x, int y, int z, Eigen::Vector3i& closest, bool negative) const
+{
+  if (!isCellValid(x, y, z))
+    return false;
+  const CompactPropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x, y, z);
+  const signed char* offset = negative ? voxel.closest_negative_point_offset_ : voxel.closest_point_offset_;
+  if (offset[0] == CompactPropDistanceFieldVoxel::UNDEFINED_OFFSET)
+    return false;
+  closest = Eigen::Vector3i(x + offset[0], y + offset[1], z + offset[2]);
+  return true;
+}
+
+}
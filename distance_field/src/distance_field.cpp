@@ -41,10 +41,78 @@
 #include <console_bridge/console.h>
 #include <octomap/octomap.h>
 #include <octomap/OcTree.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 namespace distance_field
 {
 
+namespace
+{
+
+// meshes with fewer triangles are voxelized on the calling thread
+const unsigned int MIN_PARALLEL_TRIANGLES = 1024;
+
+// separating axis test of a triangle against an axis-aligned cube (Akenine-Moller)
+bool triangleOverlapsCube(const Eigen::Vector3d& center, double half_size, const Eigen::Vector3d* triangle)
+{
+  const Eigen::Vector3d v[3] = { triangle[0] - center, triangle[1] - center, triangle[2] - center };
+
+  // the axes of the cube
+  for (int i = 0 ; i < 3 ; ++i)
+    if (std::min(v[0][i], std::min(v[1][i], v[2][i])) > half_size ||
+        std::max(v[0][i], std::max(v[1][i], v[2][i])) < -half_size)
+      return false;
+
+  // the normal of the triangle
+  const Eigen::Vector3d e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+  Eigen::Vector3d normal = e[0].cross(e[1]);
+  if (fabs(normal.dot(v[0])) > half_size * normal.cwiseAbs().sum())
+    return false;
+
+  // the cross products of the axes of the cube and the edges of the triangle
+  for (int i = 0 ; i < 3 ; ++i)
+    for (int j = 0 ; j < 3 ; ++j)
+    {
+      Eigen::Vector3d axis = Eigen::Vector3d::Unit(i).cross(e[j]);
+      double p0 = axis.dot(v[0]), p1 = axis.dot(v[1]), p2 = axis.dot(v[2]);
+      double r = half_size * axis.cwiseAbs().sum();
+      if (std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r)
+        return false;
+    }
+  return true;
+}
+
+// finds the cells overlapping the triangles [begin, end) of a mesh with transformed vertices;
+// cells are not clipped to the field so that the interior of meshes crossing its border can be found
+void scanConvertTriangles(const DistanceField* field, const shapes::Mesh* mesh, const EigenSTL::vector_Vector3d* vertices,
+                          unsigned int begin, unsigned int end, std::vector<Eigen::Vector3i>* cells)
+{
+  const double half_size = field->getResolution() / 2.0;
+  for (unsigned int t = begin ; t < end ; ++t)
+  {
+    const Eigen::Vector3d triangle[3] = { (*vertices)[mesh->triangles[3 * t]],
+                                          (*vertices)[mesh->triangles[3 * t + 1]],
+                                          (*vertices)[mesh->triangles[3 * t + 2]] };
+    Eigen::Vector3d lower = triangle[0].cwiseMin(triangle[1]).cwiseMin(triangle[2]);
+    Eigen::Vector3d upper = triangle[0].cwiseMax(triangle[1]).cwiseMax(triangle[2]);
+    Eigen::Vector3i lower_cell, upper_cell;
+    field->worldToGrid(lower.x(), lower.y(), lower.z(), lower_cell.x(), lower_cell.y(), lower_cell.z());
+    field->worldToGrid(upper.x(), upper.y(), upper.z(), upper_cell.x(), upper_cell.y(), upper_cell.z());
+    for (int x = lower_cell.x() ; x <= upper_cell.x() ; ++x)
+      for (int y = lower_cell.y() ; y <= upper_cell.y() ; ++y)
+        for (int z = lower_cell.z() ; z <= upper_cell.z() ; ++z)
+        {
+          Eigen::Vector3d center;
+          field->gridToWorld(x, y, z, center.x(), center.y(), center.z());
+          if (triangleOverlapsCube(center, half_size, triangle))
+            cells->push_back(Eigen::Vector3i(x, y, z));
+        }
+  }
+}
+
+}
+
 DistanceField::DistanceField(double size_x, double size_y, double size_z, double resolution,
                              double origin_x, double origin_y, double origin_z) :
   size_x_(size_x),
@@ -54,7 +122,8 @@ DistanceField::DistanceField(double size_x, double size_y, double size_z, double
   origin_y_(origin_y),
   origin_z_(origin_z),
   resolution_(resolution),
-  inv_twice_resolution_(1.0/(2.0*resolution_))
+  inv_twice_resolution_(1.0/(2.0*resolution_)),
+  fill_meshes_(true)
 {
 }
 
@@ -88,6 +157,31 @@ double DistanceField::getDistanceGradient(double x, double y, double z, double&
   return getDistance(gx,gy,gz);
 }
 
+void DistanceField::getDistances(const EigenSTL::vector_Vector3d& points,
+                                 std::vector<double>& distances) const
+{
+  distances.resize(points.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    distances[i] = getDistance(points[i].x(), points[i].y(), points[i].z());
+}
+
+void DistanceField::getDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                         std::vector<double>& distances,
+                                         EigenSTL::vector_Vector3d& gradients,
+                                         std::vector<bool>& in_bounds) const
+{
+  distances.resize(points.size());
+  gradients.resize(points.size());
+  in_bounds.resize(points.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    bool valid;
+    distances[i] = getDistanceGradient(points[i].x(), points[i].y(), points[i].z(),
+                                       gradients[i].x(), gradients[i].y(), gradients[i].z(), valid);
+    in_bounds[i] = valid;
+  }
+}
+
 void DistanceField::getIsoSurfaceMarkers(double min_distance, double max_distance,
                                          const std::string & frame_id, const ros::Time stamp,
                                          visualization_msgs::Marker& inf_marker) const
@@ -212,25 +306,100 @@ void DistanceField::addShapeToField(const shapes::Shape* shape,
     }
     addOcTreeToField(oc->octree.get());
   } else {
-    bodies::Body* body = bodies::createBodyFromShape(shape);
     Eigen::Affine3d pose_e;
     tf::poseMsgToEigen(pose, pose_e);
-    body->setPose(pose_e);
-    EigenSTL::vector_Vector3d point_vec = determineCollisionPoints(body, resolution_);
-    delete body;
+    EigenSTL::vector_Vector3d point_vec;
+    getShapePoints(shape, pose_e, point_vec);
     addPointsToField(point_vec);
   }
 }
 
 void DistanceField::addOcTreeToField(const octomap::OcTree* octree)
 {
+  std::vector<CellBox> boxes;
+  getOcTreeCellBoxes(octree, boxes);
+  addCellBoxesToField(boxes);
+}
+
+void DistanceField::addCellBoxesToField(const std::vector<CellBox>& boxes)
+{
+  EigenSTL::vector_Vector3d points;
+  getCellBoxPoints(boxes, points);
+  addPointsToField(points);
+}
+
+void DistanceField::getCellBoxPoints(const std::vector<CellBox>& boxes,
+                                     EigenSTL::vector_Vector3d& points) const
+{
+  for (std::size_t i = 0 ; i < boxes.size() ; ++i)
+    for (int x = boxes[i].first.x() ; x <= boxes[i].second.x() ; ++x)
+      for (int y = boxes[i].first.y() ; y <= boxes[i].second.y() ; ++y)
+        for (int z = boxes[i].first.z() ; z <= boxes[i].second.z() ; ++z)
+        {
+          Eigen::Vector3d point;
+          gridToWorld(x, y, z, point.x(), point.y(), point.z());
+          points.push_back(point);
+        }
+}
+
+void DistanceField::getOcTreeCellBoxes(const octomap::OcTree* octree,
+                                       std::vector<CellBox>& boxes) const
+{
+  const double origin[3] = { origin_x_, origin_y_, origin_z_ };
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  // cell centers lying on the border of two leaves go to the upper
+  // one; the tolerance, in cells, absorbs the float coordinates of octomap
+  const double eps = 1e-3;
+
+  octomap::point3d bbx_min(origin_x_ - 0.5 * resolution_, origin_y_ - 0.5 * resolution_, origin_z_ - 0.5 * resolution_);
+  octomap::point3d bbx_max(origin_x_ + (num_cells[0] - 0.5) * resolution_,
+                           origin_y_ + (num_cells[1] - 0.5) * resolution_,
+                           origin_z_ + (num_cells[2] - 0.5) * resolution_);
+
+  for(octomap::OcTree::leaf_bbx_iterator it = octree->begin_leafs_bbx(bbx_min,bbx_max),
+        end=octree->end_leafs_bbx(); it!= end; ++it)
+  {
+    if (!octree->isNodeOccupied(*it))
+      continue;
+    const double center[3] = { it.getX(), it.getY(), it.getZ() };
+    const double half_size = 0.5 * it.getSize();
+    CellBox box;
+    bool empty = false;
+    for (int d = 0 ; d < 3 ; ++d)
+    {
+      // the cells whose centers lie within the leaf
+      int lower = (int)ceil((center[d] - half_size - origin[d]) / resolution_ - eps);
+      int upper = (int)ceil((center[d] + half_size - origin[d]) / resolution_ - eps) - 1;
+      // a leaf smaller than a cell occupies the cell containing its center
+      if (upper < lower)
+        lower = upper = (int)floor((center[d] - origin[d]) / resolution_ + 0.5);
+      box.first[d] = std::max(lower, 0);
+      box.second[d] = std::min(upper, num_cells[d] - 1);
+      if (box.first[d] > box.second[d])
+        empty = true;
+    }
+    if (!empty)
+      boxes.push_back(box);
+  }
+}
+
+void DistanceField::getOcTreePoints(const octomap::OcTree* octree,
+                                    const Eigen::Affine3d& pose,
+                                    EigenSTL::vector_Vector3d& points) const
+{
+  if (pose.isApprox(Eigen::Affine3d::Identity()))
+  {
+    std::vector<CellBox> boxes;
+    getOcTreeCellBoxes(octree, boxes);
+    getCellBoxPoints(boxes, points);
+    return;
+  }
+
   //lower extent
   double min_x, min_y, min_z;
   gridToWorld(0,0,0,
               min_x, min_y, min_z);
 
-  octomap::point3d bbx_min(min_x, min_y, min_z);
-
   int num_x = getXNumCells();
   int num_y = getYNumCells();
   int num_z = getZNumCells();
@@ -240,9 +409,19 @@ void DistanceField::addOcTreeToField(const octomap::OcTree* octree)
   gridToWorld(num_x, num_y, num_z,
               max_x, max_y, max_z);
 
-  octomap::point3d bbx_max(max_x, max_y, max_z);
+  // the extent of the field in the frame of the octree
+  Eigen::Affine3d inv_pose = pose.inverse();
+  Eigen::Vector3d lower = inv_pose * Eigen::Vector3d(min_x, min_y, min_z);
+  Eigen::Vector3d upper = lower;
+  for (int i = 1 ; i < 8 ; ++i)
+  {
+    Eigen::Vector3d corner = inv_pose * Eigen::Vector3d(i & 1 ? max_x : min_x, i & 2 ? max_y : min_y, i & 4 ? max_z : min_z);
+    lower = lower.cwiseMin(corner);
+    upper = upper.cwiseMax(corner);
+  }
 
-  EigenSTL::vector_Vector3d points;
+  octomap::point3d bbx_min(lower.x(), lower.y(), lower.z());
+  octomap::point3d bbx_max(upper.x(), upper.y(), upper.z());
 
   for(octomap::OcTree::leaf_bbx_iterator it = octree->begin_leafs_bbx(bbx_min,bbx_max),
         end=octree->end_leafs_bbx(); it!= end; ++it)
@@ -250,21 +429,135 @@ void DistanceField::addOcTreeToField(const octomap::OcTree* octree)
     if (octree->isNodeOccupied(*it))
     {
       if(it.getSize() <= resolution_) {
-        Eigen::Vector3d point(it.getX(), it.getY(), it.getZ());
-        points.push_back(point);
+        points.push_back(pose * Eigen::Vector3d(it.getX(), it.getY(), it.getZ()));
       } else {
-        double ceil_val = ceil(it.getSize()/resolution_)*resolution_;
-        for(double x = it.getX()-ceil_val; x < it.getX()+ceil_val; x += resolution_) {
-          for(double y = it.getY()-ceil_val; y < it.getY()+ceil_val; y += resolution_) {
-            for(double z = it.getZ()-ceil_val; z < it.getZ()+ceil_val; z += resolution_) {
-              points.push_back(Eigen::Vector3d(x,y,z));
+        // samples spaced by the resolution of the field, centered in the leaf
+        int samples = (int)ceil(it.getSize() / resolution_);
+        double first = -0.5 * (samples - 1) * resolution_;
+        for(int x = 0; x < samples; ++x) {
+          for(int y = 0; y < samples; ++y) {
+            for(int z = 0; z < samples; ++z) {
+              points.push_back(pose * Eigen::Vector3d(it.getX() + first + x * resolution_,
+                                                      it.getY() + first + y * resolution_,
+                                                      it.getZ() + first + z * resolution_));
             }
           }
         }
       }
     }
   }
-  addPointsToField(points);
+}
+
+void DistanceField::getMeshPoints(const shapes::Mesh* mesh,
+                                  const Eigen::Affine3d& pose,
+                                  EigenSTL::vector_Vector3d& points) const
+{
+  EigenSTL::vector_Vector3d vertices(mesh->vertex_count);
+  for (unsigned int i = 0 ; i < mesh->vertex_count ; ++i)
+    vertices[i] = pose * Eigen::Vector3d(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
+
+  // the triangles are split among threads for large meshes
+  unsigned int num_threads = 1;
+  if (mesh->triangle_count >= MIN_PARALLEL_TRIANGLES)
+    num_threads = std::max(1u, std::min(boost::thread::hardware_concurrency(), mesh->triangle_count / MIN_PARALLEL_TRIANGLES));
+  std::vector<std::vector<Eigen::Vector3i> > thread_cells(num_threads);
+  if (num_threads == 1)
+    scanConvertTriangles(this, mesh, &vertices, 0, mesh->triangle_count, &thread_cells[0]);
+  else
+  {
+    boost::thread_group threads;
+    for (unsigned int t = 0 ; t < num_threads ; ++t)
+      threads.create_thread(boost::bind(&scanConvertTriangles, this, mesh, &vertices,
+                                        (unsigned int)((unsigned long long)mesh->triangle_count * t / num_threads),
+                                        (unsigned int)((unsigned long long)mesh->triangle_count * (t + 1) / num_threads),
+                                        &thread_cells[t]));
+    threads.join_all();
+  }
+
+  // mark the surface cells in a block covering the mesh, with one free cell of padding on each side
+  Eigen::Vector3i lower(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+  Eigen::Vector3i upper(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+  for (std::size_t t = 0 ; t < thread_cells.size() ; ++t)
+    for (std::size_t i = 0 ; i < thread_cells[t].size() ; ++i)
+    {
+      lower = lower.cwiseMin(thread_cells[t][i]);
+      upper = upper.cwiseMax(thread_cells[t][i]);
+    }
+  if (lower.x() > upper.x())
+    return;
+  lower -= Eigen::Vector3i::Ones();
+  upper += Eigen::Vector3i::Ones();
+  const Eigen::Vector3i dims = upper - lower + Eigen::Vector3i::Ones();
+
+  enum { UNKNOWN = 0, SURFACE = 1, OUTSIDE = 2 };
+  std::vector<char> block((std::size_t)dims.x() * dims.y() * dims.z(), UNKNOWN);
+  for (std::size_t t = 0 ; t < thread_cells.size() ; ++t)
+    for (std::size_t i = 0 ; i < thread_cells[t].size() ; ++i)
+    {
+      Eigen::Vector3i c = thread_cells[t][i] - lower;
+      block[((std::size_t)c.x() * dims.y() + c.y()) * dims.z() + c.z()] = SURFACE;
+    }
+
+  // the cells that cannot be reached from the padding without crossing the surface are inside
+  if (fill_meshes_)
+  {
+    std::vector<Eigen::Vector3i> stack(1, Eigen::Vector3i::Zero());
+    block[0] = OUTSIDE;
+    while (!stack.empty())
+    {
+      Eigen::Vector3i c = stack.back();
+      stack.pop_back();
+      for (int d = 0 ; d < 6 ; ++d)
+      {
+        Eigen::Vector3i n = c;
+        n[d / 2] += d % 2 ? 1 : -1;
+        if (n[d / 2] < 0 || n[d / 2] >= dims[d / 2])
+          continue;
+        char &state = block[((std::size_t)n.x() * dims.y() + n.y()) * dims.z() + n.z()];
+        if (state == UNKNOWN)
+        {
+          state = OUTSIDE;
+          stack.push_back(n);
+        }
+      }
+    }
+  }
+
+  std::size_t i = 0;
+  for (int x = 0 ; x < dims.x() ; ++x)
+    for (int y = 0 ; y < dims.y() ; ++y)
+      for (int z = 0 ; z < dims.z() ; ++z, ++i)
+        if (block[i] == SURFACE || (fill_meshes_ && block[i] == UNKNOWN))
+        {
+          Eigen::Vector3i c = lower + Eigen::Vector3i(x, y, z);
+          if (!isCellValid(c.x(), c.y(), c.z()))
+            continue;
+          Eigen::Vector3d point;
+          gridToWorld(c.x(), c.y(), c.z(), point.x(), point.y(), point.z());
+          points.push_back(point);
+        }
+}
+
+void DistanceField::getShapePoints(const shapes::Shape* shape,
+                                   const Eigen::Affine3d& pose,
+                                   EigenSTL::vector_Vector3d& points) const
+{
+  points.clear();
+  if(shape->type == shapes::OCTREE) {
+    const shapes::OcTree* oc = dynamic_cast<const shapes::OcTree*>(shape);
+    if(!oc) {
+      logError("Problem dynamic casting shape that claims to be OcTree");
+      return;
+    }
+    getOcTreePoints(oc->octree.get(), pose, points);
+  } else if(shape->type == shapes::MESH) {
+    getMeshPoints(static_cast<const shapes::Mesh*>(shape), pose, points);
+  } else {
+    bodies::Body* body = bodies::createBodyFromShape(shape);
+    body->setPose(pose);
+    points = determineCollisionPoints(body, resolution_);
+    delete body;
+  }
 }
 
 void DistanceField::moveShapeInField(const shapes::Shape* shape,
@@ -275,16 +568,14 @@ void DistanceField::moveShapeInField(const shapes::Shape* shape,
     logWarn("Move shape not supported for Octree");
     return;
   }
-  bodies::Body* body = bodies::createBodyFromShape(shape);
   Eigen::Affine3d old_pose_e;
   tf::poseMsgToEigen(old_pose, old_pose_e);
-  body->setPose(old_pose_e);
-  EigenSTL::vector_Vector3d old_point_vec = determineCollisionPoints(body, resolution_);
+  EigenSTL::vector_Vector3d old_point_vec;
+  getShapePoints(shape, old_pose_e, old_point_vec);
   Eigen::Affine3d new_pose_e;
   tf::poseMsgToEigen(new_pose, new_pose_e);
-  body->setPose(new_pose_e);
-  EigenSTL::vector_Vector3d new_point_vec = determineCollisionPoints(body, resolution_);
-  delete body;
+  EigenSTL::vector_Vector3d new_point_vec;
+  getShapePoints(shape, new_pose_e, new_point_vec);
   updatePointsInField(old_point_vec,
                       new_point_vec);
 }
@@ -292,12 +583,10 @@ void DistanceField::moveShapeInField(const shapes::Shape* shape,
 void DistanceField::removeShapeFromField(const shapes::Shape* shape,
                                          const geometry_msgs::Pose& pose)
 {
-  bodies::Body* body = bodies::createBodyFromShape(shape);
   Eigen::Affine3d pose_e;
   tf::poseMsgToEigen(pose, pose_e);
-  body->setPose(pose_e);
-  EigenSTL::vector_Vector3d point_vec = determineCollisionPoints(body, resolution_);
-  delete body;
+  EigenSTL::vector_Vector3d point_vec;
+  getShapePoints(shape, pose_e, point_vec);
   removePointsFromField(point_vec);
 }
 
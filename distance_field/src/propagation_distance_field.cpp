@@ -40,17 +40,88 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/unordered_set.hpp>
+#include <cstring>
+#include <iterator>
+#include <limits>
 
 namespace distance_field
 {
 
+namespace
+{
+// buckets with fewer cells are not worth splitting among threads
+const std::size_t MIN_PARALLEL_BUCKET_SIZE = 2048;
+
+// layout of the binary format: a BinaryHeader, followed by the cell data, optionally zlib compressed.
+// The cell data holds, for the cells in (x, y, z) order, the squared distances and negative squared
+// distances (uint16), the closest points and closest negative points (3 int16 per cell), and the update
+// directions and negative update directions (int8).  Each of these arrays is padded to a multiple of 8 bytes.
+const char BINARY_MAGIC[8] = { 'M', 'V', 'P', 'D', 'F', 'B', 0, 0 };
+const boost::uint32_t BINARY_VERSION = 1;
+const boost::uint32_t BINARY_BYTE_ORDER = 0x01020304;
+const boost::uint32_t BINARY_FLAG_COMPRESSED = 1;
+const boost::uint32_t BINARY_FLAG_NEGATIVE = 2;
+
+struct BinaryHeader
+{
+  char            magic_[8];
+  boost::uint32_t version_;
+  boost::uint32_t byte_order_;
+  boost::uint32_t flags_;
+  boost::int32_t  max_distance_sq_;
+  double          resolution_;
+  double          size_[3];
+  double          origin_[3];
+  double          max_distance_;
+  boost::int32_t  num_cells_[3];
+  boost::uint32_t reserved_;
+};
+
+std::size_t binaryPadding(std::size_t size)
+{
+  return (8 - size % 8) % 8;
+}
+
+template<typename T>
+void writeBinaryArray(std::ostream& out, const std::vector<T>& values)
+{
+  static const char zeros[8] = { 0 };
+  if (!values.empty())
+    out.write(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(T));
+  out.write(zeros, binaryPadding(values.size() * sizeof(T)));
+}
+
+// the state of a cell after reset(), for the blocks a sparse grid allocates
+void initializeResetVoxel(PropDistanceFieldVoxel& voxel, int x, int y, int z)
+{
+  voxel.closest_negative_point_.x() = x;
+  voxel.closest_negative_point_.y() = y;
+  voxel.closest_negative_point_.z() = z;
+  voxel.negative_distance_square_ = 0;
+}
+}
+
 PropagationDistanceField::PropagationDistanceField(double size_x, double size_y, double size_z,
                                                    double resolution,
                                                    double origin_x, double origin_y, double origin_z,
                                                    double max_distance,
-                                                   bool propagate_negative):
+                                                   bool propagate_negative,
+                                                   unsigned int propagation_threads,
+                                                   bool sparse_storage):
   DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z),
   propagate_negative_(propagate_negative),
+  propagation_threads_(propagation_threads > 0 ? propagation_threads : 1),
+  update_stamp_(0),
+  sparse_storage_(sparse_storage),
+  rebuild_fraction_(0.0),
   max_distance_(max_distance)
 {
   initialize();
@@ -60,7 +131,9 @@ PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree
                                                    const octomap::point3d& bbx_min,
                                                    const octomap::point3d& bbx_max,
                                                    double max_distance,
-                                                   bool propagate_negative_distances) :
+                                                   bool propagate_negative_distances,
+                                                   unsigned int propagation_threads,
+                                                   bool sparse_storage) :
   DistanceField(bbx_max.x()-bbx_min.x(),
                 bbx_max.y()-bbx_min.y(),
                 bbx_max.z()-bbx_min.z(),
@@ -69,6 +142,10 @@ PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree
                 bbx_min.y(),
                 bbx_min.z()),
   propagate_negative_(propagate_negative_distances),
+  propagation_threads_(propagation_threads > 0 ? propagation_threads : 1),
+  update_stamp_(0),
+  sparse_storage_(sparse_storage),
+  rebuild_fraction_(0.0),
   max_distance_(max_distance)
 {
   initialize();
@@ -77,9 +154,15 @@ PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree
 
 PropagationDistanceField::PropagationDistanceField(std::istream& is,
                                                    double max_distance,
-                                                   bool propagate_negative_distances) :
+                                                   bool propagate_negative_distances,
+                                                   unsigned int propagation_threads,
+                                                   bool sparse_storage) :
   DistanceField(0,0,0,0,0,0,0),
   propagate_negative_(propagate_negative_distances),
+  propagation_threads_(propagation_threads > 0 ? propagation_threads : 1),
+  update_stamp_(0),
+  sparse_storage_(sparse_storage),
+  rebuild_fraction_(0.0),
   max_distance_(max_distance)
 {
   readFromStream(is);
@@ -91,9 +174,12 @@ void PropagationDistanceField::initialize()
   voxel_grid_.reset(new VoxelGrid<PropDistanceFieldVoxel>(size_x_, size_y_, size_z_,
                                                           resolution_,
                                                           origin_x_, origin_y_, origin_z_,
-                                                          PropDistanceFieldVoxel(max_distance_sq_,0)));
+                                                          PropDistanceFieldVoxel(max_distance_sq_,0),
+                                                          sparse_storage_));
+  voxel_grid_->setCellInitializer(&initializeResetVoxel);
 
   initNeighborhoods();
+  update_stamps_.clear();
 
   bucket_queue_.resize(max_distance_sq_+1);
   negative_bucket_queue_.resize(max_distance_sq_+1);
@@ -185,6 +271,13 @@ void PropagationDistanceField::updatePointsInField(const EigenSTL::vector_Vector
     //logInform("Adding obstacle voxel %d %d %d", (*it).x(), (*it).y(), (*it).z());
   }
 
+  const std::size_t num_changes = old_not_new.size() + new_not_in_current.size();
+  if(rebuild_fraction_ > 0.0 && num_changes > 0 &&
+     num_changes >= rebuild_fraction_ * getXNumCells() * getYNumCells() * getZNumCells()) {
+    rebuildChangedRegion(old_not_new, new_not_in_current);
+    return;
+  }
+
   removeObstacleVoxels(old_not_new);
   addNewObstacleVoxels(new_not_in_current);
 
@@ -218,6 +311,20 @@ void PropagationDistanceField::addPointsToField(const EigenSTL::vector_Vector3d&
   addNewObstacleVoxels(voxel_points);
 }
 
+void PropagationDistanceField::addCellBoxesToField(const std::vector<CellBox>& boxes)
+{
+  std::vector<Eigen::Vector3i> voxel_points;
+
+  for (std::size_t i = 0 ; i < boxes.size() ; ++i)
+    for (int x = boxes[i].first.x() ; x <= boxes[i].second.x() ; ++x)
+      for (int y = boxes[i].first.y() ; y <= boxes[i].second.y() ; ++y)
+        for (int z = boxes[i].first.z() ; z <= boxes[i].second.z() ; ++z)
+          if(getGrid().getCell(x, y, z).distance_square_ > 0)
+            voxel_points.push_back(Eigen::Vector3i(x, y, z));
+
+  addNewObstacleVoxels(voxel_points);
+}
+
 void PropagationDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
 {
   std::vector<Eigen::Vector3i> voxel_points;
@@ -401,12 +508,125 @@ void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vec
   }
 }
 
+void PropagationDistanceField::rebuildChangedRegion(const std::vector<Eigen::Vector3i>& removed,
+                                                    const std::vector<Eigen::Vector3i>& added)
+{
+  const Eigen::Vector3i num_cells(getXNumCells(), getYNumCells(), getZNumCells());
+  const int initial_update_direction = getDirectionNumber(0,0,0);
+
+  Eigen::Vector3i lower = removed.empty() ? added[0] : removed[0];
+  Eigen::Vector3i upper = lower;
+  for(std::size_t i = 0; i < removed.size(); i++) {
+    lower = lower.cwiseMin(removed[i]);
+    upper = upper.cwiseMax(removed[i]);
+  }
+  for(std::size_t i = 0; i < added.size(); i++) {
+    lower = lower.cwiseMin(added[i]);
+    upper = upper.cwiseMax(added[i]);
+  }
+
+  // cells further than the maximum distance from all changes keep their values
+  const int margin = ceil(max_distance_/resolution_) + 1;
+  lower = (lower - Eigen::Vector3i::Constant(margin)).cwiseMax(Eigen::Vector3i::Zero());
+  upper = (upper + Eigen::Vector3i::Constant(margin)).cwiseMin(num_cells - Eigen::Vector3i::Ones());
+  const Eigen::Vector3i extent = upper - lower + Eigen::Vector3i::Ones();
+
+  if((double)extent.x() * extent.y() * extent.z() * 2.0 > (double)num_cells.x() * num_cells.y() * num_cells.z()) {
+    // it is cheaper to propagate the whole field again
+    std::vector<Eigen::Vector3i> obstacles;
+    compareEigen_Vector3i comp;
+    const VoxelGrid<PropDistanceFieldVoxel>& grid = getGrid();
+    for(int x = 0; x < num_cells.x(); x++)
+      for(int y = 0; y < num_cells.y(); y++)
+        for(int z = 0; z < num_cells.z(); z++)
+          if(grid.getCell(x,y,z).distance_square_ == 0 &&
+             !std::binary_search(removed.begin(), removed.end(), Eigen::Vector3i(x,y,z), comp))
+            obstacles.push_back(Eigen::Vector3i(x,y,z));
+    obstacles.insert(obstacles.end(), added.begin(), added.end());
+    reset();
+    addNewObstacleVoxels(obstacles);
+    return;
+  }
+
+  // the state of the obstacle cells after the update
+  for(std::size_t i = 0; i < removed.size(); i++)
+    voxel_grid_->getCell(removed[i].x(), removed[i].y(), removed[i].z()).distance_square_ = max_distance_sq_;
+  for(std::size_t i = 0; i < added.size(); i++)
+    voxel_grid_->getCell(added[i].x(), added[i].y(), added[i].z()).distance_square_ = 0;
+
+  // reset the region, seeding the propagation from its obstacles
+  for(int x = lower.x(); x <= upper.x(); x++)
+    for(int y = lower.y(); y <= upper.y(); y++)
+      for(int z = lower.z(); z <= upper.z(); z++) {
+        PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x,y,z);
+        const Eigen::Vector3i loc(x,y,z);
+        if(voxel.distance_square_ == 0) {
+          voxel.closest_point_ = loc;
+          voxel.update_direction_ = initial_update_direction;
+          bucket_queue_[0].push_back(loc);
+          voxel.negative_distance_square_ = max_distance_sq_;
+          voxel.closest_negative_point_.x() = PropDistanceFieldVoxel::UNINITIALIZED;
+          voxel.closest_negative_point_.y() = PropDistanceFieldVoxel::UNINITIALIZED;
+          voxel.closest_negative_point_.z() = PropDistanceFieldVoxel::UNINITIALIZED;
+        } else {
+          voxel.distance_square_ = max_distance_sq_;
+          voxel.closest_point_.x() = PropDistanceFieldVoxel::UNINITIALIZED;
+          voxel.closest_point_.y() = PropDistanceFieldVoxel::UNINITIALIZED;
+          voxel.closest_point_.z() = PropDistanceFieldVoxel::UNINITIALIZED;
+          voxel.negative_distance_square_ = 0;
+          voxel.closest_negative_point_ = loc;
+        }
+      }
+
+  // the cells bordering the region are valid and propagate their closest points into it
+  const Eigen::Vector3i border_lower = (lower - Eigen::Vector3i::Ones()).cwiseMax(Eigen::Vector3i::Zero());
+  const Eigen::Vector3i border_upper = (upper + Eigen::Vector3i::Ones()).cwiseMin(num_cells - Eigen::Vector3i::Ones());
+  for(int x = border_lower.x(); x <= border_upper.x(); x++)
+    for(int y = border_lower.y(); y <= border_upper.y(); y++)
+      for(int z = border_lower.z(); z <= border_upper.z(); z++) {
+        // skip over the cells of the region
+        if(x >= lower.x() && x <= upper.x() && y >= lower.y() && y <= upper.y() && z >= lower.z() && z <= upper.z())
+          z = upper.z();
+        else {
+          PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x,y,z);
+          if(voxel.distance_square_ < max_distance_sq_) {
+            voxel.update_direction_ = initial_update_direction;
+            bucket_queue_[0].push_back(Eigen::Vector3i(x,y,z));
+          }
+          if(propagate_negative_ && voxel.negative_distance_square_ < max_distance_sq_) {
+            voxel.negative_update_direction_ = initial_update_direction;
+            negative_bucket_queue_[0].push_back(Eigen::Vector3i(x,y,z));
+          }
+        }
+      }
+  propagatePositive();
+
+  if(propagate_negative_) {
+    // the free cells next to an obstacle are the closest free cells of the obstacles
+    for(int x = lower.x(); x <= upper.x(); x++)
+      for(int y = lower.y(); y <= upper.y(); y++)
+        for(int z = lower.z(); z <= upper.z(); z++) {
+          PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x,y,z);
+          if(voxel.distance_square_ > 0 && voxel.distance_square_ <= 3) {
+            voxel.negative_update_direction_ = initial_update_direction;
+            negative_bucket_queue_[0].push_back(Eigen::Vector3i(x,y,z));
+          }
+        }
+    propagateNegative();
+  }
+}
+
 void PropagationDistanceField::propagatePositive()
 {
 
   // now process the queue:
   for (unsigned int i=0; i<bucket_queue_.size(); ++i)
   {
+    if (propagation_threads_ > 1 && bucket_queue_[i].size() >= MIN_PARALLEL_BUCKET_SIZE)
+    {
+      propagateBucketParallel(bucket_queue_, i, false);
+      continue;
+    }
     std::vector<Eigen::Vector3i>::iterator list_it = bucket_queue_[i].begin();
     std::vector<Eigen::Vector3i>::iterator list_end = bucket_queue_[i].end();
     for ( ; list_it != list_end ; ++list_it)
@@ -466,6 +686,11 @@ void PropagationDistanceField::propagateNegative()
   // now process the queue:
   for (unsigned int i=0; i<negative_bucket_queue_.size(); ++i)
   {
+    if (propagation_threads_ > 1 && negative_bucket_queue_[i].size() >= MIN_PARALLEL_BUCKET_SIZE)
+    {
+      propagateBucketParallel(negative_bucket_queue_, i, true);
+      continue;
+    }
     std::vector<Eigen::Vector3i>::iterator list_it = negative_bucket_queue_[i].begin();
     std::vector<Eigen::Vector3i>::iterator list_end = negative_bucket_queue_[i].end();
     for ( ; list_it != list_end ; ++list_it)
@@ -519,26 +744,422 @@ void PropagationDistanceField::propagateNegative()
   }
 }
 
+void PropagationDistanceField::computeBucketUpdates(const Eigen::Vector3i& loc, unsigned int bucket, bool negative,
+                                                    std::vector<BucketUpdate>& updates) const
+{
+  // the same steps as the loops of propagatePositive() and propagateNegative(), without changing the grid
+  const VoxelGrid<PropDistanceFieldVoxel>& grid = getGrid();
+  const PropDistanceFieldVoxel* vptr = &grid.getCell(loc.x(), loc.y(), loc.z());
+  int update_direction = negative ? vptr->negative_update_direction_ : vptr->update_direction_;
+  const Eigen::Vector3i& closest_point = negative ? vptr->closest_negative_point_ : vptr->closest_point_;
+  if (update_direction<0 || update_direction>26)
+  {
+    logError("PROGRAMMING ERROR: Invalid update direction detected: %d", update_direction);
+    return;
+  }
+
+  const std::vector<Eigen::Vector3i >& neighborhood = neighborhoods_[bucket > 1 ? 1 : bucket][update_direction];
+  for (unsigned int n=0; n<neighborhood.size(); n++)
+  {
+    const Eigen::Vector3i& diff = neighborhood[n];
+    Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+    if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+      continue;
+
+    const PropDistanceFieldVoxel* neighbor = &grid.getCell(nloc.x(),nloc.y(),nloc.z());
+    int new_distance_sq = eucDistSq(closest_point, nloc);
+    if (new_distance_sq > max_distance_sq_)
+      continue;
+    if (new_distance_sq < (negative ? neighbor->negative_distance_square_ : neighbor->distance_square_))
+    {
+      BucketUpdate u;
+      u.loc_ = nloc;
+      u.distance_sq_ = new_distance_sq;
+      u.update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+      updates.push_back(u);
+    }
+  }
+}
+
+void PropagationDistanceField::computeBucketUpdatesRange(const std::vector<Eigen::Vector3i>* cells, std::size_t begin, std::size_t end,
+                                                         unsigned int bucket, bool negative,
+                                                         std::vector<BucketUpdate>* updates, std::vector<std::size_t>* ends) const
+{
+  for (std::size_t k = begin ; k < end ; ++k)
+  {
+    computeBucketUpdates((*cells)[k], bucket, negative, *updates);
+    (*ends)[k] = updates->size();
+  }
+}
+
+void PropagationDistanceField::propagateBucketParallel(std::vector<std::vector<Eigen::Vector3i> >& queue, unsigned int bucket, bool negative)
+{
+  const int ny = getYNumCells();
+  const int nz = getZNumCells();
+  // a sparse grid keeps the cells updated in this bucket in a set, rather than a stamp for every cell
+  boost::unordered_set<std::size_t> updated_cells;
+  if (!sparse_storage_)
+  {
+    if (update_stamps_.size() != (std::size_t)getXNumCells() * ny * nz)
+      update_stamps_.assign((std::size_t)getXNumCells() * ny * nz, 0);
+    if (++update_stamp_ == 0)
+    {
+      std::fill(update_stamps_.begin(), update_stamps_.end(), 0);
+      update_stamp_ = 1;
+    }
+  }
+
+  // the updates are computed in parallel from the content of the grid before this bucket;
+  // since distances only decrease, this finds every update the serial loop would make
+  const std::vector<Eigen::Vector3i> cells = queue[bucket];
+  const std::size_t n = cells.size();
+  const std::size_t num_threads = std::min<std::size_t>(propagation_threads_, n);
+  std::vector<std::vector<BucketUpdate> > updates(num_threads);
+  std::vector<std::size_t> ends(n);
+  std::vector<std::size_t> begins(num_threads + 1);
+  for (std::size_t t = 0 ; t <= num_threads ; ++t)
+    begins[t] = n * t / num_threads;
+  boost::thread_group threads;
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+    threads.create_thread(boost::bind(&PropagationDistanceField::computeBucketUpdatesRange, this, &cells, begins[t], begins[t + 1],
+                                      bucket, negative, &updates[t], &ends));
+  threads.join_all();
+
+  // the updates are applied in the order of the bucket, as the serial loop does; a cell updated
+  // earlier in this bucket has a new closest point, so its updates are computed again
+  std::vector<BucketUpdate> recomputed;
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+  {
+    std::size_t u = 0;
+    for (std::size_t k = begins[t] ; k < begins[t + 1] ; ++k)
+    {
+      const Eigen::Vector3i loc = cells[k];
+      const std::vector<BucketUpdate>* source = &updates[t];
+      std::size_t first = u, last = ends[k];
+      u = last;
+      const std::size_t index = ((std::size_t)loc.x() * ny + loc.y()) * nz + loc.z();
+      if (sparse_storage_ ? updated_cells.count(index) > 0 : update_stamps_[index] == update_stamp_)
+      {
+        recomputed.clear();
+        computeBucketUpdates(loc, bucket, negative, recomputed);
+        source = &recomputed;
+        first = 0;
+        last = recomputed.size();
+      }
+
+      const PropDistanceFieldVoxel* vptr = &voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+      for (std::size_t j = first ; j < last ; ++j)
+      {
+        const BucketUpdate& up = (*source)[j];
+        PropDistanceFieldVoxel* neighbor = &voxel_grid_->getCell(up.loc_.x(), up.loc_.y(), up.loc_.z());
+        if (negative)
+        {
+          if (up.distance_sq_ >= neighbor->negative_distance_square_)
+            continue;
+          neighbor->negative_distance_square_ = up.distance_sq_;
+          neighbor->closest_negative_point_ = vptr->closest_negative_point_;
+          neighbor->negative_update_direction_ = up.update_direction_;
+        }
+        else
+        {
+          if (up.distance_sq_ >= neighbor->distance_square_)
+            continue;
+          neighbor->distance_square_ = up.distance_sq_;
+          neighbor->closest_point_ = vptr->closest_point_;
+          neighbor->update_direction_ = up.update_direction_;
+        }
+        const std::size_t updated_index = ((std::size_t)up.loc_.x() * ny + up.loc_.y()) * nz + up.loc_.z();
+        if (sparse_storage_)
+          updated_cells.insert(updated_index);
+        else
+          update_stamps_[updated_index] = update_stamp_;
+        queue[up.distance_sq_].push_back(up.loc_);
+      }
+    }
+  }
+  queue[bucket].clear();
+}
+
 void PropagationDistanceField::reset()
 {
   voxel_grid_->reset(PropDistanceFieldVoxel(max_distance_sq_,0));
+  // a sparse grid initializes the cells when it allocates them
+  if (sparse_storage_)
+    return;
   for(int x = 0; x < getXNumCells(); x++)
   {
     for(int y = 0; y < getYNumCells(); y++)
     {
       for(int z = 0; z < getZNumCells(); z++)
       {
-        PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x,y,z);
-        voxel.closest_negative_point_.x() = x;
-        voxel.closest_negative_point_.y() = y;
-        voxel.closest_negative_point_.z() = z;
-        voxel.negative_distance_square_ = 0;
+        initializeResetVoxel(voxel_grid_->getCell(x,y,z), x, y, z);
       }
     }
   }
   //object_voxel_locations_.clear();
 }
 
+bool PropagationDistanceField::writeBinaryToStream(std::ostream& os, bool compress) const
+{
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  if (max_distance_sq_ > 0xffff)
+  {
+    logError("Cannot write a distance field with a maximum distance of %d cells in binary form", (int)ceil(max_distance_/resolution_));
+    return false;
+  }
+  for (int i = 0 ; i < 3 ; ++i)
+    if (num_cells[i] > 0x7fff)
+    {
+      logError("Cannot write a distance field with %d cells along an axis in binary form", num_cells[i]);
+      return false;
+    }
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.version_ = BINARY_VERSION;
+  header.byte_order_ = BINARY_BYTE_ORDER;
+  header.flags_ = (compress ? BINARY_FLAG_COMPRESSED : 0) | (propagate_negative_ ? BINARY_FLAG_NEGATIVE : 0);
+  header.max_distance_sq_ = max_distance_sq_;
+  header.resolution_ = resolution_;
+  header.size_[0] = size_x_;
+  header.size_[1] = size_y_;
+  header.size_[2] = size_z_;
+  header.origin_[0] = origin_x_;
+  header.origin_[1] = origin_y_;
+  header.origin_[2] = origin_z_;
+  header.max_distance_ = max_distance_;
+  for (int i = 0 ; i < 3 ; ++i)
+    header.num_cells_[i] = num_cells[i];
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  boost::iostreams::filtering_ostream out;
+  if (compress)
+    out.push(boost::iostreams::zlib_compressor());
+  out.push(os);
+
+  const std::size_t n = (std::size_t)num_cells[0] * num_cells[1] * num_cells[2];
+  const VoxelGrid<PropDistanceFieldVoxel>& grid = getGrid();
+  {
+    std::vector<boost::uint16_t> distances(n), negative_distances(n);
+    std::size_t i = 0;
+    for (int x = 0 ; x < num_cells[0] ; ++x)
+      for (int y = 0 ; y < num_cells[1] ; ++y)
+        for (int z = 0 ; z < num_cells[2] ; ++z, ++i)
+        {
+          const PropDistanceFieldVoxel& voxel = grid.getCell(x, y, z);
+          distances[i] = voxel.distance_square_;
+          negative_distances[i] = voxel.negative_distance_square_;
+        }
+    writeBinaryArray(out, distances);
+    writeBinaryArray(out, negative_distances);
+  }
+  for (int negative = 0 ; negative < 2 ; ++negative)
+  {
+    std::vector<boost::int16_t> points(3 * n);
+    std::size_t i = 0;
+    for (int x = 0 ; x < num_cells[0] ; ++x)
+      for (int y = 0 ; y < num_cells[1] ; ++y)
+        for (int z = 0 ; z < num_cells[2] ; ++z, i += 3)
+        {
+          // the closest unoccupied cell of a cell that was never written is the cell itself, which the fill value can not hold
+          const PropDistanceFieldVoxel voxel = grid.getCellValue(x, y, z);
+          const Eigen::Vector3i& point = negative ? voxel.closest_negative_point_ : voxel.closest_point_;
+          points[i] = point.x();
+          points[i + 1] = point.y();
+          points[i + 2] = point.z();
+        }
+    writeBinaryArray(out, points);
+  }
+  for (int negative = 0 ; negative < 2 ; ++negative)
+  {
+    std::vector<boost::int8_t> directions(n);
+    std::size_t i = 0;
+    for (int x = 0 ; x < num_cells[0] ; ++x)
+      for (int y = 0 ; y < num_cells[1] ; ++y)
+        for (int z = 0 ; z < num_cells[2] ; ++z, ++i)
+        {
+          const PropDistanceFieldVoxel& voxel = grid.getCell(x, y, z);
+          int direction = negative ? voxel.negative_update_direction_ : voxel.update_direction_;
+          // cells that were never updated have no meaningful direction
+          directions[i] = direction >= 0 && direction <= 26 ? direction : -1;
+        }
+    writeBinaryArray(out, directions);
+  }
+  out.reset();
+  return os.good();
+}
+
+bool PropagationDistanceField::readBinaryFromStream(std::istream& is)
+{
+  if (!is.good())
+    return false;
+  std::vector<char> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+  return readBinaryFromData(data.empty() ? NULL : &data[0], data.size());
+}
+
+bool PropagationDistanceField::readBinaryFromFile(const std::string& path)
+{
+  try
+  {
+    boost::iostreams::mapped_file_source file(path);
+    return readBinaryFromData(file.data(), file.size());
+  }
+  catch (std::exception &ex)
+  {
+    logError("Unable to map distance field file '%s': %s", path.c_str(), ex.what());
+    return false;
+  }
+}
+
+bool PropagationDistanceField::readBinaryFromData(const char* data, std::size_t size)
+{
+  BinaryHeader header;
+  if (size < sizeof(header))
+  {
+    logError("Binary distance field data is truncated");
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic_, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+  {
+    logError("Data is not a binary distance field");
+    return false;
+  }
+  if (header.version_ != BINARY_VERSION)
+  {
+    logError("Unsupported binary distance field version %u", (unsigned int)header.version_);
+    return false;
+  }
+  if (header.byte_order_ != BINARY_BYTE_ORDER)
+  {
+    logError("Binary distance field was written with a different byte order");
+    return false;
+  }
+
+  // the header is checked against itself and against the size of the cell data before anything is allocated for the field
+  const double resolution = header.resolution_;
+  if (!(resolution > 0.0) || !boost::math::isfinite(resolution) ||
+      !(header.max_distance_ >= 0.0) || !boost::math::isfinite(header.max_distance_))
+  {
+    logError("Binary distance field has an invalid resolution or maximum distance");
+    return false;
+  }
+  double total_cells = 1.0;
+  for (int d = 0 ; d < 3 ; ++d)
+  {
+    // the number of cells is computed as the voxel grid does
+    const double cells = header.size_[d] * (1.0 / resolution);
+    if (!(cells >= 0.0) || cells >= (double)std::numeric_limits<boost::int32_t>::max() || header.num_cells_[d] != (int)cells)
+    {
+      logError("Binary distance field dimensions are inconsistent with its parameters");
+      return false;
+    }
+    total_cells *= header.num_cells_[d];
+  }
+  const double max_distance_cells = ceil(header.max_distance_ / resolution);
+  if (max_distance_cells * max_distance_cells > 0xffff || header.max_distance_sq_ != (int)(max_distance_cells * max_distance_cells))
+  {
+    logError("Binary distance field dimensions are inconsistent with its parameters");
+    return false;
+  }
+
+  // each cell takes 18 bytes, plus the padding of the 6 arrays; zlib does not compress by more than a factor of 1032
+  const char* cells = data + sizeof(header);
+  std::size_t cells_size = size - sizeof(header);
+  const bool compressed = header.flags_ & BINARY_FLAG_COMPRESSED;
+  if (18.0 * total_cells > (compressed ? 1032.0 * cells_size : (double)cells_size))
+  {
+    logError("Binary distance field cell data has the wrong size");
+    return false;
+  }
+  const std::size_t n = (std::size_t)header.num_cells_[0] * header.num_cells_[1] * header.num_cells_[2];
+  const std::size_t distances_size = 2 * n + binaryPadding(2 * n);
+  const std::size_t points_size = 6 * n + binaryPadding(6 * n);
+  const std::size_t directions_size = n + binaryPadding(n);
+  const std::size_t expected_size = 2 * distances_size + 2 * points_size + 2 * directions_size;
+
+  std::vector<char> decompressed;
+  if (compressed)
+  {
+    try
+    {
+      boost::iostreams::filtering_istream in;
+      in.push(boost::iostreams::zlib_decompressor());
+      in.push(boost::iostreams::array_source(cells, cells_size));
+      // one byte more than expected is enough to tell that the data is too long
+      decompressed.resize(expected_size + 1);
+      in.read(&decompressed[0], decompressed.size());
+      decompressed.resize(in.gcount());
+    }
+    catch (std::exception &ex)
+    {
+      logError("Unable to decompress binary distance field: %s", ex.what());
+      return false;
+    }
+    cells = decompressed.empty() ? NULL : &decompressed[0];
+    cells_size = decompressed.size();
+  }
+  if (cells_size != expected_size)
+  {
+    logError("Binary distance field cell data has the wrong size");
+    return false;
+  }
+
+  resolution_ = resolution;
+  inv_twice_resolution_ = 1.0/(2.0*resolution_);
+  size_x_ = header.size_[0];
+  size_y_ = header.size_[1];
+  size_z_ = header.size_[2];
+  origin_x_ = header.origin_[0];
+  origin_y_ = header.origin_[1];
+  origin_z_ = header.origin_[2];
+  max_distance_ = header.max_distance_;
+  propagate_negative_ = header.flags_ & BINARY_FLAG_NEGATIVE;
+  initialize();
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+
+  const char* distances = cells;
+  const char* negative_distances = distances + distances_size;
+  const char* points = negative_distances + distances_size;
+  const char* negative_points = points + points_size;
+  const char* directions = negative_points + points_size;
+  const char* negative_directions = directions + directions_size;
+
+  std::size_t i = 0;
+  for (int x = 0 ; x < num_cells[0] ; ++x)
+    for (int y = 0 ; y < num_cells[1] ; ++y)
+      for (int z = 0 ; z < num_cells[2] ; ++z, ++i)
+      {
+        boost::uint16_t d[2];
+        boost::int16_t p[6];
+        memcpy(&d[0], distances + 2 * i, 2);
+        memcpy(&d[1], negative_distances + 2 * i, 2);
+        memcpy(&p[0], points + 6 * i, 6);
+        memcpy(&p[3], negative_points + 6 * i, 6);
+        if (d[0] > max_distance_sq_ || d[1] > max_distance_sq_)
+        {
+          logError("Binary distance field has a distance beyond its maximum distance");
+          reset();
+          return false;
+        }
+
+        // a sparse grid does not need to allocate cells that are in their reset state
+        if (sparse_storage_ && d[0] == max_distance_sq_ && d[1] == 0 && p[0] == PropDistanceFieldVoxel::UNINITIALIZED &&
+            p[3] == x && p[4] == y && p[5] == z)
+          continue;
+
+        PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x, y, z);
+        voxel.distance_square_ = d[0];
+        voxel.negative_distance_square_ = d[1];
+        voxel.closest_point_ = Eigen::Vector3i(p[0], p[1], p[2]);
+        voxel.closest_negative_point_ = Eigen::Vector3i(p[3], p[4], p[5]);
+        voxel.update_direction_ = (boost::int8_t)directions[i];
+        voxel.negative_update_direction_ = (boost::int8_t)negative_directions[i];
+      }
+  return true;
+}
+
 void PropagationDistanceField::initNeighborhoods()
 {
   // first initialize the direction number mapping:
@@ -614,7 +1235,48 @@ double PropagationDistanceField::getDistance(double x, double y, double z) const
 
 double PropagationDistanceField::getDistance(int x, int y, int z) const
 {
-  return getDistance(voxel_grid_->getCell(x,y,z));
+  return getDistance(getGrid().getCell(x,y,z));
+}
+
+void PropagationDistanceField::getDistances(const EigenSTL::vector_Vector3d& points,
+                                            std::vector<double>& distances) const
+{
+  const VoxelGrid<PropDistanceFieldVoxel>& grid = getGrid();
+  distances.resize(points.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    distances[i] = getDistance(grid(points[i].x(), points[i].y(), points[i].z()));
+}
+
+void PropagationDistanceField::getDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                    std::vector<double>& distances,
+                                                    EigenSTL::vector_Vector3d& gradients,
+                                                    std::vector<bool>& in_bounds) const
+{
+  // same as DistanceField::getDistanceGradient(), with the grid accessed directly
+  const VoxelGrid<PropDistanceFieldVoxel>& grid = getGrid();
+  const int max_x = grid.getNumCells(DIM_X) - 1;
+  const int max_y = grid.getNumCells(DIM_Y) - 1;
+  const int max_z = grid.getNumCells(DIM_Z) - 1;
+  distances.resize(points.size());
+  gradients.resize(points.size());
+  in_bounds.resize(points.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    int gx, gy, gz;
+    grid.worldToGrid(points[i].x(), points[i].y(), points[i].z(), gx, gy, gz);
+    if (gx<1 || gy<1 || gz<1 || gx>=max_x || gy>=max_y || gz>=max_z)
+    {
+      gradients[i].setZero();
+      in_bounds[i] = false;
+      distances[i] = getUninitializedDistance();
+      continue;
+    }
+    gradients[i].x() = (getDistance(grid.getCell(gx+1,gy,gz)) - getDistance(grid.getCell(gx-1,gy,gz)))*inv_twice_resolution_;
+    gradients[i].y() = (getDistance(grid.getCell(gx,gy+1,gz)) - getDistance(grid.getCell(gx,gy-1,gz)))*inv_twice_resolution_;
+    gradients[i].z() = (getDistance(grid.getCell(gx,gy,gz+1)) - getDistance(grid.getCell(gx,gy,gz-1)))*inv_twice_resolution_;
+    in_bounds[i] = true;
+    distances[i] = getDistance(grid.getCell(gx,gy,gz));
+  }
 }
 
 bool PropagationDistanceField::isCellValid(int x, int y, int z) const
@@ -680,6 +1342,22 @@ bool PropagationDistanceField::writeToStream(std::ostream& os) const
   out.flush();
 }
 
+std::size_t PropagationDistanceField::getMemoryUsage() const
+{
+  std::size_t bytes = sizeof(*this) + voxel_grid_->getMemoryUsage();
+  for (std::size_t i = 0 ; i < bucket_queue_.size() ; ++i)
+    bytes += sizeof(bucket_queue_[i]) + bucket_queue_[i].capacity() * sizeof(Eigen::Vector3i);
+  for (std::size_t i = 0 ; i < negative_bucket_queue_.size() ; ++i)
+    bytes += sizeof(negative_bucket_queue_[i]) + negative_bucket_queue_[i].capacity() * sizeof(Eigen::Vector3i);
+  bytes += update_stamps_.capacity() * sizeof(unsigned int);
+  bytes += sqrt_table_.capacity() * sizeof(double);
+  for (std::size_t i = 0 ; i < neighborhoods_.size() ; ++i)
+    for (std::size_t j = 0 ; j < neighborhoods_[i].size() ; ++j)
+      bytes += sizeof(neighborhoods_[i][j]) + neighborhoods_[i][j].capacity() * sizeof(Eigen::Vector3i);
+  bytes += direction_number_to_direction_.capacity() * sizeof(Eigen::Vector3i);
+  return bytes;
+}
+
 bool PropagationDistanceField::readFromStream(std::istream& is)
 {
   if(!is.good()) return false;
@@ -0,0 +1,108 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/distance_field/sensor_frustum.h>
+#include <cmath>
+
+distance_field::SensorFrustum::SensorFrustum(const moveit_sensor_manager::SensorInfo &info) :
+  info_(info),
+  tan_x_(tan(info.x_angle / 2.0)),
+  tan_y_(tan(info.y_angle / 2.0))
+{
+  // the corners of the near (0-3) and far (4-7) faces
+  shapes::Mesh *mesh = new shapes::Mesh(8, 12);
+  const double dist[2] = { info_.min_dist, info_.max_dist };
+  for (unsigned int f = 0 ; f < 2 ; ++f)
+    for (unsigned int c = 0 ; c < 4 ; ++c)
+    {
+      double *v = mesh->vertices + 3 * (4 * f + c);
+      v[0] = (c == 0 || c == 3 ? -1.0 : 1.0) * dist[f] * tan_x_;
+      v[1] = (c < 2 ? -1.0 : 1.0) * dist[f] * tan_y_;
+      v[2] = dist[f];
+    }
+
+  // two triangles per face, wound so the normals point out of the frustum
+  static const unsigned int triangles[36] = { 0, 2, 1,  0, 3, 2,    // near
+                                              4, 5, 6,  4, 6, 7,    // far
+                                              0, 1, 5,  0, 5, 4,    // -y
+                                              2, 3, 7,  2, 7, 6,    // +y
+                                              1, 2, 6,  1, 6, 5,    // +x
+                                              3, 0, 4,  3, 4, 7 };  // -x
+  for (unsigned int i = 0 ; i < 36 ; ++i)
+    mesh->triangles[i] = triangles[i];
+  mesh->computeTriangleNormals();
+  mesh->computeVertexNormals();
+  shape_.reset(mesh);
+}
+
+bool distance_field::SensorFrustum::contains(const Eigen::Vector3d &point) const
+{
+  return point.z() >= info_.min_dist && point.z() <= info_.max_dist &&
+    fabs(point.x()) <= point.z() * tan_x_ && fabs(point.y()) <= point.z() * tan_y_;
+}
+
+bool distance_field::SensorFrustum::isVisible(const Eigen::Affine3d &sensor_pose, const Eigen::Vector3d &point, const DistanceField &df, double tolerance) const
+{
+  if (!contains(sensor_pose, point))
+    return false;
+
+  const Eigen::Vector3d &origin = sensor_pose.translation();
+  Eigen::Vector3d dir = point - origin;
+  double length = dir.norm();
+  dir /= length;
+
+  // a distance below half a cell means the sample is in an obstacle cell; never step less than that
+  double min_step = df.getResolution() / 2.0;
+  double end = length - tolerance;
+  for (double t = info_.min_dist ; t < end ; )
+  {
+    Eigen::Vector3d p = origin + t * dir;
+    double d = df.getDistance(p.x(), p.y(), p.z());
+    if (d < min_step)
+      return false;
+    t += d;
+  }
+  return true;
+}
+
+double distance_field::SensorFrustum::getVisibleFraction(const Eigen::Affine3d &sensor_pose, const EigenSTL::vector_Vector3d &region, const DistanceField &df) const
+{
+  if (region.empty())
+    return 0.0;
+  std::size_t visible = 0;
+  for (std::size_t i = 0 ; i < region.size() ; ++i)
+    if (isVisible(sensor_pose, region[i], df))
+      visible++;
+  return (double)visible / (double)region.size();
+}
@@ -0,0 +1,189 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/distance_field/world_distance_field.h>
+#include <moveit/profiler/memory_usage.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace distance_field
+{
+
+WorldDistanceField::WorldDistanceField(const collision_detection::WorldPtr& world,
+                                       const boost::shared_ptr<DistanceField>& field) :
+  field_(field)
+{
+  setWorld(world);
+}
+
+WorldDistanceField::~WorldDistanceField()
+{
+  if (world_)
+    world_->removeObserver(observer_handle_);
+}
+
+void WorldDistanceField::setWorld(const collision_detection::WorldPtr& world)
+{
+  if (world_)
+  {
+    world_->removeObserver(observer_handle_);
+
+    // objects that are not in the new world are removed; the others are updated below
+    std::vector<std::string> removed;
+    for (std::map<std::string, std::vector<int> >::const_iterator it = object_cells_.begin() ; it != object_cells_.end() ; ++it)
+      if (!world->hasObject(it->first))
+        removed.push_back(it->first);
+    for (std::size_t i = 0 ; i < removed.size() ; ++i)
+    {
+      std::vector<int> none;
+      updateObject(removed[i], none);
+    }
+  }
+
+  world_ = world;
+  observer_handle_ = world_->addObserver(boost::bind(&WorldDistanceField::notify, this, _1, _2));
+  world_->notifyObserverAllObjects(observer_handle_, collision_detection::World::CREATE);
+}
+
+void WorldDistanceField::notify(const collision_detection::World::ObjectConstPtr& obj, collision_detection::World::Action action)
+{
+  // objects are notified before they are destroyed
+  std::vector<int> cells;
+  if (action != collision_detection::World::DESTROY)
+    computeCells(*obj, cells);
+  updateObject(obj->id_, cells);
+}
+
+void WorldDistanceField::updateObject(const std::string& id, std::vector<int>& cells)
+{
+  std::vector<int> none;
+  std::map<std::string, std::vector<int> >::iterator it = object_cells_.find(id);
+  const std::vector<int>& old_cells = it == object_cells_.end() ? none : it->second;
+
+  EigenSTL::vector_Vector3d removed_points;
+  EigenSTL::vector_Vector3d added_points;
+
+  // both lists are sorted; only the cells that become free or occupied change the field
+  std::size_t i = 0, j = 0;
+  while (i < old_cells.size() || j < cells.size())
+  {
+    if (j == cells.size() || (i < old_cells.size() && old_cells[i] < cells[j]))
+    {
+      boost::unordered_map<int, unsigned int>::iterator count = cell_counts_.find(old_cells[i]);
+      if (--count->second == 0)
+      {
+        cell_counts_.erase(count);
+        removed_points.push_back(getCellCenter(old_cells[i]));
+      }
+      ++i;
+    }
+    else if (i == old_cells.size() || cells[j] < old_cells[i])
+    {
+      if (++cell_counts_[cells[j]] == 1)
+        added_points.push_back(getCellCenter(cells[j]));
+      ++j;
+    }
+    else
+    {
+      ++i;
+      ++j;
+    }
+  }
+
+  if (cells.empty())
+  {
+    if (it != object_cells_.end())
+      object_cells_.erase(it);
+  }
+  else if (it == object_cells_.end())
+    object_cells_[id].swap(cells);
+  else
+    it->second.swap(cells);
+
+  if (!removed_points.empty() || !added_points.empty())
+    field_->updatePointsInField(removed_points, added_points);
+}
+
+void WorldDistanceField::computeCells(const collision_detection::World::Object& obj, std::vector<int>& cells) const
+{
+  const int ny = field_->getYNumCells();
+  const int nz = field_->getZNumCells();
+  EigenSTL::vector_Vector3d points;
+  for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+  {
+    field_->getShapePoints(obj.shapes_[i].get(), obj.shape_poses_[i], points);
+    for (std::size_t k = 0 ; k < points.size() ; ++k)
+    {
+      int x, y, z;
+      if (field_->worldToGrid(points[k].x(), points[k].y(), points[k].z(), x, y, z))
+        cells.push_back((x * ny + y) * nz + z);
+    }
+  }
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+}
+
+void WorldDistanceField::getObjectsAtCell(int x, int y, int z, std::vector<std::string>& ids) const
+{
+  ids.clear();
+  if (!field_->isCellValid(x, y, z))
+    return;
+  const int index = (x * field_->getYNumCells() + y) * field_->getZNumCells() + z;
+  if (cell_counts_.find(index) == cell_counts_.end())
+    return;
+  for (std::map<std::string, std::vector<int> >::const_iterator it = object_cells_.begin() ; it != object_cells_.end() ; ++it)
+    if (std::binary_search(it->second.begin(), it->second.end(), index))
+      ids.push_back(it->first);
+}
+
+std::size_t WorldDistanceField::getMemoryUsage() const
+{
+  std::size_t bytes = sizeof(*this) + field_->getMemoryUsage();
+  for (std::map<std::string, std::vector<int> >::const_iterator it = object_cells_.begin() ; it != object_cells_.end() ; ++it)
+    bytes += moveit::tools::estimateMapNodeBytes<std::string, std::vector<int> >() + it->first.capacity() + it->second.capacity() * sizeof(int);
+  bytes += cell_counts_.bucket_count() * sizeof(void*) + cell_counts_.size() * (sizeof(std::pair<const int, unsigned int>) + sizeof(void*));
+  return bytes;
+}
+
+Eigen::Vector3d WorldDistanceField::getCellCenter(int index) const
+{
+  const int ny = field_->getYNumCells();
+  const int nz = field_->getZNumCells();
+  Eigen::Vector3d center;
+  field_->gridToWorld(index / (ny * nz), (index / nz) % ny, index % nz, center.x(), center.y(), center.z());
+  return center;
+}
+
+}
@@ -0,0 +1,281 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2009, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/* Benchmarks of PropagationDistanceField: construction, incremental updates with small and large sets of points,
+   adding meshes and octrees, and queries, for dense and sparse fields of several sizes and resolutions. The heap memory
+   of each field is reported when it is empty and once it holds a table top with objects. See moveit::Benchmark for
+   the command line arguments. */
+
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/profiler/benchmark.h>
+#include <geometric_shapes/shapes.h>
+#include <octomap/octomap.h>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <cmath>
+
+using namespace distance_field;
+
+namespace
+{
+
+const double MAX_DISTANCE = 0.3;
+const std::size_t QUERY_POINTS = 1000;
+
+struct FieldConfig
+{
+  const char *name_;
+  double      size_x_, size_y_, size_z_;
+  double      resolution_;
+  bool        sparse_;
+};
+
+const FieldConfig CONFIGS[] =
+{
+  { "1x1x1m@2cm/dense",  1.0, 1.0, 1.0, 0.02, false },
+  { "2x2x2m@2cm/dense",  2.0, 2.0, 2.0, 0.02, false },
+  { "2x2x2m@2cm/sparse", 2.0, 2.0, 2.0, 0.02, true },
+  { "2x2x1m@1cm/dense",  2.0, 2.0, 1.0, 0.01, false },
+  { "2x2x1m@1cm/sparse", 2.0, 2.0, 1.0, 0.01, true }
+};
+
+PropagationDistanceField* makeField(const FieldConfig &config)
+{
+  return new PropagationDistanceField(config.size_x_, config.size_y_, config.size_z_, config.resolution_,
+                                      0.0, 0.0, 0.0, MAX_DISTANCE, false, 1, config.sparse_);
+}
+
+/** \brief \e count points spread uniformly over the box from \e min to \e max */
+EigenSTL::vector_Vector3d randomPoints(std::size_t count, const Eigen::Vector3d &min, const Eigen::Vector3d &max, unsigned int seed)
+{
+  boost::mt19937 rng(seed);
+  boost::variate_generator<boost::mt19937&, boost::uniform_real<> > u(rng, boost::uniform_real<>(0.0, 1.0));
+  EigenSTL::vector_Vector3d points(count);
+  for (std::size_t i = 0 ; i < count ; ++i)
+    points[i] = min + Eigen::Vector3d(u(), u(), u()).cwiseProduct(max - min);
+  return points;
+}
+
+/** \brief The cells of a table top at 40% of the height of the field, covering the middle of the field */
+EigenSTL::vector_Vector3d tablePoints(const FieldConfig &config)
+{
+  EigenSTL::vector_Vector3d points;
+  double z = config.size_z_ * 0.4;
+  for (double x = config.size_x_ * 0.25 ; x < config.size_x_ * 0.75 ; x += config.resolution_)
+    for (double y = config.size_y_ * 0.1 ; y < config.size_y_ * 0.9 ; y += config.resolution_)
+      points.push_back(Eigen::Vector3d(x, y, z));
+  return points;
+}
+
+/** \brief A closed sphere mesh of \e radius with \e stacks x \e slices quads (about 2 * stacks * slices triangles) */
+shapes::Mesh* makeSphereMesh(double radius, unsigned int stacks, unsigned int slices)
+{
+  unsigned int vertex_count = (stacks - 1) * slices + 2;
+  unsigned int triangle_count = 2 * slices * (stacks - 1);
+  shapes::Mesh *mesh = new shapes::Mesh(vertex_count, triangle_count);
+
+  // the poles are the last two vertices
+  for (unsigned int i = 1 ; i < stacks ; ++i)
+  {
+    double phi = M_PI * i / stacks;
+    for (unsigned int j = 0 ; j < slices ; ++j)
+    {
+      double theta = 2.0 * M_PI * j / slices;
+      double *v = mesh->vertices + 3 * ((i - 1) * slices + j);
+      v[0] = radius * sin(phi) * cos(theta);
+      v[1] = radius * sin(phi) * sin(theta);
+      v[2] = radius * cos(phi);
+    }
+  }
+  unsigned int top = vertex_count - 2, bottom = vertex_count - 1;
+  mesh->vertices[3 * top + 2] = radius;
+  mesh->vertices[3 * bottom + 2] = -radius;
+
+  unsigned int *t = mesh->triangles;
+  for (unsigned int j = 0 ; j < slices ; ++j)
+  {
+    unsigned int next = (j + 1) % slices;
+    *t++ = top; *t++ = j; *t++ = next;
+    for (unsigned int i = 1 ; i + 1 < stacks ; ++i)
+    {
+      unsigned int a = (i - 1) * slices + j, b = (i - 1) * slices + next, c = i * slices + j, d = i * slices + next;
+      *t++ = a; *t++ = c; *t++ = b;
+      *t++ = b; *t++ = c; *t++ = d;
+    }
+    *t++ = bottom; *t++ = (stacks - 2) * slices + next; *t++ = (stacks - 2) * slices + j;
+  }
+  mesh->computeTriangleNormals();
+  return mesh;
+}
+
+void construct(const FieldConfig &config)
+{
+  boost::scoped_ptr<PropagationDistanceField> df(makeField(config));
+  moveit::Benchmark::keep(df);
+}
+
+void addAndRemovePoints(PropagationDistanceField &df, const EigenSTL::vector_Vector3d &points)
+{
+  df.addPointsToField(points);
+  df.removePointsFromField(points);
+}
+
+// moves the points from a to b, or back on the next call
+void updatePoints(PropagationDistanceField &df, const EigenSTL::vector_Vector3d &a, const EigenSTL::vector_Vector3d &b, bool &forward)
+{
+  if (forward)
+    df.updatePointsInField(a, b);
+  else
+    df.updatePointsInField(b, a);
+  forward = !forward;
+}
+
+void addShape(PropagationDistanceField &df, const shapes::Shape *shape, const geometry_msgs::Pose &pose)
+{
+  df.reset();
+  df.addShapeToField(shape, pose);
+}
+
+void addOcTree(PropagationDistanceField &df, const octomap::OcTree *tree)
+{
+  df.reset();
+  df.addOcTreeToField(tree);
+}
+
+void getDistances(const PropagationDistanceField &df, const EigenSTL::vector_Vector3d &points)
+{
+  double sum = 0.0;
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    sum += df.getDistance(points[i].x(), points[i].y(), points[i].z());
+  moveit::Benchmark::keep(sum);
+}
+
+void getDistanceGradients(const PropagationDistanceField &df, const EigenSTL::vector_Vector3d &points)
+{
+  double sum = 0.0;
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    double gx, gy, gz;
+    bool in_bounds;
+    sum += df.getDistanceGradient(points[i].x(), points[i].y(), points[i].z(), gx, gy, gz, in_bounds) + gx;
+  }
+  moveit::Benchmark::keep(sum);
+}
+
+void getDistanceGradientsBatch(const PropagationDistanceField &df, const EigenSTL::vector_Vector3d &points,
+                               std::vector<double> &distances, EigenSTL::vector_Vector3d &gradients, std::vector<bool> &in_bounds)
+{
+  df.getDistanceGradients(points, distances, gradients, in_bounds);
+  moveit::Benchmark::keep(distances);
+}
+
+void benchmarkConfig(moveit::Benchmark &bench, const FieldConfig &config, const shapes::Mesh *mesh, const octomap::OcTree &tree)
+{
+  const std::string p = std::string(config.name_) + "/";
+  Eigen::Vector3d min(0.0, 0.0, 0.0), max(config.size_x_, config.size_y_, config.size_z_);
+
+  bench.run(p + "construct", boost::bind(&construct, boost::cref(config)));
+
+  std::size_t heap = moveit::Benchmark::getHeapBytes();
+  boost::scoped_ptr<PropagationDistanceField> df(makeField(config));
+  bench.recordMemory(p + "memory/empty", moveit::Benchmark::getHeapBytes() - heap);
+
+  // a table with objects on it, which the incremental updates below interact with
+  EigenSTL::vector_Vector3d table = tablePoints(config);
+  EigenSTL::vector_Vector3d objects = randomPoints(2000, Eigen::Vector3d(max.x() * 0.3, max.y() * 0.2, max.z() * 0.45),
+                                                   Eigen::Vector3d(max.x() * 0.7, max.y() * 0.8, max.z() * 0.6), 1);
+  df->addPointsToField(table);
+  df->addPointsToField(objects);
+  bench.recordMemory(p + "memory/table", moveit::Benchmark::getHeapBytes() - heap);
+
+  const std::size_t counts[] = { 100, 10000 };
+  for (std::size_t i = 0 ; i < 2 ; ++i)
+  {
+    std::string n = boost::lexical_cast<std::string>(counts[i]);
+    EigenSTL::vector_Vector3d points = randomPoints(counts[i], min, max, 2 + i);
+    bench.run(p + "addPointsToField+removePointsFromField/" + n,
+              boost::bind(&addAndRemovePoints, boost::ref(*df), boost::cref(points)), counts[i]);
+
+    // the points move by a few cells, as points of a moving object or a new sensor scan would
+    EigenSTL::vector_Vector3d moved(points);
+    for (std::size_t j = 0 ; j < moved.size() ; ++j)
+      moved[j] += Eigen::Vector3d(0.05, 0.0, 0.0);
+    bool forward = true;
+    bench.run(p + "updatePointsInField/" + n,
+              boost::bind(&updatePoints, boost::ref(*df), boost::cref(points), boost::cref(moved), boost::ref(forward)), counts[i]);
+  }
+
+  EigenSTL::vector_Vector3d queries = randomPoints(QUERY_POINTS, min, max, 10);
+  bench.run(p + "getDistance", boost::bind(&getDistances, boost::cref(*df), boost::cref(queries)), QUERY_POINTS);
+  bench.run(p + "getDistanceGradient", boost::bind(&getDistanceGradients, boost::cref(*df), boost::cref(queries)), QUERY_POINTS);
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  std::vector<bool> in_bounds;
+  bench.run(p + "getDistanceGradients", boost::bind(&getDistanceGradientsBatch, boost::cref(*df), boost::cref(queries),
+                                                    boost::ref(distances), boost::ref(gradients), boost::ref(in_bounds)), QUERY_POINTS);
+
+  geometry_msgs::Pose pose;
+  pose.position.x = max.x() / 2.0;
+  pose.position.y = max.y() / 2.0;
+  pose.position.z = max.z() / 2.0;
+  pose.orientation.w = 1.0;
+  bench.run(p + "reset+addShapeToField/mesh" + boost::lexical_cast<std::string>(mesh->triangle_count),
+            boost::bind(&addShape, boost::ref(*df), mesh, boost::cref(pose)));
+  bench.run(p + "reset+addOcTreeToField/" + boost::lexical_cast<std::string>(tree.getNumLeafNodes()) + "leaves",
+            boost::bind(&addOcTree, boost::ref(*df), &tree));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  boost::scoped_ptr<shapes::Mesh> mesh(makeSphereMesh(0.3, 100, 100));
+
+  // clutter in the lower half of a 2 m cube, as a sensor would see it
+  octomap::OcTree tree(0.02);
+  EigenSTL::vector_Vector3d cells = randomPoints(20000, Eigen::Vector3d(0.2, 0.2, 0.0), Eigen::Vector3d(1.8, 1.8, 1.0), 20);
+  for (std::size_t i = 0 ; i < cells.size() ; ++i)
+    tree.updateNode(octomap::point3d(cells[i].x(), cells[i].y(), cells[i].z()), true);
+
+  for (std::size_t i = 0 ; i < sizeof(CONFIGS) / sizeof(CONFIGS[0]) ; ++i)
+    benchmarkConfig(bench, CONFIGS[i], mesh.get(), tree);
+
+  return bench.report();
+}
@@ -38,12 +38,22 @@
 
 #include <moveit/distance_field/voxel_grid.h>
 #include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/distance_field/compact_distance_field.h>
+#include <moveit/distance_field/world_distance_field.h>
 #include <moveit/distance_field/distance_field_common.h>
+#include <moveit/distance_field/sensor_frustum.h>
 #include <console_bridge/console.h>
 #include <geometric_shapes/body_operations.h>
+#include <geometric_shapes/shape_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <octomap/octomap.h>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <limits>
 
 using namespace distance_field;
 
@@ -733,7 +743,10 @@ TEST(TestSignedPropagationDistanceField, TestOcTree)
                                       PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, false);
 
   df_highres.addOcTreeToField(&tree_lowres);
-  EXPECT_EQ(countOccupiedCells(df_highres), 3*(6*6*6));
+  // each 5cm leaf covers two or three 2cm cells in each dimension
+  EXPECT_GE(countOccupiedCells(df_highres), 3*(2*2*2));
+  EXPECT_LE(countOccupiedCells(df_highres), 3*(3*3*3));
+  EXPECT_TRUE(checkOctomapVersusDistanceField(df_highres, tree_lowres));
   std::cout << "Occupied cells " << countOccupiedCells(df_highres) << std::endl;
 
   //testing adding shape that happens to be octree
@@ -811,6 +824,478 @@ TEST(TestSignedPropagationDistanceField, TestReadWrite)
   EXPECT_FALSE(areDistanceFieldsDistancesEqual(df, df3));
 }
 
+TEST(TestSignedPropagationDistanceField, TestParallelPropagation)
+{
+  PropagationDistanceField serial_df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                     PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  PropagationDistanceField parallel_df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                       PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true, 4);
+  EXPECT_EQ(4u, parallel_df.getPropagationThreads());
+
+  shapes::Sphere sphere(.5);
+  shapes::Box box(.4, .8, .3);
+
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .8;
+  p.position.y = .8;
+  p.position.z = .8;
+
+  geometry_msgs::Pose np;
+  np.orientation.w = 1.0;
+  np.position.x = 1.9;
+  np.position.y = 1.4;
+  np.position.z = 2.5;
+
+  serial_df.addShapeToField(&sphere, p);
+  parallel_df.addShapeToField(&sphere, p);
+  serial_df.addShapeToField(&box, np);
+  parallel_df.addShapeToField(&box, np);
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(serial_df, parallel_df));
+
+  for (int z=0; z<serial_df.getZNumCells(); z++)
+    for (int x=0; x<serial_df.getXNumCells(); x++)
+      for (int y=0; y<serial_df.getYNumCells(); y++)
+      {
+        ASSERT_EQ(serial_df.getCell(x,y,z).closest_point_, parallel_df.getCell(x,y,z).closest_point_);
+        ASSERT_EQ(serial_df.getCell(x,y,z).closest_negative_point_, parallel_df.getCell(x,y,z).closest_negative_point_);
+      }
+
+  // removal propagates again from the remaining obstacles
+  serial_df.moveShapeInField(&sphere, p, np);
+  parallel_df.moveShapeInField(&sphere, p, np);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(serial_df, parallel_df));
+}
+
+TEST(TestSignedPropagationDistanceField, TestCompactField)
+{
+  EXPECT_LE(sizeof(CompactPropDistanceFieldVoxel) * 3, sizeof(PropDistanceFieldVoxel));
+
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  df.addShapeToField(&sphere, p);
+
+  CompactDistanceField compact_df(df);
+  ASSERT_EQ(df.getXNumCells(), compact_df.getXNumCells());
+  ASSERT_EQ(df.getYNumCells(), compact_df.getYNumCells());
+  ASSERT_EQ(df.getZNumCells(), compact_df.getZNumCells());
+  EXPECT_EQ(df.getMaximumDistanceSquared(), compact_df.getMaximumDistanceSquared());
+  for (int z=0; z<df.getZNumCells(); z++)
+    for (int x=0; x<df.getXNumCells(); x++)
+      for (int y=0; y<df.getYNumCells(); y++)
+      {
+        ASSERT_EQ(df.getDistance(x,y,z), compact_df.getDistance(x,y,z));
+        Eigen::Vector3i closest;
+        if (compact_df.getClosestCell(x,y,z,closest))
+          EXPECT_EQ(df.getCell(x,y,z).closest_point_, closest);
+        else
+          EXPECT_EQ((int)PropDistanceFieldVoxel::UNINITIALIZED, df.getCell(x,y,z).closest_point_.x());
+        if (compact_df.getClosestCell(x,y,z,closest,true))
+          EXPECT_EQ(df.getCell(x,y,z).closest_negative_point_, closest);
+      }
+  EXPECT_EQ(df.getDistance(.5,.5,.5), compact_df.getDistance(.5,.5,.5));
+  EXPECT_EQ(df.getDistance(.1,.9,.2), compact_df.getDistance(.1,.9,.2));
+
+  compact_df.reset();
+  EXPECT_NEAR(compact_df.getUninitializedDistance(), compact_df.getDistance(.5,.5,.5), 1e-6);
+}
+
+TEST(TestSignedPropagationDistanceField, TestSparseStorage)
+{
+  PropagationDistanceField dense_df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                    PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  PropagationDistanceField sparse_df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                     PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true, 1, true);
+  PropagationDistanceField parallel_sparse_df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                              PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true, 4, true);
+  EXPECT_FALSE(dense_df.hasSparseStorage());
+  EXPECT_TRUE(sparse_df.hasSparseStorage());
+  EXPECT_EQ(0u, sparse_df.getGrid().getNumAllocatedBlocks());
+
+  shapes::Sphere sphere(.3);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .8;
+  p.position.y = .8;
+  p.position.z = .8;
+  dense_df.addShapeToField(&sphere, p);
+  sparse_df.addShapeToField(&sphere, p);
+  parallel_sparse_df.addShapeToField(&sphere, p);
+
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(dense_df, sparse_df));
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(dense_df, parallel_sparse_df));
+
+  // only the blocks near the sphere are allocated
+  int block = VoxelGrid<PropDistanceFieldVoxel>::BLOCK_SIZE;
+  std::size_t total_blocks = ((sparse_df.getXNumCells() + block - 1) / block) *
+    ((sparse_df.getYNumCells() + block - 1) / block) * ((sparse_df.getZNumCells() + block - 1) / block);
+  EXPECT_GT(sparse_df.getGrid().getNumAllocatedBlocks(), 0u);
+  EXPECT_LT(sparse_df.getGrid().getNumAllocatedBlocks() * 10, total_blocks);
+
+  geometry_msgs::Pose np = p;
+  np.position.z = 2.5;
+  dense_df.moveShapeInField(&sphere, p, np);
+  sparse_df.moveShapeInField(&sphere, p, np);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(dense_df, sparse_df));
+
+  // cells that were never written report themselves as their closest unoccupied cell, as in a dense field
+  std::size_t blocks = sparse_df.getGrid().getNumAllocatedBlocks();
+  for (int x = 0 ; x < sparse_df.getXNumCells() ; ++x)
+    for (int y = 0 ; y < sparse_df.getYNumCells() ; ++y)
+      for (int z = 0 ; z < sparse_df.getZNumCells() ; ++z)
+        ASSERT_EQ(dense_df.getCell(x, y, z).closest_negative_point_, sparse_df.getCell(x, y, z).closest_negative_point_);
+  EXPECT_EQ(blocks, sparse_df.getGrid().getNumAllocatedBlocks());
+
+  sparse_df.reset();
+  EXPECT_EQ(0u, sparse_df.getGrid().getNumAllocatedBlocks());
+}
+
+TEST(TestSignedPropagationDistanceField, TestBatchQueries)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  df.addShapeToField(&sphere, p);
+
+  EigenSTL::vector_Vector3d points;
+  for (double x = -0.1; x < width + 0.1; x += 0.07)
+    for (double y = -0.1; y < height + 0.1; y += 0.09)
+      for (double z = -0.1; z < depth + 0.1; z += 0.11)
+        points.push_back(Eigen::Vector3d(x, y, z));
+
+  std::vector<double> distances;
+  df.getDistances(points, distances);
+  ASSERT_EQ(points.size(), distances.size());
+
+  std::vector<double> gradient_distances;
+  EigenSTL::vector_Vector3d gradients;
+  std::vector<bool> in_bounds;
+  df.getDistanceGradients(points, gradient_distances, gradients, in_bounds);
+  ASSERT_EQ(points.size(), gradient_distances.size());
+  ASSERT_EQ(points.size(), gradients.size());
+  ASSERT_EQ(points.size(), in_bounds.size());
+
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    EXPECT_EQ(df.getDistance(points[i].x(), points[i].y(), points[i].z()), distances[i]);
+    Eigen::Vector3d grad;
+    bool valid;
+    double dist = df.getDistanceGradient(points[i].x(), points[i].y(), points[i].z(), grad.x(), grad.y(), grad.z(), valid);
+    EXPECT_EQ(dist, gradient_distances[i]);
+    EXPECT_EQ(valid, in_bounds[i]);
+    EXPECT_EQ(grad, gradients[i]);
+  }
+}
+
+TEST(TestSignedPropagationDistanceField, TestWorldDistanceField)
+{
+  collision_detection::WorldPtr world(new collision_detection::World());
+  shapes::ShapeConstPtr box(new shapes::Box(.3, .3, .3));
+  shapes::ShapeConstPtr sphere(new shapes::Sphere(.2));
+  Eigen::Affine3d box_pose = Eigen::Affine3d(Eigen::Translation3d(.3, .3, .3));
+  Eigen::Affine3d sphere_pose = Eigen::Affine3d(Eigen::Translation3d(.6, .6, .6));
+  world->addToObject("box", box, box_pose);
+
+  boost::shared_ptr<PropagationDistanceField> df(new PropagationDistanceField(width, height, depth, resolution,
+                                                                              origin_x, origin_y, origin_z, max_dist, true));
+  WorldDistanceField wdf(world, df);
+  EXPECT_EQ(df, wdf.getDistanceField());
+
+  geometry_msgs::Pose box_msg, sphere_msg;
+  tf::poseEigenToMsg(box_pose, box_msg);
+  tf::poseEigenToMsg(sphere_pose, sphere_msg);
+
+  PropagationDistanceField box_df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  box_df.addShapeToField(box.get(), box_msg);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, box_df));
+
+  // objects that overlap the box do not take cells away from it when they are removed
+  world->addToObject("sphere", sphere, sphere_pose);
+  world->addToObject("overlap", box, box_pose);
+  PropagationDistanceField both_df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  both_df.addShapeToField(box.get(), box_msg);
+  both_df.addShapeToField(sphere.get(), sphere_msg);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, both_df));
+  world->removeObject("overlap");
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, both_df));
+
+  // moving the sphere onto the box leaves only the box
+  world->moveShapeInObject("sphere", sphere, box_pose);
+  PropagationDistanceField moved_df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  moved_df.addShapeToField(box.get(), box_msg);
+  moved_df.addShapeToField(sphere.get(), box_msg);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, moved_df));
+
+  world->removeObject("sphere");
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, box_df));
+
+  // a different world replaces the objects of the previous one
+  collision_detection::WorldPtr other_world(new collision_detection::World());
+  other_world->addToObject("sphere", sphere, sphere_pose);
+  wdf.setWorld(other_world);
+  PropagationDistanceField sphere_df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  sphere_df.addShapeToField(sphere.get(), sphere_msg);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, sphere_df));
+
+  // the previous world is no longer observed
+  world->removeObject("box");
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, sphere_df));
+
+  other_world->clearObjects();
+  PropagationDistanceField empty_df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(*df, empty_df));
+}
+
+TEST(TestSignedPropagationDistanceField, TestBinaryReadWrite)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  df.addShapeToField(&sphere, p);
+
+  for (int compress = 0 ; compress < 2 ; ++compress)
+  {
+    std::stringstream ss;
+    ASSERT_TRUE(df.writeBinaryToStream(ss, compress));
+
+    // the parameters come from the data, not the constructor
+    PropagationDistanceField df2(0.1, 0.1, 0.1, 0.05, 1.0, 1.0, 1.0, 0.1, false);
+    ASSERT_TRUE(df2.readBinaryFromStream(ss));
+    EXPECT_EQ(df.getUninitializedDistance(), df2.getUninitializedDistance());
+    EXPECT_EQ(df.getOriginX(), df2.getOriginX());
+    ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, df2));
+    for (int z=0; z<df.getZNumCells(); z++)
+      for (int x=0; x<df.getXNumCells(); x++)
+        for (int y=0; y<df.getYNumCells(); y++)
+        {
+          ASSERT_EQ(df.getCell(x,y,z).closest_point_, df2.getCell(x,y,z).closest_point_);
+          ASSERT_EQ(df.getCell(x,y,z).closest_negative_point_, df2.getCell(x,y,z).closest_negative_point_);
+        }
+  }
+
+  std::ofstream f("test_binary.df", std::ios::out | std::ios::binary);
+  ASSERT_TRUE(df.writeBinaryToStream(f));
+  f.close();
+
+  PropagationDistanceField df3(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true, 1, true);
+  ASSERT_TRUE(df3.readBinaryFromFile("test_binary.df"));
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, df3));
+
+  // the loaded field can be updated without propagating from scratch
+  geometry_msgs::Pose np = p;
+  np.position.x = .3;
+  df.moveShapeInField(&sphere, p, np);
+  df3.moveShapeInField(&sphere, p, np);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, df3));
+
+  std::stringstream bad("not a distance field");
+  EXPECT_FALSE(df3.readBinaryFromStream(bad));
+  EXPECT_FALSE(df3.readBinaryFromFile("does_not_exist.df"));
+
+  // corrupt headers are rejected before the field is touched; the
+  // offsets are those of the resolution and the x cell count
+  std::stringstream out;
+  ASSERT_TRUE(df.writeBinaryToStream(out));
+  const std::string good = out.str();
+  const std::size_t resolution_offset = 24;
+  const std::size_t num_cells_offset = 88;
+  const double bad_resolutions[] = { 0.0, -resolution, std::numeric_limits<double>::quiet_NaN() };
+  for (std::size_t k = 0 ; k < sizeof(bad_resolutions) / sizeof(bad_resolutions[0]) ; ++k)
+  {
+    std::string data = good;
+    memcpy(&data[resolution_offset], &bad_resolutions[k], sizeof(double));
+    EXPECT_FALSE(df3.readBinaryFromData(data.data(), data.size()));
+  }
+  const boost::int32_t bad_cells[] = { -1, df.getXNumCells() + 1, std::numeric_limits<boost::int32_t>::max() };
+  for (std::size_t k = 0 ; k < sizeof(bad_cells) / sizeof(bad_cells[0]) ; ++k)
+  {
+    std::string data = good;
+    memcpy(&data[num_cells_offset], &bad_cells[k], sizeof(boost::int32_t));
+    EXPECT_FALSE(df3.readBinaryFromData(data.data(), data.size()));
+  }
+  EXPECT_FALSE(df3.readBinaryFromData(good.data(), good.size() - 8));
+  EXPECT_EQ(df.getXNumCells(), df3.getXNumCells());
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, df3));
+  EXPECT_TRUE(df3.readBinaryFromData(good.data(), good.size()));
+}
+
+TEST(TestSignedPropagationDistanceField, TestMeshVoxelization)
+{
+  shapes::Box box(.5, .5, .5);
+  boost::scoped_ptr<shapes::Mesh> mesh(shapes::createMeshFromShape(&box));
+  ASSERT_TRUE(mesh.get() != NULL);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+
+  PropagationDistanceField df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  EXPECT_TRUE(df.getFillMeshes());
+  df.addShapeToField(mesh.get(), p);
+
+  int cx, cy, cz;
+  ASSERT_TRUE(df.worldToGrid(.5, .5, .5, cx, cy, cz));
+  EXPECT_EQ(0, df.getCell(cx, cy, cz).distance_square_);
+  EXPECT_LT(df.getDistance(.5, .5, .5), 0.0);
+
+  // no obstacle cell lies further than one cell from the box
+  for (int z=0; z<df.getZNumCells(); z++)
+    for (int x=0; x<df.getXNumCells(); x++)
+      for (int y=0; y<df.getYNumCells(); y++)
+        if (df.getCell(x,y,z).distance_square_ == 0)
+        {
+          double wx, wy, wz;
+          df.gridToWorld(x, y, z, wx, wy, wz);
+          EXPECT_LE(fabs(wx - .5), .25 + resolution);
+          EXPECT_LE(fabs(wy - .5), .25 + resolution);
+          EXPECT_LE(fabs(wz - .5), .25 + resolution);
+        }
+
+  // removing the mesh removes exactly the cells it added
+  df.removeShapeFromField(mesh.get(), p);
+  EXPECT_EQ(df.getUninitializedDistance(), df.getDistance(.5, .5, .5));
+
+  // without filling, only the surface is an obstacle
+  PropagationDistanceField hollow(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  hollow.setFillMeshes(false);
+  hollow.addShapeToField(mesh.get(), p);
+  EXPECT_GT(hollow.getCell(cx, cy, cz).distance_square_, 0);
+  int sx, sy, sz;
+  ASSERT_TRUE(hollow.worldToGrid(.25, .5, .5, sx, sy, sz));
+  EXPECT_EQ(0, hollow.getCell(sx, sy, sz).distance_square_);
+}
+
+TEST(TestSignedPropagationDistanceField, TestOcTreeLeafBoxes)
+{
+  // a cube that octomap prunes into a single leaf 16 cells wide
+  octomap::OcTree tree(PERF_RESOLUTION);
+  for(int x = 0; x < 16; x++)
+    for(int y = 0; y < 16; y++)
+      for(int z = 0; z < 16; z++)
+        tree.updateNode(octomap::point3d(.64 + (x + .5) * PERF_RESOLUTION,
+                                         .64 + (y + .5) * PERF_RESOLUTION,
+                                         .64 + (z + .5) * PERF_RESOLUTION), true);
+  tree.prune();
+
+  unsigned int leaves = 0;
+  for(octomap::OcTree::leaf_iterator it = tree.begin_leafs(), end = tree.end_leafs(); it != end; ++it)
+    if (tree.isNodeOccupied(*it))
+      leaves++;
+  EXPECT_LT(leaves, 16u*16u*16u);
+
+  PropagationDistanceField df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                              PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, false);
+  df.addOcTreeToField(&tree);
+  EXPECT_EQ(16u*16u*16u, countOccupiedCells(df));
+  EXPECT_TRUE(checkOctomapVersusDistanceField(df, tree));
+
+  // the points of the shape are the same cells, so it can be removed again
+  boost::shared_ptr<octomap::OcTree> tree_ptr(new octomap::OcTree(tree));
+  shapes::OcTree shape_oc(tree_ptr);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  df.removeShapeFromField(&shape_oc, p);
+  EXPECT_EQ(0u, countOccupiedCells(df));
+}
+
+TEST(TestSignedPropagationDistanceField, TestRebuildChangedRegion)
+{
+  PropagationDistanceField df_inc(2.0, 2.0, 2.0, .05, 0.0, 0.0, 0.0, .2, true);
+  PropagationDistanceField df_reb(2.0, 2.0, 2.0, .05, 0.0, 0.0, 0.0, .2, true);
+  df_reb.setRebuildFraction(1e-6);
+  EXPECT_EQ(1e-6, df_reb.getRebuildFraction());
+
+  shapes::Sphere sphere(.1);
+  shapes::Box box(.3, .2, .1);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  geometry_msgs::Pose bp = p;
+  bp.position.x = 1.5;
+  df_inc.addShapeToField(&sphere, p);
+  df_reb.addShapeToField(&sphere, p);
+  df_inc.addShapeToField(&box, bp);
+  df_reb.addShapeToField(&box, bp);
+
+  // small moves only rebuild a region around the sphere
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    geometry_msgs::Pose np = p;
+    np.position.x += .05;
+    np.position.z += .02;
+    df_inc.moveShapeInField(&sphere, p, np);
+    df_reb.moveShapeInField(&sphere, p, np);
+    p = np;
+    ASSERT_TRUE(areDistanceFieldsDistancesEqual(df_inc, df_reb));
+  }
+
+  // moving the sphere across the field rebuilds everything
+  geometry_msgs::Pose np = p;
+  np.position.x = 1.5;
+  np.position.y = 1.5;
+  np.position.z = 1.5;
+  df_inc.moveShapeInField(&sphere, p, np);
+  df_reb.moveShapeInField(&sphere, p, np);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df_inc, df_reb));
+
+  df_inc.removeShapeFromField(&box, bp);
+  df_reb.removeShapeFromField(&box, bp);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df_inc, df_reb));
+}
+
+TEST(TestSensorFrustum, TestVisibility)
+{
+  moveit_sensor_manager::SensorInfo info;
+  info.min_dist = 0.05;
+  info.max_dist = 2.0;
+  info.x_angle = 1.0;
+  info.y_angle = 1.0;
+  SensorFrustum frustum(info);
+
+  // a wall across the middle of the field
+  PropagationDistanceField df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist);
+  EigenSTL::vector_Vector3d wall;
+  for (double x = 0.2 ; x <= 0.8 ; x += resolution)
+    for (double y = 0.2 ; y <= 0.8 ; y += resolution)
+      wall.push_back(Eigen::Vector3d(x, y, 0.5));
+  df.addPointsToField(wall);
+
+  // the sensor looks along Z, towards the wall
+  Eigen::Affine3d sensor_pose = Eigen::Affine3d(Eigen::Translation3d(0.5, 0.5, 0.05));
+  EXPECT_TRUE(frustum.contains(sensor_pose, Eigen::Vector3d(0.5, 0.5, 0.3)));
+  EXPECT_FALSE(frustum.contains(sensor_pose, Eigen::Vector3d(0.9, 0.5, 0.1)));
+  EXPECT_FALSE(frustum.contains(sensor_pose, Eigen::Vector3d(0.5, 0.5, 0.0)));
+
+  EXPECT_TRUE(frustum.isVisible(sensor_pose, Eigen::Vector3d(0.5, 0.5, 0.3), df));
+  EXPECT_TRUE(frustum.isVisible(sensor_pose, Eigen::Vector3d(0.5, 0.5, 0.5), df));
+  EXPECT_FALSE(frustum.isVisible(sensor_pose, Eigen::Vector3d(0.5, 0.5, 0.8), df));
+
+  EigenSTL::vector_Vector3d region;
+  region.push_back(Eigen::Vector3d(0.5, 0.5, 0.3));
+  region.push_back(Eigen::Vector3d(0.5, 0.5, 0.8));
+  EXPECT_DOUBLE_EQ(0.5, frustum.getVisibleFraction(sensor_pose, region, df));
+
+  const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(frustum.getShape().get());
+  EXPECT_EQ(8u, mesh->vertex_count);
+  EXPECT_EQ(12u, mesh->triangle_count);
+}
+
 int main(int argc, char **argv){
   testing::InitGoogleTest(&argc, argv);
 
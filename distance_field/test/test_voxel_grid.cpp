@@ -91,6 +91,60 @@ TEST(TestVoxelGrid, TestReadWrite)
 
 }
 
+void initializeCell(int& cell, int x, int y, int z)
+{
+  cell += x * 10000 + y * 100 + z;
+}
+
+TEST(TestVoxelGrid, TestSparse)
+{
+  int def=-100;
+  VoxelGrid<int> vg(1.0,0.5,0.3,0.01,0,0,0, def, true);
+  EXPECT_TRUE(vg.isSparse());
+  EXPECT_EQ(100, vg.getNumCells(DIM_X));
+  EXPECT_EQ(50, vg.getNumCells(DIM_Y));
+  EXPECT_EQ(30, vg.getNumCells(DIM_Z));
+
+  vg.reset(7);
+  const VoxelGrid<int>& cvg = vg;
+  EXPECT_EQ(7, cvg.getCell(0,0,0));
+  EXPECT_EQ(7, cvg.getCell(99,49,29));
+  EXPECT_EQ(0u, vg.getNumAllocatedBlocks());
+
+  // writing allocates only the block that holds the cell
+  vg.getCell(99,49,29) = 3;
+  vg.setCell(98,48,28, 4);
+  EXPECT_EQ(1u, vg.getNumAllocatedBlocks());
+  EXPECT_EQ(3, cvg.getCell(99,49,29));
+  EXPECT_EQ(4, cvg.getCell(98,48,28));
+  EXPECT_EQ(7, cvg.getCell(97,49,29));
+  EXPECT_EQ(7, cvg.getCell(0,0,0));
+  EXPECT_EQ(1u, vg.getNumAllocatedBlocks());
+
+  vg.setCell(0,0,0, 5);
+  EXPECT_EQ(2u, vg.getNumAllocatedBlocks());
+  EXPECT_EQ(5, cvg.getCell(0,0,0));
+  EXPECT_EQ(7, cvg.getCell(8,0,0));
+
+  // out-of-bounds queries in world coordinates still give the default
+  EXPECT_EQ(def, vg(-1.0,0.0,0.0));
+
+  vg.reset(1);
+  EXPECT_EQ(0u, vg.getNumAllocatedBlocks());
+  EXPECT_EQ(1, cvg.getCell(99,49,29));
+
+  vg.setCellInitializer(&initializeCell);
+  vg.getCell(17,9,3) = 0;
+  EXPECT_EQ(1 + 16 * 10000 + 8 * 100 + 0, cvg.getCell(16,8,0));
+  EXPECT_EQ(1 + 23 * 10000 + 15 * 100 + 7, cvg.getCell(23,15,7));
+  EXPECT_EQ(1, cvg.getCell(24,15,7));
+
+  // copies of cells that are not allocated include the initializer, without allocating
+  EXPECT_EQ(1 + 24 * 10000 + 15 * 100 + 7, cvg.getCellValue(24,15,7));
+  EXPECT_EQ(1 + 16 * 10000 + 8 * 100 + 0, cvg.getCellValue(16,8,0));
+  EXPECT_EQ(1u, vg.getNumAllocatedBlocks());
+}
+
 int main(int argc, char **argv){
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -40,8 +40,13 @@
 // KDL
 #include <kdl/chain.hpp>
 #include <kdl/chainidsolver_recursive_newton_euler.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/jntspaceinertiamatrix.hpp>
+#include <kdl/chaindynparam.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
 #include <geometry_msgs/Vector3.h>
 #include <geometry_msgs/Wrench.h>
 
@@ -52,12 +57,40 @@ namespace dynamics_solver
 /**
  * This solver currently computes the required torques given a
  * joint configuration, velocities, accelerations and external wrenches
- * acting on the links of a robot
+ * acting on the links of a robot.
+ *
+ * The query functions do not modify the solver, so one solver can be used
+ * by several threads at the same time. The scratch space of a query is kept
+ * in a Workspace; the functions without a Workspace argument create one for
+ * the call.
  */
 class DynamicsSolver
 {
 public:
 
+  /**
+   * @brief Scratch space for the queries of a solver. A thread that makes many
+   * queries can keep one and pass it to the query functions, to avoid allocations.
+   * A workspace must not be used by multiple threads at the same time.
+   */
+  class Workspace
+  {
+  public:
+    Workspace(const DynamicsSolver &solver);
+
+  private:
+    friend class DynamicsSolver;
+
+    boost::shared_ptr<KDL::ChainIdSolver_RNE> id_solver_;
+    boost::shared_ptr<KDL::ChainDynParam> dyn_param_; // created on first use
+    boost::shared_ptr<KDL::ChainJntToJacSolver> jac_solver_; // created on first use
+    KDL::JntArray angles_, velocities_, accelerations_, torques_;
+    KDL::JntSpaceInertiaMatrix mass_matrix_;
+    KDL::Jacobian jacobian_;
+    KDL::Wrenches wrenches_;
+    std::vector<double> values_;
+  };
+
   /**
    * @brief Initialize the dynamics solver
    * @param urdf_model The urdf model for the robot
@@ -90,11 +123,41 @@ public:
                   const std::vector<geometry_msgs::Wrench> &wrenches,
                   std::vector<double> &torques) const;
 
+  /** @brief Same as above, with the scratch space of \e workspace */
+  bool getTorques(const std::vector<double> &joint_angles,
+                  const std::vector<double> &joint_velocities,
+                  const std::vector<double> &joint_accelerations,
+                  const std::vector<geometry_msgs::Wrench> &wrenches,
+                  std::vector<double> &torques,
+                  Workspace &workspace) const;
+
+  /**
+   * @brief Get the torques for all waypoints of a trajectory of this group, with no external wrenches.
+   * The joint velocities and accelerations are taken from the waypoints (zero where not set).
+   * The solver scratch space is allocated once per thread, not per waypoint.
+   * @param trajectory The trajectory; its group must be the group of this solver
+   * @param torques The computed torques, one vector per waypoint (resized as needed)
+   * @param first_violation If not NULL, set to the index of the first waypoint at which a torque exceeds
+   * getMaxTorques() (joints with a maximum torque of 0 are not checked), or to the number of waypoints
+   * if there is none
+   * @param stop_at_violation If true, torques are not computed for the waypoints after a violation
+   * (their entries in \e torques are left empty)
+   * @param num_threads The number of threads the waypoints are distributed over
+   * @return False if the trajectory is not for the group of this solver or the torques could not be computed
+   */
+  bool getTrajectoryTorques(const robot_trajectory::RobotTrajectory &trajectory,
+                            std::vector<std::vector<double> > &torques,
+                            std::size_t *first_violation = NULL,
+                            bool stop_at_violation = false,
+                            unsigned int num_threads = 1) const;
+
   /**
    * @brief Get the maximum payload for this group (in kg). Payload is
    * the weight that this group can hold when the weight is attached to the origin
    * of the last link of this group. (The order of joint_angles vector is the same
    * as the order of joints for this group in the RobotModel)
+   * The torques of the payload are computed with the transpose of the Jacobian of the
+   * last link, so this needs one gravity torque computation and no full inverse dynamics.
    * @param joint_angles The joint angles (desired joint configuration)
    * this must have size = number of joints in the group
    * @param payload The computed maximum payload
@@ -105,6 +168,24 @@ public:
                      double &payload,
                      unsigned int &joint_saturated) const;
 
+  /** @brief Same as above, with the scratch space of \e workspace */
+  bool getMaxPayload(const std::vector<double> &joint_angles,
+                     double &payload,
+                     unsigned int &joint_saturated,
+                     Workspace &workspace) const;
+
+  /**
+   * @brief Get the maximum payload (in kg) for every waypoint of a trajectory of this group,
+   * as computed by getMaxPayload(). Joint velocities and accelerations are ignored.
+   * @param trajectory The trajectory; its group must be the group of this solver
+   * @param payloads The maximum payload for each waypoint (resized as needed)
+   * @param joints_saturated The first saturated joint for each waypoint (resized as needed)
+   * @return False if the trajectory is not for the group of this solver or the payload could not be computed
+   */
+  bool getTrajectoryMaxPayloads(const robot_trajectory::RobotTrajectory &trajectory,
+                                std::vector<double> &payloads,
+                                std::vector<unsigned int> &joints_saturated) const;
+
   /**
    * @brief Get torques corresponding to a particular payload value.  Payload is
    * the weight that this group can hold when the weight is attached to the origin
@@ -119,6 +200,59 @@ public:
                          double payload,
                          std::vector<double> &joint_torques) const;
 
+  /** @brief Same as above, with the scratch space of \e workspace */
+  bool getPayloadTorques(const std::vector<double> &joint_angles,
+                         double payload,
+                         std::vector<double> &joint_torques,
+                         Workspace &workspace) const;
+
+  /**
+   * @brief Get the joint space inertia matrix M(q) of the group (rows and columns
+   * in the order of joints for this group in the RobotModel)
+   * @param joint_angles The joint angles; this must have size = number of joints in the group
+   * @param mass_matrix The computed matrix; it is only resized if it does not already have
+   * the size number of joints x number of joints
+   * @return False if the input vector is of the wrong size or the matrix could not be computed
+   */
+  bool getMassMatrix(const std::vector<double> &joint_angles,
+                     Eigen::MatrixXd &mass_matrix) const;
+
+  /** @brief Same as above, with the scratch space of \e workspace */
+  bool getMassMatrix(const std::vector<double> &joint_angles,
+                     Eigen::MatrixXd &mass_matrix,
+                     Workspace &workspace) const;
+
+  /**
+   * @brief Get the Coriolis and centrifugal torques C(q, qdot) * qdot
+   * @param joint_angles The joint angles; this must have size = number of joints in the group
+   * @param joint_velocities The joint velocities; this must have size = number of joints in the group
+   * @param torques The computed torques; this must have size = number of joints in the group
+   * @return False if any of the vectors are of the wrong size or the torques could not be computed
+   */
+  bool getCoriolisTorques(const std::vector<double> &joint_angles,
+                          const std::vector<double> &joint_velocities,
+                          std::vector<double> &torques) const;
+
+  /** @brief Same as above, with the scratch space of \e workspace */
+  bool getCoriolisTorques(const std::vector<double> &joint_angles,
+                          const std::vector<double> &joint_velocities,
+                          std::vector<double> &torques,
+                          Workspace &workspace) const;
+
+  /**
+   * @brief Get the torques needed to hold the group against gravity, g(q)
+   * @param joint_angles The joint angles; this must have size = number of joints in the group
+   * @param torques The computed torques; this must have size = number of joints in the group
+   * @return False if any of the vectors are of the wrong size or the torques could not be computed
+   */
+  bool getGravityTorques(const std::vector<double> &joint_angles,
+                         std::vector<double> &torques) const;
+
+  /** @brief Same as above, with the scratch space of \e workspace */
+  bool getGravityTorques(const std::vector<double> &joint_angles,
+                         std::vector<double> &torques,
+                         Workspace &workspace) const;
+
   /**
    * @brief Get maximum torques for this group
    * @return Vector of max torques
@@ -145,7 +279,29 @@ public:
 
 private:
 
-  boost::shared_ptr<KDL::ChainIdSolver_RNE> chain_id_solver_; // KDL chain inverse dynamics
+  struct TrajectoryTorques;
+
+  /** \brief Compute the torques for the waypoints of one thread (every num_threads-th chunk) */
+  void computeTrajectoryTorques(TrajectoryTorques *work, std::size_t thread_index) const;
+
+  /** \brief Run the inverse dynamics on the values in the arrays of \e workspace */
+  bool computeTorques(Workspace &workspace) const;
+
+  /** \brief Check the size of \e values (described by \e name in the error message) against the number of joints */
+  bool checkJointVectorSize(const std::vector<double> &values, const char *name) const;
+
+  /** \brief Copy \e joint_angles into \e workspace and make sure its dynamic parameters solver exists */
+  void prepareDynParam(const std::vector<double> &joint_angles, Workspace &workspace) const;
+
+  /** \brief Copy the positions, velocities and accelerations of waypoint \e index of \e trajectory into \e workspace */
+  void loadWayPoint(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index, Workspace &workspace) const;
+
+  /** \brief Compute the gravity torques and the Jacobian of the tip for the joint angles in \e workspace */
+  bool computePayloadTerms(Workspace &workspace) const;
+
+  /** \brief Compute the maximum payload from the terms computed by computePayloadTerms() */
+  void computeMaxPayload(const Workspace &workspace, double &payload, unsigned int &joint_saturated) const;
+
   KDL::Chain kdl_chain_; // KDL chain
 
   std::string group_name_, base_name_, tip_name_; // group name, base name, tip name
@@ -155,10 +311,8 @@ private:
   robot_model::RobotModelConstPtr kinematic_model_; // kinematic model
   const robot_model::JointModelGroup* joint_model_group_; //joint model group
 
-  robot_state::RobotStatePtr kinematic_state_; //kinematic state
-  robot_state::JointStateGroup* joint_state_group_; //joint state for the group
-
   double gravity_; //Norm of the gravity vector passed in initialize()
+  KDL::Vector gravity_vector_; //The gravity vector passed in initialize()
 
 };
 
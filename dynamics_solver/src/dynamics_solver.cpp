@@ -45,25 +45,18 @@
 #include <kdl/chainjnttojacsolver.hpp>
 #include <kdl/tree.hpp>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 namespace dynamics_solver
 {
 
-namespace
-{
-inline geometry_msgs::Vector3 transformVector(const Eigen::Affine3d &transform,
-                                              const geometry_msgs::Vector3 &vector)
+DynamicsSolver::Workspace::Workspace(const DynamicsSolver &solver) :
+  id_solver_(new KDL::ChainIdSolver_RNE(solver.kdl_chain_, solver.gravity_vector_)),
+  angles_(solver.num_joints_), velocities_(solver.num_joints_), accelerations_(solver.num_joints_), torques_(solver.num_joints_),
+  wrenches_(solver.num_segments_, KDL::Wrench::Zero()), mass_matrix_(solver.num_joints_),
+  jacobian_(solver.num_joints_)
 {
-  Eigen::Vector3d p;
-  p = Eigen::Vector3d(vector.x, vector.y, vector.z);
-  p = transform.rotation()*p;
-
-  geometry_msgs::Vector3 result;
-  result.x = p.x();
-  result.y = p.y();
-  result.z = p.z();
-
-  return result;
-}
 }
 
 DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr &kinematic_model,
@@ -122,9 +115,6 @@ DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr &kinematic_
   num_joints_ = kdl_chain_.getNrOfJoints();
   num_segments_ = kdl_chain_.getNrOfSegments();
 
-  kinematic_state_.reset(new robot_state::RobotState(kinematic_model_));
-  joint_state_group_ = kinematic_state_->getJointStateGroup(joint_model_group_->getName());
-
   const std::vector<std::string> joint_model_names = joint_model_group_->getJointModelNames();
   for(unsigned int i=0; i < joint_model_names.size(); ++i)
   {
@@ -137,9 +127,8 @@ DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr &kinematic_
 
   KDL::Vector gravity(gravity_vector.x,gravity_vector.y,gravity_vector.z); // \todo Not sure if KDL expects the negative of this (Sachin)
   gravity_ = gravity.Norm();
+  gravity_vector_ = gravity;
   logDebug("Gravity norm set to %f", gravity_);
-
-  chain_id_solver_.reset(new KDL::ChainIdSolver_RNE(kdl_chain_, gravity));
 }
 
 bool DynamicsSolver::getTorques(const std::vector<double> &joint_angles,
@@ -147,6 +136,22 @@ bool DynamicsSolver::getTorques(const std::vector<double> &joint_angles,
                                 const std::vector<double> &joint_accelerations,
                                 const std::vector<geometry_msgs::Wrench> &wrenches,
                                 std::vector<double> &torques) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  Workspace workspace(*this);
+  return getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, torques, workspace);
+}
+
+bool DynamicsSolver::getTorques(const std::vector<double> &joint_angles,
+                                const std::vector<double> &joint_velocities,
+                                const std::vector<double> &joint_accelerations,
+                                const std::vector<geometry_msgs::Wrench> &wrenches,
+                                std::vector<double> &torques,
+                                Workspace &workspace) const
 {
   if(!joint_model_group_)
   {
@@ -179,88 +184,112 @@ bool DynamicsSolver::getTorques(const std::vector<double> &joint_angles,
     return false;
   }
 
-  KDL::JntArray kdl_angles(num_joints_), kdl_velocities(num_joints_), kdl_accelerations(num_joints_), kdl_torques(num_joints_);
-  KDL::Wrenches kdl_wrenches(num_segments_);
-
   for(unsigned int i=0; i < num_joints_; ++i)
   {
-    kdl_angles(i) = joint_angles[i];
-    kdl_velocities(i) = joint_velocities[i];
-    kdl_accelerations(i) = joint_accelerations[i];
+    workspace.angles_(i) = joint_angles[i];
+    workspace.velocities_(i) = joint_velocities[i];
+    workspace.accelerations_(i) = joint_accelerations[i];
   }
 
   for(unsigned int i=0; i < num_segments_; ++i)
   {
-    kdl_wrenches[i](0) = wrenches[i].force.x;
-    kdl_wrenches[i](1) = wrenches[i].force.y;
-    kdl_wrenches[i](2) = wrenches[i].force.z;
-
-    kdl_wrenches[i](3) = wrenches[i].torque.x;
-    kdl_wrenches[i](4) = wrenches[i].torque.y;
-    kdl_wrenches[i](5) = wrenches[i].torque.z;
+    KDL::Wrench &kdl_wrench = workspace.wrenches_[i];
+    kdl_wrench(0) = wrenches[i].force.x;
+    kdl_wrench(1) = wrenches[i].force.y;
+    kdl_wrench(2) = wrenches[i].force.z;
+
+    kdl_wrench(3) = wrenches[i].torque.x;
+    kdl_wrench(4) = wrenches[i].torque.y;
+    kdl_wrench(5) = wrenches[i].torque.z;
   }
 
-  if(chain_id_solver_->CartToJnt(kdl_angles, kdl_velocities, kdl_accelerations, kdl_wrenches, kdl_torques) < 0)
-  {
-    logError("Something went wrong computing torques");
+  if(!computeTorques(workspace))
     return false;
-  }
 
   for(unsigned int i=0; i < num_joints_; ++i)
-    torques[i] = kdl_torques(i);
+    torques[i] = workspace.torques_(i);
 
   return true;
 }
 
-bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
-                                   double &payload,
-                                   unsigned int &joint_saturated) const
+bool DynamicsSolver::computeTorques(Workspace &workspace) const
 {
-  if(!joint_model_group_)
+  if(workspace.id_solver_->CartToJnt(workspace.angles_, workspace.velocities_, workspace.accelerations_,
+                                     workspace.wrenches_, workspace.torques_) < 0)
   {
-    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    logError("Something went wrong computing torques");
     return false;
   }
-  if(joint_angles.size() != num_joints_)
+  return true;
+}
+
+void DynamicsSolver::loadWayPoint(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index,
+                                  Workspace &workspace) const
+{
+  if (trajectory.isCompact())
   {
-    logError("Joint angles vector should be size %d", num_joints_);
-    return false;
+    // read the rows directly; creating the waypoint states is not safe from multiple threads
+    const double *positions = trajectory.getWayPointPositions(index);
+    const double *velocities = trajectory.getWayPointVelocities(index);
+    const double *accelerations = trajectory.getWayPointAccelerations(index);
+    for (unsigned int j = 0 ; j < num_joints_ ; ++j)
+    {
+      workspace.angles_(j) = positions[j];
+      workspace.velocities_(j) = velocities ? velocities[j] : 0.0;
+      workspace.accelerations_(j) = accelerations ? accelerations[j] : 0.0;
+    }
   }
-  std::vector<double> joint_velocities(num_joints_, 0.0), joint_accelerations(num_joints_, 0.0);
-  std::vector<double> torques(num_joints_, 0.0), zero_torques(num_joints_, 0.0);
-
-  std::vector<geometry_msgs::Wrench> wrenches(num_segments_);
-  if(!getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, zero_torques))
-    return false;
-
-  for(unsigned int i=0; i < num_joints_; ++i)
+  else
   {
-    if(fabs(zero_torques[i]) >= max_torques_[i])
+    const robot_state::JointStateGroup *jsg = trajectory.getWayPoint(index).getJointStateGroup(group_name_);
+    jsg->getVariableValues(workspace.values_);
+    const std::vector<robot_state::JointState*> &joints = jsg->getJointStateVector();
+    for (unsigned int j = 0 ; j < num_joints_ ; ++j)
     {
-      payload = 0.0;
-      joint_saturated = i;
-      return true;
+      workspace.angles_(j) = workspace.values_[j];
+      workspace.velocities_(j) = joints[j]->getVelocities().empty() ? 0.0 : joints[j]->getVelocities()[0];
+      workspace.accelerations_(j) = joints[j]->getAccelerations().empty() ? 0.0 : joints[j]->getAccelerations()[0];
     }
   }
+}
 
-  joint_state_group_->setVariableValues(joint_angles);
-  const Eigen::Affine3d &base_frame = kinematic_state_->getFrameTransform(base_name_);
-  const Eigen::Affine3d &tip_frame = kinematic_state_->getFrameTransform(tip_name_);
-  Eigen::Affine3d transform = tip_frame.inverse() * base_frame;
-  wrenches.back().force.z = 1.0;
-  wrenches.back().force = transformVector(transform, wrenches.back().force);
-  wrenches.back().torque = transformVector(transform, wrenches.back().torque);
-
-  logDebug("New wrench (local frame): %f %f %f", wrenches.back().force.x, wrenches.back().force.y, wrenches.back().force.z);
+bool DynamicsSolver::computePayloadTerms(Workspace &workspace) const
+{
+  if(!workspace.dyn_param_)
+    workspace.dyn_param_.reset(new KDL::ChainDynParam(kdl_chain_, gravity_vector_));
+  if(!workspace.jac_solver_)
+    workspace.jac_solver_.reset(new KDL::ChainJntToJacSolver(kdl_chain_));
 
-  if(!getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, torques))
+  if(workspace.dyn_param_->JntToGravity(workspace.angles_, workspace.torques_) < 0 ||
+     workspace.jac_solver_->JntToJac(workspace.angles_, workspace.jacobian_) < 0)
+  {
+    logError("Something went wrong computing payload torques");
     return false;
+  }
+  return true;
+}
 
+void DynamicsSolver::computeMaxPayload(const Workspace &workspace, double &payload, unsigned int &joint_saturated) const
+{
+  // the torques of a payload are linear in its weight: the payload is the wrench (0, 0, weight) at the tip, in the
+  // base frame, which the RNE solver subtracts, so the torque per Newton of a joint is minus the component of its
+  // Jacobian column along the z axis of the base frame
   double min_payload = std::numeric_limits<double>::max();
+  joint_saturated = 0;
   for(unsigned int i=0; i < num_joints_; ++i)
   {
-    double payload_joint = std::max<double>((max_torques_[i]-zero_torques[i])/(torques[i]-zero_torques[i]),(-max_torques_[i]-zero_torques[i])/(torques[i]-zero_torques[i]));//because we set the payload to 1.0
-    logDebug("Joint: %d, Actual Torque: %f, Max Allowed: %f, Gravity: %f", i, torques[i], max_torques_[i], zero_torques[i]);
+    const double zero_torque = workspace.torques_(i);
+    if(fabs(zero_torque) >= max_torques_[i])
+    {
+      payload = 0.0;
+      joint_saturated = i;
+      return;
+    }
+    const double unit_torque = -workspace.jacobian_(2, i);
+    if(fabs(unit_torque) < std::numeric_limits<double>::epsilon())
+      continue;
+    double payload_joint = std::max<double>((max_torques_[i]-zero_torque)/unit_torque,(-max_torques_[i]-zero_torque)/unit_torque);
+    logDebug("Joint: %d, Torque per Newton: %f, Max Allowed: %f, Gravity: %f", i, unit_torque, max_torques_[i], zero_torque);
     logDebug("Joint: %d, Payload Allowed (N): %f", i, payload_joint);
     if(payload_joint < min_payload)
     {
@@ -270,12 +299,195 @@ bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
   }
   payload = min_payload/gravity_;
   logDebug("Max payload (kg): %f", payload);
+}
+
+struct DynamicsSolver::TrajectoryTorques
+{
+  TrajectoryTorques(const robot_trajectory::RobotTrajectory &trajectory, std::vector<std::vector<double> > &torques,
+                    bool stop_at_violation, std::size_t num_threads) :
+    trajectory_(trajectory), torques_(torques), stop_at_violation_(stop_at_violation), num_threads_(num_threads),
+    first_violation_(trajectory.getWayPointCount()), failed_(false)
+  {
+  }
+
+  const robot_trajectory::RobotTrajectory &trajectory_;
+  std::vector<std::vector<double> > &torques_;
+  bool stop_at_violation_;
+  std::size_t num_threads_;
+
+  boost::mutex lock_;
+  std::size_t first_violation_;
+  bool failed_;
+};
+
+void DynamicsSolver::computeTrajectoryTorques(TrajectoryTorques *work, std::size_t thread_index) const
+{
+  // scratch space for this thread, reused for all its waypoints
+  Workspace workspace(*this);
+
+  // the waypoints are split in contiguous chunks, so each thread visits its waypoints in order
+  const std::size_t num_points = work->trajectory_.getWayPointCount();
+  const std::size_t chunk = (num_points + work->num_threads_ - 1) / work->num_threads_;
+  const std::size_t end = std::min(num_points, (thread_index + 1) * chunk);
+  for (std::size_t i = thread_index * chunk ; i < end ; ++i)
+  {
+    if (work->stop_at_violation_)
+    {
+      boost::mutex::scoped_lock slock(work->lock_);
+      if (work->first_violation_ < i || work->failed_)
+        return;
+    }
+
+    loadWayPoint(work->trajectory_, i, workspace);
+    if (!computeTorques(workspace))
+    {
+      boost::mutex::scoped_lock slock(work->lock_);
+      work->failed_ = true;
+      return;
+    }
+
+    std::vector<double> &torques = work->torques_[i];
+    torques.resize(num_joints_);
+    bool violation = false;
+    for (unsigned int j = 0 ; j < num_joints_ ; ++j)
+    {
+      torques[j] = workspace.torques_(j);
+      if (max_torques_[j] > 0.0 && fabs(torques[j]) > max_torques_[j])
+        violation = true;
+    }
+    if (violation)
+    {
+      boost::mutex::scoped_lock slock(work->lock_);
+      if (i < work->first_violation_)
+        work->first_violation_ = i;
+      if (work->stop_at_violation_)
+        return;
+    }
+  }
+}
+
+bool DynamicsSolver::getTrajectoryTorques(const robot_trajectory::RobotTrajectory &trajectory,
+                                          std::vector<std::vector<double> > &torques,
+                                          std::size_t *first_violation,
+                                          bool stop_at_violation,
+                                          unsigned int num_threads) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if(trajectory.getGroup() != joint_model_group_)
+  {
+    logError("The trajectory is not for group %s", group_name_.c_str());
+    return false;
+  }
+
+  torques.clear();
+  torques.resize(trajectory.getWayPointCount());
+  TrajectoryTorques work(trajectory, torques, stop_at_violation,
+                         std::max<std::size_t>(1, std::min<std::size_t>(num_threads, trajectory.getWayPointCount())));
+  if (work.num_threads_ == 1)
+    computeTrajectoryTorques(&work, 0);
+  else
+  {
+    boost::thread_group threads;
+    for (std::size_t t = 1 ; t < work.num_threads_ ; ++t)
+      threads.create_thread(boost::bind(&DynamicsSolver::computeTrajectoryTorques, this, &work, t));
+    computeTrajectoryTorques(&work, 0);
+    threads.join_all();
+  }
+
+  if (work.failed_)
+    return false;
+  if (first_violation)
+    *first_violation = work.first_violation_;
+  return true;
+}
+
+bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
+                                   double &payload,
+                                   unsigned int &joint_saturated) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  Workspace workspace(*this);
+  return getMaxPayload(joint_angles, payload, joint_saturated, workspace);
+}
+
+bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
+                                   double &payload,
+                                   unsigned int &joint_saturated,
+                                   Workspace &workspace) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if(joint_angles.size() != num_joints_)
+  {
+    logError("Joint angles vector should be size %d", num_joints_);
+    return false;
+  }
+
+  for(unsigned int i=0; i < num_joints_; ++i)
+    workspace.angles_(i) = joint_angles[i];
+  if(!computePayloadTerms(workspace))
+    return false;
+  computeMaxPayload(workspace, payload, joint_saturated);
+  return true;
+}
+
+bool DynamicsSolver::getTrajectoryMaxPayloads(const robot_trajectory::RobotTrajectory &trajectory,
+                                              std::vector<double> &payloads,
+                                              std::vector<unsigned int> &joints_saturated) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if(trajectory.getGroup() != joint_model_group_)
+  {
+    logError("The trajectory is not for group %s", group_name_.c_str());
+    return false;
+  }
+
+  Workspace workspace(*this);
+  const std::size_t num_points = trajectory.getWayPointCount();
+  payloads.resize(num_points);
+  joints_saturated.resize(num_points);
+  for(std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    loadWayPoint(trajectory, i, workspace);
+    if(!computePayloadTerms(workspace))
+      return false;
+    computeMaxPayload(workspace, payloads[i], joints_saturated[i]);
+  }
   return true;
 }
 
 bool DynamicsSolver::getPayloadTorques(const std::vector<double> &joint_angles,
                                        double payload,
                                        std::vector<double> &joint_torques) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  Workspace workspace(*this);
+  return getPayloadTorques(joint_angles, payload, joint_torques, workspace);
+}
+
+bool DynamicsSolver::getPayloadTorques(const std::vector<double> &joint_angles,
+                                       double payload,
+                                       std::vector<double> &joint_torques,
+                                       Workspace &workspace) const
 {
   if(!joint_model_group_)
   {
@@ -292,21 +504,143 @@ bool DynamicsSolver::getPayloadTorques(const std::vector<double> &joint_angles,
     logError("Joint torques vector should be size %d", num_joints_);
     return false;
   }
-  std::vector<double> joint_velocities(num_joints_, 0.0), joint_accelerations(num_joints_, 0.0);
-  std::vector<geometry_msgs::Wrench> wrenches(num_segments_);
 
-  joint_state_group_->setVariableValues(joint_angles);
-  const Eigen::Affine3d &base_frame = kinematic_state_->getFrameTransform(base_name_);
-  const Eigen::Affine3d &tip_frame = kinematic_state_->getFrameTransform(tip_name_);
-  Eigen::Affine3d transform = tip_frame.inverse()* base_frame;
-  wrenches.back().force.z = payload * gravity_;
-  wrenches.back().force = transformVector(transform, wrenches.back().force);
-  wrenches.back().torque = transformVector(transform, wrenches.back().torque);
+  for(unsigned int i=0; i < num_joints_; ++i)
+    workspace.angles_(i) = joint_angles[i];
+  if(!computePayloadTerms(workspace))
+    return false;
 
-  logDebug("New wrench (local frame): %f %f %f", wrenches.back().force.x, wrenches.back().force.y, wrenches.back().force.z);
+  // the same torques as the RNE solver gives for the wrench (0, 0, force) at the tip (see computeMaxPayload())
+  const double force = payload * gravity_;
+  for(unsigned int i=0; i < num_joints_; ++i)
+    joint_torques[i] = workspace.torques_(i) - force * workspace.jacobian_(2, i);
+  return true;
+}
 
-  if(!getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, joint_torques))
+bool DynamicsSolver::checkJointVectorSize(const std::vector<double> &values, const char *name) const
+{
+  if(values.size() != num_joints_)
+  {
+    logError("%s vector should be size %d", name, num_joints_);
     return false;
+  }
+  return true;
+}
+
+void DynamicsSolver::prepareDynParam(const std::vector<double> &joint_angles, Workspace &workspace) const
+{
+  if(!workspace.dyn_param_)
+    workspace.dyn_param_.reset(new KDL::ChainDynParam(kdl_chain_, gravity_vector_));
+  for(unsigned int i=0; i < num_joints_; ++i)
+    workspace.angles_(i) = joint_angles[i];
+}
+
+bool DynamicsSolver::getMassMatrix(const std::vector<double> &joint_angles,
+                                   Eigen::MatrixXd &mass_matrix) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  Workspace workspace(*this);
+  return getMassMatrix(joint_angles, mass_matrix, workspace);
+}
+
+bool DynamicsSolver::getMassMatrix(const std::vector<double> &joint_angles,
+                                   Eigen::MatrixXd &mass_matrix,
+                                   Workspace &workspace) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if(!checkJointVectorSize(joint_angles, "Joint angles"))
+    return false;
+
+  prepareDynParam(joint_angles, workspace);
+  if(workspace.dyn_param_->JntToMass(workspace.angles_, workspace.mass_matrix_) < 0)
+  {
+    logError("Something went wrong computing the mass matrix");
+    return false;
+  }
+  mass_matrix = workspace.mass_matrix_.data;
+  return true;
+}
+
+bool DynamicsSolver::getCoriolisTorques(const std::vector<double> &joint_angles,
+                                        const std::vector<double> &joint_velocities,
+                                        std::vector<double> &torques) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  Workspace workspace(*this);
+  return getCoriolisTorques(joint_angles, joint_velocities, torques, workspace);
+}
+
+bool DynamicsSolver::getCoriolisTorques(const std::vector<double> &joint_angles,
+                                        const std::vector<double> &joint_velocities,
+                                        std::vector<double> &torques,
+                                        Workspace &workspace) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if(!checkJointVectorSize(joint_angles, "Joint angles") || !checkJointVectorSize(joint_velocities, "Joint velocities") ||
+     !checkJointVectorSize(torques, "Torques"))
+    return false;
+
+  prepareDynParam(joint_angles, workspace);
+  for(unsigned int i=0; i < num_joints_; ++i)
+    workspace.velocities_(i) = joint_velocities[i];
+  if(workspace.dyn_param_->JntToCoriolis(workspace.angles_, workspace.velocities_, workspace.torques_) < 0)
+  {
+    logError("Something went wrong computing Coriolis torques");
+    return false;
+  }
+  for(unsigned int i=0; i < num_joints_; ++i)
+    torques[i] = workspace.torques_(i);
+  return true;
+}
+
+bool DynamicsSolver::getGravityTorques(const std::vector<double> &joint_angles,
+                                       std::vector<double> &torques) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  Workspace workspace(*this);
+  return getGravityTorques(joint_angles, torques, workspace);
+}
+
+bool DynamicsSolver::getGravityTorques(const std::vector<double> &joint_angles,
+                                       std::vector<double> &torques,
+                                       Workspace &workspace) const
+{
+  if(!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if(!checkJointVectorSize(joint_angles, "Joint angles") || !checkJointVectorSize(torques, "Torques"))
+    return false;
+
+  prepareDynParam(joint_angles, workspace);
+  if(workspace.dyn_param_->JntToGravity(workspace.angles_, workspace.torques_) < 0)
+  {
+    logError("Something went wrong computing gravity torques");
+    return false;
+  }
+  for(unsigned int i=0; i < num_joints_; ++i)
+    torques[i] = workspace.torques_(i);
   return true;
 }
 
@@ -39,6 +39,7 @@
 
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/state_result_cache.h>
 #include <moveit/transforms/transforms.h>
 #include <moveit/collision_detection/collision_world.h>
 
@@ -104,6 +105,27 @@ public:
    */
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const = 0;
 
+  /**
+   * \brief Decide whether the constraint is satisfied by the state of
+   * \e group and compute the gradient of the reported distance with
+   * respect to the variables of \e group.
+   *
+   * The gradient is computed analytically from the Jacobian of the
+   * group, so \e group must be a chain (see
+   * robot_state::JointStateGroup::getJacobian()).  Where the distance
+   * is not differentiable, one of the one-sided derivatives is
+   * reported.  The default implementation reports a zero gradient,
+   * which is what constraints that do not depend smoothly on the
+   * state (e.g., visibility constraints) use.
+   *
+   * @param [in] group The group whose variables the gradient is computed for; the state evaluated is the state \e group is part of
+   * @param [out] gradient The gradient of the distance, in the order of the variables of \e group
+   * @param [in] verbose Whether or not to print output
+   *
+   * @return The same result as decide() for the state \e group is part of
+   */
+  virtual ConstraintEvaluationResult decideWithGradient(const robot_state::JointStateGroup &group, Eigen::VectorXd &gradient, bool verbose = false) const;
+
   /** \brief This function returns true if this constraint is
       configured and able to decide whether states do meet the
       constraint or not. If this function returns false it means
@@ -144,6 +166,22 @@ public:
   {
   }
 
+  /**
+   * \brief Resolve the mobile frames the constraint refers to, so
+   * that decide() does not look them up by name.
+   *
+   * Frames that are links of \e model are resolved to their link
+   * models; other frames (e.g., attached bodies) are still looked up
+   * by name.  Constraints resolve their frames against the model they
+   * were constructed with when they are configured, so this only
+   * needs to be called when evaluating states of a different model.
+   *
+   * @param [in] model The model of the states the constraint will be evaluated for
+   */
+  virtual void compile(const robot_model::RobotModel &model)
+  {
+  }
+
   /**
    *
    * \brief The weight of a constraint is a multiplicative factor associated to the distance computed by the decide() function
@@ -241,6 +279,7 @@ public:
    */
   virtual bool equal(const KinematicConstraint &other, double margin) const;
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
+  virtual ConstraintEvaluationResult decideWithGradient(const robot_state::JointStateGroup &group, Eigen::VectorXd &gradient, bool verbose = false) const;
   virtual bool enabled() const;
   virtual void clear();
   virtual void print(std::ostream &out = std::cout) const;
@@ -344,7 +383,7 @@ public:
    * @param [in] model The kinematic model used for constraint evaluation
    */
   OrientationConstraint(const robot_model::RobotModelConstPtr &model) :
-    KinematicConstraint(model), link_model_(NULL)
+    KinematicConstraint(model), link_model_(NULL), quick_accept_cos_(1.0)
   {
     type_ = ORIENTATION_CONSTRAINT;
   }
@@ -383,8 +422,10 @@ public:
   virtual bool equal(const KinematicConstraint &other, double margin) const;
   virtual void clear();
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
+  virtual ConstraintEvaluationResult decideWithGradient(const robot_state::JointStateGroup &group, Eigen::VectorXd &gradient, bool verbose = false) const;
   virtual bool enabled() const;
   virtual void print(std::ostream &out = std::cout) const;
+  virtual void compile(const robot_model::RobotModel &model);
 
   /**
    * \brief Gets the subject link model
@@ -469,7 +510,10 @@ protected:
   Eigen::Matrix3d               desired_rotation_matrix_inv_; /**< \brief The inverse of the desired rotation matrix, precomputed for efficiency */
   std::string                   desired_rotation_frame_id_; /**< \brief The target frame of the transform tree */
   bool                          mobile_frame_; /**< \brief Whether or not the header frame is mobile or fixed */
+  robot_state::FrameHandle desired_rotation_frame_; /**< \brief The mobile header frame, resolved against the robot model */
   double                        absolute_x_axis_tolerance_, absolute_y_axis_tolerance_, absolute_z_axis_tolerance_; /**< \brief Storage for the tolerances */
+  Eigen::Quaterniond            desired_rotation_quaternion_; /**< \brief The desired rotation as a quaternion, for the quick checks of decide() */
+  double                        quick_accept_cos_; /**< \brief The cosine of half the rotation angle below which all the Euler angles are within tolerance */
 };
 
 
@@ -548,8 +592,10 @@ public:
   virtual bool equal(const KinematicConstraint &other, double margin) const;
   virtual void clear();
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
+  virtual ConstraintEvaluationResult decideWithGradient(const robot_state::JointStateGroup &group, Eigen::VectorXd &gradient, bool verbose = false) const;
   virtual bool enabled() const;
   virtual void print(std::ostream &out = std::cout) const;
+  virtual void compile(const robot_model::RobotModel &model);
 
   /**
    * \brief Returns the associated link model, or NULL if not enabled
@@ -624,15 +670,42 @@ public:
 
 protected:
 
+  /** \brief A node of the bounding volume hierarchy over the constraint regions */
+  struct RegionTreeNode
+  {
+    Eigen::Vector3d min_; /**< \brief The lower corner of the box that bounds the regions of the node */
+    Eigen::Vector3d max_; /**< \brief The upper corner of the box that bounds the regions of the node */
+    std::size_t     begin_, end_; /**< \brief The range of region_tree_index_ the regions of a leaf are stored in */
+    int             left_, right_; /**< \brief The children of an inner node; -1 for leaves */
+  };
+
+  /** \brief Construct the hierarchy over the bounding boxes of constraint_region_, as they are posed in the constraint frame */
+  void buildRegionTree();
+
+  /**
+   * \brief Find the first region (in the order of constraint_region_) that contains a point
+   *
+   * @param [in] pt The point, expressed in the frame the regions are posed in
+   *
+   * @return The index of the region, or the number of regions if no region contains the point
+   */
+  std::size_t findContainingRegion(const Eigen::Vector3d &pt) const;
+
   Eigen::Vector3d                                   offset_; /**< \brief The target offset */
   bool                                              has_offset_; /**< \brief Whether the offset is substantially different than 0.0 */
   std::vector<bodies::BodyPtr>                      constraint_region_; /**< \brief The constraint region vector */
   EigenSTL::vector_Affine3d                         constraint_region_pose_; /**< \brief The constraint region pose vector */
   bool                                              mobile_frame_; /**< \brief Whether or not a mobile frame is employed*/
   std::string                                       constraint_frame_id_; /**< \brief The constraint frame id */
+  robot_state::FrameHandle                          constraint_frame_; /**< \brief The mobile constraint frame, resolved against the robot model */
   const robot_model::LinkModel *link_model_; /**< \brief The link model constraint subject */
+  std::vector<RegionTreeNode>                       region_tree_; /**< \brief The bounding volume hierarchy over the constraint regions; the first node is the root */
+  std::vector<std::size_t>                          region_tree_index_; /**< \brief The indices of the constraint regions, grouped by the leaves of region_tree_ */
 };
 
+/** \brief The collision worlds that the threads evaluating a VisibilityConstraint keep (defined in the implementation) */
+struct VisibilityCacheRegistry;
+
 /**
  * \brief Class for constraints on the visibility relationship between
  * a sensor and a target.
@@ -742,6 +815,8 @@ public:
    */
   VisibilityConstraint(const robot_model::RobotModelConstPtr &model);
 
+  virtual ~VisibilityConstraint();
+
   /**
    * \brief Configure the constraint based on a
    * moveit_msgs::VisibilityConstraint
@@ -801,6 +876,7 @@ public:
   virtual bool enabled() const;
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
   virtual void print(std::ostream &out = std::cout) const;
+  virtual void compile(const robot_model::RobotModel &model);
 
 protected:
 
@@ -820,6 +896,8 @@ protected:
   bool                                   mobile_target_frame_; /**< \brief True if the target is a non-fixed frame relative to the transform frame */
   std::string                            target_frame_id_; /**< \brief The target frame id */
   std::string                            sensor_frame_id_; /**< \brief The sensor frame id */
+  robot_state::FrameHandle               target_frame_; /**< \brief The mobile target frame, resolved against the robot model */
+  robot_state::FrameHandle               sensor_frame_; /**< \brief The mobile sensor frame, resolved against the robot model */
   Eigen::Affine3d                        sensor_pose_; /**< \brief The sensor pose transformed into the transform frame */
   int                                    sensor_view_direction_; /**< \brief Storage for the sensor view direction */
   Eigen::Affine3d                        target_pose_; /**< \brief The target pose transformed into the transform frame */
@@ -828,6 +906,8 @@ protected:
   double                                 target_radius_; /**< \brief Storage for the target radius */
   double                                 max_view_angle_; /**< \brief Storage for the max view angle */
   double                                 max_range_angle_; /**< \brief Storage for the max range angle */
+  std::vector<double>                    link_radii_; /**< \brief For each link (in model order), the radius of a sphere centered at its collision body that contains its (scaled and padded) shape */
+  boost::shared_ptr<VisibilityCacheRegistry> caches_; /**< \brief The collision worlds with the cone that the threads keep for this constraint; renewed when the constraint is cleared */
 };
 
 /**
@@ -851,7 +931,7 @@ public:
    * @param [in] model The kinematic model used for constraint evaluation
    */
   KinematicConstraintSet(const robot_model::RobotModelConstPtr &model) :
-    robot_model_(model)
+    robot_model_(model), compiled_(false)
   {
   }
 
@@ -911,6 +991,51 @@ public:
    */
   bool add(const std::vector<moveit_msgs::VisibilityConstraint> &vc, const robot_state::Transforms &tf);
 
+  /**
+   * \brief Prepare the set for repeated evaluation of states of \e model
+   *
+   * The mobile frames of all constraints are resolved against the
+   * links of \e model and the constraints are ordered by the cost of
+   * their evaluation: joint constraints first, then position and
+   * orientation constraints, then visibility constraints.  Once the
+   * set is compiled, decide() stops at the first constraint that is
+   * not satisfied.  Adding constraints or clearing the set discards
+   * the compiled form.
+   *
+   * @param [in] model The model of the states the set will be evaluated for
+   */
+  void compile(const robot_model::RobotModel &model);
+
+  /**
+   * \brief Keep the results of decide() for up to \e max_entries states
+   *
+   * Results are looked up by the values of all variables of the
+   * state (quantized to multiples of \e resolution, if it is
+   * positive) and the attached bodies of the state, and the least
+   * recently used result is discarded when the cache is full.  With a
+   * positive resolution, states that differ by less than the
+   * resolution may share a result.  Verbose evaluations are not
+   * cached.  Adding constraints or clearing the set discards the
+   * stored results.
+   *
+   * @param [in] max_entries The maximum number of results to keep; 0 disables the cache
+   * @param [in] resolution The resolution the variable values are quantized with; 0 to compare them exactly
+   */
+  void setResultCache(std::size_t max_entries, double resolution = 0.0);
+
+  /**
+   * \brief Get the hit statistics of the cache enabled by setResultCache(); all zero if there is no cache
+   */
+  robot_state::StateResultCacheStatistics getResultCacheStatistics() const;
+
+  /**
+   * \brief Returns whether compile() was called since the set was last modified
+   */
+  bool isCompiled() const
+  {
+    return compiled_;
+  }
+
   /**
    * \brief Determines whether all constraints are satisfied by state,
    * returning a single evaluation result
@@ -920,7 +1045,10 @@ public:
    *
    * @return A single constraint evaluation result, where it will
    * report satisfied only if all constraints are satisfied, and with
-   * a distance that is the sum of all individual distances.
+   * a distance that is the sum of all individual distances.  If the
+   * set is compiled and \e verbose is false, the evaluation stops at the
+   * first constraint that is not satisfied and the distance only
+   * includes the constraints evaluated up to that point.
    */
   ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
 
@@ -944,6 +1072,44 @@ public:
    */
   ConstraintEvaluationResult decide(const robot_state::RobotState &state, std::vector<ConstraintEvaluationResult> &results, bool verbose = false) const;
 
+  /**
+   * \brief Determines whether all constraints are satisfied by the
+   * state of \e group, and computes the gradient of the summed
+   * distance with respect to the variables of \e group.
+   *
+   * @param [in] group The group whose variables the gradient is computed for
+   * @param [out] gradient The sum of the gradients of the individual constraints (see KinematicConstraint::decideWithGradient())
+   * @param [in] verbose Whether to print the results of each constraint check
+   *
+   * @return A single constraint evaluation result, where it will
+   * report satisfied only if all constraints are satisfied, and with
+   * a distance that is the sum of all individual distances.  All
+   * constraints are evaluated, whether the set is compiled or not.
+   */
+  ConstraintEvaluationResult decideWithGradient(const robot_state::JointStateGroup &group, Eigen::VectorXd &gradient, bool verbose = false) const;
+
+  /**
+   * \brief Determines for each of a set of states whether all
+   * constraints are satisfied.
+   *
+   * The constraints are evaluated one at a time for all states,
+   * cheapest first: joint constraints are checked for every state,
+   * and the other constraints only for the states that satisfy all
+   * joint constraints.  These remaining checks are split among \e
+   * num_threads threads.  As for a compiled set, the evaluation for a
+   * state stops at the first constraint it does not satisfy, so the
+   * distance of a state that does not satisfy the constraints only
+   * includes the constraints evaluated up to that point.  The states
+   * may be evaluated concurrently and must not be modified during
+   * the call.
+   *
+   * @param [in] states The states to test
+   * @param [out] results The result for each state, in the order of \e states
+   * @param [in] num_threads The number of threads to use for the constraints that are not joint constraints
+   */
+  void decideBatch(const std::vector<const robot_state::RobotState*> &states, std::vector<ConstraintEvaluationResult> &results,
+                   unsigned int num_threads = 1) const;
+
   /**
    * \brief Whether or not another KinematicConstraintSet is equal to
    * this one.
@@ -1045,6 +1211,21 @@ protected:
   std::vector<moveit_msgs::VisibilityConstraint>  visibility_constraints_;/**<  \brief Messages corresponding to all internal visibility constraints */
   moveit_msgs::Constraints                        all_constraints_; /**<  \brief Messages corresponding to all internal constraints */
 
+  std::vector<const KinematicConstraint*>         compiled_constraints_; /**<  \brief The enabled constraints ordered by the cost of their evaluation, set by compile() */
+  bool                                            compiled_; /**<  \brief Whether compiled_constraints_ corresponds to the constraints in the set */
+
+  /** \brief The results of decide() by state, or NULL if they are not cached.  Copies of the set share the
+      cache until either of them is modified, at which point the modified set gets a cache of its own */
+  boost::shared_ptr<robot_state::StateResultCache<ConstraintEvaluationResult> > result_cache_;
+
+private:
+
+  /** \brief Evaluate the constraints for decide(), without using the result cache */
+  ConstraintEvaluationResult evaluate(const robot_state::RobotState &state, bool verbose) const;
+
+  /** \brief Replace the result cache by an empty one with the same settings, as the constraints changed */
+  void resetResultCache();
+
 };
 
 typedef boost::shared_ptr<KinematicConstraintSet> KinematicConstraintSetPtr; /**< \brief boost::shared_ptr to a KinematicConstraintSetPtr */
@@ -44,7 +44,14 @@
 #include <boost/math/constants/constants.hpp>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
 #include <limits>
+#include <map>
+#include <set>
 
 namespace kinematic_constraints
 {
@@ -58,6 +65,45 @@ static double normalizeAngle(double angle)
       v -= 2.0 * boost::math::constants::pi<double>();
   return v;
 }
+
+// the signed difference between a joint position and the desired one; for continuous joints this is the shortest
+// distance, and \e derivative is set to the derivative of the difference with respect to the joint position
+static double computeJointDifference(double current_joint_position, double desired_joint_position, bool continuous, double &derivative)
+{
+  derivative = 1.0;
+  if (!continuous)
+    return current_joint_position - desired_joint_position;
+
+  double dif = normalizeAngle(current_joint_position) - desired_joint_position;
+  if (dif > boost::math::constants::pi<double>())
+  {
+    derivative = -1.0;
+    dif = 2.0*boost::math::constants::pi<double>() - dif;
+  }
+  else
+    if (dif < -boost::math::constants::pi<double>())
+      dif += 2.0*boost::math::constants::pi<double>(); // we include a sign change to have dif > 0
+  return dif;
+}
+
+// the Jacobian of \e point (in the frame of \e link) with respect to the variables of \e group, expressed in the
+// model frame; false if the group does not move the link
+static bool getModelFrameJacobian(const robot_state::JointStateGroup &group, const robot_model::LinkModel *link, const Eigen::Vector3d &point,
+                                  Eigen::MatrixXd &jacobian)
+{
+  if (!link || !group.getJointModelGroup()->getJacobianChain(link))
+    return false;
+  if (!group.getJacobian(link, point, jacobian))
+    return false;
+
+  // getJacobian() expresses the Jacobian in the frame of the parent link of the chain
+  const robot_model::LinkModel *reference_link = group.getJointModelGroup()->getJacobianReferenceLink();
+  const robot_state::LinkState *reference_state = reference_link ? group.getRobotState()->getLinkState(reference_link) : NULL;
+  const Eigen::Matrix3d rotation = reference_state ? reference_state->getGlobalLinkTransform().rotation() : group.getRobotState()->getRootTransform().rotation();
+  jacobian.topRows(3) = rotation * jacobian.topRows(3);
+  jacobian.bottomRows(3) = rotation * jacobian.bottomRows(3);
+  return true;
+}
 }
 
 kinematic_constraints::KinematicConstraint::KinematicConstraint(const robot_model::RobotModelConstPtr &model) :
@@ -69,6 +115,13 @@ kinematic_constraints::KinematicConstraint::~KinematicConstraint()
 {
 }
 
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::KinematicConstraint::decideWithGradient(const robot_state::JointStateGroup &group,
+                                                                                                              Eigen::VectorXd &gradient, bool verbose) const
+{
+  gradient = Eigen::VectorXd::Zero(group.getVariableCount());
+  return decide(*group.getRobotState(), verbose);
+}
+
 bool kinematic_constraints::JointConstraint::configure(const moveit_msgs::JointConstraint &jc)
 {
   //clearing before we configure to get rid of any old data
@@ -211,7 +264,7 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::JointCo
   if (!joint_model_)
     return ConstraintEvaluationResult(true, 0.0);
 
-  const robot_state::JointState *joint = state.getJointState(joint_model_->getName());
+  const robot_state::JointState *joint = state.getJointState(joint_model_);
 
   if (!joint)
   {
@@ -233,21 +286,9 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::JointCo
       current_joint_position = joint->getVariableValues()[it->second];
   }
 
-  double dif = 0.0;
-
   // compute signed shortest distance for continuous joints
-  if (joint_is_continuous_)
-  {
-    dif = normalizeAngle(current_joint_position) - joint_position_;
-
-    if (dif > boost::math::constants::pi<double>())
-      dif = 2.0*boost::math::constants::pi<double>() - dif;
-    else
-      if (dif < -boost::math::constants::pi<double>())
-        dif += 2.0*boost::math::constants::pi<double>(); // we include a sign change to have dif > 0
-  }
-  else
-    dif = current_joint_position - joint_position_;
+  double derivative;
+  double dif = computeJointDifference(current_joint_position, joint_position_, joint_is_continuous_, derivative);
 
   // check bounds
   bool result = dif <= (joint_tolerance_above_+2*std::numeric_limits<double>::epsilon()) && dif >= (-joint_tolerance_below_-2*std::numeric_limits<double>::epsilon());
@@ -258,6 +299,33 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::JointCo
   return ConstraintEvaluationResult(result, constraint_weight_ * fabs(dif));
 }
 
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::JointConstraint::decideWithGradient(const robot_state::JointStateGroup &group,
+                                                                                                         Eigen::VectorXd &gradient, bool verbose) const
+{
+  gradient = Eigen::VectorXd::Zero(group.getVariableCount());
+  ConstraintEvaluationResult res = decide(*group.getRobotState(), verbose);
+  if (!joint_model_ || res.distance <= 0.0)
+    return res;
+
+  // mimic joints are indexed by the variable they follow
+  const std::map<std::string, unsigned int> &group_index_map = group.getJointModelGroup()->getJointVariablesIndexMap();
+  std::map<std::string, unsigned int>::const_iterator git = group_index_map.find(joint_variable_name_);
+  if (git == group_index_map.end())
+    return res;
+
+  const robot_state::JointState *joint = group.getRobotState()->getJointState(joint_model_);
+  const std::map<std::string, unsigned int> &index_map = joint->getVariableIndexMap();
+  std::map<std::string, unsigned int>::const_iterator it = index_map.find(joint_variable_name_);
+  double current_joint_position = joint->getVariableValues()[it == index_map.end() ? 0 : it->second];
+
+  double derivative;
+  double dif = computeJointDifference(current_joint_position, joint_position_, joint_is_continuous_, derivative);
+  if (joint_model_->getMimic())
+    derivative *= joint_model_->getMimicFactor();
+  gradient(git->second) = constraint_weight_ * (dif < 0.0 ? -derivative : derivative);
+  return res;
+}
+
 bool kinematic_constraints::JointConstraint::enabled() const
 {
   return joint_model_;
@@ -318,6 +386,7 @@ bool kinematic_constraints::PositionConstraint::configure(const moveit_msgs::Pos
   else
   {
     constraint_frame_id_ = pc.header.frame_id;
+    constraint_frame_ = robot_state::FrameHandle(*robot_model_, constraint_frame_id_);
     mobile_frame_ = true;
   }
 
@@ -385,6 +454,8 @@ bool kinematic_constraints::PositionConstraint::configure(const moveit_msgs::Pos
     else
       constraint_weight_ = pc.weight;
 
+  buildRegionTree();
+
   return !constraint_region_.empty();
 }
 
@@ -452,7 +523,7 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Positio
   if (!link_model_ || constraint_region_.empty())
     return ConstraintEvaluationResult(true, 0.0);
 
-  const robot_state::LinkState *link_state = state.getLinkState(link_model_->getName());
+  const robot_state::LinkState *link_state = state.getLinkState(link_model_);
 
   if (!link_state)
   {
@@ -461,30 +532,188 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Positio
   }
 
   Eigen::Vector3d pt = link_state->getGlobalLinkTransform() * offset_;
-  if (mobile_frame_)
+
+  // for a mobile frame, the regions are posed in the constraint frame, so the point is tested in that frame
+  const Eigen::Affine3d *frame = mobile_frame_ ? &state.getFrameTransform(constraint_frame_) : NULL;
+  Eigen::Vector3d region_pt = frame ? Eigen::Vector3d(frame->inverse() * pt) : pt;
+
+  if (verbose)
   {
     for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
     {
-      Eigen::Affine3d tmp = state.getFrameTransform(constraint_frame_id_) * constraint_region_pose_[i];
-      bool result = constraint_region_[i]->cloneAt(tmp)->containsPoint(pt, verbose);
-      if (result || (i + 1 == constraint_region_pose_.size()))
-        return finishPositionConstraintDecision(pt, tmp.translation(), link_model_->getName(), constraint_weight_, result, verbose);
+      bool result = constraint_region_[i]->containsPoint(region_pt, verbose);
+      Eigen::Vector3d center = frame ? Eigen::Vector3d(*frame * constraint_region_pose_[i].translation()) : constraint_region_[i]->getPose().translation();
+      if (result || (i + 1 == constraint_region_.size()))
+        return finishPositionConstraintDecision(pt, center, link_model_->getName(), constraint_weight_, result, verbose);
       else
-        finishPositionConstraintDecision(pt, tmp.translation(), link_model_->getName(), constraint_weight_, result, verbose);
+        finishPositionConstraintDecision(pt, center, link_model_->getName(), constraint_weight_, result, verbose);
     }
+    return ConstraintEvaluationResult(false, 0.0);
   }
-  else
+
+  // the result is decided by the first region that contains the point, or by the last region if there is none
+  std::size_t i = findContainingRegion(region_pt);
+  bool result = i < constraint_region_.size();
+  if (!result)
+    i = constraint_region_.size() - 1;
+  Eigen::Vector3d center = frame ? Eigen::Vector3d(*frame * constraint_region_pose_[i].translation()) : constraint_region_[i]->getPose().translation();
+  return finishPositionConstraintDecision(pt, center, link_model_->getName(), constraint_weight_, result, false);
+}
+
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::PositionConstraint::decideWithGradient(const robot_state::JointStateGroup &group,
+                                                                                                            Eigen::VectorXd &gradient, bool verbose) const
+{
+  gradient = Eigen::VectorXd::Zero(group.getVariableCount());
+  ConstraintEvaluationResult res = decide(*group.getRobotState(), verbose);
+  if (!link_model_ || constraint_region_.empty() || res.distance <= 0.0)
+    return res;
+
+  const robot_state::RobotState &state = *group.getRobotState();
+  const robot_state::LinkState *link_state = state.getLinkState(link_model_);
+  if (!link_state)
+    return res;
+
+  // find the region the distance was computed for, as decide() does
+  Eigen::Vector3d pt = link_state->getGlobalLinkTransform() * offset_;
+  const Eigen::Affine3d *frame = mobile_frame_ ? &state.getFrameTransform(constraint_frame_) : NULL;
+  std::size_t i = findContainingRegion(frame ? Eigen::Vector3d(frame->inverse() * pt) : pt);
+  if (i >= constraint_region_.size())
+    i = constraint_region_.size() - 1;
+  Eigen::Vector3d center = frame ? Eigen::Vector3d(*frame * constraint_region_pose_[i].translation()) : constraint_region_[i]->getPose().translation();
+
+  // the distance is weight * |pt - center|, so its gradient is weight * u^T (d pt/dq - d center/dq)
+  Eigen::Vector3d u = pt - center;
+  double norm = u.norm();
+  if (norm < std::numeric_limits<double>::epsilon())
+    return res;
+  u *= constraint_weight_ / norm;
+
+  Eigen::MatrixXd jacobian;
+  if (getModelFrameJacobian(group, link_model_, offset_, jacobian))
+    gradient += jacobian.topRows(3).transpose() * u;
+  if (frame && getModelFrameJacobian(group, constraint_frame_.getLinkModel(), constraint_region_pose_[i].translation(), jacobian))
+    gradient -= jacobian.topRows(3).transpose() * u;
+  return res;
+}
+
+namespace kinematic_constraints
+{
+namespace
+{
+// orders region indices by the coordinate of the center of their bounding box along one axis
+struct RegionCenterLess
+{
+  RegionCenterLess(const EigenSTL::vector_Vector3d *centers, int axis) : centers_(centers), axis_(axis)
   {
-    for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+  }
+
+  bool operator()(std::size_t a, std::size_t b) const
+  {
+    return (*centers_)[a][axis_] < (*centers_)[b][axis_];
+  }
+
+  const EigenSTL::vector_Vector3d *centers_;
+  int                              axis_;
+};
+}
+}
+
+void kinematic_constraints::PositionConstraint::buildRegionTree()
+{
+  static const std::size_t MAX_LEAF_REGIONS = 2;
+
+  region_tree_.clear();
+  region_tree_index_.resize(constraint_region_.size());
+  if (constraint_region_.empty())
+    return;
+
+  EigenSTL::vector_Vector3d lower(constraint_region_.size()), upper(constraint_region_.size()), centers(constraint_region_.size());
+  for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+  {
+    bodies::BoundingSphere sphere;
+    constraint_region_[i]->computeBoundingSphere(sphere);
+    // a small margin keeps points on the surface of a region inside its box
+    double r = sphere.radius * (1.0 + 1e-9) + std::numeric_limits<double>::epsilon();
+    lower[i] = sphere.center - Eigen::Vector3d(r, r, r);
+    upper[i] = sphere.center + Eigen::Vector3d(r, r, r);
+    centers[i] = sphere.center;
+    region_tree_index_[i] = i;
+  }
+
+  // the nodes are split at the median of the box centers along the longest axis of the node
+  std::vector<std::pair<std::size_t, std::size_t> > ranges(1, std::make_pair(0, constraint_region_.size()));
+  std::vector<int> parents(1, -1);
+  for (std::size_t n = 0 ; n < ranges.size() ; ++n)
+  {
+    std::size_t begin = ranges[n].first, end = ranges[n].second;
+    RegionTreeNode node;
+    node.min_ = lower[region_tree_index_[begin]];
+    node.max_ = upper[region_tree_index_[begin]];
+    Eigen::Vector3d cmin = centers[region_tree_index_[begin]], cmax = cmin;
+    for (std::size_t k = begin + 1 ; k < end ; ++k)
     {
-      bool result = constraint_region_[i]->containsPoint(pt, true);
-      if (result || (i + 1 == constraint_region_.size()))
-        return finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
+      std::size_t i = region_tree_index_[k];
+      node.min_ = node.min_.cwiseMin(lower[i]);
+      node.max_ = node.max_.cwiseMax(upper[i]);
+      cmin = cmin.cwiseMin(centers[i]);
+      cmax = cmax.cwiseMax(centers[i]);
+    }
+    node.begin_ = begin;
+    node.end_ = end;
+    node.left_ = node.right_ = -1;
+    if (parents[n] >= 0)
+    {
+      RegionTreeNode &parent = region_tree_[parents[n]];
+      if (parent.left_ < 0)
+        parent.left_ = n;
       else
-        finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
+        parent.right_ = n;
+    }
+    region_tree_.push_back(node);
+
+    if (end - begin > MAX_LEAF_REGIONS)
+    {
+      int axis;
+      (cmax - cmin).maxCoeff(&axis);
+      std::size_t mid = (begin + end) / 2;
+      std::nth_element(region_tree_index_.begin() + begin, region_tree_index_.begin() + mid, region_tree_index_.begin() + end,
+                       RegionCenterLess(&centers, axis));
+      ranges.push_back(std::make_pair(begin, mid));
+      parents.push_back(n);
+      ranges.push_back(std::make_pair(mid, end));
+      parents.push_back(n);
     }
   }
-  return ConstraintEvaluationResult(false, 0.0);
+}
+
+std::size_t kinematic_constraints::PositionConstraint::findContainingRegion(const Eigen::Vector3d &pt) const
+{
+  std::size_t best = constraint_region_.size();
+  if (region_tree_.empty())
+    return best;
+
+  std::vector<int> stack(1, 0);
+  while (!stack.empty())
+  {
+    const RegionTreeNode &node = region_tree_[stack.back()];
+    stack.pop_back();
+    if ((pt.array() < node.min_.array()).any() || (pt.array() > node.max_.array()).any())
+      continue;
+    if (node.left_ >= 0)
+    {
+      stack.push_back(node.right_);
+      stack.push_back(node.left_);
+      continue;
+    }
+    for (std::size_t k = node.begin_ ; k < node.end_ ; ++k)
+    {
+      std::size_t i = region_tree_index_[k];
+      // regions that come after one already known to contain the point do not matter
+      if (i < best && constraint_region_[i]->containsPoint(pt))
+        best = i;
+    }
+  }
+  return best;
 }
 
 void kinematic_constraints::PositionConstraint::print(std::ostream &out) const
@@ -503,7 +732,16 @@ void kinematic_constraints::PositionConstraint::clear()
   constraint_region_pose_.clear();
   mobile_frame_ = false;
   constraint_frame_id_ = "";
+  constraint_frame_ = robot_state::FrameHandle();
   link_model_ = NULL;
+  region_tree_.clear();
+  region_tree_index_.clear();
+}
+
+void kinematic_constraints::PositionConstraint::compile(const robot_model::RobotModel &model)
+{
+  if (mobile_frame_)
+    constraint_frame_ = robot_state::FrameHandle(model, constraint_frame_id_);
 }
 
 bool kinematic_constraints::PositionConstraint::enabled() const
@@ -545,6 +783,7 @@ bool kinematic_constraints::OrientationConstraint::configure(const moveit_msgs::
   else
   {
     desired_rotation_frame_id_ = oc.header.frame_id;
+    desired_rotation_frame_ = robot_state::FrameHandle(*robot_model_, desired_rotation_frame_id_);
     desired_rotation_matrix_ = Eigen::Matrix3d(q);
     mobile_frame_ = true;
   }
@@ -569,6 +808,12 @@ bool kinematic_constraints::OrientationConstraint::configure(const moveit_msgs::
   if (absolute_z_axis_tolerance_ < std::numeric_limits<double>::epsilon())
     logWarn("Near-zero value for absolute_z_axis_tolerance");
 
+  // a rotation by an angle of at most pi/2 has XYZ Euler angles no larger than that angle, so decide() accepts rotations
+  // smaller than the smallest tolerance without folding the Euler angles
+  desired_rotation_quaternion_ = Eigen::Quaterniond(desired_rotation_matrix_);
+  const double smallest = std::min(std::min(absolute_x_axis_tolerance_, absolute_y_axis_tolerance_), absolute_z_axis_tolerance_);
+  quick_accept_cos_ = cos(std::min(smallest, boost::math::constants::pi<double>() / 2.0) / 2.0);
+
   return link_model_ != NULL;
 }
 
@@ -596,8 +841,17 @@ void kinematic_constraints::OrientationConstraint::clear()
   desired_rotation_matrix_ = Eigen::Matrix3d::Identity();
   desired_rotation_matrix_inv_ = Eigen::Matrix3d::Identity();
   desired_rotation_frame_id_ = "";
+  desired_rotation_frame_ = robot_state::FrameHandle();
   mobile_frame_ = false;
   absolute_z_axis_tolerance_ = absolute_y_axis_tolerance_ = absolute_x_axis_tolerance_ = 0.0;
+  desired_rotation_quaternion_ = Eigen::Quaterniond::Identity();
+  quick_accept_cos_ = 1.0;
+}
+
+void kinematic_constraints::OrientationConstraint::compile(const robot_model::RobotModel &model)
+{
+  if (mobile_frame_)
+    desired_rotation_frame_ = robot_state::FrameHandle(model, desired_rotation_frame_id_);
 }
 
 bool kinematic_constraints::OrientationConstraint::enabled() const
@@ -610,7 +864,7 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Orienta
   if (!link_model_)
     return ConstraintEvaluationResult(true, 0.0);
 
-  const robot_state::LinkState *link_state = state.getLinkState(link_model_->getName());
+  const robot_state::LinkState *link_state = state.getLinkState(link_model_);
 
   if (!link_state)
   {
@@ -618,18 +872,37 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Orienta
     return ConstraintEvaluationResult(false, 0.0);
   }
 
+  // states close to the desired orientation are decided from the quaternion of the rotation from the desired orientation
+  // to the link, without extracting Euler angles from a matrix
+  if (!verbose)
+  {
+    const Eigen::Quaterniond q_link(link_state->getGlobalLinkTransform().linear());
+    const Eigen::Quaterniond q = mobile_frame_ ?
+      (Eigen::Quaterniond(state.getFrameTransform(desired_rotation_frame_).linear()) * desired_rotation_quaternion_).conjugate() * q_link :
+      desired_rotation_quaternion_.conjugate() * q_link;
+    if (fabs(q.w()) >= quick_accept_cos_)
+    {
+      // the XYZ Euler angles of a small rotation are in [-pi/2, pi/2], where folding does not change their magnitude
+      const double w = q.w(), x = q.x(), y = q.y(), z = q.z();
+      const double a = fabs(atan2(2.0 * (w * x - y * z), 1.0 - 2.0 * (x * x + y * y)));
+      const double b = fabs(asin(std::max(-1.0, std::min(1.0, 2.0 * (x * z + w * y)))));
+      const double c = fabs(atan2(2.0 * (w * z - x * y), 1.0 - 2.0 * (y * y + z * z)));
+      return ConstraintEvaluationResult(true, constraint_weight_ * (a + b + c));
+    }
+  }
+
+  // link transforms are rigid, so their linear part is their rotation; Affine3d::rotation() would compute an SVD
   Eigen::Vector3d xyz;
   if (mobile_frame_)
   {
-    Eigen::Matrix3d tmp = state.getFrameTransform(desired_rotation_frame_id_).rotation() * desired_rotation_matrix_;
-    Eigen::Affine3d diff(tmp.inverse() * link_state->getGlobalLinkTransform().rotation());
-    xyz = diff.rotation().eulerAngles(0, 1, 2);
-    // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
+    const Eigen::Matrix3d desired = state.getFrameTransform(desired_rotation_frame_).linear() * desired_rotation_matrix_;
+    const Eigen::Matrix3d diff = desired.transpose() * link_state->getGlobalLinkTransform().linear();
+    xyz = diff.eulerAngles(0, 1, 2); // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
   }
   else
   {
-    Eigen::Affine3d diff(desired_rotation_matrix_inv_ * link_state->getGlobalLinkTransform().rotation());
-    xyz = diff.rotation().eulerAngles(0, 1, 2); // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
+    const Eigen::Matrix3d diff = desired_rotation_matrix_inv_ * link_state->getGlobalLinkTransform().linear();
+    xyz = diff.eulerAngles(0, 1, 2); // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
   }
 
   xyz(0) = std::min(fabs(xyz(0)), boost::math::constants::pi<double>() - fabs(xyz(0)));
@@ -653,6 +926,53 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Orienta
   return ConstraintEvaluationResult(result, constraint_weight_ * (xyz(0) + xyz(1) + xyz(2)));
 }
 
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::OrientationConstraint::decideWithGradient(const robot_state::JointStateGroup &group,
+                                                                                                               Eigen::VectorXd &gradient, bool verbose) const
+{
+  gradient = Eigen::VectorXd::Zero(group.getVariableCount());
+  ConstraintEvaluationResult res = decide(*group.getRobotState(), verbose);
+  if (!link_model_ || res.distance <= 0.0)
+    return res;
+
+  const robot_state::RobotState &state = *group.getRobotState();
+  const robot_state::LinkState *link_state = state.getLinkState(link_model_);
+  if (!link_state)
+    return res;
+
+  Eigen::Matrix3d desired = mobile_frame_ ? Eigen::Matrix3d(state.getFrameTransform(desired_rotation_frame_).rotation() * desired_rotation_matrix_) :
+    desired_rotation_matrix_;
+  Eigen::Matrix3d desired_inv = mobile_frame_ ? Eigen::Matrix3d(desired.inverse()) : desired_rotation_matrix_inv_;
+  Eigen::Affine3d diff(desired_inv * link_state->getGlobalLinkTransform().rotation());
+  Eigen::Vector3d xyz = diff.rotation().eulerAngles(0, 1, 2);
+
+  // the rates of the XYZ Euler angles are E^-1 times the angular velocity of diff, which is undefined at the
+  // singularity of the representation
+  double ca = cos(xyz(0)), sa = sin(xyz(0)), cb = cos(xyz(1)), sb = sin(xyz(1));
+  if (fabs(cb) < 1e-9)
+    return res;
+  Eigen::Matrix3d euler_rates;
+  euler_rates << 1.0, 0.0, sb,
+                 0.0,  ca, -sa * cb,
+                 0.0,  sa, ca * cb;
+
+  // derivative of min(|x|, pi - |x|), the folding decide() applies to each angle
+  Eigen::Vector3d folding;
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    double s = xyz(k) < 0.0 ? -1.0 : 1.0;
+    folding(k) = fabs(xyz(k)) < boost::math::constants::pi<double>() / 2.0 ? s : -s;
+  }
+
+  // the angular velocity of diff is desired_inv * (w_link - w_frame), for the model frame angular velocities
+  Eigen::Vector3d u = constraint_weight_ * (desired_inv.transpose() * (euler_rates.inverse().transpose() * folding));
+  Eigen::MatrixXd jacobian;
+  if (getModelFrameJacobian(group, link_model_, Eigen::Vector3d::Zero(), jacobian))
+    gradient += jacobian.bottomRows(3).transpose() * u;
+  if (mobile_frame_ && getModelFrameJacobian(group, desired_rotation_frame_.getLinkModel(), Eigen::Vector3d::Zero(), jacobian))
+    gradient -= jacobian.bottomRows(3).transpose() * u;
+  return res;
+}
+
 void kinematic_constraints::OrientationConstraint::print(std::ostream &out) const
 {
   if (link_model_)
@@ -665,10 +985,245 @@ void kinematic_constraints::OrientationConstraint::print(std::ostream &out) cons
     out << "No constraint" << std::endl;
 }
 
+namespace kinematic_constraints
+{
+namespace
+{
+
+// construct the trimesh of a cone from the sensor origin (apex) to the disc approximated by points, centered at base_center
+static shapes::Mesh* constructCone(const Eigen::Vector3d &apex, const Eigen::Vector3d &base_center, const EigenSTL::vector_Vector3d &points)
+{
+  // allocate memory for a mesh to represent the visibility cone
+  shapes::Mesh *m = new shapes::Mesh();
+  m->vertex_count = points.size() + 2;
+  m->vertices = new double[m->vertex_count * 3];
+  m->triangle_count = points.size() * 2;
+  m->triangles = new unsigned int[m->triangle_count * 3];
+  // we do NOT allocate normals because we do not compute them
+
+  // the sensor origin
+  m->vertices[0] = apex.x();
+  m->vertices[1] = apex.y();
+  m->vertices[2] = apex.z();
+
+  // the center of the base of the cone approximation
+  m->vertices[3] = base_center.x();
+  m->vertices[4] = base_center.y();
+  m->vertices[5] = base_center.z();
+
+  // the points that approximate the base disc
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    m->vertices[i*3 + 6] = points[i].x();
+    m->vertices[i*3 + 7] = points[i].y();
+    m->vertices[i*3 + 8] = points[i].z();
+  }
+
+  // add the triangles
+  std::size_t p3 = points.size() * 3;
+  for (std::size_t i = 1 ; i < points.size() ; ++i)
+  {
+    // triangle forming a side of the cone, using the sensor origin
+    std::size_t i3 = (i - 1) * 3;
+    m->triangles[i3] = i + 1;
+    m->triangles[i3 + 1] = 0;
+    m->triangles[i3 + 2] = i + 2;
+    // triangle forming a part of the base of the cone, using the center of the base
+    std::size_t i6 = p3 + i3;
+    m->triangles[i6] = i + 1;
+    m->triangles[i6 + 1] = 1;
+    m->triangles[i6 + 2] = i + 2;
+  }
+
+  // last triangles
+  m->triangles[p3 - 3] = points.size() + 1;
+  m->triangles[p3 - 2] = 0;
+  m->triangles[p3 - 1] = 2;
+  p3 *= 2;
+  m->triangles[p3 - 3] = points.size() + 1;
+  m->triangles[p3 - 2] = 1;
+  m->triangles[p3 - 1] = 2;
+
+  return m;
+}
+
+/** \brief The collision data a thread keeps for one VisibilityConstraint */
+struct VisibilityCache
+{
+  VisibilityCache() : owner_(NULL), handle_(0)
+  {
+  }
+
+  /// The world that holds the cone, expressed in the frame of the target
+  collision_detection::CollisionWorldFCL        world_;
+
+  /// The matrix that defers the decision for contacts with the cone to owner_
+  collision_detection::AllowedCollisionMatrix   acm_;
+
+  /// The constraint acm_ is bound to
+  const VisibilityConstraint                   *owner_;
+
+  /// The cone in world_, or NULL if it was not constructed yet
+  shapes::ShapeConstPtr                         cone_;
+
+  /// The handle of the cone object in world_
+  collision_detection::World::ObjectHandle      handle_;
+
+  /// The position of the sensor in the frame of the target that cone_ was constructed for
+  Eigen::Vector3d                               apex_;
+};
+
+typedef boost::shared_ptr<VisibilityCache> VisibilityCachePtr;
+
+}
+
+/** \brief The caches of all the threads that evaluated a VisibilityConstraint. The registry owns them, so they are released
+    together with the constraint; threads only refer to them, and release the ones they created when they exit. */
+struct VisibilityCacheRegistry
+{
+  boost::mutex                 lock_;
+  std::set<VisibilityCachePtr> caches_;
+};
+
+namespace
+{
+
+/** \brief The caches a thread refers to, by registry */
+struct ThreadVisibilityCaches
+{
+  struct Entry
+  {
+    boost::weak_ptr<VisibilityCacheRegistry> registry_;
+    boost::weak_ptr<VisibilityCache>         cache_;
+  };
+  typedef std::map<const VisibilityCacheRegistry*, Entry> EntryMap;
+
+  ~ThreadVisibilityCaches()
+  {
+    for (EntryMap::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+      if (boost::shared_ptr<VisibilityCacheRegistry> registry = it->second.registry_.lock())
+      {
+        boost::mutex::scoped_lock slock(registry->lock_);
+        registry->caches_.erase(it->second.cache_.lock());
+      }
+  }
+
+  EntryMap entries_;
+};
+
+// the caches of a thread are released when the thread exits
+static boost::thread_specific_ptr<ThreadVisibilityCaches> thread_caches;
+
+// the cache of the calling thread in registry, created if needed; it lives as long as the registry
+static VisibilityCache* getThreadVisibilityCache(const boost::shared_ptr<VisibilityCacheRegistry> &registry)
+{
+  if (!thread_caches.get())
+    thread_caches.reset(new ThreadVisibilityCaches());
+  ThreadVisibilityCaches::EntryMap &entries = thread_caches->entries_;
+  ThreadVisibilityCaches::EntryMap::iterator it = entries.find(registry.get());
+  if (it != entries.end())
+  {
+    // the entry may be for a released registry that had the same address
+    if (it->second.registry_.lock() == registry)
+      if (VisibilityCachePtr cache = it->second.cache_.lock())
+        return cache.get();
+  }
+  else
+    // entries of released registries are dropped whenever an entry is added, so they do not accumulate
+    for (it = entries.begin() ; it != entries.end() ; )
+      if (it->second.registry_.expired())
+        entries.erase(it++);
+      else
+        ++it;
+
+  VisibilityCachePtr cache(new VisibilityCache());
+  {
+    boost::mutex::scoped_lock slock(registry->lock_);
+    registry->caches_.insert(cache);
+  }
+  ThreadVisibilityCaches::Entry &entry = entries[registry.get()];
+  entry.registry_ = registry;
+  entry.cache_ = cache;
+  return cache.get();
+}
+
+// the radius of the smallest sphere centered at the origin of the shape that contains the shape; infinite for unbounded shapes
+static double originBoundingRadius(const shapes::Shape *shape)
+{
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    return static_cast<const shapes::Sphere*>(shape)->radius;
+  case shapes::BOX:
+    {
+      const double *size = static_cast<const shapes::Box*>(shape)->size;
+      return 0.5 * sqrt(size[0] * size[0] + size[1] * size[1] + size[2] * size[2]);
+    }
+  case shapes::CYLINDER:
+    {
+      const shapes::Cylinder *cylinder = static_cast<const shapes::Cylinder*>(shape);
+      return sqrt(cylinder->radius * cylinder->radius + 0.25 * cylinder->length * cylinder->length);
+    }
+  case shapes::CONE:
+    {
+      const shapes::Cone *cone = static_cast<const shapes::Cone*>(shape);
+      return sqrt(cone->radius * cone->radius + 0.25 * cone->length * cone->length);
+    }
+  case shapes::MESH:
+    {
+      // meshes need not be centered at their origin, so the farthest vertex is used
+      const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+      double r2 = 0.0;
+      for (unsigned int i = 0 ; i < mesh->vertex_count ; ++i)
+        r2 = std::max(r2, Eigen::Map<const Eigen::Vector3d>(mesh->vertices + 3 * i).squaredNorm());
+      return sqrt(r2);
+    }
+  default:
+    break;
+  }
+  return std::numeric_limits<double>::infinity();
+}
+
+// conservative test whether a sphere may intersect the convex hull of the apex and a disc of radius base_radius, centered at distance length along axis;
+// every point of the hull is within asin(base_radius / length) of the axis, as seen from the apex, and within length + base_radius of the apex
+static bool sphereMayTouchCone(const Eigen::Vector3d &center, double radius, const Eigen::Vector3d &apex,
+                               const Eigen::Vector3d &axis, double length, double base_radius)
+{
+  Eigen::Vector3d d = center - apex;
+  double dn = d.norm();
+  if (dn > length + base_radius + radius)
+    return false;
+  if (base_radius >= length)
+    return true;
+  double sin_a = base_radius / length;
+  double cos_a = sqrt(1.0 - sin_a * sin_a);
+  double t = d.dot(axis);
+  double q = (d - t * axis).norm();
+  // distance from the center to the infinite cone, measured in the plane through the axis and the center
+  double dist = t * cos_a + q * sin_a < 0.0 ? dn : q * cos_a - t * sin_a;
+  return dist <= radius;
+}
+
+}
+}
+
 kinematic_constraints::VisibilityConstraint::VisibilityConstraint(const robot_model::RobotModelConstPtr &model) :
-  KinematicConstraint(model), collision_robot_(new collision_detection::CollisionRobotFCL(model))
+  KinematicConstraint(model), collision_robot_(new collision_detection::CollisionRobotFCL(model)),
+  caches_(new VisibilityCacheRegistry())
 {
   type_ = VISIBILITY_CONSTRAINT;
+
+  // the bounding spheres used to skip the full check are centered at the collision bodies of the links
+  const std::vector<const robot_model::LinkModel*> &links = model->getLinkModels();
+  link_radii_.resize(links.size(), 0.0);
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    if (links[i]->getShape())
+      link_radii_[i] = originBoundingRadius(links[i]->getShape().get()) * collision_robot_->getLinkScale(links[i]->getName()) +
+        collision_robot_->getLinkPadding(links[i]->getName());
+}
+
+kinematic_constraints::VisibilityConstraint::~VisibilityConstraint()
+{
 }
 
 void kinematic_constraints::VisibilityConstraint::clear()
@@ -677,6 +1232,8 @@ void kinematic_constraints::VisibilityConstraint::clear()
   mobile_target_frame_ = false;
   target_frame_id_ = "";
   sensor_frame_id_ = "";
+  target_frame_ = robot_state::FrameHandle();
+  sensor_frame_ = robot_state::FrameHandle();
   sensor_pose_ = Eigen::Affine3d::Identity();
   sensor_view_direction_ = 0;
   target_pose_ = Eigen::Affine3d::Identity();
@@ -685,6 +1242,8 @@ void kinematic_constraints::VisibilityConstraint::clear()
   target_radius_ = -1.0;
   max_view_angle_ = 0.0;
   max_range_angle_ = 0.0;
+  // the cones of the previous configuration must not be reused
+  caches_.reset(new VisibilityCacheRegistry());
 }
 
 bool kinematic_constraints::VisibilityConstraint::configure(const moveit_msgs::VisibilityConstraint &vc, const robot_state::Transforms &tf)
@@ -728,6 +1287,7 @@ bool kinematic_constraints::VisibilityConstraint::configure(const moveit_msgs::V
   else
   {
     target_frame_id_ = vc.target_pose.header.frame_id;
+    target_frame_ = robot_state::FrameHandle(*robot_model_, target_frame_id_);
     mobile_target_frame_ = true;
   }
 
@@ -742,6 +1302,7 @@ bool kinematic_constraints::VisibilityConstraint::configure(const moveit_msgs::V
   else
   {
     sensor_frame_id_ = vc.sensor_pose.header.frame_id;
+    sensor_frame_ = robot_state::FrameHandle(*robot_model_, sensor_frame_id_);
     mobile_sensor_frame_ = true;
   }
 
@@ -788,6 +1349,14 @@ bool kinematic_constraints::VisibilityConstraint::equal(const KinematicConstrain
   return false;
 }
 
+void kinematic_constraints::VisibilityConstraint::compile(const robot_model::RobotModel &model)
+{
+  if (mobile_target_frame_)
+    target_frame_ = robot_state::FrameHandle(model, target_frame_id_);
+  if (mobile_sensor_frame_)
+    sensor_frame_ = robot_state::FrameHandle(model, sensor_frame_id_);
+}
+
 bool kinematic_constraints::VisibilityConstraint::enabled() const
 {
   return target_radius_ > std::numeric_limits<double>::epsilon();
@@ -797,8 +1366,8 @@ shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(con
 {
   // the current pose of the sensor
 
-  const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
-  const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
+  const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_) * sensor_pose_ : sensor_pose_;
+  const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_) * target_pose_ : target_pose_;
 
   // transform the points on the disc to the desired target frame
   const EigenSTL::vector_Vector3d *points = &points_;
@@ -811,58 +1380,7 @@ shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(con
     points = tempPoints.get();
   }
 
-  // allocate memory for a mesh to represent the visibility cone
-  shapes::Mesh *m = new shapes::Mesh();
-  m->vertex_count = cone_sides_ + 2;
-  m->vertices = new double[m->vertex_count * 3];
-  m->triangle_count = cone_sides_ * 2;
-  m->triangles = new unsigned int[m->triangle_count * 3];
-  // we do NOT allocate normals because we do not compute them
-
-  // the sensor origin
-  m->vertices[0] = sp.translation().x();
-  m->vertices[1] = sp.translation().y();
-  m->vertices[2] = sp.translation().z();
-
-  // the center of the base of the cone approximation
-  m->vertices[3] = tp.translation().x();
-  m->vertices[4] = tp.translation().y();
-  m->vertices[5] = tp.translation().z();
-
-  // the points that approximate the base disc
-  for (std::size_t i = 0 ; i < points->size() ; ++i)
-  {
-    m->vertices[i*3 + 6] = points->at(i).x();
-    m->vertices[i*3 + 7] = points->at(i).y();
-    m->vertices[i*3 + 8] = points->at(i).z();
-  }
-
-  // add the triangles
-  std::size_t p3 = points->size() * 3;
-  for (std::size_t i = 1 ; i < points->size() ; ++i)
-  {
-    // triangle forming a side of the cone, using the sensor origin
-    std::size_t i3 = (i - 1) * 3;
-    m->triangles[i3] = i + 1;
-    m->triangles[i3 + 1] = 0;
-    m->triangles[i3 + 2] = i + 2;
-    // triangle forming a part of the base of the cone, using the center of the base
-    std::size_t i6 = p3 + i3;
-    m->triangles[i6] = i + 1;
-    m->triangles[i6 + 1] = 1;
-    m->triangles[i6 + 2] = i + 2;
-  }
-
-  // last triangles
-  m->triangles[p3 - 3] = points->size() + 1;
-  m->triangles[p3 - 2] = 0;
-  m->triangles[p3 - 1] = 2;
-  p3 *= 2;
-  m->triangles[p3 - 3] = points->size() + 1;
-  m->triangles[p3 - 2] = 1;
-  m->triangles[p3 - 1] = 2;
-
-  return m;
+  return constructCone(sp.translation(), tp.translation(), *points);
 }
 
 void kinematic_constraints::VisibilityConstraint::getMarkers(const robot_state::RobotState &state, visualization_msgs::MarkerArray &markers) const
@@ -893,8 +1411,8 @@ void kinematic_constraints::VisibilityConstraint::getMarkers(const robot_state::
 
   markers.markers.push_back(mk);
 
-  const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
-  const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
+  const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_) * sensor_pose_ : sensor_pose_;
+  const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_) * target_pose_ : target_pose_;
 
   visualization_msgs::Marker mka;
   mka.type = visualization_msgs::Marker::ARROW;
@@ -941,8 +1459,8 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
 
   if (max_view_angle_ > 0.0 || max_range_angle_ > 0.0)
   {
-    const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
-    const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
+    const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_) * sensor_pose_ : sensor_pose_;
+    const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_) * target_pose_ : target_pose_;
 
     //necessary to do subtraction as SENSOR_Z is 0 and SENSOR_X is 2
     const Eigen::Vector3d &normal2 = sp.rotation().col(2-sensor_view_direction_);
@@ -986,29 +1504,86 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
     }
   }
 
-  shapes::Mesh *m = getVisibilityCone(state);
-  if (!m)
-    return ConstraintEvaluationResult(false, 0.0);
+  const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_) * sensor_pose_ : sensor_pose_;
+  const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_) * target_pose_ : target_pose_;
 
-  // add the visibility cone as an object
-  collision_detection::CollisionWorldFCL collision_world;
-  collision_world.getWorld()->addToObject("cone", shapes::ShapeConstPtr(m), Eigen::Affine3d::Identity());
+  // before running the full check, see if any link that is not allowed to touch the cone is close enough to it;
+  // the bounding spheres of the links are tested against a cone that contains the approximation of the visibility cone.
+  // Attached bodies are always allowed to touch the cone (see decideContact()), so they need not be tested
+  Eigen::Vector3d axis = tp.translation() - sp.translation();
+  double length = axis.norm();
+  bool may_collide = length <= std::numeric_limits<double>::epsilon();
+  if (!may_collide)
+  {
+    axis /= length;
+    const std::vector<robot_state::LinkState*> &ls = state.getLinkStateVector();
+    for (std::size_t i = 0 ; i < ls.size() && !may_collide ; ++i)
+    {
+      const robot_model::LinkModel *lm = ls[i]->getLinkModel();
+      if (!lm->getShape() ||
+          robot_state::Transforms::sameFrame(lm->getName(), sensor_frame_id_) ||
+          robot_state::Transforms::sameFrame(lm->getName(), target_frame_id_))
+        continue;
+      may_collide = sphereMayTouchCone(ls[i]->getGlobalCollisionBodyTransform().translation(), link_radii_[i],
+                                       sp.translation(), axis, length, target_radius_);
+    }
+  }
+  if (!may_collide)
+  {
+    if (verbose)
+      logInform("Visibility constraint satisfied. No link is close to the visibility cone.");
+    return ConstraintEvaluationResult(true, 0.0);
+  }
+
+  VisibilityCache *cache = getThreadVisibilityCache(caches_);
+
+  if (cache->owner_ != this)
+  {
+    cache->acm_.setDefaultEntry("cone", boost::bind(&VisibilityConstraint::decideContact, this, _1));
+    cache->owner_ = this;
+  }
+
+  // the cone is constructed in the frame of the target, so it only needs to be constructed again
+  // if the sensor moves relative to the target; otherwise the existing cone is moved to the pose of the target
+  Eigen::Vector3d apex = tp.inverse() * sp.translation();
+  if (cache->cone_ && (apex - cache->apex_).squaredNorm() < std::numeric_limits<double>::epsilon())
+    cache->world_.getWorld()->moveShapeInObject(cache->handle_, cache->cone_, tp);
+  else
+  {
+    EigenSTL::vector_Vector3d points(points_);
+    if (!mobile_target_frame_)
+    {
+      Eigen::Affine3d tpi = target_pose_.inverse();
+      for (std::size_t i = 0 ; i < points.size() ; ++i)
+        points[i] = tpi * points[i];
+    }
+
+    shapes::Mesh *m = constructCone(apex, Eigen::Vector3d::Zero(), points);
+    if (!m)
+      return ConstraintEvaluationResult(false, 0.0);
+
+    // add the visibility cone as an object
+    const collision_detection::WorldPtr &world = cache->world_.getWorld();
+    world->removeObject("cone");
+    cache->cone_.reset(m);
+    world->addToObject("cone", cache->cone_, tp);
+    cache->handle_ = world->getObjectHandle("cone");
+    cache->apex_ = apex;
+  }
 
   // check for collisions between the robot and the cone
   collision_detection::CollisionRequest req;
   collision_detection::CollisionResult res;
-  collision_detection::AllowedCollisionMatrix acm;
-  acm.setDefaultEntry("cone", boost::bind(&VisibilityConstraint::decideContact, this, _1));
   req.contacts = true;
   req.verbose = verbose;
   req.max_contacts = 1;
-  collision_world.checkRobotCollision(req, res, *collision_robot_, state, acm);
+  cache->world_.checkRobotCollision(req, res, *collision_robot_, state, cache->acm_);
 
   if (verbose)
   {
     std::stringstream ss;
-    m->print(ss);
-    logInform("Visibility constraint %ssatisfied. Visibility cone approximation:\n %s", res.collision ? "not " : "", ss.str().c_str());
+    cache->cone_->print(ss);
+    logInform("Visibility constraint %ssatisfied. Visibility cone approximation (in the target frame):\n %s", res.collision ? "not " : "", ss.str().c_str());
   }
 
   return ConstraintEvaluationResult(!res.collision, res.collision ? res.contacts.begin()->second.front().depth : 0.0);
@@ -1057,10 +1632,15 @@ void kinematic_constraints::KinematicConstraintSet::clear()
   position_constraints_.clear();
   orientation_constraints_.clear();
   visibility_constraints_.clear();
+  compiled_constraints_.clear();
+  compiled_ = false;
+  resetResultCache();
 }
 
 bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit_msgs::JointConstraint> &jc)
 {
+  compiled_ = false;
+  resetResultCache();
   bool result = true;
   for (unsigned int i = 0 ; i < jc.size() ; ++i)
   {
@@ -1076,6 +1656,8 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
 
 bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit_msgs::PositionConstraint> &pc, const robot_state::Transforms &tf)
 {
+  compiled_ = false;
+  resetResultCache();
   bool result = true;
   for (unsigned int i = 0 ; i < pc.size() ; ++i)
   {
@@ -1091,6 +1673,8 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
 
 bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit_msgs::OrientationConstraint> &oc, const robot_state::Transforms &tf)
 {
+  compiled_ = false;
+  resetResultCache();
   bool result = true;
   for (unsigned int i = 0 ; i < oc.size() ; ++i)
   {
@@ -1106,6 +1690,8 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
 
 bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit_msgs::VisibilityConstraint> &vc, const robot_state::Transforms &tf)
 {
+  compiled_ = false;
+  resetResultCache();
   bool result = true;
   for (unsigned int i = 0 ; i < vc.size() ; ++i)
   {
@@ -1128,9 +1714,113 @@ bool kinematic_constraints::KinematicConstraintSet::add(const moveit_msgs::Const
   return j && p && o && v;
 }
 
+namespace kinematic_constraints
+{
+// the rank of a constraint type in the order of evaluation of a compiled set; cheaper constraints come first
+static int getEvaluationRank(KinematicConstraint::ConstraintType type)
+{
+  switch (type)
+  {
+  case KinematicConstraint::JOINT_CONSTRAINT:
+    return 0;
+  case KinematicConstraint::POSITION_CONSTRAINT:
+  case KinematicConstraint::ORIENTATION_CONSTRAINT:
+    return 1;
+  case KinematicConstraint::VISIBILITY_CONSTRAINT:
+    return 2;
+  default:
+    return 3;
+  }
+}
+
+static bool cheaperToEvaluate(const KinematicConstraint *a, const KinematicConstraint *b)
+{
+  return getEvaluationRank(a->getType()) < getEvaluationRank(b->getType());
+}
+
+// evaluate the constraints for the states indexed by pending[begin, end), stopping at the first violated constraint
+static void decideStates(const std::vector<const KinematicConstraint*> *constraints, const std::vector<const robot_state::RobotState*> *states,
+                         const std::vector<std::size_t> *pending, std::size_t begin, std::size_t end,
+                         std::vector<ConstraintEvaluationResult> *results)
+{
+  for (std::size_t k = begin ; k < end ; ++k)
+  {
+    std::size_t s = (*pending)[k];
+    ConstraintEvaluationResult &res = (*results)[s];
+    for (std::size_t i = 0 ; i < constraints->size() && res.satisfied ; ++i)
+    {
+      ConstraintEvaluationResult r = (*constraints)[i]->decide(*(*states)[s], false);
+      res.distance += r.distance;
+      res.satisfied = r.satisfied;
+    }
+  }
+}
+}
+
+void kinematic_constraints::KinematicConstraintSet::compile(const robot_model::RobotModel &model)
+{
+  compiled_constraints_.clear();
+  for (std::size_t i = 0 ; i < kinematic_constraints_.size() ; ++i)
+  {
+    // disabled constraints are always satisfied and contribute no distance
+    if (!kinematic_constraints_[i]->enabled())
+      continue;
+    kinematic_constraints_[i]->compile(model);
+    compiled_constraints_.push_back(kinematic_constraints_[i].get());
+  }
+  std::stable_sort(compiled_constraints_.begin(), compiled_constraints_.end(), &cheaperToEvaluate);
+  compiled_ = true;
+}
+
+void kinematic_constraints::KinematicConstraintSet::setResultCache(std::size_t max_entries, double resolution)
+{
+  if (max_entries == 0)
+    result_cache_.reset();
+  else
+    result_cache_.reset(new robot_state::StateResultCache<ConstraintEvaluationResult>(max_entries, resolution));
+}
+
+robot_state::StateResultCacheStatistics kinematic_constraints::KinematicConstraintSet::getResultCacheStatistics() const
+{
+  return result_cache_ ? result_cache_->getStatistics() : robot_state::StateResultCacheStatistics();
+}
+
+void kinematic_constraints::KinematicConstraintSet::resetResultCache()
+{
+  if (result_cache_)
+    setResultCache(result_cache_->getMaxEntries(), result_cache_->getResolution());
+}
+
 kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::KinematicConstraintSet::decide(const robot_state::RobotState &state, bool verbose) const
+{
+  if (!result_cache_ || verbose)
+    return evaluate(state, verbose);
+  ConstraintEvaluationResult res;
+  if (!result_cache_->find(state, std::string(), res))
+  {
+    res = evaluate(state, false);
+    result_cache_->insert(state, std::string(), res);
+  }
+  return res;
+}
+
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::KinematicConstraintSet::evaluate(const robot_state::RobotState &state, bool verbose) const
 {
   ConstraintEvaluationResult res(true, 0.0);
+  if (compiled_ && !verbose)
+  {
+    for (std::size_t i = 0 ; i < compiled_constraints_.size() ; ++i)
+    {
+      ConstraintEvaluationResult r = compiled_constraints_[i]->decide(state, false);
+      res.distance += r.distance;
+      if (!r.satisfied)
+      {
+        res.satisfied = false;
+        break;
+      }
+    }
+    return res;
+  }
   for (unsigned int i = 0 ; i < kinematic_constraints_.size() ; ++i)
   {
     ConstraintEvaluationResult r = kinematic_constraints_[i]->decide(state, verbose);
@@ -1146,8 +1836,8 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Kinemat
                                                                                                         bool verbose) const
 {
   ConstraintEvaluationResult result(true, 0.0);
-  results.resize(joint_constraints_.size());
-  for (std::size_t i = 0 ; i < joint_constraints_.size() ; ++i)
+  results.resize(kinematic_constraints_.size());
+  for (std::size_t i = 0 ; i < kinematic_constraints_.size() ; ++i)
   {
     results[i] = kinematic_constraints_[i]->decide(state, verbose);
     result.satisfied = result.satisfied && results[i].satisfied;
@@ -1157,6 +1847,77 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Kinemat
   return result;
 }
 
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::KinematicConstraintSet::decideWithGradient(const robot_state::JointStateGroup &group,
+                                                                                                                    Eigen::VectorXd &gradient, bool verbose) const
+{
+  ConstraintEvaluationResult result(true, 0.0);
+  gradient = Eigen::VectorXd::Zero(group.getVariableCount());
+  Eigen::VectorXd g;
+  for (std::size_t i = 0 ; i < kinematic_constraints_.size() ; ++i)
+  {
+    ConstraintEvaluationResult r = kinematic_constraints_[i]->decideWithGradient(group, g, verbose);
+    result.satisfied = result.satisfied && r.satisfied;
+    result.distance += r.distance;
+    gradient += g;
+  }
+  return result;
+}
+
+void kinematic_constraints::KinematicConstraintSet::decideBatch(const std::vector<const robot_state::RobotState*> &states,
+                                                                 std::vector<ConstraintEvaluationResult> &results,
+                                                                 unsigned int num_threads) const
+{
+  results.assign(states.size(), ConstraintEvaluationResult(true, 0.0));
+
+  // use the order of the compiled set if there is one
+  std::vector<const KinematicConstraint*> ordered;
+  if (compiled_)
+    ordered = compiled_constraints_;
+  else
+  {
+    for (std::size_t i = 0 ; i < kinematic_constraints_.size() ; ++i)
+      if (kinematic_constraints_[i]->enabled())
+        ordered.push_back(kinematic_constraints_[i].get());
+    std::stable_sort(ordered.begin(), ordered.end(), &cheaperToEvaluate);
+  }
+
+  // joint constraints are cheap, so they are checked for all states, one constraint at a time
+  std::size_t k = 0;
+  for ( ; k < ordered.size() && ordered[k]->getType() == KinematicConstraint::JOINT_CONSTRAINT ; ++k)
+    for (std::size_t s = 0 ; s < states.size() ; ++s)
+      if (results[s].satisfied)
+      {
+        ConstraintEvaluationResult r = ordered[k]->decide(*states[s], false);
+        results[s].distance += r.distance;
+        results[s].satisfied = r.satisfied;
+      }
+  if (k == ordered.size())
+    return;
+  std::vector<const KinematicConstraint*> remaining(ordered.begin() + k, ordered.end());
+
+  // the states that satisfy the joint constraints are split evenly among the threads
+  std::vector<std::size_t> pending;
+  for (std::size_t s = 0 ; s < states.size() ; ++s)
+    if (results[s].satisfied)
+      pending.push_back(s);
+  if (pending.empty())
+    return;
+
+  // each thread updates the results of its own states only
+  std::size_t n = std::min<std::size_t>(std::max(num_threads, 1u), pending.size());
+  if (n == 1)
+    decideStates(&remaining, &states, &pending, 0, pending.size(), &results);
+  else
+  {
+    boost::thread_group threads;
+    for (std::size_t t = 1 ; t < n ; ++t)
+      threads.create_thread(boost::bind(&decideStates, &remaining, &states, &pending,
+                                        pending.size() * t / n, pending.size() * (t + 1) / n, &results));
+    decideStates(&remaining, &states, &pending, 0, pending.size() / n, &results);
+    threads.join_all();
+  }
+}
+
 void kinematic_constraints::KinematicConstraintSet::print(std::ostream &out) const
 {
   out << kinematic_constraints_.size() << " kinematic constraints" << std::endl;
@@ -41,6 +41,7 @@
 #include <fstream>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/filesystem/path.hpp>
+#include <boost/math/constants/constants.hpp>
 
 class LoadPlanningModelsPr2 : public testing::Test
 {
@@ -521,6 +522,74 @@ TEST_F(LoadPlanningModelsPr2, PositionConstraintsMobile)
     EXPECT_TRUE(pc.decide(ks, false).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, PositionConstraintsManyRegions)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  // a grid of small boxes and spheres, one of which contains the wrist in the default state
+  Eigen::Vector3d wrist = ks.getLinkState("l_wrist_roll_link")->getGlobalLinkTransform().translation();
+  Eigen::Vector3d wrist_torso = ks.getFrameTransform("torso_lift_link").inverse() * wrist;
+
+  for (int mobile = 0 ; mobile < 2 ; ++mobile)
+  {
+    const Eigen::Vector3d &origin = mobile ? wrist_torso : wrist;
+    moveit_msgs::PositionConstraint pcm;
+    pcm.link_name = "l_wrist_roll_link";
+    pcm.header.frame_id = mobile ? "torso_lift_link" : kmodel->getModelFrame();
+    pcm.weight = 1.0;
+    for (int x = -2 ; x <= 2 ; ++x)
+      for (int y = -2 ; y <= 2 ; ++y)
+        for (int z = -1 ; z <= 1 ; ++z)
+        {
+          shape_msgs::SolidPrimitive sp;
+          sp.type = (x + y + z) % 2 ? shape_msgs::SolidPrimitive::BOX : shape_msgs::SolidPrimitive::SPHERE;
+          if (sp.type == shape_msgs::SolidPrimitive::BOX)
+            sp.dimensions.resize(3, 0.08);
+          else
+            sp.dimensions.resize(1, 0.04);
+          geometry_msgs::Pose pose;
+          pose.position.x = origin.x() + 0.1 * x;
+          pose.position.y = origin.y() + 0.1 * y;
+          pose.position.z = origin.z() + 0.1 * z;
+          pose.orientation.w = 1.0;
+          pcm.constraint_region.primitives.push_back(sp);
+          pcm.constraint_region.primitive_poses.push_back(pose);
+        }
+
+    kinematic_constraints::PositionConstraint pc(kmodel);
+    EXPECT_TRUE(pc.configure(pcm, tf));
+    EXPECT_EQ(mobile == 1, pc.mobileReferenceFrame());
+    EXPECT_EQ(75u, pc.getConstraintRegions().size());
+
+    robot_state::RobotState st(ks);
+    std::map<std::string, double> jvals;
+    for (int i = 0 ; i < 30 ; ++i)
+    {
+      jvals["l_shoulder_pan_joint"] = -0.3 + 0.02 * i;
+      jvals["l_elbow_flex_joint"] = -0.05 * (i % 7);
+      jvals["torso_lift_joint"] = 0.01 * i;
+      st.setStateValues(jvals);
+
+      kinematic_constraints::ConstraintEvaluationResult r = pc.decide(st);
+      EXPECT_EQ(pc.decide(st, true).satisfied, r.satisfied);
+      EXPECT_NEAR(pc.decide(st, true).distance, r.distance, 1e-9);
+
+      // compare against testing every region on its own
+      Eigen::Vector3d p = st.getLinkState("l_wrist_roll_link")->getGlobalLinkTransform().translation();
+      if (mobile)
+        p = st.getFrameTransform("torso_lift_link").inverse() * p;
+      bool inside = false;
+      for (std::size_t k = 0 ; k < pc.getConstraintRegions().size() && !inside ; ++k)
+        inside = pc.getConstraintRegions()[k]->containsPoint(p);
+      EXPECT_EQ(inside, r.satisfied);
+    }
+    ks.setToDefaultValues();
+    EXPECT_TRUE(pc.decide(ks).satisfied);
+  }
+}
+
 TEST_F(LoadPlanningModelsPr2, PositionConstraintsEquality)
 {
     robot_state::RobotState ks(kmodel);
@@ -665,6 +734,153 @@ TEST_F(LoadPlanningModelsPr2, OrientationConstraintsSimple)
     EXPECT_FALSE(oc.decide(ks).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, OrientationConstraintsQuickAccept)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  ASSERT_TRUE(jsg);
+
+  kinematic_constraints::OrientationConstraint oc(kmodel);
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.header.frame_id = kmodel->getModelFrame();
+  ocm.link_name = "r_wrist_roll_link";
+  geometry_msgs::Pose p;
+  tf::poseEigenToMsg(ks.getLinkState(ocm.link_name)->getGlobalLinkTransform(), p);
+  ocm.orientation = p.orientation;
+  ocm.absolute_x_axis_tolerance = 0.4;
+  ocm.absolute_y_axis_tolerance = 0.5;
+  ocm.absolute_z_axis_tolerance = 0.6;
+  ocm.weight = 2.0;
+  EXPECT_TRUE(oc.configure(ocm, tf));
+
+  // whether or not a state is decided from its quaternion, the result matches the folded XYZ Euler angles
+  const double pi = boost::math::constants::pi<double>();
+  const Eigen::Matrix3d desired = oc.getDesiredRotationMatrix();
+  unsigned int satisfied = 0;
+  for (int i = 0 ; i < 200 ; ++i)
+  {
+    std::vector<double> values;
+    jsg->getVariableValues(values);
+    jsg->setToRandomValuesNearBy(values, std::vector<double>(values.size(), i % 2 ? 0.2 : 1.0));
+
+    Eigen::Vector3d xyz = (desired.transpose() * ks.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform().rotation()).eulerAngles(0, 1, 2);
+    for (int k = 0 ; k < 3 ; ++k)
+      xyz(k) = std::min(fabs(xyz(k)), pi - fabs(xyz(k)));
+    bool expected = xyz(0) < 0.4 && xyz(1) < 0.5 && xyz(2) < 0.6;
+
+    kinematic_constraints::ConstraintEvaluationResult res = oc.decide(ks);
+    EXPECT_EQ(expected, res.satisfied);
+    EXPECT_NEAR(2.0 * (xyz(0) + xyz(1) + xyz(2)), res.distance, 1e-6);
+    if (res.satisfied)
+      ++satisfied;
+  }
+  EXPECT_LT(0u, satisfied);
+}
+
+static void expectGradientMatchesDifferences(const kinematic_constraints::KinematicConstraint &kc, robot_state::JointStateGroup *jsg)
+{
+  Eigen::VectorXd gradient;
+  kinematic_constraints::ConstraintEvaluationResult res = kc.decideWithGradient(*jsg, gradient);
+  EXPECT_NEAR(res.distance, kc.decide(*jsg->getRobotState()).distance, 1e-12);
+  ASSERT_EQ(jsg->getVariableCount(), gradient.size());
+
+  std::vector<double> values;
+  jsg->getVariableValues(values);
+  const double h = 1e-6;
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+  {
+    std::vector<double> v = values;
+    v[i] = values[i] + h;
+    jsg->setVariableValues(v);
+    double above = kc.decide(*jsg->getRobotState()).distance;
+    v[i] = values[i] - h;
+    jsg->setVariableValues(v);
+    double below = kc.decide(*jsg->getRobotState()).distance;
+    EXPECT_NEAR((above - below) / (2.0 * h), gradient(i), 1e-4);
+  }
+  jsg->setVariableValues(values);
+}
+
+TEST_F(LoadPlanningModelsPr2, ConstraintGradients)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  ASSERT_TRUE(jsg);
+  std::vector<double> values(jsg->getVariableCount());
+  ASSERT_EQ(7u, values.size());
+  values[0] = -0.5; values[1] = 0.3; values[2] = -0.6; values[3] = -1.0;
+  values[4] = 0.4; values[5] = -0.7; values[6] = 0.2;
+  jsg->setVariableValues(values);
+
+  kinematic_constraints::JointConstraint jc(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "r_elbow_flex_joint";
+  jcm.position = -1.5;
+  jcm.tolerance_above = 0.01;
+  jcm.tolerance_below = 0.01;
+  jcm.weight = 1.0;
+  EXPECT_TRUE(jc.configure(jcm));
+  expectGradientMatchesDifferences(jc, jsg);
+
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.link_name = "r_wrist_roll_link";
+  pcm.target_point_offset.x = 0.1;
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.01;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.5;
+  pcm.constraint_region.primitive_poses[0].position.y = -0.5;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.0;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+  EXPECT_FALSE(pc.decide(ks).satisfied);
+  expectGradientMatchesDifferences(pc, jsg);
+
+  // a region attached to a link the group moves as well
+  pcm.header.frame_id = "r_upper_arm_roll_link";
+  EXPECT_TRUE(pc.configure(pcm, tf));
+  EXPECT_TRUE(pc.mobileReferenceFrame());
+  expectGradientMatchesDifferences(pc, jsg);
+
+  kinematic_constraints::OrientationConstraint oc(kmodel);
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.header.frame_id = kmodel->getModelFrame();
+  ocm.link_name = "r_wrist_roll_link";
+  ocm.orientation.x = 0.1;
+  ocm.orientation.y = 0.2;
+  ocm.orientation.z = 0.05;
+  ocm.orientation.w = sqrt(1.0 - 0.01 - 0.04 - 0.0025);
+  ocm.absolute_x_axis_tolerance = 0.01;
+  ocm.absolute_y_axis_tolerance = 0.01;
+  ocm.absolute_z_axis_tolerance = 0.01;
+  ocm.weight = 1.0;
+  EXPECT_TRUE(oc.configure(ocm, tf));
+  EXPECT_FALSE(oc.decide(ks).satisfied);
+  expectGradientMatchesDifferences(oc, jsg);
+
+  // the gradient of a set is the sum of the gradients of its constraints
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+  moveit_msgs::Constraints c;
+  c.joint_constraints.push_back(jcm);
+  c.orientation_constraints.push_back(ocm);
+  EXPECT_TRUE(kcs.add(c, tf));
+  Eigen::VectorXd gj, go, gs;
+  jc.decideWithGradient(*jsg, gj);
+  oc.decideWithGradient(*jsg, go);
+  kcs.decideWithGradient(*jsg, gs);
+  EXPECT_TRUE(gs.isApprox(gj + go));
+}
+
 TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsSimple)
 {
     robot_state::RobotState ks(kmodel);
@@ -788,6 +1004,76 @@ TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsPR2)
   EXPECT_FALSE(vc.decide(ks, true).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsRepeated)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  kinematic_constraints::VisibilityConstraint vc(kmodel);
+  moveit_msgs::VisibilityConstraint vcm;
+
+  vcm.sensor_pose.header.frame_id = "narrow_stereo_optical_frame";
+  vcm.sensor_pose.pose.position.z = 0.05;
+  vcm.sensor_pose.pose.orientation.w = 1.0;
+
+  vcm.target_pose.header.frame_id = "l_gripper_r_finger_tip_link";
+  vcm.target_pose.pose.position.z = 0.03;
+  vcm.target_pose.pose.orientation.w = 1.0;
+
+  vcm.target_radius = .05;
+  vcm.cone_sides = 10;
+  vcm.max_view_angle = 0.0;
+  vcm.max_range_angle = 0.0;
+  vcm.sensor_view_direction = moveit_msgs::VisibilityConstraint::SENSOR_Z;
+  vcm.weight = 1.0;
+  EXPECT_TRUE(vc.configure(vcm, tf));
+
+  std::map<std::string, double> in_collision;
+  in_collision["l_shoulder_lift_joint"] = .5;
+  in_collision["r_shoulder_pan_joint"] = .5;
+  in_collision["r_elbow_flex_joint"] = -1.4;
+  std::map<std::string, double> free = in_collision;
+  free["r_shoulder_pan_joint"] = .4;
+
+  // the cone kept from previous calls must follow the sensor and the target
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    ks.setStateValues(in_collision);
+    EXPECT_FALSE(vc.decide(ks).satisfied);
+    ks.setStateValues(free);
+    EXPECT_TRUE(vc.decide(ks).satisfied);
+    ks.setToDefaultValues();
+    EXPECT_TRUE(vc.decide(ks).satisfied);
+  }
+
+  // moving only the right arm does not change the cone, moving the left arm does
+  ks.setStateValues(free);
+  EXPECT_TRUE(vc.decide(ks).satisfied);
+  free["r_shoulder_pan_joint"] = .5;
+  ks.setStateValues(free);
+  EXPECT_FALSE(vc.decide(ks).satisfied);
+  free["l_shoulder_lift_joint"] = 0.0;
+  free["r_elbow_flex_joint"] = -.6;
+  ks.setStateValues(free);
+  EXPECT_TRUE(vc.decide(ks).satisfied);
+
+  // another constraint keeps a cone of its own
+  kinematic_constraints::VisibilityConstraint vc2(kmodel);
+  vcm.target_radius = .01;
+  vcm.target_pose.pose.position.z = 0.00;
+  vcm.target_pose.pose.position.x = 0.035;
+  EXPECT_TRUE(vc2.configure(vcm, tf));
+  ks.setToDefaultValues();
+  EXPECT_TRUE(vc2.decide(ks).satisfied);
+  EXPECT_TRUE(vc.decide(ks).satisfied);
+
+  // reconfiguring discards the previous cone
+  vcm.target_radius = .05;
+  EXPECT_TRUE(vc2.configure(vcm, tf));
+  EXPECT_FALSE(vc2.decide(ks).satisfied);
+}
+
 TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSet)
 {
   robot_state::RobotState ks(kmodel);
@@ -853,6 +1139,182 @@ TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSet)
   EXPECT_FALSE(kcs.decide(ks).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetCompile)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+
+  // the position of the left wrist relative to the torso, which is a mobile frame
+  Eigen::Vector3d p = ks.getFrameTransform("torso_lift_link").inverse() * ks.getLinkState("l_wrist_roll_link")->getGlobalLinkTransform().translation();
+
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.header.frame_id = "torso_lift_link";
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.05;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = p.x();
+  pcm.constraint_region.primitive_poses[0].position.y = p.y();
+  pcm.constraint_region.primitive_poses[0].position.z = p.z();
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "head_pan_joint";
+  jcm.position = 0.0;
+  jcm.tolerance_above = 0.1;
+  jcm.tolerance_below = 0.1;
+  jcm.weight = 1.0;
+
+  // the position constraint is added first, but the joint constraint is evaluated first once compiled
+  std::vector<moveit_msgs::PositionConstraint> pcv(1, pcm);
+  EXPECT_TRUE(kcs.add(pcv, tf));
+  std::vector<moveit_msgs::JointConstraint> jcv(1, jcm);
+  EXPECT_TRUE(kcs.add(jcv));
+  EXPECT_FALSE(kcs.isCompiled());
+  kcs.compile(*kmodel);
+  EXPECT_TRUE(kcs.isCompiled());
+
+  std::map<std::string, double> jvals;
+  for (int i = 0 ; i < 4 ; ++i)
+  {
+    // the constraints are relative to the torso, so moving it does not matter
+    jvals["torso_lift_joint"] = 0.1 * i;
+    jvals["head_pan_joint"] = i % 2 ? 0.5 : 0.0;
+    jvals["l_shoulder_pan_joint"] = i < 2 ? 0.0 : 0.5;
+    ks.setStateValues(jvals);
+
+    bool satisfied = i == 0;
+    EXPECT_EQ(satisfied, kcs.decide(ks).satisfied);
+    EXPECT_EQ(satisfied, kcs.decide(ks, true).satisfied);
+
+    std::vector<kinematic_constraints::ConstraintEvaluationResult> results;
+    EXPECT_EQ(satisfied, kcs.decide(ks, results).satisfied);
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ(i < 2, results[0].satisfied);
+    EXPECT_EQ(i % 2 == 0, results[1].satisfied);
+  }
+
+  // adding a constraint discards the compiled form
+  EXPECT_TRUE(kcs.add(jcv));
+  EXPECT_FALSE(kcs.isCompiled());
+  kcs.clear();
+  EXPECT_FALSE(kcs.isCompiled());
+}
+
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetBatch)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "head_pan_joint";
+  jcm.position = 0.0;
+  jcm.tolerance_above = 0.3;
+  jcm.tolerance_below = 0.3;
+  jcm.weight = 1.0;
+
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.link_name = "r_wrist_roll_link";
+  ocm.header.frame_id = "torso_lift_link";
+  ocm.orientation.w = 1.0;
+  ocm.absolute_x_axis_tolerance = 0.2;
+  ocm.absolute_y_axis_tolerance = 0.2;
+  ocm.absolute_z_axis_tolerance = 0.2;
+  ocm.weight = 1.0;
+
+  moveit_msgs::Constraints c;
+  c.orientation_constraints.push_back(ocm);
+  c.joint_constraints.push_back(jcm);
+  EXPECT_TRUE(kcs.add(c, tf));
+
+  std::vector<robot_state::RobotStatePtr> states;
+  std::vector<const robot_state::RobotState*> state_ptrs;
+  std::map<std::string, double> jvals;
+  for (int i = 0 ; i < 20 ; ++i)
+  {
+    jvals["head_pan_joint"] = -0.5 + 0.05 * i;
+    jvals["r_wrist_roll_joint"] = 0.3 - 0.03 * i;
+    robot_state::RobotStatePtr st(new robot_state::RobotState(ks));
+    st->setStateValues(jvals);
+    states.push_back(st);
+    state_ptrs.push_back(st.get());
+  }
+
+  // the result for each state matches the evaluation of the state on its own, with and without threads and compilation
+  for (int k = 0 ; k < 2 ; ++k)
+  {
+    for (unsigned int num_threads = 1 ; num_threads <= 3 ; ++num_threads)
+    {
+      std::vector<kinematic_constraints::ConstraintEvaluationResult> results;
+      kcs.decideBatch(state_ptrs, results, num_threads);
+      ASSERT_EQ(states.size(), results.size());
+      for (std::size_t i = 0 ; i < states.size() ; ++i)
+      {
+        EXPECT_EQ(kcs.decide(*states[i], true).satisfied, results[i].satisfied);
+        if (results[i].satisfied)
+          EXPECT_NEAR(kcs.decide(*states[i], true).distance, results[i].distance, 1e-9);
+      }
+    }
+    kcs.compile(*kmodel);
+  }
+
+  std::vector<kinematic_constraints::ConstraintEvaluationResult> results;
+  kcs.decideBatch(std::vector<const robot_state::RobotState*>(), results, 2);
+  EXPECT_TRUE(results.empty());
+}
+
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetResultCache)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "head_pan_joint";
+  jcm.position = 0.4;
+  jcm.tolerance_above = 0.1;
+  jcm.tolerance_below = 0.05;
+  jcm.weight = 1.0;
+  std::vector<moveit_msgs::JointConstraint> jcv(1, jcm);
+  EXPECT_TRUE(kcs.add(jcv));
+
+  kcs.setResultCache(10);
+  EXPECT_FALSE(kcs.decide(ks).satisfied);
+  EXPECT_FALSE(kcs.decide(ks).satisfied);
+  EXPECT_EQ(1u, kcs.getResultCacheStatistics().hits);
+  EXPECT_EQ(1u, kcs.getResultCacheStatistics().misses);
+
+  // without quantization, any change to the state is a different entry
+  std::map<std::string, double> jvals;
+  jvals["head_pan_joint"] = 0.41;
+  ks.setStateValues(jvals);
+  EXPECT_TRUE(kcs.decide(ks).satisfied);
+  EXPECT_EQ(2u, kcs.getResultCacheStatistics().misses);
+  EXPECT_EQ(2u, kcs.getResultCacheStatistics().entries);
+
+  // verbose evaluations bypass the cache
+  EXPECT_TRUE(kcs.decide(ks, true).satisfied);
+  EXPECT_EQ(1u, kcs.getResultCacheStatistics().hits);
+
+  // changing the constraints discards the results
+  jcv[0].position = 0.0;
+  EXPECT_TRUE(kcs.add(jcv));
+  EXPECT_EQ(0u, kcs.getResultCacheStatistics().entries);
+  EXPECT_FALSE(kcs.decide(ks).satisfied);
+
+  kcs.setResultCache(0);
+  EXPECT_EQ(0u, kcs.getResultCacheStatistics().misses);
+}
+
 TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetEquality)
 {
   robot_state::RobotState ks(kmodel);
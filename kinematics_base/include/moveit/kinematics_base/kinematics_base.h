@@ -40,6 +40,8 @@
 
 #include <geometry_msgs/PoseStamped.h>
 #include <moveit_msgs/MoveItErrorCodes.h>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+#include <Eigen/Geometry>
 #include <boost/function.hpp>
 #include <string>
 
@@ -179,6 +181,66 @@ public:
                                 moveit_msgs::MoveItErrorCodes &error_code,
                                 const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const = 0;
 
+  /**
+   * @brief Given a desired pose of the end-effector, search for the joint angles required to reach it.
+   * This overload takes Eigen types so that callers holding Eigen transforms do not need to convert them.
+   * The default implementation converts its arguments and calls the geometry_msgs version; solvers that work
+   * with Eigen internally should override it.
+   * @param ik_pose the desired pose of the link
+   * @param ik_seed_state an initial guess solution for the inverse kinematics
+   * @param timeout The amount of time (in seconds) available to the solver
+   * @param solution the solution vector
+   * @param solution_callback A callback solution for the IK solution; may be empty
+   * @param error_code an error code that encodes the reason for failure or success
+   * @return True if a valid solution was found, false otherwise
+   */
+  virtual bool searchPositionIK(const Eigen::Affine3d &ik_pose,
+                                const Eigen::VectorXd &ik_seed_state,
+                                double timeout,
+                                Eigen::VectorXd &solution,
+                                const IKCallbackFn &solution_callback,
+                                moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
+  /**
+   * @brief Given a desired pose of the end-effector, search for the joint angles required to reach it,
+   * staying within \e consistency_limits of the seed. Eigen counterpart of the geometry_msgs version.
+   * @param ik_pose the desired pose of the link
+   * @param ik_seed_state an initial guess solution for the inverse kinematics
+   * @param timeout The amount of time (in seconds) available to the solver
+   * @param consistency_limits the distance that any joint in the solution can be from the corresponding joints in the current seed state; may be empty
+   * @param solution the solution vector
+   * @param solution_callback A callback solution for the IK solution; may be empty
+   * @param error_code an error code that encodes the reason for failure or success
+   * @return True if a valid solution was found, false otherwise
+   */
+  virtual bool searchPositionIK(const Eigen::Affine3d &ik_pose,
+                                const Eigen::VectorXd &ik_seed_state,
+                                double timeout,
+                                const std::vector<double> &consistency_limits,
+                                Eigen::VectorXd &solution,
+                                const IKCallbackFn &solution_callback,
+                                moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
+  /**
+   * @brief Search for the joint angles that reach each of a set of poses of the end-effector.
+   * The default implementation calls searchPositionIK() once per pose; solvers that can share work between
+   * poses (analytic solvers, solvers that use several threads) should override it.
+   * @param ik_poses The desired poses of the link, in the frame returned by getBaseFrame()
+   * @param ik_seed_states The initial guesses, one per pose, or a single one used for all the poses
+   * @param timeout The amount of time (in seconds) available to the solver for each pose
+   * @param solutions The solution vectors, one per pose (empty for poses without a solution)
+   * @param error_codes The error codes, one per pose
+   * @return True if a solution was found for every pose, false otherwise
+   */
+  virtual bool searchPositionIKBatch(const EigenSTL::vector_Affine3d &ik_poses,
+                                     const std::vector<std::vector<double> > &ik_seed_states,
+                                     double timeout,
+                                     std::vector<std::vector<double> > &solutions,
+                                     std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                     const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
   /**
    * @brief Given a set of joint angles and a set of links, compute their pose
    * @param link_names A set of links for which FK needs to be computed
@@ -190,6 +252,18 @@ public:
                              const std::vector<double> &joint_angles,
                              std::vector<geometry_msgs::Pose> &poses) const = 0;
 
+  /**
+   * @brief Given a set of joint angles and a set of links, compute their pose.
+   * The default implementation converts its arguments and calls the geometry_msgs version.
+   * @param link_names A set of links for which FK needs to be computed
+   * @param joint_angles The state for which FK is being computed
+   * @param poses The resultant set of poses (in the frame returned by getBaseFrame())
+   * @return True if a valid solution was found, false otherwise
+   */
+  virtual bool getPositionFK(const std::vector<std::string> &link_names,
+                             const Eigen::VectorXd &joint_angles,
+                             EigenSTL::vector_Affine3d &poses) const;
+
   /**
    * @brief Set the parameters for the solver
    * @param robot_description This parameter can be used as an identifier for the robot kinematics is computed for; For example, rhe name of the ROS parameter that contains the robot description;
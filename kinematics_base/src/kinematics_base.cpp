@@ -36,6 +36,7 @@
 *********************************************************************/
 
 #include <moveit/kinematics_base/kinematics_base.h>
+#include <eigen_conversions/eigen_msg.h>
 
 const double kinematics::KinematicsBase::DEFAULT_SEARCH_DISCRETIZATION = 0.1;
 const double kinematics::KinematicsBase::DEFAULT_TIMEOUT = 1.0;
@@ -80,6 +81,95 @@ bool kinematics::KinematicsBase::setRedundantJoints(const std::vector<std::strin
   return redundant_joint_indices.size() == redundant_joint_names.size() ? setRedundantJoints(redundant_joint_indices) : false;
 }
 
+bool kinematics::KinematicsBase::searchPositionIK(const Eigen::Affine3d &ik_pose,
+                                                  const Eigen::VectorXd &ik_seed_state,
+                                                  double timeout,
+                                                  Eigen::VectorXd &solution,
+                                                  const IKCallbackFn &solution_callback,
+                                                  moveit_msgs::MoveItErrorCodes &error_code,
+                                                  const kinematics::KinematicsQueryOptions &options) const
+{
+  return searchPositionIK(ik_pose, ik_seed_state, timeout, std::vector<double>(), solution, solution_callback, error_code, options);
+}
+
+bool kinematics::KinematicsBase::searchPositionIK(const Eigen::Affine3d &ik_pose,
+                                                  const Eigen::VectorXd &ik_seed_state,
+                                                  double timeout,
+                                                  const std::vector<double> &consistency_limits,
+                                                  Eigen::VectorXd &solution,
+                                                  const IKCallbackFn &solution_callback,
+                                                  moveit_msgs::MoveItErrorCodes &error_code,
+                                                  const kinematics::KinematicsQueryOptions &options) const
+{
+  geometry_msgs::Pose ik_pose_msg;
+  tf::poseEigenToMsg(ik_pose, ik_pose_msg);
+  std::vector<double> seed(ik_seed_state.data(), ik_seed_state.data() + ik_seed_state.size());
+  std::vector<double> sol;
+  bool result;
+  if (consistency_limits.empty())
+    result = solution_callback ?
+      searchPositionIK(ik_pose_msg, seed, timeout, sol, solution_callback, error_code, options) :
+      searchPositionIK(ik_pose_msg, seed, timeout, sol, error_code, options);
+  else
+    result = solution_callback ?
+      searchPositionIK(ik_pose_msg, seed, timeout, consistency_limits, sol, solution_callback, error_code, options) :
+      searchPositionIK(ik_pose_msg, seed, timeout, consistency_limits, sol, error_code, options);
+  if (result)
+  {
+    solution.resize(sol.size());
+    for (std::size_t i = 0 ; i < sol.size() ; ++i)
+      solution[i] = sol[i];
+  }
+  return result;
+}
+
+bool kinematics::KinematicsBase::getPositionFK(const std::vector<std::string> &link_names,
+                                               const Eigen::VectorXd &joint_angles,
+                                               EigenSTL::vector_Affine3d &poses) const
+{
+  std::vector<double> angles(joint_angles.data(), joint_angles.data() + joint_angles.size());
+  std::vector<geometry_msgs::Pose> pose_msgs;
+  if (!getPositionFK(link_names, angles, pose_msgs))
+    return false;
+  poses.resize(pose_msgs.size());
+  for (std::size_t i = 0 ; i < pose_msgs.size() ; ++i)
+    tf::poseMsgToEigen(pose_msgs[i], poses[i]);
+  return true;
+}
+
+bool kinematics::KinematicsBase::searchPositionIKBatch(const EigenSTL::vector_Affine3d &ik_poses,
+                                                      const std::vector<std::vector<double> > &ik_seed_states,
+                                                      double timeout,
+                                                      std::vector<std::vector<double> > &solutions,
+                                                      std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                                      const kinematics::KinematicsQueryOptions &options) const
+{
+  solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+  if (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size())
+  {
+    for (std::size_t i = 0 ; i < ik_poses.size() ; ++i)
+    {
+      solutions[i].clear();
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::INVALID_ROBOT_STATE;
+    }
+    return ik_poses.empty();
+  }
+
+  bool all_solved = true;
+  geometry_msgs::Pose ik_pose;
+  for (std::size_t i = 0 ; i < ik_poses.size() ; ++i)
+  {
+    tf::poseEigenToMsg(ik_poses[i], ik_pose);
+    if (!searchPositionIK(ik_pose, ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[i], timeout, solutions[i], error_codes[i], options))
+    {
+      solutions[i].clear();
+      all_solved = false;
+    }
+  }
+  return all_solved;
+}
+
 std::string kinematics::KinematicsBase::removeSlash(const std::string &str) const
 {
   return (!str.empty() && str[0] == '/') ? removeSlash(str.substr(1)) : str;
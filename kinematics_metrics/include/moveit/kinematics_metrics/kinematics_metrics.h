@@ -53,11 +53,33 @@ class KinematicsMetrics
 {
 public:
 
-  /** \brief Construct a KinematicsMetricss from a RobotModel */
-  KinematicsMetrics(const robot_model::RobotModelConstPtr &kinematic_model) :
-    kinematic_model_(kinematic_model), penalty_multiplier_(0.0)
+  /**
+   * \brief The manipulability measures of a group at a state, as computed by getManipulabilityMetrics().
+   * An instance also holds the scratch space of the computation; reusing it for many
+   * states avoids memory allocation. An instance must not be shared between threads.
+   */
+  struct ManipulabilityMetrics
   {
-  }
+    /** \brief sqrt(det(JJ^T)), multiplied by the joint limits penalty */
+    double index;
+
+    /** \brief sigma_min/sigma_max for the singular values of J, multiplied by the joint limits penalty */
+    double condition_number;
+
+    /** \brief The eigen values of the translation part of JJ^T, in increasing order */
+    Eigen::Vector3d ellipsoid_eigen_values;
+
+    /** \brief The eigen vectors (columns) that correspond to ellipsoid_eigen_values */
+    Eigen::Matrix3d ellipsoid_eigen_vectors;
+
+    /** \brief The Jacobian the measures were computed from */
+    Eigen::MatrixXd jacobian;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /** \brief Construct a KinematicsMetricss from a RobotModel */
+  KinematicsMetrics(const robot_model::RobotModelConstPtr &kinematic_model);
 
   /**
    * @brief Get the manipulability for a given group at a given joint configuration
@@ -109,6 +131,36 @@ public:
                                   Eigen::MatrixXcd &eigen_values,
                                   Eigen::MatrixXcd &eigen_vectors) const;
 
+  /**
+   * @brief Get the (translation) manipulability ellipsoid for a given group at a given joint configuration.
+   * Since JJ^T is symmetric, the eigen values and vectors are real; they are computed with a fixed size
+   * self-adjoint solver and the eigen values are in increasing order.
+   * @param kinematic_state Complete kinematic state for the robot
+   * @param joint_model_group A pointer to the desired joint model group
+   * @param eigen_values The eigen values for the translation part of JJ^T
+   * @param eigen_vectors The eigen vectors for the translation part of JJ^T (as columns)
+   * @return False if the group was not found
+   */
+  bool getManipulabilityEllipsoid(const robot_state::RobotState &kinematic_state,
+                                  const robot_model::JointModelGroup *joint_model_group,
+                                  Eigen::Vector3d &eigen_values,
+                                  Eigen::Matrix3d &eigen_vectors) const;
+
+  /**
+   * @brief Get the manipulability index, the condition number and the manipulability ellipsoid
+   * for a given group at a given joint configuration, from a single eigen decomposition of JJ^T.
+   * This is cheaper than calling getManipulabilityIndex(), getManipulability() and getManipulabilityEllipsoid().
+   * @param kinematic_state Complete kinematic state for the robot
+   * @param joint_model_group A pointer to the desired joint model group
+   * @param metrics The computed measures; its scratch space is reused if it has the right size
+   * @param translation If true, only the translation part of the Jacobian is used for the index and the condition number
+   * @return False if the group was not found or the Jacobian could not be computed
+   */
+  bool getManipulabilityMetrics(const robot_state::RobotState &kinematic_state,
+                                const robot_model::JointModelGroup *joint_model_group,
+                                ManipulabilityMetrics &metrics,
+                                bool translation = false) const;
+
   /**
    * @brief Get the manipulability = sigma_min/sigma_max
    * where sigma_min and sigma_max are the smallest and largest singular values
@@ -154,8 +206,33 @@ protected:
   Eigen::MatrixXd getJacobian(const robot_state::RobotState &kinematic_state,
                               const robot_model::JointModelGroup *joint_model_group) const;
 
+  /** \brief Compute the Jacobian of the last link of the group into \e jacobian; no memory is allocated if it has the right size */
+  bool getJacobian(const robot_state::RobotState &kinematic_state,
+                   const robot_model::JointModelGroup *joint_model_group,
+                   Eigen::MatrixXd &jacobian) const;
+
 private:
 
+  /** \brief The bounds of a joint that has one variable, as used by getJointLimitsPenalty() */
+  struct SingleDOFJointLimits
+  {
+    std::size_t joint_index_; // index in the joint state vector of the group
+    double lower_;
+    double upper_;
+  };
+
+  /** \brief The joints of a group that count in getJointLimitsPenalty(), with their bounds, precomputed
+      once so the penalty needs no type checks or bound lookups */
+  struct GroupJointLimits
+  {
+    std::vector<SingleDOFJointLimits> single_dof_joints_;
+
+    /** \brief Bounded planar joints: their indices and the lower and upper values of their variables */
+    std::vector<std::size_t> planar_joints_;
+    std::vector<std::vector<double> > planar_lower_bounds_;
+    std::vector<std::vector<double> > planar_upper_bounds_;
+  };
+
     /**
    * @brief Defines a multiplier for the manipulabilty
    * = 1 - exp ( -penalty_multipler_ * product_{i=1}{n} (distance_to_lower_limit * distance_to_higher_limit/(joint_range*joint_range)))
@@ -170,6 +247,8 @@ private:
 
   double penalty_multiplier_;
 
+  std::map<const robot_model::JointModelGroup*, GroupJointLimits> group_joint_limits_;
+
 };
 
 typedef boost::shared_ptr<KinematicsMetrics> KinematicsMetricsPtr;
@@ -0,0 +1,170 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_KINEMATICS_METRICS_REACHABILITY_MAP_
+#define MOVEIT_KINEMATICS_METRICS_REACHABILITY_MAP_
+
+#include <moveit/kinematics_metrics/kinematics_metrics.h>
+#include <moveit/distance_field/voxel_grid.h>
+#include <random_numbers/random_numbers.h>
+#include <boost/cstdint.hpp>
+#include <iostream>
+
+namespace kinematics_metrics
+{
+
+/** \brief The data kept for a cell of a ReachabilityMap */
+struct ReachabilityCell
+{
+  ReachabilityCell() : sample_count_(0), manipulability_sum_(0.0f), max_manipulability_(0.0f)
+  {
+  }
+
+  /** \brief The number of sampled states that put the tip of the group in this cell */
+  boost::uint32_t sample_count_;
+
+  /** \brief The sum of the manipulability indices of these states */
+  float manipulability_sum_;
+
+  /** \brief The largest manipulability index of these states */
+  float max_manipulability_;
+};
+
+/**
+ * \brief A voxelized map of the workspace of a group: for each cell, how often the tip of the group
+ * (the last link of the group) reaches it and with what manipulability. The map is built offline by sampling
+ * the joint space of the group, either randomly or on a grid, using several threads. It can be saved in
+ * binary form, and used as a prior for choosing reachable positions (see samplePosition()).
+ */
+class ReachabilityMap
+{
+public:
+
+  /**
+   * \brief Construct an empty map of the box of size (\e size_x, \e size_y, \e size_z) with minimum corner
+   * (\e origin_x, \e origin_y, \e origin_z) in the model frame, with cells of size \e resolution
+   */
+  ReachabilityMap(double size_x, double size_y, double size_z, double resolution,
+                  double origin_x, double origin_y, double origin_z);
+
+  /**
+   * \brief Add \e sample_count random states of \e joint_model_group to the map. The variables of the other
+   * groups are taken from \e reference_state.
+   * @param metrics The metrics used to compute the manipulability index of each state
+   * @param num_threads The number of threads the samples are distributed over
+   * @param translation Passed to KinematicsMetrics::getManipulabilityMetrics()
+   * @return False if the group is not valid
+   */
+  bool addRandomSamples(const KinematicsMetrics &metrics,
+                        const robot_state::RobotState &reference_state,
+                        const robot_model::JointModelGroup *joint_model_group,
+                        std::size_t sample_count,
+                        unsigned int num_threads = 1,
+                        bool translation = true);
+
+  /**
+   * \brief Add the states of a grid over the joint space of \e joint_model_group to the map, with
+   * \e steps_per_variable values spread evenly over the bounds of each variable. All the variables of
+   * the group must have finite bounds. The other arguments are as in addRandomSamples().
+   */
+  bool addGridSamples(const KinematicsMetrics &metrics,
+                      const robot_state::RobotState &reference_state,
+                      const robot_model::JointModelGroup *joint_model_group,
+                      unsigned int steps_per_variable,
+                      unsigned int num_threads = 1,
+                      bool translation = true);
+
+  /** \brief Get the cell that contains \e position (in the model frame); an empty cell is returned for positions outside the map */
+  const ReachabilityCell& getCell(const Eigen::Vector3d &position) const
+  {
+    return grid_(position.x(), position.y(), position.z());
+  }
+
+  /** \brief Get the mean manipulability of the states that reach the cell of \e position; 0 if there are none */
+  double getMeanManipulability(const Eigen::Vector3d &position) const
+  {
+    const ReachabilityCell &cell = getCell(position);
+    return cell.sample_count_ > 0 ? cell.manipulability_sum_ / cell.sample_count_ : 0.0;
+  }
+
+  /** \brief Get the underlying grid */
+  const distance_field::VoxelGrid<ReachabilityCell>& getGrid() const
+  {
+    return grid_;
+  }
+
+  /** \brief Get the total number of states added to the map (including the ones outside of it) */
+  std::size_t getSampleCount() const
+  {
+    return sample_count_;
+  }
+
+  /**
+   * \brief Pick the center of a cell at random, with a probability proportional to the sum of the
+   * manipulability indices of the cell, so cells that are reached often and with good manipulability
+   * are preferred. This can be used to choose position targets or seeds when sampling for IK.
+   * @return False if no cell was reached
+   */
+  bool samplePosition(random_numbers::RandomNumberGenerator &rng, Eigen::Vector3d &position) const;
+
+  /** \brief Write the map to \e stream in binary form */
+  bool writeBinaryToStream(std::ostream &stream) const;
+
+  /** \brief Read a map written by writeBinaryToStream(), replacing the content of this map */
+  bool readBinaryFromStream(std::istream &stream);
+
+private:
+
+  struct Samples;
+
+  /** \brief Evaluate the states of thread \e thread_index and add them to the map */
+  void addSamples(Samples *samples, unsigned int thread_index);
+
+  /** \brief Rebuild the cumulative weights used by samplePosition() */
+  void updateSamplingTable();
+
+  distance_field::VoxelGrid<ReachabilityCell> grid_;
+  std::size_t sample_count_;
+
+  /** \brief The cumulative weights of the reached cells and their indices (x, y, z) */
+  std::vector<double> sampling_weights_;
+  std::vector<Eigen::Vector3i> sampling_cells_;
+};
+
+typedef boost::shared_ptr<ReachabilityMap> ReachabilityMapPtr;
+typedef boost::shared_ptr<const ReachabilityMap> ReachabilityMapConstPtr;
+
+}
+
+#endif
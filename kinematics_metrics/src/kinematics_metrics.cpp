@@ -42,53 +42,120 @@
 namespace kinematics_metrics
 {
 
+namespace
+{
+// The eigen values of JJ^T are the squares of the singular values of J; if J has fewer columns than rows,
+// only the largest eigen values correspond to singular values (the others are zero)
+template<int N>
+void computeMeasures(const Eigen::Matrix<double, N, 1> &eigen_values, int columns,
+                     double &index, double &condition_number)
+{
+  double determinant = 1.0;
+  for (int i = 0 ; i < N ; ++i)
+    determinant *= std::max(0.0, eigen_values(i));
+  index = sqrt(determinant);
+
+  const int rank = std::min(N, columns);
+  const double largest = eigen_values(N - 1);
+  condition_number = rank > 0 && largest > 0.0 ? sqrt(std::max(0.0, eigen_values(N - rank)) / largest) : 0.0;
+}
+}
+
 Eigen::MatrixXd KinematicsMetrics::getJacobian(const robot_state::RobotState &kinematic_state,
                                                const robot_model::JointModelGroup *joint_model_group) const
 {
   Eigen::MatrixXd jacobian;
-  Eigen::Vector3d reference_point_position(0.0, 0.0, 0.0);
-  std::string link_name = joint_model_group->getLinkModelNames().back();
-  kinematic_state.getJointStateGroup(joint_model_group->getName())->getJacobian(link_name, reference_point_position, jacobian);
+  getJacobian(kinematic_state, joint_model_group, jacobian);
   return jacobian;
 }
 
+bool KinematicsMetrics::getJacobian(const robot_state::RobotState &kinematic_state,
+                                    const robot_model::JointModelGroup *joint_model_group,
+                                    Eigen::MatrixXd &jacobian) const
+{
+  const robot_state::JointStateGroup *joint_state_group = kinematic_state.getJointStateGroup(joint_model_group->getName());
+  if (!joint_state_group || joint_model_group->getLinkModels().empty())
+    return false;
+  return joint_state_group->getJacobian(joint_model_group->getLinkModels().back(), Eigen::Vector3d::Zero(), jacobian);
+}
+
+KinematicsMetrics::KinematicsMetrics(const robot_model::RobotModelConstPtr &kinematic_model) :
+  kinematic_model_(kinematic_model), penalty_multiplier_(0.0)
+{
+  const std::map<std::string, robot_model::JointModelGroup*> &groups = kinematic_model_->getJointModelGroupMap();
+  for (std::map<std::string, robot_model::JointModelGroup*>::const_iterator it = groups.begin() ; it != groups.end() ; ++it)
+  {
+    GroupJointLimits &limits = group_joint_limits_[it->second];
+    const std::vector<const robot_model::JointModel*> &joints = it->second->getJointModels();
+    for (std::size_t i = 0 ; i < joints.size() ; ++i)
+    {
+      const robot_model::JointModel::Bounds &bounds = joints[i]->getVariableBounds();
+      switch (joints[i]->getType())
+      {
+      case robot_model::JointModel::REVOLUTE:
+        if (static_cast<const robot_model::RevoluteJointModel*>(joints[i])->isContinuous())
+          break;
+        // fall through: bounded revolute joints are treated like prismatic ones
+      case robot_model::JointModel::PRISMATIC:
+        {
+          SingleDOFJointLimits joint_limits;
+          joint_limits.joint_index_ = i;
+          joint_limits.lower_ = bounds[0].first;
+          joint_limits.upper_ = bounds[0].second;
+          limits.single_dof_joints_.push_back(joint_limits);
+        }
+        break;
+      case robot_model::JointModel::PLANAR:
+        if (bounds[0].first == -std::numeric_limits<double>::max() || bounds[0].second == std::numeric_limits<double>::max() ||
+            bounds[1].first == -std::numeric_limits<double>::max() || bounds[1].second == std::numeric_limits<double>::max() ||
+            bounds[2].first == -boost::math::constants::pi<double>() || bounds[2].second == boost::math::constants::pi<double>())
+          break;
+        limits.planar_joints_.push_back(i);
+        limits.planar_lower_bounds_.push_back(std::vector<double>());
+        limits.planar_upper_bounds_.push_back(std::vector<double>());
+        for (std::size_t j = 0 ; j < bounds.size() ; ++j)
+        {
+          limits.planar_lower_bounds_.back().push_back(bounds[j].first);
+          limits.planar_upper_bounds_.back().push_back(bounds[j].second);
+        }
+        break;
+      default:
+        //Joint limits are not well-defined for floating joints
+        break;
+      }
+    }
+  }
+}
+
 double KinematicsMetrics::getJointLimitsPenalty(const robot_state::JointStateGroup* joint_state_group) const
 {
   if(fabs(penalty_multiplier_) <= boost::math::tools::epsilon<double>())
      return 1.0;
-  double joint_limits_multiplier(1.0);
+  std::map<const robot_model::JointModelGroup*, GroupJointLimits>::const_iterator it =
+    group_joint_limits_.find(joint_state_group->getJointModelGroup());
+  if (it == group_joint_limits_.end())
+    return 1.0;
+  const GroupJointLimits &limits = it->second;
   const std::vector<robot_state::JointState*> &joint_state_vector = joint_state_group->getJointStateVector();
-  for(std::size_t i=0; i < joint_state_group->getJointStateVector().size(); ++i)
+
+  double joint_limits_multiplier(1.0);
+  for(std::size_t i=0; i < limits.single_dof_joints_.size(); ++i)
   {
-     if(joint_state_vector[i]->getType() == robot_model::JointModel::REVOLUTE)
-    {
-      const robot_model::RevoluteJointModel* revolute_model = dynamic_cast<const robot_model::RevoluteJointModel*> (joint_state_vector[i]->getJointModel());
-      if(revolute_model->isContinuous())
-        continue;
-    }
-    if(joint_state_vector[i]->getType() == robot_model::JointModel::PLANAR)
-    {
-      const std::vector<std::pair<double, double> >& planar_bounds = joint_state_vector[i]->getVariableBounds();
-      if(planar_bounds[0].first == -std::numeric_limits<double>::max() || planar_bounds[0].second == std::numeric_limits<double>::max() ||
-         planar_bounds[1].first == -std::numeric_limits<double>::max() || planar_bounds[1].second == std::numeric_limits<double>::max() ||
-         planar_bounds[2].first == -boost::math::constants::pi<double>() || planar_bounds[2].second == boost::math::constants::pi<double>())
-        continue;
-    }
-    if(joint_state_vector[i]->getType() == robot_model::JointModel::FLOATING)
-    {
-      //Joint limits are not well-defined for floating joints
+    const SingleDOFJointLimits &joint_limits = limits.single_dof_joints_[i];
+    const double value = joint_state_vector[joint_limits.joint_index_]->getVariableValues()[0];
+    double lower_bound_distance = fabs(value - joint_limits.lower_);
+    double upper_bound_distance = fabs(joint_limits.upper_ - value);
+    double range = lower_bound_distance + upper_bound_distance;
+    if(range <= boost::math::tools::epsilon<double>())
       continue;
-    }
-    const std::vector<double>& joint_values = joint_state_vector[i]->getVariableValues();
-    const std::vector<std::pair<double, double> >& bounds = joint_state_vector[i]->getVariableBounds();
-    std::vector<double> lower_bounds, upper_bounds;
-    for(std::size_t j=0; j < bounds.size(); ++j)
-    {
-      lower_bounds.push_back(bounds[j].first);
-      upper_bounds.push_back(bounds[j].second);
-    }
-    double lower_bound_distance = joint_state_vector[i]->getJointModel()->distance(joint_values, lower_bounds);
-    double upper_bound_distance = joint_state_vector[i]->getJointModel()->distance(joint_values, upper_bounds);
+    joint_limits_multiplier *= (lower_bound_distance * upper_bound_distance/(range*range));
+  }
+  for(std::size_t i=0; i < limits.planar_joints_.size(); ++i)
+  {
+    const robot_state::JointState *joint_state = joint_state_vector[limits.planar_joints_[i]];
+    const std::vector<double>& joint_values = joint_state->getVariableValues();
+    double lower_bound_distance = joint_state->getJointModel()->distance(joint_values, limits.planar_lower_bounds_[i]);
+    double upper_bound_distance = joint_state->getJointModel()->distance(joint_values, limits.planar_upper_bounds_[i]);
     double range = lower_bound_distance + upper_bound_distance;
     if(range <= boost::math::tools::epsilon<double>())
       continue;
@@ -116,22 +183,10 @@ bool KinematicsMetrics::getManipulabilityIndex(const robot_state::RobotState &ki
     logError("Joint model group does not exist");
     return false;
   }
-  Eigen::MatrixXd jacobian = getJacobian(kinematic_state, joint_model_group);
-  // Get joint limits penalty
-  double penalty = getJointLimitsPenalty(kinematic_state.getJointStateGroup(joint_model_group->getName()));
-  if(translation)
-  {
-    Eigen::MatrixXd jacobian_2 = jacobian.topLeftCorner(3,jacobian.cols());
-    Eigen::MatrixXd matrix = jacobian_2*jacobian_2.transpose();
-    // Get manipulability index
-    manipulability_index = penalty * sqrt(matrix.determinant());
-  }
-  else
-  {
-    Eigen::MatrixXd matrix = jacobian*jacobian.transpose();
-    // Get manipulability index
-    manipulability_index = penalty * sqrt(matrix.determinant());
-  }
+  ManipulabilityMetrics metrics;
+  if (!getManipulabilityMetrics(kinematic_state, joint_model_group, metrics, translation))
+    return false;
+  manipulability_index = metrics.index;
   return true;
 }
 
@@ -154,14 +209,73 @@ bool KinematicsMetrics::getManipulabilityEllipsoid(const robot_state::RobotState
     logError("Joint model group does not exist");
     return false;
   }
-  Eigen::MatrixXd jacobian = getJacobian(kinematic_state, joint_model_group);
-  Eigen::MatrixXd matrix = jacobian*jacobian.transpose();
-  Eigen::EigenSolver<Eigen::MatrixXd> eigensolver(matrix.block(0, 0, 3, 3));
+  Eigen::Vector3d real_eigen_values;
+  Eigen::Matrix3d real_eigen_vectors;
+  if (!getManipulabilityEllipsoid(kinematic_state, joint_model_group, real_eigen_values, real_eigen_vectors))
+    return false;
+  eigen_values = real_eigen_values.cast<std::complex<double> >();
+  eigen_vectors = real_eigen_vectors.cast<std::complex<double> >();
+  return true;
+}
+
+bool KinematicsMetrics::getManipulabilityEllipsoid(const robot_state::RobotState &kinematic_state,
+                                                   const robot_model::JointModelGroup *joint_model_group,
+                                                   Eigen::Vector3d &eigen_values,
+                                                   Eigen::Matrix3d &eigen_vectors) const
+{
+  if (!joint_model_group)
+  {
+    logError("Joint model group does not exist");
+    return false;
+  }
+  Eigen::MatrixXd jacobian;
+  if (!getJacobian(kinematic_state, joint_model_group, jacobian))
+    return false;
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigensolver(jacobian.topRows<3>() * jacobian.topRows<3>().transpose());
   eigen_values = eigensolver.eigenvalues();
   eigen_vectors = eigensolver.eigenvectors();
   return true;
 }
 
+bool KinematicsMetrics::getManipulabilityMetrics(const robot_state::RobotState &kinematic_state,
+                                                 const robot_model::JointModelGroup *joint_model_group,
+                                                 ManipulabilityMetrics &metrics,
+                                                 bool translation) const
+{
+  if (!joint_model_group)
+  {
+    logError("Joint model group does not exist");
+    return false;
+  }
+  if (!getJacobian(kinematic_state, joint_model_group, metrics.jacobian) || metrics.jacobian.rows() != 6)
+  {
+    logError("Could not compute the Jacobian for group '%s'", joint_model_group->getName().c_str());
+    return false;
+  }
+  const Eigen::MatrixXd &jacobian = metrics.jacobian;
+
+  // the translation part of JJ^T gives the ellipsoid, and all the measures if only translation is considered
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> translation_solver(jacobian.topRows<3>() * jacobian.topRows<3>().transpose());
+  metrics.ellipsoid_eigen_values = translation_solver.eigenvalues();
+  metrics.ellipsoid_eigen_vectors = translation_solver.eigenvectors();
+
+  if (translation)
+    computeMeasures<3>(metrics.ellipsoid_eigen_values, jacobian.cols(), metrics.index, metrics.condition_number);
+  else
+  {
+    Eigen::Matrix<double, 6, 6> matrix = jacobian * jacobian.transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6> > solver(matrix, Eigen::EigenvaluesOnly);
+    Eigen::Matrix<double, 6, 1> eigen_values = solver.eigenvalues();
+    computeMeasures<6>(eigen_values, jacobian.cols(), metrics.index, metrics.condition_number);
+  }
+
+  // Get joint limits penalty
+  double penalty = getJointLimitsPenalty(kinematic_state.getJointStateGroup(joint_model_group->getName()));
+  metrics.index *= penalty;
+  metrics.condition_number *= penalty;
+  return true;
+}
+
 bool KinematicsMetrics::getManipulability(const robot_state::RobotState &kinematic_state,
                                           const std::string &group_name,
                                           double &manipulability,
@@ -182,26 +296,10 @@ bool KinematicsMetrics::getManipulability(const robot_state::RobotState &kinemat
     return false;
   }
 
-  // Get joint limits penalty
-  double penalty = getJointLimitsPenalty(kinematic_state.getJointStateGroup(joint_model_group->getName()));
-  if(translation)
-  {
-    Eigen::MatrixXd jacobian = getJacobian(kinematic_state, joint_model_group);
-    Eigen::JacobiSVD<Eigen::MatrixXd> svdsolver(jacobian.topLeftCorner(3,jacobian.cols()));
-    Eigen::MatrixXd singular_values = svdsolver.singularValues();
-    for(unsigned int i=0; i < singular_values.rows(); ++i)
-      logDebug("Singular value: %d %f",i,singular_values(i,0));
-    manipulability = penalty * singular_values.minCoeff()/singular_values.maxCoeff();
-  }
-  else
-  {
-    Eigen::MatrixXd jacobian = getJacobian(kinematic_state, joint_model_group);
-    Eigen::JacobiSVD<Eigen::MatrixXd> svdsolver(jacobian);
-    Eigen::MatrixXd singular_values = svdsolver.singularValues();
-    for(unsigned int i=0; i < singular_values.rows(); ++i)
-      logDebug("Singular value: %d %f",i,singular_values(i,0));
-    manipulability = penalty * singular_values.minCoeff()/singular_values.maxCoeff();
-  }
+  ManipulabilityMetrics metrics;
+  if (!getManipulabilityMetrics(kinematic_state, joint_model_group, metrics, translation))
+    return false;
+  manipulability = metrics.condition_number;
   return true;
 }
 
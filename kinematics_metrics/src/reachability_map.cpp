@@ -0,0 +1,439 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/kinematics_metrics/reachability_map.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace kinematics_metrics
+{
+
+namespace
+{
+// the number of samples a thread evaluates before adding them to the map
+const std::size_t SAMPLE_BATCH_SIZE = 1024;
+
+// layout of the binary format: a BinaryHeader, followed by the sample counts (uint32), the sums of the
+// manipulability indices (float) and the largest manipulability indices (float) of the cells, in (x, y, z) order
+const char BINARY_MAGIC[8] = { 'M', 'V', 'R', 'M', 'A', 'P', 0, 0 };
+const boost::uint32_t BINARY_VERSION = 1;
+const boost::uint32_t BINARY_BYTE_ORDER = 0x01020304;
+
+struct BinaryHeader
+{
+  char            magic_[8];
+  boost::uint32_t version_;
+  boost::uint32_t byte_order_;
+  double          resolution_;
+  double          size_[3];
+  double          origin_[3];
+  boost::int32_t  num_cells_[3];
+  boost::uint32_t reserved_;
+  boost::uint64_t sample_count_;
+};
+
+typedef std::vector<std::pair<Eigen::Vector3i, float> > SampleBatch;
+
+// add the cells reached by a batch of samples, with their manipulability indices, to the grid
+void addBatch(distance_field::VoxelGrid<ReachabilityCell> &grid, SampleBatch &batch)
+{
+  for (std::size_t i = 0 ; i < batch.size() ; ++i)
+  {
+    ReachabilityCell &cell = grid.getCell(batch[i].first.x(), batch[i].first.y(), batch[i].first.z());
+    cell.sample_count_++;
+    cell.manipulability_sum_ += batch[i].second;
+    cell.max_manipulability_ = std::max(cell.max_manipulability_, batch[i].second);
+  }
+  batch.clear();
+}
+
+// values are read in bounded chunks, so a corrupt count cannot allocate more than the stream holds
+const std::size_t BINARY_READ_CHUNK = 1 << 16;
+
+template<typename T>
+bool readBinaryArray(std::istream &in, std::size_t count, std::vector<T> &values)
+{
+  values.clear();
+  while (values.size() < count)
+  {
+    const std::size_t offset = values.size();
+    values.resize(offset + std::min(count - offset, BINARY_READ_CHUNK));
+    in.read(reinterpret_cast<char*>(&values[offset]), (values.size() - offset) * sizeof(T));
+    if (!in.good())
+      return false;
+  }
+  return true;
+}
+
+// the number of bytes left to read from \e in, or the maximum value if the stream cannot tell
+std::size_t remainingBytes(std::istream &in)
+{
+  std::istream::pos_type pos = in.tellg();
+  if (pos < 0)
+    return std::numeric_limits<std::size_t>::max();
+  in.seekg(0, std::ios::end);
+  std::istream::pos_type end = in.tellg();
+  in.seekg(pos);
+  if (end < 0 || !in.good())
+  {
+    in.clear();
+    in.seekg(pos);
+    return std::numeric_limits<std::size_t>::max();
+  }
+  return end > pos ? (std::size_t)(end - pos) : 0;
+}
+}
+
+struct ReachabilityMap::Samples
+{
+  const KinematicsMetrics *metrics_;
+  const robot_state::RobotState *reference_state_;
+  const robot_model::JointModelGroup *joint_model_group_;
+  bool translation_;
+  std::size_t count_;
+  unsigned int num_threads_;
+
+  // for grid samples: the number of values of each variable and their bounds; empty for random samples
+  unsigned int steps_;
+  std::vector<std::pair<double, double> > bounds_;
+
+  boost::mutex lock_;
+};
+
+ReachabilityMap::ReachabilityMap(double size_x, double size_y, double size_z, double resolution,
+                                 double origin_x, double origin_y, double origin_z) :
+  grid_(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, ReachabilityCell()),
+  sample_count_(0)
+{
+  grid_.reset(ReachabilityCell());
+}
+
+bool ReachabilityMap::addRandomSamples(const KinematicsMetrics &metrics,
+                                       const robot_state::RobotState &reference_state,
+                                       const robot_model::JointModelGroup *joint_model_group,
+                                       std::size_t sample_count,
+                                       unsigned int num_threads,
+                                       bool translation)
+{
+  if (!joint_model_group || joint_model_group->getLinkModels().empty())
+  {
+    logError("Cannot build a reachability map without a group with links");
+    return false;
+  }
+  Samples samples;
+  samples.metrics_ = &metrics;
+  samples.reference_state_ = &reference_state;
+  samples.joint_model_group_ = joint_model_group;
+  samples.translation_ = translation;
+  samples.count_ = sample_count;
+  samples.num_threads_ = std::max(1u, num_threads);
+  samples.steps_ = 0;
+
+  boost::thread_group threads;
+  for (unsigned int t = 1 ; t < samples.num_threads_ ; ++t)
+    threads.create_thread(boost::bind(&ReachabilityMap::addSamples, this, &samples, t));
+  addSamples(&samples, 0);
+  threads.join_all();
+
+  sample_count_ += sample_count;
+  updateSamplingTable();
+  return true;
+}
+
+bool ReachabilityMap::addGridSamples(const KinematicsMetrics &metrics,
+                                     const robot_state::RobotState &reference_state,
+                                     const robot_model::JointModelGroup *joint_model_group,
+                                     unsigned int steps_per_variable,
+                                     unsigned int num_threads,
+                                     bool translation)
+{
+  if (!joint_model_group || joint_model_group->getLinkModels().empty())
+  {
+    logError("Cannot build a reachability map without a group with links");
+    return false;
+  }
+  if (steps_per_variable == 0)
+    return true;
+
+  Samples samples;
+  const std::vector<const robot_model::JointModel*> &joints = joint_model_group->getJointModels();
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    const robot_model::JointModel::Bounds &bounds = joints[i]->getVariableBounds();
+    samples.bounds_.insert(samples.bounds_.end(), bounds.begin(), bounds.end());
+  }
+  double count = 1.0;
+  for (std::size_t i = 0 ; i < samples.bounds_.size() ; ++i)
+  {
+    if (samples.bounds_[i].first <= -std::numeric_limits<double>::max() || samples.bounds_[i].second >= std::numeric_limits<double>::max())
+    {
+      logError("Cannot sample group '%s' on a grid: it has unbounded variables", joint_model_group->getName().c_str());
+      return false;
+    }
+    count *= steps_per_variable;
+  }
+  if (count > (double)std::numeric_limits<std::size_t>::max())
+  {
+    logError("Too many grid samples for group '%s'", joint_model_group->getName().c_str());
+    return false;
+  }
+
+  samples.metrics_ = &metrics;
+  samples.reference_state_ = &reference_state;
+  samples.joint_model_group_ = joint_model_group;
+  samples.translation_ = translation;
+  samples.count_ = (std::size_t)count;
+  samples.num_threads_ = std::max(1u, num_threads);
+  samples.steps_ = steps_per_variable;
+
+  boost::thread_group threads;
+  for (unsigned int t = 1 ; t < samples.num_threads_ ; ++t)
+    threads.create_thread(boost::bind(&ReachabilityMap::addSamples, this, &samples, t));
+  addSamples(&samples, 0);
+  threads.join_all();
+
+  sample_count_ += samples.count_;
+  updateSamplingTable();
+  return true;
+}
+
+void ReachabilityMap::addSamples(Samples *samples, unsigned int thread_index)
+{
+  // each thread works on its own copy of the state, so the forward kinematics of the threads are independent
+  robot_state::RobotState state(*samples->reference_state_);
+  robot_state::JointStateGroup *joint_state_group = state.getJointStateGroup(samples->joint_model_group_->getName());
+  const robot_state::LinkState *tip = state.getLinkState(samples->joint_model_group_->getLinkModels().back());
+  KinematicsMetrics::ManipulabilityMetrics metrics;
+  std::vector<double> values(samples->bounds_.size());
+  SampleBatch batch;
+  batch.reserve(SAMPLE_BATCH_SIZE);
+
+  const std::size_t chunk = (samples->count_ + samples->num_threads_ - 1) / samples->num_threads_;
+  const std::size_t end = std::min(samples->count_, (thread_index + 1) * chunk);
+  for (std::size_t i = thread_index * chunk ; i < end ; ++i)
+  {
+    if (samples->steps_ > 0)
+    {
+      // decode the index of the grid state, one digit per variable
+      std::size_t index = i;
+      for (std::size_t j = 0 ; j < values.size() ; ++j)
+      {
+        const unsigned int step = index % samples->steps_;
+        index /= samples->steps_;
+        const std::pair<double, double> &bounds = samples->bounds_[j];
+        values[j] = samples->steps_ > 1 ? bounds.first + (bounds.second - bounds.first) * step / (samples->steps_ - 1) :
+          (bounds.first + bounds.second) / 2.0;
+      }
+      joint_state_group->setVariableValues(values);
+    }
+    else
+      joint_state_group->setToRandomValues();
+
+    const Eigen::Vector3d &position = tip->getGlobalLinkTransform().translation();
+    Eigen::Vector3i cell;
+    if (!grid_.worldToGrid(position.x(), position.y(), position.z(), cell.x(), cell.y(), cell.z()))
+      continue;
+    if (!samples->metrics_->getManipulabilityMetrics(state, samples->joint_model_group_, metrics, samples->translation_))
+      continue;
+    batch.push_back(std::make_pair(cell, (float)metrics.index));
+
+    if (batch.size() >= SAMPLE_BATCH_SIZE)
+    {
+      boost::mutex::scoped_lock slock(samples->lock_);
+      addBatch(grid_, batch);
+    }
+  }
+  if (!batch.empty())
+  {
+    boost::mutex::scoped_lock slock(samples->lock_);
+    addBatch(grid_, batch);
+  }
+}
+
+void ReachabilityMap::updateSamplingTable()
+{
+  sampling_weights_.clear();
+  sampling_cells_.clear();
+  const distance_field::VoxelGrid<ReachabilityCell> &grid = grid_;
+  double total = 0.0;
+  for (int x = 0 ; x < grid_.getNumCells(distance_field::DIM_X) ; ++x)
+    for (int y = 0 ; y < grid_.getNumCells(distance_field::DIM_Y) ; ++y)
+      for (int z = 0 ; z < grid_.getNumCells(distance_field::DIM_Z) ; ++z)
+      {
+        const ReachabilityCell &cell = grid.getCell(x, y, z);
+        if (cell.manipulability_sum_ <= 0.0f)
+          continue;
+        total += cell.manipulability_sum_;
+        sampling_weights_.push_back(total);
+        sampling_cells_.push_back(Eigen::Vector3i(x, y, z));
+      }
+}
+
+bool ReachabilityMap::samplePosition(random_numbers::RandomNumberGenerator &rng, Eigen::Vector3d &position) const
+{
+  if (sampling_weights_.empty())
+    return false;
+  const double r = rng.uniformReal(0.0, sampling_weights_.back());
+  std::size_t index = std::upper_bound(sampling_weights_.begin(), sampling_weights_.end(), r) - sampling_weights_.begin();
+  if (index >= sampling_cells_.size())
+    index = sampling_cells_.size() - 1;
+  const Eigen::Vector3i &cell = sampling_cells_[index];
+  return grid_.gridToWorld(cell.x(), cell.y(), cell.z(), position.x(), position.y(), position.z());
+}
+
+bool ReachabilityMap::writeBinaryToStream(std::ostream &stream) const
+{
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.version_ = BINARY_VERSION;
+  header.byte_order_ = BINARY_BYTE_ORDER;
+  header.resolution_ = grid_.getResolution();
+  header.size_[0] = grid_.getSize(distance_field::DIM_X);
+  header.size_[1] = grid_.getSize(distance_field::DIM_Y);
+  header.size_[2] = grid_.getSize(distance_field::DIM_Z);
+  header.origin_[0] = grid_.getOrigin(distance_field::DIM_X);
+  header.origin_[1] = grid_.getOrigin(distance_field::DIM_Y);
+  header.origin_[2] = grid_.getOrigin(distance_field::DIM_Z);
+  header.num_cells_[0] = grid_.getNumCells(distance_field::DIM_X);
+  header.num_cells_[1] = grid_.getNumCells(distance_field::DIM_Y);
+  header.num_cells_[2] = grid_.getNumCells(distance_field::DIM_Z);
+  header.sample_count_ = sample_count_;
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  const std::size_t n = (std::size_t)header.num_cells_[0] * header.num_cells_[1] * header.num_cells_[2];
+  std::vector<boost::uint32_t> counts(n);
+  std::vector<float> sums(n), maxima(n);
+  std::size_t i = 0;
+  for (int x = 0 ; x < header.num_cells_[0] ; ++x)
+    for (int y = 0 ; y < header.num_cells_[1] ; ++y)
+      for (int z = 0 ; z < header.num_cells_[2] ; ++z, ++i)
+      {
+        const ReachabilityCell &cell = grid_.getCell(x, y, z);
+        counts[i] = cell.sample_count_;
+        sums[i] = cell.manipulability_sum_;
+        maxima[i] = cell.max_manipulability_;
+      }
+  if (n > 0)
+  {
+    stream.write(reinterpret_cast<const char*>(&counts[0]), n * sizeof(boost::uint32_t));
+    stream.write(reinterpret_cast<const char*>(&sums[0]), n * sizeof(float));
+    stream.write(reinterpret_cast<const char*>(&maxima[0]), n * sizeof(float));
+  }
+  return stream.good();
+}
+
+bool ReachabilityMap::readBinaryFromStream(std::istream &stream)
+{
+  BinaryHeader header;
+  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!stream.good() || memcmp(header.magic_, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+  {
+    logError("The data is not a binary reachability map");
+    return false;
+  }
+  if (header.version_ != BINARY_VERSION || header.byte_order_ != BINARY_BYTE_ORDER)
+  {
+    logError("Unsupported binary reachability map (version %u)", header.version_);
+    return false;
+  }
+  if (!(header.resolution_ > 0.0) || !boost::math::isfinite(header.resolution_))
+  {
+    logError("Invalid resolution in binary reachability map");
+    return false;
+  }
+  for (int d = 0 ; d < 3 ; ++d)
+  {
+    // the number of cells is computed as the voxel grid does
+    const double cells = header.size_[d] * (1.0 / header.resolution_);
+    if (!(cells >= 0.0) || cells >= (double)std::numeric_limits<boost::int32_t>::max() || header.num_cells_[d] != (int)cells)
+    {
+      logError("Invalid number of cells in binary reachability map");
+      return false;
+    }
+  }
+
+  // every cell stores a count, a sum and a maximum; dimensions whose product overflows or needs more data than is
+  // left are rejected before anything is allocated for them
+  const std::size_t cell_bytes = sizeof(boost::uint32_t) + 2 * sizeof(float);
+  const std::size_t max_cells = remainingBytes(stream) / cell_bytes;
+  std::size_t n = 1;
+  for (int d = 0 ; d < 3 ; ++d)
+  {
+    if (header.num_cells_[d] != 0 && n > max_cells / (std::size_t)header.num_cells_[d])
+    {
+      logError("Truncated binary reachability map");
+      return false;
+    }
+    n *= (std::size_t)header.num_cells_[d];
+  }
+  std::vector<boost::uint32_t> counts;
+  std::vector<float> sums, maxima;
+  if (!readBinaryArray(stream, n, counts) || !readBinaryArray(stream, n, sums) || !readBinaryArray(stream, n, maxima))
+  {
+    logError("Truncated binary reachability map");
+    return false;
+  }
+
+  grid_.resize(header.size_[0], header.size_[1], header.size_[2], header.resolution_,
+               header.origin_[0], header.origin_[1], header.origin_[2], ReachabilityCell());
+  grid_.reset(ReachabilityCell());
+  if (grid_.getNumCells(distance_field::DIM_X) != header.num_cells_[0] ||
+      grid_.getNumCells(distance_field::DIM_Y) != header.num_cells_[1] ||
+      grid_.getNumCells(distance_field::DIM_Z) != header.num_cells_[2])
+  {
+    logError("Inconsistent grid size in binary reachability map");
+    return false;
+  }
+
+  std::size_t i = 0;
+  for (int x = 0 ; x < header.num_cells_[0] ; ++x)
+    for (int y = 0 ; y < header.num_cells_[1] ; ++y)
+      for (int z = 0 ; z < header.num_cells_[2] ; ++z, ++i)
+      {
+        ReachabilityCell &cell = grid_.getCell(x, y, z);
+        cell.sample_count_ = counts[i];
+        cell.manipulability_sum_ = sums[i];
+        cell.max_manipulability_ = maxima[i];
+      }
+  sample_count_ = header.sample_count_;
+  updateSamplingTable();
+  return true;
+}
+
+}
@@ -41,6 +41,9 @@
 #include <moveit/planning_scene/planning_scene.h>
 #include <moveit/planning_interface/planning_request.h>
 #include <moveit/planning_interface/planning_response.h>
+#include <ros/time.h>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <string>
 #include <map>
 
@@ -75,6 +78,9 @@ class PlanningContext
 {
 public:
 
+  /** \brief Callback for the solutions found while solve() runs; \e res holds the best solution so far as its last trajectory */
+  typedef boost::function<void(const MotionPlanDetailedResponse &res)> SolutionCallback;
+
   /** \brief Construct a planning context named \e name for the group \e group */
   PlanningContext(const std::string &name, const std::string &group);
 
@@ -104,11 +110,20 @@ public:
     return request_;
   }
 
-  /** \brief Set the planning scene for this context */
-  void setPlanningScene(const planning_scene::PlanningSceneConstPtr &planning_scene);
+  /** \brief Set the planning scene for this context. Derived classes that keep data computed for the scene should
+      override this and check whether that data is still valid. */
+  virtual void setPlanningScene(const planning_scene::PlanningSceneConstPtr &planning_scene);
 
   /** \brief Set the planning request for this context */
-  void setMotionPlanRequest(const MotionPlanRequest &request);
+  virtual void setMotionPlanRequest(const MotionPlanRequest &request);
+
+  /** \brief Return true if this context can be used for more than one request: after setPlanningScene(),
+      setMotionPlanRequest() and clear() are called with the new scene and request, solve() plans for them while reusing
+      what was set up for previous requests (state spaces, roadmaps, etc.). The default is false. */
+  virtual bool canBeReused() const
+  {
+    return false;
+  }
 
   /** \brief Solve the motion planning problem and store the result in \e res. This function should not clear data structures before computing. The constructor and clear() do that. */
   virtual bool solve(MotionPlanResponse &res) = 0;
@@ -119,7 +134,38 @@ public:
   /** \brief If solve() is running, terminate the computation. Return false if termination not possible. No-op if solve() is not running (returns true).*/
   virtual bool terminate() = 0;
 
-  /** \brief Clear the data structures used by the planner */
+  /** \brief Terminate the computation as terminate() does, and put the best solution reported so far (see getBestSolution())
+      in \e res. Returns false if there is no such solution. */
+  bool terminateWithBestSolution(MotionPlanResponse &res);
+
+  /** \brief Set a time by which solve() must return, regardless of the allowed planning time of the request. A default
+      constructed time (the default) means no deadline. */
+  void setDeadline(const ros::WallTime &deadline)
+  {
+    deadline_ = deadline;
+  }
+
+  const ros::WallTime& getDeadline() const
+  {
+    return deadline_;
+  }
+
+  /** \brief Get the time left for planning, in seconds: the allowed planning time of the request, limited by the deadline */
+  double getRemainingTime(const ros::WallTime &start) const;
+
+  /** \brief Set a function to be called each time a better solution is found while solve() runs. Only planners that report
+      intermediate solutions (anytime planners) call it. The callback runs in the planning thread and should return quickly. */
+  void setSolutionCallback(const SolutionCallback &callback)
+  {
+    solution_callback_ = callback;
+  }
+
+  /** \brief Get the best solution reported by the planner since the scene or request were last set. Returns false if
+      there is none. Can be called while solve() runs. */
+  bool getBestSolution(MotionPlanResponse &res) const;
+
+  /** \brief Clear the data structures used by the planner. Contexts that can be reused (see canBeReused()) should only
+      clear the data specific to the last request and keep what can be reused for the next one. */
   virtual void clear() = 0;
 
 protected:
@@ -135,6 +181,23 @@ protected:
 
   /// The planning request for this context
   MotionPlanRequest request_;
+
+  /** \brief Anytime planners call this for each solution they find, with its \e cost (lower is better). A solution that
+      is better than the best one so far replaces it and is passed to the solution callback. Returns true in that case. */
+  bool reportSolution(const robot_trajectory::RobotTrajectoryPtr &trajectory, double cost, const std::string &description = "");
+
+  /** \brief Forget the best solution reported so far */
+  void clearBestSolution();
+
+private:
+
+  ros::WallTime deadline_;
+  SolutionCallback solution_callback_;
+
+  mutable boost::mutex best_solution_lock_;
+  robot_trajectory::RobotTrajectoryPtr best_solution_;
+  double best_solution_cost_;
+  ros::WallTime best_solution_start_;
 };
 
 MOVEIT_CLASS_FORWARD(PlanningContext);
@@ -144,13 +207,9 @@ class PlannerManager
 {
 public:
 
-  PlannerManager()
-  {
-  }
+  PlannerManager();
 
-  virtual ~PlannerManager()
-  {
-  }
+  virtual ~PlannerManager();
 
   /// Initialize a planner. This function will be called after the construction of the plugin, before any other call is made.
   /// It is assumed that motion plans will be computed for the robot described by \e model and that any exposed ROS functionality
@@ -176,6 +235,21 @@ public:
   PlanningContextPtr getPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
                                         const MotionPlanRequest &req) const;
 
+  /// \brief Same as getPlanningContext(), but reuse contexts for which canBeReused() is true. Such contexts are kept in a pool,
+  /// per group and planner id, once constructed. A context that is not in use by a previous caller (the pointer
+  /// returned to that caller was released) is set up for the new scene and request and cleared, which keeps the data it
+  /// can reuse; otherwise a new context is constructed. The deadline and solution callback a caller set are reset when it
+  /// releases the context. Contexts that cannot be reused are returned as by getPlanningContext().
+  PlanningContextPtr getPooledPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                              const MotionPlanRequest &req,
+                                              moveit_msgs::MoveItErrorCodes &error_code) const;
+
+  /// \brief Set the maximum number of contexts pooled per group and planner id (default 4)
+  void setContextPoolSize(std::size_t size);
+
+  /// \brief Forget the pooled contexts; contexts in use are not returned to the pool
+  void clearContextPool();
+
   /// \brief Determine whether this plugin instance is able to represent this planning request
   virtual bool canServiceRequest(const MotionPlanRequest &req)  const = 0;
 
@@ -199,6 +273,11 @@ protected:
       particular configurations specified for a group, or of the
       form "group_name" if default settings are to be used. */
   PlannerConfigurationMap config_settings_;
+
+private:
+
+  struct ContextPool;
+  boost::shared_ptr<ContextPool> context_pool_;
 };
 
 MOVEIT_CLASS_FORWARD(PlannerManager);
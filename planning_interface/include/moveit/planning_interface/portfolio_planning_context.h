@@ -0,0 +1,139 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_PLANNING_INTERFACE_PORTFOLIO_PLANNING_CONTEXT_
+#define MOVEIT_PLANNING_INTERFACE_PORTFOLIO_PLANNING_CONTEXT_
+
+#include <moveit/planning_interface/planning_interface.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/cstdint.hpp>
+
+namespace planning_interface
+{
+
+/** \brief A planning context that runs several other planning contexts concurrently on the same problem and reports
+    the solution of one of them. Typically the contexts use different algorithms or configurations, so that the
+    one best suited to the problem at hand determines the planning time. */
+class PortfolioPlanningContext : public PlanningContext
+{
+public:
+
+  /** \brief How the reported solution is selected */
+  enum SelectionMode
+    {
+      /** \brief Report the first solution found and terminate the remaining contexts */
+      FIRST_SOLUTION,
+
+      /** \brief Let every context run to completion (each is bound by its own allowed planning time) and report the
+          solution with the shortest joint space path */
+      SHORTEST_SOLUTION
+    };
+
+  PortfolioPlanningContext(const std::string &name, const std::string &group, SelectionMode mode = FIRST_SOLUTION);
+
+  virtual ~PortfolioPlanningContext();
+
+  /** \brief Add a context to the portfolio. The context must already have its planning scene and request set. */
+  void addContext(const PlanningContextPtr &context);
+
+  const std::vector<PlanningContextPtr>& getContexts() const
+  {
+    return contexts_;
+  }
+
+  SelectionMode getSelectionMode() const
+  {
+    return mode_;
+  }
+
+  void setSelectionMode(SelectionMode mode)
+  {
+    mode_ = mode;
+  }
+
+  /** \brief The index (in getContexts()) of the context whose solution was reported by the last call to solve(), or -1 if
+      no context found a solution */
+  int getWinnerIndex() const
+  {
+    return winner_;
+  }
+
+  /** \brief The name of the context whose solution was reported by the last call to solve(), or an empty string if no
+      context found a solution */
+  std::string getWinnerName() const;
+
+  virtual bool solve(MotionPlanResponse &res);
+  virtual bool solve(MotionPlanDetailedResponse &res);
+
+  virtual bool terminate();
+  virtual void clear();
+
+private:
+
+  template<typename Response>
+  bool solvePortfolio(Response &res);
+
+  /* Run the context at \e index; \e request_id is the tracing request id of the thread that runs the portfolio */
+  template<typename Response>
+  void solveContext(std::size_t index, std::vector<Response> *results, boost::uint64_t request_id);
+
+  std::vector<PlanningContextPtr> contexts_;
+  SelectionMode mode_;
+  int winner_;
+
+  /* state shared by the threads of a solve() call, protected by lock_ */
+  boost::mutex lock_;
+  boost::condition_variable finished_condition_;
+  std::vector<bool> success_;
+  std::vector<bool> finished_;
+  bool done_;
+};
+
+MOVEIT_CLASS_FORWARD(PortfolioPlanningContext);
+
+/** \brief Construct a portfolio for \e req with one planning context per configuration of \e planner that applies to the
+    requested group (the configurations named "group" or "group[config]"). All contexts share a snapshot of
+    \e planning_scene, so the scene may keep changing while they run. If no configuration applies to the group, the
+    portfolio holds the single context \e planner builds for \e req. If no context can be constructed, \e error_code is set
+    and an empty pointer is returned. */
+PortfolioPlanningContextPtr getPortfolioPlanningContext(const PlannerManager &planner,
+                                                        const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                        const MotionPlanRequest &req,
+                                                        moveit_msgs::MoveItErrorCodes &error_code,
+                                                        PortfolioPlanningContext::SelectionMode mode = PortfolioPlanningContext::FIRST_SOLUTION);
+
+}
+
+#endif
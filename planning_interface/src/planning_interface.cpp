@@ -36,6 +36,8 @@
 
 #include <moveit/planning_interface/planning_interface.h>
 #include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include <limits>
 #include <set>
 
 namespace
@@ -56,7 +58,9 @@ static ActiveContexts& getActiveContexts()
 
 planning_interface::PlanningContext::PlanningContext(const std::string &name, const std::string &group) :
   name_(name),
-  group_(group)
+  group_(group),
+  best_solution_cost_(std::numeric_limits<double>::infinity()),
+  best_solution_start_(ros::WallTime::now())
 {
   ActiveContexts &ac = getActiveContexts();
   boost::mutex::scoped_lock _(ac.mutex_);
@@ -73,6 +77,7 @@ planning_interface::PlanningContext::~PlanningContext()
 void planning_interface::PlanningContext::setPlanningScene(const planning_scene::PlanningSceneConstPtr &planning_scene)
 {
   planning_scene_ = planning_scene;
+  clearBestSolution();
 }
 
 void planning_interface::PlanningContext::setMotionPlanRequest(const MotionPlanRequest &request)
@@ -86,6 +91,125 @@ void planning_interface::PlanningContext::setMotionPlanRequest(const MotionPlanR
   if (request_.num_planning_attempts < 0)
     logError("The number of desired planning attempts should be positive. Assuming one attempt.");
   request_.num_planning_attempts == std::max(1, request_.num_planning_attempts);
+  clearBestSolution();
+}
+
+double planning_interface::PlanningContext::getRemainingTime(const ros::WallTime &start) const
+{
+  double remaining = request_.allowed_planning_time - (ros::WallTime::now() - start).toSec();
+  if (!deadline_.isZero())
+    remaining = std::min(remaining, (deadline_ - ros::WallTime::now()).toSec());
+  return std::max(0.0, remaining);
+}
+
+bool planning_interface::PlanningContext::terminateWithBestSolution(MotionPlanResponse &res)
+{
+  if (!terminate())
+    logWarn("Unable to terminate planning context '%s'", name_.c_str());
+  return getBestSolution(res);
+}
+
+bool planning_interface::PlanningContext::getBestSolution(MotionPlanResponse &res) const
+{
+  boost::mutex::scoped_lock slock(best_solution_lock_);
+  if (!best_solution_)
+    return false;
+  res.trajectory_ = best_solution_;
+  res.planning_time_ = (ros::WallTime::now() - best_solution_start_).toSec();
+  res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  return true;
+}
+
+bool planning_interface::PlanningContext::reportSolution(const robot_trajectory::RobotTrajectoryPtr &trajectory, double cost, const std::string &description)
+{
+  MotionPlanDetailedResponse res;
+  {
+    boost::mutex::scoped_lock slock(best_solution_lock_);
+    if (best_solution_ && cost >= best_solution_cost_)
+      return false;
+    best_solution_ = trajectory;
+    best_solution_cost_ = cost;
+    if (!solution_callback_)
+      return true;
+    res.trajectory_.push_back(trajectory);
+    res.description_.push_back(description);
+    res.processing_time_.push_back((ros::WallTime::now() - best_solution_start_).toSec());
+    res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  }
+  solution_callback_(res);
+  return true;
+}
+
+void planning_interface::PlanningContext::clearBestSolution()
+{
+  boost::mutex::scoped_lock slock(best_solution_lock_);
+  best_solution_.reset();
+  best_solution_cost_ = std::numeric_limits<double>::infinity();
+  best_solution_start_ = ros::WallTime::now();
+}
+
+// contexts that can be reused, per group and planner id
+struct planning_interface::PlannerManager::ContextPool
+{
+  ContextPool() : max_size_(4)
+  {
+  }
+
+  struct Entry
+  {
+    PlanningContextPtr context_;
+    bool in_use_;
+  };
+
+  // the deleter of the pointers handed out; marks the context as no longer in use
+  struct Release
+  {
+    boost::weak_ptr<ContextPool> pool_;
+    std::pair<std::string, std::string> key_;
+    PlanningContextPtr context_;
+
+    void operator()(PlanningContext *)
+    {
+      // the next caller must not inherit an expired deadline, or a callback into this one
+      context_->setDeadline(ros::WallTime());
+      context_->setSolutionCallback(PlanningContext::SolutionCallback());
+
+      boost::shared_ptr<ContextPool> pool = pool_.lock();
+      if (!pool)
+        return;
+      boost::mutex::scoped_lock slock(pool->lock_);
+      std::vector<Entry> &entries = pool->entries_[key_];
+      for (std::size_t i = 0 ; i < entries.size() ; ++i)
+        if (entries[i].context_ == context_)
+        {
+          entries[i].in_use_ = false;
+          break;
+        }
+    }
+  };
+
+  PlanningContextPtr handOut(const boost::shared_ptr<ContextPool> &self, const std::pair<std::string, std::string> &key,
+                             const PlanningContextPtr &context)
+  {
+    Release release;
+    release.pool_ = self;
+    release.key_ = key;
+    release.context_ = context;
+    return PlanningContextPtr(context.get(), release);
+  }
+
+  boost::mutex lock_;
+  std::size_t max_size_;
+  std::map<std::pair<std::string, std::string>, std::vector<Entry> > entries_;
+};
+
+planning_interface::PlannerManager::PlannerManager() :
+  context_pool_(new ContextPool())
+{
+}
+
+planning_interface::PlannerManager::~PlannerManager()
+{
 }
 
 bool planning_interface::PlannerManager::initialize(const robot_model::RobotModelConstPtr &, const std::string &)
@@ -105,6 +229,64 @@ planning_interface::PlanningContextPtr planning_interface::PlannerManager::getPl
   return getPlanningContext(planning_scene, req, dummy);
 }
 
+planning_interface::PlanningContextPtr planning_interface::PlannerManager::getPooledPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                                                    const MotionPlanRequest &req,
+                                                                                                    moveit_msgs::MoveItErrorCodes &error_code) const
+{
+  std::pair<std::string, std::string> key(req.group_name, req.planner_id);
+  PlanningContextPtr context;
+  {
+    boost::mutex::scoped_lock slock(context_pool_->lock_);
+    std::vector<ContextPool::Entry> &entries = context_pool_->entries_[key];
+    for (std::size_t i = 0 ; i < entries.size() ; ++i)
+      if (!entries[i].in_use_)
+      {
+        entries[i].in_use_ = true;
+        context = entries[i].context_;
+        break;
+      }
+  }
+
+  if (context)
+  {
+    context->setPlanningScene(planning_scene);
+    context->setMotionPlanRequest(req);
+    context->clear();
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return context_pool_->handOut(context_pool_, key, context);
+  }
+
+  context = getPlanningContext(planning_scene, req, error_code);
+  if (!context || !context->canBeReused())
+    return context;
+
+  boost::mutex::scoped_lock slock(context_pool_->lock_);
+  std::vector<ContextPool::Entry> &entries = context_pool_->entries_[key];
+  if (entries.size() >= context_pool_->max_size_)
+    return context;
+  ContextPool::Entry entry;
+  entry.context_ = context;
+  entry.in_use_ = true;
+  entries.push_back(entry);
+  return context_pool_->handOut(context_pool_, key, context);
+}
+
+void planning_interface::PlannerManager::setContextPoolSize(std::size_t size)
+{
+  boost::mutex::scoped_lock slock(context_pool_->lock_);
+  context_pool_->max_size_ = size;
+  for (std::map<std::pair<std::string, std::string>, std::vector<ContextPool::Entry> >::iterator it = context_pool_->entries_.begin() ;
+       it != context_pool_->entries_.end() ; ++it)
+    if (it->second.size() > size)
+      it->second.resize(size);
+}
+
+void planning_interface::PlannerManager::clearContextPool()
+{
+  boost::mutex::scoped_lock slock(context_pool_->lock_);
+  context_pool_->entries_.clear();
+}
+
 void planning_interface::PlannerManager::getPlanningAlgorithms(std::vector<std::string> &algs) const
 {
   // nothing by default
@@ -0,0 +1,296 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/planning_interface/portfolio_planning_context.h>
+#include <moveit/profiler/tracing.h>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <ros/time.h>
+#include <algorithm>
+#include <limits>
+
+namespace planning_interface
+{
+
+namespace
+{
+
+const robot_trajectory::RobotTrajectoryPtr* getSolution(const MotionPlanResponse &res)
+{
+  return res.trajectory_ && !res.trajectory_->empty() ? &res.trajectory_ : NULL;
+}
+
+const robot_trajectory::RobotTrajectoryPtr* getSolution(const MotionPlanDetailedResponse &res)
+{
+  return !res.trajectory_.empty() && res.trajectory_.back() && !res.trajectory_.back()->empty() ? &res.trajectory_.back() : NULL;
+}
+
+void setPlanningTime(MotionPlanResponse &res, double time)
+{
+  res.planning_time_ = time;
+}
+
+void setPlanningTime(MotionPlanDetailedResponse &, double)
+{
+  // the detailed response keeps the processing times reported by the winning context
+}
+
+double getPathLength(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  double length = 0.0;
+  for (std::size_t i = 1 ; i < trajectory.getWayPointCount() ; ++i)
+    length += trajectory.getWayPoint(i - 1).distance(trajectory.getWayPoint(i));
+  return length;
+}
+
+}
+
+}
+
+planning_interface::PortfolioPlanningContext::PortfolioPlanningContext(const std::string &name, const std::string &group, SelectionMode mode) :
+  PlanningContext(name, group),
+  mode_(mode),
+  winner_(-1),
+  done_(false)
+{
+}
+
+planning_interface::PortfolioPlanningContext::~PortfolioPlanningContext()
+{
+}
+
+void planning_interface::PortfolioPlanningContext::addContext(const PlanningContextPtr &context)
+{
+  contexts_.push_back(context);
+}
+
+std::string planning_interface::PortfolioPlanningContext::getWinnerName() const
+{
+  return winner_ >= 0 ? contexts_[winner_]->getName() : std::string();
+}
+
+bool planning_interface::PortfolioPlanningContext::solve(MotionPlanResponse &res)
+{
+  return solvePortfolio(res);
+}
+
+bool planning_interface::PortfolioPlanningContext::solve(MotionPlanDetailedResponse &res)
+{
+  return solvePortfolio(res);
+}
+
+template<typename Response>
+void planning_interface::PortfolioPlanningContext::solveContext(std::size_t index, std::vector<Response> *results, boost::uint64_t request_id)
+{
+  MOVEIT_TRACE_REQUEST(request_id);
+  bool skip;
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    skip = done_;
+  }
+
+  // a solution may have been accepted before this context got to start
+  bool success;
+  {
+    MOVEIT_TRACE_SCOPE("PlanningContext::solve");
+    success = !skip && contexts_[index]->solve((*results)[index]) && getSolution((*results)[index]);
+  }
+
+  boost::mutex::scoped_lock slock(lock_);
+  success_[index] = success;
+  finished_[index] = true;
+  if (success && mode_ == FIRST_SOLUTION && !done_)
+  {
+    done_ = true;
+    winner_ = index;
+    for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+      if (!finished_[i])
+        contexts_[i]->terminate();
+  }
+  finished_condition_.notify_all();
+}
+
+template<typename Response>
+bool planning_interface::PortfolioPlanningContext::solvePortfolio(Response &res)
+{
+  ros::WallTime start = ros::WallTime::now();
+  winner_ = -1;
+  if (contexts_.empty())
+  {
+    logError("No planning contexts were added to portfolio '%s'", name_.c_str());
+    res.error_code_.val = moveit_msgs::MoveItErrorCodes::FAILURE;
+    return false;
+  }
+
+  // the portfolio deadline applies to each of its contexts
+  if (!getDeadline().isZero())
+    for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+      contexts_[i]->setDeadline(getDeadline());
+
+  std::vector<Response> results(contexts_.size());
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    success_.assign(contexts_.size(), false);
+    finished_.assign(contexts_.size(), false);
+    done_ = false;
+  }
+
+  // the calling thread runs the first context; the other threads trace their work as part of the same request
+  boost::uint64_t request_id = moveit::tools::Tracing::getThreadRequestId();
+  boost::thread_group threads;
+  for (std::size_t i = 1 ; i < contexts_.size() ; ++i)
+    threads.create_thread(boost::bind(&PortfolioPlanningContext::solveContext<Response>, this, i, &results, request_id));
+  solveContext(0, &results, request_id);
+
+  // a context that was just starting when the solution was accepted may have missed the termination request, so repeat it
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    while (std::find(finished_.begin(), finished_.end(), false) != finished_.end())
+    {
+      finished_condition_.timed_wait(slock, boost::posix_time::milliseconds(10));
+      if (done_)
+        for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+          if (!finished_[i])
+            contexts_[i]->terminate();
+    }
+  }
+  threads.join_all();
+
+  if (mode_ == SHORTEST_SOLUTION)
+  {
+    double best = std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+      if (success_[i])
+      {
+        double length = getPathLength(**getSolution(results[i]));
+        if (length < best)
+        {
+          best = length;
+          winner_ = i;
+        }
+      }
+  }
+
+  if (winner_ >= 0)
+  {
+    logDebug("Portfolio '%s' reports the solution of context '%s'", name_.c_str(), contexts_[winner_]->getName().c_str());
+    res = results[winner_];
+  }
+  else
+  {
+    // report the error of the first context that did run
+    res = results[0];
+    for (std::size_t i = 0 ; i < results.size() ; ++i)
+      if (results[i].error_code_.val != 0)
+      {
+        res = results[i];
+        break;
+      }
+    if (res.error_code_.val == moveit_msgs::MoveItErrorCodes::SUCCESS || res.error_code_.val == 0)
+      res.error_code_.val = moveit_msgs::MoveItErrorCodes::PLANNING_FAILED;
+  }
+  setPlanningTime(res, (ros::WallTime::now() - start).toSec());
+  return winner_ >= 0;
+}
+
+bool planning_interface::PortfolioPlanningContext::terminate()
+{
+  bool result = true;
+  boost::mutex::scoped_lock slock(lock_);
+  done_ = true;
+  for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+    if (!contexts_[i]->terminate())
+      result = false;
+  return result;
+}
+
+void planning_interface::PortfolioPlanningContext::clear()
+{
+  for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+    contexts_[i]->clear();
+  winner_ = -1;
+}
+
+planning_interface::PortfolioPlanningContextPtr planning_interface::getPortfolioPlanningContext(const PlannerManager &planner,
+                                                                                                const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                                                const MotionPlanRequest &req,
+                                                                                                moveit_msgs::MoveItErrorCodes &error_code,
+                                                                                                PortfolioPlanningContext::SelectionMode mode)
+{
+  // all contexts plan in the same scene, which must not change while they run
+  planning_scene::PlanningSceneConstPtr snapshot = planning_scene->getSnapshot();
+  PortfolioPlanningContextPtr portfolio(new PortfolioPlanningContext("portfolio", req.group_name, mode));
+  portfolio->setPlanningScene(snapshot);
+  portfolio->setMotionPlanRequest(req);
+
+  const std::string prefix = req.group_name + "[";
+  const PlannerConfigurationMap &configs = planner.getPlannerConfigurations();
+  std::vector<std::string> planner_ids;
+  for (PlannerConfigurationMap::const_iterator it = configs.begin() ; it != configs.end() ; ++it)
+    if (it->second.group == req.group_name || it->first == req.group_name)
+    {
+      if (it->first == req.group_name)
+        planner_ids.push_back("");
+      else
+        if (it->first.size() > prefix.size() + 1 && it->first.compare(0, prefix.size(), prefix) == 0 && it->first[it->first.size() - 1] == ']')
+          planner_ids.push_back(it->first.substr(prefix.size(), it->first.size() - prefix.size() - 1));
+    }
+  if (planner_ids.empty())
+    planner_ids.push_back(req.planner_id);
+
+  MotionPlanRequest context_req = req;
+  error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  for (std::size_t i = 0 ; i < planner_ids.size() ; ++i)
+  {
+    context_req.planner_id = planner_ids[i];
+    moveit_msgs::MoveItErrorCodes context_error_code;
+    PlanningContextPtr context = planner.getPlanningContext(snapshot, context_req, context_error_code);
+    if (context)
+      portfolio->addContext(context);
+    else
+    {
+      logWarn("Unable to construct planning context for planner '%s' in group '%s'", planner_ids[i].c_str(), req.group_name.c_str());
+      error_code = context_error_code;
+    }
+  }
+
+  if (portfolio->getContexts().empty())
+  {
+    if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
+      error_code.val = moveit_msgs::MoveItErrorCodes::FAILURE;
+    return PortfolioPlanningContextPtr();
+  }
+  error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  return portfolio;
+}
@@ -0,0 +1,162 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_interface/planning_interface.h>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+
+namespace
+{
+
+// a context that can be reused and reports one solution per solve() call
+class ReusableContext : public planning_interface::PlanningContext
+{
+public:
+
+  ReusableContext(const std::string &group) : planning_interface::PlanningContext("reusable", group)
+  {
+  }
+
+  virtual bool canBeReused() const
+  {
+    return true;
+  }
+
+  virtual bool solve(planning_interface::MotionPlanResponse &res)
+  {
+    reportSolution(robot_trajectory::RobotTrajectoryPtr(), 1.0);
+    return true;
+  }
+
+  virtual bool solve(planning_interface::MotionPlanDetailedResponse &res)
+  {
+    reportSolution(robot_trajectory::RobotTrajectoryPtr(), 1.0);
+    return true;
+  }
+
+  virtual bool terminate()
+  {
+    return true;
+  }
+
+  virtual void clear()
+  {
+  }
+};
+
+class ReusablePlannerManager : public planning_interface::PlannerManager
+{
+public:
+
+  virtual planning_interface::PlanningContextPtr getPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                    const planning_interface::MotionPlanRequest &req,
+                                                                    moveit_msgs::MoveItErrorCodes &error_code) const
+  {
+    planning_interface::PlanningContextPtr context(new ReusableContext(req.group_name));
+    context->setPlanningScene(planning_scene);
+    context->setMotionPlanRequest(req);
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return context;
+  }
+
+  virtual bool canServiceRequest(const planning_interface::MotionPlanRequest &req) const
+  {
+    return true;
+  }
+};
+
+void countSolutions(const boost::shared_ptr<int> &count, const planning_interface::MotionPlanDetailedResponse &)
+{
+  ++*count;
+}
+
+}
+
+TEST(PlanningContextPool, ReuseAfterDeadline)
+{
+  ReusablePlannerManager manager;
+  planning_interface::MotionPlanRequest req;
+  req.group_name = "arm";
+  req.allowed_planning_time = 5.0;
+  moveit_msgs::MoveItErrorCodes error_code;
+
+  planning_interface::PlanningContextPtr context = manager.getPooledPlanningContext(planning_scene::PlanningSceneConstPtr(), req, error_code);
+  ASSERT_TRUE(context);
+  const planning_interface::PlanningContext *pooled = context.get();
+  context->setDeadline(ros::WallTime::now() - ros::WallDuration(1.0));
+  EXPECT_EQ(0.0, context->getRemainingTime(ros::WallTime::now()));
+  context.reset();
+
+  // the same context is handed out again, without the deadline of the previous caller
+  context = manager.getPooledPlanningContext(planning_scene::PlanningSceneConstPtr(), req, error_code);
+  ASSERT_TRUE(context);
+  EXPECT_EQ(pooled, context.get());
+  EXPECT_TRUE(context->getDeadline().isZero());
+  EXPECT_GT(context->getRemainingTime(ros::WallTime::now()), 0.0);
+}
+
+TEST(PlanningContextPool, ReuseAfterSolutionCallback)
+{
+  ReusablePlannerManager manager;
+  planning_interface::MotionPlanRequest req;
+  req.group_name = "arm";
+  moveit_msgs::MoveItErrorCodes error_code;
+
+  boost::shared_ptr<int> count(new int(0));
+  boost::weak_ptr<int> weak_count = count;
+  planning_interface::PlanningContextPtr context = manager.getPooledPlanningContext(planning_scene::PlanningSceneConstPtr(), req, error_code);
+  ASSERT_TRUE(context);
+  const planning_interface::PlanningContext *pooled = context.get();
+  context->setSolutionCallback(boost::bind(&countSolutions, count, _1));
+  planning_interface::MotionPlanResponse res;
+  EXPECT_TRUE(context->solve(res));
+  EXPECT_EQ(1, *count);
+  context.reset();
+
+  // releasing the context drops the callback, and what it holds of the previous caller
+  count.reset();
+  EXPECT_TRUE(weak_count.expired());
+
+  context = manager.getPooledPlanningContext(planning_scene::PlanningSceneConstPtr(), req, error_code);
+  ASSERT_TRUE(context);
+  EXPECT_EQ(pooled, context.get());
+  EXPECT_TRUE(context->solve(res));
+  EXPECT_TRUE(context->terminateWithBestSolution(res));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_PLANNING_REQUEST_ADAPTER_PLAN_CACHE_ADAPTER_
+#define MOVEIT_PLANNING_REQUEST_ADAPTER_PLAN_CACHE_ADAPTER_
+
+#include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
+#include <list>
+
+namespace planning_request_adapter
+{
+
+/** \brief A planning request adapter that remembers the plans computed for previous requests. A request matches a
+    remembered plan if it is for the same group, its start state is the same up to the state resolution and the rest of
+    the request (constraints, attached bodies, etc.; the allowed planning time and number of attempts are not
+    considered) is the same. On a match the remembered plan is checked with PlanningScene::isPathValid() and, if still
+    valid in the current scene, returned without planning. The plan is not checked again while the scene does not change,
+    except for its first segment: the returned plan starts at the requested start state, so that state and the motion from
+    it to the second waypoint are checked on every match. To cache the final trajectories, this adapter should be the first in a chain. */
+class PlanCacheAdapter : public PlanningRequestAdapter
+{
+public:
+
+  /** \brief Keep up to \e max_entries plans; start states are compared by rounding each variable to \e state_resolution */
+  PlanCacheAdapter(std::size_t max_entries = 64, double state_resolution = 1e-3);
+
+  virtual std::string getDescription() const
+  {
+    return "Plan Cache";
+  }
+
+  /** \brief Set the number of plans to remember. Least recently used plans are forgotten first. */
+  void setCacheSize(std::size_t max_entries);
+
+  std::size_t getCacheSize() const
+  {
+    return cache_size_;
+  }
+
+  /** \brief Set the resolution at which start states are compared. This forgets all plans. */
+  void setStateResolution(double resolution);
+
+  double getStateResolution() const
+  {
+    return state_resolution_;
+  }
+
+  /** \brief Forget all plans */
+  void clearCache();
+
+  /** \brief The number of requests answered from the cache so far */
+  std::size_t getHitCount() const;
+
+  /** \brief The number of requests passed on to the planner so far */
+  std::size_t getMissCount() const;
+
+  virtual bool adaptAndPlan(const PlannerFn &planner,
+                            const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest &req,
+                            planning_interface::MotionPlanResponse &res,
+                            std::vector<std::size_t> &added_path_index) const;
+
+private:
+
+  /** \brief A plan and the request it was computed for */
+  struct CachedPlan
+  {
+    std::string                          group_name_;
+    std::vector<boost::int64_t>          start_state_; // the start state, rounded to the state resolution
+    std::vector<boost::uint8_t>          request_;     // the serialized request, without the start joint values
+    std::size_t                          change_stamp_; // the version of the scene the plan was last found valid in
+    robot_trajectory::RobotTrajectoryPtr trajectory_;
+    std::vector<std::size_t>             added_path_index_;
+  };
+
+  void computeKey(const robot_state::RobotState &start_state, const planning_interface::MotionPlanRequest &req, CachedPlan &key) const;
+
+  std::size_t                   cache_size_;
+  double                        state_resolution_;
+  mutable std::list<CachedPlan> cache_; // most recently used first
+  mutable std::size_t           hits_;
+  mutable std::size_t           misses_;
+  mutable boost::mutex          cache_lock_;
+};
+
+typedef boost::shared_ptr<PlanCacheAdapter> PlanCacheAdapterPtr;
+typedef boost::shared_ptr<const PlanCacheAdapter> PlanCacheAdapterConstPtr;
+
+}
+
+#endif
@@ -63,6 +63,25 @@ public:
   /// Get a short string that identifies the planning request adapter
   virtual std::string getDescription() const { return ""; }
 
+  /** \brief Return true if this adapter checks requests with validateRequest(). Such checks do not depend on the other
+      adapters, so PlanningRequestAdapterChain runs the checks of all its adapters concurrently, before any adapter is
+      called. The default is false. */
+  virtual bool hasRequestValidation() const
+  {
+    return false;
+  }
+
+  /** \brief Check whether \e req can be planned for in \e planning_scene (e.g., the start state is valid, the goal
+      constraints can be satisfied), without changing either. On failure, return false and set \e error_code. May be called
+      concurrently with the checks of other adapters. A check that throws rejects the request. The default implementation
+      accepts every request. */
+  virtual bool validateRequest(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                               const planning_interface::MotionPlanRequest &req,
+                               moveit_msgs::MoveItErrorCodes &error_code) const
+  {
+    return true;
+  }
+
   bool adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
                     const planning_scene::PlanningSceneConstPtr& planning_scene,
                     const planning_interface::MotionPlanRequest &req,
@@ -114,7 +133,29 @@ public:
                     planning_interface::MotionPlanResponse &res,
                     std::vector<std::size_t> &added_path_index) const;
 
+  /** \brief Same as above, but also record where the time went. For each adapter, in chain order, \e stages receives
+      the wall time spent in the adapter itself (excluding the adapters after it and the planner), followed by one entry
+      for the planner proper and a final entry for the whole chain. Each description names the stage and the number of
+      planning scene diffs and clones the stage created and, if query counting is on (see
+      PlanningScene::setQueryCountersEnabled()), the collision and kinematics queries the stage made. Only \e description_ and \e processing_time_ are filled
+      (\e error_code_ is copied from \e res). If an adapter checks requests (see
+      PlanningRequestAdapter::hasRequestValidation()), a first entry gives the time for running the checks. Since no per-stage trajectories are stored, the entries are not
+      included by MotionPlanDetailedResponse::getMessage(). */
+  bool adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                    const planning_scene::PlanningSceneConstPtr& planning_scene,
+                    const planning_interface::MotionPlanRequest &req,
+                    planning_interface::MotionPlanResponse &res,
+                    std::vector<std::size_t> &added_path_index,
+                    planning_interface::MotionPlanDetailedResponse &stages) const;
+
 private:
+
+  /* Run the request checks of the adapters concurrently; \e count is set to the number of checks */
+  bool validateRequest(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                       const planning_interface::MotionPlanRequest &req,
+                       moveit_msgs::MoveItErrorCodes &error_code,
+                       std::size_t &count) const;
+
   std::vector<PlanningRequestAdapterConstPtr> adapters_;
 };
 
@@ -0,0 +1,230 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/planning_request_adapter/plan_cache_adapter.h>
+#include <ros/serialization.h>
+#include <ros/time.h>
+#include <cmath>
+
+namespace planning_request_adapter
+{
+namespace
+{
+// deep copy, so that neither the caller nor the cache see changes made to the trajectory by the other
+robot_trajectory::RobotTrajectoryPtr copyTrajectory(const robot_trajectory::RobotTrajectory &trajectory, const robot_state::RobotState *first)
+{
+  robot_trajectory::RobotTrajectoryPtr result(new robot_trajectory::RobotTrajectory(trajectory.getRobotModel(), trajectory.getGroupName()));
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    result->addSuffixWayPoint(i == 0 && first ? *first : trajectory.getWayPoint(i), trajectory.getWayPointDurationFromPrevious(i));
+  return result;
+}
+
+// the largest distance (in meters) a link may move between the checked states of the first segment of a cached plan
+const double FIRST_SEGMENT_LINK_DISPLACEMENT = 0.01;
+
+// a cached plan is returned with its start replaced by the requested start state, for which it was never validated: check
+// that state and the states interpolated on the way to the next waypoint (a plan of one waypoint also has to reach the goal)
+bool isFirstSegmentValid(const planning_scene::PlanningScene &scene, const robot_trajectory::RobotTrajectory &trajectory,
+                         const planning_interface::MotionPlanRequest &req)
+{
+  robot_trajectory::RobotTrajectory segment(trajectory.getRobotModel(), trajectory.getGroupName());
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() && i < 2 ; ++i)
+    segment.addSuffixWayPoint(trajectory.getWayPoint(i), trajectory.getWayPointDurationFromPrevious(i));
+  planning_scene::PathValidationOptions options;
+  options.max_link_displacement = FIRST_SEGMENT_LINK_DISPLACEMENT;
+  return scene.isPathValid(segment, req.path_constraints,
+                           trajectory.getWayPointCount() == 1 ? req.goal_constraints : std::vector<moveit_msgs::Constraints>(),
+                           options, req.group_name);
+}
+}
+}
+
+planning_request_adapter::PlanCacheAdapter::PlanCacheAdapter(std::size_t max_entries, double state_resolution) :
+  cache_size_(max_entries),
+  state_resolution_(state_resolution),
+  hits_(0),
+  misses_(0)
+{
+}
+
+void planning_request_adapter::PlanCacheAdapter::setCacheSize(std::size_t max_entries)
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  cache_size_ = max_entries;
+  while (cache_.size() > cache_size_)
+    cache_.pop_back();
+}
+
+void planning_request_adapter::PlanCacheAdapter::setStateResolution(double resolution)
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  state_resolution_ = resolution;
+  cache_.clear();
+}
+
+void planning_request_adapter::PlanCacheAdapter::clearCache()
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  cache_.clear();
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::getHitCount() const
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  return hits_;
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::getMissCount() const
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  return misses_;
+}
+
+void planning_request_adapter::PlanCacheAdapter::computeKey(const robot_state::RobotState &start_state, const planning_interface::MotionPlanRequest &req,
+                                                            CachedPlan &key) const
+{
+  key.group_name_ = req.group_name;
+
+  std::vector<double> values;
+  start_state.getStateValues(values);
+  key.start_state_.resize(values.size());
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    key.start_state_[i] = (boost::int64_t)floor(values[i] / state_resolution_ + 0.5);
+
+  // the start joint values are compared after rounding; the time budget does not change which plans are valid
+  planning_interface::MotionPlanRequest request = req;
+  request.start_state.joint_state = sensor_msgs::JointState();
+  request.start_state.multi_dof_joint_state = sensor_msgs::MultiDOFJointState();
+  request.allowed_planning_time = 0.0;
+  request.num_planning_attempts = 0;
+  key.request_.resize(ros::serialization::serializationLength(request));
+  ros::serialization::OStream stream(&key.request_[0], key.request_.size());
+  ros::serialization::serialize(stream, request);
+}
+
+bool planning_request_adapter::PlanCacheAdapter::adaptAndPlan(const PlannerFn &planner,
+                                                              const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                              const planning_interface::MotionPlanRequest &req,
+                                                              planning_interface::MotionPlanResponse &res,
+                                                              std::vector<std::size_t> &added_path_index) const
+{
+  if (cache_size_ == 0)
+    return planner(planning_scene, req, res);
+
+  ros::WallTime start = ros::WallTime::now();
+  robot_state::RobotStatePtr start_state = planning_scene->getCurrentStateUpdated(req.start_state);
+  CachedPlan request;
+  {
+    boost::mutex::scoped_lock slock(cache_lock_);
+    computeKey(*start_state, req, request);
+  }
+
+  robot_trajectory::RobotTrajectoryPtr cached;
+  std::size_t cached_stamp = 0;
+  std::vector<std::size_t> cached_added_path_index;
+  {
+    boost::mutex::scoped_lock slock(cache_lock_);
+    for (std::list<CachedPlan>::iterator it = cache_.begin() ; it != cache_.end() ; ++it)
+      if (it->group_name_ == request.group_name_ && it->start_state_ == request.start_state_ && it->request_ == request.request_)
+      {
+        cache_.splice(cache_.begin(), cache_, it);
+        cached = cache_.front().trajectory_;
+        cached_stamp = cache_.front().change_stamp_;
+        cached_added_path_index = cache_.front().added_path_index_;
+        break;
+      }
+  }
+
+  if (cached)
+  {
+    // the cached plan starts within the state resolution of the requested start state; start exactly at the latter
+    robot_trajectory::RobotTrajectoryPtr trajectory = copyTrajectory(*cached, start_state.get());
+    std::size_t stamp = planning_scene->getChangeStamp();
+    // a plan that does not suit this start state may still suit its own, so it is only dropped if the rest of it is invalid
+    bool start_valid = isFirstSegmentValid(*planning_scene, *trajectory, req);
+    bool valid = start_valid &&
+      (stamp == cached_stamp || planning_scene->isPathValid(*trajectory, req.path_constraints, req.goal_constraints, req.group_name));
+
+    boost::mutex::scoped_lock slock(cache_lock_);
+    for (std::list<CachedPlan>::iterator it = cache_.begin() ; it != cache_.end() ; ++it)
+      if (it->trajectory_ == cached)
+      {
+        if (valid)
+          it->change_stamp_ = stamp;
+        else if (start_valid)
+          cache_.erase(it);
+        break;
+      }
+
+    if (valid)
+    {
+      hits_++;
+      res.trajectory_ = trajectory;
+      res.planning_time_ = (ros::WallTime::now() - start).toSec();
+      res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+      added_path_index = cached_added_path_index;
+      return true;
+    }
+    logDebug("The cached plan for this request is no longer valid. Planning again.");
+  }
+
+  {
+    boost::mutex::scoped_lock slock(cache_lock_);
+    misses_++;
+  }
+
+  bool result = planner(planning_scene, req, res);
+  if (result && res.trajectory_ && !res.trajectory_->empty())
+  {
+    request.change_stamp_ = planning_scene->getChangeStamp();
+    request.trajectory_ = copyTrajectory(*res.trajectory_, NULL);
+    request.added_path_index_ = added_path_index;
+
+    // concurrent identical requests may each have planned; keep the latest plan only
+    boost::mutex::scoped_lock slock(cache_lock_);
+    for (std::list<CachedPlan>::iterator it = cache_.begin() ; it != cache_.end() ; ++it)
+      if (it->group_name_ == request.group_name_ && it->start_state_ == request.start_state_ && it->request_ == request.request_)
+      {
+        cache_.erase(it);
+        break;
+      }
+    if (cache_size_ > 0)
+    {
+      cache_.push_front(request);
+      while (cache_.size() > cache_size_)
+        cache_.pop_back();
+    }
+  }
+  return result;
+}
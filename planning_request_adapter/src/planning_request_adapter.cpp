@@ -33,8 +33,12 @@
 *********************************************************************/
 
 #include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <moveit/profiler/tracing.h>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <ros/time.h>
 #include <algorithm>
+#include <sstream>
 
 // we could really use some c++11 lambda functions here :)
 
@@ -49,7 +53,10 @@ bool callPlannerInterfaceSolve(const planning_interface::PlannerManager *planner
 {
   planning_interface::PlanningContextPtr context = planner->getPlanningContext(planning_scene, req, res.error_code_);
   if (context)
+  {
+    MOVEIT_TRACE_SCOPE("PlanningContext::solve");
     return context->solve(res);
+  }
   else
     return false;
 }
@@ -80,6 +87,85 @@ namespace planning_request_adapter
 namespace
 {
 
+// inclusive wall time, scene copies and queries for each stage of the chain; the planner is the last stage
+struct StageRecord
+{
+  StageRecord(std::size_t count) : time_(count, 0.0), diffs_(count, 0), clones_(count, 0), queries_(count)
+  {
+  }
+
+  std::vector<double> time_;
+  std::vector<std::size_t> diffs_;
+  std::vector<std::size_t> clones_;
+  std::vector<moveit::tools::QueryCounts> queries_;
+};
+
+// adds the time, scene copies and queries spent in its scope to a stage; stages may run more than once (e.g., retries)
+class ScopedStage
+{
+public:
+  ScopedStage(StageRecord *record, std::size_t index) : record_(record), index_(index), start_(ros::WallTime::now()),
+                                                        queries_(planning_scene::PlanningScene::getThreadQueryCounts())
+  {
+    planning_scene::PlanningScene::getThreadSceneCopyCounts(diffs_, clones_);
+  }
+
+  ~ScopedStage()
+  {
+    std::size_t diffs, clones;
+    planning_scene::PlanningScene::getThreadSceneCopyCounts(diffs, clones);
+    record_->time_[index_] += (ros::WallTime::now() - start_).toSec();
+    record_->diffs_[index_] += diffs - diffs_;
+    record_->clones_[index_] += clones - clones_;
+    moveit::tools::QueryCounts queries = planning_scene::PlanningScene::getThreadQueryCounts();
+    queries -= queries_;
+    record_->queries_[index_] += queries;
+  }
+
+private:
+  StageRecord *record_;
+  std::size_t index_;
+  ros::WallTime start_;
+  std::size_t diffs_;
+  std::size_t clones_;
+  moveit::tools::QueryCounts queries_;
+};
+
+bool callRecordedPlannerSolve(const planning_interface::PlannerManager *planner,
+                              StageRecord *record,
+                              const planning_scene::PlanningSceneConstPtr& planning_scene,
+                              const planning_interface::MotionPlanRequest &req,
+                              planning_interface::MotionPlanResponse &res)
+{
+  ScopedStage stage(record, record->time_.size() - 1);
+  return callPlannerInterfaceSolve(planner, planning_scene, req, res);
+}
+
+void callValidateRequest(const PlanningRequestAdapter *adapter,
+                         const planning_scene::PlanningSceneConstPtr& planning_scene,
+                         const planning_interface::MotionPlanRequest &req,
+                         moveit_msgs::MoveItErrorCodes *error_code,
+                         char *valid)
+{
+  try
+  {
+    *valid = adapter->validateRequest(planning_scene, req, *error_code);
+  }
+  // a check that could not be completed does not let the request through
+  catch(std::runtime_error &ex)
+  {
+    logError("Exception caught validating the request with adapter '%s': %s", adapter->getDescription().c_str(), ex.what());
+    error_code->val = moveit_msgs::MoveItErrorCodes::FAILURE;
+    *valid = false;
+  }
+  catch(...)
+  {
+    logError("Exception caught validating the request with adapter '%s'", adapter->getDescription().c_str());
+    error_code->val = moveit_msgs::MoveItErrorCodes::FAILURE;
+    *valid = false;
+  }
+}
+
 // boost bind is not happy with overloading, so we add intermediate function objects
 
 bool callAdapter1(const PlanningRequestAdapter *adapter,
@@ -87,23 +173,27 @@ bool callAdapter1(const PlanningRequestAdapter *adapter,
                   const planning_scene::PlanningSceneConstPtr& planning_scene,
                   const planning_interface::MotionPlanRequest &req,
                   planning_interface::MotionPlanResponse &res,
-                  std::vector<std::size_t> &added_path_index)
+                  std::vector<std::size_t> &added_path_index,
+                  StageRecord *record,
+                  std::size_t index)
 {
+  ScopedStage stage(record, index);
+  PlanningRequestAdapter::PlannerFn fn = boost::bind(&callRecordedPlannerSolve, planner.get(), record, _1, _2, _3);
   try
   {
-    return adapter->adaptAndPlan(planner, planning_scene, req, res, added_path_index);
+    return adapter->adaptAndPlan(fn, planning_scene, req, res, added_path_index);
   }
   catch(std::runtime_error &ex)
   {
     logError("Exception caught executing adapter '%s': %s", adapter->getDescription().c_str(), ex.what());
     added_path_index.clear();
-    return callPlannerInterfaceSolve(planner.get(), planning_scene, req, res);
+    return fn(planning_scene, req, res);
   }
   catch(...)
   {
     logError("Exception caught executing adapter '%s'", adapter->getDescription().c_str());
     added_path_index.clear();
-    return callPlannerInterfaceSolve(planner.get(), planning_scene, req, res);
+    return fn(planning_scene, req, res);
   }
 }
 
@@ -112,8 +202,11 @@ bool callAdapter2(const PlanningRequestAdapter *adapter,
                   const planning_scene::PlanningSceneConstPtr& planning_scene,
                   const planning_interface::MotionPlanRequest &req,
                   planning_interface::MotionPlanResponse &res,
-                  std::vector<std::size_t> &added_path_index)
+                  std::vector<std::size_t> &added_path_index,
+                  StageRecord *record,
+                  std::size_t index)
 {
+  ScopedStage stage(record, index);
   try
   {
     return adapter->adaptAndPlan(planner, planning_scene, req, res, added_path_index);
@@ -151,11 +244,46 @@ bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const p
                                                                          planning_interface::MotionPlanResponse &res,
                                                                          std::vector<std::size_t> &added_path_index) const
 {
+  planning_interface::MotionPlanDetailedResponse stages;
+  bool result = adaptAndPlan(planner, planning_scene, req, res, added_path_index, stages);
+  if (!stages.processing_time_.empty())
+  {
+    std::stringstream ss;
+    for (std::size_t i = 0 ; i < stages.processing_time_.size() ; ++i)
+      ss << "  " << stages.description_[i] << ": " << stages.processing_time_[i] << "s" << std::endl;
+    logDebug("Planning request adapter chain timing:\n%s", ss.str().c_str());
+  }
+  return result;
+}
+
+bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                                                                         const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                         const planning_interface::MotionPlanRequest &req,
+                                                                         planning_interface::MotionPlanResponse &res,
+                                                                         std::vector<std::size_t> &added_path_index,
+                                                                         planning_interface::MotionPlanDetailedResponse &stages) const
+{
+  // a new request, unless the caller already traces one
+  MOVEIT_TRACE_REQUEST(0);
+  MOVEIT_TRACE_SCOPE("PlanningRequestAdapterChain::adaptAndPlan");
+  ros::WallTime start = ros::WallTime::now();
+  StageRecord record(adapters_.size() + 1);
+  bool result;
+
+  std::size_t validation_count;
+  bool valid = validateRequest(planning_scene, req, res.error_code_, validation_count);
+  double validation_time = (ros::WallTime::now() - start).toSec();
+
+  if (!valid)
+  {
+    added_path_index.clear();
+    result = false;
+  }
   // if there are no adapters, run the planner directly
-  if (adapters_.empty())
+  else if (adapters_.empty())
   {
     added_path_index.clear();
-    return callPlannerInterfaceSolve(planner.get(), planning_scene, req, res);
+    result = callRecordedPlannerSolve(planner.get(), &record, planning_scene, req, res);
   }
   else
   {
@@ -164,10 +292,11 @@ bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const p
 
     // if there are adapters, construct a function pointer for each, in order,
     // so that in the end we have a nested sequence of function pointers that call the adapters in the correct order.
-    PlanningRequestAdapter::PlannerFn fn = boost::bind(&callAdapter1, adapters_.back().get(), planner, _1, _2, _3, boost::ref(added_path_index_each.back()));
+    PlanningRequestAdapter::PlannerFn fn = boost::bind(&callAdapter1, adapters_.back().get(), planner, _1, _2, _3, boost::ref(added_path_index_each.back()),
+                                                       &record, adapters_.size() - 1);
     for (int i = adapters_.size() - 2 ; i >= 0 ; --i)
-      fn = boost::bind(&callAdapter2, adapters_[i].get(), fn, _1, _2, _3, boost::ref(added_path_index_each[i]));
-    bool result = fn(planning_scene, req, res);
+      fn = boost::bind(&callAdapter2, adapters_[i].get(), fn, _1, _2, _3, boost::ref(added_path_index_each[i]), &record, (std::size_t)i);
+    result = fn(planning_scene, req, res);
     added_path_index.clear();
 
     // merge the index values from each adapter
@@ -180,6 +309,83 @@ bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const p
         added_path_index.push_back(added_path_index_each[i][j]);
       }
     std::sort(added_path_index.begin(), added_path_index.end());
-    return result;
   }
+
+  // the recorded values are inclusive of the stages nested inside; subtract the next stage to get each adapter's share
+  stages.trajectory_.clear();
+  stages.description_.clear();
+  stages.processing_time_.clear();
+  stages.error_code_ = res.error_code_;
+  if (validation_count > 0)
+  {
+    std::stringstream ss;
+    ss << "request validation (" << validation_count << " checks)";
+    stages.description_.push_back(ss.str());
+    stages.processing_time_.push_back(validation_time);
+  }
+  for (std::size_t i = 0 ; i < record.time_.size() ; ++i)
+  {
+    double time = record.time_[i];
+    std::size_t diffs = record.diffs_[i];
+    std::size_t clones = record.clones_[i];
+    moveit::tools::QueryCounts queries = record.queries_[i];
+    if (i + 1 < record.time_.size())
+    {
+      time = std::max(0.0, time - record.time_[i + 1]);
+      diffs -= std::min(diffs, record.diffs_[i + 1]);
+      clones -= std::min(clones, record.clones_[i + 1]);
+      queries -= record.queries_[i + 1];
+    }
+    std::stringstream ss;
+    if (i < adapters_.size())
+      ss << "adapter '" << adapters_[i]->getDescription() << "'";
+    else
+      ss << "planner";
+    ss << " (" << diffs << " scene diffs, " << clones << " scene clones";
+    // only counted when the query counters are on (see PlanningScene::setQueryCountersEnabled())
+    if (!queries.empty())
+      ss << ", " << queries.toString();
+    ss << ")";
+    stages.description_.push_back(ss.str());
+    stages.processing_time_.push_back(time);
+  }
+  stages.description_.push_back("total");
+  stages.processing_time_.push_back((ros::WallTime::now() - start).toSec());
+
+  return result;
+}
+
+bool planning_request_adapter::PlanningRequestAdapterChain::validateRequest(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                            const planning_interface::MotionPlanRequest &req,
+                                                                            moveit_msgs::MoveItErrorCodes &error_code,
+                                                                            std::size_t &count) const
+{
+  std::vector<const PlanningRequestAdapter*> validators;
+  for (std::size_t i = 0 ; i < adapters_.size() ; ++i)
+    if (adapters_[i]->hasRequestValidation())
+      validators.push_back(adapters_[i].get());
+  count = validators.size();
+  if (validators.empty())
+    return true;
+
+  // the calling thread runs the first check
+  std::vector<moveit_msgs::MoveItErrorCodes> error_codes(validators.size());
+  std::vector<char> valid(validators.size(), true);
+  boost::thread_group threads;
+  for (std::size_t i = 1 ; i < validators.size() ; ++i)
+    threads.create_thread(boost::bind(&callValidateRequest, validators[i], boost::cref(planning_scene), boost::cref(req), &error_codes[i], &valid[i]));
+  callValidateRequest(validators[0], planning_scene, req, &error_codes[0], &valid[0]);
+  threads.join_all();
+
+  // report the first failed check, in chain order
+  for (std::size_t i = 0 ; i < validators.size() ; ++i)
+    if (!valid[i])
+    {
+      logDebug("Request rejected by adapter '%s'", validators[i]->getDescription().c_str());
+      error_code = error_codes[i];
+      if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS || error_code.val == 0)
+        error_code.val = moveit_msgs::MoveItErrorCodes::FAILURE;
+      return false;
+    }
+  return true;
 }
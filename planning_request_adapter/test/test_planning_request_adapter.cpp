@@ -0,0 +1,217 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace
+{
+
+// a context that counts the calls to solve() and always succeeds
+class CountingContext : public planning_interface::PlanningContext
+{
+public:
+
+  CountingContext(const std::string &group, int *solve_count) :
+    planning_interface::PlanningContext("counting", group), solve_count_(solve_count)
+  {
+  }
+
+  virtual bool solve(planning_interface::MotionPlanResponse &res)
+  {
+    ++*solve_count_;
+    res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
+  }
+
+  virtual bool solve(planning_interface::MotionPlanDetailedResponse &res)
+  {
+    ++*solve_count_;
+    res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
+  }
+
+  virtual bool terminate()
+  {
+    return true;
+  }
+
+  virtual void clear()
+  {
+  }
+
+private:
+
+  int *solve_count_;
+};
+
+class CountingPlannerManager : public planning_interface::PlannerManager
+{
+public:
+
+  CountingPlannerManager() : solve_count_(0)
+  {
+  }
+
+  virtual planning_interface::PlanningContextPtr getPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                    const planning_interface::MotionPlanRequest &req,
+                                                                    moveit_msgs::MoveItErrorCodes &error_code) const
+  {
+    planning_interface::PlanningContextPtr context(new CountingContext(req.group_name, &solve_count_));
+    context->setPlanningScene(planning_scene);
+    context->setMotionPlanRequest(req);
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return context;
+  }
+
+  virtual bool canServiceRequest(const planning_interface::MotionPlanRequest &req) const
+  {
+    return true;
+  }
+
+  mutable int solve_count_;
+};
+
+// an adapter that only checks requests; the check either accepts, rejects or throws
+class CheckingAdapter : public planning_request_adapter::PlanningRequestAdapter
+{
+public:
+
+  enum Outcome
+  {
+    ACCEPT, REJECT, THROW
+  };
+
+  CheckingAdapter(Outcome outcome) : outcome_(outcome)
+  {
+  }
+
+  virtual std::string getDescription() const
+  {
+    return outcome_ == ACCEPT ? "accepting" : outcome_ == REJECT ? "rejecting" : "throwing";
+  }
+
+  virtual bool hasRequestValidation() const
+  {
+    return true;
+  }
+
+  virtual bool validateRequest(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                               const planning_interface::MotionPlanRequest &req,
+                               moveit_msgs::MoveItErrorCodes &error_code) const
+  {
+    if (outcome_ == THROW)
+      throw std::runtime_error("the check failed");
+    if (outcome_ == REJECT)
+    {
+      error_code.val = moveit_msgs::MoveItErrorCodes::INVALID_GOAL_CONSTRAINTS;
+      return false;
+    }
+    return true;
+  }
+
+  virtual bool adaptAndPlan(const PlannerFn &planner,
+                            const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest &req,
+                            planning_interface::MotionPlanResponse &res,
+                            std::vector<std::size_t> &added_path_index) const
+  {
+    return planner(planning_scene, req, res);
+  }
+
+private:
+
+  Outcome outcome_;
+};
+
+bool planWithChain(const std::vector<CheckingAdapter::Outcome> &outcomes, int &solve_count, moveit_msgs::MoveItErrorCodes &error_code)
+{
+  planning_request_adapter::PlanningRequestAdapterChain chain;
+  for (std::size_t i = 0 ; i < outcomes.size() ; ++i)
+    chain.addAdapter(planning_request_adapter::PlanningRequestAdapterConstPtr(new CheckingAdapter(outcomes[i])));
+  boost::shared_ptr<CountingPlannerManager> planner(new CountingPlannerManager());
+  planning_interface::MotionPlanRequest req;
+  req.group_name = "arm";
+  planning_interface::MotionPlanResponse res;
+  bool result = chain.adaptAndPlan(planner, planning_scene::PlanningSceneConstPtr(), req, res);
+  solve_count = planner->solve_count_;
+  error_code = res.error_code_;
+  return result;
+}
+
+}
+
+TEST(PlanningRequestAdapterChain, ParallelValidation)
+{
+  std::vector<CheckingAdapter::Outcome> outcomes(3, CheckingAdapter::ACCEPT);
+  int solve_count = 0;
+  moveit_msgs::MoveItErrorCodes error_code;
+  EXPECT_TRUE(planWithChain(outcomes, solve_count, error_code));
+  EXPECT_EQ(1, solve_count);
+
+  // the first failed check, in chain order, is reported; the planner is not called
+  outcomes[1] = CheckingAdapter::REJECT;
+  outcomes[2] = CheckingAdapter::THROW;
+  EXPECT_FALSE(planWithChain(outcomes, solve_count, error_code));
+  EXPECT_EQ(0, solve_count);
+  EXPECT_EQ(moveit_msgs::MoveItErrorCodes::INVALID_GOAL_CONSTRAINTS, error_code.val);
+
+  outcomes[1] = CheckingAdapter::THROW;
+  outcomes[2] = CheckingAdapter::REJECT;
+  EXPECT_FALSE(planWithChain(outcomes, solve_count, error_code));
+  EXPECT_EQ(0, solve_count);
+  EXPECT_EQ(moveit_msgs::MoveItErrorCodes::FAILURE, error_code.val);
+}
+
+TEST(PlanningRequestAdapterChain, ThrowingValidationRejects)
+{
+  // the calling thread runs the first check, the other threads the rest; an exception rejects the request either way
+  for (std::size_t i = 0 ; i < 2 ; ++i)
+  {
+    std::vector<CheckingAdapter::Outcome> outcomes(2, CheckingAdapter::ACCEPT);
+    outcomes[i] = CheckingAdapter::THROW;
+    int solve_count = 0;
+    moveit_msgs::MoveItErrorCodes error_code;
+    EXPECT_FALSE(planWithChain(outcomes, solve_count, error_code));
+    EXPECT_EQ(0, solve_count);
+    EXPECT_EQ(moveit_msgs::MoveItErrorCodes::FAILURE, error_code.val);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -39,6 +39,7 @@
 
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/state_result_cache.h>
 #include <moveit/transforms/transforms.h>
 #include <moveit/collision_detection/collision_detector_allocator.h>
 #include <moveit/collision_detection/world_diff.h>
@@ -46,15 +47,25 @@
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
 #include <moveit/macros/deprecation.h>
+#include <moveit/profiler/query_counters.h>
 #include <moveit_msgs/PlanningScene.h>
 #include <moveit_msgs/RobotTrajectory.h>
 #include <moveit_msgs/Constraints.h>
 #include <moveit_msgs/PlanningSceneComponents.h>
+#include <octomap/OcTreeKey.h>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/concept_check.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace distance_field
+{
+class DistanceField;
+class WorldDistanceField;
+}
 
 /** \brief This namespace includes the central class for representing planning contexts */
 namespace planning_scene
@@ -79,6 +90,60 @@ typedef std::map<std::string, std_msgs::ColorRGBA> ObjectColorMap;
 /** \brief A map from object names (e.g., attached bodies, collision objects) to their types */
 typedef std::map<std::string, object_recognition_msgs::ObjectType> ObjectTypeMap;
 
+/** \brief Options for how PlanningScene::isPathValid() checks the states of a path */
+struct PathValidationOptions
+{
+  PathValidationOptions() : num_threads(1), bisection_order(true), max_link_displacement(0.0)
+  {
+  }
+
+  /** \brief The number of threads the state checks are distributed over; with 1, all checks are done by the calling thread.
+      When more threads are used, the state feasibility function of the scene must be safe to call concurrently. */
+  unsigned int num_threads;
+
+  /** \brief Check the states in bisection order (the endpoints first, then the midpoints of ever smaller intervals) rather
+      than in sequence, so invalid states are found sooner on average */
+  bool bisection_order;
+
+  /** \brief If positive, states are interpolated between consecutive waypoints so that no link is estimated to move
+      more than this distance (in meters) from one checked state to the next. The waypoints alone are checked otherwise. */
+  double max_link_displacement;
+};
+
+/** \brief Estimates of the memory held by a planning scene, in bytes (see PlanningScene::getMemoryUsage()) */
+struct PlanningSceneMemoryUsage
+{
+  PlanningSceneMemoryUsage() : world_objects_(0), octrees_(0), collision_detectors_(0), state_(0), diffs_(0), caches_(0), distance_field_(0)
+  {
+  }
+
+  /** \brief The world objects without octrees, including their shapes (e.g., the vertices and triangles of meshes) */
+  std::size_t world_objects_;
+
+  /** \brief The world objects with octrees, including the nodes of the octrees */
+  std::size_t octrees_;
+
+  /** \brief The collision worlds and robots of the collision detectors (FCL objects, BVHs and broad-phase structures) */
+  std::size_t collision_detectors_;
+
+  /** \brief The current state of the robot, including its attached bodies */
+  std::size_t state_;
+
+  /** \brief The record of the changes to the world, for diff scenes */
+  std::size_t diffs_;
+
+  /** \brief The collision check cache and the collision object messages kept for getPlanningSceneMsg() */
+  std::size_t caches_;
+
+  /** \brief The distance field maintained for the world (see PlanningScene::setDistanceField()) */
+  std::size_t distance_field_;
+
+  std::size_t total() const
+  {
+    return world_objects_ + octrees_ + collision_detectors_ + state_ + diffs_ + caches_ + distance_field_;
+  }
+};
+
 /** \brief This class maintains the representation of the
     environment as seen by a planning instance. The environment
     geometry, the robot geometry and state are maintained. */
@@ -181,6 +246,23 @@ public:
    * has the diffs specified by \e msg applied. */
   PlanningScenePtr diff(const moveit_msgs::PlanningScene &msg) const;
 
+  /** \brief Get an immutable copy of this scene, as returned by clone(), that does not change when this scene does.
+   *
+   *  The copy is made once and handed out to all callers until this scene (or, for a diff scene, its parent) is
+   *  changed, so concurrent planning requests can each get a consistent scene cheaply. Like clone(), the copy
+   *  shares the world objects and the collision data structures built for them with this scene.
+   *  Changes are noticed when made through the functions of this class or to the world; a change made through a
+   *  reference returned by a get*NonConst function earlier is only noticed once a get*NonConst function is called again.
+   *  As with diff(), the scene must not be modified while this function is running.
+   */
+  PlanningSceneConstPtr getSnapshot() const;
+
+  /** \brief Get a value that identifies the current version of this scene and its parents, for keeping data computed
+   *  from the scene. It changes whenever this scene or one of its parents changes, as noticed by getSnapshot(), and
+   *  different scenes have different values.
+   */
+  std::size_t getChangeStamp() const;
+
   /** \brief Get the parent scene (whith respect to which the diffs are maintained). This may be empty */
   const PlanningSceneConstPtr& getParent() const
   {
@@ -191,7 +273,7 @@ public:
   const std::string& getPlanningFrame() const
   {
     // if we have an updated set of transforms, return it; otherwise, return the parent one
-    return ftf_ ? ftf_->getTargetFrame() : parent_->getPlanningFrame();
+    return ftf_ ? ftf_->getTargetFrame() : data_parent_->getPlanningFrame();
   }
 
   /** \brief Get the kinematic model for which the planning scene is maintained */
@@ -205,7 +287,7 @@ public:
   const robot_state::RobotState& getCurrentState() const
   {
     // if we have an updated state, return it; otherwise, return the parent one
-    return kstate_ ? *kstate_ : parent_->getCurrentState();
+    return kstate_ ? *kstate_ : data_parent_->getCurrentState();
   }
   /** \brief Get the state at which the robot is assumed to be. */
   robot_state::RobotState& getCurrentStateNonConst();
@@ -216,7 +298,7 @@ public:
   /** \brief Get the allowed collision matrix */
   const collision_detection::AllowedCollisionMatrix& getAllowedCollisionMatrix() const
   {
-    return acm_ ? *acm_ : parent_->getAllowedCollisionMatrix();
+    return acm_ ? *acm_ : data_parent_->getAllowedCollisionMatrix();
   }
   /** \brief Get the allowed collision matrix */
   collision_detection::AllowedCollisionMatrix& getAllowedCollisionMatrixNonConst();
@@ -225,18 +307,18 @@ public:
   const robot_state::Transforms& getTransforms() const
   {
     // if we have updated transforms, return those
-    return (ftf_ || !parent_) ? *ftf_ : parent_->getTransforms();
+    return (ftf_ || !parent_) ? *ftf_ : data_parent_->getTransforms();
   }
   /** \brief Get the set of fixed transforms from known frames to the planning frame */
   robot_state::Transforms& getTransformsNonConst();
 
   /** \brief Get the transform corresponding to the frame \e id. This will be known if \e id is a link name, an attached body id or a collision object.
       Return identity when no transform is available. Use knowsFrameTransform() to test if this function will be successful or not. */
-  const Eigen::Affine3d& getFrameTransform(const std::string &id) const;
+  Eigen::Affine3d getFrameTransform(const std::string &id) const;
 
   /** \brief Get the transform corresponding to the frame \e id. This will be known if \e id is a link name, an attached body id or a collision object.
       Return identity when no transform is available. Use knowsFrameTransform() to test if this function will be successful or not. */
-  const Eigen::Affine3d& getFrameTransform(const robot_state::RobotState &state, const std::string &id) const;
+  Eigen::Affine3d getFrameTransform(const robot_state::RobotState &state, const std::string &id) const;
 
   /** \brief Check if a transform to the frame \e id is known. This will be known if \e id is a link name, an attached body id or a collision object */
   bool knowsFrameTransform(const std::string &id) const;
@@ -372,12 +454,45 @@ public:
   /** \brief The distance between the robot model at state \e kstate to the nearest collision, ignoring distances between elements that always allowed to collide, if the robot has no padding. */
   double distanceToCollisionUnpadded(const robot_state::RobotState &kstate, const collision_detection::AllowedCollisionMatrix& acm) const;
 
+  /** \brief Compare the distance between the robot model at state \e kstate and the nearest collision to \e max_distance. If nothing is closer
+      than \e max_distance, \e max_distance is returned; otherwise a distance smaller than \e max_distance is returned, which is not necessarily
+      the distance to the nearest collision. This is much cheaper than computing the exact distance when only a safety margin
+      needs to be checked. */
+  double distanceToCollision(const robot_state::RobotState &kstate, double max_distance) const;
+
+  /** \brief Compare the distance between the robot model at state \e kstate and the nearest collision to \e max_distance (see above), if the robot has no padding */
+  double distanceToCollisionUnpadded(const robot_state::RobotState &kstate, double max_distance) const;
+
+  /** \brief Compare the distance between the robot model at state \e kstate and the nearest collision to \e max_distance (see above), ignoring distances between elements that always allowed to collide. */
+  double distanceToCollision(const robot_state::RobotState &kstate, const collision_detection::AllowedCollisionMatrix& acm, double max_distance) const;
+
+  /** \brief Compare the distance between the robot model at state \e kstate and the nearest collision to \e max_distance (see above), ignoring distances between elements that always allowed to collide, if the robot has no padding. */
+  double distanceToCollisionUnpadded(const robot_state::RobotState &kstate, const collision_detection::AllowedCollisionMatrix& acm, double max_distance) const;
+
   /** \brief Save the geometry of the planning scene to a stream, as plain text */
   void saveGeometryToStream(std::ostream &out) const;
 
   /** \brief Load the geometry of the planning scene from a stream */
   void loadGeometryFromStream(std::istream &in);
 
+  /** \brief Save the geometry of the planning scene to a stream, in a versioned binary format (in the byte order of this
+      machine). Mesh vertices and triangles are stored as contiguous arrays, so they load without parsing. Octrees are not saved. */
+  void saveGeometryToBinaryStream(std::ostream &out) const;
+
+  /** \brief Load the geometry of the planning scene from the \e size bytes at \e data, in the format written by
+      saveGeometryToBinaryStream(). Return false if the data is not in that format or is truncated. */
+  bool loadGeometryFromBinaryData(const char *data, std::size_t size);
+
+  /** \brief Load the geometry of the planning scene from a stream in the format written by saveGeometryToBinaryStream() */
+  bool loadGeometryFromBinaryStream(std::istream &in);
+
+  /** \brief Load the geometry of the planning scene from a file in the format written by saveGeometryToBinaryStream().
+      The file is memory-mapped, so mesh data is copied from the mapping straight into the meshes. */
+  bool loadGeometryFromBinaryFile(const std::string &path);
+
+  /** \brief Convert scene geometry saved by saveGeometryToStream() to the format of saveGeometryToBinaryStream() */
+  static bool convertGeometryTextToBinary(std::istream &in, std::ostream &out);
+
   /** \brief Fill the message \e scene with the differences between this instance of PlanningScene with respect to the parent.
       If there is no parent, everything is considered to be a diff and the function behaves like getPlanningSceneMsg() */
   void getPlanningSceneDiffMsg(moveit_msgs::PlanningScene &scene) const;
@@ -409,8 +524,45 @@ public:
   void processCollisionMapMsg(const moveit_msgs::CollisionMap &map);
   void processOctomapMsg(const octomap_msgs::OctomapWithPose &map);
   void processOctomapMsg(const octomap_msgs::Octomap &map);
+
+  /** \brief Set the octomap of the world to \e octree at pose \e t. If \e octree is the octree passed last, at the same pose, it is
+      considered updated in place: the world keeps its object and only notifies observers of the update, so the collision
+      world keeps its FCL objects. If octomaps are cropped or pruned and change detection is enabled for \e octree
+      (see octomap::OcTree::enableChangeDetection()), only the changed cells are filtered again. Resetting the change
+      detection is up to the caller, once all the scenes it updates have processed the octree. */
   void processOctomapPtr(const boost::shared_ptr<const octomap::OcTree> &octree, const Eigen::Affine3d &t);
 
+  /** \brief Crop the octomaps that enter the world from now on to the box between \e min and \e max, expressed in the planning frame.
+      Collision checks with a cropped octomap only traverse the part of the map near the robot, so their cost does not grow with the size of the map. */
+  void setOctomapBounds(const Eigen::Vector3d &min, const Eigen::Vector3d &max);
+
+  /** \brief Crop the octomaps that enter the world from now on to the bounding box of the robot in the current state
+      (see robot_state::RobotState::computeAABB()), enlarged by \e padding on every side (e.g., by the reach of the robot) */
+  void setOctomapBoundsFromRobot(double padding);
+
+  /** \brief Stop cropping the octomaps that enter the world */
+  void clearOctomapBounds();
+
+  /** \brief Get the box octomaps are cropped to, in the planning frame. Return false if octomaps are not cropped. */
+  bool getOctomapBounds(Eigen::Vector3d &min, Eigen::Vector3d &max) const;
+
+  /** \brief If \e flag is true, only the occupied cells of the octomaps that enter the world from now on are kept; free cells are dropped
+      (and unknown cells are never stored) */
+  void setOctomapPruneFree(bool flag);
+
+  /** \brief Check if free cells are dropped from the octomaps that enter the world */
+  bool getOctomapPruneFree() const;
+
+  /** \brief Decode \e map on a background thread, and build the collision data structures for it there, so the calling thread
+      is not blocked. The octree replaces the octomap in the world at the next call to applyPendingOctomap(). If more messages
+      arrive before that call, only the most recent one is kept. */
+  void processOctomapMsgAsync(const octomap_msgs::OctomapWithPose &map);
+
+  /** \brief If an octomap passed to processOctomapMsgAsync() is decoded, replace the octomap in the world with it and return true.
+      The previous octree stays in the world until the new one is added. If \e wait is true, first wait for the octomap being
+      decoded, if any. */
+  bool applyPendingOctomap(bool wait = false);
+
   /** \brief Set the current robot state to be \e state. If not
       all joint values are specified, the previously maintained
       joint values are kept. */
@@ -425,6 +577,14 @@ public:
   /** \brief Set the callback to be triggered when changes are made to the current scene world */
   void setCollisionObjectUpdateCallback(const collision_detection::World::ObserverCallbackFn &callback);
 
+  /** \brief Keep \e field up to date with the objects in the world of this scene. The objects already in the world are added
+      to the field, which should contain no other obstacles. Later changes to the world only update the affected regions of the
+      field. Pass NULL to stop maintaining a field. */
+  void setDistanceField(const boost::shared_ptr<distance_field::DistanceField> &field);
+
+  /** \brief Get the distance field maintained for the world of this scene (NULL if setDistanceField() was not called) */
+  boost::shared_ptr<const distance_field::DistanceField> getDistanceField() const;
+
   bool hasObjectColor(const std::string &id) const;
 
   const std_msgs::ColorRGBA& getObjectColor(const std::string &id) const;
@@ -451,6 +611,48 @@ public:
       parent and the pointer to the parent is discarded. */
   void decoupleParent();
 
+  /** \brief Read the data this scene does not modify (the current state, the allowed collision matrix, the transforms,
+      the collision robots and the object colors and types) from a snapshot of the parent (see getSnapshot()), so looking
+      it up no longer walks the chain of parent scenes. The scene remains a diff of its parent and only its own changes are
+      pushed by pushDiffs() and reported by getPlanningSceneDiffMsg(), but later changes in the parent are no longer
+      visible in this scene. */
+  void flatten();
+
+  /** \brief Get the number of parent scenes that looking up data in this scene may go through (0 if the scene has no
+      parent, 1 if it was flattened) */
+  std::size_t getDiffDepth() const
+  {
+    return diff_depth_;
+  }
+
+  /** \brief Set the depth beyond which diff scenes created from this one (and from those diffs) are flattened when they
+      are created (see flatten()), so lookups never walk more than \e depth parent scenes. 0, the default, means no limit. */
+  void setMaxDiffDepth(std::size_t depth)
+  {
+    max_diff_depth_ = depth;
+  }
+
+  /** \brief Get the depth beyond which new diff scenes are flattened (0 means no limit) */
+  std::size_t getMaxDiffDepth() const
+  {
+    return max_diff_depth_;
+  }
+
+  /** \brief Decode the shapes of the collision objects added by messages (processCollisionObjectMsg(), processPlanningSceneWorldMsg()
+      and the world of scene messages) on up to \e num_threads threads, and build the collision data structures for them there
+      (see CollisionWorld::prepareShape()), before they enter the world together. 1, the default, decodes them on the calling
+      thread while they are added. Diff scenes created from this one use the same number of threads. */
+  void setShapeDecodingThreads(unsigned int num_threads)
+  {
+    shape_decoding_threads_ = std::max(num_threads, 1u);
+  }
+
+  /** \brief Get the number of threads the shapes in collision object messages are decoded on */
+  unsigned int getShapeDecodingThreads() const
+  {
+    return shape_decoding_threads_;
+  }
+
   /** \brief Specify a predicate that decides whether states are considered valid or invalid for reasons beyond ones covered by collision checking and constraint evaluation.
       This is useful for setting up problem specific constraints (e.g., stability) */
   void setStateFeasibilityPredicate(const StateFeasibilityFn &fn)
@@ -485,6 +687,16 @@ public:
   /** \brief Check if a given state is in collision (with the environment or self collision) */
   bool isStateColliding(const robot_state::RobotState &state, const std::string &group = "", bool verbose = false) const;
 
+  /** \brief Keep the results of isStateColliding() for up to \e max_entries states, discarding the least recently used
+      result when full. Results are looked up by the variable values of the state (quantized to multiples of \e resolution,
+      if it is positive), its attached bodies, the group and the version of the scene; any change to the scene (or its
+      parent) makes previous results unreachable. Changes made through references obtained from the non-const accessors
+      before they are made are not detected. Verbose checks are not cached. If \e max_entries is 0, the cache is disabled. */
+  void setCollisionCheckCache(std::size_t max_entries, double resolution = 0.0);
+
+  /** \brief Get the hit statistics of the cache enabled by setCollisionCheckCache(); all zero if there is no cache */
+  robot_state::StateResultCacheStatistics getCollisionCheckCacheStatistics() const;
+
   /** \brief Check if a given state is feasible, in accordance to the feasibility predicate specified by setStateFeasibilityPredicate(). Returns true if no feasibility predicate was specified. */
   bool isStateFeasible(const moveit_msgs::RobotState &state, bool verbose = false) const;
 
@@ -564,6 +776,15 @@ public:
   bool isPathValid(const robot_trajectory::RobotTrajectory &trajectory,
                    const std::string &group = "", bool verbose = false, std::vector<std::size_t> *invalid_index = NULL) const;
 
+  /** \brief Check if a given path is valid, as above, with the states checked as described by \e options. Unless \e invalid_index
+      is specified, the checks stop at the first invalid state. An invalid interpolated state is reported as the index of the
+      waypoint that ends its segment. The indices in \e invalid_index are sorted and unique. */
+  bool isPathValid(const robot_trajectory::RobotTrajectory &trajectory,
+                   const moveit_msgs::Constraints& path_constraints,
+                   const std::vector<moveit_msgs::Constraints>& goal_constraints,
+                   const PathValidationOptions &options,
+                   const std::string &group = "", bool verbose = false, std::vector<std::size_t> *invalid_index = NULL) const;
+
   /** \brief Get the top \e max_costs cost sources for a specified trajectory. The resulting costs are stored in \e costs */
   void getCostSources(const robot_trajectory::RobotTrajectory &trajectory, std::size_t max_costs,
                       std::set<collision_detection::CostSource> &costs, double overlap_fraction = 0.9) const;
@@ -595,6 +816,31 @@ public:
   /** \brief Clone a planning scene. Even if the scene \e scene depends on a parent, the cloned scene will not. */
   static PlanningScenePtr clone(const PlanningSceneConstPtr &scene);
 
+  /** \brief Get the number of scenes created by diff() and clone() from the calling thread so far. Scenes created by clone()
+      are counted in \e clones and also in \e diffs, since clone() goes through diff(). Callers that want the number of copies
+      made by some operation take the difference of two readings. */
+  static void getThreadSceneCopyCounts(std::size_t &diffs, std::size_t &clones);
+
+  /** \brief Turn the counting of collision checks, broad and narrow phase pairs, IK calls and forward kinematics passes on
+      or off, for all threads (see moveit::tools::QueryCounters). Counting is off by default. */
+  static void setQueryCountersEnabled(bool flag);
+
+  static bool getQueryCountersEnabled();
+
+  /** \brief Get the queries counted for the calling thread since its counts were last reset. Like the scene copy
+      counts, callers that want the queries made by some operation take the difference of two readings. */
+  static moveit::tools::QueryCounts getThreadQueryCounts();
+
+  /** \brief Set the query counts of the calling thread to 0 */
+  static void resetThreadQueryCounts();
+
+  /** \brief Get an estimate of the memory held by this scene. For a diff scene, only what the scene does not share with its
+      parent is counted: world objects that are the same as in the parent, and the state, collision robots and allowed
+      collision matrix taken from the parent, are not. Collision geometry is shared through the geometry cache of the
+      collision detector (see collision_detection::getCollisionGeometryCacheStatistics()), so it may also be counted for
+      other scenes with the same shapes. The robot model is not counted. */
+  void getMemoryUsage(PlanningSceneMemoryUsage &usage) const;
+
 private:
 
   /* Private constructor used by the diff() methods. */
@@ -651,11 +897,79 @@ private:
   void allocateCollisionDetectors();
   void allocateCollisionDetectors(CollisionDetector& detector);
 
+  /* Process \e object, taking the shapes of an ADD or APPEND operation from \e decoded (in the order primitives, meshes, planes;
+     NULL entries are skipped) if it is not NULL, instead of decoding them from the message */
+  bool processCollisionObjectMsg(const moveit_msgs::CollisionObject &object, const std::vector<shapes::ShapeConstPtr> *decoded);
+
+  /* Process \e objects in order, decoding the shapes they add on shape_decoding_threads_ threads first */
+  void processCollisionObjectMsgs(const std::vector<moveit_msgs::CollisionObject> &objects);
+
+  /* Decodes the octomaps passed to processOctomapMsgAsync() on a background thread */
+  class AsyncOctomap;
+
+  /* The way octomaps are reduced when they enter the world */
+  struct OctomapFilter
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    OctomapFilter() : crop_(false), prune_free_(false)
+    {
+    }
+
+    /* Check whether octrees are changed at all when they enter the world */
+    bool active() const
+    {
+      return crop_ || prune_free_;
+    }
+
+    /* Get the octree to add to the world for \e octree at pose \e t */
+    boost::shared_ptr<const octomap::OcTree> apply(const boost::shared_ptr<const octomap::OcTree> &octree, const Eigen::Affine3d &t) const;
+
+    /* Make the reduced copy of \e octree at pose \e t (only called if active()) */
+    boost::shared_ptr<octomap::OcTree> filter(const octomap::OcTree &octree, const Eigen::Affine3d &t) const;
+
+    /* Update \e result, made by filter() for \e octree at pose \e t, for the cells \e keys of \e octree. \e result must not
+       be shared: octrees that entered the world are never modified */
+    void update(const octomap::OcTree &octree, const Eigen::Affine3d &t, const octomap::KeySet &keys, octomap::OcTree &result) const;
+
+    /* Make result_ reflect the cells of \e source its change detection reports. The previous result is brought up to date
+       and swapped in when nothing but the filter holds it any more; otherwise result_ is copied */
+    void updateResult(const octomap::OcTree &source, const Eigen::Affine3d &t);
+
+    /* Get the crop box, expressed in the frame of an octree at pose \e t */
+    void getCropBounds(const Eigen::Affine3d &t, octomap::point3d &bmin, octomap::point3d &bmax) const;
+
+    bool                                     crop_;
+    Eigen::Vector3d                          min_;
+    Eigen::Vector3d                          max_;
+    bool                                     prune_free_;
+
+    // the last octree passed to processOctomapPtr(), with the pose and the result it was filtered for
+    boost::weak_ptr<const octomap::OcTree>   source_;
+    Eigen::Affine3d                          source_pose_;
+    boost::shared_ptr<octomap::OcTree>       result_;
+
+    // the result before result_, and the cells it misses compared to result_
+    boost::shared_ptr<octomap::OcTree>       spare_;
+    octomap::KeySet                          spare_pending_;
+  };
+
+  /* Get the filter for octomaps, creating it if needed; the octree filtered last is forgotten, as the settings are about to change */
+  OctomapFilter& getOctomapFilterNonConst();
+
+  /* Discard the snapshot returned by getSnapshot(), as the scene is about to change. */
+  void invalidateSnapshot();
+
+  /* Identify the results of collision checks for \e group in the current version of the scene and its parents */
+  std::string getCollisionCheckContext(const std::string &group) const;
+  void notifyWorldChange(const collision_detection::World::ObjectConstPtr &obj, collision_detection::World::Action action);
+
 
 
   std::string                                    name_;         // may be empty
 
   PlanningSceneConstPtr                          parent_;       // Null unless this is a diff scene
+  PlanningSceneConstPtr                          data_parent_;  // the scene unmodified data is read from: parent_, or a snapshot of it (see flatten())
 
   robot_model::RobotModelConstPtr                kmodel_;       // Never null (may point to same model as parent)
 
@@ -683,6 +997,38 @@ private:
   // a map of object types
   boost::scoped_ptr<ObjectTypeMap>               object_types_;
 
+  std::size_t                                    diff_depth_;             // see getDiffDepth()
+  std::size_t                                    max_diff_depth_;         // see setMaxDiffDepth()
+  unsigned int                                   shape_decoding_threads_; // see setShapeDecodingThreads()
+
+  /* The message built for a world object, and the version of the object it was built for */
+  struct CollisionObjectMsgCacheEntry
+  {
+    CollisionObjectMsgCacheEntry() : version_(0)
+    {
+    }
+
+    std::size_t                   version_;
+    moveit_msgs::CollisionObject  msg_;
+  };
+
+  // the messages built for world objects by getPlanningSceneMsgCollisionObject(), reused while the objects do not change
+  mutable std::map<std::string, CollisionObjectMsgCacheEntry> collision_object_msgs_;
+  mutable boost::mutex                           collision_object_msgs_lock_;
+
+  mutable PlanningSceneConstPtr                  snapshot_;               // NULL until requested, or after a change
+  mutable PlanningSceneConstPtr                  snapshot_parent_;        // the snapshot of parent_ snapshot_ was made from
+  mutable boost::mutex                           snapshot_lock_;
+  collision_detection::World::ObserverHandle     snapshot_observer_handle_;
+  std::size_t                                    change_stamp_;           // unique among all scenes; renewed by invalidateSnapshot()
+
+  boost::scoped_ptr<robot_state::StateResultCache<bool> > collision_check_cache_; // NULL unless setCollisionCheckCache() is called
+
+  boost::shared_ptr<AsyncOctomap>                async_octomap_;          // NULL until processOctomapMsgAsync() is called
+  boost::scoped_ptr<OctomapFilter>               octomap_filter_;         // NULL unless octomaps are cropped or pruned
+
+  boost::scoped_ptr<distance_field::WorldDistanceField> world_distance_field_; // NULL unless setDistanceField() is called
+
 
 };
 
@@ -38,12 +38,22 @@
 #include <moveit/collision_detection_fcl/collision_detector_allocator_fcl.h>
 #include <geometric_shapes/shape_operations.h>
 #include <moveit/collision_detection/collision_tools.h>
+#include <moveit/distance_field/world_distance_field.h>
+#include <moveit/profiler/tracing.h>
+#include <moveit/profiler/memory_usage.h>
 #include <moveit/trajectory_processing/trajectory_tools.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/exceptions/exceptions.h>
 #include <octomap_msgs/conversions.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <iterator>
 #include <set>
+#include <deque>
 #include <ros/console.h>
 namespace planning_scene
 {
@@ -51,6 +61,99 @@ const std::string PlanningScene::COLLISION_MAP_NS = "<collision_map>";
 const std::string PlanningScene::OCTOMAP_NS = "<octomap>";
 const std::string PlanningScene::DEFAULT_SCENE_NAME = "(noname)";
 
+// the stamps identify versions of scenes, so they are never reused
+static std::size_t newChangeStamp()
+{
+  static boost::mutex lock;
+  static std::size_t next_stamp = 0;
+  boost::mutex::scoped_lock slock(lock);
+  return ++next_stamp;
+}
+
+namespace
+{
+struct SceneCopyCounts
+{
+  SceneCopyCounts() : diffs_(0), clones_(0)
+  {
+  }
+
+  std::size_t diffs_;
+  std::size_t clones_;
+};
+
+// counted per thread so that readings taken around a call are not disturbed by other threads
+boost::thread_specific_ptr<SceneCopyCounts> scene_copy_counts;
+
+SceneCopyCounts& getSceneCopyCounts()
+{
+  SceneCopyCounts *counts = scene_copy_counts.get();
+  if (!counts)
+  {
+    counts = new SceneCopyCounts();
+    scene_copy_counts.reset(counts);
+  }
+  return *counts;
+}
+
+// notify world about in-place updates of the shapes of obj, if world has the same shapes at the same poses for it
+bool updateShapesInWorld(const collision_detection::World::Object &obj, collision_detection::World &world)
+{
+  collision_detection::World::ObjectConstPtr other = world.getObject(obj.id_);
+  if (!other || other->shapes_ != obj.shapes_)
+    return false;
+  for (std::size_t i = 0 ; i < obj.shape_poses_.size() ; ++i)
+    if (!other->shape_poses_[i].isApprox(obj.shape_poses_[i]))
+      return false;
+  other.reset();
+  for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+    world.updateShapeInObject(obj.id_, obj.shapes_[i]);
+  return true;
+}
+
+// where the cells of the cube with center c and half size h lie relative to the box [bmin, bmax]: 1 if all their centers are in it,
+// -1 if none is, 0 otherwise; as for single cells, centers within half the resolution r of the box count as in it
+int cellsInBox(const octomap::point3d &c, double h, double r, const octomap::point3d &bmin, const octomap::point3d &bmax)
+{
+  bool inside = true;
+  for (unsigned int i = 0 ; i < 3 ; ++i)
+  {
+    const double lo = c(i) - h + r / 2.0, hi = c(i) + h - r / 2.0;
+    if (hi < bmin(i) - r / 2.0 || lo > bmax(i) + r / 2.0)
+      return -1;
+    if (lo < bmin(i) - r / 2.0 || hi > bmax(i) + r / 2.0)
+      inside = false;
+  }
+  return inside ? 1 : 0;
+}
+
+// remove the cells of the node with key at depth (> 0) of octree that are outside the box [bmin, bmax]; nodes entirely outside are
+// removed at once, and only the nodes across the boundary of the box are split, so large pruned regions are not expanded cell by cell
+void cropOctreeNode(octomap::OcTree &octree, const octomap::OcTreeKey &key, unsigned int depth,
+                    const octomap::point3d &bmin, const octomap::point3d &bmax)
+{
+  // unknown space has nothing to remove
+  if (!octree.search(key, depth))
+    return;
+  const int where = cellsInBox(octree.keyToCoord(key, depth), octree.getNodeSize(depth) / 2.0, octree.getResolution(), bmin, bmax);
+  if (where > 0)
+    return;
+  if (where < 0)
+  {
+    // pruned ancestors are expanded as needed
+    octree.deleteNode(key, depth);
+    return;
+  }
+  const octomap::key_type offset = (octomap::key_type)(1 << (octree.getTreeDepth() - 1)) >> (depth + 1);
+  for (unsigned int i = 0 ; i < 8 ; ++i)
+  {
+    octomap::OcTreeKey child;
+    octomap::computeChildKey(i, offset, key, child);
+    cropOctreeNode(octree, child, depth + 1, bmin, bmax);
+  }
+}
+}
+
 class SceneTransforms : public robot_state::Transforms
 {
 public:
@@ -77,7 +180,7 @@ public:
       return knowsObject(frame);
   }
 
-  virtual const Eigen::Affine3d& getTransform(const std::string &from_frame) const
+  virtual Eigen::Affine3d getTransform(const std::string &from_frame) const
   {  // the call below also calls Transforms::getTransform() too
     return scene_->getFrameTransform(from_frame);
   }
@@ -147,11 +250,18 @@ planning_scene::PlanningScene::~PlanningScene()
 {
   if (current_world_object_update_callback_)
     world_->removeObserver(current_world_object_update_observer_handle_);
+  world_->removeObserver(snapshot_observer_handle_);
 }
 
 void planning_scene::PlanningScene::initialize()
 {
   name_ = DEFAULT_SCENE_NAME;
+  diff_depth_ = 0;
+  max_diff_depth_ = 0;
+  shape_decoding_threads_ = 1;
+  change_stamp_ = newChangeStamp();
+
+  snapshot_observer_handle_ = world_->addObserver(boost::bind(&PlanningScene::notifyWorldChange, this, _1, _2));
 
   ftf_.reset(new SceneTransforms(this));
 
@@ -183,7 +293,7 @@ robot_model::RobotModelPtr planning_scene::PlanningScene::createRobotModel(const
 }
 
 planning_scene::PlanningScene::PlanningScene(const PlanningSceneConstPtr &parent) :
-  parent_(parent)
+  parent_(parent), data_parent_(parent)
 {
   if (!parent_)
     throw moveit::ConstructException("NULL parent pointer for planning scene");
@@ -192,11 +302,13 @@ planning_scene::PlanningScene::PlanningScene(const PlanningSceneConstPtr &parent
     name_ = parent_->getName() + "+";
 
   kmodel_ = parent_->kmodel_;
+  change_stamp_ = newChangeStamp();
 
   // maintain a separate world.  Copy on write ensures that most of the object
   // info is shared until it is modified.
   world_.reset(new collision_detection::World(*parent_->world_));
   world_const_ = world_;
+  snapshot_observer_handle_ = world_->addObserver(boost::bind(&PlanningScene::notifyWorldChange, this, _1, _2));
 
   // record changes to the world
   world_diff_.reset(new collision_detection::WorldDiff(world_));
@@ -223,19 +335,129 @@ planning_scene::PlanningScene::PlanningScene(const PlanningSceneConstPtr &parent
     detector->crobot_unpadded_const_.reset();
   }
   setActiveCollisionDetector(parent_->getActiveCollisionDetectorName());
+
+  if (parent_->octomap_filter_)
+  {
+    octomap_filter_.reset(new OctomapFilter());
+    octomap_filter_->crop_ = parent_->octomap_filter_->crop_;
+    octomap_filter_->min_ = parent_->octomap_filter_->min_;
+    octomap_filter_->max_ = parent_->octomap_filter_->max_;
+    octomap_filter_->prune_free_ = parent_->octomap_filter_->prune_free_;
+  }
+
+  diff_depth_ = parent_->diff_depth_ + 1;
+  max_diff_depth_ = parent_->max_diff_depth_;
+  shape_decoding_threads_ = parent_->shape_decoding_threads_;
 }
 
 planning_scene::PlanningScenePtr planning_scene::PlanningScene::clone(const planning_scene::PlanningSceneConstPtr &scene)
 {
-  PlanningScenePtr result = scene->diff();
+  getSceneCopyCounts().clones_++;
+  getSceneCopyCounts().diffs_++;
+  // not diff(): getSnapshot() clones while holding its lock, and diff() may flatten the copy through a snapshot
+  PlanningScenePtr result(new PlanningScene(scene));
   result->decoupleParent();
   result->setName(scene->getName());
   return result;
 }
 
+void planning_scene::PlanningScene::getThreadSceneCopyCounts(std::size_t &diffs, std::size_t &clones)
+{
+  const SceneCopyCounts &counts = getSceneCopyCounts();
+  diffs = counts.diffs_;
+  clones = counts.clones_;
+}
+
+void planning_scene::PlanningScene::setQueryCountersEnabled(bool flag)
+{
+  moveit::tools::QueryCounters::setEnabled(flag);
+}
+
+bool planning_scene::PlanningScene::getQueryCountersEnabled()
+{
+  return moveit::tools::QueryCounters::isEnabled();
+}
+
+moveit::tools::QueryCounts planning_scene::PlanningScene::getThreadQueryCounts()
+{
+  return moveit::tools::QueryCounters::getThreadCounts();
+}
+
+void planning_scene::PlanningScene::resetThreadQueryCounts()
+{
+  moveit::tools::QueryCounters::resetThreadCounts();
+}
+
+void planning_scene::PlanningScene::getMemoryUsage(PlanningSceneMemoryUsage &usage) const
+{
+  usage = PlanningSceneMemoryUsage();
+
+  for (collision_detection::World::const_iterator it = world_->begin() ; it != world_->end() ; ++it)
+  {
+    std::size_t bytes = moveit::tools::estimateMapNodeBytes<std::string, collision_detection::World::ObjectPtr>();
+    // objects not changed since the scene was diffed are shared with the parent
+    if (parent_ && parent_->getWorld()->getObject(it->first) == it->second)
+    {
+      usage.world_objects_ += bytes;
+      continue;
+    }
+    const collision_detection::World::Object &obj = *it->second;
+    bytes += sizeof(obj) + obj.id_.capacity() + obj.shapes_.capacity() * sizeof(shapes::ShapeConstPtr) +
+      obj.shape_poses_.capacity() * sizeof(Eigen::Affine3d);
+    bool octree = false;
+    for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+    {
+      bytes += robot_state::getShapeMemoryUsage(*obj.shapes_[i]);
+      if (obj.shapes_[i]->type == shapes::OCTREE)
+        octree = true;
+    }
+    if (octree)
+      usage.octrees_ += bytes;
+    else
+      usage.world_objects_ += bytes;
+  }
+
+  for (CollisionDetectorConstIterator it = collision_.begin() ; it != collision_.end() ; ++it)
+  {
+    usage.collision_detectors_ += sizeof(CollisionDetector) + it->second->cworld_->getMemoryUsage();
+    if (it->second->crobot_)
+      usage.collision_detectors_ += it->second->crobot_->getMemoryUsage();
+    if (it->second->crobot_unpadded_)
+      usage.collision_detectors_ += it->second->crobot_unpadded_->getMemoryUsage();
+  }
+
+  if (kstate_)
+    usage.state_ = kstate_->getMemoryUsage();
+
+  if (world_diff_)
+  {
+    usage.diffs_ = sizeof(collision_detection::WorldDiff);
+    for (collision_detection::WorldDiff::const_iterator it = world_diff_->begin() ; it != world_diff_->end() ; ++it)
+      // the change, its handle and its entries in the two indices
+      usage.diffs_ += sizeof(*it) + it->first.capacity() + sizeof(collision_detection::World::ObjectHandle) +
+        2 * (sizeof(std::pair<std::string, std::size_t>) + 2 * sizeof(void*));
+  }
+
+  if (collision_check_cache_)
+    usage.caches_ += collision_check_cache_->getMemoryUsage();
+  {
+    boost::mutex::scoped_lock slock(collision_object_msgs_lock_);
+    for (std::map<std::string, CollisionObjectMsgCacheEntry>::const_iterator it = collision_object_msgs_.begin() ; it != collision_object_msgs_.end() ; ++it)
+      usage.caches_ += moveit::tools::estimateMapNodeBytes<std::string, CollisionObjectMsgCacheEntry>() + it->first.capacity() +
+        ros::serialization::serializationLength(it->second.msg_);
+  }
+
+  if (world_distance_field_)
+    usage.distance_field_ = world_distance_field_->getMemoryUsage();
+}
+
 planning_scene::PlanningScenePtr planning_scene::PlanningScene::diff() const
 {
-  return PlanningScenePtr(new PlanningScene(shared_from_this()));
+  getSceneCopyCounts().diffs_++;
+  PlanningScenePtr result(new PlanningScene(shared_from_this()));
+  if (max_diff_depth_ > 0 && result->diff_depth_ > max_diff_depth_)
+    result->flatten();
+  return result;
 }
 
 planning_scene::PlanningScenePtr planning_scene::PlanningScene::diff(const moveit_msgs::PlanningScene &msg) const
@@ -245,11 +467,79 @@ planning_scene::PlanningScenePtr planning_scene::PlanningScene::diff(const movei
   return result;
 }
 
+planning_scene::PlanningSceneConstPtr planning_scene::PlanningScene::getSnapshot() const
+{
+  // a diff scene also changes when its parent does; the parent snapshot tells whether that happened
+  PlanningSceneConstPtr parent_snapshot;
+  if (parent_)
+    parent_snapshot = parent_->getSnapshot();
+
+  boost::mutex::scoped_lock slock(snapshot_lock_);
+  if (!snapshot_ || snapshot_parent_ != parent_snapshot)
+  {
+    snapshot_ = clone(shared_from_this());
+    snapshot_parent_ = parent_snapshot;
+  }
+  return snapshot_;
+}
+
+void planning_scene::PlanningScene::invalidateSnapshot()
+{
+  boost::mutex::scoped_lock slock(snapshot_lock_);
+  snapshot_.reset();
+  snapshot_parent_.reset();
+  change_stamp_ = newChangeStamp();
+}
+
+std::size_t planning_scene::PlanningScene::getChangeStamp() const
+{
+  std::size_t h = 0;
+  for (const PlanningScene *scene = this ; scene ; scene = scene->parent_.get())
+    boost::hash_combine(h, scene->change_stamp_);
+  return h;
+}
+
+std::string planning_scene::PlanningScene::getCollisionCheckContext(const std::string &group) const
+{
+  // the stamps are kept whole rather than hashed, so different scenes never share a context
+  std::vector<std::size_t> ids;
+  for (const PlanningScene *scene = this ; scene ; scene = scene->parent_.get())
+    ids.push_back(scene->change_stamp_);
+  // the matrix can be modified through a reference obtained earlier
+  const collision_detection::AllowedCollisionMatrix &acm = getAllowedCollisionMatrix();
+  ids.push_back(acm.getInstanceID());
+  ids.push_back(acm.getVersion());
+
+  // group names contain no '\0', so the group name is delimited unambiguously
+  std::string context(group);
+  context.push_back('\0');
+  context.append(reinterpret_cast<const char*>(&ids[0]), ids.size() * sizeof(std::size_t));
+  return context;
+}
+
+void planning_scene::PlanningScene::setCollisionCheckCache(std::size_t max_entries, double resolution)
+{
+  if (max_entries == 0)
+    collision_check_cache_.reset();
+  else
+    collision_check_cache_.reset(new robot_state::StateResultCache<bool>(max_entries, resolution));
+}
+
+robot_state::StateResultCacheStatistics planning_scene::PlanningScene::getCollisionCheckCacheStatistics() const
+{
+  return collision_check_cache_ ? collision_check_cache_->getStatistics() : robot_state::StateResultCacheStatistics();
+}
+
+void planning_scene::PlanningScene::notifyWorldChange(const collision_detection::World::ObjectConstPtr &obj, collision_detection::World::Action action)
+{
+  invalidateSnapshot();
+}
+
 void planning_scene::PlanningScene::CollisionDetector::copyPadding(const planning_scene::PlanningScene::CollisionDetector& src)
 {
   if (!crobot_)
   {
-    alloc_->allocateRobot(parent_->getCollisionRobot());
+    crobot_ = alloc_->allocateRobot(parent_->getCollisionRobot());
     crobot_const_ = crobot_;
   }
 
@@ -259,6 +549,7 @@ void planning_scene::PlanningScene::CollisionDetector::copyPadding(const plannin
 
 void planning_scene::PlanningScene::propogateRobotPadding()
 {
+  invalidateSnapshot();
   if (!active_collision_->crobot_)
     return;
 
@@ -271,16 +562,17 @@ void planning_scene::PlanningScene::propogateRobotPadding()
 
 void planning_scene::PlanningScene::CollisionDetector::findParent(const PlanningScene& scene)
 {
-  if (parent_ || !scene.parent_)
+  if (parent_ || !scene.data_parent_)
     return;
 
-  CollisionDetectorConstIterator it = scene.parent_->collision_.find(alloc_->getName());
-  if (it != scene.parent_->collision_.end())
+  CollisionDetectorConstIterator it = scene.data_parent_->collision_.find(alloc_->getName());
+  if (it != scene.data_parent_->collision_.end())
     parent_ = it->second->parent_;
 }
 
 void planning_scene::PlanningScene::addCollisionDetector(const collision_detection::CollisionDetectorAllocatorPtr& allocator)
 {
+  invalidateSnapshot();
   const std::string& name = allocator->getName();
   CollisionDetectorPtr& detector = collision_[name];
 
@@ -321,6 +613,7 @@ void planning_scene::PlanningScene::addCollisionDetector(const collision_detecti
 void planning_scene::PlanningScene::setActiveCollisionDetector(const collision_detection::CollisionDetectorAllocatorPtr& allocator,
                                                                bool exclusive)
 {
+  invalidateSnapshot();
   if (exclusive)
   {
     CollisionDetectorPtr p;
@@ -346,6 +639,7 @@ void planning_scene::PlanningScene::setActiveCollisionDetector(const collision_d
 
 bool planning_scene::PlanningScene::setActiveCollisionDetector(const std::string& collision_detector_name)
 {
+  invalidateSnapshot();
   CollisionDetectorIterator it = collision_.find(collision_detector_name);
   if (it != collision_.end())
   {
@@ -417,15 +711,19 @@ const collision_detection::CollisionRobotConstPtr& planning_scene::PlanningScene
 
 void planning_scene::PlanningScene::clearDiffs()
 {
+  invalidateSnapshot();
   if (!parent_)
     return;
 
   // clear everything, reset the world, record diffs
   world_.reset(new collision_detection::World(*parent_->world_));
   world_const_ = world_;
+  snapshot_observer_handle_ = world_->addObserver(boost::bind(&PlanningScene::notifyWorldChange, this, _1, _2));
   world_diff_.reset(new collision_detection::WorldDiff(world_));
   if (current_world_object_update_callback_)
     current_world_object_update_observer_handle_ = world_->addObserver(current_world_object_update_callback_);
+  if (world_distance_field_)
+    world_distance_field_->setWorld(world_);
 
   // use parent crobot_ if it exists.  Otherwise copy padding from parent.
   for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
@@ -445,7 +743,7 @@ void planning_scene::PlanningScene::clearDiffs()
     }
     else
     {
-      it->second->copyPadding(*parent_->active_collision_);
+      it->second->copyPadding(*data_parent_->active_collision_);
 
       it->second->cworld_ = it->second->alloc_->allocateWorld(world_);
       it->second->cworld_const_ = it->second->cworld_;
@@ -465,7 +763,7 @@ void planning_scene::PlanningScene::pushDiffs(const PlanningScenePtr &scene)
     return;
 
   if (ftf_)
-    scene->getTransformsNonConst().setAllTransforms(ftf_->getAllTransforms());
+    scene->getTransformsNonConst().setTransformsSnapshot(ftf_->getTransformsSnapshot());
 
   if (kstate_)
     scene->getCurrentStateNonConst() = *kstate_;
@@ -493,6 +791,9 @@ void planning_scene::PlanningScene::pushDiffs(const PlanningScenePtr &scene)
       else
       {
         const collision_detection::World::Object& obj = *world_->getObject(it->first);
+        // shapes updated in place only need the parent notified, if it has them at the same poses
+        if (it->second == collision_detection::World::UPDATE_SHAPE && updateShapesInWorld(obj, *scene->world_))
+          continue;
         scene->world_->removeObject(obj.id_);
         scene->world_->addToObject(obj.id_, obj.shapes_, obj.shape_poses_);
         if (hasObjectColor(it->first))
@@ -524,6 +825,26 @@ double planning_scene::PlanningScene::distanceToCollision(const robot_state::Rob
   return getCollisionWorld()->distanceRobot(*getCollisionRobot(), kstate, acm);
 }
 
+double planning_scene::PlanningScene::distanceToCollisionUnpadded(const robot_state::RobotState &kstate, double max_distance) const
+{
+  return getCollisionWorld()->distanceRobot(*getCollisionRobotUnpadded(), kstate, max_distance);
+}
+
+double planning_scene::PlanningScene::distanceToCollisionUnpadded(const robot_state::RobotState &kstate, const collision_detection::AllowedCollisionMatrix& acm, double max_distance) const
+{
+  return getCollisionWorld()->distanceRobot(*getCollisionRobotUnpadded(), kstate, acm, max_distance);
+}
+
+double planning_scene::PlanningScene::distanceToCollision(const robot_state::RobotState &kstate, double max_distance) const
+{
+  return getCollisionWorld()->distanceRobot(*getCollisionRobot(), kstate, max_distance);
+}
+
+double planning_scene::PlanningScene::distanceToCollision(const robot_state::RobotState &kstate, const collision_detection::AllowedCollisionMatrix& acm, double max_distance) const
+{
+  return getCollisionWorld()->distanceRobot(*getCollisionRobot(), kstate, acm, max_distance);
+}
+
 void planning_scene::PlanningScene::checkCollision(const collision_detection::CollisionRequest& req, collision_detection::CollisionResult &res) const
 {
   checkCollision(req, res, getCurrentState());
@@ -537,14 +858,9 @@ void planning_scene::PlanningScene::checkSelfCollision(const collision_detection
 void planning_scene::PlanningScene::checkCollision(const collision_detection::CollisionRequest& req, collision_detection::CollisionResult &res,
                                                    const robot_state::RobotState &kstate) const
 {
-  // check collision with the world using the padded version
-  getCollisionWorld()->checkRobotCollision(req, res, *getCollisionRobot(), kstate, getAllowedCollisionMatrix());
-
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
-  {
-    // do self-collision checking with the unpadded version of the robot
-    getCollisionRobotUnpadded()->checkSelfCollision(req, res, kstate, getAllowedCollisionMatrix());
-  }
+  MOVEIT_TRACE_SCOPE("PlanningScene::checkCollision");
+  // check collision with the world using the padded version and self-collision with the unpadded version of the robot
+  getCollisionWorld()->checkCollision(req, res, *getCollisionRobot(), *getCollisionRobotUnpadded(), kstate, getAllowedCollisionMatrix());
 }
 
 void planning_scene::PlanningScene::checkSelfCollision(const collision_detection::CollisionRequest& req, collision_detection::CollisionResult &res,
@@ -559,12 +875,9 @@ void planning_scene::PlanningScene::checkCollision(const collision_detection::Co
                                                    const robot_state::RobotState &kstate,
                                                    const collision_detection::AllowedCollisionMatrix& acm) const
 {
-  // check collision with the world using the padded version
-  getCollisionWorld()->checkRobotCollision(req, res, *getCollisionRobot(), kstate, acm);
-
-  // do self-collision checking with the unpadded version of the robot
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
-    getCollisionRobotUnpadded()->checkSelfCollision(req, res, kstate, acm);
+  MOVEIT_TRACE_SCOPE("PlanningScene::checkCollision");
+  // check collision with the world using the padded version and self-collision with the unpadded version of the robot
+  getCollisionWorld()->checkCollision(req, res, *getCollisionRobot(), *getCollisionRobotUnpadded(), kstate, acm);
 }
 
 void planning_scene::PlanningScene::checkCollisionUnpadded(const collision_detection::CollisionRequest& req,
@@ -585,14 +898,9 @@ void planning_scene::PlanningScene::checkCollisionUnpadded(const collision_detec
                                                            const robot_state::RobotState &kstate,
                                                            const collision_detection::AllowedCollisionMatrix& acm) const
 {
-  // check collision with the world using the padded version
-  getCollisionWorld()->checkRobotCollision(req, res, *getCollisionRobotUnpadded(), kstate, acm);
-
-  // do self-collision checking with the unpadded version of the robot
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
-  {
-    getCollisionRobotUnpadded()->checkSelfCollision(req, res, kstate, acm);
-  }
+  MOVEIT_TRACE_SCOPE("PlanningScene::checkCollisionUnpadded");
+  // check collision with the world and self-collision using the unpadded version of the robot
+  getCollisionWorld()->checkCollision(req, res, *getCollisionRobotUnpadded(), *getCollisionRobotUnpadded(), kstate, acm);
 }
 
 void planning_scene::PlanningScene::checkSelfCollision(const collision_detection::CollisionRequest& req,
@@ -640,6 +948,7 @@ void planning_scene::PlanningScene::getCollidingLinks(std::vector<std::string> &
 
 const collision_detection::CollisionRobotPtr& planning_scene::PlanningScene::getCollisionRobotNonConst()
 {
+  invalidateSnapshot();
   if (!active_collision_->crobot_)
   {
     active_collision_->crobot_ = active_collision_->alloc_->allocateRobot(active_collision_->parent_->getCollisionRobot());
@@ -650,9 +959,10 @@ const collision_detection::CollisionRobotPtr& planning_scene::PlanningScene::get
 
 robot_state::RobotState& planning_scene::PlanningScene::getCurrentStateNonConst()
 {
+  invalidateSnapshot();
   if (!kstate_)
   {
-    kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
+    kstate_.reset(new robot_state::RobotState(data_parent_->getCurrentState()));
     kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
   }
   return *kstate_;
@@ -681,19 +991,35 @@ void planning_scene::PlanningScene::setCollisionObjectUpdateCallback(const colli
   current_world_object_update_callback_ = callback;
 }
 
+void planning_scene::PlanningScene::setDistanceField(const boost::shared_ptr<distance_field::DistanceField> &field)
+{
+  world_distance_field_.reset();
+  if (field)
+    world_distance_field_.reset(new distance_field::WorldDistanceField(world_, field));
+}
+
+boost::shared_ptr<const distance_field::DistanceField> planning_scene::PlanningScene::getDistanceField() const
+{
+  if (world_distance_field_)
+    return world_distance_field_->getDistanceField();
+  return boost::shared_ptr<const distance_field::DistanceField>();
+}
+
 collision_detection::AllowedCollisionMatrix& planning_scene::PlanningScene::getAllowedCollisionMatrixNonConst()
 {
+  invalidateSnapshot();
   if (!acm_)
-    acm_.reset(new collision_detection::AllowedCollisionMatrix(parent_->getAllowedCollisionMatrix()));
+    acm_.reset(new collision_detection::AllowedCollisionMatrix(data_parent_->getAllowedCollisionMatrix()));
   return *acm_;
 }
 
 robot_state::Transforms& planning_scene::PlanningScene::getTransformsNonConst()
 {
+  invalidateSnapshot();
   if (!ftf_)
   {
     ftf_.reset(new SceneTransforms(this));
-    ftf_->setAllTransforms(parent_->getTransforms().getAllTransforms());
+    ftf_->setTransformsSnapshot(data_parent_->getTransforms().getTransformsSnapshot());
   }
   return *ftf_;
 }
@@ -820,30 +1146,42 @@ private:
 
 void planning_scene::PlanningScene::getPlanningSceneMsgCollisionObject(moveit_msgs::PlanningScene &scene_msg, const std::string &ns) const
 {
-  moveit_msgs::CollisionObject co;
-  co.header.frame_id = getPlanningFrame();
-  co.id = ns;
-  co.operation = moveit_msgs::CollisionObject::ADD;
   collision_detection::CollisionWorld::ObjectConstPtr obj = world_->getObject(ns);
   if (!obj)
     return;
-  ShapeVisitorAddToCollisionObject sv(&co);
-  for (std::size_t j = 0 ; j < obj->shapes_.size() ; ++j)
-  {
-    shapes::ShapeMsg sm;
-    if (constructMsgFromShape(obj->shapes_[j].get(), sm))
+
+  // the shapes are only converted again if the object changed since they were last converted
+  boost::mutex::scoped_lock slock(collision_object_msgs_lock_);
+  CollisionObjectMsgCacheEntry &entry = collision_object_msgs_[ns];
+  if (entry.version_ == 0 || entry.version_ != obj->version_)
+  {
+    moveit_msgs::CollisionObject &co = entry.msg_;
+    co = moveit_msgs::CollisionObject();
+    co.id = ns;
+    co.operation = moveit_msgs::CollisionObject::ADD;
+    ShapeVisitorAddToCollisionObject sv(&co);
+    for (std::size_t j = 0 ; j < obj->shapes_.size() ; ++j)
     {
-      geometry_msgs::Pose p;
-      tf::poseEigenToMsg(obj->shape_poses_[j], p);
-      sv.setPoseMessage(&p);
-      boost::apply_visitor(sv, sm);
+      shapes::ShapeMsg sm;
+      if (constructMsgFromShape(obj->shapes_[j].get(), sm))
+      {
+        geometry_msgs::Pose p;
+        tf::poseEigenToMsg(obj->shape_poses_[j], p);
+        sv.setPoseMessage(&p);
+        boost::apply_visitor(sv, sm);
+      }
     }
+    entry.version_ = obj->version_;
   }
-  if (!co.primitives.empty() || !co.meshes.empty() || !co.planes.empty())
+
+  const moveit_msgs::CollisionObject &cached = entry.msg_;
+  if (!cached.primitives.empty() || !cached.meshes.empty() || !cached.planes.empty())
   {
+    scene_msg.world.collision_objects.push_back(cached);
+    moveit_msgs::CollisionObject &co = scene_msg.world.collision_objects.back();
+    co.header.frame_id = getPlanningFrame();
     if (hasObjectType(co.id))
       co.type = getObjectType(co.id);
-    scene_msg.world.collision_objects.push_back(co);
   }
 }
 
@@ -854,6 +1192,14 @@ void planning_scene::PlanningScene::getPlanningSceneMsgCollisionObjects(moveit_m
   for (std::size_t i = 0 ; i < ns.size() ; ++i)
     if (ns[i] != COLLISION_MAP_NS && ns[i] != OCTOMAP_NS)
       getPlanningSceneMsgCollisionObject(scene_msg, ns[i]);
+
+  // forget the messages of objects that are no longer in the world
+  boost::mutex::scoped_lock slock(collision_object_msgs_lock_);
+  for (std::map<std::string, CollisionObjectMsgCacheEntry>::iterator it = collision_object_msgs_.begin() ; it != collision_object_msgs_.end() ; )
+    if (world_->hasObject(it->first))
+      ++it;
+    else
+      collision_object_msgs_.erase(it++);
 }
 
 void planning_scene::PlanningScene::getPlanningSceneMsgCollisionMap(moveit_msgs::PlanningScene &scene_msg) const
@@ -1025,8 +1371,10 @@ void planning_scene::PlanningScene::saveGeometryToStream(std::ostream &out) cons
 
 void planning_scene::PlanningScene::loadGeometryFromStream(std::istream &in)
 {
+  invalidateSnapshot();
   if (!in.good() || in.eof())
     return;
+  collision_detection::WorldUpdateBatch batch(*world_);
   std::getline(in, name_);
   do
   {
@@ -1068,133 +1416,533 @@ void planning_scene::PlanningScene::loadGeometryFromStream(std::istream &in)
   } while (true);
 }
 
-void planning_scene::PlanningScene::setCurrentState(const moveit_msgs::RobotState &state)
+namespace planning_scene
+{
+namespace
 {
-  if (parent_)
-  {
-    if (!kstate_)
-    {
-      kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
-      kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
-    }
-    else
-      // attached bodies are sent fully, so we need to clear old ones, if any
-      kstate_->clearAttachedBodies();
-    robot_state::robotStateMsgToRobotState(getTransforms(), state, *kstate_);
-  }
-  else
-  {
-    // attached bodies are sent fully, so we need to clear old ones, if any
-    kstate_->clearAttachedBodies();
-    robot_state::robotStateMsgToRobotState(*ftf_, state, *kstate_);
-  }
 
-  // we add object types to the planning scene, if any are specified
-  for (std::size_t i = 0 ; i < state.attached_collision_objects.size() ; ++i)
-  {
-    const moveit_msgs::CollisionObject &o = state.attached_collision_objects[i].object;
-    if (!o.id.empty() && (!o.type.db.empty() || !o.type.key.empty()))
-      setObjectType(o.id, o.type);
-  }
-}
+// layout of the binary geometry format:
+//   header: MAGIC, uint32 version, uint32 byte order mark, scene name
+//   objects: uint8 1, object id, uint32 shape count, shapes; the list ends with uint8 0
+//   shape: uint32 type, 7 doubles for the pose (x y z qx qy qz qw), 4 floats for the color, then the type specific data
+//   strings: uint32 length, then the characters
+const char BINARY_GEOMETRY_MAGIC[8] = { 'M', 'V', 'S', 'C', 'E', 'N', 'E', 'B' };
+const boost::uint32_t BINARY_GEOMETRY_VERSION = 1;
+const boost::uint32_t BINARY_GEOMETRY_BYTE_ORDER = 0x01020304;
 
-void planning_scene::PlanningScene::setCurrentState(const robot_state::RobotState &state)
+template<typename T>
+void writeBinary(std::ostream &out, const T &value)
 {
-  getCurrentStateNonConst() = state;
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
 }
 
-void planning_scene::PlanningScene::decoupleParent()
+void writeBinary(std::ostream &out, const std::string &value)
 {
-  if (!parent_)
-    return;
-
-  if (!ftf_)
-  {
-    ftf_.reset(new SceneTransforms(this));
-    ftf_->setAllTransforms(parent_->getTransforms().getAllTransforms());
-  }
+  writeBinary(out, (boost::uint32_t)value.size());
+  out.write(value.data(), value.size());
+}
 
-  if (!kstate_)
-  {
-    kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
-    kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
-  }
+bool isBinaryGeometrySupported(const shapes::Shape *shape)
+{
+  return shape && (shape->type == shapes::SPHERE || shape->type == shapes::CYLINDER || shape->type == shapes::CONE ||
+                   shape->type == shapes::BOX || shape->type == shapes::PLANE || shape->type == shapes::MESH);
+}
 
-  if (!acm_)
-    acm_.reset(new collision_detection::AllowedCollisionMatrix(parent_->getAllowedCollisionMatrix()));
+void writeBinaryGeometryHeader(std::ostream &out, const std::string &name)
+{
+  out.write(BINARY_GEOMETRY_MAGIC, sizeof(BINARY_GEOMETRY_MAGIC));
+  writeBinary(out, BINARY_GEOMETRY_VERSION);
+  writeBinary(out, BINARY_GEOMETRY_BYTE_ORDER);
+  writeBinary(out, name);
+}
 
-  for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
+void writeBinaryGeometryShape(std::ostream &out, const shapes::Shape *shape, const Eigen::Affine3d &pose, const float color[4])
+{
+  writeBinary(out, (boost::uint32_t)shape->type);
+  Eigen::Quaterniond q(pose.rotation());
+  const double p[7] = { pose.translation().x(), pose.translation().y(), pose.translation().z(), q.x(), q.y(), q.z(), q.w() };
+  out.write(reinterpret_cast<const char*>(p), sizeof(p));
+  out.write(reinterpret_cast<const char*>(color), 4 * sizeof(float));
+  switch (shape->type)
   {
-    if (!it->second->crobot_)
+  case shapes::SPHERE:
+    writeBinary(out, static_cast<const shapes::Sphere*>(shape)->radius);
+    break;
+  case shapes::CYLINDER:
+    writeBinary(out, static_cast<const shapes::Cylinder*>(shape)->radius);
+    writeBinary(out, static_cast<const shapes::Cylinder*>(shape)->length);
+    break;
+  case shapes::CONE:
+    writeBinary(out, static_cast<const shapes::Cone*>(shape)->radius);
+    writeBinary(out, static_cast<const shapes::Cone*>(shape)->length);
+    break;
+  case shapes::BOX:
+    out.write(reinterpret_cast<const char*>(static_cast<const shapes::Box*>(shape)->size), 3 * sizeof(double));
+    break;
+  case shapes::PLANE:
     {
-      it->second->crobot_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobot());
-      it->second->crobot_const_ = it->second->crobot_;
+      const shapes::Plane *plane = static_cast<const shapes::Plane*>(shape);
+      const double coef[4] = { plane->a, plane->b, plane->c, plane->d };
+      out.write(reinterpret_cast<const char*>(coef), sizeof(coef));
     }
-    if (!it->second->crobot_unpadded_)
+    break;
+  case shapes::MESH:
     {
-      it->second->crobot_unpadded_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobotUnpadded());
-      it->second->crobot_unpadded_const_ = it->second->crobot_unpadded_;
+      const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+      writeBinary(out, (boost::uint32_t)mesh->vertex_count);
+      writeBinary(out, (boost::uint32_t)mesh->triangle_count);
+      out.write(reinterpret_cast<const char*>(mesh->vertices), 3 * mesh->vertex_count * sizeof(double));
+      out.write(reinterpret_cast<const char*>(mesh->triangles), 3 * mesh->triangle_count * sizeof(unsigned int));
     }
-    it->second->parent_.reset();
+    break;
+  default:
+    break;
   }
-  world_diff_.reset();
+}
 
-  if (!object_colors_)
+// reads values from a block of memory, failing once the end is reached
+class BinaryGeometryReader
+{
+public:
+
+  BinaryGeometryReader(const char *data, std::size_t size) : data_(data), size_(size), pos_(0)
   {
-    ObjectColorMap kc;
-    parent_->getKnownObjectColors(kc);
-    object_colors_.reset(new ObjectColorMap(kc));
   }
-  else
+
+  bool read(void *dest, std::size_t n)
   {
-    ObjectColorMap kc;
-    parent_->getKnownObjectColors(kc);
-    for (ObjectColorMap::const_iterator it = kc.begin() ; it != kc.end() ; ++it)
-      if (object_colors_->find(it->first) == object_colors_->end())
-        (*object_colors_)[it->first] = it->second;
+    if (n > size_ - pos_)
+      return false;
+    memcpy(dest, data_ + pos_, n);
+    pos_ += n;
+    return true;
   }
 
-  if (!object_types_)
+  template<typename T>
+  bool read(T &value)
   {
-    ObjectTypeMap kc;
-    parent_->getKnownObjectTypes(kc);
-    object_types_.reset(new ObjectTypeMap(kc));
+    return read(&value, sizeof(T));
   }
-  else
+
+  bool read(std::string &value)
   {
-    ObjectTypeMap kc;
-    parent_->getKnownObjectTypes(kc);
-    for (ObjectTypeMap::const_iterator it = kc.begin() ; it != kc.end() ; ++it)
-      if (object_types_->find(it->first) == object_types_->end())
-        (*object_types_)[it->first] = it->second;
+    boost::uint32_t n;
+    if (!read(n) || n > size_ - pos_)
+      return false;
+    value.assign(data_ + pos_, n);
+    pos_ += n;
+    return true;
   }
 
-  parent_.reset();
-}
-
-void planning_scene::PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::PlanningScene &scene_msg)
-{
-  logDebug("Adding planning scene diff");
-  if (!scene_msg.name.empty())
-    name_ = scene_msg.name;
-
-  if (!scene_msg.robot_model_name.empty() && scene_msg.robot_model_name != getRobotModel()->getName())
-    logWarn("Setting the scene for model '%s' but model '%s' is loaded.", scene_msg.robot_model_name.c_str(), getRobotModel()->getName().c_str());
-
-  // there is at least one transform in the list of fixed transform: from model frame to itself;
-  // if the list is empty, then nothing has been set
-  if (!scene_msg.fixed_frame_transforms.empty())
+  /** \brief The number of bytes left to read */
+  std::size_t remaining() const
   {
-    if (!ftf_)
-      ftf_.reset(new SceneTransforms(this));
-    ftf_->setTransforms(scene_msg.fixed_frame_transforms);
+    return size_ - pos_;
   }
 
-  // if at least some joints have been specified, we set them
-  if (!scene_msg.robot_state.multi_dof_joint_state.joint_names.empty() ||
-      !scene_msg.robot_state.joint_state.name.empty() ||
-      !scene_msg.robot_state.attached_collision_objects.empty())
-    setCurrentState(scene_msg.robot_state);
+private:
+
+  const char  *data_;
+  std::size_t  size_;
+  std::size_t  pos_;
+};
+
+// return NULL if the data is truncated or invalid, or the shape type is not known
+shapes::Shape* readBinaryGeometryShape(BinaryGeometryReader &reader, Eigen::Affine3d &pose, float color[4])
+{
+  boost::uint32_t type;
+  double p[7];
+  if (!reader.read(type) || !reader.read(p, sizeof(p)) || !reader.read(color, 4 * sizeof(float)))
+    return NULL;
+  pose = Eigen::Translation3d(p[0], p[1], p[2]) * Eigen::Quaterniond(p[6], p[3], p[4], p[5]);
+
+  switch (type)
+  {
+  case shapes::SPHERE:
+    {
+      double r;
+      if (reader.read(r))
+        return new shapes::Sphere(r);
+    }
+    break;
+  case shapes::CYLINDER:
+    {
+      double r, l;
+      if (reader.read(r) && reader.read(l))
+        return new shapes::Cylinder(r, l);
+    }
+    break;
+  case shapes::CONE:
+    {
+      double r, l;
+      if (reader.read(r) && reader.read(l))
+        return new shapes::Cone(r, l);
+    }
+    break;
+  case shapes::BOX:
+    {
+      double size[3];
+      if (reader.read(size, sizeof(size)))
+        return new shapes::Box(size[0], size[1], size[2]);
+    }
+    break;
+  case shapes::PLANE:
+    {
+      double coef[4];
+      if (reader.read(coef, sizeof(coef)))
+        return new shapes::Plane(coef[0], coef[1], coef[2], coef[3]);
+    }
+    break;
+  case shapes::MESH:
+    {
+      boost::uint32_t vertex_count, triangle_count;
+      if (!reader.read(vertex_count) || !reader.read(triangle_count))
+        break;
+      // the counts are checked against the data before the mesh is allocated
+      const std::size_t vertex_bytes = 3 * (std::size_t)vertex_count * sizeof(double);
+      const std::size_t triangle_bytes = 3 * (std::size_t)triangle_count * sizeof(unsigned int);
+      if (vertex_bytes > reader.remaining() || triangle_bytes > reader.remaining() - vertex_bytes)
+      {
+        logError("Mesh of %u vertices and %u triangles exceeds the binary scene geometry", vertex_count, triangle_count);
+        break;
+      }
+      shapes::Mesh *mesh = new shapes::Mesh(vertex_count, triangle_count);
+      reader.read(mesh->vertices, vertex_bytes);
+      reader.read(mesh->triangles, triangle_bytes);
+      for (std::size_t i = 0 ; i < 3 * (std::size_t)triangle_count ; ++i)
+        if (mesh->triangles[i] >= vertex_count)
+        {
+          logError("Mesh triangle refers to vertex %u of %u in binary scene geometry", mesh->triangles[i], vertex_count);
+          delete mesh;
+          return NULL;
+        }
+      mesh->computeTriangleNormals();
+      mesh->computeVertexNormals();
+      return mesh;
+    }
+  default:
+    logError("Unknown shape type (%u) in binary scene geometry", (unsigned int)type);
+    break;
+  }
+  return NULL;
+}
+
+}
+}
+
+void planning_scene::PlanningScene::saveGeometryToBinaryStream(std::ostream &out) const
+{
+  writeBinaryGeometryHeader(out, name_);
+  const std::vector<std::string> &ns = world_->getObjectIds();
+  for (std::size_t i = 0 ; i < ns.size() ; ++i)
+    if (ns[i] != COLLISION_MAP_NS && ns[i] != OCTOMAP_NS)
+    {
+      collision_detection::CollisionWorld::ObjectConstPtr obj = world_->getObject(ns[i]);
+      if (!obj)
+        continue;
+      float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      if (hasObjectColor(ns[i]))
+      {
+        const std_msgs::ColorRGBA &c = getObjectColor(ns[i]);
+        color[0] = c.r; color[1] = c.g; color[2] = c.b; color[3] = c.a;
+      }
+      boost::uint32_t count = 0;
+      for (std::size_t j = 0 ; j < obj->shapes_.size() ; ++j)
+        if (isBinaryGeometrySupported(obj->shapes_[j].get()))
+          count++;
+      writeBinary(out, (boost::uint8_t)1);
+      writeBinary(out, ns[i]);
+      writeBinary(out, count);
+      for (std::size_t j = 0 ; j < obj->shapes_.size() ; ++j)
+        if (isBinaryGeometrySupported(obj->shapes_[j].get()))
+          writeBinaryGeometryShape(out, obj->shapes_[j].get(), obj->shape_poses_[j], color);
+    }
+  writeBinary(out, (boost::uint8_t)0);
+}
+
+bool planning_scene::PlanningScene::loadGeometryFromBinaryData(const char *data, std::size_t size)
+{
+  invalidateSnapshot();
+  BinaryGeometryReader reader(data, size);
+  char magic[sizeof(BINARY_GEOMETRY_MAGIC)];
+  boost::uint32_t version, byte_order;
+  if (!reader.read(magic, sizeof(magic)) || memcmp(magic, BINARY_GEOMETRY_MAGIC, sizeof(magic)) != 0 ||
+      !reader.read(version) || !reader.read(byte_order))
+  {
+    logError("The data does not contain scene geometry in binary format");
+    return false;
+  }
+  if (version != BINARY_GEOMETRY_VERSION || byte_order != BINARY_GEOMETRY_BYTE_ORDER)
+  {
+    logError("Scene geometry in binary format version %u cannot be read (or was written on a machine with different byte order)",
+             (unsigned int)version);
+    return false;
+  }
+  std::string name;
+  if (!reader.read(name))
+    return false;
+  name_ = name;
+  collision_detection::WorldUpdateBatch batch(*world_);
+
+  while (true)
+  {
+    boost::uint8_t tag;
+    if (!reader.read(tag))
+      break;
+    if (tag == 0)
+      return true;
+    std::string ns;
+    boost::uint32_t shape_count;
+    if (!reader.read(ns) || !reader.read(shape_count))
+      break;
+    for (boost::uint32_t i = 0 ; i < shape_count ; ++i)
+    {
+      Eigen::Affine3d pose;
+      float c[4];
+      shapes::Shape *s = readBinaryGeometryShape(reader, pose, c);
+      if (!s)
+      {
+        logError("Truncated or corrupt scene geometry in binary format");
+        return false;
+      }
+      world_->addToObject(ns, shapes::ShapePtr(s), pose);
+      if (c[0] > 0.0f || c[1] > 0.0f || c[2] > 0.0f || c[3] > 0.0f)
+      {
+        std_msgs::ColorRGBA color;
+        color.r = c[0]; color.g = c[1]; color.b = c[2]; color.a = c[3];
+        setObjectColor(ns, color);
+      }
+    }
+  }
+  logError("Truncated scene geometry in binary format");
+  return false;
+}
+
+bool planning_scene::PlanningScene::loadGeometryFromBinaryStream(std::istream &in)
+{
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  return loadGeometryFromBinaryData(data.data(), data.size());
+}
+
+bool planning_scene::PlanningScene::loadGeometryFromBinaryFile(const std::string &path)
+{
+  boost::iostreams::mapped_file_source file;
+  try
+  {
+    file.open(path);
+  }
+  catch (std::ios_base::failure &ex)
+  {
+    logError("Unable to map scene geometry file '%s': %s", path.c_str(), ex.what());
+    return false;
+  }
+  bool result = loadGeometryFromBinaryData(file.data(), file.size());
+  file.close();
+  return result;
+}
+
+bool planning_scene::PlanningScene::convertGeometryTextToBinary(std::istream &in, std::ostream &out)
+{
+  // this follows loadGeometryFromStream(), writing the shapes instead of adding them to a world
+  if (!in.good() || in.eof())
+    return false;
+  std::string name;
+  std::getline(in, name);
+  writeBinaryGeometryHeader(out, name);
+  do
+  {
+    std::string marker;
+    in >> marker;
+    if (!in.good() || in.eof() || marker != "*")
+      break;
+    std::string ns;
+    std::getline(in, ns);
+    if (!in.good() || in.eof())
+      break;
+    unsigned int shape_count;
+    in >> shape_count;
+    std::vector<shapes::ShapePtr> shapes;
+    EigenSTL::vector_Affine3d poses;
+    std::vector<float> colors;
+    for (std::size_t i = 0 ; i < shape_count && in.good() && !in.eof() ; ++i)
+    {
+      shapes::Shape *s = shapes::constructShapeFromText(in);
+      double x, y, z, rx, ry, rz, rw;
+      in >> x >> y >> z;
+      in >> rx >> ry >> rz >> rw;
+      float c[4];
+      in >> c[0] >> c[1] >> c[2] >> c[3];
+      if (isBinaryGeometrySupported(s))
+      {
+        shapes.push_back(shapes::ShapePtr(s));
+        poses.push_back(Eigen::Translation3d(x, y, z) * Eigen::Quaterniond(rw, rx, ry, rz));
+        colors.insert(colors.end(), c, c + 4);
+      }
+      else
+        delete s;
+    }
+    writeBinary(out, (boost::uint8_t)1);
+    writeBinary(out, ns);
+    writeBinary(out, (boost::uint32_t)shapes.size());
+    for (std::size_t i = 0 ; i < shapes.size() ; ++i)
+      writeBinaryGeometryShape(out, shapes[i].get(), poses[i], &colors[4 * i]);
+  } while (true);
+  writeBinary(out, (boost::uint8_t)0);
+  return out.good();
+}
+
+void planning_scene::PlanningScene::setCurrentState(const moveit_msgs::RobotState &state)
+{
+  invalidateSnapshot();
+  if (parent_)
+  {
+    if (!kstate_)
+    {
+      kstate_.reset(new robot_state::RobotState(data_parent_->getCurrentState()));
+      kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
+    }
+    else
+      // attached bodies are sent fully, so we need to clear old ones, if any
+      kstate_->clearAttachedBodies();
+    robot_state::robotStateMsgToRobotState(getTransforms(), state, *kstate_);
+  }
+  else
+  {
+    // attached bodies are sent fully, so we need to clear old ones, if any
+    kstate_->clearAttachedBodies();
+    robot_state::robotStateMsgToRobotState(*ftf_, state, *kstate_);
+  }
+
+  // we add object types to the planning scene, if any are specified
+  for (std::size_t i = 0 ; i < state.attached_collision_objects.size() ; ++i)
+  {
+    const moveit_msgs::CollisionObject &o = state.attached_collision_objects[i].object;
+    if (!o.id.empty() && (!o.type.db.empty() || !o.type.key.empty()))
+      setObjectType(o.id, o.type);
+  }
+}
+
+void planning_scene::PlanningScene::setCurrentState(const robot_state::RobotState &state)
+{
+  invalidateSnapshot();
+  getCurrentStateNonConst() = state;
+}
+
+void planning_scene::PlanningScene::flatten()
+{
+  invalidateSnapshot();
+  if (!parent_)
+    return;
+
+  // the snapshot reads nothing from other scenes; the data modified here stays local, so only those changes are diffs
+  data_parent_ = parent_->getSnapshot();
+  for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
+  {
+    CollisionDetectorConstIterator jt = data_parent_->collision_.find(it->first);
+    if (jt != data_parent_->collision_.end())
+      it->second->parent_ = jt->second;
+  }
+  diff_depth_ = 1;
+}
+
+void planning_scene::PlanningScene::decoupleParent()
+{
+  invalidateSnapshot();
+  if (!parent_)
+    return;
+
+  if (!ftf_)
+  {
+    ftf_.reset(new SceneTransforms(this));
+    ftf_->setTransformsSnapshot(data_parent_->getTransforms().getTransformsSnapshot());
+  }
+
+  if (!kstate_)
+  {
+    kstate_.reset(new robot_state::RobotState(data_parent_->getCurrentState()));
+    kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
+  }
+
+  if (!acm_)
+    acm_.reset(new collision_detection::AllowedCollisionMatrix(data_parent_->getAllowedCollisionMatrix()));
+
+  for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
+  {
+    if (!it->second->crobot_)
+    {
+      it->second->crobot_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobot());
+      it->second->crobot_const_ = it->second->crobot_;
+    }
+    if (!it->second->crobot_unpadded_)
+    {
+      it->second->crobot_unpadded_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobotUnpadded());
+      it->second->crobot_unpadded_const_ = it->second->crobot_unpadded_;
+    }
+  }
+
+  if (!object_colors_)
+  {
+    ObjectColorMap kc;
+    data_parent_->getKnownObjectColors(kc);
+    object_colors_.reset(new ObjectColorMap(kc));
+  }
+  else
+  {
+    ObjectColorMap kc;
+    data_parent_->getKnownObjectColors(kc);
+    for (ObjectColorMap::const_iterator it = kc.begin() ; it != kc.end() ; ++it)
+      if (object_colors_->find(it->first) == object_colors_->end())
+        (*object_colors_)[it->first] = it->second;
+  }
+
+  if (!object_types_)
+  {
+    ObjectTypeMap kc;
+    data_parent_->getKnownObjectTypes(kc);
+    object_types_.reset(new ObjectTypeMap(kc));
+  }
+  else
+  {
+    ObjectTypeMap kc;
+    data_parent_->getKnownObjectTypes(kc);
+    for (ObjectTypeMap::const_iterator it = kc.begin() ; it != kc.end() ; ++it)
+      if (object_types_->find(it->first) == object_types_->end())
+        (*object_types_)[it->first] = it->second;
+  }
+
+  for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
+    it->second->parent_.reset();
+  world_diff_.reset();
+  parent_.reset();
+  data_parent_.reset();
+  diff_depth_ = 0;
+}
+
+void planning_scene::PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::PlanningScene &scene_msg)
+{
+  MOVEIT_TRACE_SCOPE("PlanningScene::setPlanningSceneDiffMsg");
+  invalidateSnapshot();
+  logDebug("Adding planning scene diff");
+  if (!scene_msg.name.empty())
+    name_ = scene_msg.name;
+
+  if (!scene_msg.robot_model_name.empty() && scene_msg.robot_model_name != getRobotModel()->getName())
+    logWarn("Setting the scene for model '%s' but model '%s' is loaded.", scene_msg.robot_model_name.c_str(), getRobotModel()->getName().c_str());
+
+  // there is at least one transform in the list of fixed transform: from model frame to itself;
+  // if the list is empty, then nothing has been set
+  if (!scene_msg.fixed_frame_transforms.empty())
+  {
+    if (!ftf_)
+      ftf_.reset(new SceneTransforms(this));
+    ftf_->setTransforms(scene_msg.fixed_frame_transforms);
+  }
+
+  // if at least some joints have been specified, we set them
+  if (!scene_msg.robot_state.multi_dof_joint_state.joint_names.empty() ||
+      !scene_msg.robot_state.joint_state.name.empty() ||
+      !scene_msg.robot_state.attached_collision_objects.empty())
+    setCurrentState(scene_msg.robot_state);
 
   // if at least some links are mentioned in the allowed collision matrix, then we have an update
   if (!scene_msg.allowed_collision_matrix.entry_names.empty())
@@ -1222,9 +1970,11 @@ void planning_scene::PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::P
       setObjectColor(scene_msg.object_colors[i].id, scene_msg.object_colors[i].color);
   }
 
+  // the changes to the world reach the collision detectors at the end
+  collision_detection::WorldUpdateBatch batch(*world_);
+
   // process collision object updates
-  for (std::size_t i = 0 ; i < scene_msg.world.collision_objects.size() ; ++i)
-    processCollisionObjectMsg(scene_msg.world.collision_objects[i]);
+  processCollisionObjectMsgs(scene_msg.world.collision_objects);
 
   // if an octomap was specified, replace the one we have with that one
   if (!scene_msg.world.octomap.octomap.data.empty())
@@ -1237,6 +1987,8 @@ void planning_scene::PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::P
 
 void planning_scene::PlanningScene::setPlanningSceneMsg(const moveit_msgs::PlanningScene &scene_msg)
 {
+  MOVEIT_TRACE_SCOPE("PlanningScene::setPlanningSceneMsg");
+  invalidateSnapshot();
   logDebug("Setting new planning scene: '%s'", scene_msg.name.c_str());
   name_ = scene_msg.name;
 
@@ -1263,20 +2015,25 @@ void planning_scene::PlanningScene::setPlanningSceneMsg(const moveit_msgs::Plann
   object_colors_.reset(new ObjectColorMap());
   for (std::size_t i = 0 ; i < scene_msg.object_colors.size() ; ++i)
     setObjectColor(scene_msg.object_colors[i].id, scene_msg.object_colors[i].color);
+  collision_detection::WorldUpdateBatch batch(*world_);
   world_->clearObjects();
   processPlanningSceneWorldMsg(scene_msg.world);
 }
 
 void planning_scene::PlanningScene::processPlanningSceneWorldMsg(const moveit_msgs::PlanningSceneWorld &world)
 {
-  for (std::size_t i = 0 ; i < world.collision_objects.size() ; ++i)
-    processCollisionObjectMsg(world.collision_objects[i]);
+  MOVEIT_TRACE_SCOPE("PlanningScene::processPlanningSceneWorldMsg");
+  invalidateSnapshot();
+  // the changes to the world reach the collision detectors at the end
+  collision_detection::WorldUpdateBatch batch(*world_);
+  processCollisionObjectMsgs(world.collision_objects);
   processOctomapMsg(world.octomap);
   processCollisionMapMsg(world.collision_map);
 }
 
 void planning_scene::PlanningScene::usePlanningSceneMsg(const moveit_msgs::PlanningScene &scene_msg)
 {
+  invalidateSnapshot();
   if (scene_msg.is_diff)
     setPlanningSceneDiffMsg(scene_msg);
   else
@@ -1285,6 +2042,7 @@ void planning_scene::PlanningScene::usePlanningSceneMsg(const moveit_msgs::Plann
 
 void planning_scene::PlanningScene::processCollisionMapMsg(const moveit_msgs::CollisionMap &map)
 {
+  invalidateSnapshot();
   // each collision map replaces any previous one
   world_->removeObject(COLLISION_MAP_NS);
 
@@ -1300,8 +2058,178 @@ void planning_scene::PlanningScene::processCollisionMapMsg(const moveit_msgs::Co
   }
 }
 
+boost::shared_ptr<const octomap::OcTree> planning_scene::PlanningScene::OctomapFilter::apply(const boost::shared_ptr<const octomap::OcTree> &octree,
+                                                                                             const Eigen::Affine3d &t) const
+{
+  if (!octree || !active())
+    return octree;
+  return filter(*octree, t);
+}
+
+void planning_scene::PlanningScene::OctomapFilter::getCropBounds(const Eigen::Affine3d &t, octomap::point3d &bmin, octomap::point3d &bmax) const
+{
+  Eigen::Affine3d inv = t.inverse();
+  Eigen::Vector3d lo = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d hi = -lo;
+  for (int i = 0 ; i < 8 ; ++i)
+  {
+    Eigen::Vector3d corner(i & 1 ? max_.x() : min_.x(), i & 2 ? max_.y() : min_.y(), i & 4 ? max_.z() : min_.z());
+    corner = inv * corner;
+    lo = lo.cwiseMin(corner);
+    hi = hi.cwiseMax(corner);
+  }
+  bmin = octomap::point3d(lo.x(), lo.y(), lo.z());
+  bmax = octomap::point3d(hi.x(), hi.y(), hi.z());
+}
+
+boost::shared_ptr<octomap::OcTree> planning_scene::PlanningScene::OctomapFilter::filter(const octomap::OcTree &octree, const Eigen::Affine3d &t) const
+{
+  // the copy keeps the pruned regions of the octree; cells are removed from it by whole nodes
+  boost::shared_ptr<octomap::OcTree> result(new octomap::OcTree(octree));
+  if (crop_ && result->getRoot())
+  {
+    // the part of the octree to keep, in the frame of the octree
+    octomap::point3d bmin, bmax;
+    getCropBounds(t, bmin, bmax);
+    const octomap::key_type root = (octomap::key_type)(1 << (octree.getTreeDepth() - 1));
+    const octomap::OcTreeKey root_key(root, root, root);
+    const int where = cellsInBox(result->keyToCoord(root_key, 0), result->getNodeSize(0) / 2.0, result->getResolution(), bmin, bmax);
+    if (where < 0)
+      result->clear();
+    else
+      if (where == 0)
+        for (unsigned int i = 0 ; i < 8 ; ++i)
+        {
+          octomap::OcTreeKey child;
+          octomap::computeChildKey(i, root >> 1, root_key, child);
+          cropOctreeNode(*result, child, 1, bmin, bmax);
+        }
+  }
+  if (prune_free_)
+  {
+    // free leaves are removed at their depth
+    std::vector<std::pair<octomap::OcTreeKey, unsigned int> > free_leaves;
+    for (octomap::OcTree::leaf_iterator it = result->begin_leafs(), end = result->end_leafs() ; it != end ; ++it)
+      if (!result->isNodeOccupied(*it))
+        free_leaves.push_back(std::make_pair(it.getKey(), it.getDepth()));
+    for (std::size_t i = 0 ; i < free_leaves.size() ; ++i)
+      result->deleteNode(free_leaves[i].first, free_leaves[i].second);
+  }
+  result->updateInnerOccupancy();
+  result->prune();
+  return result;
+}
+
+void planning_scene::PlanningScene::OctomapFilter::update(const octomap::OcTree &octree, const Eigen::Affine3d &t, const octomap::KeySet &keys,
+                                                         octomap::OcTree &result) const
+{
+  octomap::point3d bmin, bmax;
+  if (crop_)
+    getCropBounds(t, bmin, bmax);
+  const double tolerance = octree.getResolution() / 2.0;
+
+  // the cells are kept or dropped by the same rules filter() applies
+  for (octomap::KeySet::const_iterator it = keys.begin() ; it != keys.end() ; ++it)
+  {
+    const octomap::OcTreeNode *node = octree.search(*it);
+    bool keep = node && (!prune_free_ || octree.isNodeOccupied(node));
+    if (keep && crop_)
+    {
+      octomap::point3d p = octree.keyToCoord(*it);
+      keep = p.x() >= bmin.x() - tolerance && p.x() <= bmax.x() + tolerance &&
+             p.y() >= bmin.y() - tolerance && p.y() <= bmax.y() + tolerance &&
+             p.z() >= bmin.z() - tolerance && p.z() <= bmax.z() + tolerance;
+    }
+    if (keep)
+      result.setNodeValue(*it, node->getLogOdds(), true);
+    else
+      result.deleteNode(*it);
+  }
+  result.updateInnerOccupancy();
+}
+
+void planning_scene::PlanningScene::OctomapFilter::updateResult(const octomap::OcTree &source, const Eigen::Affine3d &t)
+{
+  octomap::KeySet changed;
+  for (octomap::KeyBoolMap::const_iterator it = source.changedKeysBegin() ; it != source.changedKeysEnd() ; ++it)
+    changed.insert(it->first);
+
+  // result_ is in the world (and in collision snapshots other threads may be using), so it is not modified. Once the
+  // previous result is released by all of them, it only misses the cells changed for result_, so updating it is as
+  // cheap as updating a copy of result_, without copying the whole tree
+  if (spare_ && spare_.unique())
+  {
+    spare_pending_.insert(changed.begin(), changed.end());
+    update(source, t, spare_pending_, *spare_);
+    spare_.swap(result_);
+  }
+  else
+  {
+    boost::shared_ptr<octomap::OcTree> result(new octomap::OcTree(*result_));
+    update(source, t, changed, *result);
+    spare_ = result_;
+    result_ = result;
+  }
+  spare_pending_.swap(changed);
+}
+
+planning_scene::PlanningScene::OctomapFilter& planning_scene::PlanningScene::getOctomapFilterNonConst()
+{
+  if (!octomap_filter_)
+    octomap_filter_.reset(new OctomapFilter());
+  octomap_filter_->source_.reset();
+  octomap_filter_->result_.reset();
+  octomap_filter_->spare_.reset();
+  octomap_filter_->spare_pending_.clear();
+  return *octomap_filter_;
+}
+
+void planning_scene::PlanningScene::setOctomapBounds(const Eigen::Vector3d &min, const Eigen::Vector3d &max)
+{
+  OctomapFilter &filter = getOctomapFilterNonConst();
+  filter.crop_ = true;
+  filter.min_ = min.cwiseMin(max);
+  filter.max_ = min.cwiseMax(max);
+}
+
+void planning_scene::PlanningScene::setOctomapBoundsFromRobot(double padding)
+{
+  std::vector<double> aabb;
+  getCurrentState().computeAABB(aabb);
+  setOctomapBounds(Eigen::Vector3d(aabb[0] - padding, aabb[2] - padding, aabb[4] - padding),
+                   Eigen::Vector3d(aabb[1] + padding, aabb[3] + padding, aabb[5] + padding));
+}
+
+void planning_scene::PlanningScene::clearOctomapBounds()
+{
+  if (octomap_filter_)
+    getOctomapFilterNonConst().crop_ = false;
+}
+
+bool planning_scene::PlanningScene::getOctomapBounds(Eigen::Vector3d &min, Eigen::Vector3d &max) const
+{
+  if (!octomap_filter_ || !octomap_filter_->crop_)
+    return false;
+  min = octomap_filter_->min_;
+  max = octomap_filter_->max_;
+  return true;
+}
+
+void planning_scene::PlanningScene::setOctomapPruneFree(bool flag)
+{
+  if (flag || octomap_filter_)
+    getOctomapFilterNonConst().prune_free_ = flag;
+}
+
+bool planning_scene::PlanningScene::getOctomapPruneFree() const
+{
+  return octomap_filter_ && octomap_filter_->prune_free_;
+}
+
 void planning_scene::PlanningScene::processOctomapMsg(const octomap_msgs::Octomap &map)
 {
+  MOVEIT_TRACE_SCOPE("PlanningScene::processOctomapMsg");
+  invalidateSnapshot();
   // each octomap replaces any previous one
   world_->removeObject(OCTOMAP_NS);
 
@@ -1318,16 +2246,19 @@ void planning_scene::PlanningScene::processOctomapMsg(const octomap_msgs::Octoma
   if (!map.header.frame_id.empty())
   {
     const Eigen::Affine3d &t = getTransforms().getTransform(map.header.frame_id);
-    world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(om)), t);
+    world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(octomap_filter_ ? octomap_filter_->apply(om, t) : om)), t);
   }
   else
   {
-    world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(om)), Eigen::Affine3d::Identity());
+    world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(octomap_filter_ ? octomap_filter_->apply(om, Eigen::Affine3d::Identity()) : om)),
+                        Eigen::Affine3d::Identity());
   }
 }
 
 void planning_scene::PlanningScene::processOctomapMsg(const octomap_msgs::OctomapWithPose &map)
 {
+  MOVEIT_TRACE_SCOPE("PlanningScene::processOctomapMsg");
+  invalidateSnapshot();
   // each octomap replaces any previous one
   world_->removeObject(OCTOMAP_NS);
 
@@ -1345,11 +2276,185 @@ void planning_scene::PlanningScene::processOctomapMsg(const octomap_msgs::Octoma
   Eigen::Affine3d p;
   tf::poseMsgToEigen(map.origin, p);
   p = t * p;
-  world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(om)), p);
+  world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(octomap_filter_ ? octomap_filter_->apply(om, p) : om)), p);
+}
+
+class planning_scene::PlanningScene::AsyncOctomap : private boost::noncopyable
+{
+public:
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  AsyncOctomap() : decoded_(false), busy_(false), stop_(false)
+  {
+    thread_ = boost::thread(boost::bind(&AsyncOctomap::run, this));
+  }
+
+  ~AsyncOctomap()
+  {
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+
+  /* Decode \e map, to be placed at \e pose and reduced by \e filter (if not NULL) */
+  void push(const octomap_msgs::OctomapWithPose &map, const Eigen::Affine3d &pose, const OctomapFilter *filter,
+            const collision_detection::CollisionWorldConstPtr &cworld)
+  {
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      // a message that was not decoded yet is replaced by the newer one
+      incoming_.reset(new octomap_msgs::OctomapWithPose(map));
+      incoming_pose_ = pose;
+      incoming_filter_.reset(filter ? new OctomapFilter(*filter) : NULL);
+      cworld_ = cworld;
+    }
+    cond_.notify_all();
+  }
+
+  /* Get the shape of the most recently decoded message (NULL if the octomap is to be removed) and its pose */
+  bool pop(shapes::ShapeConstPtr &shape, Eigen::Affine3d &pose, bool wait)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (wait)
+      while (incoming_ || busy_)
+        cond_.wait(slock);
+    if (!decoded_)
+      return false;
+    decoded_ = false;
+    shape.swap(decoded_shape_);
+    decoded_shape_.reset();
+    pose = decoded_pose_;
+    return true;
+  }
+
+private:
+
+  void run()
+  {
+    while (true)
+    {
+      boost::shared_ptr<octomap_msgs::OctomapWithPose> map;
+      Eigen::Affine3d pose;
+      boost::shared_ptr<OctomapFilter> filter;
+      collision_detection::CollisionWorldConstPtr cworld;
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        while (!stop_ && !incoming_)
+          cond_.wait(slock);
+        if (stop_)
+          return;
+        map.swap(incoming_);
+        pose = incoming_pose_;
+        filter.swap(incoming_filter_);
+        cworld.swap(cworld_);
+        busy_ = true;
+      }
+
+      shapes::ShapeConstPtr shape;
+      if (!map->octomap.data.empty())
+      {
+        if (map->octomap.id != "OcTree")
+          logError("Received ocomap is of type '%s' but type 'OcTree' is expected.", map->octomap.id.c_str());
+        else
+        {
+          boost::shared_ptr<const octomap::OcTree> om(static_cast<octomap::OcTree*>(octomap_msgs::msgToMap(map->octomap)));
+          shape.reset(new shapes::OcTree(filter ? filter->apply(om, pose) : om));
+          cworld->prepareShape(shape);
+        }
+      }
+      map.reset();
+
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        decoded_ = true;
+        decoded_shape_ = shape;
+        decoded_pose_ = pose;
+        busy_ = false;
+      }
+      cond_.notify_all();
+    }
+  }
+
+  boost::shared_ptr<octomap_msgs::OctomapWithPose> incoming_;      // the next message to decode
+  Eigen::Affine3d                                  incoming_pose_;
+  boost::shared_ptr<OctomapFilter>                 incoming_filter_;
+  collision_detection::CollisionWorldConstPtr      cworld_;        // the collision world to prepare the octree for
+  bool                                             decoded_;       // true if a decoded message was not applied yet
+  shapes::ShapeConstPtr                            decoded_shape_;
+  Eigen::Affine3d                                  decoded_pose_;
+  bool                                             busy_;
+  bool                                             stop_;
+  boost::mutex                                     lock_;
+  boost::condition_variable                        cond_;
+  boost::thread                                    thread_;
+};
+
+void planning_scene::PlanningScene::processOctomapMsgAsync(const octomap_msgs::OctomapWithPose &map)
+{
+  if (!async_octomap_)
+    async_octomap_.reset(new AsyncOctomap());
+  // the transforms of the scene are only used from this thread
+  Eigen::Affine3d p;
+  tf::poseMsgToEigen(map.origin, p);
+  p = getTransforms().getTransform(map.header.frame_id) * p;
+  async_octomap_->push(map, p, octomap_filter_.get(), getCollisionWorld());
+}
+
+bool planning_scene::PlanningScene::applyPendingOctomap(bool wait)
+{
+  shapes::ShapeConstPtr shape;
+  Eigen::Affine3d p;
+  if (!async_octomap_ || !async_octomap_->pop(shape, p, wait))
+    return false;
+
+  invalidateSnapshot();
+  if (!shape)
+  {
+    world_->removeObject(OCTOMAP_NS);
+    return true;
+  }
+
+  // add the new octree before removing the old one, so there is no moment without an octomap in the world
+  std::vector<shapes::ShapeConstPtr> previous;
+  collision_detection::CollisionWorld::ObjectConstPtr obj = world_->getObject(OCTOMAP_NS);
+  if (obj)
+    previous = obj->shapes_;
+  obj.reset();
+  world_->addToObject(OCTOMAP_NS, shape, p);
+  for (std::size_t i = 0 ; i < previous.size() ; ++i)
+    world_->removeShapeFromObject(OCTOMAP_NS, previous[i]);
+  return true;
 }
 
-void planning_scene::PlanningScene::processOctomapPtr(const boost::shared_ptr<const octomap::OcTree> &octree, const Eigen::Affine3d &t)
+void planning_scene::PlanningScene::processOctomapPtr(const boost::shared_ptr<const octomap::OcTree> &source, const Eigen::Affine3d &t)
 {
+  invalidateSnapshot();
+  // the same octree at the same pose gives the same filtered octree, which is then recognized below as already in the world
+  boost::shared_ptr<const octomap::OcTree> octree = source;
+  if (octomap_filter_ && octomap_filter_->active() && source)
+  {
+    if (octomap_filter_->result_ && octomap_filter_->source_.lock() == source &&
+        octomap_filter_->source_pose_.isApprox(t, std::numeric_limits<double>::epsilon() * 100.0) &&
+        source->isChangeDetectionEnabled())
+    {
+      // the octree was updated in place; only the cells reported by its change detection need filtering
+      if (source->numChangesDetected() > 0)
+        octomap_filter_->updateResult(*source, t);
+    }
+    else
+    {
+      octomap_filter_->result_ = octomap_filter_->filter(*source, t);
+      octomap_filter_->spare_.reset();
+      octomap_filter_->spare_pending_.clear();
+      octomap_filter_->source_ = source;
+      octomap_filter_->source_pose_ = t;
+    }
+    octree = octomap_filter_->result_;
+  }
   collision_detection::CollisionWorld::ObjectConstPtr map = world_->getObject(OCTOMAP_NS);
   if (map)
   {
@@ -1362,11 +2467,10 @@ void planning_scene::PlanningScene::processOctomapPtr(const boost::shared_ptr<co
         // if the pose changed, we update it
         if (map->shape_poses_[0].isApprox(t, std::numeric_limits<double>::epsilon() * 100.0))
         {
-          if (world_diff_)
-            world_diff_->set(OCTOMAP_NS,
-                             collision_detection::World::DESTROY |
-                             collision_detection::World::CREATE |
-                             collision_detection::World::ADD_SHAPE);
+          // the cells may have changed in place; the object stays, but observers (and the diff) learn about the update
+          shapes::ShapeConstPtr shape = map->shapes_[0];
+          map.reset();
+          world_->updateShapeInObject(OCTOMAP_NS, shape);
         }
         else
         {
@@ -1385,6 +2489,8 @@ void planning_scene::PlanningScene::processOctomapPtr(const boost::shared_ptr<co
 
 bool planning_scene::PlanningScene::processAttachedCollisionObjectMsg(const moveit_msgs::AttachedCollisionObject &object)
 {
+  MOVEIT_TRACE_SCOPE("PlanningScene::processAttachedCollisionObjectMsg");
+  invalidateSnapshot();
   if (!getRobotModel()->hasLinkModel(object.link_name))
   {
     if (object.object.operation == moveit_msgs::CollisionObject::ADD)
@@ -1408,7 +2514,7 @@ bool planning_scene::PlanningScene::processAttachedCollisionObjectMsg(const move
 
   if (!kstate_) // there must be a parent in this case
   {
-    kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
+    kstate_.reset(new robot_state::RobotState(data_parent_->getCurrentState()));
     kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
   }
 
@@ -1610,8 +2716,139 @@ bool planning_scene::PlanningScene::processAttachedCollisionObjectMsg(const move
   return false;
 }
 
+namespace
+{
+
+/* Decodes the shapes added by a list of collision object messages, one shape at a time from a shared queue */
+struct ShapeDecoding
+{
+  struct Task
+  {
+    const moveit_msgs::CollisionObject *object_;
+    std::size_t                         object_index_;
+    std::size_t                         shape_index_;
+  };
+
+  ShapeDecoding(const collision_detection::CollisionWorldConstPtr &cworld, std::vector<std::vector<shapes::ShapeConstPtr> > *decoded) :
+    cworld_(cworld), decoded_(decoded), next_(0)
+  {
+  }
+
+  void add(const moveit_msgs::CollisionObject &object, std::size_t object_index)
+  {
+    std::size_t count = object.primitives.size() + object.meshes.size() + object.planes.size();
+    (*decoded_)[object_index].resize(count);
+    for (std::size_t i = 0 ; i < count ; ++i)
+    {
+      Task t;
+      t.object_ = &object;
+      t.object_index_ = object_index;
+      t.shape_index_ = i;
+      tasks_.push_back(t);
+    }
+  }
+
+  void run()
+  {
+    while (true)
+    {
+      std::size_t k;
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        if (next_ >= tasks_.size())
+          return;
+        k = next_++;
+      }
+
+      // shapes are numbered as they are added to the world: primitives, then meshes, then planes
+      const Task &t = tasks_[k];
+      const moveit_msgs::CollisionObject &object = *t.object_;
+      std::size_t i = t.shape_index_;
+      shapes::Shape *s;
+      if (i < object.primitives.size())
+        s = shapes::constructShapeFromMsg(object.primitives[i]);
+      else if ((i -= object.primitives.size()) < object.meshes.size())
+        s = shapes::constructShapeFromMsg(object.meshes[i]);
+      else
+        s = shapes::constructShapeFromMsg(object.planes[i - object.meshes.size()]);
+      if (!s)
+        continue;
+      shapes::ShapeConstPtr shape(s);
+      cworld_->prepareShape(shape);
+      // each task writes its own element, which was allocated before the threads started
+      (*decoded_)[t.object_index_][t.shape_index_] = shape;
+    }
+  }
+
+  collision_detection::CollisionWorldConstPtr         cworld_;
+  std::vector<std::vector<shapes::ShapeConstPtr> >   *decoded_;
+  std::vector<Task>                                   tasks_;
+  std::size_t                                         next_;
+  boost::mutex                                        lock_;
+};
+
+bool addsShapes(const moveit_msgs::CollisionObject &object)
+{
+  return object.operation == moveit_msgs::CollisionObject::ADD || object.operation == moveit_msgs::CollisionObject::APPEND;
+}
+
+void decodeShapes(const std::vector<const moveit_msgs::CollisionObject*> &objects, unsigned int num_threads,
+                  const collision_detection::CollisionWorldConstPtr &cworld, std::vector<std::vector<shapes::ShapeConstPtr> > &decoded)
+{
+  decoded.clear();
+  decoded.resize(objects.size());
+  ShapeDecoding decoding(cworld, &decoded);
+  for (std::size_t i = 0 ; i < objects.size() ; ++i)
+    if (addsShapes(*objects[i]))
+      decoding.add(*objects[i], i);
+
+  num_threads = std::min<std::size_t>(num_threads, decoding.tasks_.size());
+  boost::thread_group threads;
+  for (std::size_t t = 1 ; t < num_threads ; ++t)
+    threads.create_thread(boost::bind(&ShapeDecoding::run, &decoding));
+  decoding.run();
+  threads.join_all();
+}
+
+}
+
+void planning_scene::PlanningScene::processCollisionObjectMsgs(const std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  if (shape_decoding_threads_ <= 1)
+  {
+    for (std::size_t i = 0 ; i < objects.size() ; ++i)
+      processCollisionObjectMsg(objects[i], NULL);
+    return;
+  }
+
+  std::vector<const moveit_msgs::CollisionObject*> object_ptrs(objects.size());
+  for (std::size_t i = 0 ; i < objects.size() ; ++i)
+    object_ptrs[i] = &objects[i];
+  std::vector<std::vector<shapes::ShapeConstPtr> > decoded;
+  decodeShapes(object_ptrs, shape_decoding_threads_, getCollisionWorld(), decoded);
+
+  // the objects enter the world in the order of the messages, as one batch
+  collision_detection::WorldUpdateBatch batch(*world_);
+  for (std::size_t i = 0 ; i < objects.size() ; ++i)
+    processCollisionObjectMsg(objects[i], addsShapes(objects[i]) ? &decoded[i] : NULL);
+}
+
 bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs::CollisionObject &object)
 {
+  if (shape_decoding_threads_ <= 1 || !addsShapes(object))
+    return processCollisionObjectMsg(object, NULL);
+
+  std::vector<const moveit_msgs::CollisionObject*> object_ptrs(1, &object);
+  std::vector<std::vector<shapes::ShapeConstPtr> > decoded;
+  decodeShapes(object_ptrs, shape_decoding_threads_, getCollisionWorld(), decoded);
+  return processCollisionObjectMsg(object, &decoded[0]);
+}
+
+bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs::CollisionObject &object,
+                                                              const std::vector<shapes::ShapeConstPtr> *decoded)
+{
+  MOVEIT_TRACE_SCOPE("PlanningScene::processCollisionObjectMsg");
+  invalidateSnapshot();
   if (object.id == COLLISION_MAP_NS)
   {
     logError("The ID '%s' cannot be used for collision objects (name reserved)", COLLISION_MAP_NS.c_str());
@@ -1654,34 +2891,35 @@ bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs:
       world_->removeObject(object.id);
 
     const Eigen::Affine3d &t = getTransforms().getTransform(object.header.frame_id);
-    for (std::size_t i = 0 ; i < object.primitives.size() ; ++i)
+    std::size_t k = 0;
+    for (std::size_t i = 0 ; i < object.primitives.size() ; ++i, ++k)
     {
-      shapes::Shape *s = shapes::constructShapeFromMsg(object.primitives[i]);
+      shapes::ShapeConstPtr s = decoded ? (*decoded)[k] : shapes::ShapeConstPtr(shapes::constructShapeFromMsg(object.primitives[i]));
       if (s)
       {
         Eigen::Affine3d p;
         tf::poseMsgToEigen(object.primitive_poses[i], p);
-        world_->addToObject(object.id, shapes::ShapeConstPtr(s), t * p);
+        world_->addToObject(object.id, s, t * p);
       }
     }
-    for (std::size_t i = 0 ; i < object.meshes.size() ; ++i)
+    for (std::size_t i = 0 ; i < object.meshes.size() ; ++i, ++k)
     {
-      shapes::Shape *s = shapes::constructShapeFromMsg(object.meshes[i]);
+      shapes::ShapeConstPtr s = decoded ? (*decoded)[k] : shapes::ShapeConstPtr(shapes::constructShapeFromMsg(object.meshes[i]));
       if (s)
       {
         Eigen::Affine3d p;
         tf::poseMsgToEigen(object.mesh_poses[i], p);
-        world_->addToObject(object.id, shapes::ShapeConstPtr(s), t * p);
+        world_->addToObject(object.id, s, t * p);
       }
     }
-    for (std::size_t i = 0 ; i < object.planes.size() ; ++i)
+    for (std::size_t i = 0 ; i < object.planes.size() ; ++i, ++k)
     {
-      shapes::Shape *s = shapes::constructShapeFromMsg(object.planes[i]);
+      shapes::ShapeConstPtr s = decoded ? (*decoded)[k] : shapes::ShapeConstPtr(shapes::constructShapeFromMsg(object.planes[i]));
       if (s)
       {
         Eigen::Affine3d p;
         tf::poseMsgToEigen(object.plane_poses[i], p);
-        world_->addToObject(object.id, shapes::ShapeConstPtr(s), t * p);
+        world_->addToObject(object.id, s, t * p);
       }
     }
     if (!object.type.key.empty() || !object.type.db.empty())
@@ -1753,12 +2991,12 @@ bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs:
   return false;
 }
 
-const Eigen::Affine3d& planning_scene::PlanningScene::getFrameTransform(const std::string &id) const
+Eigen::Affine3d planning_scene::PlanningScene::getFrameTransform(const std::string &id) const
 {
   return getFrameTransform(getCurrentState(), id);
 }
 
-const Eigen::Affine3d& planning_scene::PlanningScene::getFrameTransform(const robot_state::RobotState &state, const std::string &id) const
+Eigen::Affine3d planning_scene::PlanningScene::getFrameTransform(const robot_state::RobotState &state, const std::string &id) const
 {
   if (!id.empty() && id[0] == '/')
     return getFrameTransform(id.substr(1));
@@ -1803,8 +3041,8 @@ bool planning_scene::PlanningScene::hasObjectType(const std::string &id) const
   if (object_types_)
     if (object_types_->find(id) != object_types_->end())
       return true;
-  if (parent_)
-    return parent_->hasObjectType(id);
+  if (data_parent_)
+    return data_parent_->hasObjectType(id);
   return false;
 }
 
@@ -1816,8 +3054,8 @@ const object_recognition_msgs::ObjectType& planning_scene::PlanningScene::getObj
     if (it != object_types_->end())
       return it->second;
   }
-  if (parent_)
-    return parent_->getObjectType(id);
+  if (data_parent_)
+    return data_parent_->getObjectType(id);
   static const object_recognition_msgs::ObjectType empty;
   return empty;
 
@@ -1825,6 +3063,7 @@ const object_recognition_msgs::ObjectType& planning_scene::PlanningScene::getObj
 
 void planning_scene::PlanningScene::setObjectType(const std::string &id, const object_recognition_msgs::ObjectType &type)
 {
+  invalidateSnapshot();
   if (!object_types_)
     object_types_.reset(new ObjectTypeMap());
   (*object_types_)[id] = type;
@@ -1832,6 +3071,7 @@ void planning_scene::PlanningScene::setObjectType(const std::string &id, const o
 
 void planning_scene::PlanningScene::removeObjectType(const std::string &id)
 {
+  invalidateSnapshot();
   if (object_types_)
     object_types_->erase(id);
 }
@@ -1839,8 +3079,8 @@ void planning_scene::PlanningScene::removeObjectType(const std::string &id)
 void planning_scene::PlanningScene::getKnownObjectTypes(ObjectTypeMap &kc) const
 {
   kc.clear();
-  if (parent_)
-    parent_->getKnownObjectTypes(kc);
+  if (data_parent_)
+    data_parent_->getKnownObjectTypes(kc);
   if (object_types_)
     for (ObjectTypeMap::const_iterator it = object_types_->begin() ; it != object_types_->end() ; ++it)
       kc[it->first] = it->second;
@@ -1851,8 +3091,8 @@ bool planning_scene::PlanningScene::hasObjectColor(const std::string &id) const
   if (object_colors_)
     if (object_colors_->find(id) != object_colors_->end())
       return true;
-  if (parent_)
-    return parent_->hasObjectColor(id);
+  if (data_parent_)
+    return data_parent_->hasObjectColor(id);
   return false;
 }
 
@@ -1864,8 +3104,8 @@ const std_msgs::ColorRGBA& planning_scene::PlanningScene::getObjectColor(const s
     if (it != object_colors_->end())
       return it->second;
   }
-  if (parent_)
-    return parent_->getObjectColor(id);
+  if (data_parent_)
+    return data_parent_->getObjectColor(id);
   static const std_msgs::ColorRGBA empty;
   return empty;
 }
@@ -1873,8 +3113,8 @@ const std_msgs::ColorRGBA& planning_scene::PlanningScene::getObjectColor(const s
 void planning_scene::PlanningScene::getKnownObjectColors(ObjectColorMap &kc) const
 {
   kc.clear();
-  if (parent_)
-    parent_->getKnownObjectColors(kc);
+  if (data_parent_)
+    data_parent_->getKnownObjectColors(kc);
   if (object_colors_)
     for (ObjectColorMap::const_iterator it = object_colors_->begin() ; it != object_colors_->end() ; ++it)
       kc[it->first] = it->second;
@@ -1882,6 +3122,7 @@ void planning_scene::PlanningScene::getKnownObjectColors(ObjectColorMap &kc) con
 
 void planning_scene::PlanningScene::setObjectColor(const std::string &id, const std_msgs::ColorRGBA &color)
 {
+  invalidateSnapshot();
   if (!object_colors_)
     object_colors_.reset(new ObjectColorMap());
   (*object_colors_)[id] = color;
@@ -1889,6 +3130,7 @@ void planning_scene::PlanningScene::setObjectColor(const std::string &id, const
 
 void planning_scene::PlanningScene::removeObjectColor(const std::string &id)
 {
+  invalidateSnapshot();
   if (object_colors_)
     object_colors_->erase(id);
 }
@@ -1907,11 +3149,23 @@ bool planning_scene::PlanningScene::isStateColliding(const std::string &group, b
 
 bool planning_scene::PlanningScene::isStateColliding(const robot_state::RobotState &state, const std::string &group, bool verbose) const
 {
+  std::string context;
+  if (collision_check_cache_ && !verbose)
+  {
+    context = getCollisionCheckContext(group);
+    bool colliding;
+    if (collision_check_cache_->find(state, context, colliding))
+      return colliding;
+  }
+
   collision_detection::CollisionRequest req;
   req.verbose = verbose;
   req.group_name = group;
   collision_detection::CollisionResult  res;
   checkCollision(req, res, state);
+
+  if (collision_check_cache_ && !verbose)
+    collision_check_cache_->insert(state, context, res.collision);
   return res.collision;
 }
 
@@ -2050,11 +3304,13 @@ bool planning_scene::PlanningScene::isPathValid(const robot_trajectory::RobotTra
                                                 const std::vector<moveit_msgs::Constraints>& goal_constraints,
                                                 const std::string &group, bool verbose, std::vector<std::size_t> *invalid_index) const
 {
+  MOVEIT_TRACE_SCOPE("PlanningScene::isPathValid");
   bool result = true;
   if (invalid_index)
     invalid_index->clear();
   kinematic_constraints::KinematicConstraintSet ks_p(getRobotModel());
   ks_p.add(path_constraints, getTransforms());
+  ks_p.compile(*getRobotModel());
   std::size_t n_wp = trajectory.getWayPointCount();
   for (std::size_t i = 0 ; i < n_wp ; ++i)
   {
@@ -2128,6 +3384,247 @@ bool planning_scene::PlanningScene::isPathValid(const robot_trajectory::RobotTra
   return isPathValid(trajectory, emp_constraints, emp_constraints_vector, group, verbose, invalid_index);
 }
 
+namespace planning_scene
+{
+namespace
+{
+
+// a state to check along a path: the waypoint at index_, or, if fraction_ < 1, the state at fraction_ of the segment
+// from the previous waypoint to this one
+struct PathSample
+{
+  PathSample(std::size_t index, double fraction) : index_(index), fraction_(fraction)
+  {
+  }
+
+  std::size_t index_;
+  double      fraction_;
+};
+
+// true if the two states carry the same attached bodies, with the same shapes at the same poses relative to their links
+bool sameAttachedBodies(const robot_state::RobotState &a, const robot_state::RobotState &b)
+{
+  std::vector<const robot_state::AttachedBody*> ab_a, ab_b;
+  a.getAttachedBodies(ab_a);
+  b.getAttachedBodies(ab_b);
+  if (ab_a.size() != ab_b.size())
+    return false;
+  for (std::size_t i = 0 ; i < ab_a.size() ; ++i)
+  {
+    if (ab_a[i]->getName() != ab_b[i]->getName() || ab_a[i]->getAttachedLinkName() != ab_b[i]->getAttachedLinkName() ||
+        ab_a[i]->getShapes() != ab_b[i]->getShapes())
+      return false;
+    const EigenSTL::vector_Affine3d &t_a = ab_a[i]->getFixedTransforms();
+    const EigenSTL::vector_Affine3d &t_b = ab_b[i]->getFixedTransforms();
+    for (std::size_t j = 0 ; j < t_a.size() ; ++j)
+      if (t_a[j].matrix() != t_b[j].matrix())
+        return false;
+  }
+  return true;
+}
+
+// estimate the largest distance a link with geometry travels between two states: the displacement of the origin of its
+// collision body, plus the angle it rotates by times the radius of its extents
+double estimateLinkDisplacement(const robot_state::RobotState &a, const robot_state::RobotState &b)
+{
+  const std::vector<robot_state::LinkState*> &ls_a = a.getLinkStateVector();
+  const std::vector<robot_state::LinkState*> &ls_b = b.getLinkStateVector();
+  double d = 0.0;
+  for (std::size_t i = 0 ; i < ls_a.size() ; ++i)
+  {
+    const robot_model::LinkModel *lm = ls_a[i]->getLinkModel();
+    if (!lm->getShape())
+      continue;
+    const Eigen::Affine3d &t_a = ls_a[i]->getGlobalCollisionBodyTransform();
+    const Eigen::Affine3d &t_b = ls_b[i]->getGlobalCollisionBodyTransform();
+    double angle = Eigen::AngleAxisd(t_a.rotation().transpose() * t_b.rotation()).angle();
+    double di = (t_a.translation() - t_b.translation()).norm() + angle * lm->getShapeExtentsAtOrigin().norm() / 2.0;
+    if (di > d)
+      d = di;
+  }
+  return d;
+}
+
+// the order to visit n items in so that each one is far from those visited before it: the two ends, then the
+// midpoints of ever smaller intervals
+void computeBisectionOrder(std::size_t n, std::vector<std::size_t> &order)
+{
+  order.clear();
+  if (n == 0)
+    return;
+  order.reserve(n);
+  order.push_back(0);
+  if (n == 1)
+    return;
+  order.push_back(n - 1);
+  std::deque<std::pair<std::size_t, std::size_t> > intervals; // the items strictly inside each interval are not visited yet
+  intervals.push_back(std::make_pair(0, n - 1));
+  while (!intervals.empty())
+  {
+    std::pair<std::size_t, std::size_t> iv = intervals.front();
+    intervals.pop_front();
+    if (iv.second - iv.first < 2)
+      continue;
+    std::size_t mid = (iv.first + iv.second) / 2;
+    order.push_back(mid);
+    intervals.push_back(std::make_pair(iv.first, mid));
+    intervals.push_back(std::make_pair(mid, iv.second));
+  }
+}
+
+// the state of a path validation shared by the threads that run it; each thread takes the next sample to check
+// until all samples are checked or, if only the first failure matters, an invalid state is found
+struct PathValidation
+{
+  PathValidation(const PlanningScene *scene, const robot_trajectory::RobotTrajectory *trajectory,
+                 const kinematic_constraints::KinematicConstraintSet *path_constraints, const std::vector<PathSample> *samples,
+                 const std::vector<std::size_t> *order, const std::string *group, bool verbose, bool stop_on_first) :
+    scene_(scene), trajectory_(trajectory), path_constraints_(path_constraints), samples_(samples), order_(order),
+    group_(group), verbose_(verbose), stop_on_first_(stop_on_first), next_(0), cancel_(false), invalid_(samples->size(), 0)
+  {
+  }
+
+  void run()
+  {
+    boost::scoped_ptr<robot_state::RobotState> interpolated;
+    while (true)
+    {
+      std::size_t k;
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        if (cancel_ || next_ >= order_->size())
+          return;
+        k = (*order_)[next_++];
+      }
+
+      const PathSample &sample = (*samples_)[k];
+      const robot_state::RobotState *st = &trajectory_->getWayPoint(sample.index_);
+      if (sample.fraction_ < 1.0)
+      {
+        const robot_state::RobotState &from = trajectory_->getWayPoint(sample.index_ - 1);
+        if (!interpolated)
+          interpolated.reset(new robot_state::RobotState(from));
+        from.interpolate(*st, sample.fraction_, *interpolated);
+        st = interpolated.get();
+      }
+
+      bool valid = !scene_->isStateColliding(*st, *group_, verbose_) && scene_->isStateFeasible(*st, verbose_) &&
+        (path_constraints_->empty() || path_constraints_->decide(*st, verbose_).satisfied);
+      if (!valid)
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        invalid_[k] = 1;
+        if (stop_on_first_)
+          cancel_ = true;
+      }
+    }
+  }
+
+  const PlanningScene                                 *scene_;
+  const robot_trajectory::RobotTrajectory             *trajectory_;
+  const kinematic_constraints::KinematicConstraintSet *path_constraints_;
+  const std::vector<PathSample>                       *samples_;
+  const std::vector<std::size_t>                      *order_;
+  const std::string                                   *group_;
+  bool                                                 verbose_;
+  bool                                                 stop_on_first_;
+
+  std::size_t                                          next_;
+  bool                                                 cancel_;
+  std::vector<char>                                    invalid_;
+  boost::mutex                                         lock_;
+};
+
+}
+}
+
+bool planning_scene::PlanningScene::isPathValid(const robot_trajectory::RobotTrajectory &trajectory,
+                                                const moveit_msgs::Constraints& path_constraints,
+                                                const std::vector<moveit_msgs::Constraints>& goal_constraints,
+                                                const PathValidationOptions &options,
+                                                const std::string &group, bool verbose, std::vector<std::size_t> *invalid_index) const
+{
+  MOVEIT_TRACE_SCOPE("PlanningScene::isPathValid");
+  if (invalid_index)
+    invalid_index->clear();
+  std::size_t n_wp = trajectory.getWayPointCount();
+  if (n_wp == 0)
+    return true;
+  kinematic_constraints::KinematicConstraintSet ks_p(getRobotModel());
+  ks_p.add(path_constraints, getTransforms());
+  ks_p.compile(*getRobotModel());
+
+  // the states to check, in the order they appear along the path
+  std::vector<PathSample> samples;
+  samples.push_back(PathSample(0, 1.0));
+  for (std::size_t i = 1 ; i < n_wp ; ++i)
+  {
+    std::size_t steps = 1;
+    if (options.max_link_displacement > 0.0)
+    {
+      double d = estimateLinkDisplacement(trajectory.getWayPoint(i - 1), trajectory.getWayPoint(i));
+      steps = std::max<std::size_t>(1, (std::size_t)ceil(d / options.max_link_displacement));
+    }
+    for (std::size_t s = 1 ; s <= steps ; ++s)
+      samples.push_back(PathSample(i, (double)s / (double)steps));
+  }
+
+  std::vector<std::size_t> order;
+  if (options.bisection_order)
+    computeBisectionOrder(samples.size(), order);
+  else
+  {
+    order.resize(samples.size());
+    for (std::size_t k = 0 ; k < order.size() ; ++k)
+      order[k] = k;
+  }
+
+  PathValidation validation(this, &trajectory, &ks_p, &samples, &order, &group, verbose, invalid_index == NULL);
+  std::size_t num_threads = std::min<std::size_t>(std::max(options.num_threads, 1u), samples.size());
+  if (num_threads == 1)
+    validation.run();
+  else
+  {
+    boost::thread_group threads;
+    for (std::size_t t = 1 ; t < num_threads ; ++t)
+      threads.create_thread(boost::bind(&PathValidation::run, &validation));
+    validation.run();
+    threads.join_all();
+  }
+
+  bool result = true;
+  for (std::size_t k = 0 ; k < samples.size() ; ++k)
+    if (validation.invalid_[k])
+    {
+      if (!invalid_index)
+        return false;
+      if (invalid_index->empty() || invalid_index->back() != samples[k].index_)
+        invalid_index->push_back(samples[k].index_);
+      result = false;
+    }
+
+  // check goal for last state
+  if (!goal_constraints.empty())
+  {
+    bool found = false;
+    for (std::size_t k = 0 ; k < goal_constraints.size() ; ++k)
+      if (isStateConstrained(trajectory.getLastWayPoint(), goal_constraints[k]))
+      {
+        found = true;
+        break;
+      }
+    if (!found)
+    {
+      if (verbose)
+        logInform("Goal not satisfied");
+      if (invalid_index && (invalid_index->empty() || invalid_index->back() != n_wp - 1))
+        invalid_index->push_back(n_wp - 1);
+      result = false;
+    }
+  }
+  return result;
+}
+
 void planning_scene::PlanningScene::getCostSources(const robot_trajectory::RobotTrajectory &trajectory, std::size_t max_costs,
                                                    std::set<collision_detection::CostSource> &costs, double overlap_fraction) const
 {
@@ -2146,13 +3643,25 @@ void planning_scene::PlanningScene::getCostSources(const robot_trajectory::Robot
   std::set<collision_detection::CostSource> cs;
   std::set<collision_detection::CostSource> cs_start;
   std::size_t n_wp = trajectory.getWayPointCount();
+  std::vector<double> values, previous_values;
   for (std::size_t i = 0 ; i < n_wp ; ++i)
   {
+    // a waypoint that repeats the previous one has the same cost sources
+    const robot_state::RobotState &wp = trajectory.getWayPoint(i);
+    wp.getStateValues(values);
+    if (i > 0 && values == previous_values && sameAttachedBodies(wp, trajectory.getWayPoint(i - 1)))
+      continue;
+    values.swap(previous_values);
+
     collision_detection::CollisionResult cres;
-    checkCollision(creq, cres, trajectory.getWayPoint(i));
+    checkCollision(creq, cres, wp);
     cs.insert(cres.cost_sources.begin(), cres.cost_sources.end());
     if (i == 0)
       cs_start.swap(cres.cost_sources);
+
+    // only the most costly sources are kept in the end, so the others can be dropped as we go
+    while (cs.size() > max_costs)
+      cs.erase(--cs.end());
   }
 
   if (cs.size() <= max_costs)
@@ -0,0 +1,317 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Benchmarks of the planning scene operations a scene server spends its time in: applying and producing planning scene
+   messages, processing collision object and octomap messages, and creating, cloning and pushing diffs. The cases run for
+   worlds of 10, 100 and 1000 boxes, of 5 meshes of 1000, 10000 and 100000 triangles, and for octomaps of 1000, 10000 and
+   50000 occupied cells. The notes give the serialized size of the messages involved. See moveit::Benchmark for the
+   command line arguments. */
+
+#include <moveit/test_resources/config.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/profiler/benchmark.h>
+#include <octomap_msgs/conversions.h>
+#include <octomap/octomap.h>
+#include <urdf_parser/urdf_parser.h>
+#include <console_bridge/console.h>
+#include <ros/serialization.h>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <fstream>
+#include <cmath>
+
+namespace
+{
+
+boost::shared_ptr<urdf::ModelInterface> loadURDF()
+{
+  std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+  std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+  if (!xml_file.is_open())
+  {
+    logError("Unable to open '%s'", urdf_file.c_str());
+    return boost::shared_ptr<urdf::ModelInterface>();
+  }
+  std::string xml_string;
+  while (xml_file.good())
+  {
+    std::string line;
+    std::getline(xml_file, line);
+    xml_string += (line + "\n");
+  }
+  return urdf::parseURDF(xml_string);
+}
+
+template<typename M>
+std::string sizeNote(const M &msg)
+{
+  return "message " + boost::lexical_cast<std::string>(ros::serialization::serializationLength(msg)) + " bytes";
+}
+
+moveit_msgs::CollisionObject makeBoxObject(const std::string &frame, std::size_t index, double x, double y, double z)
+{
+  moveit_msgs::CollisionObject object;
+  object.header.frame_id = frame;
+  object.id = "box" + boost::lexical_cast<std::string>(index);
+  object.operation = moveit_msgs::CollisionObject::ADD;
+  object.primitives.resize(1);
+  object.primitives[0].type = shape_msgs::SolidPrimitive::BOX;
+  object.primitives[0].dimensions.resize(3);
+  object.primitives[0].dimensions[0] = 0.05;
+  object.primitives[0].dimensions[1] = 0.05;
+  object.primitives[0].dimensions[2] = 0.1;
+  object.primitive_poses.resize(1);
+  object.primitive_poses[0].position.x = x;
+  object.primitive_poses[0].position.y = y;
+  object.primitive_poses[0].position.z = z;
+  object.primitive_poses[0].orientation.w = 1.0;
+  return object;
+}
+
+/** \brief A collision object with a bumpy 1 x 1 m sheet of 2 * \e rows * \e cols triangles, like a piece of
+    reconstructed terrain */
+moveit_msgs::CollisionObject makeMeshObject(const std::string &frame, std::size_t index, unsigned int rows, unsigned int cols)
+{
+  moveit_msgs::CollisionObject object;
+  object.header.frame_id = frame;
+  object.id = "mesh" + boost::lexical_cast<std::string>(index);
+  object.operation = moveit_msgs::CollisionObject::ADD;
+  object.meshes.resize(1);
+  shape_msgs::Mesh &mesh = object.meshes[0];
+  for (unsigned int i = 0 ; i <= rows ; ++i)
+    for (unsigned int j = 0 ; j <= cols ; ++j)
+    {
+      geometry_msgs::Point p;
+      p.x = (double)i / rows;
+      p.y = (double)j / cols;
+      p.z = 0.02 * sin(20.0 * p.x) * cos(20.0 * p.y);
+      mesh.vertices.push_back(p);
+    }
+  for (unsigned int i = 0 ; i < rows ; ++i)
+    for (unsigned int j = 0 ; j < cols ; ++j)
+    {
+      unsigned int v = i * (cols + 1) + j;
+      shape_msgs::MeshTriangle t;
+      t.vertex_indices[0] = v;
+      t.vertex_indices[1] = v + cols + 1;
+      t.vertex_indices[2] = v + 1;
+      mesh.triangles.push_back(t);
+      t.vertex_indices[0] = v + 1;
+      t.vertex_indices[1] = v + cols + 1;
+      t.vertex_indices[2] = v + cols + 2;
+      mesh.triangles.push_back(t);
+    }
+  object.mesh_poses.resize(1);
+  object.mesh_poses[0].position.x = 0.5;
+  object.mesh_poses[0].position.y = -2.0 + index;
+  object.mesh_poses[0].position.z = 0.3;
+  object.mesh_poses[0].orientation.w = 1.0;
+  return object;
+}
+
+/** \brief An octree with a resolution of 2 cm and \e count random occupied cells in front of the robot */
+void makeOctomapMsg(const std::string &frame, std::size_t count, bool binary, octomap_msgs::Octomap &msg)
+{
+  octomap::OcTree tree(0.02);
+  boost::mt19937 rng(count);
+  boost::variate_generator<boost::mt19937&, boost::uniform_real<> > x(rng, boost::uniform_real<>(0.4, 2.0)),
+    y(rng, boost::uniform_real<>(-1.0, 1.0)), z(rng, boost::uniform_real<>(0.0, 2.0));
+  for (std::size_t i = 0 ; i < count ; ++i)
+    tree.updateNode(octomap::point3d(x(), y(), z()), true);
+  if (binary)
+    octomap_msgs::binaryMapToMsg(tree, msg);
+  else
+    octomap_msgs::fullMapToMsg(tree, msg);
+  msg.header.frame_id = frame;
+}
+
+void processObject(planning_scene::PlanningScene *scene, const std::vector<moveit_msgs::CollisionObject> *objects, std::size_t *next)
+{
+  moveit::Benchmark::keep(scene->processCollisionObjectMsg((*objects)[*next]));
+  *next = (*next + 1) % objects->size();
+}
+
+void processOctomap(planning_scene::PlanningScene *scene, const octomap_msgs::Octomap *msg)
+{
+  scene->processOctomapMsg(*msg);
+  moveit::Benchmark::keep(*scene);
+}
+
+void getMsg(const planning_scene::PlanningScene *scene, moveit_msgs::PlanningScene *msg)
+{
+  scene->getPlanningSceneMsg(*msg);
+  moveit::Benchmark::keep(*msg);
+}
+
+void getDiffMsg(const planning_scene::PlanningScene *scene, moveit_msgs::PlanningScene *msg)
+{
+  scene->getPlanningSceneDiffMsg(*msg);
+  moveit::Benchmark::keep(*msg);
+}
+
+void setDiffMsg(planning_scene::PlanningScene *scene, const moveit_msgs::PlanningScene *msg)
+{
+  scene->setPlanningSceneDiffMsg(*msg);
+  moveit::Benchmark::keep(*scene);
+}
+
+void makeDiff(const planning_scene::PlanningScene *scene)
+{
+  moveit::Benchmark::keep(scene->diff());
+}
+
+void makeClone(const planning_scene::PlanningSceneConstPtr *scene)
+{
+  moveit::Benchmark::keep(planning_scene::PlanningScene::clone(*scene));
+}
+
+void pushDiffs(planning_scene::PlanningScene *child, const planning_scene::PlanningScenePtr *target)
+{
+  child->pushDiffs(*target);
+  moveit::Benchmark::keep(**target);
+}
+
+/** \brief Run the cases for the world made of \e objects, added to a copy of \e empty (a scene with no world objects) */
+void benchmarkObjects(moveit::Benchmark &bench, const planning_scene::PlanningSceneConstPtr &empty, const std::string &name,
+                      const std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  planning_scene::PlanningScenePtr scene = planning_scene::PlanningScene::clone(empty);
+
+  // all the objects in one message, as a scene server receives them
+  moveit_msgs::PlanningScene objects_msg;
+  objects_msg.is_diff = true;
+  objects_msg.world.collision_objects = objects;
+  scene->setPlanningSceneDiffMsg(objects_msg);
+
+  // adding an object that exists replaces it, so the scene keeps its size
+  std::size_t next = 0;
+  bench.run("processCollisionObjectMsg/" + name, boost::bind(&processObject, scene.get(), &objects, &next));
+  bench.setNote("processCollisionObjectMsg/" + name, sizeNote(objects[0]));
+
+  planning_scene::PlanningScenePtr target = planning_scene::PlanningScene::clone(empty);
+  bench.run("setPlanningSceneDiffMsg/" + name, boost::bind(&setDiffMsg, target.get(), &objects_msg), objects.size());
+  bench.setNote("setPlanningSceneDiffMsg/" + name, sizeNote(objects_msg));
+
+  moveit_msgs::PlanningScene msg;
+  bench.run("getPlanningSceneMsg/" + name, boost::bind(&getMsg, scene.get(), &msg));
+  scene->getPlanningSceneMsg(msg);
+  bench.setNote("getPlanningSceneMsg/" + name, sizeNote(msg));
+
+  bench.run("diff/" + name, boost::bind(&makeDiff, scene.get()));
+  planning_scene::PlanningSceneConstPtr const_scene = scene;
+  bench.run("clone/" + name, boost::bind(&makeClone, &const_scene));
+
+  // a typical update: one object moves and the robot changes its configuration
+  planning_scene::PlanningScenePtr child = scene->diff();
+  moveit_msgs::CollisionObject moved = objects[0];
+  if (!moved.primitive_poses.empty())
+    moved.primitive_poses[0].position.z += 0.1;
+  if (!moved.mesh_poses.empty())
+    moved.mesh_poses[0].position.z += 0.1;
+  child->processCollisionObjectMsg(moved);
+  child->getCurrentStateNonConst().getJointStateGroup("right_arm")->setToRandomValues();
+
+  bench.run("getPlanningSceneDiffMsg/" + name, boost::bind(&getDiffMsg, child.get(), &msg));
+  child->getPlanningSceneDiffMsg(msg);
+  bench.setNote("getPlanningSceneDiffMsg/" + name, sizeNote(msg));
+
+  planning_scene::PlanningScenePtr push_target = planning_scene::PlanningScene::clone(const_scene);
+  bench.run("pushDiffs/" + name, boost::bind(&pushDiffs, child.get(), &push_target));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadURDF();
+  if (!urdf_model)
+    return 1;
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+  planning_scene::PlanningScenePtr empty(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  const std::string &frame = empty->getPlanningFrame();
+
+  const std::size_t box_counts[] = { 10, 100, 1000 };
+  for (std::size_t k = 0 ; k < 3 ; ++k)
+  {
+    boost::mt19937 rng(box_counts[k]);
+    boost::variate_generator<boost::mt19937&, boost::uniform_real<> > x(rng, boost::uniform_real<>(0.4, 2.0)),
+      y(rng, boost::uniform_real<>(-1.0, 1.0)), z(rng, boost::uniform_real<>(0.0, 2.0));
+    std::vector<moveit_msgs::CollisionObject> objects;
+    for (std::size_t i = 0 ; i < box_counts[k] ; ++i)
+      objects.push_back(makeBoxObject(frame, i, x(), y(), z()));
+    benchmarkObjects(bench, empty, "boxes/" + boost::lexical_cast<std::string>(box_counts[k]), objects);
+  }
+
+  // 5 meshes of 2 * rows * cols triangles
+  const unsigned int mesh_rows[] = { 10, 50, 100 };
+  const unsigned int mesh_cols[] = { 50, 100, 500 };
+  for (std::size_t k = 0 ; k < 3 ; ++k)
+  {
+    std::vector<moveit_msgs::CollisionObject> objects;
+    for (std::size_t i = 0 ; i < 5 ; ++i)
+      objects.push_back(makeMeshObject(frame, i, mesh_rows[k], mesh_cols[k]));
+    benchmarkObjects(bench, empty, "meshes/" + boost::lexical_cast<std::string>(2 * mesh_rows[k] * mesh_cols[k]), objects);
+  }
+
+  const std::size_t cell_counts[] = { 1000, 10000, 50000 };
+  for (std::size_t k = 0 ; k < 3 ; ++k)
+  {
+    std::string suffix = "/" + boost::lexical_cast<std::string>(cell_counts[k]);
+    planning_scene::PlanningScenePtr scene = planning_scene::PlanningScene::clone(empty);
+    octomap_msgs::Octomap full, binary;
+    makeOctomapMsg(frame, cell_counts[k], false, full);
+    makeOctomapMsg(frame, cell_counts[k], true, binary);
+
+    bench.run("processOctomapMsg/full" + suffix, boost::bind(&processOctomap, scene.get(), &full));
+    bench.setNote("processOctomapMsg/full" + suffix, sizeNote(full));
+    bench.run("processOctomapMsg/binary" + suffix, boost::bind(&processOctomap, scene.get(), &binary));
+    bench.setNote("processOctomapMsg/binary" + suffix, sizeNote(binary));
+
+    scene->processOctomapMsg(full);
+    moveit_msgs::PlanningScene msg;
+    bench.run("getPlanningSceneMsg/octomap" + suffix, boost::bind(&getMsg, scene.get(), &msg));
+    scene->getPlanningSceneMsg(msg);
+    bench.setNote("getPlanningSceneMsg/octomap" + suffix, sizeNote(msg));
+  }
+
+  return bench.report();
+}
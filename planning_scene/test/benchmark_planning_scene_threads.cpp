@@ -0,0 +1,209 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Benchmarks of how state validity checks, collision checks and constraint evaluation scale with the number of threads
+   that call them at the same time, either on one shared planning scene (and constraint set) or on a diff() of the
+   scene (and a constraint set) per thread. Throughput that grows less than the number of threads, or a 99th percentile
+   that grows with it, point at contention in shared structures. See moveit::Benchmark for the command line arguments;
+   --threads selects the thread counts. */
+
+#include <moveit/test_resources/config.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/profiler/benchmark.h>
+#include <urdf_parser/urdf_parser.h>
+#include <console_bridge/console.h>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <fstream>
+#include <algorithm>
+
+namespace
+{
+
+/** \brief What the threads of a case call */
+enum Query
+{
+  IS_STATE_VALID,
+  IS_STATE_VALID_CONSTRAINED,
+  CHECK_COLLISION,
+  DECIDE
+};
+
+/** \brief The data of one thread: the scene and constraints it queries and the states it queries them with. The states
+    are used in turn, so results cached for a state are not reused right away. */
+struct ThreadContext
+{
+  planning_scene::PlanningSceneConstPtr                   scene_;
+  kinematic_constraints::KinematicConstraintSetConstPtr   constraints_;
+  std::vector<robot_state::RobotStatePtr>                 states_;
+  std::size_t                                             next_;
+};
+
+boost::shared_ptr<urdf::ModelInterface> loadURDF()
+{
+  std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+  std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+  if (!xml_file.is_open())
+  {
+    logError("Unable to open '%s'", urdf_file.c_str());
+    return boost::shared_ptr<urdf::ModelInterface>();
+  }
+  std::string xml_string;
+  while (xml_file.good())
+  {
+    std::string line;
+    std::getline(xml_file, line);
+    xml_string += (line + "\n");
+  }
+  return urdf::parseURDF(xml_string);
+}
+
+/** \brief Add a table in front of the robot and \e count small boxes on and around it */
+void addObjects(planning_scene::PlanningScene &scene, std::size_t count)
+{
+  const collision_detection::WorldPtr &world = scene.getWorldNonConst();
+  world->addToObject("table", shapes::ShapeConstPtr(new shapes::Box(0.8, 1.6, 0.05)),
+                     Eigen::Affine3d(Eigen::Translation3d(0.9, 0.0, 0.7)));
+
+  boost::mt19937 rng(count);
+  boost::variate_generator<boost::mt19937&, boost::uniform_real<> > x(rng, boost::uniform_real<>(0.4, 1.4)),
+    y(rng, boost::uniform_real<>(-1.0, 1.0)), z(rng, boost::uniform_real<>(0.7, 1.5));
+  for (std::size_t i = 0 ; i < count ; ++i)
+    world->addToObject("box" + boost::lexical_cast<std::string>(i), shapes::ShapeConstPtr(new shapes::Box(0.05, 0.05, 0.1)),
+                       Eigen::Affine3d(Eigen::Translation3d(x(), y(), z())));
+}
+
+/** \brief Constraints on the pose of the right wrist, loose enough for some of the random states to satisfy them */
+kinematic_constraints::KinematicConstraintSetPtr makeConstraints(const planning_scene::PlanningScene &scene)
+{
+  geometry_msgs::PoseStamped pose;
+  pose.header.frame_id = scene.getRobotModel()->getModelFrame();
+  pose.pose.position.x = 0.6;
+  pose.pose.position.y = -0.2;
+  pose.pose.position.z = 1.0;
+  pose.pose.orientation.w = 1.0;
+  kinematic_constraints::KinematicConstraintSetPtr constraints(new kinematic_constraints::KinematicConstraintSet(scene.getRobotModel()));
+  constraints->add(kinematic_constraints::constructGoalConstraints("r_wrist_roll_link", pose, 0.5, 1.0), scene.getTransforms());
+  return constraints;
+}
+
+void query(ThreadContext *context, Query type)
+{
+  const robot_state::RobotState &state = *context->states_[context->next_];
+  context->next_ = (context->next_ + 1) % context->states_.size();
+  bool result = false;
+  switch (type)
+  {
+  case IS_STATE_VALID:
+    result = context->scene_->isStateValid(state);
+    break;
+  case IS_STATE_VALID_CONSTRAINED:
+    result = context->scene_->isStateValid(state, *context->constraints_);
+    break;
+  case CHECK_COLLISION:
+    {
+      collision_detection::CollisionRequest req;
+      collision_detection::CollisionResult res;
+      context->scene_->checkCollision(req, res, state);
+      result = res.collision;
+    }
+    break;
+  case DECIDE:
+    result = context->constraints_->decide(state).satisfied;
+    break;
+  }
+  moveit::Benchmark::keep(result);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadURDF();
+  if (!urdf_model)
+    return 1;
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+  planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  addObjects(*scene, 50);
+  kinematic_constraints::KinematicConstraintSetPtr shared_constraints = makeConstraints(*scene);
+
+  const char *query_names[] = { "isStateValid", "isStateValid(constraints)", "checkCollision", "KinematicConstraintSet::decide" };
+  const Query queries[] = { IS_STATE_VALID, IS_STATE_VALID_CONSTRAINED, CHECK_COLLISION, DECIDE };
+  const std::vector<unsigned int> &thread_counts = bench.getThreadCounts();
+  unsigned int max_threads = *std::max_element(thread_counts.begin(), thread_counts.end());
+
+  // the contexts of the threads, for a shared scene and for a scene per thread; thread i uses the same states in both
+  std::vector<ThreadContext> shared(max_threads), separate(max_threads);
+  for (unsigned int i = 0 ; i < max_threads ; ++i)
+  {
+    shared[i].scene_ = scene;
+    shared[i].constraints_ = shared_constraints;
+    shared[i].next_ = 0;
+    for (std::size_t j = 0 ; j < 32 ; ++j)
+    {
+      robot_state::RobotStatePtr state(new robot_state::RobotState(scene->getCurrentState()));
+      state->getJointStateGroup("right_arm")->setToRandomValues();
+      state->getJointStateGroup("left_arm")->setToRandomValues();
+      shared[i].states_.push_back(state);
+    }
+    separate[i] = shared[i];
+    separate[i].scene_ = scene->diff();
+    separate[i].constraints_ = makeConstraints(*scene);
+  }
+
+  for (std::size_t q = 0 ; q < 4 ; ++q)
+    for (std::size_t t = 0 ; t < thread_counts.size() ; ++t)
+    {
+      std::string suffix = "/" + boost::lexical_cast<std::string>(thread_counts[t]) + "threads";
+      std::vector<boost::function<void()> > shared_fns, separate_fns;
+      for (unsigned int i = 0 ; i < thread_counts[t] ; ++i)
+      {
+        shared_fns.push_back(boost::bind(&query, &shared[i], queries[q]));
+        separate_fns.push_back(boost::bind(&query, &separate[i], queries[q]));
+      }
+      bench.runConcurrent(std::string(query_names[q]) + "/shared" + suffix, shared_fns);
+      bench.runConcurrent(std::string(query_names[q]) + "/per_thread" + suffix, separate_fns);
+    }
+
+  return bench.report();
+}
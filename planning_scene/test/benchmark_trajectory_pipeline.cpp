@@ -0,0 +1,207 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Benchmarks of what happens to a planned trajectory before it is executed: conversion to and from messages, unwinding of
+   continuous joints, time parameterization, sampling at the rate of a controller (1 kHz) and validation against the planning
+   scene. Each step runs for trajectories of 50, 500 and 5000 waypoints, stored with a full state per waypoint ("full") and
+   compactly ("compact", see RobotTrajectory::setCompact()). The sampling cases report the samples per second in the
+   Items/s column. See moveit::Benchmark for the command line arguments. */
+
+#include <moveit/test_resources/config.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/profiler/benchmark.h>
+#include <urdf_parser/urdf_parser.h>
+#include <console_bridge/console.h>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <fstream>
+#include <cmath>
+
+namespace
+{
+
+const std::string GROUP = "right_arm";
+
+boost::shared_ptr<urdf::ModelInterface> loadURDF()
+{
+  std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+  std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+  if (!xml_file.is_open())
+  {
+    logError("Unable to open '%s'", urdf_file.c_str());
+    return boost::shared_ptr<urdf::ModelInterface>();
+  }
+  std::string xml_string;
+  while (xml_file.good())
+  {
+    std::string line;
+    std::getline(xml_file, line);
+    xml_string += (line + "\n");
+  }
+  return urdf::parseURDF(xml_string);
+}
+
+/** \brief A collision free trajectory of \e count waypoints for the right arm: the arm swings out to the side while the
+    forearm and the wrist roll two full turns. The values of the roll joints are wrapped to [-pi, pi], as a planner
+    would report them, so unwinding has work to do. Waypoints are 10 ms apart until the trajectory is parameterized. */
+void makeTrajectory(const robot_state::RobotState &start, std::size_t count, robot_trajectory::RobotTrajectory &trajectory)
+{
+  trajectory.clear();
+  robot_state::RobotState state(start);
+  robot_state::JointStateGroup *jsg = state.getJointStateGroup(GROUP);
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    double s = count > 1 ? (double)i / (double)(count - 1) : 0.0;
+    double roll = 4.0 * M_PI * s;
+    std::map<std::string, double> values;
+    values["r_shoulder_pan_joint"] = -0.8 * s;
+    values["r_shoulder_lift_joint"] = -0.3 * s;
+    values["r_forearm_roll_joint"] = atan2(sin(roll), cos(roll));
+    values["r_wrist_roll_joint"] = atan2(sin(-roll), cos(-roll));
+    jsg->setVariableValues(values);
+    trajectory.addSuffixWayPoint(state, 0.01);
+  }
+}
+
+double getDuration(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  return trajectory.empty() ? 0.0 : trajectory.getWaypointDurationFromStart(trajectory.getWayPointCount() - 1);
+}
+
+void getMsg(const robot_trajectory::RobotTrajectory *trajectory, moveit_msgs::RobotTrajectory *msg)
+{
+  trajectory->getRobotTrajectoryMsg(*msg);
+  moveit::Benchmark::keep(*msg);
+}
+
+void setMsg(robot_trajectory::RobotTrajectory *trajectory, const robot_state::RobotState *reference,
+            const moveit_msgs::RobotTrajectory *msg)
+{
+  trajectory->setRobotTrajectoryMsg(*reference, *msg);
+  moveit::Benchmark::keep(*trajectory);
+}
+
+void unwind(robot_trajectory::RobotTrajectory *trajectory, const robot_state::RobotState *start)
+{
+  trajectory->unwind(*start);
+  moveit::Benchmark::keep(*trajectory);
+}
+
+void parameterize(const trajectory_processing::IterativeParabolicTimeParameterization *iptp,
+                  robot_trajectory::RobotTrajectory *trajectory)
+{
+  moveit::Benchmark::keep(iptp->computeTimeStamps(*trajectory));
+}
+
+/** \brief Sample the whole trajectory every millisecond, with a cursor (as a controller would) or with a search per sample */
+void sample(const robot_trajectory::RobotTrajectory *trajectory, robot_state::RobotStatePtr *output, bool use_cursor)
+{
+  double duration = getDuration(*trajectory);
+  std::size_t cursor = 0;
+  for (std::size_t i = 0 ; i * 0.001 <= duration ; ++i)
+    if (use_cursor)
+      trajectory->getStateAtDurationFromStart(i * 0.001, *output, cursor);
+    else
+      trajectory->getStateAtDurationFromStart(i * 0.001, *output);
+  moveit::Benchmark::keep(**output);
+}
+
+void validate(const planning_scene::PlanningScene *scene, const robot_trajectory::RobotTrajectory *trajectory)
+{
+  moveit::Benchmark::keep(scene->isPathValid(*trajectory, GROUP));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadURDF();
+  if (!urdf_model)
+    return 1;
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+  planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  const robot_model::RobotModelConstPtr &model = scene->getRobotModel();
+  const robot_state::RobotState &start = scene->getCurrentState();
+
+  trajectory_processing::IterativeParabolicTimeParameterization iptp;
+  robot_state::RobotStatePtr output(new robot_state::RobotState(start));
+
+  const std::size_t sizes[] = { 50, 500, 5000 };
+  for (std::size_t k = 0 ; k < 3 ; ++k)
+    for (int compact = 0 ; compact < 2 ; ++compact)
+    {
+      std::string suffix = std::string(compact ? "/compact/" : "/full/") + boost::lexical_cast<std::string>(sizes[k]);
+
+      robot_trajectory::RobotTrajectory trajectory(model, GROUP);
+      if (compact)
+        trajectory.setCompact(start);
+      makeTrajectory(start, sizes[k], trajectory);
+
+      moveit_msgs::RobotTrajectory msg, out_msg;
+      trajectory.getRobotTrajectoryMsg(msg);
+      robot_trajectory::RobotTrajectory from_msg(model, GROUP);
+      if (compact)
+        from_msg.setCompact(start);
+
+      bench.run("getRobotTrajectoryMsg" + suffix, boost::bind(&getMsg, &trajectory, &out_msg));
+      bench.run("setRobotTrajectoryMsg" + suffix, boost::bind(&setMsg, &from_msg, &start, &msg));
+
+      // unwinding an unwound trajectory visits the same values, so the first pass is not special
+      bench.run("unwind" + suffix, boost::bind(&unwind, &trajectory, &start));
+
+      // the later cases use the parameterized trajectory
+      bench.run("computeTimeStamps" + suffix, boost::bind(&parameterize, &iptp, &trajectory));
+      double duration = getDuration(trajectory);
+      double samples = floor(duration / 0.001) + 1.0;
+      std::string note = "duration " + boost::lexical_cast<std::string>(duration) + " s";
+      bench.run("getStateAtDurationFromStart/1kHz/cursor" + suffix, boost::bind(&sample, &trajectory, &output, true), samples);
+      bench.setNote("getStateAtDurationFromStart/1kHz/cursor" + suffix, note);
+      bench.run("getStateAtDurationFromStart/1kHz/search" + suffix, boost::bind(&sample, &trajectory, &output, false), samples);
+      bench.setNote("getStateAtDurationFromStart/1kHz/search" + suffix, note);
+
+      // isPathValid() stops at the first invalid waypoint, so the timing only covers the whole path if it is valid
+      bench.run("isPathValid" + suffix, boost::bind(&validate, scene.get(), &trajectory), sizes[k]);
+      if (bench.enabled("isPathValid" + suffix) && !scene->isPathValid(trajectory, GROUP))
+        bench.setNote("isPathValid" + suffix, "path is not valid; only a prefix is checked");
+    }
+
+  return bench.report();
+}
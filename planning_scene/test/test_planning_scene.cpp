@@ -36,10 +36,14 @@
 
 #include <gtest/gtest.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <moveit/distance_field/propagation_distance_field.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
+#include <sstream>
+#include <cstring>
 #include <moveit/test_resources/config.h>
 #include <boost/filesystem/path.hpp>
+#include <octomap_msgs/conversions.h>
 
 
 boost::shared_ptr<urdf::ModelInterface> loadRobotModel()
@@ -128,6 +132,709 @@ TEST(PlanningScene, MakeAttachedDiff)
   ps->checkCollision(req, res);
 }
 
+TEST(PlanningScene, CachedCollisionObjectMsgs)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  shapes::ShapeConstPtr sphere(new shapes::Sphere(0.4));
+  ps->getWorldNonConst()->addToObject("sphere", sphere, Eigen::Affine3d::Identity());
+
+  moveit_msgs::PlanningScene msg1, msg2;
+  ps->getPlanningSceneMsg(msg1);
+  ps->getPlanningSceneMsg(msg2);
+  ASSERT_EQ(1u, msg1.world.collision_objects.size());
+  ASSERT_EQ(1u, msg2.world.collision_objects.size());
+  ASSERT_EQ(1u, msg2.world.collision_objects[0].primitive_poses.size());
+  EXPECT_EQ(0.0, msg2.world.collision_objects[0].primitive_poses[0].position.z);
+
+  // the message reused for an unchanged object is rebuilt once the object changes
+  ps->getWorldNonConst()->moveShapeInObject("sphere", sphere, Eigen::Affine3d(Eigen::Translation3d(0, 0, 1)));
+  moveit_msgs::PlanningScene msg3;
+  ps->getPlanningSceneMsg(msg3);
+  ASSERT_EQ(1u, msg3.world.collision_objects.size());
+  ASSERT_EQ(1u, msg3.world.collision_objects[0].primitive_poses.size());
+  EXPECT_EQ(1.0, msg3.world.collision_objects[0].primitive_poses[0].position.z);
+
+  // a diff scene shares the object until it changes there
+  planning_scene::PlanningScenePtr child = ps->diff();
+  child->getWorldNonConst()->moveShapeInObject("sphere", sphere, Eigen::Affine3d(Eigen::Translation3d(0, 0, 2)));
+  moveit_msgs::PlanningScene diff_msg;
+  child->getPlanningSceneDiffMsg(diff_msg);
+  ASSERT_EQ(1u, diff_msg.world.collision_objects.size());
+  EXPECT_EQ(2.0, diff_msg.world.collision_objects[0].primitive_poses[0].position.z);
+}
+
+TEST(PlanningScene, BinaryGeometry)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+  ps.setName("binary");
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.2, 0.3)),
+                                     Eigen::Affine3d(Eigen::Translation3d(1, 2, 3)));
+  shapes::Mesh *mesh = new shapes::Mesh(3, 1);
+  for (unsigned int i = 0 ; i < 9 ; ++i)
+    mesh->vertices[i] = i == 0 || i == 4 || i == 8 ? 1.0 : 0.0;
+  mesh->triangles[0] = 0; mesh->triangles[1] = 1; mesh->triangles[2] = 2;
+  ps.getWorldNonConst()->addToObject("mesh", shapes::ShapeConstPtr(mesh), Eigen::Affine3d::Identity());
+  std_msgs::ColorRGBA color;
+  color.r = 0.5; color.g = 0.25; color.b = 1.0; color.a = 1.0;
+  ps.setObjectColor("box", color);
+
+  std::stringstream binary;
+  ps.saveGeometryToBinaryStream(binary);
+  planning_scene::PlanningScene loaded(urdf_model, srdf_model);
+  ASSERT_TRUE(loaded.loadGeometryFromBinaryStream(binary));
+  EXPECT_EQ("binary", loaded.getName());
+  ASSERT_TRUE(loaded.getWorld()->hasObject("box"));
+  ASSERT_TRUE(loaded.getWorld()->hasObject("mesh"));
+  collision_detection::World::ObjectConstPtr box = loaded.getWorld()->getObject("box");
+  ASSERT_EQ(1u, box->shapes_.size());
+  EXPECT_EQ(shapes::BOX, box->shapes_[0]->type);
+  EXPECT_DOUBLE_EQ(0.2, static_cast<const shapes::Box*>(box->shapes_[0].get())->size[1]);
+  EXPECT_DOUBLE_EQ(3.0, box->shape_poses_[0].translation().z());
+  ASSERT_TRUE(loaded.hasObjectColor("box"));
+  EXPECT_FLOAT_EQ(0.25, loaded.getObjectColor("box").g);
+  const shapes::Mesh *loaded_mesh = static_cast<const shapes::Mesh*>(loaded.getWorld()->getObject("mesh")->shapes_[0].get());
+  ASSERT_EQ(3u, loaded_mesh->vertex_count);
+  ASSERT_EQ(1u, loaded_mesh->triangle_count);
+  EXPECT_EQ(2u, loaded_mesh->triangles[2]);
+  EXPECT_DOUBLE_EQ(1.0, loaded_mesh->vertices[4]);
+
+  // the text format converts to the same binary data
+  std::stringstream text, converted;
+  ps.saveGeometryToStream(text);
+  ASSERT_TRUE(planning_scene::PlanningScene::convertGeometryTextToBinary(text, converted));
+  planning_scene::PlanningScene from_text(urdf_model, srdf_model);
+  ASSERT_TRUE(from_text.loadGeometryFromBinaryStream(converted));
+  EXPECT_TRUE(from_text.getWorld()->hasObject("box"));
+  EXPECT_TRUE(from_text.getWorld()->hasObject("mesh"));
+
+  // truncated data is rejected
+  std::string data = binary.str();
+  planning_scene::PlanningScene truncated(urdf_model, srdf_model);
+  EXPECT_FALSE(truncated.loadGeometryFromBinaryData(data.data(), data.size() / 2));
+
+  // so are mesh counts the data can not hold, and triangles that refer to missing vertices; with the mesh saved last,
+  // the data ends with the vertex and triangle counts, 9 coordinates, 3 indices and the end tag
+  planning_scene::PlanningScene mesh_only(urdf_model, srdf_model);
+  mesh_only.getWorldNonConst()->addToObject("mesh", loaded.getWorld()->getObject("mesh")->shapes_[0], Eigen::Affine3d::Identity());
+  std::stringstream mesh_binary;
+  mesh_only.saveGeometryToBinaryStream(mesh_binary);
+  const std::string mesh_data = mesh_binary.str();
+  const std::size_t triangles_offset = mesh_data.size() - 1 - 3 * sizeof(unsigned int);
+  const std::size_t counts_offset = triangles_offset - 9 * sizeof(double) - 2 * sizeof(boost::uint32_t);
+  boost::uint32_t counts[2];
+  memcpy(counts, &mesh_data[counts_offset], sizeof(counts));
+  ASSERT_EQ(3u, counts[0]);
+  ASSERT_EQ(1u, counts[1]);
+
+  std::string corrupt = mesh_data;
+  const boost::uint32_t huge_count = 0x40000000u;
+  memcpy(&corrupt[counts_offset], &huge_count, sizeof(huge_count));
+  planning_scene::PlanningScene corrupt_vertices(urdf_model, srdf_model);
+  EXPECT_FALSE(corrupt_vertices.loadGeometryFromBinaryData(corrupt.data(), corrupt.size()));
+  corrupt = mesh_data;
+  memcpy(&corrupt[counts_offset + sizeof(boost::uint32_t)], &huge_count, sizeof(huge_count));
+  planning_scene::PlanningScene corrupt_triangles(urdf_model, srdf_model);
+  EXPECT_FALSE(corrupt_triangles.loadGeometryFromBinaryData(corrupt.data(), corrupt.size()));
+  corrupt = mesh_data;
+  const unsigned int bad_index = 3;
+  memcpy(&corrupt[triangles_offset + 2 * sizeof(unsigned int)], &bad_index, sizeof(bad_index));
+  planning_scene::PlanningScene corrupt_index(urdf_model, srdf_model);
+  EXPECT_FALSE(corrupt_index.loadGeometryFromBinaryData(corrupt.data(), corrupt.size()));
+  planning_scene::PlanningScene intact(urdf_model, srdf_model);
+  EXPECT_TRUE(intact.loadGeometryFromBinaryData(mesh_data.data(), mesh_data.size()));
+}
+
+TEST(PlanningScene, AsyncOctomap)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  octomap::OcTree octree(0.1);
+  octree.updateNode(octomap::point3d(2.0, 0.0, 0.0), true);
+  octomap_msgs::OctomapWithPose map;
+  map.header.frame_id = ps.getPlanningFrame();
+  map.origin.orientation.w = 1.0;
+  ASSERT_TRUE(octomap_msgs::fullMapToMsg(octree, map.octomap));
+
+  // nothing changes until the decoded octomap is applied
+  EXPECT_FALSE(ps.applyPendingOctomap());
+  ps.processOctomapMsgAsync(map);
+  EXPECT_FALSE(ps.getWorld()->hasObject(planning_scene::PlanningScene::OCTOMAP_NS));
+  ASSERT_TRUE(ps.applyPendingOctomap(true));
+  ASSERT_TRUE(ps.getWorld()->hasObject(planning_scene::PlanningScene::OCTOMAP_NS));
+  EXPECT_EQ(1u, ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_.size());
+  EXPECT_FALSE(ps.applyPendingOctomap(true));
+
+  // a newer octomap replaces the previous one
+  ps.processOctomapMsgAsync(map);
+  ASSERT_TRUE(ps.applyPendingOctomap(true));
+  EXPECT_EQ(1u, ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_.size());
+
+  // an empty octomap removes it
+  map.octomap.data.clear();
+  ps.processOctomapMsgAsync(map);
+  ASSERT_TRUE(ps.applyPendingOctomap(true));
+  EXPECT_FALSE(ps.getWorld()->hasObject(planning_scene::PlanningScene::OCTOMAP_NS));
+}
+
+TEST(PlanningScene, OctomapBounds)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  boost::shared_ptr<octomap::OcTree> octree(new octomap::OcTree(0.1));
+  octree->updateNode(octomap::point3d(0.5, 0.0, 0.0), true);
+  octree->updateNode(octomap::point3d(10.0, 0.0, 0.0), true);
+  octree->updateNode(octomap::point3d(-0.5, 0.0, 0.0), false);
+
+  Eigen::Vector3d min, max;
+  EXPECT_FALSE(ps.getOctomapBounds(min, max));
+  ps.setOctomapBounds(Eigen::Vector3d(1, 1, 1), Eigen::Vector3d(-1, -1, -1));
+  ASSERT_TRUE(ps.getOctomapBounds(min, max));
+  EXPECT_EQ(-1.0, min.x());
+  EXPECT_EQ(1.0, max.x());
+
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  shapes::ShapeConstPtr shape = ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0];
+  const octomap::OcTree *cropped = static_cast<const shapes::OcTree*>(shape.get())->octree.get();
+  EXPECT_NE(octree.get(), cropped);
+  ASSERT_TRUE(cropped->search(0.5, 0.0, 0.0) != NULL);
+  EXPECT_TRUE(cropped->isNodeOccupied(cropped->search(0.5, 0.0, 0.0)));
+  EXPECT_TRUE(cropped->search(10.0, 0.0, 0.0) == NULL);
+  EXPECT_TRUE(cropped->search(-0.5, 0.0, 0.0) != NULL);
+
+  // the same octree at the same pose is not cropped again
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  EXPECT_EQ(shape, ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0]);
+
+  // free cells can be dropped as well
+  ps.setOctomapPruneFree(true);
+  EXPECT_TRUE(ps.getOctomapPruneFree());
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  cropped = static_cast<const shapes::OcTree*>(ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0].get())->octree.get();
+  EXPECT_TRUE(cropped->search(0.5, 0.0, 0.0) != NULL);
+  EXPECT_TRUE(cropped->search(-0.5, 0.0, 0.0) == NULL);
+
+  ps.clearOctomapBounds();
+  EXPECT_FALSE(ps.getOctomapBounds(min, max));
+  ps.setOctomapBoundsFromRobot(0.5);
+  EXPECT_TRUE(ps.getOctomapBounds(min, max));
+}
+
+TEST(PlanningScene, OctomapUpdatedInPlace)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+  ps.setOctomapBounds(Eigen::Vector3d(-1, -1, -1), Eigen::Vector3d(1, 1, 1));
+
+  boost::shared_ptr<octomap::OcTree> octree(new octomap::OcTree(0.1));
+  octree->enableChangeDetection(true);
+  octree->updateNode(octomap::point3d(0.5, 0.0, 0.0), true);
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  octree->resetChangeDetection();
+  collision_detection::World::ObjectConstPtr map = ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS);
+  const octomap::OcTree *cropped = static_cast<const shapes::OcTree*>(map->shapes_[0].get())->octree.get();
+  EXPECT_TRUE(cropped->search(0.0, 0.5, 0.0) == NULL);
+
+  // the changed cells reach a new cropped octree; the one already in the world (which snapshots may be using) is not modified
+  octree->updateNode(octomap::point3d(0.0, 0.5, 0.0), true);
+  octree->updateNode(octomap::point3d(0.0, 5.0, 0.0), true);
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  octree->resetChangeDetection();
+  EXPECT_TRUE(cropped->search(0.0, 0.5, 0.0) == NULL);
+  const octomap::OcTree *updated = static_cast<const shapes::OcTree*>(ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0].get())->octree.get();
+  EXPECT_NE(cropped, updated);
+  ASSERT_TRUE(updated->search(0.0, 0.5, 0.0) != NULL);
+  EXPECT_TRUE(updated->isNodeOccupied(updated->search(0.0, 0.5, 0.0)));
+  EXPECT_TRUE(updated->search(0.0, 5.0, 0.0) == NULL);
+  EXPECT_TRUE(updated->search(0.5, 0.0, 0.0) != NULL);
+
+  // without change detection, octrees updated in place are filtered again
+  boost::shared_ptr<octomap::OcTree> plain(new octomap::OcTree(0.1));
+  plain->updateNode(octomap::point3d(0.5, 0.0, 0.0), true);
+  ps.processOctomapPtr(plain, Eigen::Affine3d::Identity());
+  plain->updateNode(octomap::point3d(0.0, 0.5, 0.0), true);
+  ps.processOctomapPtr(plain, Eigen::Affine3d::Identity());
+  updated = static_cast<const shapes::OcTree*>(ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0].get())->octree.get();
+  ASSERT_TRUE(updated->search(0.0, 0.5, 0.0) != NULL);
+  EXPECT_TRUE(updated->isNodeOccupied(updated->search(0.0, 0.5, 0.0)));
+}
+
+TEST(PlanningScene, OctomapCropPrunedRegion)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+  ps.setOctomapBounds(Eigen::Vector3d(-0.32, -0.32, -0.32), Eigen::Vector3d(0.32, 0.32, 0.32));
+
+  // a solid block of 1.6m that prunes to a few large leaves, partly inside the crop box
+  boost::shared_ptr<octomap::OcTree> octree(new octomap::OcTree(0.1));
+  for (double x = 0.05 ; x < 1.6 ; x += 0.1)
+    for (double y = 0.05 ; y < 1.6 ; y += 0.1)
+      for (double z = 0.05 ; z < 1.6 ; z += 0.1)
+        octree->updateNode(octomap::point3d(x, y, z), true);
+  octree->updateInnerOccupancy();
+  octree->prune();
+
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  const octomap::OcTree *cropped = static_cast<const shapes::OcTree*>(ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0].get())->octree.get();
+  for (double x = 0.05 ; x < 1.6 ; x += 0.1)
+  {
+    const octomap::OcTreeNode *node = cropped->search(x, x, x);
+    if (x < 0.4)
+    {
+      ASSERT_TRUE(node != NULL) << x;
+      EXPECT_TRUE(cropped->isNodeOccupied(node));
+    }
+    else
+      EXPECT_TRUE(node == NULL) << x;
+  }
+}
+
+TEST(PlanningScene, OctomapRepeatedUpdates)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+  ps.setOctomapBounds(Eigen::Vector3d(-1, -1, -1), Eigen::Vector3d(1, 1, 1));
+
+  boost::shared_ptr<octomap::OcTree> octree(new octomap::OcTree(0.1));
+  octree->enableChangeDetection(true);
+  octree->updateNode(octomap::point3d(0.5, 0.0, 0.0), true);
+  ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  octree->resetChangeDetection();
+
+  // every update starts from the previous results, which must end up with the cells changed by all the updates
+  std::vector<octomap::point3d> cells;
+  cells.push_back(octomap::point3d(0.0, 0.5, 0.0));
+  cells.push_back(octomap::point3d(0.0, 0.0, 0.5));
+  cells.push_back(octomap::point3d(-0.5, 0.0, 0.0));
+  cells.push_back(octomap::point3d(0.0, -0.5, 0.0));
+  for (std::size_t i = 0 ; i < cells.size() ; ++i)
+  {
+    octree->updateNode(cells[i], true);
+    octree->updateNode(octomap::point3d(0.0, 5.0 + i, 0.0), true);
+    ps.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+    octree->resetChangeDetection();
+
+    const octomap::OcTree *cropped = static_cast<const shapes::OcTree*>(ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0].get())->octree.get();
+    EXPECT_TRUE(cropped->search(0.5, 0.0, 0.0) != NULL);
+    for (std::size_t j = 0 ; j <= i ; ++j)
+    {
+      ASSERT_TRUE(cropped->search(cells[j]) != NULL);
+      EXPECT_TRUE(cropped->isNodeOccupied(cropped->search(cells[j])));
+      EXPECT_TRUE(cropped->search(0.0, 5.0 + j, 0.0) == NULL);
+    }
+    for (std::size_t j = i + 1 ; j < cells.size() ; ++j)
+      EXPECT_TRUE(cropped->search(cells[j]) == NULL);
+  }
+}
+
+TEST(PlanningScene, Snapshot)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d id = Eigen::Affine3d::Identity();
+  ps->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.4)), id);
+
+  // the same snapshot is handed out until the scene changes
+  planning_scene::PlanningSceneConstPtr snap1 = ps->getSnapshot();
+  EXPECT_TRUE(snap1 == ps->getSnapshot());
+  EXPECT_TRUE(snap1->getWorld()->hasObject("sphere"));
+
+  ps->getWorldNonConst()->addToObject("sphere2", shapes::ShapeConstPtr(new shapes::Sphere(0.5)), id);
+  planning_scene::PlanningSceneConstPtr snap2 = ps->getSnapshot();
+  EXPECT_FALSE(snap1 == snap2);
+  EXPECT_FALSE(snap1->getWorld()->hasObject("sphere2"));
+  EXPECT_TRUE(snap2->getWorld()->hasObject("sphere2"));
+
+  ps->getAllowedCollisionMatrixNonConst().setEntry("sphere", "sphere2", true);
+  planning_scene::PlanningSceneConstPtr snap3 = ps->getSnapshot();
+  EXPECT_FALSE(snap2 == snap3);
+  collision_detection::AllowedCollision::Type type;
+  EXPECT_FALSE(snap2->getAllowedCollisionMatrix().getEntry("sphere", "sphere2", type));
+  EXPECT_TRUE(snap3->getAllowedCollisionMatrix().getEntry("sphere", "sphere2", type));
+
+  // the snapshot of a diff scene follows changes to the parent
+  planning_scene::PlanningScenePtr child = ps->diff();
+  planning_scene::PlanningSceneConstPtr child_snap1 = child->getSnapshot();
+  EXPECT_TRUE(child_snap1 == child->getSnapshot());
+  ps->getAllowedCollisionMatrixNonConst().setEntry("sphere", "sphere2", false);
+  planning_scene::PlanningSceneConstPtr child_snap2 = child->getSnapshot();
+  EXPECT_FALSE(child_snap1 == child_snap2);
+  EXPECT_TRUE(child_snap1->getAllowedCollisionMatrix().getEntry("sphere", "sphere2", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, type);
+  EXPECT_TRUE(child_snap2->getAllowedCollisionMatrix().getEntry("sphere", "sphere2", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::NEVER, type);
+}
+
+TEST(PlanningScene, FlattenDiffChains)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  ps->setMaxDiffDepth(2);
+  EXPECT_EQ(0u, ps->getDiffDepth());
+
+  planning_scene::PlanningScenePtr d1 = ps->diff();
+  planning_scene::PlanningScenePtr d2 = d1->diff();
+  planning_scene::PlanningScenePtr d3 = d2->diff();
+  planning_scene::PlanningScenePtr d4 = d3->diff();
+  EXPECT_EQ(1u, d1->getDiffDepth());
+  EXPECT_EQ(2u, d2->getDiffDepth());
+  EXPECT_EQ(1u, d3->getDiffDepth());
+  EXPECT_EQ(2u, d4->getDiffDepth());
+  EXPECT_EQ(2u, d4->getMaxDiffDepth());
+
+  // the flattened scene is still a diff of its parent, but no longer sees changes made to its parents
+  EXPECT_TRUE(d3->getParent() == d2);
+  ps->getAllowedCollisionMatrixNonConst().setEntry("a", "b", true);
+  collision_detection::AllowedCollision::Type type;
+  EXPECT_TRUE(d2->getAllowedCollisionMatrix().getEntry("a", "b", type));
+  EXPECT_FALSE(d3->getAllowedCollisionMatrix().getEntry("a", "b", type));
+  EXPECT_FALSE(d4->getAllowedCollisionMatrix().getEntry("a", "b", type));
+
+  d2->flatten();
+  EXPECT_EQ(1u, d2->getDiffDepth());
+  EXPECT_TRUE(d2->getAllowedCollisionMatrix().getEntry("a", "b", type));
+}
+
+TEST(PlanningScene, FlattenedDiffPushesOnlyItsChanges)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  planning_scene::PlanningScenePtr d = ps->diff();
+  d->flatten();
+  d->getAllowedCollisionMatrixNonConst().setEntry("a", "b", true);
+
+  // the inherited state, transforms and padding are not part of the diff
+  moveit_msgs::PlanningScene msg;
+  d->getPlanningSceneDiffMsg(msg);
+  EXPECT_TRUE(msg.robot_state.joint_state.name.empty());
+  EXPECT_TRUE(msg.fixed_frame_transforms.empty());
+  EXPECT_TRUE(msg.link_padding.empty());
+  EXPECT_FALSE(msg.allowed_collision_matrix.entry_names.empty());
+
+  // changes made to the parent meanwhile are not overwritten by the inherited copies
+  robot_state::RobotState &state = ps->getCurrentStateNonConst();
+  std::vector<double> values;
+  state.getStateValues(values);
+  values[0] += 0.1;
+  state.setStateValues(values);
+  ps->getCollisionRobotNonConst()->setLinkPadding(ps->getRobotModel()->getLinkModelNames()[0], 0.05);
+  d->pushDiffs(ps);
+
+  std::vector<double> pushed;
+  ps->getCurrentState().getStateValues(pushed);
+  EXPECT_EQ(values, pushed);
+  EXPECT_EQ(0.05, ps->getCollisionRobot()->getLinkPadding(ps->getRobotModel()->getLinkModelNames()[0]));
+  collision_detection::AllowedCollision::Type type;
+  EXPECT_TRUE(ps->getAllowedCollisionMatrix().getEntry("a", "b", type));
+}
+
+TEST(PlanningScene, DistanceField)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  EXPECT_FALSE(ps->getDistanceField());
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.2, .2, .2)),
+                                      Eigen::Affine3d(Eigen::Translation3d(.5, .5, .5)));
+
+  planning_scene::PlanningScenePtr diff = ps->diff();
+  boost::shared_ptr<distance_field::PropagationDistanceField> df(new distance_field::PropagationDistanceField(1.0, 1.0, 1.0, 0.05, 0.0, 0.0, 0.0, 0.3));
+  diff->setDistanceField(df);
+  ASSERT_TRUE(diff->getDistanceField());
+  EXPECT_EQ(0.0, diff->getDistanceField()->getDistance(.5, .5, .5));
+  EXPECT_LT(0.0, diff->getDistanceField()->getDistance(.2, .2, .2));
+
+  // changes to the world of the scene update the field
+  diff->getWorldNonConst()->addToObject("other", shapes::ShapeConstPtr(new shapes::Box(.2, .2, .2)),
+                                        Eigen::Affine3d(Eigen::Translation3d(.2, .2, .2)));
+  EXPECT_EQ(0.0, df->getDistance(.2, .2, .2));
+  diff->getWorldNonConst()->removeObject("box");
+  EXPECT_LT(0.0, df->getDistance(.5, .5, .5));
+
+  // clearing the diffs brings the field back to the world of the parent
+  diff->clearDiffs();
+  EXPECT_EQ(0.0, df->getDistance(.5, .5, .5));
+  EXPECT_LT(0.0, df->getDistance(.2, .2, .2));
+  diff->getWorldNonConst()->removeObject("box");
+  EXPECT_LT(0.0, df->getDistance(.5, .5, .5));
+
+  diff->setDistanceField(boost::shared_ptr<distance_field::DistanceField>());
+  EXPECT_FALSE(diff->getDistanceField());
+}
+
+TEST(PlanningScene, CollisionCheckCache)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  ps->getAllowedCollisionMatrixNonConst().setEntry(true);
+  ps->setCollisionCheckCache(2, 0.01);
+
+  robot_state::RobotState state(ps->getCurrentState());
+  EXPECT_FALSE(ps->isStateColliding(state));
+  EXPECT_FALSE(ps->isStateColliding(state));
+  robot_state::StateResultCacheStatistics stats = ps->getCollisionCheckCacheStatistics();
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(1u, stats.entries);
+
+  // states closer than the resolution share results
+  std::map<std::string, double> m;
+  m["r_shoulder_pan_joint"] = 0.001;
+  state.setStateValues(m);
+  EXPECT_FALSE(ps->isStateColliding(state));
+  EXPECT_EQ(2u, ps->getCollisionCheckCacheStatistics().hits);
+
+  // changing the scene makes previous results unreachable
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(5.0, 5.0, 5.0)), Eigen::Affine3d::Identity());
+  EXPECT_TRUE(ps->isStateColliding(state));
+  EXPECT_EQ(2u, ps->getCollisionCheckCacheStatistics().misses);
+
+  // also when the matrix is modified through a reference obtained earlier
+  collision_detection::AllowedCollisionMatrix &acm = ps->getAllowedCollisionMatrixNonConst();
+  EXPECT_TRUE(ps->isStateColliding(state));
+  acm.setEntry("box", ps->getRobotModel()->getLinkModelNames(), true);
+  EXPECT_FALSE(ps->isStateColliding(state));
+
+  // a body attached to a different link is a different state, even if its name is the same
+  const std::vector<std::string> &links = ps->getRobotModel()->getLinkModelNames();
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Sphere(0.01)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  state.attachBody("ball", shapes, poses, std::vector<std::string>(), links[0]);
+  std::size_t misses = ps->getCollisionCheckCacheStatistics().misses;
+  EXPECT_FALSE(ps->isStateColliding(state));
+  EXPECT_FALSE(ps->isStateColliding(state));
+  EXPECT_EQ(misses + 1, ps->getCollisionCheckCacheStatistics().misses);
+  state.clearAttachedBody("ball");
+  state.attachBody("ball", shapes, poses, std::vector<std::string>(), links[1]);
+  EXPECT_FALSE(ps->isStateColliding(state));
+  EXPECT_EQ(misses + 2, ps->getCollisionCheckCacheStatistics().misses);
+  state.clearAttachedBody("ball");
+
+  // the least recently used results are discarded
+  for (int i = 0 ; i < 5 ; ++i)
+  {
+    m["r_shoulder_pan_joint"] = 0.1 * i;
+    state.setStateValues(m);
+    EXPECT_FALSE(ps->isStateColliding(state));
+  }
+  EXPECT_EQ(2u, ps->getCollisionCheckCacheStatistics().entries);
+
+  ps->setCollisionCheckCache(0);
+  EXPECT_EQ(0u, ps->getCollisionCheckCacheStatistics().hits);
+  EXPECT_FALSE(ps->isStateColliding(state));
+}
+
+TEST(PlanningScene, QueryCounters)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(5.0, 5.0, 5.0)), Eigen::Affine3d::Identity());
+  robot_state::RobotState state(ps->getCurrentState());
+
+  // nothing is counted unless counting is on
+  planning_scene::PlanningScene::resetThreadQueryCounts();
+  EXPECT_TRUE(ps->isStateColliding(state));
+  EXPECT_TRUE(planning_scene::PlanningScene::getThreadQueryCounts().empty());
+
+  planning_scene::PlanningScene::setQueryCountersEnabled(true);
+  EXPECT_TRUE(ps->isStateColliding(state));
+  moveit::tools::QueryCounts counts = planning_scene::PlanningScene::getThreadQueryCounts();
+  EXPECT_LE(1u, counts.get(moveit::tools::COLLISION_CHECKS));
+  EXPECT_LE(1u, counts.get(moveit::tools::BROAD_PHASE_PAIRS));
+  EXPECT_LE(1u, counts.get(moveit::tools::NARROW_PHASE_CALLS));
+  EXPECT_EQ(0u, counts.get(moveit::tools::IK_CALLS));
+
+  std::map<std::string, double> m;
+  m["r_shoulder_pan_joint"] = 0.1;
+  state.setStateValues(m);
+  moveit::tools::QueryCounts after = planning_scene::PlanningScene::getThreadQueryCounts();
+  after -= counts;
+  EXPECT_EQ(1u, after.get(moveit::tools::FK_UPDATES));
+  EXPECT_EQ(0u, after.get(moveit::tools::COLLISION_CHECKS));
+
+  planning_scene::PlanningScene::resetThreadQueryCounts();
+  EXPECT_TRUE(planning_scene::PlanningScene::getThreadQueryCounts().empty());
+  planning_scene::PlanningScene::setQueryCountersEnabled(false);
+}
+
+TEST(PlanningScene, MemoryUsage)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  planning_scene::PlanningSceneMemoryUsage empty;
+  ps->getMemoryUsage(empty);
+  EXPECT_LT(0u, empty.state_);
+  EXPECT_LT(0u, empty.collision_detectors_);
+  EXPECT_EQ(0u, empty.world_objects_);
+  EXPECT_EQ(0u, empty.distance_field_);
+
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(1.0, 1.0, 1.0)), Eigen::Affine3d::Identity());
+  planning_scene::PlanningSceneMemoryUsage with_box;
+  ps->getMemoryUsage(with_box);
+  EXPECT_LT(0u, with_box.world_objects_);
+  EXPECT_LT(empty.collision_detectors_, with_box.collision_detectors_);
+  EXPECT_LT(empty.total(), with_box.total());
+
+  // a diff scene does not count what it shares with its parent
+  planning_scene::PlanningScenePtr child = ps->diff();
+  planning_scene::PlanningSceneMemoryUsage diff;
+  child->getMemoryUsage(diff);
+  EXPECT_EQ(0u, diff.state_);
+  EXPECT_EQ(0u, diff.diffs_);
+  EXPECT_GT(with_box.world_objects_, diff.world_objects_);
+
+  child->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.5)), Eigen::Affine3d::Identity());
+  child->getMemoryUsage(diff);
+  EXPECT_LT(0u, diff.diffs_);
+
+  // the octree of an octomap is counted separately
+  octomap::OcTree tree(0.1);
+  tree.updateNode(octomap::point3d(1.0, 1.0, 1.0), true);
+  ps->processOctomapPtr(boost::shared_ptr<const octomap::OcTree>(new octomap::OcTree(tree)), Eigen::Affine3d::Identity());
+  planning_scene::PlanningSceneMemoryUsage with_octree;
+  ps->getMemoryUsage(with_octree);
+  EXPECT_LT(0u, with_octree.octrees_);
+  EXPECT_EQ(with_box.world_objects_, with_octree.world_objects_);
+
+  EXPECT_LT(0u, ps->getCurrentState().getMemoryUsage());
+}
+
+// reject the states with the right shoulder pan joint between -.6 and -.4
+static bool shoulderPanFeasible(const robot_state::RobotState &state, bool verbose)
+{
+  double v = state.getJointState("r_shoulder_pan_joint")->getVariableValues()[0];
+  return v < -.6 || v > -.4;
+}
+
+TEST(PlanningScene, PathValidationOptions)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  ps->getAllowedCollisionMatrixNonConst().setEntry(true);
+  ps->setStateFeasibilityPredicate(&shoulderPanFeasible);
+
+  // the waypoints are all feasible, but the motion between the second and third one is not
+  robot_trajectory::RobotTrajectory trajectory(ps->getRobotModel(), "");
+  robot_state::RobotState state(ps->getCurrentState());
+  const double values[] = { .2, 0., -1., -1.2, -1.4 };
+  for (std::size_t i = 0 ; i < sizeof(values) / sizeof(values[0]) ; ++i)
+  {
+    std::map<std::string, double> m;
+    m["r_shoulder_pan_joint"] = values[i];
+    state.setStateValues(m);
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+
+  const moveit_msgs::Constraints path_constraints;
+  const std::vector<moveit_msgs::Constraints> goal_constraints;
+  std::vector<std::size_t> invalid;
+  EXPECT_TRUE(ps->isPathValid(trajectory, path_constraints, goal_constraints, "", false, &invalid));
+
+  planning_scene::PathValidationOptions options;
+  EXPECT_TRUE(ps->isPathValid(trajectory, path_constraints, goal_constraints, options));
+
+  options.max_link_displacement = 0.01;
+  EXPECT_FALSE(ps->isPathValid(trajectory, path_constraints, goal_constraints, options));
+  for (unsigned int threads = 1 ; threads <= 4 ; threads *= 2)
+  {
+    options.num_threads = threads;
+    EXPECT_FALSE(ps->isPathValid(trajectory, path_constraints, goal_constraints, options, "", false, &invalid));
+    ASSERT_EQ(1u, invalid.size());
+    EXPECT_EQ(2u, invalid[0]);
+  }
+
+  // the infeasible waypoint is reported the same way, in whatever order the checks are done
+  std::map<std::string, double> m;
+  m["r_shoulder_pan_joint"] = -.5;
+  state.setStateValues(m);
+  trajectory.addSuffixWayPoint(state, 0.1);
+  options.max_link_displacement = 0.0;
+  options.bisection_order = false;
+  EXPECT_FALSE(ps->isPathValid(trajectory, path_constraints, goal_constraints, options, "", false, &invalid));
+  ASSERT_EQ(1u, invalid.size());
+  EXPECT_EQ(5u, invalid[0]);
+}
+
+TEST(PlanningScene, ParallelShapeDecoding)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+  for (int i = 0 ; i < 8 ; ++i)
+  {
+    std::stringstream id;
+    id << "object" << i;
+    shapes::Mesh *mesh = new shapes::Mesh(3, 1);
+    for (unsigned int j = 0 ; j < 9 ; ++j)
+      mesh->vertices[j] = j == 0 || j == 4 || j == 8 ? 1.0 + i : 0.0;
+    mesh->triangles[0] = 0; mesh->triangles[1] = 1; mesh->triangles[2] = 2;
+    ps.getWorldNonConst()->addToObject(id.str(), shapes::ShapeConstPtr(mesh), Eigen::Affine3d(Eigen::Translation3d(i, 0, 0)));
+    ps.getWorldNonConst()->addToObject(id.str(), shapes::ShapeConstPtr(new shapes::Box(0.1, 0.2, 0.1 * (i + 1))),
+                                       Eigen::Affine3d(Eigen::Translation3d(0, i, 0)));
+  }
+  moveit_msgs::PlanningSceneWorld msg;
+  moveit_msgs::PlanningScene scene_msg;
+  ps.getPlanningSceneMsg(scene_msg);
+  msg = scene_msg.world;
+
+  planning_scene::PlanningScene serial(urdf_model, srdf_model);
+  serial.processPlanningSceneWorldMsg(msg);
+  planning_scene::PlanningScene parallel(urdf_model, srdf_model);
+  parallel.setShapeDecodingThreads(4);
+  EXPECT_EQ(4u, parallel.getShapeDecodingThreads());
+  EXPECT_EQ(4u, parallel.diff()->getShapeDecodingThreads());
+  parallel.processPlanningSceneWorldMsg(msg);
+
+  // the same objects enter the world, with their shapes in the same order
+  ASSERT_EQ(serial.getWorld()->getObjectIds().size(), parallel.getWorld()->getObjectIds().size());
+  for (collision_detection::World::const_iterator it = serial.getWorld()->begin() ; it != serial.getWorld()->end() ; ++it)
+  {
+    collision_detection::World::ObjectConstPtr obj = parallel.getWorld()->getObject(it->first);
+    ASSERT_TRUE(obj);
+    ASSERT_EQ(it->second->shapes_.size(), obj->shapes_.size());
+    for (std::size_t i = 0 ; i < obj->shapes_.size() ; ++i)
+    {
+      EXPECT_EQ(it->second->shapes_[i]->type, obj->shapes_[i]->type);
+      EXPECT_TRUE(it->second->shape_poses_[i].isApprox(obj->shape_poses_[i]));
+    }
+  }
+
+  // single objects are decoded the same way
+  moveit_msgs::CollisionObject co = msg.collision_objects[0];
+  co.id = "copy";
+  EXPECT_TRUE(parallel.processCollisionObjectMsg(co));
+  ASSERT_TRUE(parallel.getWorld()->hasObject("copy"));
+  EXPECT_EQ(2u, parallel.getWorld()->getObject("copy")->shapes_.size());
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,180 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_PROFILER_BENCHMARK_
+#define MOVEIT_PROFILER_BENCHMARK_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace moveit
+{
+
+/** \brief A small harness for micro-benchmarks. Each case is a function that is called repeatedly, in batches large
+    enough for the clock to measure them reliably, until a minimum amount of time was spent on it. The time per call is
+    reported as a mean and as percentiles over the batches, so occasional slow calls are visible.
+
+    The command line of the executable selects what runs:
+    \verbatim
+    --min-time <seconds>   time spent on each case (default 0.5)
+    --filter <text>        only run the cases whose name contains <text>
+    --csv <file>           also write the results to <file>
+    --threads <n,m,...>    the thread counts concurrent cases run with (default 1,2,4 and the number of cores)
+    \endverbatim */
+class Benchmark : private boost::noncopyable
+{
+public:
+
+  /** \brief The measurements of one case */
+  struct Result
+  {
+    Result() : calls_(0), seconds_(0.0), mean_(0.0), p50_(0.0), p99_(0.0), items_per_call_(1.0), threads_(1), throughput_(0.0),
+              memory_(0)
+    {
+    }
+
+    /** \brief The name of the case */
+    std::string name_;
+
+    /** \brief The number of timed calls (0 if the case was skipped) */
+    std::size_t calls_;
+
+    /** \brief The total time of the timed calls, in seconds (summed over threads) */
+    double      seconds_;
+
+    /** \brief The mean time of a call, in seconds */
+    double      mean_;
+
+    /** \brief The median time of a call, over batches, in seconds */
+    double      p50_;
+
+    /** \brief The 99th percentile of the time of a call, over batches, in seconds */
+    double      p99_;
+
+    /** \brief The number of items (e.g., states, checks) one call processes */
+    double      items_per_call_;
+
+    /** \brief The number of threads that made calls at the same time */
+    unsigned int threads_;
+
+    /** \brief The number of items processed per second of wall time, by all threads together */
+    double      throughput_;
+
+    /** \brief Memory attributed to the case, in bytes (0 if not measured; see recordMemory()) */
+    std::size_t memory_;
+
+    /** \brief Free text reported with the case (see setNote()) */
+    std::string note_;
+  };
+
+  /** \brief Read the options from the command line of the executable */
+  Benchmark(int argc, char **argv);
+
+  /** \brief Check if the case named \e name is selected by the command line filter */
+  bool enabled(const std::string &name) const;
+
+  /** \brief Time \e fn under the name \e name, if it is enabled. One call processes \e items_per_call items.
+      The function is called once before timing starts, so caches and lazily allocated memory are warm. */
+  Result run(const std::string &name, const boost::function<void()> &fn, double items_per_call = 1.0);
+
+  /** \brief Time the functions in \e fns under the name \e name, if it is enabled: each function is called repeatedly
+      by a thread of its own, and all threads run at the same time. The times per call (as in run()) are collected over
+      all threads, so the percentiles show the latency a caller sees under contention, while the throughput shows how
+      the work scales with the number of threads. */
+  Result runConcurrent(const std::string &name, const std::vector<boost::function<void()> > &fns, double items_per_call = 1.0);
+
+  /** \brief Record \e bytes of memory used by \e name (e.g., a data structure in some configuration), if it is enabled.
+      The memory is reported along with the timed cases. */
+  Result recordMemory(const std::string &name, std::size_t bytes);
+
+  /** \brief Report \e note along with the results of the case named \e name (e.g., the success rate of a sampler).
+      Nothing is done if that case did not run. */
+  void setNote(const std::string &name, const std::string &note);
+
+  /** \brief Get the number of bytes currently allocated on the heap by this process, if the C library can tell (glibc
+      can); 0 otherwise. The difference of two calls measures what was allocated (and not freed) in between. */
+  static std::size_t getHeapBytes();
+
+  /** \brief Get the thread counts selected on the command line for concurrent cases */
+  const std::vector<unsigned int>& getThreadCounts() const
+  {
+    return thread_counts_;
+  }
+
+  /** \brief Get the results of the cases that ran so far */
+  const std::vector<Result>& getResults() const
+  {
+    return results_;
+  }
+
+  /** \brief Get the minimum time spent on each case, in seconds */
+  double getMinTime() const
+  {
+    return min_time_;
+  }
+
+  /** \brief Print a table of the results to \e out and, if requested on the command line, write them to a CSV file.
+      Returns the exit code for the executable: 0 on success, 1 if the CSV file could not be written or the command line
+      was invalid. */
+  int report(std::ostream &out = std::cout) const;
+
+  /** \brief Make the compiler believe \e value is used, so computations that only produce it are not optimized away */
+  template<typename T>
+  static void keep(const T &value)
+  {
+#ifdef __GNUC__
+    __asm__ __volatile__("" : : "g"(&value) : "memory");
+#else
+    sink_ = static_cast<const void*>(&value);
+#endif
+  }
+
+private:
+
+  double                    min_time_;
+  std::string               filter_;
+  std::string               csv_file_;
+  std::vector<unsigned int> thread_counts_;
+  bool                      args_ok_;
+  std::vector<Result>       results_;
+
+  static const void * volatile sink_;
+};
+
+}
+
+#endif
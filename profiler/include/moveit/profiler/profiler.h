@@ -58,9 +58,18 @@
 #include <map>
 #include <string>
 #include <iostream>
+#include <vector>
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace moveit
 {
@@ -69,29 +78,65 @@ namespace moveit
     spent in various chunks of code. This is different from
     external profiling tools in that it allows the user to count
     time spent in various bits of code (sub-function granularity)
-    or count how many times certain pieces of code are executed.*/
+    or count how many times certain pieces of code are executed.
+    Each thread counts in its own storage, so threads do not wait
+    for each other; the data of the threads is only combined when
+    it is printed. */
 class Profiler : private boost::noncopyable
 {
 public:
 
+  /** \brief The formats of exported profiling data (see exportData()) */
+  enum ExportFormat
+  {
+    /** \brief A JSON object with the total time and arrays of events, averages and blocks of time; blocks
+        include their non-empty histogram buckets as [nanoseconds, count] pairs */
+    EXPORT_JSON,
+
+    /** \brief Comma separated values, one row per event, average, block of time and non-empty histogram bucket;
+        the first row names the columns */
+    EXPORT_CSV,
+
+    /** \brief A compact binary form, in native byte order (see profiler.cpp for the layout) */
+    EXPORT_BINARY
+  };
+
+  /** \brief Callback that receives the exported data of a periodic snapshot */
+  typedef boost::function<void(const std::string&)> SnapshotCallback;
+
+  /** \brief A name registered with registerKey(). Counting with a key instead of a name avoids
+      creating and comparing strings, which makes profiling cheap enough for very small blocks of code */
+  typedef unsigned int Key;
+
   /** \brief This instance will call Profiler::begin() when constructed and Profiler::end() when it goes out of scope. */
   class ScopedBlock
   {
   public:
     /** \brief Start counting time for the block named \e name of the profiler \e prof */
-    ScopedBlock(const std::string &name, Profiler &prof = Profiler::Instance()) : name_(name), prof_(prof)
+    ScopedBlock(const std::string &name, Profiler &prof = Profiler::Instance()) : name_(name), key_(0), useKey_(false), prof_(prof)
     {
       prof_.begin(name);
     }
 
+    /** \brief Start counting time for the block with key \e key of the profiler \e prof */
+    ScopedBlock(Key key, Profiler &prof = Profiler::Instance()) : key_(key), useKey_(true), prof_(prof)
+    {
+      prof_.begin(key);
+    }
+
     ~ScopedBlock(void)
     {
-      prof_.end(name_);
+      if (useKey_)
+        prof_.end(key_);
+      else
+        prof_.end(name_);
     }
 
   private:
 
     std::string  name_;
+    Key          key_;
+    bool         useKey_;
     Profiler    &prof_;
   };
 
@@ -125,7 +170,8 @@ public:
 
   /** \brief Constructor. It is allowed to separately instantiate this
       class (not only as a singleton) */
-  Profiler(bool printOnDestroy = false, bool autoStart = false) : running_(false), printOnDestroy_(printOnDestroy)
+  Profiler(bool printOnDestroy = false, bool autoStart = false) : threadSlot_(&releaseThreadSlot), running_(false),
+                                                                  printOnDestroy_(printOnDestroy), stopSnapshots_(false)
   {
     if (autoStart)
       start();
@@ -134,7 +180,8 @@ public:
   /** \brief Destructor */
   ~Profiler(void)
   {
-    if (printOnDestroy_ && !data_.empty())
+    stopSnapshots();
+    if (printOnDestroy_ && (!slots_.empty() || !retired_.events.empty() || !retired_.avg.empty() || !retired_.time.empty()))
       status();
   }
 
@@ -165,12 +212,30 @@ public:
   /** \brief Clear counted time and events */
   void clear(void);
 
+  /** \brief Get the key for \e name; the same name always gets the same key */
+  static Key RegisterKey(const std::string &name)
+  {
+    return Instance().registerKey(name);
+  }
+
+  /** \brief Get the key for \e name; the same name always gets the same key. Keys are specific to a profiler instance */
+  Key registerKey(const std::string &name);
+
   /** \brief Count a specific event for a number of times */
   static void Event(const std::string& name, const unsigned int times = 1)
   {
     Instance().event(name, times);
   }
 
+  /** \brief Count a specific event for a number of times */
+  static void Event(Key key, const unsigned int times = 1)
+  {
+    Instance().event(key, times);
+  }
+
+  /** \brief Count a specific event for a number of times */
+  void event(Key key, const unsigned int times = 1);
+
   /** \brief Count a specific event for a number of times */
   void event(const std::string &name, const unsigned int times = 1);
 
@@ -183,6 +248,15 @@ public:
   /** \brief Maintain the average of a specific value */
   void average(const std::string &name, const double value);
 
+  /** \brief Maintain the average of a specific value */
+  static void Average(Key key, const double value)
+  {
+    Instance().average(key, value);
+  }
+
+  /** \brief Maintain the average of a specific value */
+  void average(Key key, const double value);
+
   /** \brief Begin counting time for a specific chunk of code */
   static void Begin(const std::string &name)
   {
@@ -201,6 +275,24 @@ public:
   /** \brief Stop counting time for a specific chunk of code */
   void end(const std::string &name);
 
+  /** \brief Begin counting time for a specific chunk of code */
+  static void Begin(Key key)
+  {
+    Instance().begin(key);
+  }
+
+  /** \brief Stop counting time for a specific chunk of code */
+  static void End(Key key)
+  {
+    Instance().end(key);
+  }
+
+  /** \brief Begin counting time for a specific chunk of code */
+  void begin(Key key);
+
+  /** \brief Stop counting time for a specific chunk of code */
+  void end(Key key);
+
   /** \brief Print the status of the profiled code chunks and
       events. Optionally, computation done by different threads
       can be printed separately. */
@@ -225,6 +317,27 @@ public:
       events to the console (using msg::Console) */
   void console(void);
 
+  /** \brief Write the profiled code chunks and events, combined over all threads, to \e out in
+      the format \e format. If \e reset is true, the counted data is cleared in the same step, so
+      successive exports cover disjoint periods. Unlike status(), this does not stop the profiler. */
+  static void Export(std::ostream &out, ExportFormat format, bool reset = false)
+  {
+    Instance().exportData(out, format, reset);
+  }
+
+  /** \brief Write the profiled code chunks and events, combined over all threads, to \e out in
+      the format \e format. If \e reset is true, the counted data is cleared in the same step, so
+      successive exports cover disjoint periods. Unlike status(), this does not stop the profiler. */
+  void exportData(std::ostream &out, ExportFormat format, bool reset = false);
+
+  /** \brief Start a background thread that exports the data in \e format every \e period seconds,
+      passes it to \e callback and clears it. A running snapshot thread is stopped first. The profiled
+      threads are only held up while their own data is copied and cleared */
+  void startSnapshots(double period, ExportFormat format, const SnapshotCallback &callback);
+
+  /** \brief Stop the snapshot thread started by startSnapshots(), if any */
+  void stopSnapshots(void);
+
   /** \brief Check if the profiler is counting time or not */
   bool running(void) const
   {
@@ -239,44 +352,110 @@ public:
 
 private:
 
-  /** \brief Information about time spent in a section of the code */
+  /** \brief Information about time spent in a section of the code. Times are measured in nanoseconds
+      with a monotonic clock, and kept in a histogram with logarithmically spaced buckets (four buckets
+      for each power of two, so a bucket is at most 25% wide) for computing percentiles */
   struct TimeInfo
   {
-    TimeInfo(void) : total(0, 0, 0, 0), shortest(boost::posix_time::pos_infin), longest(boost::posix_time::neg_infin), parts(0)
+    /** \brief The number of buckets of the histogram, enough for any 64 bit duration */
+    static const unsigned int HISTOGRAM_BUCKETS = 256;
+
+    TimeInfo(void) : total(0), shortest(std::numeric_limits<boost::int64_t>::max()), longest(0), parts(0)
     {
+      std::fill(histogram, histogram + HISTOGRAM_BUCKETS, 0);
     }
 
-    /** \brief Total time counted. */
-    boost::posix_time::time_duration total;
+    /** \brief Total time counted (nanoseconds). */
+    boost::int64_t total;
 
-    /** \brief The shortest counted time interval */
-    boost::posix_time::time_duration shortest;
+    /** \brief The shortest counted time interval (nanoseconds) */
+    boost::int64_t shortest;
 
-    /** \brief The longest counted time interval */
-    boost::posix_time::time_duration longest;
+    /** \brief The longest counted time interval (nanoseconds) */
+    boost::int64_t longest;
 
     /** \brief Number of times a chunk of time was added to this structure */
     unsigned long int parts;
 
+    /** \brief The number of counted time intervals in each bucket (see bucketIndex()) */
+    unsigned long int histogram[HISTOGRAM_BUCKETS];
+
     /** \brief The point in time when counting time started */
-    boost::posix_time::ptime start;
+    boost::chrono::steady_clock::time_point start;
 
     /** \brief Begin counting time */
     void set(void)
     {
-      start = boost::posix_time::microsec_clock::universal_time();
+      start = boost::chrono::steady_clock::now();
     }
 
     /** \brief Add the counted time to the total time */
     void update(void)
     {
-      const boost::posix_time::time_duration &dt = boost::posix_time::microsec_clock::universal_time() - start;
+      const boost::int64_t dt = boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now() - start).count();
       if (dt > longest)
         longest = dt;
       if (dt < shortest)
         shortest = dt;
-      total = total + dt;
+      total += dt;
       ++parts;
+      ++histogram[bucketIndex(dt)];
+    }
+
+    /** \brief Add the time counted in \e other */
+    void add(const TimeInfo &other)
+    {
+      total += other.total;
+      parts += other.parts;
+      if (other.shortest < shortest)
+        shortest = other.shortest;
+      if (other.longest > longest)
+        longest = other.longest;
+      for (unsigned int i = 0 ; i < HISTOGRAM_BUCKETS ; ++i)
+        histogram[i] += other.histogram[i];
+    }
+
+    /** \brief Get the time (nanoseconds) below which a fraction \e p of the counted intervals lie, at the resolution of the histogram */
+    boost::int64_t percentile(double p) const
+    {
+      if (parts == 0)
+        return 0;
+      const unsigned long int target = std::max(1ul, (unsigned long int)ceil(p * parts));
+      unsigned long int count = 0;
+      for (unsigned int i = 0 ; i < HISTOGRAM_BUCKETS ; ++i)
+      {
+        count += histogram[i];
+        if (count >= target)
+          return std::min(longest, std::max(shortest, bucketValue(i)));
+      }
+      return longest;
+    }
+
+    /** \brief The bucket of a duration: durations below 4 have their own bucket; above, the bucket is given
+        by the position of the highest set bit and the two bits after it */
+    static unsigned int bucketIndex(boost::int64_t duration)
+    {
+      if (duration < 4)
+        return duration < 0 ? 0 : (unsigned int)duration;
+      boost::uint64_t v = duration;
+      unsigned int msb = 0;
+      if (v >> 32) { v >>= 32; msb += 32; }
+      if (v >> 16) { v >>= 16; msb += 16; }
+      if (v >> 8) { v >>= 8; msb += 8; }
+      if (v >> 4) { v >>= 4; msb += 4; }
+      if (v >> 2) { v >>= 2; msb += 2; }
+      if (v >> 1) { msb += 1; }
+      return 4 * (msb - 1) + (unsigned int)((duration >> (msb - 2)) & 3);
+    }
+
+    /** \brief The middle of the range of durations of a bucket */
+    static boost::int64_t bucketValue(unsigned int index)
+    {
+      if (index < 4)
+        return index;
+      const unsigned int shift = index / 4 - 1;
+      const boost::int64_t low = (boost::int64_t)(4 + index % 4) << shift;
+      return low + ((boost::int64_t)1 << shift) / 2;
     }
   };
 
@@ -291,6 +470,14 @@ private:
 
     /** \brief Number of times a value was added to this structure */
     unsigned long int parts;
+
+    /** \brief Add the values counted in \e other */
+    void add(const AvgInfo &other)
+    {
+      total += other.total;
+      totalSqr += other.totalSqr;
+      parts += other.parts;
+    }
   };
 
   /** \brief Information to be maintained for each thread */
@@ -304,15 +491,91 @@ private:
 
     /** \brief The amount of time spent in various places */
     std::map<std::string, TimeInfo>          time;
+
+    /** \brief The stored events counted with keys, indexed by key */
+    std::vector<unsigned long int>           keyEvents;
+
+    /** \brief The stored averages counted with keys, indexed by key */
+    std::vector<AvgInfo>                     keyAvg;
+
+    /** \brief The amount of time spent in places counted with keys, indexed by key */
+    std::vector<TimeInfo>                    keyTime;
   };
 
+  /** \brief The storage of a thread. Only the owning thread writes to it; the lock is only contended
+      while status() or clear() access the data */
+  struct ThreadSlot
+  {
+    ThreadSlot(Profiler *profiler, const boost::thread::id &id) : owner(profiler), threadId(id)
+    {
+    }
+
+    /** \brief The profiler the storage is registered with */
+    Profiler         *owner;
+
+    /** \brief The thread this storage belongs to */
+    boost::thread::id threadId;
+
+    /** \brief Lock for the data */
+    boost::mutex      lock;
+
+    /** \brief The data counted by the thread */
+    PerThread         data;
+  };
+
+  /** \brief Get the storage of the calling thread, creating and registering it on first use */
+  ThreadSlot& getThreadSlot(void)
+  {
+    ThreadSlot *slot = threadSlot_.get();
+    return slot ? *slot : registerThreadSlot();
+  }
+
+  /** \brief Create the storage of the calling thread */
+  ThreadSlot& registerThreadSlot(void);
+
+  /** \brief Called when a thread exits: its data is kept with that of the other exited threads and its storage is
+      released. Threads that used the profiler are expected to exit before it is destroyed */
+  static void releaseThreadSlot(ThreadSlot *slot)
+  {
+    slot->owner->retireThreadSlot(slot);
+  }
+
+  /** \brief Move the data of the storage of an exited thread to retired_ and remove the storage */
+  void retireThreadSlot(ThreadSlot *slot);
+
+  /** \brief Move the data of a thread from \e data to \e old (which is expected to be empty), leaving \e data empty
+      except for the start times of the blocks of time, which may be in progress */
+  static void resetThreadData(PerThread &data, PerThread &old);
+
+  /** \brief Add the data of \e data to \e combined, whose data is only kept by name */
+  void addThreadData(PerThread &combined, const PerThread &data) const;
+
   void printThreadInfo(std::ostream &out, const PerThread &data);
 
-  boost::mutex                           lock_;
-  std::map<boost::thread::id, PerThread> data_;
-  TimeInfo                               tinfo_;
-  bool                                   running_;
-  bool                                   printOnDestroy_;
+  /** \brief Combine the data of all threads into \e combined and get the counted time (seconds) so far;
+      optionally clear the data */
+  void takeSnapshot(PerThread &combined, double &total_time, bool reset);
+
+  /** \brief The loop of the snapshot thread */
+  void snapshotThread(double period, ExportFormat format, SnapshotCallback callback);
+
+  /** \brief Protects slots_, retired_, tinfo_ and the registered keys */
+  boost::mutex                               lock_;
+  std::map<std::string, Key>                 keys_;
+  std::vector<std::string>                   keyNames_;
+  std::vector<boost::shared_ptr<ThreadSlot> > slots_;
+  /** \brief The data of the threads that exited, kept by name */
+  PerThread                                  retired_;
+  boost::thread_specific_ptr<ThreadSlot>     threadSlot_;
+  TimeInfo                                   tinfo_;
+  bool                                       running_;
+  bool                                       printOnDestroy_;
+
+  /** \brief The periodic snapshot thread, and what is used to stop it */
+  boost::scoped_ptr<boost::thread>           snapshotThread_;
+  boost::mutex                               snapshotLock_;
+  boost::condition_variable                  snapshotCondition_;
+  bool                                       stopSnapshots_;
 
 };
 }
@@ -339,6 +602,10 @@ public:
     {
     }
 
+    ScopedBlock(unsigned int, Profiler & = Profiler::Instance())
+    {
+    }
+
     ~ScopedBlock(void)
     {
     }
@@ -391,10 +658,54 @@ public:
   {
   }
 
+  typedef unsigned int Key;
+
+  static Key RegisterKey(const std::string &)
+  {
+    return 0;
+  }
+
+  Key registerKey(const std::string &)
+  {
+    return 0;
+  }
+
   static void Event(const std::string&, const unsigned int = 1)
   {
   }
 
+  static void Event(Key, const unsigned int = 1)
+  {
+  }
+
+  void event(Key, const unsigned int = 1)
+  {
+  }
+
+  static void Average(Key, const double)
+  {
+  }
+
+  void average(Key, const double)
+  {
+  }
+
+  static void Begin(Key)
+  {
+  }
+
+  static void End(Key)
+  {
+  }
+
+  void begin(Key)
+  {
+  }
+
+  void end(Key)
+  {
+  }
+
   void event(const std::string &, const unsigned int = 1)
   {
   }
@@ -439,6 +750,30 @@ public:
   {
   }
 
+  enum ExportFormat
+  {
+    EXPORT_JSON, EXPORT_CSV, EXPORT_BINARY
+  };
+
+  typedef void (*SnapshotCallback)(const std::string&);
+
+  static void Export(std::ostream &, ExportFormat, bool = false)
+  {
+  }
+
+  void exportData(std::ostream &, ExportFormat, bool = false)
+  {
+  }
+
+  template <typename Callback>
+  void startSnapshots(double, ExportFormat, const Callback &)
+  {
+  }
+
+  void stopSnapshots(void)
+  {
+  }
+
   bool running(void) const
   {
     return false;
@@ -0,0 +1,138 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_PROFILER_QUERY_COUNTERS_
+#define MOVEIT_PROFILER_QUERY_COUNTERS_
+
+#include <boost/atomic.hpp>
+#include <cstddef>
+#include <string>
+
+namespace moveit
+{
+namespace tools
+{
+
+/** \brief The kinds of queries counted by QueryCounters */
+enum QueryType
+  {
+    /** \brief Calls to the collision checking functions of CollisionRobotFCL and CollisionWorldFCL */
+    COLLISION_CHECKS,
+
+    /** \brief Calls to the distance functions of CollisionRobotFCL and CollisionWorldFCL */
+    DISTANCE_QUERIES,
+
+    /** \brief Pairs of objects the broad phase passed to the FCL collision and distance callbacks */
+    BROAD_PHASE_PAIRS,
+
+    /** \brief Pairs the callbacks passed on to FCL's narrow phase (fcl::collide(), fcl::distance(), ...) */
+    NARROW_PHASE_CALLS,
+
+    /** \brief Calls to the IK solvers made by JointStateGroup::setFromIK() (and Cartesian path computation) */
+    IK_CALLS,
+
+    /** \brief Passes of RobotState::updateLinkTransforms() (forward kinematics) */
+    FK_UPDATES,
+
+    QUERY_TYPE_COUNT
+  };
+
+/** \brief A number of queries of each type */
+struct QueryCounts
+{
+  QueryCounts();
+
+  std::size_t get(QueryType type) const
+  {
+    return counts_[type];
+  }
+
+  QueryCounts& operator+=(const QueryCounts &other);
+  QueryCounts& operator-=(const QueryCounts &other);
+
+  /** \brief Check if all the counts are 0 */
+  bool empty() const;
+
+  /** \brief The counts that are not 0, as "<count> <name>" separated by commas */
+  std::string toString() const;
+
+  /** \brief The name of a query type (e.g., "collision checks") */
+  static const char* getName(QueryType type);
+
+  std::size_t counts_[QUERY_TYPE_COUNT];
+};
+
+/** \brief Counters of the collision and kinematics queries made by each thread. Counting is off by default; when it is
+    on, each counted query costs a lookup of the counts of the calling thread and an increment. The counts of a thread
+    are only changed by that thread, so no locking is involved; callers that want the queries made by some operation
+    take the difference of two readings of the same thread. Queries made by threads the operation starts are counted
+    in those threads. */
+class QueryCounters
+{
+public:
+
+  /** \brief Turn counting on or off for all threads */
+  static void setEnabled(bool flag);
+
+  static bool isEnabled()
+  {
+    return enabled_.load(boost::memory_order_relaxed);
+  }
+
+  /** \brief Count \e times queries of type \e type for the calling thread, if counting is on */
+  static void count(QueryType type, std::size_t times = 1)
+  {
+    if (enabled_.load(boost::memory_order_relaxed))
+      threadCounts().counts_[type] += times;
+  }
+
+  /** \brief Get the counts of the calling thread */
+  static QueryCounts getThreadCounts();
+
+  /** \brief Set the counts of the calling thread to 0 */
+  static void resetThreadCounts();
+
+private:
+
+  static QueryCounts& threadCounts();
+
+  /// Read on every counted query; counts are per thread, so no ordering with other data is needed
+  static boost::atomic<bool> enabled_;
+};
+
+}
+}
+
+#endif
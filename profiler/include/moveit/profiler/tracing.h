@@ -0,0 +1,145 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_PROFILER_TRACING_
+#define MOVEIT_PROFILER_TRACING_
+
+/** Tracing probes are compiled in only if MOVEIT_ENABLE_TRACING is set to 1 (see the MOVEIT_ENABLE_TRACING
+    option of the build). Otherwise the MOVEIT_TRACE_* macros expand to nothing. */
+#ifndef MOVEIT_ENABLE_TRACING
+#  define MOVEIT_ENABLE_TRACING 0
+#endif
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+
+namespace moveit
+{
+namespace tools
+{
+
+/** \brief An event emitted by a tracing probe */
+struct TraceEvent
+{
+  /** \brief The name of the probe (a string literal, e.g. "PlanningScene::isPathValid") */
+  const char      *name;
+
+  /** \brief True when the traced block starts, false when it ends */
+  bool             begin;
+
+  /** \brief The request the calling thread works on (0 if none was set) */
+  boost::uint64_t  request_id;
+
+  /** \brief The time of the event, in nanoseconds of a steady clock */
+  boost::uint64_t  time;
+};
+
+/** \brief Tracing of the boundaries of the blocks that make up the processing of a request (planning, collision checks,
+    IK, ...), so the timeline of a single request can be reconstructed. Each event carries the request id of the calling
+    thread, which is set for the duration of a request with ScopedRequest.
+
+    Events are passed to the callback set with setCallback(), if any. When the build finds sys/sdt.h, each event is also a
+    USDT probe (moveit:trace_begin and moveit:trace_end, with the name and the request id as arguments), so the probes can be
+    used by SystemTap, bpftrace or LTTng without a callback. */
+class Tracing
+{
+public:
+
+  /** \brief Callback that receives the events of all threads; it is called by the thread that emits the event */
+  typedef boost::function<void(const TraceEvent&)> Callback;
+
+  /** \brief Set the callback that receives the events (an empty function to remove it) */
+  static void setCallback(const Callback &callback);
+
+  /** \brief Emit an event for the probe \e name from the calling thread */
+  static void emit(const char *name, bool begin);
+
+  /** \brief Get a request id that was not returned before (never 0) */
+  static boost::uint64_t newRequestId();
+
+  /** \brief Get the request id of the calling thread (0 if none was set) */
+  static boost::uint64_t getThreadRequestId();
+
+  /** \brief Set the request id of the calling thread */
+  static void setThreadRequestId(boost::uint64_t id);
+
+  /** \brief Emits the begin event of a probe when constructed and the end event when destroyed */
+  class ScopedProbe
+  {
+  public:
+    explicit ScopedProbe(const char *name) : name_(name)
+    {
+      emit(name_, true);
+    }
+
+    ~ScopedProbe()
+    {
+      emit(name_, false);
+    }
+
+  private:
+    const char *name_;
+  };
+
+  /** \brief Sets the request id of the calling thread while in scope. If \e id is 0 and the thread has no request id
+      yet, a new one is used; if \e id is 0 and the thread has a request id already, it is kept (nested requests, e.g.
+      an adapter chain called from a larger pipeline, belong to the outer request). */
+  class ScopedRequest
+  {
+  public:
+    explicit ScopedRequest(boost::uint64_t id = 0);
+    ~ScopedRequest();
+
+  private:
+    boost::uint64_t previous_;
+  };
+};
+
+}
+}
+
+#if MOVEIT_ENABLE_TRACING
+#  define MOVEIT_TRACE_CONCAT_(a, b) a##b
+#  define MOVEIT_TRACE_CONCAT(a, b) MOVEIT_TRACE_CONCAT_(a, b)
+/** \brief Trace the rest of the enclosing scope as the block \e name (a string literal) */
+#  define MOVEIT_TRACE_SCOPE(name) moveit::tools::Tracing::ScopedProbe MOVEIT_TRACE_CONCAT(moveit_trace_probe_, __LINE__)(name)
+/** \brief Attribute the probes in the rest of the enclosing scope to the request \e id (0 for a new or the enclosing request) */
+#  define MOVEIT_TRACE_REQUEST(id) moveit::tools::Tracing::ScopedRequest MOVEIT_TRACE_CONCAT(moveit_trace_request_, __LINE__)(id)
+#else
+#  define MOVEIT_TRACE_SCOPE(name)
+#  define MOVEIT_TRACE_REQUEST(id)
+#endif
+
+#endif
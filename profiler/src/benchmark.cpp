@@ -0,0 +1,373 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "moveit/profiler/benchmark.h"
+#include <console_bridge/console.h>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+const void * volatile moveit::Benchmark::sink_ = NULL;
+
+namespace
+{
+
+typedef boost::chrono::steady_clock Clock;
+
+// batches shorter than this are dominated by the resolution and the cost of reading the clock
+const double MIN_BATCH_SECONDS = 1e-5;
+
+// the number of calls in a batch is not increased past this
+const std::size_t MAX_BATCH_CALLS = 1 << 20;
+
+// the minimum number of batches timed for each case (and thread)
+const std::size_t MIN_BATCHES = 10;
+
+double secondsSince(const Clock::time_point &start)
+{
+  return boost::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double timeBatch(const boost::function<void()> &fn, std::size_t calls)
+{
+  Clock::time_point start = Clock::now();
+  for (std::size_t i = 0 ; i < calls ; ++i)
+    fn();
+  return secondsSince(start);
+}
+
+// call fn once, to warm up, and find a number of calls per batch the clock can measure well
+std::size_t calibrateBatch(const boost::function<void()> &fn)
+{
+  fn();
+  std::size_t batch = 1;
+  while (batch < MAX_BATCH_CALLS && timeBatch(fn, batch) < MIN_BATCH_SECONDS)
+    batch *= 2;
+  return batch;
+}
+
+// the calls of one thread: the time per call of each batch, and the totals
+struct Timing
+{
+  Timing() : calls_(0), seconds_(0.0)
+  {
+  }
+
+  std::vector<double> per_call_;
+  std::size_t         calls_;
+  double              seconds_;
+};
+
+// time batches of calls to fn until min_time seconds passed since start
+void timeBatches(const boost::function<void()> &fn, std::size_t batch, double min_time, const Clock::time_point &start, Timing &timing)
+{
+  do
+  {
+    double t = timeBatch(fn, batch);
+    timing.per_call_.push_back(t / (double)batch);
+    timing.seconds_ += t;
+    timing.calls_ += batch;
+  } while (secondsSince(start) < min_time || timing.per_call_.size() < MIN_BATCHES);
+}
+
+// the body of a thread of Benchmark::runConcurrent(): calibrate, wait for the other threads, then time
+void timeThread(const boost::function<void()> &fn, double min_time, boost::barrier *ready, Timing *timing)
+{
+  std::size_t batch = calibrateBatch(fn);
+  ready->wait();
+  timeBatches(fn, batch, min_time, Clock::now(), *timing);
+}
+
+// the value below which a fraction p of the sorted values lies
+double percentile(const std::vector<double> &sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+  std::size_t index = std::min(sorted.size() - 1, (std::size_t)std::ceil(p * sorted.size()) - (p > 0.0 ? 1 : 0));
+  return sorted[index];
+}
+
+// fill in the statistics of result from the timings of its threads and the wall time they took
+void summarize(const std::vector<Timing> &timings, double wall_seconds, moveit::Benchmark::Result &result)
+{
+  std::vector<double> per_call;
+  for (std::size_t i = 0 ; i < timings.size() ; ++i)
+  {
+    per_call.insert(per_call.end(), timings[i].per_call_.begin(), timings[i].per_call_.end());
+    result.calls_ += timings[i].calls_;
+    result.seconds_ += timings[i].seconds_;
+  }
+  std::sort(per_call.begin(), per_call.end());
+  result.threads_ = timings.size();
+  result.mean_ = result.calls_ > 0 ? result.seconds_ / (double)result.calls_ : 0.0;
+  result.p50_ = percentile(per_call, 0.5);
+  result.p99_ = percentile(per_call, 0.99);
+  result.throughput_ = wall_seconds > 0.0 ? result.items_per_call_ * (double)result.calls_ / wall_seconds : 0.0;
+}
+
+// print a number of bytes with a unit that keeps the number readable
+std::string formatBytes(std::size_t bytes)
+{
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2);
+  if (bytes < 1024)
+    ss << bytes << " B";
+  else
+    if (bytes < 1024 * 1024)
+      ss << bytes / 1024.0 << " KB";
+    else
+      if (bytes < 1024 * 1024 * 1024)
+        ss << bytes / (1024.0 * 1024.0) << " MB";
+      else
+        ss << bytes / (1024.0 * 1024.0 * 1024.0) << " GB";
+  return ss.str();
+}
+
+// print a time in seconds with a unit that keeps the number readable
+std::string formatTime(double seconds)
+{
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2);
+  if (seconds < 1e-6)
+    ss << seconds * 1e9 << " ns";
+  else
+    if (seconds < 1e-3)
+      ss << seconds * 1e6 << " us";
+    else
+      if (seconds < 1.0)
+        ss << seconds * 1e3 << " ms";
+      else
+        ss << seconds << " s";
+  return ss.str();
+}
+
+}
+
+moveit::Benchmark::Benchmark(int argc, char **argv) : min_time_(0.5), args_ok_(true)
+{
+  for (int i = 1 ; i < argc ; ++i)
+  {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--min-time") == 0 && has_value)
+    {
+      try
+      {
+        min_time_ = boost::lexical_cast<double>(argv[++i]);
+      }
+      catch (boost::bad_lexical_cast &)
+      {
+        logError("Benchmark: '%s' is not a number of seconds", argv[i]);
+        args_ok_ = false;
+      }
+    }
+    else
+      if (strcmp(argv[i], "--filter") == 0 && has_value)
+        filter_ = argv[++i];
+      else
+        if (strcmp(argv[i], "--csv") == 0 && has_value)
+          csv_file_ = argv[++i];
+        else
+          if (strcmp(argv[i], "--threads") == 0 && has_value)
+          {
+            std::vector<std::string> counts;
+            boost::split(counts, argv[++i], boost::is_any_of(","));
+            for (std::size_t j = 0 ; j < counts.size() ; ++j)
+              try
+              {
+                unsigned int n = boost::lexical_cast<unsigned int>(counts[j]);
+                if (n > 0)
+                  thread_counts_.push_back(n);
+              }
+              catch (boost::bad_lexical_cast &)
+              {
+                logError("Benchmark: '%s' is not a number of threads", counts[j].c_str());
+                args_ok_ = false;
+              }
+          }
+          else
+          {
+            logError("Benchmark: unknown argument '%s'. Known arguments are --min-time <seconds>, --filter <text>, "
+                     "--csv <file> and --threads <n,m,...>", argv[i]);
+            args_ok_ = false;
+          }
+  }
+
+  if (thread_counts_.empty())
+  {
+    unsigned int cores = std::max(1u, boost::thread::hardware_concurrency());
+    for (unsigned int n = 1 ; n < cores && n <= 4 ; n *= 2)
+      thread_counts_.push_back(n);
+    thread_counts_.push_back(cores);
+  }
+}
+
+bool moveit::Benchmark::enabled(const std::string &name) const
+{
+  return args_ok_ && (filter_.empty() || name.find(filter_) != std::string::npos);
+}
+
+moveit::Benchmark::Result moveit::Benchmark::run(const std::string &name, const boost::function<void()> &fn, double items_per_call)
+{
+  Result result;
+  result.name_ = name;
+  result.items_per_call_ = items_per_call;
+  if (!enabled(name))
+    return result;
+
+  std::size_t batch = calibrateBatch(fn);
+  std::vector<Timing> timings(1);
+  Clock::time_point start = Clock::now();
+  timeBatches(fn, batch, min_time_, start, timings[0]);
+  summarize(timings, secondsSince(start), result);
+  results_.push_back(result);
+  return result;
+}
+
+moveit::Benchmark::Result moveit::Benchmark::runConcurrent(const std::string &name, const std::vector<boost::function<void()> > &fns,
+                                                           double items_per_call)
+{
+  Result result;
+  result.name_ = name;
+  result.items_per_call_ = items_per_call;
+  if (!enabled(name) || fns.empty())
+    return result;
+
+  // the threads start timing together, once all of them are calibrated; this thread takes the wall time
+  std::vector<Timing> timings(fns.size());
+  boost::barrier ready(fns.size() + 1);
+  boost::thread_group threads;
+  for (std::size_t i = 0 ; i < fns.size() ; ++i)
+    threads.create_thread(boost::bind(&timeThread, boost::cref(fns[i]), min_time_, &ready, &timings[i]));
+  ready.wait();
+  Clock::time_point start = Clock::now();
+  threads.join_all();
+  summarize(timings, secondsSince(start), result);
+  results_.push_back(result);
+  return result;
+}
+
+moveit::Benchmark::Result moveit::Benchmark::recordMemory(const std::string &name, std::size_t bytes)
+{
+  Result result;
+  result.name_ = name;
+  result.memory_ = bytes;
+  if (!enabled(name))
+    return result;
+  results_.push_back(result);
+  return result;
+}
+
+void moveit::Benchmark::setNote(const std::string &name, const std::string &note)
+{
+  for (std::size_t i = results_.size() ; i > 0 ; --i)
+    if (results_[i - 1].name_ == name)
+    {
+      results_[i - 1].note_ = note;
+      break;
+    }
+}
+
+std::size_t moveit::Benchmark::getHeapBytes()
+{
+#ifdef __GLIBC__
+  // small blocks come from the arena, large ones are mapped separately
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  struct mallinfo info = mallinfo();
+  return (std::size_t)(unsigned int)info.uordblks + (std::size_t)(unsigned int)info.hblkhd;
+#endif
+#else
+  return 0;
+#endif
+}
+
+int moveit::Benchmark::report(std::ostream &out) const
+{
+  if (!args_ok_)
+    return 1;
+
+  std::size_t width = 4;
+  for (std::size_t i = 0 ; i < results_.size() ; ++i)
+    width = std::max(width, results_[i].name_.size());
+
+  out << std::left << std::setw(width + 2) << "Case" << std::right << std::setw(8) << "Threads" << std::setw(12) << "Calls"
+      << std::setw(14) << "Mean" << std::setw(14) << "Median" << std::setw(14) << "99%" << std::setw(16) << "Items/s" << std::setw(14) << "Memory" << "  Note" << std::endl;
+  for (std::size_t i = 0 ; i < results_.size() ; ++i)
+  {
+    const Result &r = results_[i];
+    if (r.calls_ == 0)
+    {
+      out << std::left << std::setw(width + 2) << r.name_ << std::right << std::setw(8 + 12 + 14 * 3 + 16) << ""
+          << std::setw(14) << formatBytes(r.memory_) << "  " << r.note_ << std::endl;
+      continue;
+    }
+    out << std::left << std::setw(width + 2) << r.name_ << std::right << std::setw(8) << r.threads_ << std::setw(12) << r.calls_
+        << std::setw(14) << formatTime(r.mean_) << std::setw(14) << formatTime(r.p50_) << std::setw(14) << formatTime(r.p99_)
+        << std::setw(16) << std::fixed << std::setprecision(0) << r.throughput_
+        << std::setw(14) << (r.memory_ > 0 ? formatBytes(r.memory_) : "") << "  " << r.note_ << std::endl;
+  }
+
+  if (csv_file_.empty())
+    return 0;
+
+  std::ofstream csv(csv_file_.c_str());
+  if (!csv.good())
+  {
+    logError("Benchmark: unable to write '%s'", csv_file_.c_str());
+    return 1;
+  }
+  csv << "name,threads,calls,seconds,mean,p50,p99,items_per_second,memory_bytes,note" << std::endl;
+  csv << std::setprecision(9);
+  for (std::size_t i = 0 ; i < results_.size() ; ++i)
+  {
+    const Result &r = results_[i];
+    csv << r.name_ << "," << r.threads_ << "," << r.calls_ << "," << r.seconds_ << "," << r.mean_ << "," << r.p50_ << ","
+        << r.p99_ << "," << r.throughput_ << "," << r.memory_ << ",\"" << r.note_ << "\"" << std::endl;
+  }
+  return csv.good() ? 0 : 1;
+}
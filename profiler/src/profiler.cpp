@@ -49,6 +49,8 @@ moveit::Profiler& moveit::Profiler::Instance(void)
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <cstdio>
+#include <boost/bind.hpp>
 
 void moveit::Profiler::start(void)
 {
@@ -75,50 +77,143 @@ void moveit::Profiler::stop(void)
 void moveit::Profiler::clear(void)
 {
   lock_.lock();
-  data_.clear();
+  // the threads keep pointers to their storage, so it is emptied rather than removed
+  for (std::size_t i = 0 ; i < slots_.size() ; ++i)
+  {
+    PerThread old;
+    boost::mutex::scoped_lock slock(slots_[i]->lock);
+    resetThreadData(slots_[i]->data, old);
+  }
+  retired_ = PerThread();
   tinfo_ = TimeInfo();
   if (running_)
     tinfo_.set();
   lock_.unlock();
 }
 
-void moveit::Profiler::event(const std::string &name, const unsigned int times)
+void moveit::Profiler::resetThreadData(PerThread &data, PerThread &old)
 {
+  std::swap(data, old);
+  // blocks that are in progress keep their start time, so they are counted when they end
+  for (std::map<std::string, TimeInfo>::const_iterator it = old.time.begin() ; it != old.time.end() ; ++it)
+    data.time[it->first].start = it->second.start;
+  data.keyTime.resize(old.keyTime.size());
+  for (std::size_t k = 0 ; k < old.keyTime.size() ; ++k)
+    data.keyTime[k].start = old.keyTime[k].start;
+}
+
+moveit::Profiler::ThreadSlot& moveit::Profiler::registerThreadSlot(void)
+{
+  boost::shared_ptr<ThreadSlot> slot(new ThreadSlot(this, boost::this_thread::get_id()));
   lock_.lock();
-  data_[boost::this_thread::get_id()].events[name] += times;
+  slots_.push_back(slot);
   lock_.unlock();
+  threadSlot_.reset(slot.get());
+  return *slot;
+}
+
+void moveit::Profiler::retireThreadSlot(ThreadSlot *slot)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  {
+    boost::mutex::scoped_lock tlock(slot->lock);
+    addThreadData(retired_, slot->data);
+  }
+  for (std::size_t i = 0 ; i < slots_.size() ; ++i)
+    if (slots_[i].get() == slot)
+    {
+      slots_.erase(slots_.begin() + i);
+      break;
+    }
+}
+
+moveit::Profiler::Key moveit::Profiler::registerKey(const std::string &name)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<std::string, Key>::const_iterator it = keys_.find(name);
+  if (it != keys_.end())
+    return it->second;
+  Key key = keyNames_.size();
+  keyNames_.push_back(name);
+  keys_[name] = key;
+  return key;
+}
+
+void moveit::Profiler::event(Key key, const unsigned int times)
+{
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  if (key >= slot.data.keyEvents.size())
+    slot.data.keyEvents.resize(key + 1, 0);
+  slot.data.keyEvents[key] += times;
+}
+
+void moveit::Profiler::average(Key key, const double value)
+{
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  if (key >= slot.data.keyAvg.size())
+    slot.data.keyAvg.resize(key + 1, AvgInfo());
+  AvgInfo &a = slot.data.keyAvg[key];
+  a.total += value;
+  a.totalSqr += value*value;
+  a.parts++;
+}
+
+void moveit::Profiler::begin(Key key)
+{
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  if (key >= slot.data.keyTime.size())
+    slot.data.keyTime.resize(key + 1);
+  slot.data.keyTime[key].set();
+}
+
+void moveit::Profiler::end(Key key)
+{
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  if (key < slot.data.keyTime.size())
+    slot.data.keyTime[key].update();
+}
+
+void moveit::Profiler::event(const std::string &name, const unsigned int times)
+{
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  slot.data.events[name] += times;
 }
 
 void moveit::Profiler::average(const std::string &name, const double value)
 {
-  lock_.lock();
-  AvgInfo &a = data_[boost::this_thread::get_id()].avg[name];
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  AvgInfo &a = slot.data.avg[name];
   a.total += value;
   a.totalSqr += value*value;
   a.parts++;
-  lock_.unlock();
 }
 
 void moveit::Profiler::begin(const std::string &name)
 {
-  lock_.lock();
-  data_[boost::this_thread::get_id()].time[name].set();
-  lock_.unlock();
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  slot.data.time[name].set();
 }
 
 void moveit::Profiler::end(const std::string &name)
 {
-  lock_.lock();
-  data_[boost::this_thread::get_id()].time[name].update();
-  lock_.unlock();
+  ThreadSlot &slot = getThreadSlot();
+  boost::mutex::scoped_lock slock(slot.lock);
+  slot.data.time[name].update();
 }
 
 namespace
 {
 
-inline double to_seconds(const boost::posix_time::time_duration &d)
+inline double to_seconds(boost::int64_t nanoseconds)
 {
-  return (double)d.total_microseconds() / 1000000.0;
+  return (double)nanoseconds / 1000000000.0;
 }
 
 }
@@ -135,38 +230,57 @@ void moveit::Profiler::status(std::ostream &out, bool merge)
   if (merge)
   {
     PerThread combined;
-    for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin() ; it != data_.end() ; ++it)
+    for (std::size_t i = 0 ; i < slots_.size() ; ++i)
     {
-      for (std::map<std::string, unsigned long int>::const_iterator iev = it->second.events.begin() ; iev != it->second.events.end(); ++iev)
-        combined.events[iev->first] += iev->second;
-      for (std::map<std::string, AvgInfo>::const_iterator iavg = it->second.avg.begin() ; iavg != it->second.avg.end(); ++iavg)
-      {
-        combined.avg[iavg->first].total += iavg->second.total;
-        combined.avg[iavg->first].totalSqr += iavg->second.totalSqr;
-        combined.avg[iavg->first].parts += iavg->second.parts;
-      }
-      for (std::map<std::string, TimeInfo>::const_iterator itm = it->second.time.begin() ; itm != it->second.time.end(); ++itm)
-      {
-        TimeInfo &tc = combined.time[itm->first];
-        tc.total = tc.total + itm->second.total;
-        tc.parts = tc.parts + itm->second.parts;
-        if (tc.shortest > itm->second.shortest)
-          tc.shortest = itm->second.shortest;
-        if (tc.longest < itm->second.longest)
-          tc.longest = itm->second.longest;
-      }
+      boost::mutex::scoped_lock slock(slots_[i]->lock);
+      addThreadData(combined, slots_[i]->data);
     }
+    addThreadData(combined, retired_);
     printThreadInfo(out, combined);
   }
   else
-    for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin() ; it != data_.end() ; ++it)
+  {
+    for (std::size_t i = 0 ; i < slots_.size() ; ++i)
+    {
+      PerThread data;
+      {
+        boost::mutex::scoped_lock slock(slots_[i]->lock);
+        addThreadData(data, slots_[i]->data);
+      }
+      out << "Thread " << slots_[i]->threadId << ":" << std::endl;
+      printThreadInfo(out, data);
+    }
+    if (!retired_.events.empty() || !retired_.avg.empty() || !retired_.time.empty())
     {
-      out << "Thread " << it->first << ":" << std::endl;
-      printThreadInfo(out, it->second);
+      out << "Exited threads:" << std::endl;
+      printThreadInfo(out, retired_);
     }
+  }
   lock_.unlock();
 }
 
+void moveit::Profiler::addThreadData(PerThread &combined, const PerThread &data) const
+{
+  for (std::map<std::string, unsigned long int>::const_iterator iev = data.events.begin() ; iev != data.events.end(); ++iev)
+    combined.events[iev->first] += iev->second;
+  for (std::map<std::string, AvgInfo>::const_iterator iavg = data.avg.begin() ; iavg != data.avg.end(); ++iavg)
+    combined.avg[iavg->first].add(iavg->second);
+  for (std::map<std::string, TimeInfo>::const_iterator itm = data.time.begin() ; itm != data.time.end(); ++itm)
+    if (itm->second.parts > 0)
+      combined.time[itm->first].add(itm->second);
+
+  // data counted with keys is reported under the registered names
+  for (std::size_t k = 0 ; k < data.keyEvents.size() ; ++k)
+    if (data.keyEvents[k] > 0)
+      combined.events[keyNames_[k]] += data.keyEvents[k];
+  for (std::size_t k = 0 ; k < data.keyAvg.size() ; ++k)
+    if (data.keyAvg[k].parts > 0)
+      combined.avg[keyNames_[k]].add(data.keyAvg[k]);
+  for (std::size_t k = 0 ; k < data.keyTime.size() ; ++k)
+    if (data.keyTime[k].parts > 0)
+      combined.time[keyNames_[k]].add(data.keyTime[k]);
+}
+
 void moveit::Profiler::console(void)
 {
   std::stringstream ss;
@@ -268,6 +382,8 @@ void moveit::Profiler::printThreadInfo(std::ostream &out, const PerThread &data)
       out << ", " << pavg << " s on average";
       if (pavg < 1.0)
         out << " (" << 1.0/pavg << " /s)";
+      out << ", p50 = " << to_seconds(d.percentile(0.5)) << " s, p99 = " << to_seconds(d.percentile(0.99))
+          << " s, p99.9 = " << to_seconds(d.percentile(0.999)) << " s";
     }
     out << std::endl;
     unaccounted -= time[i].value;
@@ -284,4 +400,277 @@ void moveit::Profiler::printThreadInfo(std::ostream &out, const PerThread &data)
   out << std::endl;
 }
 
+void moveit::Profiler::takeSnapshot(PerThread &combined, double &total_time, bool reset)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  total_time = to_seconds(tinfo_.total);
+  if (running_)
+    total_time += to_seconds(boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now() - tinfo_.start).count());
+  for (std::size_t i = 0 ; i < slots_.size() ; ++i)
+  {
+    PerThread data;
+    {
+      // swap the data out, so the thread is held up as briefly as possible
+      boost::mutex::scoped_lock tlock(slots_[i]->lock);
+      if (reset)
+        resetThreadData(slots_[i]->data, data);
+      else
+        data = slots_[i]->data;
+    }
+    addThreadData(combined, data);
+  }
+  addThreadData(combined, retired_);
+  if (reset)
+  {
+    retired_ = PerThread();
+    tinfo_ = TimeInfo();
+    if (running_)
+      tinfo_.set();
+  }
+}
+
+/// @cond IGNORE
+namespace
+{
+
+// layout of the binary export: the magic string and a uint32 version, the total time (double), then the
+// events, the averages and the blocks of time, each as a uint32 count followed by the entries. Every entry
+// starts with its name (uint32 length and characters). Events then have their count (uint64); averages their
+// total and total of squares (double) and number of values (uint64); blocks their total, shortest and longest
+// times (int64 nanoseconds), number of parts (uint64) and the non-empty histogram buckets, as a uint32 count
+// followed by (uint32 bucket index, uint64 count) pairs.
+const char BINARY_MAGIC[8] = { 'M', 'V', 'P', 'R', 'O', 'F', 0, 0 };
+const boost::uint32_t BINARY_VERSION = 1;
+
+template<typename T>
+inline void writeBinary(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void writeBinary(std::ostream &out, const std::string &value)
+{
+  writeBinary(out, (boost::uint32_t)value.size());
+  out.write(value.data(), value.size());
+}
+
+std::string jsonString(const std::string &value)
+{
+  std::string result = "\"";
+  for (std::size_t i = 0 ; i < value.size() ; ++i)
+  {
+    const char c = value[i];
+    if (c == '"' || c == '\\')
+    {
+      result += '\\';
+      result += c;
+    }
+    else if ((unsigned char)c < 0x20)
+    {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int)(unsigned char)c);
+      result += buffer;
+    }
+    else
+      result += c;
+  }
+  result += '"';
+  return result;
+}
+
+std::string csvString(const std::string &value)
+{
+  if (value.find_first_of(",\"\n") == std::string::npos)
+    return value;
+  std::string result = "\"";
+  for (std::size_t i = 0 ; i < value.size() ; ++i)
+  {
+    if (value[i] == '"')
+      result += '"';
+    result += value[i];
+  }
+  result += '"';
+  return result;
+}
+
+inline double mean(double total, unsigned long int parts)
+{
+  return parts > 0 ? total / (double)parts : 0.0;
+}
+
+inline double stddev(double total, double totalSqr, unsigned long int parts)
+{
+  if (parts < 2)
+    return 0.0;
+  const double m = total / (double)parts;
+  return sqrt(fabs(totalSqr - (double)parts * m * m) / ((double)parts - 1.));
+}
+
+}
+/// @endcond
+
+void moveit::Profiler::exportData(std::ostream &out, ExportFormat format, bool reset)
+{
+  PerThread data;
+  double total_time;
+  takeSnapshot(data, total_time, reset);
+
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out.precision(12);
+
+  switch (format)
+  {
+  case EXPORT_JSON:
+    {
+      out << "{\"total_time\": " << total_time << ", \"events\": [";
+      for (std::map<std::string, unsigned long int>::const_iterator it = data.events.begin() ; it != data.events.end() ; ++it)
+        out << (it == data.events.begin() ? "" : ", ") << "{\"name\": " << jsonString(it->first) << ", \"count\": " << it->second << "}";
+      out << "], \"averages\": [";
+      for (std::map<std::string, AvgInfo>::const_iterator it = data.avg.begin() ; it != data.avg.end() ; ++it)
+        out << (it == data.avg.begin() ? "" : ", ") << "{\"name\": " << jsonString(it->first)
+            << ", \"count\": " << it->second.parts << ", \"mean\": " << mean(it->second.total, it->second.parts)
+            << ", \"stddev\": " << stddev(it->second.total, it->second.totalSqr, it->second.parts) << "}";
+      out << "], \"blocks\": [";
+      for (std::map<std::string, TimeInfo>::const_iterator it = data.time.begin() ; it != data.time.end() ; ++it)
+      {
+        const TimeInfo &t = it->second;
+        out << (it == data.time.begin() ? "" : ", ") << "{\"name\": " << jsonString(it->first)
+            << ", \"count\": " << t.parts << ", \"total\": " << to_seconds(t.total);
+        if (t.parts > 0)
+          out << ", \"shortest\": " << to_seconds(t.shortest) << ", \"longest\": " << to_seconds(t.longest)
+              << ", \"p50\": " << to_seconds(t.percentile(0.5)) << ", \"p99\": " << to_seconds(t.percentile(0.99))
+              << ", \"p999\": " << to_seconds(t.percentile(0.999));
+        out << ", \"histogram\": [";
+        bool first = true;
+        for (unsigned int i = 0 ; i < TimeInfo::HISTOGRAM_BUCKETS ; ++i)
+          if (t.histogram[i] > 0)
+          {
+            out << (first ? "" : ", ") << "[" << TimeInfo::bucketValue(i) << ", " << t.histogram[i] << "]";
+            first = false;
+          }
+        out << "]}";
+      }
+      out << "]}" << std::endl;
+    }
+    break;
+
+  case EXPORT_CSV:
+    {
+      out << "type,name,count,total,mean,stddev,shortest,longest,p50,p99,p999,bucket" << std::endl;
+      out << "total,," << 1 << "," << total_time << ",,,,,,,," << std::endl;
+      for (std::map<std::string, unsigned long int>::const_iterator it = data.events.begin() ; it != data.events.end() ; ++it)
+        out << "event," << csvString(it->first) << "," << it->second << ",,,,,,,,," << std::endl;
+      for (std::map<std::string, AvgInfo>::const_iterator it = data.avg.begin() ; it != data.avg.end() ; ++it)
+        out << "average," << csvString(it->first) << "," << it->second.parts << "," << it->second.total << ","
+            << mean(it->second.total, it->second.parts) << "," << stddev(it->second.total, it->second.totalSqr, it->second.parts)
+            << ",,,,,," << std::endl;
+      for (std::map<std::string, TimeInfo>::const_iterator it = data.time.begin() ; it != data.time.end() ; ++it)
+      {
+        const TimeInfo &t = it->second;
+        out << "block," << csvString(it->first) << "," << t.parts << "," << to_seconds(t.total) << ","
+            << mean(to_seconds(t.total), t.parts) << ",,";
+        if (t.parts > 0)
+          out << to_seconds(t.shortest) << "," << to_seconds(t.longest) << "," << to_seconds(t.percentile(0.5)) << ","
+              << to_seconds(t.percentile(0.99)) << "," << to_seconds(t.percentile(0.999)) << ",";
+        else
+          out << ",,,,,";
+        out << std::endl;
+        // one row per non-empty bucket: the count of the bucket and the middle of its range (seconds)
+        for (unsigned int i = 0 ; i < TimeInfo::HISTOGRAM_BUCKETS ; ++i)
+          if (t.histogram[i] > 0)
+            out << "histogram," << csvString(it->first) << "," << t.histogram[i] << ",,,,,,,,,"
+                << to_seconds(TimeInfo::bucketValue(i)) << std::endl;
+      }
+    }
+    break;
+
+  case EXPORT_BINARY:
+    {
+      out.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+      writeBinary(out, BINARY_VERSION);
+      writeBinary(out, total_time);
+      writeBinary(out, (boost::uint32_t)data.events.size());
+      for (std::map<std::string, unsigned long int>::const_iterator it = data.events.begin() ; it != data.events.end() ; ++it)
+      {
+        writeBinary(out, it->first);
+        writeBinary(out, (boost::uint64_t)it->second);
+      }
+      writeBinary(out, (boost::uint32_t)data.avg.size());
+      for (std::map<std::string, AvgInfo>::const_iterator it = data.avg.begin() ; it != data.avg.end() ; ++it)
+      {
+        writeBinary(out, it->first);
+        writeBinary(out, it->second.total);
+        writeBinary(out, it->second.totalSqr);
+        writeBinary(out, (boost::uint64_t)it->second.parts);
+      }
+      writeBinary(out, (boost::uint32_t)data.time.size());
+      for (std::map<std::string, TimeInfo>::const_iterator it = data.time.begin() ; it != data.time.end() ; ++it)
+      {
+        const TimeInfo &t = it->second;
+        writeBinary(out, it->first);
+        writeBinary(out, t.total);
+        writeBinary(out, t.shortest);
+        writeBinary(out, t.longest);
+        writeBinary(out, (boost::uint64_t)t.parts);
+        boost::uint32_t buckets = 0;
+        for (unsigned int i = 0 ; i < TimeInfo::HISTOGRAM_BUCKETS ; ++i)
+          if (t.histogram[i] > 0)
+            ++buckets;
+        writeBinary(out, buckets);
+        for (boost::uint32_t i = 0 ; i < TimeInfo::HISTOGRAM_BUCKETS ; ++i)
+          if (t.histogram[i] > 0)
+          {
+            writeBinary(out, i);
+            writeBinary(out, (boost::uint64_t)t.histogram[i]);
+          }
+      }
+    }
+    break;
+  }
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void moveit::Profiler::startSnapshots(double period, ExportFormat format, const SnapshotCallback &callback)
+{
+  stopSnapshots();
+  stopSnapshots_ = false;
+  snapshotThread_.reset(new boost::thread(boost::bind(&Profiler::snapshotThread, this, period, format, callback)));
+}
+
+void moveit::Profiler::stopSnapshots(void)
+{
+  if (!snapshotThread_)
+    return;
+  {
+    boost::mutex::scoped_lock slock(snapshotLock_);
+    stopSnapshots_ = true;
+  }
+  snapshotCondition_.notify_all();
+  snapshotThread_->join();
+  snapshotThread_.reset();
+}
+
+void moveit::Profiler::snapshotThread(double period, ExportFormat format, SnapshotCallback callback)
+{
+  const boost::posix_time::time_duration wait = boost::posix_time::microseconds((boost::int64_t)(period * 1000000.0));
+  boost::system_time next = boost::get_system_time() + wait;
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock slock(snapshotLock_);
+      while (!stopSnapshots_ && snapshotCondition_.timed_wait(slock, next))
+        ;
+      if (stopSnapshots_)
+        return;
+    }
+    next += wait;
+    std::stringstream ss;
+    exportData(ss, format, true);
+    callback(ss.str());
+  }
+}
+
 #endif
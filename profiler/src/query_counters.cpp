@@ -0,0 +1,135 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include "moveit/profiler/query_counters.h"
+#include <boost/thread/tss.hpp>
+#include <sstream>
+
+boost::atomic<bool> moveit::tools::QueryCounters::enabled_(false);
+
+namespace
+{
+boost::thread_specific_ptr<moveit::tools::QueryCounts> thread_counts;
+}
+
+moveit::tools::QueryCounts::QueryCounts()
+{
+  for (int i = 0 ; i < QUERY_TYPE_COUNT ; ++i)
+    counts_[i] = 0;
+}
+
+moveit::tools::QueryCounts& moveit::tools::QueryCounts::operator+=(const QueryCounts &other)
+{
+  for (int i = 0 ; i < QUERY_TYPE_COUNT ; ++i)
+    counts_[i] += other.counts_[i];
+  return *this;
+}
+
+moveit::tools::QueryCounts& moveit::tools::QueryCounts::operator-=(const QueryCounts &other)
+{
+  for (int i = 0 ; i < QUERY_TYPE_COUNT ; ++i)
+    counts_[i] -= other.counts_[i];
+  return *this;
+}
+
+bool moveit::tools::QueryCounts::empty() const
+{
+  for (int i = 0 ; i < QUERY_TYPE_COUNT ; ++i)
+    if (counts_[i] > 0)
+      return false;
+  return true;
+}
+
+std::string moveit::tools::QueryCounts::toString() const
+{
+  std::stringstream ss;
+  for (int i = 0 ; i < QUERY_TYPE_COUNT ; ++i)
+    if (counts_[i] > 0)
+    {
+      if (ss.tellp() > 0)
+        ss << ", ";
+      ss << counts_[i] << " " << getName((QueryType)i);
+    }
+  return ss.str();
+}
+
+const char* moveit::tools::QueryCounts::getName(QueryType type)
+{
+  switch (type)
+  {
+  case COLLISION_CHECKS:
+    return "collision checks";
+  case DISTANCE_QUERIES:
+    return "distance queries";
+  case BROAD_PHASE_PAIRS:
+    return "broad phase pairs";
+  case NARROW_PHASE_CALLS:
+    return "narrow phase calls";
+  case IK_CALLS:
+    return "IK calls";
+  case FK_UPDATES:
+    return "FK updates";
+  default:
+    return "unknown";
+  }
+}
+
+void moveit::tools::QueryCounters::setEnabled(bool flag)
+{
+  enabled_.store(flag, boost::memory_order_relaxed);
+}
+
+moveit::tools::QueryCounts moveit::tools::QueryCounters::getThreadCounts()
+{
+  QueryCounts *counts = thread_counts.get();
+  return counts ? *counts : QueryCounts();
+}
+
+void moveit::tools::QueryCounters::resetThreadCounts()
+{
+  if (QueryCounts *counts = thread_counts.get())
+    *counts = QueryCounts();
+}
+
+moveit::tools::QueryCounts& moveit::tools::QueryCounters::threadCounts()
+{
+  QueryCounts *counts = thread_counts.get();
+  if (!counts)
+  {
+    counts = new QueryCounts();
+    thread_counts.reset(counts);
+  }
+  return *counts;
+}
@@ -0,0 +1,117 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include "moveit/profiler/tracing.h"
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#if MOVEIT_TRACING_USDT
+#include <sys/sdt.h>
+#endif
+
+namespace
+{
+boost::thread_specific_ptr<boost::uint64_t> thread_request_id;
+
+// replaced, never modified, so emitting threads only need an atomic load
+boost::shared_ptr<const moveit::tools::Tracing::Callback> trace_callback;
+
+boost::mutex request_id_lock;
+boost::uint64_t last_request_id = 0;
+}
+
+void moveit::tools::Tracing::setCallback(const Callback &callback)
+{
+  boost::shared_ptr<const Callback> c;
+  if (callback)
+    c = boost::make_shared<Callback>(callback);
+  boost::atomic_store(&trace_callback, c);
+}
+
+void moveit::tools::Tracing::emit(const char *name, bool begin)
+{
+  boost::uint64_t id = getThreadRequestId();
+#if MOVEIT_TRACING_USDT
+  if (begin)
+    DTRACE_PROBE2(moveit, trace_begin, name, id);
+  else
+    DTRACE_PROBE2(moveit, trace_end, name, id);
+#endif
+  boost::shared_ptr<const Callback> c = boost::atomic_load(&trace_callback);
+  if (c)
+  {
+    TraceEvent e;
+    e.name = name;
+    e.begin = begin;
+    e.request_id = id;
+    e.time = boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+    (*c)(e);
+  }
+}
+
+boost::uint64_t moveit::tools::Tracing::newRequestId()
+{
+  boost::mutex::scoped_lock slock(request_id_lock);
+  return ++last_request_id;
+}
+
+boost::uint64_t moveit::tools::Tracing::getThreadRequestId()
+{
+  boost::uint64_t *id = thread_request_id.get();
+  return id ? *id : 0;
+}
+
+void moveit::tools::Tracing::setThreadRequestId(boost::uint64_t id)
+{
+  boost::uint64_t *current = thread_request_id.get();
+  if (current)
+    *current = id;
+  else
+    thread_request_id.reset(new boost::uint64_t(id));
+}
+
+moveit::tools::Tracing::ScopedRequest::ScopedRequest(boost::uint64_t id) : previous_(getThreadRequestId())
+{
+  if (id == 0)
+    id = previous_ ? previous_ : newRequestId();
+  setThreadRequestId(id);
+}
+
+moveit::tools::Tracing::ScopedRequest::~ScopedRequest()
+{
+  setThreadRequestId(previous_);
+}
@@ -227,6 +227,17 @@ public:
   virtual void getVariableRandomValuesNearBy(random_numbers::RandomNumberGenerator &rng, std::vector<double> &values, const Bounds &other_bounds,
                                              const std::vector<double> &near, const double distance) const = 0;
 
+  /** \brief Provide the values of the joint variables (within default bounds) that correspond to the point \e unit of the unit hypercube
+      (getStateSpaceDimension() values in [0, 1), e.g., from a VariableSampler). The vector is NOT cleared; elements are only added with push_back */
+  void getVariableValuesFromUnit(const double *unit, std::vector<double> &values) const
+  {
+    getVariableValuesFromUnit(unit, values, variable_bounds_);
+  }
+
+  /** \brief Provide the values of the joint variables (within specified bounds) that correspond to the point \e unit of the unit hypercube.
+      Uniformly distributed points give values distributed as by getVariableRandomValues(). The vector is NOT cleared; elements are only added with push_back */
+  virtual void getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &other_bounds) const = 0;
+
   /** @} */
 
   /** @name Functionality specific to verifying bounds
@@ -362,6 +373,11 @@ public:
       previously set to identity and that only calls to updateTransform() were issued afterwards */
   virtual void updateTransform(const std::vector<double>& joint_values, Eigen::Affine3d &transf) const = 0;
 
+  /** \brief Compute \e parent * \e joint_transform into \e result, where \e joint_transform was produced for this joint by
+      computeTransform() or updateTransform(). Joints whose transforms have a known structure skip part of the product.
+      \e result must not be the same object as \e parent. */
+  virtual void composeTransform(const Eigen::Affine3d &parent, const Eigen::Affine3d &joint_transform, Eigen::Affine3d &result) const;
+
   /** @} */
 
 protected:
@@ -39,8 +39,10 @@
 
 #include <moveit/robot_model/joint_model.h>
 #include <moveit/robot_model/link_model.h>
+#include <moveit/robot_model/variable_sampler.h>
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <set>
 
 namespace robot_model
@@ -61,6 +63,47 @@ class JointModelGroup
 
 public:
 
+  /** \brief A joint on the path from a link to the root of the group, with what is needed to compute
+      its column of the Jacobian of that link */
+  struct JacobianChainEntry
+  {
+    /** \brief The child link of the joint. The joint axis is expressed in the frame of this link */
+    const LinkModel      *link_;
+
+    /** \brief The index of the group variable (the column of the Jacobian) the joint contributes to */
+    unsigned int          column_;
+
+    /** \brief The index of the joint in getJacobianJointLinks(); the same for all the chains the joint is part of */
+    unsigned int          joint_index_;
+
+    /** \brief The type of the joint (revolute, prismatic or planar) */
+    JointModel::JointType type_;
+
+    /** \brief The axis of revolute and prismatic joints */
+    Eigen::Vector3d       axis_;
+
+    /** \brief The mimic factor for mimic joints, 1.0 otherwise */
+    double                multiplier_;
+  };
+
+  /** \brief The joints of the group that move a link, from the link towards the root of the group */
+  typedef std::vector<JacobianChainEntry> JacobianChain;
+
+  /** \brief The joints returned by getJointModels(), arranged by how their variables are handled, so operations on all the
+      variables of the group run one homogeneous loop per kind of joint instead of a virtual call per joint. Each list holds
+      indices into getJointModels(). Bounds are read from the joint models when used, so they may still change. */
+  struct JointDispatch
+  {
+    /** \brief Prismatic and non-continuous revolute joints: one variable, kept within its bounds */
+    std::vector<unsigned int> bounded_;
+
+    /** \brief Continuous revolute joints: one variable, an angle that wraps around */
+    std::vector<unsigned int> continuous_;
+
+    /** \brief Planar and floating joints, which use the virtual functions of JointModel */
+    std::vector<unsigned int> other_;
+  };
+
   JointModelGroup(const std::string& name, const std::vector<const JointModel*>& joint_vector, const RobotModel *parent_model);
 
   ~JointModelGroup();
@@ -186,6 +229,13 @@ public:
     return updated_link_model_with_geometry_set_;
   }
 
+  /** \brief Return the same data as getUpdatedLinkModelsWithGeometry() as a mask: element \e i is true if the link with
+      tree index \e i (see LinkModel::getTreeIndex()) is updated and has geometry. The mask has one element per link of the model. */
+  const std::vector<bool>& getUpdatedLinkModelsWithGeometryMask() const
+  {
+    return updated_link_model_with_geometry_mask_;
+  }
+
   /** \brief Get the names of the links returned by getUpdatedLinkModels() */
   const std::vector<std::string>& getUpdatedLinkModelsWithGeometryNames() const
   {
@@ -242,6 +292,14 @@ public:
   /** \brief Compute random values for the state of the joint group */
   void getVariableRandomValuesNearBy(random_numbers::RandomNumberGenerator &rng, std::vector<double> &values, const std::vector<double> &near, const std::vector<double> &distances) const;
 
+  /** \brief Get the number of coordinates of the points a VariableSampler needs to produce for getVariableSampledValues() */
+  unsigned int getSampleDimension() const;
+
+  /** \brief Compute values for the state of the joint group from the next point of \e sampler, which needs at least getSampleDimension()
+      coordinates. With a low-discrepancy sampler (e.g., SobolSampler), a sequence of calls covers the space of the group more evenly
+      than random values do. Return false if the sampler has too few coordinates. */
+  bool getVariableSampledValues(VariableSampler &sampler, std::vector<double> &values) const;
+
   /** \brief Get the number of variables that describe this joint group */
   unsigned int getVariableCount() const
   {
@@ -263,6 +321,56 @@ public:
     return is_chain_;
   }
 
+  /** \brief Get the joints that contribute to the Jacobian of \e link, or NULL if \e link is not updated by this group.
+      The tables are computed when the group is constructed, so Jacobians can be evaluated without name lookups */
+  const JacobianChain* getJacobianChain(const LinkModel *link) const
+  {
+    std::map<const LinkModel*, JacobianChain>::const_iterator it = jacobian_chains_.find(link);
+    return it == jacobian_chains_.end() ? NULL : &it->second;
+  }
+
+  /** \brief Get the child links of all the joints that appear in the tables returned by getJacobianChain(), indexed by
+      JacobianChainEntry::joint_index_. Jacobians of several links can share the transforms of these links */
+  const std::vector<const LinkModel*>& getJacobianJointLinks() const
+  {
+    return jacobian_joint_links_;
+  }
+
+  /** \brief Get the link whose frame Jacobians of this group are expressed in. For groups with a single root joint
+      this is the parent link of that joint. It is NULL if that joint is the root of the model or if the group has
+      several roots (a group of disconnected parts of the tree), in which case the frame of the root of the model is used */
+  const LinkModel* getJacobianReferenceLink() const
+  {
+    return jacobian_reference_link_;
+  }
+
+  /** \brief Check if all the joints returned by getJointModels() are revolute or prismatic, so each has exactly one variable.
+      Distances and interpolation for such groups can be computed directly on the variables, without dispatching per joint type. */
+  bool hasOnlySingleDOFJoints() const
+  {
+    return single_dof_joints_;
+  }
+
+  /** \brief For each joint returned by getJointModels(), true if it is a continuous revolute joint */
+  const std::vector<bool>& getContinuousJointFlags() const
+  {
+    return continuous_joint_flags_;
+  }
+
+  /** \brief Get the joints returned by getJointModels(), arranged by kind (see JointDispatch) */
+  const JointDispatch& getJointDispatch() const
+  {
+    return joint_dispatch_;
+  }
+
+  /** \brief Get the joints returned by getJointModels() as ranges of consecutive joints in the order of the model
+      (see JointModel::getTreeIndex()). Each range is a pair of the index of its first joint and the number of joints in it.
+      Most groups (chains in particular) consist of a single range. */
+  const std::vector<std::pair<unsigned int, unsigned int> >& getJointIndexRanges() const
+  {
+    return joint_index_ranges_;
+  }
+
   /** \brief Check if this group was designated as an end-effector in the SRDF */
   bool isEndEffector() const
   {
@@ -321,14 +429,15 @@ public:
     return solver_instance_;
   }
 
+  /** \brief Get a solver instance that no other caller of this function is using, so IK can run in several threads at once.
+      Idle instances are reused; when none is idle, a new one is created with the solver allocator of the group. The instance
+      goes back to the pool when the last copy of the returned pointer is released. If the allocator does not create distinct
+      instances, the shared instance (getSolverInstance()) is returned instead. Returns an empty pointer if the group has no solver. */
+  kinematics::KinematicsBaseConstPtr acquireSolverInstance() const;
+
   bool canSetStateFromIK(const std::string &tip) const;
 
-  bool setRedundantJoints(const std::vector<unsigned int> &joints)
-  {
-    if(solver_instance_)
-      return (solver_instance_->setRedundantJoints(joints));
-    return false;
-  }
+  bool setRedundantJoints(const std::vector<unsigned int> &joints);
 
   /** \brief Get the default IK timeout */
   double getDefaultIKTimeout() const
@@ -351,6 +460,30 @@ public:
     default_ik_attempts_ = ik_attempts;
   }
 
+  /** \brief Keep the solutions of the last \e capacity IK queries for this group, so repeating a query does not run the solver again
+      (see robot_state::JointStateGroup::setFromIK()). Queries are identified by the target pose, rounded to \e pose_resolution
+      (meters for the position, quaternion components for the orientation), the seed, rounded to \e seed_resolution (so nearby
+      seeds share their solutions), and a context (the identity of the validity callback, and the version of the scene it checks).
+      A capacity of 0 (the default) disables the memo. The memo can be used from multiple threads at once. */
+  void setIKMemo(std::size_t capacity, double pose_resolution = 1e-4, double seed_resolution = 0.1);
+
+  /** \brief Get the number of IK solutions the memo of this group keeps (0 if the memo is disabled) */
+  std::size_t getIKMemoCapacity() const;
+
+  /** \brief Forget all the IK solutions in the memo of this group */
+  void clearIKMemo() const;
+
+  /** \brief Look for the solution (in the order of the variables of this group) of the IK query for \e pose, in the frame of the
+      solver, from \e seed, with the validity callback identified by \e context as of \e context_version. Return false if the
+      query is not in the memo. */
+  bool lookupIKMemo(const Eigen::Affine3d &pose, const std::vector<double> &seed, const std::string &context, unsigned int context_version,
+                    std::vector<double> &solution) const;
+
+  /** \brief Remember \e solution for an IK query, as identified by lookupIKMemo(). The least recently used solution is forgotten
+      if the memo is full. */
+  void storeIKMemo(const Eigen::Affine3d &pose, const std::vector<double> &seed, const std::string &context, unsigned int context_version,
+                   const std::vector<double> &solution) const;
+
   /** \brief Return the mapping between the order of the joints in this group and the order of the joints in the kinematics solver */
   const std::vector<unsigned int>& getKinematicsSolverJointBijection() const
   {
@@ -429,6 +562,9 @@ protected:
   /** \brief The list of downstream link models in the order they should be updated (may include links that are not in this group) */
   std::set<const LinkModel*>                            updated_link_model_with_geometry_set_;
 
+  /** \brief For each link of the model (by tree index), whether it is in updated_link_model_with_geometry_vector_ */
+  std::vector<bool>                                     updated_link_model_with_geometry_mask_;
+
   /** \brief The list of downstream link names in the order they should be updated (may include links that are not in this group) */
   std::vector<std::string>                              updated_link_model_with_geometry_name_vector_;
 
@@ -455,12 +591,41 @@ protected:
 
   bool                                                  is_chain_;
 
+  /** \brief True if all the joints in joint_model_vector_ are revolute or prismatic */
+  bool                                                  single_dof_joints_;
+
+  /** \brief For each joint in joint_model_vector_, true if it is a continuous revolute joint */
+  std::vector<bool>                                     continuous_joint_flags_;
+
+  /** \brief The joints in joint_model_vector_, by kind (see getJointDispatch()) */
+  JointDispatch                                         joint_dispatch_;
+
+  /** \brief The joints in joint_model_vector_, as ranges of consecutive tree indices (see getJointIndexRanges()) */
+  std::vector<std::pair<unsigned int, unsigned int> >   joint_index_ranges_;
+
+  /** \brief For each updated link, the joints of this group that move it (see getJacobianChain()) */
+  std::map<const LinkModel*, JacobianChain>             jacobian_chains_;
+
+  /** \brief The child links of the joints in jacobian_chains_ (see getJacobianJointLinks()) */
+  std::vector<const LinkModel*>                         jacobian_joint_links_;
+
+  /** \brief The link Jacobians are expressed in, if any (see getJacobianReferenceLink()) */
+  const LinkModel                                      *jacobian_reference_link_;
+
   std::pair<SolverAllocatorFn, SolverAllocatorMapFn>    solver_allocators_;
 
   kinematics::KinematicsBaseConstPtr                    solver_instance_const_;
 
   kinematics::KinematicsBasePtr                         solver_instance_;
 
+  /** \brief The solver instances handed out by acquireSolverInstance() */
+  struct SolverInstancePool;
+  boost::shared_ptr<SolverInstancePool>                 solver_pool_;
+
+  /** \brief The recent IK solutions (see setIKMemo()) */
+  struct IKMemo;
+  boost::shared_ptr<IKMemo>                             ik_memo_;
+
   std::vector<unsigned int>                             ik_joint_bijection_;
 
   double                                                default_ik_timeout_;
@@ -124,6 +124,12 @@ public:
     return shape_extents_;
   }
 
+  /** \brief Get the radius of a sphere that bounds the link's geometry; the sphere is centered at the origin of the collision geometry */
+  double getBoundingSphereRadius() const
+  {
+    return bounding_sphere_radius_;
+  }
+
   /** \brief Get the set of links that are attached to this one via fixed transforms */
   const AssociatedFixedTransformMap& getAssociatedFixedTransforms() const
   {
@@ -171,6 +177,9 @@ private:
   /** \brief The extents if shape (dimensions of axis aligned bounding box when shape is at origin */
   Eigen::Vector3d           shape_extents_;
 
+  /** \brief The radius of the sphere that bounds the axis aligned bounding box of the shape when shape is at origin */
+  double                    bounding_sphere_radius_;
+
   /** \brief Filename associated with the visual geometry mesh of this link. If empty, no mesh was used. */
   std::string               visual_mesh_filename_;
 
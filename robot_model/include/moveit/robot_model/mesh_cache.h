@@ -0,0 +1,62 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_ROBOT_MODEL_MESH_CACHE_
+#define MOVEIT_ROBOT_MODEL_MESH_CACHE_
+
+#include <geometric_shapes/shapes.h>
+#include <Eigen/Core>
+#include <string>
+
+namespace robot_model
+{
+
+/** \brief The name of the environment variable that holds the directory meshes decoded while building a RobotModel are kept in.
+    When the variable is not set, meshes are decoded every time a model is built. */
+static const std::string MESH_CACHE_DIRECTORY_VARIABLE = "MOVEIT_MESH_CACHE";
+
+/** \brief Return the directory named by MESH_CACHE_DIRECTORY_VARIABLE, or an empty string if the variable is not set */
+std::string getMeshCacheDirectory();
+
+/** \brief Load the mesh at \e resource (a file name or a resource URI) and scale it by \e scale.
+
+    If \e cache_directory is not empty, the decoded mesh is looked up there first, under a name computed from the content of the
+    resource and the scale; a mesh that has to be decoded is then stored there for next time. Since the name depends on the content
+    of the resource, editing a mesh file never makes a stale copy visible. Return NULL if the mesh cannot be loaded.
+    This function can be called from multiple threads at once. */
+shapes::Mesh* loadMesh(const std::string &resource, const Eigen::Vector3d &scale, const std::string &cache_directory);
+
+}
+
+#endif
@@ -54,6 +54,7 @@ public:
   virtual void getVariableRandomValues(random_numbers::RandomNumberGenerator &rng, std::vector<double> &values, const Bounds &other_bounds) const;
   virtual void getVariableRandomValuesNearBy(random_numbers::RandomNumberGenerator &rng, std::vector<double> &values, const Bounds &other_bounds,
                                              const std::vector<double> &near, const double distance) const;
+  virtual void getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &other_bounds) const;
   virtual void enforceBounds(std::vector<double> &values, const Bounds &other_bounds) const;
   virtual bool satisfiesBounds(const std::vector<double> &values, const Bounds &other_bounds, double margin) const;
 
@@ -66,6 +67,7 @@ public:
   virtual void computeTransform(const std::vector<double>& joint_values, Eigen::Affine3d &transf) const;
   virtual void computeJointStateValues(const Eigen::Affine3d& transf, std::vector<double> &joint_values) const;
   virtual void updateTransform(const std::vector<double>& joint_values, Eigen::Affine3d &transf) const;
+  virtual void composeTransform(const Eigen::Affine3d &parent, const Eigen::Affine3d &joint_transform, Eigen::Affine3d &result) const;
 
   /** \brief Check if this joint wraps around */
   bool isContinuous() const
@@ -79,10 +81,22 @@ public:
     return axis_;
   }
 
+  /** \brief Set the axis of rotation; the axis is normalized and the way transforms are computed is chosen from it */
+  void setAxis(const Eigen::Vector3d &axis);
+
 protected:
+  /** \brief The kernels used to compute transforms: rotations about the X, Y or Z axis (in either direction), or about any other axis */
+  enum AxisType
+    {
+      AXIS_X, AXIS_Y, AXIS_Z, AXIS_UNALIGNED
+    };
+
   /** \brief The axis of the joint */
   Eigen::Vector3d axis_;
 
+  /** \brief The kernel used for axis_ */
+  AxisType axis_type_;
+
   /** \brief Flag indicating whether this joint wraps around */
   bool continuous_;
 };
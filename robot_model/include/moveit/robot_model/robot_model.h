@@ -66,6 +66,41 @@ class RobotModel
 {
 public:
 
+  /** \brief How the global transform of a link is computed by forward kinematics (see getForwardKinematicsSteps()).
+      Links connected to the rest of the tree by chains of fixed joints are computed directly from the closest link
+      above them that is moved by a joint with variables (or from the root transform), using the product of the
+      origins of the fixed joints in between. */
+  struct ForwardKinematicsStep
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /** \brief The tree index of the link the transform is computed from, or -1 for the root transform of the state */
+    int                parent_index_;
+
+    /** \brief The joint whose transform is applied after origin_, or NULL if the link is attached to the link at parent_index_
+        by fixed joints only */
+    const JointModel  *joint_;
+
+    /** \brief The joint origin transform of the link, or the product of the joint origins of the chain of fixed joints */
+    Eigen::Affine3d    origin_;
+  };
+
+  typedef std::vector<ForwardKinematicsStep, Eigen::aligned_allocator<ForwardKinematicsStep> > ForwardKinematicsSteps;
+
+  /** \brief How the values of a mimic joint are computed from the values of the joint it mimics (see getMimicUpdates()) */
+  struct MimicUpdate
+  {
+    /** \brief The joint that is mimicked; it does not mimic any other joint */
+    const JointModel  *source_;
+
+    /** \brief The mimic joint */
+    const JointModel  *target_;
+
+    /** \brief The value of every variable of the target is factor_ * source value + offset_ */
+    double             factor_;
+    double             offset_;
+  };
+
   /** \brief Construct a kinematic model from a parsed description and a list of planning groups */
   RobotModel(const boost::shared_ptr<const urdf::ModelInterface> &urdf_model,
              const boost::shared_ptr<const srdf::Model> &srdf_model);
@@ -166,6 +201,19 @@ public:
     return link_model_vector_;
   }
 
+  /** \brief Get the forward kinematics table: one entry for every link, in the order of getLinkModels() (by tree index) */
+  const ForwardKinematicsSteps& getForwardKinematicsSteps() const
+  {
+    return fk_steps_;
+  }
+
+  /** \brief Get the mimic joint table: one entry for every joint that mimics another, ordered by the tree index of the
+      mimicked joint. Chains of mimic joints are collapsed, so updating a joint and then the joints of its entries is enough. */
+  const std::vector<MimicUpdate>& getMimicUpdates() const
+  {
+    return mimic_updates_;
+  }
+
   /** \brief Get the link names (of all links) */
   const std::vector<std::string>& getLinkModelNames() const
   {
@@ -326,6 +374,12 @@ protected:
   /** \brief The vector of link names that corresponds to link_model_vector_ */
   std::vector<std::string>                      link_model_names_vector_;
 
+  /** \brief The forward kinematics table, in the order of link_model_vector_ */
+  ForwardKinematicsSteps                        fk_steps_;
+
+  /** \brief The mimic joint table (see getMimicUpdates()) */
+  std::vector<MimicUpdate>                      mimic_updates_;
+
   /** \brief Only links that have collision geometry specified */
   std::vector<LinkModel*>                       link_models_with_collision_geometry_vector_;
 
@@ -405,6 +459,9 @@ protected:
   /** \brief Compute helpful information about joints */
   void buildJointInfo();
 
+  /** \brief Compute the forward kinematics table (fk_steps_) */
+  void buildForwardKinematicsSteps();
+
   /** \brief (This function is mostly intended for internal use). Given a parent link, build up (recursively),
       the kinematic model by walking  down the tree*/
   JointModel* buildRecursive(LinkModel *parent, const urdf::Link *link, const srdf::Model &srdf_model);
@@ -421,6 +478,14 @@ protected:
 
   /** \brief Given a geometry spec from the URDF and a filename (for a mesh), construct the corresponding shape object*/
   shapes::ShapePtr constructShape(const urdf::Geometry *geom);
+
+  /** \brief Load the meshes used as collision geometry by the links of \e urdf_model, using multiple threads. Meshes
+      are decoded once per file and scale, even if multiple links use them. The results are stored in loaded_meshes_
+      for constructShape() to use while the model is built. */
+  void loadMeshes(const urdf::ModelInterface &urdf_model);
+
+  /** \brief The meshes loaded by loadMeshes(), by the URDF geometry they were loaded for. This is only filled while the model is built. */
+  std::map<const urdf::Geometry*, shapes::ShapePtr> loaded_meshes_;
 };
 
 typedef boost::shared_ptr<RobotModel> RobotModelPtr;
@@ -0,0 +1,159 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_ROBOT_MODEL_VARIABLE_SAMPLER_
+#define MOVEIT_ROBOT_MODEL_VARIABLE_SAMPLER_
+
+#include <random_numbers/random_numbers.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace robot_model
+{
+
+/** \brief Produces points in the unit hypercube [0, 1)^d. The joint models map these points to values of their variables
+    (see JointModel::getVariableValuesFromUnit() and JointModelGroup::getVariableSampledValues()), so the way the points
+    are produced decides how the states of a group are spread. Samplers are not thread safe. */
+class VariableSampler
+{
+public:
+
+  VariableSampler(unsigned int dimension) : dimension_(dimension)
+  {
+  }
+
+  virtual ~VariableSampler()
+  {
+  }
+
+  /** \brief Get the number of coordinates of each point */
+  unsigned int getDimension() const
+  {
+    return dimension_;
+  }
+
+  /** \brief Write the next point (getDimension() values in [0, 1)) to \e point */
+  virtual void sample(double *point) = 0;
+
+protected:
+
+  unsigned int dimension_;
+};
+
+typedef boost::shared_ptr<VariableSampler> VariableSamplerPtr;
+
+/** \brief Independent pseudo-random points, as used by JointModelGroup::getVariableRandomValues() */
+class UniformVariableSampler : public VariableSampler
+{
+public:
+
+  UniformVariableSampler(unsigned int dimension) : VariableSampler(dimension)
+  {
+  }
+
+  virtual void sample(double *point);
+
+private:
+
+  random_numbers::RandomNumberGenerator rng_;
+};
+
+/** \brief The points of the Halton sequence: coordinate \e i of point \e n is the radical inverse of \e n in the base of the \e i-th prime.
+    The sequence is deterministic and covers the hypercube evenly for any number of points; in many dimensions (more than about ten),
+    the coordinates with large bases are correlated over short runs of points, so SobolSampler is usually the better choice there. */
+class HaltonSampler : public VariableSampler
+{
+public:
+
+  /** \brief Start the sequence at point \e skip (the point with index 0 is the origin and is best skipped) */
+  HaltonSampler(unsigned int dimension, unsigned int skip = 1);
+
+  virtual void sample(double *point);
+
+private:
+
+  std::vector<unsigned int> bases_;
+  unsigned int              index_;
+};
+
+/** \brief The points of the Sobol sequence, with the direction numbers of S. Joe and F. Y. Kuo. Sobol points cover the hypercube
+    evenly, and their projections on pairs of coordinates stay even as the dimension grows. Direction numbers are included for up to
+    MAX_DIMENSION coordinates; further coordinates are pseudo-random. */
+class SobolSampler : public VariableSampler
+{
+public:
+
+  static const unsigned int MAX_DIMENSION = 21;
+
+  /** \brief Start the sequence after the origin, skipping \e skip more points */
+  SobolSampler(unsigned int dimension, unsigned int skip = 0);
+
+  virtual void sample(double *point);
+
+private:
+
+  /// The direction numbers of each coordinate, as 32 bit fractions
+  std::vector<std::vector<boost::uint32_t> > directions_;
+
+  /// The coordinates of the current point, as 32 bit fractions
+  std::vector<boost::uint32_t>               current_;
+  boost::uint32_t                            index_;
+  random_numbers::RandomNumberGenerator      rng_;
+};
+
+/** \brief Latin hypercube sampling: points come in batches of \e count, and in each batch every coordinate falls in each of
+    \e count equal intervals of [0, 1) exactly once, at a random position within the interval. The intervals of the
+    coordinates are paired at random. For a fixed budget of \e count points, this spreads every coordinate evenly. */
+class LatinHypercubeSampler : public VariableSampler
+{
+public:
+
+  LatinHypercubeSampler(unsigned int dimension, unsigned int count);
+
+  virtual void sample(double *point);
+
+private:
+
+  /// For each coordinate, the order its intervals are used in by the current batch
+  std::vector<std::vector<unsigned int> > strata_;
+  unsigned int                            count_;
+  unsigned int                            next_;
+  random_numbers::RandomNumberGenerator   rng_;
+};
+
+}
+
+#endif
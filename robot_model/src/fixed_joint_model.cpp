@@ -59,6 +59,10 @@ void robot_model::FixedJointModel::getVariableRandomValuesNearBy(random_numbers:
 {
 }
 
+void robot_model::FixedJointModel::getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &bounds) const
+{
+}
+
 void robot_model::FixedJointModel::enforceBounds(std::vector<double> &values, const Bounds &bounds) const
 {
 }
@@ -325,3 +325,25 @@ void robot_model::FloatingJointModel::getVariableRandomValuesNearBy(random_numbe
     values[s + 6] = near[s + 6]*q[3] - near[s + 3]*q[0] - near[s + 4]*q[1] - near[s + 5]*q[2];
   }
 }
+
+void robot_model::FloatingJointModel::getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &bounds) const
+{
+  std::size_t s = values.size();
+  values.resize(s + 7);
+  // as for random values, unbounded translations are not sampled
+  for (int i = 0 ; i < 3 ; ++i)
+    if (bounds[i].second >= std::numeric_limits<double>::max() || bounds[i].first <= -std::numeric_limits<double>::max())
+      values[s + i] = 0.0;
+    else
+      values[s + i] = bounds[i].first + unit[i] * (bounds[i].second - bounds[i].first);
+
+  // the remaining three coordinates map to a uniformly distributed rotation (K. Shoemake, Uniform random rotations, Graphics Gems III)
+  const double r1 = sqrt(1.0 - unit[3]);
+  const double r2 = sqrt(unit[3]);
+  const double t1 = 2.0 * boost::math::constants::pi<double>() * unit[4];
+  const double t2 = 2.0 * boost::math::constants::pi<double>() * unit[5];
+  values[s + 3] = r1 * sin(t1);
+  values[s + 4] = r1 * cos(t1);
+  values[s + 5] = r2 * sin(t2);
+  values[s + 6] = r2 * cos(t2);
+}
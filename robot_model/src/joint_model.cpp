@@ -110,6 +110,11 @@ void robot_model::JointModel::computeDefaultVariableLimits()
   }
 }
 
+void robot_model::JointModel::composeTransform(const Eigen::Affine3d &parent, const Eigen::Affine3d &joint_transform, Eigen::Affine3d &result) const
+{
+  result = parent * joint_transform;
+}
+
 void robot_model::JointModel::setVariableLimits(const std::vector<moveit_msgs::JointLimits>& jlim)
 {
   user_specified_limits_.clear();
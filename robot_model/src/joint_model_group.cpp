@@ -36,7 +36,10 @@
 
 #include <moveit/robot_model/joint_model_group.h>
 #include <moveit/robot_model/robot_model.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 #include <algorithm>
+#include <list>
 
 namespace robot_model
 {
@@ -84,12 +87,101 @@ bool includesParent(const JointModel *joint, const JointModelGroup *group)
 }
 }
 
+struct robot_model::JointModelGroup::SolverInstancePool
+{
+  SolverInstancePool() : config_version_(0), shared_only_(false)
+  {
+  }
+
+  /** \brief Return \e solver, configured as of \e config_version, to the list of idle instances */
+  static void release(const boost::shared_ptr<SolverInstancePool> &pool, const kinematics::KinematicsBasePtr &solver, unsigned int config_version)
+  {
+    boost::mutex::scoped_lock slock(pool->lock_);
+    pool->idle_.push_back(std::make_pair(solver, config_version));
+  }
+
+  boost::mutex                                                      lock_;
+
+  /** \brief The instances not in use, with the version of the configuration they last received */
+  std::vector<std::pair<kinematics::KinematicsBasePtr, unsigned int> > idle_;
+
+  /** \brief Incremented when the timeout or the redundant joints of the group change */
+  unsigned int                                                      config_version_;
+
+  /** \brief True if the allocator only returns the shared instance */
+  bool                                                              shared_only_;
+};
+
+struct robot_model::JointModelGroup::IKMemo
+{
+  IKMemo() : capacity_(0), pose_resolution_(1e-4), seed_resolution_(0.1)
+  {
+  }
+
+  /** \brief The identity of a query: the rounded pose and seed, and the context */
+  struct Key
+  {
+    std::vector<long> values_;
+    std::string       context_;
+    unsigned int      context_version_;
+
+    bool operator<(const Key &other) const
+    {
+      if (context_version_ != other.context_version_)
+        return context_version_ < other.context_version_;
+      if (values_ != other.values_)
+        return values_ < other.values_;
+      return context_ < other.context_;
+    }
+  };
+
+  static long round(double value, double resolution)
+  {
+    return (long)floor(value / resolution + 0.5);
+  }
+
+  void makeKey(const Eigen::Affine3d &pose, const std::vector<double> &seed, const std::string &context, unsigned int context_version, Key &key) const
+  {
+    key.values_.clear();
+    key.values_.reserve(7 + seed.size());
+    for (int i = 0 ; i < 3 ; ++i)
+      key.values_.push_back(round(pose.translation()(i), pose_resolution_));
+    // q and -q are the same orientation
+    Eigen::Quaterniond q(pose.rotation());
+    if (q.w() < 0.0)
+      q.coeffs() *= -1.0;
+    for (int i = 0 ; i < 4 ; ++i)
+      key.values_.push_back(round(q.coeffs()(i), pose_resolution_));
+    if (seed_resolution_ > 0.0)
+      for (std::size_t i = 0 ; i < seed.size() ; ++i)
+        key.values_.push_back(round(seed[i], seed_resolution_));
+    key.context_ = context;
+    key.context_version_ = context_version;
+  }
+
+  void clear()
+  {
+    entries_.clear();
+    index_.clear();
+  }
+
+  /** \brief The entries, most recently used first */
+  typedef std::list<std::pair<Key, std::vector<double> > > EntryList;
+
+  boost::mutex                            lock_;
+  std::size_t                             capacity_;
+  double                                  pose_resolution_;
+  double                                  seed_resolution_;
+  EntryList                               entries_;
+  std::map<Key, EntryList::iterator>      index_;
+};
+
 robot_model::JointModelGroup::JointModelGroup(const std::string& group_name,
 					      const std::vector<const JointModel*> &unsorted_group_joints,
 					      const RobotModel* parent_model) :
   parent_model_(parent_model), name_(group_name),
-  variable_count_(0), is_end_effector_(false), is_chain_(false),
-  default_ik_timeout_(0.5), default_ik_attempts_(2)
+  variable_count_(0), is_end_effector_(false), is_chain_(false), single_dof_joints_(true),
+  jacobian_reference_link_(NULL), solver_pool_(new SolverInstancePool()), ik_memo_(new IKMemo()), default_ik_timeout_(0.5), default_ik_attempts_(2)
 {
   // sort joints in Depth-First order
   std::vector<const JointModel*> group_joints = unsorted_group_joints;
@@ -121,6 +213,17 @@ robot_model::JointModelGroup::JointModelGroup(const std::string& group_name,
   for (std::size_t i = 0 ; i < joint_model_vector_.size() ; ++i)
   {
     joint_model_name_vector_.push_back(joint_model_vector_[i]->getName());
+    if (joint_model_vector_[i]->getType() != JointModel::REVOLUTE && joint_model_vector_[i]->getType() != JointModel::PRISMATIC)
+      single_dof_joints_ = false;
+    continuous_joint_flags_.push_back(joint_model_vector_[i]->getType() == JointModel::REVOLUTE &&
+                                      static_cast<const RevoluteJointModel*>(joint_model_vector_[i])->isContinuous());
+    if (continuous_joint_flags_.back())
+      joint_dispatch_.continuous_.push_back(i);
+    else
+      if (joint_model_vector_[i]->getType() == JointModel::REVOLUTE || joint_model_vector_[i]->getType() == JointModel::PRISMATIC)
+        joint_dispatch_.bounded_.push_back(i);
+      else
+        joint_dispatch_.other_.push_back(i);
     bool found = false;
     const JointModel *joint = joint_model_vector_[i];
     // if we find that an ancestor is also in the group, then the joint is not a root
@@ -128,6 +231,17 @@ robot_model::JointModelGroup::JointModelGroup(const std::string& group_name,
       joint_roots_.push_back(joint_model_vector_[i]);
   }
   
+  // compute the ranges of consecutive joints (in the order of the model) that make up the group
+  std::vector<int> tree_indices;
+  for (std::size_t i = 0 ; i < joint_model_vector_.size() ; ++i)
+    tree_indices.push_back(joint_model_vector_[i]->getTreeIndex());
+  std::sort(tree_indices.begin(), tree_indices.end());
+  for (std::size_t i = 0 ; i < tree_indices.size() ; ++i)
+    if (!joint_index_ranges_.empty() && joint_index_ranges_.back().first + joint_index_ranges_.back().second == (unsigned int)tree_indices[i])
+      joint_index_ranges_.back().second++;
+    else
+      joint_index_ranges_.push_back(std::make_pair((unsigned int)tree_indices[i], 1u));
+
   // compute joint_variables_index_map_
   unsigned int vector_index_counter = 0;
   for (std::size_t i = 0 ; i < joint_model_vector_.size() ; ++i)
@@ -194,6 +308,63 @@ robot_model::JointModelGroup::JointModelGroup(const std::string& group_name,
     updated_link_model_name_vector_.push_back(updated_link_model_vector_[i]->getName());
   for (std::size_t i = 0; i < updated_link_model_with_geometry_vector_.size(); ++i)
     updated_link_model_with_geometry_name_vector_.push_back(updated_link_model_with_geometry_vector_[i]->getName());
+  updated_link_model_with_geometry_mask_.resize(parent_model->getLinkModels().size(), false);
+  for (std::size_t i = 0; i < updated_link_model_with_geometry_vector_.size(); ++i)
+  {
+    std::size_t index = updated_link_model_with_geometry_vector_[i]->getTreeIndex();
+    if (index >= updated_link_model_with_geometry_mask_.size())
+      updated_link_model_with_geometry_mask_.resize(index + 1, false);
+    updated_link_model_with_geometry_mask_[index] = true;
+  }
+
+  // precompute, for each updated link, the joints on the path to the root of the group that contribute to the Jacobian of that link
+  if (!joint_roots_.empty())
+  {
+    if (joint_roots_.size() == 1)
+      jacobian_reference_link_ = joint_roots_[0]->getParentLinkModel();
+    std::map<const LinkModel*, unsigned int> joint_indices;
+    for (std::size_t i = 0 ; i < updated_link_model_vector_.size() ; ++i)
+    {
+      JacobianChain &chain = jacobian_chains_[updated_link_model_vector_[i]];
+      const LinkModel *link = updated_link_model_vector_[i];
+      while (link && link->getParentJointModel())
+      {
+        const JointModel *joint = link->getParentJointModel();
+        const JointModel *active = joint->getMimic() ? joint->getMimic() : joint;
+        if ((joint->getType() == JointModel::REVOLUTE || joint->getType() == JointModel::PRISMATIC || joint->getType() == JointModel::PLANAR) &&
+            joint_model_map_.find(joint->getName()) != joint_model_map_.end() &&
+            std::find(joint_model_vector_.begin(), joint_model_vector_.end(), active) != joint_model_vector_.end())
+        {
+          JacobianChainEntry entry;
+          entry.link_ = link;
+          entry.column_ = joint_variables_index_map_[active->getName()];
+          std::map<const LinkModel*, unsigned int>::const_iterator it = joint_indices.find(link);
+          if (it == joint_indices.end())
+          {
+            entry.joint_index_ = jacobian_joint_links_.size();
+            joint_indices[link] = entry.joint_index_;
+            jacobian_joint_links_.push_back(link);
+          }
+          else
+            entry.joint_index_ = it->second;
+          entry.type_ = joint->getType();
+          if (joint->getType() == JointModel::REVOLUTE)
+            entry.axis_ = static_cast<const RevoluteJointModel*>(joint)->getAxis();
+          else
+            if (joint->getType() == JointModel::PRISMATIC)
+              entry.axis_ = static_cast<const PrismaticJointModel*>(joint)->getAxis();
+            else
+              entry.axis_ = Eigen::Vector3d::UnitZ();
+          entry.multiplier_ = joint->getMimic() ? joint->getMimicFactor() : 1.0;
+          chain.push_back(entry);
+        }
+        // the roots are on different branches, so no joint of the group is above the root that was reached
+        if (std::find(joint_roots_.begin(), joint_roots_.end(), joint) != joint_roots_.end())
+          break;
+        link = joint->getParentLinkModel();
+      }
+    }
+  }
 
   // check if this group should actually be a chain
   if (joint_roots_.size() == 1 && joint_model_vector_.size() > 1 && !is_chain_)
@@ -247,8 +418,48 @@ const robot_model::JointModel* robot_model::JointModelGroup::getJointModel(const
 
 void robot_model::JointModelGroup::getVariableRandomValues(random_numbers::RandomNumberGenerator &rng, std::vector<double> &values) const
 {
+  // revolute and prismatic joints sample uniformly within their bounds (continuous joints have the bounds of one turn)
+  if (single_dof_joints_)
+  {
+    std::size_t offset = values.size();
+    values.resize(offset + joint_model_vector_.size());
+    for (std::size_t i = 0  ; i < joint_model_vector_.size() ; ++i)
+    {
+      const std::pair<double, double> &b = joint_model_vector_[i]->getVariableBounds()[0];
+      values[offset + i] = rng.uniformReal(b.first, b.second);
+    }
+  }
+  else
+    for (std::size_t i = 0  ; i < joint_model_vector_.size() ; ++i)
+      joint_model_vector_[i]->getVariableRandomValues(rng, values);
+}
+
+unsigned int robot_model::JointModelGroup::getSampleDimension() const
+{
+  unsigned int dimension = 0;
   for (std::size_t i = 0  ; i < joint_model_vector_.size() ; ++i)
-    joint_model_vector_[i]->getVariableRandomValues(rng, values);
+    dimension += joint_model_vector_[i]->getStateSpaceDimension();
+  return dimension;
+}
+
+bool robot_model::JointModelGroup::getVariableSampledValues(VariableSampler &sampler, std::vector<double> &values) const
+{
+  unsigned int dimension = getSampleDimension();
+  if (sampler.getDimension() < dimension)
+  {
+    logError("Sampling group '%s' needs points with %u coordinates but the sampler produces %u", name_.c_str(), dimension, sampler.getDimension());
+    return false;
+  }
+
+  std::vector<double> point(std::max(sampler.getDimension(), 1u));
+  sampler.sample(&point[0]);
+  const double *unit = &point[0];
+  for (std::size_t i = 0  ; i < joint_model_vector_.size() ; ++i)
+  {
+    joint_model_vector_[i]->getVariableValuesFromUnit(unit, values);
+    unit += joint_model_vector_[i]->getStateSpaceDimension();
+  }
+  return true;
 }
 
 void robot_model::JointModelGroup::getVariableRandomValuesNearBy(random_numbers::RandomNumberGenerator &rng, std::vector<double> &values, const std::vector<double> &near, const std::map<robot_model::JointModel::JointType, double> &distance_map) const
@@ -364,11 +575,92 @@ void robot_model::JointModelGroup::setDefaultIKTimeout(double ik_timeout)
   default_ik_timeout_ = ik_timeout;
   if (solver_instance_)
     solver_instance_->setDefaultTimeout(ik_timeout);
+  boost::mutex::scoped_lock slock(solver_pool_->lock_);
+  solver_pool_->config_version_++;
+}
+
+bool robot_model::JointModelGroup::setRedundantJoints(const std::vector<unsigned int> &joints)
+{
+  if (!solver_instance_)
+    return false;
+  clearIKMemo();
+  boost::mutex::scoped_lock slock(solver_pool_->lock_);
+  solver_pool_->config_version_++;
+  return solver_instance_->setRedundantJoints(joints);
+}
+
+void robot_model::JointModelGroup::setIKMemo(std::size_t capacity, double pose_resolution, double seed_resolution)
+{
+  if (pose_resolution <= 0.0)
+  {
+    logError("The pose resolution of the IK memo of group '%s' must be positive", name_.c_str());
+    return;
+  }
+  boost::mutex::scoped_lock slock(ik_memo_->lock_);
+  ik_memo_->clear();
+  ik_memo_->capacity_ = capacity;
+  ik_memo_->pose_resolution_ = pose_resolution;
+  ik_memo_->seed_resolution_ = seed_resolution;
+}
+
+std::size_t robot_model::JointModelGroup::getIKMemoCapacity() const
+{
+  boost::mutex::scoped_lock slock(ik_memo_->lock_);
+  return ik_memo_->capacity_;
+}
+
+void robot_model::JointModelGroup::clearIKMemo() const
+{
+  boost::mutex::scoped_lock slock(ik_memo_->lock_);
+  ik_memo_->clear();
+}
+
+bool robot_model::JointModelGroup::lookupIKMemo(const Eigen::Affine3d &pose, const std::vector<double> &seed, const std::string &context,
+                                                unsigned int context_version, std::vector<double> &solution) const
+{
+  IKMemo::Key key;
+  boost::mutex::scoped_lock slock(ik_memo_->lock_);
+  if (ik_memo_->capacity_ == 0)
+    return false;
+  ik_memo_->makeKey(pose, seed, context, context_version, key);
+  std::map<IKMemo::Key, IKMemo::EntryList::iterator>::const_iterator it = ik_memo_->index_.find(key);
+  if (it == ik_memo_->index_.end())
+    return false;
+  ik_memo_->entries_.splice(ik_memo_->entries_.begin(), ik_memo_->entries_, it->second);
+  solution = it->second->second;
+  return true;
+}
+
+void robot_model::JointModelGroup::storeIKMemo(const Eigen::Affine3d &pose, const std::vector<double> &seed, const std::string &context,
+                                               unsigned int context_version, const std::vector<double> &solution) const
+{
+  IKMemo::Key key;
+  boost::mutex::scoped_lock slock(ik_memo_->lock_);
+  if (ik_memo_->capacity_ == 0)
+    return;
+  ik_memo_->makeKey(pose, seed, context, context_version, key);
+  std::map<IKMemo::Key, IKMemo::EntryList::iterator>::iterator it = ik_memo_->index_.find(key);
+  if (it != ik_memo_->index_.end())
+  {
+    it->second->second = solution;
+    ik_memo_->entries_.splice(ik_memo_->entries_.begin(), ik_memo_->entries_, it->second);
+    return;
+  }
+  if (ik_memo_->entries_.size() >= ik_memo_->capacity_)
+  {
+    ik_memo_->index_.erase(ik_memo_->entries_.back().first);
+    ik_memo_->entries_.pop_back();
+  }
+  ik_memo_->entries_.push_front(std::make_pair(key, solution));
+  ik_memo_->index_[key] = ik_memo_->entries_.begin();
 }
 
 void robot_model::JointModelGroup::setSolverAllocators(const std::pair<SolverAllocatorFn, SolverAllocatorMapFn> &solvers)
 {
   solver_allocators_ = solvers;
+  clearIKMemo();
+  // instances leased from the previous pool go back to that pool
+  solver_pool_.reset(new SolverInstancePool());
   if (solver_allocators_.first)
   {
     solver_instance_ = solver_allocators_.first(this);
@@ -394,6 +686,53 @@ void robot_model::JointModelGroup::setSolverAllocators(const std::pair<SolverAll
   }
 }
 
+kinematics::KinematicsBaseConstPtr robot_model::JointModelGroup::acquireSolverInstance() const
+{
+  if (!solver_instance_)
+    return kinematics::KinematicsBaseConstPtr();
+
+  kinematics::KinematicsBasePtr solver;
+  unsigned int solver_version = 0, config_version = 0;
+  boost::shared_ptr<SolverInstancePool> pool = solver_pool_;
+  {
+    boost::mutex::scoped_lock slock(pool->lock_);
+    if (pool->shared_only_)
+      return solver_instance_const_;
+    if (!pool->idle_.empty())
+    {
+      solver = pool->idle_.back().first;
+      solver_version = pool->idle_.back().second;
+      pool->idle_.pop_back();
+    }
+    config_version = pool->config_version_;
+  }
+
+  // the allocator may be slow (it typically loads a plugin), so it is called without holding the lock
+  if (!solver)
+  {
+    solver = solver_allocators_.first(this);
+    if (!solver || solver == solver_instance_ || solver->getJointNames() != solver_instance_->getJointNames())
+    {
+      logWarn("The solver allocator for group '%s' does not create distinct solver instances. IK for this group will not run in parallel.", name_.c_str());
+      boost::mutex::scoped_lock slock(pool->lock_);
+      pool->shared_only_ = true;
+      return solver_instance_const_;
+    }
+    solver_version = config_version + 1;
+  }
+
+  // bring the instance up to date with the configuration of the shared one
+  if (solver_version != config_version)
+  {
+    solver->setDefaultTimeout(default_ik_timeout_);
+    std::vector<unsigned int> redundant_joints;
+    solver_instance_->getRedundantJoints(redundant_joints);
+    solver->setRedundantJoints(redundant_joints);
+  }
+
+  return kinematics::KinematicsBaseConstPtr(solver.get(), boost::bind(&SolverInstancePool::release, pool, solver, config_version));
+}
+
 bool robot_model::JointModelGroup::canSetStateFromIK(const std::string &tip) const
 {
   const kinematics::KinematicsBaseConstPtr& solver = getSolverInstance();
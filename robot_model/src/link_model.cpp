@@ -36,7 +36,7 @@
 
 #include <moveit/robot_model/link_model.h>
 
-robot_model::LinkModel::LinkModel() : parent_joint_model_(NULL), tree_index_(-1)
+robot_model::LinkModel::LinkModel() : parent_joint_model_(NULL), bounding_sphere_radius_(0.0), tree_index_(-1)
 {
   joint_origin_transform_.setIdentity();
   collision_origin_transform_.setIdentity();
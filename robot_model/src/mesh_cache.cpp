@@ -0,0 +1,211 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/robot_model/mesh_cache.h>
+#include <geometric_shapes/mesh_operations.h>
+#include <resource_retriever/retriever.h>
+#include <console_bridge/console.h>
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+namespace robot_model
+{
+namespace
+{
+static const char MESH_CACHE_MAGIC[8] = {'M', 'V', 'T', 'M', 'E', 'S', 'H', '1'};
+
+// 64-bit FNV-1a; unlike boost::hash, the value is the same for every build, so it can name files
+static boost::uint64_t fnv1a(const boost::uint8_t *data, std::size_t size, boost::uint64_t h = 14695981039346656037ULL)
+{
+  for (std::size_t i = 0 ; i < size ; ++i)
+  {
+    h ^= data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static std::string cacheFileName(const std::string &cache_directory, const resource_retriever::MemoryResource &res, const double *scale)
+{
+  boost::uint64_t h = fnv1a(res.data.get(), res.size);
+  h = fnv1a(reinterpret_cast<const boost::uint8_t*>(scale), 3 * sizeof(double), h);
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << h << ".mesh";
+  return (boost::filesystem::path(cache_directory) / ss.str()).string();
+}
+
+static shapes::Mesh* readCachedMesh(const std::string &filename, boost::uint64_t size, const double *scale)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  if (!in.good())
+    return NULL;
+
+  char magic[sizeof(MESH_CACHE_MAGIC)];
+  boost::uint64_t stored_size = 0;
+  double stored_scale[3];
+  boost::uint32_t vertex_count = 0, triangle_count = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&stored_size), sizeof(stored_size));
+  in.read(reinterpret_cast<char*>(stored_scale), sizeof(stored_scale));
+  in.read(reinterpret_cast<char*>(&vertex_count), sizeof(vertex_count));
+  in.read(reinterpret_cast<char*>(&triangle_count), sizeof(triangle_count));
+
+  // the file name is only a hash, so check what the file says it was made from
+  if (in.fail() || memcmp(magic, MESH_CACHE_MAGIC, sizeof(magic)) != 0 || stored_size != size ||
+      memcmp(stored_scale, scale, sizeof(stored_scale)) != 0)
+    return NULL;
+
+  // the counts are checked against the size of the file before the mesh is allocated
+  const std::streampos data_start = in.tellg();
+  in.seekg(0, std::ios::end);
+  const std::streampos data_end = in.tellg();
+  in.seekg(data_start);
+  const boost::uint64_t data_size = in.fail() || data_end < data_start ? 0 : (boost::uint64_t)(data_end - data_start);
+  if (data_size != 3 * (boost::uint64_t)vertex_count * sizeof(double) + 3 * (boost::uint64_t)triangle_count * sizeof(boost::uint32_t))
+  {
+    logWarn("Cached mesh '%s' is truncated or corrupt", filename.c_str());
+    return NULL;
+  }
+
+  shapes::Mesh *mesh = new shapes::Mesh(vertex_count, triangle_count);
+  in.read(reinterpret_cast<char*>(mesh->vertices), 3 * (std::size_t)vertex_count * sizeof(double));
+  bool valid = true;
+  for (std::size_t i = 0 ; i < 3 * (std::size_t)triangle_count ; ++i)
+  {
+    boost::uint32_t v = 0;
+    in.read(reinterpret_cast<char*>(&v), sizeof(v));
+    if (v >= vertex_count)
+      valid = false;
+    mesh->triangles[i] = v;
+  }
+  if (in.fail() || !valid)
+  {
+    logWarn("Cached mesh '%s' is truncated or corrupt", filename.c_str());
+    delete mesh;
+    return NULL;
+  }
+  mesh->computeTriangleNormals();
+  mesh->computeVertexNormals();
+  return mesh;
+}
+
+static void writeCachedMesh(const std::string &filename, boost::uint64_t size, const double *scale, const shapes::Mesh &mesh)
+{
+  try
+  {
+    boost::filesystem::path path(filename);
+    boost::filesystem::create_directories(path.parent_path());
+
+    // write to a temporary file first, so that other processes never see a partial mesh
+    boost::filesystem::path tmp = path.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%.tmp");
+    {
+      std::ofstream out(tmp.string().c_str(), std::ios::binary);
+      boost::uint32_t vertex_count = mesh.vertex_count, triangle_count = mesh.triangle_count;
+      out.write(MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+      out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      out.write(reinterpret_cast<const char*>(scale), 3 * sizeof(double));
+      out.write(reinterpret_cast<const char*>(&vertex_count), sizeof(vertex_count));
+      out.write(reinterpret_cast<const char*>(&triangle_count), sizeof(triangle_count));
+      out.write(reinterpret_cast<const char*>(mesh.vertices), 3 * mesh.vertex_count * sizeof(double));
+      for (std::size_t i = 0 ; i < 3 * mesh.triangle_count ; ++i)
+      {
+        boost::uint32_t v = mesh.triangles[i];
+        out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+      }
+      if (!out.good())
+      {
+        logWarn("Unable to write cached mesh '%s'", tmp.string().c_str());
+        out.close();
+        boost::filesystem::remove(tmp);
+        return;
+      }
+    }
+    boost::filesystem::rename(tmp, path);
+  }
+  catch (boost::filesystem::filesystem_error &ex)
+  {
+    logWarn("Unable to cache mesh as '%s': %s", filename.c_str(), ex.what());
+  }
+}
+
+}
+}
+
+std::string robot_model::getMeshCacheDirectory()
+{
+  const char *dir = getenv(MESH_CACHE_DIRECTORY_VARIABLE.c_str());
+  return dir ? std::string(dir) : std::string();
+}
+
+shapes::Mesh* robot_model::loadMesh(const std::string &resource, const Eigen::Vector3d &scale, const std::string &cache_directory)
+{
+  if (cache_directory.empty())
+    return shapes::createMeshFromResource(resource, scale);
+
+  resource_retriever::Retriever retriever;
+  resource_retriever::MemoryResource res;
+  try
+  {
+    res = retriever.get(resource);
+  }
+  catch (resource_retriever::Exception &ex)
+  {
+    logError("%s", ex.what());
+    return NULL;
+  }
+  if (res.size == 0)
+  {
+    logWarn("Retrieved empty mesh for resource '%s'", resource.c_str());
+    return NULL;
+  }
+
+  const double s[3] = { scale.x(), scale.y(), scale.z() };
+  std::string filename = cacheFileName(cache_directory, res, s);
+  shapes::Mesh *mesh = readCachedMesh(filename, res.size, s);
+  if (mesh)
+  {
+    logDebug("Loaded mesh '%s' from cache file '%s'", resource.c_str(), filename.c_str());
+    return mesh;
+  }
+
+  mesh = shapes::createMeshFromBinary(reinterpret_cast<const char*>(res.data.get()), res.size, scale, resource);
+  if (mesh)
+    writeCachedMesh(filename, res.size, s, *mesh);
+  return mesh;
+}
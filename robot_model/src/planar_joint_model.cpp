@@ -116,6 +116,19 @@ void robot_model::PlanarJointModel::getVariableRandomValuesNearBy(random_numbers
   normalizeRotation(values);
 }
 
+void robot_model::PlanarJointModel::getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &bounds) const
+{
+  std::size_t s = values.size();
+  values.resize(s + 3);
+  // as for random values, unbounded translations are not sampled
+  for (int i = 0 ; i < 2 ; ++i)
+    if (bounds[i].second >= std::numeric_limits<double>::max() || bounds[i].first <= -std::numeric_limits<double>::max())
+      values[s + i] = 0.0;
+    else
+      values[s + i] = bounds[i].first + unit[i] * (bounds[i].second - bounds[i].first);
+  values[s + 2] = bounds[2].first + unit[2] * (bounds[2].second - bounds[2].first);
+}
+
 void robot_model::PlanarJointModel::interpolate(const std::vector<double> &from, const std::vector<double> &to, const double t, std::vector<double> &state) const
 {
   // interpolate position
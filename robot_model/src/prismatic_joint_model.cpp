@@ -83,6 +83,11 @@ void robot_model::PrismaticJointModel::getVariableRandomValuesNearBy(random_numb
                                    std::min(bounds[0].second, near[values.size()] + distance)));
 }
 
+void robot_model::PrismaticJointModel::getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &bounds) const
+{
+  values.push_back(bounds[0].first + unit[0] * (bounds[0].second - bounds[0].first));
+}
+
 void robot_model::PrismaticJointModel::enforceBounds(std::vector<double> &values, const Bounds &bounds) const
 {
   const std::pair<double, double> &b = bounds[0];
@@ -40,13 +40,30 @@
 #include <cmath>
 
 robot_model::RevoluteJointModel::RevoluteJointModel(const std::string& name) : JointModel(name),
-                                                                                   axis_(0.0, 0.0, 0.0), continuous_(false)
+                                                                                   axis_(0.0, 0.0, 0.0), axis_type_(AXIS_UNALIGNED), continuous_(false)
 {
   type_ = REVOLUTE;
   variable_bounds_.push_back(std::make_pair(-boost::math::constants::pi<double>(), boost::math::constants::pi<double>()));
   variable_names_.push_back(name_);
 }
 
+void robot_model::RevoluteJointModel::setAxis(const Eigen::Vector3d &axis)
+{
+  static const double EPSILON = 1e-9;
+  double norm = axis.norm();
+  axis_ = norm > EPSILON ? Eigen::Vector3d(axis / norm) : axis;
+  axis_type_ = AXIS_UNALIGNED;
+
+  // axes that are aligned with X, Y or Z (the common case) get closed form rotations
+  for (int i = 0 ; i < 3 ; ++i)
+    if (norm > EPSILON && fabs(axis_[(i + 1) % 3]) < EPSILON && fabs(axis_[(i + 2) % 3]) < EPSILON)
+    {
+      axis_ = axis_[i] > 0.0 ? Eigen::Vector3d::Unit(i) : Eigen::Vector3d(-Eigen::Vector3d::Unit(i));
+      axis_type_ = static_cast<AxisType>(AXIS_X + i);
+      break;
+    }
+}
+
 unsigned int robot_model::RevoluteJointModel::getStateSpaceDimension() const
 {
   return 1;
@@ -84,6 +101,12 @@ void robot_model::RevoluteJointModel::getVariableRandomValuesNearBy(random_numbe
                                      std::min(bounds[0].second, near[values.size()] + distance)));
 }
 
+void robot_model::RevoluteJointModel::getVariableValuesFromUnit(const double *unit, std::vector<double> &values, const Bounds &bounds) const
+{
+  // continuous joints have the bounds of one turn, so they are covered as well
+  values.push_back(bounds[0].first + unit[0] * (bounds[0].second - bounds[0].first));
+}
+
 void robot_model::RevoluteJointModel::interpolate(const std::vector<double> &from, const std::vector<double> &to, const double t, std::vector<double> &state) const
 {
   if (continuous_)
@@ -165,12 +188,91 @@ void robot_model::RevoluteJointModel::computeDefaultVariableLimits()
 
 void robot_model::RevoluteJointModel::computeTransform(const std::vector<double>& joint_values, Eigen::Affine3d &transf) const
 {
+  transf.setIdentity();
   updateTransform(joint_values, transf);
 }
 
 void robot_model::RevoluteJointModel::updateTransform(const std::vector<double>& joint_values, Eigen::Affine3d &transf) const
 {
-  transf = Eigen::Affine3d(Eigen::AngleAxisd(joint_values[0], axis_));
+  // only the rotation part changes; the translation stays zero
+  const double c = cos(joint_values[0]);
+  switch (axis_type_)
+  {
+  case AXIS_X:
+    {
+      const double s = axis_.x() * sin(joint_values[0]);
+      transf.linear() << 1.0, 0.0, 0.0,
+                         0.0, c, -s,
+                         0.0, s, c;
+    }
+    break;
+  case AXIS_Y:
+    {
+      const double s = axis_.y() * sin(joint_values[0]);
+      transf.linear() << c, 0.0, s,
+                         0.0, 1.0, 0.0,
+                         -s, 0.0, c;
+    }
+    break;
+  case AXIS_Z:
+    {
+      const double s = axis_.z() * sin(joint_values[0]);
+      transf.linear() << c, -s, 0.0,
+                         s, c, 0.0,
+                         0.0, 0.0, 1.0;
+    }
+    break;
+  default:
+    {
+      // Rodrigues' formula
+      const double s = sin(joint_values[0]);
+      const double t = 1.0 - c;
+      const double x = axis_.x(), y = axis_.y(), z = axis_.z();
+      transf.linear() << t * x * x + c, t * x * y - s * z, t * x * z + s * y,
+                         t * x * y + s * z, t * y * y + c, t * y * z - s * x,
+                         t * x * z - s * y, t * y * z + s * x, t * z * z + c;
+    }
+    break;
+  }
+}
+
+void robot_model::RevoluteJointModel::composeTransform(const Eigen::Affine3d &parent, const Eigen::Affine3d &joint_transform, Eigen::Affine3d &result) const
+{
+  // the joint transform is a pure rotation; for aligned axes, one column of the result is a column of the parent
+  // and the other two mix the corresponding columns of the parent with the cosine and sine stored in joint_transform
+  const Eigen::Affine3d::ConstLinearPart p = parent.linear();
+  switch (axis_type_)
+  {
+  case AXIS_X:
+    {
+      const double c = joint_transform(1, 1), s = joint_transform(2, 1);
+      result.linear().col(0) = p.col(0);
+      result.linear().col(1) = c * p.col(1) + s * p.col(2);
+      result.linear().col(2) = c * p.col(2) - s * p.col(1);
+    }
+    break;
+  case AXIS_Y:
+    {
+      const double c = joint_transform(0, 0), s = joint_transform(0, 2);
+      result.linear().col(0) = c * p.col(0) - s * p.col(2);
+      result.linear().col(1) = p.col(1);
+      result.linear().col(2) = s * p.col(0) + c * p.col(2);
+    }
+    break;
+  case AXIS_Z:
+    {
+      const double c = joint_transform(0, 0), s = joint_transform(1, 0);
+      result.linear().col(0) = c * p.col(0) + s * p.col(1);
+      result.linear().col(1) = c * p.col(1) - s * p.col(0);
+      result.linear().col(2) = p.col(2);
+    }
+    break;
+  default:
+    result.linear().noalias() = p * joint_transform.linear();
+    break;
+  }
+  result.translation() = parent.translation();
+  result.makeAffine();
 }
 
 void robot_model::RevoluteJointModel::computeJointStateValues(const Eigen::Affine3d& transf, std::vector<double> &joint_values) const
@@ -35,10 +35,14 @@
 /* Author: Ioan Sucan, E. Gil Jones */
 
 #include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_model/mesh_cache.h>
 #include <geometric_shapes/shape_operations.h>
 #include <boost/math/constants/constants.hpp>
 #include <moveit/profiler/profiler.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <algorithm>
+#include <sstream>
 #include <limits>
 #include <queue>
 #include <cmath>
@@ -76,10 +80,13 @@ void robot_model::RobotModel::buildModel(const urdf::ModelInterface &urdf_model,
     const urdf::Link *root_link_ptr = urdf_model.getRoot().get();
     model_frame_ = '/' + root_link_ptr->name;
 
+    loadMeshes(urdf_model);
     root_joint_ = buildRecursive(NULL, root_link_ptr, srdf_model);
+    loaded_meshes_.clear();
     root_link_ = root_joint_->child_link_model_;
     buildMimic(urdf_model);
     buildJointInfo();
+    buildForwardKinematicsSteps();
 
     if (link_models_with_collision_geometry_vector_.empty())
       logWarn("No geometry is associated to any robot links");
@@ -150,6 +157,34 @@ void robot_model::RobotModel::buildJointInfo()
   }
 }
 
+void robot_model::RobotModel::buildForwardKinematicsSteps()
+{
+  fk_steps_.resize(link_model_vector_.size());
+  for (std::size_t i = 0 ; i < link_model_vector_.size() ; ++i)
+  {
+    const LinkModel *link = link_model_vector_[i];
+    ForwardKinematicsStep &step = fk_steps_[link->getTreeIndex()];
+    const JointModel *joint = link->getParentJointModel();
+    step.origin_ = link->getJointOriginTransform();
+    if (joint->getType() != JointModel::FIXED)
+    {
+      step.joint_ = joint;
+      step.parent_index_ = joint->getParentLinkModel() ? joint->getParentLinkModel()->getTreeIndex() : -1;
+      continue;
+    }
+
+    // collapse the chain of fixed joints above this link
+    step.joint_ = NULL;
+    const LinkModel *parent = joint->getParentLinkModel();
+    while (parent && parent->getParentJointModel()->getType() == JointModel::FIXED)
+    {
+      step.origin_ = parent->getJointOriginTransform() * step.origin_;
+      parent = parent->getParentJointModel()->getParentLinkModel();
+    }
+    step.parent_index_ = parent ? parent->getTreeIndex() : -1;
+  }
+}
+
 void robot_model::RobotModel::buildGroupStates(const srdf::Model &srdf_model)
 {
   // copy the default states to the groups
@@ -229,6 +264,22 @@ void robot_model::RobotModel::buildMimic(const urdf::ModelInterface &urdf_model)
     else
       if (joint_model_vector_[i]->mimic_)
         joint_model_vector_[i]->mimic_->mimic_requests_.push_back(joint_model_vector_[i]);
+
+  // the flat table of mimic requests, grouped by the joint that is mimicked
+  mimic_updates_.clear();
+  for (std::size_t i = 0 ; i < joint_model_vector_.size() ; ++i)
+  {
+    const std::vector<const JointModel*> &mr = joint_model_vector_[i]->mimic_requests_;
+    for (std::size_t j = 0 ; j < mr.size() ; ++j)
+    {
+      MimicUpdate update;
+      update.source_ = joint_model_vector_[i];
+      update.target_ = mr[j];
+      update.factor_ = mr[j]->getMimicFactor();
+      update.offset_ = mr[j]->getMimicOffset();
+      mimic_updates_.push_back(update);
+    }
+  }
 }
 
 bool robot_model::RobotModel::hasEndEffector(const std::string& eef) const
@@ -636,7 +687,7 @@ robot_model::JointModel* robot_model::RobotModel::constructJointModel(const urdf
         if (urdf_joint->limits)
           j->max_velocity_ = fabs(urdf_joint->limits->velocity);
         j->continuous_ = false;
-        j->axis_ = Eigen::Vector3d(urdf_joint->axis.x, urdf_joint->axis.y, urdf_joint->axis.z);
+        j->setAxis(Eigen::Vector3d(urdf_joint->axis.x, urdf_joint->axis.y, urdf_joint->axis.z));
         result = j;
       }
       break;
@@ -647,7 +698,7 @@ robot_model::JointModel* robot_model::RobotModel::constructJointModel(const urdf
         j->variable_bounds_[0] = std::make_pair(-boost::math::constants::pi<double>(), boost::math::constants::pi<double>());
         if (urdf_joint->limits)
           j->max_velocity_ = fabs(urdf_joint->limits->velocity);
-        j->axis_ = Eigen::Vector3d(urdf_joint->axis.x, urdf_joint->axis.y, urdf_joint->axis.z);
+        j->setAxis(Eigen::Vector3d(urdf_joint->axis.x, urdf_joint->axis.y, urdf_joint->axis.z));
         result = j;
       }
       break;
@@ -792,6 +843,7 @@ robot_model::LinkModel* robot_model::RobotModel::constructLinkModel(const urdf::
     result->shape_.reset();
     result->shape_extents_ = Eigen::Vector3d(0.0, 0.0, 0.0);
   }
+  result->bounding_sphere_radius_ = result->shape_extents_.norm() / 2.0;
 
   // figure out visual mesh (try visual urdf tag first, collision tag otherwise
   if (urdf_link->visual && urdf_link->visual->geometry)
@@ -850,11 +902,14 @@ shapes::ShapePtr robot_model::RobotModel::constructShape(const urdf::Geometry *g
     break;
   case urdf::Geometry::MESH:
     {
+      std::map<const urdf::Geometry*, shapes::ShapePtr>::const_iterator it = loaded_meshes_.find(geom);
+      if (it != loaded_meshes_.end())
+        return it->second;
       const urdf::Mesh *mesh = static_cast<const urdf::Mesh*>(geom);
       if (!mesh->filename.empty())
       {
         Eigen::Vector3d scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-        shapes::Mesh *m = shapes::createMeshFromResource(mesh->filename, scale);
+        shapes::Mesh *m = loadMesh(mesh->filename, scale, getMeshCacheDirectory());
         result = m;
       }
     }
@@ -867,6 +922,83 @@ shapes::ShapePtr robot_model::RobotModel::constructShape(const urdf::Geometry *g
   return shapes::ShapePtr(result);
 }
 
+namespace robot_model
+{
+namespace
+{
+struct MeshRequest
+{
+  std::string                         filename_;
+  Eigen::Vector3d                     scale_;
+  std::vector<const urdf::Geometry*>  users_;
+  shapes::ShapePtr                    mesh_;
+};
+
+static void loadMeshRequests(std::vector<MeshRequest> *requests, std::size_t first, std::size_t step, const std::string *cache_directory)
+{
+  for (std::size_t i = first ; i < requests->size() ; i += step)
+  {
+    MeshRequest &r = (*requests)[i];
+    r.mesh_.reset(loadMesh(r.filename_, r.scale_, *cache_directory));
+  }
+}
+}
+}
+
+void robot_model::RobotModel::loadMeshes(const urdf::ModelInterface &urdf_model)
+{
+  moveit::Profiler::ScopedBlock prof_block("RobotModel::loadMeshes");
+
+  // find the meshes constructLinkModel() will need, once per file and scale
+  std::vector<MeshRequest> requests;
+  std::map<std::string, std::size_t> index;
+  for (std::map<std::string, boost::shared_ptr<urdf::Link> >::const_iterator it = urdf_model.links_.begin() ; it != urdf_model.links_.end() ; ++it)
+  {
+    const urdf::Link *urdf_link = it->second.get();
+    const urdf::Geometry *geom = NULL;
+    if (urdf_link->collision && urdf_link->collision->geometry)
+      geom = urdf_link->collision->geometry.get();
+    else
+      if (urdf_link->visual && urdf_link->visual->geometry)
+        geom = urdf_link->visual->geometry.get();
+    if (!geom || geom->type != urdf::Geometry::MESH)
+      continue;
+    const urdf::Mesh *mesh = static_cast<const urdf::Mesh*>(geom);
+    if (mesh->filename.empty())
+      continue;
+
+    std::stringstream key;
+    key << mesh->filename << " " << mesh->scale.x << " " << mesh->scale.y << " " << mesh->scale.z;
+    std::map<std::string, std::size_t>::const_iterator jt = index.find(key.str());
+    if (jt == index.end())
+    {
+      index[key.str()] = requests.size();
+      requests.resize(requests.size() + 1);
+      requests.back().filename_ = mesh->filename;
+      requests.back().scale_ = Eigen::Vector3d(mesh->scale.x, mesh->scale.y, mesh->scale.z);
+      requests.back().users_.push_back(geom);
+    }
+    else
+      requests[jt->second].users_.push_back(geom);
+  }
+  if (requests.empty())
+    return;
+
+  std::string cache_directory = getMeshCacheDirectory();
+  std::size_t nthreads = std::min<std::size_t>(std::max(1u, boost::thread::hardware_concurrency()), requests.size());
+  boost::thread_group threads;
+  for (std::size_t i = 1 ; i < nthreads ; ++i)
+    threads.create_thread(boost::bind(&loadMeshRequests, &requests, i, nthreads, &cache_directory));
+  loadMeshRequests(&requests, 0, nthreads, &cache_directory);
+  threads.join_all();
+
+  // links that share a mesh get their own copy, as they would if they had loaded it themselves;
+  // meshes that failed to load are recorded too, so they are not tried again
+  for (std::size_t i = 0 ; i < requests.size() ; ++i)
+    for (std::size_t j = 0 ; j < requests[i].users_.size() ; ++j)
+      loaded_meshes_[requests[i].users_[j]] = (j == 0 || !requests[i].mesh_) ? requests[i].mesh_ : shapes::ShapePtr(requests[i].mesh_->clone());
+}
+
 const std::string& robot_model::RobotModel::getRootJointName() const
 {
   static const std::string empty;
@@ -0,0 +1,200 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/robot_model/variable_sampler.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+
+namespace
+{
+
+// the direction numbers of the Sobol sequence for the coordinates after the first (S. Joe and F. Y. Kuo, new-joe-kuo-6.21201):
+// the degree s of the primitive polynomial, its coefficients a and the initial numbers m_1..m_s
+struct SobolInitialization
+{
+  unsigned int s;
+  unsigned int a;
+  unsigned int m[7];
+};
+
+const SobolInitialization SOBOL_INIT[] = {
+  { 1,  0, { 1 } },
+  { 2,  1, { 1, 3 } },
+  { 3,  1, { 1, 3, 1 } },
+  { 3,  2, { 1, 1, 1 } },
+  { 4,  1, { 1, 1, 3, 3 } },
+  { 4,  4, { 1, 3, 5, 13 } },
+  { 5,  2, { 1, 1, 5, 5, 17 } },
+  { 5,  4, { 1, 1, 5, 5, 5 } },
+  { 5,  7, { 1, 1, 7, 11, 19 } },
+  { 5, 11, { 1, 1, 5, 1, 1 } },
+  { 5, 13, { 1, 1, 1, 3, 11 } },
+  { 5, 14, { 1, 3, 5, 5, 31 } },
+  { 6,  1, { 1, 3, 3, 9, 7, 49 } },
+  { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+  { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+  { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+  { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+  { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+  { 7,  1, { 1, 3, 7, 11, 23, 15, 103 } },
+  { 7,  4, { 1, 3, 7, 13, 13, 15, 69 } }
+};
+
+const unsigned int SOBOL_BITS = 32;
+const double SOBOL_SCALE = 1.0 / 4294967296.0;
+
+// the radical inverse of index in the given base: the digits of index, mirrored around the decimal point
+double radicalInverse(unsigned int index, unsigned int base)
+{
+  const double inv_base = 1.0 / base;
+  double factor = inv_base;
+  double result = 0.0;
+  while (index > 0)
+  {
+    result += (index % base) * factor;
+    index /= base;
+    factor *= inv_base;
+  }
+  return result;
+}
+
+}
+
+void robot_model::UniformVariableSampler::sample(double *point)
+{
+  for (unsigned int i = 0 ; i < dimension_ ; ++i)
+    point[i] = rng_.uniform01();
+}
+
+robot_model::HaltonSampler::HaltonSampler(unsigned int dimension, unsigned int skip) : VariableSampler(dimension), index_(skip)
+{
+  // the first primes, by trial division
+  for (unsigned int n = 2 ; bases_.size() < dimension ; ++n)
+  {
+    bool prime = true;
+    for (std::size_t i = 0 ; prime && i < bases_.size() && bases_[i] * bases_[i] <= n ; ++i)
+      prime = n % bases_[i] != 0;
+    if (prime)
+      bases_.push_back(n);
+  }
+}
+
+void robot_model::HaltonSampler::sample(double *point)
+{
+  for (unsigned int i = 0 ; i < dimension_ ; ++i)
+    point[i] = radicalInverse(index_, bases_[i]);
+  ++index_;
+}
+
+robot_model::SobolSampler::SobolSampler(unsigned int dimension, unsigned int skip) : VariableSampler(dimension), index_(0)
+{
+  if (dimension > MAX_DIMENSION)
+    logWarn("Sobol sampling is supported for up to %u coordinates; the remaining %u coordinates are sampled pseudo-randomly",
+            MAX_DIMENSION, dimension - MAX_DIMENSION);
+
+  directions_.resize(std::min(dimension, MAX_DIMENSION), std::vector<boost::uint32_t>(SOBOL_BITS));
+  for (std::size_t d = 0 ; d < directions_.size() ; ++d)
+  {
+    std::vector<boost::uint32_t> &v = directions_[d];
+    if (d == 0)
+    {
+      // the first coordinate is the van der Corput sequence in base 2
+      for (unsigned int i = 0 ; i < SOBOL_BITS ; ++i)
+        v[i] = (boost::uint32_t)1 << (SOBOL_BITS - 1 - i);
+      continue;
+    }
+    const SobolInitialization &init = SOBOL_INIT[d - 1];
+    for (unsigned int i = 0 ; i < init.s && i < SOBOL_BITS ; ++i)
+      v[i] = (boost::uint32_t)init.m[i] << (SOBOL_BITS - 1 - i);
+    for (unsigned int i = init.s ; i < SOBOL_BITS ; ++i)
+    {
+      v[i] = v[i - init.s] ^ (v[i - init.s] >> init.s);
+      for (unsigned int k = 1 ; k < init.s ; ++k)
+        if ((init.a >> (init.s - 1 - k)) & 1)
+          v[i] ^= v[i - k];
+    }
+  }
+  current_.resize(directions_.size(), 0);
+
+  // the origin, the first point of the sequence, is never produced
+  std::vector<double> point(dimension);
+  for (unsigned int i = 0 ; i < skip ; ++i)
+    sample(point.empty() ? NULL : &point[0]);
+}
+
+void robot_model::SobolSampler::sample(double *point)
+{
+  // in Gray code order, consecutive points differ by the direction number of the lowest zero bit of the index
+  unsigned int c = 0;
+  for (boost::uint32_t n = index_ ; (n & 1) && c < SOBOL_BITS - 1 ; n >>= 1)
+    ++c;
+  ++index_;
+
+  for (std::size_t d = 0 ; d < current_.size() ; ++d)
+  {
+    current_[d] ^= directions_[d][c];
+    point[d] = current_[d] * SOBOL_SCALE;
+  }
+  for (unsigned int d = current_.size() ; d < dimension_ ; ++d)
+    point[d] = rng_.uniform01();
+}
+
+robot_model::LatinHypercubeSampler::LatinHypercubeSampler(unsigned int dimension, unsigned int count) :
+  VariableSampler(dimension), strata_(dimension), count_(std::max(count, 1u)), next_(count_)
+{
+  for (unsigned int d = 0 ; d < dimension ; ++d)
+  {
+    strata_[d].resize(count_);
+    for (unsigned int i = 0 ; i < count_ ; ++i)
+      strata_[d][i] = i;
+  }
+}
+
+void robot_model::LatinHypercubeSampler::sample(double *point)
+{
+  // a new batch pairs the intervals of the coordinates anew
+  if (next_ == count_)
+  {
+    for (unsigned int d = 0 ; d < dimension_ ; ++d)
+      for (unsigned int i = count_ - 1 ; i > 0 ; --i)
+        std::swap(strata_[d][i], strata_[d][rng_.uniformInteger(0, i)]);
+    next_ = 0;
+  }
+
+  const double width = 1.0 / count_;
+  for (unsigned int d = 0 ; d < dimension_ ; ++d)
+    point[d] = (strata_[d][next_] + rng_.uniform01()) * width;
+  ++next_;
+}
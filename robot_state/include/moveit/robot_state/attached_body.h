@@ -40,6 +40,7 @@
 #include <moveit/robot_state/link_state.h>
 #include <eigen_stl_containers/eigen_stl_containers.h>
 #include <sensor_msgs/JointState.h>
+#include <boost/shared_ptr.hpp>
 #include <set>
 
 namespace robot_state
@@ -47,9 +48,13 @@ namespace robot_state
 
 class LinkState;
 
+/** \brief Get an estimate of the memory held by a shape, in bytes (vertices, triangles and normals for meshes, the nodes of the tree for octrees) */
+std::size_t getShapeMemoryUsage(const shapes::Shape &shape);
+
 /** @brief Object defining bodies that can be attached to robot
  *  links. This is useful when handling objects picked up by
- *  the robot. */
+ *  the robot. Copies of an attached body share the (immutable)
+ *  definition of the body and only own their global transforms. */
 class AttachedBody
 {
   friend class RobotState;
@@ -65,12 +70,16 @@ public:
                const std::set<std::string> &touch_links,
                const sensor_msgs::JointState &attach_posture);
 
+  /** \brief Construct a copy of \e other. The definition of the body (shapes, fixed transforms, touch links, detach posture)
+      is shared with \e other, so this is cheap regardless of the size of the shapes */
+  AttachedBody(const AttachedBody &other);
+
   ~AttachedBody();
 
   /** \brief Get the name of the attached body */
   const std::string& getName() const
   {
-    return id_;
+    return body_->id_;
   }
 
   /** \brief Get the name of the link this body is attached to */
@@ -88,7 +97,13 @@ public:
   /** \brief Get the shapes that make up this attached body */
   const std::vector<shapes::ShapeConstPtr>& getShapes() const
   {
-    return shapes_;
+    return body_->shapes_;
+  }
+
+  /** \brief Get the extents of each of the shapes (dimensions of the axis-aligned bounding box when the shape is at origin) */
+  const EigenSTL::vector_Vector3d& getShapeExtents() const
+  {
+    return body_->shape_extents_;
   }
 
   /** \brief Get the fixed transform (the transforms to the shapes associated with this body) */
@@ -96,19 +111,26 @@ public:
   /** \brief Get the links that the attached body is allowed to touch */
   const std::set<std::string>& getTouchLinks() const
   {
-    return touch_links_;
+    return body_->touch_links_;
+  }
+
+  /** \brief Get the links that the attached body is allowed to touch as a mask: element \e i is true if the link with tree
+      index \e i (see LinkModel::getTreeIndex()) is a touch link. Links past the end of the mask are not touch links. */
+  const std::vector<bool>& getTouchLinkMask() const
+  {
+    return body_->touch_link_mask_;
   }
 
   /** \brief Return the posture that is necessary for the object to be released, (if any). This is useful for example when storing
       the configuration of a gripper holding an object */
   const sensor_msgs::JointState& getDetachPosture() const
   {
-    return detach_posture_;
+    return body_->detach_posture_;
   }
 
   const EigenSTL::vector_Affine3d& getFixedTransforms() const
   {
-    return attach_trans_;
+    return body_->attach_trans_;
   }
 
   /** \brief Get the global transforms for the collision bodies */
@@ -117,38 +139,81 @@ public:
     return global_collision_body_transforms_;
   }
 
-  /** \brief Set the padding for the shapes of this attached object */
+  /** \brief Get a number that identifies this attached body and the current version of its definition. It is different for
+      every constructed body (copies included) and changes when the definition is modified (e.g., by setPadding()), so data
+      derived from a body can be recognized as stale even if a new body is later constructed at the same address */
+  std::size_t getInstanceID() const
+  {
+    return instance_id_;
+  }
+
+  /** \brief Set the padding for the shapes of this attached object. If the definition of the body is shared with other
+      copies, it is first duplicated, so the other copies are not affected */
   void setPadding(double padding);
 
-  /** \brief Set the scale for the shapes of this attached object */
+  /** \brief Set the scale for the shapes of this attached object. If the definition of the body is shared with other
+      copies, it is first duplicated, so the other copies are not affected */
   void setScale(double scale);
 
   /** \brief Recompute global_collision_body_transform given the transform of the parent link*/
   void computeTransform(const Eigen::Affine3d &parent_link_global_transform);
 
+  /** \brief Get an estimate of the memory held by this attached body, in bytes. The definition of the body (including its shapes)
+      is counted as well, even if it is shared with other copies */
+  std::size_t getMemoryUsage() const;
+
 private:
 
-  /** \brief The link that owns this attached body */
-  const robot_model::LinkModel      *parent_link_model_;
+  /** \brief The part of an attached body that does not change with the state of the robot */
+  struct Body
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  /** \brief string id for reference */
-  std::string                        id_;
+    /** \brief string id for reference */
+    std::string                        id_;
 
-  /** \brief The geometries of the attached body */
-  std::vector<shapes::ShapeConstPtr> shapes_;
+    /** \brief The geometries of the attached body */
+    std::vector<shapes::ShapeConstPtr> shapes_;
 
-  /** \brief The constant transforms applied to the link (needs to be specified by user) */
-  EigenSTL::vector_Affine3d          attach_trans_;
+    /** \brief The extents of shapes_ (computed once, as this can be expensive for meshes) */
+    EigenSTL::vector_Vector3d          shape_extents_;
 
-  /** \brief The set of links this body is allowed to touch */
-  std::set<std::string>              touch_links_;
+    /** \brief The constant transforms applied to the link (needs to be specified by user) */
+    EigenSTL::vector_Affine3d          attach_trans_;
 
-  /** \brief Posture of links for releasing the object (if any). This is useful for example when storing
-      the configuration of a gripper holding an object */
-  sensor_msgs::JointState            detach_posture_;
+    /** \brief The set of links this body is allowed to touch */
+    std::set<std::string>              touch_links_;
+
+    /** \brief The links in touch_links_, by tree index */
+    std::vector<bool>                  touch_link_mask_;
+
+    /** \brief Posture of links for releasing the object (if any). This is useful for example when storing
+        the configuration of a gripper holding an object */
+    sensor_msgs::JointState            detach_posture_;
+  };
+
+  AttachedBody& operator=(const AttachedBody &other); // not implemented
+
+  /** \brief Make sure the definition of the body is not shared with other copies, so it can be modified */
+  Body* makeUnique();
+
+  /** \brief Recompute the extents of the shapes in \e body */
+  static void updateShapeExtents(Body *body);
+
+  /** \brief Recompute the touch link mask of \e body from its touch links, which are looked up in the tree \e link belongs to */
+  static void updateTouchLinkMask(Body *body, const robot_model::LinkModel *link);
+
+  /** \brief The link that owns this attached body */
+  const robot_model::LinkModel      *parent_link_model_;
+
+  /** \brief The definition of the body, shared between copies */
+  boost::shared_ptr<const Body>      body_;
 
   /** \brief The global transforms for these attached bodies (computed by forward kinematics) */
   EigenSTL::vector_Affine3d          global_collision_body_transforms_;
+
+  /** \brief The value returned by getInstanceID() */
+  std::size_t                        instance_id_;
 };
 
 }
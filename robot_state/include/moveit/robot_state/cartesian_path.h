@@ -0,0 +1,233 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_ROBOT_STATE_CARTESIAN_PATH_
+#define MOVEIT_ROBOT_STATE_CARTESIAN_PATH_
+
+#include <moveit/robot_state/robot_state.h>
+
+namespace robot_state
+{
+
+/** \brief Compute Cartesian paths for a link, as JointStateGroup::computeCartesianPath() does, but store the
+    joint values of the points of the path in a buffer that is kept between calls instead of allocating a
+    RobotState for every point.
+
+    The frames of the IK solver are resolved once per path, and every IK call is made directly on the solver
+    with a single attempt, seeded with the previous point. Optionally, steps that move the link by less than a
+    threshold are taken with the Jacobian of the group (see JointStateGroup::computeJointVelocity()); IK is
+    only called if the resulting pose is not accurate enough. Consecutive segments of a path with several
+    waypoints share their end points, so, unlike JointStateGroup::computeCartesianPath(), no point is repeated.
+    An instance must not be used by multiple threads at the same time. */
+class CartesianPathGenerator
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  CartesianPathGenerator();
+
+  /** \brief Compute the path of \e link_name to \e target, starting from the current state of \e jsg.
+      The arguments and the return value are those of JointStateGroup::computeCartesianPath(). At the end
+      of the call, \e jsg is at the last point of the path. */
+  double computeCartesianPath(JointStateGroup *jsg, const std::string &link_name, const Eigen::Affine3d &target, bool global_reference_frame,
+                              double max_step, double jump_threshold, const StateValidityCallbackFn &validCallback = StateValidityCallbackFn(),
+                              const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
+
+  /** \brief Compute the path of \e link_name through \e waypoints, starting from the current state of \e jsg.
+      The arguments and the return value are those of JointStateGroup::computeCartesianPath(). At the end
+      of the call, \e jsg is at the last point of the path. */
+  double computeCartesianPath(JointStateGroup *jsg, const std::string &link_name, const EigenSTL::vector_Affine3d &waypoints, bool global_reference_frame,
+                              double max_step, double jump_threshold, const StateValidityCallbackFn &validCallback = StateValidityCallbackFn(),
+                              const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
+
+  /** \brief Steps that move the link by at most \e step (translation plus rotation angle) are first attempted with the
+      Jacobian of the group. A value of 0 (the default) always uses IK. */
+  void setJacobianStep(double step)
+  {
+    jacobian_step_ = step;
+  }
+
+  double getJacobianStep() const
+  {
+    return jacobian_step_;
+  }
+
+  /** \brief A step taken with the Jacobian is accepted if the link ends within \e tolerance (translation plus rotation
+      angle) of the desired pose */
+  void setJacobianTolerance(double tolerance)
+  {
+    jacobian_tolerance_ = tolerance;
+  }
+
+  double getJacobianTolerance() const
+  {
+    return jacobian_tolerance_;
+  }
+
+  /** \brief Choose the step size of each segment adaptively. The first step of a segment moves the link by
+      \e max_step (translation plus rotation angle, as passed to computeCartesianPath()). A step after which the
+      group variables move by more than \e max_joint_step (infinity norm, see JointStateGroup::infinityNormDistance())
+      is undone and retried with half the size; after a step that moves the variables by less than half of
+      \e max_joint_step, the step size doubles again, up to \e max_step. If a step of \e min_step still moves the
+      variables too much, a jump was found and the path stops there. A \e max_joint_step of 0 (the default) uses
+      the fixed number of steps of JointStateGroup::computeCartesianPath(). The \e jump_threshold test is
+      applied after either mode. */
+  void setAdaptiveStep(double max_joint_step, double min_step)
+  {
+    max_joint_step_ = max_joint_step;
+    min_step_ = min_step;
+  }
+
+  /** \brief Get the largest joint-space distance between consecutive points in adaptive mode (0 if disabled) */
+  double getMaxJointStep() const
+  {
+    return max_joint_step_;
+  }
+
+  /** \brief Get the smallest Cartesian step taken in adaptive mode */
+  double getMinStep() const
+  {
+    return min_step_;
+  }
+
+  /** \brief Get the number of points of the last computed path, including its start */
+  std::size_t getPointCount() const
+  {
+    return point_count_;
+  }
+
+  /** \brief Get the number of variables of each point of the last computed path */
+  unsigned int getVariableCount() const
+  {
+    return variable_count_;
+  }
+
+  /** \brief Get the values of the group variables for point \e index of the last computed path */
+  const double* getPoint(std::size_t index) const
+  {
+    return &points_[index * variable_count_];
+  }
+
+  /** \brief Set the group \e jsg to point \e index of the last computed path */
+  void setToPoint(std::size_t index, JointStateGroup *jsg) const;
+
+  /** \brief Fill \e traj with one copy of \e reference per point of the last computed path, with the values of the group
+      set to those of the point */
+  void getStates(const RobotState &reference, std::vector<RobotStatePtr> &traj) const;
+
+  /** \brief Get the number of IK calls made for the last computed path */
+  unsigned int getIKCallCount() const
+  {
+    return ik_calls_;
+  }
+
+  /** \brief Get the number of points of the last computed path that were obtained with the Jacobian */
+  unsigned int getJacobianStepCount() const
+  {
+    return jacobian_steps_;
+  }
+
+private:
+
+  /** \brief Resolve the frames of the IK solver for \e link_name; return false if neither IK nor Jacobian steps are possible */
+  bool setup(JointStateGroup *jsg, const std::string &link_name, const StateValidityCallbackFn &validCallback);
+
+  /** \brief Add the path from the current pose of the link to \e target; return the completed fraction, like
+      JointStateGroup::computeCartesianPath() */
+  double computeSegment(JointStateGroup *jsg, const Eigen::Affine3d &target, double max_step, double jump_threshold,
+                        const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options);
+
+  /** \brief Take the steps of a segment from \e start_pose to \e target, adding a point and its fraction of the
+      segment for each; return the fraction of the segment that was completed */
+  double takeFixedSteps(JointStateGroup *jsg, const Eigen::Affine3d &start_pose, const Eigen::Affine3d &target, double max_step, bool test_joint_space_jump,
+                        const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options);
+
+  /** \brief Same as takeFixedSteps(), with the adaptive step size described in setAdaptiveStep() */
+  double takeAdaptiveSteps(JointStateGroup *jsg, const Eigen::Affine3d &start_pose, const Eigen::Affine3d &target, double max_step,
+                           const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options);
+
+  /** \brief Move the link from \e previous_pose to \e pose, along the Jacobian if the step is small enough or with IK */
+  bool takeStep(JointStateGroup *jsg, const Eigen::Affine3d &previous_pose, const Eigen::Affine3d &pose,
+                const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options);
+
+  /** \brief The infinity norm distance between the group values \e a and \e b */
+  double jointDistance(const robot_model::JointModelGroup *jmg, const double *a, const double *b);
+
+  /** \brief Move the link to \e pose with one step along the Jacobian; on failure, the group is left unchanged */
+  bool takeJacobianStep(JointStateGroup *jsg, const Eigen::Affine3d &pose, const StateValidityCallbackFn &validCallback);
+
+  /** \brief Move the link to \e pose with one IK call seeded with the current values of the group */
+  bool callIK(JointStateGroup *jsg, const Eigen::Affine3d &pose, const kinematics::KinematicsQueryOptions &options);
+
+  void appendPoint(const JointStateGroup *jsg);
+
+  double                             jacobian_step_;
+  double                             jacobian_tolerance_;
+  double                             max_joint_step_;
+  double                             min_step_;
+
+  /** \brief The points of the last path, point_count_ rows of variable_count_ values; the capacity is kept between calls */
+  std::vector<double>                points_;
+  std::size_t                        point_count_;
+  std::string                        group_name_;
+  unsigned int                       variable_count_;
+
+  unsigned int                       ik_calls_;
+  unsigned int                       jacobian_steps_;
+
+  /** \brief State of the current call: the link, the IK solver and the transforms to the frames of the solver */
+  std::string                        link_name_;
+  const LinkState                   *link_state_;
+  kinematics::KinematicsBaseConstPtr solver_;
+  Eigen::Affine3d                    ik_base_inverse_;
+  Eigen::Affine3d                    tip_offset_;
+  kinematics::KinematicsBase::IKCallbackFn ik_callback_;
+
+  /** \brief Scratch space reused between steps */
+  std::vector<double>                fractions_;
+  std::vector<double>                previous_values_;
+  std::vector<double>                joint_a_;
+  std::vector<double>                joint_b_;
+  std::vector<double>                values_;
+  std::vector<double>                seed_;
+  std::vector<double>                solution_;
+  Eigen::VectorXd                    ik_seed_;
+  Eigen::VectorXd                    ik_solution_;
+  Eigen::VectorXd                    twist_;
+  Eigen::VectorXd                    qdot_;
+};
+
+}
+
+#endif
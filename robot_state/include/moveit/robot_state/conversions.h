@@ -41,6 +41,9 @@
 #include <moveit/transforms/transforms.h>
 #include <moveit_msgs/RobotState.h>
 #include <moveit_msgs/RobotTrajectory.h>
+#include <boost/cstdint.hpp>
+#include <boost/weak_ptr.hpp>
+#include <list>
 
 namespace robot_state
 {
@@ -68,6 +71,75 @@ bool robotStateMsgToRobotState(const Transforms &tf, const moveit_msgs::RobotSta
  */
 bool robotStateMsgToRobotState(const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies = true);
 
+/**
+ * @brief Converts robot state messages to kinematic states like
+ * robotStateMsgToRobotState(), reusing work done for earlier
+ * messages. For each distinct ordering of joint names, the mapping
+ * from message entries to joint variables is computed once, so
+ * further messages with the same ordering are copied by index. The
+ * shapes of attached collision objects are kept by object id and
+ * reused when an object with the same geometry is attached again.
+ * A converter is not thread safe; use one per thread.
+ */
+class RobotStateMsgConverter
+{
+public:
+
+  /**
+   * @brief Construct a converter that remembers up to \e max_layouts
+   * joint name orderings and up to \e max_bodies attached objects
+   */
+  RobotStateMsgConverter(std::size_t max_layouts = 4, std::size_t max_bodies = 16);
+
+  /** @brief Same as robotStateMsgToRobotState(const Transforms&, const moveit_msgs::RobotState&, RobotState&, bool) */
+  bool convert(const Transforms &tf, const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies = true);
+
+  /** @brief Same as robotStateMsgToRobotState(const moveit_msgs::RobotState&, RobotState&, bool) */
+  bool convert(const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies = true);
+
+  /** @brief Forget the remembered joint name orderings and attached objects */
+  void clear();
+
+private:
+
+  /** @brief Where the values of a joint are in a joint state message with a particular ordering of names */
+  struct JointLayout
+  {
+    const robot_model::JointModel *joint_;
+    std::vector<int>               source_; // for each variable of the joint, the index in the message, or -1
+  };
+
+  /** @brief How a particular ordering of joint names maps to the variables of a model */
+  struct Layout
+  {
+    boost::weak_ptr<const robot_model::RobotModel> model_; // does not match another model allocated at the same address
+    std::vector<std::string>                     names_;
+    std::vector<JointLayout>                     joints_;
+    std::vector<const robot_model::JointModel*>  name_joints_; // the joint of each name in the message, or NULL
+    std::set<std::string>                        missing_; // variables not in the message
+  };
+
+  /** @brief The shapes of an attached object, with their poses in the frame of the object */
+  struct CachedBody
+  {
+    std::string                        id_;
+    std::vector<boost::uint8_t>        geometry_; // the serialized shapes and poses of the object message
+    std::vector<shapes::ShapeConstPtr> shapes_;
+    EigenSTL::vector_Affine3d          poses_;
+  };
+
+  bool convertHelper(const Transforms *tf, const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies);
+  const Layout& getLayout(const robot_model::RobotModelConstPtr &model, const std::vector<std::string> &names);
+  bool setJointState(const sensor_msgs::JointState &joint_state, RobotState& state, std::set<std::string> &missing);
+  void attachBody(const Transforms *tf, const moveit_msgs::AttachedCollisionObject &aco, RobotState& state);
+
+  std::size_t           max_layouts_;
+  std::size_t           max_bodies_;
+  std::list<Layout>     layouts_; // most recently used first
+  std::list<CachedBody> bodies_; // most recently used first
+  std::vector<double>   values_;
+};
+
 /**
  * @brief Convert a kinematic state to a robot state message
  * @param state The input kinematic state object
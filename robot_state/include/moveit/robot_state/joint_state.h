@@ -51,8 +51,10 @@ class JointState
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  /** \brief Constructs the joint state from the model */
-  JointState(const robot_model::JointModel* jm);
+  /** \brief Constructs the joint state from the model. If \e variable_transform is specified, the variable transform
+      of this joint is stored at that location (typically memory owned by a RobotState); otherwise the joint state
+      allocates its own storage for it. */
+  JointState(const robot_model::JointModel* jm, Eigen::Affine3d *variable_transform = NULL);
 
   /** \brief Copy constructor */
   JointState(const JointState &other);
@@ -155,13 +157,13 @@ public:
   /** \brief Get the current variable transform */
   const Eigen::Affine3d& getVariableTransform() const
   {
-    return variable_transform_;
+    return *variable_transform_;
   }
 
   /** \brief Get the current variable transform */
   Eigen::Affine3d& getVariableTransform()
   {
-    return variable_transform_;
+    return *variable_transform_;
   }
 
   /** \brief Get the joint model corresponding to this state*/
@@ -206,8 +208,14 @@ private:
   /** \brief The joint model this state corresponds to */
   const robot_model::JointModel      *joint_model_;
 
-  /** \brief Tthe local transform (computed by forward kinematics) */
-  Eigen::Affine3d                     variable_transform_;
+  /** \brief The local transform (computed by forward kinematics) */
+  Eigen::Affine3d                    *variable_transform_;
+
+  /** \brief True if the memory pointed to by variable_transform_ was allocated by this joint state */
+  bool                                owns_variable_transform_;
+
+  /** \brief True if the variable transform changed since the last time the transforms of the child link were computed */
+  bool                                dirty_;
 
   /** \brief The joint values given in the order indicated by joint_variables_index_map_ */
   std::vector<double>                 joint_state_values_;
@@ -218,8 +226,16 @@ private:
   /// ignore this
   std::vector<double>                 horrible_acceleration_placeholder_;
 
-  /** \brief The set of joints that need to be updated when this one is */
-  std::vector<JointState*>            mimic_requests_;
+  /** \brief A joint that mimics this one, with the factor and offset its values are computed with */
+  struct MimicRequest
+  {
+    JointState *joint_;
+    double      factor_;
+    double      offset_;
+  };
+
+  /** \brief The set of joints that need to be updated when this one is (see robot_model::RobotModel::getMimicUpdates()) */
+  std::vector<MimicRequest>           mimic_requests_;
 };
 
 }
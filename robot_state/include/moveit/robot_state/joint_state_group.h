@@ -54,8 +54,48 @@ class JointStateGroup;
 typedef boost::function<bool(JointStateGroup *joint_state_group, const std::vector<double> &joint_group_variable_values)> StateValidityCallbackFn;
 typedef boost::function<bool(const JointStateGroup *joint_state_group, Eigen::VectorXd &stvector)> SecondaryTaskFn;
 
+/** \brief The cost of an IK solution (lower is better). The values of \e joint_state_group are set to the solution;
+    \e initial_values are the values of the group before IK was called */
+typedef boost::function<double(const JointStateGroup *joint_state_group, const std::vector<double> &initial_values)> IKCostFn;
+
 class RobotState;
 
+/** \brief Settings and scratch storage for the damped least-squares version of JointStateGroup::computeJointVelocity().
+    Keeping one instance across calls (e.g., in a servo loop) avoids reallocating the matrices involved; an instance
+    must not be shared by threads. */
+struct DiffIKWorkspace
+{
+  DiffIKWorkspace() : max_damping(0.1), singular_value_threshold(0.05), joint_limit_margin(0.1), min_joint_weight(0.01), group_(NULL)
+  {
+  }
+
+  /** \brief The damping applied when the Jacobian is singular. The damping grows smoothly from 0 as the smallest
+      singular value of the (weighted) Jacobian drops below \e singular_value_threshold */
+  double max_damping;
+
+  /** \brief The smallest singular value below which damping is applied */
+  double singular_value_threshold;
+
+  /** \brief The fraction of the range of a joint, next to each of its limits, in which motion towards the limit is
+      penalized; 0 disables the joint limit weighting */
+  double joint_limit_margin;
+
+  /** \brief The weight of a joint that is moving towards the limit it is at (1 is the weight of a joint that is free) */
+  double min_joint_weight;
+
+private:
+
+  friend class JointStateGroup;
+
+  const robot_model::JointModelGroup *group_;
+  std::vector<double> lower_;
+  std::vector<double> upper_;
+  std::vector<double> values_;
+  Eigen::VectorXd weights_;
+  Eigen::VectorXd cost_;
+  Eigen::Matrix<double, 6, Eigen::Dynamic> jacobian_;
+};
+
 /** @class JointStateGroup
  *  @brief The joint state corresponding to a group
  */
@@ -131,6 +171,15 @@ public:
   /** Compute transforms using current joint values */
   void updateLinkTransforms();
 
+  /** \brief Compute forward kinematics for many configurations of this group at once.
+      Each row of \e values is one configuration (with getVariableCount() columns, in
+      the order of getVariableValues()). On success, \e transforms[i][k] is the global
+      transform of link \e link_names[i] for configuration \e k. Only the links updated
+      by this group are recomputed for each configuration. The state of the group is
+      left at the last configuration in \e values. */
+  bool computeLinkTransforms(const Eigen::MatrixXd &values, const std::vector<std::string> &link_names,
+                             std::vector<EigenSTL::vector_Affine3d> &transforms);
+
   /** \brief Check if a joint is part of this group */
   bool hasJointState(const std::string &joint) const;
 
@@ -157,6 +206,10 @@ public:
   /** \brief Sample a random state in accordance with the type of joints employed */
   void setToRandomValues();
 
+  /** \brief Set the state to the one that corresponds to the next point of \e sampler (see JointModelGroup::getVariableSampledValues()).
+      Return false if the sampler produces too few coordinates for the group. */
+  bool setToSampledValues(robot_model::VariableSampler &sampler);
+
   /** \brief Sample a random state in accordance with
       the type of joints employed, near the specified joint state.
       The distance map specifies distances according to joint type. */
@@ -209,10 +262,13 @@ public:
     return joint_state_vector_;
   }
 
-  /** \brief Return the instance of a random number generator */
+  /** \brief Return the instance of a random number generator. This is the generator of the calling thread
+      if setUseThreadRandomNumberGenerators() was enabled */
   random_numbers::RandomNumberGenerator& getRandomNumberGenerator();
 
-  /** \brief Given a set of joint angles, compute the jacobian with reference to a particular point on a given link
+  /** \brief Given a set of joint angles, compute the jacobian with reference to a particular point on a given link.
+   * The group does not need to be a chain; columns of joints that do not move the link are zero. The Jacobian is
+   * expressed in the frame returned by robot_model::JointModelGroup::getJacobianReferenceLink()
    * \param link_name The name of the link
    * \param reference_point_position The reference point position (with respect to the link specified in link_name)
    * \param jacobian The resultant jacobian
@@ -222,6 +278,27 @@ public:
   bool getJacobian(const std::string &link_name, const Eigen::Vector3d &reference_point_position, Eigen::MatrixXd& jacobian,
                    bool use_quaterion_representation = false) const;
 
+  /** \brief Same as getJacobian() above, but the link is identified by its model. The joints that move the link
+   * are taken from the table precomputed by the group (see robot_model::JointModelGroup::getJacobianChain()), so no
+   * name lookups are made. If \e jacobian already has the right size, no memory is allocated.
+   */
+  bool getJacobian(const robot_model::LinkModel *link, const Eigen::Vector3d &reference_point_position, Eigen::MatrixXd& jacobian,
+                   bool use_quaternion_representation = false) const;
+
+  /** \brief Same as getJacobian() above, but the result is written to a fixed size matrix. \e DOF must be the number of
+   * variables of the group; this is available for 6 and 7 DOF groups. No memory is allocated.
+   */
+  template <int DOF>
+  bool getJacobian(const robot_model::LinkModel *link, const Eigen::Vector3d &reference_point_position, Eigen::Matrix<double, 6, DOF>& jacobian) const;
+
+  /** \brief Compute the stacked Jacobian of several points, one on each link in \e links. Rows 6*i to 6*i+5 of
+   * \e jacobian are the Jacobian of \e reference_point_positions[i] on \e links[i], as computed by getJacobian() above.
+   * The transforms of the joints are computed once and shared by all the links, which makes this cheaper than
+   * separate calls for links with common ancestors (e.g., the tips of the arms of a dual-arm group).
+   */
+  bool getJacobian(const std::vector<const robot_model::LinkModel*> &links, const EigenSTL::vector_Vector3d &reference_point_positions,
+                   Eigen::MatrixXd& jacobian) const;
+
   /** \brief Get the default IK timeout */
   double getDefaultIKTimeout() const
   {
@@ -234,6 +311,17 @@ public:
     return joint_model_group_->getDefaultIKAttempts();
   }
 
+  /** \brief Identify the validity callbacks passed to setFromIK() by this group state, for the IK memo of the group
+      (see robot_model::JointModelGroup::setIKMemo()). \e constraint_id names the callback, and \e version is the version of
+      what it checks (e.g., the planning scene); changing either makes the solutions remembered before unavailable.
+      IK queries with a validity callback only use the memo when \e constraint_id is not empty. Queries with consistency
+      limits, or that accept approximate solutions, never use the memo. */
+  void setIKMemoContext(const std::string &constraint_id, unsigned int version)
+  {
+    ik_memo_context_ = constraint_id;
+    ik_memo_version_ = version;
+  }
+
   /** \brief If the group this state corresponds to is a chain and a solver is available, then the joint values can be set by computing inverse kinematics.
       The pose is assumed to be in the reference frame of the kinematic model. Returns true on success.
       @param pose The pose the \e tip  link in the chain needs to achieve
@@ -330,6 +418,29 @@ public:
       @param constraint A state validity constraint to be required for IK solutions */
   bool setFromIK(const EigenSTL::vector_Affine3d &poses, const std::vector<std::string> &tips, const std::vector<std::vector<double> > &consistency_limits, unsigned int attempts = 0, double timeout = 0.0, const StateValidityCallbackFn &constraint = StateValidityCallbackFn(), const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
 
+  /** \brief Run \e attempts IK attempts for \e pose of \e tip and keep the best valid solution according to \e cost,
+      instead of the first one. The attempts are distributed over \e threads threads; each thread beyond the first
+      uses its own solver instance created with the solver allocator of the group (if the allocator does not create
+      distinct instances, fewer threads are used) and its own copy of the state, so \e constraint and \e cost must
+      be safe to call concurrently. The first attempt is seeded with the current values of the group, the others
+      with random values. Returns true and sets the group to the best solution if any attempt succeeded.
+      @param pose The pose \e tip needs to achieve, in the reference frame of the kinematic model
+      @param tip The name of the frame for which IK is attempted
+      @param attempts The number of IK attempts over all threads (0 for the default)
+      @param timeout The timeout passed to the kinematics solver on each attempt (0 for the default)
+      @param threads The number of threads (0 is treated as 1)
+      @param cost The cost solutions are ranked by; closestIKCost() is used if none is specified
+      @param constraint A state validity constraint to be required for IK solutions */
+  bool setFromIKRanked(const Eigen::Affine3d &pose, const std::string &tip, unsigned int attempts, double timeout, unsigned int threads,
+                       const IKCostFn &cost = IKCostFn(), const StateValidityCallbackFn &constraint = StateValidityCallbackFn(),
+                       const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
+
+  /** \brief An IKCostFn that prefers solutions close to the initial values (see distance()) */
+  static double closestIKCost(const JointStateGroup *joint_state_group, const std::vector<double> &initial_values);
+
+  /** \brief An IKCostFn that prefers solutions far from the joint limits (see getMinDistanceToBounds()) */
+  static double jointLimitsIKCost(const JointStateGroup *joint_state_group, const std::vector<double> &initial_values);
+
   /** \brief Set the joint values from a cartesian velocity applied during a time dt
    * @param twist a cartesian velocity on the 'tip' frame
    * @param tip the frame for which the twist is given
@@ -349,6 +460,19 @@ public:
   /** \brief Given a twist for a particular link (\e tip), and an optional secondary task (\e st), compute the corresponding joint velocity and store it in \e qdot */
   void computeJointVelocity(Eigen::VectorXd &qdot, const Eigen::VectorXd &twist, const std::string &tip, const SecondaryTaskFn &st = SecondaryTaskFn()) const;
 
+  /** \brief Given a twist for a link (\e tip), expressed in the frame of the link, compute the corresponding joint velocity
+      \e qdot by damped least squares: the damping grows as the Jacobian nears a singularity, and joints that move towards
+      their limits are weighted down (see DiffIKWorkspace). An optional secondary task (\e st) is projected in the null space
+      of the Jacobian. Storage in \e workspace is reused between calls, and groups of 6 or 7 variables use fixed size
+      matrices. Return false if the Jacobian of \e tip cannot be computed for this group. */
+  bool computeJointVelocity(Eigen::VectorXd &qdot, const Eigen::VectorXd &twist, const robot_model::LinkModel *tip, DiffIKWorkspace &workspace,
+                            const SecondaryTaskFn &st = SecondaryTaskFn()) const;
+
+  /** \brief Set the joint values from a cartesian velocity applied during a time dt, using the damped least-squares
+      computeJointVelocity() above. \e qdot receives the joint velocity that was applied. */
+  bool setFromDiffIK(const Eigen::VectorXd &twist, const robot_model::LinkModel *tip, double dt, DiffIKWorkspace &workspace, Eigen::VectorXd &qdot,
+                     const StateValidityCallbackFn &constraint = StateValidityCallbackFn(), const SecondaryTaskFn &st = SecondaryTaskFn());
+
   /** \brief Given the velocities for the joints in this group (\e qdot) and an amount of time (\e dt), update the current state using the Euler forward method.
       If the constraint specified is satisfied, return true, otherwise return false. */
   bool integrateJointVelocity(const Eigen::VectorXd &qdot, double dt, const StateValidityCallbackFn &constraint = StateValidityCallbackFn());
@@ -434,6 +558,33 @@ private:
   /** \brief Copy the values from another joint state group */
   void copyFrom(const JointStateGroup &other_jsg);
 
+  /** \brief Bring \e pose of \e tip to the frame of \e solver and its tip link; return false if that is not possible */
+  bool getIKQuery(const kinematics::KinematicsBaseConstPtr &solver, const Eigen::Affine3d &pose, const std::string &tip,
+                  Eigen::Affine3d &ik_query) const;
+
+  /** \brief The state shared by the threads of setFromIKRanked() */
+  struct RankedIKSearch;
+
+  /** \brief The attempts of one thread of setFromIKRanked() */
+  void rankedIKThread(RankedIKSearch *search, const kinematics::KinematicsBaseConstPtr &solver);
+
+  /** \brief Check that the Jacobian of \e link can be computed for this group and return the joints that move it */
+  const robot_model::JointModelGroup::JacobianChain* getCheckedJacobianChain(const robot_model::LinkModel *link) const;
+
+  /** \brief Get the inverse of the transform of the frame Jacobians are expressed in */
+  Eigen::Affine3d getJacobianReferenceTransformInverse() const;
+
+  /** \brief Fill the first 6 rows of \e jacobian (which needs to be zero) for the joints in \e chain;
+      return the transform of the link with respect to the reference frame of the Jacobian */
+  template <typename MatrixType>
+  Eigen::Affine3d computeJacobian(const robot_model::JointModelGroup::JacobianChain &chain, const robot_model::LinkModel *link,
+                                  const Eigen::Vector3d &reference_point_position, MatrixType &jacobian) const;
+
+  /** \brief The damped least-squares solve of computeJointVelocity() for a Jacobian with \e DOF columns (or Eigen::Dynamic) */
+  template <int DOF>
+  void solveDampedLeastSquares(Eigen::Matrix<double, 6, DOF> &jacobian, const Eigen::Matrix3d &tip_rotation, const Eigen::Matrix<double, 6, 1> &twist,
+                               Eigen::VectorXd &qdot, DiffIKWorkspace &workspace, const SecondaryTaskFn &st) const;
+
   /** \brief This function converts output from the IK plugin to the proper ordering of values expected by this group and passes it to \e constraint */
   void ikCallbackFnAdapter(const StateValidityCallbackFn &constraint, const geometry_msgs::Pose &ik_pose,
                            const std::vector<double> &ik_sol, moveit_msgs::MoveItErrorCodes &error_code);
@@ -462,6 +613,12 @@ private:
       getRandomNumberGenerator() instead. */
   boost::scoped_ptr<random_numbers::RandomNumberGenerator> rng_;
 
+  /** \brief The identity of the validity callbacks passed to setFromIK(), for the IK memo of the group (see setIKMemoContext()) */
+  std::string                             ik_memo_context_;
+
+  /** \brief The version of what the validity callbacks passed to setFromIK() check */
+  unsigned int                            ik_memo_version_;
+
 };
 }
 
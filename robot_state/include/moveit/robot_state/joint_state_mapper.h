@@ -0,0 +1,94 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_ROBOT_STATE_JOINT_STATE_MAPPER_
+#define MOVEIT_ROBOT_STATE_JOINT_STATE_MAPPER_
+
+#include <moveit/robot_state/robot_state.h>
+#include <sensor_msgs/JointState.h>
+
+namespace robot_state
+{
+
+/** \brief Apply sensor_msgs::JointState messages to a RobotState repeatedly, without temporary maps or strings.
+
+    The first time a message is applied, the order of its names is matched against the variables
+    of the state and the result is cached. As long as later messages use the same list of names
+    (and the state uses the same model), positions are copied with a single indexed loop.
+    Names that are not known to the state and mimic joints are ignored, as with
+    RobotState::setStateValues(const sensor_msgs::JointState&). */
+class JointStateMapper
+{
+public:
+
+  JointStateMapper();
+
+  /** \brief Set the positions in \e js to \e state and update the link transforms. Return false if the message
+      has fewer positions than names (the positions that are specified are still applied). */
+  bool apply(const sensor_msgs::JointState &js, RobotState &state);
+
+  /** \brief Forget the cached name ordering; it will be rebuilt on the next call to apply() */
+  void clear();
+
+private:
+
+  /** \brief A joint that receives values from the message */
+  struct Target
+  {
+    /** \brief The index of the joint in RobotState::getJointStateVector() */
+    std::size_t         joint_index;
+
+    /** \brief For each variable of the joint, the index of its position in the message (-1 if not specified) */
+    std::vector<int>    msg_index;
+
+    /** \brief Scratch space for the values of the joint */
+    std::vector<double> values;
+  };
+
+  void rebuild(const sensor_msgs::JointState &js, const RobotState &state);
+
+  /** \brief The model the cached ordering was computed for */
+  const robot_model::RobotModel *model_;
+
+  /** \brief The names of the message the cached ordering was computed for */
+  std::vector<std::string>       names_;
+
+  /** \brief The joints that receive values from messages with names_ */
+  std::vector<Target>            targets_;
+};
+
+}
+
+#endif
@@ -37,7 +37,7 @@
 #ifndef MOVEIT_ROBOT_STATE_LINK_STATE_
 #define MOVEIT_ROBOT_STATE_LINK_STATE_
 
-#include <moveit/robot_model/link_model.h>
+#include <moveit/robot_model/robot_model.h>
 #include <eigen_stl_containers/eigen_stl_containers.h>
 
 namespace robot_state
@@ -55,8 +55,9 @@ public:
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  /** @brief Constructor */
-  LinkState(RobotState *state, const robot_model::LinkModel *lm);
+  /** @brief Constructor. The global link transform and the global collision body transform are stored
+      at \e transforms[0] and \e transforms[1] respectively; this memory is owned by \e state */
+  LinkState(RobotState *state, const robot_model::LinkModel *lm, Eigen::Affine3d *transforms);
 
   ~LinkState();
 
@@ -119,13 +120,13 @@ public:
   /** @brief Get the global transform for this link */
   const Eigen::Affine3d& getGlobalLinkTransform() const
   {
-    return global_link_transform_;
+    return *global_link_transform_;
   }
 
   /** @brief Get the global transform for the collision body associated with this link */
   const Eigen::Affine3d& getGlobalCollisionBodyTransform() const
   {
-    return global_collision_body_transform_;
+    return *global_collision_body_transform_;
   }
 
 private:
@@ -142,13 +143,20 @@ private:
 
   LinkState                           *parent_link_state_;
 
+  /** \brief How computeTransform() obtains the transform of this link, and the link state it starts from (NULL for the root transform) */
+  const robot_model::RobotModel::ForwardKinematicsStep *fk_step_;
+  const LinkState                     *fk_parent_link_state_;
+
   std::map<std::string, AttachedBody*> attached_body_map_;
 
-  /** \brief The global transform this link forwards (computed by forward kinematics) */
-  Eigen::Affine3d                      global_link_transform_;
+  /** \brief The global transform this link forwards (computed by forward kinematics); points to memory owned by robot_state_ */
+  Eigen::Affine3d                     *global_link_transform_;
+
+  /** \brief The global transform for this link (computed by forward kinematics); points to memory owned by robot_state_ */
+  Eigen::Affine3d                     *global_collision_body_transform_;
 
-  /** \brief The global transform for this link (computed by forward kinematics) */
-  Eigen::Affine3d                      global_collision_body_transform_;
+  /** \brief Flag used during a forward kinematics pass to indicate the transforms of this link were recomputed */
+  bool                                 updated_;
 };
 }
 
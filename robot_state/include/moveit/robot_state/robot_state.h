@@ -49,6 +49,50 @@ namespace robot_state
 
 typedef boost::function<void(AttachedBody *body, bool attached)> AttachedBodyCallback;
 
+/** @brief A frame id resolved once against a robot model, so that RobotState::getFrameTransform() can find the frame
+ *   without string operations. The model frame and links are found in constant time. Other frames are taken to be
+ *   attached bodies, which can be attached and detached at any time, so they are still looked up by id.
+ *   A handle can be used with any state of the model it was resolved against. */
+class FrameHandle
+{
+public:
+
+  enum Type
+    {
+      UNKNOWN, MODEL_FRAME, LINK, ATTACHED_BODY
+    };
+
+  FrameHandle() : type_(UNKNOWN), link_(NULL)
+  {
+  }
+
+  /** \brief Resolve \e frame_id (a leading '/' is ignored) against \e model */
+  FrameHandle(const robot_model::RobotModel &model, const std::string &frame_id);
+
+  Type getType() const
+  {
+    return type_;
+  }
+
+  /** \brief The link the frame was resolved to, or NULL if it is not a link */
+  const robot_model::LinkModel* getLinkModel() const
+  {
+    return link_;
+  }
+
+  /** \brief The frame id, without a leading '/' */
+  const std::string& getName() const
+  {
+    return name_;
+  }
+
+private:
+
+  Type                          type_;
+  const robot_model::LinkModel *link_;
+  std::string                   name_;
+};
+
 /** @brief Definition of a kinematic state - the parts of the robot
  *   state which can change. Const members are thread safe */
 class RobotState
@@ -81,7 +125,8 @@ public:
    *  Also returns the set of joint names for which joint states have not been provided.*/
   void setStateValues(const std::map<std::string, double>& joint_state_map, std::vector<std::string>& missing);
 
-  /** @brief Set the joint state values from a joint state message */
+  /** @brief Set the joint state values from a joint state message. When applying many messages with the same
+      names (e.g., from a state monitor), JointStateMapper avoids the temporary map built here. */
   void setStateValues(const sensor_msgs::JointState& msg);
 
   /** @brief Set the joint state values for an array of variable names, given the values are specified in the same order as the names.
@@ -99,9 +144,21 @@ public:
   /** @brief Get the joint state values in a sensor_msgs::JointState msg */
   void getStateValues(sensor_msgs::JointState& msg) const;
 
-  /** \brief Perform forward kinematics with the current values and update the link transforms.*/
+  /** @brief Copy the values of the joints of group \e group from \e src, a state of the same model, and update the transforms
+   *  of the links the group moves (see robot_model::JointModelGroup::getUpdatedLinkModels()). The variable transforms of the joints
+   *  are copied from \e src in blocks (see robot_model::JointModelGroup::getJointIndexRanges()) instead of being recomputed.
+   *  This is faster than getting and setting the values of the group through JointStateGroup. */
+  bool copyGroupValues(const RobotState &src, const robot_model::JointModelGroup *group);
+
+  /** \brief Perform forward kinematics with the current values and update the link transforms.
+      Only the transforms of links that are below a joint whose value changed since the last update are recomputed. */
   void updateLinkTransforms();
 
+  /** \brief Perform forward kinematics for a subset of the links in this state. The links must be sorted in depth-first order
+      (as in the model). The transform of a link is recomputed only if the value of its parent joint changed since the last update,
+      or if the transform of its parent link was recomputed by this call. */
+  void updateLinkTransforms(const std::vector<LinkState*> &links);
+
   /** \brief Update the state after setting a particular link to the input global transform pose.*/
   bool updateStateWithLinkAt(const std::string& link_name, const Eigen::Affine3d& transform, bool backward = false);
 
@@ -153,15 +210,29 @@ public:
   /** \brief Get a joint state by its name */
   JointState* getJointState(const std::string &joint) const;
 
+  /** \brief Get the state of the joint \e jmodel. This is a constant time lookup if \e jmodel is part of the model this state was constructed from */
   JointState* getJointState(const robot_model::JointModel *jmodel) const
   {
-    // \todo make this more efficient (store index of JointState in the model)
+    // joint states are maintained in the same order as the joint models in the kinematic model
+    std::size_t index = jmodel->getTreeIndex();
+    if (index < joint_state_vector_.size() && joint_state_vector_[index]->getJointModel() == jmodel)
+      return joint_state_vector_[index];
     return getJointState(jmodel->getName());
   }
 
   /** \brief Get a link state by its name */
   LinkState* getLinkState(const std::string &link) const;
 
+  /** \brief Get the state of the link \e lmodel. This is a constant time lookup if \e lmodel is part of the model this state was constructed from */
+  LinkState* getLinkState(const robot_model::LinkModel *lmodel) const
+  {
+    // link states are maintained in the same order as the link models in the kinematic model
+    std::size_t index = lmodel->getTreeIndex();
+    if (index < link_state_vector_.size() && link_state_vector_[index]->getLinkModel() == lmodel)
+      return link_state_vector_[index];
+    return getLinkState(lmodel->getName());
+  }
+
   /** \brief Get a vector of joint state corresponding to this kinematic state */
   const std::vector<JointState*>& getJointStateVector() const
   {
@@ -229,12 +300,27 @@ public:
       Return identity when no transform is available. Use knowsFrameTransform() to test if this function will be successful or not. */
   const Eigen::Affine3d& getFrameTransform(const std::string &id) const;
 
-  /** \brief Compute the axis-aligned bounding box for this particular robot state. \e aabb will have 6 values: xmin, xmax, ymin, ymax, zmin, zmax */
+  /** \brief Get the transform corresponding to a frame resolved earlier. Same as the function above, but does not compare
+      strings unless the frame is an attached body */
+  const Eigen::Affine3d& getFrameTransform(const FrameHandle &frame) const;
+
+  /** \brief Compute the axis-aligned box bounding the collision geometry of the links and attached bodies in this state. \e aabb will have 6 values: xmin, xmax, ymin, ymax, zmin, zmax (all 0 if there is no geometry). */
   void computeAABB(std::vector<double> &aabb) const;
 
+  /** \brief Compute a sphere that bounds the collision geometry of the links and of the attached bodies, for this particular robot state.
+      This is a conservative (not minimal) bound, meant for quickly culling far away objects. */
+  void computeBoundingSphere(Eigen::Vector3d &center, double &radius) const;
+
+  /** \brief Get an estimate of the memory held by this state, in bytes: the joint, link and group states, the transforms and the
+      attached bodies (including their shapes). The robot model is shared and not counted */
+  std::size_t getMemoryUsage() const;
+
   /** \brief Check if a transform to the frame \e id is known. This will be known if \e id is a link name or an attached body id */
   bool knowsFrameTransform(const std::string &id) const;
 
+  /** \brief Check if a transform to a frame resolved earlier is known */
+  bool knowsFrameTransform(const FrameHandle &frame) const;
+
   /** \brief Print information about the constructed model */
   void printStateInfo(std::ostream &out = std::cout) const;
 
@@ -250,7 +336,8 @@ public:
   /** \brief Set the global transform applied to the entire tree of links */
   void setRootTransform(const Eigen::Affine3d &transform);
 
-  /** \brief Return the instance of a random number generator */
+  /** \brief Return the instance of a random number generator. This is the generator of the calling thread
+      if setUseThreadRandomNumberGenerators() was enabled */
   random_numbers::RandomNumberGenerator& getRandomNumberGenerator();
 
   /** @brief Get a MarkerArray that fully describes the robot markers for a given robot.
@@ -291,7 +378,9 @@ public:
 
 private:
 
+  const Eigen::Affine3d& getAttachedBodyFrameTransform(const std::string &id) const;
   void buildState();
+  void freeState();
   void copyFrom(const RobotState &ks);
   void printTransform(const std::string &st, const Eigen::Affine3d &t, std::ostream &out = std::cout) const;
   void getStateTreeJointString(std::stringstream& ss, const robot_state::JointState* js, const std::string& prefix, bool last) const;
@@ -300,6 +389,12 @@ private:
 
   robot_model::RobotModelConstPtr kinematic_model_;
 
+  /** \brief All the transforms maintained by this state, in one contiguous (aligned) block of memory: the variable transforms
+      for the joints (in the order of the joint states) followed by the global link transform and the global collision body
+      transform for each link (in the order of the link states). Joint states and link states point into this block, so copying
+      a state of the same model amounts to copying this block and the joint values. */
+  EigenSTL::vector_Affine3d               transforms_;
+
   std::vector<JointState*>                joint_state_vector_;
   std::map<std::string, JointState*>      joint_state_map_;
 
@@ -0,0 +1,99 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_ROBOT_STATE_ROBOT_STATE_POOL_
+#define MOVEIT_ROBOT_STATE_ROBOT_STATE_POOL_
+
+#include <moveit/robot_state/robot_state.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace robot_state
+{
+
+/** \brief A pool of RobotState instances for one RobotModel.
+
+    Building a RobotState allocates its complete object graph (joint states, link states, joint state groups).
+    States obtained from the pool are returned to it when their last shared pointer goes away, and are handed out
+    again later, so that code creating many temporary states (planners, trajectory builders, samplers) does not
+    rebuild that graph every time. States that outlive the pool are simply deleted. This class is thread safe. */
+class RobotStatePool
+{
+public:
+
+  /** \brief Create a pool for states of \e kinematic_model. At most \e max_free_states unused states are kept. */
+  RobotStatePool(const robot_model::RobotModelConstPtr &kinematic_model, std::size_t max_free_states = 64);
+
+  ~RobotStatePool();
+
+  /** \brief Get a state with default values and no attached bodies */
+  RobotStatePtr allocState();
+
+  /** \brief Get a state that is a copy of \e state. \e state must use the model of this pool. */
+  RobotStatePtr allocState(const RobotState &state);
+
+  /** \brief Get the model the states of this pool are built for */
+  const robot_model::RobotModelConstPtr& getRobotModel() const
+  {
+    return kinematic_model_;
+  }
+
+  /** \brief Get the number of unused states currently held by the pool */
+  std::size_t getFreeStateCount() const;
+
+private:
+
+  struct Storage
+  {
+    boost::mutex             lock_;
+    std::vector<RobotState*> free_states_;
+    std::size_t              max_free_states_;
+  };
+
+  RobotStatePtr allocStateInternal(bool set_default);
+
+  /** \brief Deleter of the shared pointers handed out by the pool */
+  static void releaseState(const boost::weak_ptr<Storage> &storage, RobotState *state);
+
+  robot_model::RobotModelConstPtr kinematic_model_;
+  boost::shared_ptr<Storage>      storage_;
+};
+
+typedef boost::shared_ptr<RobotStatePool> RobotStatePoolPtr;
+typedef boost::shared_ptr<const RobotStatePool> RobotStatePoolConstPtr;
+
+}
+
+#endif
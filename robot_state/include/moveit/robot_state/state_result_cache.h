@@ -0,0 +1,251 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_ROBOT_STATE_STATE_RESULT_CACHE_
+#define MOVEIT_ROBOT_STATE_STATE_RESULT_CACHE_
+
+#include <moveit/robot_state/robot_state.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/cstdint.hpp>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <list>
+
+namespace robot_state
+{
+
+/** \brief The hit statistics of a StateResultCache */
+struct StateResultCacheStatistics
+{
+  StateResultCacheStatistics() : hits(0), misses(0), entries(0)
+  {
+  }
+
+  std::size_t hits;    /**< \brief The number of lookups that found a result */
+  std::size_t misses;  /**< \brief The number of lookups that did not find a result */
+  std::size_t entries; /**< \brief The number of results currently stored */
+};
+
+/** \brief A bounded cache of results computed for robot states, evicting the least recently used result when full.
+
+    Results are keyed on the values of all the variables of a state, the attached bodies of the state, and a
+    caller-supplied \e context that identifies anything else the result depends on (e.g., the version of a scene).
+    Keys are hashed only to find candidate results; a result is returned only if its full key matches. When \e resolution is positive, the variable values are quantized to multiples of it, so states that differ by
+    less than the resolution may share a result; otherwise the values must match exactly. This class is thread safe. */
+template<typename Result>
+class StateResultCache
+{
+public:
+
+  /** \brief Create a cache for at most \e max_entries results */
+  StateResultCache(std::size_t max_entries, double resolution = 0.0) :
+    max_entries_(max_entries), resolution_(resolution)
+  {
+  }
+
+  /** \brief Look up the result for \e state in \e context. Returns true and sets \e result if it is stored. */
+  bool find(const RobotState &state, const std::string &context, Result &result)
+  {
+    Key key;
+    computeKey(state, context, key);
+    boost::mutex::scoped_lock slock(lock_);
+    typename Index::iterator it = index_.find(key);
+    if (it == index_.end())
+    {
+      stats_.misses++;
+      return false;
+    }
+    stats_.hits++;
+    // mark the entry as the most recently used one
+    entries_.splice(entries_.begin(), entries_, it->second);
+    result = it->second->second;
+    return true;
+  }
+
+  /** \brief Store the result for \e state in \e context */
+  void insert(const RobotState &state, const std::string &context, const Result &result)
+  {
+    if (max_entries_ == 0)
+      return;
+    Key key;
+    computeKey(state, context, key);
+    boost::mutex::scoped_lock slock(lock_);
+    typename Index::iterator it = index_.find(key);
+    if (it != index_.end())
+    {
+      it->second->second = result;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+    if (index_.size() >= max_entries_)
+    {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    entries_.push_front(std::make_pair(key, result));
+    index_.insert(std::make_pair(key, entries_.begin()));
+  }
+
+  /** \brief Remove all stored results. The statistics are kept. */
+  void clear()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    index_.clear();
+    entries_.clear();
+  }
+
+  /** \brief Get the hit statistics since the cache was created or the statistics were last reset */
+  StateResultCacheStatistics getStatistics() const
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    StateResultCacheStatistics stats = stats_;
+    stats.entries = index_.size();
+    return stats;
+  }
+
+  /** \brief Reset the hit and miss counts */
+  void resetStatistics()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    stats_ = StateResultCacheStatistics();
+  }
+
+  /** \brief Get an estimate of the memory held by the stored results and their keys, in bytes */
+  std::size_t getMemoryUsage() const
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    // each result is a list node and an index node, both holding a copy of the key
+    std::size_t bytes = sizeof(*this) + index_.bucket_count() * sizeof(void*) +
+      entries_.size() * (sizeof(typename EntryList::value_type) + sizeof(typename Index::value_type) + 4 * sizeof(void*));
+    for (typename EntryList::const_iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+      bytes += 2 * it->first.getMemoryUsage();
+    return bytes;
+  }
+
+  /** \brief Get the maximum number of results kept */
+  std::size_t getMaxEntries() const
+  {
+    return max_entries_;
+  }
+
+  /** \brief Get the resolution the variable values are quantized with (0 if they are compared exactly) */
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+private:
+
+  /* Everything a result depends on; two keys are equal only if all of it is */
+  struct Key
+  {
+    std::vector<boost::int64_t> values;   // the quantized (or bit-copied) variable values
+    std::vector<std::string>    attached; // the sorted names of the attached bodies, each followed by the name of its link
+    std::string                 context;
+
+    bool operator==(const Key &other) const
+    {
+      return values == other.values && attached == other.attached && context == other.context;
+    }
+
+    std::size_t getMemoryUsage() const
+    {
+      std::size_t bytes = values.capacity() * sizeof(boost::int64_t) + attached.capacity() * sizeof(std::string) + context.capacity();
+      for (std::size_t i = 0 ; i < attached.size() ; ++i)
+        bytes += attached[i].capacity();
+      return bytes;
+    }
+  };
+
+  struct KeyHash
+  {
+    std::size_t operator()(const Key &key) const
+    {
+      std::size_t h = boost::hash_range(key.values.begin(), key.values.end());
+      boost::hash_combine(h, boost::hash_range(key.attached.begin(), key.attached.end()));
+      boost::hash_combine(h, key.context);
+      return h;
+    }
+  };
+
+  typedef std::list<std::pair<Key, Result> > EntryList;
+  typedef boost::unordered_map<Key, typename EntryList::iterator, KeyHash> Index;
+
+  void computeKey(const RobotState &state, const std::string &context, Key &key) const
+  {
+    std::vector<double> values;
+    state.getStateValues(values);
+    key.values.resize(values.size());
+    for (std::size_t i = 0 ; i < values.size() ; ++i)
+      if (resolution_ > 0.0)
+        key.values[i] = (boost::int64_t)floor(values[i] / resolution_ + 0.5);
+      else
+      {
+        // the bits of the value; -0.0 is the same value as 0.0
+        double v = values[i] == 0.0 ? 0.0 : values[i];
+        std::memcpy(&key.values[i], &v, sizeof(v));
+      }
+
+    // the attached bodies are identified by their names and the links they are attached to
+    std::vector<const AttachedBody*> attached;
+    state.getAttachedBodies(attached);
+    std::vector<std::pair<std::string, std::string> > names(attached.size());
+    for (std::size_t i = 0 ; i < attached.size() ; ++i)
+      names[i] = std::make_pair(attached[i]->getName(), attached[i]->getAttachedLinkName());
+    std::sort(names.begin(), names.end());
+    key.attached.resize(2 * names.size());
+    for (std::size_t i = 0 ; i < names.size() ; ++i)
+    {
+      key.attached[2 * i] = names[i].first;
+      key.attached[2 * i + 1] = names[i].second;
+    }
+    key.context = context;
+  }
+
+  std::size_t                max_entries_;
+  double                     resolution_;
+
+  EntryList                  entries_; // most recently used first
+  Index                      index_;
+  StateResultCacheStatistics stats_;
+  mutable boost::mutex       lock_;
+};
+
+}
+
+#endif
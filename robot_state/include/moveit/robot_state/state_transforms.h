@@ -43,6 +43,7 @@ namespace robot_state
 {
 
 MOVEIT_CLASS_FORWARD(RobotState);
+class FrameHandle;
 
 class StateTransforms : public Transforms
 {
@@ -50,7 +51,14 @@ public:
   StateTransforms(const std::string &target_frame, const RobotStateConstPtr &state);
 
   virtual bool canTransform(const std::string &from_frame) const;
-  virtual const Eigen::Affine3d& getTransform(const std::string &from_frame) const;
+  virtual Eigen::Affine3d getTransform(const std::string &from_frame) const;
+
+  /** \brief Same as canTransform(const std::string&), for a frame resolved against the model of the state */
+  bool canTransform(const FrameHandle &frame) const;
+
+  /** \brief Same as getTransform(const std::string&), for a frame resolved against the model of the state. Frames of the
+      robot are found without string lookups. */
+  Eigen::Affine3d getTransform(const FrameHandle &frame) const;
 
 protected:
 
@@ -0,0 +1,64 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_ROBOT_STATE_THREAD_RANDOM_NUMBERS_
+#define MOVEIT_ROBOT_STATE_THREAD_RANDOM_NUMBERS_
+
+#include <random_numbers/random_numbers.h>
+#include <boost/cstdint.hpp>
+
+namespace robot_state
+{
+
+/** \brief Get the random number generator of the calling thread. The generator is allocated (and seeded from the system)
+    the first time a thread requests it, unless seedThreadRandomNumberGenerator() was called by that thread before. */
+random_numbers::RandomNumberGenerator& getThreadRandomNumberGenerator();
+
+/** \brief Replace the random number generator of the calling thread with one seeded by \e seed. This makes the random
+    samples drawn by this thread reproducible (e.g., for benchmarks), independently of other threads. */
+void seedThreadRandomNumberGenerator(boost::uint32_t seed);
+
+/** \brief When \e flag is true, RobotState::getRandomNumberGenerator() and JointStateGroup::getRandomNumberGenerator()
+    return the generator of the calling thread instead of allocating (and seeding) one per instance. This makes
+    random sampling in short-lived states cheap. Disabled by default. This can be called from any thread; a state that
+    already returned a generator keeps using it until getRandomNumberGenerator() is called again. */
+void setUseThreadRandomNumberGenerators(bool flag);
+
+/** \brief Check whether RobotState and JointStateGroup use the random number generator of the calling thread */
+bool getUseThreadRandomNumberGenerators();
+
+}
+
+#endif
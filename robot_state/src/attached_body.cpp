@@ -35,66 +35,190 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/robot_state/attached_body.h>
+#include <moveit/profiler/memory_usage.h>
+#include <geometric_shapes/shape_operations.h>
 #include <ros/console.h>
+#include <boost/atomic.hpp>
+
+namespace robot_state
+{
+  static boost::atomic<std::size_t> next_instance_id(0);
+
+  static std::size_t newInstanceID()
+  {
+    // ids only need to be distinct, so no ordering with other memory operations is required
+    return next_instance_id.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
 robot_state::AttachedBody::AttachedBody(const robot_model::LinkModel *parent_link_model,
                                         const std::string &id,
                                         const std::vector<shapes::ShapeConstPtr> &shapes,
                                         const EigenSTL::vector_Affine3d &attach_trans,
                                         const std::set<std::string> &touch_links,
                                         const sensor_msgs::JointState &detach_posture) :
-  parent_link_model_(parent_link_model),
-  id_(id),
-  shapes_(shapes),
-  attach_trans_(attach_trans),
-  touch_links_(touch_links),
-  detach_posture_(detach_posture)
+  parent_link_model_(parent_link_model), instance_id_(newInstanceID())
 {
+  Body *body = new Body();
+  body->id_ = id;
+  body->shapes_ = shapes;
+  body->attach_trans_ = attach_trans;
+  body->touch_links_ = touch_links;
+  body->detach_posture_ = detach_posture;
+  updateShapeExtents(body);
+  updateTouchLinkMask(body, parent_link_model);
+  body_.reset(body);
 	ROS_INFO_STREAM("THIS COMES FIRST FOR detach_posture_:  " << detach_posture);
   global_collision_body_transforms_.resize(attach_trans.size());
   for(std::size_t i = 0 ; i < global_collision_body_transforms_.size() ; ++i)
     global_collision_body_transforms_[i].setIdentity();
 }
 
+robot_state::AttachedBody::AttachedBody(const AttachedBody &other) :
+  parent_link_model_(other.parent_link_model_),
+  body_(other.body_),
+  global_collision_body_transforms_(other.global_collision_body_transforms_),
+  instance_id_(newInstanceID())
+{
+}
+
 robot_state::AttachedBody::~AttachedBody()
 {
 }
 
+robot_state::AttachedBody::Body* robot_state::AttachedBody::makeUnique()
+{
+  // once the definition is only owned here (and because this is a non-const function), we can safely const-cast:
+  if (!body_.unique())
+    body_.reset(new Body(*body_));
+  // the definition is about to change
+  instance_id_ = newInstanceID();
+  return const_cast<Body*>(body_.get());
+}
+
+void robot_state::AttachedBody::updateShapeExtents(Body *body)
+{
+  body->shape_extents_.resize(body->shapes_.size());
+  for (std::size_t i = 0 ; i < body->shapes_.size() ; ++i)
+    body->shape_extents_[i] = shapes::computeShapeExtents(body->shapes_[i].get());
+}
+
+void robot_state::AttachedBody::updateTouchLinkMask(Body *body, const robot_model::LinkModel *link)
+{
+  body->touch_link_mask_.clear();
+  if (body->touch_links_.empty() || !link)
+    return;
+
+  // the links of the model are reached from the root of the tree
+  while (link->getParentJointModel() && link->getParentJointModel()->getParentLinkModel())
+    link = link->getParentJointModel()->getParentLinkModel();
+  std::vector<const robot_model::LinkModel*> stack(1, link);
+  while (!stack.empty())
+  {
+    const robot_model::LinkModel *l = stack.back();
+    stack.pop_back();
+    if (body->touch_links_.find(l->getName()) != body->touch_links_.end())
+    {
+      std::size_t index = l->getTreeIndex();
+      if (index >= body->touch_link_mask_.size())
+        body->touch_link_mask_.resize(index + 1, false);
+      body->touch_link_mask_[index] = true;
+    }
+    const std::vector<robot_model::JointModel*> &joints = l->getChildJointModels();
+    for (std::size_t i = 0 ; i < joints.size() ; ++i)
+      if (joints[i]->getChildLinkModel())
+        stack.push_back(joints[i]->getChildLinkModel());
+  }
+}
+
 void robot_state::AttachedBody::setScale(double scale)
 {
-  for (std::size_t i = 0 ; i < shapes_.size() ; ++i)
+  Body *body = makeUnique();
+  std::vector<shapes::ShapeConstPtr> &body_shapes = body->shapes_;
+  for (std::size_t i = 0 ; i < body_shapes.size() ; ++i)
   {
     // if this shape is only owned here (and because this is a non-const function), we can safely const-cast:
-    if (shapes_[i].unique())
-      const_cast<shapes::Shape*>(shapes_[i].get())->scale(scale);
+    if (body_shapes[i].unique())
+      const_cast<shapes::Shape*>(body_shapes[i].get())->scale(scale);
     else
     {
       // if the shape is owned elsewhere, we make a copy:
-      shapes::Shape *copy = shapes_[i]->clone();
+      shapes::Shape *copy = body_shapes[i]->clone();
       copy->scale(scale);
-      shapes_[i].reset(copy);
+      body_shapes[i].reset(copy);
     }
   }
+  updateShapeExtents(body);
 }
 
 void robot_state::AttachedBody::setPadding(double padding)
 {
-  for (std::size_t i = 0 ; i < shapes_.size() ; ++i)
+  Body *body = makeUnique();
+  std::vector<shapes::ShapeConstPtr> &body_shapes = body->shapes_;
+  for (std::size_t i = 0 ; i < body_shapes.size() ; ++i)
   {
     // if this shape is only owned here (and because this is a non-const function), we can safely const-cast:
-    if (shapes_[i].unique())
-      const_cast<shapes::Shape*>(shapes_[i].get())->padd(padding);
+    if (body_shapes[i].unique())
+      const_cast<shapes::Shape*>(body_shapes[i].get())->padd(padding);
     else
     {
       // if the shape is owned elsewhere, we make a copy:
-      shapes::Shape *copy = shapes_[i]->clone();
+      shapes::Shape *copy = body_shapes[i]->clone();
       copy->padd(padding);
-      shapes_[i].reset(copy);
+      body_shapes[i].reset(copy);
     }
   }
+  updateShapeExtents(body);
 }
 
 void robot_state::AttachedBody::computeTransform(const Eigen::Affine3d &parent_link_global_transform)
 {
   for(std::size_t i = 0; i < global_collision_body_transforms_.size() ; ++i)
-    global_collision_body_transforms_[i] = parent_link_global_transform * attach_trans_[i];
+    global_collision_body_transforms_[i] = parent_link_global_transform * body_->attach_trans_[i];
+}
+
+std::size_t robot_state::AttachedBody::getMemoryUsage() const
+{
+  std::size_t bytes = sizeof(*this) + global_collision_body_transforms_.capacity() * sizeof(Eigen::Affine3d) +
+    sizeof(Body) + body_->id_.capacity() + body_->shapes_.capacity() * sizeof(shapes::ShapeConstPtr) +
+    body_->shape_extents_.capacity() * sizeof(Eigen::Vector3d) + body_->attach_trans_.capacity() * sizeof(Eigen::Affine3d) +
+    body_->touch_link_mask_.capacity() / 8 + body_->detach_posture_.position.capacity() * sizeof(double);
+  for (std::set<std::string>::const_iterator it = body_->touch_links_.begin() ; it != body_->touch_links_.end() ; ++it)
+    bytes += moveit::tools::estimateSetNodeBytes<std::string>() + it->capacity();
+  for (std::size_t i = 0 ; i < body_->shapes_.size() ; ++i)
+    if (body_->shapes_[i])
+      bytes += getShapeMemoryUsage(*body_->shapes_[i]);
+  return bytes;
+}
+
+std::size_t robot_state::getShapeMemoryUsage(const shapes::Shape &shape)
+{
+  switch (shape.type)
+  {
+  case shapes::MESH:
+    {
+      const shapes::Mesh &mesh = static_cast<const shapes::Mesh&>(shape);
+      std::size_t bytes = sizeof(shapes::Mesh) + mesh.vertex_count * 3 * sizeof(double) + mesh.triangle_count * 3 * sizeof(unsigned int);
+      if (mesh.normals)
+        bytes += mesh.triangle_count * 3 * sizeof(double);
+      return bytes;
+    }
+  case shapes::OCTREE:
+    {
+      const shapes::OcTree &tree = static_cast<const shapes::OcTree&>(shape);
+      return sizeof(shapes::OcTree) + (tree.octree ? tree.octree->memoryUsage() : 0);
+    }
+  case shapes::SPHERE:
+    return sizeof(shapes::Sphere);
+  case shapes::CYLINDER:
+    return sizeof(shapes::Cylinder);
+  case shapes::CONE:
+    return sizeof(shapes::Cone);
+  case shapes::BOX:
+    return sizeof(shapes::Box);
+  case shapes::PLANE:
+    return sizeof(shapes::Plane);
+  default:
+    return sizeof(shapes::Shape);
+  }
 }
@@ -0,0 +1,384 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/robot_state/cartesian_path.h>
+#include <moveit/profiler/query_counters.h>
+#include <boost/bind.hpp>
+
+namespace robot_state
+{
+namespace
+{
+// IK solution callback that checks the solution with a StateValidityCallbackFn, like JointStateGroup::setFromIK() does
+void checkIKSolution(JointStateGroup *jsg, const StateValidityCallbackFn &constraint, std::vector<double> &solution,
+                     const geometry_msgs::Pose &, const std::vector<double> &ik_sol, moveit_msgs::MoveItErrorCodes &error_code)
+{
+  const std::vector<unsigned int> &bij = jsg->getJointModelGroup()->getKinematicsSolverJointBijection();
+  solution.resize(bij.size());
+  for (std::size_t i = 0 ; i < bij.size() ; ++i)
+    solution[i] = ik_sol[bij[i]];
+  error_code.val = constraint(jsg, solution) ? moveit_msgs::MoveItErrorCodes::SUCCESS : moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+}
+
+// the distance used to compare poses: translation plus rotation angle
+double poseDistance(const Eigen::Affine3d &a, const Eigen::Affine3d &b)
+{
+  return (a.translation() - b.translation()).norm() + Eigen::AngleAxisd(a.rotation().transpose() * b.rotation()).angle();
+}
+}
+}
+
+robot_state::CartesianPathGenerator::CartesianPathGenerator() :
+  jacobian_step_(0.0), jacobian_tolerance_(1e-4), max_joint_step_(0.0), min_step_(1e-3), point_count_(0), variable_count_(0), ik_calls_(0), jacobian_steps_(0), link_state_(NULL)
+{
+}
+
+void robot_state::CartesianPathGenerator::setToPoint(std::size_t index, JointStateGroup *jsg) const
+{
+  std::vector<double> values(getPoint(index), getPoint(index) + variable_count_);
+  jsg->setVariableValues(values);
+}
+
+void robot_state::CartesianPathGenerator::getStates(const RobotState &reference, std::vector<RobotStatePtr> &traj) const
+{
+  traj.resize(point_count_);
+  for (std::size_t i = 0 ; i < point_count_ ; ++i)
+  {
+    traj[i].reset(new RobotState(reference));
+    setToPoint(i, traj[i]->getJointStateGroup(group_name_));
+  }
+}
+
+void robot_state::CartesianPathGenerator::appendPoint(const JointStateGroup *jsg)
+{
+  if (points_.size() < (point_count_ + 1) * variable_count_)
+    points_.resize(std::max(points_.size() * 2, (point_count_ + 1) * variable_count_));
+  jsg->getVariableValues(values_);
+  std::copy(values_.begin(), values_.end(), points_.begin() + point_count_ * variable_count_);
+  ++point_count_;
+}
+
+bool robot_state::CartesianPathGenerator::setup(JointStateGroup *jsg, const std::string &link_name, const StateValidityCallbackFn &validCallback)
+{
+  point_count_ = 0;
+  ik_calls_ = 0;
+  jacobian_steps_ = 0;
+  group_name_ = jsg->getName();
+  variable_count_ = jsg->getVariableCount();
+  link_name_ = link_name;
+  link_state_ = jsg->getRobotState()->getLinkState(link_name);
+  solver_ = jsg->getJointModelGroup()->acquireSolverInstance();
+  ik_callback_ = kinematics::KinematicsBase::IKCallbackFn();
+  if (!link_state_)
+    return false;
+
+  if (solver_)
+  {
+    // bring poses to the frame of the IK solver; this assumes the base of the solver is not moved by the group
+    ik_base_inverse_ = Eigen::Affine3d::Identity();
+    const std::string &ik_frame = solver_->getBaseFrame();
+    if (ik_frame != jsg->getJointModelGroup()->getParentModel()->getModelFrame())
+    {
+      const LinkState *ls = jsg->getRobotState()->getLinkState(ik_frame);
+      if (!ls)
+        return false;
+      ik_base_inverse_ = ls->getGlobalLinkTransform().inverse();
+    }
+
+    // see if the link can be transformed via fixed transforms to the tip frame known to the IK solver
+    tip_offset_ = Eigen::Affine3d::Identity();
+    const std::string &tip_frame = solver_->getTipFrame();
+    if (link_name != tip_frame)
+    {
+      const robot_model::LinkModel::AssociatedFixedTransformMap &fixed_links = link_state_->getLinkModel()->getAssociatedFixedTransforms();
+      robot_model::LinkModel::AssociatedFixedTransformMap::const_iterator it = fixed_links.begin();
+      for ( ; it != fixed_links.end() ; ++it)
+        if (it->first->getName() == tip_frame)
+        {
+          tip_offset_ = it->second;
+          break;
+        }
+      if (it == fixed_links.end())
+      {
+        logError("Cannot compute IK for tip reference frame '%s'", link_name.c_str());
+        solver_.reset();
+      }
+    }
+    if (solver_ && validCallback)
+      ik_callback_ = boost::bind(&checkIKSolution, jsg, boost::cref(validCallback), boost::ref(solution_), _1, _2, _3);
+  }
+
+  if (!solver_ && jacobian_step_ <= 0.0)
+  {
+    logError("No kinematics solver instantiated for group '%s'", group_name_.c_str());
+    return false;
+  }
+
+  // make sure that continuous joints wrap
+  const std::vector<JointState*> &joints = jsg->getJointStateVector();
+  const std::vector<bool> &continuous = jsg->getJointModelGroup()->getContinuousJointFlags();
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+    if (continuous[i])
+      joints[i]->enforceBounds();
+  jsg->updateLinkTransforms();
+
+  appendPoint(jsg);
+  return true;
+}
+
+double robot_state::CartesianPathGenerator::computeCartesianPath(JointStateGroup *jsg, const std::string &link_name, const Eigen::Affine3d &target,
+                                                                 bool global_reference_frame, double max_step, double jump_threshold,
+                                                                 const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options)
+{
+  double percentage_solved = setup(jsg, link_name, validCallback) ?
+    computeSegment(jsg, global_reference_frame ? target : link_state_->getGlobalLinkTransform() * target, max_step, jump_threshold, validCallback, options) : 0.0;
+
+  // give the IK solver back to the pool of the group
+  solver_.reset();
+  return percentage_solved;
+}
+
+double robot_state::CartesianPathGenerator::computeCartesianPath(JointStateGroup *jsg, const std::string &link_name, const EigenSTL::vector_Affine3d &waypoints,
+                                                                 bool global_reference_frame, double max_step, double jump_threshold,
+                                                                 const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options)
+{
+  double percentage_solved = 0.0;
+  bool ready = setup(jsg, link_name, validCallback);
+  for (std::size_t i = 0 ; ready && i < waypoints.size() ; ++i)
+  {
+    // each segment starts from the last point of the previous one
+    const Eigen::Affine3d target = global_reference_frame ? waypoints[i] : link_state_->getGlobalLinkTransform() * waypoints[i];
+    double wp_percentage_solved = computeSegment(jsg, target, max_step, jump_threshold, validCallback, options);
+    if (fabs(wp_percentage_solved - 1.0) < std::numeric_limits<double>::epsilon())
+      percentage_solved = (double)(i + 1) / (double)waypoints.size();
+    else
+    {
+      percentage_solved += wp_percentage_solved / (double)waypoints.size();
+      break;
+    }
+  }
+
+  solver_.reset();
+  return percentage_solved;
+}
+
+double robot_state::CartesianPathGenerator::computeSegment(JointStateGroup *jsg, const Eigen::Affine3d &target, double max_step, double jump_threshold,
+                                                           const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options)
+{
+  const Eigen::Affine3d start_pose = link_state_->getGlobalLinkTransform();
+  const std::size_t first_point = point_count_ - 1;
+  bool test_joint_space_jump = jump_threshold > 0.0;
+
+  // fractions_[i] is the fraction of the segment at point first_point + i
+  fractions_.assign(1, 0.0);
+  double last_valid_percentage = max_joint_step_ > 0.0 ?
+    takeAdaptiveSteps(jsg, start_pose, target, max_step, validCallback, options) :
+    takeFixedSteps(jsg, start_pose, target, max_step, test_joint_space_jump, validCallback, options);
+
+  if (test_joint_space_jump && point_count_ > first_point + 1)
+  {
+    // compute the distances (infinity norm) between consecutive points and their average
+    std::vector<double> dist_vector(point_count_ - first_point - 1);
+    double total_dist = 0.0;
+    for (std::size_t i = 0 ; i < dist_vector.size() ; ++i)
+    {
+      dist_vector[i] = jointDistance(jsg->getJointModelGroup(), getPoint(first_point + i), getPoint(first_point + i + 1));
+      total_dist += dist_vector[i];
+    }
+
+    double thres = jump_threshold * (total_dist / (double)dist_vector.size());
+    for (std::size_t i = 0 ; i < dist_vector.size() ; ++i)
+      if (dist_vector[i] > thres)
+      {
+        logDebug("Truncating Cartesian path due to detected jump in joint-space distance");
+        last_valid_percentage = fractions_[i];
+        point_count_ = first_point + i + 1;
+        break;
+      }
+  }
+
+  // leave the group at the last point of the path
+  setToPoint(point_count_ - 1, jsg);
+  return last_valid_percentage;
+}
+
+double robot_state::CartesianPathGenerator::takeFixedSteps(JointStateGroup *jsg, const Eigen::Affine3d &start_pose, const Eigen::Affine3d &target,
+                                                           double max_step, bool test_joint_space_jump,
+                                                           const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options)
+{
+  // decide how many steps we will need for this segment
+  double distance = (target.translation() - start_pose.translation()).norm();
+  unsigned int steps = (test_joint_space_jump ? 5 : 1) + (unsigned int)floor(distance / max_step);
+
+  Eigen::Quaterniond start_quaternion(start_pose.rotation());
+  Eigen::Quaterniond target_quaternion(target.rotation());
+  Eigen::Affine3d previous_pose = start_pose;
+  double last_valid_percentage = 0.0;
+  for (unsigned int i = 1 ; i <= steps ; ++i)
+  {
+    double percentage = (double)i / (double)steps;
+    Eigen::Affine3d pose(start_quaternion.slerp(percentage, target_quaternion));
+    pose.translation() = percentage * target.translation() + (1 - percentage) * start_pose.translation();
+    if (!takeStep(jsg, previous_pose, pose, validCallback, options))
+      break;
+    appendPoint(jsg);
+    fractions_.push_back(percentage);
+    previous_pose = pose;
+    last_valid_percentage = percentage;
+  }
+  return last_valid_percentage;
+}
+
+double robot_state::CartesianPathGenerator::takeAdaptiveSteps(JointStateGroup *jsg, const Eigen::Affine3d &start_pose, const Eigen::Affine3d &target,
+                                                              double max_step, const StateValidityCallbackFn &validCallback,
+                                                              const kinematics::KinematicsQueryOptions &options)
+{
+  // the step sizes, as fractions of the segment
+  double length = poseDistance(start_pose, target);
+  double max_fraction = length > std::numeric_limits<double>::epsilon() ? std::min(1.0, max_step / length) : 1.0;
+  double min_fraction = length > std::numeric_limits<double>::epsilon() ? std::min(max_fraction, min_step_ / length) : 1.0;
+
+  Eigen::Quaterniond start_quaternion(start_pose.rotation());
+  Eigen::Quaterniond target_quaternion(target.rotation());
+  Eigen::Affine3d previous_pose = start_pose;
+  double fraction = max_fraction;
+  double done = 0.0;
+  while (done < 1.0)
+  {
+    double percentage = std::min(1.0, done + fraction);
+    Eigen::Affine3d pose(start_quaternion.slerp(percentage, target_quaternion));
+    pose.translation() = percentage * target.translation() + (1 - percentage) * start_pose.translation();
+
+    jsg->getVariableValues(previous_values_);
+    bool ok = takeStep(jsg, previous_pose, pose, validCallback, options);
+    double d = 0.0;
+    if (ok)
+    {
+      jsg->getVariableValues(values_);
+      d = jointDistance(jsg->getJointModelGroup(), &previous_values_[0], &values_[0]);
+    }
+    if (ok && d <= max_joint_step_)
+    {
+      appendPoint(jsg);
+      fractions_.push_back(percentage);
+      previous_pose = pose;
+      done = percentage;
+      if (d < 0.5 * max_joint_step_)
+        fraction = std::min(max_fraction, 2.0 * fraction);
+      continue;
+    }
+
+    // undo the step and retry with a smaller one
+    if (ok)
+      jsg->setVariableValues(previous_values_);
+    if (fraction <= min_fraction)
+    {
+      if (ok)
+        logDebug("Stopping Cartesian path due to a jump in joint-space distance");
+      break;
+    }
+    fraction = std::max(min_fraction, 0.5 * fraction);
+  }
+  return done;
+}
+
+bool robot_state::CartesianPathGenerator::takeStep(JointStateGroup *jsg, const Eigen::Affine3d &previous_pose, const Eigen::Affine3d &pose,
+                                                   const StateValidityCallbackFn &validCallback, const kinematics::KinematicsQueryOptions &options)
+{
+  if (jacobian_step_ > 0.0 && poseDistance(previous_pose, pose) <= jacobian_step_ && takeJacobianStep(jsg, pose, validCallback))
+    return true;
+  return solver_ && callIK(jsg, pose, options);
+}
+
+double robot_state::CartesianPathGenerator::jointDistance(const robot_model::JointModelGroup *jmg, const double *a, const double *b)
+{
+  const std::vector<const robot_model::JointModel*> &jnt = jmg->getJointModels();
+  double distance = 0.0;
+  for (std::size_t k = 0 ; k < jnt.size() ; ++k)
+  {
+    std::size_t vc = jnt[k]->getVariableCount();
+    joint_a_.assign(a, a + vc);
+    joint_b_.assign(b, b + vc);
+    distance = std::max(distance, jnt[k]->distance(joint_a_, joint_b_));
+    a += vc;
+    b += vc;
+  }
+  return distance;
+}
+
+bool robot_state::CartesianPathGenerator::takeJacobianStep(JointStateGroup *jsg, const Eigen::Affine3d &pose, const StateValidityCallbackFn &validCallback)
+{
+  // the twist that brings the link to the pose in unit time, in the frame of the link (see JointStateGroup::computeJointVelocity())
+  const Eigen::Affine3d current = link_state_->getGlobalLinkTransform();
+  Eigen::AngleAxisd rotation(current.rotation().transpose() * pose.rotation());
+  twist_.resize(6);
+  twist_.head<3>() = current.rotation().transpose() * (pose.translation() - current.translation());
+  twist_.tail<3>() = rotation.angle() * rotation.axis();
+
+  jsg->getVariableValues(seed_);
+  jsg->computeJointVelocity(qdot_, twist_, link_name_);
+  jsg->integrateJointVelocity(qdot_, 1.0);
+  if (poseDistance(link_state_->getGlobalLinkTransform(), pose) <= jacobian_tolerance_)
+  {
+    jsg->getVariableValues(values_);
+    if (!validCallback || validCallback(jsg, values_))
+    {
+      ++jacobian_steps_;
+      return true;
+    }
+  }
+  jsg->setVariableValues(seed_);
+  return false;
+}
+
+bool robot_state::CartesianPathGenerator::callIK(JointStateGroup *jsg, const Eigen::Affine3d &pose, const kinematics::KinematicsQueryOptions &options)
+{
+  // seed with the current values of the group (the previous point)
+  const std::vector<unsigned int> &bij = jsg->getJointModelGroup()->getKinematicsSolverJointBijection();
+  jsg->getVariableValues(values_);
+  ik_seed_.resize(bij.size());
+  for (std::size_t i = 0 ; i < bij.size() ; ++i)
+    ik_seed_[bij[i]] = values_[i];
+
+  ++ik_calls_;
+  moveit::tools::QueryCounters::count(moveit::tools::IK_CALLS);
+  moveit_msgs::MoveItErrorCodes error;
+  if (!solver_->searchPositionIK(ik_base_inverse_ * pose * tip_offset_, ik_seed_, jsg->getDefaultIKTimeout(), ik_solution_, ik_callback_, error, options))
+    return false;
+
+  for (std::size_t i = 0 ; i < bij.size() ; ++i)
+    values_[i] = ik_solution_[bij[i]];
+  jsg->setVariableValues(values_);
+  return true;
+}
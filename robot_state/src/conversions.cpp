@@ -37,6 +37,7 @@
 #include <moveit/robot_state/conversions.h>
 #include <geometric_shapes/shape_operations.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <ros/serialization.h>
 
 namespace robot_state
 {
@@ -234,101 +235,119 @@ static void attachedBodyToMsg(const AttachedBody &attached_body, moveit_msgs::At
   }
 }
 
-static void msgToAttachedBody(const Transforms *tf, const moveit_msgs::AttachedCollisionObject &aco, RobotState& state)
+static bool checkCollisionObjectMsg(const moveit_msgs::CollisionObject &object)
 {
-  if (aco.object.operation == moveit_msgs::CollisionObject::ADD)
+  if (object.primitives.size() != object.primitive_poses.size())
   {
-    if (!aco.object.primitives.empty() || !aco.object.meshes.empty() || !aco.object.planes.empty())
+    logError("Number of primitive shapes does not match number of poses in collision object message");
+    return false;
+  }
+
+  if (object.meshes.size() != object.mesh_poses.size())
+  {
+    logError("Number of meshes does not match number of poses in collision object message");
+    return false;
+  }
+
+  if (object.planes.size() != object.plane_poses.size())
+  {
+    logError("Number of planes does not match number of poses in collision object message");
+    return false;
+  }
+  return true;
+}
+
+// the shapes of a collision object and their poses, in the frame of the object's header
+static void constructShapesFromMsg(const moveit_msgs::CollisionObject &object, std::vector<shapes::ShapeConstPtr> &shapes, EigenSTL::vector_Affine3d &poses)
+{
+  for (std::size_t i = 0 ; i < object.primitives.size() ; ++i)
+  {
+    shapes::Shape *s = shapes::constructShapeFromMsg(object.primitives[i]);
+    if (s)
     {
-      if (aco.object.primitives.size() != aco.object.primitive_poses.size())
-      {
-        logError("Number of primitive shapes does not match number of poses in collision object message");
-        return;
-      }
+      Eigen::Affine3d p;
+      tf::poseMsgToEigen(object.primitive_poses[i], p);
+      shapes.push_back(shapes::ShapeConstPtr(s));
+      poses.push_back(p);
+    }
+  }
+  for (std::size_t i = 0 ; i < object.meshes.size() ; ++i)
+  {
+    shapes::Shape *s = shapes::constructShapeFromMsg(object.meshes[i]);
+    if (s)
+    {
+      Eigen::Affine3d p;
+      tf::poseMsgToEigen(object.mesh_poses[i], p);
+      shapes.push_back(shapes::ShapeConstPtr(s));
+      poses.push_back(p);
+    }
+  }
+  for (std::size_t i = 0 ; i < object.planes.size() ; ++i)
+  {
+    shapes::Shape *s = shapes::constructShapeFromMsg(object.planes[i]);
+    if (s)
+    {
+      Eigen::Affine3d p;
+      tf::poseMsgToEigen(object.plane_poses[i], p);
 
-      if (aco.object.meshes.size() != aco.object.mesh_poses.size())
+      shapes.push_back(shapes::ShapeConstPtr(s));
+      poses.push_back(p);
+    }
+  }
+}
+
+// attach shapes with poses in the frame of the object's header to the link named in \e aco
+static void attachShapes(const Transforms *tf, const moveit_msgs::AttachedCollisionObject &aco, const LinkState *ls,
+                         const std::vector<shapes::ShapeConstPtr> &shapes, EigenSTL::vector_Affine3d poses, RobotState& state)
+{
+  // transform poses to link frame
+  if (aco.object.header.frame_id != aco.link_name)
+  {
+    Eigen::Affine3d t0;
+    if (state.knowsFrameTransform(aco.object.header.frame_id))
+      t0 = state.getFrameTransform(aco.object.header.frame_id);
+    else
+      if (tf && tf->canTransform(aco.object.header.frame_id))
+        t0 = tf->getTransform(aco.object.header.frame_id);
+      else
       {
-        logError("Number of meshes does not match number of poses in collision object message");
-        return;
+        t0.setIdentity();
+        logError("Cannot properly transform from frame '%s'. The pose of the attached body may be incorrect", aco.object.header.frame_id.c_str());
       }
+    Eigen::Affine3d t = ls->getGlobalLinkTransform().inverse() * t0;
+    for (std::size_t i = 0 ; i < poses.size() ; ++i)
+      poses[i] = t * poses[i];
+  }
 
-      if (aco.object.planes.size() != aco.object.plane_poses.size())
-      {
-        logError("Number of planes does not match number of poses in collision object message");
+  if (shapes.empty())
+    logError("There is no geometry to attach to link '%s' as part of attached body '%s'", aco.link_name.c_str(), aco.object.id.c_str());
+  else
+  {
+    if (state.clearAttachedBody(aco.object.id))
+      logInform("The robot state already had an object named '%s' attached to link '%s'. The object was replaced.",
+                aco.object.id.c_str(), aco.link_name.c_str());
+    std::set<std::string> touch_links(aco.touch_links.begin(), aco.touch_links.end());
+    state.attachBody(aco.object.id, shapes, poses, touch_links, aco.link_name, aco.detach_posture);
+    logDebug("Attached object '%s' to link '%s'", aco.object.id.c_str(), aco.link_name.c_str());
+  }
+}
+
+static void msgToAttachedBody(const Transforms *tf, const moveit_msgs::AttachedCollisionObject &aco, RobotState& state)
+{
+  if (aco.object.operation == moveit_msgs::CollisionObject::ADD)
+  {
+    if (!aco.object.primitives.empty() || !aco.object.meshes.empty() || !aco.object.planes.empty())
+    {
+      if (!checkCollisionObjectMsg(aco.object))
         return;
-      }
 
       LinkState *ls = state.getLinkState(aco.link_name);
       if (ls)
       {
         std::vector<shapes::ShapeConstPtr> shapes;
         EigenSTL::vector_Affine3d poses;
-
-        for (std::size_t i = 0 ; i < aco.object.primitives.size() ; ++i)
-        {
-          shapes::Shape *s = shapes::constructShapeFromMsg(aco.object.primitives[i]);
-          if (s)
-          {
-            Eigen::Affine3d p;
-            tf::poseMsgToEigen(aco.object.primitive_poses[i], p);
-            shapes.push_back(shapes::ShapeConstPtr(s));
-            poses.push_back(p);
-          }
-        }
-        for (std::size_t i = 0 ; i < aco.object.meshes.size() ; ++i)
-        {
-          shapes::Shape *s = shapes::constructShapeFromMsg(aco.object.meshes[i]);
-          if (s)
-          {
-            Eigen::Affine3d p;
-            tf::poseMsgToEigen(aco.object.mesh_poses[i], p);
-            shapes.push_back(shapes::ShapeConstPtr(s));
-            poses.push_back(p);
-          }
-        }
-        for (std::size_t i = 0 ; i < aco.object.planes.size() ; ++i)
-        {
-          shapes::Shape *s = shapes::constructShapeFromMsg(aco.object.planes[i]);
-          if (s)
-          {
-            Eigen::Affine3d p;
-            tf::poseMsgToEigen(aco.object.plane_poses[i], p);
-
-            shapes.push_back(shapes::ShapeConstPtr(s));
-            poses.push_back(p);
-          }
-        }
-
-        // transform poses to link frame
-        if (aco.object.header.frame_id != aco.link_name)
-        {
-          Eigen::Affine3d t0;
-          if (state.knowsFrameTransform(aco.object.header.frame_id))
-            t0 = state.getFrameTransform(aco.object.header.frame_id);
-          else
-            if (tf && tf->canTransform(aco.object.header.frame_id))
-              t0 = tf->getTransform(aco.object.header.frame_id);
-            else
-            {
-              t0.setIdentity();
-              logError("Cannot properly transform from frame '%s'. The pose of the attached body may be incorrect", aco.object.header.frame_id.c_str());
-            }
-          Eigen::Affine3d t = ls->getGlobalLinkTransform().inverse() * t0;
-          for (std::size_t i = 0 ; i < poses.size() ; ++i)
-            poses[i] = t * poses[i];
-        }
-
-        if (shapes.empty())
-          logError("There is no geometry to attach to link '%s' as part of attached body '%s'", aco.link_name.c_str(), aco.object.id.c_str());
-        else
-        {
-          if (state.clearAttachedBody(aco.object.id))
-            logInform("The robot state already had an object named '%s' attached to link '%s'. The object was replaced.",
-                      aco.object.id.c_str(), aco.link_name.c_str());
-          std::set<std::string> touch_links(aco.touch_links.begin(), aco.touch_links.end());
-          state.attachBody(aco.object.id, shapes, poses, touch_links, aco.link_name, aco.detach_posture);
-          logDebug("Attached object '%s' to link '%s'", aco.object.id.c_str(), aco.link_name.c_str());
-        }
+        constructShapesFromMsg(aco.object, shapes, poses);
+        attachShapes(tf, aco, ls, shapes, poses, state);
       }
     }
     else
@@ -343,6 +362,23 @@ static void msgToAttachedBody(const Transforms *tf, const moveit_msgs::AttachedC
       logError("Unknown collision object operation: %d", aco.object.operation);
 }
 
+// check that the variables missing from the joint state are all set by the multi-dof joint state
+static bool coveredByMultiDOFJoints(std::set<std::string> &missing, const moveit_msgs::MultiDOFJointState &mjs, const RobotState& state)
+{
+  if (!missing.empty())
+    for (unsigned int i = 0 ; i < mjs.joint_names.size(); ++i)
+    {
+      const robot_model::JointModel *jm = state.getRobotModel()->getJointModel(mjs.joint_names[i]);
+      if (jm)
+      {
+        const std::vector<std::string> &vnames = jm->getVariableNames();
+        for (std::size_t i = 0 ; i < vnames.size(); ++i)
+          missing.erase(vnames[i]);
+      }
+    }
+  return missing.empty();
+}
+
 static bool robotStateMsgToRobotStateHelper(const Transforms *tf, const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies)
 {
   std::set<std::string> missing;
@@ -357,24 +393,7 @@ static bool robotStateMsgToRobotStateHelper(const Transforms *tf, const moveit_m
     state.updateLinkTransforms();
   }
 
-  if (result1 && result2)
-  {
-    if (!missing.empty())
-      for (unsigned int i = 0 ; i < robot_state.multi_dof_joint_state.joint_names.size(); ++i)
-      {
-        const robot_model::JointModel *jm = state.getRobotModel()->getJointModel(robot_state.multi_dof_joint_state.joint_names[i]);
-        if (jm)
-        {
-          const std::vector<std::string> &vnames = jm->getVariableNames();
-          for (std::size_t i = 0 ; i < vnames.size(); ++i)
-            missing.erase(vnames[i]);
-        }
-      }
-
-    return missing.empty();
-  }
-  else
-    return false;
+  return result1 && result2 && coveredByMultiDOFJoints(missing, robot_state.multi_dof_joint_state, state);
 }
 
 }
@@ -440,3 +459,208 @@ void robot_state::robotStateToJointStateMsg(const RobotState& state, sensor_msgs
 
   joint_state.header.frame_id = state.getRobotModel()->getModelFrame();
 }
+
+// ********************************************
+// * Caching converter
+// ********************************************
+
+namespace
+{
+
+// the serialized geometry of a collision object; the shapes constructed from two objects with equal geometry are the same
+static void serializeGeometry(const moveit_msgs::CollisionObject &object, std::vector<boost::uint8_t> &geometry)
+{
+  namespace ser = ros::serialization;
+  geometry.resize(ser::serializationLength(object.primitives) + ser::serializationLength(object.primitive_poses) +
+                  ser::serializationLength(object.meshes) + ser::serializationLength(object.mesh_poses) +
+                  ser::serializationLength(object.planes) + ser::serializationLength(object.plane_poses));
+  ser::OStream stream(&geometry[0], geometry.size());
+  ser::serialize(stream, object.primitives);
+  ser::serialize(stream, object.primitive_poses);
+  ser::serialize(stream, object.meshes);
+  ser::serialize(stream, object.mesh_poses);
+  ser::serialize(stream, object.planes);
+  ser::serialize(stream, object.plane_poses);
+}
+
+}
+
+robot_state::RobotStateMsgConverter::RobotStateMsgConverter(std::size_t max_layouts, std::size_t max_bodies) :
+  max_layouts_(max_layouts),
+  max_bodies_(max_bodies)
+{
+}
+
+bool robot_state::RobotStateMsgConverter::convert(const Transforms &tf, const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies)
+{
+  return convertHelper(&tf, robot_state, state, copy_attached_bodies);
+}
+
+bool robot_state::RobotStateMsgConverter::convert(const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies)
+{
+  return convertHelper(NULL, robot_state, state, copy_attached_bodies);
+}
+
+void robot_state::RobotStateMsgConverter::clear()
+{
+  layouts_.clear();
+  bodies_.clear();
+}
+
+const robot_state::RobotStateMsgConverter::Layout& robot_state::RobotStateMsgConverter::getLayout(const robot_model::RobotModelConstPtr &model_ptr,
+                                                                                                     const std::vector<std::string> &names)
+{
+  for (std::list<Layout>::iterator it = layouts_.begin() ; it != layouts_.end() ; )
+  {
+    robot_model::RobotModelConstPtr cached = it->model_.lock();
+    // the joints of layouts for models that no longer exist must not be used
+    if (!cached)
+      it = layouts_.erase(it);
+    else if (cached == model_ptr && it->names_ == names)
+    {
+      layouts_.splice(layouts_.begin(), layouts_, it);
+      return layouts_.front();
+    }
+    else
+      ++it;
+  }
+
+  const robot_model::RobotModel &model = *model_ptr;
+  layouts_.push_front(Layout());
+  Layout &layout = layouts_.front();
+  layout.model_ = model_ptr;
+  layout.names_ = names;
+
+  // if a name appears more than once, the last value is the one that is used
+  std::map<std::string, int> index;
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    index[names[i]] = i;
+
+  const std::vector<const robot_model::JointModel*> &joints = model.getJointModels();
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    if (joints[i]->getMimic())
+      continue;
+    const std::vector<std::string> &vnames = joints[i]->getVariableNames();
+    JointLayout jl;
+    jl.joint_ = joints[i];
+    jl.source_.resize(vnames.size(), -1);
+    bool has_any = false;
+    for (std::size_t j = 0 ; j < vnames.size() ; ++j)
+    {
+      std::map<std::string, int>::const_iterator it = index.find(vnames[j]);
+      if (it == index.end())
+        layout.missing_.insert(vnames[j]);
+      else
+      {
+        jl.source_[j] = it->second;
+        has_any = true;
+      }
+    }
+    if (has_any)
+      layout.joints_.push_back(jl);
+  }
+
+  layout.name_joints_.resize(names.size(), NULL);
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    if (model.hasJointModel(names[i]))
+      layout.name_joints_[i] = model.getJointModel(names[i]);
+
+  if (layouts_.size() > max_layouts_ && layouts_.size() > 1)
+    layouts_.pop_back();
+  return layout;
+}
+
+bool robot_state::RobotStateMsgConverter::setJointState(const sensor_msgs::JointState &joint_state, RobotState& state, std::set<std::string> &missing)
+{
+  if (joint_state.name.size() != joint_state.position.size())
+  {
+    logError("Different number of names and positions in JointState message: %u, %u",
+             (unsigned int)joint_state.name.size(), (unsigned int)joint_state.position.size());
+    return false;
+  }
+
+  const Layout &layout = getLayout(state.getRobotModel(), joint_state.name);
+  for (std::size_t i = 0 ; i < layout.joints_.size() ; ++i)
+  {
+    const JointLayout &jl = layout.joints_[i];
+    JointState *js = state.getJointState(jl.joint_);
+    values_ = js->getVariableValues();
+    for (std::size_t j = 0 ; j < jl.source_.size() ; ++j)
+      if (jl.source_[j] >= 0)
+        values_[j] = joint_state.position[jl.source_[j]];
+    js->setVariableValues(&values_[0]);
+  }
+  missing = layout.missing_;
+
+  // keep velocities in, the same way jointStateToRobotState() does
+  if (!joint_state.velocity.empty())
+    for (std::size_t i = 0 ; i < layout.name_joints_.size() && i < joint_state.velocity.size() ; ++i)
+      if (layout.name_joints_[i])
+      {
+        JointState *js = state.getJointState(layout.name_joints_[i]);
+        js->getVelocities().resize(1);
+        js->getVelocities()[0] = joint_state.velocity[i];
+      }
+
+  return true;
+}
+
+void robot_state::RobotStateMsgConverter::attachBody(const Transforms *tf, const moveit_msgs::AttachedCollisionObject &aco, RobotState& state)
+{
+  // anything other than adding geometry is handled as robotStateMsgToRobotState() does
+  if (aco.object.operation != moveit_msgs::CollisionObject::ADD ||
+      (aco.object.primitives.empty() && aco.object.meshes.empty() && aco.object.planes.empty()))
+  {
+    msgToAttachedBody(tf, aco, state);
+    return;
+  }
+
+  if (!checkCollisionObjectMsg(aco.object))
+    return;
+
+  LinkState *ls = state.getLinkState(aco.link_name);
+  if (!ls)
+    return;
+
+  std::vector<boost::uint8_t> geometry;
+  serializeGeometry(aco.object, geometry);
+
+  std::list<CachedBody>::iterator it = bodies_.begin();
+  for ( ; it != bodies_.end() ; ++it)
+    if (it->id_ == aco.object.id && it->geometry_ == geometry)
+      break;
+
+  if (it != bodies_.end())
+    bodies_.splice(bodies_.begin(), bodies_, it);
+  else
+  {
+    bodies_.push_front(CachedBody());
+    CachedBody &body = bodies_.front();
+    body.id_ = aco.object.id;
+    body.geometry_.swap(geometry);
+    constructShapesFromMsg(aco.object, body.shapes_, body.poses_);
+    if (bodies_.size() > max_bodies_ && bodies_.size() > 1)
+      bodies_.pop_back();
+  }
+
+  const CachedBody &body = bodies_.front();
+  attachShapes(tf, aco, ls, body.shapes_, body.poses_, state);
+}
+
+bool robot_state::RobotStateMsgConverter::convertHelper(const Transforms *tf, const moveit_msgs::RobotState &robot_state, RobotState& state, bool copy_attached_bodies)
+{
+  std::set<std::string> missing;
+  bool result1 = setJointState(robot_state.joint_state, state, missing);
+  bool result2 = multiDOFJointsToRobotState(robot_state.multi_dof_joint_state, state, tf);
+  state.updateLinkTransforms();
+
+  if (copy_attached_bodies && !robot_state.attached_collision_objects.empty())
+  {
+    for (std::size_t i = 0 ; i < robot_state.attached_collision_objects.size() ; ++i)
+      attachBody(tf, robot_state.attached_collision_objects[i], state);
+    state.updateLinkTransforms();
+  }
+
+  return result1 && result2 && coveredByMultiDOFJoints(missing, robot_state.multi_dof_joint_state, state);
+}
@@ -36,10 +36,13 @@
 
 #include <moveit/robot_state/joint_state.h>
 
-robot_state::JointState::JointState(const robot_model::JointModel *jm) : joint_model_(jm)
+robot_state::JointState::JointState(const robot_model::JointModel *jm, Eigen::Affine3d *variable_transform) :
+  joint_model_(jm), variable_transform_(variable_transform), owns_variable_transform_(variable_transform == NULL), dirty_(true)
 {
+  if (owns_variable_transform_)
+    variable_transform_ = new Eigen::Affine3d();
   joint_state_values_.resize(getVariableCount());
-  variable_transform_.setIdentity();
+  variable_transform_->setIdentity();
   std::vector<double> values;
   joint_model_->getVariableDefaultValues(values);
   setVariableValues(values);
@@ -49,12 +52,15 @@ robot_state::JointState::JointState(const robot_model::JointModel *jm) : joint_m
 }
 
 robot_state::JointState::JointState(const JointState &other) :
-  joint_model_(other.joint_model_), variable_transform_(other.variable_transform_), joint_state_values_(other.joint_state_values_), mimic_requests_(other.mimic_requests_)
+  joint_model_(other.joint_model_), variable_transform_(new Eigen::Affine3d(*other.variable_transform_)), owns_variable_transform_(true), dirty_(other.dirty_),
+  joint_state_values_(other.joint_state_values_), mimic_requests_(other.mimic_requests_)
 {
 }
 
 robot_state::JointState::~JointState()
 {
+  if (owns_variable_transform_)
+    delete variable_transform_;
 }
 
 robot_state::JointState& robot_state::JointState::operator=(const robot_state::JointState &other)
@@ -63,7 +69,8 @@ robot_state::JointState& robot_state::JointState::operator=(const robot_state::J
   {
     assert(joint_state_values_.size() == other.joint_state_values_.size());
     joint_state_values_ = other.joint_state_values_;
-    variable_transform_ = other.variable_transform_;
+    *variable_transform_ = *other.variable_transform_;
+    dirty_ = true;
     mimic_requests_ = other.mimic_requests_;
   }
   return *this;
@@ -75,7 +82,8 @@ bool robot_state::JointState::setVariableValue(const std::string &variable, doub
   if (it != getVariableIndexMap().end())
   {
     joint_state_values_[it->second] = value;
-    joint_model_->updateTransform(joint_state_values_, variable_transform_);
+    joint_model_->updateTransform(joint_state_values_, *variable_transform_);
+    dirty_ = true;
     updateMimicJoints();
     return true;
   }
@@ -95,7 +103,8 @@ bool robot_state::JointState::setVariableValues(const std::vector<double>& joint
     return false;
   }
   joint_state_values_ = joint_state_values;
-  joint_model_->updateTransform(joint_state_values, variable_transform_);
+  joint_model_->updateTransform(joint_state_values, *variable_transform_);
+  dirty_ = true;
   updateMimicJoints();
   return true;
 }
@@ -103,7 +112,8 @@ bool robot_state::JointState::setVariableValues(const std::vector<double>& joint
 void robot_state::JointState::setVariableValues(const double *joint_state_values)
 {
   std::copy(joint_state_values, joint_state_values + joint_state_values_.size(), joint_state_values_.begin());
-  joint_model_->updateTransform(joint_state_values_, variable_transform_);
+  joint_model_->updateTransform(joint_state_values_, *variable_transform_);
+  dirty_ = true;
   updateMimicJoints();
 }
 
@@ -125,7 +135,8 @@ void robot_state::JointState::setVariableValues(const std::map<std::string, doub
 
   if (has_any)
   {
-    joint_model_->updateTransform(joint_state_values_, variable_transform_);
+    joint_model_->updateTransform(joint_state_values_, *variable_transform_);
+    dirty_ = true;
     updateMimicJoints();
   }
 }
@@ -157,7 +168,8 @@ void robot_state::JointState::setVariableValues(const std::map<std::string, doub
     }
   if (update)
   {
-    joint_model_->updateTransform(joint_state_values_, variable_transform_);
+    joint_model_->updateTransform(joint_state_values_, *variable_transform_);
+    dirty_ = true;
     updateMimicJoints();
   }
 }
@@ -165,32 +177,38 @@ void robot_state::JointState::setVariableValues(const std::map<std::string, doub
 void robot_state::JointState::setVariableValues(const Eigen::Affine3d& transform)
 {
   joint_model_->computeJointStateValues(transform, joint_state_values_);
-  joint_model_->updateTransform(joint_state_values_, variable_transform_);
+  joint_model_->updateTransform(joint_state_values_, *variable_transform_);
+  dirty_ = true;
   updateMimicJoints();
 }
 
 void robot_state::JointState::updateMimicJoints()
 {
+  // mimic joints do not have mimic requests of their own, so their values are written directly
   for (std::size_t i = 0 ; i < mimic_requests_.size() ; ++i)
   {
-    std::vector<double> mim_val(joint_state_values_.size());
+    const MimicRequest &request = mimic_requests_[i];
+    std::vector<double> &mim_val = request.joint_->joint_state_values_;
     for (std::size_t j = 0 ; j < mim_val.size() ; ++j)
-      mim_val[j] = joint_state_values_[j] * mimic_requests_[i]->getJointModel()->getMimicFactor() + mimic_requests_[i]->getJointModel()->getMimicOffset();
-    mimic_requests_[i]->setVariableValues(&mim_val[0]);
+      mim_val[j] = joint_state_values_[j] * request.factor_ + request.offset_;
+    request.joint_->joint_model_->updateTransform(mim_val, *request.joint_->variable_transform_);
+    request.joint_->dirty_ = true;
   }
 }
 
 void robot_state::JointState::enforceBounds()
 {
   joint_model_->enforceBounds(joint_state_values_);
-  joint_model_->updateTransform(joint_state_values_, variable_transform_);
+  joint_model_->updateTransform(joint_state_values_, *variable_transform_);
+  dirty_ = true;
   updateMimicJoints();
 }
 
 void robot_state::JointState::interpolate(const JointState *to, const double t, JointState *dest) const
 {
   joint_model_->interpolate(joint_state_values_, to->joint_state_values_, t, dest->joint_state_values_);
-  dest->joint_model_->updateTransform(dest->joint_state_values_, dest->variable_transform_);
+  dest->joint_model_->updateTransform(dest->joint_state_values_, *dest->variable_transform_);
+  dest->dirty_ = true;
   dest->updateMimicJoints();
 }
 
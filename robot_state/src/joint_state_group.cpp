@@ -35,15 +35,21 @@
 /* Author: Ioan Sucan, E. Gil Jones, Sachin Chitta */
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/thread_random_numbers.h>
+#include <moveit/profiler/query_counters.h>
+#include <moveit/profiler/tracing.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/math/constants/constants.hpp>
 #include <algorithm>
 #include <Eigen/SVD>
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
 
 robot_state::JointStateGroup::JointStateGroup(RobotState *state,
                                               const robot_model::JointModelGroup *jmg) :
-  kinematic_state_(state), joint_model_group_(jmg)
+  kinematic_state_(state), joint_model_group_(jmg), ik_memo_version_(0)
 {
   const std::vector<const robot_model::JointModel*>& joint_model_vector = jmg->getJointModels();
   for (std::size_t i = 0; i < joint_model_vector.size() ; ++i)
@@ -76,6 +82,8 @@ robot_state::JointStateGroup::~JointStateGroup()
 
 random_numbers::RandomNumberGenerator& robot_state::JointStateGroup::getRandomNumberGenerator()
 {
+  if (getUseThreadRandomNumberGenerators())
+    return getThreadRandomNumberGenerator();
   if (!rng_)
     rng_.reset(new random_numbers::RandomNumberGenerator());
   return *rng_;
@@ -134,8 +142,57 @@ void robot_state::JointStateGroup::setVariableValues(const sensor_msgs::JointSta
 
 void robot_state::JointStateGroup::updateLinkTransforms()
 {
-  for(unsigned int i = 0; i < updated_links_.size(); ++i)
-    updated_links_[i]->computeTransform();
+  kinematic_state_->updateLinkTransforms(updated_links_);
+}
+
+bool robot_state::JointStateGroup::computeLinkTransforms(const Eigen::MatrixXd &values, const std::vector<std::string> &link_names,
+                                                         std::vector<EigenSTL::vector_Affine3d> &transforms)
+{
+  if (values.cols() != getVariableCount())
+  {
+    logError("JointStateGroup: Incorrect variable count specified for batch of joint values. Expected %u but got %u columns in group '%s'",
+             getVariableCount(), (unsigned int)values.cols(), joint_model_group_->getName().c_str());
+    return false;
+  }
+
+  // resolve the links once, so the loop over configurations does no lookups by name
+  std::vector<const LinkState*> links(link_names.size());
+  for (std::size_t i = 0 ; i < link_names.size() ; ++i)
+  {
+    links[i] = kinematic_state_->getLinkState(link_names[i]);
+    if (!links[i])
+    {
+      logError("JointStateGroup: Link '%s' is not known to the robot state", link_names[i].c_str());
+      return false;
+    }
+  }
+
+  const std::size_t n = values.rows();
+  transforms.resize(links.size());
+  for (std::size_t i = 0 ; i < transforms.size() ; ++i)
+    transforms[i].resize(n);
+
+  // the rows of a column-major matrix are not contiguous; reuse one buffer for all configurations
+  std::vector<double> row(values.cols());
+  for (std::size_t k = 0 ; k < n ; ++k)
+  {
+    for (std::size_t j = 0 ; j < row.size() ; ++j)
+      row[j] = values(k, j);
+    unsigned int value_counter = 0;
+    for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
+    {
+      unsigned int dim = joint_state_vector_[i]->getVariableCount();
+      if (dim != 0)
+      {
+        joint_state_vector_[i]->setVariableValues(&row[value_counter]);
+        value_counter += dim;
+      }
+    }
+    updateLinkTransforms();
+    for (std::size_t i = 0 ; i < links.size() ; ++i)
+      transforms[i][k] = links[i]->getGlobalLinkTransform();
+  }
+  return true;
 }
 
 robot_state::JointStateGroup& robot_state::JointStateGroup::operator=(const JointStateGroup &other)
@@ -147,6 +204,13 @@ robot_state::JointStateGroup& robot_state::JointStateGroup::operator=(const Join
 
 void robot_state::JointStateGroup::copyFrom(const JointStateGroup &other_jsg)
 {
+  // between states of the same model, the values and variable transforms are copied directly
+  if (other_jsg.joint_model_group_ == joint_model_group_ &&
+      kinematic_state_->getRobotModel() == other_jsg.kinematic_state_->getRobotModel())
+  {
+    kinematic_state_->copyGroupValues(*other_jsg.kinematic_state_, joint_model_group_);
+    return;
+  }
   const std::vector<JointState*> &ojsv = other_jsg.getJointStateVector();
   for (std::size_t i = 0 ; i < ojsv.size() ; ++i)
     joint_state_vector_[i]->setVariableValues(ojsv[i]->getVariableValues());
@@ -178,6 +242,15 @@ void robot_state::JointStateGroup::setToRandomValues()
   setVariableValues(random_joint_states);
 }
 
+bool robot_state::JointStateGroup::setToSampledValues(robot_model::VariableSampler &sampler)
+{
+  std::vector<double> sampled_values;
+  if (!joint_model_group_->getVariableSampledValues(sampler, sampled_values))
+    return false;
+  setVariableValues(sampled_values);
+  return true;
+}
+
 void robot_state::JointStateGroup::setToRandomValuesNearBy(const std::vector<double> &near,
                                                            const std::map<robot_model::JointModel::JointType, double> &distance_map)
 {
@@ -218,28 +291,115 @@ void robot_state::JointStateGroup::getVariableValues(Eigen::VectorXd& joint_stat
   }
 }
 
+namespace
+{
+// distance between the values of two revolute or prismatic joints
+static inline double singleDOFDistance(double a, double b, bool continuous)
+{
+  double d = fabs(a - b);
+  return (continuous && d > boost::math::constants::pi<double>()) ? 2.0 * boost::math::constants::pi<double>() - d : d;
+}
+
+// interpolation between the values of two revolute or prismatic joints (as done by the joint models)
+static inline double singleDOFInterpolate(double from, double to, double t, bool continuous)
+{
+  double diff = to - from;
+  if (!continuous || fabs(diff) <= boost::math::constants::pi<double>())
+    return from + diff * t;
+  if (diff > 0.0)
+    diff = 2.0 * boost::math::constants::pi<double>() - diff;
+  else
+    diff = -2.0 * boost::math::constants::pi<double>() - diff;
+  double v = from - diff * t;
+  // input states are within bounds, so the following check is sufficient
+  if (v > boost::math::constants::pi<double>())
+    v -= 2.0 * boost::math::constants::pi<double>();
+  else
+    if (v < -boost::math::constants::pi<double>())
+      v += 2.0 * boost::math::constants::pi<double>();
+  return v;
+}
+
+// bring an angle of a continuous joint to [-pi, pi] (as done by the joint models)
+static inline double wrapAngle(double v)
+{
+  v = fmod(v, 2.0 * boost::math::constants::pi<double>());
+  if (v < -boost::math::constants::pi<double>())
+    v += 2.0 * boost::math::constants::pi<double>();
+  else
+    if (v > boost::math::constants::pi<double>())
+      v -= 2.0 * boost::math::constants::pi<double>();
+  return v;
+}
+}
+
 bool robot_state::JointStateGroup::satisfiesBounds(double margin) const
 {
-  for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
-    if (!joint_state_vector_[i]->satisfiesBounds(margin))
+  // continuous joints are always within bounds
+  const robot_model::JointModelGroup::JointDispatch &dispatch = joint_model_group_->getJointDispatch();
+  for (std::size_t k = 0 ; k < dispatch.bounded_.size() ; ++k)
+  {
+    const JointState *js = joint_state_vector_[dispatch.bounded_[k]];
+    const std::pair<double, double> &b = js->getJointModel()->getVariableBounds()[0];
+    const double v = js->getVariableValues()[0];
+    if (v < b.first - margin || v > b.second + margin)
+      return false;
+  }
+  for (std::size_t k = 0 ; k < dispatch.other_.size() ; ++k)
+    if (!joint_state_vector_[dispatch.other_[k]]->satisfiesBounds(margin))
       return false;
   return true;
 }
 
 void robot_state::JointStateGroup::enforceBounds()
 {
-  for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
-    joint_state_vector_[i]->enforceBounds();
+  // only the joints whose values change are set again
+  const robot_model::JointModelGroup::JointDispatch &dispatch = joint_model_group_->getJointDispatch();
+  for (std::size_t k = 0 ; k < dispatch.bounded_.size() ; ++k)
+  {
+    JointState *js = joint_state_vector_[dispatch.bounded_[k]];
+    const std::pair<double, double> &b = js->getJointModel()->getVariableBounds()[0];
+    const double v = js->getVariableValues()[0];
+    if (v < b.first)
+      js->setVariableValues(&b.first);
+    else
+      if (v > b.second)
+        js->setVariableValues(&b.second);
+  }
+  for (std::size_t k = 0 ; k < dispatch.continuous_.size() ; ++k)
+  {
+    JointState *js = joint_state_vector_[dispatch.continuous_[k]];
+    const double v = js->getVariableValues()[0];
+    const double w = wrapAngle(v);
+    if (w != v)
+      js->setVariableValues(&w);
+  }
+  for (std::size_t k = 0 ; k < dispatch.other_.size() ; ++k)
+    joint_state_vector_[dispatch.other_[k]]->enforceBounds();
   updateLinkTransforms();
 }
 
 double robot_state::JointStateGroup::infinityNormDistance(const JointStateGroup *other) const
 {
-  if (joint_state_vector_.empty())
-    return 0.0;
-  double max_d = joint_state_vector_[0]->distance(other->joint_state_vector_[0]);
-  for (std::size_t i = 1 ; i < joint_state_vector_.size() ; ++i)
+  const robot_model::JointModelGroup::JointDispatch &dispatch = joint_model_group_->getJointDispatch();
+  double max_d = 0.0;
+  for (std::size_t k = 0 ; k < dispatch.bounded_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.bounded_[k];
+    double d = singleDOFDistance(joint_state_vector_[i]->getVariableValues()[0], other->joint_state_vector_[i]->getVariableValues()[0], false);
+    if (d > max_d)
+      max_d = d;
+  }
+  for (std::size_t k = 0 ; k < dispatch.continuous_.size() ; ++k)
   {
+    const unsigned int i = dispatch.continuous_[k];
+    double d = singleDOFDistance(joint_state_vector_[i]->getVariableValues()[0], other->joint_state_vector_[i]->getVariableValues()[0], true);
+    if (d > max_d)
+      max_d = d;
+  }
+  for (std::size_t k = 0 ; k < dispatch.other_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.other_[k];
     double d = joint_state_vector_[i]->distance(other->joint_state_vector_[i]);
     if (d > max_d)
       max_d = d;
@@ -249,16 +409,48 @@ double robot_state::JointStateGroup::infinityNormDistance(const JointStateGroup
 
 double robot_state::JointStateGroup::distance(const JointStateGroup *other) const
 {
+  const robot_model::JointModelGroup::JointDispatch &dispatch = joint_model_group_->getJointDispatch();
   double d = 0.0;
-  for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
+  for (std::size_t k = 0 ; k < dispatch.bounded_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.bounded_[k];
+    d += singleDOFDistance(joint_state_vector_[i]->getVariableValues()[0], other->joint_state_vector_[i]->getVariableValues()[0], false) *
+      joint_state_vector_[i]->getJointModel()->getDistanceFactor();
+  }
+  for (std::size_t k = 0 ; k < dispatch.continuous_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.continuous_[k];
+    d += singleDOFDistance(joint_state_vector_[i]->getVariableValues()[0], other->joint_state_vector_[i]->getVariableValues()[0], true) *
+      joint_state_vector_[i]->getJointModel()->getDistanceFactor();
+  }
+  for (std::size_t k = 0 ; k < dispatch.other_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.other_[k];
     d += joint_state_vector_[i]->distance(other->joint_state_vector_[i]) * joint_state_vector_[i]->getJointModel()->getDistanceFactor();
+  }
   return d;
 }
 
 void robot_state::JointStateGroup::interpolate(const JointStateGroup *to, const double t, JointStateGroup *dest) const
 {
-  for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
+  const robot_model::JointModelGroup::JointDispatch &dispatch = joint_model_group_->getJointDispatch();
+  for (std::size_t k = 0 ; k < dispatch.bounded_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.bounded_[k];
+    double v = singleDOFInterpolate(joint_state_vector_[i]->getVariableValues()[0], to->joint_state_vector_[i]->getVariableValues()[0], t, false);
+    dest->joint_state_vector_[i]->setVariableValues(&v);
+  }
+  for (std::size_t k = 0 ; k < dispatch.continuous_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.continuous_[k];
+    double v = singleDOFInterpolate(joint_state_vector_[i]->getVariableValues()[0], to->joint_state_vector_[i]->getVariableValues()[0], t, true);
+    dest->joint_state_vector_[i]->setVariableValues(&v);
+  }
+  for (std::size_t k = 0 ; k < dispatch.other_.size() ; ++k)
+  {
+    const unsigned int i = dispatch.other_[k];
     joint_state_vector_[i]->interpolate(to->joint_state_vector_[i], t, dest->joint_state_vector_[i]);
+  }
   dest->updateLinkTransforms();
 }
 
@@ -354,15 +546,9 @@ bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, uns
   return setFromIK(pose_in, solver->getTipFrame(), consistency_limits, attempts, timeout, constraint, options);
 }
 
-bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, const std::string &tip_in, const std::vector<double> &consistency_limits, unsigned int attempts, double timeout, const StateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
+bool robot_state::JointStateGroup::getIKQuery(const kinematics::KinematicsBaseConstPtr &solver, const Eigen::Affine3d &pose_in, const std::string &tip_in,
+                                              Eigen::Affine3d &ik_query) const
 {
-  const kinematics::KinematicsBaseConstPtr& solver = joint_model_group_->getSolverInstance();
-  if (!solver)
-  {
-    logError("No kinematics solver instantiated for this group");
-    return false;
-  }
-
   Eigen::Affine3d pose = pose_in;
   std::string tip = tip_in;
 
@@ -414,6 +600,24 @@ bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, con
     return false;
   }
 
+  ik_query = pose;
+  return true;
+}
+
+bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, const std::string &tip_in, const std::vector<double> &consistency_limits, unsigned int attempts, double timeout, const StateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
+{
+  MOVEIT_TRACE_SCOPE("JointStateGroup::setFromIK");
+  kinematics::KinematicsBaseConstPtr solver = joint_model_group_->acquireSolverInstance();
+  if (!solver)
+  {
+    logError("No kinematics solver instantiated for this group");
+    return false;
+  }
+
+  Eigen::Affine3d ik_query;
+  if (!getIKQuery(solver, pose_in, tip_in, ik_query))
+    return false;
+
   // if no timeout has been specified, use the default one
   if (timeout < std::numeric_limits<double>::epsilon())
     timeout = joint_model_group_->getDefaultIKTimeout();
@@ -422,16 +626,6 @@ bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, con
     attempts = joint_model_group_->getDefaultIKAttempts();
 
   const std::vector<unsigned int> &bij = joint_model_group_->getKinematicsSolverJointBijection();
-  Eigen::Quaterniond quat(pose.rotation());
-  Eigen::Vector3d point(pose.translation());
-  geometry_msgs::Pose ik_query;
-  ik_query.position.x = point.x();
-  ik_query.position.y = point.y();
-  ik_query.position.z = point.z();
-  ik_query.orientation.x = quat.x();
-  ik_query.orientation.y = quat.y();
-  ik_query.orientation.z = quat.z();
-  ik_query.orientation.w = quat.w();
 
   kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
   if (constraint)
@@ -440,9 +634,24 @@ bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, con
   bool first_seed = true;
   std::vector<double> initial_values;
   getVariableValues(initial_values);
+
+  // a query that was answered recently does not need the solver
+  const bool use_memo = consistency_limits.empty() && !options.return_approximate_solution && (!constraint || !ik_memo_context_.empty()) &&
+    joint_model_group_->getIKMemoCapacity() > 0;
+  const std::string &memo_context = constraint ? ik_memo_context_ : std::string();
+  if (use_memo)
+  {
+    std::vector<double> solution;
+    if (joint_model_group_->lookupIKMemo(ik_query, initial_values, memo_context, ik_memo_version_, solution))
+    {
+      setVariableValues(solution);
+      return true;
+    }
+  }
+
+  Eigen::VectorXd seed(bij.size()), ik_sol;
   for (unsigned int st = 0 ; st < attempts ; ++st)
   {
-    std::vector<double> seed(bij.size());
 
     // the first seed is the initial state
     if (first_seed)
@@ -475,22 +684,170 @@ bool robot_state::JointStateGroup::setFromIK(const Eigen::Affine3d &pose_in, con
     }
 
     // compute the IK solution
-    std::vector<double> ik_sol;
+    moveit::tools::QueryCounters::count(moveit::tools::IK_CALLS);
     moveit_msgs::MoveItErrorCodes error;
-    if (ik_callback_fn ?
-        solver->searchPositionIK(ik_query, seed, timeout, consistency_limits, ik_sol, ik_callback_fn, error, options) :
-        solver->searchPositionIK(ik_query, seed, timeout, consistency_limits, ik_sol, error, options))
+    if (solver->searchPositionIK(ik_query, seed, timeout, consistency_limits, ik_sol, ik_callback_fn, error, options))
     {
       std::vector<double> solution(bij.size());
       for (std::size_t i = 0 ; i < bij.size() ; ++i)
         solution[i] = ik_sol[bij[i]];
       setVariableValues(solution);
+      if (use_memo)
+        joint_model_group_->storeIKMemo(ik_query, initial_values, memo_context, ik_memo_version_, solution);
       return true;
     }
   }
   return false;
 }
 
+struct robot_state::JointStateGroup::RankedIKSearch
+{
+  Eigen::Affine3d                           ik_query;
+  double                                    timeout;
+  unsigned int                              attempts;
+  IKCostFn                                  cost;
+  StateValidityCallbackFn                   constraint;
+  kinematics::KinematicsQueryOptions        options;
+  std::vector<double>                       initial_values;
+
+  boost::mutex                              lock;
+  unsigned int                              next_attempt;
+  unsigned int                              solutions;
+  double                                    best_cost;
+  std::vector<double>                       best_solution;
+};
+
+double robot_state::JointStateGroup::closestIKCost(const JointStateGroup *joint_state_group, const std::vector<double> &initial_values)
+{
+  const std::vector<JointState*> &joints = joint_state_group->getJointStateVector();
+  std::vector<double> initial;
+  double d = 0.0;
+  std::size_t index = 0;
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    const std::vector<double> &values = joints[i]->getVariableValues();
+    initial.assign(initial_values.begin() + index, initial_values.begin() + index + values.size());
+    d += joints[i]->getJointModel()->distance(values, initial) * joints[i]->getJointModel()->getDistanceFactor();
+    index += values.size();
+  }
+  return d;
+}
+
+double robot_state::JointStateGroup::jointLimitsIKCost(const JointStateGroup *joint_state_group, const std::vector<double> &)
+{
+  return -joint_state_group->getMinDistanceToBounds().first;
+}
+
+void robot_state::JointStateGroup::rankedIKThread(RankedIKSearch *search, const kinematics::KinematicsBaseConstPtr &solver)
+{
+  const std::vector<unsigned int> &bij = joint_model_group_->getKinematicsSolverJointBijection();
+  kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
+  if (search->constraint)
+    ik_callback_fn = boost::bind(&JointStateGroup::ikCallbackFnAdapter, this, search->constraint, _1, _2, _3);
+  std::vector<unsigned int> red_joints;
+  if (search->options.lock_redundant_joints)
+    solver->getRedundantJoints(red_joints);
+
+  std::vector<double> solution(bij.size()), random_values;
+  Eigen::VectorXd seed(bij.size()), ik_sol;
+  while (true)
+  {
+    unsigned int attempt;
+    {
+      boost::mutex::scoped_lock slock(search->lock);
+      if (search->next_attempt >= search->attempts)
+        break;
+      attempt = search->next_attempt++;
+    }
+
+    // the first seed is the initial state, the others are random
+    if (attempt == 0)
+      for (std::size_t i = 0 ; i < bij.size() ; ++i)
+        seed[bij[i]] = search->initial_values[i];
+    else
+    {
+      joint_model_group_->getVariableRandomValues(getRandomNumberGenerator(), random_values);
+      for (std::size_t i = 0 ; i < bij.size() ; ++i)
+        seed[bij[i]] = random_values[i];
+      for (std::size_t i = 0 ; i < red_joints.size() ; ++i)
+        seed[bij[red_joints[i]]] = search->initial_values[red_joints[i]];
+    }
+
+    moveit::tools::QueryCounters::count(moveit::tools::IK_CALLS);
+    moveit_msgs::MoveItErrorCodes error;
+    if (!solver->searchPositionIK(search->ik_query, seed, search->timeout, ik_sol, ik_callback_fn, error, search->options))
+      continue;
+
+    for (std::size_t i = 0 ; i < bij.size() ; ++i)
+      solution[i] = ik_sol[bij[i]];
+    setVariableValues(solution);
+    double cost = search->cost(this, search->initial_values);
+
+    boost::mutex::scoped_lock slock(search->lock);
+    if (search->solutions == 0 || cost < search->best_cost)
+    {
+      search->best_cost = cost;
+      search->best_solution = solution;
+    }
+    ++search->solutions;
+  }
+}
+
+bool robot_state::JointStateGroup::setFromIKRanked(const Eigen::Affine3d &pose, const std::string &tip, unsigned int attempts, double timeout, unsigned int threads,
+                                                   const IKCostFn &cost, const StateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
+{
+  MOVEIT_TRACE_SCOPE("JointStateGroup::setFromIKRanked");
+  kinematics::KinematicsBaseConstPtr solver = joint_model_group_->acquireSolverInstance();
+  if (!solver)
+  {
+    logError("No kinematics solver instantiated for this group");
+    return false;
+  }
+
+  RankedIKSearch search;
+  if (!getIKQuery(solver, pose, tip, search.ik_query))
+    return false;
+  search.timeout = timeout < std::numeric_limits<double>::epsilon() ? joint_model_group_->getDefaultIKTimeout() : timeout;
+  search.attempts = attempts == 0 ? joint_model_group_->getDefaultIKAttempts() : attempts;
+  search.cost = cost ? cost : IKCostFn(&JointStateGroup::closestIKCost);
+  search.constraint = constraint;
+  search.options = options;
+  getVariableValues(search.initial_values);
+  search.next_attempt = 0;
+  search.solutions = 0;
+  search.best_cost = 0.0;
+
+  // the threads beyond the first one need their own solver and state
+  std::vector<kinematics::KinematicsBaseConstPtr> thread_solvers;
+  for (unsigned int i = 1 ; i < std::min(threads, search.attempts) ; ++i)
+  {
+    // if the pool can only hand out the shared instance, the search stays single threaded
+    kinematics::KinematicsBaseConstPtr thread_solver = joint_model_group_->acquireSolverInstance();
+    if (thread_solver == solver || std::find(thread_solvers.begin(), thread_solvers.end(), thread_solver) != thread_solvers.end())
+      break;
+    thread_solvers.push_back(thread_solver);
+  }
+
+  std::vector<RobotStatePtr> thread_states;
+  boost::thread_group workers;
+  for (std::size_t i = 0 ; i < thread_solvers.size() ; ++i)
+  {
+    thread_states.push_back(RobotStatePtr(new RobotState(*kinematic_state_)));
+    workers.create_thread(boost::bind(&JointStateGroup::rankedIKThread, thread_states.back()->getJointStateGroup(getName()), &search, thread_solvers[i]));
+  }
+  rankedIKThread(&search, solver);
+  workers.join_all();
+
+  if (search.solutions > 0)
+  {
+    logDebug("Kept the best of %u IK solutions, with cost %lf", search.solutions, search.best_cost);
+    setVariableValues(search.best_solution);
+    return true;
+  }
+  setVariableValues(search.initial_values);
+  return false;
+}
+
 bool robot_state::JointStateGroup::setFromIK(const EigenSTL::vector_Affine3d &poses_in,
                                              const std::vector<std::string> &tips_in,
                                              unsigned int attempts,
@@ -510,6 +867,7 @@ bool robot_state::JointStateGroup::setFromIK(const EigenSTL::vector_Affine3d &po
                                              const StateValidityCallbackFn &constraint,
                                              const kinematics::KinematicsQueryOptions &options)
 {
+  MOVEIT_TRACE_SCOPE("JointStateGroup::setFromIK");
   if (poses_in.size() == 1 && tips_in.size() == 1 && consistency_limits.size() <= 1)
   {
     if (consistency_limits.empty())
@@ -554,7 +912,7 @@ bool robot_state::JointStateGroup::setFromIK(const EigenSTL::vector_Affine3d &po
   std::vector<kinematics::KinematicsBaseConstPtr> solvers;
   for(std::size_t i = 0; i < poses_in.size() ; ++i)
   {
-    kinematics::KinematicsBaseConstPtr solver = joint_model_group_->getParentModel()->getJointModelGroup(sub_group_names[i])->getSolverInstance();
+    kinematics::KinematicsBaseConstPtr solver = joint_model_group_->getParentModel()->getJointModelGroup(sub_group_names[i])->acquireSolverInstance();
     if (!solver)
     {
       logError("Could not find solver for %s", sub_group_names[i].c_str());
@@ -622,24 +980,6 @@ bool robot_state::JointStateGroup::setFromIK(const EigenSTL::vector_Affine3d &po
     tip_names[i] = tip;
   }
 
-  std::vector<geometry_msgs::Pose> ik_queries(poses_in.size());
-  kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
-  if (constraint)
-    ik_callback_fn = boost::bind(&JointStateGroup::ikCallbackFnAdapter, this, constraint, _1, _2, _3);
-
-  for(std::size_t i = 0; i < transformed_poses.size(); ++i)
-  {
-    Eigen::Quaterniond quat(transformed_poses[i].rotation());
-    Eigen::Vector3d point(transformed_poses[i].translation());
-    ik_queries[i].position.x = point.x();
-    ik_queries[i].position.y = point.y();
-    ik_queries[i].position.z = point.z();
-    ik_queries[i].orientation.x = quat.x();
-    ik_queries[i].orientation.y = quat.y();
-    ik_queries[i].orientation.z = quat.z();
-    ik_queries[i].orientation.w = quat.w();
-  }
-
   if (attempts == 0)
     attempts = joint_model_group_->getDefaultIKAttempts();
 
@@ -651,7 +991,7 @@ bool robot_state::JointStateGroup::setFromIK(const EigenSTL::vector_Affine3d &po
     {
       robot_state::JointStateGroup* joint_state_group = getRobotState()->getJointStateGroup(sub_group_names[sg]);
       const std::vector<unsigned int>& bij = joint_state_group->getJointModelGroup()->getKinematicsSolverJointBijection();
-      std::vector<double> seed(bij.size());
+      Eigen::VectorXd seed(bij.size());
        // the first seed is the initial state
       if (first_seed)
       {
@@ -673,13 +1013,12 @@ bool robot_state::JointStateGroup::setFromIK(const EigenSTL::vector_Affine3d &po
       }
 
       // compute the IK solution
-      std::vector<double> ik_sol;
+      Eigen::VectorXd ik_sol;
+      moveit::tools::QueryCounters::count(moveit::tools::IK_CALLS);
       moveit_msgs::MoveItErrorCodes error;
-      if (!consistency_limits.empty() ?
-         solvers[sg]->searchPositionIK(ik_queries[sg], seed, timeout < std::numeric_limits<double>::epsilon() ? joint_state_group->getDefaultIKTimeout() : timeout,
-                                       consistency_limits[sg], ik_sol, error) :
-         solvers[sg]->searchPositionIK(ik_queries[sg], seed,  timeout < std::numeric_limits<double>::epsilon() ? joint_state_group->getDefaultIKTimeout() : timeout,
-                                       ik_sol, error))
+      if (solvers[sg]->searchPositionIK(transformed_poses[sg], seed, timeout < std::numeric_limits<double>::epsilon() ? joint_state_group->getDefaultIKTimeout() : timeout,
+                                        consistency_limits.empty() ? std::vector<double>() : consistency_limits[sg], ik_sol,
+                                        kinematics::KinematicsBase::IKCallbackFn(), error))
       {
         std::vector<double> solution(bij.size());
         for (std::size_t i = 0 ; i < bij.size() ; ++i)
@@ -767,6 +1106,165 @@ bool robot_state::JointStateGroup::setFromDiffIK(const geometry_msgs::Twist &twi
   return setFromDiffIK(t, tip, dt, constraint, st);
 }
 
+bool robot_state::JointStateGroup::computeJointVelocity(Eigen::VectorXd &qdot, const Eigen::VectorXd &twist, const robot_model::LinkModel *tip,
+                                                        DiffIKWorkspace &workspace, const SecondaryTaskFn &st) const
+{
+  if (twist.size() != 6)
+  {
+    logError("A twist has 6 components, not %d", (int)twist.size());
+    return false;
+  }
+  const robot_model::JointModelGroup::JacobianChain *chain = getCheckedJacobianChain(tip);
+  if (!chain)
+    return false;
+
+  // the limits of the variables only change with the group
+  const unsigned int n = joint_model_group_->getVariableCount();
+  if (workspace.group_ != joint_model_group_)
+  {
+    const std::vector<moveit_msgs::JointLimits> &limits = joint_model_group_->getVariableLimits();
+    workspace.lower_.resize(n);
+    workspace.upper_.resize(n);
+    for (unsigned int i = 0 ; i < n ; ++i)
+    {
+      workspace.lower_[i] = limits[i].has_position_limits ? limits[i].min_position : -std::numeric_limits<double>::infinity();
+      workspace.upper_[i] = limits[i].has_position_limits ? limits[i].max_position : std::numeric_limits<double>::infinity();
+    }
+    workspace.weights_.resize(n);
+    workspace.group_ = joint_model_group_;
+  }
+
+  const Eigen::Matrix<double, 6, 1> t = twist;
+  const Eigen::Vector3d zero(0.0, 0.0, 0.0);
+  switch (n)
+  {
+  case 6:
+    {
+      Eigen::Matrix<double, 6, 6> jacobian = Eigen::Matrix<double, 6, 6>::Zero();
+      const Eigen::Matrix3d tip_rotation = computeJacobian(*chain, tip, zero, jacobian).rotation();
+      solveDampedLeastSquares<6>(jacobian, tip_rotation, t, qdot, workspace, st);
+    }
+    break;
+  case 7:
+    {
+      Eigen::Matrix<double, 6, 7> jacobian = Eigen::Matrix<double, 6, 7>::Zero();
+      const Eigen::Matrix3d tip_rotation = computeJacobian(*chain, tip, zero, jacobian).rotation();
+      solveDampedLeastSquares<7>(jacobian, tip_rotation, t, qdot, workspace, st);
+    }
+    break;
+  default:
+    workspace.jacobian_.resize(6, n);
+    workspace.jacobian_.setZero();
+    {
+      const Eigen::Matrix3d tip_rotation = computeJacobian(*chain, tip, zero, workspace.jacobian_).rotation();
+      solveDampedLeastSquares<Eigen::Dynamic>(workspace.jacobian_, tip_rotation, t, qdot, workspace, st);
+    }
+    break;
+  }
+  return true;
+}
+
+template <int DOF>
+void robot_state::JointStateGroup::solveDampedLeastSquares(Eigen::Matrix<double, 6, DOF> &jacobian, const Eigen::Matrix3d &tip_rotation,
+                                                           const Eigen::Matrix<double, 6, 1> &twist, Eigen::VectorXd &qdot,
+                                                           DiffIKWorkspace &workspace, const SecondaryTaskFn &st) const
+{
+  const int n = jacobian.cols();
+
+  // express the Jacobian in the frame of the tip, as the twist is
+  const Eigen::Matrix3d rt = tip_rotation.transpose();
+  for (int k = 0 ; k < n ; ++k)
+  {
+    jacobian.template block<3,1>(0, k) = rt * jacobian.template block<3,1>(0, k);
+    jacobian.template block<3,1>(3, k) = rt * jacobian.template block<3,1>(3, k);
+  }
+
+  getVariableValues(workspace.values_);
+  workspace.weights_.setOnes();
+  qdot.resize(n);
+
+  Eigen::Matrix<double, 6, 6> a;
+  Eigen::Matrix<double, 6, 1> y;
+  Eigen::LDLT<Eigen::Matrix<double, 6, 6> > ldlt;
+  for (int pass = 0 ; ; ++pass)
+  {
+    // a = J W J^T, with W the diagonal matrix of the joint weights
+    for (int r = 0 ; r < 6 ; ++r)
+      for (int c = r ; c < 6 ; ++c)
+      {
+        double sum = 0.0;
+        for (int k = 0 ; k < n ; ++k)
+          sum += jacobian(r, k) * workspace.weights_(k) * jacobian(c, k);
+        a(r, c) = a(c, r) = sum;
+      }
+
+    // the squared damping grows from 0 to its maximum as the smallest singular value of the weighted Jacobian
+    // drops from the threshold to 0
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6> > eigen(a, Eigen::EigenvaluesOnly);
+    const double smallest = std::sqrt(std::max(0.0, eigen.eigenvalues()(0)));
+    if (smallest < workspace.singular_value_threshold)
+    {
+      const double ratio = smallest / workspace.singular_value_threshold;
+      a.diagonal().array() += (1.0 - ratio * ratio) * workspace.max_damping * workspace.max_damping;
+    }
+    ldlt.compute(a);
+    y = ldlt.solve(twist);
+    for (int k = 0 ; k < n ; ++k)
+      qdot(k) = workspace.weights_(k) * jacobian.col(k).dot(y);
+
+    // joints that move towards a limit they are close to are weighted down, and the velocity is computed again
+    if (pass > 0 || workspace.joint_limit_margin <= 0.0)
+      break;
+    bool reweighted = false;
+    for (int k = 0 ; k < n ; ++k)
+    {
+      const double range = workspace.upper_[k] - workspace.lower_[k];
+      if (qdot(k) == 0.0 || !(range > 0.0) || range == std::numeric_limits<double>::infinity())
+        continue;
+      const double margin = workspace.joint_limit_margin * range;
+      const double distance = qdot(k) > 0.0 ? workspace.upper_[k] - workspace.values_[k] : workspace.values_[k] - workspace.lower_[k];
+      if (distance < margin)
+      {
+        workspace.weights_(k) = std::max(workspace.min_joint_weight, distance / margin);
+        reweighted = true;
+      }
+    }
+    if (!reweighted)
+      break;
+  }
+
+  // project the secondary task in the null space of the Jacobian: cost - J# J cost, with J# = W J^T (J W J^T + damping)^-1
+  if (st)
+  {
+    workspace.cost_.setZero(n);
+    st(this, workspace.cost_);
+    y.noalias() = jacobian * workspace.cost_;
+    y = ldlt.solve(y);
+    for (int k = 0 ; k < n ; ++k)
+      qdot(k) += workspace.cost_(k) - workspace.weights_(k) * jacobian.col(k).dot(y);
+  }
+}
+
+bool robot_state::JointStateGroup::setFromDiffIK(const Eigen::VectorXd &twist, const robot_model::LinkModel *tip, double dt, DiffIKWorkspace &workspace,
+                                                 Eigen::VectorXd &qdot, const StateValidityCallbackFn &constraint, const SecondaryTaskFn &st)
+{
+  if (!computeJointVelocity(qdot, twist, tip, workspace, st))
+    return false;
+  getVariableValues(workspace.values_);
+  for (std::size_t i = 0 ; i < workspace.values_.size() ; ++i)
+    workspace.values_[i] += dt * qdot(i);
+  setVariableValues(workspace.values_);
+  enforceBounds();
+
+  if (constraint)
+  {
+    getVariableValues(workspace.values_);
+    return constraint(this, workspace.values_);
+  }
+  else
+    return true;
+}
+
 bool robot_state::JointStateGroup::integrateJointVelocity(const Eigen::VectorXd &qdot, double dt, const StateValidityCallbackFn &constraint)
 {
   Eigen::VectorXd q(getVariableCount());
@@ -997,85 +1495,100 @@ bool robot_state::JointStateGroup::getJacobian(const std::string &link_name,
                                                Eigen::MatrixXd& jacobian,
                                                bool use_quaternion_representation) const
 {
-  if (!joint_model_group_->isChain())
-  {
-    logError("The group '%s' is not a chain. Cannot compute Jacobian", joint_model_group_->getName().c_str());
-    return false;
-  }
   if (!joint_model_group_->isLinkUpdated(link_name))
   {
     logError("Link name '%s' does not exist in the chain '%s' or is not a child for this chain", link_name.c_str(), joint_model_group_->getName().c_str());
     return false;
   }
+  return getJacobian(kinematic_state_->getRobotModel()->getLinkModel(link_name), reference_point_position, jacobian, use_quaternion_representation);
+}
 
-  const robot_model::JointModel* root_joint_model = (joint_model_group_->getJointRoots())[0];
-  const robot_state::LinkState *root_link_state = kinematic_state_->getLinkState(root_joint_model->getParentLinkModel()->getName());
-  Eigen::Affine3d reference_transform = root_link_state ? root_link_state->getGlobalLinkTransform() : kinematic_state_->getRootTransform();
-  reference_transform = reference_transform.inverse();
-  int rows = use_quaternion_representation ? 7 : 6;
-  int columns = joint_model_group_->getVariableCount();
-  jacobian = Eigen::MatrixXd::Zero(rows, columns);
-
-  const robot_state::LinkState *link_state = kinematic_state_->getLinkState(link_name);
-  Eigen::Affine3d link_transform = reference_transform*link_state->getGlobalLinkTransform();
-  Eigen::Vector3d point_transform = link_transform*reference_point_position;
-
-  logDebug("Point from reference origin expressed in world coordinates: %f %f %f",
-           point_transform.x(),
-           point_transform.y(),
-           point_transform.z());
+const robot_model::JointModelGroup::JacobianChain* robot_state::JointStateGroup::getCheckedJacobianChain(const robot_model::LinkModel *link) const
+{
+  const robot_model::JointModelGroup::JacobianChain *chain = link ? joint_model_group_->getJacobianChain(link) : NULL;
+  if (!chain)
+    logError("Link name '%s' does not exist in the group '%s' or is not a child for this group",
+             link ? link->getName().c_str() : "", joint_model_group_->getName().c_str());
+  return chain;
+}
 
-  Eigen::Vector3d joint_axis;
-  Eigen::Affine3d joint_transform;
+Eigen::Affine3d robot_state::JointStateGroup::getJacobianReferenceTransformInverse() const
+{
+  const robot_model::LinkModel *reference_link = joint_model_group_->getJacobianReferenceLink();
+  return (reference_link ? kinematic_state_->getLinkState(reference_link)->getGlobalLinkTransform() :
+          kinematic_state_->getRootTransform()).inverse();
+}
 
-  while (link_state)
+namespace robot_state
+{
+namespace
+{
+// add the contribution of the joint in \e entry, whose child link has transform \e joint_transform, to rows \e row to \e row + 5
+// of \e jacobian, for a point at \e point_transform
+template <typename MatrixType>
+inline void addJacobianColumns(const robot_model::JointModelGroup::JacobianChainEntry &entry, const Eigen::Affine3d &joint_transform,
+                               const Eigen::Vector3d &point_transform, unsigned int row, MatrixType &jacobian)
+{
+  const unsigned int c = entry.column_;
+  switch (entry.type_)
   {
-    /*
-    logDebug("Link: %s, %f %f %f",link_state->getName().c_str(),
-             link_state->getGlobalLinkTransform().translation().x(),
-             link_state->getGlobalLinkTransform().translation().y(),
-             link_state->getGlobalLinkTransform().translation().z());
-    logDebug("Joint: %s",link_state->getParentJointState()->getName().c_str());
-    */
-
-    if (joint_model_group_->isActiveDOF(link_state->getParentJointState()->getJointModel()->getName()))
+  case robot_model::JointModel::REVOLUTE:
     {
-        unsigned int joint_index = joint_model_group_->getJointVariablesIndexMap().find(link_state->getParentJointState()->getJointModel()->getName())->second;
-        double multiplier = 1.0; // to account for mimic joints
-        if (link_state->getParentJointState()->getJointModel()->getMimic())
-        {
-          joint_index = joint_model_group_->getJointVariablesIndexMap().find(link_state->getParentJointState()->getJointModel()->getMimic()->getName())->second;
-          multiplier = link_state->getParentJointState()->getJointModel()->getMimicFactor();
-        }
-      if (link_state->getParentJointState()->getJointModel()->getType() == robot_model::JointModel::REVOLUTE)
-      {
-        joint_transform = reference_transform*link_state->getGlobalLinkTransform();
-        joint_axis = joint_transform.rotation()*(static_cast<const robot_model::RevoluteJointModel*>(link_state->getParentJointState()->getJointModel()))->getAxis();
-        jacobian.block<3,1>(0,joint_index) = jacobian.block<3,1>(0,joint_index) + multiplier * joint_axis.cross(point_transform - joint_transform.translation());
-        jacobian.block<3,1>(3,joint_index) = jacobian.block<3,1>(3,joint_index) + multiplier * joint_axis;
-      }
-      if (link_state->getParentJointState()->getJointModel()->getType() == robot_model::JointModel::PRISMATIC)
-      {
-        joint_transform = reference_transform*link_state->getGlobalLinkTransform();
-        joint_axis = joint_transform*(static_cast<const robot_model::PrismaticJointModel*>(link_state->getParentJointState()->getJointModel()))->getAxis();
-        jacobian.block<3,1>(0,joint_index) = jacobian.block<3,1>(0,joint_index) + multiplier * joint_axis;
-      }
-      if (link_state->getParentJointState()->getJointModel()->getType() == robot_model::JointModel::PLANAR)
-      {
-        joint_transform = reference_transform*link_state->getGlobalLinkTransform();
-        joint_axis = joint_transform*Eigen::Vector3d(1.0,0.0,0.0);
-        jacobian.block<3,1>(0,joint_index) = jacobian.block<3,1>(0,joint_index) + multiplier * joint_axis;
-        joint_axis = joint_transform*Eigen::Vector3d(0.0,1.0,0.0);
-        jacobian.block<3,1>(0,joint_index+1) = jacobian.block<3,1>(0,joint_index+1) + multiplier * joint_axis;
-        joint_axis = joint_transform*Eigen::Vector3d(0.0,0.0,1.0);
-        jacobian.block<3,1>(0,joint_index+2) = jacobian.block<3,1>(0,joint_index+2) + multiplier * joint_axis.cross(point_transform - joint_transform.translation());
-        jacobian.block<3,1>(3,joint_index+2) = jacobian.block<3,1>(3,joint_index+2) + multiplier * joint_axis;
-      }
+      const Eigen::Vector3d joint_axis = joint_transform.rotation() * entry.axis_;
+      jacobian.template block<3,1>(row, c) += entry.multiplier_ * joint_axis.cross(point_transform - joint_transform.translation());
+      jacobian.template block<3,1>(row + 3, c) += entry.multiplier_ * joint_axis;
     }
-    if (link_state->getParentJointState()->getJointModel() == root_joint_model)
-      break;
-    link_state = link_state->getParentLinkState();
+    break;
+  case robot_model::JointModel::PRISMATIC:
+    jacobian.template block<3,1>(row, c) += entry.multiplier_ * (joint_transform.rotation() * entry.axis_);
+    break;
+  case robot_model::JointModel::PLANAR:
+    {
+      jacobian.template block<3,1>(row, c) += entry.multiplier_ * joint_transform.rotation().col(0);
+      jacobian.template block<3,1>(row, c + 1) += entry.multiplier_ * joint_transform.rotation().col(1);
+      const Eigen::Vector3d joint_axis = joint_transform.rotation().col(2);
+      jacobian.template block<3,1>(row, c + 2) += entry.multiplier_ * joint_axis.cross(point_transform - joint_transform.translation());
+      jacobian.template block<3,1>(row + 3, c + 2) += entry.multiplier_ * joint_axis;
+    }
+    break;
+  default:
+    break;
   }
+}
+}
+}
+
+template <typename MatrixType>
+Eigen::Affine3d robot_state::JointStateGroup::computeJacobian(const robot_model::JointModelGroup::JacobianChain &chain,
+                                                              const robot_model::LinkModel *link,
+                                                              const Eigen::Vector3d &reference_point_position,
+                                                              MatrixType &jacobian) const
+{
+  const Eigen::Affine3d reference_transform = getJacobianReferenceTransformInverse();
+  const Eigen::Affine3d link_transform = reference_transform * kinematic_state_->getLinkState(link)->getGlobalLinkTransform();
+  const Eigen::Vector3d point_transform = link_transform * reference_point_position;
+
+  for (std::size_t i = 0 ; i < chain.size() ; ++i)
+    addJacobianColumns(chain[i], reference_transform * kinematic_state_->getLinkState(chain[i].link_)->getGlobalLinkTransform(),
+                       point_transform, 0, jacobian);
+  return link_transform;
+}
+
+bool robot_state::JointStateGroup::getJacobian(const robot_model::LinkModel *link,
+                                               const Eigen::Vector3d &reference_point_position,
+                                               Eigen::MatrixXd& jacobian,
+                                               bool use_quaternion_representation) const
+{
+  const robot_model::JointModelGroup::JacobianChain *chain = getCheckedJacobianChain(link);
+  if (!chain)
+    return false;
+
+  int rows = use_quaternion_representation ? 7 : 6;
+  int columns = joint_model_group_->getVariableCount();
+  jacobian.resize(rows, columns);
+  jacobian.setZero();
+  Eigen::Affine3d link_transform = computeJacobian(*chain, link, reference_point_position, jacobian);
+
   if (use_quaternion_representation) { // Quaternion representation
     // From "Advanced Dynamics and Motion Simulation" by Paul Mitiguy
     // d/dt ( [w] ) = 1/2 * [ -x -y -z ]  * [ omega_1 ]
@@ -1084,16 +1597,79 @@ bool robot_state::JointStateGroup::getJacobian(const std::string &link_name,
     //        [z]           [ -y  x  w ]
     Eigen::Quaterniond q(link_transform.rotation());
     double w = q.w(), x = q.x(), y = q.y(), z = q.z();
-    Eigen::MatrixXd quaternion_update_matrix(4,3);
+    Eigen::Matrix<double, 4, 3> quaternion_update_matrix;
     quaternion_update_matrix << -x, -y, -z,
                                  w, -z,  y,
                                  z,  w, -x,
                                 -y,  x,  w;
-    jacobian.block(3,0,4,columns) = 0.5*quaternion_update_matrix*jacobian.block(3,0, 3, columns);
+    // column by column, since the result overlaps the angular velocity rows it is computed from
+    for (int c = 0 ; c < columns ; ++c)
+    {
+      const Eigen::Vector3d omega = jacobian.block<3,1>(3, c);
+      jacobian.block<4,1>(3, c) = 0.5 * quaternion_update_matrix * omega;
+    }
+  }
+  return true;
+}
+
+template <int DOF>
+bool robot_state::JointStateGroup::getJacobian(const robot_model::LinkModel *link,
+                                               const Eigen::Vector3d &reference_point_position,
+                                               Eigen::Matrix<double, 6, DOF>& jacobian) const
+{
+  if (static_cast<unsigned int>(DOF) != joint_model_group_->getVariableCount())
+  {
+    logError("A Jacobian with %d columns was requested for group '%s', which has %u variables",
+             DOF, joint_model_group_->getName().c_str(), joint_model_group_->getVariableCount());
+    return false;
+  }
+  const robot_model::JointModelGroup::JacobianChain *chain = getCheckedJacobianChain(link);
+  if (!chain)
+    return false;
+  jacobian.setZero();
+  computeJacobian(*chain, link, reference_point_position, jacobian);
+  return true;
+}
+
+bool robot_state::JointStateGroup::getJacobian(const std::vector<const robot_model::LinkModel*> &links,
+                                               const EigenSTL::vector_Vector3d &reference_point_positions,
+                                               Eigen::MatrixXd& jacobian) const
+{
+  if (links.size() != reference_point_positions.size())
+  {
+    logError("Jacobians requested for %u links but %u reference points were specified",
+             (unsigned int)links.size(), (unsigned int)reference_point_positions.size());
+    return false;
+  }
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    if (!getCheckedJacobianChain(links[i]))
+      return false;
+
+  jacobian.resize(6 * links.size(), joint_model_group_->getVariableCount());
+  jacobian.setZero();
+
+  // the transforms of the joints are shared by all the links they move
+  const Eigen::Affine3d reference_transform = getJacobianReferenceTransformInverse();
+  const std::vector<const robot_model::LinkModel*> &joint_links = joint_model_group_->getJacobianJointLinks();
+  EigenSTL::vector_Affine3d joint_transforms(joint_links.size());
+  for (std::size_t j = 0 ; j < joint_links.size() ; ++j)
+    joint_transforms[j] = reference_transform * kinematic_state_->getLinkState(joint_links[j])->getGlobalLinkTransform();
+
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const robot_model::JointModelGroup::JacobianChain &chain = *joint_model_group_->getJacobianChain(links[i]);
+    const Eigen::Vector3d point_transform = reference_transform * (kinematic_state_->getLinkState(links[i])->getGlobalLinkTransform() * reference_point_positions[i]);
+    for (std::size_t k = 0 ; k < chain.size() ; ++k)
+      addJacobianColumns(chain[k], joint_transforms[chain[k].joint_index_], point_transform, 6 * i, jacobian);
   }
   return true;
 }
 
+template bool robot_state::JointStateGroup::getJacobian<6>(const robot_model::LinkModel *link, const Eigen::Vector3d &reference_point_position,
+                                                           Eigen::Matrix<double, 6, 6>& jacobian) const;
+template bool robot_state::JointStateGroup::getJacobian<7>(const robot_model::LinkModel *link, const Eigen::Vector3d &reference_point_position,
+                                                           Eigen::Matrix<double, 6, 7>& jacobian) const;
+
 std::pair<double,int> robot_state::JointStateGroup::getMinDistanceToBounds() const
 {
   double distance = std::numeric_limits<double>::max();
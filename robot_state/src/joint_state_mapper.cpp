@@ -0,0 +1,114 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/robot_state/joint_state_mapper.h>
+
+robot_state::JointStateMapper::JointStateMapper() : model_(NULL)
+{
+}
+
+void robot_state::JointStateMapper::clear()
+{
+  model_ = NULL;
+  names_.clear();
+  targets_.clear();
+}
+
+void robot_state::JointStateMapper::rebuild(const sensor_msgs::JointState &js, const RobotState &state)
+{
+  model_ = state.getRobotModel().get();
+  names_ = js.name;
+  targets_.clear();
+
+  std::map<std::string, int> msg_index;
+  for (std::size_t i = 0 ; i < js.name.size() ; ++i)
+    msg_index[js.name[i]] = i;
+
+  const std::vector<JointState*> &jsv = state.getJointStateVector();
+  for (std::size_t i = 0 ; i < jsv.size() ; ++i)
+  {
+    if (jsv[i]->getVariableCount() == 0 || jsv[i]->getJointModel()->getMimic())
+      continue;
+    const std::vector<std::string> &var_names = jsv[i]->getVariableNames();
+    Target t;
+    t.joint_index = i;
+    t.msg_index.resize(var_names.size(), -1);
+    bool found = false;
+    for (std::size_t j = 0 ; j < var_names.size() ; ++j)
+    {
+      std::map<std::string, int>::const_iterator it = msg_index.find(var_names[j]);
+      if (it != msg_index.end())
+      {
+        t.msg_index[j] = it->second;
+        found = true;
+      }
+    }
+    if (found)
+    {
+      t.values.resize(var_names.size());
+      targets_.push_back(t);
+    }
+  }
+}
+
+bool robot_state::JointStateMapper::apply(const sensor_msgs::JointState &js, RobotState &state)
+{
+  if (model_ != state.getRobotModel().get() || names_ != js.name)
+    rebuild(js, state);
+
+  const int position_size = js.position.size();
+  const std::vector<JointState*> &jsv = state.getJointStateVector();
+  for (std::size_t i = 0 ; i < targets_.size() ; ++i)
+  {
+    Target &t = targets_[i];
+    JointState *joint_state = jsv[t.joint_index];
+    const std::vector<double> &current = joint_state->getVariableValues();
+    bool changed = false;
+    for (std::size_t j = 0 ; j < t.msg_index.size() ; ++j)
+    {
+      if (t.msg_index[j] >= 0 && t.msg_index[j] < position_size)
+      {
+        t.values[j] = js.position[t.msg_index[j]];
+        changed = true;
+      }
+      else
+        t.values[j] = current[j];
+    }
+    if (changed)
+      joint_state->setVariableValues(&t.values[0]);
+  }
+  state.updateLinkTransforms();
+  return js.position.size() >= js.name.size();
+}
@@ -37,11 +37,13 @@
 #include <moveit/robot_state/link_state.h>
 #include <moveit/robot_state/robot_state.h>
 
-robot_state::LinkState::LinkState(RobotState *state, const robot_model::LinkModel* lm) :
-  robot_state_(state), link_model_(lm), parent_joint_state_(NULL), parent_link_state_(NULL)
+robot_state::LinkState::LinkState(RobotState *state, const robot_model::LinkModel* lm, Eigen::Affine3d *transforms) :
+  robot_state_(state), link_model_(lm), parent_joint_state_(NULL), parent_link_state_(NULL),
+  fk_step_(NULL), fk_parent_link_state_(NULL),
+  global_link_transform_(transforms), global_collision_body_transform_(transforms + 1), updated_(false)
 {
-  global_link_transform_.setIdentity();
-  global_collision_body_transform_.setIdentity();
+  global_link_transform_->setIdentity();
+  global_collision_body_transform_->setIdentity();
 }
 
 robot_state::LinkState::~LinkState()
@@ -50,41 +52,42 @@ robot_state::LinkState::~LinkState()
 
 void robot_state::LinkState::computeTransformForward(const Eigen::Affine3d& parent_transform)
 {
-  global_link_transform_ = parent_transform;
+  *global_link_transform_ = parent_transform;
 
   // do fwd transforms
   const std::vector<robot_model::JointModel*> &child_jmodels = link_model_->getChildJointModels();
   for (std::size_t i = 0 ; i < child_jmodels.size() ; ++i)
-    robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel()->getName())->computeTransformForward(this);
+    robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel())->computeTransformForward(this);
 
   computeGeometryTransforms();
 }
 
 void robot_state::LinkState::computeTransformForward(const LinkState *parent_link)
 {
-  global_link_transform_ = parent_link->global_link_transform_ * link_model_->getJointOriginTransform() * parent_joint_state_->getVariableTransform();
+  parent_joint_state_->getJointModel()->composeTransform(*parent_link->global_link_transform_ * link_model_->getJointOriginTransform(),
+                                                         parent_joint_state_->getVariableTransform(), *global_link_transform_);
 
   // do fwd transforms
   const std::vector<robot_model::JointModel*> &child_jmodels = link_model_->getChildJointModels();
   for (std::size_t i = 0 ; i < child_jmodels.size() ; ++i)
-    robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel()->getName())->computeTransformForward(this);
+    robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel())->computeTransformForward(this);
 
   computeGeometryTransforms();
 }
 
 void robot_state::LinkState::computeTransformBackward(const LinkState *child_link)
 {
-  global_link_transform_ = child_link->global_link_transform_ * (child_link->link_model_->getJointOriginTransform() * child_link->parent_joint_state_->getVariableTransform()).inverse();
+  *global_link_transform_ = *child_link->global_link_transform_ * (child_link->link_model_->getJointOriginTransform() * child_link->parent_joint_state_->getVariableTransform()).inverse();
   if (parent_link_state_)
     parent_link_state_->computeTransformBackward(this);
   else
-    parent_joint_state_->setVariableValues(global_link_transform_);
+    parent_joint_state_->setVariableValues(*global_link_transform_);
 
   // do fwd transforms
   const std::vector<robot_model::JointModel*> &child_jmodels = link_model_->getChildJointModels();
   for (std::size_t i = 0 ; i < child_jmodels.size() ; ++i)
   {
-    LinkState *child = robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel()->getName());
+    LinkState *child = robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel());
     if (child != child_link)
       child->computeTransformForward(this);
   }
@@ -94,36 +97,40 @@ void robot_state::LinkState::computeTransformBackward(const LinkState *child_lin
 
 void robot_state::LinkState::computeTransformBackward(const Eigen::Affine3d& child_transform)
 {
-  global_link_transform_ = child_transform;
+  *global_link_transform_ = child_transform;
   if (parent_link_state_)
     parent_link_state_->computeTransformBackward(this);
   else
-    parent_joint_state_->setVariableValues(global_link_transform_);
+    parent_joint_state_->setVariableValues(*global_link_transform_);
   // do fwd transforms
   const std::vector<robot_model::JointModel*> &child_jmodels = link_model_->getChildJointModels();
   for (std::size_t i = 0 ; i < child_jmodels.size() ; ++i)
-    robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel()->getName())->computeTransformForward(this);
+    robot_state_->getLinkState(child_jmodels[i]->getChildLinkModel())->computeTransformForward(this);
 
   computeGeometryTransforms();
 }
 
 void robot_state::LinkState::computeGeometryTransforms()
 {
-  global_collision_body_transform_ = global_link_transform_ * link_model_->getCollisionOriginTransform();
+  *global_collision_body_transform_ = *global_link_transform_ * link_model_->getCollisionOriginTransform();
   updateAttachedBodies();
 }
 
 void robot_state::LinkState::computeTransform()
 {
-  global_link_transform_ = (parent_link_state_ ? parent_link_state_->global_link_transform_ : robot_state_->getRootTransform())
-    * link_model_->getJointOriginTransform() * parent_joint_state_->getVariableTransform();
+  const Eigen::Affine3d &parent = fk_parent_link_state_ ? *fk_parent_link_state_->global_link_transform_ : robot_state_->getRootTransform();
+  if (fk_step_->joint_)
+    fk_step_->joint_->composeTransform(parent * fk_step_->origin_, parent_joint_state_->getVariableTransform(), *global_link_transform_);
+  else
+    // a chain of fixed joints, collapsed into one transform by the model
+    *global_link_transform_ = parent * fk_step_->origin_;
   computeGeometryTransforms();
 }
 
 void robot_state::LinkState::updateAttachedBodies()
 {
   for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ;  ++it)
-    it->second->computeTransform(global_link_transform_);
+    it->second->computeTransform(*global_link_transform_);
 }
 
 bool robot_state::LinkState::hasAttachedBody(const std::string &id) const
@@ -35,6 +35,9 @@
 /* Author: Ioan Sucan, E. Gil Jones */
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/thread_random_numbers.h>
+#include <moveit/profiler/query_counters.h>
+#include <moveit/profiler/memory_usage.h>
 #include <geometric_shapes/shape_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <ros/console.h>
@@ -47,6 +50,8 @@ robot_state::RobotState::RobotState(const robot_model::RobotModelConstPtr &kinem
 
 random_numbers::RandomNumberGenerator& robot_state::RobotState::getRandomNumberGenerator()
 {
+  if (getUseThreadRandomNumberGenerators())
+    return getThreadRandomNumberGenerator();
   if (!rng_)
     rng_.reset(new random_numbers::RandomNumberGenerator());
   return *rng_;
@@ -55,21 +60,25 @@ random_numbers::RandomNumberGenerator& robot_state::RobotState::getRandomNumberG
 void robot_state::RobotState::buildState()
 {
   const std::vector<const robot_model::JointModel*>& joint_model_vector = kinematic_model_->getJointModels();
-  joint_state_vector_.resize(joint_model_vector.size());
+  const std::vector<const robot_model::LinkModel*>& link_model_vector = kinematic_model_->getLinkModels();
+
+  // allocate the memory for all the transforms at once; this vector is never resized after this point,
+  // so joint states and link states can safely keep pointers into it
+  transforms_.resize(joint_model_vector.size() + 2 * link_model_vector.size());
 
   // create joint states
+  joint_state_vector_.resize(joint_model_vector.size());
   for (std::size_t i = 0; i < joint_model_vector.size() ; ++i)
   {
-    joint_state_vector_[i] = new JointState(joint_model_vector[i]);
+    joint_state_vector_[i] = new JointState(joint_model_vector[i], &transforms_[i]);
     joint_state_map_[joint_state_vector_[i]->getName()] = joint_state_vector_[i];
   }
 
   // create link states
-  const std::vector<const robot_model::LinkModel*>& link_model_vector = kinematic_model_->getLinkModels();
   link_state_vector_.resize(link_model_vector.size());
   for (std::size_t i = 0 ; i < link_model_vector.size() ; ++i)
   {
-    link_state_vector_[i] = new LinkState(this, link_model_vector[i]);
+    link_state_vector_[i] = new LinkState(this, link_model_vector[i], &transforms_[joint_model_vector.size() + 2 * i]);
     link_state_map_[link_state_vector_[i]->getName()] = link_state_vector_[i];
   }
 
@@ -77,17 +86,29 @@ void robot_state::RobotState::buildState()
   for (std::size_t i = 0; i < link_state_vector_.size(); ++i)
   {
     const robot_model::JointModel* parent_joint_model = link_state_vector_[i]->getLinkModel()->getParentJointModel();
-    link_state_vector_[i]->parent_joint_state_ = joint_state_map_[parent_joint_model->getName()];
+    link_state_vector_[i]->parent_joint_state_ = getJointState(parent_joint_model);
     if (parent_joint_model->getParentLinkModel() != NULL)
-      link_state_vector_[i]->parent_link_state_ = link_state_map_[parent_joint_model->getParentLinkModel()->getName()];
+      link_state_vector_[i]->parent_link_state_ = getLinkState(parent_joint_model->getParentLinkModel());
   }
 
-  // compute mimic joint state pointers
-  for (std::size_t i = 0; i < joint_state_vector_.size(); ++i)
+  // link states are in the order of the link models, so the forward kinematics table can be indexed directly
+  const robot_model::RobotModel::ForwardKinematicsSteps &fk_steps = kinematic_model_->getForwardKinematicsSteps();
+  for (std::size_t i = 0; i < link_state_vector_.size(); ++i)
+  {
+    link_state_vector_[i]->fk_step_ = &fk_steps[i];
+    if (fk_steps[i].parent_index_ >= 0)
+      link_state_vector_[i]->fk_parent_link_state_ = link_state_vector_[fk_steps[i].parent_index_];
+  }
+
+  // compute mimic joint state pointers from the mimic table of the model
+  const std::vector<robot_model::RobotModel::MimicUpdate> &mimic_updates = kinematic_model_->getMimicUpdates();
+  for (std::size_t i = 0; i < mimic_updates.size(); ++i)
   {
-    const std::vector<const robot_model::JointModel*> &mr = joint_state_vector_[i]->joint_model_->getMimicRequests();
-    for (std::size_t j = 0 ; j < mr.size() ; ++j)
-      joint_state_vector_[i]->mimic_requests_.push_back(joint_state_map_[mr[j]->getName()]);
+    JointState::MimicRequest request;
+    request.joint_ = joint_state_vector_[mimic_updates[i].target_->getTreeIndex()];
+    request.factor_ = mimic_updates[i].factor_;
+    request.offset_ = mimic_updates[i].offset_;
+    joint_state_vector_[mimic_updates[i].source_->getTreeIndex()]->mimic_requests_.push_back(request);
   }
 
   // now make joint_state_groups
@@ -108,9 +129,8 @@ robot_state::RobotState& robot_state::RobotState::operator=(const RobotState &ot
   return *this;
 }
 
-void robot_state::RobotState::copyFrom(const RobotState &ks)
+void robot_state::RobotState::freeState()
 {
-  //need to delete anything already in the state
   for (std::size_t i = 0; i < joint_state_vector_.size(); i++)
     delete joint_state_vector_[i];
   for (std::size_t i = 0; i < link_state_vector_.size(); i++)
@@ -118,34 +138,53 @@ void robot_state::RobotState::copyFrom(const RobotState &ks)
   for (std::map<std::string, JointStateGroup*>::iterator it = joint_state_group_map_.begin();
        it != joint_state_group_map_.end(); ++it)
     delete it->second;
+  joint_state_vector_.clear();
+  joint_state_map_.clear();
+  link_state_vector_.clear();
+  link_state_map_.clear();
+  joint_state_group_map_.clear();
+  transforms_.clear();
+}
 
-  kinematic_model_ = ks.getRobotModel();
+void robot_state::RobotState::copyFrom(const RobotState &ks)
+{
+  if (this == &ks)
+    return;
+
+  // the attached bodies are re-created below
+  clearAttachedBodies();
+
+  // the structure of the state only needs to be re-created if the model changes
+  if (!kinematic_model_ || kinematic_model_ != ks.kinematic_model_)
+  {
+    freeState();
+    kinematic_model_ = ks.getRobotModel();
+    buildState();
+  }
   root_transform_ = ks.root_transform_;
 
-  // construct state
-  buildState();
+  // copy the joint values; the sizes match, so no memory is allocated
+  for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
+  {
+    joint_state_vector_[i]->joint_state_values_ = ks.joint_state_vector_[i]->joint_state_values_;
+    joint_state_vector_[i]->horrible_velocity_placeholder_ = ks.joint_state_vector_[i]->horrible_velocity_placeholder_;
+    joint_state_vector_[i]->horrible_acceleration_placeholder_ = ks.joint_state_vector_[i]->horrible_acceleration_placeholder_;
+    joint_state_vector_[i]->dirty_ = ks.joint_state_vector_[i]->dirty_;
+  }
 
-  // copy attached bodies
-  clearAttachedBodies();
-  for (std::map<std::string, AttachedBody*>::const_iterator it = ks.attached_body_map_.begin() ; it != ks.attached_body_map_.end() ; ++it)
-    attachBody(it->second->getName(), it->second->getShapes(), it->second->getFixedTransforms(),
-               it->second->getTouchLinks(), it->second->getAttachedLinkName(), it->second->getDetachPosture());
+  // copy all the transforms (joint variable transforms, link transforms, collision body transforms) in one go;
+  // since the values are consistent with the transforms, there is no need to recompute forward kinematics
+  transforms_ = ks.transforms_;
 
-  std::map<std::string, double> current_joint_values;
-  ks.getStateValues(current_joint_values);
-  setStateValues(current_joint_values);
+  // copy attached bodies; the copies share the definition of the bodies with the originals
+  for (std::map<std::string, AttachedBody*>::const_iterator it = ks.attached_body_map_.begin() ; it != ks.attached_body_map_.end() ; ++it)
+    attachBody(new AttachedBody(*it->second));
 }
 
 robot_state::RobotState::~RobotState()
 {
   clearAttachedBodies(); // we call this instead of just deleting so we get the attached body callbacks
-  for (std::size_t i = 0; i < joint_state_vector_.size(); i++)
-    delete joint_state_vector_[i];
-  for (std::size_t i = 0; i < link_state_vector_.size(); i++)
-    delete link_state_vector_[i];
-  for (std::map<std::string, JointStateGroup*>::iterator it = joint_state_group_map_.begin();
-       it != joint_state_group_map_.end(); ++it)
-    delete it->second;
+  freeState();
 }
 
 bool robot_state::RobotState::setStateValues(const std::vector<double>& joint_state_values)
@@ -247,10 +286,68 @@ void robot_state::RobotState::getStateValues(sensor_msgs::JointState& js) const
   }
 }
 
+bool robot_state::RobotState::copyGroupValues(const RobotState &src, const robot_model::JointModelGroup *group)
+{
+  if (src.kinematic_model_ != kinematic_model_)
+  {
+    logError("Values of group '%s' can only be copied between states of the same model", group->getName().c_str());
+    return false;
+  }
+  JointStateGroup *jsg = getJointStateGroup(group->getName());
+  if (!jsg || jsg->getJointModelGroup() != group)
+  {
+    logError("Group '%s' is not part of the model of this state", group->getName().c_str());
+    return false;
+  }
+  if (this == &src)
+    return true;
+
+  // the variable transforms of the joints are at the start of transforms_, in the order of the joint states
+  const std::vector<std::pair<unsigned int, unsigned int> > &ranges = group->getJointIndexRanges();
+  for (std::size_t i = 0 ; i < ranges.size() ; ++i)
+  {
+    const unsigned int end = ranges[i].first + ranges[i].second;
+    std::copy(src.transforms_.begin() + ranges[i].first, src.transforms_.begin() + end, transforms_.begin() + ranges[i].first);
+    for (unsigned int j = ranges[i].first ; j < end ; ++j)
+    {
+      JointState *js = joint_state_vector_[j];
+      const std::vector<double> &values = src.joint_state_vector_[j]->joint_state_values_;
+      std::copy(values.begin(), values.end(), js->joint_state_values_.begin());
+      js->dirty_ = true;
+      if (!js->mimic_requests_.empty())
+        js->updateMimicJoints();
+    }
+  }
+  jsg->updateLinkTransforms();
+  return true;
+}
+
 void robot_state::RobotState::updateLinkTransforms()
 {
-  for(unsigned int i = 0; i < link_state_vector_.size(); i++)
-    link_state_vector_[i]->computeTransform();
+  updateLinkTransforms(link_state_vector_);
+}
+
+void robot_state::RobotState::updateLinkTransforms(const std::vector<LinkState*> &links)
+{
+  moveit::tools::QueryCounters::count(moveit::tools::FK_UPDATES);
+
+  // since links are in depth-first order, parent links are always processed before their children
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    LinkState *ls = links[i];
+    if (ls->parent_joint_state_->dirty_ || (ls->parent_link_state_ && ls->parent_link_state_->updated_))
+    {
+      ls->computeTransform();
+      ls->updated_ = true;
+    }
+  }
+
+  // the transforms of the links below each of these joints are now up to date
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    links[i]->updated_ = false;
+    links[i]->parent_joint_state_->dirty_ = false;
+  }
 }
 
 bool robot_state::RobotState::updateStateWithLinkAt(const std::string& link_name, const Eigen::Affine3d& transform, bool backward)
@@ -258,10 +355,15 @@ bool robot_state::RobotState::updateStateWithLinkAt(const std::string& link_name
   if (!hasLinkState(link_name))
     return false;
 
+  LinkState *ls = link_state_map_[link_name];
   if (backward)
-    link_state_map_[link_name]->computeTransformBackward(transform);
+    ls->computeTransformBackward(transform);
   else
-    link_state_map_[link_name]->computeTransformForward(transform);
+  {
+    ls->computeTransformForward(transform);
+    // the link transforms no longer match the joint values; make sure the next call to updateLinkTransforms() recomputes them
+    ls->parent_joint_state_->dirty_ = true;
+  }
 
   return true;
 }
@@ -274,6 +376,9 @@ const Eigen::Affine3d& robot_state::RobotState::getRootTransform() const
 void robot_state::RobotState::setRootTransform(const Eigen::Affine3d &transform)
 {
   root_transform_ = transform;
+  // the transforms of all links depend on the root transform
+  if (!link_state_vector_.empty())
+    link_state_vector_[0]->parent_joint_state_->dirty_ = true;
 }
 
 void robot_state::RobotState::setToDefaultValues()
@@ -527,34 +632,27 @@ namespace
 {
 static inline void updateAABB(const Eigen::Affine3d &t, const Eigen::Vector3d &e, std::vector<double> &aabb)
 {
-  Eigen::Vector3d v = e / 2.0;
-  Eigen::Vector3d c2 = t * v;
-  v = -v;
-  Eigen::Vector3d c1 = t * v;
+  // the box with extents e centered at the origin of t, rotated by t, is bounded by c +/- |R| e / 2
+  const Eigen::Vector3d c = t.translation();
+  const Eigen::Vector3d h = t.linear().cwiseAbs() * e / 2.0;
   if (aabb.empty())
   {
     aabb.resize(6);
-    aabb[0] = c1.x();
-    aabb[2] = c1.y();
-    aabb[4] = c1.z();
-    aabb[1] = c2.x();
-    aabb[3] = c2.y();
-    aabb[5] = c2.z();
+    aabb[0] = c.x() - h.x();
+    aabb[2] = c.y() - h.y();
+    aabb[4] = c.z() - h.z();
+    aabb[1] = c.x() + h.x();
+    aabb[3] = c.y() + h.y();
+    aabb[5] = c.z() + h.z();
   }
   else
   {
-    if (aabb[0] > c1.x())
-      aabb[0] = c1.x();
-    if (aabb[2] > c1.y())
-      aabb[2] = c1.y();
-    if (aabb[4] > c1.z())
-      aabb[4] = c1.z();
-    if (aabb[1] < c2.x())
-      aabb[1] = c2.x();
-    if (aabb[3] < c2.y())
-      aabb[3] = c2.y();
-    if (aabb[5] < c2.z())
-      aabb[5] = c2.z();
+    aabb[0] = std::min(aabb[0], c.x() - h.x());
+    aabb[2] = std::min(aabb[2], c.y() - h.y());
+    aabb[4] = std::min(aabb[4], c.z() - h.z());
+    aabb[1] = std::max(aabb[1], c.x() + h.x());
+    aabb[3] = std::max(aabb[3], c.y() + h.y());
+    aabb[5] = std::max(aabb[5], c.z() + h.z());
   }
 }
 }
@@ -564,6 +662,9 @@ void robot_state::RobotState::computeAABB(std::vector<double> &aabb) const
   aabb.clear();
   for (std::size_t i = 0; i < link_state_vector_.size(); ++i)
   {
+    // links without geometry do not contribute to the bounding box
+    if (!link_state_vector_[i]->getLinkModel()->getShape())
+      continue;
     const Eigen::Affine3d &t = link_state_vector_[i]->getGlobalCollisionBodyTransform();
     const Eigen::Vector3d &e = link_state_vector_[i]->getLinkModel()->getShapeExtentsAtOrigin();
     updateAABB(t, e, aabb);
@@ -571,17 +672,69 @@ void robot_state::RobotState::computeAABB(std::vector<double> &aabb) const
   for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
   {
     const EigenSTL::vector_Affine3d &ts = it->second->getGlobalCollisionBodyTransforms();
-    const std::vector<shapes::ShapeConstPtr> &ss = it->second->getShapes();
+    const EigenSTL::vector_Vector3d &es = it->second->getShapeExtents();
     for (std::size_t i = 0 ; i < ts.size() ; ++i)
-    {
-      Eigen::Vector3d e = shapes::computeShapeExtents(ss[i].get());
-      updateAABB(ts[i], e, aabb);
-    }
+      updateAABB(ts[i], es[i], aabb);
   }
   if (aabb.empty())
     aabb.resize(6, 0.0);
 }
 
+void robot_state::RobotState::computeBoundingSphere(Eigen::Vector3d &center, double &radius) const
+{
+  std::vector<double> aabb;
+  computeAABB(aabb);
+  center = Eigen::Vector3d((aabb[0] + aabb[1]) / 2.0, (aabb[2] + aabb[3]) / 2.0, (aabb[4] + aabb[5]) / 2.0);
+  radius = 0.0;
+  for (std::size_t i = 0; i < link_state_vector_.size(); ++i)
+  {
+    const robot_model::LinkModel *lm = link_state_vector_[i]->getLinkModel();
+    if (!lm->getShape())
+      continue;
+    double r = (link_state_vector_[i]->getGlobalCollisionBodyTransform().translation() - center).norm() + lm->getBoundingSphereRadius();
+    if (r > radius)
+      radius = r;
+  }
+  for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
+  {
+    const EigenSTL::vector_Affine3d &ts = it->second->getGlobalCollisionBodyTransforms();
+    const EigenSTL::vector_Vector3d &es = it->second->getShapeExtents();
+    for (std::size_t i = 0 ; i < ts.size() ; ++i)
+    {
+      double r = (ts[i].translation() - center).norm() + es[i].norm() / 2.0;
+      if (r > radius)
+        radius = r;
+    }
+  }
+}
+
+std::size_t robot_state::RobotState::getMemoryUsage() const
+{
+  using moveit::tools::estimateMapNodeBytes;
+  std::size_t bytes = sizeof(*this) + transforms_.capacity() * sizeof(Eigen::Affine3d) +
+    joint_state_vector_.capacity() * sizeof(JointState*) + link_state_vector_.capacity() * sizeof(LinkState*) +
+    joint_state_map_.size() * estimateMapNodeBytes<std::string, JointState*>() +
+    link_state_map_.size() * estimateMapNodeBytes<std::string, LinkState*>() +
+    joint_state_group_map_.size() * estimateMapNodeBytes<std::string, JointStateGroup*>() +
+    attached_body_map_.size() * estimateMapNodeBytes<std::string, AttachedBody*>();
+  for (std::size_t i = 0 ; i < joint_state_vector_.size() ; ++i)
+  {
+    const JointState *js = joint_state_vector_[i];
+    bytes += sizeof(JointState) + (js->joint_state_values_.capacity() + js->horrible_velocity_placeholder_.capacity() +
+                                   js->horrible_acceleration_placeholder_.capacity()) * sizeof(double) +
+      js->mimic_requests_.capacity() * sizeof(JointState::MimicRequest);
+    if (js->owns_variable_transform_)
+      bytes += sizeof(Eigen::Affine3d);
+  }
+  for (std::size_t i = 0 ; i < link_state_vector_.size() ; ++i)
+    bytes += sizeof(LinkState) + link_state_vector_[i]->attached_body_map_.size() * estimateMapNodeBytes<std::string, AttachedBody*>();
+  for (std::map<std::string, JointStateGroup*>::const_iterator it = joint_state_group_map_.begin() ; it != joint_state_group_map_.end() ; ++it)
+    bytes += sizeof(JointStateGroup) + it->second->getJointStateVector().size() * (2 * sizeof(JointState*) + estimateMapNodeBytes<std::string, JointState*>());
+  for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
+    bytes += it->second->getMemoryUsage();
+  return bytes;
+}
+
 double robot_state::RobotState::distance(const RobotState &state) const
 {
   double d = 0.0;
@@ -598,28 +751,80 @@ void robot_state::RobotState::interpolate(const RobotState &to, const double t,
   dest.updateLinkTransforms();
 }
 
+robot_state::FrameHandle::FrameHandle(const robot_model::RobotModel &model, const std::string &frame_id) :
+  type_(ATTACHED_BODY),
+  link_(NULL),
+  name_(!frame_id.empty() && frame_id[0] == '/' ? frame_id.substr(1) : frame_id)
+{
+  if (name_ == model.getModelFrame())
+    type_ = MODEL_FRAME;
+  else
+    if (model.hasLinkModel(name_))
+    {
+      type_ = LINK;
+      link_ = model.getLinkModel(name_);
+    }
+}
+
+namespace robot_state
+{
+namespace
+{
+const Eigen::Affine3d& getIdentityTransform()
+{
+  static const Eigen::Affine3d identity_transform = Eigen::Affine3d::Identity();
+  return identity_transform;
+}
+}
+}
+
 const Eigen::Affine3d& robot_state::RobotState::getFrameTransform(const std::string &id) const
 {
   if (!id.empty() && id[0] == '/')
     return getFrameTransform(id.substr(1));
-  static const Eigen::Affine3d identity_transform = Eigen::Affine3d::Identity();
   if (id == kinematic_model_->getModelFrame())
-    return identity_transform;
+    return getIdentityTransform();
   std::map<std::string, LinkState*>::const_iterator it = link_state_map_.find(id);
   if (it != link_state_map_.end())
     return it->second->getGlobalLinkTransform();
+  return getAttachedBodyFrameTransform(id);
+}
+
+const Eigen::Affine3d& robot_state::RobotState::getFrameTransform(const FrameHandle &frame) const
+{
+  switch (frame.getType())
+  {
+  case FrameHandle::MODEL_FRAME:
+    return getIdentityTransform();
+  case FrameHandle::LINK:
+    {
+      const LinkState *ls = getLinkState(frame.getLinkModel());
+      if (ls)
+        return ls->getGlobalLinkTransform();
+      return getFrameTransform(frame.getName());
+    }
+  case FrameHandle::ATTACHED_BODY:
+    return getAttachedBodyFrameTransform(frame.getName());
+  default:
+    logError("Transform requested for an unresolved frame");
+    return getIdentityTransform();
+  }
+}
+
+const Eigen::Affine3d& robot_state::RobotState::getAttachedBodyFrameTransform(const std::string &id) const
+{
   std::map<std::string, AttachedBody*>::const_iterator jt = attached_body_map_.find(id);
   if (jt == attached_body_map_.end())
   {
     logError("Transform from frame '%s' to frame '%s' is not known ('%s' should be a link name or an attached body id).",
              id.c_str(), kinematic_model_->getModelFrame().c_str(), id.c_str());
-    return identity_transform;
+    return getIdentityTransform();
   }
   const EigenSTL::vector_Affine3d &tf = jt->second->getGlobalCollisionBodyTransforms();
   if (tf.empty())
   {
     logError("Attached body '%s' has no geometry associated to it. No transform to return.", id.c_str());
-    return identity_transform;
+    return getIdentityTransform();
   }
   if (tf.size() > 1)
     logWarn("There are multiple geometries associated to attached body '%s'. Returning the transform for the first one.", id.c_str());
@@ -636,6 +841,24 @@ bool robot_state::RobotState::knowsFrameTransform(const std::string &id) const
   return it != attached_body_map_.end() && it->second->getGlobalCollisionBodyTransforms().size() == 1;
 }
 
+bool robot_state::RobotState::knowsFrameTransform(const FrameHandle &frame) const
+{
+  switch (frame.getType())
+  {
+  case FrameHandle::MODEL_FRAME:
+    return true;
+  case FrameHandle::LINK:
+    return getLinkState(frame.getLinkModel()) != NULL;
+  case FrameHandle::ATTACHED_BODY:
+    {
+      std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.find(frame.getName());
+      return it != attached_body_map_.end() && it->second->getGlobalCollisionBodyTransforms().size() == 1;
+    }
+  default:
+    return false;
+  }
+}
+
 // ------ marker functions ------
 
 void robot_state::RobotState::getRobotMarkers(visualization_msgs::MarkerArray& arr,
@@ -0,0 +1,115 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/robot_state/robot_state_pool.h>
+#include <boost/bind.hpp>
+
+robot_state::RobotStatePool::RobotStatePool(const robot_model::RobotModelConstPtr &kinematic_model, std::size_t max_free_states) :
+  kinematic_model_(kinematic_model), storage_(new Storage())
+{
+  storage_->max_free_states_ = max_free_states;
+}
+
+robot_state::RobotStatePool::~RobotStatePool()
+{
+  boost::mutex::scoped_lock slock(storage_->lock_);
+  for (std::size_t i = 0 ; i < storage_->free_states_.size() ; ++i)
+    delete storage_->free_states_[i];
+  storage_->free_states_.clear();
+}
+
+robot_state::RobotStatePtr robot_state::RobotStatePool::allocStateInternal(bool set_default)
+{
+  RobotState *state = NULL;
+  {
+    boost::mutex::scoped_lock slock(storage_->lock_);
+    if (!storage_->free_states_.empty())
+    {
+      state = storage_->free_states_.back();
+      storage_->free_states_.pop_back();
+    }
+  }
+  if (!state)
+    state = new RobotState(kinematic_model_);
+  if (set_default)
+  {
+    state->setRootTransform(Eigen::Affine3d::Identity());
+    state->setToDefaultValues();
+  }
+  return RobotStatePtr(state, boost::bind(&RobotStatePool::releaseState, boost::weak_ptr<Storage>(storage_), _1));
+}
+
+robot_state::RobotStatePtr robot_state::RobotStatePool::allocState()
+{
+  return allocStateInternal(true);
+}
+
+robot_state::RobotStatePtr robot_state::RobotStatePool::allocState(const RobotState &state)
+{
+  if (state.getRobotModel() != kinematic_model_)
+  {
+    logError("RobotStatePool: State to copy uses model '%s' instead of model '%s'",
+             state.getRobotModel()->getName().c_str(), kinematic_model_->getName().c_str());
+    return RobotStatePtr();
+  }
+  RobotStatePtr result = allocStateInternal(false);
+  *result = state;
+  return result;
+}
+
+std::size_t robot_state::RobotStatePool::getFreeStateCount() const
+{
+  boost::mutex::scoped_lock slock(storage_->lock_);
+  return storage_->free_states_.size();
+}
+
+void robot_state::RobotStatePool::releaseState(const boost::weak_ptr<Storage> &storage, RobotState *state)
+{
+  // same as what the destructor of RobotState does: attached body callbacks are called
+  state->clearAttachedBodies();
+  state->setAttachedBodyUpdateCallback(AttachedBodyCallback());
+
+  boost::shared_ptr<Storage> s = storage.lock();
+  if (s)
+  {
+    boost::mutex::scoped_lock slock(s->lock_);
+    if (s->free_states_.size() < s->max_free_states_)
+    {
+      s->free_states_.push_back(state);
+      return;
+    }
+  }
+  delete state;
+}
@@ -48,14 +48,33 @@ robot_state::StateTransforms::StateTransforms(const std::string &target_frame, c
 
 bool robot_state::StateTransforms::canTransform(const std::string &from_frame) const
 {
-  if (state_ && state_->knowsFrameTransform(from_frame))
+  if (state_ && state_->knowsFrameTransform(FrameHandle(*state_->getRobotModel(), from_frame)))
     return true;
   return Transforms::canTransform(from_frame);
 }
 
-const Eigen::Affine3d& robot_state::StateTransforms::getTransform(const std::string &from_frame) const
+Eigen::Affine3d robot_state::StateTransforms::getTransform(const std::string &from_frame) const
 {
-  if (state_ && state_->knowsFrameTransform(from_frame))
-    return state_->getFrameTransform(from_frame);
+  if (state_)
+  {
+    // resolve the frame once, rather than once to check it is known and once more to get it
+    FrameHandle frame(*state_->getRobotModel(), from_frame);
+    if (state_->knowsFrameTransform(frame))
+      return state_->getFrameTransform(frame);
+  }
   return Transforms::getTransform(from_frame);
 }
+
+bool robot_state::StateTransforms::canTransform(const FrameHandle &frame) const
+{
+  if (state_ && state_->knowsFrameTransform(frame))
+    return true;
+  return Transforms::canTransform(frame.getName());
+}
+
+Eigen::Affine3d robot_state::StateTransforms::getTransform(const FrameHandle &frame) const
+{
+  if (state_ && state_->knowsFrameTransform(frame))
+    return state_->getFrameTransform(frame);
+  return Transforms::getTransform(frame.getName());
+}
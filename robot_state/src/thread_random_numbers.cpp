@@ -0,0 +1,76 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/robot_state/thread_random_numbers.h>
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
+
+namespace robot_state
+{
+namespace
+{
+// read by every sampling thread; no other data is published through it, so relaxed accesses suffice
+static boost::atomic<bool> use_thread_rng(false);
+
+static boost::thread_specific_ptr<random_numbers::RandomNumberGenerator>& threadRNG()
+{
+  static boost::thread_specific_ptr<random_numbers::RandomNumberGenerator> rng;
+  return rng;
+}
+}
+}
+
+random_numbers::RandomNumberGenerator& robot_state::getThreadRandomNumberGenerator()
+{
+  boost::thread_specific_ptr<random_numbers::RandomNumberGenerator> &rng = threadRNG();
+  if (!rng.get())
+    rng.reset(new random_numbers::RandomNumberGenerator());
+  return *rng;
+}
+
+void robot_state::seedThreadRandomNumberGenerator(boost::uint32_t seed)
+{
+  threadRNG().reset(new random_numbers::RandomNumberGenerator(seed));
+}
+
+void robot_state::setUseThreadRandomNumberGenerators(bool flag)
+{
+  use_thread_rng.store(flag, boost::memory_order_relaxed);
+}
+
+bool robot_state::getUseThreadRandomNumberGenerators()
+{
+  return use_thread_rng.load(boost::memory_order_relaxed);
+}
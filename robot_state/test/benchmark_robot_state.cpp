@@ -0,0 +1,370 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Micro-benchmarks of the robot state operations planners and monitors call most often, for the PR2, a 7 DOF arm
+   and a 60 link mobile manipulator. See moveit::Benchmark for the command line arguments. */
+
+#include <moveit/test_resources/config.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/conversions.h>
+#include <moveit/profiler/benchmark.h>
+#include <urdf_parser/urdf_parser.h>
+#include <console_bridge/console.h>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <sstream>
+#include <fstream>
+
+namespace
+{
+
+/** \brief Writes the URDF of a made up robot: boxes connected by joints */
+class URDFWriter
+{
+public:
+
+  URDFWriter(const std::string &name) : link_count_(0)
+  {
+    xml_ << "<?xml version=\"1.0\" ?>\n<robot name=\"" << name << "\">\n";
+  }
+
+  void addLink(const std::string &name)
+  {
+    xml_ << "  <link name=\"" << name << "\">\n"
+         << "    <collision><origin xyz=\"0 0 0.05\" rpy=\"0 0 0\"/><geometry><box size=\"0.05 0.05 0.1\"/></geometry></collision>\n"
+         << "  </link>\n";
+    ++link_count_;
+  }
+
+  /** \brief Add the link \e child and the joint that connects it to \e parent. Limits are ignored for fixed and
+      continuous joints; if \e mimic is not empty, the joint follows the joint named \e mimic, with opposite sign. */
+  void addJoint(const std::string &name, const std::string &type, const std::string &parent, const std::string &child,
+                const std::string &xyz = "0 0 0.1", const std::string &axis = "0 0 1",
+                double lower = -2.0, double upper = 2.0, const std::string &mimic = "")
+  {
+    addLink(child);
+    xml_ << "  <joint name=\"" << name << "\" type=\"" << type << "\">\n"
+         << "    <parent link=\"" << parent << "\"/>\n"
+         << "    <child link=\"" << child << "\"/>\n"
+         << "    <origin xyz=\"" << xyz << "\" rpy=\"0 0 0\"/>\n";
+    if (type != "fixed")
+    {
+      xml_ << "    <axis xyz=\"" << axis << "\"/>\n";
+      if (type == "continuous")
+        xml_ << "    <limit effort=\"10\" velocity=\"1\"/>\n";
+      else
+        xml_ << "    <limit lower=\"" << lower << "\" upper=\"" << upper << "\" effort=\"10\" velocity=\"1\"/>\n";
+    }
+    if (!mimic.empty())
+      xml_ << "    <mimic joint=\"" << mimic << "\" multiplier=\"-1\" offset=\"0\"/>\n";
+    xml_ << "  </joint>\n";
+  }
+
+  std::size_t getLinkCount() const
+  {
+    return link_count_;
+  }
+
+  std::string str() const
+  {
+    return xml_.str() + "</robot>\n";
+  }
+
+private:
+
+  std::stringstream xml_;
+  std::size_t       link_count_;
+};
+
+/** \brief Add a chain of 7 revolute joints, with alternating axes, below \e parent. The links are named prefix + "link1" .. "link7" */
+void addArm(URDFWriter &urdf, const std::string &prefix, const std::string &parent)
+{
+  std::string previous = parent;
+  for (int i = 1 ; i <= 7 ; ++i)
+  {
+    std::string index = boost::lexical_cast<std::string>(i);
+    urdf.addJoint(prefix + "joint" + index, "revolute", previous, prefix + "link" + index,
+                  "0 0 0.1", i % 2 ? "0 0 1" : "0 1 0");
+    previous = prefix + "link" + index;
+  }
+}
+
+robot_model::RobotModelPtr makeModel(const std::string &urdf_xml, const std::string &srdf_xml)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(urdf_xml);
+  if (!urdf_model)
+    return robot_model::RobotModelPtr();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initString(*urdf_model, srdf_xml);
+  return robot_model::RobotModelPtr(new robot_model::RobotModel(urdf_model, srdf_model));
+}
+
+robot_model::RobotModelPtr loadPR2()
+{
+  std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+  std::string srdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string();
+
+  std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+  if (!xml_file.is_open())
+  {
+    logError("Unable to open '%s'", urdf_file.c_str());
+    return robot_model::RobotModelPtr();
+  }
+  std::string xml_string;
+  while (xml_file.good())
+  {
+    std::string line;
+    std::getline(xml_file, line);
+    xml_string += (line + "\n");
+  }
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+  if (!urdf_model)
+    return robot_model::RobotModelPtr();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, srdf_file);
+  return robot_model::RobotModelPtr(new robot_model::RobotModel(urdf_model, srdf_model));
+}
+
+/** \brief A fixed base arm with 7 revolute joints */
+robot_model::RobotModelPtr makeArm7()
+{
+  URDFWriter urdf("arm7");
+  urdf.addLink("base_link");
+  addArm(urdf, "", "base_link");
+  return makeModel(urdf.str(),
+                   "<?xml version=\"1.0\" ?>\n<robot name=\"arm7\">\n"
+                   "  <group name=\"arm\"><chain base_link=\"base_link\" tip_link=\"link7\"/></group>\n"
+                   "</robot>\n");
+}
+
+/** \brief A planar base with wheels, a torso, a pan-tilt head and two 7 DOF arms with grippers (60 links in total) */
+robot_model::RobotModelPtr makeMobileManipulator()
+{
+  URDFWriter urdf("mobile_manipulator");
+  urdf.addLink("base_footprint");
+  urdf.addJoint("base_footprint_joint", "fixed", "base_footprint", "base_link", "0 0 0.05");
+  const char *wheels[] = { "fl", "fr", "bl", "br" };
+  const char *wheel_positions[] = { "0.2 0.2 0", "0.2 -0.2 0", "-0.2 0.2 0", "-0.2 -0.2 0" };
+  for (int i = 0 ; i < 4 ; ++i)
+    urdf.addJoint(std::string(wheels[i]) + "_wheel_joint", "continuous", "base_link", std::string(wheels[i]) + "_wheel_link",
+                  wheel_positions[i], "0 1 0");
+  urdf.addJoint("torso_lift_joint", "prismatic", "base_link", "torso_lift_link", "0 0 0.3", "0 0 1", 0.0, 0.3);
+  urdf.addJoint("head_pan_joint", "revolute", "torso_lift_link", "head_pan_link", "0 0 0.5");
+  urdf.addJoint("head_tilt_joint", "revolute", "head_pan_link", "head_tilt_link", "0 0 0.05", "0 1 0");
+  urdf.addJoint("camera_joint", "fixed", "head_tilt_link", "camera_link", "0.05 0 0");
+  urdf.addJoint("camera_optical_joint", "fixed", "camera_link", "camera_optical_frame", "0 0 0");
+
+  const char *sides[] = { "left", "right" };
+  const char *mount_positions[] = { "0 0.2 0.4", "0 -0.2 0.4" };
+  for (int i = 0 ; i < 2 ; ++i)
+  {
+    std::string p = std::string(sides[i]) + "_";
+    urdf.addJoint(p + "shoulder_mount_joint", "fixed", "torso_lift_link", p + "shoulder_mount_link", mount_positions[i]);
+    addArm(urdf, p, p + "shoulder_mount_link");
+    urdf.addJoint(p + "palm_joint", "fixed", p + "link7", p + "palm_link", "0 0 0.1");
+    urdf.addJoint(p + "finger_joint", "revolute", p + "palm_link", p + "finger_link", "0 0.02 0.05", "1 0 0", 0.0, 0.5);
+    urdf.addJoint(p + "finger2_joint", "revolute", p + "palm_link", p + "finger2_link", "0 -0.02 0.05", "1 0 0", -0.5, 0.0,
+                  p + "finger_joint");
+    urdf.addJoint(p + "tool_joint", "fixed", p + "palm_link", p + "tool_frame", "0 0 0.15");
+  }
+
+  // real robot descriptions have many fixed links for sensors and covers
+  for (int i = 0 ; urdf.getLinkCount() < 60 ; ++i)
+  {
+    std::string index = boost::lexical_cast<std::string>(i);
+    urdf.addJoint("sensor" + index + "_joint", "fixed", i % 2 ? "torso_lift_link" : "base_link", "sensor" + index + "_link",
+                  "0.1 0 0.1");
+  }
+
+  return makeModel(urdf.str(),
+                   "<?xml version=\"1.0\" ?>\n<robot name=\"mobile_manipulator\">\n"
+                   "  <virtual_joint name=\"world_joint\" type=\"planar\" parent_frame=\"odom\" child_link=\"base_footprint\"/>\n"
+                   "  <group name=\"left_arm\"><chain base_link=\"torso_lift_link\" tip_link=\"left_link7\"/></group>\n"
+                   "  <group name=\"right_arm\"><chain base_link=\"torso_lift_link\" tip_link=\"right_link7\"/></group>\n"
+                   "  <group name=\"arms\"><group name=\"left_arm\"/><group name=\"right_arm\"/></group>\n"
+                   "</robot>\n");
+}
+
+void constructState(const robot_model::RobotModelConstPtr &model)
+{
+  robot_state::RobotState state(model);
+  moveit::Benchmark::keep(state);
+}
+
+void copyState(const robot_state::RobotState &state)
+{
+  robot_state::RobotState copy(state);
+  moveit::Benchmark::keep(copy);
+}
+
+void setVector(robot_state::RobotState &state, const std::vector<double> &values)
+{
+  state.setStateValues(values);
+}
+
+void setMap(robot_state::RobotState &state, const std::map<std::string, double> &values)
+{
+  state.setStateValues(values);
+}
+
+void setJointStateMsg(robot_state::RobotState &state, const sensor_msgs::JointState &msg)
+{
+  state.setStateValues(msg);
+}
+
+// mark \e joint as changed and update the links below it
+void moveJoint(robot_state::RobotState &state, robot_state::JointState *joint, const std::vector<double> &values)
+{
+  joint->setVariableValues(values);
+  state.updateLinkTransforms();
+}
+
+void jacobian(const robot_state::JointStateGroup *group, const robot_model::LinkModel *tip, Eigen::MatrixXd &result)
+{
+  group->getJacobian(tip, Eigen::Vector3d::Zero(), result);
+  moveit::Benchmark::keep(result);
+}
+
+void jacobian7(const robot_state::JointStateGroup *group, const robot_model::LinkModel *tip, Eigen::Matrix<double, 6, 7> &result)
+{
+  group->getJacobian<7>(tip, Eigen::Vector3d::Zero(), result);
+  moveit::Benchmark::keep(result);
+}
+
+void interpolate(const robot_state::RobotState &from, const robot_state::RobotState &to, robot_state::RobotState &dest)
+{
+  from.interpolate(to, 0.5, dest);
+}
+
+void distance(const robot_state::RobotState &from, const robot_state::RobotState &to)
+{
+  double d = from.distance(to);
+  moveit::Benchmark::keep(d);
+}
+
+void toMsg(const robot_state::RobotState &state, moveit_msgs::RobotState &msg)
+{
+  robot_state::robotStateToRobotStateMsg(state, msg);
+}
+
+void fromMsg(const moveit_msgs::RobotState &msg, robot_state::RobotState &state)
+{
+  robot_state::robotStateMsgToRobotState(msg, state);
+}
+
+void fromMsgConverter(robot_state::RobotStateMsgConverter &converter, const moveit_msgs::RobotState &msg, robot_state::RobotState &state)
+{
+  converter.convert(msg, state);
+}
+
+void benchmarkModel(moveit::Benchmark &bench, const std::string &name, const robot_model::RobotModelConstPtr &model,
+                    const std::string &group_name, const std::string &tip_name)
+{
+  const std::string p = name + "/";
+  robot_state::RobotState state(model);
+  state.setToRandomValues();
+  robot_state::RobotState other(state);
+  other.setToRandomValues();
+  robot_state::RobotState dest(state);
+
+  bench.run(p + "construct", boost::bind(&constructState, model));
+  bench.run(p + "copy", boost::bind(&copyState, boost::cref(state)));
+
+  std::vector<double> values;
+  std::map<std::string, double> value_map;
+  sensor_msgs::JointState joint_state_msg;
+  state.getStateValues(values);
+  state.getStateValues(value_map);
+  state.getStateValues(joint_state_msg);
+  bench.run(p + "setStateValues/vector", boost::bind(&setVector, boost::ref(state), boost::cref(values)));
+  bench.run(p + "setStateValues/map", boost::bind(&setMap, boost::ref(state), boost::cref(value_map)));
+  bench.run(p + "setStateValues/sensor_msgs", boost::bind(&setJointStateMsg, boost::ref(state), boost::cref(joint_state_msg)));
+
+  // updateLinkTransforms() only recomputes links below joints that changed: moving the root joint updates all links,
+  // moving the last joint of the group only the links it carries
+  robot_state::JointState *root = state.getJointState(model->getRoot());
+  std::vector<double> root_values = root->getVariableValues();
+  bench.run(p + "updateLinkTransforms/all", boost::bind(&moveJoint, boost::ref(state), root, boost::cref(root_values)),
+            state.getLinkStateVector().size());
+
+  robot_state::JointStateGroup *group = state.getJointStateGroup(group_name);
+  const robot_model::LinkModel *tip = model->getLinkModel(tip_name);
+  if (!group || !tip)
+  {
+    logError("Group '%s' or link '%s' not found in model '%s'", group_name.c_str(), tip_name.c_str(), name.c_str());
+    return;
+  }
+  robot_state::JointState *last = group->getJointStateVector().back();
+  std::vector<double> last_values = last->getVariableValues();
+  bench.run(p + "updateLinkTransforms/" + last->getName(), boost::bind(&moveJoint, boost::ref(state), last, boost::cref(last_values)));
+
+  Eigen::MatrixXd jacobian_result;
+  bench.run(p + "getJacobian/" + group_name, boost::bind(&jacobian, group, tip, boost::ref(jacobian_result)));
+  if (group->getVariableCount() == 7)
+  {
+    Eigen::Matrix<double, 6, 7> jacobian7_result;
+    bench.run(p + "getJacobian<7>/" + group_name, boost::bind(&jacobian7, group, tip, boost::ref(jacobian7_result)));
+  }
+
+  bench.run(p + "interpolate", boost::bind(&interpolate, boost::cref(state), boost::cref(other), boost::ref(dest)));
+  bench.run(p + "distance", boost::bind(&distance, boost::cref(state), boost::cref(other)));
+
+  moveit_msgs::RobotState msg;
+  robot_state::robotStateToRobotStateMsg(state, msg);
+  robot_state::RobotStateMsgConverter converter;
+  bench.run(p + "robotStateToRobotStateMsg", boost::bind(&toMsg, boost::cref(state), boost::ref(msg)));
+  bench.run(p + "robotStateMsgToRobotState", boost::bind(&fromMsg, boost::cref(msg), boost::ref(dest)));
+  bench.run(p + "RobotStateMsgConverter", boost::bind(&fromMsgConverter, boost::ref(converter), boost::cref(msg), boost::ref(dest)));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  moveit::Benchmark bench(argc, argv);
+
+  robot_model::RobotModelPtr pr2 = loadPR2();
+  if (pr2)
+    benchmarkModel(bench, "pr2", pr2, "right_arm", "r_wrist_roll_link");
+  robot_model::RobotModelPtr arm7 = makeArm7();
+  if (arm7)
+    benchmarkModel(bench, "arm7", arm7, "arm", "link7");
+  robot_model::RobotModelPtr mobile = makeMobileManipulator();
+  if (mobile)
+    benchmarkModel(bench, "mobile_manipulator", mobile, "left_arm", "left_link7");
+
+  return bench.report();
+}
@@ -36,6 +36,9 @@
 
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/joint_state_mapper.h>
+#include <moveit/robot_state/thread_random_numbers.h>
+#include <moveit/robot_state/robot_state_pool.h>
 #include <urdf_parser/urdf_parser.h>
 #include <gtest/gtest.h>
 #include <sstream>
@@ -223,6 +226,22 @@ TEST(LoadingAndFK, SimpleRobot)
     EXPECT_NEAR(10.0, state.getLinkState("base_link")->getGlobalLinkTransform().translation().x(), 1e-5);
     EXPECT_NEAR(8.0, state.getLinkState("base_link")->getGlobalLinkTransform().translation().y(), 1e-5);
     EXPECT_NEAR(0.0, state.getLinkState("base_link")->getGlobalLinkTransform().translation().z(), 1e-5);
+
+    //assignment between states of the same model copies values and transforms in place
+    jv[ind_map.at("base_joint/x")] = 1.0;
+    jv[ind_map.at("base_joint/y")] = 2.0;
+    new_state.setStateValues(jv);
+    const robot_state::LinkState *new_link_state = new_state.getLinkState("base_link");
+    new_state = state;
+    EXPECT_EQ(new_link_state, new_state.getLinkState("base_link"));
+    EXPECT_NEAR(10.0, new_link_state->getGlobalLinkTransform().translation().x(), 1e-5);
+    EXPECT_NEAR(8.0, new_link_state->getGlobalLinkTransform().translation().y(), 1e-5);
+    EXPECT_NEAR(10.0, new_state.getJointState("base_joint")->getVariableValues()[ind_map.at("base_joint/x")], 1e-5);
+
+    //the copy does not share memory with the original
+    state.setStateValues(jv);
+    EXPECT_NEAR(1.0, state.getLinkState("base_link")->getGlobalLinkTransform().translation().x(), 1e-5);
+    EXPECT_NEAR(10.0, new_link_state->getGlobalLinkTransform().translation().x(), 1e-5);
 }
 
 
@@ -523,6 +542,133 @@ TEST(FK, OneRobot)
     EXPECT_NEAR(0.0, Eigen::Quaterniond(state.getLinkState("link_c")->getGlobalLinkTransform().rotation()).z(), 1e-5);
     EXPECT_NEAR(1.0, Eigen::Quaterniond(state.getLinkState("link_c")->getGlobalLinkTransform().rotation()).w(), 1e-5);
 
+    //only the links below a changed joint are recomputed, but the result matches a full update
+    std::vector<double> jc(1, 0.05);
+    state.getJointState("joint_c")->setVariableValues(jc);
+    state.updateLinkTransforms();
+    EXPECT_NEAR(1.05, state.getLinkState("link_c")->getGlobalLinkTransform().translation().x(), 1e-5);
+    EXPECT_NEAR(1.4, state.getLinkState("link_c")->getGlobalLinkTransform().translation().y(), 1e-5);
+    EXPECT_NEAR(1.5, state.getLinkState("link_b")->getGlobalLinkTransform().translation().y(), 1e-5);
+
+    //changing the root transform updates all links
+    Eigen::Affine3d root = Eigen::Affine3d::Identity();
+    root.translation().z() = 1.0;
+    state.setRootTransform(root);
+    state.updateLinkTransforms();
+    EXPECT_NEAR(1.0, state.getLinkState("base_link")->getGlobalLinkTransform().translation().z(), 1e-5);
+    EXPECT_NEAR(1.0, state.getLinkState("link_c")->getGlobalLinkTransform().translation().z(), 1e-5);
+    EXPECT_NEAR(1.05, state.getLinkState("link_c")->getGlobalLinkTransform().translation().x(), 1e-5);
+    state.setRootTransform(Eigen::Affine3d::Identity());
+    state.updateLinkTransforms();
+
+    //batch FK matches FK computed one configuration at a time
+    robot_state::JointStateGroup *jsg = state.getJointStateGroup("base_from_joints");
+    std::vector<double> v0;
+    jsg->getVariableValues(v0);
+    Eigen::MatrixXd batch(2, v0.size());
+    for (std::size_t j = 0 ; j < v0.size() ; ++j)
+    {
+        batch(0, j) = v0[j];
+        batch(1, j) = v0[j] + 0.01;
+    }
+    std::vector<std::string> batch_links;
+    batch_links.push_back("link_a");
+    batch_links.push_back("link_c");
+    std::vector<EigenSTL::vector_Affine3d> batch_tf;
+    EXPECT_TRUE(jsg->computeLinkTransforms(batch, batch_links, batch_tf));
+    ASSERT_EQ(2u, batch_tf.size());
+    ASSERT_EQ(2u, batch_tf[1].size());
+    EXPECT_TRUE(batch_tf[1][1].isApprox(state.getLinkState("link_c")->getGlobalLinkTransform()));
+    jsg->setVariableValues(v0);
+    EXPECT_TRUE(batch_tf[0][0].isApprox(state.getLinkState("link_a")->getGlobalLinkTransform()));
+    EXPECT_TRUE(batch_tf[1][0].isApprox(state.getLinkState("link_c")->getGlobalLinkTransform()));
+    EXPECT_FALSE(batch_tf[1][0].isApprox(batch_tf[1][1]));
+    EXPECT_FALSE(jsg->computeLinkTransforms(Eigen::MatrixXd(1, v0.size() + 1), batch_links, batch_tf));
+    batch_links.push_back("no_such_link");
+    EXPECT_FALSE(jsg->computeLinkTransforms(batch, batch_links, batch_tf));
+
+    //applying joint state messages through a mapper matches setStateValues()
+    sensor_msgs::JointState js;
+    js.name.push_back("joint_c");
+    js.position.push_back(0.07);
+    js.name.push_back("base_joint/theta");
+    js.position.push_back(0.3);
+    js.name.push_back("monkey");
+    js.position.push_back(1.0);
+    robot_state::RobotState state2(state);
+    state2.setStateValues(js);
+    robot_state::JointStateMapper mapper;
+    EXPECT_TRUE(mapper.apply(js, state));
+    EXPECT_NEAR(0.07, state.getJointState("joint_c")->getVariableValues()[0], 1e-5);
+    EXPECT_EQ(state2.getJointState("base_joint")->getVariableValues(), state.getJointState("base_joint")->getVariableValues());
+    EXPECT_TRUE(state2.getLinkState("link_c")->getGlobalLinkTransform().isApprox(state.getLinkState("link_c")->getGlobalLinkTransform()));
+
+    js.position[0] = 0.02;
+    EXPECT_TRUE(mapper.apply(js, state));
+    EXPECT_NEAR(0.02, state.getJointState("joint_c")->getVariableValues()[0], 1e-5);
+    js.position.resize(1);
+    js.position[0] = 0.03;
+    EXPECT_FALSE(mapper.apply(js, state));
+    EXPECT_NEAR(0.03, state.getJointState("joint_c")->getVariableValues()[0], 1e-5);
+    EXPECT_NEAR(0.3, state.getJointState("base_joint")->getVariableValues()[2], 1e-5);
+
+    //the bounding box and the bounding sphere contain the geometry of all links
+    std::vector<double> aabb;
+    state.computeAABB(aabb);
+    ASSERT_EQ(6u, aabb.size());
+    Eigen::Vector3d center;
+    double radius;
+    state.computeBoundingSphere(center, radius);
+    const std::vector<robot_state::LinkState*> &lsv = state.getLinkStateVector();
+    for (std::size_t i = 0 ; i < lsv.size() ; ++i)
+    {
+        if (!lsv[i]->getLinkModel()->getShape())
+            continue;
+        const Eigen::Vector3d &p = lsv[i]->getGlobalCollisionBodyTransform().translation();
+        EXPECT_LE(aabb[0], p.x());
+        EXPECT_GE(aabb[1], p.x());
+        EXPECT_LE(aabb[2], p.y());
+        EXPECT_GE(aabb[3], p.y());
+        EXPECT_LE(aabb[4], p.z() - 0.5);
+        EXPECT_GE(aabb[5], p.z() + 0.5);
+        EXPECT_GE(radius, (p - center).norm() + lsv[i]->getLinkModel()->getBoundingSphereRadius() - 1e-9);
+    }
+
+    //states share the generator of the thread, and seeding it makes sampling reproducible
+    robot_state::setUseThreadRandomNumberGenerators(true);
+    EXPECT_EQ(&robot_state::getThreadRandomNumberGenerator(), &state.getRandomNumberGenerator());
+    EXPECT_EQ(&robot_state::getThreadRandomNumberGenerator(), &state2.getJointStateGroup("base_from_joints")->getRandomNumberGenerator());
+    std::vector<double> r1, r2;
+    robot_state::seedThreadRandomNumberGenerator(42);
+    state2.setToRandomValues();
+    state2.getStateValues(r1);
+    robot_state::seedThreadRandomNumberGenerator(42);
+    state2.setToRandomValues();
+    state2.getStateValues(r2);
+    EXPECT_EQ(r1, r2);
+    robot_state::setUseThreadRandomNumberGenerators(false);
+    EXPECT_NE(&robot_state::getThreadRandomNumberGenerator(), &state.getRandomNumberGenerator());
+
+    //states from a pool are recycled once released
+    {
+        robot_state::RobotStatePool pool(model, 1);
+        robot_state::RobotState *raw = NULL;
+        {
+            robot_state::RobotStatePtr s1 = pool.allocState();
+            raw = s1.get();
+            EXPECT_EQ(0u, pool.getFreeStateCount());
+        }
+        EXPECT_EQ(1u, pool.getFreeStateCount());
+        robot_state::RobotStatePtr s2 = pool.allocState(state);
+        EXPECT_EQ(raw, s2.get());
+        EXPECT_TRUE(state.getLinkState("link_c")->getGlobalLinkTransform().isApprox(s2->getLinkState("link_c")->getGlobalLinkTransform()));
+        robot_state::RobotStatePtr s3 = pool.allocState();
+        EXPECT_NE(s2.get(), s3.get());
+        s2.reset();
+        s3.reset();
+        EXPECT_EQ(1u, pool.getFreeStateCount());
+    }
+
     //bonus bounds lookup test
     std::vector<std::string> jn;
     jn.push_back("base_joint");
@@ -548,6 +694,36 @@ TEST(FK, OneRobot)
     EXPECT_TRUE(state.satisfiesBounds("joint_a"));
 }
 
+TEST(FK, RevoluteAxes)
+{
+  // the closed form kernels must agree with the generic rotation for aligned, flipped and unaligned axes
+  EigenSTL::vector_Vector3d axes;
+  axes.push_back(Eigen::Vector3d(1.0, 0.0, 0.0));
+  axes.push_back(Eigen::Vector3d(0.0, -1.0, 0.0));
+  axes.push_back(Eigen::Vector3d(0.0, 0.0, 2.0));
+  axes.push_back(Eigen::Vector3d(0.3, -0.5, 0.8));
+
+  Eigen::Affine3d parent(Eigen::Translation3d(0.1, -0.2, 0.3) * Eigen::AngleAxisd(0.7, Eigen::Vector3d(1.0, 2.0, 3.0).normalized()));
+  std::vector<double> values(1, 0.0);
+  for (std::size_t i = 0 ; i < axes.size() ; ++i)
+  {
+    robot_model::RevoluteJointModel joint("joint");
+    joint.setAxis(axes[i]);
+    EXPECT_NEAR(1.0, joint.getAxis().norm(), 1e-12);
+    for (values[0] = -3.0 ; values[0] < 3.0 ; values[0] += 0.7)
+    {
+      Eigen::Affine3d expected(Eigen::AngleAxisd(values[0], axes[i].normalized()));
+      Eigen::Affine3d transf;
+      joint.computeTransform(values, transf);
+      EXPECT_TRUE(expected.matrix().isApprox(transf.matrix(), 1e-12));
+
+      Eigen::Affine3d composed;
+      joint.composeTransform(parent, transf, composed);
+      EXPECT_TRUE((parent * expected).matrix().isApprox(composed.matrix(), 1e-12));
+    }
+  }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -37,6 +37,7 @@
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/robot_state/conversions.h>
+#include <moveit/robot_state/cartesian_path.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -238,6 +239,33 @@ TEST_F(LoadPlanningModelsPr2, SubgroupInit)
   EXPECT_TRUE(jmg2->isSubgroup("right_arm"));
 }
 
+TEST_F(LoadPlanningModelsPr2, MimicJoints)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  const std::vector<robot_model::RobotModel::MimicUpdate> &updates = kmodel->getMimicUpdates();
+  ASSERT_FALSE(updates.empty());
+  for (std::size_t i = 0 ; i < updates.size() ; ++i)
+  {
+    EXPECT_TRUE(updates[i].source_->getMimic() == NULL);
+    EXPECT_EQ(updates[i].source_, updates[i].target_->getMimic());
+    if (i > 0)
+      EXPECT_LE(updates[i - 1].source_->getTreeIndex(), updates[i].source_->getTreeIndex());
+  }
+
+  // setting the values of a mimicked joint sets the values of the joints that mimic it
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::JointState *source = ks.getJointState(updates[0].source_);
+  std::vector<double> values(source->getVariableCount(), 0.3);
+  source->setVariableValues(values);
+  for (std::size_t i = 0 ; i < updates.size() && updates[i].source_ == updates[0].source_ ; ++i)
+  {
+    const std::vector<double> &mimic_values = ks.getJointState(updates[i].target_)->getVariableValues();
+    for (std::size_t j = 0 ; j < mimic_values.size() ; ++j)
+      EXPECT_NEAR(0.3 * updates[i].factor_ + updates[i].offset_, mimic_values[j], 1e-12);
+  }
+}
+
 TEST_F(LoadPlanningModelsPr2, AssociatedFixedLinks)
 {
   boost::shared_ptr<robot_model::RobotModel> kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
@@ -245,6 +273,418 @@ TEST_F(LoadPlanningModelsPr2, AssociatedFixedLinks)
   EXPECT_TRUE(kmodel->getLinkModel("r_gripper_palm_link")->getAssociatedFixedTransforms().size() > 1);
 }
 
+TEST_F(LoadPlanningModelsPr2, ForwardKinematicsSteps)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  const robot_model::RobotModel::ForwardKinematicsSteps &steps = kmodel->getForwardKinematicsSteps();
+  ASSERT_EQ(kmodel->getLinkModels().size(), steps.size());
+
+  // links below fixed joints are computed from a link moved by a joint with variables
+  const robot_model::RobotModel::ForwardKinematicsStep &palm = steps[kmodel->getLinkModel("r_gripper_palm_link")->getTreeIndex()];
+  EXPECT_TRUE(palm.joint_ == NULL);
+  ASSERT_GE(palm.parent_index_, 0);
+  EXPECT_NE(robot_model::JointModel::FIXED, kmodel->getLinkModels()[palm.parent_index_]->getParentJointModel()->getType());
+
+  // the collapsed chains give the same transforms as composing every joint
+  robot_state::RobotState state(kmodel);
+  state.setToRandomValues();
+  const std::vector<robot_state::LinkState*> &links = state.getLinkStateVector();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const robot_state::LinkState *parent = links[i]->getParentLinkState();
+    Eigen::Affine3d expected = (parent ? parent->getGlobalLinkTransform() : state.getRootTransform()) *
+      links[i]->getLinkModel()->getJointOriginTransform() * state.getJointState(links[i]->getLinkModel()->getParentJointModel())->getVariableTransform();
+    EXPECT_TRUE(expected.matrix().isApprox(links[i]->getGlobalLinkTransform().matrix(), 1e-9)) << links[i]->getName();
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, SingleDOFGroupOperations)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  EXPECT_TRUE(kmodel->getJointModelGroup("right_arm")->hasOnlySingleDOFJoints());
+  EXPECT_FALSE(kmodel->getJointModelGroup("whole_body")->hasOnlySingleDOFJoints());
+
+  robot_state::RobotState s1(kmodel), s2(kmodel), s3(kmodel);
+  s1.setToRandomValues();
+  s2.setToRandomValues();
+  robot_state::JointStateGroup *g1 = s1.getJointStateGroup("right_arm");
+  robot_state::JointStateGroup *g2 = s2.getJointStateGroup("right_arm");
+  robot_state::JointStateGroup *g3 = s3.getJointStateGroup("right_arm");
+
+  // the fast path for revolute and prismatic joints matches the per-joint computation
+  const std::vector<robot_state::JointState*> &j1 = g1->getJointStateVector();
+  const std::vector<robot_state::JointState*> &j2 = g2->getJointStateVector();
+  const std::vector<robot_state::JointState*> &j3 = g3->getJointStateVector();
+  double d = 0.0, max_d = 0.0;
+  for (std::size_t i = 0 ; i < j1.size() ; ++i)
+  {
+    double di = j1[i]->distance(j2[i]);
+    d += di * j1[i]->getJointModel()->getDistanceFactor();
+    max_d = std::max(max_d, di);
+  }
+  EXPECT_NEAR(d, g1->distance(g2), 1e-9);
+  EXPECT_NEAR(max_d, g1->infinityNormDistance(g2), 1e-9);
+
+  g1->interpolate(g2, 0.3, g3);
+  for (std::size_t i = 0 ; i < j1.size() ; ++i)
+  {
+    robot_state::JointState expected_i(j1[i]->getJointModel());
+    j1[i]->interpolate(j2[i], 0.3, &expected_i);
+    EXPECT_NEAR(expected_i.getVariableValues()[0], j3[i]->getVariableValues()[0], 1e-9);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, JointDispatch)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("whole_body");
+  const robot_model::JointModelGroup::JointDispatch &dispatch = jmg->getJointDispatch();
+  EXPECT_EQ(jmg->getJointModels().size(), dispatch.bounded_.size() + dispatch.continuous_.size() + dispatch.other_.size());
+  EXPECT_FALSE(dispatch.continuous_.empty());
+  EXPECT_FALSE(dispatch.other_.empty());
+
+  robot_state::RobotState s1(kmodel), s2(kmodel), s3(kmodel);
+  s1.setToRandomValues();
+  s2.setToRandomValues();
+  robot_state::JointStateGroup *g1 = s1.getJointStateGroup("whole_body");
+  robot_state::JointStateGroup *g2 = s2.getJointStateGroup("whole_body");
+  robot_state::JointStateGroup *g3 = s3.getJointStateGroup("whole_body");
+  EXPECT_TRUE(g1->satisfiesBounds());
+
+  // the per-kind loops over a mixed group match the per-joint computation
+  const std::vector<robot_state::JointState*> &j1 = g1->getJointStateVector();
+  const std::vector<robot_state::JointState*> &j2 = g2->getJointStateVector();
+  const std::vector<robot_state::JointState*> &j3 = g3->getJointStateVector();
+  double d = 0.0;
+  for (std::size_t i = 0 ; i < j1.size() ; ++i)
+    d += j1[i]->distance(j2[i]) * j1[i]->getJointModel()->getDistanceFactor();
+  EXPECT_NEAR(d, g1->distance(g2), 1e-9);
+
+  g1->interpolate(g2, 0.6, g3);
+  for (std::size_t i = 0 ; i < j1.size() ; ++i)
+  {
+    robot_state::JointState expected_i(j1[i]->getJointModel());
+    j1[i]->interpolate(j2[i], 0.6, &expected_i);
+    for (std::size_t k = 0 ; k < expected_i.getVariableValues().size() ; ++k)
+      EXPECT_NEAR(expected_i.getVariableValues()[k], j3[i]->getVariableValues()[k], 1e-9);
+  }
+
+  // move every variable out of its bounds and bring it back
+  std::vector<double> values;
+  g1->getVariableValues(values);
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    values[i] += 10.0;
+  g1->setVariableValues(values);
+  for (std::size_t i = 0 ; i < dispatch.bounded_.size() ; ++i)
+    EXPECT_FALSE(j1[dispatch.bounded_[i]]->satisfiesBounds());
+  EXPECT_FALSE(g1->satisfiesBounds());
+  g3->setVariableValues(values);
+  g1->enforceBounds();
+  EXPECT_TRUE(g1->satisfiesBounds());
+  for (std::size_t i = 0 ; i < j3.size() ; ++i)
+  {
+    j3[i]->enforceBounds();
+    for (std::size_t k = 0 ; k < j3[i]->getVariableValues().size() ; ++k)
+      EXPECT_NEAR(j3[i]->getVariableValues()[k], j1[i]->getVariableValues()[k], 1e-9);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, CopyGroupValues)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("right_arm");
+  const std::vector<std::pair<unsigned int, unsigned int> > &ranges = jmg->getJointIndexRanges();
+  std::size_t count = 0;
+  for (std::size_t i = 0 ; i < ranges.size() ; ++i)
+    count += ranges[i].second;
+  EXPECT_EQ(jmg->getJointModels().size(), count);
+
+  robot_state::RobotState src(kmodel), dest(kmodel), expected(kmodel);
+  src.setToRandomValues();
+  dest.setToRandomValues();
+  expected = dest;
+  std::vector<double> values;
+  src.getJointStateGroup("right_arm")->getVariableValues(values);
+  expected.getJointStateGroup("right_arm")->setVariableValues(values);
+
+  EXPECT_TRUE(dest.copyGroupValues(src, jmg));
+  std::vector<double> v1, v2;
+  dest.getStateValues(v1);
+  expected.getStateValues(v2);
+  ASSERT_EQ(v1.size(), v2.size());
+  for (std::size_t i = 0 ; i < v1.size() ; ++i)
+    EXPECT_NEAR(v1[i], v2[i], 1e-12);
+
+  dest.updateLinkTransforms();
+  expected.updateLinkTransforms();
+  const std::vector<robot_state::LinkState*> &l1 = dest.getLinkStateVector();
+  const std::vector<robot_state::LinkState*> &l2 = expected.getLinkStateVector();
+  for (std::size_t i = 0 ; i < l1.size() ; ++i)
+    EXPECT_TRUE(l1[i]->getGlobalLinkTransform().matrix().isApprox(l2[i]->getGlobalLinkTransform().matrix(), 1e-9)) << l1[i]->getName();
+
+  robot_model::RobotModelPtr other_model(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState other(other_model);
+  EXPECT_FALSE(other.copyGroupValues(src, other_model->getJointModelGroup("right_arm")));
+}
+
+TEST_F(LoadPlanningModelsPr2, JacobianChains)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg->isChain());
+  const robot_model::LinkModel *tip = kmodel->getLinkModel("r_wrist_roll_link");
+  ASSERT_TRUE(jmg->getJacobianChain(tip));
+  EXPECT_EQ(7u, jmg->getJacobianChain(tip)->size());
+  EXPECT_FALSE(jmg->getJacobianChain(kmodel->getLinkModel("l_wrist_roll_link")));
+
+  robot_state::RobotState ks(kmodel);
+  ks.setToRandomValues();
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  Eigen::Vector3d point(0.1, 0.0, 0.0);
+
+  // the name-based, model-based and fixed size versions agree
+  Eigen::MatrixXd by_name, by_model;
+  Eigen::Matrix<double, 6, 7> fixed;
+  ASSERT_TRUE(jsg->getJacobian("r_wrist_roll_link", point, by_name));
+  ASSERT_TRUE(jsg->getJacobian(tip, point, by_model));
+  ASSERT_TRUE(jsg->getJacobian(tip, point, fixed));
+  Eigen::Matrix<double, 6, 6> wrong_size;
+  EXPECT_FALSE(jsg->getJacobian(tip, point, wrong_size));
+  EXPECT_TRUE(by_name.isApprox(by_model));
+  EXPECT_TRUE(by_name.isApprox(Eigen::MatrixXd(fixed)));
+
+  // the linear part matches finite differences of the point, in the frame of the reference link
+  const robot_model::LinkModel *reference_link = jmg->getJacobianReferenceLink();
+  ASSERT_TRUE(reference_link);
+  std::vector<double> values;
+  jsg->getVariableValues(values);
+  static const double eps = 1e-6;
+  for (std::size_t c = 0 ; c < values.size() ; ++c)
+  {
+    std::vector<double> moved = values;
+    jsg->setVariableValues(moved);
+    Eigen::Vector3d before = ks.getLinkState(reference_link)->getGlobalLinkTransform().inverse() * (ks.getLinkState(tip)->getGlobalLinkTransform() * point);
+    moved[c] += eps;
+    jsg->setVariableValues(moved);
+    Eigen::Vector3d after = ks.getLinkState(reference_link)->getGlobalLinkTransform().inverse() * (ks.getLinkState(tip)->getGlobalLinkTransform() * point);
+    Eigen::Vector3d column = (after - before) / eps;
+    for (int r = 0 ; r < 3 ; ++r)
+      EXPECT_NEAR(column(r), by_model(r, c), 1e-4);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, StackedJacobianOfTree)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("arms");
+  ASSERT_TRUE(jmg);
+  EXPECT_FALSE(jmg->isChain());
+
+  robot_state::RobotState ks(kmodel);
+  ks.setToRandomValues();
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("arms");
+
+  std::vector<const robot_model::LinkModel*> links;
+  links.push_back(kmodel->getLinkModel("r_wrist_roll_link"));
+  links.push_back(kmodel->getLinkModel("l_wrist_roll_link"));
+  EigenSTL::vector_Vector3d points;
+  points.push_back(Eigen::Vector3d(0.1, 0.0, 0.0));
+  points.push_back(Eigen::Vector3d(0.0, 0.1, 0.0));
+
+  Eigen::MatrixXd stacked;
+  ASSERT_TRUE(jsg->getJacobian(links, points, stacked));
+  ASSERT_EQ(12, stacked.rows());
+  ASSERT_EQ((int)jmg->getVariableCount(), stacked.cols());
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    Eigen::MatrixXd single;
+    ASSERT_TRUE(jsg->getJacobian(links[i], points[i], single));
+    EXPECT_TRUE(single.isApprox(stacked.block(6 * i, 0, 6, stacked.cols())));
+  }
+
+  // the joints of the left arm do not move the right wrist
+  const std::vector<std::string> &variables = jmg->getVariableNames();
+  for (std::size_t c = 0 ; c < variables.size() ; ++c)
+    if (variables[c][0] == 'l')
+      EXPECT_TRUE(stacked.block(0, c, 6, 1).isZero());
+
+  points.pop_back();
+  EXPECT_FALSE(jsg->getJacobian(links, points, stacked));
+}
+
+TEST_F(LoadPlanningModelsPr2, DampedLeastSquaresDiffIK)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  std::vector<double> values(7, -0.5);
+  values[0] = 0.0;
+  jsg->setVariableValues(values);
+  const robot_model::LinkModel *tip = kmodel->getLinkModel("r_wrist_roll_link");
+
+  Eigen::VectorXd twist(6);
+  twist << 0.05, -0.02, 0.03, 0.1, 0.0, -0.1;
+
+  // away from singularities and joint limits, with no damping, the result is the pseudo-inverse solution
+  robot_state::DiffIKWorkspace workspace;
+  workspace.max_damping = 0.0;
+  workspace.joint_limit_margin = 0.0;
+  Eigen::VectorXd qdot, qdot_pinv;
+  ASSERT_TRUE(jsg->computeJointVelocity(qdot, twist, tip, workspace));
+  jsg->computeJointVelocity(qdot_pinv, twist, "r_wrist_roll_link");
+  EXPECT_TRUE(qdot.isApprox(qdot_pinv, 1e-6));
+
+  // damping and joint limit weighting only slow the motion down
+  robot_state::DiffIKWorkspace damped;
+  damped.singular_value_threshold = 10.0;
+  Eigen::VectorXd qdot_damped;
+  ASSERT_TRUE(jsg->computeJointVelocity(qdot_damped, twist, tip, damped));
+  EXPECT_LT(qdot_damped.norm(), qdot.norm());
+
+  // the workspace is reused, and small steps follow the twist
+  const Eigen::Affine3d start = ks.getLinkState(tip)->getGlobalLinkTransform();
+  for (int i = 0 ; i < 10 ; ++i)
+    ASSERT_TRUE(jsg->setFromDiffIK(twist, tip, 0.01, workspace, qdot));
+  const Eigen::Vector3d moved = start.rotation().transpose() * (ks.getLinkState(tip)->getGlobalLinkTransform().translation() - start.translation());
+  EXPECT_TRUE(moved.isApprox(0.1 * twist.head<3>(), 0.1));
+
+  EXPECT_FALSE(jsg->computeJointVelocity(qdot, twist, kmodel->getLinkModel("l_wrist_roll_link"), workspace));
+  EXPECT_FALSE(jsg->computeJointVelocity(qdot, Eigen::VectorXd::Zero(3), tip, workspace));
+}
+
+TEST_F(LoadPlanningModelsPr2, CartesianPathWithJacobianSteps)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  std::vector<double> values(7, -0.5);
+  values[0] = 0.0;
+  jsg->setVariableValues(values);
+
+  // the model has no IK solvers, so only steps along the Jacobian are possible
+  robot_state::CartesianPathGenerator generator;
+  EXPECT_EQ(0.0, generator.computeCartesianPath(jsg, "r_wrist_roll_link", Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 0.05)), false, 0.005, 0.0));
+  generator.setJacobianStep(0.01);
+  generator.setJacobianTolerance(1e-3);
+
+  Eigen::Affine3d start = ks.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform();
+  Eigen::Affine3d target = start;
+  target.translation().z() += 0.05;
+  EXPECT_NEAR(1.0, generator.computeCartesianPath(jsg, "r_wrist_roll_link", target, true, 0.005, 0.0), 1e-9);
+  EXPECT_EQ(0u, generator.getIKCallCount());
+  EXPECT_EQ(generator.getPointCount() - 1, generator.getJacobianStepCount());
+  EXPECT_EQ(7u, generator.getVariableCount());
+  EXPECT_TRUE(ks.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform().translation().isApprox(target.translation(), 1e-2));
+
+  // the points are on the line
+  std::vector<robot_state::RobotStatePtr> traj;
+  generator.getStates(ks, traj);
+  ASSERT_EQ(generator.getPointCount(), traj.size());
+  for (std::size_t i = 0 ; i < traj.size() ; ++i)
+  {
+    const Eigen::Vector3d p = traj[i]->getLinkState("r_wrist_roll_link")->getGlobalLinkTransform().translation();
+    EXPECT_NEAR(start.translation().x(), p.x(), 2e-3);
+    EXPECT_NEAR(start.translation().y(), p.y(), 2e-3);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, CartesianPathAdaptiveStep)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  std::vector<double> values(7, -0.5);
+  values[0] = 0.0;
+  jsg->setVariableValues(values);
+
+  robot_state::CartesianPathGenerator generator;
+  generator.setJacobianStep(0.1);
+  generator.setJacobianTolerance(1e-3);
+  generator.setAdaptiveStep(0.05, 1e-3);
+  EXPECT_EQ(0.05, generator.getMaxJointStep());
+
+  Eigen::Affine3d target = ks.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform();
+  target.translation().z() += 0.1;
+  EXPECT_NEAR(1.0, generator.computeCartesianPath(jsg, "r_wrist_roll_link", target, true, 0.1, 0.0), 1e-9);
+  EXPECT_TRUE(ks.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform().translation().isApprox(target.translation(), 1e-2));
+
+  // consecutive points are close in joint space
+  std::vector<robot_state::RobotStatePtr> traj;
+  generator.getStates(ks, traj);
+  ASSERT_LT(1u, traj.size());
+  for (std::size_t i = 1 ; i < traj.size() ; ++i)
+    EXPECT_GE(0.05 + 1e-9, traj[i - 1]->getJointStateGroup("right_arm")->infinityNormDistance(traj[i]->getJointStateGroup("right_arm")));
+}
+
+TEST_F(LoadPlanningModelsPr2, IKMemo)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg);
+  EXPECT_EQ(0u, jmg->getIKMemoCapacity());
+
+  Eigen::Affine3d pose(Eigen::Translation3d(0.5, -0.2, 0.8) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()));
+  std::vector<double> seed(7, 0.0), solution(7, 0.25), found;
+
+  // nothing is remembered while the memo is disabled
+  jmg->storeIKMemo(pose, seed, "", 0, solution);
+  EXPECT_FALSE(jmg->lookupIKMemo(pose, seed, "", 0, found));
+
+  jmg->setIKMemo(2);
+  EXPECT_EQ(2u, jmg->getIKMemoCapacity());
+  jmg->storeIKMemo(pose, seed, "", 0, solution);
+  ASSERT_TRUE(jmg->lookupIKMemo(pose, seed, "", 0, found));
+  EXPECT_EQ(solution, found);
+
+  // poses and seeds within the resolution share the solution, but the context has to match
+  Eigen::Affine3d close = Eigen::Translation3d(1e-6, 0.0, 0.0) * pose;
+  std::vector<double> close_seed(7, 0.01), far_seed(7, 1.0);
+  EXPECT_TRUE(jmg->lookupIKMemo(close, close_seed, "", 0, found));
+  EXPECT_FALSE(jmg->lookupIKMemo(Eigen::Translation3d(0.01, 0.0, 0.0) * pose, seed, "", 0, found));
+  EXPECT_FALSE(jmg->lookupIKMemo(pose, far_seed, "", 0, found));
+  EXPECT_FALSE(jmg->lookupIKMemo(pose, seed, "collision free", 0, found));
+  jmg->storeIKMemo(pose, seed, "collision free", 0, solution);
+  EXPECT_TRUE(jmg->lookupIKMemo(pose, seed, "collision free", 0, found));
+  EXPECT_FALSE(jmg->lookupIKMemo(pose, seed, "collision free", 1, found));
+
+  // the least recently used solution is forgotten first
+  EXPECT_TRUE(jmg->lookupIKMemo(pose, seed, "", 0, found));
+  jmg->storeIKMemo(pose, far_seed, "", 0, solution);
+  EXPECT_TRUE(jmg->lookupIKMemo(pose, seed, "", 0, found));
+  EXPECT_FALSE(jmg->lookupIKMemo(pose, seed, "collision free", 0, found));
+
+  jmg->clearIKMemo();
+  EXPECT_FALSE(jmg->lookupIKMemo(pose, seed, "", 0, found));
+  jmg->setIKMemo(0);
+}
+
+TEST_F(LoadPlanningModelsPr2, RankedIKCosts)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState ks(kmodel), other(kmodel);
+  ks.setToRandomValues();
+  other.setToRandomValues();
+  robot_state::JointStateGroup *jsg = ks.getJointStateGroup("right_arm");
+  robot_state::JointStateGroup *other_jsg = other.getJointStateGroup("right_arm");
+
+  std::vector<double> values;
+  jsg->getVariableValues(values);
+  EXPECT_NEAR(0.0, robot_state::JointStateGroup::closestIKCost(jsg, values), 1e-9);
+  other_jsg->getVariableValues(values);
+  EXPECT_NEAR(jsg->distance(other_jsg), robot_state::JointStateGroup::closestIKCost(jsg, values), 1e-9);
+  EXPECT_NEAR(-jsg->getMinDistanceToBounds().first, robot_state::JointStateGroup::jointLimitsIKCost(jsg, values), 1e-9);
+
+  // the model has no IK solvers
+  jsg->getVariableValues(values);
+  EXPECT_FALSE(jsg->setFromIKRanked(ks.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform(), "r_wrist_roll_link", 4, 0.1, 2));
+  std::vector<double> after;
+  jsg->getVariableValues(after);
+  EXPECT_EQ(values, after);
+}
+
 //TEST_F(LoadPlanningModelsPr2, robot_state::RobotState *Copy)
 TEST_F(LoadPlanningModelsPr2, FullTest)
 {
@@ -276,6 +716,10 @@ TEST_F(LoadPlanningModelsPr2, FullTest)
   ks2 = ks;
   ks2.getAttachedBodies(attached_bodies_2);
   ASSERT_EQ(attached_bodies_2.size(),1);
+  EXPECT_NE(attached_bodies_1[0], attached_bodies_2[0]);
+  // copies share the shapes of the attached body
+  EXPECT_EQ(attached_bodies_1[0]->getShapes()[0].get(), attached_bodies_2[0]->getShapes()[0].get());
+  EXPECT_TRUE(attached_bodies_2[0]->getGlobalCollisionBodyTransforms()[0].isApprox(ks.getLinkState("r_gripper_palm_link")->getGlobalLinkTransform()));
 
   ks.clearAttachedBody("box");
   attached_bodies_1.clear();
@@ -288,6 +732,138 @@ TEST_F(LoadPlanningModelsPr2, FullTest)
   ASSERT_EQ(attached_bodies_2.size(),0);
 }
 
+TEST_F(LoadPlanningModelsPr2, FrameHandles)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState ks(kmodel);
+  ks.setToRandomValues();
+
+  robot_state::FrameHandle link(*kmodel, "/r_wrist_roll_link");
+  EXPECT_EQ(robot_state::FrameHandle::LINK, link.getType());
+  EXPECT_EQ("r_wrist_roll_link", link.getName());
+  EXPECT_TRUE(ks.knowsFrameTransform(link));
+  EXPECT_TRUE(ks.getFrameTransform(link).isApprox(ks.getFrameTransform("r_wrist_roll_link")));
+
+  robot_state::FrameHandle model_frame(*kmodel, kmodel->getModelFrame());
+  EXPECT_EQ(robot_state::FrameHandle::MODEL_FRAME, model_frame.getType());
+  EXPECT_TRUE(ks.getFrameTransform(model_frame).isApprox(Eigen::Affine3d::Identity()));
+
+  // frames that are not part of the model may be attached later
+  robot_state::FrameHandle box(*kmodel, "box");
+  EXPECT_EQ(robot_state::FrameHandle::ATTACHED_BODY, box.getType());
+  EXPECT_FALSE(ks.knowsFrameTransform(box));
+
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  ks.attachBody("box", shapes, poses, std::set<std::string>(), "r_gripper_palm_link");
+  EXPECT_TRUE(ks.knowsFrameTransform(box));
+  EXPECT_TRUE(ks.getFrameTransform(box).isApprox(ks.getFrameTransform("r_gripper_palm_link")));
+}
+
+TEST_F(LoadPlanningModelsPr2, TouchLinkMask)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::set<std::string> touch_links;
+  touch_links.insert("r_gripper_palm_link");
+  touch_links.insert("base_link");
+  robot_state::AttachedBody ab(kmodel->getLinkModel("r_gripper_palm_link"), "box", shapes, poses, touch_links, sensor_msgs::JointState());
+
+  const std::vector<bool> &mask = ab.getTouchLinkMask();
+  const std::vector<const robot_model::LinkModel*> &links = static_cast<const robot_model::RobotModel&>(*kmodel).getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    std::size_t index = links[i]->getTreeIndex();
+    bool in_mask = index < mask.size() && mask[index];
+    EXPECT_EQ(touch_links.find(links[i]->getName()) != touch_links.end(), in_mask);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, AttachedBodyInstanceID)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  robot_state::AttachedBody ab(kmodel->getLinkModel("r_gripper_palm_link"), "box", shapes, poses, std::set<std::string>(), sensor_msgs::JointState());
+
+  // copies and modified bodies are distinguished, even though copies share the definition
+  robot_state::AttachedBody copy(ab);
+  EXPECT_NE(ab.getInstanceID(), copy.getInstanceID());
+  std::size_t id = copy.getInstanceID();
+  copy.setPadding(0.01);
+  EXPECT_NE(id, copy.getInstanceID());
+}
+
+TEST_F(LoadPlanningModelsPr2, MsgConverter)
+{
+  robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  robot_state::RobotState ks(kmodel);
+  ks.setToRandomValues();
+
+  moveit_msgs::AttachedCollisionObject aco;
+  aco.link_name = "r_wrist_roll_link";
+  aco.object.header.frame_id = "r_wrist_roll_link";
+  aco.object.id = "box";
+  aco.object.operation = moveit_msgs::CollisionObject::ADD;
+  aco.object.primitives.resize(1);
+  aco.object.primitives[0].type = shape_msgs::SolidPrimitive::BOX;
+  aco.object.primitives[0].dimensions.resize(3, 0.1);
+  aco.object.primitive_poses.resize(1);
+  aco.object.primitive_poses[0].orientation.w = 1.0;
+
+  moveit_msgs::RobotState msg;
+  robot_state::robotStateToRobotStateMsg(ks, msg);
+  msg.attached_collision_objects.push_back(aco);
+
+  robot_state::RobotStateMsgConverter converter;
+  robot_state::RobotState ks2(kmodel);
+  robot_state::RobotState ks3(kmodel);
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    ks.setToRandomValues();
+    robot_state::robotStateToJointStateMsg(ks, msg.joint_state);
+    ks2.setToDefaultValues();
+    ks3.setToDefaultValues();
+    EXPECT_EQ(robot_state::robotStateMsgToRobotState(msg, ks2), converter.convert(msg, ks3));
+
+    std::vector<double> v2, v3;
+    ks2.getStateValues(v2);
+    ks3.getStateValues(v3);
+    ASSERT_EQ(v2.size(), v3.size());
+    for (std::size_t i = 0 ; i < v2.size() ; ++i)
+      EXPECT_EQ(v2[i], v3[i]);
+    ASSERT_TRUE(ks3.hasAttachedBody("box"));
+    EXPECT_TRUE(ks3.getAttachedBody("box")->getGlobalCollisionBodyTransforms()[0].isApprox(ks2.getAttachedBody("box")->getGlobalCollisionBodyTransforms()[0]));
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, MsgConverterModelReplaced)
+{
+  robot_state::RobotStateMsgConverter converter;
+  moveit_msgs::RobotState msg;
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    // each model is destroyed before the next one is made, so the next one may well be at the same address
+    robot_model::RobotModelPtr kmodel(new robot_model::RobotModel(urdf_model_, srdf_model_));
+    robot_state::RobotState ks(kmodel);
+    ks.setToRandomValues();
+    robot_state::robotStateToRobotStateMsg(ks, msg, false);
+
+    robot_state::RobotState ks2(kmodel);
+    ks2.setToDefaultValues();
+    EXPECT_TRUE(converter.convert(msg, ks2, false));
+    std::vector<double> v, v2;
+    ks.getStateValues(v);
+    ks2.getStateValues(v2);
+    ASSERT_EQ(v.size(), v2.size());
+    for (std::size_t i = 0 ; i < v.size() ; ++i)
+      EXPECT_EQ(v[i], v2[i]);
+  }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -40,6 +40,7 @@
 #include <moveit/robot_state/robot_state.h>
 #include <moveit_msgs/RobotTrajectory.h>
 #include <moveit_msgs/RobotState.h>
+#include <boost/thread/mutex.hpp>
 #include <deque>
 
 namespace robot_trajectory
@@ -69,34 +70,80 @@ public:
     return waypoints_.size();
   }
 
+  /** \brief Get a waypoint. For compact trajectories, the state is created from the stored values the first time it is accessed
+      (this is safe to do from multiple threads) */
   const robot_state::RobotState& getWayPoint(std::size_t index) const
   {
-    return *waypoints_[index];
+    return reference_state_ ? materializeWayPoint(index) : *waypoints_[index];
   }
 
   const robot_state::RobotState& getLastWayPoint() const
   {
-    return *waypoints_.back();
+    return getWayPoint(waypoints_.size() - 1);
   }
 
   const robot_state::RobotState& getFirstWayPoint() const
   {
-    return *waypoints_.front();
+    return getWayPoint(0);
   }
 
+  /** \brief Get a modifiable waypoint. Compact trajectories are expanded first (see expand()). As its values may change,
+      the waypoint and the ones after it are unwound again by the next call to unwind() */
   robot_state::RobotStatePtr& getWayPointPtr(std::size_t index)
   {
+    expand();
+    if (unwound_count_ > index)
+      unwound_count_ = index;
     return waypoints_[index];
   }
 
   robot_state::RobotStatePtr& getLastWayPointPtr()
   {
-    return waypoints_.back();
+    return getWayPointPtr(waypoints_.size() - 1);
   }
 
   robot_state::RobotStatePtr& getFirstWayPointPtr()
   {
-    return waypoints_.front();
+    return getWayPointPtr(0);
+  }
+
+  /** \brief Store the waypoints compactly: for each waypoint, only the positions, velocities and accelerations of the variables
+      of the group are kept, in contiguous arrays; all other joints take their values from \e reference_state.
+      Full states are created again only when waypoints are accessed. Waypoints added later are stored compactly as well,
+      and only their group variables are kept. Returns false if the trajectory has no group. */
+  bool setCompact(const robot_state::RobotState &reference_state);
+
+  /** \brief Store one full state per waypoint again (undo setCompact()) */
+  void expand();
+
+  /** \brief Replace the waypoints by \e count compact waypoints (see setCompact()), copying their values from row-major arrays
+      of \e count rows of getGroup()->getVariableCount() values (in group order). \e velocities and \e accelerations may be NULL
+      if the waypoints have none; \e durations (the durations from the previous waypoint, \e count values) may be NULL for
+      zero durations. Returns false if the trajectory has no group. */
+  bool setCompactWayPoints(const robot_state::RobotState &reference_state, std::size_t count, const double *positions,
+                           const double *velocities, const double *accelerations, const double *durations);
+
+  /** \brief Check if the waypoints are stored compactly (see setCompact()) */
+  bool isCompact() const
+  {
+    return reference_state_.get() != NULL;
+  }
+
+  /** \brief For compact trajectories, the positions of the group variables at waypoint \e index (getGroup()->getVariableCount()
+      values, in group order); NULL otherwise. Velocities and accelerations are available the same way. */
+  const double* getWayPointPositions(std::size_t index) const
+  {
+    return reference_state_ ? &positions_[index * variable_count_] : NULL;
+  }
+
+  const double* getWayPointVelocities(std::size_t index) const
+  {
+    return reference_state_ && (derivatives_[index] & HAS_VELOCITIES) ? &velocities_[index * variable_count_] : NULL;
+  }
+
+  const double* getWayPointAccelerations(std::size_t index) const
+  {
+    return reference_state_ && (derivatives_[index] & HAS_ACCELERATIONS) ? &accelerations_[index * variable_count_] : NULL;
   }
 
   const std::deque<double>& getWayPointDurations() const
@@ -123,6 +170,7 @@ public:
     if (duration_from_previous_.size() <= index)
       duration_from_previous_.resize(index + 1, 0.0);
     duration_from_previous_[index] = value;
+    invalidateDurationsFromStart(index);
   }
 
   bool empty() const
@@ -137,8 +185,7 @@ public:
 
   void addSuffixWayPoint(const robot_state::RobotStatePtr &state, double dt)
   {
-    waypoints_.push_back(state);
-    duration_from_previous_.push_back(dt);
+    insertWayPoint(waypoints_.size(), state, dt);
   }
 
   void addPrefixWayPoint(const robot_state::RobotState &state, double dt)
@@ -148,8 +195,7 @@ public:
 
   void addPrefixWayPoint(const robot_state::RobotStatePtr &state, double dt)
   {
-    waypoints_.push_front(state);
-    duration_from_previous_.push_front(dt);
+    insertWayPoint(0, state, dt);
   }
 
   void insertWayPoint(std::size_t index, const robot_state::RobotState &state, double dt)
@@ -157,11 +203,8 @@ public:
     insertWayPoint(index, robot_state::RobotStatePtr(new robot_state::RobotState(state)), dt);
   }
 
-  void insertWayPoint(std::size_t index, const robot_state::RobotStatePtr &state, double dt)
-  {
-    waypoints_.insert(waypoints_.begin() + index, state);
-    duration_from_previous_.insert(duration_from_previous_.begin() + index, dt);
-  }
+  /** \brief Insert a waypoint. The trajectory keeps \e state itself, unless it is compact; then only the values of the group variables are copied */
+  void insertWayPoint(std::size_t index, const robot_state::RobotStatePtr &state, double dt);
 
   void append(const RobotTrajectory &source, double dt);
 
@@ -171,6 +214,12 @@ public:
 
   double getAverageSegmentDuration() const;
 
+  /** @brief Get an estimate of the memory held by the trajectory, in bytes: the waypoint states (for a compact trajectory,
+   *  only the ones currently materialized), the compact value arrays and the durations. Waypoint states shared with other
+   *  trajectories are counted here as well; the reference state of a compact trajectory is not counted.
+   */
+  std::size_t getMemoryUsage() const;
+
   void getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const;
 
   void setRobotTrajectoryMsg(const robot_state::RobotState &reference_state,
@@ -181,7 +230,13 @@ public:
 
   void reverse();
 
+  /** \brief Unwrap the values of continuous joints so they change continuously along the trajectory. Only the waypoints added
+      at the end since the previous call are processed; inserting waypoints before them, reverse() (of a partially unwound
+      trajectory) and clear() cause the next call to process the whole trajectory. Waypoints handed out by getWayPointPtr()
+      are processed again, from the first of them on. */
   void unwind();
+
+  /** \brief Unwind the whole trajectory, starting from the turn that \e state is on */
   void unwind(const robot_state::RobotState &state);
 
   /** @brief Finds the waypoint indicies before and after a duration from start.
@@ -201,15 +256,153 @@ public:
   bool getStateAtDurationFromStart(const double request_duration,
                                    robot_state::RobotStatePtr& output_state) const;
 
+  /** @brief Same as above, but the search starts at \e cursor, which is updated to the found waypoint index.
+   *  Start with cursor = 0 and pass the same cursor for a sequence of increasing durations (e.g., when
+   *  sampling the trajectory during execution); each lookup is then amortized constant time.
+   */
+  void findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after, double &blend, std::size_t &cursor) const;
+
+  bool getStateAtDurationFromStart(const double request_duration,
+                                   robot_state::RobotStatePtr& output_state, std::size_t &cursor) const;
+
 private:
 
+  /** \brief Flags in derivatives_ */
+  enum
+    {
+      HAS_VELOCITIES = 1, HAS_ACCELERATIONS = 2
+    };
+
+  /** \brief A mutex that is not shared by copies of the trajectory: each copy gets a mutex of its own */
+  struct CacheMutex : public boost::mutex
+  {
+    CacheMutex()
+    {
+    }
+
+    CacheMutex(const CacheMutex&) : boost::mutex()
+    {
+    }
+
+    CacheMutex& operator=(const CacheMutex&)
+    {
+      return *this;
+    }
+  };
+
+  /** \brief Get the state of a waypoint of a compact trajectory, creating it if needed */
+  const robot_state::RobotState& materializeWayPoint(std::size_t index) const;
+
+  /** \brief Copy the group variables of \e state to the row \e index of a compact trajectory */
+  void storeWayPointValues(std::size_t index, const robot_state::RobotState &state);
+
+  /** \brief Insert \e count rows (of unspecified content) at \e index in the compact storage */
+  void insertRows(std::size_t index, std::size_t count);
+
+  /** \brief Drop the states created for the waypoints of a compact trajectory, after its values changed */
+  void clearMaterializedWayPoints();
+
+  /** \brief Mark the durations from start as out of date, from waypoint \e index on */
+  void invalidateDurationsFromStart(std::size_t index)
+  {
+    if (durations_from_start_valid_ > index)
+      durations_from_start_valid_ = index;
+  }
+
+  /** \brief Unwind the waypoints from \e start on, relative to the waypoint before */
+  void unwindFrom(std::size_t start);
+
+  /** \brief Bring durations_from_start_ up to date with duration_from_previous_. Once this returned, durations_from_start_
+      can be read without locks until the trajectory is modified */
+  void updateDurationsFromStart() const;
+
+  /** \brief Compute the interpolation parameters for \e duration, given the index of the first waypoint reached at or after it */
+  void getIndicesForWayPoint(const double& duration, std::size_t index, int& before, int& after, double &blend) const;
+
   robot_model::RobotModelConstPtr kmodel_;
   const robot_model::JointModelGroup *group_;
-  std::deque<robot_state::RobotStatePtr> waypoints_;
+
+  /** \brief The waypoint states; for compact trajectories, the states created so far (NULL for the others) */
+  mutable std::deque<robot_state::RobotStatePtr> waypoints_;
   std::deque<double> duration_from_previous_;
+
+  /** \brief The cumulative sums of duration_from_previous_; only the first durations_from_start_valid_ entries are up to date */
+  mutable std::vector<double> durations_from_start_;
+  mutable std::size_t durations_from_start_valid_;
+
+  /** \brief Serializes the updates that const functions make to the caches: durations_from_start_ and, for compact
+      trajectories, the states created in waypoints_ */
+  mutable CacheMutex cache_lock_;
+
+  /** \brief The number of leading waypoints that unwind() processed already */
+  std::size_t unwound_count_;
+
+  /** \brief For compact trajectories, the state that provides the values of the joints outside the group; NULL otherwise */
+  robot_state::RobotStateConstPtr reference_state_;
+
+  /** \brief The number of variables of the group (the size of a row of the compact storage) */
+  unsigned int variable_count_;
+
+  /** \brief The compact storage: one row of variable_count_ values per waypoint */
+  std::vector<double> positions_;
+  std::vector<double> velocities_;
+  std::vector<double> accelerations_;
+
+  /** \brief For each waypoint of a compact trajectory, whether velocities and accelerations were set */
+  std::vector<unsigned char> derivatives_;
 };
 
 typedef boost::shared_ptr<RobotTrajectory> RobotTrajectoryPtr;
+
+/** \brief A view of a trajectory in reverse order (e.g., for playing it back), without copying or modifying the trajectory,
+    which must outlive the view. Indices and durations are as they would be after RobotTrajectory::reverse(). */
+class ReversedRobotTrajectoryView
+{
+public:
+
+  ReversedRobotTrajectoryView(const RobotTrajectory &trajectory) : trajectory_(trajectory)
+  {
+  }
+
+  std::size_t getWayPointCount() const
+  {
+    return trajectory_.getWayPointCount();
+  }
+
+  const robot_state::RobotState& getWayPoint(std::size_t index) const
+  {
+    return trajectory_.getWayPoint(trajectory_.getWayPointCount() - 1 - index);
+  }
+
+  double getWayPointDurationFromPrevious(std::size_t index) const
+  {
+    return trajectory_.getWayPointDurationFromPrevious(index == 0 ? 0 : trajectory_.getWayPointCount() - index);
+  }
+
+  double getWaypointDurationFromStart(std::size_t index) const
+  {
+    std::size_t n = trajectory_.getWayPointCount();
+    if (index >= n)
+      return -1.0;
+    return getDuration() - trajectory_.getWaypointDurationFromStart(n - 1 - index) + trajectory_.getWayPointDurationFromPrevious(0);
+  }
+
+  /** \brief The duration of the trajectory (the same in both directions) */
+  double getDuration() const
+  {
+    return trajectory_.empty() ? 0.0 : trajectory_.getWaypointDurationFromStart(trajectory_.getWayPointCount() - 1);
+  }
+
+  bool getStateAtDurationFromStart(const double request_duration, robot_state::RobotStatePtr& output_state) const
+  {
+    return trajectory_.getStateAtDurationFromStart(getDuration() + trajectory_.getWayPointDurationFromPrevious(0) - request_duration,
+                                                   output_state);
+  }
+
+private:
+
+  const RobotTrajectory &trajectory_;
+};
 typedef boost::shared_ptr<const RobotTrajectory> RobotTrajectoryConstPtr;
 
 }
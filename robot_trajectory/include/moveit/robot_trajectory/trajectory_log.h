@@ -0,0 +1,175 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#ifndef MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_LOG_
+#define MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_LOG_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <ostream>
+
+namespace boost
+{
+namespace iostreams
+{
+class mapped_file_source;
+}
+}
+
+namespace robot_trajectory
+{
+
+/** \brief Compute the hash that identifies the variable layout of \e model in trajectory logs: the model name and the names
+    of all its variables, in order. The hash does not depend on the platform. */
+boost::uint64_t computeTrajectoryLogModelHash(const robot_model::RobotModel &model);
+
+/** \brief Write \e trajectory to \e out in the binary trajectory log format (in the byte order of this machine): a header with
+    the hash of the robot model (see computeTrajectoryLogModelHash()), the group and the names of its variables, then contiguous
+    blocks of the durations from the previous waypoint, the positions and, if every waypoint has them, the velocities and the
+    accelerations of the group variables. Blocks start at multiples of 8 bytes, so the log can be read in place once it is
+    memory-mapped (see TrajectoryLogView). Returns false if the trajectory has no group. */
+bool saveTrajectoryLog(const RobotTrajectory &trajectory, std::ostream &out);
+
+/** \brief Read access to a trajectory log written by saveTrajectoryLog(), without copying its values: the waypoints can be
+    iterated in place, or loaded into the compact storage of a RobotTrajectory. */
+class TrajectoryLogView : private boost::noncopyable
+{
+public:
+
+  TrajectoryLogView();
+  ~TrajectoryLogView();
+
+  /** \brief Memory-map the log in the file \e path. Return false if the file can not be mapped or is not a valid log. */
+  bool openFile(const std::string &path);
+
+  /** \brief Use the log in the \e size bytes at \e data, which must start at a multiple of 8 bytes and stay valid while the
+      view is open. Return false if the data is not a valid log. */
+  bool openData(const char *data, std::size_t size);
+
+  void close();
+
+  bool isOpen() const
+  {
+    return data_ != NULL;
+  }
+
+  boost::uint64_t getModelHash() const
+  {
+    return model_hash_;
+  }
+
+  const std::string& getModelName() const
+  {
+    return model_name_;
+  }
+
+  const std::string& getGroupName() const
+  {
+    return group_name_;
+  }
+
+  const std::vector<std::string>& getVariableNames() const
+  {
+    return variable_names_;
+  }
+
+  std::size_t getVariableCount() const
+  {
+    return variable_names_.size();
+  }
+
+  std::size_t getWayPointCount() const
+  {
+    return waypoint_count_;
+  }
+
+  /** \brief Check whether the log was recorded for a robot model with the same variable layout as \e model */
+  bool matches(const robot_model::RobotModel &model) const
+  {
+    return isOpen() && model_hash_ == computeTrajectoryLogModelHash(model);
+  }
+
+  /** \brief The durations from the previous waypoint (getWayPointCount() values) */
+  const double* getDurations() const
+  {
+    return durations_;
+  }
+
+  /** \brief The positions of the group variables at waypoint \e index (getVariableCount() values); velocities and
+      accelerations are available the same way, or NULL if the log has none */
+  const double* getWayPointPositions(std::size_t index) const
+  {
+    return positions_ + index * variable_names_.size();
+  }
+
+  const double* getWayPointVelocities(std::size_t index) const
+  {
+    return velocities_ ? velocities_ + index * variable_names_.size() : NULL;
+  }
+
+  const double* getWayPointAccelerations(std::size_t index) const
+  {
+    return accelerations_ ? accelerations_ + index * variable_names_.size() : NULL;
+  }
+
+  /** \brief Replace the waypoints of \e trajectory by the ones of the log, stored compactly (see RobotTrajectory::setCompact())
+      with \e reference_state providing the joints outside the group. The group of the trajectory is set to the group of the log.
+      Return false if the log was recorded for a different robot model. */
+  bool load(const robot_state::RobotState &reference_state, RobotTrajectory &trajectory) const;
+
+private:
+
+  bool parse();
+
+  boost::scoped_ptr<boost::iostreams::mapped_file_source> file_;
+  const char                                             *data_;
+  std::size_t                                             size_;
+
+  boost::uint64_t                                         model_hash_;
+  std::string                                             model_name_;
+  std::string                                             group_name_;
+  std::vector<std::string>                                variable_names_;
+  std::size_t                                             waypoint_count_;
+  const double                                           *durations_;
+  const double                                           *positions_;
+  const double                                           *velocities_;
+  const double                                           *accelerations_;
+};
+
+}
+
+#endif
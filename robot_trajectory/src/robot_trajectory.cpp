@@ -39,18 +39,213 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/math/constants/constants.hpp>
 #include <numeric>
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+
+// unwrap a column of continuous joint values in place, starting with the specified offset
+void unwindColumn(double *values, std::size_t count, std::size_t stride, double running_offset)
+{
+  double last_value = values[0];
+  if (running_offset > std::numeric_limits<double>::epsilon() || running_offset < -std::numeric_limits<double>::epsilon())
+    values[0] += running_offset;
+  for (std::size_t j = 1 ; j < count ; ++j)
+  {
+    double &current_value = values[j * stride];
+    if (last_value > current_value + boost::math::constants::pi<double>())
+      running_offset += 2.0 * boost::math::constants::pi<double>();
+    else
+      if (current_value > last_value + boost::math::constants::pi<double>())
+        running_offset -= 2.0 * boost::math::constants::pi<double>();
+
+    last_value = current_value;
+    if (running_offset > std::numeric_limits<double>::epsilon() || running_offset < -std::numeric_limits<double>::epsilon())
+      current_value += running_offset;
+  }
+}
+
+}
 
 robot_trajectory::RobotTrajectory::RobotTrajectory(const robot_model::RobotModelConstPtr &kmodel, const std::string &group) :
   kmodel_(kmodel),
-  group_(group.empty() ? NULL : kmodel->getJointModelGroup(group))
+  group_(group.empty() ? NULL : kmodel->getJointModelGroup(group)),
+  variable_count_(0),
+  durations_from_start_valid_(0),
+  unwound_count_(0)
 {
 }
 
 void robot_trajectory::RobotTrajectory::setGroupName(const std::string &group_name)
 {
+  // the compact storage is laid out for the group
+  expand();
   group_ = kmodel_->getJointModelGroup(group_name);
 }
 
+bool robot_trajectory::RobotTrajectory::setCompact(const robot_state::RobotState &reference_state)
+{
+  if (!group_)
+  {
+    logError("Only trajectories for a group can be stored compactly");
+    return false;
+  }
+  robot_state::RobotStateConstPtr reference(new robot_state::RobotState(reference_state));
+
+  // take the values from the current states before switching the storage
+  std::deque<robot_state::RobotStatePtr> states;
+  for (std::size_t i = 0 ; i < waypoints_.size() ; ++i)
+    states.push_back(robot_state::RobotStatePtr(new robot_state::RobotState(getWayPoint(i))));
+
+  reference_state_ = reference;
+  variable_count_ = group_->getVariableCount();
+  positions_.clear();
+  velocities_.clear();
+  accelerations_.clear();
+  derivatives_.clear();
+  insertRows(0, states.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    storeWayPointValues(i, *states[i]);
+  clearMaterializedWayPoints();
+  return true;
+}
+
+bool robot_trajectory::RobotTrajectory::setCompactWayPoints(const robot_state::RobotState &reference_state, std::size_t count,
+                                                            const double *positions, const double *velocities,
+                                                            const double *accelerations, const double *durations)
+{
+  if (!group_)
+  {
+    logError("Only trajectories for a group can be stored compactly");
+    return false;
+  }
+  clear();
+  reference_state_.reset(new robot_state::RobotState(reference_state));
+  variable_count_ = group_->getVariableCount();
+  const std::size_t n = count * variable_count_;
+  positions_.assign(positions, positions + n);
+  if (velocities)
+    velocities_.assign(velocities, velocities + n);
+  else
+    velocities_.assign(n, 0.0);
+  if (accelerations)
+    accelerations_.assign(accelerations, accelerations + n);
+  else
+    accelerations_.assign(n, 0.0);
+  derivatives_.assign(count, (velocities ? HAS_VELOCITIES : 0) | (accelerations ? HAS_ACCELERATIONS : 0));
+  waypoints_.resize(count);
+  if (durations)
+    duration_from_previous_.assign(durations, durations + count);
+  else
+    duration_from_previous_.assign(count, 0.0);
+  return true;
+}
+
+void robot_trajectory::RobotTrajectory::expand()
+{
+  if (!reference_state_)
+    return;
+  for (std::size_t i = 0 ; i < waypoints_.size() ; ++i)
+    if (!waypoints_[i])
+      materializeWayPoint(i);
+  reference_state_.reset();
+  std::vector<double>().swap(positions_);
+  std::vector<double>().swap(velocities_);
+  std::vector<double>().swap(accelerations_);
+  std::vector<unsigned char>().swap(derivatives_);
+}
+
+const robot_state::RobotState& robot_trajectory::RobotTrajectory::materializeWayPoint(std::size_t index) const
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  if (waypoints_[index])
+    return *waypoints_[index];
+  robot_state::RobotStatePtr state(new robot_state::RobotState(*reference_state_));
+  robot_state::JointStateGroup *jsg = state->getJointStateGroup(group_->getName());
+  const std::vector<robot_state::JointState*> &joints = jsg->getJointStateVector();
+  const std::size_t row = index * variable_count_;
+  unsigned int value_counter = 0;
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    unsigned int dim = joints[i]->getVariableCount();
+    if (dim == 0)
+      continue;
+    joints[i]->setVariableValues(&positions_[row + value_counter]);
+    if (derivatives_[index] & HAS_VELOCITIES)
+      joints[i]->getVelocities().assign(velocities_.begin() + row + value_counter, velocities_.begin() + row + value_counter + dim);
+    else
+      joints[i]->getVelocities().clear();
+    if (derivatives_[index] & HAS_ACCELERATIONS)
+      joints[i]->getAccelerations().assign(accelerations_.begin() + row + value_counter, accelerations_.begin() + row + value_counter + dim);
+    else
+      joints[i]->getAccelerations().clear();
+    value_counter += dim;
+  }
+  jsg->updateLinkTransforms();
+  waypoints_[index] = state;
+  return *state;
+}
+
+void robot_trajectory::RobotTrajectory::storeWayPointValues(std::size_t index, const robot_state::RobotState &state)
+{
+  const std::vector<robot_state::JointState*> &joints = state.getJointStateGroup(group_->getName())->getJointStateVector();
+  const std::size_t row = index * variable_count_;
+  unsigned char derivatives = HAS_VELOCITIES | HAS_ACCELERATIONS;
+  unsigned int value_counter = 0;
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    unsigned int dim = joints[i]->getVariableCount();
+    if (dim == 0)
+      continue;
+    const std::vector<double> &values = joints[i]->getVariableValues();
+    const std::vector<double> &vel = joints[i]->getVelocities();
+    const std::vector<double> &acc = joints[i]->getAccelerations();
+    for (unsigned int k = 0 ; k < dim ; ++k)
+      positions_[row + value_counter + k] = values[k];
+    if (vel.size() == dim)
+      std::copy(vel.begin(), vel.end(), velocities_.begin() + row + value_counter);
+    else
+      derivatives &= ~HAS_VELOCITIES;
+    if (acc.size() == dim)
+      std::copy(acc.begin(), acc.end(), accelerations_.begin() + row + value_counter);
+    else
+      derivatives &= ~HAS_ACCELERATIONS;
+    value_counter += dim;
+  }
+  derivatives_[index] = derivatives;
+}
+
+void robot_trajectory::RobotTrajectory::insertRows(std::size_t index, std::size_t count)
+{
+  positions_.insert(positions_.begin() + index * variable_count_, count * variable_count_, 0.0);
+  velocities_.insert(velocities_.begin() + index * variable_count_, count * variable_count_, 0.0);
+  accelerations_.insert(accelerations_.begin() + index * variable_count_, count * variable_count_, 0.0);
+  derivatives_.insert(derivatives_.begin() + index, count, 0);
+}
+
+void robot_trajectory::RobotTrajectory::clearMaterializedWayPoints()
+{
+  for (std::size_t i = 0 ; i < waypoints_.size() ; ++i)
+    waypoints_[i].reset();
+}
+
+void robot_trajectory::RobotTrajectory::insertWayPoint(std::size_t index, const robot_state::RobotStatePtr &state, double dt)
+{
+  duration_from_previous_.insert(duration_from_previous_.begin() + index, dt);
+  invalidateDurationsFromStart(index);
+  if (unwound_count_ > index)
+    unwound_count_ = index;
+  if (reference_state_)
+  {
+    waypoints_.insert(waypoints_.begin() + index, robot_state::RobotStatePtr());
+    insertRows(index, 1);
+    storeWayPointValues(index, *state);
+  }
+  else
+    waypoints_.insert(waypoints_.begin() + index, state);
+}
+
 const std::string& robot_trajectory::RobotTrajectory::getGroupName() const
 {
   if (group_)
@@ -72,26 +267,73 @@ void robot_trajectory::RobotTrajectory::swap(robot_trajectory::RobotTrajectory &
   kmodel_.swap(other.kmodel_);
   std::swap(group_, other.group_);
   waypoints_.swap(other.waypoints_);
-  duration_from_previous_.swap(duration_from_previous_);
+  duration_from_previous_.swap(other.duration_from_previous_);
+  durations_from_start_.swap(other.durations_from_start_);
+  std::swap(durations_from_start_valid_, other.durations_from_start_valid_);
+  std::swap(unwound_count_, other.unwound_count_);
+  reference_state_.swap(other.reference_state_);
+  std::swap(variable_count_, other.variable_count_);
+  positions_.swap(other.positions_);
+  velocities_.swap(other.velocities_);
+  accelerations_.swap(other.accelerations_);
+  derivatives_.swap(other.derivatives_);
 }
 
 void robot_trajectory::RobotTrajectory::append(const RobotTrajectory &source, double dt)
 {
-  waypoints_.insert(waypoints_.end(), source.waypoints_.begin(),source.waypoints_.end());
+  if (reference_state_)
+  {
+    std::size_t first = waypoints_.size();
+    waypoints_.resize(first + source.waypoints_.size());
+    insertRows(first, source.waypoints_.size());
+    if (source.reference_state_ && source.group_ == group_)
+    {
+      // same layout; copy the rows
+      std::copy(source.positions_.begin(), source.positions_.end(), positions_.begin() + first * variable_count_);
+      std::copy(source.velocities_.begin(), source.velocities_.end(), velocities_.begin() + first * variable_count_);
+      std::copy(source.accelerations_.begin(), source.accelerations_.end(), accelerations_.begin() + first * variable_count_);
+      std::copy(source.derivatives_.begin(), source.derivatives_.end(), derivatives_.begin() + first);
+    }
+    else
+      for (std::size_t i = 0 ; i < source.waypoints_.size() ; ++i)
+        storeWayPointValues(first + i, source.getWayPoint(i));
+  }
+  else
+    for (std::size_t i = 0 ; i < source.waypoints_.size() ; ++i)
+      // the states created for a compact source are its cache, so they are copied rather than shared
+      waypoints_.push_back(source.reference_state_ ? robot_state::RobotStatePtr(new robot_state::RobotState(source.getWayPoint(i))) :
+                           source.waypoints_[i]);
   std::size_t index = duration_from_previous_.size();
   duration_from_previous_.insert(duration_from_previous_.end(), source.duration_from_previous_.begin(),source.duration_from_previous_.end());
   if (duration_from_previous_.size() > index)
     duration_from_previous_[index] += dt;
+  invalidateDurationsFromStart(index);
 }
 
 void robot_trajectory::RobotTrajectory::reverse()
 {
   std::reverse(waypoints_.begin(), waypoints_.end());
+  if (reference_state_)
+  {
+    // reverse the order of the rows, keeping the values within each row in place
+    const std::size_t n = derivatives_.size();
+    for (std::size_t i = 0 ; i < n / 2 ; ++i)
+    {
+      std::swap_ranges(positions_.begin() + i * variable_count_, positions_.begin() + (i + 1) * variable_count_, positions_.begin() + (n - 1 - i) * variable_count_);
+      std::swap_ranges(velocities_.begin() + i * variable_count_, velocities_.begin() + (i + 1) * variable_count_, velocities_.begin() + (n - 1 - i) * variable_count_);
+      std::swap_ranges(accelerations_.begin() + i * variable_count_, accelerations_.begin() + (i + 1) * variable_count_, accelerations_.begin() + (n - 1 - i) * variable_count_);
+    }
+    std::reverse(derivatives_.begin(), derivatives_.end());
+  }
+  // a completely unwound trajectory stays unwound
+  if (unwound_count_ < waypoints_.size())
+    unwound_count_ = 0;
   if (!duration_from_previous_.empty())
   {
     duration_from_previous_.push_back(duration_from_previous_.front());
     std::reverse(duration_from_previous_.begin(), duration_from_previous_.end());
     duration_from_previous_.pop_back();
+    invalidateDurationsFromStart(0);
   }
 }
 
@@ -100,8 +342,25 @@ void robot_trajectory::RobotTrajectory::unwind()
   if (waypoints_.empty())
     return;
 
+  // the first unwound_count_ waypoints are unwound already; continue from there
+  if (unwound_count_ > 1)
+  {
+    unwindFrom(unwound_count_);
+    return;
+  }
+
   const std::vector<const robot_model::JointModel*> &cont_joints = group_ ?
     group_->getContinuousJointModels() : kmodel_->getContinuousJointModels();
+  unwound_count_ = waypoints_.size();
+
+  if (reference_state_)
+  {
+    const std::map<std::string, unsigned int> &index_map = group_->getJointVariablesIndexMap();
+    for (std::size_t i = 0 ; i < cont_joints.size() ; ++i)
+      unwindColumn(&positions_[index_map.find(cont_joints[i]->getName())->second], derivatives_.size(), variable_count_, 0.0);
+    clearMaterializedWayPoints();
+    return;
+  }
 
   for (std::size_t i = 0 ; i < cont_joints.size() ; ++i)
   {
@@ -129,6 +388,49 @@ void robot_trajectory::RobotTrajectory::unwind()
   }
 }
 
+void robot_trajectory::RobotTrajectory::unwindFrom(std::size_t start)
+{
+  const std::size_t n = waypoints_.size();
+  if (start >= n)
+    return;
+  const std::vector<const robot_model::JointModel*> &cont_joints = group_ ?
+    group_->getContinuousJointModels() : kmodel_->getContinuousJointModels();
+  const double two_pi = 2.0 * boost::math::constants::pi<double>();
+
+  // each new value is moved by full turns to within pi of the (already unwound) value before it
+  for (std::size_t i = 0 ; i < cont_joints.size() ; ++i)
+    if (reference_state_)
+    {
+      double *values = &positions_[group_->getJointVariablesIndexMap().find(cont_joints[i]->getName())->second];
+      for (std::size_t j = start ; j < n ; ++j)
+      {
+        double &current = values[j * variable_count_];
+        current += two_pi * floor((values[(j - 1) * variable_count_] - current) / two_pi + 0.5);
+      }
+    }
+    else
+    {
+      double last_value = waypoints_[start - 1]->getJointState(cont_joints[i])->getVariableValues()[0];
+      for (std::size_t j = start ; j < n ; ++j)
+      {
+        robot_state::JointState *js = waypoints_[j]->getJointState(cont_joints[i]);
+        std::vector<double> current_value = js->getVariableValues();
+        double turns = floor((last_value - current_value[0]) / two_pi + 0.5);
+        if (turns != 0.0)
+        {
+          current_value[0] += two_pi * turns;
+          js->setVariableValues(current_value);
+        }
+        last_value = current_value[0];
+      }
+    }
+
+  if (reference_state_)
+    for (std::size_t j = start ; j < n ; ++j)
+      waypoints_[j].reset();
+  unwound_count_ = n;
+}
+
 void robot_trajectory::RobotTrajectory::unwind(const robot_state::RobotState &state)
 {
   if (waypoints_.empty())
@@ -146,6 +448,13 @@ void robot_trajectory::RobotTrajectory::unwind(const robot_state::RobotState &st
     // unwrap continuous joints
     double running_offset = jstate->getVariableValues()[0] - reference_value[0];
 
+    if (reference_state_)
+    {
+      unwindColumn(&positions_[group_->getJointVariablesIndexMap().find(cont_joints[i]->getName())->second],
+                   derivatives_.size(), variable_count_, running_offset);
+      continue;
+    }
+
     robot_state::JointState *js0 =  waypoints_[0]->getJointState(cont_joints[i]);
     double last_value = js0->getVariableValues()[0];
     if (running_offset > std::numeric_limits<double>::epsilon() || running_offset < -std::numeric_limits<double>::epsilon())
@@ -173,12 +482,33 @@ void robot_trajectory::RobotTrajectory::unwind(const robot_state::RobotState &st
       }
     }
   }
+  if (reference_state_)
+    clearMaterializedWayPoints();
+  unwound_count_ = waypoints_.size();
 }
 
 void robot_trajectory::RobotTrajectory::clear()
 {
   waypoints_.clear();
   duration_from_previous_.clear();
+  invalidateDurationsFromStart(0);
+  unwound_count_ = 0;
+  positions_.clear();
+  velocities_.clear();
+  accelerations_.clear();
+  derivatives_.clear();
+}
+
+std::size_t robot_trajectory::RobotTrajectory::getMemoryUsage() const
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  std::size_t bytes = sizeof(*this) + waypoints_.size() * sizeof(robot_state::RobotStatePtr) +
+    duration_from_previous_.size() * sizeof(double) + durations_from_start_.capacity() * sizeof(double) +
+    (positions_.capacity() + velocities_.capacity() + accelerations_.capacity()) * sizeof(double) + derivatives_.capacity();
+  for (std::size_t i = 0 ; i < waypoints_.size() ; ++i)
+    if (waypoints_[i])
+      bytes += waypoints_[i]->getMemoryUsage();
+  return bytes;
 }
 
 void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const
@@ -218,6 +548,19 @@ void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::Robot
     trajectory.multi_dof_joint_trajectory.points.resize(waypoints_.size());
   }
 
+  // in compact mode, the values are read from the rows directly
+  std::vector<unsigned int> onedof_columns, mdof_columns;
+  if (reference_state_)
+  {
+    const std::map<std::string, unsigned int> &index_map = group_->getJointVariablesIndexMap();
+    for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+      onedof_columns.push_back(index_map.find(onedof[j]->getName())->second);
+    for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+      mdof_columns.push_back(mdof[j]->getVariableCount() > 0 ? index_map.find(mdof[j]->getName())->second : 0);
+  }
+  std::vector<double> values;
+  Eigen::Affine3d transf;
+
   static const ros::Duration zero_duration(0.0);
   double total_time = 0.0;
   for (std::size_t i = 0 ; i < waypoints_.size() ; ++i)
@@ -225,13 +568,51 @@ void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::Robot
     if (duration_from_previous_.size() > i)
       total_time += duration_from_previous_[i];
 
+    if (reference_state_)
+    {
+      const double *row = &positions_[i * variable_count_];
+      if (!onedof.empty())
+      {
+        trajectory_msgs::JointTrajectoryPoint &point = trajectory.joint_trajectory.points[i];
+        point.positions.resize(onedof.size());
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          point.positions[j] = row[onedof_columns[j]];
+        if (derivatives_[i] & HAS_VELOCITIES)
+        {
+          point.velocities.resize(onedof.size());
+          for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+            point.velocities[j] = velocities_[i * variable_count_ + onedof_columns[j]];
+        }
+        if (derivatives_[i] & HAS_ACCELERATIONS)
+        {
+          point.accelerations.resize(onedof.size());
+          for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+            point.accelerations[j] = accelerations_[i * variable_count_ + onedof_columns[j]];
+        }
+        point.time_from_start = duration_from_previous_.size() > i ? ros::Duration(total_time) : zero_duration;
+      }
+      if (!mdof.empty())
+      {
+        trajectory_msgs::MultiDOFJointTrajectoryPoint &point = trajectory.multi_dof_joint_trajectory.points[i];
+        point.transforms.resize(mdof.size());
+        for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+        {
+          values.assign(row + mdof_columns[j], row + mdof_columns[j] + mdof[j]->getVariableCount());
+          mdof[j]->computeTransform(values, transf);
+          tf::transformEigenToMsg(transf, point.transforms[j]);
+        }
+        point.time_from_start = duration_from_previous_.size() > i ? ros::Duration(total_time) : zero_duration;
+      }
+      continue;
+    }
+
     if (!onedof.empty())
     {
       trajectory.joint_trajectory.points[i].positions.resize(onedof.size());
       trajectory.joint_trajectory.points[i].velocities.reserve(onedof.size());
       for (std::size_t j = 0 ; j < onedof.size() ; ++j)
       {
-        const robot_state::JointState *js = waypoints_[i]->getJointState(onedof[j]->getName());
+        const robot_state::JointState *js = getWayPoint(i).getJointState(onedof[j]);
         trajectory.joint_trajectory.points[i].positions[j] = js->getVariableValues()[0];
         // if we have velocities, copy those too
         if (!js->getVelocities().empty())
@@ -252,7 +633,7 @@ void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::Robot
     {
       trajectory.multi_dof_joint_trajectory.points[i].transforms.resize(mdof.size());
       for (std::size_t j = 0 ; j < mdof.size() ; ++j)
-        tf::transformEigenToMsg(waypoints_[i]->getJointState(mdof[j]->getName())->getVariableTransform(), trajectory.multi_dof_joint_trajectory.points[i].transforms[j]);
+        tf::transformEigenToMsg(getWayPoint(i).getJointState(mdof[j])->getVariableTransform(), trajectory.multi_dof_joint_trajectory.points[i].transforms[j]);
       if (duration_from_previous_.size() > i)
         trajectory.multi_dof_joint_trajectory.points[i].time_from_start = ros::Duration(total_time);
       else
@@ -267,38 +648,172 @@ void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state:
   // make a copy just in case the next clear() removes the memory for the reference passed in
   robot_state::RobotState copy = reference_state;
   clear();
+  // in compact mode, variables outside the group come from the new reference
+  if (reference_state_)
+    reference_state_.reset(new robot_state::RobotState(copy));
+
+  const trajectory_msgs::JointTrajectory &jt = trajectory.joint_trajectory;
+  const moveit_msgs::MultiDOFJointTrajectory &mdt = trajectory.multi_dof_joint_trajectory;
+
+  // resolve the names in the message once: for every joint with variables in the message,
+  // the message column of each of its variables (-1 for variables that are not specified)
+  std::map<std::string, int> name_columns;
+  for (std::size_t k = 0 ; k < jt.joint_names.size() ; ++k)
+    name_columns[jt.joint_names[k]] = k;
+  std::vector<const robot_model::JointModel*> joints;
+  std::vector<std::vector<int> > columns;
+  const std::vector<const robot_model::JointModel*> &all_joints = kmodel_->getJointModels();
+  for (std::size_t k = 0 ; k < all_joints.size() && !name_columns.empty() ; ++k)
+  {
+    if (all_joints[k]->getMimic())
+      continue;
+    const std::vector<std::string> &vnames = all_joints[k]->getVariableNames();
+    std::vector<int> c(vnames.size(), -1);
+    bool found = false;
+    for (std::size_t v = 0 ; v < vnames.size() ; ++v)
+    {
+      std::map<std::string, int>::const_iterator it = name_columns.find(vnames[v]);
+      if (it != name_columns.end())
+      {
+        c[v] = it->second;
+        found = true;
+      }
+    }
+    if (found)
+    {
+      joints.push_back(all_joints[k]);
+      columns.push_back(c);
+    }
+  }
+  std::vector<const robot_model::JointModel*> mdof_joints(mdt.joint_names.size(), NULL);
+  for (std::size_t k = 0 ; k < mdt.joint_names.size() ; ++k)
+  {
+    mdof_joints[k] = kmodel_->getJointModel(mdt.joint_names[k]);
+    if (!mdof_joints[k])
+      logWarn("No joint matching multi-dof joint '%s'", mdt.joint_names[k].c_str());
+  }
+  if (!mdt.joint_names.empty() && mdt.header.frame_id != kmodel_->getModelFrame())
+    logWarn("The transform for multi-dof joints was specified in frame '%s' but it was not possible to transform that to frame '%s'",
+            mdt.header.frame_id.c_str(), kmodel_->getModelFrame().c_str());
+
+  // in compact mode, the rows are written directly; start from the values of the reference
+  std::vector<int> group_columns;
+  std::vector<double> reference_row;
+  bool full_group = false;
+  if (reference_state_)
+  {
+    reference_state_->getJointStateGroup(group_->getName())->getVariableValues(reference_row);
+    const std::map<std::string, unsigned int> &index_map = group_->getJointVariablesIndexMap();
+    std::size_t group_variables = 0;
+    for (std::size_t k = 0 ; k < joints.size() ; ++k)
+    {
+      std::map<std::string, unsigned int>::const_iterator it = index_map.find(joints[k]->getName());
+      group_columns.push_back(it != index_map.end() ? (int)it->second : -1);
+      if (group_columns.back() >= 0)
+        group_variables += std::count_if(columns[k].begin(), columns[k].end(), std::bind2nd(std::greater_equal<int>(), 0));
+    }
+    full_group = group_variables == variable_count_;
+  }
 
-  std::size_t state_count = std::max(trajectory.joint_trajectory.points.size(),
-                                     trajectory.multi_dof_joint_trajectory.points.size());
-  ros::Time last_time_stamp = trajectory.joint_trajectory.points.empty() ? trajectory.multi_dof_joint_trajectory.header.stamp : trajectory.joint_trajectory.header.stamp;
+  std::size_t state_count = std::max(jt.points.size(), mdt.points.size());
+  ros::Time last_time_stamp = jt.points.empty() ? mdt.header.stamp : jt.header.stamp;
   ros::Time this_time_stamp = last_time_stamp;
+  std::vector<double> values;
 
   for (std::size_t i = 0 ; i < state_count ; ++i)
   {
-    moveit_msgs::RobotState rs;
-    if (trajectory.joint_trajectory.points.size() > i)
+    const trajectory_msgs::JointTrajectoryPoint *point = NULL;
+    if (jt.points.size() > i)
     {
-      rs.joint_state.header = trajectory.joint_trajectory.header;
-      rs.joint_state.header.stamp = rs.joint_state.header.stamp + trajectory.joint_trajectory.points[i].time_from_start;
-      rs.joint_state.name = trajectory.joint_trajectory.joint_names;
-      rs.joint_state.position = trajectory.joint_trajectory.points[i].positions;
-      rs.joint_state.velocity = trajectory.joint_trajectory.points[i].velocities;
-      this_time_stamp = rs.joint_state.header.stamp;
+      point = &jt.points[i];
+      this_time_stamp = jt.header.stamp + point->time_from_start;
+      if (point->positions.size() != jt.joint_names.size())
+      {
+        logError("Different number of names and positions in JointTrajectory message: %u, %u",
+                 (unsigned int)jt.joint_names.size(), (unsigned int)point->positions.size());
+        point = NULL;
+      }
     }
-    if (trajectory.multi_dof_joint_trajectory.points.size() > i)
+    const trajectory_msgs::MultiDOFJointTrajectoryPoint *mdof_point = NULL;
+    if (mdt.points.size() > i)
     {
-      rs.multi_dof_joint_state.joint_names = trajectory.multi_dof_joint_trajectory.joint_names;
-      rs.multi_dof_joint_state.header = trajectory.multi_dof_joint_trajectory.header;
-      rs.multi_dof_joint_state.header.stamp = trajectory.multi_dof_joint_trajectory.header.stamp + trajectory.multi_dof_joint_trajectory.points[i].time_from_start;
-      rs.multi_dof_joint_state.joint_transforms = trajectory.multi_dof_joint_trajectory.points[i].transforms;
-      this_time_stamp = rs.multi_dof_joint_state.header.stamp;
+      mdof_point = &mdt.points[i];
+      this_time_stamp = mdt.header.stamp + mdof_point->time_from_start;
+      if (mdof_point->transforms.size() != mdt.joint_names.size())
+      {
+        logError("Different number of names, values or frames in MultiDOFJointState message.");
+        mdof_point = NULL;
+      }
     }
-
-    robot_state::RobotStatePtr st(new robot_state::RobotState(copy));
-    robot_state::robotStateMsgToRobotState(rs, *st);
-    addSuffixWayPoint(st, (this_time_stamp - last_time_stamp).toSec());
+    bool has_velocities = point && point->velocities.size() == jt.joint_names.size();
+    bool has_accelerations = point && point->accelerations.size() == jt.joint_names.size();
+    double dt = (this_time_stamp - last_time_stamp).toSec();
     last_time_stamp = this_time_stamp;
+
+    if (reference_state_)
+    {
+      std::size_t index = waypoints_.size();
+      waypoints_.push_back(robot_state::RobotStatePtr());
+      duration_from_previous_.push_back(dt);
+      insertRows(index, 1);
+      double *row = &positions_[index * variable_count_];
+      std::copy(reference_row.begin(), reference_row.end(), row);
+      for (std::size_t k = 0 ; point && k < joints.size() ; ++k)
+        if (group_columns[k] >= 0)
+          for (std::size_t v = 0 ; v < columns[k].size() ; ++v)
+            if (columns[k][v] >= 0)
+            {
+              row[group_columns[k] + v] = point->positions[columns[k][v]];
+              if (has_velocities)
+                velocities_[index * variable_count_ + group_columns[k] + v] = point->velocities[columns[k][v]];
+              if (has_accelerations)
+                accelerations_[index * variable_count_ + group_columns[k] + v] = point->accelerations[columns[k][v]];
+            }
+      derivatives_[index] = (full_group && has_velocities ? HAS_VELOCITIES : 0) | (full_group && has_accelerations ? HAS_ACCELERATIONS : 0);
+      for (std::size_t k = 0 ; mdof_point && k < mdof_joints.size() ; ++k)
+      {
+        std::map<std::string, unsigned int>::const_iterator it = mdof_joints[k] ?
+          group_->getJointVariablesIndexMap().find(mdof_joints[k]->getName()) : group_->getJointVariablesIndexMap().end();
+        if (it == group_->getJointVariablesIndexMap().end())
+          continue;
+        Eigen::Affine3d transf;
+        tf::transformMsgToEigen(mdof_point->transforms[k], transf);
+        mdof_joints[k]->computeJointStateValues(transf, values);
+        std::copy(values.begin(), values.end(), row + it->second);
+      }
+    }
+    else
+    {
+      robot_state::RobotStatePtr st(new robot_state::RobotState(copy));
+      for (std::size_t k = 0 ; point && k < joints.size() ; ++k)
+      {
+        robot_state::JointState *js = st->getJointState(joints[k]);
+        values = js->getVariableValues();
+        for (std::size_t v = 0 ; v < columns[k].size() ; ++v)
+          if (columns[k][v] >= 0)
+            values[v] = point->positions[columns[k][v]];
+        js->setVariableValues(values);
+        // velocities and accelerations are kept for joints that are completely specified
+        if (values.size() == 1)
+        {
+          if (has_velocities)
+            js->getVelocities().assign(1, point->velocities[columns[k][0]]);
+          if (has_accelerations)
+            js->getAccelerations().assign(1, point->accelerations[columns[k][0]]);
+        }
+      }
+      for (std::size_t k = 0 ; mdof_point && k < mdof_joints.size() ; ++k)
+        if (mdof_joints[k])
+        {
+          Eigen::Affine3d transf;
+          tf::transformMsgToEigen(mdof_point->transforms[k], transf);
+          st->getJointState(mdof_joints[k])->setVariableValues(transf);
+        }
+      st->updateLinkTransforms();
+      addSuffixWayPoint(st, dt);
+    }
   }
+  invalidateDurationsFromStart(0);
 }
 
 void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state::RobotState &reference_state,
@@ -309,46 +824,83 @@ void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state:
   setRobotTrajectoryMsg(st, trajectory);
 }
 
-void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart( const double& duration, int& before,
-                                                                                  int& after, double &blend ) const
+void robot_trajectory::RobotTrajectory::updateDurationsFromStart() const
 {
-  if(duration < 0.0)
-  {
-    before = 0;
-    after = 0;
-    blend = 0;
+  boost::mutex::scoped_lock slock(cache_lock_);
+  std::size_t n = duration_from_previous_.size();
+  if (durations_from_start_valid_ >= n && durations_from_start_.size() == n)
     return;
+  durations_from_start_.resize(n);
+  double time = durations_from_start_valid_ > 0 ? durations_from_start_[durations_from_start_valid_ - 1] : 0.0;
+  for (std::size_t i = durations_from_start_valid_ ; i < n ; ++i)
+  {
+    time += duration_from_previous_[i];
+    durations_from_start_[i] = time;
   }
+  durations_from_start_valid_ = n;
+}
 
-  // Find indicies
-  std::size_t index = 0, num_points = waypoints_.size();
-  double running_duration = 0.0;
-  for( ; index < num_points; index++)
+void robot_trajectory::RobotTrajectory::getIndicesForWayPoint(const double& duration, std::size_t index,
+                                                              int& before, int& after, double &blend) const
+{
+  std::size_t num_points = durations_from_start_.size();
+  if (index >= num_points)
   {
-    running_duration += duration_from_previous_[index];
-    if( running_duration >= duration )
-      break;
+    // past the end of the trajectory
+    before = after = num_points - 1;
+    blend = 1.0;
+    return;
   }
   before = std::max<int>(index - 1, 0);
-  after = std::min<int>(index, num_points - 1);
+  after = index;
 
   // Compute duration blend
-  double before_time = running_duration - duration_from_previous_[index];
+  double before_time = index > 0 ? durations_from_start_[index - 1] : 0.0;
   if(after == before)
     blend = 1.0;
   else
     blend = (duration - before_time) / duration_from_previous_[index];
 }
 
+void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart( const double& duration, int& before,
+                                                                                  int& after, double &blend ) const
+{
+  // an out of range cursor forces a binary search
+  std::size_t cursor = std::numeric_limits<std::size_t>::max();
+  findWayPointIndicesForDurationAfterStart(duration, before, after, blend, cursor);
+}
+
+void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after,
+                                                                                 double &blend, std::size_t &cursor) const
+{
+  if(duration < 0.0 || duration_from_previous_.empty())
+  {
+    before = 0;
+    after = 0;
+    blend = 0;
+    cursor = 0;
+    return;
+  }
+  updateDurationsFromStart();
+
+  // Find the first waypoint reached at or after the duration: step forward from the cursor if the
+  // duration did not decrease, and do a binary search otherwise
+  std::size_t num_points = durations_from_start_.size();
+  if (cursor > num_points || (cursor > 0 && durations_from_start_[cursor - 1] >= duration))
+    cursor = std::lower_bound(durations_from_start_.begin(), durations_from_start_.end(), duration) - durations_from_start_.begin();
+  else
+    while (cursor < num_points && durations_from_start_[cursor] < duration)
+      ++cursor;
+  getIndicesForWayPoint(duration, cursor, before, after, blend);
+}
+
 double robot_trajectory::RobotTrajectory::getWaypointDurationFromStart(std::size_t index) const
 {
   if(index >= duration_from_previous_.size())
     return -1.0; // or something else? should we throw an exception?
 
-  double time = 0;
-  for(std::size_t i = 0; i <= index; ++i)
-    time += duration_from_previous_[i];
-  return time;
+  updateDurationsFromStart();
+  return durations_from_start_[index];
 }
 
 bool robot_trajectory::RobotTrajectory::getStateAtDurationFromStart(const double request_duration,
@@ -361,7 +913,20 @@ bool robot_trajectory::RobotTrajectory::getStateAtDurationFromStart(const double
   double blend = 1.0;
   findWayPointIndicesForDurationAfterStart(request_duration, before, after, blend);
   //logDebug("Interpolating %.3f of the way between index %d and %d.", blend, before, after);
-  waypoints_[before]->interpolate(*waypoints_[after], blend, *output_state);
+  getWayPoint(before).interpolate(getWayPoint(after), blend, *output_state);
   // TODO at some point we should allow for different interpolation types, or visitor classes.
   return true;
 }
+
+bool robot_trajectory::RobotTrajectory::getStateAtDurationFromStart(const double request_duration,
+                                                                    robot_state::RobotStatePtr& output_state, std::size_t &cursor) const
+{
+  if( !getWayPointCount() )
+    return false;
+
+  int before=0, after=0;
+  double blend = 1.0;
+  findWayPointIndicesForDurationAfterStart(request_duration, before, after, blend, cursor);
+  getWayPoint(before).interpolate(getWayPoint(after), blend, *output_state);
+  return true;
+}
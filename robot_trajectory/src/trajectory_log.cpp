@@ -0,0 +1,398 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include <moveit/robot_trajectory/trajectory_log.h>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <console_bridge/console.h>
+#include <cstring>
+
+namespace robot_trajectory
+{
+namespace
+{
+
+// layout of the trajectory log format:
+//   header: MAGIC, uint32 version, uint32 byte order mark, uint64 model hash, model name, group name,
+//           uint32 variable count, variable names, uint32 flags, uint64 waypoint count, zero padding to a multiple of 8 bytes
+//   blocks: durations from the previous waypoint (one double per waypoint), then positions, velocities (if LOG_HAS_VELOCITIES)
+//           and accelerations (if LOG_HAS_ACCELERATIONS), one row of doubles per waypoint, one value per variable
+//   strings: uint32 length, then the characters
+const char LOG_MAGIC[8] = { 'M', 'V', 'T', 'R', 'A', 'J', 'L', 'G' };
+const boost::uint32_t LOG_VERSION = 1;
+const boost::uint32_t LOG_BYTE_ORDER = 0x01020304;
+const boost::uint32_t LOG_HAS_VELOCITIES = 1;
+const boost::uint32_t LOG_HAS_ACCELERATIONS = 2;
+
+// writes values to a stream, counting the bytes so blocks can be aligned
+class LogWriter
+{
+public:
+
+  LogWriter(std::ostream &out) : out_(out), pos_(0)
+  {
+  }
+
+  void write(const void *data, std::size_t n)
+  {
+    out_.write(static_cast<const char*>(data), n);
+    pos_ += n;
+  }
+
+  template<typename T>
+  void write(const T &value)
+  {
+    write(&value, sizeof(T));
+  }
+
+  void write(const std::string &value)
+  {
+    write((boost::uint32_t)value.size());
+    write(value.data(), value.size());
+  }
+
+  void align()
+  {
+    static const char zeros[sizeof(double)] = { 0 };
+    if (pos_ % sizeof(double))
+      write(zeros, sizeof(double) - pos_ % sizeof(double));
+  }
+
+private:
+
+  std::ostream &out_;
+  std::size_t   pos_;
+};
+
+// reads values from a block of memory, failing once the end is reached
+class LogReader
+{
+public:
+
+  LogReader(const char *data, std::size_t size) : data_(data), size_(size), pos_(0)
+  {
+  }
+
+  bool read(void *dest, std::size_t n)
+  {
+    if (n > size_ - pos_)
+      return false;
+    memcpy(dest, data_ + pos_, n);
+    pos_ += n;
+    return true;
+  }
+
+  template<typename T>
+  bool read(T &value)
+  {
+    return read(&value, sizeof(T));
+  }
+
+  bool read(std::string &value)
+  {
+    boost::uint32_t n;
+    if (!read(n) || n > size_ - pos_)
+      return false;
+    value.assign(data_ + pos_, n);
+    pos_ += n;
+    return true;
+  }
+
+  /* The number of bytes left to read */
+  std::size_t remaining() const
+  {
+    return size_ - pos_;
+  }
+
+  /* Skip to the next multiple of 8 bytes */
+  bool align()
+  {
+    std::size_t pad = pos_ % sizeof(double) ? sizeof(double) - pos_ % sizeof(double) : 0;
+    if (pad > size_ - pos_)
+      return false;
+    pos_ += pad;
+    return true;
+  }
+
+  /* Get a block of \e count doubles in place */
+  const double* block(std::size_t count)
+  {
+    if (count > (size_ - pos_) / sizeof(double))
+      return NULL;
+    const double *b = reinterpret_cast<const double*>(data_ + pos_);
+    pos_ += count * sizeof(double);
+    return b;
+  }
+
+private:
+
+  const char  *data_;
+  std::size_t  size_;
+  std::size_t  pos_;
+};
+
+void hashString(boost::uint64_t &hash, const std::string &value)
+{
+  // FNV-1a, including the terminating zero so consecutive names can not run together
+  for (std::size_t i = 0 ; i <= value.size() ; ++i)
+  {
+    hash ^= (unsigned char)value.c_str()[i];
+    hash *= UINT64_C(1099511628211);
+  }
+}
+
+}
+}
+
+boost::uint64_t robot_trajectory::computeTrajectoryLogModelHash(const robot_model::RobotModel &model)
+{
+  boost::uint64_t hash = UINT64_C(14695981039346656037);
+  hashString(hash, model.getName());
+  const std::vector<std::string> &names = model.getVariableNames();
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    hashString(hash, names[i]);
+  return hash;
+}
+
+bool robot_trajectory::saveTrajectoryLog(const RobotTrajectory &trajectory, std::ostream &out)
+{
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  if (!group)
+  {
+    logError("Only trajectories for a group can be logged");
+    return false;
+  }
+
+  // gather the values of the group variables, as they are stored in compact trajectories
+  const std::size_t n = trajectory.getWayPointCount();
+  const std::size_t v = group->getVariableCount();
+  std::vector<double> durations(n), positions(n * v), velocities(n * v), accelerations(n * v);
+  bool has_velocities = true, has_accelerations = true;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    durations[i] = trajectory.getWayPointDurationFromPrevious(i);
+    double *row_pos = &positions[i * v], *row_vel = &velocities[i * v], *row_acc = &accelerations[i * v];
+    if (trajectory.isCompact())
+    {
+      std::copy(trajectory.getWayPointPositions(i), trajectory.getWayPointPositions(i) + v, row_pos);
+      if (const double *vel = trajectory.getWayPointVelocities(i))
+        std::copy(vel, vel + v, row_vel);
+      else
+        has_velocities = false;
+      if (const double *acc = trajectory.getWayPointAccelerations(i))
+        std::copy(acc, acc + v, row_acc);
+      else
+        has_accelerations = false;
+      continue;
+    }
+    const std::vector<robot_state::JointState*> &joints =
+      trajectory.getWayPoint(i).getJointStateGroup(group->getName())->getJointStateVector();
+    std::size_t k = 0;
+    for (std::size_t j = 0 ; j < joints.size() ; ++j)
+    {
+      unsigned int dim = joints[j]->getVariableCount();
+      if (dim == 0)
+        continue;
+      const std::vector<double> &values = joints[j]->getVariableValues();
+      const std::vector<double> &vel = joints[j]->getVelocities();
+      const std::vector<double> &acc = joints[j]->getAccelerations();
+      std::copy(values.begin(), values.begin() + dim, row_pos + k);
+      if (vel.size() == dim)
+        std::copy(vel.begin(), vel.end(), row_vel + k);
+      else
+        has_velocities = false;
+      if (acc.size() == dim)
+        std::copy(acc.begin(), acc.end(), row_acc + k);
+      else
+        has_accelerations = false;
+      k += dim;
+    }
+  }
+
+  LogWriter writer(out);
+  writer.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+  writer.write(LOG_VERSION);
+  writer.write(LOG_BYTE_ORDER);
+  writer.write(computeTrajectoryLogModelHash(*trajectory.getRobotModel()));
+  writer.write(trajectory.getRobotModel()->getName());
+  writer.write(group->getName());
+  const std::vector<std::string> &names = group->getVariableNames();
+  writer.write((boost::uint32_t)names.size());
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    writer.write(names[i]);
+  writer.write((boost::uint32_t)((has_velocities ? LOG_HAS_VELOCITIES : 0) | (has_accelerations ? LOG_HAS_ACCELERATIONS : 0)));
+  writer.write((boost::uint64_t)n);
+  writer.align();
+
+  if (n > 0)
+  {
+    writer.write(&durations[0], n * sizeof(double));
+    if (v > 0)
+    {
+      writer.write(&positions[0], n * v * sizeof(double));
+      if (has_velocities)
+        writer.write(&velocities[0], n * v * sizeof(double));
+      if (has_accelerations)
+        writer.write(&accelerations[0], n * v * sizeof(double));
+    }
+  }
+  return out.good();
+}
+
+robot_trajectory::TrajectoryLogView::TrajectoryLogView() : data_(NULL), size_(0)
+{
+  close();
+}
+
+robot_trajectory::TrajectoryLogView::~TrajectoryLogView()
+{
+}
+
+void robot_trajectory::TrajectoryLogView::close()
+{
+  file_.reset();
+  data_ = NULL;
+  size_ = 0;
+  model_hash_ = 0;
+  model_name_.clear();
+  group_name_.clear();
+  variable_names_.clear();
+  waypoint_count_ = 0;
+  durations_ = positions_ = velocities_ = accelerations_ = NULL;
+}
+
+bool robot_trajectory::TrajectoryLogView::openFile(const std::string &path)
+{
+  close();
+  boost::scoped_ptr<boost::iostreams::mapped_file_source> file(new boost::iostreams::mapped_file_source());
+  try
+  {
+    file->open(path);
+  }
+  catch (std::ios_base::failure &ex)
+  {
+    logError("Unable to map trajectory log '%s': %s", path.c_str(), ex.what());
+    return false;
+  }
+  data_ = file->data();
+  size_ = file->size();
+  file_.swap(file);
+  if (parse())
+    return true;
+  logError("'%s' is not a valid trajectory log", path.c_str());
+  close();
+  return false;
+}
+
+bool robot_trajectory::TrajectoryLogView::openData(const char *data, std::size_t size)
+{
+  close();
+  if (reinterpret_cast<std::size_t>(data) % sizeof(double))
+  {
+    logError("Trajectory logs can only be read from memory aligned to %u bytes", (unsigned int)sizeof(double));
+    return false;
+  }
+  data_ = data;
+  size_ = size;
+  if (parse())
+    return true;
+  close();
+  return false;
+}
+
+bool robot_trajectory::TrajectoryLogView::parse()
+{
+  LogReader reader(data_, size_);
+  char magic[sizeof(LOG_MAGIC)];
+  boost::uint32_t version, byte_order, variable_count, flags;
+  boost::uint64_t waypoint_count;
+  if (!reader.read(magic, sizeof(magic)) || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0 ||
+      !reader.read(version) || !reader.read(byte_order))
+    return false;
+  if (version != LOG_VERSION)
+  {
+    logError("Trajectory log version %u is not supported (expected %u)", version, LOG_VERSION);
+    return false;
+  }
+  if (byte_order != LOG_BYTE_ORDER)
+  {
+    logError("The trajectory log was written on a machine with a different byte order");
+    return false;
+  }
+  if (!reader.read(model_hash_) || !reader.read(model_name_) || !reader.read(group_name_) || !reader.read(variable_count))
+    return false;
+  // every name takes at least its length, so a corrupt count is rejected before anything is allocated for it
+  if (variable_count > reader.remaining() / sizeof(boost::uint32_t))
+    return false;
+  variable_names_.resize(variable_count);
+  for (std::size_t i = 0 ; i < variable_names_.size() ; ++i)
+    if (!reader.read(variable_names_[i]))
+      return false;
+  if (!reader.read(flags) || !reader.read(waypoint_count) || !reader.align())
+    return false;
+  waypoint_count_ = waypoint_count;
+
+  // the sizes are checked before the blocks are taken, so they can not overflow
+  if (variable_count > 0 && waypoint_count_ > size_ / (variable_count * sizeof(double)))
+    return false;
+  const std::size_t values = waypoint_count_ * variable_count;
+  durations_ = reader.block(waypoint_count_);
+  positions_ = reader.block(values);
+  if (!durations_ || !positions_)
+    return false;
+  if (flags & LOG_HAS_VELOCITIES)
+    if (!(velocities_ = reader.block(values)))
+      return false;
+  if (flags & LOG_HAS_ACCELERATIONS)
+    if (!(accelerations_ = reader.block(values)))
+      return false;
+  return true;
+}
+
+bool robot_trajectory::TrajectoryLogView::load(const robot_state::RobotState &reference_state, RobotTrajectory &trajectory) const
+{
+  if (!matches(*trajectory.getRobotModel()))
+  {
+    logError("The trajectory log was recorded for a different robot model than '%s'", trajectory.getRobotModel()->getName().c_str());
+    return false;
+  }
+  const robot_model::JointModelGroup *group = trajectory.getRobotModel()->getJointModelGroup(group_name_);
+  if (!group || group->getVariableNames() != variable_names_)
+  {
+    logError("The group '%s' of the trajectory log does not match the robot model", group_name_.c_str());
+    return false;
+  }
+  trajectory.setGroupName(group_name_);
+  return trajectory.setCompactWayPoints(reference_state, waypoint_count_, positions_, velocities_, accelerations_, durations_);
+}
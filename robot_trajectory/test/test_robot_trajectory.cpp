@@ -0,0 +1,373 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/test_resources/config.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit/robot_trajectory/trajectory_log.h>
+#include <urdf_parser/urdf_parser.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+
+static std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+static std::string srdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string();
+
+class RobotTrajectoryTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+    ASSERT_TRUE(xml_file.is_open());
+    while (xml_file.good())
+    {
+      std::string line;
+      std::getline(xml_file, line);
+      xml_string += (line + "\n");
+    }
+    xml_file.close();
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+    ASSERT_TRUE(urdf_model);
+    ASSERT_TRUE(srdf_model->initFile(*urdf_model, srdf_file));
+    kmodel_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+  }
+
+  /** \brief A trajectory of \e count waypoints of the right arm; the variables of waypoint i are -0.01 * (i + 1) * (j + 1),
+      and waypoint i is reached 0.1 * (i + 1) s after the previous one */
+  void makeTrajectory(robot_trajectory::RobotTrajectory &trajectory, std::size_t count) const
+  {
+    robot_state::RobotState state(kmodel_);
+    state.setToDefaultValues();
+    robot_state::JointStateGroup *jsg = state.getJointStateGroup("right_arm");
+    for (std::size_t i = 0 ; i < count ; ++i)
+    {
+      jsg->setVariableValues(expectedValues(i, jsg->getVariableCount()));
+      trajectory.addSuffixWayPoint(state, 0.1 * (i + 1));
+    }
+  }
+
+  static std::vector<double> expectedValues(std::size_t index, std::size_t variable_count)
+  {
+    std::vector<double> values(variable_count);
+    for (std::size_t j = 0 ; j < variable_count ; ++j)
+      values[j] = -0.01 * (index + 1) * (j + 1);
+    return values;
+  }
+
+  static void expectWayPoint(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index)
+  {
+    std::vector<double> values;
+    trajectory.getWayPoint(index).getJointStateGroup("right_arm")->getVariableValues(values);
+    std::vector<double> expected = expectedValues(index, values.size());
+    for (std::size_t j = 0 ; j < values.size() ; ++j)
+      EXPECT_NEAR(expected[j], values[j], 1e-12);
+  }
+
+  robot_model::RobotModelPtr kmodel_;
+};
+
+TEST_F(RobotTrajectoryTest, CompactStorage)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeTrajectory(trajectory, 10);
+  EXPECT_FALSE(trajectory.isCompact());
+  EXPECT_TRUE(trajectory.getWayPointPositions(0) == NULL);
+
+  robot_state::RobotState reference(kmodel_);
+  reference.setToDefaultValues();
+  ASSERT_TRUE(trajectory.setCompact(reference));
+  EXPECT_TRUE(trajectory.isCompact());
+  ASSERT_EQ(10u, trajectory.getWayPointCount());
+  const unsigned int variable_count = trajectory.getGroup()->getVariableCount();
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    const double *positions = trajectory.getWayPointPositions(i);
+    ASSERT_TRUE(positions != NULL);
+    std::vector<double> expected = expectedValues(i, variable_count);
+    for (unsigned int j = 0 ; j < variable_count ; ++j)
+      EXPECT_NEAR(expected[j], positions[j], 1e-12);
+    expectWayPoint(trajectory, i);
+  }
+
+  // the state of a waypoint is created once
+  EXPECT_EQ(&trajectory.getWayPoint(3), &trajectory.getWayPoint(3));
+
+  // waypoints added later are stored compactly too
+  robot_trajectory::RobotTrajectory appended(kmodel_, "right_arm");
+  ASSERT_TRUE(appended.setCompact(reference));
+  appended.append(trajectory, 0.0);
+  EXPECT_TRUE(appended.isCompact());
+  ASSERT_EQ(10u, appended.getWayPointCount());
+  for (std::size_t i = 0 ; i < appended.getWayPointCount() ; ++i)
+  {
+    EXPECT_TRUE(appended.getWayPointPositions(i) != NULL);
+    expectWayPoint(appended, i);
+  }
+
+  // expanding keeps the values
+  trajectory.expand();
+  EXPECT_FALSE(trajectory.isCompact());
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    expectWayPoint(trajectory, i);
+}
+
+TEST_F(RobotTrajectoryTest, CompactWayPointsFromArrays)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  robot_state::RobotState reference(kmodel_);
+  reference.setToDefaultValues();
+  const unsigned int variable_count = kmodel_->getJointModelGroup("right_arm")->getVariableCount();
+  std::vector<double> positions;
+  std::vector<double> durations;
+  for (std::size_t i = 0 ; i < 5 ; ++i)
+  {
+    std::vector<double> values = expectedValues(i, variable_count);
+    positions.insert(positions.end(), values.begin(), values.end());
+    durations.push_back(0.1 * (i + 1));
+  }
+  ASSERT_TRUE(trajectory.setCompactWayPoints(reference, 5, &positions[0], NULL, NULL, &durations[0]));
+  ASSERT_EQ(5u, trajectory.getWayPointCount());
+  EXPECT_TRUE(trajectory.getWayPointVelocities(0) == NULL);
+  for (std::size_t i = 0 ; i < 5 ; ++i)
+    expectWayPoint(trajectory, i);
+  EXPECT_NEAR(1.5, trajectory.getWaypointDurationFromStart(4), 1e-12);
+}
+
+TEST_F(RobotTrajectoryTest, DurationsFromStart)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeTrajectory(trajectory, 10);
+  double time = 0.0;
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    time += 0.1 * (i + 1);
+    EXPECT_NEAR(time, trajectory.getWaypointDurationFromStart(i), 1e-12);
+  }
+  EXPECT_EQ(-1.0, trajectory.getWaypointDurationFromStart(10));
+
+  // changing a duration shifts the waypoints after it only
+  const double before = trajectory.getWaypointDurationFromStart(3);
+  const double last = trajectory.getWaypointDurationFromStart(9);
+  trajectory.setWayPointDurationFromPrevious(5, 0.6 + 1.0);
+  EXPECT_NEAR(before, trajectory.getWaypointDurationFromStart(3), 1e-12);
+  EXPECT_NEAR(last + 1.0, trajectory.getWaypointDurationFromStart(9), 1e-12);
+
+  // so does inserting a waypoint
+  trajectory.insertWayPoint(2, trajectory.getWayPoint(2), 0.5);
+  EXPECT_NEAR(before + 0.5, trajectory.getWaypointDurationFromStart(4), 1e-12);
+  EXPECT_NEAR(last + 1.5, trajectory.getWaypointDurationFromStart(10), 1e-12);
+
+  // lookups with and without a cursor agree
+  std::size_t cursor = 0;
+  for (double t = 0.0 ; t < last + 2.0 ; t += 0.05)
+  {
+    int before1, after1, before2, after2;
+    double blend1, blend2;
+    trajectory.findWayPointIndicesForDurationAfterStart(t, before1, after1, blend1);
+    trajectory.findWayPointIndicesForDurationAfterStart(t, before2, after2, blend2, cursor);
+    EXPECT_EQ(before1, before2);
+    EXPECT_EQ(after1, after2);
+    EXPECT_NEAR(blend1, blend2, 1e-12);
+  }
+}
+
+namespace
+{
+void readDurations(const robot_trajectory::RobotTrajectory *trajectory, std::vector<double> *times)
+{
+  const std::size_t n = trajectory->getWayPointCount();
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    std::size_t index = (i * 7) % n;
+    (*times)[index] = trajectory->getWaypointDurationFromStart(index);
+  }
+}
+}
+
+TEST_F(RobotTrajectoryTest, ConcurrentDurationReads)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeTrajectory(trajectory, 50);
+
+  // the durations from start are computed on demand by const calls from all threads
+  const std::size_t num_threads = 4;
+  std::vector<std::vector<double> > times(num_threads, std::vector<double>(50));
+  boost::thread_group threads;
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+    threads.create_thread(boost::bind(&readDurations, &trajectory, &times[t]));
+  threads.join_all();
+
+  double time = 0.0;
+  for (std::size_t i = 0 ; i < 50 ; ++i)
+  {
+    time += 0.1 * (i + 1);
+    for (std::size_t t = 0 ; t < num_threads ; ++t)
+      EXPECT_NEAR(time, times[t][i], 1e-9);
+  }
+}
+
+namespace
+{
+void readWayPoints(const robot_trajectory::RobotTrajectory *trajectory, std::vector<const robot_state::RobotState*> *states,
+                    std::vector<double> *times)
+{
+  const std::size_t n = trajectory->getWayPointCount();
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    std::size_t index = (i * 7) % n;
+    (*states)[index] = &trajectory->getWayPoint(index);
+    (*times)[index] = trajectory->getWaypointDurationFromStart(index);
+  }
+}
+}
+
+TEST_F(RobotTrajectoryTest, ConcurrentCompactReads)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeTrajectory(trajectory, 50);
+  robot_state::RobotState reference(kmodel_);
+  reference.setToDefaultValues();
+  ASSERT_TRUE(trajectory.setCompact(reference));
+
+  // the states and the durations from start are created on demand by const calls from all threads
+  const std::size_t num_threads = 4;
+  std::vector<std::vector<const robot_state::RobotState*> > states(num_threads, std::vector<const robot_state::RobotState*>(50));
+  std::vector<std::vector<double> > times(num_threads, std::vector<double>(50));
+  boost::thread_group threads;
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+    threads.create_thread(boost::bind(&readWayPoints, &trajectory, &states[t], &times[t]));
+  threads.join_all();
+
+  for (std::size_t i = 0 ; i < 50 ; ++i)
+  {
+    for (std::size_t t = 0 ; t < num_threads ; ++t)
+    {
+      EXPECT_EQ(&trajectory.getWayPoint(i), states[t][i]);
+      EXPECT_EQ(trajectory.getWaypointDurationFromStart(i), times[t][i]);
+    }
+    expectWayPoint(trajectory, i);
+  }
+}
+
+TEST_F(RobotTrajectoryTest, UnwindModifiedWayPoint)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeTrajectory(trajectory, 10);
+  trajectory.unwind();
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    expectWayPoint(trajectory, i);
+
+  // a waypoint that was unwound already and is then moved by a full turn is unwound again
+  const std::string joint = "r_forearm_roll_joint";
+  const double value = trajectory.getWayPoint(4).getJointState(joint)->getVariableValues()[0];
+  trajectory.getWayPointPtr(4)->getJointState(joint)->setVariableValues(std::vector<double>(1, value + 2.0 * M_PI));
+  trajectory.unwind();
+  EXPECT_NEAR(value, trajectory.getWayPoint(4).getJointState(joint)->getVariableValues()[0], 1e-12);
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    expectWayPoint(trajectory, i);
+
+  const double last = trajectory.getLastWayPoint().getJointState(joint)->getVariableValues()[0];
+  trajectory.getLastWayPointPtr()->getJointState(joint)->setVariableValues(std::vector<double>(1, last - 2.0 * M_PI));
+  trajectory.unwind();
+  EXPECT_NEAR(last, trajectory.getLastWayPoint().getJointState(joint)->getVariableValues()[0], 1e-12);
+}
+
+namespace
+{
+// the bytes of \e data, at an address aligned for doubles as TrajectoryLogView::openData() requires
+const char* alignedCopy(const std::string &data, std::vector<double> &storage)
+{
+  storage.assign(data.size() / sizeof(double) + 1, 0.0);
+  memcpy(&storage[0], data.data(), data.size());
+  return reinterpret_cast<const char*>(&storage[0]);
+}
+}
+
+TEST_F(RobotTrajectoryTest, TrajectoryLogRoundTrip)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeTrajectory(trajectory, 10);
+  std::stringstream out;
+  ASSERT_TRUE(robot_trajectory::saveTrajectoryLog(trajectory, out));
+  const std::string data = out.str();
+
+  std::vector<double> storage;
+  robot_trajectory::TrajectoryLogView view;
+  ASSERT_TRUE(view.openData(alignedCopy(data, storage), data.size()));
+  EXPECT_TRUE(view.matches(*kmodel_));
+  EXPECT_EQ("right_arm", view.getGroupName());
+  EXPECT_EQ(kmodel_->getJointModelGroup("right_arm")->getVariableNames(), view.getVariableNames());
+  ASSERT_EQ(10u, view.getWayPointCount());
+
+  robot_state::RobotState reference(kmodel_);
+  reference.setToDefaultValues();
+  robot_trajectory::RobotTrajectory loaded(kmodel_, "");
+  ASSERT_TRUE(view.load(reference, loaded));
+  ASSERT_EQ(10u, loaded.getWayPointCount());
+  for (std::size_t i = 0 ; i < loaded.getWayPointCount() ; ++i)
+  {
+    expectWayPoint(loaded, i);
+    EXPECT_NEAR(trajectory.getWaypointDurationFromStart(i), loaded.getWaypointDurationFromStart(i), 1e-12);
+  }
+
+  // the variable count follows the magic string, the version, the byte order mark, the model hash and two names
+  const std::size_t count_offset = sizeof(boost::uint64_t) + 2 * sizeof(boost::uint32_t) + sizeof(boost::uint64_t) +
+    sizeof(boost::uint32_t) + view.getModelName().size() + sizeof(boost::uint32_t) + view.getGroupName().size();
+  boost::uint32_t count;
+  memcpy(&count, &data[count_offset], sizeof(count));
+  ASSERT_EQ(view.getVariableCount(), count);
+
+  // truncated logs are rejected
+  for (std::size_t size = 0 ; size < data.size() ; size += 8)
+    EXPECT_FALSE(view.openData(alignedCopy(data.substr(0, size), storage), size));
+
+  // so is a variable count that the rest of the data can not hold, before anything is allocated for it
+  std::string corrupt = data;
+  const boost::uint32_t huge_count = 0xfffffff0u;
+  memcpy(&corrupt[count_offset], &huge_count, sizeof(huge_count));
+  EXPECT_FALSE(view.openData(alignedCopy(corrupt, storage), corrupt.size()));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -42,6 +42,9 @@
 #include <boost/shared_ptr.hpp>
 #include <moveit_msgs/RobotTrajectory.h>
 #include <geometry_msgs/PointStamped.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 /// Namespace for the base class of a MoveIt sensor manager
 namespace moveit_sensor_manager
@@ -98,6 +101,68 @@ public:
   /// The function returns true on success (either completing execution succesfully or computing a trajecotory successufully)
   virtual bool pointSensorTo(const std::string &name, const geometry_msgs::PointStamped &target, moveit_msgs::RobotTrajectory &sensor_trajectory) = 0;
 
+  /// Evaluate the cost of pointing sensor \e name towards each of \e targets, without keeping the trajectories: \e costs[i] is the
+  /// duration of the motion towards \e targets[i] (or its joint space length, for trajectories without timing), and infinity if
+  /// the sensor cannot be pointed at that target. Managers that can estimate the cost more cheaply (e.g., from the
+  /// joint-space distance to an IK solution) should override this. The default implementation calls pointSensorTo() for
+  /// each target, so managers that execute the motion in pointSensorTo() must override it. Returns false if no target can be reached.
+  virtual bool getPointingCosts(const std::string &name, const std::vector<geometry_msgs::PointStamped> &targets, std::vector<double> &costs)
+  {
+    costs.resize(targets.size());
+    bool result = false;
+    moveit_msgs::RobotTrajectory sensor_trajectory;
+    for (std::size_t i = 0 ; i < targets.size() ; ++i)
+      if (pointSensorTo(name, targets[i], sensor_trajectory))
+      {
+        costs[i] = getTrajectoryCost(sensor_trajectory);
+        result = true;
+      }
+      else
+        costs[i] = std::numeric_limits<double>::infinity();
+    return result;
+  }
+
+  /// Point sensor \e name towards the target among \e targets with the lowest cost (see getPointingCosts()). Only the trajectory
+  /// for the selected target is computed by pointSensorTo(). The index of that target is stored in \e selected.
+  /// Returns false if no target can be reached.
+  bool pointSensorToBest(const std::string &name, const std::vector<geometry_msgs::PointStamped> &targets,
+                         moveit_msgs::RobotTrajectory &sensor_trajectory, std::size_t &selected)
+  {
+    std::vector<double> costs;
+    if (!getPointingCosts(name, targets, costs))
+      return false;
+    selected = 0;
+    for (std::size_t i = 1 ; i < costs.size() ; ++i)
+      if (costs[i] < costs[selected])
+        selected = i;
+    return costs[selected] < std::numeric_limits<double>::infinity() && pointSensorTo(name, targets[selected], sensor_trajectory);
+  }
+
+protected:
+
+  /// The cost used by the default getPointingCosts(): the duration of \e trajectory if it is timed, its joint space length otherwise
+  static double getTrajectoryCost(const moveit_msgs::RobotTrajectory &trajectory)
+  {
+    const std::vector<trajectory_msgs::JointTrajectoryPoint> &points = trajectory.joint_trajectory.points;
+    double duration = 0.0;
+    if (!points.empty())
+      duration = points.back().time_from_start.toSec();
+    if (!trajectory.multi_dof_joint_trajectory.points.empty())
+      duration = std::max(duration, trajectory.multi_dof_joint_trajectory.points.back().time_from_start.toSec());
+    if (duration > 0.0)
+      return duration;
+
+    double length = 0.0;
+    for (std::size_t i = 1 ; i < points.size() ; ++i)
+    {
+      double d = 0.0;
+      for (std::size_t j = 0 ; j < points[i].positions.size() && j < points[i - 1].positions.size() ; ++j)
+        d += (points[i].positions[j] - points[i - 1].positions[j]) * (points[i].positions[j] - points[i - 1].positions[j]);
+      length += sqrt(d);
+    }
+    return length;
+  }
+
 };
 
 typedef boost::shared_ptr<MoveItSensorManager> MoveItSensorManagerPtr;
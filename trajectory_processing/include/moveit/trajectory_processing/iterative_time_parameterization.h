@@ -41,6 +41,7 @@
 #include <moveit_msgs/JointLimits.h>
 #include <moveit_msgs/RobotState.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
+#include <Eigen/Core>
 
 namespace trajectory_processing
 {
@@ -56,18 +57,29 @@ public:
 
   bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const;
 
+  /// \brief Re-time only the waypoints from \e first_point on (e.g., the ones added by RobotTrajectory::append() to a trajectory
+  /// timed before), together with the \e blend_points waypoints before them, so the junction is smoothed as well.
+  /// The waypoints before those keep their durations, velocities and accelerations; the last of them gives the start velocity
+  /// of the re-timed part. The work done is proportional to the number of re-timed waypoints, so timing a trajectory that
+  /// grows by segments this way takes linear time overall.
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory, std::size_t first_point, std::size_t blend_points = 2) const;
+
 private:
 
+  /// @brief time the waypoints from \e start on, keeping the timing of the ones before
+  bool computeTimeStampsFrom(robot_trajectory::RobotTrajectory& trajectory, std::size_t start) const;
+
   unsigned int max_iterations_;         /// @brief maximum number of iterations to find solution
   double max_time_change_per_it_;       /// @brief maximum allowed time change per iteration in seconds
 
-  void applyVelocityConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
-                                const std::vector<std::string>& active_joints,
+  /// @brief positions is a (waypoints x joints) matrix of the group's values
+  void applyVelocityConstraints(const Eigen::MatrixXd& positions,
                                 const std::vector<moveit_msgs::JointLimits>& limits,
                                 std::vector<double> &time_diff) const;
 
-  void applyAccelerationConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
-                                    const std::vector<std::string>& active_joints,
+  void applyAccelerationConstraints(const Eigen::MatrixXd& positions,
+                                    const std::vector<bool>& has_start_velocity,
+                                    const Eigen::VectorXd& start_velocity,
                                     const std::vector<moveit_msgs::JointLimits>& limits,
                                     std::vector<double> & time_diff) const;
 
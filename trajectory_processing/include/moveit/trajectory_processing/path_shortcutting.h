@@ -0,0 +1,133 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_PATH_SHORTCUTTING_
+#define MOVEIT_TRAJECTORY_PROCESSING_PATH_SHORTCUTTING_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <random_numbers/random_numbers.h>
+#include <boost/function.hpp>
+
+namespace trajectory_processing
+{
+
+/** \brief Decide whether a piece of path, given as densely interpolated waypoints, is valid.
+    Typically bound to PlanningScene::isPathValid() (with PathValidationOptions, if desired). */
+typedef boost::function<bool(const robot_trajectory::RobotTrajectory &segment)> PathSegmentValidityFn;
+
+/// \brief This class shortens the path of a trajectory by replacing parts of it with straight lines in joint space
+/// (randomized shortcutting), and resamples paths densely.
+///
+/// Every round, a number of random pairs of waypoints is drawn. The straight segments between them are
+/// interpolated at the resolution of the shortcutter and checked with the validity function, in parallel over
+/// the candidates. The valid shortcuts that save the most path length and do not overlap are then applied.
+/// Shortcutting stops when the time budget is used up, after the maximum number of rounds, or when no pair of
+/// waypoints can be shortcut. The validity function is called concurrently when more than one thread is used.
+class PathShortcutter
+{
+public:
+  PathShortcutter(const PathSegmentValidityFn &validity_fn);
+  ~PathShortcutter();
+
+  /** \brief Set the largest distance (as computed by JointStateGroup::distance()) between consecutive states of the
+      segments that are checked, and of resampled paths */
+  void setResolution(double resolution)
+  {
+    resolution_ = resolution;
+  }
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  /** \brief Set the time budget of shortcut(), in seconds */
+  void setMaxTime(double max_time)
+  {
+    max_time_ = max_time;
+  }
+
+  void setMaxRounds(unsigned int max_rounds)
+  {
+    max_rounds_ = max_rounds;
+  }
+
+  /** \brief Set the number of candidate shortcuts checked per round */
+  void setCandidatesPerRound(unsigned int candidates)
+  {
+    candidates_per_round_ = candidates;
+  }
+
+  /** \brief Set the number of threads the candidates of a round are checked with */
+  void setNumThreads(unsigned int num_threads)
+  {
+    num_threads_ = num_threads;
+  }
+
+  /** \brief Shortcut the path of \e trajectory, which must have a group. Waypoints inside the shortcuts are removed; the
+      timing of the trajectory is not kept (all durations are set to 0), so the trajectory is expected to be time
+      parameterized afterwards. Returns true if the path was shortened. */
+  bool shortcut(robot_trajectory::RobotTrajectory &trajectory);
+
+  /** \brief Insert interpolated waypoints so that consecutive waypoints are at most the resolution apart. The durations of
+      the segments are divided evenly between the inserted waypoints. */
+  void resample(robot_trajectory::RobotTrajectory &trajectory) const;
+
+  /** \brief Shortcut and then resample \e trajectory */
+  bool shortcutAndResample(robot_trajectory::RobotTrajectory &trajectory)
+  {
+    bool result = shortcut(trajectory);
+    resample(trajectory);
+    return result;
+  }
+
+private:
+
+  struct Candidate;
+
+  void checkCandidates(const std::vector<robot_state::RobotStatePtr> *states, const robot_trajectory::RobotTrajectory *trajectory,
+                       std::vector<Candidate> *candidates, std::size_t thread_index, std::size_t num_threads) const;
+
+  PathSegmentValidityFn validity_fn_;
+  double resolution_;
+  double max_time_;
+  unsigned int max_rounds_;
+  unsigned int candidates_per_round_;
+  unsigned int num_threads_;
+  random_numbers::RandomNumberGenerator rng_;
+};
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_TIME_PARAMETERIZATION_
+#define MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_TIME_PARAMETERIZATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+
+namespace trajectory_processing
+{
+
+/// \brief This class computes the timestamps of a trajectory that follows its path in (approximately) minimum
+/// time, given the velocity and acceleration limits of the variables of the group.
+///
+/// The waypoints are parameterized by their distance along the path in joint space. The path derivatives
+/// at the waypoints are estimated with finite differences, which turns the limits into bounds on the speed
+/// along the path and its derivative. The speed profile is then found with one forward pass (accelerating
+/// as much as allowed) and one backward pass (decelerating as much as allowed), so the cost is linear in
+/// the number of waypoints. The trajectory starts and ends at rest. Unlike IterativeParabolicTimeParameterization,
+/// no iterations are needed. Velocities and accelerations are set for every waypoint.
+///
+/// Planar and floating joints are supported: their translational and rotational variables use the translation
+/// and rotation limits of this class, unless the variables have limits of their own. Planar angles are unwound
+/// along the path. The quaternion of a floating joint is kept in one hemisphere along the path, and each of its
+/// components is limited to a quarter of the rotation limits, which keeps the angular velocity and acceleration
+/// within the rotation limits.
+class TimeOptimalTimeParameterization
+{
+public:
+  TimeOptimalTimeParameterization(double max_translation_velocity = 1.0, double max_translation_acceleration = 1.0,
+                                  double max_rotation_velocity = 1.0, double max_rotation_acceleration = 1.0);
+  ~TimeOptimalTimeParameterization();
+
+  /** \brief Set the limits used for the translational variables of planar and floating joints (m/s, m/s^2) */
+  void setTranslationLimits(double max_velocity, double max_acceleration)
+  {
+    max_translation_velocity_ = max_velocity;
+    max_translation_acceleration_ = max_acceleration;
+  }
+
+  /** \brief Set the limits used for the rotational variables of planar and floating joints (rad/s, rad/s^2) */
+  void setRotationLimits(double max_velocity, double max_acceleration)
+  {
+    max_rotation_velocity_ = max_velocity;
+    max_rotation_acceleration_ = max_acceleration;
+  }
+
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const;
+
+  /** \brief Compute the timestamps with the velocity limits scaled per segment: \e velocity_scaling[i] (in (0, 1])
+      applies to the motion between waypoints i and i + 1. Missing factors are taken as 1. */
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory, const std::vector<double> &velocity_scaling) const;
+
+private:
+
+  double max_translation_velocity_;
+  double max_translation_acceleration_;
+  double max_rotation_velocity_;
+  double max_rotation_acceleration_;
+};
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_TRAJECTORY_SAMPLER_
+#define MOVEIT_TRAJECTORY_PROCESSING_TRAJECTORY_SAMPLER_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+
+namespace trajectory_processing
+{
+
+/// \brief This class samples the variables of the group of a timed trajectory with polynomial interpolation,
+/// for feeding controllers at a fixed rate.
+///
+/// The coefficients of one polynomial per segment and variable are computed in setTrajectory(): quintic if all
+/// waypoints have velocities and accelerations, cubic otherwise. Missing velocities are estimated from the
+/// neighbouring segments, and the trajectory starts and ends at rest. Continuous joints are unwound, so their
+/// sampled values may leave [-pi, pi]. Sampling writes the positions, velocities and accelerations of all
+/// variables of the group (in group order) to arrays provided by the caller and does not allocate memory.
+/// Samples at increasing times find their segment in amortized constant time.
+class TrajectorySampler
+{
+public:
+  TrajectorySampler();
+  ~TrajectorySampler();
+
+  /** \brief Compute the polynomials for \e trajectory, which must have a group. Returns false if it has none. */
+  bool setTrajectory(const robot_trajectory::RobotTrajectory &trajectory);
+
+  /** \brief The number of values in each sample of positions, velocities or accelerations */
+  std::size_t getVariableCount() const
+  {
+    return variable_count_;
+  }
+
+  /** \brief The duration of the trajectory */
+  double getDuration() const
+  {
+    return segment_start_.empty() ? 0.0 : segment_start_.back();
+  }
+
+  /** \brief Sample the trajectory at \e time (clamped to the trajectory). Any of the output arrays may be NULL. */
+  void sample(double time, double *positions, double *velocities, double *accelerations);
+
+  /** \brief Start emitting samples every \e period seconds, with the first one at \e start_time */
+  void start(double period, double start_time = 0.0);
+
+  /** \brief Emit the next sample at the rate set with start(); the last sample is at the end of the trajectory.
+      Returns false (and emits nothing) if the end of the trajectory was already emitted. */
+  bool next(double *positions, double *velocities, double *accelerations);
+
+  /** \brief Emit up to \e max_samples samples at the rate set with start() into buffers of samples x getVariableCount()
+      values (row major), which are only reallocated if they are too small. Returns the number of samples written. */
+  std::size_t next(std::size_t max_samples, std::vector<double> &positions, std::vector<double> &velocities,
+                   std::vector<double> &accelerations);
+
+private:
+
+  enum
+    {
+      COEFFICIENT_COUNT = 6
+    };
+
+  std::size_t variable_count_;
+
+  /** \brief The time at which each segment starts; the last entry is the duration of the trajectory */
+  std::vector<double> segment_start_;
+
+  /** \brief For each segment and variable, the coefficients of the polynomial in the time since the start of the segment */
+  std::vector<double> coefficients_;
+
+  /** \brief The segment of the last sample */
+  std::size_t cursor_;
+
+  double period_;
+  double start_time_;
+  std::size_t sample_index_;
+  bool done_;
+};
+
+}
+
+#endif
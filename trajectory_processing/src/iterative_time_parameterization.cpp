@@ -38,6 +38,7 @@
 #include <moveit_msgs/JointLimits.h>
 #include <console_bridge/console.h>
 #include <moveit/robot_state/conversions.h>
+#include <moveit/profiler/tracing.h>
 
 namespace trajectory_processing
 {
@@ -99,49 +100,22 @@ void IterativeParabolicTimeParameterization::printStats(const trajectory_msgs::J
 }
 
 // Applies velocity
-void IterativeParabolicTimeParameterization::applyVelocityConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
-                                                                      const std::vector<std::string>& active_joints,
+void IterativeParabolicTimeParameterization::applyVelocityConstraints(const Eigen::MatrixXd& positions,
                                                                       const std::vector<moveit_msgs::JointLimits>& limits,
                                                                       std::vector<double> &time_diff) const
 {
-
-  robot_state::RobotStatePtr curr_waypoint;
-  robot_state::RobotStatePtr next_waypoint;
-  std::map<std::string, double> curr_state_values;
-  std::map<std::string, double> next_state_values;
-
-  const robot_model::JointModelGroup *group = rob_trajectory.getGroup();
-  const std::vector<const robot_model::JointModel*> &jnt = group->getJointModels();
-
-  const unsigned int num_points = rob_trajectory.getWayPointCount();
-  const unsigned int num_joints = group->getVariableCount();
-
-  for( unsigned int i=0; i<num_points-1; ++i )
-  {
-    curr_waypoint = rob_trajectory.getWayPointPtr(i);
-    next_waypoint = rob_trajectory.getWayPointPtr(i+1);
-
-    curr_waypoint->getStateValues(curr_state_values);
-    next_waypoint->getStateValues(next_state_values);
-
-    for (unsigned int joint=0; joint < active_joints.size(); joint++)
-    {
-      double v_max = 1.0;
-
-      if( limits[joint].has_velocity_limits )
-      {
-        v_max = limits[joint].max_velocity;
-      }
-      const double dq1 = curr_state_values[active_joints[joint]];
-      const double dq2 = next_state_values[active_joints[joint]];
-      const double t_min = std::abs(dq2-dq1) / v_max;
-      if( t_min > time_diff[i] )
-      {
-        time_diff[i] = t_min;
-      }
-
-    }
-  }
+  const unsigned int num_points = positions.rows();
+  const unsigned int num_joints = positions.cols();
+
+  Eigen::ArrayXd v_max(num_joints);
+  for (unsigned int joint=0; joint < num_joints; joint++)
+    v_max(joint) = limits[joint].has_velocity_limits ? limits[joint].max_velocity : DEFAULT_VEL_MAX;
+
+  // the minimum time for each segment is set by the joint that needs the longest to cover its distance
+  Eigen::ArrayXXd t_min = (positions.bottomRows(num_points-1) - positions.topRows(num_points-1)).array().abs();
+  t_min.rowwise() /= v_max.transpose();
+  Eigen::Map<Eigen::VectorXd> time_diff_map(&time_diff[0], num_points-1);
+  time_diff_map = time_diff_map.cwiseMax(t_min.rowwise().maxCoeff().matrix());
 }
 
 // Iteratively expand dt1 interval by a constant factor until within acceleration constraint
@@ -195,155 +169,123 @@ namespace
 {
 
 // Takes the time differences, and updates the timestamps, velocities and accelerations
-// in the trajectory.
+// in the trajectory. The rows of positions are the waypoints from first_point on; if
+// fixed_first is true, the timing of the waypoint first_point is kept as it is.
 void updateTrajectory(robot_trajectory::RobotTrajectory& rob_trajectory,
-                      const std::vector<std::string>& active_joints,
-                      const std::vector<double>& time_diff)
+                      const Eigen::MatrixXd& positions,
+                      const std::vector<bool>& has_start_velocity,
+                      const Eigen::VectorXd& start_velocity,
+                      const std::vector<double>& time_diff,
+                      std::size_t first_point,
+                      bool fixed_first)
 {
-
   double time_sum = 0.0;
 
-  robot_state::RobotStatePtr prev_waypoint;
-  robot_state::RobotStatePtr curr_waypoint;
-  robot_state::RobotStatePtr next_waypoint;
-  std::map<std::string, double> prev_state_values;
-  std::map<std::string, double> curr_state_values;
-  std::map<std::string, double> next_state_values;
-  robot_state::JointState *jst;
-
   const robot_model::JointModelGroup *group = rob_trajectory.getGroup();
-  const std::vector<const robot_model::JointModel*> &jnt = group->getJointModels();
 
-  unsigned int num_points = rob_trajectory.getWayPointCount();
-  const unsigned int num_joints = group->getVariableCount();
+  unsigned int num_points = positions.rows();
+  const unsigned int num_joints = positions.cols();
+  const unsigned int first_row = fixed_first ? 1 : 0;
 
   // Error check
   if(time_diff.size() < 1)
     return;
 
-  rob_trajectory.setWayPointDurationFromPrevious(0, time_sum);
+  if (!fixed_first)
+    rob_trajectory.setWayPointDurationFromPrevious(first_point, time_sum);
 
   // Times
   for (unsigned int i=1; i<num_points; ++i)
   {
     // Update the time between the waypoints in the robot_trajectory.
-    rob_trajectory.setWayPointDurationFromPrevious(i, time_diff[i-1]);
+    rob_trajectory.setWayPointDurationFromPrevious(first_point + i, time_diff[i-1]);
   }
 
   // Return if there is only one point in the trajectory!
   if(num_points <= 1) return;
 
-  // Accelerations
-  for (unsigned int i=0; i<num_points; ++i)
+  // Velocities and accelerations for all points, computed on the position matrix
+  Eigen::MatrixXd velocities(num_points, num_joints);
+  Eigen::MatrixXd accelerations(num_points, num_joints);
+  for (unsigned int i=first_row; i<num_points; ++i)
   {
-    curr_waypoint = rob_trajectory.getWayPointPtr(i);
-    curr_waypoint->getStateValues(curr_state_values);
+    Eigen::VectorXd q1, q2, q3;
+    double dt1, dt2;
 
-    if (i > 0)
-    {
-      prev_waypoint = rob_trajectory.getWayPointPtr(i-1);
-      prev_waypoint->getStateValues(prev_state_values);
+    if(i==0)
+    { // First point
+      q1 = positions.row(i+1).transpose();
+      q2 = positions.row(i).transpose();
+      q3 = positions.row(i+1).transpose();
+
+      dt1 = time_diff[i];
+      dt2 = time_diff[i];
+    }
+    else if(i < num_points-1)
+    { // middle points
+      q1 = positions.row(i-1).transpose();
+      q2 = positions.row(i).transpose();
+      q3 = positions.row(i+1).transpose();
+
+      dt1 = time_diff[i-1];
+      dt2 = time_diff[i];
+    }
+    else
+    { // last point
+      q1 = positions.row(i-1).transpose();
+      q2 = positions.row(i).transpose();
+      q3 = positions.row(i-1).transpose();
+
+      dt1 = time_diff[i-1];
+      dt2 = time_diff[i-1];
     }
 
-    if (i < num_points-1)
+    if(dt1 == 0.0 || dt2 == 0.0)
     {
-      next_waypoint = rob_trajectory.getWayPointPtr(i+1);
-      next_waypoint->getStateValues(next_state_values);
+      velocities.row(i).setZero();
+      accelerations.row(i).setZero();
+      continue;
     }
 
+    Eigen::VectorXd v1 = (q2-q1)/dt1;
+    Eigen::VectorXd v2 = (q3-q2)/dt2;
+    if(i==0)
+      for (unsigned int j=0; j<num_joints; ++j)
+        if (has_start_velocity[j])
+        {
+          // Needed to ensure continuous velocity for first point
+          v1(j) = start_velocity(j);
+          v2(j) = start_velocity(j);
+        }
+    velocities.row(i) = ((v2+v1)/2).transpose();
+    accelerations.row(i) = (2*(v2-v1)/(dt1+dt2)).transpose();
+  }
 
+  // Write the velocities and accelerations back in one sweep
+  for (unsigned int i=first_row; i<num_points; ++i)
+  {
+    const std::vector<robot_state::JointState*> &jst =
+      rob_trajectory.getWayPointPtr(first_point + i)->getJointStateGroup(group->getName())->getJointStateVector();
     for (unsigned int j=0; j<num_joints; ++j)
     {
-      double q1;
-      double q2;
-      double q3;
-      double dt1;
-      double dt2;
-
-      if(i==0)
-      { // First point
-        q1 = next_state_values[active_joints[j]];
-        q2 = curr_state_values[active_joints[j]];
-        q3 = next_state_values[active_joints[j]];
-
-        dt1 = time_diff[i];
-        dt2 = time_diff[i];
-      }
-      else if(i < num_points-1)
-      { // middle points
-        q1 = prev_state_values[active_joints[j]];
-        q2 = curr_state_values[active_joints[j]];
-        q3 = next_state_values[active_joints[j]];
-
-        dt1 = time_diff[i-1];
-        dt2 = time_diff[i];
-      }
-      else
-      { // last point
-        q1 = prev_state_values[active_joints[j]];
-        q2 = curr_state_values[active_joints[j]];
-        q3 = prev_state_values[active_joints[j]];
-
-        dt1 = time_diff[i-1];
-        dt2 = time_diff[i-1];
-      }
-
-      double v1, v2, a;
-
-      bool start_velocity = false;
-      if(dt1 == 0.0 || dt2 == 0.0)
-      {
-        v1 = 0.0;
-        v2 = 0.0;
-        a = 0.0;
-      }
-      else
-      {
-        if(i==0)
-    {
-          const std::vector<double> &vel = curr_waypoint->getJointState(active_joints[j])->getVelocities();
-      if(!vel.empty())
-      {
-        start_velocity = true;
-            v1 = vel[0];
-          }
-        }
-        v1 = start_velocity ? v1 : (q2-q1)/dt1;
-        //v2 = (q3-q2)/dt2;
-        v2 = start_velocity ? v1 : (q3-q2)/dt2; // Needed to ensure continuous velocity for first point
-        a = 2*(v2-v1)/(dt1+dt2);
-      }
-
-      jst = curr_waypoint->getJointState(active_joints[j]);
-      // Update the velocities
-      jst->getVelocities().resize(1);
-      jst->getVelocities()[0] = (v2+v1)/2;
-      // Update the accelerations
-      jst->getAccelerations().resize(1);
-      jst->getAccelerations()[0] = a;
+      jst[j]->getVelocities().resize(1);
+      jst[j]->getVelocities()[0] = velocities(i, j);
+      jst[j]->getAccelerations().resize(1);
+      jst[j]->getAccelerations()[0] = accelerations(i, j);
     }
   }
 }
 }
 
 // Applies Acceleration constraints
-void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
-                                                                          const std::vector<std::string>& active_joints,
+void IterativeParabolicTimeParameterization::applyAccelerationConstraints(const Eigen::MatrixXd& positions,
+                                                                          const std::vector<bool>& has_start_velocity,
+                                                                          const Eigen::VectorXd& start_velocity,
                                                                           const std::vector<moveit_msgs::JointLimits>& limits,
                                                                           std::vector<double> & time_diff) const
 {
-  robot_state::RobotStatePtr prev_waypoint;
-  robot_state::RobotStatePtr curr_waypoint;
-  robot_state::RobotStatePtr next_waypoint;
-  std::map<std::string, double> prev_state_values;
-  std::map<std::string, double> curr_state_values;
-  std::map<std::string, double> next_state_values;
-
-  const robot_model::JointModelGroup *group = rob_trajectory.getGroup();
-  const std::vector<const robot_model::JointModel*> &jnt = group->getJointModels();
-
-  const unsigned int num_points = rob_trajectory.getWayPointCount();
-  const unsigned int num_joints = group->getVariableCount();
+  const unsigned int num_points = positions.rows();
+  const unsigned int num_joints = positions.cols();
   int num_updates = 0;
   int iteration = 0;
   bool backwards = false;
@@ -365,6 +307,16 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
     // This is so that any time interval increases have a chance to get propogated through the trajectory
     for (unsigned int j = 0; j < num_joints ; ++j)
     {
+      // Get acceleration limits
+      double a_max = 1.0;
+      if( limits[j].has_acceleration_limits )
+      {
+        a_max = limits[j].max_acceleration;
+      }
+
+      // The values of this joint, contiguous in memory
+      const Eigen::VectorXd q = positions.col(j);
+
       // Loop forwards, then backwards
       for( int count=0; count<2; count++)
       {
@@ -376,33 +328,11 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
             index = (num_points-1)-i;
           }
 
-          curr_waypoint = rob_trajectory.getWayPointPtr(index);
-          curr_waypoint->getStateValues(curr_state_values);
-
-          if (index > 0)
-          {
-            prev_waypoint = rob_trajectory.getWayPointPtr(index-1);
-            prev_waypoint->getStateValues(prev_state_values);
-          }
-
-          if (index < num_points-1)
-          {
-            next_waypoint = rob_trajectory.getWayPointPtr(index+1);
-            next_waypoint->getStateValues(next_state_values);
-          }
-
-          // Get acceleration limits
-          double a_max = 1.0;
-          if( limits[j].has_acceleration_limits )
-          {
-            a_max = limits[j].max_acceleration;
-          }
-
           if(index==0)
           {     // First point
-            q1 = next_state_values[active_joints[j]];
-            q2 = curr_state_values[active_joints[j]];
-            q3 = next_state_values[active_joints[j]];
+            q1 = q(index+1);
+            q2 = q(index);
+            q3 = q(index+1);
 
             dt1 = time_diff[index];
             dt2 = time_diff[index];
@@ -410,18 +340,18 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
           }
           else if(index < num_points-1)
           { // middle points
-            q1 = prev_state_values[active_joints[j]];
-            q2 = curr_state_values[active_joints[j]];
-            q3 = next_state_values[active_joints[j]];
+            q1 = q(index-1);
+            q2 = q(index);
+            q3 = q(index+1);
 
             dt1 = time_diff[index-1];
             dt2 = time_diff[index];
           }
           else
           { // last point - careful, there are only numpoints-1 time intervals
-            q1 = prev_state_values[active_joints[j]];
-            q2 = curr_state_values[active_joints[j]];
-            q3 = prev_state_values[active_joints[j]];
+            q1 = q(index-1);
+            q2 = q(index);
+            q3 = q(index-1);
 
             dt1 = time_diff[index-1];
             dt2 = time_diff[index-1];
@@ -433,17 +363,7 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
             v2 = 0.0;
             a = 0.0;
           } else {
-            bool start_velocity = false;
-            if(index==0)
-            {
-              const std::vector<double> &vel = curr_waypoint->getJointState(active_joints[j])->getVelocities();
-              if(!vel.empty())
-              {
-                start_velocity = true;
-                v1 = vel[0];
-              }
-            }
-            v1 = start_velocity ? v1 : (q2-q1)/dt1;
+            v1 = (index==0 && has_start_velocity[j]) ? start_velocity(j) : (q2-q1)/dt1;
             v2 = (q3-q2)/dt2;
             a = 2*(v2-v1)/(dt1+dt2);
           }
@@ -461,16 +381,6 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
               time_diff[index-1] = dt1;
             }
             num_updates++;
-
-            if(dt1 == 0.0 || dt2 == 0.0) {
-              v1 = 0.0;
-              v2 = 0.0;
-              a = 0.0;
-            } else {
-              v1 = (q2-q1)/dt1;
-              v2 = (q3-q2)/dt2;
-              a = 2*(v2-v1)/(dt1+dt2);
-            }
           }
         }
         backwards = !backwards;
@@ -482,6 +392,19 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
 
 bool IterativeParabolicTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const
 {
+  return computeTimeStampsFrom(trajectory, 0);
+}
+
+bool IterativeParabolicTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory,
+                                                               std::size_t first_point, std::size_t blend_points) const
+{
+  return computeTimeStampsFrom(trajectory, first_point > blend_points ? first_point - blend_points : 0);
+}
+
+bool IterativeParabolicTimeParameterization::computeTimeStampsFrom(robot_trajectory::RobotTrajectory& trajectory,
+                                                                   std::size_t start) const
+{
+  MOVEIT_TRACE_SCOPE("IterativeParabolicTimeParameterization::computeTimeStamps");
   bool success = true;
   robot_state::RobotStatePtr curr_waypoint;
   const robot_state::JointState *jst;
@@ -505,19 +428,50 @@ bool IterativeParabolicTimeParameterization::computeTimeStamps(robot_trajectory:
     }
 
   const std::vector<moveit_msgs::JointLimits> &limits = trajectory.getGroup()->getVariableLimits();
-  const std::vector<std::string> &active_joints = group->getJointModelNames();
 
   // this lib does not actually work properly when angles wrap around, so we need to unwind the path first
   trajectory.unwind();
 
-  const std::size_t num_points = trajectory.getWayPointCount();
+  // when re-timing a suffix, the waypoint before it keeps its timing and its velocities are where the suffix starts from
+  if (start >= trajectory.getWayPointCount())
+    return success;
+  const std::size_t first_point = start > 0 ? start - 1 : 0;
+  const std::size_t num_points = trajectory.getWayPointCount() - first_point;
+  const std::size_t num_joints = group->getVariableCount();
+
+  // gather the positions of the group in a (waypoints x joints) matrix once
+  Eigen::MatrixXd positions(num_points, num_joints);
+  Eigen::VectorXd values;
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    trajectory.getWayPoint(first_point + i).getJointStateGroup(group->getName())->getVariableValues(values);
+    positions.row(i) = values.transpose();
+  }
+
+  // the velocities the trajectory starts with, if specified
+  std::vector<bool> has_start_velocity(num_joints, false);
+  Eigen::VectorXd start_velocity = Eigen::VectorXd::Zero(num_joints);
+  const std::vector<robot_state::JointState*> &start_joints =
+    trajectory.getWayPoint(first_point).getJointStateGroup(group->getName())->getJointStateVector();
+  for (std::size_t j = 0 ; j < num_joints ; ++j)
+    if (!start_joints[j]->getVelocities().empty())
+    {
+      has_start_velocity[j] = true;
+      start_velocity(j) = start_joints[j]->getVelocities()[0];
+    }
+
+  if (num_points < 2)
+  {
+    trajectory.setWayPointDurationFromPrevious(0, 0.0);
+    return success;
+  }
 
   std::vector<double> time_diff(num_points-1, 0.0);       // the time difference between adjacent points
 
-  applyVelocityConstraints(trajectory, active_joints, limits, time_diff);
-  applyAccelerationConstraints(trajectory, active_joints, limits, time_diff);
+  applyVelocityConstraints(positions, limits, time_diff);
+  applyAccelerationConstraints(positions, has_start_velocity, start_velocity, limits, time_diff);
 
-  updateTrajectory(trajectory, active_joints, time_diff);
+  updateTrajectory(trajectory, positions, has_start_velocity, start_velocity, time_diff, first_point, start > 0);
   return success;
 }
 
@@ -0,0 +1,225 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/trajectory_processing/path_shortcutting.h>
+#include <console_bridge/console.h>
+#include <ros/time.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace trajectory_processing
+{
+
+static const double MIN_SHORTCUT_GAIN = 1e-6;
+
+struct PathShortcutter::Candidate
+{
+  Candidate(std::size_t start, std::size_t end, double gain) : start_(start), end_(end), gain_(gain), valid_(false)
+  {
+  }
+
+  bool operator<(const Candidate &other) const
+  {
+    return gain_ > other.gain_;
+  }
+
+  std::size_t start_;
+  std::size_t end_;
+  double gain_;
+  bool valid_;
+};
+
+PathShortcutter::PathShortcutter(const PathSegmentValidityFn &validity_fn)
+  : validity_fn_(validity_fn),
+    resolution_(0.05),
+    max_time_(1.0),
+    max_rounds_(100),
+    candidates_per_round_(8),
+    num_threads_(1)
+{}
+
+PathShortcutter::~PathShortcutter()
+{}
+
+namespace
+{
+
+double getDistance(const robot_state::RobotState &a, const robot_state::RobotState &b, const std::string &group)
+{
+  return a.getJointStateGroup(group)->distance(b.getJointStateGroup(group));
+}
+
+// Append to segment the states of the straight line from a to b (excluding a, including b), at most resolution apart
+void appendInterpolatedStates(const robot_state::RobotState &a, const robot_state::RobotState &b, double resolution,
+                              double dt, robot_trajectory::RobotTrajectory &segment)
+{
+  const std::string &group = segment.getGroupName();
+  std::size_t steps = resolution > 0.0 ? std::max<std::size_t>(1, (std::size_t)ceil(getDistance(a, b, group) / resolution)) : 1;
+  for (std::size_t s = 1 ; s < steps ; ++s)
+  {
+    robot_state::RobotStatePtr st(new robot_state::RobotState(a));
+    a.getJointStateGroup(group)->interpolate(b.getJointStateGroup(group), (double)s / (double)steps, st->getJointStateGroup(group));
+    segment.addSuffixWayPoint(st, dt / (double)steps);
+  }
+  segment.addSuffixWayPoint(b, dt / (double)steps);
+}
+
+}
+
+void PathShortcutter::checkCandidates(const std::vector<robot_state::RobotStatePtr> *states, const robot_trajectory::RobotTrajectory *trajectory,
+                                      std::vector<Candidate> *candidates, std::size_t thread_index, std::size_t num_threads) const
+{
+  for (std::size_t c = thread_index ; c < candidates->size() ; c += num_threads)
+  {
+    Candidate &candidate = (*candidates)[c];
+    robot_trajectory::RobotTrajectory segment(trajectory->getRobotModel(), trajectory->getGroupName());
+    segment.addSuffixWayPoint(*(*states)[candidate.start_], 0.0);
+    appendInterpolatedStates(*(*states)[candidate.start_], *(*states)[candidate.end_], resolution_, 0.0, segment);
+    candidate.valid_ = validity_fn_(segment);
+  }
+}
+
+bool PathShortcutter::shortcut(robot_trajectory::RobotTrajectory &trajectory)
+{
+  if (!trajectory.getGroup())
+  {
+    logError("Only trajectories for a group can be shortcut");
+    return false;
+  }
+  if (trajectory.getWayPointCount() < 3)
+    return false;
+
+  ros::WallTime end_time = ros::WallTime::now() + ros::WallDuration(max_time_);
+  const std::string &group = trajectory.getGroupName();
+
+  std::vector<robot_state::RobotStatePtr> states(trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    states[i].reset(new robot_state::RobotState(trajectory.getWayPoint(i)));
+
+  // the length of the path up to each waypoint
+  std::vector<double> length(states.size(), 0.0);
+  for (std::size_t i = 1 ; i < states.size() ; ++i)
+    length[i] = length[i - 1] + getDistance(*states[i - 1], *states[i], group);
+  double initial_length = length.back();
+
+  for (unsigned int round = 0 ; round < max_rounds_ && states.size() > 2 && ros::WallTime::now() < end_time ; ++round)
+  {
+    // draw candidates that would shorten the path
+    std::vector<Candidate> candidates;
+    for (unsigned int k = 0 ; k < candidates_per_round_ ; ++k)
+    {
+      std::size_t start = rng_.uniformInteger(0, states.size() - 3);
+      std::size_t end = rng_.uniformInteger(start + 2, states.size() - 1);
+      double gain = length[end] - length[start] - getDistance(*states[start], *states[end], group);
+      if (gain > MIN_SHORTCUT_GAIN)
+        candidates.push_back(Candidate(start, end, gain));
+    }
+    if (candidates.empty())
+      continue;
+
+    // check them, in parallel
+    std::size_t num_threads = std::min<std::size_t>(std::max(num_threads_, 1u), candidates.size());
+    if (num_threads == 1)
+      checkCandidates(&states, &trajectory, &candidates, 0, 1);
+    else
+    {
+      boost::thread_group threads;
+      for (std::size_t t = 1 ; t < num_threads ; ++t)
+        threads.create_thread(boost::bind(&PathShortcutter::checkCandidates, this, &states, &trajectory, &candidates, t, num_threads));
+      checkCandidates(&states, &trajectory, &candidates, 0, num_threads);
+      threads.join_all();
+    }
+
+    // apply the valid shortcuts with the largest gains that do not overlap
+    std::sort(candidates.begin(), candidates.end());
+    std::vector<bool> removed(states.size(), false);
+    std::vector<std::pair<std::size_t, std::size_t> > applied;
+    for (std::size_t c = 0 ; c < candidates.size() ; ++c)
+    {
+      if (!candidates[c].valid_)
+        continue;
+      bool overlaps = false;
+      for (std::size_t k = 0 ; k < applied.size() && !overlaps ; ++k)
+        overlaps = candidates[c].start_ < applied[k].second && applied[k].first < candidates[c].end_;
+      if (overlaps)
+        continue;
+      applied.push_back(std::make_pair(candidates[c].start_, candidates[c].end_));
+      for (std::size_t i = candidates[c].start_ + 1 ; i < candidates[c].end_ ; ++i)
+        removed[i] = true;
+    }
+    if (applied.empty())
+      continue;
+
+    std::vector<robot_state::RobotStatePtr> remaining;
+    for (std::size_t i = 0 ; i < states.size() ; ++i)
+      if (!removed[i])
+        remaining.push_back(states[i]);
+    states.swap(remaining);
+    length.resize(states.size());
+    for (std::size_t i = 1 ; i < states.size() ; ++i)
+      length[i] = length[i - 1] + getDistance(*states[i - 1], *states[i], group);
+  }
+
+  if (length.back() >= initial_length - MIN_SHORTCUT_GAIN)
+    return false;
+
+  logDebug("Shortcutting reduced the path length from %lf to %lf (%u waypoints remain)",
+           initial_length, length.back(), (unsigned int)states.size());
+  trajectory.clear();
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    trajectory.addSuffixWayPoint(states[i], 0.0);
+  return true;
+}
+
+void PathShortcutter::resample(robot_trajectory::RobotTrajectory &trajectory) const
+{
+  if (!trajectory.getGroup())
+  {
+    logError("Only trajectories for a group can be resampled");
+    return;
+  }
+  if (trajectory.getWayPointCount() < 2)
+    return;
+
+  robot_trajectory::RobotTrajectory resampled(trajectory.getRobotModel(), trajectory.getGroupName());
+  resampled.addSuffixWayPoint(trajectory.getWayPoint(0), trajectory.getWayPointDurationFromPrevious(0));
+  for (std::size_t i = 1 ; i < trajectory.getWayPointCount() ; ++i)
+    appendInterpolatedStates(trajectory.getWayPoint(i - 1), trajectory.getWayPoint(i), resolution_,
+                             trajectory.getWayPointDurationFromPrevious(i), resampled);
+  trajectory.swap(resampled);
+}
+
+}
@@ -0,0 +1,347 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/trajectory_processing/time_optimal_time_parameterization.h>
+#include <moveit/profiler/tracing.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace trajectory_processing
+{
+
+static const double DEFAULT_VEL_MAX = 1.0;
+static const double DEFAULT_ACCEL_MAX = 1.0;
+static const double EPSILON = 1e-9;
+
+TimeOptimalTimeParameterization::TimeOptimalTimeParameterization(double max_translation_velocity, double max_translation_acceleration,
+                                                                 double max_rotation_velocity, double max_rotation_acceleration)
+  : max_translation_velocity_(max_translation_velocity),
+    max_translation_acceleration_(max_translation_acceleration),
+    max_rotation_velocity_(max_rotation_velocity),
+    max_rotation_acceleration_(max_rotation_acceleration)
+{}
+
+TimeOptimalTimeParameterization::~TimeOptimalTimeParameterization()
+{}
+
+namespace
+{
+
+// For a point of the path with derivatives dq and ddq (with respect to the path parameter s), compute the range
+// of the second derivative of s for which the accelerations of all variables are within limits, when the squared
+// speed along the path is x. Each variable constrains the range to -a_max <= dq * u + ddq * x <= a_max.
+void getPathAccelerationRange(const double *dq, const double *ddq, const std::vector<double> &a_max, double x, double &lo, double &hi)
+{
+  lo = -std::numeric_limits<double>::max();
+  hi = std::numeric_limits<double>::max();
+  for (std::size_t j = 0 ; j < a_max.size() ; ++j)
+  {
+    if (std::abs(dq[j]) < EPSILON)
+      continue;
+    double b1 = (a_max[j] - ddq[j] * x) / dq[j];
+    double b2 = (-a_max[j] - ddq[j] * x) / dq[j];
+    if (dq[j] > 0.0)
+    {
+      hi = std::min(hi, b1);
+      lo = std::max(lo, b2);
+    }
+    else
+    {
+      hi = std::min(hi, b2);
+      lo = std::max(lo, b1);
+    }
+  }
+}
+
+// Compute the largest squared speed along the path for which the velocity limits hold and some path acceleration
+// satisfies the acceleration limits. The bounds on the path acceleration are affine in the squared speed x;
+// a range [lower_k(x), upper_j(x)] is non-empty up to the x at which the two lines cross.
+double getMaxSquaredPathSpeed(const double *dq, const double *ddq, const std::vector<double> &v_max, const std::vector<double> &a_max)
+{
+  double x_max = std::numeric_limits<double>::max();
+  std::vector<std::pair<double, double> > upper, lower; // u <= a + b * x and u >= a + b * x
+  for (std::size_t j = 0 ; j < a_max.size() ; ++j)
+  {
+    if (std::abs(dq[j]) < EPSILON)
+    {
+      if (std::abs(ddq[j]) > EPSILON)
+        x_max = std::min(x_max, a_max[j] / std::abs(ddq[j]));
+      continue;
+    }
+    x_max = std::min(x_max, v_max[j] * v_max[j] / (dq[j] * dq[j]));
+    std::pair<double, double> b1(a_max[j] / dq[j], -ddq[j] / dq[j]);
+    std::pair<double, double> b2(-a_max[j] / dq[j], -ddq[j] / dq[j]);
+    if (dq[j] > 0.0)
+    {
+      upper.push_back(b1);
+      lower.push_back(b2);
+    }
+    else
+    {
+      upper.push_back(b2);
+      lower.push_back(b1);
+    }
+  }
+  for (std::size_t j = 0 ; j < upper.size() ; ++j)
+    for (std::size_t k = 0 ; k < lower.size() ; ++k)
+    {
+      double db = lower[k].second - upper[j].second;
+      if (db > EPSILON)
+        x_max = std::min(x_max, (upper[j].first - lower[k].first) / db);
+    }
+  return x_max;
+}
+
+}
+
+bool TimeOptimalTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const
+{
+  return computeTimeStamps(trajectory, std::vector<double>());
+}
+
+bool TimeOptimalTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory,
+                                                        const std::vector<double> &velocity_scaling) const
+{
+  MOVEIT_TRACE_SCOPE("TimeOptimalTimeParameterization::computeTimeStamps");
+  if (trajectory.empty())
+    return true;
+
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  if (!group)
+  {
+    logError("It looks like the planner did not set the group the plan was computed for");
+    return false;
+  }
+
+  // the limits of every variable; planar and floating joints fall back to the translation and rotation limits
+  const std::vector<moveit_msgs::JointLimits> limits = group->getVariableLimits();
+  const std::size_t num_vars = limits.size();
+  std::vector<double> v_max(num_vars, DEFAULT_VEL_MAX), a_max(num_vars, DEFAULT_ACCEL_MAX);
+  std::vector<std::size_t> planar_angles, quaternions; // the index of the first variable
+  const std::vector<const robot_model::JointModel*> &jnt = group->getJointModels();
+  std::size_t index = 0;
+  for (std::size_t i = 0 ; i < jnt.size() ; ++i)
+  {
+    switch (jnt[i]->getType())
+    {
+    case robot_model::JointModel::PLANAR:
+      v_max[index] = v_max[index + 1] = max_translation_velocity_;
+      a_max[index] = a_max[index + 1] = max_translation_acceleration_;
+      v_max[index + 2] = max_rotation_velocity_;
+      a_max[index + 2] = max_rotation_acceleration_;
+      planar_angles.push_back(index + 2);
+      break;
+    case robot_model::JointModel::FLOATING:
+      for (std::size_t k = 0 ; k < 3 ; ++k)
+      {
+        v_max[index + k] = max_translation_velocity_;
+        a_max[index + k] = max_translation_acceleration_;
+      }
+      // for a unit quaternion, |dq/dt| = |w| / 2; limiting each of the 4 components to a quarter of the
+      // rotation limits keeps |dq/dt| below half of them
+      for (std::size_t k = 3 ; k < 7 ; ++k)
+      {
+        v_max[index + k] = max_rotation_velocity_ / 4.0;
+        a_max[index + k] = max_rotation_acceleration_ / 4.0;
+      }
+      quaternions.push_back(index + 3);
+      break;
+    default:
+      break;
+    }
+    index += jnt[i]->getVariableCount();
+  }
+  for (std::size_t j = 0 ; j < num_vars ; ++j)
+  {
+    if (limits[j].has_velocity_limits && limits[j].max_velocity > 0.0)
+      v_max[j] = limits[j].max_velocity;
+    if (limits[j].has_acceleration_limits && limits[j].max_acceleration > 0.0)
+      a_max[j] = limits[j].max_acceleration;
+  }
+
+  // the path is followed in joint space, so angles should not wrap around
+  trajectory.unwind();
+
+  const std::size_t num_points = trajectory.getWayPointCount();
+  trajectory.setWayPointDurationFromPrevious(0, 0.0);
+  if (num_points < 2)
+    return true;
+
+  // the values of the variables at each waypoint and the path parameter s (distance along the path)
+  std::vector<double> q(num_points * num_vars), values;
+  std::vector<double> ds(num_points - 1);
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    trajectory.getWayPoint(i).getJointStateGroup(group->getName())->getVariableValues(values);
+    std::copy(values.begin(), values.end(), q.begin() + i * num_vars);
+    if (i > 0)
+    {
+      // keep planar angles continuous and quaternions in the hemisphere of the previous waypoint
+      for (std::size_t k = 0 ; k < planar_angles.size() ; ++k)
+      {
+        double &angle = q[i * num_vars + planar_angles[k]];
+        double previous = q[(i - 1) * num_vars + planar_angles[k]];
+        angle = previous + atan2(sin(angle - previous), cos(angle - previous));
+      }
+      for (std::size_t k = 0 ; k < quaternions.size() ; ++k)
+      {
+        double *quat = &q[i * num_vars + quaternions[k]];
+        const double *previous = &q[(i - 1) * num_vars + quaternions[k]];
+        if (quat[0] * previous[0] + quat[1] * previous[1] + quat[2] * previous[2] + quat[3] * previous[3] < 0.0)
+          for (std::size_t c = 0 ; c < 4 ; ++c)
+            quat[c] = -quat[c];
+      }
+      double d = 0.0;
+      for (std::size_t j = 0 ; j < num_vars ; ++j)
+        d += (q[i * num_vars + j] - q[(i - 1) * num_vars + j]) * (q[i * num_vars + j] - q[(i - 1) * num_vars + j]);
+      ds[i - 1] = sqrt(d);
+    }
+  }
+
+  // first and second derivatives of the path with respect to s, by finite differences
+  std::vector<double> dq(num_points * num_vars, 0.0), ddq(num_points * num_vars, 0.0);
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    std::size_t prev = i > 0 ? i - 1 : i;
+    std::size_t next = i < num_points - 1 ? i + 1 : i;
+    double span = (i > 0 ? ds[i - 1] : 0.0) + (i < num_points - 1 ? ds[i] : 0.0);
+    if (span < EPSILON)
+      continue;
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+      dq[i * num_vars + j] = (q[next * num_vars + j] - q[prev * num_vars + j]) / span;
+    if (prev != i && next != i && ds[i - 1] > EPSILON && ds[i] > EPSILON)
+      for (std::size_t j = 0 ; j < num_vars ; ++j)
+        ddq[i * num_vars + j] = 2.0 * ((q[next * num_vars + j] - q[i * num_vars + j]) / ds[i] -
+                                       (q[i * num_vars + j] - q[prev * num_vars + j]) / ds[i - 1]) / span;
+  }
+
+  // the limit on the squared speed along the path at each waypoint
+  std::vector<double> x_lim(num_points);
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    x_lim[i] = getMaxSquaredPathSpeed(&dq[i * num_vars], &ddq[i * num_vars], v_max, a_max);
+
+    // the velocity scaling of the segments on either side of the waypoint applies
+    double scale = 1.0;
+    if (i > 0 && i - 1 < velocity_scaling.size())
+      scale = std::min(scale, velocity_scaling[i - 1]);
+    if (i < num_points - 1 && i < velocity_scaling.size())
+      scale = std::min(scale, velocity_scaling[i]);
+    if (scale > 0.0 && scale < 1.0)
+      x_lim[i] *= scale * scale;
+  }
+
+  // forward pass: accelerate as much as possible, starting at rest
+  std::vector<double> x(num_points);
+  double lo, hi;
+  x[0] = 0.0;
+  for (std::size_t i = 0 ; i < num_points - 1 ; ++i)
+  {
+    if (ds[i] < EPSILON)
+    {
+      x[i + 1] = std::min(x[i], x_lim[i + 1]);
+      continue;
+    }
+    getPathAccelerationRange(&dq[i * num_vars], &ddq[i * num_vars], a_max, x[i], lo, hi);
+    x[i + 1] = std::min(x_lim[i + 1], std::max(0.0, x[i] + 2.0 * hi * ds[i]));
+  }
+
+  // backward pass: decelerate as much as possible, stopping at the end
+  x[num_points - 1] = 0.0;
+  for (std::size_t i = num_points - 1 ; i > 0 ; --i)
+  {
+    if (ds[i - 1] < EPSILON)
+    {
+      x[i - 1] = std::min(x[i - 1], x[i]);
+      continue;
+    }
+    getPathAccelerationRange(&dq[i * num_vars], &ddq[i * num_vars], a_max, x[i], lo, hi);
+    x[i - 1] = std::min(x[i - 1], std::max(0.0, x[i] - 2.0 * lo * ds[i - 1]));
+  }
+
+  // the speed varies linearly in x between waypoints (constant path acceleration), which gives the durations
+  for (std::size_t i = 0 ; i < num_points - 1 ; ++i)
+  {
+    double dt = 0.0;
+    if (ds[i] > EPSILON)
+    {
+      double speed_sum = sqrt(x[i]) + sqrt(x[i + 1]);
+      if (speed_sum > EPSILON)
+        dt = 2.0 * ds[i] / speed_sum;
+      else
+      {
+        // the segment starts and ends at rest: accelerate for half of it and decelerate for the other half
+        double lo_next, hi_next;
+        getPathAccelerationRange(&dq[i * num_vars], &ddq[i * num_vars], a_max, 0.0, lo, hi);
+        getPathAccelerationRange(&dq[(i + 1) * num_vars], &ddq[(i + 1) * num_vars], a_max, 0.0, lo_next, hi_next);
+        double a = std::min(hi, -lo_next);
+        dt = a > EPSILON ? 2.0 * sqrt(ds[i] / a) : 0.0;
+      }
+    }
+    trajectory.setWayPointDurationFromPrevious(i + 1, dt);
+  }
+
+  // set the velocities and accelerations of the variables
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    double u = 0.0;
+    if (i < num_points - 1 && ds[i] > EPSILON)
+      u = (x[i + 1] - x[i]) / (2.0 * ds[i]);
+    else
+      if (i > 0 && ds[i - 1] > EPSILON)
+        u = (x[i] - x[i - 1]) / (2.0 * ds[i - 1]);
+    double speed = sqrt(x[i]);
+
+    const std::vector<robot_state::JointState*> &joints =
+      trajectory.getWayPointPtr(i)->getJointStateGroup(group->getName())->getJointStateVector();
+    std::size_t j = 0;
+    for (std::size_t k = 0 ; k < joints.size() ; ++k)
+    {
+      unsigned int dim = joints[k]->getVariableCount();
+      joints[k]->getVelocities().resize(dim);
+      joints[k]->getAccelerations().resize(dim);
+      for (unsigned int d = 0 ; d < dim ; ++d, ++j)
+      {
+        joints[k]->getVelocities()[d] = dq[i * num_vars + j] * speed;
+        joints[k]->getAccelerations()[d] = dq[i * num_vars + j] * u + ddq[i * num_vars + j] * x[i];
+      }
+    }
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,253 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/trajectory_processing/trajectory_sampler.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <cmath>
+
+namespace trajectory_processing
+{
+
+static const double EPSILON = 1e-9;
+
+TrajectorySampler::TrajectorySampler()
+  : variable_count_(0),
+    cursor_(0),
+    period_(0.0),
+    start_time_(0.0),
+    sample_index_(0),
+    done_(true)
+{}
+
+TrajectorySampler::~TrajectorySampler()
+{}
+
+bool TrajectorySampler::setTrajectory(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  if (!group)
+  {
+    logError("Only trajectories for a group can be sampled");
+    return false;
+  }
+  variable_count_ = group->getVariableCount();
+  segment_start_.clear();
+  coefficients_.clear();
+  cursor_ = 0;
+  done_ = true;
+  if (trajectory.empty())
+    return true;
+
+  // the waypoints at which segments start or end; of waypoints at the same time, the last one is kept
+  std::vector<std::size_t> knots;
+  std::vector<double> times;
+  double time = 0.0;
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    double dt = i > 0 ? trajectory.getWayPointDurationFromPrevious(i) : 0.0;
+    time += dt;
+    if (i == 0 || dt > EPSILON)
+    {
+      knots.push_back(i);
+      times.push_back(time);
+    }
+    else
+      knots.back() = i;
+  }
+
+  // the values at the knots
+  const std::size_t n = knots.size();
+  std::vector<double> p(n * variable_count_), v(n * variable_count_, 0.0), a(n * variable_count_, 0.0), values;
+  bool have_velocities = true, have_accelerations = true;
+  for (std::size_t k = 0 ; k < n ; ++k)
+  {
+    const robot_state::JointStateGroup *jsg = trajectory.getWayPoint(knots[k]).getJointStateGroup(group->getName());
+    jsg->getVariableValues(values);
+    std::copy(values.begin(), values.end(), p.begin() + k * variable_count_);
+    const std::vector<robot_state::JointState*> &joints = jsg->getJointStateVector();
+    std::size_t index = k * variable_count_;
+    for (std::size_t j = 0 ; j < joints.size() ; ++j)
+    {
+      std::size_t dim = joints[j]->getVariableCount();
+      if (joints[j]->getVelocities().size() == dim)
+        std::copy(joints[j]->getVelocities().begin(), joints[j]->getVelocities().end(), v.begin() + index);
+      else
+        have_velocities = false;
+      if (joints[j]->getAccelerations().size() == dim)
+        std::copy(joints[j]->getAccelerations().begin(), joints[j]->getAccelerations().end(), a.begin() + index);
+      else
+        have_accelerations = false;
+      index += dim;
+    }
+  }
+
+  // unwind continuous joints
+  const std::vector<const robot_model::JointModel*> &continuous = group->getContinuousJointModels();
+  for (std::size_t c = 0 ; c < continuous.size() ; ++c)
+  {
+    std::size_t j = group->getJointVariablesIndexMap().find(continuous[c]->getName())->second;
+    for (std::size_t k = 1 ; k < n ; ++k)
+    {
+      double previous = p[(k - 1) * variable_count_ + j];
+      double &current = p[k * variable_count_ + j];
+      current = previous + atan2(sin(current - previous), cos(current - previous));
+    }
+  }
+
+  // estimate missing velocities from the slopes of the neighbouring segments
+  if (!have_velocities)
+  {
+    std::fill(v.begin(), v.end(), 0.0);
+    for (std::size_t k = 1 ; k + 1 < n ; ++k)
+      for (std::size_t j = 0 ; j < variable_count_ ; ++j)
+        v[k * variable_count_ + j] = 0.5 * ((p[k * variable_count_ + j] - p[(k - 1) * variable_count_ + j]) / (times[k] - times[k - 1]) +
+                                            (p[(k + 1) * variable_count_ + j] - p[k * variable_count_ + j]) / (times[k + 1] - times[k]));
+  }
+  bool quintic = have_velocities && have_accelerations;
+
+  if (n == 1)
+  {
+    // a single state: one constant segment of zero duration
+    segment_start_.push_back(0.0);
+    segment_start_.push_back(0.0);
+    coefficients_.resize(variable_count_ * COEFFICIENT_COUNT, 0.0);
+    for (std::size_t j = 0 ; j < variable_count_ ; ++j)
+      coefficients_[j * COEFFICIENT_COUNT] = p[j];
+    return true;
+  }
+
+  segment_start_ = times;
+  coefficients_.resize((n - 1) * variable_count_ * COEFFICIENT_COUNT, 0.0);
+  for (std::size_t k = 0 ; k + 1 < n ; ++k)
+  {
+    double T = times[k + 1] - times[k];
+    for (std::size_t j = 0 ; j < variable_count_ ; ++j)
+    {
+      std::size_t i0 = k * variable_count_ + j, i1 = (k + 1) * variable_count_ + j;
+      double h = p[i1] - p[i0];
+      double *c = &coefficients_[(k * variable_count_ + j) * COEFFICIENT_COUNT];
+      c[0] = p[i0];
+      c[1] = v[i0];
+      if (quintic)
+      {
+        c[2] = a[i0] / 2.0;
+        c[3] = (20.0 * h - (8.0 * v[i1] + 12.0 * v[i0]) * T - (3.0 * a[i0] - a[i1]) * T * T) / (2.0 * T * T * T);
+        c[4] = (-30.0 * h + (14.0 * v[i1] + 16.0 * v[i0]) * T + (3.0 * a[i0] - 2.0 * a[i1]) * T * T) / (2.0 * T * T * T * T);
+        c[5] = (12.0 * h - 6.0 * (v[i1] + v[i0]) * T + (a[i1] - a[i0]) * T * T) / (2.0 * T * T * T * T * T);
+      }
+      else
+      {
+        c[2] = (3.0 * h - (2.0 * v[i0] + v[i1]) * T) / (T * T);
+        c[3] = (-2.0 * h + (v[i0] + v[i1]) * T) / (T * T * T);
+      }
+    }
+  }
+  return true;
+}
+
+void TrajectorySampler::sample(double time, double *positions, double *velocities, double *accelerations)
+{
+  if (segment_start_.empty())
+    return;
+  const std::size_t segment_count = segment_start_.size() - 1;
+  time = std::max(0.0, std::min(time, segment_start_.back()));
+
+  // step forward from the segment of the previous sample, or search if the time went back
+  if (cursor_ < segment_count && segment_start_[cursor_] <= time)
+  {
+    while (cursor_ + 1 < segment_count && segment_start_[cursor_ + 1] <= time)
+      ++cursor_;
+  }
+  else
+  {
+    std::vector<double>::const_iterator it = std::upper_bound(segment_start_.begin(), segment_start_.begin() + segment_count, time);
+    cursor_ = it == segment_start_.begin() ? 0 : (it - segment_start_.begin()) - 1;
+  }
+
+  double t = time - segment_start_[cursor_];
+  const double *c = &coefficients_[cursor_ * variable_count_ * COEFFICIENT_COUNT];
+  for (std::size_t j = 0 ; j < variable_count_ ; ++j, c += COEFFICIENT_COUNT)
+  {
+    if (positions)
+      positions[j] = c[0] + t * (c[1] + t * (c[2] + t * (c[3] + t * (c[4] + t * c[5]))));
+    if (velocities)
+      velocities[j] = c[1] + t * (2.0 * c[2] + t * (3.0 * c[3] + t * (4.0 * c[4] + t * 5.0 * c[5])));
+    if (accelerations)
+      accelerations[j] = 2.0 * c[2] + t * (6.0 * c[3] + t * (12.0 * c[4] + t * 20.0 * c[5]));
+  }
+}
+
+void TrajectorySampler::start(double period, double start_time)
+{
+  period_ = period;
+  start_time_ = start_time;
+  sample_index_ = 0;
+  done_ = segment_start_.empty() || period <= 0.0;
+}
+
+bool TrajectorySampler::next(double *positions, double *velocities, double *accelerations)
+{
+  if (done_)
+    return false;
+  double time = start_time_ + period_ * (double)sample_index_++;
+  if (time >= segment_start_.back())
+  {
+    time = segment_start_.back();
+    done_ = true;
+  }
+  sample(time, positions, velocities, accelerations);
+  return true;
+}
+
+std::size_t TrajectorySampler::next(std::size_t max_samples, std::vector<double> &positions, std::vector<double> &velocities,
+                                    std::vector<double> &accelerations)
+{
+  if (variable_count_ == 0)
+    return 0;
+  std::size_t size = max_samples * variable_count_;
+  if (positions.size() < size)
+    positions.resize(size);
+  if (velocities.size() < size)
+    velocities.resize(size);
+  if (accelerations.size() < size)
+    accelerations.resize(size);
+  std::size_t count = 0;
+  while (count < max_samples &&
+         next(&positions[count * variable_count_], &velocities[count * variable_count_], &accelerations[count * variable_count_]))
+    ++count;
+  return count;
+}
+
+}
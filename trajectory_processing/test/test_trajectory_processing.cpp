@@ -0,0 +1,604 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/test_resources/config.h>
+#include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/trajectory_processing/time_optimal_time_parameterization.h>
+#include <moveit/trajectory_processing/path_shortcutting.h>
+#include <moveit/trajectory_processing/trajectory_sampler.h>
+#include <urdf_parser/urdf_parser.h>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+static std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+static std::string srdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string();
+
+class TrajectoryProcessingTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+    ASSERT_TRUE(xml_file.is_open());
+    while (xml_file.good())
+    {
+      std::string line;
+      std::getline(xml_file, line);
+      xml_string += (line + "\n");
+    }
+    xml_file.close();
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+    ASSERT_TRUE(urdf_model);
+    ASSERT_TRUE(srdf_model->initFile(*urdf_model, srdf_file));
+    kmodel_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+  }
+
+  /** \brief The values of the right arm at waypoint \e index of the reference path: a smooth curve in joint space */
+  static std::vector<double> pathValues(std::size_t index, std::size_t variable_count)
+  {
+    std::vector<double> values(variable_count);
+    for (std::size_t j = 0 ; j < variable_count ; ++j)
+      values[j] = -0.3 + 0.4 * sin(0.05 * index * (j + 1));
+    return values;
+  }
+
+  /** \brief Append waypoints \e begin to \e end (excluded) of the reference path to \e trajectory, without timing */
+  void makePath(robot_trajectory::RobotTrajectory &trajectory, std::size_t begin, std::size_t end) const
+  {
+    robot_state::RobotState state(kmodel_);
+    state.setToDefaultValues();
+    robot_state::JointStateGroup *jsg = state.getJointStateGroup("right_arm");
+    for (std::size_t i = begin ; i < end ; ++i)
+    {
+      jsg->setVariableValues(pathValues(i, jsg->getVariableCount()));
+      trajectory.addSuffixWayPoint(state, 0.0);
+    }
+  }
+
+  static std::vector<double> getValues(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index)
+  {
+    std::vector<double> values;
+    trajectory.getWayPoint(index).getJointStateGroup(trajectory.getGroupName())->getVariableValues(values);
+    return values;
+  }
+
+  static std::vector<double> getVelocities(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index)
+  {
+    std::vector<double> velocities;
+    const std::vector<robot_state::JointState*> &joints =
+      trajectory.getWayPoint(index).getJointStateGroup(trajectory.getGroupName())->getJointStateVector();
+    for (std::size_t j = 0 ; j < joints.size() ; ++j)
+      velocities.insert(velocities.end(), joints[j]->getVelocities().begin(), joints[j]->getVelocities().end());
+    return velocities;
+  }
+
+  static std::vector<double> getAccelerations(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index)
+  {
+    std::vector<double> accelerations;
+    const std::vector<robot_state::JointState*> &joints =
+      trajectory.getWayPoint(index).getJointStateGroup(trajectory.getGroupName())->getJointStateVector();
+    for (std::size_t j = 0 ; j < joints.size() ; ++j)
+      accelerations.insert(accelerations.end(), joints[j]->getAccelerations().begin(), joints[j]->getAccelerations().end());
+    return accelerations;
+  }
+
+  /** \brief The velocity limits of the variables of the group, with the default the parameterizations use */
+  static std::vector<double> getVelocityLimits(const robot_trajectory::RobotTrajectory &trajectory)
+  {
+    const std::vector<moveit_msgs::JointLimits> limits = trajectory.getGroup()->getVariableLimits();
+    std::vector<double> v_max(limits.size(), 1.0);
+    for (std::size_t j = 0 ; j < limits.size() ; ++j)
+      if (limits[j].has_velocity_limits)
+        v_max[j] = limits[j].max_velocity;
+    return v_max;
+  }
+
+  robot_model::RobotModelPtr kmodel_;
+};
+
+namespace
+{
+
+bool acceptSegment(const robot_trajectory::RobotTrajectory &segment, bool valid)
+{
+  return valid;
+}
+
+// The parabolic time parameterization as it was before its passes ran on a position matrix: the values are
+// looked up per waypoint and joint, and the time differences are widened in the same order. \e q holds the values
+// of each waypoint; no start velocity is given.
+const double REFERENCE_MAX_TIME_CHANGE_PER_IT = .01;
+const double REFERENCE_ROUNDING_THRESHOLD = 0.01;
+const unsigned int REFERENCE_MAX_ITERATIONS = 100;
+
+double referenceFindT1(const double dq1, const double dq2, double dt1, const double dt2, const double a_max)
+{
+  const double mult_factor = 1.01;
+  double v1 = (dq1)/dt1;
+  double v2 = (dq2)/dt2;
+  double a = 2.0*(v2-v1)/(dt1+dt2);
+  while (std::abs(a) > a_max)
+  {
+    v1 = (dq1)/dt1;
+    v2 = (dq2)/dt2;
+    a = 2.0*(v2-v1)/(dt1+dt2);
+    dt1 *= mult_factor;
+  }
+  return dt1;
+}
+
+double referenceFindT2(const double dq1, const double dq2, const double dt1, double dt2, const double a_max)
+{
+  const double mult_factor = 1.01;
+  double v1 = (dq1)/dt1;
+  double v2 = (dq2)/dt2;
+  double a = 2.0*(v2-v1)/(dt1+dt2);
+  while (std::abs(a) > a_max)
+  {
+    v1 = (dq1)/dt1;
+    v2 = (dq2)/dt2;
+    a = 2.0*(v2-v1)/(dt1+dt2);
+    dt2 *= mult_factor;
+  }
+  return dt2;
+}
+
+std::vector<double> referenceTimeDiffs(const std::vector<std::vector<double> > &q,
+                                       const std::vector<moveit_msgs::JointLimits> &limits)
+{
+  const unsigned int num_points = q.size();
+  const unsigned int num_joints = limits.size();
+  std::vector<double> time_diff(num_points - 1, 0.0);
+
+  for (unsigned int i = 0 ; i < num_points - 1 ; ++i)
+    for (unsigned int j = 0 ; j < num_joints ; ++j)
+    {
+      double v_max = limits[j].has_velocity_limits ? limits[j].max_velocity : 1.0;
+      double t_min = std::abs(q[i + 1][j] - q[i][j]) / v_max;
+      if (t_min > time_diff[i])
+        time_diff[i] = t_min;
+    }
+
+  int num_updates = 0;
+  unsigned int iteration = 0;
+  bool backwards = false;
+  do
+  {
+    num_updates = 0;
+    iteration++;
+    for (unsigned int j = 0 ; j < num_joints ; ++j)
+    {
+      double a_max = limits[j].has_acceleration_limits ? limits[j].max_acceleration : 1.0;
+      for (int count = 0 ; count < 2 ; count++)
+      {
+        for (unsigned int i = 0 ; i < num_points - 1 ; ++i)
+        {
+          unsigned int index = backwards ? (num_points - 1) - i : i;
+          double q1, q2, q3, dt1, dt2;
+          if (index == 0)
+          {
+            q1 = q[index + 1][j];
+            q2 = q[index][j];
+            q3 = q[index + 1][j];
+            dt1 = dt2 = time_diff[index];
+          }
+          else if (index < num_points - 1)
+          {
+            q1 = q[index - 1][j];
+            q2 = q[index][j];
+            q3 = q[index + 1][j];
+            dt1 = time_diff[index - 1];
+            dt2 = time_diff[index];
+          }
+          else
+          {
+            q1 = q[index - 1][j];
+            q2 = q[index][j];
+            q3 = q[index - 1][j];
+            dt1 = dt2 = time_diff[index - 1];
+          }
+
+          double a = 0.0;
+          if (dt1 != 0.0 && dt2 != 0.0)
+          {
+            double v1 = (q2 - q1) / dt1;
+            double v2 = (q3 - q2) / dt2;
+            a = 2 * (v2 - v1) / (dt1 + dt2);
+          }
+          if (std::abs(a) > a_max + REFERENCE_ROUNDING_THRESHOLD)
+          {
+            if (!backwards)
+              time_diff[index] = std::min(dt2 + REFERENCE_MAX_TIME_CHANGE_PER_IT, referenceFindT2(q2 - q1, q3 - q2, dt1, dt2, a_max));
+            else
+              time_diff[index - 1] = std::min(dt1 + REFERENCE_MAX_TIME_CHANGE_PER_IT, referenceFindT1(q2 - q1, q3 - q2, dt1, dt2, a_max));
+            num_updates++;
+          }
+        }
+        backwards = !backwards;
+      }
+    }
+  } while (num_updates > 0 && iteration < REFERENCE_MAX_ITERATIONS);
+  return time_diff;
+}
+
+double getPathLength(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  double length = 0.0;
+  for (std::size_t i = 1 ; i < trajectory.getWayPointCount() ; ++i)
+    length += trajectory.getWayPoint(i - 1).getJointStateGroup(trajectory.getGroupName())->
+      distance(trajectory.getWayPoint(i).getJointStateGroup(trajectory.getGroupName()));
+  return length;
+}
+
+}
+
+TEST_F(TrajectoryProcessingTest, TimeOptimalRespectsLimits)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 50);
+  trajectory_processing::TimeOptimalTimeParameterization totp;
+  ASSERT_TRUE(totp.computeTimeStamps(trajectory));
+  ASSERT_EQ(50u, trajectory.getWayPointCount());
+
+  const std::vector<double> v_max = getVelocityLimits(trajectory);
+  EXPECT_EQ(0.0, trajectory.getWayPointDurationFromPrevious(0));
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    EXPECT_GE(trajectory.getWayPointDurationFromPrevious(i), 0.0);
+    std::vector<double> velocities = getVelocities(trajectory, i);
+    ASSERT_EQ(v_max.size(), velocities.size());
+    ASSERT_EQ(v_max.size(), getAccelerations(trajectory, i).size());
+    for (std::size_t j = 0 ; j < v_max.size() ; ++j)
+    {
+      EXPECT_LE(std::abs(velocities[j]), v_max[j] * (1.0 + 1e-9));
+      // the trajectory starts and ends at rest
+      if (i == 0 || i == trajectory.getWayPointCount() - 1)
+        EXPECT_NEAR(0.0, velocities[j], 1e-9);
+    }
+  }
+  const double duration = trajectory.getWaypointDurationFromStart(trajectory.getWayPointCount() - 1);
+  EXPECT_GT(duration, 0.0);
+
+  // scaling the velocity limits down slows every segment down, and keeps the velocities within the scaled limits
+  robot_trajectory::RobotTrajectory scaled(kmodel_, "right_arm");
+  makePath(scaled, 0, 50);
+  ASSERT_TRUE(totp.computeTimeStamps(scaled, std::vector<double>(49, 0.5)));
+  for (std::size_t i = 1 ; i < scaled.getWayPointCount() ; ++i)
+    EXPECT_GE(scaled.getWayPointDurationFromPrevious(i), trajectory.getWayPointDurationFromPrevious(i) - 1e-12);
+  for (std::size_t i = 0 ; i < scaled.getWayPointCount() ; ++i)
+  {
+    std::vector<double> velocities = getVelocities(scaled, i);
+    for (std::size_t j = 0 ; j < v_max.size() ; ++j)
+      EXPECT_LE(std::abs(velocities[j]), 0.5 * v_max[j] * (1.0 + 1e-9));
+  }
+  EXPECT_GT(scaled.getWaypointDurationFromStart(scaled.getWayPointCount() - 1), duration);
+}
+
+TEST_F(TrajectoryProcessingTest, TimeOptimalSingleWayPoint)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 1);
+  trajectory_processing::TimeOptimalTimeParameterization totp;
+  EXPECT_TRUE(totp.computeTimeStamps(trajectory));
+  EXPECT_EQ(0.0, trajectory.getWayPointDurationFromPrevious(0));
+
+  robot_trajectory::RobotTrajectory no_group(kmodel_, "");
+  makePath(no_group, 0, 2);
+  EXPECT_FALSE(totp.computeTimeStamps(no_group));
+}
+
+TEST_F(TrajectoryProcessingTest, ShortcutDetour)
+{
+  // a path that moves the first joint out and half of the way back while the second joint moves, which a straight
+  // line between its ends shortens
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  robot_state::RobotState state(kmodel_);
+  state.setToDefaultValues();
+  robot_state::JointStateGroup *jsg = state.getJointStateGroup("right_arm");
+  std::vector<double> values(jsg->getVariableCount(), -0.2);
+  for (std::size_t i = 0 ; i <= 20 ; ++i)
+  {
+    values[0] = -0.2 - 0.05 * std::min<std::size_t>(i, 10) + 0.025 * (i > 10 ? i - 10 : 0);
+    values[1] = 0.05 * (i > 10 ? i - 10 : 0);
+    jsg->setVariableValues(values);
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+  const std::vector<double> first = getValues(trajectory, 0);
+  const std::vector<double> last = getValues(trajectory, 20);
+  const double length = getPathLength(trajectory);
+
+  // nothing changes if no segment is valid
+  trajectory_processing::PathShortcutter rejecting(boost::bind(&acceptSegment, _1, false));
+  rejecting.setMaxRounds(10);
+  EXPECT_FALSE(rejecting.shortcut(trajectory));
+  EXPECT_EQ(21u, trajectory.getWayPointCount());
+  EXPECT_NEAR(length, getPathLength(trajectory), 1e-12);
+
+  trajectory_processing::PathShortcutter shortcutter(boost::bind(&acceptSegment, _1, true));
+  shortcutter.setMaxRounds(50);
+  shortcutter.setNumThreads(2);
+  EXPECT_TRUE(shortcutter.shortcut(trajectory));
+  EXPECT_LT(trajectory.getWayPointCount(), 21u);
+  EXPECT_LT(getPathLength(trajectory), length);
+
+  // the path still starts and ends where it did
+  std::vector<double> start = getValues(trajectory, 0);
+  std::vector<double> end = getValues(trajectory, trajectory.getWayPointCount() - 1);
+  for (std::size_t j = 0 ; j < first.size() ; ++j)
+  {
+    EXPECT_NEAR(first[j], start[j], 1e-12);
+    EXPECT_NEAR(last[j], end[j], 1e-12);
+  }
+}
+
+TEST_F(TrajectoryProcessingTest, Resample)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 10);
+  for (std::size_t i = 1 ; i < trajectory.getWayPointCount() ; ++i)
+    trajectory.setWayPointDurationFromPrevious(i, 0.1);
+  const std::vector<double> last = getValues(trajectory, 9);
+  const double length = getPathLength(trajectory);
+
+  trajectory_processing::PathShortcutter shortcutter(boost::bind(&acceptSegment, _1, true));
+  shortcutter.setResolution(0.01);
+  shortcutter.resample(trajectory);
+  EXPECT_GT(trajectory.getWayPointCount(), 10u);
+  for (std::size_t i = 1 ; i < trajectory.getWayPointCount() ; ++i)
+    EXPECT_LE(trajectory.getWayPoint(i - 1).getJointStateGroup("right_arm")->
+              distance(trajectory.getWayPoint(i).getJointStateGroup("right_arm")), 0.01 + 1e-9);
+
+  // the path and its duration are kept
+  EXPECT_NEAR(length, getPathLength(trajectory), 1e-6);
+  EXPECT_NEAR(0.9, trajectory.getWaypointDurationFromStart(trajectory.getWayPointCount() - 1), 1e-9);
+  std::vector<double> end = getValues(trajectory, trajectory.getWayPointCount() - 1);
+  for (std::size_t j = 0 ; j < last.size() ; ++j)
+    EXPECT_NEAR(last[j], end[j], 1e-12);
+}
+
+TEST_F(TrajectoryProcessingTest, SamplerMatchesWayPoints)
+{
+  // the time-optimal parameterization sets velocities and accelerations, so the sampler interpolates with quintics
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 30);
+  trajectory_processing::TimeOptimalTimeParameterization totp;
+  ASSERT_TRUE(totp.computeTimeStamps(trajectory));
+
+  trajectory_processing::TrajectorySampler sampler;
+  ASSERT_TRUE(sampler.setTrajectory(trajectory));
+  const std::size_t n = sampler.getVariableCount();
+  ASSERT_EQ(trajectory.getGroup()->getVariableCount(), n);
+  EXPECT_NEAR(trajectory.getWaypointDurationFromStart(29), sampler.getDuration(), 1e-12);
+
+  std::vector<double> positions(n), velocities(n), accelerations(n);
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    sampler.sample(trajectory.getWaypointDurationFromStart(i), &positions[0], &velocities[0], &accelerations[0]);
+    std::vector<double> values = getValues(trajectory, i);
+    std::vector<double> expected_velocities = getVelocities(trajectory, i);
+    std::vector<double> expected_accelerations = getAccelerations(trajectory, i);
+    for (std::size_t j = 0 ; j < n ; ++j)
+    {
+      EXPECT_NEAR(values[j], positions[j], 1e-6);
+      EXPECT_NEAR(expected_velocities[j], velocities[j], 1e-6);
+      EXPECT_NEAR(expected_accelerations[j], accelerations[j], 1e-6);
+    }
+  }
+
+  // without velocities, cubics through the waypoints are used, starting and ending at rest
+  robot_trajectory::RobotTrajectory untimed(kmodel_, "right_arm");
+  makePath(untimed, 0, 30);
+  for (std::size_t i = 1 ; i < untimed.getWayPointCount() ; ++i)
+    untimed.setWayPointDurationFromPrevious(i, 0.1);
+  ASSERT_TRUE(sampler.setTrajectory(untimed));
+  EXPECT_NEAR(2.9, sampler.getDuration(), 1e-12);
+  for (std::size_t i = 0 ; i < untimed.getWayPointCount() ; ++i)
+  {
+    sampler.sample(0.1 * i, &positions[0], &velocities[0], NULL);
+    std::vector<double> values = getValues(untimed, i);
+    for (std::size_t j = 0 ; j < n ; ++j)
+    {
+      EXPECT_NEAR(values[j], positions[j], 1e-6);
+      if (i == 0 || i == untimed.getWayPointCount() - 1)
+        EXPECT_NEAR(0.0, velocities[j], 1e-6);
+    }
+  }
+
+  robot_trajectory::RobotTrajectory no_group(kmodel_, "");
+  EXPECT_FALSE(sampler.setTrajectory(no_group));
+}
+
+TEST_F(TrajectoryProcessingTest, SamplerFixedRate)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 30);
+  trajectory_processing::TimeOptimalTimeParameterization totp;
+  ASSERT_TRUE(totp.computeTimeStamps(trajectory));
+
+  trajectory_processing::TrajectorySampler sampler;
+  ASSERT_TRUE(sampler.setTrajectory(trajectory));
+  const std::size_t n = sampler.getVariableCount();
+  const double period = 0.01;
+
+  // one sample at a time, every period and a last one at the end
+  std::vector<double> positions, velocities, accelerations;
+  std::vector<double> p(n), v(n), a(n);
+  sampler.start(period);
+  while (sampler.next(&p[0], &v[0], &a[0]))
+  {
+    positions.insert(positions.end(), p.begin(), p.end());
+    velocities.insert(velocities.end(), v.begin(), v.end());
+  }
+  EXPECT_FALSE(sampler.next(&p[0], &v[0], &a[0]));
+  const std::size_t count = positions.size() / n;
+  EXPECT_GE(count, (std::size_t)(sampler.getDuration() / period));
+  EXPECT_LE(count, (std::size_t)(sampler.getDuration() / period) + 2);
+  std::vector<double> last = getValues(trajectory, 29);
+  for (std::size_t j = 0 ; j < n ; ++j)
+  {
+    EXPECT_NEAR(last[j], positions[(count - 1) * n + j], 1e-6);
+    EXPECT_NEAR(0.0, velocities[(count - 1) * n + j], 1e-6);
+  }
+
+  // in batches, into buffers that are reused, the same samples come out
+  std::vector<double> batch_positions, batch_velocities, batch_accelerations;
+  sampler.start(period);
+  std::size_t total = 0;
+  std::size_t batch;
+  while ((batch = sampler.next(7, batch_positions, batch_velocities, batch_accelerations)) > 0)
+  {
+    EXPECT_EQ(7 * n, batch_positions.size());
+    for (std::size_t k = 0 ; k < batch * n ; ++k)
+    {
+      ASSERT_LT(total * n + k, positions.size());
+      EXPECT_EQ(positions[total * n + k], batch_positions[k]);
+      EXPECT_EQ(velocities[total * n + k], batch_velocities[k]);
+    }
+    total += batch;
+  }
+  EXPECT_EQ(count, total);
+}
+
+TEST_F(TrajectoryProcessingTest, IterativeParabolicMatchesReference)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 40);
+  trajectory_processing::IterativeParabolicTimeParameterization iptp;
+  ASSERT_TRUE(iptp.computeTimeStamps(trajectory));
+  ASSERT_EQ(40u, trajectory.getWayPointCount());
+
+  std::vector<std::vector<double> > q(trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < q.size() ; ++i)
+    q[i] = getValues(trajectory, i);
+  const std::vector<double> time_diff = referenceTimeDiffs(q, trajectory.getGroup()->getVariableLimits());
+
+  EXPECT_EQ(0.0, trajectory.getWayPointDurationFromPrevious(0));
+  for (std::size_t i = 1 ; i < q.size() ; ++i)
+    EXPECT_NEAR(time_diff[i - 1], trajectory.getWayPointDurationFromPrevious(i), 1e-9);
+
+  // the velocities of the waypoints between the ends are the averages of the velocities of their segments
+  for (std::size_t i = 1 ; i + 1 < q.size() ; ++i)
+  {
+    std::vector<double> velocities = getVelocities(trajectory, i);
+    ASSERT_EQ(q[i].size(), velocities.size());
+    for (std::size_t j = 0 ; j < q[i].size() ; ++j)
+      EXPECT_NEAR(((q[i][j] - q[i - 1][j]) / time_diff[i - 1] + (q[i + 1][j] - q[i][j]) / time_diff[i]) / 2.0, velocities[j], 1e-9);
+  }
+}
+
+TEST_F(TrajectoryProcessingTest, IterativeParabolicRespectsLimits)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 40);
+  trajectory_processing::IterativeParabolicTimeParameterization iptp;
+  ASSERT_TRUE(iptp.computeTimeStamps(trajectory));
+
+  const std::vector<double> v_max = getVelocityLimits(trajectory);
+  const std::vector<moveit_msgs::JointLimits> limits = trajectory.getGroup()->getVariableLimits();
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    std::vector<double> accelerations = getAccelerations(trajectory, i);
+    ASSERT_EQ(v_max.size(), accelerations.size());
+    for (std::size_t j = 0 ; j < v_max.size() ; ++j)
+    {
+      double a_max = limits[j].has_acceleration_limits ? limits[j].max_acceleration : 1.0;
+      EXPECT_LE(std::abs(accelerations[j]), a_max + 0.01 + 1e-9);
+    }
+    if (i == 0)
+      continue;
+    std::vector<double> previous = getValues(trajectory, i - 1);
+    std::vector<double> current = getValues(trajectory, i);
+    double dt = trajectory.getWayPointDurationFromPrevious(i);
+    ASSERT_GT(dt, 0.0);
+    for (std::size_t j = 0 ; j < v_max.size() ; ++j)
+      EXPECT_LE(std::abs(current[j] - previous[j]) / dt, v_max[j] * (1.0 + 1e-9));
+  }
+}
+
+TEST_F(TrajectoryProcessingTest, IterativeParabolicSuffix)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makePath(trajectory, 0, 20);
+  trajectory_processing::IterativeParabolicTimeParameterization iptp;
+  ASSERT_TRUE(iptp.computeTimeStamps(trajectory));
+  std::vector<double> durations;
+  std::vector<std::vector<double> > velocities, accelerations;
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    durations.push_back(trajectory.getWayPointDurationFromPrevious(i));
+    velocities.push_back(getVelocities(trajectory, i));
+    accelerations.push_back(getAccelerations(trajectory, i));
+  }
+
+  // re-time the appended waypoints and the two before them; the waypoint before those is where the new part starts
+  makePath(trajectory, 20, 30);
+  ASSERT_TRUE(iptp.computeTimeStamps(trajectory, 20, 2));
+  ASSERT_EQ(30u, trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < 18 ; ++i)
+  {
+    EXPECT_EQ(durations[i], trajectory.getWayPointDurationFromPrevious(i));
+    EXPECT_TRUE(velocities[i] == getVelocities(trajectory, i));
+    EXPECT_TRUE(accelerations[i] == getAccelerations(trajectory, i));
+  }
+
+  const std::vector<double> v_max = getVelocityLimits(trajectory);
+  for (std::size_t i = 18 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    std::vector<double> previous = getValues(trajectory, i - 1);
+    std::vector<double> current = getValues(trajectory, i);
+    double dt = trajectory.getWayPointDurationFromPrevious(i);
+    ASSERT_GT(dt, 0.0);
+    for (std::size_t j = 0 ; j < v_max.size() ; ++j)
+      EXPECT_LE(std::abs(current[j] - previous[j]) / dt, v_max[j] * (1.0 + 1e-9));
+    EXPECT_EQ(v_max.size(), getVelocities(trajectory, i).size());
+  }
+
+  // the last waypoint is at rest, as in a trajectory timed at once
+  std::vector<double> last = getVelocities(trajectory, 29);
+  for (std::size_t j = 0 ; j < last.size() ; ++j)
+    EXPECT_NEAR(0.0, last[j], 1e-12);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -42,6 +42,7 @@
 #include <Eigen/Geometry>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <moveit/macros/class_forward.h>
 
 namespace robot_state
@@ -52,10 +53,15 @@ MOVEIT_CLASS_FORWARD(Transforms);
 /// @brief Map frame names to the transformation matrix that can transform objects from the frame name to the planning frame
 typedef std::map<std::string, Eigen::Affine3d, std::less<std::string>,
                  Eigen::aligned_allocator<std::pair<const std::string, Eigen::Affine3d> > > FixedTransformsMap;
+typedef boost::shared_ptr<const FixedTransformsMap> FixedTransformsMapConstPtr;
 
 /** @brief Provides an implementation of a snapshot of a transform tree that can be easily queried for
     transforming different quantities. Transforms are maintained as a list of transforms to a particular frame.
-    All stored transforms are considered fixed. */
+    All stored transforms are considered fixed.
+
+    The transforms are kept in an immutable map that is replaced as a whole when transforms are set, so one thread can
+    update the transforms while others look them up, without locks on the lookups. Transforms are returned by value; a
+    reader that needs several transforms from the same update should query the map of getTransformsSnapshot(). */
 class Transforms : private boost::noncopyable
 {
 public:
@@ -84,10 +90,15 @@ public:
   /**@{*/
 
   /**
-   * @brief Return all the transforms
+   * @brief Return a copy of all the transforms (getTransformsSnapshot() shares them instead)
    * @return A map from string names of frames to corresponding Eigen::Affine3d (w.r.t the planning frame)
    */
-  const FixedTransformsMap& getAllTransforms() const;
+  FixedTransformsMap getAllTransforms() const;
+
+  /**
+   * @brief Get the current map of transforms. The map does not change; updates to the transforms publish a new map.
+   */
+  FixedTransformsMapConstPtr getTransformsSnapshot() const;
 
   /**
    * @brief Get a vector of all the transforms as ROS messages
@@ -119,6 +130,11 @@ public:
    */
   void setAllTransforms(const FixedTransformsMap &transforms);
 
+  /**
+   * @brief Set all the transforms to the map \e transforms, which is shared rather than copied (e.g. the snapshot of another instance)
+   */
+  void setTransformsSnapshot(const FixedTransformsMapConstPtr &transforms);
+
   /**@}*/
 
   /**
@@ -186,12 +202,28 @@ public:
    * @param from_frame The string id of the frame for which the transform is being computed
    * @return The required transform
    */
-  virtual const Eigen::Affine3d& getTransform(const std::string &from_frame) const;
+  virtual Eigen::Affine3d getTransform(const std::string &from_frame) const;
 
 protected:
 
+  /** @brief Publish \e transforms as the current map */
+  void publishTransforms(const FixedTransformsMapConstPtr &transforms);
+
   std::string        target_frame_;
-  FixedTransformsMap transforms_;
+
+private:
+
+  /** @brief Set the transform in \e transforms, normalizing the frame name */
+  void recordTransform(FixedTransformsMap &transforms, const Eigen::Affine3d &t, const std::string &from_frame) const;
+
+  /** @brief Set the transform of a message in \e transforms */
+  void recordTransform(FixedTransformsMap &transforms, const geometry_msgs::TransformStamped &transform) const;
+
+  /// The current map of transforms; only accessed atomically
+  FixedTransformsMapConstPtr transforms_;
+
+  /// Serializes the updates to the transforms
+  boost::mutex               update_lock_;
 
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -51,8 +51,11 @@ robot_state::Transforms::Transforms(const std::string &target_frame) : target_fr
       logWarn("Frame '%s' specified as target frame for MoveIt Transforms. Assuming '/%s' instead.", target_frame_.c_str(), target_frame_.c_str());
       target_frame_ = '/' + target_frame_;
     }
-    transforms_[target_frame_] = Eigen::Affine3d::Identity();
   }
+  boost::shared_ptr<FixedTransformsMap> transforms(new FixedTransformsMap());
+  if (!target_frame_.empty())
+    (*transforms)[target_frame_] = Eigen::Affine3d::Identity();
+  transforms_ = transforms;
 }
 
 bool robot_state::Transforms::sameFrame(const std::string &frame1, const std::string &frame2)
@@ -75,49 +78,69 @@ const std::string& robot_state::Transforms::getTargetFrame() const
   return target_frame_;
 }
 
-const robot_state::FixedTransformsMap& robot_state::Transforms::getAllTransforms() const
+robot_state::FixedTransformsMap robot_state::Transforms::getAllTransforms() const
+{
+  return *boost::atomic_load(&transforms_);
+}
+
+robot_state::FixedTransformsMapConstPtr robot_state::Transforms::getTransformsSnapshot() const
+{
+  return boost::atomic_load(&transforms_);
+}
+
+void robot_state::Transforms::publishTransforms(const FixedTransformsMapConstPtr &transforms)
 {
-  return transforms_;
+  // the caller holds update_lock_
+  boost::atomic_store(&transforms_, transforms);
 }
 
 void robot_state::Transforms::setAllTransforms(const FixedTransformsMap &transforms)
 {
-  transforms_ = transforms;
+  boost::mutex::scoped_lock slock(update_lock_);
+  publishTransforms(FixedTransformsMapConstPtr(new FixedTransformsMap(transforms)));
+}
+
+void robot_state::Transforms::setTransformsSnapshot(const FixedTransformsMapConstPtr &transforms)
+{
+  if (!transforms)
+    return;
+  boost::mutex::scoped_lock slock(update_lock_);
+  publishTransforms(transforms);
 }
 
 bool robot_state::Transforms::isFixedFrame(const std::string &frame) const
 {
   if (frame.empty())
     return false;
-  else
-    return (frame[0] == '/' ? transforms_.find(frame) : transforms_.find('/' + frame)) != transforms_.end();
+  FixedTransformsMapConstPtr transforms = boost::atomic_load(&transforms_);
+  return (frame[0] == '/' ? transforms->find(frame) : transforms->find('/' + frame)) != transforms->end();
 }
 
-const Eigen::Affine3d& robot_state::Transforms::getTransform(const std::string &from_frame) const
+Eigen::Affine3d robot_state::Transforms::getTransform(const std::string &from_frame) const
 {
   if (!from_frame.empty())
   {
-    FixedTransformsMap::const_iterator it = (from_frame[0] == '/' ? transforms_.find(from_frame) : transforms_.find('/' + from_frame));
-    if (it != transforms_.end())
+    FixedTransformsMapConstPtr transforms = boost::atomic_load(&transforms_);
+    FixedTransformsMap::const_iterator it = (from_frame[0] == '/' ? transforms->find(from_frame) : transforms->find('/' + from_frame));
+    if (it != transforms->end())
       return it->second;
   }
 
   logError("Unable to transform from frame '%s' to frame '%s'. Returning identity.", from_frame.c_str(), target_frame_.c_str());
 
   // return identity
-  static const Eigen::Affine3d identity = Eigen::Affine3d::Identity();
-  return identity;
+  return Eigen::Affine3d::Identity();
 }
 
 bool robot_state::Transforms::canTransform(const std::string &from_frame) const
 {
   if (from_frame.empty())
     return false;
-  else
-    return (from_frame[0] == '/' ? transforms_.find(from_frame) : transforms_.find('/' + from_frame)) != transforms_.end();
+  FixedTransformsMapConstPtr transforms = boost::atomic_load(&transforms_);
+  return (from_frame[0] == '/' ? transforms->find(from_frame) : transforms->find('/' + from_frame)) != transforms->end();
 }
 
-void robot_state::Transforms::setTransform(const Eigen::Affine3d &t, const std::string &from_frame)
+void robot_state::Transforms::recordTransform(FixedTransformsMap &transforms, const Eigen::Affine3d &t, const std::string &from_frame) const
 {
   if (from_frame.empty())
     logError("Cannot record transform with empty name");
@@ -126,20 +149,20 @@ void robot_state::Transforms::setTransform(const Eigen::Affine3d &t, const std::
     if (from_frame[0] != '/')
     {
       logWarn("Transform specified for frame '%s'. Assuming '/%s' instead", from_frame.c_str(), from_frame.c_str());
-      transforms_['/' + from_frame] = t;
+      transforms['/' + from_frame] = t;
     }
     else
-      transforms_[from_frame] = t;
+      transforms[from_frame] = t;
   }
 }
 
-void robot_state::Transforms::setTransform(const geometry_msgs::TransformStamped &transform)
+void robot_state::Transforms::recordTransform(FixedTransformsMap &transforms, const geometry_msgs::TransformStamped &transform) const
 {
   if (sameFrame(transform.child_frame_id, target_frame_))
   {
     Eigen::Affine3d t;
     tf::transformMsgToEigen(transform.transform, t);
-    setTransform(t, transform.header.frame_id);
+    recordTransform(transforms, t, transform.header.frame_id);
   }
   else
   {
@@ -147,17 +170,38 @@ void robot_state::Transforms::setTransform(const geometry_msgs::TransformStamped
   }
 }
 
+void robot_state::Transforms::setTransform(const Eigen::Affine3d &t, const std::string &from_frame)
+{
+  boost::mutex::scoped_lock slock(update_lock_);
+  boost::shared_ptr<FixedTransformsMap> transforms(new FixedTransformsMap(*transforms_));
+  recordTransform(*transforms, t, from_frame);
+  publishTransforms(transforms);
+}
+
+void robot_state::Transforms::setTransform(const geometry_msgs::TransformStamped &transform)
+{
+  boost::mutex::scoped_lock slock(update_lock_);
+  boost::shared_ptr<FixedTransformsMap> transforms(new FixedTransformsMap(*transforms_));
+  recordTransform(*transforms, transform);
+  publishTransforms(transforms);
+}
+
 void robot_state::Transforms::setTransforms(const std::vector<geometry_msgs::TransformStamped> &transforms)
 {
+  // all the transforms of the message are published together
+  boost::mutex::scoped_lock slock(update_lock_);
+  boost::shared_ptr<FixedTransformsMap> updated(new FixedTransformsMap(*transforms_));
   for (std::size_t i = 0 ; i < transforms.size() ; ++i)
-    setTransform(transforms[i]);
+    recordTransform(*updated, transforms[i]);
+  publishTransforms(updated);
 }
 
 void robot_state::Transforms::copyTransforms(std::vector<geometry_msgs::TransformStamped> &transforms) const
 {
-  transforms.resize(transforms_.size());
+  FixedTransformsMapConstPtr snapshot = boost::atomic_load(&transforms_);
+  transforms.resize(snapshot->size());
   std::size_t i = 0;
-  for (FixedTransformsMap::const_iterator it = transforms_.begin() ; it != transforms_.end() ; ++it, ++i)
+  for (FixedTransformsMap::const_iterator it = snapshot->begin() ; it != snapshot->end() ; ++it, ++i)
   {
     transforms[i].child_frame_id = target_frame_;
     transforms[i].header.frame_id = it->first;
@@ -63,6 +63,37 @@ TEST(Transforms, Simple)
 }
 
 
+TEST(Transforms, Snapshots)
+{
+  robot_state::Transforms tf("global");
+  Eigen::Affine3d t1(Eigen::Translation3d(1.0, 0.0, 0.0));
+  tf.setTransform(t1, "frame_1");
+
+  // a snapshot does not see later updates
+  robot_state::FixedTransformsMapConstPtr snapshot = tf.getTransformsSnapshot();
+  Eigen::Affine3d t2(Eigen::Translation3d(2.0, 0.0, 0.0));
+  tf.setTransform(t2, "frame_1");
+  tf.setTransform(t2, "frame_2");
+  EXPECT_EQ(2u, snapshot->size());
+  EXPECT_DOUBLE_EQ(1.0, snapshot->find("/frame_1")->second.translation().x());
+  EXPECT_DOUBLE_EQ(2.0, tf.getTransform("frame_1").translation().x());
+  EXPECT_TRUE(tf.canTransform("frame_2"));
+
+  // transforms are returned by value, so they outlive any number of updates
+  Eigen::Affine3d before = tf.getTransform("frame_2");
+  tf.setTransform(t1, "frame_2");
+  tf.setTransform(t1, "frame_1");
+  tf.setAllTransforms(robot_state::FixedTransformsMap());
+  EXPECT_DOUBLE_EQ(2.0, before.translation().x());
+  EXPECT_FALSE(tf.canTransform("frame_2"));
+
+  // snapshots can be shared between instances
+  robot_state::Transforms other("global");
+  other.setTransformsSnapshot(tf.getTransformsSnapshot());
+  EXPECT_EQ(tf.getTransformsSnapshot(), other.getTransformsSnapshot());
+  EXPECT_TRUE(other.isFixedFrame("frame_2"));
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);